@@ -0,0 +1,430 @@
+#!/bin/bash
+
+##########################################################################
+#
+# This file is part of FORCE - Framework for Operational Radiometric
+# Correction for Environmental monitoring.
+#
+# Copyright (C) 2013-2020 David Frantz
+#
+# FORCE is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# FORCE is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+#
+##########################################################################
+
+# functions/definitions ------------------------------------------------------------------
+export PROG=`basename $0`;
+export BIN="$( cd "$( dirname "${BASH_SOURCE[0]}" )" >/dev/null 2>&1 && pwd )"
+
+MANDATORY_ARGS=1
+
+export L2PS_EXE="$BIN/force-l2ps"
+export HIGHER_EXE="$BIN/force-higher-level"
+export INFO_EXE="gdalinfo"
+export CALC_EXE="gdal_calc.py"
+
+
+echoerr(){ echo "$PROG: $@" 1>&2; }    # warnings and/or errormessages go to STDERR
+export -f echoerr
+
+export DEBUG=false # display debug messages?
+debug(){ if [ "$DEBUG" == "true" ]; then echo "DEBUG: $@"; fi } # debug message
+export -f debug
+
+cmd_not_found(){      # check required external commands
+  for cmd in "$@"; do
+    stat=`which $cmd`
+    if [ $? != 0 ] ; then echoerr "\"$cmd\": external command not found, terminating..."; exit 1; fi
+  done
+}
+export -f cmd_not_found
+
+
+help(){
+cat <<HELP
+
+Usage: $PROG [-h] [-v] [-i] [-c] [-r reference-run] [-t tolerance] [-u url] benchmark-dir
+
+  -h  = show this help
+  -v  = show version
+  -i  = show program's purpose
+
+  -c  = CPU only, i.e. GPU_DEVICES = -1 is set in all parameter files.
+        A CPU run can be used as reference for a GPU run (-r)
+
+  -r  = directory of a previous run, which is used as reference.
+        The outputs of this run are compared against the reference,
+        and the program fails if any output deviates beyond tolerance
+
+  -t  = tolerance, i.e. maximum absolute difference of any pixel
+        (default: 0, i.e. outputs need to be identical)
+
+  -u  = URL of a benchmark archive (tar.gz), which is downloaded and
+        extracted to benchmark-dir if it does not contain a benchmark
+
+  Positional arguments:
+  - 'benchmark-dir': directory of the benchmark:
+     level2/*.prm        Level 2 parameter files; each file is run for
+                         the Level 1 images listed in level2/*.txt with
+                         the same basename (one image per line)
+     higher-level/*.prm  higher level parameter files
+     @BENCH@ in parameter files and image lists is replaced with the
+     benchmark-dir, such that the benchmark can be moved. All outputs
+     are written to benchmark-dir/run-YYYYMMDDHHMMSS
+
+HELP
+exit 1
+}
+export -f help
+
+# important, check required commands !!! dies on missing
+cmd_not_found "$L2PS_EXE $HIGHER_EXE $INFO_EXE $CALC_EXE"
+
+
+# set a parameter in a parameter file, append if not present
+function set_param(){
+
+  prm=$1
+  key=$2
+  val=$3
+
+  if grep -q "^$key " "$prm"; then
+    sed -i "s|^$key .*|$key = $val|" "$prm"
+  else
+    sed -i "\$i $key = $val" "$prm"
+  fi
+
+}
+export -f set_param
+
+
+# copy a parameter file into the run, and resolve benchmark paths
+function stage_param(){
+
+  src=$1
+  dst=$2
+
+  sed "s|@BENCH@|$DINP|g" "$src" > "$dst"
+
+}
+export -f stage_param
+
+
+# compute the checksums of all output rasters
+function checksum_outputs(){
+
+  dout=$1
+  fsum=$2
+
+  if [ ! -d "$dout" ]; then > "$fsum"; return; fi
+
+  cd "$dout"
+
+  find . -type f \( -name '*.tif' -o -name '*.dat' \) | sort | while read f; do
+    $INFO_EXE -checksum "$f" | grep 'Checksum=' | cut -d '=' -f 2 | \
+      awk -v f="$f" '{ printf("%s %d %s\n", f, NR, $1) }'
+  done > "$fsum"
+
+  cd - > /dev/null
+
+}
+export -f checksum_outputs
+
+
+# maximum absolute difference between two rasters
+function max_difference(){
+
+  a=$1
+  b=$2
+  tmp=$3
+
+  $CALC_EXE --quiet --overwrite -A "$a" -B "$b" --allBands=A --type=Float64 \
+    --calc="abs(A.astype(float)-B)" --outfile="$tmp" > /dev/null 2>&1 || { echo "NA"; return; }
+
+  $INFO_EXE -stats --config GDAL_PAM_ENABLED NO "$tmp" | grep 'STATISTICS_MAXIMUM=' | \
+    cut -d '=' -f 2 | sort -g | tail -1
+
+  rm -f "$tmp"
+
+}
+export -f max_difference
+
+
+# throughput of higher level stages from the telemetry
+function throughput_higher(){
+
+  name=$1
+  dout=$2
+  ftel=$3
+  res=$4
+
+  if [ ! -r "$ftel" ] || [ ! -r "$dout/datacube-definition.prj" ]; then
+    echoerr "no telemetry for $name"; return
+  fi
+
+  # pixels per processing unit
+  tilesize=$(sed -n 6p "$dout/datacube-definition.prj")
+  blocksize=$(sed -n 7p "$dout/datacube-definition.prj")
+  npix=$(echo "$tilesize $blocksize $res" | awk '{ printf("%.0f", int($1/$3)*int($2/$3)) }')
+
+  awk -v name="$name" -v npix=$npix '
+    {
+      gsub(/[{}" ]/, "");
+      n = split($0, kv, ",");
+      for (i=1; i<=n; i++){ split(kv[i], a, ":"); v[a[1]] = a[2] }
+      po += v["nt"]*npix;
+      for (s in v) if (s ~ /^secs_/) secs[s] += v[s];
+    }
+    END {
+      for (s in secs){
+        stage = substr(s, 6);
+        printf("%s,%s,%.3f,%.0f,%.0f\n", name, stage, secs[s], po, (secs[s] > 0) ? po/secs[s] : 0);
+      }
+    }' "$ftel" | sort
+
+}
+export -f throughput_higher
+
+
+# throughput of Level 2 stages from the profile
+function throughput_level2(){
+
+  name=$1
+  dout=$2
+  fprf=$3
+
+  if [ ! -r "$fprf" ]; then
+    echoerr "no profile for $name"; return
+  fi
+
+  # pixels of all reflectance products, one observation each
+  npix=$(find "$dout" -type f \( -name '*BOA.tif' -o -name '*BOA.dat' -o -name '*TOA.tif' -o -name '*TOA.dat' \) | \
+    while read f; do $INFO_EXE "$f" | grep '^Size is' ; done | \
+    awk '{ gsub(",", ""); n += $3*$4 } END { printf("%.0f", n) }')
+
+  awk -F ',' -v name="$name" -v npix=$npix '
+    NR > 1 { secs[$2] += $4 }
+    END {
+      for (s in secs){
+        printf("%s,%s,%.3f,%.0f,%.0f\n", name, s, secs[s], npix, (secs[s] > 0) ? npix/secs[s] : 0);
+      }
+    }' "$fprf" | sort
+
+}
+export -f throughput_level2
+
+
+# now get the options --------------------------------------------------------------------
+ARGS=`getopt -o hvicr:t:u: -n "$0" -- "$@"`
+if [ $? != 0 ] ; then help; fi
+eval set -- "$ARGS"
+
+# default options
+CPU_ONLY=false
+REFERENCE=""
+TOLERANCE=0
+URL=""
+
+while :; do
+  case "$1" in
+    -h) help ;;
+    -v) echo "this should print the version. todo"; exit 0 ;;
+    -i) echo "End-to-end benchmark and output regression check"; exit 0 ;;
+    -c) CPU_ONLY=true ;;
+    -r) REFERENCE=$(readlink -f "$2"); shift ;;
+    -t) TOLERANCE="$2"; shift ;;
+    -u) URL="$2"; shift ;;
+    -- ) shift; break ;;
+    * ) break ;;
+  esac
+  shift
+done
+
+if [ $# -ne $MANDATORY_ARGS ] ; then
+  echoerr "Mandatory argument is missing."; help
+else
+  export DINP=$(readlink -f $1) # absolute file path
+fi
+
+# options received, check now ------------------------------------------------------------
+debug "CPU only: $CPU_ONLY"
+debug "reference: $REFERENCE"
+debug "tolerance: $TOLERANCE"
+debug "url: $URL"
+
+if ! [[ "$TOLERANCE" =~ ^[0-9]+([.][0-9]+)?$ ]]; then
+  echoerr "tolerance must be a non-negative number, exiting."; exit 1;
+fi
+
+if [ -n "$REFERENCE" ] && [ ! -d "$REFERENCE" ]; then
+  echoerr "$REFERENCE is not a directory, exiting."; exit 1;
+fi
+
+# further checks and preparations --------------------------------------------------------
+if [ ! -d "$DINP/level2" ] && [ ! -d "$DINP/higher-level" ]; then
+
+  if [ -z "$URL" ]; then
+    echoerr "$DINP does not contain a benchmark, exiting."; exit 1;
+  fi
+
+  cmd_not_found "curl tar"
+
+  echo "downloading benchmark from $URL"
+  mkdir -p "$DINP"
+  curl -sfL "$URL" | tar -xz -C "$DINP"
+  if [ $? != 0 ]; then
+    echoerr "downloading benchmark failed, exiting."; exit 1;
+  fi
+
+fi
+
+if ! [[ -d "$DINP" && -w "$DINP" ]]; then
+  echoerr "$DINP is not a writeable directory, exiting."; exit 1;
+fi
+
+
+# main thing -----------------------------------------------------------------------------
+
+RUN="$DINP/run-$(date +"%Y%m%d%H%M%S")"
+mkdir -p "$RUN"
+
+if [ ! -d "$RUN" ]; then
+  echoerr "creating run directory failed."; exit 1;
+fi
+
+FTHR="$RUN/throughput.csv"
+echo "benchmark,stage,seconds,pixel_observations,throughput" > "$FTHR"
+
+FAILED=0
+
+
+# Level 2 benchmarks
+for PRM in $(ls "$DINP"/level2/*.prm 2> /dev/null); do
+
+  NAME="l2-$(basename ${PRM%.prm})"
+  LIST="${PRM%.prm}.txt"
+  DOUT="$RUN/$NAME"
+
+  echo "running $NAME"
+
+  if [ ! -r "$LIST" ]; then
+    echoerr "no image list for $PRM"; FAILED=1; continue
+  fi
+
+  mkdir -p "$DOUT/level2" "$DOUT/log" "$DOUT/temp"
+
+  stage_param "$PRM" "$DOUT/$NAME.prm"
+  set_param "$DOUT/$NAME.prm" DIR_LEVEL2 "$DOUT/level2"
+  set_param "$DOUT/$NAME.prm" DIR_LOG "$DOUT/log"
+  set_param "$DOUT/$NAME.prm" DIR_TEMP "$DOUT/temp"
+  set_param "$DOUT/$NAME.prm" OUTPUT_PROFILE "TRUE"
+  if [ "$CPU_ONLY" == "true" ]; then set_param "$DOUT/$NAME.prm" GPU_DEVICES "-1"; fi
+
+  for IMG in $(sed "s|@BENCH@|$DINP|g" "$LIST"); do
+    $L2PS_EXE "$IMG" "$DOUT/$NAME.prm" >> "$DOUT/log/$NAME.log" 2>&1
+    if [ $? != 0 ]; then
+      echoerr "$NAME failed for $IMG"; FAILED=1
+    fi
+  done
+
+  throughput_level2 "$NAME" "$DOUT/level2" "$DOUT/log/force-l2ps_profile.csv" >> "$FTHR"
+
+  checksum_outputs "$DOUT/level2" "$DOUT/checksums.txt"
+
+done
+
+
+# higher level benchmarks
+for PRM in $(ls "$DINP"/higher-level/*.prm 2> /dev/null); do
+
+  NAME="hl-$(basename ${PRM%.prm})"
+  DOUT="$RUN/$NAME"
+
+  echo "running $NAME"
+
+  mkdir -p "$DOUT/higher-level"
+
+  stage_param "$PRM" "$DOUT/$NAME.prm"
+  set_param "$DOUT/$NAME.prm" DIR_HIGHER "$DOUT/higher-level"
+  set_param "$DOUT/$NAME.prm" FILE_TELEMETRY "$DOUT/telemetry.json"
+  set_param "$DOUT/$NAME.prm" FILE_JOURNAL "NULL"
+  if [ "$CPU_ONLY" == "true" ]; then set_param "$DOUT/$NAME.prm" GPU_DEVICES "-1"; fi
+
+  $HIGHER_EXE "$DOUT/$NAME.prm" > "$DOUT/$NAME.log" 2>&1
+  if [ $? != 0 ]; then
+    echoerr "$NAME failed"; FAILED=1
+  fi
+
+  RES=$(grep '^RESOLUTION ' "$DOUT/$NAME.prm" | cut -d '=' -f 2 | tr -d ' ')
+
+  throughput_higher "$NAME" "$DOUT/higher-level" "$DOUT/telemetry.json" "$RES" >> "$FTHR"
+
+  checksum_outputs "$DOUT/higher-level" "$DOUT/checksums.txt"
+
+done
+
+
+column -s ',' -t "$FTHR"
+echo ""
+
+
+# regression check against reference run
+if [ -n "$REFERENCE" ]; then
+
+  FREG="$RUN/regression.txt"
+  > "$FREG"
+
+  for FSUM in $(ls "$REFERENCE"/*/checksums.txt 2> /dev/null); do
+
+    NAME=$(basename $(dirname "$FSUM"))
+    DREF="$REFERENCE/$NAME"
+    DOUT="$RUN/$NAME"
+
+    if [ -d "$DREF/level2" ]; then SUB="level2"; else SUB="higher-level"; fi
+
+    if [ ! -r "$DOUT/checksums.txt" ]; then
+      echo "$NAME - MISSING" >> "$FREG"; FAILED=1; continue
+    fi
+
+    # compare the files that differ in any band
+    for F in $(diff "$FSUM" "$DOUT/checksums.txt" | grep '^[<>]' | cut -d ' ' -f 2 | sort -u); do
+
+      if [ ! -r "$DREF/$SUB/$F" ] || [ ! -r "$DOUT/$SUB/$F" ]; then
+        echo "$NAME $F MISSING" >> "$FREG"; FAILED=1; continue
+      fi
+
+      DIFF=$(max_difference "$DREF/$SUB/$F" "$DOUT/$SUB/$F" "$DOUT/diff.tif")
+
+      if [ "$DIFF" == "NA" ] || [ -z "$DIFF" ] || awk -v d="$DIFF" -v t="$TOLERANCE" 'BEGIN { exit !(d > t) }'; then
+        echo "$NAME $F FAIL $DIFF" >> "$FREG"; FAILED=1
+      else
+        echo "$NAME $F PASS $DIFF" >> "$FREG"
+      fi
+
+    done
+
+  done
+
+  if [ -s "$FREG" ]; then
+    cat "$FREG"
+  else
+    echo "all outputs are identical to the reference."
+  fi
+  echo ""
+
+fi
+
+
+echo "results are in $RUN"
+
+exit $FAILED
@@ -200,6 +200,14 @@ if [ $? -ne 0 ]; then
 fi
 
 
+# if all images are extracted already, process the queue in one
+# long-lived force-l2ps process (parameters etc. are only read once)
+if [ $(echo $QUEUE | tr ' ' '\n' | grep -c -E '\.(zip|tar|tar\.gz)$') -eq 0 ]; then
+  $BINDIR/force-l2ps -b $PRM
+  exit $?
+fi
+
+
 CPUFILE=$TEMPDIR"/cpu-"$TIME
 echo $CPU > $CPUFILE
 
@@ -0,0 +1,571 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This program creates a VRT mosaic for each product in a datacube. The 
+VRTs are written directly from the datacube geometry; only one file per
+product is opened to retrieve the band properties. The products are 
+processed in parallel.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include <ctype.h>   // testing and mapping characters
+#include <unistd.h>  // standard symbolic constants and types 
+#include <dirent.h>  // allows the opening and listing of directories
+
+#include <omp.h>     // multi-platform shared memory multiprocessing
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/konami-cl.h"
+#include "../cross-level/string-cl.h"
+#include "../cross-level/alloc-cl.h"
+#include "../cross-level/dir-cl.h"
+#include "../cross-level/cube-cl.h"
+#include "../cross-level/tile-cl.h"
+
+
+/** Geospatial Data Abstraction Library (GDAL) **/
+#include "gdal.h"       // public (C callable) GDAL entry points
+#include "cpl_conv.h"   // various convenience functions for CPL
+#include "cpl_string.h" // various convenience functions for strings
+
+
+typedef struct {
+  int n;
+  int nthread;
+  char dcube[NPOW_10];
+  char dmosaic[NPOW_10];
+  char dout[NPOW_10];
+  char ftile[NPOW_10];
+} args_t;
+
+// file of a product in a tile
+typedef struct {
+  char *name; // file name
+  int tile;   // index of tile
+} chip_t;
+
+
+void usage(char *exe, int exit_code){
+
+
+  printf("Usage: %s [-h] [-v] [-i] [-j] [-m] [-t] datacube-dir\n", exe);
+  printf("\n");
+  printf("  -h  = show this help\n");
+  printf("  -v  = show version\n");
+  printf("  -i  = show program's purpose\n");
+  printf("\n");
+  printf("  -j  = number of parallel threads (default: all)\n");
+  printf("\n");
+  printf("  -m  = mosaic directory (default: mosaic)\n");
+  printf("        This should be a directory relative to the tiles\n");
+  printf("\n");
+  printf("  -t  = tile allow-list (default: all tiles)\n");
+  printf("\n");
+  printf("  Positional arguments:\n");
+  printf("  - 'datacube-dir': directory of existing datacube\n");
+  printf("\n");
+
+  exit(exit_code);
+  return;
+}
+
+
+void parse_args(int argc, char *argv[], args_t *args){
+int opt;
+
+
+  opterr = 0;
+
+  // default parameters
+  args->nthread = 0;
+  copy_string(args->dmosaic, NPOW_10, "mosaic");
+  copy_string(args->ftile,   NPOW_10, "NULL");
+
+  // optional parameters
+  while ((opt = getopt(argc, argv, "hvij:m:t:")) != -1){
+    switch(opt){
+      case 'h':
+        usage(argv[0], SUCCESS);
+      case 'v':
+        printf("FORCE version: %s\n", _VERSION_);
+        exit(SUCCESS);
+      case 'i':
+        printf("Mosaicking of image chips\n");
+        exit(SUCCESS);
+      case 'j':
+        args->nthread = atoi(optarg);
+        if (args->nthread < 0){
+          fprintf(stderr, "Number of threads must be >= 0.\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'm':
+        copy_string(args->dmosaic, NPOW_10, optarg);
+        break;
+      case 't':
+        copy_string(args->ftile, NPOW_10, optarg);
+        break;
+      case '?':
+        if (isprint(optopt)){
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        } else {
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        }
+        usage(argv[0], FAILURE);
+      default:
+        fprintf(stderr, "Error parsing arguments.\n");
+        usage(argv[0], FAILURE);
+    }
+  }
+
+  // non-optional parameters
+  args->n = 1;
+
+  if (optind < argc){
+    konami_args(argv[optind]);
+    if (argc-optind == args->n){
+      copy_string(args->dcube, NPOW_10, argv[optind++]);
+    } else if (argc-optind < args->n){
+      fprintf(stderr, "some non-optional arguments are missing.\n");
+      usage(argv[0], FAILURE);
+    } else if (argc-optind > args->n){
+      fprintf(stderr, "too many non-optional arguments.\n");
+      usage(argv[0], FAILURE);
+    }
+  } else {
+    fprintf(stderr, "non-optional arguments are missing.\n");
+    usage(argv[0], FAILURE);
+  }
+
+  return;
+}
+
+
+/** This function filters tile directories (X0000_Y0000)
+--- entry:  directory entry
++++ Return: 1 if tile directory, 0 if not
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int is_tile(const struct dirent *entry){
+int tx, ty;
+char c;
+
+  if (strlen(entry->d_name) != 11) return 0;
+  if (sscanf(entry->d_name, "X%4d_Y%4d%c", &tx, &ty, &c) != 2) return 0;
+
+  return 1;
+}
+
+
+/** This function filters image chips (*.dat, *.tif)
+--- entry:  directory entry
++++ Return: 1 if image chip, 0 if not
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int is_chip(const struct dirent *entry){
+size_t n = strlen(entry->d_name);
+
+  if (n < 5) return 0;
+  if (strcmp(entry->d_name+n-4, ".dat") != 0 &&
+      strcmp(entry->d_name+n-4, ".tif") != 0) return 0;
+
+  return 1;
+}
+
+
+/** This function compares two image chips by product name, then by tile
+--- a:      chip 1
+--- b:      chip 2
++++ Return: ordering
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int compare_chip(const void *a, const void *b){
+const chip_t *x = (const chip_t*)a;
+const chip_t *y = (const chip_t*)b;
+int cmp;
+
+  if ((cmp = strcmp(x->name, y->name)) != 0) return cmp;
+
+  return x->tile - y->tile;
+}
+
+
+/** This function finds the active tiles. These are all tile directories
++++ in the datacube, or the tiles of the allow-list
+--- args:   arguments
+--- cube:   datacube (tile list is modified)
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int find_tiles(args_t *args, cube_t *cube){
+struct dirent **entry = NULL;
+int n, i, tx, ty;
+int minx = INT_MAX, maxx = INT_MIN, miny = INT_MAX, maxy = INT_MIN;
+
+
+  if ((n = scandir(args->dcube, &entry, is_tile, alphasort)) < 0){
+    printf("unable to list %s. ", args->dcube); return FAILURE;}
+
+  if (n == 0){
+    free((void*)entry);
+    printf("no tile found in %s. ", args->dcube); return FAILURE;
+  }
+
+  free((void*)cube->tx); cube->tx = NULL;
+  free((void*)cube->ty); cube->ty = NULL;
+  alloc((void**)&cube->tx, n, sizeof(int));
+  alloc((void**)&cube->ty, n, sizeof(int));
+
+  for (i=0; i<n; i++){
+    sscanf(entry[i]->d_name, "X%4d_Y%4d", &tx, &ty);
+    cube->tx[i] = tx;
+    cube->ty[i] = ty;
+    if (tx < minx) minx = tx;
+    if (tx > maxx) maxx = tx;
+    if (ty < miny) miny = ty;
+    if (ty > maxy) maxy = ty;
+    free((void*)entry[i]);
+  }
+  free((void*)entry);
+
+  cube->tn = n;
+  update_datacube_extent(cube, minx, maxx, miny, maxy);
+
+  // replace with allow-listed tiles
+  if (strcmp(args->ftile, "NULL") != 0){
+    free((void*)cube->tx); cube->tx = NULL;
+    free((void*)cube->ty); cube->ty = NULL;
+    if (tile_active(args->ftile, cube) == FAILURE) return FAILURE;
+  }
+
+  return SUCCESS;
+}
+
+
+/** This function lists the image chips of all active tiles. The tile 
++++ directories are listed in parallel.
+--- dcube:  datacube directory
+--- cube:   datacube
+--- nchip:  number of chips (returned)
++++ Return: image chips, sorted by product and tile
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+chip_t *find_chips(char *dcube, cube_t *cube, int *nchip){
+struct dirent ***entry = NULL;
+int *n = NULL;
+int t, i, k = 0;
+char dname[NPOW_10];
+int nchar;
+chip_t *chip = NULL;
+
+
+  alloc((void**)&entry, cube->tn, sizeof(struct dirent**));
+  alloc((void**)&n, cube->tn, sizeof(int));
+
+  #pragma omp parallel for private(dname, nchar) shared(dcube, cube, entry, n) schedule(dynamic) default(none)
+  for (t=0; t<cube->tn; t++){
+
+    nchar = snprintf(dname, NPOW_10, "%s/X%04d_Y%04d", dcube, cube->tx[t], cube->ty[t]);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling dirname\n"); n[t] = 0; continue;}
+
+    // missing tiles of the allow-list are skipped
+    if ((n[t] = scandir(dname, &entry[t], is_chip, alphasort)) < 0) n[t] = 0;
+
+  }
+
+  for (t=0; t<cube->tn; t++) k += n[t];
+
+  if (k > 0) alloc((void**)&chip, k, sizeof(chip_t));
+
+  for (t=0, k=0; t<cube->tn; t++){
+    for (i=0; i<n[t]; i++, k++){
+      chip[k].name = strdup(entry[t][i]->d_name);
+      chip[k].tile = t;
+      free((void*)entry[t][i]);
+    }
+    if (entry[t] != NULL) free((void*)entry[t]);
+  }
+
+  free((void*)entry);
+  free((void*)n);
+
+  if (k > 0) qsort(chip, k, sizeof(chip_t), compare_chip);
+
+  *nchip = k;
+  return chip;
+}
+
+
+/** This function writes a metadata domain into a VRT
+--- fp:     VRT file
+--- meta:   metadata (key=value list)
+--- indent: indentation
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void write_vrt_metadata(FILE *fp, char **meta, const char *indent){
+int i;
+char *key = NULL, *value = NULL;
+const char *raw = NULL;
+
+
+  if (CSLCount(meta) == 0) return;
+
+  fprintf(fp, "%s<Metadata domain=\"FORCE\">\n", indent);
+
+  for (i=0; meta[i] != NULL; i++){
+    if ((raw = CPLParseNameValue(meta[i], &key)) == NULL || key == NULL) continue;
+    value = CPLEscapeString(raw, -1, CPLES_XML);
+    fprintf(fp, "%s  <MDI key=\"%s\">%s</MDI>\n", indent, key, value);
+    CPLFree(value);
+    CPLFree(key); key = NULL;
+  }
+
+  fprintf(fp, "%s</Metadata>\n", indent);
+
+  return;
+}
+
+
+/** This function writes the VRT mosaic of one product. Only the first 
++++ chip is opened to retrieve the properties of the product; all other
++++ chips are placed by their tile ID and the datacube geometry.
+--- args:   arguments
+--- cube:   datacube
+--- chip:   chips of the product
+--- n:      number of chips
+--- prefix: relative path from the mosaic to the datacube directory
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_mosaic(args_t *args, cube_t *cube, chip_t *chip, int n, const char *prefix){
+char fname[NPOW_10];
+char oname[NPOW_10];
+char *value = NULL;
+int nchar, i, b, nb, nx, ny, bx, by, step;
+int minx = INT_MAX, maxx = INT_MIN, miny = INT_MAX, maxy = INT_MIN;
+int tx, ty;
+double geotran[6], res, nodata;
+int has_nodata;
+const char *type = NULL;
+GDALDatasetH dataset;
+GDALRasterBandH band;
+FILE *fp = NULL;
+
+
+  // properties of the product from the first chip
+  nchar = snprintf(fname, NPOW_10, "%s/X%04d_Y%04d/%s", args->dcube,
+    cube->tx[chip[0].tile], cube->ty[chip[0].tile], chip[0].name);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+  if ((dataset = GDALOpenEx(fname, GDAL_OF_READONLY, NULL, NULL, NULL)) == NULL){
+    printf("unable to open %s\n", fname); return FAILURE;}
+
+  nx = GDALGetRasterXSize(dataset);
+  ny = GDALGetRasterYSize(dataset);
+  nb = GDALGetRasterCount(dataset);
+  GDALGetGeoTransform(dataset, geotran);
+  res = geotran[1];
+
+  if (nb < 1 || res <= 0){
+    printf("invalid image %s\n", fname); GDALClose(dataset); return FAILURE;}
+
+  // number of pixels from one tile to the next
+  step = (int)round(cube->tilesize/res);
+
+  for (i=0; i<n; i++){
+    tx = cube->tx[chip[i].tile];
+    ty = cube->ty[chip[i].tile];
+    if (tx < minx) minx = tx;
+    if (tx > maxx) maxx = tx;
+    if (ty < miny) miny = ty;
+    if (ty > maxy) maxy = ty;
+  }
+
+
+  // output name
+  copy_string(oname, NPOW_10, chip[0].name);
+  copy_string(oname+strlen(oname)-4, 5, ".vrt");
+
+  nchar = snprintf(fname, NPOW_10, "%s/%s", args->dout, oname);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); GDALClose(dataset); return FAILURE;}
+
+  if ((fp = fopen(fname, "w")) == NULL){
+    printf("unable to open %s for writing\n", fname); GDALClose(dataset); return FAILURE;}
+
+
+  fprintf(fp, "<VRTDataset rasterXSize=\"%d\" rasterYSize=\"%d\">\n",
+    (maxx-minx)*step + nx, (maxy-miny)*step + ny);
+
+  value = CPLEscapeString(GDALGetProjectionRef(dataset), -1, CPLES_XML);
+  fprintf(fp, "  <SRS dataAxisToSRSAxisMapping=\"1,2\">%s</SRS>\n", value);
+  CPLFree(value);
+
+  fprintf(fp, "  <GeoTransform> %.16e, %.16e, 0.0, %.16e, 0.0, %.16e</GeoTransform>\n",
+    cube->origin_map.x + minx*cube->tilesize, res, 
+    cube->origin_map.y - miny*cube->tilesize, -res);
+
+  write_vrt_metadata(fp, GDALGetMetadata(dataset, "FORCE"), "  ");
+
+  for (b=0; b<nb; b++){
+
+    band = GDALGetRasterBand(dataset, b+1);
+    type = GDALGetDataTypeName(GDALGetRasterDataType(band));
+    nodata = GDALGetRasterNoDataValue(band, &has_nodata);
+    GDALGetBlockSize(band, &bx, &by);
+
+    fprintf(fp, "  <VRTRasterBand dataType=\"%s\" band=\"%d\">\n", type, b+1);
+
+    value = CPLEscapeString(GDALGetDescription(band), -1, CPLES_XML);
+    fprintf(fp, "    <Description>%s</Description>\n", value);
+    CPLFree(value);
+
+    if (has_nodata) fprintf(fp, "    <NoDataValue>%.17g</NoDataValue>\n", nodata);
+
+    write_vrt_metadata(fp, GDALGetMetadata(band, "FORCE"), "    ");
+
+    for (i=0; i<n; i++){
+
+      tx = cube->tx[chip[i].tile];
+      ty = cube->ty[chip[i].tile];
+
+      value = CPLEscapeString(chip[i].name, -1, CPLES_XML);
+
+      fprintf(fp, "    <ComplexSource>\n");
+      if (prefix[0] == '/'){
+        fprintf(fp, "      <SourceFilename relativeToVRT=\"0\">%s/X%04d_Y%04d/%s</SourceFilename>\n", args->dcube, tx, ty, value);
+      } else {
+        fprintf(fp, "      <SourceFilename relativeToVRT=\"1\">%sX%04d_Y%04d/%s</SourceFilename>\n", prefix, tx, ty, value);
+      }
+      fprintf(fp, "      <SourceBand>%d</SourceBand>\n", b+1);
+      fprintf(fp, "      <SourceProperties RasterXSize=\"%d\" RasterYSize=\"%d\" DataType=\"%s\" BlockXSize=\"%d\" BlockYSize=\"%d\" />\n", nx, ny, type, bx, by);
+      fprintf(fp, "      <SrcRect xOff=\"0\" yOff=\"0\" xSize=\"%d\" ySize=\"%d\" />\n", nx, ny);
+      fprintf(fp, "      <DstRect xOff=\"%d\" yOff=\"%d\" xSize=\"%d\" ySize=\"%d\" />\n", (tx-minx)*step, (ty-miny)*step, nx, ny);
+      if (has_nodata) fprintf(fp, "      <NODATA>%.17g</NODATA>\n", nodata);
+      fprintf(fp, "    </ComplexSource>\n");
+
+      CPLFree(value);
+
+    }
+
+    fprintf(fp, "  </VRTRasterBand>\n");
+
+  }
+
+  fprintf(fp, "</VRTDataset>\n");
+
+  fclose(fp);
+  GDALClose(dataset);
+
+  return SUCCESS;
+}
+
+
+int main(int argc, char *argv[]){
+args_t args;
+cube_t *cube = NULL;
+chip_t *chip = NULL;
+int nchip = 0, nprod = 0, p, i, k;
+int *start = NULL, *count = NULL;
+int error = 0;
+char dname[NPOW_10];
+char prefix[NPOW_10];
+char *ptr = NULL, *save = NULL;
+int nchar;
+
+
+  parse_args(argc, argv, &args);
+
+  if (args.nthread > 0) omp_set_num_threads(args.nthread);
+
+  GDALAllRegister();
+
+  // read datacube definition
+  if ((cube = read_datacube_def(args.dcube)) == NULL){
+    fprintf(stderr, "Reading datacube definition failed.\n"); usage(argv[0], FAILURE);}
+
+  if (find_tiles(&args, cube) == FAILURE){
+    fprintf(stderr, "Finding tiles failed.\n"); free_datacube(cube); return FAILURE;}
+
+
+  // output directory, and relative path from the mosaic to the tiles;
+  // absolute mosaic directories refer to the tiles with absolute paths
+  if (args.dmosaic[0] == '/'){
+    copy_string(args.dout, NPOW_10, args.dmosaic);
+    copy_string(prefix, NPOW_10, "/");
+  } else {
+    nchar = snprintf(args.dout, NPOW_10, "%s/%s", args.dcube, args.dmosaic);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling dirname\n"); return FAILURE;}
+    copy_string(dname, NPOW_10, args.dmosaic);
+    prefix[0] = '\0';
+    for (ptr=strtok_r(dname, "/", &save); ptr!=NULL; ptr=strtok_r(NULL, "/", &save)){
+      if (strcmp(ptr, ".") != 0 && strlen(prefix)+3 < NPOW_10) strcat(prefix, "../");
+    }
+  }
+
+  if (createdir(args.dout) == FAILURE){
+    fprintf(stderr, "creating output directory failed.\n"); return FAILURE;}
+
+
+  // chips of all products
+  chip = find_chips(args.dcube, cube, &nchip);
+
+  alloc((void**)&start, nchip+1, sizeof(int));
+  alloc((void**)&count, nchip+1, sizeof(int));
+
+  for (i=0; i<nchip; i=k){
+    for (k=i+1; k<nchip && strcmp(chip[i].name, chip[k].name) == 0; k++);
+    start[nprod] = i;
+    count[nprod] = k-i;
+    nprod++;
+  }
+
+  printf("mosaicking %d products in %d tiles\n", nprod, cube->tn);
+
+
+  #pragma omp parallel for shared(args, cube, chip, start, count, nprod, prefix) reduction(+: error) schedule(dynamic) default(none)
+  for (p=0; p<nprod; p++){
+
+    if (write_mosaic(&args, cube, chip+start[p], count[p], prefix) == FAILURE){
+      printf("mosaicking %s failed.\n", chip[start[p]].name);
+      error++;
+    }
+
+  }
+
+  printf("%d mosaics written", nprod-error);
+  if (error > 0) printf(", %d failed", error);
+  printf("\n");
+
+
+  for (i=0; i<nchip; i++) free((void*)chip[i].name);
+  if (chip != NULL) free((void*)chip);
+  free((void*)start);
+  free((void*)count);
+  free_datacube(cube);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+}
+
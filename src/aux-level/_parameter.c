@@ -265,6 +265,7 @@ FILE *fp;
   if (args.module == _HL_UDF_){
     write_par_hl_pyp(fp, args.comments);
     //write_par_hl_rsp(fp, args.comments);
+    write_par_hl_nat(fp, args.comments);
   }
 
   if (args.module == _HL_CFI_){
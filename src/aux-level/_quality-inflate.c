@@ -43,7 +43,8 @@ This program inflates QAI layers
 
 typedef struct {
   int n;
-  char finp[NPOW_10];
+  int nf;
+  char **finp;
   char dout[NPOW_10];
 } args_t;
 
@@ -51,14 +52,14 @@ typedef struct {
 void usage(char *exe, int exit_code){
 
 
-  printf("Usage: %s [-h] [-v] [-i] input-file output-dir\n", exe);
+  printf("Usage: %s [-h] [-v] [-i] input-file(s) output-dir\n", exe);
   printf("\n");
   printf("  -h  = show this help\n");
   printf("  -v  = show version\n");
   printf("  -i  = show program's purpose\n");
   printf("\n");
   printf("  Positional arguments:\n");
-  printf("  - 'input-file': QAI file\n");
+  printf("  - 'input-file(s)': QAI file(s), processed in parallel\n");
   printf("  - 'output-dir': Output directory for QIM files.'\n");
   printf("\n");
 
@@ -68,7 +69,7 @@ void usage(char *exe, int exit_code){
 
 
 void parse_args(int argc, char *argv[], args_t *args){
-int opt;
+int opt, f;
 
 
   opterr = 0;
@@ -102,15 +103,14 @@ int opt;
 
   if (optind < argc){
     konami_args(argv[optind]);
-    if (argc-optind == args->n){
-      copy_string(args->finp, NPOW_10, argv[optind++]);
+    if (argc-optind >= args->n){
+      args->nf = argc-optind-1;
+      alloc_2D((void***)&args->finp, args->nf, NPOW_10, sizeof(char));
+      for (f=0; f<args->nf; f++) copy_string(args->finp[f], NPOW_10, argv[optind++]);
       copy_string(args->dout, NPOW_10, argv[optind++]);
-    } else if (argc-optind < args->n){
+    } else {
       fprintf(stderr, "some non-optional arguments are missing.\n");
       usage(argv[0], FAILURE);
-    } else if (argc-optind > args->n){
-      fprintf(stderr, "too many non-optional arguments.\n");
-      usage(argv[0], FAILURE);
     }
   } else {
     fprintf(stderr, "non-optional arguments are missing.\n");
@@ -121,8 +121,13 @@ int opt;
 }
 
 
-int main(int argc, char *argv[]){
-args_t args;
+/** This function inflates the QAI bit fields of one file into the QIM
++++ product, which has one band per flag
+--- finp:   QAI file
+--- dout:   output directory
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int inflate_file(char *finp, char *dout){
 double geotran[6];
 char *pch   = NULL;
 char oname[NPOW_10];
@@ -131,20 +136,15 @@ GDALDatasetH fp;
 brick_t *QAI = NULL;
 brick_t *QIM = NULL;
 small **qim_ = NULL;
-int b, p;
+int b;
 cube_t *cube = NULL;
 
 
-  parse_args(argc, argv, &args);
-
-  GDALAllRegister();
-
-  
   if ((cube = allocate_datacube()) == NULL){
     printf("unable to init cube\n"); return FAILURE;}
 
-  if ((fp = GDALOpen(args.finp, GA_ReadOnly)) == NULL){
-    printf("unable to open %s. ", args.finp); return FAILURE;}
+  if ((fp = GDALOpen(finp, GA_ReadOnly)) == NULL){
+    printf("unable to open %s. ", finp); return FAILURE;}
 
   cube->nx = cube->cx = GDALGetRasterXSize(fp);
   cube->ny = cube->cy = GDALGetRasterYSize(fp);
@@ -163,8 +163,9 @@ cube_t *cube = NULL;
   GDALClose(fp);
   
 
-  if ((QAI = read_block(args.finp, _ARD_AUX_, NULL, 1, 1, 1, _DT_SHORT_, 0, 0, 0, cube, false, 0, 0)) == NULL){
-      printf("Error reading QAI product %s\n", args.finp); return FAILURE;}
+  if ((QAI = read_block(finp, _ARD_AUX_, NULL, 1, 1, 1, _DT_SHORT_, 0, 0, 0, cube, false, 0, 0)) == NULL){
+      printf("Error reading QAI product %s\n", finp); return FAILURE;}
+  free_dataset_pool();
 
 
   QIM  = copy_brick(QAI, _QAI_FLAG_LENGTH_, _DT_SMALL_);
@@ -172,14 +173,14 @@ cube_t *cube = NULL;
     printf("Error getting QIM bands\n"); return FAILURE;}
 
   // output filename
-  basename_without_ext(args.finp, oname, NPOW_10);
+  basename_without_ext(finp, oname, NPOW_10);
   if (strstr(oname, "_QAI")  != NULL) pch = strstr(oname, "_QAI");
   if (strstr(oname, "_INF")  != NULL) pch = strstr(oname, "_INF");
   if (pch == NULL){
     printf("Wrong product given. Give QAI or INF product\n"); return FAILURE;}
   strncpy(pch, "_QIM", 4);
   
-  set_brick_dirname(QIM, args.dout);
+  set_brick_dirname(QIM, dout);
   set_brick_filename(QIM, oname);
   set_brick_open(QIM, OPEN_CREATE);
   for (b=0; b<_QAI_FLAG_LENGTH_; b++) set_brick_save(QIM, b, true);
@@ -215,26 +216,7 @@ cube_t *cube = NULL;
   #endif
 
   
-  #pragma omp parallel shared(cube, qim_, QAI) default(none)
-  {
-  
-    #pragma omp for
-    for (p=0; p<cube->nc; p++){
-      qim_[_QAI_FLAG_OFF_][p] = get_off(QAI, p);
-      qim_[_QAI_FLAG_CLD_][p] = get_cloud(QAI, p);
-      qim_[_QAI_FLAG_SHD_][p] = get_shadow(QAI, p);
-      qim_[_QAI_FLAG_SNW_][p] = get_snow(QAI, p);
-      qim_[_QAI_FLAG_WTR_][p] = get_water(QAI, p);
-      qim_[_QAI_FLAG_AOD_][p] = get_aerosol(QAI, p);
-      qim_[_QAI_FLAG_SUB_][p] = get_subzero(QAI, p);
-      qim_[_QAI_FLAG_SAT_][p] = get_saturation(QAI, p);
-      qim_[_QAI_FLAG_SUN_][p] = get_lowsun(QAI, p);
-      qim_[_QAI_FLAG_ILL_][p] = get_illumination(QAI, p);
-      qim_[_QAI_FLAG_SLP_][p] = get_slope(QAI, p);
-      qim_[_QAI_FLAG_WVP_][p] = get_vaporfill(QAI, p);
-    }
-    
-  }
+  inflate_qai(QAI, qim_);
 
 
   write_brick(QIM);
@@ -247,4 +229,31 @@ cube_t *cube = NULL;
   return SUCCESS;
 }
 
-  
\ No newline at end of file
+
+int main(int argc, char *argv[]){
+args_t args;
+int f, error = 0;
+
+
+  parse_args(argc, argv, &args);
+
+  GDALAllRegister();
+
+  // several files are inflated concurrently, a single file uses
+  // all threads for the inflation itself
+  #pragma omp parallel for shared(args) reduction(+: error) schedule(dynamic) if(args.nf > 1) default(none)
+  for (f=0; f<args.nf; f++){
+
+    if (inflate_file(args.finp[f], args.dout) == FAILURE){
+      printf("Inflating %s failed.\n", args.finp[f]);
+      error++;
+    }
+
+  }
+
+  free_2D((void**)args.finp, args.nf);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+}
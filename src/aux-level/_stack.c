@@ -35,6 +35,9 @@ This program stacks images
 #include "../cross-level/string-cl.h"
 #include "../cross-level/alloc-cl.h"
 #include "../cross-level/dir-cl.h"
+#include "../cross-level/gdalopt-cl.h"
+
+#include <omp.h>     // multi-platform shared memory multiprocessing
 
 
 /** Geospatial Data Abstraction Library (GDAL) **/
@@ -43,6 +46,10 @@ This program stacks images
 #include "cpl_string.h" // various convenience functions for strings
 
 
+// bytes per strip that is copied at once
+#define STACK_BUFFER 16777216
+
+
 typedef struct {
   char fname[NPOW_10];   // file name
   char dname[NPOW_10];   // directory name
@@ -50,6 +57,9 @@ typedef struct {
   int nx, ny, nb;        // dimensions
   char proj[NPOW_10];    // projection
   double geotran[6];     // geotransformation
+  GDALDataType type;     // data type
+  int bx, by;            // block size
+  int f;                 // file
   int b;                 // band
 } img_t;
 
@@ -60,19 +70,29 @@ typedef struct {
   char  fdst[NPOW_10];
   char  ddst[NPOW_10];
   char  edst[NPOW_10];
+  bool fast;
+  int nthread;
 } args_t;
 
 
 void usage(char *exe, int exit_code){
 
 
-  printf("Usage: %s [-h] [-v] [-i] {-o output-file} src-files\n", exe);
+  printf("Usage: %s [-h] [-v] [-i] [-f] [-j] {-o output-file} src-files\n", exe);
   printf("\n");
   printf("  -h  = show this help\n");
   printf("  -v  = show version\n");
   printf("  -i  = show program's purpose\n");
   printf("\n");
-  printf("  -o output-file  = stacked output file (.vrt)\n");
+  printf("  -o output-file  = stacked output file\n");
+  printf("     .vrt: virtual stack\n");
+  printf("     .tif: stack is copied into a GeoTiff\n");
+  printf("     .dat: stack is copied into an ENVI file\n");
+  printf("\n");
+  printf("  -f  = fast virtual stack, only the first file is opened\n");
+  printf("        all files need to have the same dimensions and bands\n");
+  printf("\n");
+  printf("  -j  = number of parallel threads for copying (default: all)\n");
   printf("\n");
   printf("  Positional arguments:\n");
   printf("  - 'src-files': source files that will be stacked\n");
@@ -91,9 +111,11 @@ bool o;
 
   // default parameters
   o = false;
+  args->fast = false;
+  args->nthread = 0;
 
   // optional parameters
-  while ((opt = getopt(argc, argv, "hvio:")) != -1){
+  while ((opt = getopt(argc, argv, "hvio:fj:")) != -1){
     switch(opt){
       case 'h':
         usage(argv[0], SUCCESS);
@@ -109,6 +131,16 @@ bool o;
         extension(args->fdst,     args->edst, NPOW_10);
         o = true;
         break;
+      case 'f':
+        args->fast = true;
+        break;
+      case 'j':
+        args->nthread = atoi(optarg);
+        if (args->nthread < 0){
+          fprintf(stderr, "Number of threads must be >= 0.\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
       case '?':
         if (isprint(optopt)){
           fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -150,6 +182,131 @@ bool o;
 }
 
 
+/** This function copies the stacked bands into a new file. The bands are
++++ split into strips that are aligned with the blocks of the input. The
++++ strips are read in parallel, each thread with its own datasets, and 
++++ are written one after another.
+--- args:   arguments
+--- inp:    input images
+--- nf:     number of input images
+--- out:    output bands
+--- nb:     number of output bands
+--- src:    input datasets (for metadata)
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int materialize_stack(args_t *args, img_t *inp, int nf, img_t *out, int nb, GDALDatasetH *src){
+int format, o, b, f, task, ntask, nstrip, nrow, y0, n;
+int nx = inp[0].nx, ny = inp[0].ny;
+int size, error = 0;
+GDALDriverH     driver = NULL;
+GDALDatasetH    dst    = NULL;
+GDALDatasetH   *local  = NULL;
+GDALRasterBandH bsrc   = NULL;
+GDALRasterBandH bdst   = NULL;
+gdalopt_t gdalopt;
+char **options = NULL;
+char *buf = NULL;
+double nodata;
+int has_nodata;
+
+
+  if (strcmp(args->edst, ".tif") == 0){
+    format = _FMT_GTIFF_;
+  } else {
+    format = _FMT_ENVI_;
+  }
+
+  memset(&gdalopt, 0, sizeof(gdalopt_t));
+  default_gdaloptions(format, &gdalopt);
+  update_gdaloptions_blocksize(format, &gdalopt, inp[0].bx, inp[0].by);
+  update_gdaloptions_threads(&gdalopt, (args->nthread > 0) ? args->nthread : omp_get_max_threads());
+
+  for (o=0; o<gdalopt.n; o+=2) options = CSLSetNameValue(options, gdalopt.option[o], gdalopt.option[o+1]);
+  if (format == _FMT_GTIFF_ && inp[0].bx < nx) options = CSLSetNameValue(options, "TILED", "YES");
+
+  if ((driver = GDALGetDriverByName(gdalopt.driver)) == NULL){
+    printf("Error getting %s driver.\n\n", gdalopt.driver); return FAILURE;}
+
+  if ((dst = GDALCreate(driver, args->fdst, nx, ny, nb, inp[0].type, options)) == NULL){
+    printf("Error creating file %s\n\n", args->fdst); return FAILURE;}
+
+  CSLDestroy(options);
+
+
+  // copy metadata
+  GDALSetGeoTransform(dst, inp[0].geotran);
+  GDALSetProjection(dst,   inp[0].proj);
+  GDALSetMetadata(dst,     GDALGetMetadata(src[0], "FORCE"), "FORCE");
+
+  for (b=0; b<nb; b++){
+    bsrc = GDALGetRasterBand(src[out[b].f], out[b].b);
+    bdst = GDALGetRasterBand(dst, b+1);
+    nodata = GDALGetRasterNoDataValue(bsrc, &has_nodata);
+    if (has_nodata) GDALSetRasterNoDataValue(bdst, nodata);
+    GDALSetMetadata(bdst, GDALGetMetadata(bsrc, "FORCE"), "FORCE");
+    GDALSetDescription(bdst, GDALGetDescription(bsrc));
+  }
+
+
+  // strips of whole blocks
+  size = GDALGetDataTypeSizeBytes(inp[0].type);
+  nrow = STACK_BUFFER / (nx*size) / inp[0].by * inp[0].by;
+  if (nrow < inp[0].by) nrow = inp[0].by;
+  if (nrow > ny) nrow = ny;
+  nstrip = (ny+nrow-1)/nrow;
+  ntask = nb*nstrip;
+
+  printf("\nCopying %d bands in %d strips of %d rows.\n", nb, nstrip, nrow);
+
+  if (args->nthread > 0) omp_set_num_threads(args->nthread);
+
+  #pragma omp parallel private(f, b, y0, n, buf, local, bsrc, bdst) shared(inp, nf, out, dst, nx, ny, nrow, nstrip, ntask, size) reduction(+: error) default(none)
+  {
+
+    alloc((void**)&local, nf, sizeof(GDALDatasetH));
+    alloc((void**)&buf, (size_t)nx*nrow*size, sizeof(char));
+
+    #pragma omp for schedule(dynamic)
+    for (task=0; task<ntask; task++){
+
+      b  = task / nstrip;
+      y0 = (task % nstrip) * nrow;
+      n  = (ny-y0 < nrow) ? ny-y0 : nrow;
+      f  = out[b].f;
+
+      if (local[f] == NULL &&
+         (local[f] = GDALOpenEx(inp[f].fname, GDAL_OF_READONLY, NULL, NULL, NULL)) == NULL){
+        printf("Unable to open %s\n", inp[f].fname); error++; continue;}
+
+      bsrc = GDALGetRasterBand(local[f], out[b].b);
+      if (GDALRasterIO(bsrc, GF_Read, 0, y0, nx, n, buf, nx, n, inp[f].type, 0, 0) != CE_None){
+        printf("Unable to read %s band %d\n", inp[f].bname, out[b].b); error++; continue;}
+
+      #pragma omp critical (stack_write)
+      {
+        bdst = GDALGetRasterBand(dst, b+1);
+        if (GDALRasterIO(bdst, GF_Write, 0, y0, nx, n, buf, nx, n, inp[f].type, 0, 0) != CE_None) error++;
+      }
+
+    }
+
+    for (f=0; f<nf; f++){
+      if (local[f] != NULL) GDALClose(local[f]);
+    }
+    free((void*)local);
+    free((void*)buf);
+
+  }
+
+  GDALClose(dst);
+
+  if (error > 0){
+    printf("Copying failed in %d strips.\n\n", error); return FAILURE;}
+
+  return SUCCESS;
+}
+
+
 int main ( int argc, char *argv[] ){
 args_t args;
 int f, nf;
@@ -158,7 +315,7 @@ int k;
 int nx = 0, ny = 0;
 int nodata;
 GDALDriverH     driver = NULL;
-GDALDatasetH    src    = NULL;
+GDALDatasetH   *src    = NULL;
 GDALDatasetH    dst    = NULL;
 GDALRasterBandH bsrc   = NULL;
 GDALRasterBandH bdst   = NULL;
@@ -170,13 +327,22 @@ const char *bname = NULL;
 const char *proj_ = NULL;
 char source[NPOW_16];
 int interleave;
+bool virtual_;
 enum { _BYFILE_, _BYBAND_, _INTERLEN_ };
 
 
   parse_args(argc, argv, &args);
 
-  if (strcmp(args.edst, ".vrt") != 0){
-    printf("Output file must have .vrt extension\n\n"); 
+  if (strcmp(args.edst, ".vrt") != 0 &&
+      strcmp(args.edst, ".tif") != 0 &&
+      strcmp(args.edst, ".dat") != 0){
+    printf("Output file must have .vrt, .tif or .dat extension\n\n"); 
+    return FAILURE;}
+
+  virtual_ = (strcmp(args.edst, ".vrt") == 0);
+
+  if (args.fast && !virtual_){
+    printf("Fast stacking (-f) is only available for .vrt output\n\n"); 
     return FAILURE;}
 
   if (fileexist(args.fdst)){
@@ -193,27 +359,42 @@ enum { _BYFILE_, _BYBAND_, _INTERLEN_ };
 
   nf = args.n;
   alloc((void**)&inp, nf, sizeof(img_t));
+  alloc((void**)&src, nf, sizeof(GDALDatasetH));
 
   // check if we stack file after file, or band after band
+  // the files are kept open for copying the metadata;
+  // in fast mode, the other files are assumed to match the first one
   for (f=0, nb=0, interleave=_BYBAND_; f<nf; f++){
 
-    copy_string(inp[f].fname, NPOW_10, args.fsrc[f]);
-    directoryname(inp[f].fname, inp[f].dname, NPOW_10);
-    basename_with_ext(inp[f].fname, inp[f].bname, NPOW_10);
+    if (args.fast && f > 0){
+      memcpy(&inp[f], &inp[0], sizeof(img_t));
+    } else {
 
-    if ((src = GDALOpenEx(inp[f].fname, GDAL_OF_READONLY, NULL, NULL, NULL)) == NULL){
-      printf("Unable to open %s\n\n", inp[f].fname); return FAILURE;}
+      if ((src[f] = GDALOpenEx(args.fsrc[f], GDAL_OF_READONLY, NULL, NULL, NULL)) == NULL){
+        printf("Unable to open %s\n\n", args.fsrc[f]); return FAILURE;}
 
-    nx  = (inp[f].nx = GDALGetRasterXSize(src));
-    ny  = (inp[f].ny = GDALGetRasterYSize(src));
-    nb += (inp[f].nb = GDALGetRasterCount(src));
-    GDALGetGeoTransform(src, inp[f].geotran);
-    
-    proj_ = GDALGetProjectionRef(src);
-    copy_string(inp[f].proj, NPOW_10, proj_);
+      inp[f].nx = GDALGetRasterXSize(src[f]);
+      inp[f].ny = GDALGetRasterYSize(src[f]);
+      inp[f].nb = GDALGetRasterCount(src[f]);
+      GDALGetGeoTransform(src[f], inp[f].geotran);
 
-    GDALClose(src);
+      proj_ = GDALGetProjectionRef(src[f]);
+      copy_string(inp[f].proj, NPOW_10, proj_);
 
+      bsrc = GDALGetRasterBand(src[f], 1);
+      inp[f].type = GDALGetRasterDataType(bsrc);
+      GDALGetBlockSize(bsrc, &inp[f].bx, &inp[f].by);
+
+    }
+
+    copy_string(inp[f].fname, NPOW_10, args.fsrc[f]);
+    directoryname(inp[f].fname, inp[f].dname, NPOW_10);
+    basename_with_ext(inp[f].fname, inp[f].bname, NPOW_10);
+    inp[f].f = f;
+
+    nx  = inp[f].nx;
+    ny  = inp[f].ny;
+    nb += inp[f].nb;
 
     printf("file %d:\n", f+1);
     printf("  %s\n", inp[f].dname);
@@ -235,6 +416,9 @@ enum { _BYFILE_, _BYBAND_, _INTERLEN_ };
         printf("Number of rows are different. This is not allowed.\n");
         printf("File 1: %d\nFile %d: %d\n\n", inp[0].ny, f+1, inp[f].ny); 
         return FAILURE;}
+      if (!virtual_ && inp[f].type != inp[0].type){
+        printf("Data types are different. This is not allowed.\n\n");
+        return FAILURE;}
       if (inp[f].nb != inp[0].nb) interleave = _BYFILE_;
     }
 
@@ -276,61 +460,72 @@ enum { _BYFILE_, _BYBAND_, _INTERLEN_ };
   }
 
 
-  // create file with VRT driver
-  if ((driver = GDALGetDriverByName("VRT")) == NULL){
-    printf("Error getting VRT driver.\n\n"); return FAILURE;}
+  if (!virtual_){
 
-  if ((dst = GDALCreate(driver, args.fdst, nx, ny, 0, GDT_Int16, NULL)) == NULL){
-    printf("Error creating file %s\n\n", args.fdst); return FAILURE;}
+    if (materialize_stack(&args, inp, nf, out, nb, src) == FAILURE){
+      printf("Error copying the stack into %s\n\n", args.fdst); return FAILURE;}
 
+  } else {
 
-  // copy file-level metadata
-  if ((src = GDALOpenEx(inp[0].fname, GDAL_OF_READONLY, NULL, NULL, NULL)) == NULL){
-    printf("Unable to open %s\n\n", inp[0].fname); return FAILURE;}
-  meta = GDALGetMetadata(src, "FORCE");
-  GDALSetGeoTransform(dst, out[0].geotran);
-  GDALSetProjection(dst,   out[0].proj);
-  GDALSetMetadata(dst,     meta, "FORCE");
-  GDALClose(src);
+    // create file with VRT driver
+    if ((driver = GDALGetDriverByName("VRT")) == NULL){
+      printf("Error getting VRT driver.\n\n"); return FAILURE;}
 
+    if ((dst = GDALCreate(driver, args.fdst, nx, ny, 0, GDT_Int16, NULL)) == NULL){
+      printf("Error creating file %s\n\n", args.fdst); return FAILURE;}
 
-  // add the bands to vrt
-  for (b=0; b<nb; b++){
 
-    // get band-level metadata
-    if ((src = GDALOpenEx(out[b].fname, GDAL_OF_READONLY, NULL, NULL, NULL)) == NULL){
-      printf("Unable to open %s\n\n", out[b].fname); return FAILURE;}
-    bsrc = GDALGetRasterBand(src, out[b].b);
-    bmeta = GDALGetMetadata(bsrc, "FORCE");
-    bname = GDALGetDescription(bsrc);
-    nodata = (int)GDALGetRasterNoDataValue(bsrc, NULL);
-
-    // add new band
-    GDALAddBand(dst, GDT_Int16, NULL);
-    bdst = GDALGetRasterBand(dst, GDALGetRasterCount(dst));
-
-    // set source
-    sprintf(source,
-      "<ComplexSource>"
-      "  <SourceFilename relativeToVRT=\"1\">%s</SourceFilename>"
-      "  <SourceBand>%d</SourceBand>"
-      "  <SrcRect xOff=\"0\" yOff=\"0\" xSize=\"%d\" ySize=\"%d\" />"
-      "  <DstRect xOff=\"0\" yOff=\"0\" xSize=\"%d\" ySize=\"%d\" />"
-      "  <NODATA>%d</NODATA>"
-      "</ComplexSource>", 
-      out[b].bname, out[b].b, out[b].nx, out[b].ny, out[b].nx, out[b].ny, nodata);
-
-    // update source and metadata
-    GDALSetMetadataItem(bdst, "source_0", source, "new_vrt_sources");
-    GDALSetMetadata(bdst, bmeta, "FORCE");
-    GDALSetDescription(bdst, bname);
-
-    GDALClose(src);
+    // copy file-level metadata
+    meta = GDALGetMetadata(src[0], "FORCE");
+    GDALSetGeoTransform(dst, out[0].geotran);
+    GDALSetProjection(dst,   out[0].proj);
+    GDALSetMetadata(dst,     meta, "FORCE");
+
+
+    // add the bands to vrt
+    for (b=0; b<nb; b++){
+
+      // get band-level metadata, from the first file in fast mode
+      if (args.fast){
+        bsrc = GDALGetRasterBand(src[0], out[b].b);
+      } else {
+        bsrc = GDALGetRasterBand(src[out[b].f], out[b].b);
+      }
+      bmeta = GDALGetMetadata(bsrc, "FORCE");
+      bname = GDALGetDescription(bsrc);
+      nodata = (int)GDALGetRasterNoDataValue(bsrc, NULL);
+
+      // add new band
+      GDALAddBand(dst, GDT_Int16, NULL);
+      bdst = GDALGetRasterBand(dst, GDALGetRasterCount(dst));
+
+      // set source
+      sprintf(source,
+        "<ComplexSource>"
+        "  <SourceFilename relativeToVRT=\"1\">%s</SourceFilename>"
+        "  <SourceBand>%d</SourceBand>"
+        "  <SrcRect xOff=\"0\" yOff=\"0\" xSize=\"%d\" ySize=\"%d\" />"
+        "  <DstRect xOff=\"0\" yOff=\"0\" xSize=\"%d\" ySize=\"%d\" />"
+        "  <NODATA>%d</NODATA>"
+        "</ComplexSource>", 
+        out[b].bname, out[b].b, out[b].nx, out[b].ny, out[b].nx, out[b].ny, nodata);
+
+      // update source and metadata
+      GDALSetMetadataItem(bdst, "source_0", source, "new_vrt_sources");
+      GDALSetMetadata(bdst, bmeta, "FORCE");
+      GDALSetDescription(bdst, bname);
+
+    }
+
+    GDALClose(dst);
 
   }
 
-  GDALClose(dst);
+  for (f=0; f<nf; f++){
+    if (src[f] != NULL) GDALClose(src[f]);
+  }
 
+  free((void*)src);
   free((void*)inp);
   free((void*)out);
 
@@ -338,4 +533,3 @@ enum { _BYFILE_, _BYBAND_, _INTERLEN_ };
 
   return SUCCESS; 
 }
-
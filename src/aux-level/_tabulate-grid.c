@@ -52,13 +52,14 @@ typedef struct {
   double bbox[4]; // bottom,top,left,right
   char dcube[NPOW_10];
   char format[NPOW_10];
+  char faoi[NPOW_10];
 } args_t;
 
 
 void usage(char *exe, int exit_code){
 
 
-  printf("Usage: %s [-h] [-v] [-i] [-b bottom,top,left,right] [-f format] datacube-dir\n", exe);
+  printf("Usage: %s [-h] [-v] [-i] [-b bottom,top,left,right] [-a aoi-file] [-f format] datacube-dir\n", exe);
   printf("\n");
   printf("  -h  = show this help\n");
   printf("  -v  = show version\n");
@@ -67,6 +68,9 @@ void usage(char *exe, int exit_code){
   printf("  -b bottom,top,left,right  = bounding box\n");
   printf("     use geographic coordinates! 4 comma-separated numbers\n");
   printf("\n");
+  printf("  -a aoi-file  = vector file with areas of interest\n");
+  printf("     only tiles that intersect with any feature are tabulated\n");
+  printf("\n");
   printf("  -f format  = output format: shp or kml (default)\n");
   printf("\n");
   printf("  Positional arguments:\n");
@@ -94,9 +98,10 @@ int i;
   args->bbox[_left_]   = -180;
   args->bbox[_right_]  =  180;
   copy_string(args->format, NPOW_10, "kml");
+  copy_string(args->faoi,   NPOW_10, "NULL");
 
   // optional parameters
-  while ((opt = getopt(argc, argv, "hvit:b:f:")) != -1){
+  while ((opt = getopt(argc, argv, "hvit:b:a:f:")) != -1){
     switch(opt){
       case 'h':
         usage(argv[0], SUCCESS);
@@ -120,6 +125,9 @@ int i;
           usage(argv[0], FAILURE);
         } 
         break;
+      case 'a':
+        copy_string(args->faoi, NPOW_10, optarg);
+        break;
       case 'f':
         copy_string(args->format, NPOW_10, optarg);
         break;
@@ -159,6 +167,176 @@ int i;
 }
 
 
+/** This function finds the tiles that intersect with the features of a
++++ vector file. The features are transformed into the datacube projec-
++++ tion. The tile grid serves as spatial index: each feature is only 
++++ tested against the tiles within its envelope, using a prepared geo-
++++ metry. The features are tested in parallel.
+--- faoi:   vector file
+--- cube:   datacube
+--- x0:     first tile in x (modified to the extent of the features)
+--- x1:     last  tile in x (modified to the extent of the features)
+--- y0:     first tile in y (modified to the extent of the features)
+--- y1:     last  tile in y (modified to the extent of the features)
++++ Return: intersecting tiles of the modified tile range, NULL if none
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool *aoi_tiles(char *faoi, cube_t *cube, int *x0, int *x1, int *y0, int *y1){
+GDALDatasetH fp;
+OGRLayerH layer;
+OGRFeatureH feature;
+OGRGeometryH geom;
+OGRSpatialReferenceH srs, lsrs;
+OGRCoordinateTransformationH transform;
+OGREnvelope env;
+OGRGeometryH *feat = NULL;
+int nfeat = 0, nbuf = 0;
+int l, nl, i, tx, ty, ex0, ex1, ey0, ey1;
+int ax0 = INT_MAX, ax1 = INT_MIN, ay0 = INT_MAX, ay1 = INT_MIN;
+int nx, ny;
+double tilex, tiley;
+char *wkt = cube->proj;
+bool *keep = NULL;
+
+
+  if ((fp = GDALOpenEx(faoi, GDAL_OF_VECTOR | GDAL_OF_READONLY, NULL, NULL, NULL)) == NULL){
+    printf("Unable to open %s.\n", faoi); return NULL;}
+
+  srs = OSRNewSpatialReference(NULL);
+  OSRImportFromWkt(srs, &wkt);
+  OSRSetAxisMappingStrategy(srs, OAMS_TRADITIONAL_GIS_ORDER);
+
+
+  // all features in datacube projection
+  nl = GDALDatasetGetLayerCount(fp);
+
+  for (l=0; l<nl; l++){
+
+    layer = GDALDatasetGetLayer(fp, l);
+    transform = NULL;
+
+    if ((lsrs = OGR_L_GetSpatialRef(layer)) != NULL && !OSRIsSame(lsrs, srs)){
+      lsrs = OSRClone(lsrs);
+      OSRSetAxisMappingStrategy(lsrs, OAMS_TRADITIONAL_GIS_ORDER);
+      transform = OCTNewCoordinateTransformation(lsrs, srs);
+      OSRDestroySpatialReference(lsrs);
+      if (transform == NULL){
+        printf("Unable to transform layer %d.\n", l); continue;}
+    }
+
+    OGR_L_ResetReading(layer);
+
+    while ((feature = OGR_L_GetNextFeature(layer)) != NULL){
+
+      if ((geom = OGR_F_GetGeometryRef(feature)) != NULL){
+
+        geom = OGR_G_Clone(geom);
+
+        if (transform != NULL && OGR_G_Transform(geom, transform) != OGRERR_NONE){
+          OGR_G_DestroyGeometry(geom);
+        } else {
+
+          if (nfeat >= nbuf){
+            re_alloc((void**)&feat, nbuf, (nbuf > 0) ? nbuf*2 : NPOW_10, sizeof(OGRGeometryH));
+            nbuf = (nbuf > 0) ? nbuf*2 : NPOW_10;
+          }
+          feat[nfeat++] = geom;
+
+          OGR_G_GetEnvelope(geom, &env);
+          tile_find(env.MinX, env.MaxY, &tilex, &tiley, &ex0, &ey0, cube);
+          tile_find(env.MaxX, env.MinY, &tilex, &tiley, &ex1, &ey1, cube);
+          if (ex0 < ax0) ax0 = ex0;
+          if (ex1 > ax1) ax1 = ex1;
+          if (ey0 < ay0) ay0 = ey0;
+          if (ey1 > ay1) ay1 = ey1;
+
+        }
+
+      }
+
+      OGR_F_Destroy(feature);
+
+    }
+
+    if (transform != NULL) OCTDestroyCoordinateTransformation(transform);
+
+  }
+
+  OSRDestroySpatialReference(srs);
+  GDALClose(fp);
+
+
+  // tile range of the features within the requested tile range
+  if (ax0 > *x0) *x0 = ax0;
+  if (ax1 < *x1) *x1 = ax1;
+  if (ay0 > *y0) *y0 = ay0;
+  if (ay1 < *y1) *y1 = ay1;
+
+  nx = *x1 - *x0 + 1;
+  ny = *y1 - *y0 + 1;
+
+  if (nfeat == 0 || nx < 1 || ny < 1){
+    for (i=0; i<nfeat; i++) OGR_G_DestroyGeometry(feat[i]);
+    if (feat != NULL) free((void*)feat);
+    return NULL;
+  }
+
+  alloc((void**)&keep, nx*ny, sizeof(bool));
+
+
+  // test the tiles within the envelope of each feature
+  #pragma omp parallel for private(env, tx, ty, ex0, ex1, ey0, ey1, tilex, tiley) shared(feat, nfeat, keep, nx, ny, x0, x1, y0, y1, cube) schedule(dynamic) default(none)
+  for (i=0; i<nfeat; i++){
+
+    OGRPreparedGeometryH prepared = OGRCreatePreparedGeometry(feat[i]);
+    OGRGeometryH poly, ring;
+
+    OGR_G_GetEnvelope(feat[i], &env);
+    tile_find(env.MinX, env.MaxY, &tilex, &tiley, &ex0, &ey0, cube);
+    tile_find(env.MaxX, env.MinY, &tilex, &tiley, &ex1, &ey1, cube);
+    if (ex0 < *x0) ex0 = *x0;
+    if (ex1 > *x1) ex1 = *x1;
+    if (ey0 < *y0) ey0 = *y0;
+    if (ey1 > *y1) ey1 = *y1;
+
+    for (ty=ey0; ty<=ey1; ty++){
+    for (tx=ex0; tx<=ex1; tx++){
+
+      if (keep[(ty-*y0)*nx + (tx-*x0)]) continue;
+
+      tilex = cube->origin_map.x + cube->tilesize*tx;
+      tiley = cube->origin_map.y - cube->tilesize*ty;
+
+      poly = OGR_G_CreateGeometry(wkbPolygon);
+      ring = OGR_G_CreateGeometry(wkbLinearRing);
+      OGR_G_SetPointCount(ring, 5);
+      OGR_G_SetPoint_2D(ring, 0, tilex,                  tiley);
+      OGR_G_SetPoint_2D(ring, 1, tilex + cube->tilesize, tiley);
+      OGR_G_SetPoint_2D(ring, 2, tilex + cube->tilesize, tiley - cube->tilesize);
+      OGR_G_SetPoint_2D(ring, 3, tilex,                  tiley - cube->tilesize);
+      OGR_G_SetPoint_2D(ring, 4, tilex,                  tiley);
+      OGR_G_AddGeometryDirectly(poly, ring);
+
+      if (OGRPreparedGeometryIntersects(prepared, poly)){
+        #pragma omp atomic write
+        keep[(ty-*y0)*nx + (tx-*x0)] = true;
+      }
+
+      OGR_G_DestroyGeometry(poly);
+
+    }
+    }
+
+    OGRDestroyPreparedGeometry(prepared);
+
+  }
+
+  for (i=0; i<nfeat; i++) OGR_G_DestroyGeometry(feat[i]);
+  free((void*)feat);
+
+  return keep;
+}
+
+
 int main(int argc, char *argv[]){
 args_t args;
 char fname[NPOW_10];
@@ -176,6 +354,7 @@ OGRFeatureH feature;
 OGRGeometryH poly, ring;
 coord_t geo[4], map[4], min, max, tile;
 cube_t *cube = NULL;
+bool *keep = NULL;
 
 
   parse_args(argc, argv, &args);
@@ -229,6 +408,12 @@ cube_t *cube = NULL;
   tile_find(min.x, max.y, &tile.x, &tile.y, &x0, &y0, cube);
   tile_find(max.x, min.y, &tile.x, &tile.y, &x1, &y1, cube);
 
+  // restrict to tiles that intersect with the areas of interest
+  if (strcmp(args.faoi, "NULL") != 0){
+    if ((keep = aoi_tiles(args.faoi, cube, &x0, &x1, &y0, &y1)) == NULL){
+      printf("No tile intersects with %s.\n", args.faoi); return FAILURE;}
+  }
+
 
   // create file
   if ((fp = OGR_Dr_CreateDataSource(driver, fname, NULL)) == NULL){
@@ -269,6 +454,8 @@ cube_t *cube = NULL;
   for (py=y0; py<=y1; py++){
   for (px=x0; px<=x1; px++){
 
+    if (keep != NULL && !keep[(py-y0)*(x1-x0+1) + (px-x0)]) continue;
+
     // bounding box
     left   = cube->origin_map.x + cube->tilesize*px;
     right  = cube->origin_map.x + cube->tilesize*(px+1);
@@ -313,6 +500,8 @@ cube_t *cube = NULL;
   //GDALClose(fp);
   OGR_DS_Destroy(fp);
 
+  if (keep != NULL) free((void*)keep);
+
 
   return SUCCESS;
 }
@@ -36,6 +36,7 @@ input coordinate.
 #include "../cross-level/konami-cl.h"
 #include "../cross-level/cube-cl.h"
 #include "../cross-level/warp-cl.h"
+#include "../cross-level/read-cl.h"
 
 
 typedef struct {
@@ -43,13 +44,14 @@ typedef struct {
   double geo[2]; // lon/lat
   double res;
   char dcube[NPOW_10];
+  char fcoord[NPOW_10];
 } args_t;
 
 
 void usage(char *exe, int exit_code){
 
 
-  printf("Usage: %s [-h] [-v] [-i] [-p lon/lat] [-r resolution] datacube-dir\n", exe);
+  printf("Usage: %s [-h] [-v] [-i] [-p lon/lat] [-f coordinate-file] [-r resolution] datacube-dir\n", exe);
   printf("\n");
   printf("  -h  = show this help\n");
   printf("  -v  = show version\n");
@@ -60,6 +62,10 @@ void usage(char *exe, int exit_code){
   printf("     longitude is X!\n");
   printf("     latitude  is Y!\n");
   printf("\n");
+  printf("  -f coordinate-file  = many points of interest\n");
+  printf("     text file with one lon/lat pair per line (separated by space)\n");
+  printf("     all points are located at once, and printed as table\n");
+  printf("\n");
   printf("  -r resolution  = target resolution\n");
   printf("     this is needed to compute the pixel number\n");
   printf("\n");
@@ -86,9 +92,10 @@ int i;
   args->geo[_X_] =  6.675589; // where FORCE was "born"
   args->geo[_Y_] = 49.748134;
   args->res =  10;
+  copy_string(args->fcoord, NPOW_10, "NULL");
 
   // optional parameters
-  while ((opt = getopt(argc, argv, "hvip:r:")) != -1){
+  while ((opt = getopt(argc, argv, "hvip:f:r:")) != -1){
     switch(opt){
       case 'h':
         usage(argv[0], SUCCESS);
@@ -112,6 +119,9 @@ int i;
           usage(argv[0], FAILURE);  
         }
         break;
+      case 'f':
+        copy_string(args->fcoord, NPOW_10, optarg);
+        break;
       case 'r':
         args->res = atof(optarg);
         if (args->res <= 0){
@@ -155,6 +165,74 @@ int i;
 }
 
 
+/** This function locates many coordinates at once. The coordinates are
++++ reprojected in one call of the cached transformation, and the tile, 
++++ pixel and chunk indices are computed in parallel. One line per point
++++ is printed: lon lat x y tile j i chunk cj ci. Points that cannot be 
++++ reprojected are printed with NA.
+--- fcoord: coordinate file
+--- cube:   datacube
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int find_tiles_batch(char *fcoord, cube_t *cube){
+double **tab = NULL;
+int nrow, ncol, p;
+double *x = NULL, *y = NULL;
+int *tx = NULL, *ty = NULL;
+int *ti = NULL, *tj = NULL;
+
+
+  if ((tab = read_table(fcoord, &nrow, &ncol)) == NULL){
+    printf("Reading coordinate file failed.\n"); return FAILURE;}
+
+  if (ncol < 2){
+    printf("Coordinate file must have lon and lat columns.\n");
+    free_2D((void**)tab, nrow); return FAILURE;}
+
+  alloc((void**)&x,  nrow, sizeof(double));
+  alloc((void**)&y,  nrow, sizeof(double));
+  alloc((void**)&tx, nrow, sizeof(int));
+  alloc((void**)&ty, nrow, sizeof(int));
+  alloc((void**)&ti, nrow, sizeof(int));
+  alloc((void**)&tj, nrow, sizeof(int));
+
+  for (p=0; p<nrow; p++){
+    x[p] = tab[p][_X_];
+    y[p] = tab[p][_Y_];
+  }
+
+  // invalid points are set to NAN
+  warp_geo_to_any_array(x, y, nrow, cube->proj);
+
+  tile_find_array(x, y, nrow, tx, ty, cube);
+
+  #pragma omp parallel for shared(x, y, nrow, tx, ty, ti, tj, cube) schedule(static) default(none)
+  for (p=0; p<nrow; p++){
+    tj[p] = (int)((x[p] - (cube->origin_map.x + tx[p]*cube->tilesize))/cube->res);
+    ti[p] = (int)(((cube->origin_map.y - ty[p]*cube->tilesize) - y[p])/cube->res);
+  }
+
+  printf("lon lat x y tile j i chunk cj ci\n");
+
+  for (p=0; p<nrow; p++){
+    if (isnan(x[p]) || isnan(y[p])){
+      printf("%.6f %.6f NA NA NA NA NA NA NA NA\n", tab[p][_X_], tab[p][_Y_]);
+    } else {
+      printf("%.6f %.6f %.2f %.2f X%04d_Y%04d %d %d %d %d %d\n",
+        tab[p][_X_], tab[p][_Y_], x[p], y[p], tx[p], ty[p], tj[p], ti[p],
+        ti[p]/cube->cy, tj[p], ti[p] - (ti[p]/cube->cy)*cube->cy);
+    }
+  }
+
+  free_2D((void**)tab, nrow);
+  free((void*)x);  free((void*)y);
+  free((void*)tx); free((void*)ty);
+  free((void*)ti); free((void*)tj);
+
+  return SUCCESS;
+}
+
+
 int main(int argc, char *argv[]){
 args_t args;
 coord_t map, tile;
@@ -169,6 +247,13 @@ cube_t *cube = NULL;
     printf("Reading datacube definition failed.\n"); return FAILURE;}
   update_datacube_res(cube, args.res);
 
+  // locate many points
+  if (strcmp(args.fcoord, "NULL") != 0){
+    if (find_tiles_batch(args.fcoord, cube) == FAILURE){
+      free_datacube(cube); return FAILURE;}
+    free_datacube(cube);
+    return SUCCESS;
+  }
 
   // get target coordinates in target css coordinates
   if ((warp_geo_to_any(args.geo[_X_],  args.geo[_Y_], &map.x, &map.y, cube->proj)) == FAILURE){
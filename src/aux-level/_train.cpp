@@ -118,11 +118,14 @@ int opt;
 int main ( int argc, char *argv[] ){
 args_t args;
 par_train_t *train = NULL;
-int f = 0, s, k, j, n_feature, n_sample, n_sample2;
+int f = 0, s, k, j, b, n_feature, n_sample, n_sample2, n_use;
 int n_sample_train, n_sample_val;
 int n_response_vars;
 double **t_features  = NULL;
 double **t_response  = NULL;
+double  *column      = NULL;
+table_map_t *m_features = NULL;
+table_map_t *m_response = NULL;
 float   *r_response  = NULL;
 int     *c_response  = NULL;
 float **features_train  = NULL;
@@ -132,6 +135,8 @@ float **features_val  = NULL;
 float  *r_response_val  = NULL;
 int    *c_response_val  = NULL;
 bool    *is_train  = NULL;
+bool    *is_use  = NULL;
+int     *row  = NULL;
 FILE   *flog = NULL;
 
 Ptr<StatModel> model;
@@ -159,8 +164,13 @@ time_t TIME;
 
 
 
-  // read response variable
-  if ((t_response = read_table(train->f_response, 
+  // read response variable (binary tables are mapped)
+  if (is_binary_table(train->f_response)){
+    if ((m_response = map_binary_table(train->f_response)) == NULL){
+      printf("unable to read response file. "); return FAILURE;}
+    n_sample = m_response->nrow;
+    n_response_vars = m_response->ncol;
+  } else if ((t_response = read_table(train->f_response, 
       &n_sample, &n_response_vars)) == NULL){
     printf("unable to read response file. "); return FAILURE;}
 
@@ -175,19 +185,48 @@ time_t TIME;
   alloc((void**)&c_response, n_sample, sizeof(int));
   alloc((void**)&r_response, n_sample, sizeof(float));
 
-  for (s=0; s<n_sample; s++){
+  alloc((void**)&column, TABLE_BLOCK_ROWS, sizeof(double));
 
-    c_response[s] = (int)t_response[s][train->response_var-1];
-    r_response[s] = (float)t_response[s][train->response_var-1];
+  if (m_response != NULL){
+
+    for (b=0; b<m_response->nblock; b++){
+      read_table_column(m_response, b, train->response_var-1, column);
+      for (k=0, s=m_response->block_row[b]; k<m_response->block_nrow[b]; k++, s++){
+        c_response[s] = (int)column[k];
+        r_response[s] = (float)column[k];
+      }
+    }
+
+    unmap_binary_table(m_response);
+
+  } else {
+
+    for (s=0; s<n_sample; s++){
+      c_response[s] = (int)t_response[s][train->response_var-1];
+      r_response[s] = (float)t_response[s][train->response_var-1];
+    }
+
+    free_2D((void**)t_response, n_sample);
 
   }
 
-  n_sample_train = n_sample*train->per_train/100;
-  n_sample_val   = n_sample-n_sample_train;
 
+  // draw the samples that are used, stratified by class
+  srand(time(NULL));
+  alloc((void**)&is_use, n_sample, sizeof(bool));
+  n_use = subsample_train(c_response, n_sample, train, is_use);
+
+  n_sample_train = n_use*train->per_train/100;
+  n_sample_val   = n_use-n_sample_train;
 
-  // read features
-  if ((t_features = read_table(train->f_feature, 
+
+  // read features (binary tables are mapped, and loaded column-wise below)
+  if (is_binary_table(train->f_feature)){
+    if ((m_features = map_binary_table(train->f_feature)) == NULL){
+      printf("unable to read feature file. "); return FAILURE;}
+    n_sample2 = m_features->nrow;
+    n_feature = m_features->ncol;
+  } else if ((t_features = read_table(train->f_feature, 
     &n_sample2, &n_feature)) == NULL){
   printf("unable to read feature file. "); return FAILURE;}
 
@@ -207,35 +246,78 @@ time_t TIME;
   alloc((void**)&r_response_val, n_sample_val, sizeof(float));
 
   alloc((void**)&is_train, n_sample, sizeof(bool));
+  alloc((void**)&row, n_sample, sizeof(int));
 
-  srand(time(NULL));
+  // the first n used samples are for training, or a random 
+  // draw of the used samples (partial Fisher-Yates shuffle)
+  for (s=0, k=0; s<n_sample; s++){
+    if (is_use[s]) row[k++] = s;
+  }
   for (k=0; k<n_sample_train; k++){
     if (train->random_split){
-      do {
-        s = rand() % n_sample;
-      } while (is_train[s]);
-    } else s = k;
-    is_train[s] = true;
+      j = k + rand() % (n_use-k);
+      s = row[j]; row[j] = row[k]; row[k] = s;
+    }
+    is_train[row[k]] = true;
   }
 
+  // position of each sample in the training (>= 0) or
+  // validation (< -1) arrays, -1 if the sample is not used
   for (s=0, k=0, j=0; s<n_sample; s++){
+    if (!is_use[s]){
+      row[s] = -1;
+      continue;
+    }
     fprintf(flog, "sample: %d, train: %d\n", s, is_train[s]);
     if (is_train[s]){
-      for (f=0; f<n_feature; f++) features_train[k][f] = t_features[s][f]/10000.0;
       r_response_train[k] = r_response[s];
       c_response_train[k] = c_response[s];
-      k++;
+      row[s] = k++;
     } else {
-      for (f=0; f<n_feature; f++) features_val[j][f] = t_features[s][f]/10000.0;
       r_response_val[j] = r_response[s];
       c_response_val[j] = c_response[s];
-      j++;
+      row[s] = -2-(j++);
     }
   }
 
+  if (m_features != NULL){
+
+    // column by column, the columns of a block are contiguous
+    for (b=0; b<m_features->nblock; b++){
+      for (f=0; f<n_feature; f++){
+        read_table_column(m_features, b, f, column);
+        for (k=0, s=m_features->block_row[b]; k<m_features->block_nrow[b]; k++, s++){
+          if (row[s] >= 0){
+            features_train[row[s]][f] = column[k]/10000.0;
+          } else if (row[s] < -1){
+            features_val[-2-row[s]][f] = column[k]/10000.0;
+          }
+        }
+      }
+    }
+
+    unmap_binary_table(m_features);
+
+  } else {
+
+    for (s=0; s<n_sample; s++){
+      if (row[s] >= 0){
+        for (f=0; f<n_feature; f++) features_train[row[s]][f] = t_features[s][f]/10000.0;
+      } else if (row[s] < -1){
+        for (f=0; f<n_feature; f++) features_val[-2-row[s]][f] = t_features[s][f]/10000.0;
+      }
+    }
+
+    free_2D((void**)t_features, n_sample);
+
+  }
+
+  free((void*)column);
+
 
   fprintf(flog, "\n");
   fprintf(flog, "Loaded %d samples and %d features\n", n_sample, n_feature);
+  fprintf(flog, "Using %d samples (%.2f%%)\n", n_use, train->per_subsample);
   fprintf(flog, "Training model with %d samples\n", n_sample_train);
   fprintf(flog, "Validating model with %d samples\n", n_sample_val);
 
@@ -243,6 +325,12 @@ time_t TIME;
   // get class priors
   class_priors(c_response, n_sample, train);
 
+  // select the model parameters with cross-validation
+  if (train->tune.kfold > 1){
+    tune_model(features_train, r_response_train, c_response_train, 
+      n_sample_train, n_feature, train, flog);
+  }
+
 
   Mat trainingDataMat(n_sample_train, n_feature, CV_32F, features_train[0]);
   Mat r_labelsMat(n_sample_train, 1, CV_32F, r_response_train);
@@ -289,8 +377,6 @@ time_t TIME;
   fprintf(flog, "____________________________________________________________________\n");
 
 
-  free_2D((void**)t_features, n_sample);
-  free_2D((void**)t_response, n_sample);
   free((void*)c_response);
   free((void*)r_response);
   free_2DC((void**)features_train);
@@ -300,6 +386,8 @@ time_t TIME;
   free((void*)c_response_val);
   free((void*)r_response_val);
   free((void*)is_train);
+  free((void*)is_use);
+  free((void*)row);
   free_param_train(train);
 
   fproctime_print(flog, "\nTraining", TIME);
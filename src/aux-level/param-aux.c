@@ -115,6 +115,14 @@ void write_par_ll_dem(FILE *fp, bool verbose){
   }
   fprintf(fp, "DEM_NODATA = -32767\n");
 
+  if (verbose){
+    fprintf(fp, "# This directory holds DEMs that were reprojected to the grid of an image.\n");
+    fprintf(fp, "# Images on the same grid (e.g. the same MGRS tile) will reuse these DEMs\n");
+    fprintf(fp, "# instead of reprojecting the DEM again. Use NULL to only cache in memory.\n");
+    fprintf(fp, "# Type: full directory path\n");
+  }
+  fprintf(fp, "DIR_DEM_CACHE = NULL\n");
+
   return;
 }
 
@@ -469,6 +477,15 @@ void write_par_ll_coreg(FILE *fp, bool verbose){
   }
   fprintf(fp, "COREG_BASE_NODATA = -9999\n");
 
+  if (verbose){
+    fprintf(fp, "# This directory holds base images that were reprojected to the grid of an\n");
+    fprintf(fp, "# image. Images on the same grid (e.g. the same MGRS tile) will reuse these\n");
+    fprintf(fp, "# base images instead of reprojecting the base image again. Use NULL to only\n");
+    fprintf(fp, "# cache in memory.\n");
+    fprintf(fp, "# Type: full directory path\n");
+  }
+  fprintf(fp, "DIR_COREG_CACHE = NULL\n");
+
   return;
 }
 
@@ -583,6 +600,26 @@ void write_par_ll_thread(FILE *fp, bool verbose){
   }
   fprintf(fp, "TIMEOUT_ZIP = 30\n");
 
+  if (verbose){
+    fprintf(fp, "# This parameter selects the GPUs, given as CUDA device IDs. The surface\n");
+    fprintf(fp, "# reflectance inversion is done on the first available device; this requires\n");
+    fprintf(fp, "# FORCE to be compiled with CUDA. Use -1 to process on the CPU.\n");
+    fprintf(fp, "# Type: Integer list. Valid range: [-1,15]\n");
+  }
+  fprintf(fp, "GPU_DEVICES = 0\n");
+
+  if (verbose){
+    fprintf(fp, "# This parameter enables NUMA-aware placement on multi-socket systems. NONE\n");
+    fprintf(fp, "# leaves the placement of threads and memory to the system. PIN spreads the\n");
+    fprintf(fp, "# threads of each process over the sockets, and places the image data on the\n");
+    fprintf(fp, "# socket whose threads process them. SOCKET binds each process of force-level2\n");
+    fprintf(fp, "# to one socket, and the processes are dealt to the sockets in turn. For a\n");
+    fprintf(fp, "# single image (force-l2ps), SOCKET behaves like PIN. This has no effect on\n");
+    fprintf(fp, "# systems with one socket.\n");
+    fprintf(fp, "# Type: Character. Valid values: {NONE,PIN,SOCKET}\n");
+  }
+  fprintf(fp, "NUMA_MODE = NONE\n");
+
   return;
 }
 
@@ -606,8 +643,12 @@ void write_par_ll_output(FILE *fp, bool verbose){
     fprintf(fp, "# with striped blocks according to the TILE_SIZE (X) and BLOCK_SIZE (Y) speci-\n");
     fprintf(fp, "# fications. Metadata are written to the ENVI header or directly into the Tiff\n");
     fprintf(fp, "# to the FORCE domain. If the size of the metadata exceeds the Tiff's limit,\n");
-    fprintf(fp, "# an external .aux.xml file is additionally generated.\n");
-    fprintf(fp, "# Type: Character. Valid values: {ENVI,GTiff,COG,CUSTOM}\n");
+    fprintf(fp, "# an external .aux.xml file is additionally generated. COGs are tiled, and\n");
+    fprintf(fp, "# have internal overviews (averages), which are computed from the data in\n");
+    fprintf(fp, "# memory. FCF is the FORCE chunk format: uncompressed arrays, stored chunk\n");
+    fprintf(fp, "# by chunk, that can be mapped into memory by force-higher-level; it cannot\n");
+    fprintf(fp, "# be read with GDAL.\n");
+    fprintf(fp, "# Type: Character. Valid values: {ENVI,GTiff,COG,FCF,CUSTOM}\n");
   }
   fprintf(fp, "OUTPUT_FORMAT = GTiff\n");
 
@@ -669,6 +710,24 @@ void write_par_ll_output(FILE *fp, bool verbose){
   }
   fprintf(fp, "OUTPUT_OVV = TRUE\n");
 
+  if (verbose){
+    fprintf(fp, "# Additionally output the products in the FORCE chunk format (.fcf)? These\n");
+    fprintf(fp, "# are uncompressed, pre-chunked arrays, which force-higher-level maps into\n");
+    fprintf(fp, "# memory without decoding. This is useful if the same time series is read\n");
+    fprintf(fp, "# repeatedly, but needs more disc space. Use OUTPUT_FORMAT = FCF to write\n");
+    fprintf(fp, "# this format instead of GDAL images. Not used if OUTPUT_FORMAT = FCF.\n");
+    fprintf(fp, "# Type: Logical. Valid values: {TRUE,FALSE}\n");
+  }
+  fprintf(fp, "OUTPUT_CHUNK_STORE = FALSE\n");
+
+  if (verbose){
+    fprintf(fp, "# Output a processing profile? Wall time, CPU time and memory of each\n");
+    fprintf(fp, "# processing stage are appended to force-l2ps_profile.csv in DIR_LOG.\n");
+    fprintf(fp, "# The profile is always printed to the logfile.\n");
+    fprintf(fp, "# Type: Logical. Valid values: {TRUE,FALSE}\n");
+  }
+  fprintf(fp, "OUTPUT_PROFILE = FALSE\n");
+
   return;
 }
 
@@ -687,6 +746,8 @@ void write_par_hl_dirs(FILE *fp, bool verbose){
 
   if (verbose){
     fprintf(fp, "# Lower Level datapool (parent directory of tiled input data)\n");
+    fprintf(fp, "# The datapool can also reside on an object store, given as GDAL\n");
+    fprintf(fp, "# virtual file system path, e.g. /vsis3/bucket/level2\n");
     fprintf(fp, "# Type: full directory path\n");
   }
   fprintf(fp, "DIR_LOWER = NULL\n");
@@ -773,6 +834,16 @@ void write_par_hl_extent(FILE *fp, bool verbose){
   }
   fprintf(fp, "BLOCK_SIZE = 0\n");
 
+  if (verbose){
+    fprintf(fp, "# This parameter enables the automatic choice of the blocksize. If TRUE,\n");
+    fprintf(fp, "# BLOCK_SIZE is ignored. The blocksize is aligned to the internal blocks of\n");
+    fprintf(fp, "# the input images, and is chosen from the number of images in the first\n");
+    fprintf(fp, "# tile with data, the used products, the measured read performance, and the\n");
+    fprintf(fp, "# MEMORY_BUDGET (or a quarter of the RAM if there is no budget).\n");
+    fprintf(fp, "# Type: Logical. Valid values: {TRUE,FALSE}\n");
+  }
+  fprintf(fp, "BLOCK_SIZE_AUTO = FALSE\n");
+
   if (verbose){
     fprintf(fp, "# Analysis resolution. The tile (and block) size must be dividable by this\n");
     fprintf(fp, "# resolution without remainder, e.g. 30m resolution with 100km tiles is not possible\n");
@@ -897,6 +968,15 @@ void write_par_hl_qai(FILE *fp, bool verbose){
   }
   fprintf(fp, "SCREEN_QAI = NODATA CLOUD_OPAQUE CLOUD_BUFFER CLOUD_CIRRUS CLOUD_SHADOW SNOW SUBZERO SATURATION\n");
 
+  if (verbose){
+    fprintf(fp, "# Merge observations of the same sensor and day, e.g. adjacent granules or\n");
+    fprintf(fp, "# scenes of the same orbit, into one observation when reading the data. This\n");
+    fprintf(fp, "# reduces the number of mostly empty observations. FIRST takes the first valid\n");
+    fprintf(fp, "# pixel, QAI prefers pixels that pass the SCREEN_QAI filter. NONE disables.\n");
+    fprintf(fp, "# Type: Character. Valid values: {NONE,FIRST,QAI}\n");
+  }
+  fprintf(fp, "MERGE_SAMEDAY = NONE\n");
+
   return;
 }
 
@@ -983,8 +1063,17 @@ void write_par_hl_output(FILE *fp, bool verbose){
     fprintf(fp, "# with striped blocks according to the TILE_SIZE (X) and BLOCK_SIZE (Y) speci-\n");
     fprintf(fp, "# fications. Metadata are written to the ENVI header or directly into the Tiff\n");
     fprintf(fp, "# to the FORCE domain. If the size of the metadata exceeds the Tiff's limit,\n");
-    fprintf(fp, "# an external .aux.xml file is additionally generated.\n");
-    fprintf(fp, "# Type: Character. Valid values: {ENVI,GTiff,COG,CUSTOM}\n");
+    fprintf(fp, "# an external .aux.xml file is additionally generated. COGs are tiled, and\n");
+    fprintf(fp, "# have internal overviews (averages), which are computed from the data in\n");
+    fprintf(fp, "# memory. FCF is the FORCE chunk format: uncompressed arrays, stored chunk\n");
+    fprintf(fp, "# by chunk, that can be mapped into memory by force-higher-level; it cannot\n");
+    fprintf(fp, "# be read with GDAL. ZARR writes Zarr (v2) arrays with the dimensions band,\n");
+    fprintf(fp, "# y, x. Each block is written as independent, zlib-compressed chunk files\n");
+    fprintf(fp, "# without locking; the time series of a pixel is contiguous within a chunk.\n");
+    fprintf(fp, "# The number of bands per chunk (TIME_CHUNK, 0: all), the compression\n");
+    fprintf(fp, "# (COMPRESS = ZLIB or NONE) and ZLEVEL can be set with OUTPUT_FORMAT = CUSTOM\n");
+    fprintf(fp, "# and DRIVER = ZARR.\n");
+    fprintf(fp, "# Type: Character. Valid values: {ENVI,GTiff,COG,FCF,ZARR,CUSTOM}\n");
   }
   fprintf(fp, "OUTPUT_FORMAT = GTiff\n");
 
@@ -1008,6 +1097,14 @@ void write_par_hl_output(FILE *fp, bool verbose){
   }
   fprintf(fp, "OUTPUT_EXPLODE = FALSE\n");
 
+  if (verbose){
+    fprintf(fp, "# If the output is exploded into single-band files, this parameter controls\n");
+    fprintf(fp, "# whether a VRT is written, which stacks all single-band files of a product.\n");
+    fprintf(fp, "# The VRT carries the FORCE metadata of the product and its bands.\n");
+    fprintf(fp, "# Type: Logical. Valid values: {TRUE,FALSE}\n");
+  }
+  fprintf(fp, "OUTPUT_VRT = FALSE\n");
+
   //if (verbose){
   //  fprintf(fp, "# If an output file already exists.. Overwrite?\n");
   //  fprintf(fp, "# Type: Logical. Valid values: {TRUE,FALSE}\n");
@@ -1043,6 +1140,127 @@ void write_par_hl_thread(FILE *fp, bool verbose){
   fprintf(fp, "NTHREAD_COMPUTE = 22\n");
   fprintf(fp, "NTHREAD_WRITE = 4\n");
 
+  if (verbose){
+    fprintf(fp, "# This parameter enables the automatic tuning of the thread split. If TRUE,\n");
+    fprintf(fp, "# the NTHREAD_* parameters are used as starting point. While processing,\n");
+    fprintf(fp, "# threads are moved to the team that was the bottleneck during the last few\n");
+    fprintf(fp, "# blocks. The total number of threads remains the same. This only applies\n");
+    fprintf(fp, "# to STREAM_SCHEDULER = PIPELINE.\n");
+    fprintf(fp, "# Type: Logical. Valid values: {TRUE,FALSE}\n");
+  }
+  fprintf(fp, "NTHREAD_AUTO = FALSE\n");
+
+  if (verbose){
+    fprintf(fp, "# This parameter defines how many blocks may be buffered between the teams.\n");
+    fprintf(fp, "# With 1, the teams advance in lockstep. Larger values allow the Input and\n");
+    fprintf(fp, "# Output teams to run ahead or lag behind if block processing times vary,\n");
+    fprintf(fp, "# at the cost of holding more blocks in memory.\n");
+    fprintf(fp, "# Type: Integer. Valid range: [1,64]\n");
+  }
+  fprintf(fp, "STREAM_DEPTH = 2\n");
+
+  if (verbose){
+    fprintf(fp, "# This parameter defines a memory budget in GB for the buffered blocks. The\n");
+    fprintf(fp, "# memory needed for each block is estimated from the file listing before\n");
+    fprintf(fp, "# reading. If the budget would be exceeded, reading is delayed until enough\n");
+    fprintf(fp, "# memory was released. A block that alone exceeds the budget is read anyway;\n");
+    fprintf(fp, "# reduce BLOCK_SIZE in this case. Use 0 to disable the budget.\n");
+    fprintf(fp, "# Type: Double. Valid range: [0,...\n");
+  }
+  fprintf(fp, "MEMORY_BUDGET = 0\n");
+
+  if (verbose){
+    fprintf(fp, "# This parameter selects the streaming scheduler. PIPELINE uses three fixed\n");
+    fprintf(fp, "# teams for Input, Processing, and Output. TASK turns the reading, processing\n");
+    fprintf(fp, "# and writing of each block into tasks, and the three workers pick up any\n");
+    fprintf(fp, "# task that is ready. Thus, two blocks may be read at the same time if input\n");
+    fprintf(fp, "# is the bottleneck, or two blocks may be written if output is the bottle-\n");
+    fprintf(fp, "# neck. The NTHREAD_* parameters give the sub-threads of each task. At most\n");
+    fprintf(fp, "# STREAM_DEPTH blocks are buffered.\n");
+    fprintf(fp, "# Type: Character. Valid values: {PIPELINE,TASK}\n");
+  }
+  fprintf(fp, "STREAM_SCHEDULER = PIPELINE\n");
+
+  if (verbose){
+    fprintf(fp, "# This parameter enables NUMA-aware placement on multi-socket systems. NONE\n");
+    fprintf(fp, "# leaves the placement of threads and memory to the system. PIN spreads the\n");
+    fprintf(fp, "# threads of each team over the sockets, and places the pixels of each block\n");
+    fprintf(fp, "# on the socket whose threads compute them. SOCKET gives each socket its own\n");
+    fprintf(fp, "# pipeline: each block is read, processed and written on one socket, and the\n");
+    fprintf(fp, "# TASK scheduler is used with one Processing worker per socket. The NTHREAD_*\n");
+    fprintf(fp, "# parameters are divided among the sockets. STREAM_DEPTH should be at least\n");
+    fprintf(fp, "# the number of sockets. This has no effect on systems with one socket.\n");
+    fprintf(fp, "# Type: Character. Valid values: {NONE,PIN,SOCKET}\n");
+  }
+  fprintf(fp, "NUMA_MODE = NONE\n");
+
+  if (verbose){
+    fprintf(fp, "# This parameter backs the large buffers of ARD and output products with\n");
+    fprintf(fp, "# huge pages, which reduces TLB misses on large blocks. NONE uses regular\n");
+    fprintf(fp, "# pages. TRANSPARENT requests transparent huge pages, which are used if the\n");
+    fprintf(fp, "# kernel enables them (madvise or always). EXPLICIT uses the huge pages that\n");
+    fprintf(fp, "# were reserved by the administrator (vm.nr_hugepages), and falls back to\n");
+    fprintf(fp, "# transparent huge pages when they are exhausted.\n");
+    fprintf(fp, "# Type: Character. Valid values: {NONE,TRANSPARENT,EXPLICIT}\n");
+  }
+  fprintf(fp, "HUGE_PAGES = NONE\n");
+
+  if (verbose){
+    fprintf(fp, "# This parameter sets the order in which the tiles are processed. NONE keeps\n");
+    fprintf(fp, "# the order of the tile allow-list, or processes the tiles row by row. ZORDER\n");
+    fprintf(fp, "# and HILBERT traverse the tiles along a space-filling curve, such that\n");
+    fprintf(fp, "# consecutive tiles are mostly neighbors, and share ARD files, halo data, and\n");
+    fprintf(fp, "# cached datasets. The chunks of a tile are always processed in sequence.\n");
+    fprintf(fp, "# Type: Character. Valid values: {NONE,ZORDER,HILBERT}\n");
+  }
+  fprintf(fp, "TILE_ORDER = NONE\n");
+
+  if (verbose){
+    fprintf(fp, "# This parameter enables distributed processing. If a directory is given,\n");
+    fprintf(fp, "# several force-higher-level processes - e.g. on different nodes of a cluster -\n");
+    fprintf(fp, "# that use the same parameter file share the tiles dynamically. Each process\n");
+    fprintf(fp, "# claims the next free tile by creating a claim file in this directory. The\n");
+    fprintf(fp, "# directory needs to be accessible from all nodes (shared filesystem), and\n");
+    fprintf(fp, "# should be empty when a new run is started. The timing of all processes is\n");
+    fprintf(fp, "# gathered in this directory. Use NULL to disable distributed processing.\n");
+    fprintf(fp, "# Type: full directory path\n");
+  }
+  fprintf(fp, "DIR_DISTRIBUTE = NULL\n");
+
+  if (verbose){
+    fprintf(fp, "# This parameter enables performance telemetry. If a file is given, one JSON\n");
+    fprintf(fp, "# record is appended per block, holding the tile, chunk, number of datasets,\n");
+    fprintf(fp, "# bytes read, wall-clock seconds for Input, Processing, and Output, as well\n");
+    fprintf(fp, "# as for QAI screening, noise screening, spectral adjustment, and the sub-\n");
+    fprintf(fp, "# module itself, the number of threads, and the peak resident memory. The\n");
+    fprintf(fp, "# memory of the image data is accounted by owner, i.e. the input, each (sub-)\n");
+    fprintf(fp, "# module, and each output product, with the bytes held, and the peak since\n");
+    fprintf(fp, "# the previous record. Use NULL to disable telemetry.\n");
+    fprintf(fp, "# Type: full file path\n");
+  }
+  fprintf(fp, "FILE_TELEMETRY = NULL\n");
+
+  if (verbose){
+    fprintf(fp, "# This parameter enables resumable processing. If a file is given, each block\n");
+    fprintf(fp, "# is recorded in this journal after all of its products were written. When\n");
+    fprintf(fp, "# a killed run is restarted with the same journal, the recorded blocks are\n");
+    fprintf(fp, "# skipped. Delete the journal to process everything again. Use NULL to\n");
+    fprintf(fp, "# disable the journal.\n");
+    fprintf(fp, "# Type: full file path\n");
+  }
+  fprintf(fp, "FILE_JOURNAL = NULL\n");
+
+  if (verbose){
+    fprintf(fp, "# This parameter selects the GPUs, given as CUDA device IDs. Submodules that\n");
+    fprintf(fp, "# support GPU offloading process the blocks on these devices; this requires\n");
+    fprintf(fp, "# FORCE to be compiled with CUDA. If several devices are given, each block\n");
+    fprintf(fp, "# is sent to the least loaded device, and the TASK scheduler is used with one\n");
+    fprintf(fp, "# Processing worker per device. STREAM_DEPTH should be at least the number\n");
+    fprintf(fp, "# of devices to keep all of them busy. Use -1 to process on the CPU.\n");
+    fprintf(fp, "# Type: Integer list. Valid range: [-1,15]\n");
+  }
+  fprintf(fp, "GPU_DEVICES = 0\n");
+
   return;
 }
 
@@ -1104,7 +1322,10 @@ void write_par_hl_bap(FILE *fp, bool verbose){
     fprintf(fp, "# the turn of the year). If p0 > p1: p0 is from previous year, e.g. p0 = 330,\n");
     fprintf(fp, "# p1 = 30, p2 = 90. If p2 < p1: p2 is from next year, e.g. p0 = 300, p1 = 330,\n");
     fprintf(fp, "# p2 = 30.\n");
-    fprintf(fp, "# Type: Integer list, 3 values. Valid values: [1,365]\n");
+    fprintf(fp, "# Several targets can be composited in the same run by giving several\n");
+    fprintf(fp, "# triplets, e.g. DOY_STATIC = 60 90 120 150 180 210 240 270 300. One set\n");
+    fprintf(fp, "# of products is written for each target.\n");
+    fprintf(fp, "# Type: Integer list, 3 values (per target). Valid values: [1,365]\n");
   }
   fprintf(fp, "DOY_STATIC = 120 180 240\n");
 
@@ -1301,10 +1522,22 @@ void write_par_hl_index(FILE *fp, bool verbose){
     fprintf(fp, "# Type: Character list. Valid values: {BLUE,GREEN,RED,NIR,SWIR1,SWIR2,RE1,\n");
     fprintf(fp, "#   RE2,RE3,BNIR,NDVI,EVI,NBR,NDTI,ARVI,SAVI,SARVI,TC-BRIGHT,TC-GREEN,TC-WET,\n");
     fprintf(fp, "#   TC-DI,NDBI,NDWI,MNDWI,NDMI,NDSI,SMA,kNDVI,NDRE1,NDRE2,CIre,NDVIre1,NDVIre2,\n");
-    fprintf(fp, "#   NDVIre3,NDVIre1n,NDVIre2n,NDVIre3n,MSRre,MSRren,CCI}\n");
+    fprintf(fp, "#   NDVIre3,NDVIre1n,NDVIre2n,NDVIre3n,MSRre,MSRren,CCI,EXPRESSION}\n");
   }
   fprintf(fp, "INDEX = NDVI EVI NBR\n");
 
+  if (verbose){
+    fprintf(fp, "# User-defined band-math indices. Each EXPRESSION in INDEX is computed with\n");
+    fprintf(fp, "# the next expression given here. An expression uses the bands BLUE,GREEN,\n");
+    fprintf(fp, "# RED,RE1,RE2,RE3,BNIR,NIR,SWIR0,SWIR1,SWIR2,VV,VH (scaled to reflectance),\n");
+    fprintf(fp, "# numbers, the operators + - * / ^, parentheses, and the functions sqrt,\n");
+    fprintf(fp, "# abs, exp, log, min and max. The result is scaled by 10000. Expressions must\n");
+    fprintf(fp, "# not contain blanks. An optional prefix of up to 3 characters names the\n");
+    fprintf(fp, "# index in the filenames (default: X01, X02, ...), e.g. NMI:(NIR-SWIR1)/(NIR+SWIR1)\n");
+    fprintf(fp, "# Type: Character list. Valid values: {NULL,expressions}\n");
+  }
+  fprintf(fp, "INDEX_EXPRESSION = NULL\n");
+
   if (verbose){
     fprintf(fp, "# Standardize the TSS time series with pixel mean and/or standard deviation?\n");
     fprintf(fp, "# Type: Logical. Valid values: {NONE,NORMALIZE,CENTER}\n");
@@ -1318,6 +1551,15 @@ void write_par_hl_index(FILE *fp, bool verbose){
   }
   fprintf(fp, "OUTPUT_TSS = FALSE\n");
 
+  if (verbose){
+    fprintf(fp, "# Directory of the spectral index cache. The quality-screened time series of\n");
+    fprintf(fp, "# each index are stored per tile and chunk, and are re-used by later runs with\n");
+    fprintf(fp, "# the same ARD, sensors, QAI rules and mask, e.g. when experimenting with\n");
+    fprintf(fp, "# interpolation, STM or fold settings. Use NULL to disable the cache.\n");
+    fprintf(fp, "# Type: full directory path\n");
+  }
+  fprintf(fp, "DIR_INDEX_CACHE = NULL\n");
+
   return;
 }
 
@@ -1434,6 +1676,17 @@ void write_par_hl_tsi(FILE *fp, bool verbose){
   }
   fprintf(fp, "INT_DAY = 16\n");
 
+  if (verbose){
+    fprintf(fp, "# Temporal chunking of the interpolation: number of interpolation steps that\n");
+    fprintf(fp, "# are held in memory at once. STM and folds are accumulated window by window,\n");
+    fprintf(fp, "# such that memory does not grow with the length of the time series. This is\n");
+    fprintf(fp, "# only used for LINEAR, MOVING and RBF interpolation, if neither TSI, NRT,\n");
+    fprintf(fp, "# LSP, POL nor UDF outputs are requested, and STM and folds do not use\n");
+    fprintf(fp, "# quantiles. 0 processes all steps at once.\n");
+    fprintf(fp, "# Type: Integer. Valid range: [0,...\n");
+  }
+  fprintf(fp, "INT_WINDOW = 0\n");
+
   if (verbose){
     fprintf(fp, "# Standardize the TSI time series with pixel mean and/or standard deviation?\n");
     fprintf(fp, "# Type: Logical. Valid values: {NONE,NORMALIZE,CENTER}\n");
@@ -1486,7 +1739,11 @@ void write_par_hl_pyp(FILE *fp, bool verbose){
     fprintf(fp, "# processing unit as 4D-nd.array [nDates, nBands, nrows, ncols]. No parallelization is  \n");
     fprintf(fp, "# done on FORCE's end.\n");
     fprintf(fp, "#     ``def forcepy_block(inblock, outblock, dates, sensors, bandnames, nodata, nproc):``\n");
-    fprintf(fp, "# Type: Character. Valid values: {PIXEL,BLOCK}\n");
+    fprintf(fp, "# 3) ``BATCH`` expects a vectorized function that receives a batch of pixels as 3D-nd.array\n");
+    fprintf(fp, "# [nDates, nBands, nPixels], and fills outarray [nOutBands, nPixels]. Batches of rows\n");
+    fprintf(fp, "# are executed in parallel with ``NTHREAD_COMPUTE`` workers.\n");
+    fprintf(fp, "#     ``def forcepy_batch(inarray, outarray, dates, sensors, bandnames, nodata, nproc):``\n");
+    fprintf(fp, "# Type: Character. Valid values: {PIXEL,BLOCK,BATCH}\n");
   }
   fprintf(fp, "PYTHON_TYPE = PIXEL\n");
 
@@ -1535,6 +1792,36 @@ void write_par_hl_rsp(FILE *fp, bool verbose){
 }
 
 
+/** This function writes parameters into a parameter skeleton file: higher
++++ level native UDF pars
+--- fp:      parameter skeleton file
+--- verbose: add description, or use more compact format for experts?
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void write_par_hl_nat(FILE *fp, bool verbose){
+
+
+  fprintf(fp, "\n# NATIVE UDF PARAMETERS\n");
+  fprintf(fp, "# ------------------------------------------------------------------------\n");
+
+  if (verbose){
+    fprintf(fp, "# This file specifies a shared object (.so) that implements a native UDF, see\n");
+    fprintf(fp, "# native-udf-abi-hl.h for the interface. You can skip this by setting\n");
+    fprintf(fp, "# FILE_NATIVE = NULL, but this requires OUTPUT_NAT = FALSE.\n");
+    fprintf(fp, "# Type: full file path\n");
+  }
+  fprintf(fp, "FILE_NATIVE = NULL\n");
+
+  if (verbose){
+    fprintf(fp, "# Output the results provided by the native UDF? If TRUE, FILE_NATIVE must exist.\n");
+    fprintf(fp, "# Type: Logical. Valid values: {TRUE,FALSE}\n");
+  }
+  fprintf(fp, "OUTPUT_NAT = FALSE\n");
+
+  return;
+}
+
+
 /** This function writes parameters into a parameter skeleton file: higher
 +++ level STM pars
 --- fp:      parameter skeleton file
@@ -2293,6 +2580,14 @@ void write_par_hl_smp(FILE *fp, bool verbose){
   fprintf(fp, "\n# SAMPLING\n");
   fprintf(fp, "# ------------------------------------------------------------------------\n");
 
+  if (verbose){
+    fprintf(fp, "# Sampling mode. POINTS samples the features at the coordinates in\n");
+    fprintf(fp, "# FILE_POINTS. ZONES computes the statistics of the features within the\n");
+    fprintf(fp, "# polygons in FILE_ZONES; no raster product needs to be written before.\n");
+    fprintf(fp, "# Type: Character. Valid values: {POINTS,ZONES}\n");
+  }
+  fprintf(fp, "SAMPLE_MODE = POINTS\n");
+
   if (verbose){
     fprintf(fp, "# File with coordinates, at which the features should be sampled.\n");
     fprintf(fp, "# 1st column: x-coordinate, 2nd column: y-coordinate, 3rd column: response\n");
@@ -2300,22 +2595,45 @@ void write_par_hl_smp(FILE *fp, bool verbose){
   }
   fprintf(fp, "FILE_POINTS = NULL\n");
 
+  if (verbose){
+    fprintf(fp, "# Vector file with polygons (zones), in which the statistics of the\n");
+    fprintf(fp, "# features are computed. Only used if SAMPLE_MODE = ZONES.\n");
+    fprintf(fp, "# Type: full file path\n");
+  }
+  fprintf(fp, "FILE_ZONES = NULL\n");
+
+  if (verbose){
+    fprintf(fp, "# Integer attribute of FILE_ZONES, which holds the zone IDs. Polygons\n");
+    fprintf(fp, "# with the same ID are merged into one zone.\n");
+    fprintf(fp, "# Type: Character.\n");
+  }
+  fprintf(fp, "ZONE_ATTRIBUTE = ID\n");
+
+  if (verbose){
+    fprintf(fp, "# Percentiles of the features that are computed in each zone.\n");
+    fprintf(fp, "# Type: Integer list. Valid range: [0,100]\n");
+  }
+  fprintf(fp, "ZONE_PERCENTILES = 25 50 75\n");
+
   if (verbose){
     fprintf(fp, "# File with sampled features. This file should not exist.\n");
+    fprintf(fp, "# For ZONES, this file holds the count, mean, standard deviation,\n");
+    fprintf(fp, "# minimum, maximum, and percentiles of each feature per zone.\n");
     fprintf(fp, "# Type: full file path\n");
   }
   fprintf(fp, "FILE_SAMPLE = NULL\n");
 
   if (verbose){
     fprintf(fp, "# File with the response variable corresponding to the sampled features.\n");
-    fprintf(fp, "# This file should not exist.\n");
+    fprintf(fp, "# For ZONES, this file holds the zone IDs. This file should not exist.\n");
     fprintf(fp, "# Type: full file path\n");
   }
   fprintf(fp, "FILE_RESPONSE = NULL\n");
 
   if (verbose){
     fprintf(fp, "# File with the coordinates corresponding to the sampled features.\n");
-    fprintf(fp, "# This file should not exist.\n");
+    fprintf(fp, "# For ZONES, this file holds the centroids of the zones (in the\n");
+    fprintf(fp, "# projection of FILE_ZONES). This file should not exist.\n");
     fprintf(fp, "# Type: full file path\n");
   }
   fprintf(fp, "FILE_COORDINATES = NULL\n");
@@ -2327,6 +2645,14 @@ void write_par_hl_smp(FILE *fp, bool verbose){
   }
   fprintf(fp, "PROJECTED = FALSE\n");
 
+  if (verbose){
+    fprintf(fp, "# Format of FILE_SAMPLE, FILE_RESPONSE and FILE_COORDINATES. TEXT writes\n");
+    fprintf(fp, "# space-separated text. BINARY writes a binary columnar table, which is\n");
+    fprintf(fp, "# faster to write and read. force-train reads both formats.\n");
+    fprintf(fp, "# Type: Character. Valid values: {TEXT,BINARY}\n");
+  }
+  fprintf(fp, "SAMPLE_FORMAT = TEXT\n");
+
   return;
 }
 
@@ -2466,7 +2792,8 @@ void write_par_aux_train(FILE *fp, bool verbose){
     fprintf(fp, "# The file needs to be a table with features in columns, and samples in rows.\n");
     fprintf(fp, "# Column delimiter is whitespace. The same number of features must be given\n");
     fprintf(fp, "# for each sample. Do not include a header. The samples need to match the\n");
-    fprintf(fp, "# response file.\n");
+    fprintf(fp, "# response file. Binary tables (force-higher-level, SAMPLE_FORMAT = BINARY)\n");
+    fprintf(fp, "# are mapped into memory and loaded column by column without parsing.\n");
     fprintf(fp, "# Type: full file path\n");
   }
   fprintf(fp, "FILE_FEATURES = NULL\n");
@@ -2505,6 +2832,15 @@ void write_par_aux_train(FILE *fp, bool verbose){
   }
   fprintf(fp, "RESPONSE_VARIABLE = 1\n");
 
+  if (verbose){
+    fprintf(fp, "# This parameter specifies how many samples (in %%) should be used at all.\n");
+    fprintf(fp, "# The samples are drawn randomly while loading; for the classification\n");
+    fprintf(fp, "# flavor, they are drawn per class (stratified), such that the class pro-\n");
+    fprintf(fp, "# portions are retained. Use 100 to load all samples.\n");
+    fprintf(fp, "# Type: Float. Valid range: ]0,100]\n");
+  }
+  fprintf(fp, "PERCENT_SUBSAMPLE = 100\n");
+
   if (verbose){
     fprintf(fp, "# This parameter specifies how many samples (in %%) should be used for\n");
     fprintf(fp, "# training the model. The other samples are left out, and used to vali-\n");
@@ -2656,6 +2992,40 @@ void write_par_aux_train(FILE *fp, bool verbose){
   }
   fprintf(fp, "SVM_GAMMA_GRID = 0.000010 10000 10\n");
 
+  fprintf(fp, "\n# HYPERPARAMETER TUNING\n");
+  fprintf(fp, "# ------------------------------------------------------------------------\n");
+  fprintf(fp, "# This block selects the model parameters with k-fold cross-validation\n");
+  fprintf(fp, "# ------------------------------------------------------------------------\n");
+
+  if (verbose){
+    fprintf(fp, "# Number of cross-validation folds for the parameter search. The training\n");
+    fprintf(fp, "# samples are divided into k subsets. Each parameter set is trained k times\n");
+    fprintf(fp, "# on k-1 subsets, and tested on the remaining subset. All folds of all para-\n");
+    fprintf(fp, "# meter sets are run in parallel. The parameter set with the best mean score\n");
+    fprintf(fp, "# (OA or RMSE) is used for the final model. Set to 0 to disable the tuning.\n");
+    fprintf(fp, "# For SVMs, the grid is given by SVM_C_GRID and SVM_GAMMA_GRID; the tuning\n");
+    fprintf(fp, "# replaces the sequential search of SVM_KFOLD.\n");
+    fprintf(fp, "# Type: Integer. Valid values: 0 or [2,...\n");
+  }
+  fprintf(fp, "TUNE_KFOLD = 0\n");
+
+  if (verbose){
+    fprintf(fp, "# Number of parameter sets that are randomly drawn from the grid (random\n");
+    fprintf(fp, "# search). Set to 0 to evaluate the full grid (grid search).\n");
+    fprintf(fp, "# Type: Integer. Valid range: [0,...\n");
+  }
+  fprintf(fp, "TUNE_NRANDOM = 0\n");
+
+  if (verbose){
+    fprintf(fp, "# Grid of the Random Forest parameters RF_NTREE, RF_NFEATURE, RF_DT_MAXDEPTH,\n");
+    fprintf(fp, "# and RF_DT_MINSAMPLE. Each parameter expects a list of candidate values.\n");
+    fprintf(fp, "# Type: Integer list. Valid range: see RF_* parameters\n");
+  }
+  fprintf(fp, "TUNE_RF_NTREE = 100 250 500\n");
+  fprintf(fp, "TUNE_RF_NFEATURE = 0\n");
+  fprintf(fp, "TUNE_RF_DT_MAXDEPTH = 0\n");
+  fprintf(fp, "TUNE_RF_DT_MINSAMPLE = 0\n");
+
   return;
 }
 
@@ -68,6 +68,7 @@ void write_par_hl_sma(FILE *fp, bool verbose);
 void write_par_hl_tsi(FILE *fp, bool verbose);
 void write_par_hl_pyp(FILE *fp, bool verbose);
 void write_par_hl_rsp(FILE *fp, bool verbose);
+void write_par_hl_nat(FILE *fp, bool verbose);
 void write_par_hl_stm(FILE *fp, bool verbose);
 void write_par_hl_fold(FILE *fp, bool verbose);
 void write_par_hl_lsp(FILE *fp, bool verbose);
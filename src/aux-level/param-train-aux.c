@@ -45,6 +45,7 @@ void register_train(params_t *params, par_train_t *train){
   register_char_par(params,     "FILE_MODEL",            _CHAR_TEST_NONE_,  &train->f_model);
   register_char_par(params,     "FILE_LOG",              _CHAR_TEST_NONE_,  &train->f_log);
   register_int_par(params,      "RESPONSE_VARIABLE",     1, INT_MAX, &train->response_var);
+  register_float_par(params,    "PERCENT_SUBSAMPLE",     0.001, 100, &train->per_subsample);
   register_float_par(params,    "PERCENT_TRAIN",         0.001, 100, &train->per_train);
   register_bool_par(params,     "RANDOM_SPLIT",          &train->random_split);
   register_charvec_par(params,  "FEATURE_WEIGHTS",       _CHAR_TEST_NONE_, &train->class_weights, &train->nclass_weights);
@@ -62,6 +63,12 @@ void register_train(params_t *params, par_train_t *train){
   register_float_par(params,    "SVM_P",                 0, INT_MAX, &train->sv.P);
   register_floatvec_par(params, "SVM_C_GRID",            0, INT_MAX, &train->sv.Cgrid, &train->sv.nCgrid);
   register_floatvec_par(params, "SVM_GAMMA_GRID",        0, INT_MAX, &train->sv.Gammagrid, &train->sv.nGammagrid);
+  register_int_par(params,      "TUNE_KFOLD",            0, INT_MAX, &train->tune.kfold);
+  register_int_par(params,      "TUNE_NRANDOM",          0, INT_MAX, &train->tune.nrandom);
+  register_intvec_par(params,   "TUNE_RF_NTREE",         1, INT_MAX, &train->tune.ntree, &train->tune.nntree);
+  register_intvec_par(params,   "TUNE_RF_NFEATURE",      0, INT_MAX, &train->tune.feature_subset, &train->tune.nfeature_subset);
+  register_intvec_par(params,   "TUNE_RF_DT_MAXDEPTH",   0, INT_MAX, &train->tune.max_depth, &train->tune.nmax_depth);
+  register_intvec_par(params,   "TUNE_RF_DT_MINSAMPLE",  0, INT_MAX, &train->tune.min_sample, &train->tune.nmin_sample);
 
 
   return;
@@ -157,6 +164,9 @@ float sum = 0.0, tol=0.01;
   if (train->sv.Gammagrid[_MIN_] > train->sv.Gammagrid[_MAX_]){
     printf("SVM_GAMMA_GRID looks odd It needs to be a list of 3 floats: minVal maxVal logStep.\n"); return FAILURE;}
 
+  if (train->tune.kfold == 1){
+    printf("TUNE_KFOLD needs to be 0 (no tuning) or at least 2.\n"); return FAILURE;}
+
   if (train->nclass_weights == 1){
     if (strcmp(train->class_weights[0], "EQUALIZED")        != 0 && 
         strcmp(train->class_weights[0], "PROPORTIONAL")     != 0 && 
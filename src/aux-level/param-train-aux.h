@@ -66,6 +66,16 @@ typedef struct {
   par_dt_t dt;
 } par_rf_t;
 
+// hyperparameter tuning parameters
+typedef struct {
+  int kfold;
+  int nrandom;
+  int *ntree, nntree;
+  int *feature_subset, nfeature_subset;
+  int *max_depth, nmax_depth;
+  int *min_sample, nmin_sample;
+} par_tune_t;
+
 // training parameters
 typedef struct {
   params_t *params;
@@ -76,7 +86,9 @@ typedef struct {
   char *f_log;
   par_sv_t sv;
   par_rf_t rf;
+  par_tune_t tune;
   int method;
+  float per_subsample;
   float per_train;
   int random_split;
   int response_var;
@@ -28,13 +28,15 @@ This file contains functions for training machine learning models
 #include "train-aux.h"
 
 
-/** This function trains a Support Vector Machine model
---- TrainData: training data
+// number of samples that are predicted together
+#define TRAIN_BATCH 4096
+
+
+/** This function sets up a Support Vector Machine model
 --- train:     train parameters
-+++ Return:    model
++++ Return:    model (untrained)
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-Ptr<StatModel> train_svm(Ptr<TrainData> TrainData, par_train_t *train, FILE *fp){
-int i;
+Ptr<SVM> configure_svm(par_train_t *train){
 
 
   Ptr<SVM> svm = SVM::create();
@@ -73,6 +75,26 @@ int i;
     svm->setClassWeights(priors);
   }
 
+  return svm;
+}
+
+
+/** This function trains a Support Vector Machine model. C and Gamma are
++++ chosen with a grid search, unless the grids are collapsed to one value
+--- TrainData: training data
+--- train:     train parameters
++++ Return:    model
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+Ptr<StatModel> train_svm(Ptr<TrainData> TrainData, par_train_t *train, FILE *fp){
+int i;
+
+
+  Ptr<SVM> svm = configure_svm(train);
+
+  // collapsed grids give fixed values
+  if (train->sv.Cgrid[_MIN_] == train->sv.Cgrid[_MAX_]) svm->setC(train->sv.Cgrid[_MIN_]);
+  if (train->sv.Gammagrid[_MIN_] == train->sv.Gammagrid[_MAX_]) svm->setGamma(train->sv.Gammagrid[_MIN_]);
+
   ParamGrid Cgrid = SVM::getDefaultGrid(SVM::C);
   ParamGrid Gammagrid = SVM::getDefaultGrid(SVM::GAMMA);
 
@@ -88,7 +110,12 @@ int i;
   ParamGrid Coefgrid = SVM::getDefaultGrid(SVM::COEF); Coefgrid.logStep = 0; Coefgrid.minVal = 1e3; Coefgrid.maxVal = 1e3;
   ParamGrid Degreegrid = SVM::getDefaultGrid(SVM::DEGREE); Degreegrid.logStep = 0; Degreegrid.minVal = 1e3; Degreegrid.maxVal = 1e3;
 
-  svm->trainAuto(TrainData, train->sv.kfold, Cgrid, Gammagrid, Pgrid, Nugrid, Coefgrid, Degreegrid, false);
+  if (train->sv.Cgrid[_MIN_] == train->sv.Cgrid[_MAX_] &&
+      train->sv.Gammagrid[_MIN_] == train->sv.Gammagrid[_MAX_]){
+    svm->train(TrainData, 0);
+  } else {
+    svm->trainAuto(TrainData, train->sv.kfold, Cgrid, Gammagrid, Pgrid, Nugrid, Coefgrid, Degreegrid, false);
+  }
 
   fprintf(fp, "\nSupport Vector Machine parameters\n");
   fprintf(fp, "--------------------------------------------------------------------\n");
@@ -115,18 +142,15 @@ int i;
 }
 
 
-/** This function trains a Random Forest model
---- TrainData: training data
+/** This function sets up a Random Forest model
 --- train:     train parameters
-+++ Return:    model
+--- n_feature: number of features
++++ Return:    model (untrained)
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-Ptr<StatModel> train_rf(Ptr<TrainData> TrainData, par_train_t *train, FILE *fp){
-int v, i;
-int n_feature;
+Ptr<RTrees> configure_rf(par_train_t *train, int n_feature){
 
 
   Ptr<RTrees> rf = RTrees::create();
-  n_feature = TrainData->getNVars();
 
 
   // parameterize forest
@@ -179,6 +203,21 @@ int n_feature;
     rf->setPriors(priors);
   }
 
+  return rf;
+}
+
+
+/** This function trains a Random Forest model
+--- TrainData: training data
+--- train:     train parameters
++++ Return:    model
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+Ptr<StatModel> train_rf(Ptr<TrainData> TrainData, par_train_t *train, FILE *fp){
+int v, i;
+
+
+  Ptr<RTrees> rf = configure_rf(train, TrainData->getNVars());
+
 
   fprintf(fp, "\nRandom Forest parameters\n");
   fprintf(fp, "--------------------------------------------------------------------\n");
@@ -279,37 +318,197 @@ float sum = 0.0;
 }
 
 
-/** This function makes a regression prediction and performs a validation
+/** This function draws the samples that are used for training and valida-
++++ tion. For classification, PERCENT_SUBSAMPLE of each class are drawn 
++++ (at least one sample), such that the class proportions are retained.
++++ For regression, the samples are drawn at random.
+--- c_response: response (classification)
+--- n_sample:   number of samples
+--- train:      train parameters
+--- use:        use sample? (returned)
++++ Return:     number of used samples
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int subsample_train(int *c_response, int n_sample, par_train_t *train, bool *use){
+int i, j, tmp, n_use = 0;
+int lo, hi, mid, nclass = 1;
+int *order = NULL;
+int *quota = NULL;
+int **hist = NULL;
+
+
+  if (train->per_subsample >= 100){
+    for (i=0; i<n_sample; i++) use[i] = true;
+    return n_sample;
+  }
+
+  // random order
+  alloc((void**)&order, n_sample, sizeof(int));
+  for (i=0; i<n_sample; i++) order[i] = i;
+  for (i=n_sample-1; i>0; i--){
+    j = rand() % (i+1);
+    tmp = order[i]; order[i] = order[j]; order[j] = tmp;
+  }
+
+  // samples per class (one class for regression)
+  if (train->method == _ML_RFC_ || train->method == _ML_SVC_){
+    hist = histogram(c_response, n_sample, &nclass);
+    alloc((void**)&quota, nclass, sizeof(int));
+    for (j=0; j<nclass; j++) quota[j] = (int)ceil(hist[1][j]*train->per_subsample/100.0);
+  } else {
+    alloc((void**)&quota, 1, sizeof(int));
+    quota[0] = (int)ceil(n_sample*train->per_subsample/100.0);
+  }
+
+  for (i=0; i<n_sample; i++) use[i] = false;
+
+  for (i=0; i<n_sample; i++){
+
+    j = 0;
+
+    // class of sample, the histogram is in ascending order
+    if (hist != NULL){
+      for (lo=0, hi=nclass-1; lo<hi; ){
+        mid = (lo+hi)/2;
+        if (hist[0][mid] < c_response[order[i]]) lo = mid+1; else hi = mid;
+      }
+      j = lo;
+    }
+
+    if (quota[j] > 0){
+      use[order[i]] = true;
+      quota[j]--;
+      n_use++;
+    }
+
+  }
+
+  if (hist != NULL) free_2D((void**)hist, 2);
+  free((void*)quota);
+  free((void*)order);
+
+  return n_use;
+}
+
+
+/** This function predicts samples in batches, which are distributed 
++++ across the cores. Random forests are compiled into flat node arrays
++++ and predicted with the batched inference engine of the higher level
++++ (see rf-hl.c). If the forest cannot be compiled, or predicts dif-
++++ ferently than OpenCV, the model is predicted with OpenCV.
+--- features:       features, on which to make predict (contiguous)
+--- model:          ML model
+--- n_sample:       number of samples
+--- n_feature:      number of features
+--- classification: classification or regression model?
+--- pred:           predictions (n_sample, returned)
++++ Return:         void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void predict_samples(float **features, Ptr<StatModel> model, int n_sample, int n_feature, bool classification, float *pred){
+Ptr<RTrees> forest = model.dynamicCast<RTrees>();
+rf_flat_t *rf = NULL;
+int b, s, nb;
+
+
+  if (n_sample < 1) return;
+
+  if (!forest.empty()){
+    rf = compile_rf_flat(forest, n_feature, classification);
+    if (rf != NULL && !check_rf_flat(rf, forest)){
+      free_rf_flat(rf);
+      rf = NULL;
+    }
+  }
+
+  #pragma omp parallel for private(s, nb) shared(features, model, rf, n_sample, n_feature, pred) schedule(dynamic) default(none)
+  for (b=0; b<n_sample; b+=TRAIN_BATCH){
+
+    nb = (n_sample-b < TRAIN_BATCH) ? n_sample-b : TRAIN_BATCH;
+
+    if (rf != NULL){
+      rf_flat_predict(rf, features[b], NULL, nb, pred+b, NULL);
+    } else {
+      Mat input(nb, n_feature, CV_32F, features[b]);
+      Mat result;
+      model->predict(input, result);
+      for (s=0; s<nb; s++) pred[b+s] = result.at<float>(s,0);
+    }
+
+  }
+
+  if (rf != NULL) free_rf_flat(rf);
+
+  return;
+}
+
+
+/** This function finds the index of a class label
+--- label:  class labels in ascending order
+--- n:      number of class labels
+--- value:  class label to find
++++ Return: index of the class label
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int class_index(int *label, int n, int value){
+int lo = 0, hi = n-1, mid;
+
+
+  while (lo < hi){
+    mid = (lo+hi)/2;
+    if (label[mid] < value) lo = mid+1; else hi = mid;
+  }
+
+  return lo;
+}
+
+
+/** This function makes a regression prediction and performs a validation.
++++ The samples are predicted in parallel batches, and the statistics are
++++ accumulated with a parallel reduction.
 --- features:  features, on which to make predict
 --- response:  response (truth)
 --- model:     ML model
 --- n_sample:  number of samples
 --- n_feature: number of features
+--- fp:        logfile
 +++ Return:    void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void predict_regression(float **features, float *response, Ptr<StatModel> model, int n_sample, int n_feature, FILE *fp){
 int s, f;
-float pred;
+float *pred = NULL;
 double sum = 0;
 float rmse;
 double slope, intercept, rsq;
-double mx = 0, my = 0, vx = 0, vy = 0, cov = 0;
+double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+double mx, my, vx, vy, cov;
 
 
-  fprintf(fp, "\nFeature-Response Array\n");
-  fprintf(fp, "--------------------------------------------------------------------\n");
+  if (n_sample < 1) return;
+
+  alloc((void**)&pred, n_sample, sizeof(float));
+
+  predict_samples(features, model, n_sample, n_feature, false, pred);
 
+  #pragma omp parallel for shared(response, pred, n_sample) reduction(+: sum, sx, sy, sxx, syy, sxy) default(none)
   for (s=0; s<n_sample; s++){
+    sx  += response[s];
+    sy  += pred[s];
+    sxx += (double)response[s]*response[s];
+    syy += (double)pred[s]*pred[s];
+    sxy += (double)response[s]*pred[s];
+    sum += (pred[s]-response[s])*(pred[s]-response[s]);
+  }
 
-    Mat sampleMat(1, n_feature, CV_32F, features[s]);
-    pred = model->predict(sampleMat);
+  // same quantities as in covar_recurrence
+  mx  = sx/n_sample;
+  my  = sy/n_sample;
+  vx  = sxx - sx*mx;
+  vy  = syy - sy*my;
+  cov = sxy - sx*my;
 
-    if (s == 0){
-      mx = response[s]; my = pred;
-    } else {
-      covar_recurrence(response[s], pred, &mx, &my, &vx, &vy, &cov, s+1);
-    }
-    sum += (pred-response[s])*(pred-response[s]);
+
+  fprintf(fp, "\nFeature-Response Array\n");
+  fprintf(fp, "--------------------------------------------------------------------\n");
+
+  for (s=0; s<n_sample; s++){
     for (f=0; f<n_feature; f++){
       if (f < 3 || f > n_feature-4){
         fprintf(fp, " %.2f ", features[s][f]);
@@ -317,7 +516,7 @@ double mx = 0, my = 0, vx = 0, vy = 0, cov = 0;
         fprintf(fp, ".");
       }
     }
-    fprintf(fp, "::: %+.2f -> %+.2f\n", response[s], pred);
+    fprintf(fp, "::: %+.2f -> %+.2f\n", response[s], pred[s]);
   }
 
 
@@ -329,13 +528,17 @@ double mx = 0, my = 0, vx = 0, vy = 0, cov = 0;
   fprintf(fp, "y = %.3f + %.3f x, Rsq:  %.3f\n", intercept, slope, rsq);
   fprintf(fp, "RMSE: %.3f\n", rmse);
 
+  free((void*)pred);
 
   return;
 }
 
 
 /** This function makes a classification prediction and performs a 
-+++ validation
++++ validation. The samples are predicted in parallel batches, and the 
++++ confusion matrix is accumulated per thread before it is merged. Over-
++++ all accuracy, Kappa, as well as producer's and user's accuracy are
++++ reported.
 --- features:  features, on which to make predict
 --- response:  response (truth)
 --- model:     ML model
@@ -344,19 +547,70 @@ double mx = 0, my = 0, vx = 0, vy = 0, cov = 0;
 +++ Return:    void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void predict_classification(float **features, int *response, Ptr<StatModel> model, int n_sample, int n_feature, FILE *fp){
-int s, f;
-int pred;
-float oa;
-size_t correct = 0;
+int s, f, i, j;
+float *pred = NULL;
+int *both = NULL;
+int **hist = NULL;
+int nclass = 0;
+int *label = NULL;
+size_t **confusion = NULL, *local = NULL;
+size_t correct = 0, sum_ref, sum_pred;
+double expected = 0;
+float oa, kappa;
+
+
+  if (n_sample < 1) return;
+
+  alloc((void**)&pred, n_sample, sizeof(float));
+
+  predict_samples(features, model, n_sample, n_feature, true, pred);
+
+
+  // class labels of reference and prediction, in ascending order
+  alloc((void**)&both, 2*n_sample, sizeof(int));
+  for (s=0; s<n_sample; s++){
+    both[s] = response[s];
+    both[n_sample+s] = (int)pred[s];
+  }
+  hist = histogram(both, 2*n_sample, &nclass);
+  free((void*)both);
+
+  alloc((void**)&label, nclass, sizeof(int));
+  for (i=0; i<nclass; i++) label[i] = hist[0][i];
+  free_2D((void**)hist, 2);
+
+  alloc_2D((void***)&confusion, nclass, nclass, sizeof(size_t));
+
+  #pragma omp parallel private(s, i, j, local) shared(response, pred, n_sample, nclass, label, confusion) default(none)
+  {
+
+    alloc((void**)&local, nclass*nclass, sizeof(size_t));
+
+    #pragma omp for schedule(static)
+    for (s=0; s<n_sample; s++){
+      i = class_index(label, nclass, response[s]);
+      j = class_index(label, nclass, (int)pred[s]);
+      local[i*nclass+j]++;
+    }
+
+    #pragma omp critical (confusion_merge)
+    {
+      for (i=0; i<nclass; i++){
+      for (j=0; j<nclass; j++){
+        confusion[i][j] += local[i*nclass+j];
+      }
+      }
+    }
+
+    free((void*)local);
+
+  }
 
 
   fprintf(fp, "\nFeature-Response Array\n");
   fprintf(fp, "--------------------------------------------------------------------\n");
 
   for (s=0; s<n_sample; s++){
-    Mat sampleMat(1, n_feature, CV_32F, features[s]);
-    pred = model->predict(sampleMat);
-    correct += (pred == response[s]);
     for (f=0; f<n_feature; f++){
       if (f < 3 || f > n_feature-4){
         fprintf(fp, "%.2f ", features[s][f]);
@@ -364,14 +618,277 @@ size_t correct = 0;
         fprintf(fp, ".");
       }
     }
-    fprintf(fp, "::: %+03d -> %+03d\n", response[s], pred);
+    fprintf(fp, "::: %+03d -> %+03d\n", response[s], (int)pred[s]);
+  }
+
+
+  fprintf(fp, "____________________________________________________________________\n");
+  fprintf(fp, "Confusion matrix (rows: reference, columns: prediction)\n");
+
+  fprintf(fp, "%8s", "");
+  for (j=0; j<nclass; j++) fprintf(fp, " %8d", label[j]);
+  fprintf(fp, " %8s\n", "PA");
+
+  for (i=0; i<nclass; i++){
+    fprintf(fp, "%8d", label[i]);
+    for (j=0, sum_ref=0; j<nclass; j++){
+      fprintf(fp, " %8lu", confusion[i][j]);
+      sum_ref += confusion[i][j];
+    }
+    if (sum_ref > 0){
+      fprintf(fp, " %7.2f%%\n", 100.0*confusion[i][i]/sum_ref);
+    } else {
+      fprintf(fp, " %8s\n", "-");
+    }
+    correct += confusion[i][i];
   }
 
+  fprintf(fp, "%8s", "UA");
+  for (j=0; j<nclass; j++){
+    for (i=0, sum_pred=0, sum_ref=0; i<nclass; i++){
+      sum_pred += confusion[i][j];
+      sum_ref  += confusion[j][i];
+    }
+    expected += (double)sum_pred*sum_ref/n_sample/n_sample;
+    if (sum_pred > 0){
+      fprintf(fp, " %7.2f%%", 100.0*confusion[j][j]/sum_pred);
+    } else {
+      fprintf(fp, " %8s", "-");
+    }
+  }
+  fprintf(fp, "\n");
+
   oa = (float)correct/n_sample;
+  kappa = (expected < 1) ? (oa-expected)/(1-expected) : 0;
 
   fprintf(fp, "____________________________________________________________________\n");
-  fprintf(fp, "OA: %.2f%%\n", oa*100);
+  fprintf(fp, "OA: %.2f%%, Kappa: %.3f\n", oa*100, kappa);
+
+  free_2D((void**)confusion, nclass);
+  free((void*)label);
+  free((void*)pred);
 
   return;
 }
 
+
+/** This function expands a SVM parameter grid (min, max, log step) into
++++ a list of values. A log step <= 1 gives the minimum value only.
+--- grid:   parameter grid
+--- values: values (returned, must be freed)
++++ Return: number of values
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int grid_values(float *grid, float **values){
+int n = 1, i;
+double v;
+
+
+  if (grid[2] > 1 && grid[_MIN_] > 0){
+    for (v=grid[_MIN_]*grid[2]; v<=grid[_MAX_]*(1+1e-6); v*=grid[2]) n++;
+  }
+
+  alloc((void**)values, n, sizeof(float));
+
+  (*values)[0] = grid[_MIN_];
+  for (i=1; i<n; i++) (*values)[i] = (*values)[i-1]*grid[2];
+
+  return n;
+}
+
+
+/** This function tunes the model parameters with a grid or random search
++++ and k-fold cross-validation. The folds of all parameter sets are inde-
++++ pendent tasks, which are distributed across the cores. All tasks share
++++ the same feature and response block; the folds are selected by index.
++++ The best parameter set is written into the train parameters, such that
++++ the final model can be trained with train_rf or train_svm.
+--- features:   features
+--- r_response: response (regression)
+--- c_response: response (classification)
+--- n_sample:   number of samples
+--- n_feature:  number of features
+--- train:      train parameters (modified)
+--- fp:         logfile
++++ Return:     void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void tune_model(float **features, float *r_response, int *c_response, int n_sample, int n_feature, par_train_t *train, FILE *fp){
+int k = train->tune.kfold;
+int nset = 0, ntask, task, s, f, i, j, a, b, c, d;
+int nC = 0, nGamma = 0;
+float *C = NULL, *Gamma = NULL;
+int *fold = NULL, *perm = NULL;
+tune_set_t *set = NULL, tmp;
+bool forest, regression;
+int best = 0;
+
+
+  forest     = (train->method == _ML_RFR_ || train->method == _ML_RFC_);
+  regression = (train->method == _ML_RFR_ || train->method == _ML_SVR_);
+
+
+  // enumerate the grid
+
+  if (forest){
+    nset = train->tune.nntree * train->tune.nfeature_subset * 
+           train->tune.nmax_depth * train->tune.nmin_sample;
+  } else {
+    nC     = grid_values(train->sv.Cgrid,     &C);
+    nGamma = grid_values(train->sv.Gammagrid, &Gamma);
+    nset = nC*nGamma;
+  }
+
+  alloc((void**)&set, nset, sizeof(tune_set_t));
+
+  if (forest){
+    for (a=0, s=0; a<train->tune.nntree;          a++){
+    for (b=0;      b<train->tune.nfeature_subset; b++){
+    for (c=0;      c<train->tune.nmax_depth;      c++){
+    for (d=0;      d<train->tune.nmin_sample;     d++, s++){
+      set[s].ntree          = train->tune.ntree[a];
+      set[s].feature_subset = train->tune.feature_subset[b];
+      set[s].max_depth      = train->tune.max_depth[c];
+      set[s].min_sample     = train->tune.min_sample[d];
+    }
+    }
+    }
+    }
+  } else {
+    for (a=0, s=0; a<nC; a++){
+    for (b=0; b<nGamma; b++, s++){
+      set[s].C     = C[a];
+      set[s].Gamma = Gamma[b];
+    }
+    }
+    free((void*)C); free((void*)Gamma);
+  }
+
+  // random search: draw from the grid
+  if (train->tune.nrandom > 0 && train->tune.nrandom < nset){
+    for (s=nset-1; s>0; s--){
+      i = rand() % (s+1);
+      tmp = set[s]; set[s] = set[i]; set[i] = tmp;
+    }
+    nset = train->tune.nrandom;
+  }
+
+
+  // assign the samples to the folds randomly
+  alloc((void**)&fold, n_sample, sizeof(int));
+  alloc((void**)&perm, n_sample, sizeof(int));
+  for (i=0; i<n_sample; i++) perm[i] = i;
+  for (i=n_sample-1; i>0; i--){
+    j = rand() % (i+1);
+    f = perm[i]; perm[i] = perm[j]; perm[j] = f;
+  }
+  for (i=0; i<n_sample; i++) fold[perm[i]] = i % k;
+  free((void*)perm);
+
+
+  // one shared block, which is not copied for the folds
+  Mat samples(n_sample, n_feature, CV_32F, features[0]);
+  Mat responses = regression ? Mat(n_sample, 1, CV_32F, r_response) : Mat(n_sample, 1, CV_32S, c_response);
+
+  ntask = nset*k;
+
+  #pragma omp parallel for private(s, f, i) shared(ntask, k, n_sample, n_feature, fold, set, train, samples, responses, forest, regression) schedule(dynamic) default(none)
+  for (task=0; task<ntask; task++){
+
+    Ptr<StatModel> model;
+    par_train_t par = *train;
+    std::vector<int> idx;
+    double err = 0, pred;
+    int n = 0;
+
+    s = task / k;
+    f = task % k;
+
+    for (i=0; i<n_sample; i++){
+      if (fold[i] != f) idx.push_back(i);
+    }
+
+    Ptr<TrainData> data = TrainData::create(samples, ROW_SAMPLE, responses, noArray(), Mat(idx, true));
+
+    if (forest){
+      par.rf.ntree          = set[s].ntree;
+      par.rf.feature_subset = set[s].feature_subset;
+      par.rf.dt.max_depth   = set[s].max_depth;
+      par.rf.dt.min_sample  = set[s].min_sample;
+      model = configure_rf(&par, n_feature);
+    } else {
+      Ptr<SVM> svm = configure_svm(&par);
+      svm->setC(set[s].C);
+      svm->setGamma(set[s].Gamma);
+      model = svm;
+    }
+
+    model->train(data, 0);
+
+    // test on the left-out fold
+    for (i=0; i<n_sample; i++){
+      if (fold[i] != f) continue;
+      pred = model->predict(samples.row(i));
+      if (regression){
+        err += (pred-responses.at<float>(i, 0))*(pred-responses.at<float>(i, 0));
+      } else {
+        err += ((int)pred == responses.at<int>(i, 0));
+      }
+      n++;
+    }
+
+    #pragma omp critical (tune_score)
+    {
+      set[s].score += err;
+      set[s].n     += n;
+    }
+
+  }
+
+  free((void*)fold);
+
+
+  // RMSE or OA
+  for (s=0; s<nset; s++){
+    if (regression){
+      set[s].score = sqrt(set[s].score/set[s].n);
+      if (set[s].score < set[best].score) best = s;
+    } else {
+      set[s].score = set[s].score/set[s].n;
+      if (set[s].score > set[best].score) best = s;
+    }
+  }
+
+
+  fprintf(fp, "\nHyperparameter tuning (%s search, %d-fold cross-validation)\n", 
+    (train->tune.nrandom > 0) ? "random" : "grid", k);
+  fprintf(fp, "--------------------------------------------------------------------\n");
+  for (s=0; s<nset; s++){
+    if (forest){
+      fprintf(fp, "ntree: %5d, nfeature: %4d, max depth: %4d, min sample: %4d", 
+        set[s].ntree, set[s].feature_subset, set[s].max_depth, set[s].min_sample);
+    } else {
+      fprintf(fp, "C: %12.6f, Gamma: %12.6f", set[s].C, set[s].Gamma);
+    }
+    if (regression){
+      fprintf(fp, " ::: RMSE: %.3f%s\n", set[s].score, (s == best) ? " *" : "");
+    } else {
+      fprintf(fp, " ::: OA: %.2f%%%s\n", set[s].score*100, (s == best) ? " *" : "");
+    }
+  }
+  fprintf(fp, "____________________________________________________________________\n");
+
+
+  // use the best set for the final model
+  if (forest){
+    train->rf.ntree          = set[best].ntree;
+    train->rf.feature_subset = set[best].feature_subset;
+    train->rf.dt.max_depth   = set[best].max_depth;
+    train->rf.dt.min_sample  = set[best].min_sample;
+  } else {
+    train->sv.Cgrid[_MIN_]     = train->sv.Cgrid[_MAX_]     = set[best].C;
+    train->sv.Gammagrid[_MIN_] = train->sv.Gammagrid[_MAX_] = set[best].Gamma;
+  }
+
+  free((void*)set);
+
+  return;
+}
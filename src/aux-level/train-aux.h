@@ -39,17 +39,37 @@ using namespace cv::ml;
 #include "../cross-level/stats-cl.h"
 #include "../cross-level/read-cl.h"
 #include "../aux-level/param-train-aux.h"
+#include "../higher-level/rf-cv-hl.h"
 
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// parameter set of the hyperparameter tuning
+typedef struct {
+  int ntree;
+  int feature_subset;
+  int max_depth;
+  int min_sample;
+  float C;
+  float Gamma;
+  double score;
+  int n;
+} tune_set_t;
+
+Ptr<SVM> configure_svm(par_train_t *train);
+Ptr<RTrees> configure_rf(par_train_t *train, int n_feature);
 Ptr<StatModel> train_svm(Ptr<TrainData> TrainData, par_train_t *train, FILE *fp);
 Ptr<StatModel> train_rf(Ptr<TrainData> TrainData, par_train_t *train, FILE *fp);
 void class_priors(int *c_response, int n_sample, par_train_t *train);
+int subsample_train(int *c_response, int n_sample, par_train_t *train, bool *use);
+void predict_samples(float **features, Ptr<StatModel> model, int n_sample, int n_feature, bool classification, float *pred);
+int class_index(int *label, int n, int value);
 void predict_regression(float **features, float *response, Ptr<StatModel> model, int n_sample, int n_feature, FILE *fp);
 void predict_classification(float **features, int *response, Ptr<StatModel> model, int n_sample, int n_feature, FILE *fp);
+int grid_values(float *grid, float **values);
+void tune_model(float **features, float *r_response, int *c_response, int n_sample, int n_feature, par_train_t *train, FILE *fp);
 
 #ifdef __cplusplus
 }
@@ -26,6 +26,64 @@ This file contains general functions for memory allocation / deallocation
 
 
 #include "alloc-cl.h"
+#include "enum-cl.h"
+
+#include <sys/mman.h> // memory management declarations
+
+
+// min. size of slabs that are backed by huge pages (bytes)
+#define ALLOC_HUGE 2097152
+
+// pool of freed slabs, bucketed by size
+typedef struct {
+  size_t bytes;  // size of slabs in this bucket
+  void **slab;   // free slabs
+  int n, size;   // number of free slabs, allocated length
+} slab_bucket_t;
+
+slab_bucket_t *slab_pool = NULL;
+int slab_pool_n = 0;
+size_t slab_pool_bytes = 0;  // bytes held by the pool
+size_t slab_pool_max   = 0;  // max. bytes held by the pool, 0: disabled
+
+// called before a slab is returned to the system, e.g. to unpin it
+void (*slab_release)(void *slab) = NULL;
+
+// huge page mode for large slabs
+int slab_huge = _HUGE_NONE_;
+bool slab_huge_warned = false;
+
+// header in front of each slab, keeps the slab aligned
+typedef struct {
+  size_t bytes;  // size of slab
+  size_t map;    // bytes mapped with mmap, 0: allocated from the heap
+  int owner;     // owner of the slab, -1: not accounted
+} slab_header_t;
+
+// memory accounting of slabs, by owner
+typedef struct {
+  char name[MEM_OWNER_LENGTH]; // owner, e.g. read/ARD1, TSA, output/NDV-STM
+  double live;                 // bytes held
+  double peak;                 // peak of bytes held since last reset
+} mem_owner_t;
+
+mem_owner_t mem_owner[MEM_OWNER_MAX] = { { "untagged", 0, 0 } };
+int mem_owner_n = 1;
+bool mem_accounting = false;
+double mem_live = 0;  // bytes held by all owners
+double mem_peak = 0;  // peak of bytes held by all owners since last reset
+
+// owner of the slabs that are allocated by this thread
+_Thread_local int mem_owner_this = 0;
+
+
+void *new_slab(size_t bytes);
+void *take_pooled_slab(size_t bytes);
+bool give_pooled_slab(void *slab, size_t bytes);
+void free_slab(void *slab);
+void account_slab(int owner, double bytes);
+int  owner_slab(void *slab);
+void retag_slab(void *slab, int owner);
 
 
 /** Allocate array
@@ -66,10 +124,58 @@ int i;
 }
 
 
+/** Allocate aligned array
++++ This function allocates a block of memory that starts at an ALLOC_-
++++ ALIGN boundary, and initializes it with 0. It can be freed with free.
+--- ptr:    Pointer to the memory block
+--- n:      Number of elements to allocate
+--- size:   Size of each element
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void alloc_aligned(void **ptr, size_t n, size_t size){
+void *arr = NULL;
+size_t bytes = n*size;
+
+  if (bytes == 0) bytes = ALLOC_ALIGN;
+
+  if (posix_memalign(&arr, ALLOC_ALIGN, bytes) != 0){
+    printf("unable to allocate memory!\n"); exit(1);}
+  memset(arr, 0, bytes);
+
+  *ptr = arr;
+  return;
+}
+
+
+/** Allocate aligned slab array
++++ This function allocates one aligned block of memory, and initializes 
++++ it with 0. The block is padded to a multiple of ALLOC_ALIGN, such that
++++ SIMD loops can run over the padding without a remainder loop. Like the
++++ slabs of alloc_2DS, the block is recycled by the slab pool, and large
++++ blocks are backed by huge pages. Must be freed with free_1DS.
+--- ptr:    Pointer to the memory block
+--- n:      Number of elements to allocate
+--- size:   Size of each element
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void alloc_1DS(void **ptr, size_t n, size_t size){
+void *arr = NULL;
+size_t bytes = aligned_stride(n, size)*size;
+
+  if (bytes == 0) bytes = ALLOC_ALIGN;
+
+  arr = new_slab(bytes);
+  memset(arr, 0, bytes);
+
+  *ptr = arr;
+  return;
+}
+
+
 /** Allocate contiguous 2D-array
 +++ This function allocates a block of memory, and initializes it with 0.
 +++ Unlike alloc_2D, one single block of memory is allocated and pointers
-+++ are set for the 2nd dimension.
++++ are set for the 2nd dimension. The block is aligned to ALLOC_ALIGN.
 --- ptr:    Pointer to the memory block
 --- n1:     Number of elements to allocate (1st dimension)
 --- n2:     Number of elements to allocate (2nd dimension)
@@ -81,7 +187,7 @@ void  *arr  = NULL;
 void **arr_ = NULL;
 int i;
 
-  alloc((void**)&arr, n1*n2, size);
+  alloc_aligned(&arr, n1*n2, size);
   alloc((void**)&arr_, n1, sizeof(void*));
   for (i=0; i<n1; i++) arr_[i] = (char*)arr + (size_t)i*n2*size;
 
@@ -90,6 +196,58 @@ int i;
 }
 
 
+/** Allocate aligned slab 2D-array
++++ This function allocates one aligned block of memory, and initializes 
++++ it with 0. Like alloc_2DC, pointers are set for the 2nd dimension, but
++++ consecutive elements of the 1st dimension are stride elements apart.
++++ With aligned_stride, every element of the 1st dimension starts at an
++++ ALLOC_ALIGN boundary. Must be freed with free_2DS.
+--- ptr:    Pointer to the memory block
+--- n1:     Number of elements to allocate (1st dimension)
+--- stride: Distance between elements of the 1st dimension (in elements)
+--- size:   Size of each element
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void alloc_2DS(void ***ptr, size_t n1, size_t stride, size_t size){
+void  *arr  = NULL;
+void **arr_ = NULL;
+size_t bytes = n1*stride*size;
+int i;
+
+  if (bytes == 0) bytes = ALLOC_ALIGN;
+
+  arr = new_slab(bytes);
+  memset(arr, 0, bytes);
+
+  // size and slab are kept in front of the pointers, also valid for n1 = 0
+  alloc((void**)&arr_, n1+2, sizeof(void*));
+  arr_[0] = (void*)(uintptr_t)bytes;
+  arr_[1] = arr;
+  for (i=0; i<n1; i++) arr_[i+2] = (char*)arr + (size_t)i*stride*size;
+
+  *ptr = arr_+2;
+  return;
+}
+
+
+/** Aligned stride
++++ This function rounds a number of elements up, such that a block of 
++++ this many elements ends at an ALLOC_ALIGN boundary.
+--- n:      Number of elements
+--- size:   Size of each element
++++ Return: stride in elements
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+size_t aligned_stride(size_t n, size_t size){
+size_t k;
+
+  if (size == 0 || ALLOC_ALIGN % size != 0) return n;
+
+  k = ALLOC_ALIGN/size;
+
+  return (n+k-1)/k*k;
+}
+
+
 /** Allocate 3D-array
 +++ This function allocates blocks of memory, and initializes them with 0.
 --- ptr:    Pointer to the memory block
@@ -114,6 +272,41 @@ int i, j;
 }
 
 
+/** Allocate contiguous 3D-array
++++ This function allocates a block of memory, and initializes it with 0.
++++ Unlike alloc_3D, one single block of memory is allocated, and pointers
++++ are set for the 2nd and 3rd dimension. The block is aligned to ALLOC_-
++++ ALIGN. Must be freed with free_3DC.
+--- ptr:    Pointer to the memory block
+--- n1:     Number of elements to allocate (1st dimension)
+--- n2:     Number of elements to allocate (2nd dimension)
+--- n3:     Number of elements to allocate (3nd dimension)
+--- size:   Size of each element
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void alloc_3DC(void ****ptr, size_t n1, size_t n2, size_t n3, size_t size){
+void    *arr   = NULL;
+void   **arr_  = NULL;
+void  ***arr__ = NULL;
+int i, j;
+
+  alloc_aligned(&arr, n1*n2*n3, size);
+  alloc((void**)&arr_,  n1*n2+1, sizeof(void*));
+  alloc((void**)&arr__, n1, sizeof(void**));
+
+  // the block is kept behind the pointers, also valid for n1*n2 = 0
+  arr_[n1*n2] = arr;
+
+  for (i=0; i<n1; i++){
+    arr__[i] = arr_ + (size_t)i*n2;
+    for (j=0; j<n2; j++) arr__[i][j] = (char*)arr + ((size_t)i*n2+j)*n3*size;
+  }
+
+  *ptr = arr__;
+  return;
+}
+
+
 /** Re-Allocate array
 +++ This function re-allocates a block of memory. If the block is larger
 +++ than before, the new part is initialized with 0.
@@ -196,13 +389,17 @@ int i;
 +++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void re_alloc_2DC(void ***ptr, size_t n1_now, size_t n2_now, size_t n1, size_t n2, size_t size){
-void  *arr  = *ptr[0];
+void  *arr  = NULL;
 void **arr_ = *ptr;
 int i;
 
   if (n1_now == n1 && n2_now == n2) return;
 
-  re_alloc((void**)&arr, n1_now*n2_now, n1*n2, size);  
+  // realloc does not keep the alignment
+  alloc_aligned(&arr, n1*n2, size);
+  memcpy(arr, arr_[0], ((n1*n2 < n1_now*n2_now) ? n1*n2 : n1_now*n2_now)*size);
+  free(arr_[0]);
+
   re_alloc((void**)&arr_, n1_now, n1, sizeof(void*));
   for (i=0; i<n1; i++) arr_[i] = (char*)arr + (size_t)i*n2*size;
 
@@ -211,6 +408,32 @@ int i;
 }
 
 
+/** Re-Allocate aligned slab 2D-array
++++ This function re-allocates an aligned slab from alloc_2DS with a dif-
++++ ferent number of elements in the 1st dimension. If the block is lar-
++++ ger than before, the new part is initialized with 0.
+--- ptr:     Pointer to the memory block
+--- n1_now:  Number of elements of current block (1st dimension)
+--- n1:      Number of elements that block should have (1st dimension)
+--- stride:  Distance between elements of the 1st dimension (in elements)
+--- size:    Size of each element
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void re_alloc_2DS(void ***ptr, size_t n1_now, size_t n1, size_t stride, size_t size){
+void **arr_ = NULL;
+
+  if (n1_now == n1) return;
+
+  alloc_2DS(&arr_, n1, stride, size);
+  retag_slab(arr_[-1], owner_slab((*ptr)[-1]));
+  memcpy(arr_[-1], (*ptr)[-1], ((n1 < n1_now) ? n1 : n1_now)*stride*size);
+  free_2DS(*ptr);
+
+  *ptr = arr_;
+  return;
+}
+
+
 /** Re-Allocate 3D-array
 +++ This function re-allocates blocks of memory. If the block is larger
 +++ than before, the new part is initialized with 0.
@@ -288,6 +511,38 @@ void free_2DC(void **ptr){
 } 
 
 
+/** Free aligned slab array
++++ This function deallocates an aligned slab from alloc_1DS.
+--- ptr:    Pointer to the memory block
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_1DS(void *ptr){
+slab_header_t *header = (slab_header_t*)((char*)ptr - ALLOC_ALIGN);
+  
+  account_slab(header->owner, -(double)header->bytes);
+
+  if (!give_pooled_slab(ptr, header->bytes)) free_slab(ptr);
+
+  return;
+} 
+
+
+/** Free aligned slab 2D-array
++++ This function deallocates an aligned slab from alloc_2DS.
+--- ptr:    Pointer to the memory block
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_2DS(void **ptr){
+  
+  account_slab(owner_slab(ptr[-1]), -(double)(uintptr_t)ptr[-2]);
+
+  if (!give_pooled_slab(ptr[-1], (size_t)(uintptr_t)ptr[-2])) free_slab(ptr[-1]);
+  free(ptr-2);
+
+  return;
+} 
+
+
 /** Free 3D-array
 +++ This function deallocates an allocated 2D array.
 --- ptr:    Pointer to the memory block
@@ -307,3 +562,480 @@ int i, j;
   return;
 } 
 
+
+/** Free contiguous 3D-array
++++ This function deallocates an allocated, contiguous 3D array.
+--- ptr:    Pointer to the memory block
+--- n1:     Number of elements to deallocate (1st dimension)
+--- n2:     Number of elements to deallocate (2nd dimension)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_3DC(void ***ptr, size_t n1, size_t n2){
+void **arr_ = (n1 > 0) ? ptr[0] : NULL;
+
+  if (arr_ != NULL){
+    free(arr_[n1*n2]);
+    free((void*)arr_);
+  }
+  free((void*)ptr);
+
+  return;
+} 
+
+
+/** Enable the slab pool
++++ With the pool enabled, slabs freed by free_2DS are not returned to the
++++ system, but kept for an allocation of the exact same size by alloc_-
++++ 2DS. This recycles the band buffers of bricks across processing units
++++ of the same size, i.e. avoids the malloc/free and page-fault churn and
++++ heap fragmentation of long runs. The pool is bounded, slabs are freed
++++ regularly when the bound would be exceeded.
+--- max_bytes: max. bytes that are held by the pool, 0 to disable
++++ Return:    void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void init_slab_pool(size_t max_bytes){
+
+  #pragma omp critical (slab_pool)
+  {
+    slab_pool_max = max_bytes;
+  }
+
+  return;
+}
+
+
+/** Set a slab release hook
++++ The hook is called for each slab, right before it is returned to the
++++ system. This allows other allocators to hook into slabs, e.g. the GPU
++++ module registers slabs as pinned memory, and needs to unregister them.
+--- release: hook, NULL to remove
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void set_slab_release(void (*release)(void *slab)){
+
+  #pragma omp critical (slab_pool)
+  {
+    slab_release = release;
+  }
+
+  return;
+}
+
+
+/** Set the huge page mode
++++ Large slabs, i.e. the band buffers of ARD and bricks, can be backed by
++++ huge pages, which reduces TLB misses on multi-GB chunks. Transparent
++++ huge pages are requested with madvise, and are used by the kernel if
++++ available. Explicit huge pages are mapped from the pool that was re-
++++ served by the administrator (vm.nr_hugepages); if it is exhausted, 
++++ transparent huge pages are used.
+--- mode:   huge page mode
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void set_slab_huge(int mode){
+
+  #pragma omp critical (slab_pool)
+  {
+    slab_huge = mode;
+  }
+
+  return;
+}
+
+
+/** This function allocates a slab, or takes one from the pool. The slab 
++++ is preceded by a header, and starts at an ALLOC_ALIGN boundary.
+--- bytes:  size of slab
++++ Return: slab
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void *new_slab(size_t bytes){
+void *slab = NULL;
+void *base = NULL;
+size_t map = 0;
+size_t align = ALLOC_ALIGN;
+slab_header_t *header = NULL;
+
+
+  if ((slab = take_pooled_slab(bytes)) != NULL){
+    header = (slab_header_t*)((char*)slab - ALLOC_ALIGN);
+    header->owner = (mem_accounting) ? mem_owner_this : -1;
+    account_slab(header->owner, bytes);
+    return slab;
+  }
+
+  if (slab_huge != _HUGE_NONE_ && bytes >= ALLOC_HUGE){
+
+    #ifdef MAP_HUGETLB
+    if (slab_huge == _HUGE_EXPLICIT_){
+      map = (bytes + ALLOC_ALIGN + ALLOC_HUGE - 1) / ALLOC_HUGE * ALLOC_HUGE;
+      base = mmap(NULL, map, PROT_READ | PROT_WRITE, 
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (base == MAP_FAILED){
+        if (!slab_huge_warned){
+          printf("Warning: no explicit huge pages available, "
+                 "using transparent huge pages.\n");
+          slab_huge_warned = true;
+        }
+        base = NULL;
+        map  = 0;
+      }
+    }
+    #endif
+
+    align = ALLOC_HUGE;
+
+  }
+
+  if (base == NULL){
+    if (posix_memalign(&base, align, bytes + ALLOC_ALIGN) != 0){
+      printf("unable to allocate memory!\n"); exit(1);}
+    #ifdef MADV_HUGEPAGE
+    if (align == ALLOC_HUGE) madvise(base, bytes + ALLOC_ALIGN, MADV_HUGEPAGE);
+    #endif
+  }
+
+  header = (slab_header_t*)base;
+  header->bytes = bytes;
+  header->map   = map;
+  header->owner = (mem_accounting) ? mem_owner_this : -1;
+  account_slab(header->owner, bytes);
+
+  return (char*)base + ALLOC_ALIGN;
+}
+
+
+/** This function takes a free slab of given size from the pool
+--- bytes:  size of slab
++++ Return: slab, or NULL if there is no such slab in the pool
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void *take_pooled_slab(size_t bytes){
+void *slab = NULL;
+int k;
+
+
+  if (slab_pool_max == 0) return NULL;
+
+  #pragma omp critical (slab_pool)
+  {
+
+    for (k=0; k<slab_pool_n; k++){
+      if (slab_pool[k].bytes == bytes && slab_pool[k].n > 0){
+        slab = slab_pool[k].slab[--slab_pool[k].n];
+        slab_pool_bytes -= bytes;
+        break;
+      }
+    }
+
+  }
+
+  return slab;
+}
+
+
+/** This function gives a slab back to the pool
+--- slab:   slab
+--- bytes:  size of slab
++++ Return: true if the slab is held by the pool, false if it needs to be
++++         freed
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool give_pooled_slab(void *slab, size_t bytes){
+bool pooled = false;
+int k;
+
+
+  if (slab_pool_max == 0) return false;
+
+  #pragma omp critical (slab_pool)
+  {
+
+    if (slab_pool_bytes + bytes <= slab_pool_max){
+
+      for (k=0; k<slab_pool_n; k++){
+        if (slab_pool[k].bytes == bytes) break;
+      }
+
+      if (k == slab_pool_n){
+        re_alloc((void**)&slab_pool, slab_pool_n, slab_pool_n+1, sizeof(slab_bucket_t));
+        slab_pool[k].bytes = bytes;
+        slab_pool_n++;
+      }
+
+      if (slab_pool[k].n == slab_pool[k].size){
+        re_alloc((void**)&slab_pool[k].slab, slab_pool[k].size, slab_pool[k].size+64, sizeof(void*));
+        slab_pool[k].size += 64;
+      }
+
+      slab_pool[k].slab[slab_pool[k].n++] = slab;
+      slab_pool_bytes += bytes;
+      pooled = true;
+
+    }
+
+  }
+
+  return pooled;
+}
+
+
+/** Free the slab pool
++++ This function frees all slabs held by the pool, and disables it.
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_slab_pool(){
+int k, i;
+
+
+  #pragma omp critical (slab_pool)
+  {
+
+    for (k=0; k<slab_pool_n; k++){
+      for (i=0; i<slab_pool[k].n; i++) free_slab(slab_pool[k].slab[i]);
+      if (slab_pool[k].slab != NULL) free((void*)slab_pool[k].slab);
+    }
+    if (slab_pool != NULL) free((void*)slab_pool);
+
+    slab_pool = NULL;
+    slab_pool_n = 0;
+    slab_pool_bytes = 0;
+    slab_pool_max = 0;
+
+  }
+
+  return;
+}
+
+
+/** This function returns a slab to the system
+--- slab:   slab
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_slab(void *slab){
+slab_header_t *header = (slab_header_t*)((char*)slab - ALLOC_ALIGN);
+
+  if (slab_release != NULL) slab_release(slab);
+
+  if (header->map > 0){
+    munmap((void*)header, header->map);
+  } else {
+    free((void*)header);
+  }
+
+  return;
+}
+
+
+/** Enable memory accounting
++++ With accounting enabled, the bytes of all slabs (alloc_2DS, alloc_1DS)
++++ are booked to the owner of the slab. The owner is the one of the al-
++++ locating thread (set_mem_owner), and can be changed later on, e.g. 
++++ when a brick is handed from the module to the output (set_owner_2DS).
++++ Slabs held by the slab pool are not booked to any owner. Accounting
++++ should be enabled before the first slab is allocated; slabs that were
++++ allocated before are not accounted.
+--- enable: enable accounting?
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void enable_mem_accounting(bool enable){
+
+  #pragma omp critical (mem_accounting)
+  {
+    mem_accounting = enable;
+  }
+
+  return;
+}
+
+
+/** Memory owner tag
++++ This function gets the tag of an owner, the owner is registered if it
++++ is new. Slabs of unknown owners are booked as untagged.
+--- owner:  owner, NULL for untagged
++++ Return: tag
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int get_mem_owner_tag(const char *owner){
+int k, tag = 0;
+
+
+  if (owner == NULL || !mem_accounting) return 0;
+
+  #pragma omp critical (mem_accounting)
+  {
+
+    for (k=1; k<mem_owner_n; k++){
+      if (strncmp(mem_owner[k].name, owner, MEM_OWNER_LENGTH-1) == 0) break;
+    }
+
+    if (k == mem_owner_n && mem_owner_n < MEM_OWNER_MAX){
+      snprintf(mem_owner[k].name, MEM_OWNER_LENGTH, "%s", owner);
+      mem_owner[k].live = mem_owner[k].peak = 0;
+      mem_owner_n++;
+    }
+
+    if (k < mem_owner_n) tag = k;
+
+  }
+
+  return tag;
+}
+
+
+/** Set the memory owner of this thread
++++ All slabs that are allocated by the calling thread are booked to this
++++ owner. Threads of parallel regions do not inherit the owner.
+--- owner:  owner, NULL for untagged
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void set_mem_owner(const char *owner){
+
+  mem_owner_this = get_mem_owner_tag(owner);
+
+  return;
+}
+
+
+/** Set the memory owner of an aligned slab 2D-array
++++ The bytes of the slab are moved from its current owner to the new one.
+--- ptr:    Pointer to the memory block (from alloc_2DS)
+--- owner:  owner
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void set_owner_2DS(void **ptr, const char *owner){
+
+  if (ptr == NULL || !mem_accounting) return;
+
+  retag_slab(ptr[-1], get_mem_owner_tag(owner));
+
+  return;
+}
+
+
+/** Set the memory owner of an aligned slab array
++++ The bytes of the slab are moved from its current owner to the new one.
+--- ptr:    Pointer to the memory block (from alloc_1DS)
+--- owner:  owner
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void set_owner_1DS(void *ptr, const char *owner){
+
+  if (ptr == NULL || !mem_accounting) return;
+
+  retag_slab(ptr, get_mem_owner_tag(owner));
+
+  return;
+}
+
+
+/** Memory owners
++++ This function gets the number of registered owners, incl. untagged.
++++ Return: number of owners
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int get_mem_owner_count(){
+
+  return mem_owner_n;
+}
+
+
+/** Memory held by an owner
+--- tag:    tag of owner
+--- owner:  owner (modified)
+--- size:   length of the buffer for owner
+--- live:   bytes held (returned)
+--- peak:   peak of bytes held since last reset (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void get_mem_owner(int tag, char *owner, size_t size, double *live, double *peak){
+
+  #pragma omp critical (mem_accounting)
+  {
+    snprintf(owner, size, "%s", mem_owner[tag].name);
+    *live = mem_owner[tag].live;
+    *peak = mem_owner[tag].peak;
+  }
+
+  return;
+}
+
+
+/** Memory held by all owners
+--- live:   bytes held (returned)
+--- peak:   peak of bytes held since last reset (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void get_mem_total(double *live, double *peak){
+
+  #pragma omp critical (mem_accounting)
+  {
+    *live = mem_live;
+    *peak = mem_peak;
+  }
+
+  return;
+}
+
+
+/** Reset the memory peaks
++++ The peaks of all owners are set to the bytes held right now, such that
++++ the next peaks refer to the time since this call.
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void reset_mem_peak(){
+int k;
+
+  #pragma omp critical (mem_accounting)
+  {
+    for (k=0; k<mem_owner_n; k++) mem_owner[k].peak = mem_owner[k].live;
+    mem_peak = mem_live;
+  }
+
+  return;
+}
+
+
+/** This function books the bytes of a slab to its owner
+--- owner:  tag of owner, -1 if the slab is not accounted
+--- bytes:  bytes, positive when allocated, negative when freed
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void account_slab(int owner, double bytes){
+
+  if (!mem_accounting || owner < 0) return;
+
+  #pragma omp critical (mem_accounting)
+  {
+    mem_owner[owner].live += bytes;
+    if (mem_owner[owner].live > mem_owner[owner].peak) mem_owner[owner].peak = mem_owner[owner].live;
+    mem_live += bytes;
+    if (mem_live > mem_peak) mem_peak = mem_live;
+  }
+
+  return;
+}
+
+
+/** This function gets the owner of a slab
+--- slab:   slab
++++ Return: tag of owner
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int owner_slab(void *slab){
+slab_header_t *header = (slab_header_t*)((char*)slab - ALLOC_ALIGN);
+
+  return header->owner;
+}
+
+
+/** This function moves a slab to another owner
+--- slab:   slab
+--- owner:  tag of new owner
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void retag_slab(void *slab, int owner){
+slab_header_t *header = (slab_header_t*)((char*)slab - ALLOC_ALIGN);
+
+  if (header->owner < 0 || header->owner == owner) return;
+
+  account_slab(header->owner, -(double)header->bytes);
+  header->owner = owner;
+  account_slab(header->owner, header->bytes);
+
+  return;
+}
@@ -31,8 +31,17 @@ Allocation header
 #include <stdio.h>   // core input and output functions
 #include <stdlib.h>  // standard general utilities library
 #include <string.h>  // string handling functions
+#include <stdint.h>  // integer types
+#include <stdbool.h> // boolean data type
 
 
+// alignment of slab allocations (bytes), fits AVX-512 and GPU transfers
+#define ALLOC_ALIGN 64
+
+// memory accounting: max. number of owners, and length of owner names
+#define MEM_OWNER_MAX 256
+#define MEM_OWNER_LENGTH 64
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -41,13 +50,35 @@ void alloc(void **ptr, size_t n, size_t size);
 void alloc_2D(void ***ptr, size_t n1, size_t n2, size_t size);
 void alloc_3D(void ****ptr, size_t n1, size_t n2, size_t n3, size_t size);
 void alloc_2DC(void ***ptr, size_t n1, size_t n2, size_t size);
+void alloc_2DS(void ***ptr, size_t n1, size_t stride, size_t size);
+void alloc_3DC(void ****ptr, size_t n1, size_t n2, size_t n3, size_t size);
+void alloc_1DS(void **ptr, size_t n, size_t size);
+void alloc_aligned(void **ptr, size_t n, size_t size);
+size_t aligned_stride(size_t n, size_t size);
 void re_alloc(void **ptr, size_t n_now, size_t n, size_t size);
 void re_alloc_2D(void ***ptr, size_t n1_now, size_t n2_now, size_t n1, size_t n2, size_t size);
 void re_alloc_3D(void ****ptr, size_t n1_now, size_t n2_now, size_t n3_now, size_t n1, size_t n2, size_t n3, size_t size);
 void re_alloc_2DC(void ***ptr, size_t n1_now, size_t n2_now, size_t n1, size_t n2, size_t size);
+void re_alloc_2DS(void ***ptr, size_t n1_now, size_t n1, size_t stride, size_t size);
 void free_2D(void **ptr, size_t n);
 void free_3D(void ***ptr, size_t n1, size_t n2);
 void free_2DC(void **ptr);
+void free_2DS(void **ptr);
+void free_1DS(void *ptr);
+void free_3DC(void ***ptr, size_t n1, size_t n2);
+void init_slab_pool(size_t max_bytes);
+void free_slab_pool();
+void set_slab_release(void (*release)(void *slab));
+void set_slab_huge(int mode);
+void enable_mem_accounting(bool enable);
+int  get_mem_owner_tag(const char *owner);
+void set_mem_owner(const char *owner);
+void set_owner_2DS(void **ptr, const char *owner);
+void set_owner_1DS(void *ptr, const char *owner);
+int  get_mem_owner_count();
+void get_mem_owner(int tag, char *owner, size_t size, double *live, double *peak);
+void get_mem_total(double *live, double *peak);
+void reset_mem_peak();
 
 #ifdef __cplusplus
 }
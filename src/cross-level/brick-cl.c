@@ -26,6 +26,10 @@ This file contains functions for organizing bricks in memory, and output
 
 
 #include "brick-cl.h"
+#include "brickview-cl.h"
+#include "chunk-cl.h"
+#include "zarr-cl.h"
+#include "numa-cl.h"
 
 /** Geospatial Data Abstraction Library (GDAL) **/
 #include "cpl_conv.h"       // various convenience functions for CPL
@@ -36,6 +40,85 @@ This file contains functions for organizing bricks in memory, and output
 #include "ogr_spatialref.h" // coordinate systems services
 
 
+// reprojection from disc to a known grid
+struct warp_ctx_t {
+  GDALDatasetH src_dataset; // image on disc
+  int src_nb;               // number of bands on disc
+  int src_nodata;           // nodata value on disc
+  int rsm;                  // resampling method
+  int dst_nx, dst_ny;       // target grid
+  double dst_geotran[6];    // target grid
+  char dst_proj[NPOW_10];   // target grid
+  void *transformer;        // exact transformer
+  void *approx;             // approximate transformer
+  char **options;           // warp options
+};
+
+
+// typed kernels, dispatched with with_brick_view
+
+// fill a band with a value
+struct fill_band_t {
+  int b, nc; float val;
+  fill_band_t(int b_, int nc_, float val_) : b(b_), nc(nc_), val(val_) {}
+  template <typename T> void operator()(brick_view<T> v) const {
+    T *x = v.band(b);
+    T  y = (T)val;
+    #pragma omp parallel for simd schedule(static)
+    for (int p=0; p<nc; p++) x[p] = y;
+  }
+};
+
+// copy a warped window into a band
+struct copy_window_t {
+  const float *buf; int b, nx, ny, xoff, yoff, cnx, cny; int *ndone;
+  copy_window_t(const float *buf_, int b_, int nx_, int ny_, int xoff_, int yoff_, int cnx_, int cny_, int *ndone_) : 
+    buf(buf_), b(b_), nx(nx_), ny(ny_), xoff(xoff_), yoff(yoff_), cnx(cnx_), cny(cny_), ndone(ndone_) {}
+  template <typename T> void operator()(brick_view<T> v) const {
+    T *x = v.band(b);
+    int i1 = (yoff+cny < ny) ? yoff+cny : ny;
+    int j1 = (xoff+cnx < nx) ? xoff+cnx : nx;
+    #pragma omp parallel for schedule(static)
+    for (int i=yoff; i<i1; i++){
+      #pragma omp simd
+      for (int j=xoff; j<j1; j++) x[i*nx+j] = (T)buf[(i-yoff)*cnx + (j-xoff)];
+    }
+    if (i1 > yoff && j1 > xoff) *ndone += (i1-yoff)*(j1-xoff);
+  }
+};
+
+// range of valid values in a band
+struct band_range_t {
+  int b; float nodata; float *mn, *mx;
+  band_range_t(int b_, float nodata_, float *mn_, float *mx_) : b(b_), nodata(nodata_), mn(mn_), mx(mx_) {}
+  template <typename T> void operator()(brick_view<T> v) const {
+    const T *x = v.band(b);
+    float lo = *mn, hi = *mx, val;
+    for (int p=0; p<v.ncells(); p++){
+      val = x[p];
+      if ((brick_type<T>::datatype == _DT_FLOAT_) ? fequal(val, nodata) : (val == nodata)) continue;
+      if (val < lo) lo = val;
+      if (val > hi) hi = val;
+    }
+    *mn = lo; *mx = hi;
+  }
+};
+
+// mark pixels that are valid in a band
+struct mark_valid_t {
+  int b; float nodata; small *valid;
+  mark_valid_t(int b_, float nodata_, small *valid_) : b(b_), nodata(nodata_), valid(valid_) {}
+  template <typename T> void operator()(brick_view<T> v) const {
+    const T *x = v.band(b);
+    #pragma omp parallel for schedule(static)
+    for (int p=0; p<v.ncells(); p++){
+      if (valid[p]) continue;
+      if ((brick_type<T>::datatype == _DT_FLOAT_) ? !fequal(x[p], nodata) : (x[p] != nodata)) valid[p] = true;
+    }
+  }
+};
+
+
 /** This function allocates a brick
 --- nb:       number of bands
 --- nc:       number of cells
@@ -63,10 +146,10 @@ brick_t *brick = NULL;
   alloc((void**)&brick->nodata,     nb, sizeof(int));
   alloc((void**)&brick->scale,      nb, sizeof(float));
   alloc((void**)&brick->wavelength, nb, sizeof(float));
-  alloc_2D((void***)&brick->unit, nb, NPOW_04, sizeof(char));
-  alloc_2D((void***)&brick->domain, nb, NPOW_10, sizeof(char));
-  alloc_2D((void***)&brick->bandname,   nb, NPOW_10, sizeof(char));
-  alloc_2D((void***)&brick->sensor,     nb, NPOW_04, sizeof(char));
+  alloc((void**)&brick->unit,       nb, sizeof(int));
+  alloc((void**)&brick->domain,     nb, sizeof(int));
+  alloc((void**)&brick->bandname,   nb, sizeof(int));
+  alloc((void**)&brick->sensor,     nb, sizeof(int));
   alloc((void**)&brick->date, nb, sizeof(date_t));
   
   init_brick_bands(brick);
@@ -107,10 +190,10 @@ int datatype = get_brick_datatype(brick);
   re_alloc((void**)&brick->nodata,       nb0, nb, sizeof(int));
   re_alloc((void**)&brick->scale,        nb0, nb, sizeof(float));
   re_alloc((void**)&brick->wavelength,   nb0, nb, sizeof(float));
-  re_alloc_2D((void***)&brick->unit,   nb0, NPOW_04, nb, NPOW_04, sizeof(char));
-  re_alloc_2D((void***)&brick->domain,   nb0, NPOW_10, nb, NPOW_10, sizeof(char));
-  re_alloc_2D((void***)&brick->bandname, nb0, NPOW_10, nb, NPOW_10, sizeof(char));
-  re_alloc_2D((void***)&brick->sensor,   nb0, NPOW_04, nb, NPOW_04, sizeof(char));
+  re_alloc((void**)&brick->unit,         nb0, nb, sizeof(int));
+  re_alloc((void**)&brick->domain,       nb0, nb, sizeof(int));
+  re_alloc((void**)&brick->bandname,     nb0, nb, sizeof(int));
+  re_alloc((void**)&brick->sensor,       nb0, nb, sizeof(int));
   re_alloc((void**)&brick->date,         nb0, nb, sizeof(date_t));
 
   if (reallocate_brick_bands(brick, nb) == FAILURE){
@@ -173,6 +256,9 @@ int b, p;
   set_brick_format(brick, &from->format);
   set_brick_open(brick, from->open);
   set_brick_explode(brick, from->explode);
+  set_brick_overview(brick, from->overview);
+  set_brick_vrt(brick, from->vrt);
+  set_brick_nthread(brick, from->nthread);
 
   if (nb == from->nb){
     for (b=0; b<nb; b++) copy_brick_band(brick, b, from, b);
@@ -189,12 +275,9 @@ int b, p;
 +++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void free_brick(brick_t *brick){
-int nb;
 
   if (brick == NULL) return;
   
-  nb = get_brick_nbands(brick);
-  
   if (brick->save        != NULL) free((void*)brick->save);
   if (brick->nodata      != NULL) free((void*)brick->nodata);
   if (brick->scale       != NULL) free((void*)brick->scale);
@@ -209,10 +292,10 @@ int nb;
   if (brick->provenance != NULL) free_2D((void**)brick->provenance, brick->nprovenance);
   brick->provenance = NULL;
 
-  if (brick->unit     != NULL) free_2D((void**)brick->unit,     nb);
-  if (brick->domain   != NULL) free_2D((void**)brick->domain,   nb);
-  if (brick->bandname != NULL) free_2D((void**)brick->bandname, nb);
-  if (brick->sensor   != NULL) free_2D((void**)brick->sensor,   nb);
+  if (brick->unit     != NULL) free((void*)brick->unit);
+  if (brick->domain   != NULL) free((void*)brick->domain);
+  if (brick->bandname != NULL) free((void*)brick->bandname);
+  if (brick->sensor   != NULL) free((void*)brick->sensor);
   brick->unit     = NULL;
   brick->domain   = NULL;
   brick->bandname = NULL;
@@ -227,7 +310,11 @@ int nb;
 }
 
 
-/** This function allocates the bandwise information in a brick
+/** This function allocates the bandwise information in a brick. All 
++++ bands are held in one aligned slab, each band starts at an aligned
++++ offset (stride). get_band_* return views into the slab, and get_bands_*
++++ [0] is the start of the slab, e.g. for reading all bands with one GDAL
++++ call, or for copying the brick in one go.
 --- brick:    brick (modified)
 --- nb:       number of bands
 --- nc:       number of cells
@@ -236,6 +323,7 @@ int nb;
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int allocate_brick_bands(brick_t *brick, int nb, int nc, int datatype){
 int nbyte;
+size_t stride;
 
 
   switch (datatype){
@@ -246,27 +334,37 @@ int nbyte;
     case _DT_SHORT_:
       set_brick_datatype(brick, _DT_SHORT_);
       set_brick_byte(brick, (nbyte = sizeof(short)));
-      alloc_2D((void***)&brick->vshort, nb, nc, nbyte);
+      brick->stride = (stride = aligned_stride(nc, nbyte));
+      alloc_2DS((void***)&brick->vshort, nb, stride, nbyte);
+      numa_place(brick->vshort[0], nb, stride, nbyte);
       break;
     case _DT_SMALL_:
       set_brick_datatype(brick, _DT_SMALL_);
       set_brick_byte(brick, (nbyte = sizeof(small)));
-      alloc_2D((void***)&brick->vsmall, nb, nc, nbyte);
+      brick->stride = (stride = aligned_stride(nc, nbyte));
+      alloc_2DS((void***)&brick->vsmall, nb, stride, nbyte);
+      numa_place(brick->vsmall[0], nb, stride, nbyte);
       break;
     case _DT_FLOAT_:
       set_brick_datatype(brick, _DT_FLOAT_);
       set_brick_byte(brick, (nbyte = sizeof(float)));
-      alloc_2D((void***)&brick->vfloat, nb, nc, nbyte);
+      brick->stride = (stride = aligned_stride(nc, nbyte));
+      alloc_2DS((void***)&brick->vfloat, nb, stride, nbyte);
+      numa_place(brick->vfloat[0], nb, stride, nbyte);
       break;
     case _DT_INT_:
       set_brick_datatype(brick, _DT_INT_);
       set_brick_byte(brick, (nbyte = sizeof(int)));
-      alloc_2D((void***)&brick->vint, nb, nc, nbyte);
+      brick->stride = (stride = aligned_stride(nc, nbyte));
+      alloc_2DS((void***)&brick->vint, nb, stride, nbyte);
+      numa_place(brick->vint[0], nb, stride, nbyte);
       break;
     case _DT_USHORT_:
       set_brick_datatype(brick, _DT_USHORT_);
       set_brick_byte(brick, (nbyte = sizeof(ushort)));
-      alloc_2D((void***)&brick->vushort, nb, nc, nbyte);
+      brick->stride = (stride = aligned_stride(nc, nbyte));
+      alloc_2DS((void***)&brick->vushort, nb, stride, nbyte);
+      numa_place(brick->vushort[0], nb, stride, nbyte);
       break;
     default:
       printf("unknown datatype for allocating brick. ");
@@ -285,26 +383,24 @@ int nbyte;
 int reallocate_brick_bands(brick_t *brick, int nb){
 int nbyte = get_brick_byte(brick);
 int nb0 = get_brick_nbands(brick);
-int nc0 = get_brick_ncells(brick);
-int nc  = get_brick_ncells(brick);
 int datatype = get_brick_datatype(brick);
 
 
   switch (datatype){
     case _DT_SHORT_:
-      re_alloc_2D((void***)&brick->vshort, nb0, nc0, nb, nc, nbyte);
+      re_alloc_2DS((void***)&brick->vshort, nb0, nb, brick->stride, nbyte);
       break;
     case _DT_SMALL_:
-      re_alloc_2D((void***)&brick->vsmall, nb0, nc0, nb, nc, nbyte);
+      re_alloc_2DS((void***)&brick->vsmall, nb0, nb, brick->stride, nbyte);
       break;
     case _DT_FLOAT_:
-      re_alloc_2D((void***)&brick->vfloat, nb0, nc0, nb, nc, nbyte);
+      re_alloc_2DS((void***)&brick->vfloat, nb0, nb, brick->stride, nbyte);
       break;
     case _DT_INT_:
-      re_alloc_2D((void***)&brick->vint, nb0, nc0, nb, nc, nbyte);
+      re_alloc_2DS((void***)&brick->vint, nb0, nb, brick->stride, nbyte);
       break;
     case _DT_USHORT_:
-      re_alloc_2D((void***)&brick->vushort, nb0, nc0, nb, nc, nbyte);
+      re_alloc_2DS((void***)&brick->vushort, nb0, nb, brick->stride, nbyte);
       break;
     default:
       printf("unknown datatype for allocating brick. ");
@@ -329,38 +425,103 @@ void copy_brick_band(brick_t *brick, int b, brick_t *from, int b_from){
   set_brick_nodata(brick, b, from->nodata[b_from]);
   set_brick_scale(brick, b, from->scale[b_from]);
   set_brick_wavelength(brick, b, from->wavelength[b_from]);
-  set_brick_unit(brick, b, from->unit[b_from]);
-  set_brick_domain(brick, b, from->domain[b_from]);
-  set_brick_bandname(brick, b, from->bandname[b_from]);
-  set_brick_sensor(brick, b, from->sensor[b_from]);
+  // interned strings: copy the IDs only
+  brick->unit[b]     = from->unit[b_from];
+  brick->domain[b]   = from->domain[b_from];
+  brick->bandname[b] = from->bandname[b_from];
+  brick->sensor[b]   = from->sensor[b_from];
   set_brick_date(brick, b, from->date[b_from]);
 
   return;
 }
 
 
+/** This function moves the bandwise data from one brick to another one.
++++ The data are re-interpreted as datatype without conversion, i.e. the
++++ datatypes must have the same size (e.g. ushort -> short). This allows
++++ converting data in place, without holding two copies in memory.
+--- brick:    target brick w/o bands (modified)
+--- from:     source brick (bands are released)
+--- datatype: datatype of target brick
++++ Return:   SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int move_brick_bands(brick_t *brick, brick_t *from, int datatype){
+void **slab = NULL;
+int nbyte;
+
+
+  switch (get_brick_datatype(from)){
+    case _DT_SHORT_:  slab = (void**)from->vshort;  break;
+    case _DT_SMALL_:  slab = (void**)from->vsmall;  break;
+    case _DT_FLOAT_:  slab = (void**)from->vfloat;  break;
+    case _DT_INT_:    slab = (void**)from->vint;    break;
+    case _DT_USHORT_: slab = (void**)from->vushort; break;
+    default:
+      printf("unknown datatype for moving brick. ");
+      return FAILURE;
+  }
+
+  switch (datatype){
+    case _DT_SHORT_:  nbyte = sizeof(short);  break;
+    case _DT_SMALL_:  nbyte = sizeof(small);  break;
+    case _DT_FLOAT_:  nbyte = sizeof(float);  break;
+    case _DT_INT_:    nbyte = sizeof(int);    break;
+    case _DT_USHORT_: nbyte = sizeof(ushort); break;
+    default:
+      printf("unknown datatype for moving brick. ");
+      return FAILURE;
+  }
+
+  if (nbyte != get_brick_byte(from)){
+    printf("datatypes differ in size, cannot move brick. ");
+    return FAILURE;
+  }
+
+  free_brick_bands(brick);
+
+  set_brick_datatype(brick, datatype);
+  set_brick_byte(brick, nbyte);
+  brick->stride = from->stride;
+
+  switch (datatype){
+    case _DT_SHORT_:  brick->vshort  = (short**)slab;  break;
+    case _DT_SMALL_:  brick->vsmall  = (small**)slab;  break;
+    case _DT_FLOAT_:  brick->vfloat  = (float**)slab;  break;
+    case _DT_INT_:    brick->vint    = (int**)slab;    break;
+    case _DT_USHORT_: brick->vushort = (ushort**)slab; break;
+  }
+
+  from->vshort  = NULL;
+  from->vsmall  = NULL;
+  from->vfloat  = NULL;
+  from->vint    = NULL;
+  from->vushort = NULL;
+  from->stride  = 0;
+
+  return SUCCESS;
+}
+
+
 /** This function frees the bandwise information in a brick
 --- brick:  brick
 +++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void free_brick_bands(brick_t *brick){
-int nb;
 
   if (brick == NULL) return;
-  
-  nb = get_brick_nbands(brick);
 
-  if (brick->vshort  != NULL) free_2D((void**)brick->vshort,  nb); 
-  if (brick->vsmall  != NULL) free_2D((void**)brick->vsmall,  nb); 
-  if (brick->vfloat  != NULL) free_2D((void**)brick->vfloat,  nb); 
-  if (brick->vint    != NULL) free_2D((void**)brick->vint,    nb); 
-  if (brick->vushort != NULL) free_2D((void**)brick->vushort, nb); 
+  if (brick->vshort  != NULL) free_2DS((void**)brick->vshort);
+  if (brick->vsmall  != NULL) free_2DS((void**)brick->vsmall);
+  if (brick->vfloat  != NULL) free_2DS((void**)brick->vfloat);
+  if (brick->vint    != NULL) free_2DS((void**)brick->vint);
+  if (brick->vushort != NULL) free_2DS((void**)brick->vushort);
   
   brick->vshort  = NULL;
   brick->vsmall  = NULL;  
   brick->vfloat  = NULL;  
   brick->vint    = NULL;  
   brick->vushort = NULL;  
+  brick->stride  = 0;
 
   return;
 }
@@ -516,8 +677,12 @@ int i;
   default_gdaloptions(_FMT_GTIFF_, &brick->format);
   brick->open = OPEN_FALSE;
   brick->explode = 0;
+  brick->overview = 0;
+  brick->vrt = 0;
+  brick->nthread = 1;
   brick->datatype = _DT_NONE_;
   brick->byte = 0;
+  brick->stride = 0;
 
   brick->nb =  0;
   brick->nx =  0;
@@ -573,10 +738,10 @@ int b;
     brick->nodata[b] = 0;
     brick->scale[b] = 0;
     brick->wavelength[b] = 0;
-    copy_string(brick->unit[b],     NPOW_04, "NA");
-    copy_string(brick->domain[b],   NPOW_10, "NA");
-    copy_string(brick->bandname[b], NPOW_10, "NA");
-    copy_string(brick->sensor[b],   NPOW_04, "NA");
+    brick->unit[b]     = STRING_NA;
+    brick->domain[b]   = STRING_NA;
+    brick->bandname[b] = STRING_NA;
+    brick->sensor[b]   = STRING_NA;
     init_date(&brick->date[b]);
   }
 
@@ -593,8 +758,8 @@ int b, p;
 
 
   printf("\nbrick info for %s - %s - SID %d\n", brick->name, brick->product, brick->sid);
-  printf("open: %d, explode %d\n", 
-    brick->open, brick->explode);
+  printf("open: %d, explode %d, overview %d, vrt %d, nthread %d\n", 
+    brick->open, brick->explode, brick->overview, brick->vrt, brick->nthread);
   print_gdaloptions(&brick->format);
   printf("datatype %d with %d bytes\n", 
     brick->datatype, brick->byte);
@@ -635,47 +800,857 @@ void print_brick_band_info(brick_t *brick, int b){
   printf("++band # %d - save %d, nodata: %d, scale: %f\n", 
     b, brick->save[b], brick->nodata[b], brick->scale[b]);
   printf("wvl: %f, domain: %s, band name: %s, sensor ID: %s\n", 
-    brick->wavelength[b], brick->domain[b], brick->bandname[b], brick->sensor[b]);
+    brick->wavelength[b], interned_string(brick->domain[b]), 
+    interned_string(brick->bandname[b]), interned_string(brick->sensor[b]));
   print_date(&brick->date[b]);
     
   return;
 }
 
 
-/** This function outputs a brick
---- brick:  brick
-+++ Return: SUCCESS/FAILURE
+/** This function appends the provenance of a written file to the prove-
++++ nance table of the parent directory
+--- brick:    brick
+--- provname: provenance file
+--- fname:    written file
+--- mode:     create or update
+--- timeout:  timeout for locking the provenance file
++++ Return:   SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int write_brick(brick_t *brick){
-int f, b, b_, p, o;
-int b_brick, b_file, nbands, nfiles;
-int ***bands = NULL;
-char *lock = NULL;
+int write_provenance(brick_t *brick, const char *provname, const char *fname, const char *mode, double timeout){
+FILE *fprov = NULL;
+lock_t *lock = NULL;
+char lwritetime[NPOW_05];
+date_t today;
+int p;
+
+
+  if (brick->nprovenance <= 0 || brick->chunk != 0) return SUCCESS;
+
+  if ((lock = lock_file(provname, timeout)) == NULL){
+    printf("Unable to lock file %s (timeout: %fs). ", provname, timeout);
+    return FAILURE;}
+
+  if (fileexist((char*)provname)){
+
+    if ((fprov = fopen(provname, "a")) == NULL){
+      printf("Unable to re-open provenance file!\n"); 
+      unlock_file(lock); return FAILURE;}
+
+  } else {
+
+    if ((fprov = fopen(provname, "w")) == NULL){
+      printf("Unable to create provenance file!\n"); 
+      unlock_file(lock); return FAILURE;}
+
+    fprintf(fprov, "%s,%s,%s,%s\n", "file", "origin", "mode", "creation");
+
+  }
+
+  current_date(&today);
+  long_date(today.year, today.month, today.day, today.hh, today.mm, today.ss, today.tz, lwritetime, NPOW_05);
+
+  fprintf(fprov, "%s,", fname);
+  for (p=0; p<(brick->nprovenance-1); p++) fprintf(fprov, "%s;", brick->provenance[p]);
+  fprintf(fprov, "%s,%s,%s\n", brick->provenance[p], mode, lwritetime);
+
+  fclose(fprov);
+
+  unlock_file(lock);
+
+  return SUCCESS;
+}
+
+
+/** This function writes the FORCE metadata of a brick to a dataset
+--- fp:          dataset
+--- brick:       brick
+--- bands_brick: bands of the brick that are written
+--- bands_file:  corresponding bands in file
+--- nbands:      number of bands
+--- fp_meta:     file metadata (tag/value)
+--- n_fp_meta:   number of file metadata
+--- sys_meta:    system metadata (tag/value)
+--- n_sys_meta:  number of system metadata
+--- band_meta:   buffer for band metadata (tag/value)
+--- n_band_meta: size of band metadata buffer
++++ Return:      SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_brick_metadata(GDALDatasetH fp, brick_t *brick, int *bands_brick, int *bands_file, int nbands, char **fp_meta, int n_fp_meta, char **sys_meta, int n_sys_meta, char **band_meta, int n_band_meta){
+GDALRasterBandH band = NULL;
+int b, b_brick, b_file, i;
+char ldate[NPOW_05];
+int nchar;
+
+
+  for (i=0; i<n_sys_meta; i+=2) GDALSetMetadataItem(fp, sys_meta[i], sys_meta[i+1], "FORCE");
+  for (i=0; i<n_fp_meta;  i+=2) GDALSetMetadataItem(fp, fp_meta[i],  fp_meta[i+1],  "FORCE");
+
+  for (b=0; b<nbands; b++){
+
+    b_brick = bands_brick[b];
+    b_file  = bands_file[b];
+
+    i = 0;
+
+    copy_string(band_meta[i++], NPOW_14, "Domain");
+    copy_string(band_meta[i++], NPOW_14, interned_string(brick->domain[b_brick]));
+
+    copy_string(band_meta[i++], NPOW_14, "Wavelength");
+    nchar = snprintf(band_meta[i], NPOW_14, "%.3f", brick->wavelength[b_brick]); i++;
+    if (nchar < 0 || nchar >= NPOW_14){ 
+      printf("Buffer Overflow in assembling band metadata\n"); return FAILURE;}
+
+    copy_string(band_meta[i++], NPOW_14, "Wavelength_unit");
+    copy_string(band_meta[i++], NPOW_14, interned_string(brick->unit[b_brick]));
+
+    copy_string(band_meta[i++], NPOW_14, "Scale");
+    nchar = snprintf(band_meta[i], NPOW_14, "%.3f", brick->scale[b_brick]); i++;
+    if (nchar < 0 || nchar >= NPOW_14){ 
+      printf("Buffer Overflow in assembling band metadata\n"); return FAILURE;}
+
+    copy_string(band_meta[i++], NPOW_14, "Sensor");
+    copy_string(band_meta[i++], NPOW_14, interned_string(brick->sensor[b_brick]));
+
+    get_brick_longdate(brick, b_brick, ldate, NPOW_05-1);
+    copy_string(band_meta[i++], NPOW_14, "Date");
+    copy_string(band_meta[i++], NPOW_14, ldate);
+
+
+    band = GDALGetRasterBand(fp, b_file);
+
+    for (i=0; i<n_band_meta; i+=2) GDALSetMetadataItem(band, band_meta[i], band_meta[i+1], "FORCE");
+
+  }
+
+  return SUCCESS;
+}
+
+
+/** This function computes the overview levels of a brick. If the brick
++++ is written in chunks, only levels that align with the chunks are used,
++++ such that each chunk can be reduced independently. Levels are added
++++ until the overview is smaller than 256 pixels.
+--- brick:   brick
+--- levels:  overview levels (returned)
+--- nmax:    maximum number of levels
++++ Return:  number of levels
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int brick_overview_levels(brick_t *brick, int *levels, int nmax){
+int f, n = 0;
+
+
+  for (f=2; n<nmax; f*=2){
+    if (brick->nx/f < 256 || brick->ny/f < 256) break;
+    if (brick->open == OPEN_BLOCK && brick->cy % f != 0) break;
+    levels[n++] = f;
+  }
+
+  return n;
+}
+
+
+/** This function writes the overviews of a brick, or of one chunk if the
++++ brick is written in chunks. The overviews are reduced from the brick in
++++ memory by averaging all valid pixels of each overview cell, thus they
++++ do not need to be computed from disc. The pyramid is reduced in a sin-
++++ gle pass over the full resolution: each level that halves the previous
++++ one is aggregated from the sums and counts of the previous level.
+--- fp:          dataset (with overviews)
+--- brick:       brick (one chunk)
+--- bands_brick: bands of the brick that are written
+--- bands_file:  corresponding bands in file
+--- nbands:      number of bands
++++ Return:      SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_brick_overviews(GDALDatasetH fp, brick_t *brick, int *bands_brick, int *bands_file, int nbands){
+GDALRasterBandH band = NULL;
+GDALRasterBandH ovv  = NULL;
+int b, o, novv, f, i, j, ii, jj, p, k, n, kk;
+int onx, ony, oyoff;
+int nrow, yoff;
+int pf = 0, pnx = 0, pny = 0;
+float *buf = NULL;
+float val, nodata;
+double *sum  = NULL, *psum = NULL;
+int    *cnt  = NULL, *pcnt = NULL;
+
+
+  if (brick->open == OPEN_BLOCK){
+    nrow = brick->cy;
+    yoff = brick->chunk*brick->cy;
+  } else {
+    nrow = brick->ny;
+    yoff = 0;
+  }
+
+  for (b=0; b<nbands; b++){
+
+    band = GDALGetRasterBand(fp, bands_file[b]);
+    novv = GDALGetOverviewCount(band);
+    nodata = brick->nodata[bands_brick[b]];
+    pf = 0;
+
+    for (o=0; o<novv; o++){
+
+      ovv = GDALGetOverview(band, o);
+      onx = GDALGetRasterBandXSize(ovv);
+      f   = (brick->nx + onx - 1) / onx;
+
+      if (brick->open == OPEN_BLOCK && brick->cy % f != 0) continue;
+
+      oyoff = yoff/f;
+      ony   = (nrow + f - 1)/f;
+      if (oyoff + ony > GDALGetRasterBandYSize(ovv)) ony = GDALGetRasterBandYSize(ovv) - oyoff;
+      if (ony <= 0) continue;
+
+      alloc((void**)&sum, onx*ony, sizeof(double));
+      alloc((void**)&cnt, onx*ony, sizeof(int));
+      alloc((void**)&buf, onx*ony, sizeof(float));
+
+      if (pf > 0 && f == 2*pf){
+
+        // cascade: aggregate 2x2 cells of the previous level
+        for (i=0, k=0; i<ony; i++){
+        for (j=0; j<onx; j++, k++){
+          for (ii=2*i; ii<2*i+2 && ii<pny; ii++){
+          for (jj=2*j; jj<2*j+2 && jj<pnx; jj++){
+            kk = ii*pnx + jj;
+            sum[k] += psum[kk];
+            cnt[k] += pcnt[kk];
+          }
+          }
+        }
+        }
+
+      } else {
+
+        // reduce from full resolution
+        for (i=0, k=0; i<ony; i++){
+        for (j=0; j<onx; j++, k++){
+          for (ii=i*f; ii<(i+1)*f && ii<nrow; ii++){
+          for (jj=j*f; jj<(j+1)*f && jj<brick->nx; jj++){
+            p = ii*brick->nx + jj;
+            if ((val = get_brick(brick, bands_brick[b], p)) == nodata) continue;
+            sum[k] += val; cnt[k]++;
+          }
+          }
+        }
+        }
+
+      }
+
+      for (k=0, n=onx*ony; k<n; k++) buf[k] = (cnt[k] > 0) ? sum[k]/cnt[k] : nodata;
+
+      if (GDALRasterIO(ovv, GF_Write, 0, oyoff, onx, ony, buf, 
+        onx, ony, GDT_Float32, 0, 0) == CE_Failure){
+        printf("Unable to write overview. "); 
+        free((void*)buf); free((void*)sum); free((void*)cnt);
+        if (psum != NULL) free((void*)psum);
+        if (pcnt != NULL) free((void*)pcnt);
+        return FAILURE;}
+
+      free((void*)buf); buf = NULL;
+      if (psum != NULL){ free((void*)psum); psum = NULL;}
+      if (pcnt != NULL){ free((void*)pcnt); pcnt = NULL;}
+      psum = sum; sum = NULL;
+      pcnt = cnt; cnt = NULL;
+      pf = f; pnx = onx; pny = ony;
+
+    }
+
+    if (psum != NULL){ free((void*)psum); psum = NULL;}
+    if (pcnt != NULL){ free((void*)pcnt); pcnt = NULL;}
+
+  }
+
+  return SUCCESS;
+}
+
+
+/** This function writes a footprint summary of a dataset, i.e. the number
++++ of valid pixels in each chunk (row-major). A pixel is valid if any of 
++++ the written bands is not nodata. Readers use this summary to skip 
++++ chunks without any data, without reading the image. If the brick is 
++++ not chunked, or the summary is too long, nothing is written.
+--- fp:          dataset
+--- brick:       brick
+--- bands_brick: bands of the brick that are written
+--- nbands:      number of bands
++++ Return:      SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_brick_footprint(GDALDatasetH fp, brick_t *brick, int *bands_brick, int nbands){
+int b, i, j, c, ncx, ncy, len = 0;
+small *valid = NULL;
+int *count = NULL;
+char summary[NPOW_14];
+char size[NPOW_05];
+int nchar;
+
+
+  if (brick->cx <= 0 || brick->cy <= 0) return SUCCESS;
+
+  ncx = (brick->nx + brick->cx - 1) / brick->cx;
+  ncy = (brick->ny + brick->cy - 1) / brick->cy;
+
+  alloc((void**)&valid, brick->nc, sizeof(small));
+  alloc((void**)&count, ncx*ncy, sizeof(int));
+
+  for (b=0; b<nbands; b++){
+    with_brick_view(brick, mark_valid_t(bands_brick[b], brick->nodata[bands_brick[b]], valid));
+  }
+
+  for (i=0; i<brick->ny; i++){
+  for (j=0; j<brick->nx; j++){
+    if (valid[i*brick->nx+j]) count[(i/brick->cy)*ncx + j/brick->cx]++;
+  }
+  }
+
+  free((void*)valid);
+
+  for (c=0; c<ncx*ncy; c++){
+    nchar = snprintf(summary+len, NPOW_14-len, (c == 0) ? "%d" : " %d", count[c]);
+    if (nchar < 0 || nchar >= NPOW_14-len){ free((void*)count); return SUCCESS;}
+    len += nchar;
+  }
+
+  free((void*)count);
+
+  nchar = snprintf(size, NPOW_05, "%d %d", brick->cx, brick->cy);
+  if (nchar < 0 || nchar >= NPOW_05){ 
+    printf("Buffer Overflow in assembling chunk size\n"); return FAILURE;}
+
+  GDALSetMetadataItem(fp, "FORCE_chunk_size",  size,    "FORCE");
+  GDALSetMetadataItem(fp, "FORCE_chunk_valid", summary, "FORCE");
+
+  return SUCCESS;
+}
+
+
+/** This function writes one metadata item into a VRT
+--- fv:     VRT file
+--- indent: indentation
+--- key:    metadata key
+--- value:  metadata value
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void write_vrt_item(FILE *fv, const char *indent, const char *key, const char *value){
+char *escaped = NULL;
+
+
+  escaped = CPLEscapeString(value, -1, CPLES_XML);
+  fprintf(fv, "%s<MDI key=\"%s\">%s</MDI>\n", indent, key, escaped);
+  CPLFree(escaped);
+
+  return;
+}
+
+
+/** This function writes one file of a brick, i.e. all bands, or one band
++++ if the brick is exploded. Existing files are merged in UPDATE/MERGE 
++++ mode, and updated chunk by chunk in BLOCK mode. The files of exploded
++++ bands are independent, thus this function may be called from several
++++ threads, as long as each thread brings its own band metadata buffer.
+--- brick:           brick
+--- bands_brick:     bands of the brick that are written
+--- bands_file:      corresponding bands in file
+--- nbands:          number of bands
+--- fname:           filename
+--- provname:        provenance file
+--- driver_physical: driver of the output format
+--- file_datatype:   datatype of the file
+--- options:         GDAL output options
+--- fp_meta:         file metadata (tag/value)
+--- n_fp_meta:       number of file metadata
+--- sys_meta:        system metadata (tag/value)
+--- n_sys_meta:      number of system metadata
+--- band_meta:       buffer for band metadata (tag/value)
+--- n_band_meta:     size of band metadata buffer
++++ Return:          SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_brick_file(brick_t *brick, int *bands_brick, int *bands_file, int nbands, char *fname, const char *provname, GDALDriverH driver_physical, GDALDataType file_datatype, char **options, char **fp_meta, int n_fp_meta, char **sys_meta, int n_sys_meta, char **band_meta, int n_band_meta){
+int b, p;
+int b_brick, b_file;
+lock_t *lock = NULL;
 double timeout;
 GDALDatasetH fp_physical = NULL;
 GDALDatasetH fp = NULL;
 GDALDatasetH fo = NULL;
 GDALRasterBandH band = NULL;
-GDALDriverH driver_physical = NULL;
 GDALDriverH driver = NULL;
-char **options = NULL;
 float *buf = NULL;
 float now, old;
 int xoff_write, yoff_write, nx_write, ny_write;
+bool chunk_store = false;
+bool zarr = false;
+
+char wname[NPOW_10];
+GDALDriverH driver_block = NULL;
+char **block_options = NULL;
+char **copy_options = NULL;
+bool inplace = false;
+bool create = false;
+int levels[NPOW_04];
+int nlevel = 0;
+int nchar;
+
+char c_update[2][NPOW_04] = { "create", "update" };
+bool update = false;
+
+
+  // FORCE chunk format is written without GDAL
+  chunk_store = (strcmp(brick->format.driver, "FCF") == 0);
+
+  // Zarr is written without GDAL
+  zarr = (strcmp(brick->format.driver, "ZARR") == 0);
+
+  if ((driver = GDALGetDriverByName("MEM")) == NULL){
+    printf("%s driver not found\n", "MEM"); return FAILURE;}
+
+  timeout = lock_timeout(get_brick_size(brick));
+
+  // Zarr chunks are independent files, no lock is needed
+  if (zarr){
+
+    if (write_zarr_store(brick, fname, bands_brick, nbands) == FAILURE){
+      printf("Unable to write %s. ", fname); return FAILURE;}
+
+    if (write_provenance(brick, provname, fname, c_update[0], timeout) == FAILURE) return FAILURE;
+
+    return SUCCESS;
+
+  }
+
+  if ((lock = lock_file(fname, timeout)) == NULL){
+    printf("Unable to lock file %s (timeout: %fs, nx/ny: %d/%d). ", fname, timeout, brick->nx, brick->ny);
+    return FAILURE;}
+
+
+  // chunk store: mosaicking and block writing are handled there
+  if (chunk_store){
+
+    update = (brick->open == OPEN_UPDATE || brick->open == OPEN_MERGE) && fileexist(fname);
+
+    if (write_chunk_store(brick, fname, bands_brick, nbands) == FAILURE){
+      printf("Unable to write %s. ", fname); unlock_file(lock); return FAILURE;}
+
+    unlock_file(lock);
+
+    if (write_provenance(brick, provname, fname, c_update[update], timeout) == FAILURE) return FAILURE;
+
+    return SUCCESS;
+
+  }
+
+  // mosaicking into existing file
+  // read and rewrite brick (safer when using compression)
+  if (brick->open != OPEN_CREATE && brick->open != OPEN_BLOCK && fileexist(fname)){
+
+    update = true;
+
+    // read brick
+    #ifdef FORCE_DEBUG
+    printf("reading existing file.\n");
+    #endif
+
+    if ((fo = GDALOpen(fname, GA_ReadOnly)) == NULL){
+      printf("Unable to open %s. ", fname); unlock_file(lock); return FAILURE;}
+
+    if (GDALGetRasterCount(fo) != nbands){
+      printf("Number of bands %d do not match for UPDATE/MERGE mode (file: %d). ", 
+        nbands, GDALGetRasterCount(fo)); 
+      unlock_file(lock); return FAILURE;}
+    if (GDALGetRasterXSize(fo) != brick->nx){
+      printf("Number of cols %d do not match for UPDATE/MERGE mode (file: %d). ", 
+        brick->nx, GDALGetRasterXSize(fo)); 
+      unlock_file(lock); return FAILURE;}
+    if (GDALGetRasterYSize(fo) != brick->ny){
+      printf("Number of rows %d do not match for UPDATE/MERGE mode (file: %d). ", 
+        brick->ny, GDALGetRasterYSize(fo)); 
+      unlock_file(lock); return FAILURE;}
+
+    alloc((void**)&buf, brick->nc, sizeof(float));
+
+    for (b=0; b<nbands; b++){
+
+      b_brick = bands_brick[b];
+      b_file  = bands_file[b];
+      
+      band = GDALGetRasterBand(fo, b_file);
+
+      if (GDALRasterIO(band, GF_Read, 0, 0, brick->nx, brick->ny, buf, 
+        brick->nx, brick->ny, GDT_Float32, 0, 0) == CE_Failure){
+        printf("Unable to read %s. ", fname); unlock_file(lock); return FAILURE;} 
+
+
+      for (p=0; p<brick->nc; p++){
+
+        now = get_brick(brick, b_brick, p);
+        old = buf[p];
+
+        // if both old and now are valid: keep now or merge now and old
+        if (now != brick->nodata[b_brick] && old != brick->nodata[b_brick]){
+          if (brick->open == OPEN_MERGE) set_brick(brick, b_brick, p, (now+old)/2.0);
+        // if only old is valid, take old value
+        } else if (now == brick->nodata[b_brick] && old != brick->nodata[b_brick]){
+          set_brick(brick, b_brick, p, old);
+        }
+        // if only now is valid, nothing to do
+
+      }
+
+    }
+
+    GDALClose(fo);
+
+    free((void*)buf);
+
+  } else {
+    update = false;
+  }
+
+
+  // block mode: update the window of the chunk. Drivers that can create
+  // files (GTiff, ENVI) are updated in place, such that writing a chunk
+  // does not depend on the number of chunks. Otherwise (e.g. COG), the
+  // chunks are collected in an uncompressed staging file, which is co-
+  // pied to the final format once, after the last chunk
+  if (brick->open == OPEN_BLOCK){
+
+    if (brick->chunk < 0){
+      printf("attempting to write invalid chunk\n");
+      unlock_file(lock); return FAILURE;
+    }
+
+    inplace = (GDALGetMetadataItem(driver_physical, GDAL_DCAP_CREATE, NULL) != NULL);
+
+    if (inplace){
+      copy_string(wname, NPOW_10, fname);
+      driver_block = driver_physical;
+    } else {
+      nchar = snprintf(wname, NPOW_10, "%s.stage.tif", fname);
+      if (nchar < 0 || nchar >= NPOW_10){ 
+        printf("Buffer Overflow in assembling filename\n"); unlock_file(lock); return FAILURE;}
+      if ((driver_block = GDALGetDriverByName("GTiff")) == NULL){
+        printf("%s driver not found\n", "GTiff"); unlock_file(lock); return FAILURE;}
+    }
+
+    if (brick->chunk > 0 && fileexist(wname)){
+      if ((fp = GDALOpen(wname, GA_Update)) == NULL){
+        printf("Unable to open %s. ", wname); unlock_file(lock); return FAILURE;}
+      create = false;
+    } else {
+      // blocks that were not written yet do not occupy disc space
+      if (inplace) block_options = CSLDuplicate(options);
+      if (!inplace || strcmp(brick->format.driver, "GTiff") == 0){
+        block_options = CSLSetNameValue(block_options, "SPARSE_OK", "TRUE");
+      }
+      if ((fp = GDALCreate(driver_block, wname, brick->nx, brick->ny, nbands, file_datatype, block_options)) == NULL){
+        printf("Error creating file %s. ", wname); unlock_file(lock); return FAILURE;}
+      CSLDestroy(block_options);
+      block_options = NULL;
+      create = true;
+      // when staging a COG, create empty overviews that are filled chunk
+      // by chunk from memory (no need to read the staging file again)
+      if (!inplace && strcmp(brick->format.driver, "COG") == 0 &&
+          (nlevel = brick_overview_levels(brick, levels, NPOW_04)) > 0){
+        if (GDALBuildOverviews(fp, "NONE", nlevel, levels, 0, NULL, NULL, NULL) == CE_Failure){
+          printf("Error creating overviews in %s. ", wname); unlock_file(lock); return FAILURE;}
+      }
+    }
+
+    nx_write     = brick->cx;
+    ny_write     = brick->cy;
+    xoff_write   = 0;
+    yoff_write   = brick->chunk*brick->cy;
+
+  } else {
+
+    if ((fp = GDALCreate(driver, fname, brick->nx, brick->ny, nbands, file_datatype, options)) == NULL){
+      printf("Error creating memory file %s. ", fname); unlock_file(lock); return FAILURE;}
+
+    nx_write     = brick->nx;
+    ny_write     = brick->ny;
+    xoff_write   = 0;
+    yoff_write   = 0;
+
+  }
+
+
+  for (b=0; b<nbands; b++){
+
+    b_brick = bands_brick[b];
+    b_file  = bands_file[b];
+
+    band = GDALGetRasterBand(fp, b_file);
+
+    switch (brick->datatype){
+      case _DT_SHORT_:
+        if (GDALRasterIO(band, GF_Write, xoff_write, yoff_write, 
+          nx_write, ny_write, brick->vshort[b_brick], 
+          nx_write, ny_write, file_datatype, 0, 0) == CE_Failure){
+          printf("Unable to write %s. ", fname); unlock_file(lock); return FAILURE;}
+        break;
+      case _DT_SMALL_:
+        if (GDALRasterIO(band, GF_Write, xoff_write, yoff_write, 
+          nx_write, ny_write, brick->vsmall[b_brick], 
+          nx_write, ny_write, file_datatype, 0, 0) == CE_Failure){
+          printf("Unable to write %s. ", fname); unlock_file(lock); return FAILURE;} 
+        break;
+      case _DT_FLOAT_:
+        if (GDALRasterIO(band, GF_Write, xoff_write, yoff_write, 
+          nx_write, ny_write, brick->vfloat[b_brick], 
+          nx_write, ny_write, file_datatype, 0, 0) == CE_Failure){
+          printf("Unable to write %s. ", fname); unlock_file(lock); return FAILURE;} 
+        break;
+      case _DT_INT_:
+        if (GDALRasterIO(band, GF_Write, xoff_write, yoff_write, 
+          nx_write, ny_write, brick->vint[b_brick], 
+          nx_write, ny_write, file_datatype, 0, 0) == CE_Failure){
+          printf("Unable to write %s. ", fname); unlock_file(lock); return FAILURE;} 
+        break;
+      case _DT_USHORT_:
+        if (GDALRasterIO(band, GF_Write, xoff_write, yoff_write, 
+          nx_write, ny_write, brick->vushort[b_brick], 
+          nx_write, ny_write, file_datatype, 0, 0) == CE_Failure){
+          printf("Unable to write %s. ", fname); unlock_file(lock); return FAILURE;} 
+        break;
+
+      default:
+        printf("unknown datatype for writing brick. ");
+        unlock_file(lock); return FAILURE;
+    }
+
+    GDALSetDescription(band, interned_string(brick->bandname[b_brick]));
+    GDALSetRasterNoDataValue(band, brick->nodata[b_brick]);
+
+  }
+
+  // write essential geo-metadata
+  #pragma omp critical
+  {
+    GDALSetGeoTransform(fp, brick->geotran);
+    GDALSetProjection(fp,   brick->proj);
+  }
+
+  // in case of ENVI, update description
+  //if (format == _FMT_ENVI_) 
+  //GDALSetDescription(fp, brick->name);
+
+
+  if (brick->open == OPEN_BLOCK){
+
+    if (create && inplace){
+      if (write_brick_metadata(fp, brick, bands_brick, bands_file, nbands, 
+        fp_meta, n_fp_meta, sys_meta, n_sys_meta, band_meta, n_band_meta) == FAILURE){ unlock_file(lock); return FAILURE;}
+    }
+
+    if (!inplace){
+      if (write_brick_overviews(fp, brick, bands_brick, bands_file, nbands) == FAILURE){
+        printf("Unable to write %s. ", wname); unlock_file(lock); return FAILURE;}
+    }
+
+    GDALClose(fp);
+
+    // convert staging file after the last chunk
+    if (!inplace && brick->chunk == brick->nchunk-1){
+
+      if ((fp = GDALOpen(wname, GA_ReadOnly)) == NULL){
+        printf("Unable to open %s. ", wname); unlock_file(lock); return FAILURE;}
+
+      // overviews were computed from memory, re-use them
+      copy_options = CSLDuplicate(options);
+      if (GDALGetOverviewCount(GDALGetRasterBand(fp, 1)) > 0){
+        copy_options = CSLSetNameValue(copy_options, "OVERVIEWS", "FORCE_USE_EXISTING");
+      }
+
+      if ((fp_physical = GDALCreateCopy(driver_physical, fname, fp, FALSE, copy_options, NULL, NULL)) == NULL){
+          printf("Error creating file %s. ", fname); unlock_file(lock); return FAILURE;}
+
+      CSLDestroy(copy_options);
+      copy_options = NULL;
+
+      if (write_brick_metadata(fp_physical, brick, bands_brick, bands_file, nbands, 
+        fp_meta, n_fp_meta, sys_meta, n_sys_meta, band_meta, n_band_meta) == FAILURE){ unlock_file(lock); return FAILURE;}
+
+      GDALClose(fp_physical);
+      GDALClose(fp);
+
+      GDALDeleteDataset(driver_block, wname);
+
+    }
+
+  } else {
+  
+    // reduce overviews from memory, and copy them along with the image
+    copy_options = CSLDuplicate(options);
+    if (brick->overview && 
+        (strcmp(brick->format.driver, "GTiff") == 0 || strcmp(brick->format.driver, "COG") == 0) &&
+        (nlevel = brick_overview_levels(brick, levels, NPOW_04)) > 0){
+      if (GDALBuildOverviews(fp, "NONE", nlevel, levels, 0, NULL, NULL, NULL) == CE_Failure){
+        printf("Error creating overviews in %s. ", fname); unlock_file(lock); return FAILURE;}
+      if (write_brick_overviews(fp, brick, bands_brick, bands_file, nbands) == FAILURE){
+        printf("Unable to write %s. ", fname); unlock_file(lock); return FAILURE;}
+      if (strcmp(brick->format.driver, "COG") == 0){
+        copy_options = CSLSetNameValue(copy_options, "OVERVIEWS", "FORCE_USE_EXISTING");
+      } else {
+        copy_options = CSLSetNameValue(copy_options, "COPY_SRC_OVERVIEWS", "YES");
+      }
+    }
+
+    // copy to physical file. This is needed for drivers that do not support CREATE
+    if ((fp_physical = GDALCreateCopy(driver_physical, fname, fp, FALSE, copy_options, NULL, NULL)) == NULL){
+        printf("Error creating file %s. ", fname); unlock_file(lock); return FAILURE;}
+
+    CSLDestroy(copy_options);
+    copy_options = NULL;
+
+    if (write_brick_metadata(fp_physical, brick, bands_brick, bands_file, nbands, 
+      fp_meta, n_fp_meta, sys_meta, n_sys_meta, band_meta, n_band_meta) == FAILURE){ unlock_file(lock); return FAILURE;}
+
+    if (write_brick_footprint(fp_physical, brick, bands_brick, nbands) == FAILURE){ unlock_file(lock); return FAILURE;}
+
+    GDALClose(fp_physical);
+    GDALClose(fp);
+
+  }
+
+
+  unlock_file(lock);
+
+  // write provenance info
+  if (write_provenance(brick, provname, fname, c_update[update], timeout) == FAILURE) return FAILURE;
+
+  return SUCCESS;
+}
+
+
+/** This function writes a VRT that stacks the exploded bands of a brick.
++++ The VRT references the single-band files relative to its own location,
++++ and carries the FORCE metadata of the file and the bands, such that 
++++ the exploded bands can be used like a multi-band image. As the VRT 
++++ does not depend on the pixel values, it is only written with the first
++++ chunk.
+--- brick:         brick
+--- bands_brick:   bands of the brick that are written
+--- nbands:        number of bands
+--- file_datatype: datatype of the files
+--- fp_meta:       file metadata (tag/value)
+--- n_fp_meta:     number of file metadata
+--- sys_meta:      system metadata (tag/value)
+--- n_sys_meta:    number of system metadata
++++ Return:        SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_brick_vrt(brick_t *brick, int **bands_brick, int nbands, GDALDataType file_datatype, char **fp_meta, int n_fp_meta, char **sys_meta, int n_sys_meta){
+FILE *fv = NULL;
+lock_t *lock = NULL;
+char vname[NPOW_10];
+char ldate[NPOW_05];
+char *value = NULL;
+const char *type = NULL;
+int b, b_brick, i, nchar;
+
+
+  if (brick->chunk > 0) return SUCCESS;
+
+  nchar = snprintf(vname, NPOW_10, "%s/%s.vrt", brick->dname, brick->fname);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+  if ((lock = lock_file(vname, 60)) == NULL){
+    printf("Unable to lock file %s (timeout: %ds). ", vname, 60);
+    return FAILURE;}
+
+  if ((fv = fopen(vname, "w")) == NULL){
+    printf("Unable to open %s for writing. ", vname); unlock_file(lock); return FAILURE;}
+
+  type = GDALGetDataTypeName(file_datatype);
+
+  fprintf(fv, "<VRTDataset rasterXSize=\"%d\" rasterYSize=\"%d\">\n", brick->nx, brick->ny);
+
+  value = CPLEscapeString(brick->proj, -1, CPLES_XML);
+  fprintf(fv, "  <SRS dataAxisToSRSAxisMapping=\"1,2\">%s</SRS>\n", value);
+  CPLFree(value);
+
+  fprintf(fv, "  <GeoTransform> %.16e, %.16e, %.16e, %.16e, %.16e, %.16e</GeoTransform>\n",
+    brick->geotran[0], brick->geotran[1], brick->geotran[2], 
+    brick->geotran[3], brick->geotran[4], brick->geotran[5]);
+
+  fprintf(fv, "  <Metadata domain=\"FORCE\">\n");
+  for (i=0; i<n_sys_meta; i+=2) write_vrt_item(fv, "    ", sys_meta[i], sys_meta[i+1]);
+  for (i=0; i<n_fp_meta;  i+=2) write_vrt_item(fv, "    ", fp_meta[i],  fp_meta[i+1]);
+  fprintf(fv, "  </Metadata>\n");
+
+  for (b=0; b<nbands; b++){
+
+    b_brick = bands_brick[b][0];
+
+    fprintf(fv, "  <VRTRasterBand dataType=\"%s\" band=\"%d\">\n", type, b+1);
+
+    value = CPLEscapeString(interned_string(brick->bandname[b_brick]), -1, CPLES_XML);
+    fprintf(fv, "    <Description>%s</Description>\n", value);
+    CPLFree(value);
+
+    fprintf(fv, "    <NoDataValue>%d</NoDataValue>\n", brick->nodata[b_brick]);
+
+    get_brick_longdate(brick, b_brick, ldate, NPOW_05-1);
+
+    fprintf(fv, "    <Metadata domain=\"FORCE\">\n");
+    write_vrt_item(fv, "      ", "Domain", interned_string(brick->domain[b_brick]));
+    fprintf(fv, "      <MDI key=\"Wavelength\">%.3f</MDI>\n", brick->wavelength[b_brick]);
+    write_vrt_item(fv, "      ", "Wavelength_unit", interned_string(brick->unit[b_brick]));
+    fprintf(fv, "      <MDI key=\"Scale\">%.3f</MDI>\n", brick->scale[b_brick]);
+    write_vrt_item(fv, "      ", "Sensor", interned_string(brick->sensor[b_brick]));
+    write_vrt_item(fv, "      ", "Date", ldate);
+    fprintf(fv, "    </Metadata>\n");
+
+    value = CPLEscapeString(interned_string(brick->bandname[b_brick]), -1, CPLES_XML);
+    fprintf(fv, "    <SimpleSource>\n");
+    fprintf(fv, "      <SourceFilename relativeToVRT=\"1\">%s_%s.%s</SourceFilename>\n", 
+      brick->fname, value, brick->format.extension);
+    fprintf(fv, "      <SourceBand>1</SourceBand>\n");
+    fprintf(fv, "      <SrcRect xOff=\"0\" yOff=\"0\" xSize=\"%d\" ySize=\"%d\" />\n", brick->nx, brick->ny);
+    fprintf(fv, "      <DstRect xOff=\"0\" yOff=\"0\" xSize=\"%d\" ySize=\"%d\" />\n", brick->nx, brick->ny);
+    fprintf(fv, "    </SimpleSource>\n");
+    CPLFree(value);
+
+    fprintf(fv, "  </VRTRasterBand>\n");
+
+  }
+
+  fprintf(fv, "</VRTDataset>\n");
+
+  fclose(fv);
+  unlock_file(lock);
+
+  return SUCCESS;
+}
+
+
+/** This function outputs a brick
+--- brick:  brick
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_brick(brick_t *brick){
+int f, b, b_, o;
+int nbands, nfiles;
+int ***bands = NULL;
+lock_t *lock = NULL;
+GDALDriverH driver_physical = NULL;
+char **options = NULL;
 
-FILE *fprov = NULL;
 char provname[NPOW_10];
+bool chunk_store = false;
+bool zarr = false;
 
 char bname[NPOW_10];
 char fname[NPOW_10];
 int nchar;
 
-char ldate[NPOW_05];
-char lwritetime[NPOW_05];
-date_t today;
+int nthread = 1;
+int nerror = 0;
 
-char c_update[2][NPOW_04] = { "create", "update" };
-bool update;
+date_t today;
 
 GDALDataType file_datatype;
 
@@ -698,7 +1673,6 @@ int i = 0;
   //CPLPushErrorHandler(CPLQuietErrorHandler);
 
   alloc_2DC((void***)&fp_meta,   n_fp_meta,   NPOW_14, sizeof(char));
-  alloc_2DC((void***)&band_meta, n_band_meta, NPOW_14, sizeof(char));
   sys_meta = system_info(&n_sys_meta);
 
 
@@ -751,11 +1725,15 @@ int i = 0;
   
   //CPLSetConfigOption("GDAL_PAM_ENABLED", "YES");
   
+  // FORCE chunk format is written without GDAL
+  chunk_store = (strcmp(brick->format.driver, "FCF") == 0);
+
+  // Zarr is written without GDAL
+  zarr = (strcmp(brick->format.driver, "ZARR") == 0);
+
   // get driver
-  if ((driver_physical = GDALGetDriverByName(brick->format.driver)) == NULL){
+  if (!chunk_store && !zarr && (driver_physical = GDALGetDriverByName(brick->format.driver)) == NULL){
     printf("%s driver not found\n", brick->format.driver); return FAILURE;}
-  if ((driver = GDALGetDriverByName("MEM")) == NULL){
-    printf("%s driver not found\n", "MEM"); return FAILURE;}
 
   // set GDAL output options
   for (o=0; o<brick->format.n; o+=2){
@@ -788,11 +1766,11 @@ int i = 0;
 
 
   // output path
-  if ((lock = (char*)CPLLockFile(brick->dname, 60)) == NULL){
+  if ((lock = lock_file(brick->dname, 60)) == NULL){
     printf("Unable to lock directory %s (timeout: %ds). ", brick->dname, 60);
     return FAILURE;}
   createdir(brick->dname);
-  CPLUnlockFile(lock);
+  unlock_file(lock);
   lock = NULL;
 
   // provenance file
@@ -803,278 +1781,60 @@ int i = 0;
     printf("Buffer Overflow in assembling provenance file\n"); return FAILURE;}     
 
 
-  for (f=0; f<nfiles; f++){
-    
-    if (brick->explode){
-      nchar = snprintf(bname, NPOW_10, "_%s", brick->bandname[bands[_brick_][f][0]]);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling band ID\n"); return FAILURE;}      
-    } else bname[0] = '\0';
-  
-    nchar = snprintf(fname, NPOW_10, "%s/%s%s.%s", brick->dname, 
-      brick->fname, bname, brick->format.extension);
-    if (nchar < 0 || nchar >= NPOW_10){ 
-      printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
-
-    timeout = lock_timeout(get_brick_size(brick));
-
-    if ((lock = (char*)CPLLockFile(fname, timeout)) == NULL){
-      printf("Unable to lock file %s (timeout: %fs, nx/ny: %d/%d). ", fname, timeout, brick->nx, brick->ny);
-      return FAILURE;}
-
-
-    // mosaicking into existing file
-    // read and rewrite brick (safer when using compression)
-    if (brick->open != OPEN_CREATE && brick->open != OPEN_BLOCK && fileexist(fname)){
-
-      update = true;
-
-      // read brick
-      #ifdef FORCE_DEBUG
-      printf("reading existing file.\n");
-      #endif
-
-      if ((fo = GDALOpen(fname, GA_ReadOnly)) == NULL){
-        printf("Unable to open %s. ", fname); return FAILURE;}
-
-      if (GDALGetRasterCount(fo) != nbands){
-        printf("Number of bands %d do not match for UPDATE/MERGE mode (file: %d). ", 
-          nbands, GDALGetRasterCount(fo)); 
-        return FAILURE;}
-      if (GDALGetRasterXSize(fo) != brick->nx){
-        printf("Number of cols %d do not match for UPDATE/MERGE mode (file: %d). ", 
-          brick->nx, GDALGetRasterXSize(fo)); 
-        return FAILURE;}
-      if (GDALGetRasterYSize(fo) != brick->ny){
-        printf("Number of rows %d do not match for UPDATE/MERGE mode (file: %d). ", 
-          brick->ny, GDALGetRasterYSize(fo)); 
-        return FAILURE;}
-
-      alloc((void**)&buf, brick->nc, sizeof(float));
-
-      for (b=0; b<nbands; b++){
-
-        b_brick = bands[_brick_][f][b];
-        b_file  = bands[_FILE_][f][b];
-        
-        band = GDALGetRasterBand(fo, b_file);
-
-        if (GDALRasterIO(band, GF_Read, 0, 0, brick->nx, brick->ny, buf, 
-          brick->nx, brick->ny, GDT_Float32, 0, 0) == CE_Failure){
-          printf("Unable to read %s. ", fname); return FAILURE;} 
-
-
-        for (p=0; p<brick->nc; p++){
-
-          now = get_brick(brick, b_brick, p);
-          old = buf[p];
-
-          // if both old and now are valid: keep now or merge now and old
-          if (now != brick->nodata[b_brick] && old != brick->nodata[b_brick]){
-            if (brick->open == OPEN_MERGE) set_brick(brick, b_brick, p, (now+old)/2.0);
-          // if only old is valid, take old value
-          } else if (now == brick->nodata[b_brick] && old != brick->nodata[b_brick]){
-            set_brick(brick, b_brick, p, old);
-          }
-          // if only now is valid, nothing to do
-
-        }
-
-      }
-
-      GDALClose(fo);
-
-      free((void*)buf);
-
-    } else {
-      update = false;
-    }
-
-
-    // open for block mode or write from scratch
-    if (brick->open == OPEN_BLOCK && fileexist(fname) && brick->chunk > 0){
-      if ((fp = GDALOpen(fname, GA_Update)) == NULL){
-        printf("Unable to open %s. ", fname); return FAILURE;}
-    } else {
-      if ((fp = GDALCreate(driver, fname, brick->nx, brick->ny, nbands, file_datatype, options)) == NULL){
-        printf("Error creating memory file %s. ", fname); return FAILURE;}
-    }
-      
-    if (brick->open == OPEN_BLOCK){
-      if (brick->chunk < 0){
-        printf("attempting to write invalid chunk\n");
-        return FAILURE;
-      }
-      nx_write     = brick->cx;
-      ny_write     = brick->cy;
-      xoff_write   = 0;
-      yoff_write   = brick->chunk*brick->cy;
-    } else {
-      nx_write     = brick->nx;
-      ny_write     = brick->ny;
-      xoff_write   = 0;
-      yoff_write   = 0;
-    }
-
-
-    for (b=0; b<nbands; b++){
-
-      b_brick = bands[_brick_][f][b];
-      b_file  = bands[_FILE_][f][b];
-
-      band = GDALGetRasterBand(fp, b_file);
-
-      switch (brick->datatype){
-        case _DT_SHORT_:
-          if (GDALRasterIO(band, GF_Write, xoff_write, yoff_write, 
-            nx_write, ny_write, brick->vshort[b_brick], 
-            nx_write, ny_write, file_datatype, 0, 0) == CE_Failure){
-            printf("Unable to write %s. ", fname); return FAILURE;}
-          break;
-        case _DT_SMALL_:
-          if (GDALRasterIO(band, GF_Write, xoff_write, yoff_write, 
-            nx_write, ny_write, brick->vsmall[b_brick], 
-            nx_write, ny_write, file_datatype, 0, 0) == CE_Failure){
-            printf("Unable to write %s. ", fname); return FAILURE;} 
-          break;
-        case _DT_FLOAT_:
-          if (GDALRasterIO(band, GF_Write, xoff_write, yoff_write, 
-            nx_write, ny_write, brick->vfloat[b_brick], 
-            nx_write, ny_write, file_datatype, 0, 0) == CE_Failure){
-            printf("Unable to write %s. ", fname); return FAILURE;} 
-          break;
-        case _DT_INT_:
-          if (GDALRasterIO(band, GF_Write, xoff_write, yoff_write, 
-            nx_write, ny_write, brick->vint[b_brick], 
-            nx_write, ny_write, file_datatype, 0, 0) == CE_Failure){
-            printf("Unable to write %s. ", fname); return FAILURE;} 
-          break;
-        case _DT_USHORT_:
-          if (GDALRasterIO(band, GF_Write, xoff_write, yoff_write, 
-            nx_write, ny_write, brick->vushort[b_brick], 
-            nx_write, ny_write, file_datatype, 0, 0) == CE_Failure){
-            printf("Unable to write %s. ", fname); return FAILURE;} 
-          break;
-
-        default:
-          printf("unknown datatype for writing brick. ");
-          return FAILURE;
-      }
-
-      GDALSetDescription(band, brick->bandname[b_brick]);
-      GDALSetRasterNoDataValue(band, brick->nodata[b_brick]);
-
-    }
-
-    // write essential geo-metadata
-    #pragma omp critical
-    {
-      GDALSetGeoTransform(fp, brick->geotran);
-      GDALSetProjection(fp,   brick->proj);
-    }
-
-    // in case of ENVI, update description
-    //if (format == _FMT_ENVI_) 
-    //GDALSetDescription(fp, brick->name);
-
-    
-    // copy to physical file. This is needed for drivers that do not support CREATE
-    if ((fp_physical = GDALCreateCopy(driver_physical, fname, fp, FALSE, options, NULL, NULL)) == NULL){
-        printf("Error creating file %s. ", fname); return FAILURE;}
-
-    for (i=0; i<n_sys_meta; i+=2) GDALSetMetadataItem(fp_physical, sys_meta[i], sys_meta[i+1], "FORCE");
-    for (i=0; i<n_fp_meta;  i+=2) GDALSetMetadataItem(fp_physical, fp_meta[i],  fp_meta[i+1],  "FORCE");
+  // exploded bands are independent files, and are written in parallel.
+  // The file and system metadata are shared, each thread brings its own
+  // buffer for the band metadata
+  nthread = (brick->explode && brick->nthread > 1) ? brick->nthread : 1;
+  if (nthread > nfiles) nthread = nfiles;
 
-    for (b=0; b<nbands; b++){
-
-      b_brick = bands[_brick_][f][b];
-      b_file  = bands[_FILE_][f][b];
-
-      i = 0;
-
-      copy_string(band_meta[i++], NPOW_14, "Domain");
-      copy_string(band_meta[i++], NPOW_14, brick->domain[b_brick]);
+  #pragma omp parallel num_threads(nthread) private(f, nchar, bname, fname, band_meta) firstprivate(n_band_meta) shared(brick, bands, nfiles, nbands, provname, driver_physical, file_datatype, options, fp_meta, n_fp_meta, sys_meta, n_sys_meta, nthread) reduction(+: nerror) default(none)
+  {
 
-      copy_string(band_meta[i++], NPOW_14, "Wavelength");
-      nchar = snprintf(band_meta[i], NPOW_14, "%.3f", brick->wavelength[b_brick]); i++;
-      if (nchar < 0 || nchar >= NPOW_14){ 
-        printf("Buffer Overflow in assembling band metadata\n"); return FAILURE;}
+    if (nthread > 1) CPLPushErrorHandler(CPLQuietErrorHandler);
 
-      copy_string(band_meta[i++], NPOW_14, "Wavelength_unit");
-      copy_string(band_meta[i++], NPOW_14, brick->unit[b_brick]);
+    alloc_2DC((void***)&band_meta, n_band_meta, NPOW_14, sizeof(char));
 
-      copy_string(band_meta[i++], NPOW_14, "Scale");
-      nchar = snprintf(band_meta[i], NPOW_14, "%.3f", brick->scale[b_brick]); i++;
-      if (nchar < 0 || nchar >= NPOW_14){ 
-        printf("Buffer Overflow in assembling band metadata\n"); return FAILURE;}
+    #pragma omp for schedule(dynamic,1)
+    for (f=0; f<nfiles; f++){
 
-      copy_string(band_meta[i++], NPOW_14, "Sensor");
-      copy_string(band_meta[i++], NPOW_14, brick->sensor[b_brick]);
+      if (brick->explode){
+        nchar = snprintf(bname, NPOW_10, "_%s", interned_string(brick->bandname[bands[_brick_][f][0]]));
+        if (nchar < 0 || nchar >= NPOW_10){ 
+          printf("Buffer Overflow in assembling band ID\n"); nerror++; continue;}
+      } else bname[0] = '\0';
 
-      get_brick_longdate(brick, b_brick, ldate, NPOW_05-1);
-      copy_string(band_meta[i++], NPOW_14, "Date");
-      copy_string(band_meta[i++], NPOW_14, ldate);
-
-
-      band = GDALGetRasterBand(fp_physical, b_file);
+      nchar = snprintf(fname, NPOW_10, "%s/%s%s.%s", brick->dname, 
+        brick->fname, bname, brick->format.extension);
+      if (nchar < 0 || nchar >= NPOW_10){ 
+        printf("Buffer Overflow in assembling filename\n"); nerror++; continue;}
 
-      for (i=0; i<n_band_meta; i+=2) GDALSetMetadataItem(band, band_meta[i], band_meta[i+1], "FORCE");
+      if (write_brick_file(brick, bands[_brick_][f], bands[_FILE_][f], nbands, fname, provname, 
+        driver_physical, file_datatype, options, fp_meta, n_fp_meta, sys_meta, n_sys_meta, 
+        band_meta, n_band_meta) == FAILURE) nerror++;
 
     }
-    
-    GDALClose(fp_physical);
-    GDALClose(fp);
-
-  
-    CPLUnlockFile(lock);
-
-    // write provenance info
-    if (brick->nprovenance > 0 && brick->chunk == 0){
-
-      if ((lock = (char*)CPLLockFile(provname, timeout)) == NULL){
-        printf("Unable to lock file %s (timeout: %fs). ", provname, timeout);
-        return FAILURE;}
-
-      if (fileexist(provname)){
-
-        if ((fprov = fopen(provname, "a")) == NULL){
-          printf("Unable to re-open provenance file!\n"); 
-          return FAILURE;}
-
-      } else {
-
-        if ((fprov = fopen(provname, "w")) == NULL){
-          printf("Unable to create provenance file!\n"); 
-          return FAILURE;}
-
-        fprintf(fprov, "%s,%s,%s,%s\n", "file", "origin", "mode", "creation");
 
-      }
-
-      current_date(&today);
-      long_date(today.year, today.month, today.day, today.hh, today.mm, today.ss, today.tz, lwritetime, NPOW_05);
-
-      fprintf(fprov, "%s,", fname);
-      for (p=0; p<(brick->nprovenance-1); p++) fprintf(fprov, "%s;", brick->provenance[p]);
-      fprintf(fprov, "%s,%s,%s\n", brick->provenance[p], c_update[update], lwritetime);
-
-      fclose(fprov);
+    free_2DC((void**)band_meta);
 
-      CPLUnlockFile(lock);
-
-    }
-  
+    if (nthread > 1) CPLPopErrorHandler();
 
   }
 
+  // stack the exploded bands in a VRT
+  if (nerror == 0 && brick->explode && brick->vrt && !chunk_store && !zarr){
+    if (write_brick_vrt(brick, bands[_brick_], nfiles, file_datatype, 
+      fp_meta, n_fp_meta, sys_meta, n_sys_meta) == FAILURE) nerror++;
+  }
+
   if (options   != NULL){ CSLDestroy(options);                      options   = NULL;}
   if (fp_meta   != NULL){ free_2DC((void**)fp_meta);                fp_meta   = NULL;}
-  if (band_meta != NULL){ free_2DC((void**)band_meta);              band_meta = NULL;}
   if (sys_meta  != NULL){ free_2DC((void**)sys_meta);               sys_meta  = NULL;}
   if (bands     != NULL){ free_3D((void***)bands, NPOW_01, nfiles); bands     = NULL;}
 
   //CPLPopErrorHandler();
 
+  if (nerror > 0) return FAILURE;
+
   return SUCCESS;
 }
 
@@ -1095,13 +1855,13 @@ int warp_from_brick_to_unknown_brick(bool tile, int rsm, int threads, brick_t *s
 int i, j, p, k, b, b_, chunk_nb, nb;
 GDALDriverH driver;
 GDALDatasetH src_dataset;
-GDALDatasetH dst_dataset;
 GDALRasterBandH src_band;
 GDALDataType dt = GDT_Int16;
 GDALWarpOptions *wopt = NULL;
 GDALWarpOperation woper;
 GDALResampleAlg resample[3] = { GRA_NearestNeighbour, GRA_Bilinear, GRA_Cubic };
 void *transformer = NULL;
+void *approx = NULL;
 char src_proj[NPOW_10];
 double src_geotran[6];
 double dst_geotran[6];
@@ -1192,8 +1952,13 @@ char **papszWarpOptions = NULL;
   dst_nc = dst_nx*dst_ny;
   dst_geotran[1] = cube->res; dst_geotran[5] = -1 * cube->res; 
 
-  // destroy transformer
-  GDALDestroyGenImgProjTransformer(transformer);
+  // re-use the transformer for the warp, but map to the destination grid
+  // instead of destination coordinates. The approximate transformer inter-
+  // polates between exact transformations (max. error of 1/8 pixel)
+  GDALSetGenImgProjTransformerDstGeoTransform(transformer, dst_geotran);
+
+  if ((approx = GDALCreateApproxTransformer(GDALGenImgProjTransform, transformer, 0.125)) == NULL){
+    printf("could not create approximate transformer. "); return FAILURE;}
 
   #ifdef FORCE_DEBUG
   printf("src nx/ny: %d/%d\n",  src_nx, src_ny);
@@ -1219,30 +1984,28 @@ char **papszWarpOptions = NULL;
   #endif
 
 
+  // the data were copied to the source image, thus the brick can be 
+  // re-allocated with destination dimensions
+  free_brick_bands(src);
+  if (allocate_brick_bands(src, nb, dst_nc, _DT_SHORT_) == FAILURE){
+    printf("could not re-allocate brick. "); return FAILURE;}
+
+
+  // warp options that are shared by all chunks of bands
+  nchar = snprintf(nthread, NPOW_04, "%d", threads);
+  if (nchar < 0 || nchar >= NPOW_04){ 
+    printf("Buffer Overflow in assembling threads\n"); return FAILURE;}
+
+  papszWarpOptions = CSLSetNameValue(papszWarpOptions, "NUM_THREADS", nthread);
+  papszWarpOptions = CSLSetNameValue(papszWarpOptions, "INIT_DEST", "-9999");
+
+
   // iterate over chunks of bands (this is more expensive than warping all bands at once,
   // but way less expensive than each band at once. it helps to stay below RAM limit of 8GB
   for (b=0; b<nb; b+=chunk_nb){
 
     if (b+chunk_nb > nb) chunk_nb = nb-b;
 
- 
-    /** "create" the destination dataset
-    ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ **/
-
-    if ((dst_dataset = GDALCreate(driver, "mem", dst_nx, dst_ny, chunk_nb, dt, NULL)) == NULL){
-      printf("could not create dst image. "); return FAILURE;}
-    if (GDALSetProjection(dst_dataset, cube->proj) == CE_Failure){
-      printf("could not set dst projection. "); return FAILURE;}
-    if (GDALSetGeoTransform(dst_dataset, dst_geotran) == CE_Failure){
-      printf("could not set dst geotransformation. "); return FAILURE;}
-
-      
-    /** create accurate transformer between source and destination
-    ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ **/
-    if ((transformer = GDALCreateGenImgProjTransformer(src_dataset, src_proj,
-      dst_dataset, cube->proj, false, 0, 2)) == NULL){
-      printf("could not create image to image transformer. "); return FAILURE;}
-
 
     // buffer to hold warped image
     alloc_2DC((void***)&buf_, chunk_nb, dst_nc, sizeof(short));
@@ -1270,8 +2033,8 @@ char **papszWarpOptions = NULL;
     for (b_=0; b_<chunk_nb; b_++) wopt->panSrcBands[b_] = b_+b+1;
     wopt->panDstBands = (int*)CPLMalloc(sizeof(int)*chunk_nb);
     for (b_=0; b_<chunk_nb; b_++) wopt->panDstBands[b_] = b_+b+1;
-    wopt->pTransformerArg = transformer;
-    wopt->pfnTransformer = GDALGenImgProjTransform;
+    wopt->pTransformerArg = approx;
+    wopt->pfnTransformer = GDALApproxTransform;
     wopt->eWorkingDataType = dt;
 
     wopt->padfSrcNoDataReal = (double*)CPLMalloc(sizeof(double)*chunk_nb);
@@ -1284,12 +2047,6 @@ char **papszWarpOptions = NULL;
     wopt->padfDstNoDataImag = (double*)CPLMalloc(sizeof(double)*chunk_nb);
     for (b_=0; b_<chunk_nb; b_++) wopt->padfDstNoDataImag[b_] = 0;
 
-    nchar = snprintf(nthread, NPOW_04, "%d", threads);
-    if (nchar < 0 || nchar >= NPOW_04){ 
-      printf("Buffer Overflow in assembling threads\n"); return FAILURE;}
-
-    papszWarpOptions = CSLSetNameValue(papszWarpOptions, "NUM_THREADS", nthread);
-    papszWarpOptions = CSLSetNameValue(papszWarpOptions, "INIT_DEST", "-9999");
     wopt->papszWarpOptions = CSLDuplicate(papszWarpOptions);
 
 
@@ -1318,24 +2075,23 @@ char **papszWarpOptions = NULL;
     }
     }
 
-    GDALDestroyGenImgProjTransformer(wopt->pTransformerArg);
     GDALDestroyWarpOptions(wopt);
   
     for (b_=0; b_<chunk_nb; b_++){
-      re_alloc((void**)&src->vshort[b_+b], src_nc, dst_nc, sizeof(short));
       memmove(src->vshort[b_+b], buf_[b_], dst_nc*sizeof(short));
     }
 
     free((void*)buf_[0]); free((void*)buf_); buf_ = NULL;
 
-    GDALClose(dst_dataset);
-
     #ifdef FORCE_DEBUG
     printf("\n%d bands were warped in %d chunks.\n", chunk_nb, k+1);
     #endif
     
   }
 
+  CSLDestroy(papszWarpOptions);
+  GDALDestroyApproxTransformer(approx);
+  GDALDestroyGenImgProjTransformer(transformer);
   GDALClose(src_dataset);
 
 
@@ -1358,173 +2114,200 @@ char **papszWarpOptions = NULL;
 }
 
 
-/** This function reprojects an image from disc into any other projection. 
-+++ The extent of the warped image is known, and a target brick needs to 
-+++ be given, which defines extent, projection etc. 
-+++ The reprojection might be performed in chunks if the number of pixels
-+++ is too large to do it in one step.
+/** This function opens an image from disc, and prepares its reprojec-
++++ tion to the grid of a target brick, i.e. the transformers and the warp
++++ options. The returned context can be used to warp any number of bands
++++ to any brick with the same grid.
 --- rsm:         resampling method
 --- threads:     number of threads to perform warping
 --- fname:       filename
---- dst:         destination brick (modified)
---- src_b:       which band to warp?    (band in file)
---- dst_b:       which band to warp to? (band in destination brick)
---- src_nodata:  nodata value of band in file
-+++ Return:      SUCCESS/FAILURE
+--- dst:         destination brick (defines the target grid)
+--- src_nodata:  nodata value of image on disc
++++ Return:      warp context or NULL
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int warp_from_disc_to_known_brick(int rsm, int threads, const char *fname, brick_t *dst, int src_b, int dst_b, int src_nodata){
-GDALDatasetH src_dataset;
-GDALDatasetH dst_dataset;
-//GDALRasterBandH src_band;
-GDALDriverH driver;
-GDALDataType dt = GDT_Float32;
-GDALWarpOptions *wopt;
-GDALWarpOperation woper;
-GDALResampleAlg resample[3] = { GRA_NearestNeighbour, GRA_Bilinear, GRA_Cubic };
-CPLErr eErr = CE_Failure;
-void *transformer = NULL;
-float *buf = NULL;
+warp_ctx_t *create_warp_ctx(int rsm, int threads, const char *fname, brick_t *dst, int src_nodata){
+warp_ctx_t *ctx = NULL;
 const char *src_proj = NULL;
-char dst_proj[NPOW_10];
-double dst_geotran[6];
-int i, j, p, np, k, k_do;
-int dst_nodata;
-int nc_done_, nc_done = 0;
-int src_nb, dst_nb;
-int dst_nx, dst_ny;
-int chunk_nx, chunk_ny;
-int chunk_xoff, chunk_yoff;
-float tmp;
 char nthread[NPOW_04];
-char initdata[NPOW_04];
 int nchar;
-char **papszWarpOptions = NULL;
 
 
-  #ifdef FORCE_CLOCK
-  time_t TIME; time(&TIME);
-  #endif
+  if (rsm < 0 || rsm > 2){
+    printf("unknown resampling method %d. ", rsm); return NULL;}
 
-#ifdef FORCE_DEBUG
-printf("warp_from_disc_to_known_brick should handle multiband src and dst images\n");
-#endif
-  
-  // register drivers and fetch in-memory driver
-  if ((driver = GDALGetDriverByName("MEM")) == NULL){
-    printf("could not fetch in-memory driver. "); return FAILURE;}
+  alloc((void**)&ctx, 1, sizeof(warp_ctx_t));
+
+  ctx->rsm = rsm;
+  ctx->src_nodata = src_nodata;
+  ctx->dst_nx = get_brick_ncols(dst);
+  ctx->dst_ny = get_brick_nrows(dst);
+  get_brick_geotran(dst, ctx->dst_geotran, 6);
+  get_brick_proj(dst, ctx->dst_proj, NPOW_10);
 
 
   /** "create" source dataset
   ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ **/
 
-  if ((src_dataset = GDALOpen(fname, GA_ReadOnly)) == NULL){
-    printf("unable to open image for warping: %s\n", fname); return FAILURE;}
-
- 
-  #ifdef FORCE_DEBUG
-  printf("src nodata is %d, band is %d, dataset is %s\n", src_nodata, src_b+1, fname);
-  #endif
+  if ((ctx->src_dataset = GDALOpen(fname, GA_ReadOnly)) == NULL){
+    printf("unable to open image for warping: %s\n", fname); 
+    free_warp_ctx(ctx); return NULL;}
 
-  src_proj = GDALGetProjectionRef(src_dataset);
+  src_proj = GDALGetProjectionRef(ctx->src_dataset);
   CPLAssert(src_proj != NULL && strlen(src_proj) > 0);
-  src_nb = GDALGetRasterCount(src_dataset);
-  
-  if (src_b >= src_nb){
-    printf("Requested band %d is out of bounds %d (disc)! ", src_b, src_nb); return FAILURE;}
+  ctx->src_nb = GDALGetRasterCount(ctx->src_dataset);
 
   #ifdef FORCE_DEBUG
   printf("WKT of image on disc: %s\n", src_proj);
+  printf("warp to UL-X: %.0f / UL-Y: %.0f @ res: %.0f\n", ctx->dst_geotran[0], ctx->dst_geotran[3], ctx->dst_geotran[1]);
   #endif
-  
 
-  /** "create" the destination dataset
+
+  /** create transformers between source and destination grid
   ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ **/
 
+  if ((ctx->transformer = GDALCreateGenImgProjTransformer(ctx->src_dataset, src_proj,
+    NULL, ctx->dst_proj, false, 0, 2)) == NULL){
+    printf("could not create image to image transformer. "); 
+    free_warp_ctx(ctx); return NULL;}
+
+  GDALSetGenImgProjTransformerDstGeoTransform(ctx->transformer, ctx->dst_geotran);
+
+  // approximate transformer, max. error of 1/8 pixel
+  if ((ctx->approx = GDALCreateApproxTransformer(GDALGenImgProjTransform, ctx->transformer, 0.125)) == NULL){
+    printf("could not create approximate transformer. "); 
+    free_warp_ctx(ctx); return NULL;}
+
+
+  /** warp options that are shared by all warps
+  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ **/
+
+  nchar = snprintf(nthread, NPOW_04, "%d", threads);
+  if (nchar < 0 || nchar >= NPOW_04){ 
+    printf("Buffer Overflow in assembling threads\n"); 
+    free_warp_ctx(ctx); return NULL;}
+
+  ctx->options = CSLSetNameValue(ctx->options, "NUM_THREADS", nthread);
+  ctx->options = CSLSetNameValue(ctx->options, "INIT_DEST", "NO_DATA");
+
+  return ctx;
+}
+
+
+/** This function frees a warp context.
+--- ctx:    warp context
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_warp_ctx(warp_ctx_t *ctx){
+
+
+  if (ctx == NULL) return;
+
+  if (ctx->options     != NULL) CSLDestroy(ctx->options);
+  if (ctx->approx      != NULL) GDALDestroyApproxTransformer(ctx->approx);
+  if (ctx->transformer != NULL) GDALDestroyGenImgProjTransformer(ctx->transformer);
+  if (ctx->src_dataset != NULL) GDALClose(ctx->src_dataset);
+
+  free((void*)ctx);
+
+  return;
+}
+
+
+/** This function reprojects bands of an image from disc into a brick, 
++++ using a warp context. All bands are warped in one operation. The 
++++ reprojection might be performed in chunks if the number of pixels is 
++++ too large to do it in one step.
+--- ctx:         warp context
+--- dst:         destination brick (modified), same grid as the context
+--- src_b:       which bands to warp?    (bands in file)
+--- dst_b:       which bands to warp to? (bands in destination brick)
+--- nb:          number of bands
++++ Return:      SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int warp_ctx_to_brick(warp_ctx_t *ctx, brick_t *dst, int *src_b, int *dst_b, int nb){
+GDALDataType dt = GDT_Float32;
+GDALWarpOptions *wopt;
+GDALWarpOperation woper;
+GDALResampleAlg resample[3] = { GRA_NearestNeighbour, GRA_Bilinear, GRA_Cubic };
+CPLErr eErr = CE_Failure;
+float *buf = NULL;
+double dst_geotran[6];
+char dst_proj[NPOW_10];
+size_t np, chunk_nc;
+int b, k, k_do;
+int dst_nb, dst_nx, dst_ny;
+int nc_done_, nc_done = 0;
+int chunk_nx, chunk_ny;
+int chunk_xoff, chunk_yoff;
+float tmp, dst_nodata;
+
+
+  #ifdef FORCE_CLOCK
+  time_t TIME; time(&TIME);
+  #endif
+
+
   get_brick_geotran(dst, dst_geotran, 6);
   get_brick_proj(dst, dst_proj, NPOW_10);
-  dst_nodata = get_brick_nodata(dst, 0);
   dst_nb = get_brick_nbands(dst);
   dst_nx = get_brick_ncols(dst);
   dst_ny = get_brick_nrows(dst);
 
-  if (dst_b >= dst_nb){
-    printf("Requested band %d is out of bounds %d (brick)! ", dst_b, dst_nb); return FAILURE;}
-
-  if ((dst_dataset = GDALCreate(driver, "mem", dst_nx, dst_ny, 1, dt, NULL)) == NULL){
-    printf("could not create dst image. "); return FAILURE;}
-  if (GDALSetProjection(dst_dataset, dst_proj)){
-    printf("could not set dst projection. "); return FAILURE;}
-  if (GDALSetGeoTransform(dst_dataset, dst_geotran)){
-    printf("could not set dst geotransformation. "); return FAILURE;}
-
-  #ifdef FORCE_DEBUG
-  printf("warp to UL-X: %.0f / UL-Y: %.0f @ res: %.0f\n", dst_geotran[0], dst_geotran[3], dst_geotran[1]);
-  #endif
-  
+  if (dst_nx != ctx->dst_nx || dst_ny != ctx->dst_ny ||
+      memcmp(dst_geotran, ctx->dst_geotran, 6*sizeof(double)) != 0 ||
+      strcmp(dst_proj, ctx->dst_proj) != 0){
+    printf("brick does not match the grid of the warp context. "); return FAILURE;}
 
-  /** create accurate transformer between source and destination
-  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ **/
+  for (b=0; b<nb; b++){
+    if (src_b[b] < 0 || src_b[b] >= ctx->src_nb){
+      printf("Requested band %d is out of bounds %d (disc)! ", src_b[b], ctx->src_nb); return FAILURE;}
+    if (dst_b[b] < 0 || dst_b[b] >= dst_nb){
+      printf("Requested band %d is out of bounds %d (brick)! ", dst_b[b], dst_nb); return FAILURE;}
+  }
 
-  if ((transformer = GDALCreateGenImgProjTransformer(src_dataset, src_proj,
-    dst_dataset, dst_proj, false, 0, 2)) == NULL){
-    printf("could not create image to image transformer. "); return FAILURE;}
-  
 
   /** set warping options
   ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ **/
 
   wopt = GDALCreateWarpOptions();
-  wopt->hSrcDS = src_dataset;
+  wopt->hSrcDS = ctx->src_dataset;
   wopt->hDstDS = NULL;
-  wopt->eResampleAlg = resample[rsm];
-  wopt->nBandCount = 1;
-  wopt->panSrcBands = 
-    (int *) CPLMalloc(sizeof(int)*wopt->nBandCount);
-  wopt->panSrcBands[0] = src_b+1;
-  wopt->panDstBands = 
-    (int *) CPLMalloc(sizeof(int)*wopt->nBandCount);
-  wopt->panDstBands[0] = src_b+1;
-  wopt->pTransformerArg = transformer;
-  wopt->pfnTransformer = GDALGenImgProjTransform;
-  wopt->eWorkingDataType = dt;
+  wopt->eResampleAlg = resample[ctx->rsm];
+  wopt->nBandCount = nb;
+  wopt->panSrcBands = (int*)CPLMalloc(sizeof(int)*nb);
+  wopt->panDstBands = (int*)CPLMalloc(sizeof(int)*nb);
+  wopt->padfSrcNoDataReal = (double*)CPLMalloc(sizeof(double)*nb);
+  wopt->padfSrcNoDataImag = (double*)CPLMalloc(sizeof(double)*nb);
+  wopt->padfDstNoDataReal = (double*)CPLMalloc(sizeof(double)*nb);
+  wopt->padfDstNoDataImag = (double*)CPLMalloc(sizeof(double)*nb);
 
-  wopt->padfSrcNoDataReal =
-    (double*) CPLMalloc(sizeof(double)*wopt->nBandCount);
-  wopt->padfSrcNoDataReal[0] = src_nodata;
-  wopt->padfSrcNoDataImag =
-    (double*) CPLMalloc(sizeof(double)*wopt->nBandCount);
-  wopt->padfSrcNoDataImag[0] = 0.0;
+  for (b=0; b<nb; b++){
+    wopt->panSrcBands[b] = src_b[b]+1;
+    wopt->panDstBands[b] = b+1;
+    wopt->padfSrcNoDataReal[b] = ctx->src_nodata;
+    wopt->padfSrcNoDataImag[b] = 0.0;
+    wopt->padfDstNoDataReal[b] = get_brick_nodata(dst, dst_b[b]);
+    wopt->padfDstNoDataImag[b] = 0.0;
+  }
 
-  wopt->padfDstNoDataReal =
-    (double*) CPLMalloc(sizeof(double)*wopt->nBandCount);
-  wopt->padfDstNoDataReal[0] = dst_nodata;
-  wopt->padfDstNoDataImag =
-    (double*) CPLMalloc(sizeof(double)*wopt->nBandCount);
-  wopt->padfDstNoDataImag[0] = 0.0;
+  // the transformer is owned by the context
+  wopt->pTransformerArg = ctx->approx;
+  wopt->pfnTransformer = GDALApproxTransform;
+  wopt->eWorkingDataType = dt;
+  wopt->papszWarpOptions = CSLDuplicate(ctx->options);
+
+  if (woper.Initialize(wopt) != CE_None){
+    printf("could not initialize warper. "); 
+    GDALDestroyWarpOptions(wopt); return FAILURE;}
 
-  nchar = snprintf(nthread, NPOW_04, "%d", threads);
-  if (nchar < 0 || nchar >= NPOW_04){ 
-    printf("Buffer Overflow in assembling threads\n"); return FAILURE;}
-    
-  nchar = snprintf(initdata, NPOW_04, "%d", dst_nodata);
-  if (nchar < 0 || nchar >= NPOW_04){ 
-    printf("Buffer Overflow in assembling nodata\n"); return FAILURE;}
-   
-  papszWarpOptions = CSLSetNameValue(papszWarpOptions, "NUM_THREADS", nthread);
-  papszWarpOptions = CSLSetNameValue(papszWarpOptions, "INIT_DEST", initdata);
-  wopt->papszWarpOptions = CSLDuplicate(papszWarpOptions);
 
   // set nodata in destination image
-  if (dst_nodata != 0){
-    #pragma omp parallel shared(dst_nx, dst_ny, dst, dst_b, dst_nodata) default(none) 
-    {
-      #pragma omp for schedule(static)
-      for (p=0; p<dst_nx*dst_ny; p++) set_brick(dst, dst_b, p, dst_nodata);
+  for (b=0; b<nb; b++){
+    if ((dst_nodata = get_brick_nodata(dst, dst_b[b])) != 0){
+      with_brick_view(dst, fill_band_t(dst_b[b], dst_nx*dst_ny, dst_nodata));
     }
   }
 
-  // warp
-  woper.Initialize(wopt);
 
   chunk_xoff = 0; chunk_yoff = 0;
   chunk_nx = dst_nx; chunk_ny = dst_ny;
@@ -1538,14 +2321,9 @@ printf("warp_from_disc_to_known_brick should handle multiband src and dst images
       chunk_nx, chunk_ny, chunk_xoff, chunk_yoff);
     #endif
 
-    alloc((void**)&buf, chunk_nx*chunk_ny, sizeof(float));
-    if (dst_nodata != 0){
-      #pragma omp parallel shared(chunk_nx, chunk_ny, buf, dst_nodata) default(none) 
-      {
-        #pragma omp for schedule(static)
-        for (np=0; np<chunk_nx*chunk_ny; np++) buf[np] = dst_nodata;
-      }
-    }
+    // band-sequential buffer, initialized by the warper
+    chunk_nc = (size_t)chunk_nx*(size_t)chunk_ny;
+    alloc((void**)&buf, chunk_nc*nb, sizeof(float));
 
     // warp
     eErr = woper.WarpRegionToBuffer(chunk_xoff, chunk_yoff, chunk_nx, chunk_ny, buf, dt, 0, 0, 0, 0);
@@ -1570,23 +2348,11 @@ printf("warp_from_disc_to_known_brick should handle multiband src and dst images
       #endif
 
       // copy buffer to image
-      nc_done_ = 0;
-      
-      #pragma omp parallel private(j, p, np) shared(dst_nx, dst_ny, chunk_nx, chunk_ny, chunk_xoff, chunk_yoff, buf, dst, dst_b, dst_nodata) reduction(+: nc_done_) default(none) 
-      {
-
-        #pragma omp for schedule(static)
-        for (i=chunk_yoff; i<chunk_yoff+chunk_ny; i++){
-        for (j=chunk_xoff; j<chunk_xoff+chunk_nx; j++){
-          if (i >= dst_ny || j >= dst_nx) continue;
-          p  = i*dst_nx+j;
-          np = (i-chunk_yoff)*chunk_nx + (j-chunk_xoff);
-          set_brick(dst, dst_b, p, buf[np]);
-          buf[np] = dst_nodata;
-          nc_done_++;
-        }
-        }
-
+      for (b=0; b<nb; b++){
+        nc_done_ = 0;
+        np = chunk_nc*b;
+        with_brick_view(dst, copy_window_t(buf+np, dst_b[b], dst_nx, dst_ny, 
+          chunk_xoff, chunk_yoff, chunk_nx, chunk_ny, &nc_done_));
       }
       
       nc_done += nc_done_;
@@ -1612,25 +2378,50 @@ printf("warp_from_disc_to_known_brick should handle multiband src and dst images
   }
 
   #ifdef FORCE_DEBUG
-  printf("\nImage was warped in %d chunks.\n", k_do);
+  printf("\n%d bands were warped in %d chunks.\n", nb, k_do);
   #endif
 
-
-  /** close & clean
-  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ **/
-  GDALDestroyGenImgProjTransformer(wopt->pTransformerArg);
   GDALDestroyWarpOptions(wopt);
-  GDALClose(src_dataset);
-  GDALClose(dst_dataset);
 
   #ifdef FORCE_CLOCK
   proctime_print("warping disc to brick", TIME);
   #endif
 
+  if (eErr != CE_None){
+    printf("could not warp. "); return FAILURE;}
+
   return SUCCESS;
 }
 
 
+/** This function reprojects an image from disc into any other projection. 
++++ The extent of the warped image is known, and a target brick needs to 
++++ be given, which defines extent, projection etc. Use a warp context
++++ directly to warp several bands, or to warp to the same grid repeatedly.
+--- rsm:         resampling method
+--- threads:     number of threads to perform warping
+--- fname:       filename
+--- dst:         destination brick (modified)
+--- src_b:       which band to warp?    (band in file)
+--- dst_b:       which band to warp to? (band in destination brick)
+--- src_nodata:  nodata value of band in file
++++ Return:      SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int warp_from_disc_to_known_brick(int rsm, int threads, const char *fname, brick_t *dst, int src_b, int dst_b, int src_nodata){
+warp_ctx_t *ctx = NULL;
+int err;
+
+
+  if ((ctx = create_warp_ctx(rsm, threads, fname, dst, src_nodata)) == NULL) return FAILURE;
+
+  err = warp_ctx_to_brick(ctx, dst, &src_b, &dst_b, 1);
+
+  free_warp_ctx(ctx);
+
+  return err;
+}
+
+
 /** This function convertes the pixel location from one brick to another.
 +++ The bricks differ in spatial resolution.
 --- from:   source brick
@@ -1770,11 +2561,9 @@ void convert_brick_ji2jip(brick_t *from, brick_t *to, int i_from, int j_from, in
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int find_domain(brick_t *brick, const char *domain){
 int b, n = get_brick_nbands(brick);
-char domain_[NPOW_10];
 
   for (b=0; b<n; b++){
-    get_brick_domain(brick, b, domain_, NPOW_10);
-    if (strcmp(domain_, domain) == 0) return b;
+    if (strcmp(interned_string(brick->domain[b]), domain) == 0) return b;
   }
   
   return -1;
@@ -2084,6 +2873,77 @@ bool get_brick_explode(brick_t *brick){
 }
 
 
+/** This function sets the overview option of a brick
+--- brick:    brick
+--- overview: write internal overviews?
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void set_brick_overview(brick_t *brick, int overview){
+
+  brick->overview = overview;
+
+  return;
+}
+
+
+/** This function gets the overview option of a brick
+--- brick:    brick
++++ Return:   write internal overviews?
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool get_brick_overview(brick_t *brick){
+  
+  return brick->overview;
+}
+
+
+/** This function sets the VRT option of a brick
+--- brick:  brick
+--- vrt:    stack exploded bands in a VRT?
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void set_brick_vrt(brick_t *brick, int vrt){
+
+  brick->vrt = vrt;
+
+  return;
+}
+
+
+/** This function gets the VRT option of a brick
+--- brick:  brick
++++ Return: stack exploded bands in a VRT?
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool get_brick_vrt(brick_t *brick){
+  
+  return brick->vrt;
+}
+
+
+/** This function sets the number of threads for writing the exploded 
++++ bands of a brick
+--- brick:   brick
+--- nthread: number of threads
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void set_brick_nthread(brick_t *brick, int nthread){
+
+  brick->nthread = (nthread < 1) ? 1 : nthread;
+
+  return;
+}
+
+
+/** This function gets the number of threads for writing the exploded 
++++ bands of a brick
+--- brick:  brick
++++ Return: number of threads
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int get_brick_nthread(brick_t *brick){
+  
+  return brick->nthread;
+}
+
+
 /** This function sets the datatype of a brick
 --- brick:    brick
 --- datatype: datatype
@@ -2139,6 +2999,35 @@ int get_brick_byte(brick_t *brick){
 }
 
 
+/** This function gets the distance between two bands in the data slab
++++ of a brick, i.e. number of cells plus alignment padding
+--- brick:  brick
++++ Return: stride (in cells)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+size_t get_brick_stride(brick_t *brick){
+  
+  return brick->stride;
+}
+
+
+/** This function gets the data slab of a brick, i.e. the first band. All
++++ bands follow contiguously, with a distance of get_brick_stride cells
+--- brick:  brick
++++ Return: data slab, or NULL if no bands are allocated
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void *get_brick_slab(brick_t *brick){
+  
+  switch (brick->datatype){
+    case _DT_SHORT_:  return (brick->vshort  != NULL) ? (void*)brick->vshort[0]  : NULL;
+    case _DT_SMALL_:  return (brick->vsmall  != NULL) ? (void*)brick->vsmall[0]  : NULL;
+    case _DT_FLOAT_:  return (brick->vfloat  != NULL) ? (void*)brick->vfloat[0]  : NULL;
+    case _DT_INT_:    return (brick->vint    != NULL) ? (void*)brick->vint[0]    : NULL;
+    case _DT_USHORT_: return (brick->vushort != NULL) ? (void*)brick->vushort[0] : NULL;
+    default:          return NULL;
+  }
+}
+
+
 /** This function sets the number of bands of a brick
 --- brick:  brick
 --- nb:     number of bands
@@ -2251,6 +3140,8 @@ size_t get_brick_size(brick_t *brick){
 int b = 0;
 size_t size = 0;
 
+  if (brick == NULL) return 0;
+
   for (b=0; b<brick->nb; b++){
     if (get_brick_save(brick, b)) size += brick->nc*brick->byte;
   }
@@ -2259,6 +3150,42 @@ size_t size = 0;
 }
 
 
+/** This function gets the memory held by a brick, i.e. all bands, inclu-
++++ ding the ones that won't be saved
+--- brick:  brick
++++ Return: memory in bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+size_t get_brick_memory(brick_t *brick){
+
+  if (brick == NULL) return 0;
+
+  if (brick->vshort == NULL && brick->vsmall  == NULL && brick->vfloat == NULL &&
+      brick->vint   == NULL && brick->vushort == NULL) return 0;
+
+  return (size_t)brick->nb*brick->nc*brick->byte;
+}
+
+
+/** This function sets the memory owner of a brick, i.e. the band data
++++ are booked to this owner in the memory accounting (see alloc-cl.c)
+--- brick:  brick
+--- owner:  owner
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void set_brick_owner(brick_t *brick, const char *owner){
+
+  if (brick == NULL) return;
+
+  if (brick->vshort  != NULL) set_owner_2DS((void**)brick->vshort,  owner);
+  if (brick->vsmall  != NULL) set_owner_2DS((void**)brick->vsmall,  owner);
+  if (brick->vfloat  != NULL) set_owner_2DS((void**)brick->vfloat,  owner);
+  if (brick->vint    != NULL) set_owner_2DS((void**)brick->vint,    owner);
+  if (brick->vushort != NULL) set_owner_2DS((void**)brick->vushort, owner);
+
+  return;
+}
+
+
 /** This function sets the number of columns in chunk of a brick
 --- brick:  brick
 --- cx:     number of columns in chunk
@@ -2562,6 +3489,28 @@ double geox, geoy;
 }
 
 
+/** This function gets the geographic coordinates of all cells of a brick.
++++ The coordinates are reprojected in one go.
+--- brick:  brick
++++ lon:    longitudes (returned, must hold ncells values)
++++ lat:    latitudes  (returned, must hold ncells values)
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int get_brick_geo_grid(brick_t *brick, double *lon, double *lat){
+int i, j, p;
+
+
+  for (i=0, p=0; i<brick->ny; i++){
+  for (j=0; j<brick->nx; j++, p++){
+    lon[p] = get_brick_x(brick, j);
+    lat[p] = get_brick_y(brick, i);
+  }
+  }
+
+  return warp_any_to_geo_array(lon, lat, brick->nc, brick->proj);
+}
+
+
 /** This function sets the geotransformation of a brick
 --- brick:   brick
 --- geotran: geotransformation
@@ -2882,7 +3831,7 @@ float get_brick_wavelength(brick_t *brick, int b){
 void set_brick_unit(brick_t *brick, int b, const char *unit){
 
 
-  copy_string(brick->unit[b], NPOW_04, unit);
+  brick->unit[b] = intern_string(unit, NPOW_04);
 
   return;
 }
@@ -2898,7 +3847,7 @@ void set_brick_unit(brick_t *brick, int b, const char *unit){
 void get_brick_unit(brick_t *brick, int b, char unit[], size_t size){
 
 
-  copy_string(unit, size, brick->unit[b]);
+  copy_string(unit, size, interned_string(brick->unit[b]));
 
   return;
 }
@@ -2913,7 +3862,7 @@ void get_brick_unit(brick_t *brick, int b, char unit[], size_t size){
 void set_brick_domain(brick_t *brick, int b, const char *domain){
 
 
-  copy_string(brick->domain[b], NPOW_10, domain);
+  brick->domain[b] = intern_string(domain, NPOW_10);
 
   return;
 }
@@ -2929,7 +3878,7 @@ void set_brick_domain(brick_t *brick, int b, const char *domain){
 void get_brick_domain(brick_t *brick, int b, char domain[], size_t size){
 
 
-  copy_string(domain, size, brick->domain[b]);
+  copy_string(domain, size, interned_string(brick->domain[b]));
 
   return;
 }
@@ -2944,7 +3893,7 @@ void get_brick_domain(brick_t *brick, int b, char domain[], size_t size){
 void set_brick_bandname(brick_t *brick, int b, const char *bandname){
 
 
-  copy_string(brick->bandname[b], NPOW_10, bandname);
+  brick->bandname[b] = intern_string(bandname, NPOW_10);
 
   return;
 }
@@ -2960,7 +3909,7 @@ void set_brick_bandname(brick_t *brick, int b, const char *bandname){
 void get_brick_bandname(brick_t *brick, int b, char bandname[], size_t size){
 
   
-  copy_string(bandname, size, brick->bandname[b]);
+  copy_string(bandname, size, interned_string(brick->bandname[b]));
 
   return;
 }
@@ -2975,7 +3924,7 @@ void get_brick_bandname(brick_t *brick, int b, char bandname[], size_t size){
 void set_brick_sensor(brick_t *brick, int b, const char *sensor){
 
 
-  copy_string(brick->sensor[b], NPOW_04, sensor);
+  brick->sensor[b] = intern_string(sensor, NPOW_04);
 
   return;
 }
@@ -2991,7 +3940,7 @@ void set_brick_sensor(brick_t *brick, int b, const char *sensor){
 void get_brick_sensor(brick_t *brick, int b, char sensor[], size_t size){
 
 
-  copy_string(sensor, size, brick->sensor[b]);
+  copy_string(sensor, size, interned_string(brick->sensor[b]));
 
   return;
 }
@@ -3597,13 +4546,9 @@ int b;
 +++ Return: minimum
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 float get_brick_min(brick_t *brick, int b){
-int p;
-float tmp, min = LONG_MAX;
+float min, max;
 
-   for (p=0; p<brick->nc; p++){
-     if (is_brick_nodata(brick, b, p)) continue;
-     if ((tmp = get_brick(brick, b, p)) < min) min = tmp;
-   }
+   get_brick_range(brick, b, &min, &max);
 
    return min;
 }
@@ -3615,13 +4560,9 @@ float tmp, min = LONG_MAX;
 +++ Return: maximum
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 float get_brick_max(brick_t *brick, int b){
-int p;
-float tmp, max = LONG_MIN;
+float min, max;
 
-   for (p=0; p<brick->nc; p++){
-     if (is_brick_nodata(brick, b, p)) continue;
-     if ((tmp = get_brick(brick, b, p)) > max) max = tmp;
-   }
+   get_brick_range(brick, b, &min, &max);
    
    return max;
 }
@@ -3635,18 +4576,12 @@ float tmp, max = LONG_MIN;
 +++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void get_brick_range(brick_t *brick, int b, float *min, float *max){
-int p;
-float tmp, mx = LONG_MIN, mn = LONG_MAX;
 
-   for (p=0; p<brick->nc; p++){
-     if (is_brick_nodata(brick, b, p)) continue;
-     tmp = get_brick(brick, b, p);
-     if (tmp < mn) mn = tmp;
-     if (tmp > mx) mx = tmp;
-   }
+   *min = LONG_MAX;
+   *max = LONG_MIN;
+
+   with_brick_view(brick, band_range_t(b, brick->nodata[b], min, max));
 
-   *min = mn;
-   *max = mx;
    return;
 }
 
@@ -60,6 +60,9 @@ typedef struct {
   int sid;               // sensor ID
   int open;              // open mode
   int explode;           // explode to single-bands?
+  int overview;          // write internal overviews?
+  int vrt;               // stack exploded bands in a VRT?
+  int nthread;           // threads for writing exploded bands
   int datatype;          // datatype
   int byte;              // number of bytes
   gdalopt_t format;      // GDAL output options
@@ -89,12 +92,13 @@ typedef struct {
   float *scale;          // scale factor
 
   float *wavelength;     // wavelength
-  char  **unit;          // wavelength unit
-  char  **domain;        // band domain (e.g. NIR)
-  char  **bandname;      // band name
-  char  **sensor;        // sensor ID
+  int   *unit;           // wavelength unit (interned string)
+  int   *domain;         // band domain (e.g. NIR) (interned string)
+  int   *bandname;       // band name (interned string)
+  int   *sensor;         // sensor ID (interned string)
   date_t *date;          // date
                          
+  size_t stride;         // cells per band in the data slab (incl. padding)
   short  **vshort;       // data (z/xy flattened by line)
   float  **vfloat;       // data (z/xy flattened by line)
   int    **vint;         // data (z/xy flattened by line)
@@ -103,17 +107,24 @@ typedef struct {
     
 } brick_t;
 
+// reprojection context, opaque
+typedef struct warp_ctx_t warp_ctx_t;
+
 int      allocate_brick_bands(brick_t *brick, int nb, int nc, int datatype);
 int      reallocate_brick_bands(brick_t *brick, int nb);
 brick_t *allocate_brick(int nb, int nc, int datatype);
 int      reallocate_brick(brick_t *brick, int nb);
 void     free_brick_bands(brick_t *brick);
+int      move_brick_bands(brick_t *brick, brick_t *from, int datatype);
 void     free_brick(brick_t *brick);
 void     copy_brick_band(brick_t *brick, int b, brick_t *from, int b_from);
 brick_t *copy_brick(brick_t *from, int nb, int datatype);
 brick_t *crop_brick(brick_t *from, double radius);
 int      warp_from_brick_to_unknown_brick(bool tile, int rsm, int threads, brick_t *src, cube_t *cube);
 int      warp_from_disc_to_known_brick(int rsm, int threads, const char *fname, brick_t *dst, int src_b, int dst_b, int src_nodata);
+warp_ctx_t *create_warp_ctx(int rsm, int threads, const char *fname, brick_t *dst, int src_nodata);
+int      warp_ctx_to_brick(warp_ctx_t *ctx, brick_t *dst, int *src_b, int *dst_b, int nb);
+void     free_warp_ctx(warp_ctx_t *ctx);
 void     init_brick_bands(brick_t *brick);
 void     init_brick(brick_t *brick);
 int      write_brick(brick_t *brick);
@@ -148,12 +159,20 @@ void     set_brick_open(brick_t *brick, int open);
 bool     get_brick_open(brick_t *brick);
 void     set_brick_explode(brick_t *brick, int explode);
 bool     get_brick_explode(brick_t *brick);
+void     set_brick_overview(brick_t *brick, int overview);
+bool     get_brick_overview(brick_t *brick);
+void     set_brick_vrt(brick_t *brick, int vrt);
+bool     get_brick_vrt(brick_t *brick);
+void     set_brick_nthread(brick_t *brick, int nthread);
+int      get_brick_nthread(brick_t *brick);
 void     set_brick_datatype(brick_t *brick, int datatype);
 int      get_brick_datatype(brick_t *brick);
 void     set_brick_output_datatype(brick_t *brick, int datatype);
 int      get_brick_output_datatype(brick_t *brick);
 void     set_brick_byte(brick_t *brick, size_t byte);
 int      get_brick_byte(brick_t *brick);
+size_t   get_brick_stride(brick_t *brick);
+void    *get_brick_slab(brick_t *brick);
 void     set_brick_nbands(brick_t *brick, int nb);
 int      get_brick_nbands(brick_t *brick);
 void     set_brick_ncols(brick_t *brick, int nx);
@@ -163,6 +182,8 @@ int      get_brick_nrows(brick_t *brick);
 void     set_brick_ncells(brick_t *brick, int nc);
 int      get_brick_ncells(brick_t *brick);
 size_t   get_brick_size(brick_t *brick);
+size_t   get_brick_memory(brick_t *brick);
+void     set_brick_owner(brick_t *brick, const char *owner);
 void     set_brick_chunkncols(brick_t *brick, int cx);
 int      get_brick_chunkncols(brick_t *brick);
 void     set_brick_chunknrows(brick_t *brick, int cy);
@@ -186,6 +207,7 @@ void     set_brick_uly(brick_t *brick, double uly);
 double   get_brick_uly(brick_t *brick);
 double   get_brick_y(brick_t *brick, int i);
 void     get_brick_geo(brick_t *brick, int j, int i, double *lon, double *lat);
+int      get_brick_geo_grid(brick_t *brick, double *lon, double *lat);
 void     set_brick_geotran(brick_t *brick, double *geotran);
 void     get_brick_geotran(brick_t *brick, double geotran[], size_t size);
 void     set_brick_width(brick_t *brick, double width);
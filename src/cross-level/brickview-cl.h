@@ -0,0 +1,143 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Typed brick views header (C++ only)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef BRICKVIEW_CL_H
+#define BRICKVIEW_CL_H
+
+#ifdef __cplusplus
+
+#include <cstddef>   // size types
+
+#include "../cross-level/brick-cl.h"
+
+
+/** The view classes give typed, inline access to the data of a brick. 
++++ The datatype is resolved at compile time, thus hot loops do not call 
++++ get_brick/set_brick with a datatype switch per pixel, and can be vec-
++++ torized by the compiler. with_brick_view dispatches once from the run-
++++ time datatype to the matching view.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+// datatype traits
+template <typename T> struct brick_type;
+
+template <> struct brick_type<short> {
+  static const int datatype = _DT_SHORT_;
+  static short **bands(brick_t *brick){ return brick->vshort; }
+};
+
+template <> struct brick_type<small> {
+  static const int datatype = _DT_SMALL_;
+  static small **bands(brick_t *brick){ return brick->vsmall; }
+};
+
+template <> struct brick_type<float> {
+  static const int datatype = _DT_FLOAT_;
+  static float **bands(brick_t *brick){ return brick->vfloat; }
+};
+
+template <> struct brick_type<int> {
+  static const int datatype = _DT_INT_;
+  static int **bands(brick_t *brick){ return brick->vint; }
+};
+
+template <> struct brick_type<ushort> {
+  static const int datatype = _DT_USHORT_;
+  static ushort **bands(brick_t *brick){ return brick->vushort; }
+};
+
+
+// contiguous range of values, e.g. one band or one row
+template <typename T>
+class brick_span {
+  public:
+    brick_span(T *data, int n) : data_(data), n_(n) {}
+    T *begin() const { return data_; }
+    T *end()   const { return data_+n_; }
+    T *data()  const { return data_; }
+    int size() const { return n_; }
+    T &operator[](int i) const { return data_[i]; }
+  private:
+    T  *data_;
+    int n_;
+};
+
+
+// typed view of a brick, does not own the data
+template <typename T>
+class brick_view {
+  public:
+    explicit brick_view(brick_t *brick) : 
+      bands_((brick->datatype == brick_type<T>::datatype) ? brick_type<T>::bands(brick) : NULL), 
+      nb_(brick->nb), nx_(brick->nx), nc_(brick->nc), stride_(brick->stride) {}
+
+    bool valid()  const { return bands_ != NULL; }
+    int nbands()  const { return nb_; }
+    int ncols()   const { return nx_; }
+    int ncells()  const { return nc_; }
+    size_t stride() const { return stride_; }
+
+    T *band(int b) const { return bands_[b]; }
+    T &operator()(int b, int p) const { return bands_[b][p]; }
+    T &operator()(int b, int i, int j) const { return bands_[b][i*nx_+j]; }
+
+    brick_span<T> cells(int b) const { return brick_span<T>(bands_[b], nc_); }
+    brick_span<T> row(int b, int i) const { return brick_span<T>(bands_[b]+(size_t)i*nx_, nx_); }
+
+  private:
+    T **bands_;
+    int nb_, nx_, nc_;
+    size_t stride_;
+};
+
+
+/** This function calls a functor with the typed view of a brick. The
++++ functor needs a templated call operator, e.g. 
++++ struct fill { template <typename T> void operator()(brick_view<T> v); }
+--- brick:  brick
+--- f:      functor
++++ Return: false if the brick has no data, true otherwise
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+template <typename F>
+inline bool with_brick_view(brick_t *brick, F f){
+
+  switch (brick->datatype){
+    case _DT_SHORT_:  f(brick_view<short>(brick));  return true;
+    case _DT_SMALL_:  f(brick_view<small>(brick));  return true;
+    case _DT_FLOAT_:  f(brick_view<float>(brick));  return true;
+    case _DT_INT_:    f(brick_view<int>(brick));    return true;
+    case _DT_USHORT_: f(brick_view<ushort>(brick)); return true;
+    default:          return false;
+  }
+
+}
+
+#endif
+
+#endif
+
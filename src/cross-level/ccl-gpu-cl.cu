@@ -0,0 +1,189 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains connected components labeling on the GPU. One thread
+per pixel merges its pixel with the preceding neighbours in a lock-free
+union-find, in which atomicMin always links a root to the smaller root.
+The trees are then flattened, such that each pixel holds the index of 
+the first pixel of its component. Numbering the components is left to
+ccl_relabel in imagefuns-cl.c. Without FORCE_CUDA, this file is compiled
+as C++ and ccl_gpu always cancels.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "ccl-gpu-cl.h"
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define GPU_NTHREAD 256
+
+
+/** device functions and kernels
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+__device__ int ccl_find_device(const int *L, int p){
+
+  while (L[p] != p) p = L[p];
+
+  return p;
+}
+
+
+// link the trees of p and q, the larger root is hooked to the smaller
+__device__ void ccl_union_device(int *L, int p, int q){
+int old;
+bool done = false;
+
+  while (!done){
+
+    p = ccl_find_device(L, p);
+    q = ccl_find_device(L, q);
+
+    if (p < q){
+      old = atomicMin(&L[q], p);
+      done = (old == q);
+      q = old;
+    } else if (q < p){
+      old = atomicMin(&L[p], q);
+      done = (old == p);
+      p = old;
+    } else {
+      done = true;
+    }
+
+  }
+
+  return;
+}
+
+
+__global__ void ccl_init_kernel(const small *image, int *L, int n){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+
+  if (p < n) L[p] = image[p] ? p : -1;
+}
+
+
+// merge with left, upper-left, upper and upper-right neighbour
+__global__ void ccl_merge_kernel(const small *image, int *L, int nx, int ny){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+int i, j, q;
+
+
+  if (p >= nx*ny || !image[p]) return;
+
+  i = p / nx;
+  j = p % nx;
+
+  if (j > 0 && image[p-1]) ccl_union_device(L, p, p-1);
+
+  if (i == 0) return;
+
+  q = p-nx;
+
+  if (image[q]){
+    ccl_union_device(L, p, q);
+  } else {
+    if (j > 0    && image[q-1]) ccl_union_device(L, p, q-1);
+    if (j < nx-1 && image[q+1]) ccl_union_device(L, p, q+1);
+  }
+
+  return;
+}
+
+
+__global__ void ccl_flatten_kernel(const small *image, int *L, int n){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+
+  if (p < n && image[p]) L[p] = ccl_find_device(L, p);
+}
+
+#endif
+
+
+/** This function links all 8-connected TRUE pixels of a binary image to
++++ the first pixel of their component in raster order.
+--- image:  Binary image (only use with 0/1)
+--- CCL:    index of first pixel of component, undefined for FALSE pixels
+---         (returned)
+--- nx:     number of columns
+--- ny:     number of rows
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int ccl_gpu(small *image, int *CCL, int nx, int ny){
+#ifdef FORCE_CUDA
+gpu_stream_t stream = claim_gpu_stream();
+cudaStream_t s = (cudaStream_t)gpu_cuda_stream(stream);
+small *img = NULL;
+int   *L   = NULL;
+int n = nx*ny, nblock;
+size_t bytes_img, bytes_ccl;
+int error = 0;
+
+
+  if (!gpu_enabled() || gpu_select(stream) == FAILURE) return CANCEL;
+
+  bytes_img = (size_t)n*sizeof(small);
+  bytes_ccl = (size_t)n*sizeof(int);
+
+  if ((img = (small*)gpu_alloc(bytes_img, stream)) == NULL) error++;
+  if ((L   = (int*)gpu_alloc(bytes_ccl, stream))   == NULL) error++;
+
+  if (!error){
+
+    nblock = (n+GPU_NTHREAD-1)/GPU_NTHREAD;
+
+    cudaMemcpyAsync(img, image, bytes_img, cudaMemcpyHostToDevice, s);
+    ccl_init_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(img, L, n);
+    ccl_merge_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(img, L, nx, ny);
+    ccl_flatten_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(img, L, n);
+    cudaMemcpyAsync(CCL, L, bytes_ccl, cudaMemcpyDeviceToHost, s);
+
+    if (cudaGetLastError() != cudaSuccess){
+      printf("launching labeling kernels failed. ");
+      error++;
+    }
+
+  }
+
+  if (gpu_sync(stream) == FAILURE) error++;
+
+  gpu_release(img, bytes_img, stream);
+  gpu_release(L,   bytes_ccl, stream);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
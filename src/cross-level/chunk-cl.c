@@ -0,0 +1,459 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for reading and writing the FORCE chunk 
+format, i.e. pre-chunked, uncompressed arrays that can be mapped into 
+memory without going through a codec
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "chunk-cl.h"
+
+#include <unistd.h>    // standard symbolic constants and types 
+#include <fcntl.h>     // file control options
+#include <errno.h>     // error numbers
+#include <sys/mman.h>  // memory management declarations
+#include <sys/stat.h>  // data returned by the stat() function
+
+
+void *chunk_band_pointer(brick_t *brick, int b);
+size_t chunk_bytes(fcf_header_t *head);
+int write_whole(int fd, const void *buf, size_t n, off_t offset);
+float chunk_store_value(chunk_store_t *store, int b, int p);
+
+
+/** This function returns a pointer to the data of one band of a brick, 
++++ irrespective of datatype
+--- brick:  brick
+--- b:      band
++++ Return: pointer to band data
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void *chunk_band_pointer(brick_t *brick, int b){
+
+
+  switch (brick->datatype){
+    case _DT_SHORT_:
+      return (void*)get_band_short(brick, b);
+    case _DT_SMALL_:
+      return (void*)get_band_small(brick, b);
+    case _DT_FLOAT_:
+      return (void*)get_band_float(brick, b);
+    case _DT_INT_:
+      return (void*)get_band_int(brick, b);
+    case _DT_USHORT_:
+      return (void*)get_band_ushort(brick, b);
+    default:
+      printf("unknown datatype for chunk store. ");
+      return NULL;
+  }
+
+}
+
+
+/** This function computes the number of bytes of one band in one chunk
+--- head:   header of chunk store
++++ Return: number of bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+size_t chunk_bytes(fcf_header_t *head){
+
+  return (size_t)head->cy*head->nx*head->byte;
+}
+
+
+/** This function writes a buffer to a file, and retries until all bytes
++++ are written
+--- fd:     file descriptor
+--- buf:    buffer
+--- n:      number of bytes
+--- offset: byte offset in file
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_whole(int fd, const void *buf, size_t n, off_t offset){
+const char *ptr = (const char*)buf;
+ssize_t nw;
+
+
+  while (n > 0){
+
+    if ((nw = pwrite(fd, ptr, n, offset)) < 0){
+      if (errno == EINTR) continue;
+      return FAILURE;
+    }
+
+    ptr += nw; offset += nw; n -= nw;
+
+  }
+
+  return SUCCESS;
+}
+
+
+/** This function reads one value from a chunk store
+--- store:  chunk store
+--- b:      band (starting at 0)
+--- p:      pixel
++++ Return: value
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+float chunk_store_value(chunk_store_t *store, int b, int p){
+fcf_header_t *head = &store->head;
+int x = p % head->nx;
+int y = p / head->nx;
+size_t k;
+const char *ptr;
+
+
+  k = ((size_t)(y / head->cy)*head->nb + b)*head->cy*head->nx + 
+      (size_t)(y % head->cy)*head->nx + x;
+  ptr = store->map + head->offset + k*head->byte;
+
+  switch (head->datatype){
+    case _DT_SHORT_:  return (float)*((const short*)ptr);
+    case _DT_SMALL_:  return (float)*((const small*)ptr);
+    case _DT_FLOAT_:  return *((const float*)ptr);
+    case _DT_INT_:    return (float)*((const int*)ptr);
+    case _DT_USHORT_: return (float)*((const ushort*)ptr);
+    default:          return 0;
+  }
+
+}
+
+
+/** This function tests whether a file is a FORCE chunk format file
+--- fname:  filename
++++ Return: true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool is_chunk_store(const char *fname){
+const char *dot = strrchr(fname, '.');
+
+  return dot != NULL && strcmp(dot, ".fcf") == 0;
+}
+
+
+/** This function opens a chunk store, and maps it into memory. The map-
++++ ping is read-only and shared, i.e. pages come straight from the page
++++ cache, and repeated reads of the same file do not decode anything.
+--- fname:  filename
++++ Return: chunk store (or NULL)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+chunk_store_t *open_chunk_store(const char *fname){
+chunk_store_t *store = NULL;
+struct stat st;
+size_t need;
+
+
+  alloc((void**)&store, 1, sizeof(chunk_store_t));
+
+  if ((store->fd = open(fname, O_RDONLY)) < 0){
+    printf("unable to open chunk store %s. ", fname);
+    free((void*)store); return NULL;}
+
+  if (fstat(store->fd, &st) != 0 || (size_t)st.st_size < sizeof(fcf_header_t)){
+    printf("chunk store %s is truncated. ", fname);
+    close(store->fd); free((void*)store); return NULL;}
+
+  store->size = (size_t)st.st_size;
+
+  if ((store->map = (char*)mmap(NULL, store->size, PROT_READ, MAP_SHARED, store->fd, 0)) == MAP_FAILED){
+    printf("unable to map chunk store %s. ", fname);
+    close(store->fd); free((void*)store); return NULL;}
+
+  memcpy(&store->head, store->map, sizeof(fcf_header_t));
+
+  if (memcmp(store->head.magic, FCF_MAGIC, 8) != 0 || 
+      store->head.version != FCF_VERSION){
+    printf("%s is not a FORCE chunk store (or unsupported version). ", fname);
+    close_chunk_store(store); return NULL;}
+
+  need = store->head.offset + chunk_bytes(&store->head)*
+         store->head.nchunk*store->head.nb;
+
+  if (store->head.nb < 1 || store->head.cy < 1 || store->size < need){
+    printf("chunk store %s is corrupt or truncated. ", fname);
+    close_chunk_store(store); return NULL;}
+
+  store->nodata = (const int32_t*)(store->map + sizeof(fcf_header_t));
+
+  return store;
+}
+
+
+/** This function unmaps and closes a chunk store
+--- store:  chunk store
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void close_chunk_store(chunk_store_t *store){
+
+  if (store == NULL) return;
+
+  if (store->map != NULL && store->map != MAP_FAILED) munmap(store->map, store->size);
+  if (store->fd >= 0) close(store->fd);
+  free((void*)store);
+
+  return;
+}
+
+
+/** This function copies a window of several bands from a chunk store
++++ into a band-sequential short buffer. Within a chunk, each line of a 
++++ band is contiguous, thus a line is one memcpy if the store holds 
++++ shorts. No resampling is done, the window needs to be given at the 
++++ resolution of the store. The bands may be spaced further apart than
++++ the window, e.g. to read into the padded bands of a brick.
+--- store:    chunk store
+--- band_map: bands to read (starting at 1)
+--- nread:    number of bands to read
+--- xoff:     column offset
+--- yoff:     row offset
+--- nx:       number of columns
+--- ny:       number of rows
+--- space:    number of values from one band to the next (>= nx*ny)
+--- buf:      buffer (nread*space, returned)
++++ Return:   SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int read_chunk_store(chunk_store_t *store, int *band_map, int nread, int xoff, int yoff, int nx, int ny, size_t space, short *buf){
+fcf_header_t *head = &store->head;
+size_t cbytes = chunk_bytes(head);
+size_t lbytes = (size_t)head->nx*head->byte;
+size_t first, last;
+const char *line = NULL;
+short *dst = NULL;
+int k, b, y, x;
+
+
+  if (xoff < 0 || yoff < 0 || xoff+nx > head->nx || yoff+ny > head->ny){
+    printf("requested window exceeds chunk store. "); return FAILURE;}
+
+  for (k=0; k<nread; k++){
+    if (band_map[k] < 1 || band_map[k] > head->nb){
+      printf("requested band %d does not exist in chunk store. ", band_map[k]); return FAILURE;}
+  }
+
+  // tell the kernel which chunks will be touched
+  first = head->offset + (size_t)(yoff / head->cy)*head->nb*cbytes;
+  last  = head->offset + (size_t)((yoff+ny-1) / head->cy + 1)*head->nb*cbytes;
+  first -= first % FCF_ALIGN;
+  madvise(store->map + first, last-first, MADV_WILLNEED);
+
+  for (k=0; k<nread; k++){
+
+    b = band_map[k]-1;
+
+    for (y=0; y<ny; y++){
+
+      line = store->map + head->offset + 
+        ((size_t)((yoff+y) / head->cy)*head->nb + b)*cbytes + 
+        (size_t)((yoff+y) % head->cy)*lbytes + (size_t)xoff*head->byte;
+      dst = buf + (size_t)k*space + (size_t)y*nx;
+
+      switch (head->datatype){
+        case _DT_SHORT_:
+          memcpy(dst, line, nx*sizeof(short));
+          break;
+        case _DT_SMALL_:
+          for (x=0; x<nx; x++) dst[x] = ((const small*)line)[x];
+          break;
+        case _DT_USHORT_:
+          for (x=0; x<nx; x++) dst[x] = ((const ushort*)line)[x];
+          break;
+        case _DT_INT_:
+          for (x=0; x<nx; x++) dst[x] = ((const int*)line)[x];
+          break;
+        case _DT_FLOAT_:
+          for (x=0; x<nx; x++) dst[x] = ((const float*)line)[x];
+          break;
+        default:
+          printf("unknown datatype in chunk store. ");
+          return FAILURE;
+      }
+
+    }
+
+  }
+
+  return SUCCESS;
+}
+
+
+/** This function writes a brick to a chunk store. In block mode, only one
++++ chunk is written into an existing file. In update and merge mode, the
++++ existing file is read, and the values are combined the same way as 
++++ for GDAL output. Otherwise, a new file is written, and moved into its
++++ final place when complete, such that readers never see partial files.
+--- brick:  brick
+--- fname:  filename
+--- bands:  bands of the brick to write
+--- nbands: number of bands to write
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_chunk_store(brick_t *brick, const char *fname, int *bands, int nbands){
+chunk_store_t *old = NULL;
+fcf_header_t head;
+int32_t *nodata = NULL;
+char tname[NPOW_10];
+size_t cbytes, lbytes, total;
+int fd, b, c, p, nrows, nchar;
+int c0, c1;
+float now, before;
+char *data = NULL;
+struct stat st;
+
+
+  memset(&head, 0, sizeof(fcf_header_t));
+  memcpy(head.magic, FCF_MAGIC, 8);
+  head.version  = FCF_VERSION;
+  head.datatype = brick->datatype;
+  head.byte     = brick->byte;
+  head.nb       = nbands;
+  head.nx       = brick->nx;
+  head.ny       = brick->ny;
+  head.cy       = (brick->cy > 0) ? brick->cy : brick->ny;
+  head.nchunk   = (head.ny + head.cy - 1) / head.cy;
+  memcpy(head.geotran, brick->geotran, 6*sizeof(double));
+  copy_string(head.proj, NPOW_10, brick->proj);
+  head.offset   = sizeof(fcf_header_t) + nbands*sizeof(int32_t);
+  head.offset   = (head.offset + FCF_ALIGN - 1) / FCF_ALIGN * FCF_ALIGN;
+
+  cbytes = chunk_bytes(&head);
+  lbytes = (size_t)head.nx*head.byte;
+  total  = head.offset + cbytes*head.nchunk*nbands;
+
+  if (brick->open == OPEN_BLOCK && brick->cx != brick->nx){
+    printf("chunk store needs full-width chunks (%d vs. %d columns). ", brick->cx, brick->nx);
+    return FAILURE;}
+
+
+  // block mode: write one chunk into existing file
+  if (brick->open == OPEN_BLOCK && brick->chunk > 0 && stat(fname, &st) == 0){
+
+    if ((old = open_chunk_store(fname)) == NULL) return FAILURE;
+    if (old->head.nb != nbands || old->head.nx != head.nx || 
+        old->head.ny != head.ny || old->head.cy != head.cy || 
+        old->head.datatype != head.datatype){
+      printf("chunk store %s does not match the brick. ", fname);
+      close_chunk_store(old); return FAILURE;}
+    close_chunk_store(old);
+
+    if ((fd = open(fname, O_WRONLY)) < 0){
+      printf("unable to open chunk store %s. ", fname); return FAILURE;}
+
+    nrows = (brick->chunk+1)*head.cy > head.ny ? head.ny - brick->chunk*head.cy : head.cy;
+
+    for (b=0; b<nbands; b++){
+      if ((data = (char*)chunk_band_pointer(brick, bands[b])) == NULL ||
+          write_whole(fd, data, nrows*lbytes, 
+            head.offset + ((size_t)brick->chunk*nbands + b)*cbytes) == FAILURE){
+        printf("unable to write chunk store %s. ", fname);
+        close(fd); return FAILURE;}
+    }
+
+    close(fd);
+    return SUCCESS;
+
+  }
+
+
+  // update/merge mode: combine with existing values
+  if ((brick->open == OPEN_UPDATE || brick->open == OPEN_MERGE) && stat(fname, &st) == 0){
+
+    if ((old = open_chunk_store(fname)) == NULL) return FAILURE;
+
+    if (old->head.nb != nbands || old->head.nx != head.nx || old->head.ny != head.ny){
+      printf("Dimensions do not match for UPDATE/MERGE mode (file: %d x %d x %d). ", 
+        old->head.nb, old->head.nx, old->head.ny);
+      close_chunk_store(old); return FAILURE;}
+
+    for (b=0; b<nbands; b++){
+      for (p=0; p<brick->nc; p++){
+
+        now    = get_brick(brick, bands[b], p);
+        before = chunk_store_value(old, b, p);
+
+        if (now != brick->nodata[bands[b]] && before != brick->nodata[bands[b]]){
+          if (brick->open == OPEN_MERGE) set_brick(brick, bands[b], p, (now+before)/2.0);
+        } else if (now == brick->nodata[bands[b]] && before != brick->nodata[bands[b]]){
+          set_brick(brick, bands[b], p, before);
+        }
+
+      }
+    }
+
+    close_chunk_store(old);
+
+  }
+
+
+  // write new file
+  nchar = snprintf(tname, NPOW_10, "%s.tmp", fname);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+  if ((fd = open(tname, O_WRONLY | O_CREAT | O_TRUNC, 0664)) < 0){
+    printf("unable to create chunk store %s. ", tname); return FAILURE;}
+
+  if (ftruncate(fd, total) != 0){
+    printf("unable to allocate chunk store %s. ", tname);
+    close(fd); unlink(tname); return FAILURE;}
+
+  alloc((void**)&nodata, nbands, sizeof(int32_t));
+  for (b=0; b<nbands; b++) nodata[b] = brick->nodata[bands[b]];
+
+  if (write_whole(fd, &head, sizeof(fcf_header_t), 0) == FAILURE ||
+      write_whole(fd, nodata, nbands*sizeof(int32_t), sizeof(fcf_header_t)) == FAILURE){
+    printf("unable to write chunk store %s. ", tname);
+    free((void*)nodata); close(fd); unlink(tname); return FAILURE;}
+
+  free((void*)nodata);
+
+  // in block mode, the brick holds one chunk only
+  if (brick->open == OPEN_BLOCK){
+    c0 = brick->chunk; c1 = brick->chunk+1;
+  } else {
+    c0 = 0; c1 = head.nchunk;
+  }
+
+  for (c=c0; c<c1; c++){
+
+    nrows = (c+1)*head.cy > head.ny ? head.ny - c*head.cy : head.cy;
+
+    for (b=0; b<nbands; b++){
+
+      if ((data = (char*)chunk_band_pointer(brick, bands[b])) == NULL){
+        close(fd); unlink(tname); return FAILURE;}
+
+      if (brick->open != OPEN_BLOCK) data += (size_t)c*head.cy*lbytes;
+
+      if (write_whole(fd, data, nrows*lbytes, 
+            head.offset + ((size_t)c*nbands + b)*cbytes) == FAILURE){
+        printf("unable to write chunk store %s. ", tname);
+        close(fd); unlink(tname); return FAILURE;}
+
+    }
+
+  }
+
+  if (close(fd) != 0 || rename(tname, fname) != 0){
+    printf("unable to finalize chunk store %s. ", fname);
+    unlink(tname); return FAILURE;}
+
+  return SUCCESS;
+}
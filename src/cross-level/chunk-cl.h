@@ -0,0 +1,88 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+FORCE chunk format header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef CHUNK_CL_H
+#define CHUNK_CL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <stdint.h>  // fixed-width integer types
+#include <stdbool.h> // boolean data type
+#include <string.h>  // string handling functions
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/brick-cl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FCF_MAGIC   "FORCECF1"
+#define FCF_VERSION 1
+#define FCF_ALIGN   4096 // chunks start at page boundaries
+
+// header of a FORCE chunk format file (.fcf)
+// the header is followed by nb nodata values (int32), and the data
+// starting at offset. The data are stored chunk by chunk, and band-
+// sequential within a chunk. A chunk is a strip of cy full-width lines.
+// All values are in native byte order.
+typedef struct {
+  char    magic[8];         // FCF_MAGIC
+  int32_t version;          // FCF_VERSION
+  int32_t datatype;         // FORCE datatype
+  int32_t byte;             // number of bytes per value
+  int32_t nb;               // number of bands
+  int32_t nx;               // number of columns
+  int32_t ny;               // number of rows
+  int32_t cy;               // number of rows per chunk
+  int32_t nchunk;           // number of chunks
+  double  geotran[6];       // geotransformation
+  char    proj[NPOW_10];    // projection
+  int64_t offset;           // byte offset of the first chunk
+} fcf_header_t;
+
+// memory-mapped chunk store
+typedef struct {
+  int fd;                   // file descriptor
+  char *map;                // mapped file
+  size_t size;              // size of mapping
+  fcf_header_t head;        // header
+  const int32_t *nodata;    // nodata values (points into mapping)
+} chunk_store_t;
+
+bool is_chunk_store(const char *fname);
+chunk_store_t *open_chunk_store(const char *fname);
+void close_chunk_store(chunk_store_t *store);
+int read_chunk_store(chunk_store_t *store, int *band_map, int nread, int xoff, int yoff, int nx, int ny, size_t space, short *buf);
+int write_chunk_store(brick_t *brick, const char *fname, int *bands, int nbands);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
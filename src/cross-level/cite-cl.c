@@ -446,7 +446,7 @@ void cite_me(int i){
 void cite_push(char *dname){
 unsigned int crc;
 char fname[NPOW_10];
-char *lock = NULL;
+lock_t *lock = NULL;
 int nchar;
 int i;
 
@@ -459,11 +459,11 @@ int i;
     
   if (fileexist(fname)) return;
 
-  if ((lock = (char*)lock_file(fname, 60)) == NULL) return;
+  if ((lock = lock_file(fname, 60)) == NULL) return;
 
   if ((_cite_fp_ = fopen(fname, "w")) == NULL){
     printf("Unable to open CITEME file!\n"); 
-    return;}
+    unlock_file(lock); return;}
 
   fprintf(_cite_fp_, "FORCE - Framework for Operational Radiometric "
                      "Correction for Environmental monitoring\n");
@@ -61,6 +61,11 @@ typedef struct {
 
 //#define SPLITS
 
+//#define FORCE_CUDA
+
+// max. number of CUDA devices
+#define GPU_MAXDEVICE 16
+
 //#define ACIX
 //#define ACIX2
 //#define CMIX_FAS
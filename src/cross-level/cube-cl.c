@@ -272,7 +272,7 @@ double tol = 5e-3;
 int write_datacube_def(cube_t *cube){
 char fname[NPOW_10];
 int nchar;
-char *lock = NULL;
+lock_t *lock = NULL;
 FILE *fp = NULL;
 
 
@@ -282,10 +282,10 @@ FILE *fp = NULL;
 
   if (!fileexist(fname)){
     
-    if ((lock = (char*)lock_file(fname, 60)) == NULL) return FAILURE;
+    if ((lock = lock_file(fname, 60)) == NULL) return FAILURE;
 
     if ((fp = fopen(fname, "w")) == NULL){
-      printf("Unable to open %s. ", fname); return FAILURE;}
+      printf("Unable to open %s. ", fname); unlock_file(lock); return FAILURE;}
 
     fprintf(fp, "%s\n", cube->proj);
     fprintf(fp, "%f\n", cube->origin_geo.x);
@@ -317,6 +317,8 @@ char fname[NPOW_10];
 char buffer[NPOW_10] = "\0";
 int nchar;
 FILE *fp = NULL;
+GByte *remote = NULL;
+vsi_l_offset remote_size = 0;
 
 
   if ((cube = allocate_datacube()) == NULL) return NULL;
@@ -327,7 +329,15 @@ FILE *fp = NULL;
   
   copy_string(cube->dname, NPOW_10, d_read);
 
-  if ((fp = fopen(fname, "r")) == NULL){
+  if (is_remote_path(fname)){
+    // object store: fetch the small text file in one request, and parse from memory
+    if (!VSIIngestFile(NULL, fname, &remote, &remote_size, NPOW_16) || 
+        (fp = fmemopen(remote, remote_size, "r")) == NULL){
+      printf("Unable to open %s. ", fname); 
+      if (remote != NULL) VSIFree(remote);
+      free_datacube(cube); return NULL;
+    }
+  } else if ((fp = fopen(fname, "r")) == NULL){
     printf("Unable to open %s. ", fname); 
     free_datacube(cube); return NULL;
   }
@@ -391,6 +401,7 @@ FILE *fp = NULL;
   }
 
   fclose(fp);
+  if (remote != NULL) VSIFree(remote);
 
   cube->cn = (int)(cube->tilesize/cube->chunksize);
 
@@ -453,54 +464,29 @@ double tol = 5e-3;
 +++ Return:  SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int tile_find(double x, double y, double *tilex, double *tiley, int *idx, int *idy, cube_t *cube){
-double tx = cube->origin_map.x, ty = cube->origin_map.y;
+double tx, ty, dx, dy;
 int px = 0, py = 0;
 
-  // if x is right of tile-origin
-  if (x > tx){
-
-    // shift tile-x to the right until x is left of tile-x
-    while (x > tx){
-      tx += cube->tilesize;
-      px++;
-    }
-    // step back one tile; x should be right of tile-x
-    tx -= cube->tilesize;
-    px--;
-
-  // if x is left of tile-origin
-  } else if (x < tx){
+  // number of tiles from the origin; coordinates on a tile border belong
+  // to the tile left of (below) the border if they are right of (below)
+  // the origin, and to the tile right of (below) the border otherwise
+  dx = (x - cube->origin_map.x) / cube->tilesize;
+  dy = (cube->origin_map.y - y) / cube->tilesize;
 
-    // shift tile-x to the left until x is right of tile-x
-    while (x < tx){
-      tx -= cube->tilesize;
-      px--;
-    }
+  if (dx > 0){
+    px = (int)ceil(dx) - 1;
+  } else if (dx < 0){
+    px = (int)floor(dx);
   }
-  // if x is tile-origin, nothing to do
-
-  // if y is below tile-origin
-  if (y < ty){
 
-    // shift tile-y to the bottom until y is above tile-y
-    while (y < ty){
-      ty -= cube->tilesize;
-      py++;
-    }
-    // step back one tile; y should be below tile-y
-    ty += cube->tilesize;
-    py--;
- 
-  // if y is above tile-origin
-  } else if (y > ty){
-
-    // shift tile-y to the top until y is below tile-y
-    while (y > ty){
-      ty += cube->tilesize;
-      py--;
-    }
+  if (dy > 0){
+    py = (int)ceil(dy) - 1;
+  } else if (dy < 0){
+    py = (int)floor(dy);
   }
-  // if y is tile-origin, nothing to do
+
+  tx = cube->origin_map.x + px*cube->tilesize;
+  ty = cube->origin_map.y - py*cube->tilesize;
 
   #ifdef FORCE_DEBUG
   printf("ul x/y of first tile (X%04d_Y%04d): %.2f/%.2f\n", px, py, tx, ty);
@@ -515,6 +501,105 @@ int px = 0, py = 0;
 }
 
 
+/** Tile finder for many coordinates
++++ This function returns the tile IDs of an array of coordinates. The co-
++++ ordinates are processed in parallel.
+--- x:       x coordinates
+--- y:       y coordinates
+--- n:       number of coordinates
+--- idx:     x tile coordinate IDs (returned)
+--- idy:     y tile coordinate IDs (returned)
+--- cube:    datacube
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void tile_find_array(double *x, double *y, int n, int *idx, int *idy, cube_t *cube){
+int i;
+double tx, ty;
+
+
+  #pragma omp parallel for private(tx, ty) shared(x, y, n, idx, idy, cube) schedule(static) default(none)
+  for (i=0; i<n; i++) tile_find(x[i], y[i], &tx, &ty, &idx[i], &idy[i], cube);
+
+  return;
+}
+
+
+/** Tile extent of an image footprint
++++ This function reprojects the corners of an image to the projection of
++++ the datacube, and sets the tile extent of the datacube to the tiles 
++++ that contain these corners. All corners are reprojected at once, thus
++++ the coordinate transformation is only set up (or taken from the cache)
++++ once.
+--- ulx:     upper left  x coordinate of image
+--- uly:     upper left  y coordinate of image
+--- lrx:     lower right x coordinate of image
+--- lry:     lower right y coordinate of image
+--- proj:    projection of image
+--- cube:    datacube (extent is modified)
++++ Return:  SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int cube_footprint(double ulx, double uly, double lrx, double lry, char *proj, cube_t *cube){
+double x[4] = { ulx, lrx, lrx, ulx };
+double y[4] = { uly, uly, lry, lry };
+int idx[4], idy[4];
+int i;
+
+
+  if (warp_any_to_any_array(x, y, 4, proj, cube->proj) == FAILURE){
+    printf("computing image corners in dst_srs failed. "); return FAILURE;}
+
+  tile_find_array(x, y, 4, idx, idy, cube);
+
+  #ifdef FORCE_DEBUG
+  printf("tile UL: %d %d\n", idx[0], idy[0]);
+  printf("tile UR: %d %d\n", idx[1], idy[1]);
+  printf("tile LR: %d %d\n", idx[2], idy[2]);
+  printf("tile LL: %d %d\n", idx[3], idy[3]);
+  #endif
+
+  cube->tminx = cube->tminy = INT_MAX;
+  cube->tmaxx = cube->tmaxy = INT_MIN;
+
+  for (i=0; i<4; i++){
+    if (idx[i] < cube->tminx) cube->tminx = idx[i];
+    if (idx[i] > cube->tmaxx) cube->tmaxx = idx[i];
+    if (idy[i] < cube->tminy) cube->tminy = idy[i];
+    if (idy[i] > cube->tmaxy) cube->tmaxy = idy[i];
+  }
+
+  cube->tnx = cube->tmaxx-cube->tminx+1;
+  cube->tny = cube->tmaxy-cube->tminy+1;
+  cube->tnc = cube->tnx*cube->tny;
+
+  return SUCCESS;
+}
+
+
+/** Test if the tile extent covers an allow-listed tile
++++ This function tests whether any of the allow-listed tiles of a data-
++++ cube is within its current tile extent. The precomputed bounds of the
++++ allow-listed tiles are used as a fast pre-filter, such that the tiles
++++ are only tested if the extent intersects these bounds.
+--- cube:    datacube
+--- bounds:  bounds of the allow-listed tiles (minx, maxx, miny, maxy)
++++ Return:  true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool cube_covered(cube_t *cube, const int bounds[4]){
+int t;
+
+
+  if (cube->tmaxx < bounds[0] || cube->tminx > bounds[1] ||
+      cube->tmaxy < bounds[2] || cube->tminy > bounds[3]) return false;
+
+  for (t=0; t<cube->tn; t++){
+    if (cube->tx[t] >= cube->tminx && cube->tx[t] <= cube->tmaxx &&
+        cube->ty[t] >= cube->tminy && cube->ty[t] <= cube->tmaxy) return true;
+  }
+
+  return false;
+}
+
+
 /** Align coordinates with tiling scheme
 +++ This function takes a coordinate, and returns the nearest coordinate
 +++ (to the topleft) that aligns with the tiling scheme. This way, e.g.
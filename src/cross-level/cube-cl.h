@@ -32,12 +32,15 @@ Datacube header
 #include <stdlib.h>  // standard general utilities library
 #include <string.h>  // string handling functions
 #include <math.h>    // common mathematical functions
+#include <stdbool.h> // boolean data type
+#include <limits.h>  // macro constants of the integer types
 
 #include "../cross-level/const-cl.h"
 #include "../cross-level/string-cl.h"
 #include "../cross-level/alloc-cl.h"
 #include "../cross-level/dir-cl.h"
 #include "../cross-level/lock-cl.h"
+#include "../cross-level/warp-cl.h"
 
 
 #ifdef __cplusplus
@@ -81,6 +84,9 @@ int write_datacube_def(cube_t *cube);
 cube_t *read_datacube_def(char *d_read);
 cube_t *copy_datacube_def(char *d_read, char *d_write, double blockoverride);
 int tile_find(double ulx, double uly, double *tilex, double *tiley, int *idx, int *idy, cube_t *cube);
+void tile_find_array(double *x, double *y, int n, int *idx, int *idy, cube_t *cube);
+int cube_footprint(double ulx, double uly, double lrx, double lry, char *proj, cube_t *cube);
+bool cube_covered(cube_t *cube, const int bounds[4]);
 int tile_align(cube_t *cube, double ulx, double uly, double *new_ulx, double *new_uly);
 
 #ifdef __cplusplus
@@ -619,3 +619,58 @@ void print_date(date_t *date){
   return;
 }
 
+
+
+/** This function flattens an array of dates into a date axis, i.e. one
++++ int array per date component. Kernels that loop over dates for every
++++ pixel read the components from contiguous arrays, and the arrays can
++++ be copied to a device as they are. All arrays share one block.
++++ Free the axis using free_date_axis
+--- axis:   date axis (returned)
+--- date:   dates
+--- n:      number of dates
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void init_date_axis(date_axis_t *axis, date_t *date, int n){
+int t;
+
+
+  memset(axis, 0, sizeof(date_axis_t));
+
+  if (n < 1) return;
+
+  axis->n = n;
+
+  alloc((void**)&axis->ce, 6*n, sizeof(int));
+  axis->doy     = axis->ce + n;
+  axis->week    = axis->ce + 2*n;
+  axis->month   = axis->ce + 3*n;
+  axis->quarter = axis->ce + 4*n;
+  axis->year    = axis->ce + 5*n;
+
+  for (t=0; t<n; t++){
+    axis->ce[t]      = date[t].ce;
+    axis->doy[t]     = date[t].doy;
+    axis->week[t]    = date[t].week;
+    axis->month[t]   = date[t].month;
+    axis->quarter[t] = date[t].quarter;
+    axis->year[t]    = date[t].year;
+  }
+
+  return;
+}
+
+
+/** This function frees a date axis
+--- axis:   date axis
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_date_axis(date_axis_t *axis){
+
+
+  if (axis->ce != NULL) free((void*)axis->ce);
+  memset(axis, 0, sizeof(date_axis_t));
+
+  return;
+}
+
@@ -34,6 +34,7 @@ Date header
 #include <string.h>  // string handling functions
 
 #include "../cross-level/const-cl.h"
+#include "../cross-level/alloc-cl.h"
 
 
 #ifdef __cplusplus
@@ -54,6 +55,16 @@ typedef struct {
   int tz;      // timezone
 } date_t;
 
+typedef struct {
+  int n;        // number of dates
+  int *ce;      // days since current era
+  int *doy;     // day-of-year
+  int *week;    // week
+  int *month;   // month
+  int *quarter; // quarter
+  int *year;    // year
+} date_axis_t;
+
 void doy2md(int doy, int *m, int *d);
 int doy2m(int doy);
 int doy2d(int doy);
@@ -82,6 +93,8 @@ void set_time(date_t *date, int hh, int mm, int ss);
 void set_secs(date_t *date, int ss);
 void copy_date(date_t *from, date_t *to);
 void print_date(date_t *date);
+void init_date_axis(date_axis_t *axis, date_t *date, int n);
+void free_date_axis(date_axis_t *axis);
 
 #ifdef __cplusplus
 }
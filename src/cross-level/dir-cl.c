@@ -33,11 +33,29 @@ This file contains functions for reading directories and handling names
 +++ Return: true/false
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 bool fileexist(char *fname){
+VSIStatBufL stat_vsi;
+
+
+  if (is_remote_path(fname)){
+    if (VSIStatL(fname, &stat_vsi) == 0) return true; else return false;
+  }
 
   if (access(fname, F_OK) == 0) return true; else return false;
 }
 
 
+/** Test whether a path points to a GDAL virtual file system, e.g. an
++++ object store (/vsis3/, /vsigs/, /vsiaz/, /vsicurl/ etc.). Such paths
++++ cannot be accessed with POSIX I/O, and are handled by GDAL's VSI layer
+--- fname:  filename
++++ Return: true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool is_remote_path(const char *fname){
+
+  if (strncmp(fname, "/vsi", 4) == 0) return true; else return false;
+}
+
+
 /** This function searches the given directory for a file, which contains
 +++ the given pattern. The first match will be returned. NULL will be re-
 +++ turned if no file was found.
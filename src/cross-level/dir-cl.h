@@ -38,6 +38,8 @@ Directory/file support header
 #include <unistd.h>   // essential POSIX functions and constants
 #include <errno.h>    // error numbers
 
+#include "cpl_vsi.h"  // GDAL virtual file system
+
 #include "../cross-level/const-cl.h"
 #include "../cross-level/string-cl.h"
 
@@ -55,6 +57,7 @@ typedef struct {
 } dir_t;
 
 bool fileexist(char *fname);
+bool is_remote_path(const char *fname);
 int findfile(char *dir_path, char *pattern, char *filter, char fname[], int size);
 int countfile(char *dir_path, char *pattern);
 int createdir(char *dir_path);
@@ -30,6 +30,8 @@ This file contains functions to download files from remote servers
 /** libcurl **/
 #include <curl.h> // multiprotocol file transfer
 
+#include <stdint.h>   // fixed-width integer types
+
 
 typedef struct {
   const char *fname;      // filename
@@ -43,6 +45,7 @@ typedef struct {
 long curl_open_download(struct curl_fileinfo *remote, curl_t *data, int remains);
 size_t curl_write_download(void *ptr, size_t size, size_t count, void *data);
 long curl_close_download(curl_t *data);
+int start_download(CURLM *multi, char *f_remote, struct curl_slist *list, curl_t *data, long id);
 
 
 /** This function uses the libcurl library to download a file. The exact 
@@ -66,10 +69,13 @@ struct curl_slist *list = NULL;
   data.fp = NULL;
  
   // global libcurl initialization
-   if ((res = curl_global_init(CURL_GLOBAL_DEFAULT)) != CURLE_OK) return res;
+  #pragma omp critical (curl_global)
+  res = curl_global_init(CURL_GLOBAL_DEFAULT);
+  if (res != CURLE_OK) return res;
   
   // start easy session
   if(!(curl = curl_easy_init())){
+    #pragma omp critical (curl_global)
     curl_global_cleanup();
     return CURLE_OUT_OF_MEMORY;
   }
@@ -106,6 +112,7 @@ struct curl_slist *list = NULL;
   if(data.fp) fclose(data.fp);
 
   // global libcurl cleanuo
+  #pragma omp critical (curl_global)
   curl_global_cleanup();
   
   if (header != NULL) curl_slist_free_all(list);
@@ -138,10 +145,13 @@ struct curl_slist *list = NULL;
   data.fp = NULL;
 
   // global libcurl initialization
-  if ((res = curl_global_init(CURL_GLOBAL_ALL)) != CURLE_OK) return res;
+  #pragma omp critical (curl_global)
+  res = curl_global_init(CURL_GLOBAL_ALL);
+  if (res != CURLE_OK) return res;
  
   // start easy session
   if(!(curl = curl_easy_init())){
+    #pragma omp critical (curl_global)
     curl_global_cleanup();
     return CURLE_OUT_OF_MEMORY;
   }
@@ -179,6 +189,7 @@ struct curl_slist *list = NULL;
   curl_easy_cleanup(curl);
 
   // global libcurl cleanuo
+  #pragma omp critical (curl_global)
   curl_global_cleanup();
   
   if (header != NULL) curl_slist_free_all(list);
@@ -187,6 +198,200 @@ struct curl_slist *list = NULL;
 }
  
 
+/** This function uses the libcurl multi interface to download several 
++++ files concurrently. The exact filenames (including path) of the remote
++++ files need to be known. Connections are reused between transfers, and
++++ HTTP/2 is negotiated if the server supports it, such that several 
++++ transfers can be multiplexed over one connection. Data are written to
++++ a partial file (*.part), which is renamed when the transfer is com-
++++ plete. An existing partial file is resumed. Local files that already
++++ exist are skipped. The directory, where the local files are to be 
++++ stored, needs to exist.
+--- f_remote: filenames (including path) of remote files
+--- f_local:  filenames (including path) of local  files (will be created)
+--- n:        number of files
+--- header:   HTTP header (may be NULL)
+--- nconn:    maximum number of concurrent transfers
+--- status:   curl exit code of each transfer (returned, may be NULL)
++++ Return:   number of failed transfers
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int download_files(char **f_remote, char **f_local, int n, char *header, int nconn, int *status){
+CURLM *multi = NULL;
+CURLMsg *msg = NULL;
+char *id = NULL;
+CURLcode res;
+curl_t *data = NULL;
+char **fpart = NULL;
+struct curl_slist *list = NULL;
+struct stat info;
+int i, next = 0, running = 0, left, nfail = 0;
+int nchar;
+
+
+  if (n < 1) return 0;
+  if (nconn < 1) nconn = 1;
+
+  if (status != NULL){
+    for (i=0; i<n; i++) status[i] = CURLE_OK;
+  }
+
+  // global libcurl initialization
+  #pragma omp critical (curl_global)
+  res = curl_global_init(CURL_GLOBAL_DEFAULT);
+  if (res != CURLE_OK){
+    if (status != NULL){ for (i=0; i<n; i++) status[i] = res;}
+    return n;
+  }
+
+  if (!(multi = curl_multi_init())){
+    #pragma omp critical (curl_global)
+    curl_global_cleanup();
+    if (status != NULL){ for (i=0; i<n; i++) status[i] = CURLE_OUT_OF_MEMORY;}
+    return n;
+  }
+
+  // limit concurrency, multiplex transfers over HTTP/2 connections
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)nconn);
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,  (long)nconn);
+
+  if (header != NULL) list = curl_slist_append(list, header);
+
+  alloc((void**)&data, n, sizeof(curl_t));
+  alloc_2D((void***)&fpart, n, NPOW_10, sizeof(char));
+
+
+  while (next < n || running > 0){
+
+    // start new transfers until the maximum number is running
+    while (next < n && running < nconn){
+
+      i = next++;
+
+      if (fileexist(f_local[i])) continue;
+
+      nchar = snprintf(fpart[i], NPOW_10, "%s.part", f_local[i]);
+      if (nchar < 0 || nchar >= NPOW_10){ 
+        printf("Buffer Overflow in assembling filename\n"); exit(1);}
+
+      data[i].fname = fpart[i];
+      data[i].size  = 0;
+
+      // resume partial file
+      if (stat(fpart[i], &info) == 0) data[i].size = info.st_size;
+
+      if (!(data[i].fp = fopen(fpart[i], (data[i].size > 0) ? "ab" : "wb"))){
+        if (status != NULL) status[i] = CURLE_WRITE_ERROR;
+        nfail++; continue;
+      }
+
+      if (start_download(multi, f_remote[i], list, &data[i], i) != CURLE_OK){
+        fclose(data[i].fp); data[i].fp = NULL;
+        if (status != NULL) status[i] = CURLE_OUT_OF_MEMORY;
+        nfail++; continue;
+      }
+
+      running++;
+
+    }
+
+    // perform transfers, and wait for activity
+    curl_multi_perform(multi, &left);
+    if (left > 0) curl_multi_wait(multi, NULL, 0, 1000, NULL);
+
+
+    // finalize completed transfers
+    while ((msg = curl_multi_info_read(multi, &left)) != NULL){
+
+      if (msg->msg != CURLMSG_DONE) continue;
+
+      res = msg->data.result;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &id);
+      i = (int)(intptr_t)id;
+
+      curl_multi_remove_handle(multi, msg->easy_handle);
+      curl_easy_cleanup(msg->easy_handle);
+      running--;
+
+      if (data[i].fp){ fclose(data[i].fp); data[i].fp = NULL;}
+
+      if (res == CURLE_OK){
+        if (rename(fpart[i], f_local[i]) != 0) res = CURLE_WRITE_ERROR;
+      } else if (res == CURLE_RANGE_ERROR || res == CURLE_HTTP_RETURNED_ERROR){
+        // partial file cannot be resumed
+        remove(fpart[i]);
+      }
+
+      if (res != CURLE_OK) nfail++;
+      if (status != NULL) status[i] = res;
+
+    }
+
+  }
+
+
+  free((void*)data);
+  free_2D((void**)fpart, n);
+  if (list != NULL) curl_slist_free_all(list);
+
+  curl_multi_cleanup(multi);
+  #pragma omp critical (curl_global)
+  curl_global_cleanup();
+
+  return nfail;
+}
+
+
+/** This function prepares one transfer of a concurrent download, and adds
++++ it to a multi handle.
+--- multi:    multi handle
+--- f_remote: filename (including path) of remote file
+--- list:     HTTP header (may be NULL)
+--- data:     local data struct, file is opened already
+--- id:       ID of the transfer
++++ Return:   curl exit code
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int start_download(CURLM *multi, char *f_remote, struct curl_slist *list, curl_t *data, long id){
+CURL *curl;
+
+
+  if (!(curl = curl_easy_init())) return CURLE_OUT_OF_MEMORY;
+
+  // set URL
+  curl_easy_setopt(curl, CURLOPT_URL, f_remote);
+
+  if (list != NULL) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+
+  #ifdef FORCE_DEBUG
+  curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+  #endif
+
+  // prefer HTTP/2 over TLS, wait for multiplexing instead of new connections
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+
+  // resume partial file
+  if (data->size > 0) curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)data->size);
+
+  // callback for writing data
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_download);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, data);
+
+  // fail on HTTP response >= 400
+  curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+
+  // remember the transfer
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, (void*)(intptr_t)id);
+
+  if (curl_multi_add_handle(multi, curl) != CURLM_OK){
+    curl_easy_cleanup(curl);
+    return CURLE_OUT_OF_MEMORY;
+  }
+
+  return CURLE_OK;
+}
+
+
 /** Callback before a transfer with FTP wildcardmatch
 +++ This function is called by libcurl before a file is downloaded. Tiny 
 +++ files < 50KB will be skipped. The function concatenates the filenames
@@ -32,6 +32,7 @@ Image methods header
 #include <stdlib.h>   // standard general utilities library
 
 #include "../cross-level/const-cl.h"
+#include "../cross-level/alloc-cl.h"
 #include "../cross-level/dir-cl.h"
 
 
@@ -41,6 +42,7 @@ extern "C" {
 
 int download_file(char *f_remote, char *f_local, char *header);
 int download_pattern(char *d_local, char *pattern, char *header);
+int download_files(char **f_remote, char **f_local, int n, char *header, int nconn, int *status);
 
 #ifdef __cplusplus
 }
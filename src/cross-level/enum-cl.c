@@ -38,6 +38,7 @@ const tagged_enum_t _TAGGED_ENUM_RES_MERGE_[_RES_MERGE_LENGTH_] = {
 const tagged_enum_t _TAGGED_ENUM_FMT_[_FMT_LENGTH_] = {
   { _FMT_ENVI_, "ENVI" }, { _FMT_GTIFF_, "GTiff" }, 
   { _FMT_COG_, "COG" },   { _FMT_JPEG_, "JPEG" },
+  { _FMT_FCF_, "FCF" },   { _FMT_ZARR_, "ZARR" },
   { _FMT_CUSTOM_, "CUSTOM"}};
 
 const tagged_enum_t _TAGGED_ENUM_SEN_[_SEN_LENGTH_] = {
@@ -79,7 +80,8 @@ const tagged_enum_t _TAGGED_ENUM_IDX_[_IDX_LENGTH_] = {
   { _IDX_CRE_, "CIre"   }, { _IDX_NR1_, "NDVIre1"   }, { _IDX_NR2_, "NDVIre2"      },
   { _IDX_NR3_, "NDVIre3"}, { _IDX_N1n_, "NDVIre1n"  }, { _IDX_N2n_, "NDVIre2n"     },
   { _IDX_N3n_, "NDVIre3n"},{ _IDX_Mre_, "MSRre"     }, { _IDX_Mrn_, "MSRren"       },
-  { _IDX_CCI_, "CCI"    }, { _IDX_EV2_, "EVI2"      }, { _IDX_CSW_, "CRemoveSWIR1" }};
+  { _IDX_CCI_, "CCI"    }, { _IDX_EV2_, "EVI2"      }, { _IDX_CSW_, "CRemoveSWIR1" },
+  { _IDX_EXP_, "EXPRESSION" }};
 
 const tagged_enum_t _TAGGED_ENUM_INT_[_INT_LENGTH_] = {
   { _INT_NONE_,     "NONE"    }, { _INT_LINEAR_, "LINEAR" },
@@ -209,5 +211,26 @@ const tagged_enum_t _TAGGED_ENUM_RGB_[_RGB_LENGTH_] = {
   { _RGB_R_,  "RED" }, { _RGB_G_,  "GREEN" }, { _RGB_B_,  "BLUE" }};
 
 const tagged_enum_t _TAGGED_ENUM_UDF_[_UDF_LENGTH_] = {
-  { _UDF_PIXEL_,  "PIXEL" }, { _UDF_BLOCK_,  "BLOCK" }};
+  { _UDF_PIXEL_,  "PIXEL" }, { _UDF_BLOCK_,  "BLOCK" }, { _UDF_BATCH_,  "BATCH" }};
+
+const tagged_enum_t _TAGGED_ENUM_STREAM_[_STREAM_LENGTH_] = {
+  { _STREAM_PIPELINE_,  "PIPELINE" }, { _STREAM_TASK_,  "TASK" }};
+
+const tagged_enum_t _TAGGED_ENUM_NUMA_[_NUMA_LENGTH_] = {
+  { _NUMA_NONE_,  "NONE" }, { _NUMA_PIN_,  "PIN" }, { _NUMA_SOCKET_,  "SOCKET" }};
+
+const tagged_enum_t _TAGGED_ENUM_HUGE_[_HUGE_LENGTH_] = {
+  { _HUGE_NONE_,  "NONE" }, { _HUGE_TRANSPARENT_,  "TRANSPARENT" }, { _HUGE_EXPLICIT_,  "EXPLICIT" }};
+
+const tagged_enum_t _TAGGED_ENUM_ORDER_[_ORDER_LENGTH_] = {
+  { _ORDER_NONE_,  "NONE" }, { _ORDER_ZORDER_,  "ZORDER" }, { _ORDER_HILBERT_,  "HILBERT" }};
+
+const tagged_enum_t _TAGGED_ENUM_MERGE_[_MERGE_LENGTH_] = {
+  { _MERGE_NONE_,  "NONE" }, { _MERGE_FIRST_,  "FIRST" }, { _MERGE_QAI_,  "QAI" }};
+
+const tagged_enum_t _TAGGED_ENUM_SMP_[_SMP_LENGTH_] = {
+  { _SMP_POINTS_,  "POINTS" }, { _SMP_ZONES_,  "ZONES" }};
+
+const tagged_enum_t _TAGGED_ENUM_TABLE_[_TABLE_LENGTH_] = {
+  { _TABLE_TEXT_,  "TEXT" }, { _TABLE_BINARY_,  "BINARY" }};
 
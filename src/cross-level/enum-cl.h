@@ -81,7 +81,7 @@ enum { _DT_NONE_,  _DT_SHORT_, _DT_SMALL_,
        _DT_FLOAT_, _DT_INT_,   _DT_USHORT_ };
 
 // output formats
-enum { _FMT_ENVI_, _FMT_GTIFF_, _FMT_COG_, _FMT_JPEG_, _FMT_CUSTOM_, _FMT_LENGTH_ };
+enum { _FMT_ENVI_, _FMT_GTIFF_, _FMT_COG_, _FMT_JPEG_, _FMT_FCF_, _FMT_ZARR_, _FMT_CUSTOM_, _FMT_LENGTH_ };
 
 // t-test tailtype
 enum { _TAIL_LEFT_, _TAIL_TWO_, _TAIL_RIGHT_, _TAIL_LENGTH_ };
@@ -157,7 +157,7 @@ enum { _IDX_BLU_, _IDX_GRN_, _IDX_RED_, _IDX_NIR_, _IDX_SW1_, _IDX_SW2_,
        _IDX_SMA_, _IDX_BVV_, _IDX_BVH_, _IDX_NDT_, _IDX_NDM_, _IDX_SW0_,
        _IDX_KNV_, _IDX_ND1_, _IDX_ND2_, _IDX_CRE_, _IDX_NR1_, _IDX_NR2_,
        _IDX_NR3_, _IDX_N1n_, _IDX_N2n_, _IDX_N3n_, _IDX_Mre_, _IDX_Mrn_,
-       _IDX_CCI_, _IDX_EV2_, _IDX_CSW_, _IDX_LENGTH_};
+       _IDX_CCI_, _IDX_EV2_, _IDX_CSW_, _IDX_EXP_, _IDX_LENGTH_};
 
 // standardization
 enum { _STD_NONE_, _STD_NORMAL_, _STD_CENTER_, _STD_LENGTH_ };
@@ -270,11 +270,36 @@ enum { _KERNEL_SQUARE_, _KERNEL_CIRCLE_, _KERNEL_LENGTH_ };
 enum { _TASK_INPUT_, _TASK_COMPUTE_, _TASK_OUTPUT_, 
        _TASK_ALL_,   _TASK_RUNTIME_, _TASK_LENGTH_};
 
+// compute sub-task type
+enum { _SUBTASK_QAI_, _SUBTASK_NOISE_, _SUBTASK_ADJUST_, 
+       _SUBTASK_MODULE_, _SUBTASK_LENGTH_ };
+
+// streaming scheduler
+enum { _STREAM_PIPELINE_, _STREAM_TASK_, _STREAM_LENGTH_ };
+
+// NUMA placement
+enum { _NUMA_NONE_, _NUMA_PIN_, _NUMA_SOCKET_, _NUMA_LENGTH_ };
+
+// huge page mode
+enum { _HUGE_NONE_, _HUGE_TRANSPARENT_, _HUGE_EXPLICIT_, _HUGE_LENGTH_ };
+
+// tile traversal order
+enum { _ORDER_NONE_, _ORDER_ZORDER_, _ORDER_HILBERT_, _ORDER_LENGTH_ };
+
+// sampling mode
+enum { _SMP_POINTS_, _SMP_ZONES_, _SMP_LENGTH_ };
+
+// merging of same-day observations
+enum { _MERGE_NONE_, _MERGE_FIRST_, _MERGE_QAI_, _MERGE_LENGTH_ };
+
+// table format
+enum { _TABLE_TEXT_, _TABLE_BINARY_, _TABLE_LENGTH_ };
+
 // clock type
 enum { _CLOCK_NULL_, _CLOCK_TICK_, _CLOCK_TOCK_, _CLOCK_LENGTH_ };
 
 // user-defined function type
-enum { _UDF_PIXEL_, _UDF_BLOCK_, _UDF_LENGTH_ };
+enum { _UDF_PIXEL_, _UDF_BLOCK_, _UDF_BATCH_, _UDF_LENGTH_ };
 
 // tag and value
 enum { _TV_TAG_, _TV_VAL_, _TV_LENGTH_ };
@@ -311,6 +336,13 @@ extern const tagged_enum_t _TAGGED_ENUM_SCR_[_SCR_LENGTH_];
 extern const tagged_enum_t _TAGGED_ENUM_INF_[_INF_LENGTH_];
 extern const tagged_enum_t _TAGGED_ENUM_RGB_[_RGB_LENGTH_];
 extern const tagged_enum_t _TAGGED_ENUM_UDF_[_UDF_LENGTH_];
+extern const tagged_enum_t _TAGGED_ENUM_STREAM_[_STREAM_LENGTH_];
+extern const tagged_enum_t _TAGGED_ENUM_NUMA_[_NUMA_LENGTH_];
+extern const tagged_enum_t _TAGGED_ENUM_HUGE_[_HUGE_LENGTH_];
+extern const tagged_enum_t _TAGGED_ENUM_ORDER_[_ORDER_LENGTH_];
+extern const tagged_enum_t _TAGGED_ENUM_MERGE_[_MERGE_LENGTH_];
+extern const tagged_enum_t _TAGGED_ENUM_SMP_[_SMP_LENGTH_];
+extern const tagged_enum_t _TAGGED_ENUM_TABLE_[_TABLE_LENGTH_];
 
 #ifdef __cplusplus
 }
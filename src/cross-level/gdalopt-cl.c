@@ -65,13 +65,31 @@ int o = 0;
       copy_string(gdalopt->option[o++], NPOW_10, "PIXEL");
       copy_string(gdalopt->option[o++], NPOW_10, "BIGTIFF");
       copy_string(gdalopt->option[o++], NPOW_10, "YES");
-      copy_string(gdalopt->option[o++], NPOW_10, "TILED");
-      copy_string(gdalopt->option[o++], NPOW_10, "YES");
+      copy_string(gdalopt->option[o++], NPOW_10, "OVERVIEWS");
+      copy_string(gdalopt->option[o++], NPOW_10, "AUTO");
+      copy_string(gdalopt->option[o++], NPOW_10, "RESAMPLING");
+      copy_string(gdalopt->option[o++], NPOW_10, "AVERAGE");
       break;
     case _FMT_JPEG_:
       copy_string(gdalopt->extension,   NPOW_04, "jpg");
       copy_string(gdalopt->driver,      NPOW_04, "JPEG");
       break;
+    case _FMT_FCF_:
+      // FORCE chunk format, written without GDAL (chunk-cl.c)
+      copy_string(gdalopt->extension,   NPOW_04, "fcf");
+      copy_string(gdalopt->driver,      NPOW_04, "FCF");
+      break;
+    case _FMT_ZARR_:
+      // Zarr v2 array, written without GDAL (zarr-cl.c)
+      copy_string(gdalopt->extension,   NPOW_04, "zarr");
+      copy_string(gdalopt->driver,      NPOW_04, "ZARR");
+      copy_string(gdalopt->option[o++], NPOW_10, "COMPRESS");
+      copy_string(gdalopt->option[o++], NPOW_10, "ZLIB");
+      copy_string(gdalopt->option[o++], NPOW_10, "ZLEVEL");
+      copy_string(gdalopt->option[o++], NPOW_10, "1");
+      copy_string(gdalopt->option[o++], NPOW_10, "TIME_CHUNK");
+      copy_string(gdalopt->option[o++], NPOW_10, "0");
+      break;
     case _FMT_CUSTOM_:
       break;
     default:
@@ -122,6 +140,43 @@ char blockysize[NPOW_10];
 }
 
 
+/** This function enables multi-threaded compression in the GDAL output
++++ options for drivers that support it (GTiff, COG). Options that were 
++++ already given, e.g. in a custom options file, are not overwritten.
+--- gdalopt: GDAL options (returned)
+--- nthread: number of compression threads
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void update_gdaloptions_threads(gdalopt_t *gdalopt, int nthread){
+int nchar;
+int o = gdalopt->n;
+char threads[NPOW_10];
+
+
+  if (nthread < 2) return;
+
+  if (strcmp(gdalopt->driver, "GTiff") != 0 &&
+      strcmp(gdalopt->driver, "COG")   != 0) return;
+
+  for (o=0; o<gdalopt->n; o+=2){
+    if (strcmp(gdalopt->option[o], "NUM_THREADS") == 0) return;
+  }
+
+  if (o >= (NPOW_06-1)) return;
+
+  nchar = snprintf(threads, NPOW_10, "%d", nthread);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling NUM_THREADS\n"); exit(FAILURE);}
+  copy_string(gdalopt->option[o++], NPOW_10, "NUM_THREADS");
+  copy_string(gdalopt->option[o++], NPOW_10, threads);
+
+  gdalopt->n = o;
+
+
+  return;
+}
+
+
 /** This function reads GDAL output options
 --- fname:   text file
 --- gdalopt: GDAL options (returned)
@@ -49,6 +49,7 @@ typedef struct {
 
 void default_gdaloptions(int format, gdalopt_t *gdalopt);
 void update_gdaloptions_blocksize(int format, gdalopt_t *gdalopt, int cx, int cy);
+void update_gdaloptions_threads(gdalopt_t *gdalopt, int nthread);
 void parse_gdaloptions(char *fname, gdalopt_t *gdalopt);
 void print_gdaloptions(gdalopt_t *gdalopt);
 
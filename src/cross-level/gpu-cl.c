@@ -0,0 +1,705 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for handling GPU device memory
++++ The GPU code is only compiled if FORCE_CUDA is defined (see cuda.sh).
++++ Otherwise, init_gpu fails and all processing stays on the CPU.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "gpu-cl.h"
+
+#include <unistd.h>  // standard symbolic constants and types 
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#endif
+
+
+#ifdef FORCE_CUDA
+
+// pool of released device buffers, bucketed by size
+typedef struct {
+  size_t bytes;  // size of buffers in this bucket
+  void **ptr;    // free buffers
+  int n, size;   // number of free buffers, allocated length
+} gpu_bucket_t;
+
+// stream of a device
+typedef struct {
+  int dev;              // index into gpu_dev
+  cudaStream_t stream;  // CUDA stream
+} gpu_queue_t;
+
+// initialized device
+typedef struct {
+  int id;                          // CUDA device ID
+  gpu_queue_t queue[GPU_NSTREAM];  // streams
+  int next;                        // next stream to hand out
+  gpu_bucket_t *pool;              // pool of released buffers
+  int pool_n;                      // number of buckets
+  size_t pool_bytes;               // bytes held by the pool
+  size_t pool_max;                 // max. bytes held by the pool
+  size_t live;                     // bytes allocated and in use
+} gpu_dev_t;
+
+gpu_dev_t gpu_dev[GPU_MAXDEVICE];
+int gpu_ndev = 0;           // number of initialized devices, 0: GPU disabled
+
+// host slabs that are registered as pinned memory
+typedef struct {
+  void  *slab;
+  size_t bytes;
+} gpu_pin_t;
+
+gpu_pin_t *gpu_pin = NULL;
+int gpu_pin_n = 0, gpu_pin_size = 0;
+size_t gpu_pin_bytes = 0;  // pinned bytes
+size_t gpu_pin_max   = 0;  // max. pinned bytes
+
+
+int gpu_check(cudaError_t err, const char *what);
+void free_gpu_pool(gpu_dev_t *dev);
+void unpin_slab(void *slab);
+
+#endif
+
+
+/** This function initializes GPU devices. For each device, streams are
++++ created, and a pool for device buffers is set up, which may hold up 
++++ to half of the free device memory. Devices that are not available are
++++ skipped.
+--- device:  device IDs
+--- ndevice: number of devices
++++ Return:  number of devices that can be used, 0 if processing needs to
++++          stay on the CPU
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int init_gpu(int *device, int ndevice){
+#ifdef FORCE_CUDA
+int n = 0, d, s;
+size_t mem_free, mem_total;
+gpu_dev_t *dev = NULL;
+bool ok;
+
+
+  if (gpu_ndev > 0) return gpu_ndev;
+
+  if (cudaGetDeviceCount(&n) != cudaSuccess) n = 0;
+
+  for (d=0; d<ndevice && gpu_ndev < GPU_MAXDEVICE; d++){
+
+    if (device[d] < 0) continue;
+
+    if (device[d] >= n){
+      printf("no CUDA device %d available.\n", device[d]);
+      continue;
+    }
+
+    if (gpu_check(cudaSetDevice(device[d]), "selecting device") == FAILURE) continue;
+
+    dev = &gpu_dev[gpu_ndev];
+    memset(dev, 0, sizeof(gpu_dev_t));
+    dev->id = device[d];
+
+    for (s=0, ok=true; s<GPU_NSTREAM && ok; s++){
+      dev->queue[s].dev = gpu_ndev;
+      if (gpu_check(cudaStreamCreateWithFlags(&dev->queue[s].stream, cudaStreamNonBlocking), "creating stream") == FAILURE){
+        while (--s >= 0) cudaStreamDestroy(dev->queue[s].stream);
+        ok = false;
+      }
+    }
+    if (!ok) continue;
+
+    if (cudaMemGetInfo(&mem_free, &mem_total) != cudaSuccess) mem_free = 0;
+    dev->pool_max = mem_free / 2;
+
+    #ifdef FORCE_DEBUG
+    printf("GPU %d: %.1f of %.1f GB free\n", dev->id, 
+      mem_free/1073741824.0, mem_total/1073741824.0);
+    #endif
+
+    gpu_ndev++;
+
+  }
+
+  if (gpu_ndev == 0){
+    printf("no CUDA device available, stay on CPU.\n");
+    return 0;
+  }
+
+  // page-lock up to a quarter of the physical memory
+  gpu_pin_max = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE) / 4;
+  set_slab_release(&unpin_slab);
+
+  return gpu_ndev;
+
+#else
+
+  return 0;
+
+#endif
+}
+
+
+/** This function releases the GPU devices, i.e. destroys the streams and
++++ frees all buffers held by the pools.
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_gpu(){
+#ifdef FORCE_CUDA
+int d, s;
+
+
+  if (gpu_ndev == 0) return;
+
+  for (d=0; d<gpu_ndev; d++){
+    cudaSetDevice(gpu_dev[d].id);
+    cudaDeviceSynchronize();
+    for (s=0; s<GPU_NSTREAM; s++) cudaStreamDestroy(gpu_dev[d].queue[s].stream);
+    free_gpu_pool(&gpu_dev[d]);
+  }
+
+  // slabs stay pinned until freed, pooled slabs are freed after this
+  set_slab_release(NULL);
+  while (gpu_pin_n > 0) unpin_slab(gpu_pin[gpu_pin_n-1].slab);
+  if (gpu_pin != NULL) free((void*)gpu_pin);
+  gpu_pin = NULL;
+  gpu_pin_size = 0;
+
+  gpu_ndev = 0;
+
+#endif
+
+  return;
+}
+
+
+/** This function tells if any GPU is initialized
++++ Return: true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool gpu_enabled(){
+#ifdef FORCE_CUDA
+
+  return gpu_ndev > 0;
+
+#else
+
+  return false;
+
+#endif
+}
+
+
+/** This function returns the number of initialized GPUs
++++ Return: number of GPUs
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int gpu_count(){
+#ifdef FORCE_CUDA
+
+  return gpu_ndev;
+
+#else
+
+  return 0;
+
+#endif
+}
+
+
+/** This function hands out a CUDA stream for a processing unit. The 
++++ device with the least memory in use is chosen, i.e. units are
++++ balanced by load, and spread round-robin over devices that are
++++ equally loaded. On the device, the streams are used in turn: 
++++ transfers and kernels of a unit stay in order, while the units in the
++++ read, compute and write stages overlap.
++++ Return: stream, NULL if GPU is disabled
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+gpu_stream_t claim_gpu_stream(){
+#ifdef FORCE_CUDA
+gpu_queue_t *queue = NULL;
+int d, best = 0;
+static int turn = 0;
+
+
+  if (gpu_ndev == 0) return NULL;
+
+  #pragma omp critical (gpu_pool)
+  {
+
+    for (d=1; d<gpu_ndev; d++){
+      if (gpu_dev[(turn+d)%gpu_ndev].live < gpu_dev[(turn+best)%gpu_ndev].live) best = d;
+    }
+    best = (turn+best)%gpu_ndev;
+    turn = (best+1)%gpu_ndev;
+
+    queue = &gpu_dev[best].queue[gpu_dev[best].next];
+    gpu_dev[best].next = (gpu_dev[best].next+1)%GPU_NSTREAM;
+
+  }
+
+  return (gpu_stream_t)queue;
+
+#else
+
+  return NULL;
+
+#endif
+}
+
+
+/** This function makes the device of a stream the current device of the
++++ calling thread. Call this before launching kernels.
+--- stream: stream
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int gpu_select(gpu_stream_t stream){
+#ifdef FORCE_CUDA
+
+  if (gpu_ndev == 0 || stream == NULL) return FAILURE;
+
+  return gpu_check(cudaSetDevice(gpu_dev[((gpu_queue_t*)stream)->dev].id), "selecting device");
+
+#else
+
+  return FAILURE;
+
+#endif
+}
+
+
+/** This function returns the CUDA stream (cudaStream_t) of a stream
+--- stream: stream
++++ Return: CUDA stream
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void *gpu_cuda_stream(gpu_stream_t stream){
+#ifdef FORCE_CUDA
+
+  if (stream == NULL) return NULL;
+
+  return (void*)((gpu_queue_t*)stream)->stream;
+
+#else
+
+  return NULL;
+
+#endif
+}
+
+
+/** This function waits until all work in a stream is done
+--- stream: stream
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int gpu_sync(gpu_stream_t stream){
+#ifdef FORCE_CUDA
+
+  if (gpu_select(stream) == FAILURE) return FAILURE;
+
+  return gpu_check(cudaStreamSynchronize(((gpu_queue_t*)stream)->stream), "synchronizing stream");
+
+#else
+
+  return FAILURE;
+
+#endif
+}
+
+
+/** This function allocates memory on the device of a stream. A released
++++ buffer of the same size is recycled if available. The memory is not
++++ initialized.
+--- bytes:  size of buffer
+--- stream: stream
++++ Return: device buffer, NULL if allocation failed
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void *gpu_alloc(size_t bytes, gpu_stream_t stream){
+#ifdef FORCE_CUDA
+gpu_dev_t *dev = NULL;
+void *ptr = NULL;
+int k;
+
+
+  if (gpu_ndev == 0 || stream == NULL || bytes == 0) return NULL;
+
+  dev = &gpu_dev[((gpu_queue_t*)stream)->dev];
+
+  #pragma omp critical (gpu_pool)
+  {
+
+    for (k=0; k<dev->pool_n; k++){
+      if (dev->pool[k].bytes == bytes && dev->pool[k].n > 0){
+        ptr = dev->pool[k].ptr[--dev->pool[k].n];
+        dev->pool_bytes -= bytes;
+        break;
+      }
+    }
+
+    dev->live += bytes;
+
+  }
+
+  if (ptr != NULL) return ptr;
+
+  cudaSetDevice(dev->id);
+
+  if (cudaMalloc(&ptr, bytes) != cudaSuccess){
+    // device is full: give back what the pool holds, and retry
+    cudaGetLastError();
+    free_gpu_pool(dev);
+    if (gpu_check(cudaMalloc(&ptr, bytes), "allocating device memory") == FAILURE){
+      #pragma omp critical (gpu_pool)
+      {
+        dev->live -= bytes;
+      }
+      return NULL;
+    }
+  }
+
+  return ptr;
+
+#else
+
+  return NULL;
+
+#endif
+}
+
+
+/** This function releases device memory to the pool of its device. If 
++++ the pool is full, the memory is freed instead.
+--- ptr:    device buffer
+--- bytes:  size of buffer
+--- stream: stream that the buffer was allocated with
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void gpu_release(void *ptr, size_t bytes, gpu_stream_t stream){
+#ifdef FORCE_CUDA
+gpu_dev_t *dev = NULL;
+bool pooled = false;
+int k;
+
+
+  if (ptr == NULL || gpu_ndev == 0 || stream == NULL) return;
+
+  dev = &gpu_dev[((gpu_queue_t*)stream)->dev];
+
+  #pragma omp critical (gpu_pool)
+  {
+
+    dev->live -= bytes;
+
+    if (dev->pool_bytes + bytes <= dev->pool_max){
+
+      for (k=0; k<dev->pool_n; k++){
+        if (dev->pool[k].bytes == bytes) break;
+      }
+
+      if (k == dev->pool_n){
+        re_alloc((void**)&dev->pool, dev->pool_n, dev->pool_n+1, sizeof(gpu_bucket_t));
+        dev->pool[k].bytes = bytes;
+        dev->pool_n++;
+      }
+
+      if (dev->pool[k].n == dev->pool[k].size){
+        re_alloc((void**)&dev->pool[k].ptr, dev->pool[k].size, dev->pool[k].size+16, sizeof(void*));
+        dev->pool[k].size += 16;
+      }
+
+      dev->pool[k].ptr[dev->pool[k].n++] = ptr;
+      dev->pool_bytes += bytes;
+      pooled = true;
+
+    }
+
+  }
+
+  if (!pooled){
+    cudaSetDevice(dev->id);
+    cudaFree(ptr);
+  }
+
+#endif
+
+  return;
+}
+
+
+/** This function allocates a device mirror of the band slab of a brick,
++++ i.e. with the same datatype, number of bands, cells and stride. The
++++ mirror lives on the device of the stream, and all copies are enqueued
++++ in this stream. Band data is not copied, see upload_brick.
+--- brick:  brick
+--- stream: stream
++++ Return: device brick, NULL if GPU is disabled or allocation failed
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+gpu_brick_t *allocate_gpu_brick(brick_t *brick, gpu_stream_t stream){
+gpu_brick_t *gpu = NULL;
+
+
+  if (!gpu_enabled() || stream == NULL || get_brick_slab(brick) == NULL) return NULL;
+
+  alloc((void**)&gpu, 1, sizeof(gpu_brick_t));
+
+  gpu->datatype = get_brick_datatype(brick);
+  gpu->nb       = get_brick_nbands(brick);
+  gpu->nc       = get_brick_ncells(brick);
+  gpu->stride   = get_brick_stride(brick);
+  gpu->byte     = get_brick_byte(brick);
+  gpu->bytes    = (size_t)gpu->nb * gpu->stride * gpu->byte;
+  gpu->stream   = stream;
+
+  if ((gpu->slab = gpu_alloc(gpu->bytes, stream)) == NULL){
+    free((void*)gpu);
+    return NULL;
+  }
+
+  return gpu;
+}
+
+
+/** This function frees a device brick, the slab is released to the pool
+--- gpu:    device brick
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_gpu_brick(gpu_brick_t *gpu){
+
+  if (gpu == NULL) return;
+
+  gpu_release(gpu->slab, gpu->bytes, gpu->stream);
+  free((void*)gpu);
+
+  return;
+}
+
+
+/** This function returns a band of a device brick
+--- gpu:    device brick
+--- b:      band
++++ Return: device pointer to band
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void *get_gpu_band(gpu_brick_t *gpu, int b){
+
+  return (void*)((char*)gpu->slab + (size_t)b * gpu->stride * gpu->byte);
+}
+
+
+/** This function page-locks the band slab of a brick, such that copies
++++ to and from the device are truly asynchronous. The slab stays pinned
++++ until it is returned to the system, i.e. slabs recycled through the
++++ slab pool are registered only once. Pinning is bounded; unpinned 
++++ slabs can still be copied, but the copies are staged by the driver.
+--- brick:  brick
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int pin_brick(brick_t *brick){
+#ifdef FORCE_CUDA
+void *slab = get_brick_slab(brick);
+size_t bytes;
+int k, status = SUCCESS;
+
+
+  if (gpu_ndev == 0 || slab == NULL) return FAILURE;
+
+  bytes = (size_t)get_brick_nbands(brick) * get_brick_stride(brick) * get_brick_byte(brick);
+
+  #pragma omp critical (gpu_pin)
+  {
+
+    for (k=0; k<gpu_pin_n; k++){
+      if (gpu_pin[k].slab == slab) break;
+    }
+
+    if (k == gpu_pin_n){
+
+      if (gpu_pin_bytes + bytes > gpu_pin_max){
+        status = FAILURE;
+      } else {
+        // portable: the slab is pinned for all devices
+        cudaSetDevice(gpu_dev[0].id);
+        if (cudaHostRegister(slab, bytes, cudaHostRegisterPortable) != cudaSuccess){
+          cudaGetLastError();
+          status = FAILURE;
+        } else {
+          if (gpu_pin_n == gpu_pin_size){
+            re_alloc((void**)&gpu_pin, gpu_pin_size, gpu_pin_size+64, sizeof(gpu_pin_t));
+            gpu_pin_size += 64;
+          }
+          gpu_pin[gpu_pin_n].slab  = slab;
+          gpu_pin[gpu_pin_n].bytes = bytes;
+          gpu_pin_n++;
+          gpu_pin_bytes += bytes;
+        }
+      }
+
+    }
+
+  }
+
+  return status;
+
+#else
+
+  return FAILURE;
+
+#endif
+}
+
+
+/** This function copies the band slab of a brick to the device. The copy
++++ is asynchronous, i.e. enqueued in the stream of the device brick. Keep
++++ the brick alive until the stream is synchronized.
+--- brick:  brick
+--- gpu:    device brick
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int upload_brick(brick_t *brick, gpu_brick_t *gpu){
+#ifdef FORCE_CUDA
+void *host = get_brick_slab(brick);
+
+
+  if (gpu == NULL || host == NULL) return FAILURE;
+
+  if (gpu->datatype != get_brick_datatype(brick) ||
+      gpu->bytes    != (size_t)get_brick_nbands(brick) * get_brick_stride(brick) * get_brick_byte(brick)){
+    printf("device brick does not match brick. "); return FAILURE;}
+
+  if (gpu_select(gpu->stream) == FAILURE) return FAILURE;
+
+  return gpu_check(cudaMemcpyAsync(gpu->slab, host, gpu->bytes, 
+    cudaMemcpyHostToDevice, ((gpu_queue_t*)gpu->stream)->stream), "uploading brick");
+
+#else
+
+  return FAILURE;
+
+#endif
+}
+
+
+/** This function copies a device brick back to the band slab of a brick.
++++ The copy is asynchronous, i.e. enqueued in the stream of the device
++++ brick. Synchronize the stream before using the data.
+--- gpu:    device brick
+--- brick:  brick
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int download_brick(gpu_brick_t *gpu, brick_t *brick){
+#ifdef FORCE_CUDA
+void *host = get_brick_slab(brick);
+
+
+  if (gpu == NULL || host == NULL) return FAILURE;
+
+  if (gpu->datatype != get_brick_datatype(brick) ||
+      gpu->bytes    != (size_t)get_brick_nbands(brick) * get_brick_stride(brick) * get_brick_byte(brick)){
+    printf("device brick does not match brick. "); return FAILURE;}
+
+  if (gpu_select(gpu->stream) == FAILURE) return FAILURE;
+
+  return gpu_check(cudaMemcpyAsync(host, gpu->slab, gpu->bytes, 
+    cudaMemcpyDeviceToHost, ((gpu_queue_t*)gpu->stream)->stream), "downloading brick");
+
+#else
+
+  return FAILURE;
+
+#endif
+}
+
+
+#ifdef FORCE_CUDA
+
+/** This function checks the return code of a CUDA call
+--- err:    return code
+--- what:   description of the call
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int gpu_check(cudaError_t err, const char *what){
+
+  if (err == cudaSuccess) return SUCCESS;
+
+  printf("CUDA error %s: %s.\n", what, cudaGetErrorString(err));
+
+  return FAILURE;
+}
+
+
+/** This function unregisters a pinned slab, before it is returned to 
++++ the system. Slabs that are not pinned are ignored.
+--- slab:   host slab
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void unpin_slab(void *slab){
+int k;
+
+
+  #pragma omp critical (gpu_pin)
+  {
+
+    for (k=0; k<gpu_pin_n; k++){
+      if (gpu_pin[k].slab == slab) break;
+    }
+
+    if (k < gpu_pin_n){
+      cudaSetDevice(gpu_dev[0].id);
+      cudaHostUnregister(slab);
+      gpu_pin_bytes -= gpu_pin[k].bytes;
+      gpu_pin[k] = gpu_pin[--gpu_pin_n];
+    }
+
+  }
+
+  return;
+}
+
+
+/** This function frees all device buffers held by the pool of a device
+--- dev:    device
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_gpu_pool(gpu_dev_t *dev){
+int k, i;
+
+
+  #pragma omp critical (gpu_pool)
+  {
+
+    cudaSetDevice(dev->id);
+
+    for (k=0; k<dev->pool_n; k++){
+      for (i=0; i<dev->pool[k].n; i++) cudaFree(dev->pool[k].ptr[i]);
+      if (dev->pool[k].ptr != NULL) free((void*)dev->pool[k].ptr);
+    }
+    if (dev->pool != NULL) free((void*)dev->pool);
+
+    dev->pool = NULL;
+    dev->pool_n = 0;
+    dev->pool_bytes = 0;
+
+  }
+
+  return;
+}
+
+#endif
+
@@ -0,0 +1,85 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+GPU device memory header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef GPU_CL_H
+#define GPU_CL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <stdbool.h> // boolean data type
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/alloc-cl.h"
+#include "../cross-level/brick-cl.h"
+
+
+// number of CUDA streams per device, i.e. processing units that may be in flight
+#define GPU_NSTREAM 4
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// opaque handle of a stream on one of the devices
+typedef void* gpu_stream_t;
+
+// device mirror of the band slab of a brick
+typedef struct {
+  int    datatype;   // datatype
+  int    nb;         // number of bands
+  int    nc;         // number of cells
+  size_t stride;     // cells per band in the slab (incl. padding)
+  size_t byte;       // bytes per cell
+  size_t bytes;      // size of slab
+  void  *slab;       // device memory, band b starts at b*stride cells
+  gpu_stream_t stream; // stream, and thus device, of the mirror
+} gpu_brick_t;
+
+int  init_gpu(int *device, int ndevice);
+void free_gpu();
+bool gpu_enabled();
+int  gpu_count();
+gpu_stream_t claim_gpu_stream();
+int  gpu_select(gpu_stream_t stream);
+void *gpu_cuda_stream(gpu_stream_t stream);
+int  gpu_sync(gpu_stream_t stream);
+void *gpu_alloc(size_t bytes, gpu_stream_t stream);
+void gpu_release(void *ptr, size_t bytes, gpu_stream_t stream);
+gpu_brick_t *allocate_gpu_brick(brick_t *brick, gpu_stream_t stream);
+void free_gpu_brick(gpu_brick_t *gpu);
+void *get_gpu_band(gpu_brick_t *gpu, int b);
+int  pin_brick(brick_t *brick);
+int  upload_brick(brick_t *brick, gpu_brick_t *gpu);
+int  download_brick(gpu_brick_t *gpu, brick_t *brick);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -27,6 +27,9 @@ This file contains functions for image methods
 
 #include "imagefuns-cl.h"
 
+#define CCL_STRIP 64 // number of rows per strip of connected components labeling
+#define DT_LANES  64 // number of columns that are scanned together in the distance transform
+
 
 /** This function estimates the width of a Gaussian used to perform Gaus-
 +++ sian lowpass filtering.
@@ -142,8 +145,11 @@ int nx, ny;
 }
 
 
-/** This function buffers all TRUE pixels by r pixels using the midpoint 
-+++ circle algorithm.
+/** This function buffers all TRUE pixels by r pixels. The footprint is
++++ a circle drawn with the midpoint circle algorithm. Pixels closer to
++++ the image boundary than the radius are not buffered. Depending on the
++++ number of TRUE pixels, the buffer is drawn circle by circle (sparse
++++ images), or by dilation (dense images). Both give the same result.
 --- image:  Binary image (only use with 0/1)
 --- nx:     number of columns
 --- ny:     number of rows
@@ -151,6 +157,44 @@ int nx, ny;
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int buffer_(small *image, int nx, int ny, int r){
+int i, j;
+double n = 0;
+
+
+  if (r <= 0) return SUCCESS;
+
+  #pragma omp parallel private(j) shared(nx, ny, r, image) reduction(+: n) default(none) 
+  {
+
+    #pragma omp for schedule(static)
+    for (i=r; i<(ny-r); i++){
+    for (j=r; j<(nx-r); j++){
+      if (image[nx*i+j]) n++;
+    }
+    }
+
+  }
+
+  // circles cost ~r^2 per TRUE pixel, dilation ~r per pixel
+  if (n*r*r < (double)nx*ny*(2*r+1)){
+    return buffer_circle_(image, nx, ny, r);
+  } else {
+    return buffer_dilate_(image, nx, ny, r);
+  }
+
+}
+
+
+/** This function buffers all TRUE pixels by r pixels using the midpoint 
++++ circle algorithm. The cost scales with the number of TRUE pixels and
++++ with the squared radius.
+--- image:  Binary image (only use with 0/1)
+--- nx:     number of columns
+--- ny:     number of rows
+--- r:      radius
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int buffer_circle_(small *image, int nx, int ny, int r){
 int i, j, k, p, d, x, y;
 int nc = nx*ny;
 small *tmp = NULL;
@@ -209,6 +253,128 @@ small *tmp = NULL;
 }
 
 
+/** This function buffers all TRUE pixels by r pixels. The buffer has the
++++ same footprint as in buffer_circle_. The footprint is reduced to one
++++ half-width per row offset, and the image is dilated with a horizontal
++++ distance transform. The cost scales with the image size and the ra-
++++ dius, but not with the number of TRUE pixels.
+--- image:  Binary image (only use with 0/1)
+--- nx:     number of columns
+--- ny:     number of rows
+--- r:      radius
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int buffer_dilate_(small *image, int nx, int ny, int r){
+int i, j, k, p, d, x, y, dy;
+int *width = NULL;
+ushort *hdist = NULL;
+ushort far;
+small *row_ = NULL;
+
+
+  if (r <= 0) return SUCCESS;
+
+  // pixels farther away than any half-width are never buffered
+  far = (r+1 < USHRT_MAX) ? r+1 : USHRT_MAX;
+
+
+  /** half-width of the buffer for every row offset,
+  +++ midpoint circle algorithm **/
+
+  alloc((void**)&width, r+1, sizeof(int));
+  for (k=0; k<=r; k++) width[k] = -1;
+
+  d = 3 - r;
+  x = 0;
+  y = r;
+
+  while (x <= y){
+
+    // columns +-x are drawn from -y to +y
+    for (k=0; k<=y; k++){ if (x > width[k]) width[k] = x; }
+
+    // rows +-x are drawn from -y to +y
+    if (y > width[x]) width[x] = y;
+
+    if (d < 0){
+      d = d + (4 * x) + 6;
+    } else {
+      d = d + 4 * (x - y) + 10;
+      y -= 1;
+    }
+    x += 1;
+
+  }
+
+
+  /** horizontal distance to the next TRUE pixel in the same row, 
+  +++ boundary pixels are not buffered (boundary width is determined
+  +++ by buffer radius) **/
+
+  alloc((void**)&hdist, (size_t)nx*ny, sizeof(ushort));
+
+  #pragma omp parallel private(j, p) shared(nx, ny, r, far, image, hdist) default(none) 
+  {
+
+    #pragma omp for schedule(static)
+    for (i=0; i<ny; i++){
+
+      p = i*nx;
+
+      // forward scan
+      for (j=0; j<nx; j++){
+        if (image[p+j] && i >= r && i < (ny-r) && j >= r && j < (nx-r)){
+          hdist[p+j] = 0;
+        } else if (j > 0 && hdist[p+j-1] < far){
+          hdist[p+j] = hdist[p+j-1]+1;
+        } else {
+          hdist[p+j] = far;
+        }
+      }
+
+      // backward scan
+      for (j=nx-2; j>=0; j--){
+        if (hdist[p+j+1]+1 < hdist[p+j]) hdist[p+j] = hdist[p+j+1]+1;
+      }
+
+    }
+
+  }
+
+
+  /** dilate with the buffer footprint **/
+
+  #pragma omp parallel private(j, p, dy, row_) shared(nx, ny, r, width, image, hdist) default(none) 
+  {
+
+    #pragma omp for schedule(static)
+    for (i=0; i<ny; i++){
+
+      row_ = image + (size_t)i*nx;
+
+      memset(row_, 0, nx*sizeof(small));
+
+      for (dy=-r; dy<=r; dy++){
+
+        if (i+dy < 0 || i+dy >= ny) continue;
+
+        p = (i+dy)*nx;
+
+        for (j=0; j<nx; j++) row_[j] |= (hdist[p+j] <= width[abs(dy)]);
+
+      }
+
+    }
+
+  }
+
+  free((void*)width);
+  free((void*)hdist);
+
+  return SUCCESS;
+}
+
+
 /** This function performs a majority filling, i.e. FALSE cells that are 
 +++ surrounded by 5 or more TRUE cells will be set to TRUE. This fills
 +++ small holes in a binary image. Brick entry point
@@ -322,27 +488,37 @@ ushort *distance = NULL;
 
   /** first phase **/
   
-  #pragma omp parallel private(y) shared(nx, ny, image, G) default(none) 
+  // DT_LANES neighboring columns are scanned together, row by row
+
+  #pragma omp parallel private(y, u, w) shared(nx, ny, image, G) default(none) 
   {
 
     #pragma omp for schedule(static)
-    for (x=0; x<nx; x++){
+    for (x=0; x<nx; x+=DT_LANES){
+
+      w = (nx-x < DT_LANES) ? nx-x : DT_LANES;
 
       // scan 1
-      if (image[x]) G[x] = 0; else G[x] = nx+ny;
-      
+      for (u=x; u<x+w; u++){
+        if (image[u]) G[u] = 0; else G[u] = nx+ny;
+      }
+
       for (y=1; y<ny; y++){
-        if (image[y*nx+x]){
-          G[y*nx+x] = 0;
-        } else {
-          G[y*nx+x] = 1 + G[(y-1)*nx+x];
+        for (u=x; u<x+w; u++){
+          if (image[y*nx+u]){
+            G[y*nx+u] = 0;
+          } else {
+            G[y*nx+u] = 1 + G[(y-1)*nx+u];
+          }
         }
       }
 
       // scan 2    
       for (y=ny-2; y>=0; y--){
-        if (G[(y+1)*nx+x] < G[y*nx+x]){
-          G[y*nx+x] = 1 + G[(y+1)*nx+x];
+        for (u=x; u<x+w; u++){
+          if (G[(y+1)*nx+u] < G[y*nx+u]){
+            G[y*nx+u] = 1 + G[(y+1)*nx+u];
+          }
         }
       }
 
@@ -460,12 +636,9 @@ int nx, ny;
 
 /** This function performs connected components labeling, i.e. it segments
 +++ all 8-connected TRUE patches. A unique ID is given to each segment, 
-+++ starting at top-left.
-+++-----------------------------------------------------------------------
-+++ Chang, F., Chen, C.-J., Lu, C.-J. (2004). A linear-time component-la-
-+++ beling algorithm using contour tracing technique. Computer Vision and
-+++ Image Understanding, 93 (2), 206-220.
-+++-----------------------------------------------------------------------
++++ starting at top-left. The pixels are joined to trees by a union-find,
++++ either on the GPU or in parallel strips on the CPU, and the trees are
++++ numbered in the order of their first pixel.
 --- image:  Binary image (only use with 0/1)
 --- CCL:    Connected components
 --- nx:     number of columns
@@ -473,140 +646,219 @@ int nx, ny;
 +++ Return: number of segments
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int connectedcomponents_(small *image, int *CCL, int nx, int ny){
-int i, j, p;
-int dir, k = 0, label = 0;
 
-  for (i=0, p=0; i<ny; i++){
-  for (j=0, label=0; j<nx; j++, p++){
 
+  if (nx < 1 || ny < 1) return 0;
 
-    if (image[p]){
+  if (!gpu_enabled() || ccl_gpu(image, CCL, nx, ny) != SUCCESS){
+    ccl_union_strips(image, CCL, nx, ny);
+  }
 
-      if (label != 0){ // use last label
+  return ccl_relabel(image, CCL, nx, ny);
+}
 
-        CCL[p] = label;
 
-      } else {
-
-        label = CCL[p];
+/** This function returns the root of a union-find tree. Optionally, the
++++ path is halved on the way.
++++ This function is used in connectedcomponents
++++--------------------------------------------------------------------**/
+int ccl_find(int *CCL, int p, bool halve){
 
-        if (label == 0){
+  while (CCL[p] != p){
+    if (halve) CCL[p] = CCL[CCL[p]];
+    p = CCL[p];
+  }
 
-          label = ++k;
-          dir = 0;
-          ccl_contourtrace(i, j, label, dir, image, CCL, nx, ny); // external contour
-          CCL[p] = label;
+  return p;
+}
 
-        }
 
-      }
+/** This function links the trees of two pixels. The larger root is hook-
++++ ed to the smaller one, thus each tree is rooted at its first pixel in
++++ raster order. The hooked root is returned, -1 if nothing was linked.
++++ This function is used in connectedcomponents
++++--------------------------------------------------------------------**/
+int ccl_union(int *CCL, int p, int q, bool halve){
 
-    } else if (label != 0){ // if last pixel was labeled
+  p = ccl_find(CCL, p, halve);
+  q = ccl_find(CCL, q, halve);
 
-      if (CCL[p] == 0){
-        dir = 1;
-        ccl_contourtrace(i, j-1, label, dir, image, CCL, nx, ny); // internal contour
-      }
+  if (p == q) return -1;
 
-      label = 0;
+  if (p < q){
+    CCL[q] = p;
+    return q;
+  } else {
+    CCL[p] = q;
+    return p;
+  }
+}
 
-    }
 
-  }
-  }
+/** This function joins all 8-connected TRUE pixels to union-find trees.
++++ The image is cut into strips of CCL_STRIP rows, which are joined in
++++ parallel. The strips are then merged along their borders, and each
++++ root that was hooked while merging is linked to its final root. Thus, 
++++ every pixel either is a root, or links to a preceding pixel of the 
++++ same strip, or links to its root directly.
++++ This function is used in connectedcomponents
++++--------------------------------------------------------------------**/
+void ccl_union_strips(small *image, int *CCL, int nx, int ny){
+int s, nstrip = (ny+CCL_STRIP-1)/CCL_STRIP;
+int i, j, i0, i1, p, q, r;
+int *top = NULL, ntop = 0;
 
 
-  // replace -1 with 0
-  for (p=0; p<nx*ny; p++){
-    if (CCL[p] < 0) CCL[p] = 0;
-  }
+  #pragma omp parallel for private(i, j, i0, i1, p, q) shared(image, CCL, nx, ny, nstrip) schedule(dynamic,1)
+  for (s=0; s<nstrip; s++){
 
-  return(k);
-}
+    i0 = s*CCL_STRIP;
+    i1 = i0+CCL_STRIP;
+    if (i1 > ny) i1 = ny;
 
+    for (i=i0; i<i1; i++){
+    for (j=0; j<nx; j++){
 
-/** Tracer Function for connected components labeling
-+++ This function is used in connectedcomponents
-+++--------------------------------------------------------------------**/
-void ccl_tracer(int *cy, int *cx, int *dir, small *image, int *CCL, int nx, int ny){
-int i, y, x, tval;
-static int neighbor[8][2] = {{0,1},{1,1},{1,0},{1,-1},{0,-1},{-1,-1},{-1,0},{-1,1}};
+      p = i*nx+j;
 
+      if (!image[p]){ CCL[p] = -1; continue;}
 
-  for (i=0; i<7; i++){
+      CCL[p] = p;
 
-    y = *cy + neighbor[*dir][0];
-    x = *cx + neighbor[*dir][1];
+      if (j > 0 && image[p-1]) ccl_union(CCL, p, p-1, true);
 
-    if (y>=0 && y<ny && x>=0 && x<nx){
+      if (i == i0) continue;
 
-      tval = image[y*nx+x];
-      
-    } else {
+      q = p-nx;
 
-      tval = 0;
+      // upper-left and upper-right are connected through upper
+      if (image[q]){
+        ccl_union(CCL, p, q, true);
+      } else {
+        if (j > 0    && image[q-1]) ccl_union(CCL, p, q-1, true);
+        if (j < nx-1 && image[q+1]) ccl_union(CCL, p, q+1, true);
+      }
 
     }
+    }
 
-    if (tval == 0){
+  }
 
-      if (y>=0 && y<ny && x>=0 && x<nx) CCL[y*nx+x] = -1;
-      *dir = (*dir + 1) % 8;
+  if (nstrip < 2) return;
 
-    } else {
 
-      *cy = y;
-      *cx = x;
-      break;
+  // each border pixel hooks at most two roots
+  alloc((void**)&top, 2*nx*(nstrip-1), sizeof(int));
+
+  for (s=1; s<nstrip; s++){
+
+    i = s*CCL_STRIP;
+
+    for (j=0; j<nx; j++){
+
+      p = i*nx+j;
+
+      if (!image[p]) continue;
+
+      q = p-nx;
+
+      if (image[q]){
+        if ((r = ccl_union(CCL, p, q, false)) >= 0) top[ntop++] = r;
+      } else {
+        if (j > 0    && image[q-1] && (r = ccl_union(CCL, p, q-1, false)) >= 0) top[ntop++] = r;
+        if (j < nx-1 && image[q+1] && (r = ccl_union(CCL, p, q+1, false)) >= 0) top[ntop++] = r;
+      }
 
     }
 
   }
 
+  for (r=0; r<ntop; r++) CCL[top[r]] = ccl_find(CCL, top[r], false);
+
+  free((void*)top);
+
   return;
 }
 
 
-/** Contour tracing Function for connected components labeling
+/** This function numbers union-find trees in the order of their roots, 
++++ and assigns the number to each pixel. Every pixel is expected to be a
++++ root, or to link to a preceding pixel of the same strip, or to link to
++++ its root directly. The strips are resolved in parallel, and labels are
++++ negative until all pixels are resolved.
 +++ This function is used in connectedcomponents
 +++--------------------------------------------------------------------**/
-void ccl_contourtrace(int cy, int cx, int label, int dir, 
-                      small *image, int *CCL, int nx, int ny){
-bool stop = false, search = true;
-int fx, fy, sx = cx, sy = cy;
+int ccl_relabel(small *image, int *CCL, int nx, int ny){
+int s, nstrip = (ny+CCL_STRIP-1)/CCL_STRIP;
+int p, p0, p1, q, k;
+int nc = nx*ny;
+int *nroot = NULL;
 
-  ccl_tracer(&cy, &cx, &dir, image, CCL, nx, ny);
 
-  if (cx != sx || cy != sy){
+  alloc((void**)&nroot, nstrip+1, sizeof(int));
 
-    fx = cx;
-    fy = cy;
+  #pragma omp parallel private(p, p0, p1, q, k) shared(image, CCL, nx, ny, nc, nstrip, nroot)
+  {
 
-    while (search){
+    // number of roots per strip
+    #pragma omp for schedule(static)
+    for (s=0; s<nstrip; s++){
+      p0 = s*CCL_STRIP*nx;
+      p1 = p0+CCL_STRIP*nx;
+      if (p1 > nc) p1 = nc;
+      for (p=p0; p<p1; p++){
+        if (image[p] && CCL[p] == p) nroot[s+1]++;
+      }
+    }
 
-      dir = (dir + 6) % 8;
-      CCL[cy*nx+cx] = label;
-      ccl_tracer(&cy, &cx, &dir, image, CCL, nx, ny);
+    #pragma omp single
+    {
+      for (s=0; s<nstrip; s++) nroot[s+1] += nroot[s];
+    }
 
-      if (cx == sx && cy == sy){
+    // label roots, and resolve pixels that link within their strip
+    #pragma omp for schedule(static)
+    for (s=0; s<nstrip; s++){
 
-        stop = true;
+      p0 = s*CCL_STRIP*nx;
+      p1 = p0+CCL_STRIP*nx;
+      if (p1 > nc) p1 = nc;
+      k  = nroot[s];
 
-      } else if (stop){
+      for (p=p0; p<p1; p++){
 
-        if (cx == fx && cy == fy){
-          search = false;
-        } else {
-          stop = false;
+        if (!image[p]) continue;
+
+        q = CCL[p];
+
+        if (q == p){
+          CCL[p] = -(++k);
+        } else if (q >= p0){
+          CCL[p] = CCL[q];
         }
 
       }
 
     }
 
+    // resolve pixels that link to a root of another strip
+    #pragma omp for schedule(static)
+    for (p=0; p<nc; p++){
+      if (image[p] && CCL[p] >= 0) CCL[p] = CCL[CCL[p]];
+    }
+
+    #pragma omp for schedule(static)
+    for (p=0; p<nc; p++){
+      CCL[p] = image[p] ? -CCL[p] : 0;
+    }
+
   }
 
-  return;
+  k = nroot[nstrip];
+
+  free((void*)nroot);
+
+  return k;
 }
 
 
@@ -719,6 +971,11 @@ int nx, ny;
 +++ alysis: Applications and Efficient Algorithms. IEEE Transactions on Im
 +++ age Processing, 2 (2), 176-201.
 ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++ The raster scans are order-dependent, and run sequentially. The pro-
++++ pagation step runs in parallel on a level-synchronous frontier: mar-
++++ ker values are only lowered (atomic compare-and-swap), and every pix-
++++ el that was lowered is propagated again in the next level, thus the
++++ result does not depend on the processing order.
 --- MASK:   mask image
 --- MARKER: marker image
 --- nx:     number of columns
@@ -726,38 +983,51 @@ int nx, ny;
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int greyscale_reconstruction_(short *MASK, short *MARKER, int nx, int ny){
-int i, j, p, ii, jj, np, np1[4], np2[4], k;
-short min, max;
-queue_t fifo;
+int i, j, p, ii, jj, np, np1[4], np2[4], k, f;
+short min, max, val, old, target;
+frontier_t front[2], seg;
+frontier_t *cur = &front[0], *nxt = &front[1], *tmp = NULL;
+int err = 0;
 
   np1[0] = -nx-1; np1[1] = -nx; np1[2] = -nx+1; np1[3] = -1;
   np2[0] = nx+1; np2[1] = nx; np2[2] = nx-1; np2[3] = 1;
 
 
-  // initialize queue
-  if ((create_queue(&fifo, (nx*ny)/2)) == FAILURE){
-    printf("failed to create new queue!\n"); return FAILURE;}
+  // initialize frontiers
+  if ((create_frontier(&front[0], nx+ny)) == FAILURE ||
+      (create_frontier(&front[1], nx+ny)) == FAILURE){
+    printf("failed to create new frontier!\n"); return FAILURE;}
 
 
   /* set border of marker image to mask value
      set rest of image to maximum of mask */
   max = SHRT_MIN;  
+
+  #pragma omp parallel for reduction(max: max) shared(nx, ny, MASK) default(none)
   for (p=0; p<nx*ny; p++){
     if (MASK[p] > max) max = MASK[p];
   }
   
-  
-  for (i=0, p=0; i<ny; i++){
-  for (j=0; j<nx; j++, p++){
-    
-    if (i == 0 || j == 0 || i == ny-1 || j == nx-1){
-      MARKER[p] = MASK[p];
-    } else {
-      MARKER[p] = max;
+
+  #pragma omp parallel private(j, p) shared(nx, ny, max, MASK, MARKER) default(none)
+  {
+
+    #pragma omp for schedule(static)
+    for (i=0; i<ny; i++){
+    for (j=0; j<nx; j++){
+
+      p = i*nx+j;
+
+      if (i == 0 || j == 0 || i == ny-1 || j == nx-1){
+        MARKER[p] = MASK[p];
+      } else {
+        MARKER[p] = max;
+      }
+
+    }
     }
 
   }
-  }
 
 
   // sequential reconstruction in raster order
@@ -796,11 +1066,12 @@ queue_t fifo;
       np = p+np2[k];
       if (MARKER[np] > MARKER[p] && MARKER[np] > MASK[np]){
 
-        if (enqueue(&fifo, j, i) == FAILURE){
+        if (push_frontier(cur, j, i) == FAILURE){
           printf("Failed to enqueue another coord. pair!\n"); 
+          destroy_frontier(&front[0]); destroy_frontier(&front[1]);
           return FAILURE;
         }
-        continue;
+        break;
 
       }
     }
@@ -808,41 +1079,67 @@ queue_t fifo;
   }
   }
 
-  //fprintf("step 2: done. queue length: %d\n", fifo->length);
 
-  // queue propagation
-  while (dequeue(&fifo, &j, &i) == SUCCESS){
+  // parallel propagation, one frontier level at a time
+  #pragma omp parallel private(f, i, j, p, ii, jj, np, val, old, target, seg) shared(nx, MASK, MARKER, cur, nxt, tmp) reduction(+: err) default(none)
+  {
 
-    p = nx*i+j;
+    create_frontier(&seg, 1024);
 
-    for (ii=-1; ii<=1; ii++){
-    for (jj=-1; jj<=1; jj++){
+    while (cur->n > 0){
 
-      if (ii == 0 && jj == 0) continue;
+      #pragma omp for schedule(guided)
+      for (f=0; f<cur->n; f++){
 
-      np = (i+ii)*nx+j+jj;
+        j = cur->buf_x[f];
+        i = cur->buf_y[f];
+        p = nx*i+j;
 
-      if (MARKER[np] > MARKER[p] && MASK[np] != MARKER[np]){
+        val = __atomic_load_n(&MARKER[p], __ATOMIC_RELAXED);
 
-        if (MARKER[p] > MASK[np]) MARKER[np] = MARKER[p]; else MARKER[np] = MASK[np];
-        
-        if (enqueue(&fifo, j+jj, i+ii) == FAILURE){
-          printf("Failed to enqueue another coord. pair!\n");
-          return FAILURE;
+        for (ii=-1; ii<=1; ii++){
+        for (jj=-1; jj<=1; jj++){
+
+          if (ii == 0 && jj == 0) continue;
+
+          np = (i+ii)*nx+j+jj;
+
+          // lower neighbor to max(marker, mask), if this is lower
+          if (val > MASK[np]) target = val; else target = MASK[np];
+          old = __atomic_load_n(&MARKER[np], __ATOMIC_RELAXED);
+
+          while (old > target){
+            if (__atomic_compare_exchange_n(&MARKER[np], &old, target, false, 
+                  __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+              if (push_frontier(&seg, j+jj, i+ii) == FAILURE) err++;
+              break;
+            }
+          }
+
+        }
         }
 
       }
 
+      gather_frontier(nxt, &seg);
+
+      #pragma omp single
+      {
+        tmp = cur; cur = nxt; nxt = tmp;
+      }
+
     }
-    }
 
-  }  
+    destroy_frontier(&seg);
+
+  }
 
-  //fprintf("step 3: done. queue length: %d\n", fifo->length);
+  // free frontiers' memory
+  destroy_frontier(&front[0]);
+  destroy_frontier(&front[1]);
 
-  // free queue's memory
-  destroy_queue(&fifo);
-  //fifo = NULL;
+  if (err > 0){
+    printf("Failed to enqueue another coord. pair!\n"); return FAILURE;}
 
   return SUCCESS;
 }
@@ -35,6 +35,8 @@ Image methods header
 #include "../cross-level/const-cl.h"
 #include "../cross-level/brick-cl.h"
 #include "../cross-level/queue-cl.h"
+#include "../cross-level/gpu-cl.h"
+#include "../cross-level/ccl-gpu-cl.h"
 
 
 #ifdef __cplusplus
@@ -46,6 +48,8 @@ int gauss_kernel(int nk, float sigma, float ***kernel);
 int distance_kernel(int nk, float ***kernel);
 int buffer(brick_t *brick, int b, int r);
 int buffer_(small *image, int nx, int ny, int r);
+int buffer_circle_(small *image, int nx, int ny, int r);
+int buffer_dilate_(small *image, int nx, int ny, int r);
 int majorfill(brick_t *brick, int b);
 int majorfill_(small *image, int nx, int ny);
 ushort *dist_transform(brick_t *brick, int b);
@@ -54,8 +58,10 @@ int dt_dfun(int nx, int x, int i, int y, ushort *G);
 int dt_Sep(int nx, int i, int u, int y, ushort *G);
 int connectedcomponents(brick_t *brick, int b_brick, brick_t *segmentation, int b_segmentation);
 int connectedcomponents_(small *image, int *CCL, int nx, int ny);
-void ccl_tracer(int *cy, int *cx, int *dir, small *image, int *CCL, int nx, int ny);
-void ccl_contourtrace(int cy, int cx, int label, int dir, small *image, int *CCL, int nx, int ny);
+int ccl_find(int *CCL, int p, bool halve);
+int ccl_union(int *CCL, int p, int q, bool halve);
+void ccl_union_strips(small *image, int *CCL, int nx, int ny);
+int ccl_relabel(small *image, int *CCL, int nx, int ny);
 int binary_to_objects(small *image, int nx, int ny, int nmin, int **OBJ, int **SIZE, int *nobj);
 int greyscale_reconstruction(brick_t *mask, int b_mask, brick_t *marker, int b_marker);
 int greyscale_reconstruction_(short *MASK, short *MARKER, int nx, int ny);
@@ -25,22 +25,111 @@ This file contains a public interface for locking files
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
 
+// open file description locks
+#define _GNU_SOURCE
+
 #include "lock-cl.h"
 
 /** Geospatial Data Abstraction Library (GDAL) **/
 #include "cpl_multiproc.h" // CPL Multi-Threading
 
+#include <errno.h>     // error numbers
+#include <string.h>    // string handling functions
+#include <fcntl.h>     // file control options
+#include <unistd.h>    // standard symbolic constants and types
+#include <sys/file.h>  // file locking
+#include <sys/stat.h>  // file status
+
+
+int lock_fd(int fd);
+
+
+/** Acquire an exclusive lock on an open file
++++ This function blocks until the lock is acquired. Open file description
++++ locks are used where available: they are released by the kernel when
++++ the process dies, work on network filesystems, and exclude each other
++++ between threads of the same process. Otherwise, flock is used.
+--- fd:     file descriptor
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int lock_fd(int fd){
+int err;
+#ifdef F_OFD_SETLKW
+struct flock fl;
+
+  memset(&fl, 0, sizeof(struct flock));
+  fl.l_type   = F_WRLCK;
+  fl.l_whence = SEEK_SET;
+  fl.l_start  = 0;
+  fl.l_len    = 0;
+
+  while ((err = fcntl(fd, F_OFD_SETLKW, &fl)) == -1 && errno == EINTR);
+#else
+  while ((err = flock(fd, LOCK_EX)) == -1 && errno == EINTR);
+#endif
+
+  if (err == -1) return FAILURE;
+
+  return SUCCESS;
+}
+
 
 /** Lock a file
++++ This function locks a file by holding an advisory kernel lock on a 
++++ lockfile next to it. Waiting processes and threads block until the 
++++ lock is released, instead of polling. A crashed process cannot leave
++++ a stale lock. When compiled with FORCE_LOCKFILE, GDAL's lockfiles 
++++ are used instead, e.g. for filesystems without locking support.
 --- fname:   filename
---- timeout: try to lock the file for a maximum time of x seconds
-+++ Return:  filename of lockfile
+--- timeout: try to lock the file for a maximum time of x seconds 
+             (FORCE_LOCKFILE only, kernel locks block until acquired)
++++ Return:  lock
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-char *lock_file(char *fname, int timeout){
-char *lock = NULL;
+lock_t *lock_file(const char *fname, int timeout){
+lock_t *lock = NULL;
+struct stat st_fd, st_path;
+int nchar;
 
-  if ((lock = (char*)CPLLockFile(fname, timeout)) == NULL){
+
+  alloc((void**)&lock, 1, sizeof(lock_t));
+  lock->fd = -1;
+
+  #ifdef FORCE_LOCKFILE
+
+  if ((lock->cpl = CPLLockFile(fname, timeout)) == NULL){
     printf("Unable to lock file (timeout: %ds): %s\n", timeout, fname); 
+    free((void*)lock);
+    return NULL;
+  }
+
+  return lock;
+
+  #endif
+
+  nchar = snprintf(lock->fname, NPOW_10, "%s.lock", fname);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling lockfile\n"); 
+    free((void*)lock);
+    return NULL;}
+
+
+  while (1){
+
+    if ((lock->fd = open(lock->fname, O_RDWR | O_CREAT | O_CLOEXEC, 0666)) == -1 ||
+        lock_fd(lock->fd) == FAILURE){
+      printf("Unable to lock file (%s): %s\n", strerror(errno), fname); 
+      if (lock->fd != -1) close(lock->fd);
+      free((void*)lock);
+      return NULL;
+    }
+
+    // the previous holder removes the lockfile on unlock. If this happened
+    // while waiting, the lock is held on a stale file: try again
+    if (fstat(lock->fd, &st_fd) == 0 && stat(lock->fname, &st_path) == 0 &&
+        st_fd.st_dev == st_path.st_dev && st_fd.st_ino == st_path.st_ino) break;
+
+    close(lock->fd);
+
   }
 
   return lock;
@@ -48,12 +137,24 @@ char *lock = NULL;
 
 
 /** Unlock a file
---- lock:   filename of lockfile
+--- lock:   lock
 +++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-void unlock_file(char *lock){
+void unlock_file(lock_t *lock){
+
+
+  if (lock == NULL) return;
+
+  if (lock->cpl != NULL){
+    CPLUnlockFile(lock->cpl);
+  } else if (lock->fd != -1){
+    // remove the lockfile while still holding the lock
+    unlink(lock->fname);
+    close(lock->fd);
+  }
+
+  free((void*)lock);
 
-  CPLUnlockFile(lock);
   return;
 }
 
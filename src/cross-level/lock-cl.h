@@ -30,14 +30,24 @@ Lockfiles header
 
 #include <stdio.h>   // core input and output functions
 #include <stdlib.h>  // standard general utilities library
+#include <math.h>    // common mathematical functions
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/alloc-cl.h"
 
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-char *lock_file(char *fname, int timeout);
-void unlock_file(char *lock);
+typedef struct {
+  int fd;               // file descriptor of lockfile
+  void *cpl;            // CPL lock handle (FORCE_LOCKFILE only)
+  char fname[NPOW_10];  // filename of lockfile
+} lock_t;
+
+lock_t *lock_file(const char *fname, int timeout);
+void unlock_file(lock_t *lock);
 double lock_timeout(size_t bytes);
 
 #ifdef __cplusplus
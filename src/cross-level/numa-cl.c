@@ -0,0 +1,368 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for placing threads and memory on NUMA nodes
++++ The topology is read from sysfs, threads are pinned with sched_setaf-
++++ finity, and memory is placed with the mbind system call, such that no
++++ additional library is needed. On other systems, or with less than two
++++ nodes, all functions fall back to the unplaced behaviour.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+// CPU sets
+#define _GNU_SOURCE
+
+#include "numa-cl.h"
+
+#include <stdint.h>  // fixed-width integer types
+#include <string.h>  // string handling functions
+#include <unistd.h>  // standard symbolic constants and types
+
+#ifdef __linux__
+#include <sched.h>        // scheduling, CPU affinity
+#include <sys/syscall.h>  // system calls
+#endif
+
+/** OpenMP **/
+#include <omp.h> // multi-platform shared memory multiprocessing
+
+
+// max. number of NUMA nodes
+#define NUMA_MAXNODE 64
+
+// memory policy flags of mbind (linux/mempolicy.h)
+#define NUMA_MPOL_PREFERRED 1
+#define NUMA_MPOL_MF_MOVE   (1<<1)
+
+
+#ifdef __linux__
+
+// NUMA node
+typedef struct {
+  int id;         // node ID in sysfs
+  cpu_set_t cpu;  // CPUs of this node
+  int ncpu;       // number of CPUs
+} numa_node_t;
+
+numa_node_t numa_node[NUMA_MAXNODE];
+int numa_nnode = 0;             // number of nodes, 0: placement disabled
+int numa_placement = _NUMA_NONE_;
+
+
+int parse_cpulist(const char *list, cpu_set_t *cpu);
+int current_node();
+void bind_pages(uintptr_t from, uintptr_t to, int node);
+
+#endif
+
+
+/** This function parses a list of CPUs as given in sysfs, e.g. "0-63,128-
++++ 191".
+--- list:   CPU list
+--- cpu:    CPU set (returned)
++++ Return: number of CPUs
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+#ifdef __linux__
+int parse_cpulist(const char *list, cpu_set_t *cpu){
+const char *ptr = list;
+char *end = NULL;
+long from, to, c;
+int n = 0;
+
+
+  CPU_ZERO(cpu);
+
+  while (*ptr != '\0' && *ptr != '\n'){
+
+    from = strtol(ptr, &end, 10);
+    if (end == ptr) break;
+    to = from;
+    ptr = end;
+
+    if (*ptr == '-'){
+      to = strtol(ptr+1, &end, 10);
+      ptr = end;
+    }
+
+    for (c=from; c<=to && c<CPU_SETSIZE; c++){
+      CPU_SET(c, cpu); n++;
+    }
+
+    if (*ptr == ',') ptr++;
+
+  }
+
+  return n;
+}
+
+
+/** This function returns the node of the CPU that runs the calling thread
++++ Return: node index, -1 if unknown
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int current_node(){
+int cpu, n;
+
+
+  if ((cpu = sched_getcpu()) < 0) return -1;
+
+  for (n=0; n<numa_nnode; n++){
+    if (CPU_ISSET(cpu, &numa_node[n].cpu)) return n;
+  }
+
+  return -1;
+}
+
+
+/** This function moves the pages of a memory range to a node. The range
++++ is page-aligned inwards, partial pages stay where they are.
+--- from:   start of range
+--- to:     end of range
+--- node:   node index
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void bind_pages(uintptr_t from, uintptr_t to, int node){
+uintptr_t page = sysconf(_SC_PAGESIZE);
+uintptr_t start = (from + page - 1) / page * page;
+uintptr_t end   = to / page * page;
+unsigned long mask = 1UL << numa_node[node].id;
+
+
+  if (end <= start) return;
+
+  syscall(SYS_mbind, (void*)start, (unsigned long)(end - start), 
+    NUMA_MPOL_PREFERRED, &mask, sizeof(unsigned long)*8 + 1, NUMA_MPOL_MF_MOVE);
+
+  return;
+}
+#endif
+
+
+/** This function initializes NUMA placement. The nodes and their CPUs are
++++ read from sysfs. Placement is disabled if the system has less than two
++++ nodes. This function does not enter any OpenMP region, and can thus be
++++ called before worker processes are forked.
+--- mode:   NUMA placement mode
++++ Return: number of nodes used for placement, 0 if disabled
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int init_numa(int mode){
+#ifdef __linux__
+char fname[NPOW_10];
+char list[NPOW_16];
+FILE *fp = NULL;
+int d, nchar;
+
+
+  numa_nnode = 0;
+  numa_placement = _NUMA_NONE_;
+
+  if (mode == _NUMA_NONE_) return 0;
+
+  for (d=0; d<NUMA_MAXNODE; d++){
+
+    nchar = snprintf(fname, NPOW_10, "/sys/devices/system/node/node%d/cpulist", d);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); return 0;}
+
+    if ((fp = fopen(fname, "r")) == NULL) continue;
+
+    if (fgets(list, NPOW_16, fp) != NULL){
+      numa_node[numa_nnode].id   = d;
+      numa_node[numa_nnode].ncpu = parse_cpulist(list, &numa_node[numa_nnode].cpu);
+      // memory-only nodes cannot run threads
+      if (numa_node[numa_nnode].ncpu > 0) numa_nnode++;
+    }
+
+    fclose(fp);
+
+  }
+
+  if (numa_nnode < 2){
+    printf("less than two NUMA nodes, NUMA placement is disabled.\n");
+    numa_nnode = 0;
+    return 0;
+  }
+
+  numa_placement = mode;
+
+  return numa_nnode;
+
+#else
+
+  if (mode != _NUMA_NONE_) printf("NUMA placement is only supported on Linux.\n");
+  return 0;
+
+#endif
+}
+
+
+/** This function returns the active NUMA placement mode
++++ Return: NUMA placement mode
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int numa_mode(){
+#ifdef __linux__
+
+  return numa_placement;
+
+#else
+
+  return _NUMA_NONE_;
+
+#endif
+}
+
+
+/** This function returns the number of NUMA nodes used for placement
++++ Return: number of nodes, 0 if placement is disabled
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int numa_count(){
+#ifdef __linux__
+
+  return numa_nnode;
+
+#else
+
+  return 0;
+
+#endif
+}
+
+
+/** This function returns the node that handles a processing unit. With
++++ one pipeline per socket, the units are dealt to the nodes in turn.
+--- unit:   processing unit
++++ Return: node index, -1 if the unit is spread over all nodes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int numa_unit_node(int unit){
+
+
+  if (numa_mode() != _NUMA_SOCKET_) return -1;
+
+  return unit % numa_count();
+}
+
+
+/** This function returns the size of a thread team. With one pipeline 
++++ per socket, the threads of each team are divided among the sockets.
+--- nthread: number of threads
++++ Return:  number of threads per team
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int numa_threads(int nthread){
+
+
+  if (numa_mode() != _NUMA_SOCKET_) return nthread;
+
+  if (nthread < numa_count()) return 1;
+
+  return nthread / numa_count();
+}
+
+
+/** This function pins the calling thread to the CPUs of a node. Threads
++++ that are created by this thread inherit the affinity.
+--- node:   node index
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void numa_pin(int node){
+#ifdef __linux__
+
+
+  if (numa_nnode == 0 || node < 0) return;
+
+  sched_setaffinity(0, sizeof(cpu_set_t), &numa_node[node % numa_nnode].cpu);
+
+#endif
+  return;
+}
+
+
+/** This function pins the threads of the next OpenMP team. Either all
++++ threads are pinned to one node, or the threads are spread over all 
++++ nodes in contiguous blocks, such that the static scheduling of pixel 
++++ loops matches the placement of numa_place. This relies on the OpenMP
++++ runtime reusing its threads, which holds for teams of the same size.
+--- node:   node index, -1: spread over all nodes
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void numa_bind_team(int node){
+int nnode = numa_count();
+
+
+  if (numa_mode() == _NUMA_NONE_) return;
+
+  #pragma omp parallel shared(node,nnode) default(none)
+  {
+
+    if (node >= 0){
+      numa_pin(node);
+    } else {
+      numa_pin(omp_get_thread_num()*nnode/omp_get_num_threads());
+    }
+
+  }
+
+  return;
+}
+
+
+/** This function places a slab of bands on NUMA nodes. Pages that were
++++ already touched (pooled slabs, zero-initialization) are moved. With
++++ pinned threads, the pixels of each band are split among the nodes in
++++ the same blocks as the thread team. With one pipeline per socket, the
++++ slab is placed on the node of the calling thread, i.e. on the socket
++++ of the pipeline that reads and computes it.
+--- slab:   slab
+--- nb:     number of bands
+--- stride: distance between bands (in elements)
+--- size:   size of each element
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void numa_place(void *slab, size_t nb, size_t stride, size_t size){
+#ifdef __linux__
+uintptr_t from = (uintptr_t)slab;
+size_t bytes = stride*size;
+int n, node;
+size_t b;
+
+
+  if (numa_placement == _NUMA_NONE_ || slab == NULL || nb == 0) return;
+
+  if (numa_placement == _NUMA_SOCKET_){
+
+    if ((node = current_node()) < 0) return;
+    bind_pages(from, from + nb*bytes, node);
+
+  } else {
+
+    for (b=0; b<nb; b++, from+=bytes){
+      for (n=0; n<numa_nnode; n++){
+        bind_pages(from + stride*n/numa_nnode*size, 
+                   from + stride*(n+1)/numa_nnode*size, n);
+      }
+    }
+
+  }
+
+#endif
+  return;
+}
+
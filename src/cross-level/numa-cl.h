@@ -0,0 +1,56 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+NUMA placement header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef NUMA_CL_H
+#define NUMA_CL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/enum-cl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int init_numa(int mode);
+int numa_mode();
+int numa_count();
+int numa_unit_node(int unit);
+int numa_threads(int nthread);
+void numa_pin(int node);
+void numa_bind_team(int node);
+void numa_place(void *slab, size_t nb, size_t stride, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -29,100 +29,232 @@ This file contains functions for principal components analysis
 #include "pca-cl.h"
 
 /** GNU Scientific Library (GSL) **/
-#include "gsl/gsl_blas.h"
 #include "gsl/gsl_eigen.h"
 
 
-/** Compute Principal Components
-+++ This function computes Principal Components. The input data may be in-
-+++ complete, a nodata value must be given. The PCs can be truncated using
-+++ a percenatge of total variance.
+/** Initialize PCA
++++ This function initializes an empty PCA accumulator. Data of several
++++ chunks can be accumulated into one accumulator, such that all chunks
++++ are projected with the same basis.
+--- pc:     PCA accumulator
+--- nb:     number of bands
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int pca_init(pca_t *pc, int nb){
+
+
+  if (nb < 1){
+    printf("no bands for PCA.\n"); return FAILURE;}
+
+  pc->nb  = nb;
+  pc->n   = 0;
+  pc->npc = 0;
+
+  alloc((void**)&pc->shift, nb, sizeof(double));
+  alloc((void**)&pc->sum,   nb, sizeof(double));
+  alloc_2D((void***)&pc->sxy, nb, nb, sizeof(double));
+
+  pc->mean = NULL;
+  pc->eval = NULL;
+  pc->evec = NULL;
+
+  return SUCCESS;
+}
+
+
+/** Free PCA
++++ This function frees the PCA accumulator.
+--- pc:     PCA accumulator
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void pca_free(pca_t *pc){
+
+
+  if (pc->shift != NULL){ free((void*)pc->shift); pc->shift = NULL;}
+  if (pc->sum   != NULL){ free((void*)pc->sum);   pc->sum   = NULL;}
+  if (pc->mean  != NULL){ free((void*)pc->mean);  pc->mean  = NULL;}
+  if (pc->eval  != NULL){ free((void*)pc->eval);  pc->eval  = NULL;}
+  if (pc->sxy   != NULL){ free_2D((void**)pc->sxy,  pc->nb); pc->sxy  = NULL;}
+  if (pc->evec  != NULL){ free_2D((void**)pc->evec, pc->nb); pc->evec = NULL;}
+
+  return;
+}
+
+
+/** Accumulate data for PCA
++++ This function accumulates the band sums and cross-products of one chunk
++++ of data. Pixels with nodata in any band are skipped. Valid pixels are
++++ gathered into blocks, and each thread accumulates the cross-products
++++ of its blocks before they are merged. Values are shifted by the first
++++ valid pixel to keep the one-pass covariance numerically stable.
+--- pc:     PCA accumulator
 --- INP:    input image
 --- mask_:  mask image
---- nb:     number of bands
 --- nc:     number of cells
 --- nodata: nodata value
---- minvar: amount of retained variance [0...1]
---- newnb:  number of PC bands (returned)
-+++ Return: PC rotated data 
++++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-float **pca(short **INP, small *mask_, int nb, int nc, short nodata, float minvar, int *newnb){
-int p, k, nk, b;
-double *mean = NULL;
-float totalvar = 0, cumvar = 0, pctvar;
-int numcomp = nb;
-bool *NODATA = NULL;
-float **PCA  = NULL;
-gsl_matrix *GINP = NULL;
-gsl_matrix *GPCA = NULL;
-gsl_matrix *covm = NULL;
-gsl_matrix *evec = NULL;
-gsl_vector *eval = NULL;
+int pca_accumulate(pca_t *pc, short **INP, small *mask_, int nc, short nodata){
+int nb = pc->nb;
+int p, b, bb, k, nk;
+long n = 0;
+bool valid;
+double  *sum = NULL;
+double **sxy = NULL;
+double **blk = NULL;
+double s;
 
 
-  #ifdef FORCE_CLOCK
-  time_t TIME; time(&TIME);
-  #endif
+  if (pc->evec != NULL){
+    printf("PCA was already fitted.\n"); return FAILURE;}
 
-  // compile nodata image for computing PCA with valld data only
-  alloc((void**)&NODATA, nc, sizeof(bool));
-  alloc((void**)&mean,   nb, sizeof(double));
 
-  for (p=0, nk=0; p<nc; p++){
+  // shift by first valid pixel
+  if (pc->n == 0){
 
-    if (mask_ != NULL && !mask_[p]){
-      NODATA[p] = true; continue;}
+    for (p=0; p<nc; p++){
 
-    for (b=0; b<nb; b++){
-      if (INP[b][p] == nodata){
-        NODATA[p] = true;
-      } else {
-        mean[b] += INP[b][p];
+      if (mask_ != NULL && !mask_[p]) continue;
+
+      for (b=0, valid=true; b<nb; b++){
+        if (INP[b][p] == nodata){ valid = false; break;}
+      }
+
+      if (!valid) continue;
+
+      for (b=0; b<nb; b++) pc->shift[b] = INP[b][p];
+      break;
+
+    }
+
+  }
+
+
+  #pragma omp parallel private(p,b,bb,k,nk,valid,sum,sxy,blk,s) shared(pc,INP,mask_,nc,nb,nodata) reduction(+: n) default(none)
+  {
+
+    alloc((void**)&sum, nb, sizeof(double));
+    alloc_2D((void***)&sxy, nb, nb, sizeof(double));
+    alloc_2D((void***)&blk, nb, PCA_BLOCK, sizeof(double));
+
+    #pragma omp for schedule(static)
+    for (k=0; k<nc; k+=PCA_BLOCK){
+
+      // gather valid pixels of this block
+      for (p=k, nk=0; p<nc && p<k+PCA_BLOCK; p++){
+
+        if (mask_ != NULL && !mask_[p]) continue;
+
+        for (b=0, valid=true; b<nb; b++){
+          if (INP[b][p] == nodata){ valid = false; break;}
+        }
+
+        if (!valid) continue;
+
+        for (b=0; b<nb; b++) blk[b][nk] = INP[b][p] - pc->shift[b];
+        nk++;
+
+      }
+
+      if (nk == 0) continue;
+      n += nk;
+
+      // rank-k update of sums and cross-products
+      for (b=0; b<nb; b++){
+
+        s = 0;
+        #pragma omp simd reduction(+: s)
+        for (p=0; p<nk; p++) s += blk[b][p];
+        sum[b] += s;
+
+        for (bb=b; bb<nb; bb++){
+          s = 0;
+          #pragma omp simd reduction(+: s)
+          for (p=0; p<nk; p++) s += blk[b][p]*blk[bb][p];
+          sxy[b][bb] += s;
+        }
+
+      }
+
+    }
+
+    #pragma omp critical
+    {
+      for (b=0; b<nb; b++){
+        pc->sum[b] += sum[b];
+        for (bb=b; bb<nb; bb++) pc->sxy[b][bb] += sxy[b][bb];
       }
     }
 
-    if (!NODATA[p]) nk++;
+    free((void*)sum);
+    free_2D((void**)sxy, nb);
+    free_2D((void**)blk, nb);
+
   }
 
-  for (b=0; b<nb; b++) mean[b] /= nk;
+  pc->n += n;
 
   #ifdef FORCE_DEBUG
-  printf("number of cells %d, number of valid cells %d\n", nc, nk);
+  printf("number of cells %d, number of valid cells %ld\n", nc, n);
   #endif
 
+  return SUCCESS;
+}
+
+
+/** Fit PCA
++++ This function computes the covariance matrix from the accumulated data,
++++ and finds its eigen-values and eigen-vectors. The PCs can be truncated 
++++ using a percentage of total variance.
+--- pc:     PCA accumulator
+--- minvar: amount of retained variance [0...1]
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int pca_fit(pca_t *pc, float minvar){
+int nb = pc->nb;
+int b, bb;
+double n = (double)pc->n;
+double totalvar = 0, cumvar = 0;
+gsl_matrix *covm = NULL;
+gsl_matrix *evec = NULL;
+gsl_vector *eval = NULL;
+gsl_eigen_symmv_workspace *w = NULL;
+
+
+  if (pc->n < 2){
+    printf("not enough valid cells for PCA.\n"); return FAILURE;}
+
+  if (pc->evec != NULL){
+    printf("PCA was already fitted.\n"); return FAILURE;}
 
-  // allocate GSL matrices for original and projected data
-  GINP = gsl_matrix_alloc(nk, nb);
-  GPCA = gsl_matrix_alloc(nk, nb);
 
   // allocate covariance matrix, eigen-values and eigen-vectors
-  covm = gsl_matrix_calloc(nb, nb);
+  covm = gsl_matrix_alloc(nb, nb);
   eval = gsl_vector_alloc(nb);
   evec = gsl_matrix_alloc(nb, nb);
 
+  alloc((void**)&pc->mean, nb, sizeof(double));
+  alloc((void**)&pc->eval, nb, sizeof(double));
+  alloc_2D((void***)&pc->evec, nb, nb, sizeof(double));
+
 
-  // center each band around mean
+  // mean and covariance matrix
   for (b=0; b<nb; b++){
 
-    for (p=0, k=0; p<nc; p++){
-      if (!NODATA[p]) gsl_matrix_set(GINP, k++, b, INP[b][p]-mean[b]);
+    pc->mean[b] = pc->shift[b] + pc->sum[b]/n;
+
+    for (bb=b; bb<nb; bb++){
+      gsl_matrix_set(covm, b, bb, (pc->sxy[b][bb] - pc->sum[b]*pc->sum[bb]/n) / (n-1));
+      gsl_matrix_set(covm, bb, b, gsl_matrix_get(covm, b, bb));
     }
 
     #ifdef FORCE_DEBUG
-    printf("mean band %d: %f\n", b, mean[b]);
+    printf("mean band %d: %f\n", b, pc->mean[b]);
     #endif
 
   }
-  
-  free((void*)mean);
-
-
-  // compute covariance matrix and scale
-  gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, GINP, GINP, 0, covm);
-  gsl_matrix_scale(covm, 1.0/(double)(nk - 1));
 
   #ifdef FORCE_DEBUG
-  int bb;
   printf("Covariance Matrix:\n");
   for (b=0;  b<nb;  b++){
   for (bb=0; bb<nb; bb++){
@@ -134,18 +266,27 @@ gsl_vector *eval = NULL;
 
 
   // find eigen-values and eigen-vectors
-  gsl_eigen_symmv_workspace *w = gsl_eigen_symmv_alloc(nb);
+  w = gsl_eigen_symmv_alloc(nb);
   gsl_eigen_symmv(covm, eval, evec, w);
   gsl_eigen_symmv_free(w);
   gsl_eigen_symmv_sort(eval, evec, GSL_EIGEN_SORT_VAL_DESC);
 
+  for (b=0; b<nb; b++){
+    pc->eval[b] = gsl_vector_get(eval, b);
+    for (bb=0; bb<nb; bb++) pc->evec[b][bb] = gsl_matrix_get(evec, b, bb);
+  }
+
+  gsl_vector_free(eval);
+  gsl_matrix_free(covm);
+  gsl_matrix_free(evec);
+
   #ifdef FORCE_DEBUG
   printf("Eigen values:\n");
-  for (b=0; b<nb; b++) printf("%10.4f ", gsl_vector_get(eval,b));
+  for (b=0; b<nb; b++) printf("%10.4f ", pc->eval[b]);
   printf("\n\nEigen Vector Matrix Values:\n");
   for (b=0;  b<nb;  b++){
   for (bb=0; bb<nb; bb++){
-    printf("%8.5f ", gsl_matrix_get(evec,b,bb));
+    printf("%8.5f ", pc->evec[b][bb]);
     if (bb==nb-1) printf("\n");
   }
   }
@@ -153,55 +294,126 @@ gsl_vector *eval = NULL;
 
 
   // find how many components to keep
+  pc->npc = nb;
+
   if (minvar < 1){
-    for (b=0; b<nb; b++) totalvar += gsl_vector_get(eval,b);
+    for (b=0; b<nb; b++) totalvar += pc->eval[b];
     for (b=0; b<nb; b++){
-      cumvar += gsl_vector_get(eval,b);
-      pctvar = cumvar/totalvar;
-      if (pctvar > minvar){
-        numcomp = b+1;
+      cumvar += pc->eval[b];
+      if (cumvar/totalvar > minvar){
+        pc->npc = b+1;
         break;
       }
     }
-  } else numcomp = nb;
+  }
 
   #ifdef FORCE_DEBUG
-  printf("%d components are retained\n", numcomp);
+  printf("%d components are retained\n", pc->npc);
   #endif
 
+  return SUCCESS;
+}
+
+
+/** Project data to Principal Components
++++ This function projects one chunk of data onto the fitted principal com-
++++ ponents. Pixels with nodata in any band are set to nodata.
+--- pc:     PCA accumulator (fitted)
+--- INP:    input image
+--- mask_:  mask image
+--- nc:     number of cells
+--- nodata: nodata value
++++ Return: PC rotated data 
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+float **pca_project(pca_t *pc, short **INP, small *mask_, int nc, short nodata){
+int nb = pc->nb, npc = pc->npc;
+int p, b, bb;
+bool valid;
+double *x = NULL;
+double s;
+float **PCA = NULL;
+
+
+  if (pc->evec == NULL){
+    printf("PCA was not fitted.\n"); return NULL;}
+
+  alloc_2D((void***)&PCA, npc, nc, sizeof(float));
+
+
+  #pragma omp parallel private(b,bb,valid,x,s) shared(pc,INP,mask_,PCA,nc,nb,npc,nodata) default(none)
+  {
+
+    alloc((void**)&x, nb, sizeof(double));
+
+    #pragma omp for schedule(static)
+    for (p=0; p<nc; p++){
+
+      valid = (mask_ == NULL || mask_[p]);
 
-  // allocate projected and truncated data
-  alloc_2D((void***)&PCA, numcomp, nc, sizeof(float));
+      for (b=0; b<nb && valid; b++){
+        if (INP[b][p] == nodata) valid = false;
+        x[b] = INP[b][p] - pc->mean[b];
+      }
 
-  // project original data to principal components
-  gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, GINP, evec, 0.0, GPCA);
+      if (!valid){
+        for (b=0; b<npc; b++) PCA[b][p] = nodata;
+        continue;
+      }
 
-  // restructure data
-  for (b=0; b<numcomp; b++){
-    for (p=0, k=0; p<nc; p++){
-      if (NODATA[p]){ 
-        PCA[b][p] = nodata;
-      } else {
-        PCA[b][p] = gsl_matrix_get(GPCA, k++, b);
+      for (b=0; b<npc; b++){
+        for (bb=0, s=0; bb<nb; bb++) s += x[bb]*pc->evec[bb][b];
+        PCA[b][p] = (float)s;
       }
+
     }
+
+    free((void*)x);
+
   }
 
+  return PCA;
+}
+
+
+/** Compute Principal Components
++++ This function computes Principal Components. The input data may be in-
++++ complete, a nodata value must be given. The PCs can be truncated using
++++ a percenatge of total variance. Use pca_init, pca_accumulate, pca_fit
++++ and pca_project directly to project several chunks with one basis.
+--- INP:    input image
+--- mask_:  mask image
+--- nb:     number of bands
+--- nc:     number of cells
+--- nodata: nodata value
+--- minvar: amount of retained variance [0...1]
+--- newnb:  number of PC bands (returned)
++++ Return: PC rotated data 
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+float **pca(short **INP, small *mask_, int nb, int nc, short nodata, float minvar, int *newnb){
+pca_t pc;
+float **PCA = NULL;
 
-  // clean
-  gsl_vector_free(eval);
-  gsl_matrix_free(covm);
-  gsl_matrix_free(evec);
-  gsl_matrix_free(GINP);
-  gsl_matrix_free(GPCA);
-  free((void*)NODATA);
 
   #ifdef FORCE_CLOCK
-  proctime_print("computing PCA", TIME);
+  time_t TIME; time(&TIME);
   #endif
 
+  if (pca_init(&pc, nb) != SUCCESS) return NULL;
+
+  if (pca_accumulate(&pc, INP, mask_, nc, nodata) != SUCCESS ||
+      pca_fit(&pc, minvar) != SUCCESS ||
+      (PCA = pca_project(&pc, INP, mask_, nc, nodata)) == NULL){
+    pca_free(&pc);
+    return NULL;
+  }
+
+  *newnb = pc.npc;
+  pca_free(&pc);
+
+  #ifdef FORCE_CLOCK
+  proctime_print("computing PCA", TIME);
+  #endif
 
-  *newnb = numcomp;
   return PCA;
 }
 
@@ -36,10 +36,30 @@ PCA header
 #include "../cross-level/alloc-cl.h"
 
 
+// number of pixels that are accumulated as one block
+#define PCA_BLOCK 256
+
+typedef struct {
+  int nb;         // number of bands
+  long n;         // number of accumulated pixels
+  double *shift;  // per-band shift of accumulated values
+  double *sum;    // sum of shifted values
+  double **sxy;   // cross-products of shifted values (upper triangle)
+  double *mean;   // mean (fitted)
+  double *eval;   // eigenvalues, descending (fitted)
+  double **evec;  // eigenvectors, one component per column (fitted)
+  int npc;        // number of retained components (fitted)
+} pca_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+int pca_init(pca_t *pc, int nb);
+void pca_free(pca_t *pc);
+int pca_accumulate(pca_t *pc, short **INP, small *mask_, int nc, short nodata);
+int pca_fit(pca_t *pc, float minvar);
+float **pca_project(pca_t *pc, short **INP, small *mask_, int nc, short nodata);
 float **pca(short **INP, small *mask_, int nb, int nc, short nodata, float minvar, int *newnb);
 
 #ifdef __cplusplus
@@ -0,0 +1,106 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains a pool of persistent workers
++++ The workers are native threads. To the OpenMP runtime, each worker is
++++ an initial thread: its parallel regions are outermost regions, and the
++++ runtime keeps the threads of these teams alive between the regions. 
++++ Nested regions, on the contrary, are forked and joined anew each time.
++++ Named critical sections and atomics stay process-wide with GNU OpenMP.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "pool-cl.h"
+
+#include <pthread.h>  // POSIX threads
+
+/** OpenMP **/
+#include <omp.h> // multi-platform shared memory multiprocessing
+
+
+// worker of a pool
+typedef struct {
+  pool_fun_t fun;  // function run by the worker
+  void *arg;       // argument of the function
+  int id;          // worker ID
+  int nest;        // max. active levels of the caller
+} pool_worker_t;
+
+
+void *pool_worker(void *ptr);
+
+
+/** This function is run by each worker. The worker inherits the nesting
++++ level of the caller, minus the level that the pool takes over.
+--- ptr:    worker
++++ Return: NULL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void *pool_worker(void *ptr){
+pool_worker_t *worker = (pool_worker_t*)ptr;
+
+
+  omp_set_max_active_levels((worker->nest > 1) ? worker->nest-1 : 1);
+
+  worker->fun(worker->arg, worker->id);
+
+  return NULL;
+}
+
+
+/** This function runs a function on a pool of workers, and returns when
++++ all workers are done. The workers live as long as the function, i.e.
++++ the thread teams of each worker persist, too. This replaces an outer-
++++ most parallel region with one thread per worker. The workers depend on
++++ each other, thus the program exits if a worker cannot be started.
+--- nworker: number of workers
+--- fun:     function, called with arg and the worker ID
+--- arg:     argument of the function
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void run_pool(int nworker, pool_fun_t fun, void *arg){
+pthread_t *thread = NULL;
+pool_worker_t *worker = NULL;
+int nest = omp_get_max_active_levels();
+int w;
+
+
+  alloc((void**)&thread, nworker, sizeof(pthread_t));
+  alloc((void**)&worker, nworker, sizeof(pool_worker_t));
+
+  for (w=0; w<nworker; w++){
+    worker[w].fun  = fun;
+    worker[w].arg  = arg;
+    worker[w].id   = w;
+    worker[w].nest = nest;
+    if (pthread_create(&thread[w], NULL, pool_worker, &worker[w]) != 0){
+      printf("unable to start worker %d.\n", w); exit(FAILURE);}
+  }
+
+  for (w=0; w<nworker; w++) pthread_join(thread[w], NULL);
+
+  free((void*)thread);
+  free((void*)worker);
+
+  return;
+}
+
@@ -0,0 +1,244 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for profiling processing stages, i.e. wall
+time, CPU time and memory consumption
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "profile-cl.h"
+
+
+profile_t _profile_ = { .id = "\0", .n = 0 };
+
+double profile_wall_time();
+double profile_cpu_time();
+double profile_memory();
+double profile_peak_memory();
+
+
+/** This function returns a monotonic wall clock time
++++ Return: wall time in seconds
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double profile_wall_time(){
+struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+/** This function returns the CPU time consumed by all threads of this
++++ process
++++ Return: CPU time in seconds
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double profile_cpu_time(){
+struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+/** This function returns the current resident memory of this process. 
++++ This is read from /proc; 0 is returned if not available.
++++ Return: resident memory in bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double profile_memory(){
+FILE *fp = NULL;
+long size, resident;
+
+
+  if ((fp = fopen("/proc/self/statm", "r")) == NULL) return 0;
+
+  if (fscanf(fp, "%ld %ld", &size, &resident) != 2) resident = 0;
+  fclose(fp);
+
+  return (double)resident * sysconf(_SC_PAGESIZE);
+}
+
+
+/** This function returns the peak resident memory of this process
++++ Return: peak resident memory in bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double profile_peak_memory(){
+struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+  // ru_maxrss is given in kilobytes
+  return (double)usage.ru_maxrss * 1024;
+}
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function starts a new profile, i.e. all stages are cleared, and
++++ the clock starts ticking
+--- id:     identifier of the profile, e.g. image
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void start_profile(const char *id){
+
+
+  memset(&_profile_, 0, sizeof(profile_t));
+  copy_string(_profile_.id, NPOW_10, id);
+
+  _profile_.wall_start = _profile_.wall0 = profile_wall_time();
+  _profile_.cpu_start  = _profile_.cpu0  = profile_cpu_time();
+  _profile_.mem0 = profile_memory();
+
+  return;
+}
+
+
+/** This function closes a processing stage, i.e. wall time, CPU time and
++++ memory since the last mark are assigned to this stage. If the stage
++++ was already profiled before (e.g. once per datacube), the times are
++++ accumulated. The next stage starts immediately. Nothing is recorded
++++ if no profile was started, thus stages can be marked in shared code
++++ at no cost.
+--- stage:  name of the processing stage
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void lap_profile(const char *stage){
+int s;
+double wall, cpu, mem;
+
+
+  if (_profile_.wall_start <= 0) return;
+
+  wall = profile_wall_time();
+  cpu  = profile_cpu_time();
+  mem  = profile_memory();
+
+  for (s=0; s<_profile_.n; s++){
+    if (strcmp(_profile_.stage[s], stage) == 0) break;
+  }
+
+  if (s == _profile_.n){
+    if (_profile_.n == PROFILE_MAXSTAGE){
+      printf("too many stages for profiling. "); return;}
+    copy_string(_profile_.stage[s], NPOW_06, stage);
+    _profile_.n++;
+  }
+
+  _profile_.calls[s]++;
+  _profile_.wall[s] += wall - _profile_.wall0;
+  _profile_.cpu[s]  += cpu  - _profile_.cpu0;
+  _profile_.dmem[s] += mem  - _profile_.mem0;
+  _profile_.mem[s]   = mem;
+  _profile_.peak[s]  = profile_peak_memory();
+
+  _profile_.wall0 = wall;
+  _profile_.cpu0  = cpu;
+  _profile_.mem0  = mem;
+
+  return;
+}
+
+
+/** This function prints the profile to stdout
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void print_profile(){
+int s;
+double wall, cpu;
+double mb = 1024.0*1024.0;
+
+
+  if (_profile_.n == 0) return;
+
+  printf("Profile of stages:\n");
+  printf("  %-24s %9s %9s %6s %9s %9s %9s\n", 
+    "stage", "wall[s]", "cpu[s]", "cpu/w", "mem[MB]", "+/-[MB]", "peak[MB]");
+
+  for (s=0; s<_profile_.n; s++){
+    printf("  %-24s %9.2f %9.2f %6.2f %9.1f %+9.1f %9.1f\n", 
+      _profile_.stage[s], _profile_.wall[s], _profile_.cpu[s], 
+      (_profile_.wall[s] > 0) ? _profile_.cpu[s]/_profile_.wall[s] : 0,
+      _profile_.mem[s]/mb, _profile_.dmem[s]/mb, _profile_.peak[s]/mb);
+  }
+
+  wall = _profile_.wall0 - _profile_.wall_start;
+  cpu  = _profile_.cpu0  - _profile_.cpu_start;
+
+  printf("  %-24s %9.2f %9.2f %6.2f %9s %9s %9.1f\n", 
+    "total", wall, cpu, (wall > 0) ? cpu/wall : 0, "", "", 
+    _profile_.peak[_profile_.n-1]/mb);
+
+  return;
+}
+
+
+/** This function appends the profile to a CSV file. The file is locked
++++ during writing, thus several processes can write to the same file. A 
++++ header is written if the file does not exist yet.
+--- fname:  filename
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_profile(char *fname){
+FILE *fp = NULL;
+lock_t *lock = NULL;
+bool header;
+int s;
+
+
+  if (_profile_.n == 0) return SUCCESS;
+
+  if ((lock = lock_file(fname, 60)) == NULL) return FAILURE;
+
+  header = !fileexist(fname);
+
+  if ((fp = fopen(fname, "a")) == NULL){
+    printf("Unable to open profile file %s. ", fname); 
+    unlock_file(lock);
+    return FAILURE;}
+
+  if (header) fprintf(fp, "id,stage,calls,wall,cpu,memory,memory_change,memory_peak\n");
+
+  for (s=0; s<_profile_.n; s++){
+    fprintf(fp, "%s,%s,%d,%.3f,%.3f,%.0f,%.0f,%.0f\n", 
+      _profile_.id, _profile_.stage[s], _profile_.calls[s], 
+      _profile_.wall[s], _profile_.cpu[s],
+      _profile_.mem[s], _profile_.dmem[s], _profile_.peak[s]);
+  }
+
+  fclose(fp);
+  unlock_file(lock);
+
+  return SUCCESS;
+}
+
@@ -0,0 +1,77 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Processing stage profiler header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef PROFILE_CL_H
+#define PROFILE_CL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <string.h>  // string handling functions
+#include <stdbool.h> // boolean data type
+#include <unistd.h>  // standard symbolic constants and types 
+#include <time.h>    // date and time handling functions
+#include <sys/resource.h> // resource usage of processes
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/string-cl.h"
+#include "../cross-level/dir-cl.h"
+#include "../cross-level/lock-cl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROFILE_MAXSTAGE 32 // maximum number of profiled stages
+
+typedef struct {
+  char   id[NPOW_10];                     // identifier, e.g. image
+  int    n;                               // number of stages
+  char   stage[PROFILE_MAXSTAGE][NPOW_06];// stage names
+  int    calls[PROFILE_MAXSTAGE];         // number of calls per stage
+  double wall[PROFILE_MAXSTAGE];          // wall time per stage [s]
+  double cpu[PROFILE_MAXSTAGE];           // CPU time per stage [s]
+  double mem[PROFILE_MAXSTAGE];           // resident memory after stage [bytes]
+  double dmem[PROFILE_MAXSTAGE];          // change of resident memory [bytes]
+  double peak[PROFILE_MAXSTAGE];          // peak resident memory [bytes]
+  double wall0, cpu0, mem0;               // last mark
+  double wall_start, cpu_start;           // start of profiling
+} profile_t;
+
+extern profile_t _profile_;
+
+void start_profile(const char *id);
+void lap_profile(const char *stage);
+void print_profile();
+int write_profile(char *fname);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
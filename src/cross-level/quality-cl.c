@@ -233,3 +233,46 @@ void set_vaporfill(brick_t *qai, int p, short val){
   set_qai(qai, _QAI_BIT_WVP_, p, val);
 }
 
+
+/** This function expands all QAI bit fields into one band per flag, in
++++ one pass over the QAI layer. The pixels are processed in lanes, and
++++ all flags of a lane are extracted with constant shifts and masks, 
++++ such that the compiler can vectorize the loop.
+--- qai:    Quality Assurance Information
+--- flag:   flags (_QAI_FLAG_LENGTH_ x nc, returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void inflate_qai(brick_t *qai, small **flag){
+int nc = get_brick_ncells(qai);
+int p0, p, n;
+unsigned short bits;
+const short *q = qai->vshort[0];
+
+
+  #pragma omp parallel for private(p, n, bits) shared(nc, q, flag) schedule(static) default(none)
+  for (p0=0; p0<nc; p0+=QAI_LANE){
+
+    n = (nc-p0 < QAI_LANE) ? nc-p0 : QAI_LANE;
+
+    #pragma omp simd private(bits)
+    for (p=p0; p<p0+n; p++){
+      bits = (unsigned short)q[p];
+      flag[_QAI_FLAG_OFF_][p] = (small)((bits >> _QAI_BIT_OFF_) & 1);
+      flag[_QAI_FLAG_CLD_][p] = (small)((bits >> _QAI_BIT_CLD_) & 3);
+      flag[_QAI_FLAG_SHD_][p] = (small)((bits >> _QAI_BIT_SHD_) & 1);
+      flag[_QAI_FLAG_SNW_][p] = (small)((bits >> _QAI_BIT_SNW_) & 1);
+      flag[_QAI_FLAG_WTR_][p] = (small)((bits >> _QAI_BIT_WTR_) & 1);
+      flag[_QAI_FLAG_AOD_][p] = (small)((bits >> _QAI_BIT_AOD_) & 3);
+      flag[_QAI_FLAG_SUB_][p] = (small)((bits >> _QAI_BIT_SUB_) & 1);
+      flag[_QAI_FLAG_SAT_][p] = (small)((bits >> _QAI_BIT_SAT_) & 1);
+      flag[_QAI_FLAG_SUN_][p] = (small)((bits >> _QAI_BIT_SUN_) & 1);
+      flag[_QAI_FLAG_ILL_][p] = (small)((bits >> _QAI_BIT_ILL_) & 3);
+      flag[_QAI_FLAG_SLP_][p] = (small)((bits >> _QAI_BIT_SLP_) & 1);
+      flag[_QAI_FLAG_WVP_][p] = (small)((bits >> _QAI_BIT_WVP_) & 1);
+    }
+
+  }
+
+  return;
+}
+
@@ -29,6 +29,10 @@ Quality assurance header
 #include "../cross-level/brick-cl.h"
 
 
+// number of pixels that are expanded together
+#define QAI_LANE 4096
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -59,6 +63,7 @@ void set_lowsun(brick_t *qai, int p, short val);
 void set_illumination(brick_t *qai, int p, short val);
 void set_slope(brick_t *qai, int p, short val);
 void set_vaporfill(brick_t *qai, int p, short val);
+void inflate_qai(brick_t *qai, small **flag);
 
 #ifdef __cplusplus
 }
@@ -28,20 +28,26 @@ This file contains an implementation of a First-In-First-Out queue
 #include "queue-cl.h"
 
 
-/** This function creates a FIFO queue using a circular buffer. Free with 
-+++ destroy_queue.
+int grow_queue(queue_t *q);
+
+
+/** This function creates a FIFO queue using a circular buffer. The buf-
++++ fer grows when it is full, thus size is only the initial size. Free 
++++ with destroy_queue.
 --- q:      queue
---- size:   size of the buffer
+--- size:   initial size of the buffer
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int create_queue(queue_t *q, int size){
 
+  if (size < 2) size = 2;
+
   q->head = 0;
   q->tail = 0;
   q->size = size;
 
-  alloc((void**)&q->buf_x, size, sizeof(short));
-  alloc((void**)&q->buf_y, size, sizeof(short));
+  alloc((void**)&q->buf_x, size, sizeof(int));
+  alloc((void**)&q->buf_y, size, sizeof(int));
 
   return SUCCESS;
 }
@@ -74,14 +80,15 @@ int enqueue(queue_t *q, int x, int y){
 
   if ((q->head+1 == q->tail) ||
       (q->head+1 == q->size && q->tail == 0)){
-    return FAILURE; // head runs into tail (buffer is full)...
-  } else {
-    q->buf_x[q->head] = (short)x;
-    q->buf_y[q->head] = (short)y;
-    q->head++; // step forward head
-    if(q->head == q->size) q->head = 0; // circular buffer
+    // head runs into tail (buffer is full)...
+    if (grow_queue(q) == FAILURE) return FAILURE;
   }
 
+  q->buf_x[q->head] = x;
+  q->buf_y[q->head] = y;
+  q->head++; // step forward head
+  if(q->head == q->size) q->head = 0; // circular buffer
+
   return SUCCESS;
 }
 
@@ -96,8 +103,8 @@ int dequeue(queue_t *q, int *x, int *y){
 
 
   if (q->tail != q->head){ //see if any data is available
-    *x = (int)q->buf_x[q->tail];
-    *y = (int)q->buf_y[q->tail];
+    *x = q->buf_x[q->tail];
+    *y = q->buf_y[q->tail];
     q->tail++;  // step forward  tail
     if (q->tail == q->size) q->tail = 0; // circular buffer
   } else {
@@ -107,3 +114,148 @@ int dequeue(queue_t *q, int *x, int *y){
   return SUCCESS;
 }
 
+
+/** This function doubles the size of a full FIFO queue. If the queue 
++++ wraps around the end of the circular buffer, the wrapped part (tail 
++++ to end of buffer) is moved to the end of the enlarged buffer.
+--- q:      queue
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int grow_queue(queue_t *q){
+int size, shift;
+
+
+  if (q->size > INT_MAX/2) return FAILURE;
+
+  size  = q->size*2;
+  shift = size-q->size;
+
+  re_alloc((void**)&q->buf_x, q->size, size, sizeof(int));
+  re_alloc((void**)&q->buf_y, q->size, size, sizeof(int));
+
+  if (q->tail > q->head){
+    memmove(q->buf_x+q->tail+shift, q->buf_x+q->tail, (q->size-q->tail)*sizeof(int));
+    memmove(q->buf_y+q->tail+shift, q->buf_y+q->tail, (q->size-q->tail)*sizeof(int));
+    q->tail += shift;
+  }
+
+  q->size = size;
+
+  return SUCCESS;
+}
+
+
+/** This function creates a frontier, i.e. a concurrent work list of 
++++ image coordinates for level-synchronous, parallel flood-fill algo-
++++ rithms. A frontier is either used as a shared list, which is read by
++++ all threads, or as a thread-local segment, to which a thread pushes 
++++ new coordinates. The segments of all threads are gathered into a 
++++ shared frontier with gather_frontier. The buffer grows on demand. 
++++ Free with destroy_frontier.
+--- f:      frontier
+--- size:   initial size of the buffer
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int create_frontier(frontier_t *f, int size){
+
+  if (size < 1) size = 1;
+
+  f->n    = 0;
+  f->size = size;
+
+  alloc((void**)&f->buf_x, size, sizeof(int));
+  alloc((void**)&f->buf_y, size, sizeof(int));
+
+  return SUCCESS;
+}
+
+
+/** This function frees a frontier
+--- f:      frontier
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void destroy_frontier(frontier_t *f){
+
+  f->n    = 0;
+  f->size = 0;
+  
+  free((void*)f->buf_x); f->buf_x = NULL;
+  free((void*)f->buf_y); f->buf_y = NULL;
+
+  return;
+}
+
+
+/** This function appends an image coordinate to a frontier. This is not
++++ thread-safe, i.e. use it on a thread-local segment, or outside of a 
++++ parallel region.
+--- f:      frontier
+--- x:      column
+--- y:      row
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int push_frontier(frontier_t *f, int x, int y){
+
+
+  if (f->n == f->size){
+    if (f->size > INT_MAX/2) return FAILURE;
+    re_alloc((void**)&f->buf_x, f->size, f->size*2, sizeof(int));
+    re_alloc((void**)&f->buf_y, f->size, f->size*2, sizeof(int));
+    f->size *= 2;
+  }
+
+  f->buf_x[f->n] = x;
+  f->buf_y[f->n] = y;
+  f->n++;
+
+  return SUCCESS;
+}
+
+
+/** This function gathers the thread-local segments of all threads into 
++++ a shared frontier, which is overwritten. Each thread reserves its 
++++ range with an atomic capture, and copies its segment without any 
++++ lock. This function must be called by all threads of the team (it 
++++ contains barriers). The segments are emptied.
+--- dst:    shared frontier
+--- seg:    thread-local segment
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void gather_frontier(frontier_t *dst, frontier_t *seg){
+int offset, size;
+
+
+  #pragma omp barrier
+
+  #pragma omp single
+  {
+    dst->n = 0;
+  }
+
+  #pragma omp atomic capture
+  { offset = dst->n; dst->n += seg->n; }
+
+  #pragma omp barrier
+
+  #pragma omp single
+  {
+    if (dst->n > dst->size){
+      size = dst->size;
+      while (size < dst->n) size = (size > INT_MAX/2) ? INT_MAX : size*2;
+      re_alloc((void**)&dst->buf_x, dst->size, size, sizeof(int));
+      re_alloc((void**)&dst->buf_y, dst->size, size, sizeof(int));
+      dst->size = size;
+    }
+  }
+
+  if (seg->n > 0){
+    memcpy(dst->buf_x+offset, seg->buf_x, seg->n*sizeof(int));
+    memcpy(dst->buf_y+offset, seg->buf_y, seg->n*sizeof(int));
+  }
+  seg->n = 0;
+
+  #pragma omp barrier
+
+  return;
+}
+
@@ -30,6 +30,8 @@ First-In-First-Out header
 
 #include <stdio.h>   // core input and output functions
 #include <stdlib.h>  // standard general utilities library
+#include <string.h>  // string handling functions
+#include <limits.h>  // macro constants of the integer types
 
 #include "../cross-level/const-cl.h"
 #include "../cross-level/alloc-cl.h"
@@ -40,17 +42,28 @@ extern "C" {
 #endif
 
 typedef struct {
-  short *buf_x;
-  short *buf_y;
+  int *buf_x;
+  int *buf_y;
   int head;
   int tail;
   int size;
 } queue_t;
 
+typedef struct {
+  int *buf_x;
+  int *buf_y;
+  int n;
+  int size;
+} frontier_t;
+
 int create_queue(queue_t *q, int size);
 void destroy_queue(queue_t* q);
 int enqueue(queue_t *q, int x, int y);
 int dequeue(queue_t *q, int *x, int *y);
+int create_frontier(frontier_t *f, int size);
+void destroy_frontier(frontier_t *f);
+int push_frontier(frontier_t *f, int x, int y);
+void gather_frontier(frontier_t *dst, frontier_t *seg);
 
 #ifdef __cplusplus
 }
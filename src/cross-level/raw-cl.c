@@ -0,0 +1,632 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for reading uncompressed images with a known
+layout (ENVI band-sequential, and GeoTiff with uncompressed strips) with-
+out GDAL, i.e. straight from the file into the destination buffer
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "raw-cl.h"
+
+#include <unistd.h>    // standard symbolic constants and types 
+#include <fcntl.h>     // file control options
+#include <errno.h>     // error numbers
+#include <strings.h>   // case-insensitive string comparison
+#include <sys/stat.h>  // data returned by the stat() function
+
+
+// TIFF file, as needed for parsing the first directory
+typedef struct {
+  int fd;                   // file descriptor
+  bool swap;                // not in native byte order
+  bool big;                 // BigTIFF
+} tiff_t;
+
+bool native_little();
+void swap_bytes(void *ptr, int size);
+uint64_t get_uint(const unsigned char *ptr, int size, bool swap);
+double get_double(const unsigned char *ptr, bool swap);
+int read_whole(int fd, void *buf, size_t n, off_t offset);
+int envi_value(const char *hdr, const char *key, char value[], int size);
+int open_envi(raw_image_t *raw, const char *fname);
+int tiff_type_size(int type);
+unsigned char *tiff_data(tiff_t *tif, const unsigned char *entry, int *type, uint64_t *count);
+int open_tiff(raw_image_t *raw, const unsigned char head[16]);
+
+
+/** This function tests whether the machine is little endian
++++ Return: true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool native_little(){
+uint16_t one = 1;
+
+  return *((unsigned char*)&one) == 1;
+}
+
+
+/** This function reverses the byte order of one value
+--- ptr:    value (modified)
+--- size:   number of bytes
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void swap_bytes(void *ptr, int size){
+unsigned char *b = (unsigned char*)ptr, tmp;
+int i;
+
+  for (i=0; i<size/2; i++){
+    tmp = b[i]; b[i] = b[size-1-i]; b[size-1-i] = tmp;
+  }
+
+  return;
+}
+
+
+/** This function decodes an unsigned integer of a file
+--- ptr:    encoded value
+--- size:   number of bytes (1, 2, 4 or 8)
+--- swap:   not in native byte order?
++++ Return: value
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+uint64_t get_uint(const unsigned char *ptr, int size, bool swap){
+unsigned char tmp[8];
+uint16_t u16;
+uint32_t u32;
+uint64_t u64;
+
+
+  memcpy(tmp, ptr, size);
+  if (swap) swap_bytes(tmp, size);
+
+  switch (size){
+    case 1:  return tmp[0];
+    case 2:  memcpy(&u16, tmp, 2); return u16;
+    case 4:  memcpy(&u32, tmp, 4); return u32;
+    default: memcpy(&u64, tmp, 8); return u64;
+  }
+
+}
+
+
+/** This function decodes a double of a file
+--- ptr:    encoded value
+--- swap:   not in native byte order?
++++ Return: value
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double get_double(const unsigned char *ptr, bool swap){
+unsigned char tmp[8];
+double d;
+
+
+  memcpy(tmp, ptr, 8);
+  if (swap) swap_bytes(tmp, 8);
+  memcpy(&d, tmp, 8);
+
+  return d;
+}
+
+
+/** This function reads a buffer from a file, and retries until all 
++++ bytes are read
+--- fd:     file descriptor
+--- buf:    buffer (returned)
+--- n:      number of bytes
+--- offset: byte offset in file
++++ Return: SUCCESS/FAILURE (also if the file ends before)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int read_whole(int fd, void *buf, size_t n, off_t offset){
+char *ptr = (char*)buf;
+ssize_t nr;
+
+
+  while (n > 0){
+
+    if ((nr = pread(fd, ptr, n, offset)) < 0){
+      if (errno == EINTR) continue;
+      return FAILURE;
+    }
+
+    if (nr == 0) return FAILURE;
+
+    ptr += nr; offset += nr; n -= nr;
+
+  }
+
+  return SUCCESS;
+}
+
+
+/** This function gets the value of a key in an ENVI header. Values in 
++++ braces are returned with the braces.
+--- hdr:    ENVI header
+--- key:    key, e.g. samples
+--- value:  value (returned)
+--- size:   length of value buffer
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int envi_value(const char *hdr, const char *key, char value[], int size){
+const char *line = hdr, *ptr = NULL, *end = NULL;
+size_t len = strlen(key);
+int n;
+
+
+  while (line != NULL && *line != '\0'){
+
+    ptr = line;
+    while (*ptr == ' ' || *ptr == '\t') ptr++;
+
+    if (strncasecmp(ptr, key, len) == 0){
+
+      ptr += len;
+      while (*ptr == ' ' || *ptr == '\t') ptr++;
+
+      if (*ptr == '='){
+
+        ptr++;
+        while (*ptr == ' ' || *ptr == '\t') ptr++;
+
+        if (*ptr == '{'){
+          if ((end = strchr(ptr, '}')) != NULL) end++;
+        } else {
+          end = strpbrk(ptr, "\r\n");
+        }
+        if (end == NULL) end = ptr + strlen(ptr);
+
+        if ((n = (int)(end-ptr)) >= size) return FAILURE;
+        memcpy(value, ptr, n); value[n] = '\0';
+        return SUCCESS;
+
+      }
+
+    }
+
+    if ((line = strchr(line, '\n')) != NULL) line++;
+
+  }
+
+  return FAILURE;
+}
+
+
+/** This function parses the header of an ENVI image. Only band-sequen-
++++ tial images of bytes or 16bit integers, which are georeferenced by 
++++ an unrotated map info, are supported.
+--- raw:    raw image (modified)
+--- fname:  filename of image
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int open_envi(raw_image_t *raw, const char *fname){
+char hname[NPOW_10], value[NPOW_10];
+char *hdr = NULL, *dot = NULL, *tok = NULL, *save = NULL;
+double map[6];
+int64_t offset = 0;
+int fd = -1, nchar, type = 0, order = 0, k, b;
+ssize_t nr;
+struct stat st;
+
+
+  // the header replaces the extension, or is appended to the filename
+  copy_string(hname, NPOW_10, fname);
+  if ((dot = strrchr(hname, '.')) != NULL && strchr(dot, '/') == NULL){
+    *dot = '\0';
+    nchar = snprintf(value, NPOW_10, "%s.hdr", hname);
+    if (nchar >= 0 && nchar < NPOW_10) fd = open(value, O_RDONLY);
+  }
+  if (fd < 0){
+    nchar = snprintf(value, NPOW_10, "%s.hdr", fname);
+    if (nchar >= 0 && nchar < NPOW_10) fd = open(value, O_RDONLY);
+  }
+  if (fd < 0) return FAILURE;
+
+  alloc((void**)&hdr, NPOW_16, sizeof(char));
+  nr = read(fd, hdr, NPOW_16-1);
+  close(fd);
+
+  if (nr < 4 || strncmp(hdr, "ENVI", 4) != 0){
+    free((void*)hdr); return FAILURE;}
+
+
+  if (envi_value(hdr, "samples",       value, NPOW_10) == SUCCESS) raw->nx = atoi(value);
+  if (envi_value(hdr, "lines",         value, NPOW_10) == SUCCESS) raw->ny = atoi(value);
+  if (envi_value(hdr, "bands",         value, NPOW_10) == SUCCESS) raw->nb = atoi(value);
+  if (envi_value(hdr, "data type",     value, NPOW_10) == SUCCESS) type    = atoi(value);
+
+  if (envi_value(hdr, "header offset", value, NPOW_10) == SUCCESS) offset  = atoll(value);
+  if (envi_value(hdr, "byte order",    value, NPOW_10) == SUCCESS) order   = atoi(value);
+
+  if (raw->nb > 1 && (envi_value(hdr, "interleave", value, NPOW_10) != SUCCESS ||
+      strncasecmp(value, "bsq", 3) != 0)){
+    free((void*)hdr); return FAILURE;}
+
+  // {projection, reference pixel x, y, easting, northing, pixel size x, y, ...}
+  if (envi_value(hdr, "map info", value, NPOW_10) != SUCCESS ||
+      strstr(value, "rotation") != NULL){
+    free((void*)hdr); return FAILURE;}
+
+  free((void*)hdr);
+
+  tok = strtok_r(value+1, ",", &save);
+  for (k=0; k<6; k++){
+    if ((tok = strtok_r(NULL, ",", &save)) == NULL) return FAILURE;
+    map[k] = atof(tok);
+  }
+
+
+  switch (type){
+    case 1:  raw->byte = 1; break;
+    case 2:  raw->byte = 2; break;
+    default: return FAILURE;
+  }
+
+  raw->swap = (order == 1) == native_little();
+
+  raw->geotran[0] = map[2] - (map[0]-1)*map[4];
+  raw->geotran[1] = map[4];
+  raw->geotran[2] = 0;
+  raw->geotran[3] = map[3] + (map[1]-1)*map[5];
+  raw->geotran[4] = 0;
+  raw->geotran[5] = -map[5];
+
+  if (raw->nx < 1 || raw->ny < 1 || raw->nb < 1 || offset < 0) return FAILURE;
+
+  if (fstat(raw->fd, &st) != 0 || 
+      st.st_size < offset + (int64_t)raw->nb*raw->ny*raw->nx*raw->byte) return FAILURE;
+
+  // one strip per band
+  raw->rps    = raw->ny;
+  raw->nstrip = 1;
+  alloc((void**)&raw->strip, raw->nb, sizeof(int64_t));
+  for (b=0; b<raw->nb; b++) raw->strip[b] = offset + (int64_t)b*raw->ny*raw->nx*raw->byte;
+
+  return SUCCESS;
+}
+
+
+/** This function returns the size of a TIFF field type
+--- type:   field type
++++ Return: number of bytes, 0 if not supported
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int tiff_type_size(int type){
+
+  switch (type){
+    case 1:  return 1; // BYTE
+    case 3:  return 2; // SHORT
+    case 4:  return 4; // LONG
+    case 12: return 8; // DOUBLE
+    case 16: return 8; // LONG8
+    default: return 0;
+  }
+
+}
+
+
+/** This function gets the values of a TIFF directory entry, which are 
++++ either stored in the entry, or somewhere else in the file.
+--- tif:    TIFF file
+--- entry:  directory entry
+--- type:   field type (returned)
+--- count:  number of values (returned)
++++ Return: values (must be freed), NULL if not supported
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+unsigned char *tiff_data(tiff_t *tif, const unsigned char *entry, int *type, uint64_t *count){
+unsigned char *data = NULL;
+int size, inline_size = tif->big ? 8 : 4;
+const unsigned char *value = entry + (tif->big ? 12 : 8);
+uint64_t bytes;
+
+
+  *type  = (int)get_uint(entry+2, 2, tif->swap);
+  *count = tif->big ? get_uint(entry+4, 8, tif->swap) : get_uint(entry+4, 4, tif->swap);
+
+  if ((size = tiff_type_size(*type)) == 0 || *count < 1) return NULL;
+
+  bytes = *count*size;
+
+  alloc((void**)&data, bytes, sizeof(unsigned char));
+
+  if (bytes <= (uint64_t)inline_size){
+    memcpy(data, value, bytes);
+  } else if (read_whole(tif->fd, data, bytes, 
+    (off_t)get_uint(value, inline_size, tif->swap)) == FAILURE){
+    free((void*)data); return NULL;
+  }
+
+  return data;
+}
+
+
+/** This function parses the first directory of a TIFF file. Only strip-
++++ ped, uncompressed GeoTiffs of bytes or 16bit integers, which are geo-
++++ referenced by tiepoint and pixel scale (area), are supported. Multi-
++++ band images need to be stored band by band (INTERLEAVE=BAND).
+--- raw:    raw image (modified)
+--- head:   first bytes of the file
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int open_tiff(raw_image_t *raw, const unsigned char head[16]){
+tiff_t tif;
+unsigned char num[8], *ifd = NULL, *entry = NULL, *data = NULL;
+int esize, type, size, version;
+uint64_t i, k, n, off, count;
+uint64_t bits = 0, compression = 1, spp = 1, rps = 0, planar = 1, format = 1;
+uint64_t nstrip = 0;
+double scale[3], tie[6];
+bool has_scale = false, has_tie = false, error = false;
+
+
+  tif.fd   = raw->fd;
+  tif.swap = (head[0] == 'I') != native_little();
+
+  version = (int)get_uint(head+2, 2, tif.swap);
+
+  if (version == 42){
+    tif.big = false;
+    off = get_uint(head+4, 4, tif.swap);
+  } else if (version == 43){
+    tif.big = true;
+    off = get_uint(head+8, 8, tif.swap);
+  } else return FAILURE;
+
+  if (read_whole(tif.fd, num, tif.big ? 8 : 2, (off_t)off) == FAILURE) return FAILURE;
+  n     = get_uint(num, tif.big ? 8 : 2, tif.swap);
+  esize = tif.big ? 20 : 12;
+
+  if (n < 1 || n > NPOW_10) return FAILURE;
+
+  alloc((void**)&ifd, n*esize, sizeof(unsigned char));
+  if (read_whole(tif.fd, ifd, n*esize, (off_t)(off + (tif.big ? 8 : 2))) == FAILURE){
+    free((void*)ifd); return FAILURE;}
+
+
+  for (i=0; i<n && !error; i++){
+
+    entry = ifd + i*esize;
+
+    switch (get_uint(entry, 2, tif.swap)){
+      case 256:   // ImageWidth
+      case 257:   // ImageLength
+      case 258:   // BitsPerSample
+      case 259:   // Compression
+      case 273:   // StripOffsets
+      case 277:   // SamplesPerPixel
+      case 278:   // RowsPerStrip
+      case 284:   // PlanarConfiguration
+      case 339:   // SampleFormat
+      case 33550: // ModelPixelScale
+      case 33922: // ModelTiepoint
+      case 34735: // GeoKeyDirectory
+        break;
+      case 322:   // TileWidth
+      case 34264: // ModelTransformation
+        error = true;
+        continue;
+      default:
+        continue;
+    }
+
+    if ((data = tiff_data(&tif, entry, &type, &count)) == NULL){
+      error = true; continue;}
+
+    size = tiff_type_size(type);
+
+    switch (get_uint(entry, 2, tif.swap)){
+      case 256: raw->nx     = (int)get_uint(data, size, tif.swap); break;
+      case 257: raw->ny     = (int)get_uint(data, size, tif.swap); break;
+      case 258: bits        = get_uint(data, size, tif.swap); break;
+      case 259: compression = get_uint(data, size, tif.swap); break;
+      case 277: spp         = get_uint(data, size, tif.swap); break;
+      case 278: rps         = get_uint(data, size, tif.swap); break;
+      case 284: planar      = get_uint(data, size, tif.swap); break;
+      case 339: format      = get_uint(data, size, tif.swap); break;
+      case 273:
+        nstrip = count;
+        alloc((void**)&raw->strip, count, sizeof(int64_t));
+        for (k=0; k<count; k++) raw->strip[k] = (int64_t)get_uint(data+k*size, size, tif.swap);
+        break;
+      case 33550:
+        if (type != 12 || count < 3){ error = true; break;}
+        for (k=0; k<3; k++) scale[k] = get_double(data+k*8, tif.swap);
+        has_scale = true;
+        break;
+      case 33922:
+        if (type != 12 || count < 6){ error = true; break;}
+        for (k=0; k<6; k++) tie[k] = get_double(data+k*8, tif.swap);
+        has_tie = true;
+        break;
+      case 34735:
+        // GTRasterTypeGeoKey, GDAL shifts by half a pixel for PixelIsPoint
+        for (k=4; k+3<count; k+=4){
+          if (get_uint(data+(k+0)*size, size, tif.swap) == 1025 && 
+              get_uint(data+(k+1)*size, size, tif.swap) == 0    && 
+              get_uint(data+(k+3)*size, size, tif.swap) == 2) error = true;
+        }
+        break;
+    }
+
+    free((void*)data);
+
+  }
+
+  free((void*)ifd);
+
+
+  if (error || !has_scale || !has_tie || compression != 1) return FAILURE;
+
+  if (raw->nx < 1 || raw->ny < 1 || spp < 1) return FAILURE;
+
+  if (bits == 8 && format == 1){
+    raw->byte = 1;
+  } else if (bits == 16 && format == 2){
+    raw->byte = 2;
+  } else return FAILURE;
+
+  if (spp > 1 && planar != 2) return FAILURE;
+
+  raw->nb   = (int)spp;
+  raw->swap = tif.swap;
+
+  if (rps < 1 || rps > (uint64_t)raw->ny) rps = raw->ny;
+  raw->rps    = (int)rps;
+  raw->nstrip = (raw->ny + raw->rps - 1) / raw->rps;
+
+  if (nstrip != (uint64_t)raw->nstrip*raw->nb) return FAILURE;
+
+  raw->geotran[0] = tie[3] - tie[0]*scale[0];
+  raw->geotran[1] = scale[0];
+  raw->geotran[2] = 0;
+  raw->geotran[3] = tie[4] + tie[1]*scale[1];
+  raw->geotran[4] = 0;
+  raw->geotran[5] = -scale[1];
+
+  return SUCCESS;
+}
+
+
+/** This function opens an uncompressed image with a known layout. If the
++++ image is not supported, NULL is returned without complaint, and the
++++ image should be read with GDAL.
+--- fname:  filename
++++ Return: raw image (or NULL)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+raw_image_t *open_raw_image(const char *fname){
+raw_image_t *raw = NULL;
+unsigned char head[16];
+int status;
+
+
+  alloc((void**)&raw, 1, sizeof(raw_image_t));
+
+  if ((raw->fd = open(fname, O_RDONLY)) < 0){
+    free((void*)raw); return NULL;}
+
+  if (read_whole(raw->fd, head, 16, 0) == FAILURE){
+    close_raw_image(raw); return NULL;}
+
+  if ((head[0] == 'I' && head[1] == 'I' && (head[2] == 42 || head[2] == 43) && head[3] == 0) ||
+      (head[0] == 'M' && head[1] == 'M' && head[2] == 0 && (head[3] == 42 || head[3] == 43))){
+    status = open_tiff(raw, head);
+  } else {
+    status = open_envi(raw, fname);
+  }
+
+  if (status != SUCCESS){
+    close_raw_image(raw); return NULL;}
+
+  return raw;
+}
+
+
+/** This function closes a raw image
+--- raw:    raw image
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void close_raw_image(raw_image_t *raw){
+
+  if (raw == NULL) return;
+
+  if (raw->fd >= 0) close(raw->fd);
+  if (raw->strip != NULL) free((void*)raw->strip);
+  free((void*)raw);
+
+  return;
+}
+
+
+/** This function copies a window of several bands from a raw image into
++++ a band-sequential short buffer. The byte ranges of all bands are an-
++++ nounced to the kernel first, such that they are read ahead concur-
++++ rently, then they are read straight into the buffer, i.e. without 
++++ going through a block cache. Full-width windows are read strip by 
++++ strip, otherwise line by line. No resampling is done, the window 
++++ needs to be given at the resolution of the image.
+--- raw:      raw image
+--- band_map: bands to read (starting at 1)
+--- nread:    number of bands to read
+--- xoff:     column offset
+--- yoff:     row offset
+--- nx:       number of columns
+--- ny:       number of rows
+--- space:    number of values from one band to the next (>= nx*ny)
+--- buf:      buffer (nread*space, returned)
++++ Return:   SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int read_raw_image(raw_image_t *raw, int *band_map, int nread, int xoff, int yoff, int nx, int ny, size_t space, short *buf){
+bool full = (xoff == 0 && nx == raw->nx);
+int64_t lbytes = (int64_t)raw->nx*raw->byte;
+int64_t offset;
+size_t i, n, bytes;
+short *dst = NULL;
+unsigned char *src = NULL;
+int pass, k, b, y, run;
+
+
+  if (xoff < 0 || yoff < 0 || xoff+nx > raw->nx || yoff+ny > raw->ny){
+    printf("requested window exceeds image. "); return FAILURE;}
+
+  for (k=0; k<nread; k++){
+    if (band_map[k] < 1 || band_map[k] > raw->nb){
+      printf("requested band %d does not exist in image. ", band_map[k]); return FAILURE;}
+  }
+
+  for (pass=0; pass<2; pass++){
+
+    for (k=0; k<nread; k++){
+
+      b = band_map[k]-1;
+
+      for (y=0; y<ny; y+=run){
+
+        run = full ? raw->rps - (yoff+y) % raw->rps : 1;
+        if (run > ny-y) run = ny-y;
+
+        offset = raw->strip[(size_t)b*raw->nstrip + (yoff+y) / raw->rps] + 
+                 ((yoff+y) % raw->rps)*lbytes + (int64_t)xoff*raw->byte;
+        n      = (size_t)run*nx;
+        bytes  = n*raw->byte;
+
+        if (pass == 0){
+          posix_fadvise(raw->fd, (off_t)offset, (off_t)bytes, POSIX_FADV_WILLNEED);
+          continue;
+        }
+
+        dst = buf + (size_t)k*space + (size_t)y*nx;
+
+        if (raw->byte == 1){
+          // bytes are read into the upper half, and widened in place
+          src = (unsigned char*)dst + n;
+          if (read_whole(raw->fd, src, bytes, (off_t)offset) == FAILURE) return FAILURE;
+          for (i=0; i<n; i++) dst[i] = src[i];
+        } else {
+          if (read_whole(raw->fd, dst, bytes, (off_t)offset) == FAILURE) return FAILURE;
+          if (raw->swap) for (i=0; i<n; i++) swap_bytes(&dst[i], 2);
+        }
+
+      }
+
+    }
+
+  }
+
+  return SUCCESS;
+}
+
@@ -0,0 +1,71 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Raw image reader header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef RAW_CL_H
+#define RAW_CL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <stdint.h>  // fixed-width integer types
+#include <stdbool.h> // boolean data type
+#include <string.h>  // string handling functions
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/alloc-cl.h"
+#include "../cross-level/string-cl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// uncompressed image with a known layout, i.e. ENVI band-sequential, or
+// GeoTiff with strips that are not compressed. The data of one band are
+// stored in strips of rps full-width lines; ENVI has one strip per band
+typedef struct {
+  int fd;                   // file descriptor
+  int nx;                   // number of columns
+  int ny;                   // number of rows
+  int nb;                   // number of bands
+  int byte;                 // number of bytes per value (1: byte, 2: int16)
+  bool swap;                // values are not in native byte order
+  int rps;                  // number of rows per strip
+  int nstrip;               // number of strips per band
+  int64_t *strip;           // byte offsets of strips, band by band
+  double geotran[6];        // geotransformation
+} raw_image_t;
+
+raw_image_t *open_raw_image(const char *fname);
+void close_raw_image(raw_image_t *raw);
+int read_raw_image(raw_image_t *raw, int *band_map, int nread, int xoff, int yoff, int nx, int ny, size_t space, short *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -28,8 +28,9 @@ This file contains functions for reading all-purpose files
 #include "read-cl.h"
 
 
-/** This function reads a table.
---- fname:  text file
+/** This function reads a table. Binary tables, see table-cl.c, are de-
++++ tected by their magic number.
+--- fname:  text file or binary table
 --- nrows: number of rows (returned)
 --- ncols: number of cols (returned)
 +++ Return: table
@@ -47,6 +48,8 @@ int ni_buf = NPOW_00;
 int nj_buf = NPOW_00;
 
 
+  if (is_binary_table(fname)) return read_binary_table(fname, nrows, ncols);
+
   alloc_2D((void***)&tab, ni_buf, nj_buf, sizeof(double));
 
   // open file
@@ -35,6 +35,7 @@ Reading all-purpose files
 #include "../cross-level/const-cl.h"
 #include "../cross-level/alloc-cl.h"
 #include "../cross-level/string-cl.h"
+#include "../cross-level/table-cl.h"
 
 
 #ifdef __cplusplus
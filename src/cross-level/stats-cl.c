@@ -33,9 +33,33 @@ This file contains functions for statistics
 
 #include "stats-cl.h"
 
+#define TSCORE_TABLES  16 // max. number of t-score tables, i.e. (p, tail) pairs
+#define TSCORE_DF     512 // max. degrees of freedom in t-score tables
+
+
+typedef struct {
+  int value;
+  int count;
+} histbin_t;
+
+typedef struct {
+  float p;                    // probability (significance level)
+  int tail;                   // tail type
+  bool known[TSCORE_DF+1];    // was the t-score computed?
+  bool ok[TSCORE_DF+1];       // could the t-score be computed?
+  float tcrit[TSCORE_DF+1];   // critical t-score for each df
+} tscore_table_t;
+
+// critical t-scores, shared by all threads for the whole run
+tscore_table_t tscore_table[TSCORE_TABLES];
+int tscore_ntable = 0;
 
 void quantile_swap(float *x, int from, int to);
+void quantile_select(float *x, int left, int right, int n, const float *p, int lo, int hi, int depth, float *q);
+int histogram_bins(int *x, int n, histbin_t **bins);
 int comp(const void *a, const void *b);
+int comp_float(const void *a, const void *b);
+int comp_bin(const void *a, const void *b);
 
 
 /** One-pass variance and covariance estimation
@@ -408,12 +432,31 @@ void linreg_predict(double x, double slope, double intercept, double *y){
 +++ Return:   SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int slope_significant(float p, int tailtype, int n, float b, float b0, float seb){
-float t, tcrit;
+float tcrit;
 int df;
 
   df = n-2;
-  if (tscore(p, df, tailtype, &tcrit) == FAILURE){
+  if (tscore_cached(p, df, tailtype, &tcrit) == FAILURE){
     return 0;}
+
+  return slope_significance(tcrit, tailtype, b, b0, seb);
+}
+
+
+/** Significance of slope with known critical t-score
++++ This function tests if a slope is significantly different from b0,
++++ given the critical t-score. Use it when many slopes are tested with
++++ the same degrees of freedom, and the t-score is computed only once.
+--- tcrit:    critical t-score
+--- tailtype: left (-1), twotail (0), right (1)
+--- b:        slope
+--- b0:       slope to test against
+--- seb:      standard error of slope
++++ Return:   -1: significantly smaller, 1: significantly larger, 0: not
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int slope_significance(float tcrit, int tailtype, float b, float b0, float seb){
+float t;
+
   t = (b-b0)/seb;
 
   if (tailtype == _TAIL_LEFT_  && t <=  tcrit) return -1;
@@ -462,6 +505,64 @@ bool negative;
 }
 
 
+/** Tabulated critical t-score
++++ This function returns a critical t-score from a table, which is shared
++++ by all threads for the whole run. The degrees of freedom are small
++++ integers, and the significance level and tail type are fixed by the
++++ parameter file, thus each t-score is only computed once (see tscore).
++++ Large degrees of freedom, or too many tables, fall back to tscore.
+--- p:        probability (significance level)
+--- df:       degrees of freedom
+--- tailtype: left (-1), twotail (0), right (1)
+--- tcrit:    critical t-score
++++ Return:   SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int tscore_cached(float p, int df, int tailtype, float *tcrit){
+tscore_table_t *table = NULL;
+int i, status = FAILURE;
+
+
+  if (df < 1 || df > TSCORE_DF) return tscore(p, df, tailtype, tcrit);
+
+  #pragma omp critical (tscore_table)
+  {
+
+    for (i=0; i<tscore_ntable; i++){
+      if (tscore_table[i].p == p && tscore_table[i].tail == tailtype){
+        table = &tscore_table[i];
+        break;
+      }
+    }
+
+    if (table == NULL && tscore_ntable < TSCORE_TABLES){
+      table = &tscore_table[tscore_ntable++];
+      memset(table, 0, sizeof(tscore_table_t));
+      table->p    = p;
+      table->tail = tailtype;
+    }
+
+    if (table != NULL){
+
+      if (!table->known[df]){
+        table->ok[df] = tscore(p, df, tailtype, &table->tcrit[df]) == SUCCESS;
+        table->known[df] = true;
+      }
+
+      if (table->ok[df]){
+        *tcrit = table->tcrit[df];
+        status = SUCCESS;
+      }
+
+    }
+
+  }
+
+  if (table == NULL) return tscore(p, df, tailtype, tcrit);
+
+  return status;
+}
+
+
 /** Convert any tailtype to 'left'
 +++ This function converts any tailtype's p to 'left' tailtype
 --- p:        probability (significance level)
@@ -656,58 +757,163 @@ float abst, tsq, p, z;
 
 
 /** Quantile
-+++ This function computes a quantile of an array. The quick select algo-
-+++ rithm is used for this purpose. Caution: the array will be screwed up.
-+++ Copy the array before calling the quantile function.
++++ This function computes a quantile of an array. The introselect algo-
++++ rithm is used for this purpose, see quantiles. Caution: the array will
++++ be screwed up. Copy the array before calling the quantile function.
 --- x:      array
 --- n:      length of array
 --- p:      probability [0,1]
 +++ Return: quantile
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 float quantile(float *x, int n, float p){
-int left = 0, right = n - 1, r, w, k;
-float piv;
+float q = 0;
+
+
+  quantiles(x, n, &p, 1, &q);
+
+  return q;
+}
+
+
+/** Quantile position
++++ This function computes the position of a quantile in the sorted array.
+--- n:      length of array
+--- p:      probability [0,1]
++++ Return: position
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int quantile_rank(int n, float p){
+
+  return (int) (n-1)/(1/p);
+}
+
+
+/** Multiple quantiles
++++ This function computes several quantiles of an array in one selection
++++ pass. The array is recursively partitioned into elements smaller than,
++++ equal to, and larger than a pivot, and only partitions that contain a
++++ requested position are processed further. Each value is the exact or-
++++ der statistic at quantile_rank. If partitioning degenerates (depth 
++++ exceeds 2 log2 n), the remaining partition is sorted instead, which 
++++ bounds the cost to O(n log n) (introselect). Caution: the array will 
++++ be screwed up. Copy the array before calling the quantiles function.
+--- x:      array
+--- n:      length of array
+--- p:      probabilities [0,1], sorted in ascending order
+--- np:     number of probabilities
+--- q:      quantiles (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void quantiles(float *x, int n, const float *p, int np, float *q){
+int depth = 0, m;
+
+
+  if (n < 1 || np < 1) return;
+
+  for (m=n; m>1; m/=2) depth += 2;
+
+  quantile_select(x, 0, n-1, n, p, 0, np-1, depth, q);
+
+  return;
+}
+
+
+/** Multiple quantiles from histogram
++++ This function computes several quantiles of 16-bit data from a histo-
++++ gram. The histogram holds 65536 bins, where bin v-SHRT_MIN counts the
++++ occurences of value v. It only needs to be filled between minimum and
++++ maximum, and is reset to zero on return. The result is identical to
++++ the quantiles function, but the cost is linear in the number of values
++++ plus the range; use it when the range is small.
+--- hist:   histogram
+--- min:    minimum value
+--- max:    maximum value
+--- n:      number of values
+--- p:      probabilities [0,1], sorted in ascending order
+--- np:     number of probabilities
+--- q:      quantiles (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void quantiles_hist(int *hist, short min, short max, int n, const float *p, int np, float *q){
+int v, i = 0, k, sum = 0;
+
+
+  k = (np > 0) ? quantile_rank(n, p[0]) : n;
+
+  for (v=min-SHRT_MIN; v<=max-SHRT_MIN; v++){
+
+    sum += hist[v];
+    hist[v] = 0;
+
+    while (k < sum){
+      q[i++] = v+SHRT_MIN;
+      k = (i < np) ? quantile_rank(n, p[i]) : n;
+    }
+
+  }
+
+  return;
+}
 
 
-  // compute position from probability
-  k = (int) (n-1)/(1/p);
+/** Function for one partitioning step of multiple quantiles
++++ This function is used in the multiple quantiles function. The posi-
++++ tions of p[lo..hi] are within x[left..right]. depth is the number of
++++ partitioning steps left before falling back to sorting.
++++--------------------------------------------------------------------**/
+void quantile_select(float *x, int left, int right, int n, const float *p, int lo, int hi, int depth, float *q){
+int lt, gt, r, a, b, mid;
+float piv;
 
-  // do until left and right converge at k
-  while (left < right){
 
-    r = left ;        // reader
-    w = right;        // writer
-    piv = x[(r+w)/2]; // pivot
+  while (lo <= hi){
 
-    // do until reader and writer are equal
-    while (r < w){
+    // small partition: sort it
+    if (right-left < 16){
+      for (r=left+1; r<=right; r++){
+        for (mid=r; mid>left && x[mid-1] > x[mid]; mid--) quantile_swap(x, mid-1, mid);
+      }
+      for (a=lo; a<=hi; a++) q[a] = x[quantile_rank(n, p[a])];
+      return;
+    }
 
-      if (x[r] >= piv){
-        // if larger than pivot, put value to the end, decrease writer
-        quantile_swap(x, r, w);
-        w--;
+    // degenerate partitioning: sort it
+    if (depth-- <= 0){
+      qsort(x+left, right-left+1, sizeof(float), comp_float);
+      for (a=lo; a<=hi; a++) q[a] = x[quantile_rank(n, p[a])];
+      return;
+    }
+
+    // median of three
+    mid = left + (right-left)/2;
+    if (x[mid]   < x[left]) quantile_swap(x, mid,   left);
+    if (x[right] < x[left]) quantile_swap(x, right, left);
+    if (x[right] < x[mid])  quantile_swap(x, right, mid);
+    piv = x[mid];
+
+    // three-way partition: x[left..lt-1] < piv = x[lt..gt] < x[gt+1..right]
+    lt = r = left; gt = right;
+    while (r <= gt){
+      if (x[r] < piv){
+        quantile_swap(x, lt++, r++);
+      } else if (x[r] > piv){
+        quantile_swap(x, r, gt--);
       } else {
-        // if smaller than pivot, skip, increase reader
         r++;
       }
     }
 
-    // if elements are equal, array consists of one unique value
-    if (x[left] == x[right]) return (x[k]);
+    // requested positions below, within, and above the pivot run
+    for (a=lo; a<=hi && quantile_rank(n, p[a]) < lt;  a++);
+    for (b=a;  b<=hi && quantile_rank(n, p[b]) <= gt; b++) q[b] = piv;
 
-    // if reader was increased, decrese reader
-    if (x[r] > piv) r--;
+    if (a > lo) quantile_select(x, left, lt-1, n, p, lo, a-1, depth, q);
 
-    // reader is on the end of the first k elements
-    if (k <= r){
-      right = r;
-    } else {
-      left = r + 1;
-    }
+    left = gt+1;
+    lo   = b;
 
   }
 
-  return x[k];
+  return;
 }
 
 
@@ -724,9 +930,11 @@ float tmp = x[from];
 
 
 /** Mode
-+++ This function computes the mode of an array. The array is completely
-+++ sorted. Caution: the array will be screwed up.
-+++ Copy the array before calling the mode function.
++++ This function computes the mode of an array. If several values are 
++++ equally frequent, the smallest one is returned. Short arrays are sor-
++++ ted in place (caution: the array will be screwed up, copy the array 
++++ before calling the mode function); long arrays are counted in linear 
++++ time, see histogram_bins.
 --- x:      array
 --- n:      length of array
 +++ Return: mode
@@ -734,11 +942,31 @@ float tmp = x[from];
 int mode(int *x, int n){
 int i;
 int max = 1;
-int mod = x[0];
+int mod;
 int now = 1;
+histbin_t *bins = NULL;
+int nbin;
+
+
+  if (n > 64){
+
+    nbin = histogram_bins(x, n, &bins);
+
+    for (i=0, max=0; i<nbin; i++){
+      if (bins[i].count > max){
+        max = bins[i].count;
+        mod = bins[i].value;
+      }
+    }
+
+    free((void*)bins);
+    return mod;
+
+  }
 
 
   qsort(x, n, sizeof(int), comp);
+  mod = x[0];
 
   for (i=1; i<n; i++){
     if (x[i] == x[i-1]){
@@ -769,21 +997,13 @@ int now = 1;
 +++ Return: number
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int n_uniq(int *x, int n){
-int i;
-int *arr = NULL;
-int num = 1;
-
+histbin_t *bins = NULL;
+int num;
 
-  alloc((void**)&arr, n, sizeof(int));
-  for (i=0; i<n; i++) arr[i] = x[i];
 
-  qsort(arr, n, sizeof(int), comp);
-
-  for (i=1; i<n; i++){
-    if (arr[i] != arr[i-1]) num++;
-  }
+  num = histogram_bins(x, n, &bins);
 
-  free((void*)arr);
+  free((void*)bins);
 
 
   return num;
@@ -791,49 +1011,126 @@ int num = 1;
 
 
 /** Histogram
-+++ This function computes a histogram.
++++ This function computes a histogram. The unique values are returned in 
++++ ascending order (1st row), together with their counts (2nd row).
 --- x:      array
 --- n:      length of array
+--- n_uniq: number of unique values (returned)
 +++ Return: histogram
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int **histogram(int *x, int n, int *n_uniq){
-int i, k;
-int *arr = NULL;
+int k;
+histbin_t *bins = NULL;
 int **hist = NULL;
-int num = 1;
+int num;
 
 
-  alloc((void**)&arr, n, sizeof(int));
-  for (i=0; i<n; i++) arr[i] = x[i];
+  num = histogram_bins(x, n, &bins);
 
-  qsort(arr, n, sizeof(int), comp);
+  alloc_2D((void***)&hist, 2, (num > 0) ? num : 1, sizeof(int));
 
-  for (i=1; i<n; i++){
-    if (arr[i] != arr[i-1]) num++;
+  for (k=0; k<num; k++){
+    hist[0][k] = bins[k].value;
+    hist[1][k] = bins[k].count;
   }
 
-  alloc_2D((void***)&hist, 2, num, sizeof(int));
+  free((void*)bins);
+
+  *n_uniq = num;
+  return hist;
+}
+
+
+/** Histogram bins
++++ This function counts the occurences of each unique value of an array,
++++ without sorting the array. If the value range is small compared to n,
++++ the values are counted in an array (counting sort); otherwise, they 
++++ are counted in an open-addressing hash table, and only the unique va-
++++ lues are sorted. The array is not modified.
+--- x:      array
+--- n:      length of array
+--- bins:   unique values and counts, ascending order (returned)
++++ Return: number of unique values
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int histogram_bins(int *x, int n, histbin_t **bins){
+int i, k, num = 0, min, max;
+long range;
+int *count = NULL, *key = NULL;
+unsigned int h, mask, m;
+histbin_t *bin = NULL;
 
-  k = 0;
 
-  hist[0][k] = arr[0];
-  hist[1][k]++;
+  *bins = NULL;
+  if (n < 1) return 0;
 
+  min = max = x[0];
   for (i=1; i<n; i++){
+    if (x[i] < min) min = x[i];
+    if (x[i] > max) max = x[i];
+  }
+
+  range = (long)max-(long)min+1;
+
 
-    if (arr[i] != arr[i-1]){
-      k++;
-      hist[0][k] = arr[i];
+  if (range <= 4L*n+256){
+
+    // counting sort
+    alloc((void**)&count, range, sizeof(int));
+
+    for (i=0; i<n; i++){
+      if (count[x[i]-min]++ == 0) num++;
     }
 
-    hist[1][k]++;
-  }
+    alloc((void**)&bin, num, sizeof(histbin_t));
 
+    for (k=0, i=0; k<range; k++){
+      if (count[k] == 0) continue;
+      bin[i].value = (int)(k+min);
+      bin[i].count = count[k];
+      i++;
+    }
 
-  free((void*)arr);
+    free((void*)count);
 
-  *n_uniq = num;
-  return hist;
+  } else {
+
+    // hash table with linear probing, load factor <= 0.5
+    for (m=1; m<2u*n; m*=2);
+    mask = m-1;
+
+    alloc((void**)&count, m, sizeof(int));
+    alloc((void**)&key,   m, sizeof(int));
+
+    for (i=0; i<n; i++){
+
+      h = ((unsigned int)x[i] * 2654435761u) & mask;
+      while (count[h] > 0 && key[h] != x[i]) h = (h+1) & mask;
+
+      if (count[h]++ == 0){
+        key[h] = x[i];
+        num++;
+      }
+
+    }
+
+    alloc((void**)&bin, num, sizeof(histbin_t));
+
+    for (h=0, i=0; h<m; h++){
+      if (count[h] == 0) continue;
+      bin[i].value = key[h];
+      bin[i].count = count[h];
+      i++;
+    }
+
+    free((void*)count);
+    free((void*)key);
+
+    qsort(bin, num, sizeof(histbin_t), comp_bin);
+
+  }
+
+  *bins = bin;
+  return num;
 }
 
 
@@ -841,6 +1138,23 @@ int num = 1;
 +++ This function is used mode algorithm
 +++--------------------------------------------------------------------**/
 int comp(const void *a, const void *b){
-  return ( *(int*)a - *(int*)b );
+  return ( (*(int*)a > *(int*)b) - (*(int*)a < *(int*)b) );
+}
+
+
+/** Function for comparing two float array elements
++++ This function is used in the introselect fallback for quantiles
++++--------------------------------------------------------------------**/
+int comp_float(const void *a, const void *b){
+  return ( (*(float*)a > *(float*)b) - (*(float*)a < *(float*)b) );
+}
+
+
+/** Function for comparing two histogram bins by value
++++ This function is used in the histogram algorithm
++++--------------------------------------------------------------------**/
+int comp_bin(const void *a, const void *b){
+  return ( (((histbin_t*)a)->value > ((histbin_t*)b)->value) - 
+           (((histbin_t*)a)->value < ((histbin_t*)b)->value) );
 }
 
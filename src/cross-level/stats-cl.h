@@ -32,6 +32,7 @@ Statistics header
 #include <stdlib.h>  // standard general utilities library
 #include <stdbool.h> // boolean data type
 #include <math.h>    // common mathematical functions
+#include <limits.h>  // macro constants of the integer types
 
 #include "../cross-level/const-cl.h"
 #include "../cross-level/alloc-cl.h"
@@ -58,7 +59,9 @@ void linreg_r(double cov, double varx, double vary, double *r);
 void linreg_rsquared(double cov, double varx, double vary, double *rsq);
 void linreg_predict(double x, double slope, double intercept, double *y);
 int slope_significant(float p, int tailtype, int n, float b, float b0, float seb);
+int slope_significance(float tcrit, int tailtype, float b, float b0, float seb);
 int tscore(float p, int df, int tailtype, float *tscore);
+int tscore_cached(float p, int df, int tailtype, float *tcrit);
 float tscore_tail2left(float p, int tail, bool negative);
 float tscore_left2twotail(float p, bool negative);
 float tscore_tail2twotail(float p, int tail, bool negative);
@@ -68,6 +71,9 @@ float tscore_Hills_inv_t(float p, int idf);
 float tscore_T_z(float t, int df);
 float tscore_T_p(float t, int df);
 float quantile(float *x, int n, float p);
+int quantile_rank(int n, float p);
+void quantiles(float *x, int n, const float *p, int np, float *q);
+void quantiles_hist(int *hist, short min, short max, int n, const float *p, int np, float *q);
 int mode(int *x, int n);
 int n_uniq(int *x, int n);
 int **histogram(int *x, int n, int *n_uniq);
@@ -28,6 +28,33 @@ This file contains functions for string handling
 #include "string-cl.h"
 
 
+/** String table
++++ Strings that repeat many times, e.g. the band metadata of bricks, are
++++ interned: each distinct string is stored once per run, and is refer-
++++ red to by a small integer ID. The strings are stored in arenas, and 
++++ the pointers in blocks that never move, such that IDs can be resolved
++++ without locking. The table lives until the program exits.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+#define STRTAB_BLOCK  4096    // strings per block
+#define STRTAB_NBLOCK 4096    // maximum number of blocks
+#define STRTAB_ARENA  1048576 // bytes per arena
+
+typedef struct {
+  const char **block[STRTAB_NBLOCK]; // interned strings
+  int n;                              // number of interned strings
+  int *hash;                          // hash table of string IDs (-1: empty)
+  int nhash;                          // size of hash table
+  char *arena;                        // current arena
+  size_t used;                        // used bytes of current arena
+} strtab_t;
+
+const char *strtab_first[STRTAB_BLOCK] = { "NA" };
+strtab_t strtab = { { strtab_first }, 1, NULL, 0, NULL, STRTAB_ARENA };
+
+// last string interned by this thread (strings often repeat in a row)
+_Thread_local int strtab_last = STRING_NA;
+
+
 /** Copy string
 +++ This function copies a source string into a destination buffer. 
 +++ strncpy copies as many characters from src to dst as there is space
@@ -86,3 +113,130 @@ errno = 0;
   return SUCCESS;
 }
 
+
+/** This function computes the FNV-1a hash of a string
+--- src:    string
++++ Return: hash
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+unsigned int hash_string(const char *src){
+unsigned int h = 2166136261u;
+
+
+  for (; *src != '\0'; src++){
+    h ^= (unsigned char)*src;
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+
+/** This function (re-)builds the hash table of the string table with 
++++ the given size, and enters all interned strings
+--- nhash:  size of the hash table (power of 2)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void rehash_strings(int nhash){
+int id, k;
+
+
+  free((void*)strtab.hash);
+  if ((strtab.hash = (int*)malloc(nhash*sizeof(int))) == NULL){
+    printf("unable to allocate string table\n"); exit(1);}
+  for (k=0; k<nhash; k++) strtab.hash[k] = -1;
+  strtab.nhash = nhash;
+
+  for (id=0; id<strtab.n; id++){
+    k = hash_string(interned_string(id)) & (nhash-1);
+    while (strtab.hash[k] >= 0) k = (k+1) & (nhash-1);
+    strtab.hash[k] = id;
+  }
+
+  return;
+}
+
+
+/** Intern string
++++ This function returns the ID of a string in the string table. If the
++++ string is not in the table yet, it is added. As with copy_string, 
++++ the program will interrupt if the string does not fit into a buffer 
++++ of the given size, such that it can later be copied into such a 
++++ buffer. This function is thread-safe.
+--- src:    string
+--- size:   size of the buffer the string needs to fit in
++++ Return: string ID
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int intern_string(const char *src, size_t size){
+size_t len = strlen(src);
+unsigned int h;
+int id = -1, k;
+char *dst = NULL;
+
+
+  if (len >= size){
+    printf("cannot copy, string too long:\n%s\n", src);
+    exit(1);
+  }
+
+  if (strcmp(interned_string(strtab_last), src) == 0) return strtab_last;
+
+  h = hash_string(src);
+
+  #pragma omp critical (string_table)
+  {
+
+    if (strtab.nhash == 0) rehash_strings(STRTAB_BLOCK);
+
+    for (k=h&(strtab.nhash-1); strtab.hash[k] >= 0; k=(k+1)&(strtab.nhash-1)){
+      if (strcmp(interned_string(strtab.hash[k]), src) == 0){
+        id = strtab.hash[k]; break;
+      }
+    }
+
+    if (id < 0){
+
+      if (strtab.n >= STRTAB_BLOCK*STRTAB_NBLOCK){
+        printf("string table is full\n"); exit(1);}
+
+      if (strtab.used + len + 1 > STRTAB_ARENA){
+        if ((strtab.arena = (char*)malloc(STRTAB_ARENA)) == NULL){
+          printf("unable to allocate string table\n"); exit(1);}
+        strtab.used = 0;
+      }
+
+      if (strtab.block[strtab.n/STRTAB_BLOCK] == NULL){
+        if ((strtab.block[strtab.n/STRTAB_BLOCK] = (const char**)malloc(STRTAB_BLOCK*sizeof(char*))) == NULL){
+          printf("unable to allocate string table\n"); exit(1);}
+      }
+
+      dst = strtab.arena + strtab.used;
+      memcpy(dst, src, len+1);
+      strtab.used += len+1;
+
+      id = strtab.n;
+      strtab.block[id/STRTAB_BLOCK][id%STRTAB_BLOCK] = dst;
+      strtab.hash[k] = id;
+      strtab.n++;
+
+      // keep the hash table at most half full
+      if (2*strtab.n > strtab.nhash) rehash_strings(2*strtab.nhash);
+
+    }
+
+  }
+
+  strtab_last = id;
+
+  return id;
+}
+
+
+/** This function returns an interned string
+--- id:     string ID
++++ Return: string
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+const char *interned_string(int id){
+
+  return strtab.block[id/STRTAB_BLOCK][id%STRTAB_BLOCK];
+}
+
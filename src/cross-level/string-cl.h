@@ -40,7 +40,12 @@ String handling header
 extern "C" {
 #endif
 
+// ID of the interned "NA" string
+#define STRING_NA 0
+
 void copy_string(char *dst, size_t size, const char *src);
+int intern_string(const char *src, size_t size);
+const char *interned_string(int id);
 int char_to_int(const char *src, int *val);
 int char_to_float(const char *src, float *val);
 
@@ -308,16 +308,39 @@ float sunHourAngle(float time, float longitude, float eqtime){
 +++ Return:    void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void sunpos(float latitude, float longitude, date_t date, float *zen, float *azi){
-float lat[4], lon, zone;
+
+
+  sunpos_row(&latitude, &longitude, 1, date, zen, azi);
+
+  return;
+}
+
+
+/** Sun zenith and azimuth for a row of coordinates
++++ This function calculates the sun zenith and azimuth in degrees for a
++++ number of coordinates that share the same date. The date-dependent 
++++ terms (Julian century, declination, equation of time) are computed 
++++ once, and the remaining per-coordinate trigonometry is written branch-
++++ free, such that the loop can be vectorized.
+--- latitude:  Latitudes
+--- longitude: Longitudes
+--- n:         Number of coordinates
+--- date:      Date
+--- zen:       Sun zeniths  (returned)
+--- azi:       Sun azimuths (returned)
++++ Return:    void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void sunpos_row(float *latitude, float *longitude, int n, date_t date, float *zen, float *azi){
+int i;
+float zone;
 float timenow[2], JC;
 float solarDec[4], eqTime;
-float solarTimeFix, trueSolarTime, hourAngle;
+float lat[3];
+float trueSolarTime, hourAngle;
 float csz, azDenom, zenith[3], azimuth, azRad;
-float exoelev, refrac, te;
+float exoelev, refrac, te, te2;
 
 
-  lat[0] = latitude;
-  lon    = longitude;
   zone   = date.tz;
 
   timenow[0] = date.hh + date.mm/60.0 + date.ss/3600.0 - zone;  // in hours since 0Z := GMT
@@ -330,49 +353,50 @@ float exoelev, refrac, te;
   solarDec[3] = cos(solarDec[1]);
   eqTime = sunEquationOfTime(JC);
 
-  lat[1] = lat[0]*_D2R_CONV_;
-  lat[2] = sin(lat[1]);
-  lat[3] = cos(lat[1]);
 
-  solarTimeFix = eqTime + 4.0 * lon - zone;
-  trueSolarTime = timenow[1] + solarTimeFix;
-  while (trueSolarTime > 1440) trueSolarTime -= 1440;
+  #pragma omp simd private(lat, trueSolarTime, hourAngle, csz, azDenom, zenith, azimuth, azRad, exoelev, refrac, te, te2)
+  for (i=0; i<n; i++){
 
-  hourAngle = trueSolarTime / 4.0 - 180.0;
-  if (hourAngle < -180) hourAngle += 360.0;
+    lat[0] = latitude[i]*_D2R_CONV_;
+    lat[1] = sin(lat[0]);
+    lat[2] = cos(lat[0]);
 
-  csz = lat[2]*solarDec[2] + 
-    lat[3]*solarDec[3]*cos(hourAngle*_D2R_CONV_);
-  if (csz > 1.0) csz = 1.0; else if (csz < -1.0) csz = -1.0; 
-  zenith[0] = acos(csz);
-  zenith[1] = zenith[0]*_R2D_CONV_;
+    trueSolarTime = timenow[1] + eqTime + 4.0 * longitude[i] - zone;
+    if (trueSolarTime > 1440) trueSolarTime -= 1440*ceil(trueSolarTime/1440-1);
 
-  azDenom = lat[3]*sin(zenith[0]);
-  if (fabs(azDenom) > 0.001){
+    hourAngle = trueSolarTime / 4.0 - 180.0;
+    if (hourAngle < -180) hourAngle += 360.0;
 
-    azRad = ( lat[2]*cos(zenith[0]) - solarDec[2] ) / azDenom;
-    if (fabs(azRad) > 1.0){
-      if (azRad < 0) azRad = -1.0; else azRad = 1.0;
-    }
+    csz = lat[1]*solarDec[2] + 
+      lat[2]*solarDec[3]*cos(hourAngle*_D2R_CONV_);
+    csz = fmin(fmax(csz, -1.0), 1.0);
+    zenith[0] = acos(csz);
+    zenith[1] = zenith[0]*_R2D_CONV_;
 
-    azimuth = 180.0 - acos(azRad)*_R2D_CONV_;
-    if (hourAngle > 0.0) azimuth = -1.0*azimuth;
+    azDenom = lat[2]*sin(zenith[0]);
+    if (fabs(azDenom) > 0.001){
 
-  } else {
-    if (lat[0] > 0.0) azimuth = 180.0; else azimuth = 0.0;
-  }
+      azRad = ( lat[1]*cos(zenith[0]) - solarDec[2] ) / azDenom;
+      azRad = fmin(fmax(azRad, -1.0), 1.0);
+
+      azimuth = 180.0 - acos(azRad)*_R2D_CONV_;
+      if (hourAngle > 0.0) azimuth = -1.0*azimuth;
 
-  if (azimuth < 0.0) azimuth += 360.0;
-
-  // refraction correction
-  exoelev = 90.0 - zenith[1];
-  if (exoelev > 85.0){
-    refrac = 0.0;
-  } else {
-    te = tan(exoelev*_D2R_CONV_);
-    if (exoelev > 5.0){
-      refrac = 58.1 / te - 0.07 / (te*te*te) +
-        0.000086 / (te*te*te*te*te);
+    } else {
+      azimuth = (latitude[i] > 0.0) ? 180.0 : 0.0;
+    }
+
+    if (azimuth < 0.0) azimuth += 360.0;
+
+    // refraction correction
+    exoelev = 90.0 - zenith[1];
+    te  = tan(exoelev*_D2R_CONV_);
+    te2 = te*te;
+    if (exoelev > 85.0){
+      refrac = 0.0;
+    } else if (exoelev > 5.0){
+      refrac = 58.1 / te - 0.07 / (te2*te) +
+        0.000086 / (te2*te2*te);
     } else if (exoelev > -0.575){
       refrac = 1735.0  + exoelev *
           (-518.2  + exoelev * 
@@ -381,12 +405,12 @@ float exoelev, refrac, te;
     } else {
       refrac = -20.774 / te;
     }
-    refrac = refrac / 3600.0;
-  }
-  zenith[2] = zenith[1] - refrac;
+    zenith[2] = zenith[1] - refrac / 3600.0;
 
-  *zen = zenith[2];
-  *azi = azimuth;
+    zen[i] = zenith[2];
+    azi[i] = azimuth;
+
+  }
 
   return;
 }
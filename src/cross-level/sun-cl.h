@@ -57,6 +57,7 @@ float sunDeclination(float t);
 float sunEquationOfTime(float t);
 float sunHourAngle(float time, float longitude, float eqtime);
 void sunpos(float latitude, float longitude, date_t date, float *zen, float *azi);
+void sunpos_row(float *latitude, float *longitude, int n, date_t date, float *zen, float *azi);
 
 #ifdef __cplusplus
 }
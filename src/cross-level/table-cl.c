@@ -0,0 +1,410 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for buffered table output. Rows are collec-
+ted in memory, and written in large batches. Tables are either written
+as text (one row per line, space-separated), or in a binary columnar 
+format: a header with the magic number and the number of columns, fol-
+lowed by blocks, each holding the number of rows, and then each column
+of the block as contiguous doubles. Binary tables are read transparently
+by read_table.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "table-cl.h"
+
+#include <unistd.h>    // standard symbolic constants and types 
+#include <fcntl.h>     // file control options
+#include <sys/mman.h>  // memory management declarations
+#include <sys/stat.h>  // data returned by the stat() function
+
+
+#define TABLE_TEXT_BUFFER 16777216 // bytes of text collected before flushing
+
+
+/** This function allocates a table writer. The file is only created, when
++++ the first rows are flushed.
+--- fname:    output file
+--- format:   table format (_TABLE_TEXT_ or _TABLE_BINARY_)
+--- ncol:     number of columns
+--- decimals: number of decimals in text format
++++ Return:   table writer
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+table_writer_t *open_table_writer(char *fname, int format, int ncol, int decimals){
+table_writer_t *tw = NULL;
+
+
+  alloc((void**)&tw, 1, sizeof(table_writer_t));
+
+  if (strlen(fname) >= NPOW_10){
+    printf("table filename is too long. "); free((void*)tw); return NULL;}
+
+  strcpy(tw->fname, fname);
+  tw->format   = format;
+  tw->ncol     = ncol;
+  tw->decimals = decimals;
+
+  if (format == _TABLE_BINARY_){
+    alloc_2D((void***)&tw->col, ncol, TABLE_BLOCK_ROWS, sizeof(double));
+  } else {
+    tw->size = TABLE_TEXT_BUFFER;
+    alloc((void**)&tw->txt, tw->size, sizeof(char));
+  }
+
+  return tw;
+}
+
+
+/** This function appends rows to a table writer. The rows are buffered,
++++ and flushed when the buffer is full.
+--- tw:     table writer
+--- tab:    rows (nrow x ncol)
+--- allow:  write this row? NULL to write all rows
+--- nrow:   number of rows
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_table_rows(table_writer_t *tw, double **tab, bool *allow, int nrow){
+int row, col, n;
+size_t need;
+
+
+  // upper bound of a formatted row
+  need = (size_t)tw->ncol*(24+tw->decimals)+2;
+
+  for (row=0; row<nrow; row++){
+
+    if (allow != NULL && !allow[row]) continue;
+
+    if (tw->format == _TABLE_BINARY_){
+
+      for (col=0; col<tw->ncol; col++) tw->col[col][tw->nrow] = tab[row][col];
+
+      if (++tw->nrow == TABLE_BLOCK_ROWS && 
+          flush_table_writer(tw) == FAILURE) return FAILURE;
+
+    } else {
+
+      if (tw->len+need > tw->size){
+        if (flush_table_writer(tw) == FAILURE) return FAILURE;
+        if (need > tw->size){
+          re_alloc((void**)&tw->txt, tw->size, need, sizeof(char));
+          tw->size = need;
+        }
+      }
+
+      for (col=0; col<tw->ncol; col++){
+        n = snprintf(tw->txt+tw->len, tw->size-tw->len, (col == 0) ? "%.*f" : " %.*f", tw->decimals, tab[row][col]);
+        if (n < 0 || (size_t)n >= tw->size-tw->len){
+          printf("formatting table row failed. "); return FAILURE;}
+        tw->len += n;
+      }
+      tw->txt[tw->len++] = '\n';
+
+    }
+
+  }
+
+  return SUCCESS;
+}
+
+
+/** This function writes all buffered rows of a table writer to disk.
+--- tw:     table writer
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int flush_table_writer(table_writer_t *tw){
+int32_t n;
+int col;
+
+
+  if (tw->len == 0 && tw->nrow == 0) return SUCCESS;
+
+  if (tw->fp == NULL){
+
+    if ((tw->fp = fopen(tw->fname, "wb")) == NULL){
+      printf("unable to open %s. ", tw->fname); return FAILURE;}
+
+    if (tw->format == _TABLE_BINARY_){
+      n = tw->ncol;
+      if (fwrite(TABLE_MAGIC, 1, TABLE_MAGIC_LENGTH, tw->fp) != TABLE_MAGIC_LENGTH ||
+          fwrite(&n, sizeof(int32_t), 1, tw->fp) != 1){
+        printf("unable to write %s. ", tw->fname); return FAILURE;}
+    }
+
+  }
+
+  if (tw->format == _TABLE_BINARY_){
+
+    n = tw->nrow;
+    if (fwrite(&n, sizeof(int32_t), 1, tw->fp) != 1){
+      printf("unable to write %s. ", tw->fname); return FAILURE;}
+
+    for (col=0; col<tw->ncol; col++){
+      if (fwrite(tw->col[col], sizeof(double), tw->nrow, tw->fp) != (size_t)tw->nrow){
+        printf("unable to write %s. ", tw->fname); return FAILURE;}
+    }
+
+    tw->nrow = 0;
+
+  } else {
+
+    if (fwrite(tw->txt, 1, tw->len, tw->fp) != tw->len){
+      printf("unable to write %s. ", tw->fname); return FAILURE;}
+
+    tw->len = 0;
+
+  }
+
+  return SUCCESS;
+}
+
+
+/** This function flushes the remaining rows, closes the file and frees 
++++ the table writer.
+--- tw:     table writer
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int close_table_writer(table_writer_t *tw){
+int status;
+
+
+  if (tw == NULL) return SUCCESS;
+
+  status = flush_table_writer(tw);
+
+  if (tw->fp != NULL && fclose(tw->fp) != 0){
+    printf("unable to close %s. ", tw->fname); status = FAILURE;}
+
+  if (tw->col != NULL) free_2D((void**)tw->col, tw->ncol);
+  if (tw->txt != NULL) free((void*)tw->txt);
+  free((void*)tw);
+
+  return status;
+}
+
+
+/** This function tests whether a file is a binary table.
+--- fname:  file
++++ Return: true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool is_binary_table(char *fname){
+FILE *fp = NULL;
+char magic[TABLE_MAGIC_LENGTH];
+bool binary;
+
+
+  if ((fp = fopen(fname, "rb")) == NULL) return false;
+
+  binary = fread(magic, 1, TABLE_MAGIC_LENGTH, fp) == TABLE_MAGIC_LENGTH &&
+           memcmp(magic, TABLE_MAGIC, TABLE_MAGIC_LENGTH) == 0;
+
+  fclose(fp);
+
+  return binary;
+}
+
+
+/** This function reads a binary table.
+--- fname:  binary table
+--- nrows:  number of rows (returned)
+--- ncols:  number of cols (returned)
++++ Return: table (nrows x ncols)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double **read_binary_table(char *fname, int *nrows, int *ncols){
+FILE *fp = NULL;
+char magic[TABLE_MAGIC_LENGTH];
+int32_t nc, nb;
+double **tab = NULL;
+double *block = NULL;
+int ni = 0, ni_buf = NPOW_10;
+int i, j;
+bool error = false;
+
+
+  if ((fp = fopen(fname, "rb")) == NULL){
+    printf("unable to open table %s. ", fname); return NULL;}
+
+  if (fread(magic, 1, TABLE_MAGIC_LENGTH, fp) != TABLE_MAGIC_LENGTH ||
+      memcmp(magic, TABLE_MAGIC, TABLE_MAGIC_LENGTH) != 0 ||
+      fread(&nc, sizeof(int32_t), 1, fp) != 1 || nc < 1){
+    printf("unable to read table %s. Invalid header. ", fname); fclose(fp); return NULL;}
+
+  alloc_2D((void***)&tab, ni_buf, nc, sizeof(double));
+  alloc((void**)&block, (size_t)nc*TABLE_BLOCK_ROWS, sizeof(double));
+
+  // read block by block, and transpose columns to rows
+  while (!error && fread(&nb, sizeof(int32_t), 1, fp) == 1){
+
+    if (nb < 0 || nb > TABLE_BLOCK_ROWS ||
+        fread(block, sizeof(double), (size_t)nc*nb, fp) != (size_t)nc*nb){
+      error = true; break;}
+
+    while (ni+nb > ni_buf){
+      re_alloc_2D((void***)&tab, ni_buf, nc, ni_buf*2, nc, sizeof(double));
+      ni_buf *= 2;
+    }
+
+    for (j=0; j<nc; j++){
+    for (i=0; i<nb; i++) tab[ni+i][j] = block[(size_t)j*nb+i];
+    }
+
+    ni += nb;
+
+  }
+
+  fclose(fp);
+  free((void*)block);
+
+  if (error){
+    printf("unable to read table %s. Truncated block after row %d. ", fname, ni);
+    free_2D((void**)tab, ni_buf);
+    return NULL;
+  }
+
+  // re-shape buffer to actual number of rows
+  if (ni > 0 && ni != ni_buf){
+    re_alloc_2D((void***)&tab, ni_buf, nc, ni, nc, sizeof(double));
+  }
+
+  *nrows = ni;
+  *ncols = nc;
+  return tab;
+}
+
+
+/** This function maps a binary table into memory. Only the block headers
++++ are read to index the blocks; the columns are read on demand, such that
++++ large tables can be loaded column by column without a parsing step, and
++++ without holding the whole table as rows.
+--- fname:  binary table
++++ Return: mapped table (or NULL)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+table_map_t *map_binary_table(char *fname){
+table_map_t *tm = NULL;
+struct stat st;
+size_t offset;
+int32_t nc, nb;
+int nbuf = NPOW_04;
+
+
+  alloc((void**)&tm, 1, sizeof(table_map_t));
+
+  if ((tm->fd = open(fname, O_RDONLY)) < 0){
+    printf("unable to open table %s. ", fname);
+    free((void*)tm); return NULL;}
+
+  if (fstat(tm->fd, &st) != 0 || 
+      (size_t)st.st_size < TABLE_MAGIC_LENGTH+sizeof(int32_t)){
+    printf("table %s is truncated. ", fname);
+    close(tm->fd); free((void*)tm); return NULL;}
+
+  tm->size = (size_t)st.st_size;
+
+  if ((tm->map = (char*)mmap(NULL, tm->size, PROT_READ, MAP_SHARED, tm->fd, 0)) == MAP_FAILED){
+    printf("unable to map table %s. ", fname);
+    tm->map = NULL; unmap_binary_table(tm); return NULL;}
+
+  madvise(tm->map, tm->size, MADV_SEQUENTIAL);
+
+  memcpy(&nc, tm->map+TABLE_MAGIC_LENGTH, sizeof(int32_t));
+
+  if (memcmp(tm->map, TABLE_MAGIC, TABLE_MAGIC_LENGTH) != 0 || nc < 1){
+    printf("unable to read table %s. Invalid header. ", fname);
+    unmap_binary_table(tm); return NULL;}
+
+  tm->ncol = nc;
+
+  alloc((void**)&tm->block_nrow, nbuf, sizeof(int));
+  alloc((void**)&tm->block_row,  nbuf, sizeof(int));
+  alloc((void**)&tm->block_data, nbuf, sizeof(size_t));
+
+  // index the blocks
+  offset = TABLE_MAGIC_LENGTH+sizeof(int32_t);
+
+  while (offset+sizeof(int32_t) <= tm->size){
+
+    memcpy(&nb, tm->map+offset, sizeof(int32_t));
+    offset += sizeof(int32_t);
+
+    if (nb < 0 || nb > TABLE_BLOCK_ROWS || 
+        offset+(size_t)nc*nb*sizeof(double) > tm->size){
+      printf("unable to read table %s. Truncated block after row %d. ", fname, tm->nrow);
+      unmap_binary_table(tm); return NULL;}
+
+    if (tm->nblock == nbuf){
+      re_alloc((void**)&tm->block_nrow, nbuf, nbuf*2, sizeof(int));
+      re_alloc((void**)&tm->block_row,  nbuf, nbuf*2, sizeof(int));
+      re_alloc((void**)&tm->block_data, nbuf, nbuf*2, sizeof(size_t));
+      nbuf *= 2;
+    }
+
+    tm->block_nrow[tm->nblock] = nb;
+    tm->block_row[tm->nblock]  = tm->nrow;
+    tm->block_data[tm->nblock] = offset;
+    tm->nblock++;
+
+    tm->nrow += nb;
+    offset += (size_t)nc*nb*sizeof(double);
+
+  }
+
+  return tm;
+}
+
+
+/** This function reads one column of one block of a mapped binary table.
++++ The columns in the file are not aligned, thus they are copied.
+--- tm:     mapped table
+--- block:  block
+--- col:    column
+--- buf:    buffer, at least block_nrow[block] values (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void read_table_column(table_map_t *tm, int block, int col, double *buf){
+size_t nb = tm->block_nrow[block];
+
+
+  memcpy(buf, tm->map + tm->block_data[block] + (size_t)col*nb*sizeof(double), 
+    nb*sizeof(double));
+
+  return;
+}
+
+
+/** This function unmaps a binary table
+--- tm:     mapped table
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void unmap_binary_table(table_map_t *tm){
+
+  if (tm == NULL) return;
+
+  if (tm->map != NULL) munmap(tm->map, tm->size);
+  if (tm->fd >= 0) close(tm->fd);
+  if (tm->block_nrow != NULL) free((void*)tm->block_nrow);
+  if (tm->block_row  != NULL) free((void*)tm->block_row);
+  if (tm->block_data != NULL) free((void*)tm->block_data);
+  free((void*)tm);
+
+  return;
+}
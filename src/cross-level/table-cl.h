@@ -0,0 +1,94 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Buffered table output header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef TABLE_CL_H
+#define TABLE_CL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <string.h>  // string handling functions
+#include <stdbool.h> // boolean data type
+#include <stdint.h>  // fixed-width integer types
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/enum-cl.h"
+#include "../cross-level/alloc-cl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// magic number of binary tables
+#define TABLE_MAGIC "FORCETB1"
+#define TABLE_MAGIC_LENGTH 8
+
+// rows per block of binary tables
+#define TABLE_BLOCK_ROWS NPOW_16
+
+// buffered writer of one table
+typedef struct {
+  char fname[NPOW_10]; // output file, created on first flush
+  FILE *fp;            // output file, NULL if not created yet
+  int format;          // text or binary
+  int ncol;            // number of columns
+  int decimals;        // number of decimals in text format
+  char *txt;           // text buffer
+  size_t len, size;    // used, allocated size of text buffer
+  double **col;        // column buffer of binary format (ncol x size)
+  int nrow;            // number of buffered rows of binary format
+} table_writer_t;
+
+// memory-mapped binary table
+typedef struct {
+  int fd;              // file descriptor
+  char *map;           // mapped file
+  size_t size;         // size of file
+  int ncol;            // number of columns
+  int nrow;            // number of rows
+  int nblock;          // number of blocks
+  int *block_nrow;     // number of rows of each block
+  int *block_row;      // first row of each block
+  size_t *block_data;  // offset of the column data of each block
+} table_map_t;
+
+table_writer_t *open_table_writer(char *fname, int format, int ncol, int decimals);
+int write_table_rows(table_writer_t *tw, double **tab, bool *allow, int nrow);
+int flush_table_writer(table_writer_t *tw);
+int close_table_writer(table_writer_t *tw);
+bool is_binary_table(char *fname);
+double **read_binary_table(char *fname, int *nrows, int *ncols);
+table_map_t *map_binary_table(char *fname);
+void read_table_column(table_map_t *tm, int block, int col, double *buf);
+void unmap_binary_table(table_map_t *tm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
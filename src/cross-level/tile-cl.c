@@ -28,91 +28,138 @@ This file contains functions that handle tiling operations
 #include "tile-cl.h"
 
 
+int tile_hash(int size, int x, int y);
+
+
+/** Hash a tile
++++ This function computes the hash table slot of a tile.
+--- size:   size of hash table (power of 2)
+--- x:      x tile coordinate ID
+--- y:      y tile coordinate ID
++++ Return: slot
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int tile_hash(int size, int x, int y){
+unsigned int h;
+
+  h = (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u;
+  h ^= h >> 16;
+  h *= 2654435761u;
+
+  return (int)(h & (unsigned int)(size-1));
+}
+
+
 /** Read tile allow-list
 +++ This function reads the tile allow-list. If none is given, it is gra-
 +++ cefully ignored. The X/Y IDs and the number of entries is returned.
++++ The tiles are also hashed, such that tile_allowlisted is O(1).
 --- f_tile: path of tile allow-list
---- X:      X tile coordinate IDs (returned)
---- Y:      Y tile coordinate IDs (returned)
---- k:      number of tiles       (returned)
+--- list:   tile allow-list (returned)
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int tile_readlist(char *f_tile, int **X, int **Y, int *k){
+int tile_readlist(char *f_tile, tile_list_t *list){
 FILE *fp = NULL;
 char  buffer[NPOW_10] = "\0";
-int i, *x = NULL, *y = NULL;
+int i, h;
 char cx[5], cy[5];
 
 
+  list->k = 0;
+  list->x = NULL;
+  list->y = NULL;
+  list->size = 0;
+  list->slot = NULL;
+
   // if no file is specified, make sure that processing can continue
-  if ((strcmp(f_tile, "NULL") == 0)){
-    *k = 0;
-    alloc((void**)&x, 1, sizeof(int)); *X = x;
-    alloc((void**)&y, 1, sizeof(int)); *Y = y;
-    return SUCCESS;
-  }
+  if ((strcmp(f_tile, "NULL") == 0)) return SUCCESS;
 
 
   if ((fp = fopen(f_tile, "r")) == NULL){
     printf("Unable to open tile file!\n"); return FAILURE;}
 
   if (fgets(buffer, NPOW_10, fp) == NULL){
-    printf("Error while reading from tile file!\n"); return FAILURE;}
+    printf("Error while reading from tile file!\n"); fclose(fp); return FAILURE;}
 
   // number of positive tiles should be in 1st line
-  if ((*k = atoi(buffer)) <= 0){
-    printf("Error retrieving number of lines in tile file!\n"); return FAILURE;}
+  if ((list->k = atoi(buffer)) <= 0){
+    printf("Error retrieving number of lines in tile file!\n"); fclose(fp); return FAILURE;}
+
+  alloc((void**)&list->x, list->k, sizeof(int)); 
+  alloc((void**)&list->y, list->k, sizeof(int));
 
-  alloc((void**)&x, *k, sizeof(int)); 
-  alloc((void**)&y, *k, sizeof(int));
+  // hash table with load factor <= 0.5
+  for (list->size=2; list->size<2*list->k; list->size*=2);
+  alloc((void**)&list->slot, list->size, sizeof(int));
+  for (h=0; h<list->size; h++) list->slot[h] = -1;
 
   // read line by line, one Tile ID should be in each line
-  for (i=0; i<*k; i++){
+  for (i=0; i<list->k; i++){
 
     if (fgets(buffer, NPOW_10, fp) == NULL){
-      printf("Error reading line %d in tile file\n", i+2); return FAILURE;}
+      printf("Error reading line %d in tile file\n", i+2); 
+      fclose(fp); tile_freelist(list); return FAILURE;}
 
     strncpy(cx, buffer+1, 4); cx[4] = '\0'; 
     strncpy(cy, buffer+7, 4); cy[4] = '\0'; 
-    x[i] = atoi(cx);
-    y[i] = atoi(cy);
+    list->x[i] = atoi(cx);
+    list->y[i] = atoi(cy);
+
+    // insert, duplicates are only hashed once
+    h = tile_hash(list->size, list->x[i], list->y[i]);
+    while (list->slot[h] >= 0 && 
+           (list->x[list->slot[h]] != list->x[i] || 
+            list->y[list->slot[h]] != list->y[i])) h = (h+1) & (list->size-1);
+    if (list->slot[h] < 0) list->slot[h] = i;
 
   }
 
   fclose(fp);
   
   #ifdef FORCE_DEBUG
-  printf("positive tile list contains %d tiles\n", *k);
+  printf("positive tile list contains %d tiles\n", list->k);
   #endif
 
-  *X = x;
-  *Y = y;
   return SUCCESS;
 }
 
 
+/** Free tile allow-list
++++ This function frees the tile allow-list.
+--- list:   tile allow-list
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void tile_freelist(tile_list_t *list){
+
+  if (list->x    != NULL){ free((void*)list->x);    list->x    = NULL;}
+  if (list->y    != NULL){ free((void*)list->y);    list->y    = NULL;}
+  if (list->slot != NULL){ free((void*)list->slot); list->slot = NULL;}
+  list->k = 0;
+  list->size = 0;
+
+  return;
+}
+
+
 /** Test if tile is allow-listed
 +++ This function tests whether a given tile is allow-listed or not.
---- allow_x: allow-listed X tile coordinate IDs
---- allow_y: allow-listed Y tile coordinate IDs
---- allow_k: number of allow-listed tiles
+--- list:    tile allow-list
 --- x:       x tile coordinate ID
 --- y:       y tile coordinate ID
 +++ Return:  SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int tile_allowlisted(int *allow_x, int *allow_y, int allow_k, int x, int y){
-int k;
-bool allow = false;
-
-  if (allow_k > 0){
-    for (k=0; k<allow_k; k++){
-      if (x == allow_x[k] && y == allow_y[k]) allow = true;
-    }
-  } else {
-    allow = true;
+int tile_allowlisted(tile_list_t *list, int x, int y){
+int h;
+
+  if (list->k <= 0) return SUCCESS;
+
+  h = tile_hash(list->size, x, y);
+
+  while (list->slot[h] >= 0){
+    if (list->x[list->slot[h]] == x && list->y[list->slot[h]] == y) return SUCCESS;
+    h = (h+1) & (list->size-1);
   }
-  
-  if (allow) return SUCCESS; else return FAILURE;
+
+  return FAILURE;
 }
 
 
@@ -127,11 +174,11 @@ bool allow = false;
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int tile_active(char *f_tile, cube_t *cube){
 int tx, ty;
-int *allow_x = NULL, *allow_y = NULL, allow_k;
+tile_list_t allow;
 
 
   // read tile allow-list
-  if (tile_readlist(f_tile, &allow_x, &allow_y, &allow_k) != SUCCESS){
+  if (tile_readlist(f_tile, &allow) != SUCCESS){
     printf("Reading tile file failed! "); return FAILURE;}
 
   // allocate active tile list
@@ -144,7 +191,7 @@ int *allow_x = NULL, *allow_y = NULL, allow_k;
   for (tx=cube->tminx; tx<=cube->tmaxx; tx++){
 
     // if tile is not allowlisted (if specified), skip
-    if (tile_allowlisted(allow_x, allow_y, allow_k, tx, ty) == FAILURE) continue;
+    if (tile_allowlisted(&allow, tx, ty) == FAILURE) continue;
 
     cube->tx[cube->tn] = tx;
     cube->ty[cube->tn] = ty;
@@ -153,8 +200,7 @@ int *allow_x = NULL, *allow_y = NULL, allow_k;
   }
   }
 
-  free((void*)allow_x);
-  free((void*)allow_y);
+  tile_freelist(&allow);
 
   // is there any tile to do?
   if (cube->tn == 0){
@@ -39,8 +39,17 @@ Tiling header
 extern "C" {
 #endif
 
-int tile_readlist(char *f_tile, int **X, int **Y, int *k);
-int tile_allowlisted(int *allow_x, int *allow_y, int allow_k, int x, int y);
+typedef struct {
+  int  k;      // number of tiles, 0 if all tiles are allowed
+  int *x;      // X tile coordinate IDs
+  int *y;      // Y tile coordinate IDs
+  int  size;   // size of hash table (power of 2)
+  int *slot;   // hash table, index into x/y, -1 if empty
+} tile_list_t;
+
+int tile_readlist(char *f_tile, tile_list_t *list);
+void tile_freelist(tile_list_t *list);
+int tile_allowlisted(tile_list_t *list, int x, int y);
 int tile_active(char *f_tile, cube_t *cube);
 
 #ifdef __cplusplus
@@ -161,3 +161,24 @@ float diff, max, A, B;
   return false;
 }
 
+
+/** Hash of a byte sequence
++++ This function updates a 64-bit FNV-1a hash with a byte sequence. Start
++++ with HASH_INIT, and chain the calls to hash several fields.
+--- hash:   current hash
+--- data:   bytes
+--- size:   number of bytes
++++ Return: updated hash
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t size){
+const unsigned char *byte = (const unsigned char*)data;
+size_t i;
+
+
+  for (i=0; i<size; i++){
+    hash ^= byte[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
@@ -34,6 +34,11 @@ Utility functions header
 #include <time.h>    // date and time handling functions
 #include <stdbool.h> // boolean data type
 #include <float.h>   // macro constants of the floating-point library
+#include <stdint.h>  // fixed-width integer types
+
+
+// seed of hash_bytes (FNV-1a offset basis)
+#define HASH_INIT 14695981039346656037ULL
 
 
 #ifdef __cplusplus
@@ -47,6 +52,7 @@ double proctime(time_t start);
 void proctime_print(const char *string, time_t start);
 void fproctime_print(FILE *fp, const char *string, time_t start);
 bool fequal(float a, float b);
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t size);
 
 #ifdef __cplusplus
 }
@@ -32,6 +32,126 @@ This file contains functions that handle warping and reprojection requests
 #include "gdalwarper.h"     // GDAL warper related entry points and defs
 #include "ogr_spatialref.h" // coordinate systems services
 
+#include <string>
+
+
+// number of coordinate transformations that are cached per thread
+#define WARP_CACHE 8
+
+typedef struct {
+  std::string src;
+  std::string dst;
+  OGRCoordinateTransformation *poCT;
+} warp_cache_t;
+
+// OGR transformations must not be shared between threads
+static thread_local warp_cache_t warp_cache[WARP_CACHE];
+static thread_local int warp_cache_next = 0;
+
+OGRCoordinateTransformation *warp_transformation(const char *src_wkt, const char *dst_wkt);
+int warp_transform_array(double *x, double *y, int n, const char *src_wkt, const char *dst_wkt);
+
+
+/** Get cached coordinate transformation
++++ This function returns a coordinate transformation between two projec-
++++ tions. Setting up a transformation is much more expensive than trans-
++++ forming a point. Therefore, the most recently used transformations are
++++ cached per thread and are reused for the same pair of projections.
++++ Cached transformations are owned by the cache and must not be deleted.
+--- src_wkt:  source projection, NULL for geographic WGS84
+--- dst_wkt:  target projection, NULL for geographic WGS84
++++ Return: coordinate transformation or NULL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+OGRCoordinateTransformation *warp_transformation(const char *src_wkt, const char *dst_wkt){
+OGRSpatialReference oSrcSRS, oDstSRS;
+OGRCoordinateTransformation *poCT = NULL;
+std::string src = (src_wkt != NULL) ? src_wkt : "";
+std::string dst = (dst_wkt != NULL) ? dst_wkt : "";
+int i;
+
+
+  for (i=0; i<WARP_CACHE; i++){
+    if (warp_cache[i].poCT != NULL && 
+        warp_cache[i].src == src && 
+        warp_cache[i].dst == dst) return warp_cache[i].poCT;
+  }
+
+
+  CPLSetConfigOption("OGR_CT_FORCE_TRADITIONAL_GIS_ORDER", "YES"); 
+
+  // set coordinate systems
+  if (src_wkt == NULL){
+    oSrcSRS.SetWellKnownGeogCS("WGS84");
+  } else if (oSrcSRS.importFromWkt(src_wkt) != OGRERR_NONE){
+    printf("Importing source projection failed.\n"); return NULL;
+  }
+
+  if (dst_wkt == NULL){
+    oDstSRS.SetWellKnownGeogCS("WGS84");
+  } else if (oDstSRS.importFromWkt(dst_wkt) != OGRERR_NONE){
+    printf("Importing target projection failed.\n"); return NULL;
+  }
+
+  // create transformation
+  if ((poCT = OGRCreateCoordinateTransformation(&oSrcSRS, &oDstSRS)) == NULL) return NULL;
+
+
+  // replace the oldest entry
+  i = warp_cache_next;
+  warp_cache_next = (warp_cache_next+1) % WARP_CACHE;
+
+  if (warp_cache[i].poCT != NULL) OGRCoordinateTransformation::DestroyCT(warp_cache[i].poCT);
+  warp_cache[i].src  = src;
+  warp_cache[i].dst  = dst;
+  warp_cache[i].poCT = poCT;
+
+  return poCT;
+}
+
+
+/** Reproject points between two projections
++++ This function reprojects an array of coordinates in place, using a 
++++ cached transformation. Points that cannot be transformed are set to
++++ NAN, all other points are transformed regardless.
+--- x:        x-coordinates in source projection, target on return
+--- y:        y-coordinates in source projection, target on return
+--- n:        number of points
+--- src_wkt:  source projection, NULL for geographic WGS84
+--- dst_wkt:  target projection, NULL for geographic WGS84
++++ Return: SUCCESS if all points were transformed, FAILURE otherwise
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int warp_transform_array(double *x, double *y, int n, const char *src_wkt, const char *dst_wkt){
+OGRCoordinateTransformation *poCT = NULL;
+int *ok = NULL;
+int i, err = 0;
+
+
+  if (n < 1) return SUCCESS;
+
+  if ((poCT = warp_transformation(src_wkt, dst_wkt)) == NULL){
+    for (i=0; i<n; i++) x[i] = y[i] = NAN;
+    return FAILURE;
+  }
+
+  alloc((void**)&ok, n, sizeof(int));
+
+  if (!poCT->Transform(n, x, y, NULL, ok)){
+    for (i=0; i<n; i++) ok[i] = ok[i] && !isinf(x[i]) && !isinf(y[i]);
+  }
+
+  for (i=0; i<n; i++){
+    if (!ok[i]){
+      x[i] = y[i] = NAN;
+      err++;
+    }
+  }
+
+  free((void*)ok);
+
+  if (err > 0) return FAILURE;
+  return SUCCESS;
+}
+
 
 /** Reproject point from geographic to any projection
 +++ This function reprojects a coordinate.
@@ -44,14 +164,9 @@ This file contains functions that handle warping and reprojection requests
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int warp_geo_to_any(double  srs_x, double  srs_y, 
                double *dst_x, double *dst_y, char *dst_wkt){
-OGRSpatialReference oSrcSRS, oDstSRS;
-OGRCoordinateTransformation *poCT = NULL;
-char *wkt = dst_wkt;
 double x, y;
 
 
-  CPLSetConfigOption("OGR_CT_FORCE_TRADITIONAL_GIS_ORDER", "YES"); 
-
   if (srs_x < -180 || srs_x > 180){
     printf("Longitude is out of bounds.\n"); return FAILURE;}
   if (srs_y <  -90 || srs_y >  90){
@@ -59,19 +174,38 @@ double x, y;
 
   x = srs_x; y = srs_y;
 
-  // set coordinate systems
-  oSrcSRS.SetWellKnownGeogCS("WGS84");
-  oDstSRS.importFromWkt(&wkt);
+  if (warp_transform_array(&x, &y, 1, NULL, dst_wkt) == FAILURE){
+    printf( "Transformation failed.\n" ); return FAILURE;}
 
-  // create transformation
-  poCT = OGRCreateCoordinateTransformation(&oSrcSRS, &oDstSRS);
+  *dst_x = x; *dst_y = y;
+  return SUCCESS;
+}
 
-  // transform
-  if (poCT == NULL || !poCT->Transform(1, &x, &y)){
-    printf( "Transformation failed.\n" ); return FAILURE;
-  } else delete poCT;
 
-  *dst_x = x; *dst_y = y;
+/** Reproject points from geographic to any projection
++++ This function reprojects an array of coordinates in place. Points out-
++++ side of the geographic bounds, or points that cannot be transformed
++++ are set to NAN, all other points are transformed regardless.
+--- x:        longitudes, x-coordinates in target projection on return
+--- y:        latitudes,  y-coordinates in target projection on return
+--- n:        number of points
+--- dst_wkt:  target projection
++++ Return: SUCCESS if all points were transformed, FAILURE otherwise
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int warp_geo_to_any_array(double *x, double *y, int n, char *dst_wkt){
+int i, err = 0;
+
+
+  for (i=0; i<n; i++){
+    if (x[i] < -180 || x[i] > 180 || y[i] < -90 || y[i] > 90){
+      x[i] = y[i] = NAN;
+      err++;
+    }
+  }
+
+  if (warp_transform_array(x, y, n, NULL, dst_wkt) == FAILURE) err++;
+
+  if (err > 0) return FAILURE;
   return SUCCESS;
 }
 
@@ -88,27 +222,13 @@ double x, y;
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int warp_any_to_geo(double  srs_x, double  srs_y, 
                double *dst_x, double *dst_y, char *src_wkt){
-OGRSpatialReference oSrcSRS, oDstSRS;
-OGRCoordinateTransformation *poCT = NULL;
-char *wkt = src_wkt;
 double x, y;
 
 
-  CPLSetConfigOption("OGR_CT_FORCE_TRADITIONAL_GIS_ORDER", "YES"); 
-
   x = srs_x; y = srs_y;
 
-  // set coordinate systems
-  oSrcSRS.importFromWkt(&wkt);
-  oDstSRS.SetWellKnownGeogCS("WGS84");
-
-  // create transformation
-  poCT = OGRCreateCoordinateTransformation(&oSrcSRS, &oDstSRS);
-
-  // transform
-  if (poCT == NULL || !poCT->Transform(1, &x, &y)){
-    printf( "Transformation failed.\n" ); return FAILURE;
-  } else delete poCT;
+  if (warp_transform_array(&x, &y, 1, src_wkt, NULL) == FAILURE){
+    printf( "Transformation failed.\n" ); return FAILURE;}
 
   if (x < -180 || x > 180){
     printf("Longitude is out of bounds.\n"); return FAILURE;}
@@ -120,6 +240,34 @@ double x, y;
 }
 
 
+/** Reproject points from any projection to geographic
++++ This function reprojects an array of coordinates in place. The coor-
++++ dinate transformation is only set up once for all points, which is 
++++ much faster than reprojecting the points one by one.
+--- x:        x-coordinates in source projection, longitudes on return
+--- y:        y-coordinates in source projection, latitudes  on return
+--- n:        number of points
+--- src_wkt:  source projection
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int warp_any_to_geo_array(double *x, double *y, int n, char *src_wkt){
+int i;
+
+
+  if (warp_transform_array(x, y, n, src_wkt, NULL) == FAILURE){
+    printf( "Transformation failed.\n" ); return FAILURE;}
+
+  for (i=0; i<n; i++){
+    if (x[i] < -180 || x[i] > 180){
+      printf("Longitude is out of bounds.\n"); return FAILURE;}
+    if (y[i] <  -90 || y[i] >  90){
+      printf("Latitude  is out of bounds.\n"); return FAILURE;}
+  }
+
+  return SUCCESS;
+}
+
+
 /** Reproject point from any to any other projection
 +++ This function reprojects a coordinate.
 --- srs_x:    x-coordinate in source projection
@@ -133,30 +281,33 @@ double x, y;
 int warp_any_to_any(double  srs_x, double  srs_y,
                  double *dst_x, double *dst_y,
                  char *src_wkt, char *dst_wkt){
-OGRSpatialReference oSrcSRS, oDstSRS;
-OGRCoordinateTransformation *poCT = NULL;
-char *src_css = src_wkt;
-char *dst_css = dst_wkt;
 double x, y;
 
 
-  CPLSetConfigOption("OGR_CT_FORCE_TRADITIONAL_GIS_ORDER", "YES"); 
-
   x = srs_x; y = srs_y;
 
-  // set coordinate systems
-  oSrcSRS.importFromWkt(&src_css);
-  oDstSRS.importFromWkt(&dst_css);
-
-  // create transformation
-  poCT = OGRCreateCoordinateTransformation(&oSrcSRS, &oDstSRS);
-
-  // transform
-  if (poCT == NULL || !poCT->Transform(1, &x, &y)){
-    printf( "Transformation failed.\n" ); return FAILURE;
-  } else delete poCT;
+  if (warp_transform_array(&x, &y, 1, src_wkt, dst_wkt) == FAILURE){
+    printf( "Transformation failed.\n" ); return FAILURE;}
 
   *dst_x = x; *dst_y = y;
   return SUCCESS;
 }
 
+
+/** Reproject points from any to any other projection
++++ This function reprojects an array of coordinates in place. Points that
++++ cannot be transformed are set to NAN, all other points are transformed
++++ regardless.
+--- x:        x-coordinates in source projection, target on return
+--- y:        y-coordinates in source projection, target on return
+--- n:        number of points
+--- src_wkt:  source projection
+--- dst_wkt:  target projection
++++ Return: SUCCESS if all points were transformed, FAILURE otherwise
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int warp_any_to_any_array(double *x, double *y, int n, char *src_wkt, char *dst_wkt){
+
+
+  return warp_transform_array(x, y, n, src_wkt, dst_wkt);
+}
+
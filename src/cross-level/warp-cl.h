@@ -30,8 +30,10 @@ Warp header
 
 #include <stdio.h>   // core input and output functions
 #include <stdlib.h>  // standard general utilities library
+#include <math.h>    // common mathematical functions
 
 #include "../cross-level/const-cl.h"
+#include "../cross-level/alloc-cl.h"
 
 
 #ifdef __cplusplus
@@ -39,8 +41,11 @@ extern "C" {
 #endif
 
 int warp_geo_to_any(double  srs_x, double  srs_y, double *dst_x, double *dst_y, char *dst_wkt);
+int warp_geo_to_any_array(double *x, double *y, int n, char *dst_wkt);
 int warp_any_to_geo(double  srs_x, double  srs_y, double *dst_x, double *dst_y, char *src_wkt);
+int warp_any_to_geo_array(double *x, double *y, int n, char *src_wkt);
 int warp_any_to_any(double  srs_x, double  srs_y, double *dst_x, double *dst_y, char *src_wkt, char *dst_wkt);
+int warp_any_to_any_array(double *x, double *y, int n, char *src_wkt, char *dst_wkt);
 
 #ifdef __cplusplus
 }
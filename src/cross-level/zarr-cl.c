@@ -0,0 +1,438 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for writing bricks as Zarr (v2) arrays. The
+array has the dimensions band, y, x. Each chunk is an independent file, 
+thus the chunks of a brick can be written without locking, and in any 
+order. Time series of a pixel are contiguous within a chunk.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "zarr-cl.h"
+
+#include <unistd.h>    // standard symbolic constants and types 
+#include <errno.h>     // error numbers
+#include <sys/stat.h>  // data returned by the stat() function
+
+/** zlib compression library **/
+#include <zlib.h>
+
+
+enum { _ZARR_NONE_, _ZARR_ZLIB_ };
+
+typedef struct {
+  int tc;         // number of bands per chunk
+  int cy;         // number of rows per chunk
+  int cx;         // number of columns per chunk
+  int nbc;        // number of band chunks
+  int nyc;        // number of row chunks
+  int compress;   // compressor
+  int level;      // compression level
+} zarr_layout_t;
+
+void zarr_layout(brick_t *brick, int nbands, zarr_layout_t *zarr);
+const char *zarr_dtype(int datatype);
+void fprint_json_string(FILE *fp, const char *str);
+int write_zarr_file(const char *fname, const char *content, size_t n);
+int write_zarr_metadata(brick_t *brick, const char *dname, int *bands, int nbands, zarr_layout_t *zarr);
+int write_zarr_chunk(brick_t *brick, const char *dname, int *bands, int nbands, zarr_layout_t *zarr, int bc, int yc);
+
+
+/** This function compiles the chunk layout and compression of a Zarr 
++++ array from the brick and its output options (TIME_CHUNK, COMPRESS, 
++++ ZLEVEL)
+--- brick:  brick
+--- nbands: number of bands to write
+--- zarr:   chunk layout (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void zarr_layout(brick_t *brick, int nbands, zarr_layout_t *zarr){
+int o;
+
+
+  zarr->tc = nbands;
+  zarr->cy = (brick->cy > 0) ? brick->cy : brick->ny;
+  zarr->cx = brick->nx;
+  zarr->compress = _ZARR_ZLIB_;
+  zarr->level = 1;
+
+  for (o=0; o<brick->format.n; o+=2){
+    if (strcmp(brick->format.option[o], "TIME_CHUNK") == 0){
+      zarr->tc = atoi(brick->format.option[o+1]);
+    } else if (strcmp(brick->format.option[o], "COMPRESS") == 0){
+      if (strcmp(brick->format.option[o+1], "NONE") == 0) zarr->compress = _ZARR_NONE_;
+    } else if (strcmp(brick->format.option[o], "ZLEVEL") == 0){
+      zarr->level = atoi(brick->format.option[o+1]);
+    }
+  }
+
+  if (zarr->tc < 1 || zarr->tc > nbands) zarr->tc = nbands;
+  if (zarr->level < 1 || zarr->level > 9) zarr->level = 1;
+
+  zarr->nbc = (nbands + zarr->tc - 1) / zarr->tc;
+  zarr->nyc = (brick->ny + zarr->cy - 1) / zarr->cy;
+
+  return;
+}
+
+
+/** This function returns the Zarr datatype (numpy typestr)
+--- datatype: FORCE datatype
++++ Return:   datatype string
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+const char *zarr_dtype(int datatype){
+const int one = 1;
+bool little = (*(const char*)&one == 1);
+
+
+  switch (datatype){
+    case _DT_SHORT_:  return little ? "<i2" : ">i2";
+    case _DT_SMALL_:  return "|u1";
+    case _DT_FLOAT_:  return little ? "<f4" : ">f4";
+    case _DT_INT_:    return little ? "<i4" : ">i4";
+    case _DT_USHORT_: return little ? "<u2" : ">u2";
+    default:          return NULL;
+  }
+
+}
+
+
+/** This function prints a JSON string, escaping quotes, backslashes and
++++ control characters
+--- fp:     output stream
+--- str:    string
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void fprint_json_string(FILE *fp, const char *str){
+const char *c;
+
+
+  fputc('"', fp);
+
+  for (c=str; *c != '\0'; c++){
+    if (*c == '"' || *c == '\\'){
+      fputc('\\', fp); fputc(*c, fp);
+    } else if ((unsigned char)*c < 0x20){
+      fprintf(fp, "\\u%04x", (unsigned char)*c);
+    } else {
+      fputc(*c, fp);
+    }
+  }
+
+  fputc('"', fp);
+
+  return;
+}
+
+
+/** This function writes a file of the Zarr store. The file is written 
++++ under a temporary name, and then renamed, such that readers - and 
++++ concurrent writers of the same file - never see partial files.
+--- fname:   filename
+--- content: content
+--- n:       number of bytes
++++ Return:  SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_zarr_file(const char *fname, const char *content, size_t n){
+char tname[NPOW_10];
+FILE *fp = NULL;
+int nchar;
+
+
+  nchar = snprintf(tname, NPOW_10, "%s.%d.tmp", fname, (int)getpid());
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+  if ((fp = fopen(tname, "wb")) == NULL){
+    printf("Unable to create %s. ", tname); return FAILURE;}
+
+  if (fwrite(content, 1, n, fp) != n){
+    printf("Unable to write %s. ", tname);
+    fclose(fp); unlink(tname); return FAILURE;}
+
+  if (fclose(fp) != 0 || rename(tname, fname) != 0){
+    printf("Unable to finalize %s. ", fname);
+    unlink(tname); return FAILURE;}
+
+  return SUCCESS;
+}
+
+
+/** This function writes the array (.zarray) and attribute (.zattrs) meta-
++++ data. The attributes follow the xarray convention for dimension names,
++++ and hold the FORCE metadata and georeference.
+--- brick:  brick
+--- dname:  Zarr store
+--- bands:  bands of the brick to write
+--- nbands: number of bands to write
+--- zarr:   chunk layout
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_zarr_metadata(brick_t *brick, const char *dname, int *bands, int nbands, zarr_layout_t *zarr){
+char fname[NPOW_10];
+char ldate[NPOW_05];
+char *buf = NULL;
+size_t size = 0;
+FILE *fp = NULL;
+int b, nchar;
+
+
+  // array metadata
+  if ((fp = open_memstream(&buf, &size)) == NULL) return FAILURE;
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"zarr_format\": 2,\n");
+  fprintf(fp, "  \"shape\": [%d, %d, %d],\n", nbands, brick->ny, brick->nx);
+  fprintf(fp, "  \"chunks\": [%d, %d, %d],\n", zarr->tc, zarr->cy, zarr->cx);
+  fprintf(fp, "  \"dtype\": \"%s\",\n", zarr_dtype(brick->datatype));
+  if (zarr->compress == _ZARR_ZLIB_){
+    fprintf(fp, "  \"compressor\": {\"id\": \"zlib\", \"level\": %d},\n", zarr->level);
+  } else {
+    fprintf(fp, "  \"compressor\": null,\n");
+  }
+  fprintf(fp, "  \"fill_value\": %d,\n", brick->nodata[bands[0]]);
+  fprintf(fp, "  \"order\": \"C\",\n");
+  fprintf(fp, "  \"filters\": null,\n");
+  fprintf(fp, "  \"dimension_separator\": \".\"\n");
+  fprintf(fp, "}\n");
+  fclose(fp);
+
+  nchar = snprintf(fname, NPOW_10, "%s/.zarray", dname);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); free(buf); return FAILURE;}
+
+  if (write_zarr_file(fname, buf, size) == FAILURE){ free(buf); return FAILURE;}
+  free(buf); buf = NULL; size = 0;
+
+
+  // attributes
+  if ((fp = open_memstream(&buf, &size)) == NULL) return FAILURE;
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"_ARRAY_DIMENSIONS\": [\"band\", \"y\", \"x\"],\n");
+  fprintf(fp, "  \"FORCE_version\": "); fprint_json_string(fp, _VERSION_); fprintf(fp, ",\n");
+  fprintf(fp, "  \"FORCE_description\": "); fprint_json_string(fp, brick->name); fprintf(fp, ",\n");
+  fprintf(fp, "  \"FORCE_product\": "); fprint_json_string(fp, brick->product); fprintf(fp, ",\n");
+  fprintf(fp, "  \"geotransform\": [%.10f, %.10f, %.10f, %.10f, %.10f, %.10f],\n",
+    brick->geotran[0], brick->geotran[1], brick->geotran[2], 
+    brick->geotran[3], brick->geotran[4], brick->geotran[5]);
+  fprintf(fp, "  \"crs_wkt\": "); fprint_json_string(fp, brick->proj); fprintf(fp, ",\n");
+
+  fprintf(fp, "  \"band_names\": [");
+  for (b=0; b<nbands; b++){
+    if (b > 0) fprintf(fp, ", ");
+    fprint_json_string(fp, interned_string(brick->bandname[bands[b]]));
+  }
+  fprintf(fp, "],\n");
+
+  fprintf(fp, "  \"dates\": [");
+  for (b=0; b<nbands; b++){
+    if (b > 0) fprintf(fp, ", ");
+    get_brick_longdate(brick, bands[b], ldate, NPOW_05-1);
+    fprint_json_string(fp, ldate);
+  }
+  fprintf(fp, "],\n");
+
+  fprintf(fp, "  \"domain\": [");
+  for (b=0; b<nbands; b++){
+    if (b > 0) fprintf(fp, ", ");
+    fprint_json_string(fp, interned_string(brick->domain[bands[b]]));
+  }
+  fprintf(fp, "],\n");
+
+  fprintf(fp, "  \"wavelength\": [");
+  for (b=0; b<nbands; b++) fprintf(fp, "%s%.3f", (b > 0) ? ", " : "", brick->wavelength[bands[b]]);
+  fprintf(fp, "],\n");
+
+  fprintf(fp, "  \"scale\": [");
+  for (b=0; b<nbands; b++) fprintf(fp, "%s%.3f", (b > 0) ? ", " : "", brick->scale[bands[b]]);
+  fprintf(fp, "],\n");
+
+  fprintf(fp, "  \"nodata\": [");
+  for (b=0; b<nbands; b++) fprintf(fp, "%s%d", (b > 0) ? ", " : "", brick->nodata[bands[b]]);
+  fprintf(fp, "]\n");
+
+  fprintf(fp, "}\n");
+  fclose(fp);
+
+  nchar = snprintf(fname, NPOW_10, "%s/.zattrs", dname);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); free(buf); return FAILURE;}
+
+  if (write_zarr_file(fname, buf, size) == FAILURE){ free(buf); return FAILURE;}
+  free(buf);
+
+  return SUCCESS;
+}
+
+
+/** This function writes one chunk of a Zarr array. Band and row chunks 
++++ that exceed the array are padded with the fill value, as required.
+--- brick:  brick
+--- dname:  Zarr store
+--- bands:  bands of the brick to write
+--- nbands: number of bands to write
+--- zarr:   chunk layout
+--- bc:     band chunk
+--- yc:     row chunk
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_zarr_chunk(brick_t *brick, const char *dname, int *bands, int nbands, zarr_layout_t *zarr, int bc, int yc){
+char fname[NPOW_10];
+size_t lbytes = (size_t)zarr->cx*brick->byte;
+size_t bbytes = lbytes*zarr->cy;
+size_t nraw = bbytes*zarr->tc;
+uLongf ncmp;
+char *raw = NULL;
+Bytef *cmp = NULL;
+const char *src = NULL;
+int b, b_, y, y_, yoff, nchar;
+int x, p;
+float nodata;
+
+
+  alloc((void**)&raw, nraw, sizeof(char));
+
+  // row offset in the brick, bricks in block mode hold one chunk only
+  yoff = (brick->open == OPEN_BLOCK) ? 0 : yc*zarr->cy;
+
+  for (b=0; b<zarr->tc; b++){
+
+    b_ = bc*zarr->tc + b;
+
+    for (y=0; y<zarr->cy; y++){
+
+      y_ = yc*zarr->cy + y;
+
+      if (b_ < nbands && y_ < brick->ny){
+        switch (brick->datatype){
+          case _DT_SHORT_:  src = (const char*)get_band_short(brick, bands[b_]);  break;
+          case _DT_SMALL_:  src = (const char*)get_band_small(brick, bands[b_]);  break;
+          case _DT_FLOAT_:  src = (const char*)get_band_float(brick, bands[b_]);  break;
+          case _DT_INT_:    src = (const char*)get_band_int(brick, bands[b_]);    break;
+          case _DT_USHORT_: src = (const char*)get_band_ushort(brick, bands[b_]); break;
+        }
+        memcpy(raw + b*bbytes + y*lbytes, src + (size_t)(yoff+y)*lbytes, lbytes);
+      } else {
+        nodata = brick->nodata[bands[0]];
+        for (x=0, p=(zarr->cy*b+y)*zarr->cx; x<zarr->cx; x++, p++){
+          switch (brick->datatype){
+            case _DT_SHORT_:  ((short*)raw)[p]  = (short)nodata;  break;
+            case _DT_SMALL_:  ((small*)raw)[p]  = (small)nodata;  break;
+            case _DT_FLOAT_:  ((float*)raw)[p]  = nodata;         break;
+            case _DT_INT_:    ((int*)raw)[p]    = (int)nodata;    break;
+            case _DT_USHORT_: ((ushort*)raw)[p] = (ushort)nodata; break;
+          }
+        }
+      }
+
+    }
+
+  }
+
+  nchar = snprintf(fname, NPOW_10, "%s/%d.%d.0", dname, bc, yc);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); free((void*)raw); return FAILURE;}
+
+  if (zarr->compress == _ZARR_ZLIB_){
+
+    ncmp = compressBound(nraw);
+    alloc((void**)&cmp, ncmp, sizeof(Bytef));
+
+    if (compress2(cmp, &ncmp, (const Bytef*)raw, nraw, zarr->level) != Z_OK){
+      printf("Unable to compress chunk %s. ", fname);
+      free((void*)raw); free((void*)cmp); return FAILURE;}
+
+    if (write_zarr_file(fname, (const char*)cmp, ncmp) == FAILURE){
+      free((void*)raw); free((void*)cmp); return FAILURE;}
+
+    free((void*)cmp);
+
+  } else {
+
+    if (write_zarr_file(fname, raw, nraw) == FAILURE){
+      free((void*)raw); return FAILURE;}
+
+  }
+
+  free((void*)raw);
+
+  return SUCCESS;
+}
+
+
+/** This function writes a brick to a Zarr store. In block mode, only the
++++ chunks of the current block are written. The metadata are written
++++ with the first block, or if they do not exist yet. Nothing is read 
++++ back, and no lock is needed, thus UPDATE and MERGE mode are not sup-
++++ ported.
+--- brick:  brick
+--- fname:  Zarr store (directory)
+--- bands:  bands of the brick to write
+--- nbands: number of bands to write
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_zarr_store(brick_t *brick, const char *fname, int *bands, int nbands){
+zarr_layout_t zarr;
+char mname[NPOW_10];
+int bc, yc, yc0, yc1, nchar;
+struct stat st;
+
+
+  if (brick->open == OPEN_UPDATE || brick->open == OPEN_MERGE){
+    printf("Zarr output does not support UPDATE or MERGE mode. "); return FAILURE;}
+
+  if (zarr_dtype(brick->datatype) == NULL){
+    printf("unknown datatype for Zarr output. "); return FAILURE;}
+
+  zarr_layout(brick, nbands, &zarr);
+
+  if (brick->open == OPEN_BLOCK && 
+     (brick->cx != brick->nx || brick->cy != zarr.cy || brick->chunk < 0)){
+    printf("Zarr output needs full-width chunks. "); return FAILURE;}
+
+  if (mkdir(fname, 0775) != 0 && errno != EEXIST){
+    printf("Unable to create Zarr store %s. ", fname); return FAILURE;}
+
+  nchar = snprintf(mname, NPOW_10, "%s/.zarray", fname);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+  if (brick->open != OPEN_BLOCK || brick->chunk == 0 || stat(mname, &st) != 0){
+    if (write_zarr_metadata(brick, fname, bands, nbands, &zarr) == FAILURE) return FAILURE;
+  }
+
+  if (brick->open == OPEN_BLOCK){
+    yc0 = brick->chunk; yc1 = brick->chunk+1;
+  } else {
+    yc0 = 0; yc1 = zarr.nyc;
+  }
+
+  for (yc=yc0; yc<yc1; yc++){
+  for (bc=0; bc<zarr.nbc; bc++){
+    if (write_zarr_chunk(brick, fname, bands, nbands, &zarr, bc, yc) == FAILURE) return FAILURE;
+  }
+  }
+
+  return SUCCESS;
+}
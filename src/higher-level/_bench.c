@@ -0,0 +1,926 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This program benchmarks the higher level kernels on synthetic ARD. The
+processing module and its settings are taken from a parameter file, the
+input data are generated in memory, i.e. no data are read or written.
+The timings of all processing stages are written as CSV. Alternatively,
+the module is run on the CPU and on the GPU, and the outputs and timings
+are compared.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include <ctype.h>   // testing and mapping characters
+#include <unistd.h>  // standard symbolic constants and types
+#include <string.h>  // string handling functions
+#include <math.h>    // common mathematical functions
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/alloc-cl.h"
+#include "../cross-level/brick-cl.h"
+#include "../cross-level/cube-cl.h"
+#include "../cross-level/date-cl.h"
+#include "../cross-level/gpu-cl.h"
+#include "../cross-level/konami-cl.h"
+#include "../cross-level/quality-cl.h"
+#include "../cross-level/profile-cl.h"
+#include "../higher-level/tasks-hl.h"
+#include "../higher-level/plan-hl.h"
+#include "../higher-level/param-hl.h"
+#include "../higher-level/read-ard-hl.h"
+#include "../higher-level/rf-hl.h"
+#include "../higher-level/py-udf-hl.h"
+
+/** Geospatial Data Abstraction Library (GDAL) **/
+#include "gdal.h"           // public (C callable) GDAL entry points
+
+/** OpenMP **/
+#include <omp.h> // multi-platform shared memory multiprocessing
+
+
+// number of trees and tree depth of the synthetic random forest
+#define BENCH_NTREE 100
+#define BENCH_DEPTH 12
+
+// number of samples that are predicted per task
+#define BENCH_BATCH 4096
+
+// maximum share of nodata mismatches for CPU/GPU parity
+#define BENCH_MISMATCH 1e-4
+
+
+typedef struct {
+  int n;
+  char fprm[NPOW_10];
+  char fout[NPOW_10];
+  int nt;
+  int nx;
+  int nf;
+  float cloud;
+  int repeat;
+  unsigned int seed;
+  bool parity;
+  double tol;
+} args_t;
+
+typedef struct {
+  double max;      // maximum absolute difference
+  double sum;      // sum of absolute differences
+  size_t n;        // number of compared pixels (valid in both)
+  size_t mismatch; // number of pixels that are nodata in one output only
+  size_t total;    // number of pixels
+} parity_t;
+
+
+void usage(char *exe, int exit_code){
+
+
+  printf("Usage: %s [-h] [-v] [-i] [-t nt] [-n nx] [-c cloud] [-f nf]\n", exe);
+  printf("          [-r repeat] [-s seed] [-p] [-d tolerance] [-o output-file]\n");
+  printf("          parameter-file\n");
+  printf("\n");
+  printf("  -h  = show this help\n");
+  printf("  -v  = show version\n");
+  printf("  -i  = show program's purpose\n");
+  printf("\n");
+  printf("  -t nt = number of observations (ARD input)\n");
+  printf("     default: 100; feature input: number of features in parameter file\n");
+  printf("  -n nx = number of pixels in x and y of the synthetic block\n");
+  printf("     default: 300\n");
+  printf("  -c cloud = fraction of cloudy pixels (ARD) or nodata (features)\n");
+  printf("     default: 0.3\n");
+  printf("  -f nf = number of features of the random forest microbenchmark\n");
+  printf("     default: 10, 0 disables the microbenchmark\n");
+  printf("  -r repeat = number of repetitions\n");
+  printf("     default: 3\n");
+  printf("  -s seed = seed of the random number generator\n");
+  printf("     default: 1\n");
+  printf("  -p  = CPU/GPU parity: the module is run with and without GPU on\n");
+  printf("     identical input, and the outputs are compared. Differences,\n");
+  printf("     nodata mismatches and speedup are written instead of timings\n");
+  printf("  -d tolerance = maximum absolute difference for CPU/GPU parity\n");
+  printf("     default: 1\n");
+  printf("  -o output-file = CSV file, the results are appended\n");
+  printf("     default: standard output\n");
+  printf("\n");
+  printf("  Positional arguments:\n");
+  printf("  - 'parameter-file': parameter file for any higher level submodule\n");
+  printf("    that does not need secondary input. Processing module, sensors,\n");
+  printf("    date range, QAI screening and module settings are used, the\n");
+  printf("    ARD are synthesized. The compute threads are used.\n");
+  printf("\n");
+
+  exit(exit_code);
+  return;
+}
+
+
+void parse_args(int argc, char *argv[], args_t *args){
+int opt;
+
+
+  opterr = 0;
+
+  args->fout[0] = '\0';
+  args->nt = 100;
+  args->nx = 300;
+  args->nf = 10;
+  args->cloud = 0.3;
+  args->repeat = 3;
+  args->seed = 1;
+  args->parity = false;
+  args->tol = 1;
+
+  // optional parameters
+  while ((opt = getopt(argc, argv, "hvit:n:c:f:r:s:pd:o:")) != -1){
+    switch(opt){
+      case 't':
+        args->nt = atoi(optarg);
+        if (args->nt < 1){
+          fprintf(stderr, "number of observations must be >= 1.\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'n':
+        args->nx = atoi(optarg);
+        if (args->nx < 1){
+          fprintf(stderr, "number of pixels must be >= 1.\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'c':
+        args->cloud = atof(optarg);
+        if (args->cloud < 0 || args->cloud > 1){
+          fprintf(stderr, "cloud fraction must be in [0,1].\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'f':
+        args->nf = atoi(optarg);
+        if (args->nf < 0){
+          fprintf(stderr, "number of features must be >= 0.\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'r':
+        args->repeat = atoi(optarg);
+        if (args->repeat < 1){
+          fprintf(stderr, "number of repetitions must be >= 1.\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 's':
+        args->seed = (unsigned int)atoi(optarg);
+        break;
+      case 'p':
+        args->parity = true;
+        break;
+      case 'd':
+        args->tol = atof(optarg);
+        if (args->tol < 0){
+          fprintf(stderr, "tolerance must be >= 0.\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'o':
+        copy_string(args->fout, NPOW_10, optarg);
+        break;
+      case 'h':
+        usage(argv[0], SUCCESS);
+      case 'v':
+        printf("FORCE version: %s\n", _VERSION_);
+        exit(SUCCESS);
+      case 'i':
+        printf("Benchmark of higher level kernels on synthetic ARD\n");
+        exit(SUCCESS);
+      case '?':
+        if (isprint(optopt)){
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        } else {
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        }
+        usage(argv[0], FAILURE);
+      default:
+        fprintf(stderr, "Error parsing arguments.\n");
+        usage(argv[0], FAILURE);
+    }
+  }
+
+  // non-optional parameters
+  args->n = 1;
+
+  if (optind < argc){
+    konami_args(argv[optind]);
+    if (argc-optind == args->n){
+      copy_string(args->fprm, NPOW_10, argv[optind++]);
+    } else if (argc-optind < args->n){
+      fprintf(stderr, "some non-optional arguments are missing.\n");
+      usage(argv[0], FAILURE);
+    } else if (argc-optind > args->n){
+      fprintf(stderr, "too many non-optional arguments.\n");
+      usage(argv[0], FAILURE);
+    }
+  } else {
+    fprintf(stderr, "non-optional arguments are missing.\n");
+    usage(argv[0], FAILURE);
+  }
+
+  return;
+}
+
+
+/** This function compiles a datacube that consists of one square block
+--- nx:     number of pixels in x and y
+--- res:    spatial resolution
++++ Return: datacube
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+cube_t *synthetic_cube(int nx, double res){
+cube_t *cube = NULL;
+
+
+  cube = allocate_datacube();
+
+  cube->tilesize  = nx*res;
+  cube->chunksize = nx*res;
+  cube->cn = 1;
+  update_datacube_res(cube, res);
+  update_datacube_extent(cube, 0, 0, 0, 0);
+
+  return cube;
+}
+
+
+/** This function synthesizes a block of auxiliary ARD
+--- fname:  filename of the reflectance product
+--- prd:    product tag
+--- sen:    sensor parameters
+--- value:  value of all pixels
+--- cube:   datacube
++++ Return: image brick
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t *synthetic_aux(char *fname, const char *prd, par_sen_t *sen, short value, cube_t *cube){
+brick_t *brick = NULL;
+char temp[NPOW_10];
+char *pch = NULL;
+short *brick_ = NULL;
+int p, nc;
+
+
+  copy_string(temp, NPOW_10, fname);
+  pch = strstr(temp, "BOA");
+  strncpy(pch, prd, 3);
+
+  if ((brick = nodata_block(temp, _ARD_AUX_, sen, 1, -9999, _DT_SHORT_, 0, 0, 0, cube)) == NULL ||
+      (brick_ = get_band_short(brick, 0)) == NULL) return NULL;
+
+  nc = get_brick_chunkncells(brick);
+  for (p=0; p<nc; p++) brick_[p] = value;
+
+  return brick;
+}
+
+
+/** This function synthesizes ARD. The observations are spread evenly
++++ over the date range, and cycle through the sensors. Reflectance fol-
++++ lows a seasonal cycle with opposite sign in alternating bands (such
++++ that spectral indices vary), plus noise. Cloudy pixels are bright and
++++ flagged in the QAI. Auxiliary products are synthesized if used.
+--- nt:     number of observations
+--- cloud:  fraction of cloudy pixels
+--- seed:   seed of the random number generator
+--- cube:   datacube
+--- phl:    HL parameters
++++ Return: ARD
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+ard_t *synthetic_ard(int nt, float cloud, unsigned int seed, cube_t *cube, par_hl_t *phl){
+ard_t *ard = NULL;
+char fname[NPOW_10];
+char cdate[NPOW_04];
+int t, b, p, nb, nc, nchar, ce, y, m, d, doy;
+int error = 0;
+unsigned int state;
+float season, noise;
+bool cloudy;
+
+
+  alloc((void**)&ard, nt, sizeof(ard_t));
+
+  #pragma omp parallel for private(fname,cdate,b,p,nb,nc,nchar,ce,y,m,d,doy,state,season,noise,cloudy) shared(ard,nt,cloud,seed,cube,phl) reduction(+: error) default(none)
+  for (t=0; t<nt; t++){
+
+    state = seed + t;
+
+    ce = phl->date_range[_MIN_].ce;
+    if (nt > 1) ce += (int)((double)t*(phl->date_range[_MAX_].ce-phl->date_range[_MIN_].ce)/(nt-1));
+    ce2date(ce, &y, &m, &d);
+    ce2doy(ce, &doy, &y);
+    compact_date(y, m, d, cdate, NPOW_04);
+
+    nchar = snprintf(fname, NPOW_10, "%s_LEVEL2_%s_BOA.tif", cdate, phl->sen.sensor[t % phl->sen.n]);
+    if (nchar < 0 || nchar >= NPOW_10){
+      printf("Buffer Overflow in assembling filename\n"); error++; continue;}
+
+    if ((ard[t].DAT = nodata_block(fname, _ARD_REF_, &phl->sen, 0, -9999, _DT_SHORT_, 0, 0, 0, cube)) == NULL ||
+        (ard[t].dat = get_bands_short(ard[t].DAT)) == NULL){
+      printf("Error synthesizing main product %s. ", fname); error++; continue;}
+
+    if ((ard[t].QAI = synthetic_aux(fname, "QAI", &phl->sen, 0, cube)) == NULL ||
+        (ard[t].qai = get_band_short(ard[t].QAI, 0)) == NULL){
+      printf("Error synthesizing QAI product %s. ", fname); error++; continue;}
+
+    nb = get_brick_nbands(ard[t].DAT);
+    nc = get_brick_chunkncells(ard[t].DAT);
+
+    season = 0.5 - 0.5*cos(2*M_PI*(doy-30)/365.0);
+
+    for (p=0; p<nc; p++){
+
+      cloudy = rand_r(&state) < cloud*RAND_MAX;
+
+      if (cloudy) set_cloud(ard[t].QAI, p, 2);
+
+      for (b=0; b<nb; b++){
+        noise = (rand_r(&state)%201) - 100;
+        if (cloudy){
+          ard[t].dat[b][p] = (short)(6000 + noise);
+        } else if (b % 2){
+          ard[t].dat[b][p] = (short)(1500 + 3000*season + noise);
+        } else {
+          ard[t].dat[b][p] = (short)(1200 - 800*season + noise);
+        }
+      }
+
+    }
+
+    if (phl->prd.dst){
+      if ((ard[t].DST = synthetic_aux(fname, "DST", &phl->sen, 1000, cube)) == NULL ||
+          (ard[t].dst = get_band_short(ard[t].DST, 0)) == NULL){
+        printf("Error synthesizing DST product %s. ", fname); error++;}
+    }
+
+    if (phl->prd.aod){
+      if ((ard[t].AOD = synthetic_aux(fname, "AOD", &phl->sen, 150, cube)) == NULL ||
+          (ard[t].aod = get_band_short(ard[t].AOD, 0)) == NULL){
+        printf("Error synthesizing AOD product %s. ", fname); error++;}
+    }
+
+    if (phl->prd.hot){
+      if ((ard[t].HOT = synthetic_aux(fname, "HOT", &phl->sen, -500, cube)) == NULL ||
+          (ard[t].hot = get_band_short(ard[t].HOT, 0)) == NULL){
+        printf("Error synthesizing HOT product %s. ", fname); error++;}
+    }
+
+    if (phl->prd.vzn){
+      if ((ard[t].VZN = synthetic_aux(fname, "VZN", &phl->sen, 500, cube)) == NULL ||
+          (ard[t].vzn = get_band_short(ard[t].VZN, 0)) == NULL){
+        printf("Error synthesizing VZN product %s. ", fname); error++;}
+    }
+
+    if (phl->prd.wvp){
+      if ((ard[t].WVP = synthetic_aux(fname, "WVP", &phl->sen, 2000, cube)) == NULL ||
+          (ard[t].wvp = get_band_short(ard[t].WVP, 0)) == NULL){
+        printf("Error synthesizing WVP product %s. ", fname); error++;}
+    }
+
+  }
+
+  if (error > 0){
+    printf("%d synthesizing errors. ", error);
+    free_ard(ard, nt);
+    return NULL;
+  }
+
+  return ard;
+}
+
+
+/** This function synthesizes features, one band per feature. Values are
++++ uniformly distributed in [0,10000], and nodata at the given fraction.
+--- nt:     number of features (returned)
+--- cloud:  fraction of nodata pixels
+--- seed:   seed of the random number generator
+--- cube:   datacube
+--- phl:    HL parameters
++++ Return: features
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+ard_t *synthetic_features(int *nt, float cloud, unsigned int seed, cube_t *cube, par_hl_t *phl){
+ard_t *features = NULL;
+int f, p, nc;
+int error = 0;
+unsigned int state;
+
+
+  alloc((void**)&features, phl->ftr.nfeature, sizeof(ard_t));
+
+  #pragma omp parallel for private(p,nc,state) shared(features,cloud,seed,cube,phl) reduction(+: error) default(none)
+  for (f=0; f<phl->ftr.nfeature; f++){
+
+    state = seed + f;
+
+    if ((features[f].DAT = nodata_block(phl->ftr.bname[f], _ARD_FTR_, NULL, 1, phl->ftr.nodata, _DT_SHORT_, 0, 0, 0, cube)) == NULL ||
+        (features[f].dat = get_bands_short(features[f].DAT)) == NULL){
+      printf("Error synthesizing feature %s. ", phl->ftr.bname[f]); error++; continue;}
+
+    if ((features[f].QAI = copy_brick(features[f].DAT, 1, _DT_SHORT_)) == NULL ||
+        (features[f].qai = get_band_short(features[f].QAI, 0)) == NULL){
+      printf("Error compiling feature %s.", phl->ftr.bname[f]); error++; continue;}
+
+    nc = get_brick_chunkncells(features[f].DAT);
+
+    for (p=0; p<nc; p++){
+      if (rand_r(&state) < cloud*RAND_MAX){
+        features[f].dat[0][p] = phl->ftr.nodata;
+        set_off(features[f].QAI, p, true);
+      } else {
+        features[f].dat[0][p] = (short)(rand_r(&state)%10001);
+      }
+    }
+
+  }
+
+  if (error > 0){
+    printf("%d synthesizing errors. ", error);
+    free_ard(features, phl->ftr.nfeature);
+    *nt = 0;
+    return NULL;
+  }
+
+  *nt = phl->ftr.nfeature;
+  return features;
+}
+
+
+/** This function synthesizes a random forest for regression. All trees
++++ are complete, i.e. each sample takes the maximum number of steps.
+--- nfeature: number of features
+--- seed:     seed of the random number generator
++++ Return:   flat random forest
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+rf_flat_t *synthetic_forest(int nfeature, unsigned int seed){
+rf_flat_t *rf = NULL;
+int nnode = (1 << (BENCH_DEPTH+1)) - 1;
+int ninner = (1 << BENCH_DEPTH) - 1;
+int t, k, node;
+unsigned int state = seed;
+
+
+  rf = allocate_rf_flat(BENCH_NTREE, BENCH_NTREE*nnode, nfeature, 0);
+
+  for (t=0; t<BENCH_NTREE; t++){
+
+    rf->root[t]  = t*nnode;
+    rf->depth[t] = BENCH_DEPTH;
+
+    for (k=0; k<nnode; k++){
+
+      node = rf->root[t] + k;
+
+      if (k < ninner){
+        rf->var[node] = rand_r(&state) % nfeature;
+        rf->thr[node] = (rand_r(&state)%10001)/10000.0;
+        rf->child[2*node]   = rf->root[t] + 2*k+1;
+        rf->child[2*node+1] = rf->root[t] + 2*k+2;
+      } else {
+        // leaves point to themselves
+        rf->child[2*node]   = node;
+        rf->child[2*node+1] = node;
+        rf->value[node] = rand_r(&state)%10001;
+      }
+
+    }
+
+  }
+
+  return rf;
+}
+
+
+/** This function predicts samples with a flat random forest in parallel
++++ batches, as the ML module does
+--- rf:     flat random forest
+--- x:      samples
+--- n:      number of samples
+--- pred:   predictions (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void bench_forest(rf_flat_t *rf, float *x, int n, float *pred){
+int i, nb;
+
+
+  #pragma omp parallel for private(nb) shared(rf,x,n,pred) schedule(dynamic,1) default(none)
+  for (i=0; i<n; i+=BENCH_BATCH){
+    if ((nb = n-i) > BENCH_BATCH) nb = BENCH_BATCH;
+    rf_flat_predict(rf, x + (size_t)i*rf->nfeature, NULL, nb, pred+i, NULL);
+  }
+
+  return;
+}
+
+
+/** This function runs one repetition of the module on synthetic input.
++++ The sequence is the same as in compute_higher_level. Synthesizing the
++++ input is not timed, all other stages are profiled.
+--- args:   arguments
+--- phl:    HL parameters
+--- cube:   datacube
+--- aux:    auxilliary data
+--- repeat: repetition
+--- nt:     number of observations / features (returned)
+--- nprod:  number of output bricks (returned)
++++ Return: OUTPUT bricks
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t **bench_module(args_t *args, par_hl_t *phl, cube_t *cube, aux_t *aux, int repeat, int *nt, int *nprod){
+ard_t *ard = NULL;
+brick_t **OUTPUT = NULL;
+gpu_stream_t stream;
+char id[NPOW_10];
+int nchar;
+
+
+  *nprod = 0;
+
+  if (phl->input_level1 == _INP_FTR_){
+    ard = synthetic_features(nt, args->cloud, args->seed, cube, phl);
+  } else {
+    *nt = args->nt;
+    ard = synthetic_ard(*nt, args->cloud, args->seed, cube, phl);
+  }
+
+  if (ard == NULL){
+    printf("Synthesizing input failed!\n"); return NULL;}
+
+  nchar = snprintf(id, NPOW_10, "%s-%d", module_name(phl->type), repeat);
+  if (nchar < 0 || nchar >= NPOW_10){
+    printf("Buffer Overflow in assembling id\n"); free_ard(ard, *nt); return NULL;}
+
+  start_profile(id);
+
+  if (phl->gpu && phl->type != _HL_L2I_ && phl->type != _HL_CFI_){
+    stream = claim_gpu_stream();
+    upload_ard(ard, *nt, stream);
+    gpu_sync(stream);
+    lap_profile("upload");
+  }
+
+  if (screen_qai(ard, *nt, NULL, &phl->qai, phl->input_level1) != SUCCESS){
+    printf("Screening QAI failed!\n"); free_ard(ard, *nt); return NULL;}
+  lap_profile("screen_qai");
+
+  if (phl->input_level1 == _INP_ARD_ || phl->input_level1 == _INP_QAI_){
+    if (screen_noise(ard, *nt, NULL, &phl->qai) == FAILURE){
+      printf("Screening noise failed!\n"); free_ard(ard, *nt); return NULL;}
+    lap_profile("screen_noise");
+  }
+
+  compact_ard(ard, *nt, phl);
+  if (index_ard(ard, *nt, NULL) == FAILURE){
+    printf("Indexing valid observations failed!\n"); free_ard(ard, *nt); return NULL;}
+  lap_profile("compact");
+
+  if (phl->input_level1 == _INP_ARD_){
+    if (spectral_adjust(ard, NULL, *nt, phl) == FAILURE){
+      printf("Spectral adjustment failed!\n"); free_ard(ard, *nt); return NULL;}
+    lap_profile("adjust");
+  }
+
+  // kernels are profiled within the module, the rest goes here
+  OUTPUT = compute_module(ard, NULL, NULL, *nt, 0, cube, phl, aux, nprod);
+  lap_profile("module");
+
+  free_ard(ard, *nt);
+
+  return OUTPUT;
+}
+
+
+/** This function frees the output bricks of a module
+--- OUTPUT: OUTPUT bricks
+--- nprod:  number of output bricks
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_output(brick_t **OUTPUT, int nprod){
+int o;
+
+
+  if (OUTPUT == NULL) return;
+
+  for (o=0; o<nprod; o++) free_brick(OUTPUT[o]);
+  free((void*)OUTPUT);
+
+  return;
+}
+
+
+/** This function sums up the wall time of all profiled stages
++++ Return: wall time in seconds
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double profile_wall(){
+int s;
+double wall = 0;
+
+
+  for (s=0; s<_profile_.n; s++) wall += _profile_.wall[s];
+
+  return wall;
+}
+
+
+/** This function compares the CPU and GPU output of one product. Pixels
++++ that are nodata in both outputs are skipped, pixels that are nodata in
++++ one output only are counted as mismatch.
+--- CPU:    output brick computed on the CPU
+--- GPU:    output brick computed on the GPU
++++ Return: parity statistics
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+parity_t compare_output(brick_t *CPU, brick_t *GPU){
+parity_t par;
+int b, p, nb, nc;
+float cpu, gpu, nodata;
+double d;
+bool cpu_nodata, gpu_nodata;
+
+
+  memset(&par, 0, sizeof(parity_t));
+
+  nb = get_brick_nbands(CPU);
+  nc = get_brick_chunkncells(CPU);
+
+  if (get_brick_nbands(GPU) != nb || get_brick_chunkncells(GPU) != nc){
+    par.total = par.mismatch = (size_t)nb*nc;
+    return par;
+  }
+
+  for (b=0; b<nb; b++){
+
+    nodata = get_brick_nodata(CPU, b);
+
+    for (p=0; p<nc; p++){
+
+      cpu = get_brick(CPU, b, p);
+      gpu = get_brick(GPU, b, p);
+
+      cpu_nodata = (cpu == nodata);
+      gpu_nodata = (gpu == nodata);
+
+      par.total++;
+
+      if (cpu_nodata && gpu_nodata) continue;
+
+      if (cpu_nodata != gpu_nodata){
+        par.mismatch++;
+        continue;
+      }
+
+      d = fabs(cpu-gpu);
+      if (d > par.max) par.max = d;
+      par.sum += d;
+      par.n++;
+
+    }
+
+  }
+
+  return par;
+}
+
+
+/** This function writes the profile of one repetition as CSV
+--- fp:     file
+--- phl:    HL parameters
+--- args:   arguments
+--- nt:     number of observations / features
+--- nc:     number of pixels
+--- repeat: repetition
+--- OUTPUT: output bricks
+--- nprod:  number of output bricks
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void write_bench(FILE *fp, par_hl_t *phl, args_t *args, int nt, int nc, int repeat, brick_t **OUTPUT, int nprod){
+double output = 0;
+int s, o;
+
+
+  for (o=0; o<nprod; o++) output += get_brick_memory(OUTPUT[o]);
+
+  for (s=0; s<_profile_.n; s++){
+    fprintf(fp, "%s,%s,%s,%d,%d,%d,%.3f,%d,%d,%d,%d,%.6f,%.6f,%.0f,%.0f\n",
+      module_name(phl->type), _profile_.stage[s], (phl->gpu) ? "gpu" : "cpu",
+      nt, nc, args->nf, args->cloud, phl->cthread, args->seed, repeat,
+      _profile_.calls[s], _profile_.wall[s], _profile_.cpu[s], _profile_.peak[s], output);
+  }
+
+  fflush(fp);
+
+  return;
+}
+
+
+/** This function runs the module on the CPU and on the GPU with identical
++++ input, and writes one CSV row per output product with differences,
++++ nodata mismatches and speedup (including transfers). The GPU path is
++++ recommended as default if the outputs agree within tolerance, and if 
++++ it is faster.
+--- fp:     file
+--- args:   arguments
+--- phl:    HL parameters
+--- cube:   datacube
+--- aux:    auxilliary data
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int parity_bench(FILE *fp, args_t *args, par_hl_t *phl, cube_t *cube, aux_t *aux){
+brick_t **CPU = NULL;
+brick_t **GPU = NULL;
+parity_t par;
+char product[NPOW_10];
+double wall_cpu, wall_gpu, speedup, share;
+int nt, nprod_cpu, nprod_gpu, r, o;
+bool device;
+
+
+  for (r=0; r<args->repeat; r++){
+
+    phl->gpu = false;
+    CPU = bench_module(args, phl, cube, aux, r, &nt, &nprod_cpu);
+    wall_cpu = profile_wall();
+
+    phl->gpu = true;
+    GPU = bench_module(args, phl, cube, aux, r, &nt, &nprod_gpu);
+    wall_gpu = profile_wall();
+
+    if (CPU == NULL || GPU == NULL || nprod_cpu != nprod_gpu){
+      printf("CPU and GPU outputs are incompatible.\n");
+      free_output(CPU, nprod_cpu);
+      free_output(GPU, nprod_gpu);
+      return FAILURE;
+    }
+
+    speedup = (wall_gpu > 0) ? wall_cpu/wall_gpu : 0;
+
+    for (o=0; o<nprod_cpu; o++){
+
+      par = compare_output(CPU[o], GPU[o]);
+      share = (par.total > 0) ? (double)par.mismatch/par.total : 0;
+
+      device = par.max <= args->tol && share <= BENCH_MISMATCH && speedup > 1;
+
+      get_brick_product(CPU[o], product, NPOW_10);
+
+      fprintf(fp, "%s,%s,%d,%d,%.3f,%d,%d,%d,%.3f,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%s\n",
+        module_name(phl->type), product, nt, get_brick_chunkncells(CPU[o]), 
+        args->cloud, phl->cthread, args->seed, r, 
+        par.max, (par.n > 0) ? par.sum/par.n : 0, share,
+        args->tol, wall_cpu, wall_gpu, speedup, (device) ? "gpu" : "cpu");
+
+    }
+
+    fflush(fp);
+
+    free_output(CPU, nprod_cpu);
+    free_output(GPU, nprod_gpu);
+
+  }
+
+  return SUCCESS;
+}
+
+
+int main ( int argc, char *argv[] ){
+args_t args;
+par_hl_t *phl = NULL;
+cube_t   *cube = NULL;
+aux_t    *aux = NULL;
+brick_t **OUTPUT = NULL;
+rf_flat_t *rf = NULL;
+float *x = NULL, *pred = NULL;
+FILE *fp = NULL;
+bool header = true;
+size_t memory;
+int nt, nc, nprod, r;
+int status = SUCCESS;
+unsigned int state;
+size_t i;
+
+
+  parse_args(argc, argv, &args);
+
+  memory = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+  init_slab_pool(memory / 4);
+
+  CPLPushErrorHandler(CPLQuietErrorHandler);
+  GDALAllRegister();
+
+
+  phl = allocate_param_higher();
+  copy_string(phl->f_par, NPOW_10, args.fprm);
+
+  if (parse_param_higher(phl) == FAILURE){
+    printf("Reading parameter file failed!\n"); return FAILURE;}
+
+  if (phl->input_level2 != _INP_NONE_ || phl->type == _HL_SMP_){
+    printf("%s cannot be benchmarked on synthetic data.\n", module_name(phl->type)); return FAILURE;}
+
+  phl->gpu = gpu_module(phl) && init_gpu(phl->gpu_device, phl->ngpu_device) > 0;
+
+  if (args.parity && !phl->gpu){
+    printf("%s has no GPU path, or no GPU is available.\n", module_name(phl->type)); return FAILURE;}
+
+  if ((aux = read_aux(phl)) == NULL){
+    printf("Reading aux file failed!\n"); return FAILURE;}
+
+  register_python(phl);
+
+  cube = synthetic_cube(args.nx, phl->res);
+  nc = cube->cc;
+
+  omp_set_num_threads(phl->cthread);
+
+
+  if (args.fout[0] != '\0'){
+    header = !fileexist(args.fout);
+    if ((fp = fopen(args.fout, "a")) == NULL){
+      printf("Unable to open output file %s.\n", args.fout); return FAILURE;}
+  } else {
+    fp = stdout;
+  }
+
+
+  if (args.parity){
+
+    if (header) fprintf(fp, "module,product,nt,nc,cloud,threads,seed,repeat,max_abs,mean_abs,nodata_mismatch,tolerance,wall_cpu,wall_gpu,speedup,default\n");
+
+    status = parity_bench(fp, &args, phl, cube, aux);
+
+  } else {
+
+    if (header) fprintf(fp, "module,stage,backend,nt,nc,nf,cloud,threads,seed,repeat,calls,wall,cpu,memory_peak,output_bytes\n");
+
+    if (args.nf > 0){
+      rf = synthetic_forest(args.nf, args.seed);
+      alloc((void**)&x,    (size_t)nc*args.nf, sizeof(float));
+      alloc((void**)&pred, nc, sizeof(float));
+      for (i=0, state=args.seed; i<(size_t)nc*args.nf; i++) x[i] = (rand_r(&state)%10001)/10000.0;
+    }
+
+    for (r=0; r<args.repeat && status == SUCCESS; r++){
+
+      if ((OUTPUT = bench_module(&args, phl, cube, aux, r, &nt, &nprod)) == NULL){
+        status = FAILURE; break;}
+
+      if (rf != NULL){
+        bench_forest(rf, x, nc, pred);
+        lap_profile("rf_predict");
+      }
+
+      write_bench(fp, phl, &args, nt, nc, r, OUTPUT, nprod);
+
+      free_output(OUTPUT, nprod);
+
+    }
+
+    if (rf != NULL){
+      free_rf_flat(rf);
+      free((void*)x);
+      free((void*)pred);
+    }
+
+  }
+
+
+  if (fp != stdout) fclose(fp);
+
+  free_gpu();
+  free_datacube(cube);
+  free_aux(phl, aux);
+  deregister_python(phl);
+  free_param_higher(phl);
+  free_slab_pool();
+
+  CPLPopErrorHandler();
+
+
+  return status;
+}
+
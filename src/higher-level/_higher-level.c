@@ -30,15 +30,23 @@ This program is the FORCE Higher Level Processing System
 
 #include <ctype.h>   // testing and mapping characters
 #include <unistd.h>  // standard symbolic constants and types 
+#include <dirent.h>  // directory entries
+#include <string.h>  // string handling functions
 
 #include "../cross-level/const-cl.h"
 #include "../cross-level/brick-cl.h"
+#include "../cross-level/gpu-cl.h"
+#include "../cross-level/numa-cl.h"
 #include "../cross-level/tile-cl.h"
 #include "../cross-level/konami-cl.h"
 #include "../cross-level/cite-cl.h"
+#include "../cross-level/dir-cl.h"
 #include "../higher-level/progress-hl.h"
 #include "../higher-level/tasks-hl.h"
+#include "../higher-level/plan-hl.h"
 #include "../higher-level/param-hl.h"
+#include "../higher-level/read-ard-hl.h"
+#include "../higher-level/py-udf-hl.h"
 
 /** Geospatial Data Abstraction Library (GDAL) **/
 #include "gdal.h"           // public (C callable) GDAL entry points
@@ -50,20 +58,52 @@ This program is the FORCE Higher Level Processing System
 typedef struct {
   int n;
   char fprm[NPOW_10];
+  char **fsub;
+  int nsub;
+  char dwatch[NPOW_10];
+  double cache;
+  char fplan[NPOW_10];
+  char fbench[NPOW_10];
+  int preview;
 } args_t;
 
 
 void usage(char *exe, int exit_code){
 
 
-  printf("Usage: %s [-h] [-v] [-i] parameter-file\n", exe);
+  printf("Usage: %s [-h] [-v] [-i] [-c cache] [-p factor] [-n plan-file [-b bench-file]]\n", exe);
+  printf("          parameter-file [parameter-file ...]\n");
+  printf("       %s [-h] [-v] [-i] [-c cache] -s watch-dir\n", exe);
   printf("\n");
   printf("  -h  = show this help\n");
   printf("  -v  = show version\n");
   printf("  -i  = show program's purpose\n");
   printf("\n");
+  printf("  -s watch-dir = run as service, i.e. process all parameter files\n");
+  printf("     (*.prm) that are placed in watch-dir, one after another.\n");
+  printf("     Finished files are renamed to *.prm.done or *.prm.failed.\n");
+  printf("     A file named STOP in watch-dir stops the service.\n");
+  printf("     Decoded ARD blocks are kept in memory, such that subsequent\n");
+  printf("     jobs on the same data do not need to read them again\n");
+  printf("  -c cache = memory for caching ARD blocks in GB\n");
+  printf("     default: 0 (disabled), or 1/4 of physical memory with -s\n");
+  printf("  -n plan-file = dry run, i.e. nothing is processed. The observations,\n");
+  printf("     memory per chunk, runtime and output size are estimated per tile\n");
+  printf("     from the ARD listing, and written to plan-file (CSV)\n");
+  printf("  -b bench-file = profile of force-bench (CSV) with the cost of the\n");
+  printf("     module, runtime and output size are only estimated with -b\n");
+  printf("  -p factor = preview, i.e. RESOLUTION is coarsened by factor (2-8),\n");
+  printf("     the ARD are read from their overviews (or with USE_PSF), and\n");
+  printf("     the outputs are written to DIR_HIGHER/PREVIEW-<factor>X\n");
+  printf("\n");
   printf("  Positional arguments:\n");
   printf("  - 'parameter-file': parameter file for any higher level submodule\n");
+  printf("    further parameter files are run on the same input, i.e. the\n");
+  printf("    data are read once for all submodules. Input parameters\n");
+  printf("    (directories, extent, sensors, dates, QAI screening) must match\n");
+  printf("    Parameter files for modules on features (ML, SMP) are chained,\n");
+  printf("    i.e. the products of the preceding modules are used as features\n");
+  printf("    in memory. Products that are used as features are not written\n");
   printf("\n");
 
   exit(exit_code);
@@ -77,9 +117,38 @@ int opt;
 
   opterr = 0;
 
+  args->dwatch[0] = '\0';
+  args->cache = -1;
+  args->fplan[0] = '\0';
+  args->fbench[0] = '\0';
+  args->preview = 1;
+
   // optional parameters
-  while ((opt = getopt(argc, argv, "hvi")) != -1){
+  while ((opt = getopt(argc, argv, "hvis:c:n:b:p:")) != -1){
     switch(opt){
+      case 's':
+        copy_string(args->dwatch, NPOW_10, optarg);
+        break;
+      case 'c':
+        args->cache = atof(optarg);
+        if (args->cache < 0){
+          fprintf(stderr, "cache size must be >= 0.\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'n':
+        copy_string(args->fplan, NPOW_10, optarg);
+        break;
+      case 'b':
+        copy_string(args->fbench, NPOW_10, optarg);
+        break;
+      case 'p':
+        args->preview = atoi(optarg);
+        if (args->preview < 2 || args->preview > 8){
+          fprintf(stderr, "preview factor must be in 2-8.\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
       case 'h':
         usage(argv[0], SUCCESS);
       case 'v':
@@ -101,19 +170,43 @@ int opt;
     }
   }
 
+  if (args->fbench[0] != '\0' && args->fplan[0] == '\0'){
+    fprintf(stderr, "-b can only be used with -n.\n");
+    usage(argv[0], FAILURE);
+  }
+
+  // service mode: parameter files are taken from watch directory
+  if (args->dwatch[0] != '\0'){
+    if (args->fplan[0] != '\0'){
+      fprintf(stderr, "-n cannot be used with -s.\n");
+      usage(argv[0], FAILURE);
+    }
+    if (args->preview > 1){
+      fprintf(stderr, "-p cannot be used with -s.\n");
+      usage(argv[0], FAILURE);
+    }
+    if (optind < argc){
+      fprintf(stderr, "parameter files cannot be given with -s.\n");
+      usage(argv[0], FAILURE);
+    }
+    args->fprm[0] = '\0';
+    args->fsub = NULL;
+    args->nsub = 0;
+    return;
+  }
+
   // non-optional parameters
   args->n = 1;
 
   if (optind < argc){
     konami_args(argv[optind]);
-    if (argc-optind == args->n){
+    if (argc-optind >= args->n){
       copy_string(args->fprm, NPOW_10, argv[optind++]);
-    } else if (argc-optind < args->n){
+      args->fsub = argv+optind;
+      args->nsub = argc-optind;
+    } else {
       fprintf(stderr, "some non-optional arguments are missing.\n");
       usage(argv[0], FAILURE);
-    } else if (argc-optind > args->n){
-      fprintf(stderr, "too many non-optional arguments.\n");
-      usage(argv[0], FAILURE);
     }
   } else {
     fprintf(stderr, "non-optional arguments are missing.\n");
@@ -124,8 +217,18 @@ int opt;
 }
 
 
-int main ( int argc, char *argv[] ){
-args_t args;
+/** This function runs the higher level processing for one parameter file,
++++ and optional parameter files of submodules
+--- fprm:    parameter file
+--- fsub:    parameter files of submodules
+--- nsub:    number of submodules
+--- service: keep caches alive for further runs?
+--- fplan:   plan file for a dry run, or NULL
+--- fbench:  benchmark file for the dry run, or NULL
+--- preview: preview factor, 1 for full resolution
++++ Return:  SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int run_higher_level(char *fprm, char **fsub, int nsub, bool service, char *fplan, char *fbench, int preview){
 par_hl_t    *phl      = NULL;
 cube_t      *cube     = NULL;
 aux_t       *aux      = NULL;
@@ -136,22 +239,34 @@ int         *nt2      = NULL;
 brick_t     **MASK    = NULL;
 brick_t     ***OUTPUT = NULL;
 int         *nprod    = NULL;
-GDALDriverH driver;
 progress_t  pro;
+double blocksize;
+int s, status;
 
 
   /** INITIALIZING
   +** *******************************************************************/
-  
-  parse_args(argc, argv, &args);
 
   phl = allocate_param_higher();
-  copy_string(phl->f_par, NPOW_10, args.fprm);
+  copy_string(phl->f_par, NPOW_10, fprm);
+  phl->preview = preview;
 
   // parse parameter file
   if (parse_param_higher(phl) == FAILURE){
     printf("Reading parameter file failed!\n"); return FAILURE;}
 
+  // parse parameter files of submodules
+  for (s=0; s<nsub; s++){
+    if (add_submodule(phl, fsub[s]) == FAILURE){
+      printf("Adding submodule failed!\n"); return FAILURE;}
+  }
+
+  // tune GDAL for ARD on object stores
+  configure_remote_ard(phl);
+
+  // offload to the GPUs if compiled with CUDA and a device is present
+  phl->gpu = gpu_module(phl) && init_gpu(phl->gpu_device, phl->ngpu_device) > 0;
+
   cite_me(_CITE_FORCE_);
 
   // parse auxiliary files
@@ -160,6 +275,17 @@ progress_t  pro;
 
   // register python UDF plug-in
   register_python(phl);
+  for (s=0; s<phl->nsub; s++) register_python(phl->sub[s]);
+
+  // load native UDF plug-in
+  register_native(phl);
+  for (s=0; s<phl->nsub; s++) register_native(phl->sub[s]);
+
+  // choose block size from the data
+  if (phl->ablock && (blocksize = auto_blocksize(phl)) > 0){
+    phl->blocksize = blocksize;
+    for (s=0; s<phl->nsub; s++) phl->sub[s]->blocksize = blocksize;
+  }
 
   // copy and read datacube definition
   if ((cube = copy_datacube_def(phl->d_lower, phl->d_higher, phl->blocksize)) == NULL){
@@ -174,6 +300,31 @@ progress_t  pro;
   if (tile_active(phl->f_tile, cube) == FAILURE){
     printf("Compiling active tiles failed!\n"); return FAILURE;}
 
+  // dry run: estimate the costs per tile, but do not process
+  if (fplan != NULL){
+    status = plan_higher_level(cube, phl, fplan, fbench);
+    free_ard_catalog();
+    free_datacube(cube);
+    free_aux(phl, aux);
+    for (s=0; s<phl->nsub; s++) deregister_native(phl->sub[s]);
+    for (s=0; s<phl->nsub; s++) deregister_python(phl->sub[s]);
+    deregister_native(phl);
+    deregister_python(phl);
+    free_param_higher(phl);
+    return status;
+  }
+
+  // bucket the samples, or zones, by tile and chunk
+  if (phl->type == _HL_SMP_){
+    if (phl->smp.mode == _SMP_ZONES_) index_zones(&aux->zone, phl, cube);
+    else index_samples(&aux->sample, phl, cube);
+  }
+  for (s=0; s<phl->nsub; s++){
+    if (phl->sub[s]->type != _HL_SMP_) continue;
+    if (phl->sub[s]->smp.mode == _SMP_ZONES_) index_zones(&aux->sub[s]->zone, phl->sub[s], cube);
+    else index_samples(&aux->sub[s]->sample, phl->sub[s], cube);
+  }
+
   // initialize progress handle
   init_progess(&pro, cube, phl);
 
@@ -193,35 +344,14 @@ progress_t  pro;
     printf("Number of threads exceeds system limit\n"); return FAILURE;}
   omp_set_nested(true);
   omp_set_max_active_levels(2);
+  init_numa(phl->numa_mode);
+  set_slab_huge(phl->huge_pages);
 
 
-  // make GDAL less verbose
-  CPLPushErrorHandler(CPLQuietErrorHandler);
-
-  // register GDAL drivers
-  GDALAllRegister();
-  if ((driver = GDALGetDriverByName("JP2ECW")) != NULL) GDALDeregisterDriver(driver);
-  
-
   /** LOOP OVER ALL CHUNKS
   +** *******************************************************************/
 
-  while (progress(&pro)){
-
-    #pragma omp parallel num_threads(3) shared(ARD1,ARD2,MASK,OUTPUT,aux,nprod,nt1,nt2,pro,cube,phl) default(none)
-    {
-
-      if (omp_get_thread_num() == 0){
-        read_higher_level(&pro, MASK, ARD1, ARD2, nt1, nt2, cube, phl);
-      } else if (omp_get_thread_num() == 1){
-        compute_higher_level(&pro, MASK, ARD1, ARD2, nt1, nt2, cube, phl, aux, OUTPUT, nprod);
-      } else {
-        output_higher_level(&pro, OUTPUT, nprod, phl);
-      }
-
-    }
-
-  }
+  stream_higher_level(&pro, MASK, ARD1, ARD2, nt1, nt2, cube, phl, aux, OUTPUT, nprod);
 
 
   cite_push(phl->d_higher);
@@ -233,18 +363,150 @@ progress_t  pro;
   free((void*)ARD2);
   free((void*)MASK);
   free((void*)OUTPUT);
+  // the service keeps ARD catalog and block cache for the next job,
+  // these are validated against the file system when used
+  if (!service) free_ard_catalog();
+  free_halo_cache();
+  free_footprint_cache();
+  free_dataset_pool();
+  free_gpu();
   free((void*)nt1);
   free((void*)nt2);
   free((void*)nprod);
   free_datacube(cube);
   free_aux(phl, aux);
-  free_param_higher(phl);
 
+  for (s=0; s<phl->nsub; s++) deregister_native(phl->sub[s]);
+  for (s=0; s<phl->nsub; s++) deregister_python(phl->sub[s]);
+  deregister_native(phl);
   deregister_python(phl);
 
-  CPLPopErrorHandler();
+  free_param_higher(phl);
+
+
+  return SUCCESS;
+}
 
 
+/** This function filters parameter files in the watch directory
+--- entry:   directory entry
++++ Return:  1 if entry is a parameter file, 0 otherwise
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int is_job(const struct dirent *entry){
+size_t n = strlen(entry->d_name);
+
+  return n > 4 && strcmp(entry->d_name+n-4, ".prm") == 0;
+}
+
+
+/** This function runs the higher level processing as service. Parameter
++++ files that are placed in the watch directory are processed one after
++++ another, and renamed to *.done or *.failed when finished. The service
++++ polls the directory every second, and stops when a file named STOP
++++ appears. ARD catalog, block cache, buffer pool and python interpreter
++++ persist across jobs.
+--- dwatch:  watch directory
++++ Return:  SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int serve_higher_level(char *dwatch){
+struct dirent **entry = NULL;
+char fjob[NPOW_10];
+char fstop[NPOW_10];
+char fdone[NPOW_10];
+int nchar, n, e, status;
+
+
+  nchar = snprintf(fstop, NPOW_10, "%s/STOP", dwatch);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+  if (!fileexist(dwatch)){
+    printf("Watch directory %s does not exist.\n", dwatch); return FAILURE;}
+
+  persist_python();
+
+  printf("Serving higher level jobs from %s\n", dwatch);
+
+  while (!fileexist(fstop)){
+
+    if ((n = scandir(dwatch, &entry, is_job, alphasort)) < 0){
+      printf("Scanning watch directory failed.\n"); return FAILURE;}
+
+    if (n == 0){ free((void*)entry); sleep(1); continue;}
+
+    // first job in alphabetical order, rescan afterwards
+    nchar = snprintf(fjob, NPOW_10, "%s/%s", dwatch, entry[0]->d_name);
+    for (e=0; e<n; e++) free((void*)entry[e]);
+    free((void*)entry);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+    printf("\nStarting job %s\n", fjob);
+
+    status = run_higher_level(fjob, NULL, 0, true, NULL, NULL, 1);
+
+    nchar = snprintf(fdone, NPOW_10, "%s.%s", fjob, (status == SUCCESS) ? "done" : "failed");
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+    if (rename(fjob, fdone) != 0){
+      printf("Renaming job %s failed.\n", fjob); return FAILURE;}
+
+    printf("Finished job %s: %s\n", fjob, (status == SUCCESS) ? "done" : "failed");
+
+  }
+
+  finalize_python();
+
   return SUCCESS;
 }
 
+
+int main ( int argc, char *argv[] ){
+args_t args;
+GDALDriverH driver;
+size_t memory;
+int status;
+
+
+  parse_args(argc, argv, &args);
+
+  memory = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+
+  // recycle band buffers across processing units, 
+  // the pool may hold up to a quarter of the physical memory
+  init_slab_pool(memory / 4);
+
+  // keep decoded ARD blocks for subsequent jobs
+  if (args.cache >= 0){
+    init_block_cache((size_t)(args.cache * 1024 * 1024 * 1024));
+  } else if (args.dwatch[0] != '\0'){
+    init_block_cache(memory / 4);
+  }
+
+  // make GDAL less verbose
+  CPLPushErrorHandler(CPLQuietErrorHandler);
+
+  // register GDAL drivers
+  GDALAllRegister();
+  if ((driver = GDALGetDriverByName("JP2ECW")) != NULL) GDALDeregisterDriver(driver);
+
+
+  if (args.dwatch[0] != '\0'){
+    status = serve_higher_level(args.dwatch);
+  } else {
+    status = run_higher_level(args.fprm, args.fsub, args.nsub, false,
+      (args.fplan[0]  != '\0') ? args.fplan  : NULL, 
+      (args.fbench[0] != '\0') ? args.fbench : NULL, args.preview);
+  }
+
+
+  free_ard_catalog();
+  free_block_cache();
+  free_slab_pool();
+
+  CPLPopErrorHandler();
+
+
+  return status;
+}
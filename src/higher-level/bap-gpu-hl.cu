@@ -0,0 +1,448 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains the Best Available Pixel compositing on the GPU. The
+kernel mirrors the CPU code in bap-hl.c, one thread per pixel. The tem-
+poral scores do not depend on the pixel if the target is static, thus 
+they are computed on the host (see temporal_score), and passed per date.
+The correlation score is computed on the fly, such that no correlation
+matrix needs to be held per pixel. All arrays are band-major with the 
+brick stride. Without FORCE_CUDA, this file is compiled as C++ and 
+bap_gpu always cancels.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "bap-gpu-hl.h"
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define GPU_NTHREAD 256
+
+// ARD of one date, device pointers
+typedef struct {
+  const short * const *ard;
+  const small * const *msk;
+  const short * const *qai;
+  const short * const *dst;
+  const short * const *hot;
+  const short * const *vzn;
+} gpu_bap_ard_t;
+
+// per-date information, device pointers
+typedef struct {
+  const float *d, *y;
+  const int *tdist, *doy, *year, *sensor;
+  const small *valid;
+} gpu_bap_date_t;
+
+
+/** kernels
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+// mean absolute correlation of one observation with all other obser-
+// vations, see corr_matrix; -9999 if there is no valid pair
+__device__ float corr_score_gpu(gpu_bap_ard_t in, int nt, int nb, size_t s, int p, int t){
+const short *x = NULL, *y = NULL;
+double xm, ym, xv, yv, cv, sum = 0, num = 0;
+float c, r = -9999;
+int u, b;
+
+  for (u=0; u<nt; u++){
+
+    if (u == t || !in.msk[u][p]) continue;
+
+    // same order as on the host, i.e. the earlier date first
+    x = in.ard[(u < t) ? u : t];
+    y = in.ard[(u < t) ? t : u];
+
+    for (b=0, xm=0, ym=0; b<nb; b++){
+      xm += x[b*s+p];
+      ym += y[b*s+p];
+    }
+    xm /= nb; ym /= nb;
+
+    for (b=0, cv=0, xv=0, yv=0; b<nb; b++){
+      cv += (x[b*s+p]-xm)*(y[b*s+p]-ym);
+      xv += (x[b*s+p]-xm)*(x[b*s+p]-xm);
+      yv += (y[b*s+p]-ym)*(y[b*s+p]-ym);
+    }
+
+    if (sqrt(xv*yv) == 0) continue;
+
+    c = (float)(cv/sqrt(xv*yv));
+    sum += fabs(c);
+    num++;
+    r = (float)(sum/num);
+
+  }
+
+  return r;
+}
+
+// scores of one observation, see auxiliary_score, parametric_score and
+// water_score
+__device__ void score_gpu(gpu_bap_ard_t in, gpu_bap_date_t date, par_scr_t w, float dreq, float vreq,
+  int sw2, int nir, float scale, bool water, int nt, int nb, size_t s, int p, int t, par_scr_t *score){
+float vz;
+
+  score->t = 0;
+
+  // a corrupt target gives a zero score
+  if (!date.valid[t]){
+
+    score->d = score->y = score->c = score->h = score->r = score->v = 0;
+
+  } else {
+
+    score->d = date.d[t];
+    score->y = date.y[t];
+
+    // cloud distance score
+    if (w.c > 0){
+      score->c = 1.0 / (1.0 + exp((-10.0/dreq) * 
+                ((float)in.dst[t][p] - (dreq/2.0)) ));
+    } else score->c = 0.0;
+
+    // haze score
+    if (w.h > 0){
+      score->h = 1.0 / (1.0 + exp((10.0/200.0) * 
+                ((float)in.hot[t][p] + 150.0)));
+    } else score->h = 0.0;
+
+    // correlation score
+    if (w.r > 0){
+      score->r = 1.0 / (1.0 + exp((-10.0/(0.5*2.0/3.0)) *
+                (corr_score_gpu(in, nt, nb, s, p, t) - (0.5*4.0/3.0))));
+    } else score->r = 0.0;
+
+    // view zenith score
+    if (w.v > 0){
+      vz = ((float)in.vzn[t][p])*0.01;
+      if (vz < 0 || vz > 180){ score->v = 0.0;
+      } else { score->v = 1.0 / (1.0 + exp(10.0/vreq * 
+                          (vz - (vreq/2.0))));
+      }
+    } else score->v = 0.0;
+
+    // total score
+    score->t += (w.d * score->d);
+    score->t += (w.y * score->y);
+    score->t += (w.c * score->c);
+    score->t += (w.h * score->h);
+    score->t += (w.r * score->r);
+    score->t += (w.v * score->v);
+    score->t /=  w.t;
+
+  }
+
+  // override total score in case of water
+  if (water && sw2 >= 0 && nir >= 0){
+    score->t = (scale-in.ard[t][sw2*s+p])/scale;
+    if (in.ard[t][nir*s+p] < in.ard[t][sw2*s+p]) score->t /= 2.0;
+  }
+
+  return;
+}
+
+// BAP scoring and selection, see level3
+__global__ void bap_kernel(gpu_bap_ard_t in, gpu_bap_date_t date, const small *mask,
+  short *bap, short *inf, short *scr, int nc, int nt, int nb, size_t s,
+  par_scr_t w, float dreq, float vreq, int offsea, int sw2, int nir, float scale, short nodata){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+int t, b, max_t = -1, n = 0;
+float nobs = 0, nwater = 0;
+float max_score = -1;
+float hmean, hsd;
+double hn = 0, hm = 0, hv = 0, oldm;
+bool water;
+par_scr_t score, best;
+
+  if (p >= nc) return;
+
+  // skip pixels that are masked
+  if (mask != NULL && !mask[p]) return;
+
+
+  // water or land pixel?
+  for (t=0; t<nt; t++){
+    if (!in.msk[t][p]) continue;
+    if ((in.qai[t][p] >> _QAI_BIT_WTR_) & 1) nwater++;
+    nobs++;
+  }
+  water = (nobs > 0 && nwater/nobs > 0.9);
+
+
+  // mean and sd of haze score, see haze_stats
+  for (t=0; t<nt; t++){
+
+    if (!in.msk[t][p]) continue;
+
+    if (!date.valid[t]){
+      score.d = score.h = 0;
+    } else {
+      score.d = date.d[t];
+      if (w.h > 0){
+        score.h = 1.0 / (1.0 + exp((10.0/200.0) * 
+                  ((float)in.hot[t][p] + 150.0)));
+      } else score.h = 0.0;
+    }
+
+    if (!offsea && score.d < 0.01) continue;
+
+    if (++hn == 1){
+      hm = score.h;
+    } else {
+      oldm = hm;
+      hm = oldm + (score.h-oldm)/hn;
+      hv = hv + (score.h-oldm)*(score.h-hm);
+    }
+
+  }
+
+  if (hn > 0){
+    hmean = (float)hm;
+    hsd   = (float)sqrt(hv/(hn-1));
+  } else {
+    hmean = -1;
+    hsd   = -1;
+  }
+
+
+  // go through time, see bap_compositing
+  for (t=0; t<nt; t++){
+
+    if (!in.msk[t][p]) continue;
+
+    score_gpu(in, date, w, dreq, vreq, sw2, nir, scale, water, nt, nb, s, p, t, &score);
+
+    if (!offsea && score.d < 0.01) continue;
+    if (w.h  > 0 && score.h  < 0.01 && 
+        hmean > 0.01 && hsd > 0.01) continue;
+    if (w.c > 0 && score.c < 0.01) continue;
+
+    n++;
+
+    // find best score
+    if (score.t > max_score){
+      max_score = score.t;
+      max_t = t;
+      best = score;
+    }
+
+  }
+
+
+  if (n > 0){
+
+    // compositing scores
+    if (scr != NULL){
+      scr[_SCR_TOTAL_*s+p]    = (short) (best.t * 10000);
+      if (!water){
+        scr[_SCR_DOY_*s+p]    = (short) (best.d * 10000);
+        scr[_SCR_YEAR_*s+p]   = (short) (best.y * 10000);
+        scr[_SCR_DST_*s+p]    = (short) (best.c * 10000);
+        scr[_SCR_HAZE_*s+p]   = (short) (best.h * 10000);
+        scr[_SCR_CORREL_*s+p] = (short) (best.r * 10000);
+        scr[_SCR_VZEN_*s+p]   = (short) (best.v * 10000);
+      }
+    }
+
+    // compositing information
+    if (inf != NULL){
+      inf[_INF_QAI_*s+p]  = in.qai[max_t][p];
+      inf[_INF_NUM_*s+p]  = n;
+      inf[_INF_DOY_*s+p]  = date.doy[max_t];
+      inf[_INF_YEAR_*s+p] = date.year[max_t];
+      inf[_INF_DIFF_*s+p] = date.tdist[max_t];
+      inf[_INF_SEN_*s+p]  = date.sensor[max_t];
+    }
+
+    // best available pixel composite
+    if (bap != NULL){
+      for (b=0; b<nb; b++) bap[b*s+p] = in.ard[max_t][b*s+p];
+    }
+
+  } else {
+
+    if (scr != NULL){
+      for (b=0; b<_SCR_LENGTH_; b++) scr[b*s+p] = nodata;
+    }
+    if (inf != NULL){
+      inf[_INF_QAI_*s+p] = 1;
+      inf[_INF_NUM_*s+p] = 0;
+      for (b=2; b<_INF_LENGTH_; b++) inf[b*s+p] = nodata;
+    }
+    if (bap != NULL){
+      for (b=0; b<nb; b++) bap[b*s+p] = nodata;
+    }
+
+  }
+
+  return;
+}
+
+#endif
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function runs the BAP scoring and selection on the GPU. The ARD
++++ (job->ard, msk, qai, dst, hot, vzn) must already be on the device, 
++++ enqueued in the same stream. Only the products with a host slab are
++++ computed and downloaded. Masked pixels are zero, as on the host. The
++++ function returns after the downloads are complete.
+--- job:    BAP job
+--- stream: stream of the processing unit
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int bap_gpu(bap_gpu_t *job, gpu_stream_t stream){
+#ifdef FORCE_CUDA
+cudaStream_t s = (cudaStream_t)gpu_cuda_stream(stream);
+size_t bytes_ptr, bytes_f, bytes_i, bytes_v;
+size_t bytes_bap = 0, bytes_inf = 0, bytes_scr = 0;
+const void **ptr = NULL;
+void **d_ptr = NULL;
+float *d_f = NULL;
+int *d_i = NULL;
+small *d_v = NULL;
+short *d_bap = NULL, *d_inf = NULL, *d_scr = NULL;
+gpu_bap_ard_t in;
+gpu_bap_date_t date;
+int nblock, t, nt = job->nt;
+int error = 0;
+
+
+  if (!gpu_enabled() || gpu_select(stream) == FAILURE) return CANCEL;
+
+  nblock = (job->nc + GPU_NTHREAD - 1) / GPU_NTHREAD;
+
+  bytes_ptr = 6*nt*sizeof(void*);
+  bytes_f   = 2*nt*sizeof(float);
+  bytes_i   = 4*nt*sizeof(int);
+  bytes_v   = nt*sizeof(small);
+  if (job->bap != NULL) bytes_bap = job->nb*job->stride*sizeof(short);
+  if (job->inf != NULL) bytes_inf = _INF_LENGTH_*job->stride*sizeof(short);
+  if (job->scr != NULL) bytes_scr = _SCR_LENGTH_*job->stride*sizeof(short);
+
+
+  // device pointers of ARD, absent products point to the QAI, but are 
+  // not read
+  alloc((void**)&ptr, 6*nt, sizeof(void*));
+  for (t=0; t<nt; t++){
+    ptr[t]      = job->ard[t];
+    ptr[nt+t]   = job->msk[t];
+    ptr[2*nt+t] = job->qai[t];
+    ptr[3*nt+t] = (job->dst != NULL) ? job->dst[t] : job->qai[t];
+    ptr[4*nt+t] = (job->hot != NULL) ? job->hot[t] : job->qai[t];
+    ptr[5*nt+t] = (job->vzn != NULL) ? job->vzn[t] : job->qai[t];
+  }
+
+  if ((d_ptr = (void**)gpu_alloc(bytes_ptr, stream)) == NULL) error++;
+  if ((d_f   = (float*)gpu_alloc(bytes_f, stream)) == NULL) error++;
+  if ((d_i   = (int*)gpu_alloc(bytes_i, stream)) == NULL) error++;
+  if ((d_v   = (small*)gpu_alloc(bytes_v, stream)) == NULL) error++;
+  if (bytes_bap > 0 && (d_bap = (short*)gpu_alloc(bytes_bap, stream)) == NULL) error++;
+  if (bytes_inf > 0 && (d_inf = (short*)gpu_alloc(bytes_inf, stream)) == NULL) error++;
+  if (bytes_scr > 0 && (d_scr = (short*)gpu_alloc(bytes_scr, stream)) == NULL) error++;
+
+  if (!error){
+
+    cudaMemcpyAsync(d_ptr, ptr, bytes_ptr, cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_f,      job->score_d, nt*sizeof(float), cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_f+nt,   job->score_y, nt*sizeof(float), cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_i,      job->tdist,   nt*sizeof(int), cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_i+nt,   job->doy,     nt*sizeof(int), cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_i+2*nt, job->year,    nt*sizeof(int), cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_i+3*nt, job->sensor,  nt*sizeof(int), cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_v,      job->valid,   bytes_v, cudaMemcpyHostToDevice, s);
+
+    // cells that are not touched by the CPU code are zero, as in the bricks
+    if (d_bap != NULL) cudaMemsetAsync(d_bap, 0, bytes_bap, s);
+    if (d_inf != NULL) cudaMemsetAsync(d_inf, 0, bytes_inf, s);
+    if (d_scr != NULL) cudaMemsetAsync(d_scr, 0, bytes_scr, s);
+
+    in.ard = (const short**)d_ptr;
+    in.msk = (const small**)d_ptr+nt;
+    in.qai = (const short**)d_ptr+2*nt;
+    in.dst = (const short**)d_ptr+3*nt;
+    in.hot = (const short**)d_ptr+4*nt;
+    in.vzn = (const short**)d_ptr+5*nt;
+
+    date.d      = d_f;
+    date.y      = d_f+nt;
+    date.tdist  = d_i;
+    date.doy    = d_i+nt;
+    date.year   = d_i+2*nt;
+    date.sensor = d_i+3*nt;
+    date.valid  = d_v;
+
+    bap_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(
+      in, date, job->mask, d_bap, d_inf, d_scr, job->nc, nt, job->nb, job->stride,
+      job->w, job->dreq, job->vreq, job->offsea, job->sw2, job->nir, job->scale, job->nodata);
+
+    if (cudaGetLastError() != cudaSuccess){
+      printf("launching BAP kernel failed. ");
+      error++;
+    }
+
+  }
+
+  if (!error){
+
+    // download products
+    if (d_bap != NULL) cudaMemcpyAsync(job->bap, d_bap, bytes_bap, cudaMemcpyDeviceToHost, s);
+    if (d_inf != NULL) cudaMemcpyAsync(job->inf, d_inf, bytes_inf, cudaMemcpyDeviceToHost, s);
+    if (d_scr != NULL) cudaMemcpyAsync(job->scr, d_scr, bytes_scr, cudaMemcpyDeviceToHost, s);
+
+  }
+
+  if (gpu_sync(stream) == FAILURE) error++;
+
+
+  gpu_release(d_ptr, bytes_ptr, stream);
+  gpu_release(d_f,   bytes_f, stream);
+  gpu_release(d_i,   bytes_i, stream);
+  gpu_release(d_v,   bytes_v, stream);
+  gpu_release(d_bap, bytes_bap, stream);
+  gpu_release(d_inf, bytes_inf, stream);
+  gpu_release(d_scr, bytes_scr, stream);
+  free((void*)ptr);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
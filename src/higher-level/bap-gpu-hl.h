@@ -0,0 +1,86 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Best Available Pixel compositing on the GPU header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef BAPGPU_HL_H
+#define BAPGPU_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/gpu-cl.h"
+#include "../higher-level/param-hl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// BAP scoring and selection on the device, static target only
+typedef struct {
+  int nc, nt, nb;        // number of cells, ARD dates, bands
+  size_t stride;         // cells per band in host and device arrays
+  short nodata;          // nodata value
+
+  // input (device pointers, listed in host arrays of length nt)
+  const short **ard;     // ARD band slabs, band b starts at b*stride
+  const small **msk;     // ARD masks
+  const short **qai;     // quality assurance information
+  const short **dst;     // cloud distance (NULL if not scored)
+  const short **hot;     // haze optimized transformation (NULL if not scored)
+  const short **vzn;     // view zenith (NULL if not scored)
+  const small *mask;     // processing mask (device, optional)
+
+  // temporal scores of each date, see temporal_score (host)
+  float *score_d;        // DOY score
+  float *score_y;        // Year score
+  int   *tdist;          // temporal distance to target
+  small *valid;          // target is valid
+  int   *doy, *year;     // date of each ARD
+  int   *sensor;         // sensor ID + 1 of each ARD
+
+  // scoring
+  par_scr_t w;           // score weights
+  float dreq, vreq;      // cloud / view zenith scoring
+  int offsea;            // use off-season data?
+  int sw2, nir;          // bands for water compositing, -1: not available
+  float scale;           // scale of reflectance
+
+  // host slabs that receive the products, NULL: not downloaded
+  short *bap;            // best available pixel composite
+  short *inf;            // compositing information
+  short *scr;            // compositing scores
+} bap_gpu_t;
+
+int bap_gpu(bap_gpu_t *job, gpu_stream_t stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -30,10 +30,13 @@ This file contains functions BAP selection
 /** GNU Scientific Library (GSL) **/
 #include <gsl/gsl_multimin.h>          // minimization functions 
 
+#define TARGET_CACHE 4096 // number of slots for cached logistic fits
+
 
 double fun_logistic_target(const gsl_vector *v, void *params);
 int optimize_logistic_target(float *param, float *a, float *b);
-void target_function(par_bap_t *bap, target_t *target);
+void cached_logistic_target(target_cache_t *cache, float *param, float *a, float *b);
+void target_function(par_bap_t *bap, target_t *target, target_cache_t *cache);
 
 
 /** Sigmoid minimizer function
@@ -113,6 +116,46 @@ double size;
 }
 
 
+/** This function returns the sigmoid function parameters from the cache,
++++ or fits and caches them. The fit only depends on the centered dates, 
++++ as the function values are fixed by the parameter file. Adjacent 
++++ pixels mostly share the same phenology, thus the simplex fit is 
++++ only done for few distinct date combinations. Cached values are 
++++ the same as fitted values, colliding slots are overwritten.
+--- cache:  target cache
+--- param:  centered dates and function values
+--- a:      parameter a (returned)
+--- b:      parameter b (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void cached_logistic_target(target_cache_t *cache, float *param, float *a, float *b){
+unsigned int h;
+int slot;
+
+
+  h = ((unsigned int)(int)param[0]*73856093u) ^ ((unsigned int)(int)param[2]*19349663u);
+  slot = h % cache->size;
+
+  if (cache->used[slot] && 
+      cache->x0[slot] == param[0] && 
+      cache->x2[slot] == param[2]){
+    *a = cache->a[slot];
+    *b = cache->b[slot];
+    return;
+  }
+
+  optimize_logistic_target(param, a, b);
+
+  cache->x0[slot] = param[0];
+  cache->x2[slot] = param[2];
+  cache->a[slot]  = *a;
+  cache->b[slot]  = *b;
+  cache->used[slot] = true;
+
+  return;
+}
+
+
 /** This function estimates the function parameters for the temporal sco-
 +++ ring functions, i.e. the sigmas (left and right tail) of the Gaussian
 +++ or a and b for the sigmoid functions. Parameters are estimated for all
@@ -121,9 +164,10 @@ double size;
 +++ estimated for each pixel on the basis of the phenology. 
 --- bap:    bap parameters
 --- target: target information
+--- cache:  target cache (or NULL)
 +++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-void target_function(par_bap_t *bap, target_t *target){
+void target_function(par_bap_t *bap, target_t *target, target_cache_t *cache){
 int f, y;
 float param[7];
 
@@ -145,7 +189,11 @@ float param[7];
       target[y].a = fabs((param[0])/sqrt(-2*log(bap->Ds[0]/bap->Ds[1])));
       target[y].b = fabs((param[2])/sqrt(-2*log(bap->Ds[2]/bap->Ds[1])));
     } else if (bap->score_type == _SCR_TYPE_SIG_DES_ || bap->score_type == _SCR_TYPE_SIG_ASC_){
-      optimize_logistic_target(param, &target[y].a, &target[y].b);
+      if (cache != NULL){
+        cached_logistic_target(cache, param, &target[y].a, &target[y].b);
+      } else {
+        optimize_logistic_target(param, &target[y].a, &target[y].b);
+      }
     }
 
   }
@@ -163,11 +211,13 @@ float param[7];
 +++ Based on the temporal target, the function parameters for the 
 +++ Gaussian or sigmoidal scoring functions are estimated.
 --- bap:    bap parameters
+--- k:      target, i.e. k-th triplet of target DOYs
 +++ Return: target information
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-target_t *compile_target_static(par_bap_t *bap){
+target_t *compile_target_static(par_bap_t *bap, int k){
 int f, y;
 int ce;
+int *dt = bap->Dt + k*3;
 target_t *target;
 
 
@@ -176,12 +226,12 @@ target_t *target;
   // Compile temporal target in continuous time
   for (y=0; y<bap->Yn; y++){
     for (f=0; f<3; f++){
-      if (f == 0 && bap->Dt[f] > bap->Dt[f+1]){
-        ce = doy2ce(bap->Dt[f], bap->Yt-bap->Yr+y-1);
-      } else if (f == 2 && bap->Dt[f] < bap->Dt[f-1]){
-        ce = doy2ce(bap->Dt[f], bap->Yt-bap->Yr+y+1);
+      if (f == 0 && dt[f] > dt[f+1]){
+        ce = doy2ce(dt[f], bap->Yt-bap->Yr+y-1);
+      } else if (f == 2 && dt[f] < dt[f-1]){
+        ce = doy2ce(dt[f], bap->Yt-bap->Yr+y+1);
       } else {
-        ce = doy2ce(bap->Dt[f], bap->Yt-bap->Yr+y);
+        ce = doy2ce(dt[f], bap->Yt-bap->Yr+y);
       }
       target[y].ce[f] = ce;
     }
@@ -189,23 +239,76 @@ target_t *target;
 
 
   // Estimate function values for temporal scoring functions
-  target_function(bap, target);
+  target_function(bap, target, NULL);
 
 
   return target;
 }
 
 
+/** This function allocates a cache for phenology-adaptive targets. The
++++ cache is not thread-safe, i.e. one cache is needed per thread.
+--- bap:    bap parameters
+--- lsp:    LSP
++++ Return: target cache
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+target_cache_t *allocate_target_cache(par_bap_t *bap, ard_t *lsp){
+target_cache_t *cache = NULL;
+
+
+  alloc((void**)&cache, 1, sizeof(target_cache_t));
+
+  cache->size = TARGET_CACHE;
+  alloc((void**)&cache->x0,   cache->size, sizeof(float));
+  alloc((void**)&cache->x2,   cache->size, sizeof(float));
+  alloc((void**)&cache->a,    cache->size, sizeof(float));
+  alloc((void**)&cache->b,    cache->size, sizeof(float));
+  alloc((void**)&cache->used, cache->size, sizeof(bool));
+
+  cache->nl = 3*get_brick_nbands(lsp[0].DAT);
+  alloc((void**)&cache->lsp,    cache->nl, sizeof(short));
+  alloc((void**)&cache->target, bap->Yn,   sizeof(target_t));
+  cache->valid = false;
+
+  return cache;
+}
+
+
+/** This function frees a cache for phenology-adaptive targets.
+--- cache:  target cache
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_target_cache(target_cache_t *cache){
+
+  if (cache == NULL) return;
+
+  free((void*)cache->x0);
+  free((void*)cache->x2);
+  free((void*)cache->a);
+  free((void*)cache->b);
+  free((void*)cache->used);
+  free((void*)cache->lsp);
+  free((void*)cache->target);
+  free((void*)cache);
+
+  return;
+}
+
+
 /** This function compiles the temporal target, at which the composites
 +++ are anchored. The phenology-adaptive approach is used. Based on the 
 +++ temporal target, the function parameters for the Gaussian or sigmo-
-+++ idal scoring functions are estimated.
++++ idal scoring functions are estimated. If a cache is given, the target
++++ of the last pixel is reused if the LSP values are identical, and the
++++ sigmoid fits are reused for identical dates.
 --- bap:    bap parameters
 --- lsp:    LSP
 --- p:      pixel
+--- nodata: LSP nodata value
+--- cache:  target cache (or NULL)
 +++ Return: target information
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-target_t *compile_target_adaptive(par_bap_t *bap, ard_t *lsp, int p, short nodata){
+target_t *compile_target_adaptive(par_bap_t *bap, ard_t *lsp, int p, short nodata, target_cache_t *cache){
 int f, nf = 3, ny;
 target_t *target;
 double mx, my, vx, vy, cv, n, intercept, slope, yhat, sum, num, rmse;
@@ -213,11 +316,31 @@ int y0 = bap->pac.y0, y1 = bap->Yt-bap->Yr;
 int yr, y;
 int lsp_yr;
 float *lsp_;
+bool same;
 
 
   ny = get_brick_nbands(lsp[0].DAT);
 
   alloc((void**)&target, bap->Yn, sizeof(target_t));
+
+  // same phenology as last pixel?
+  if (cache != NULL){
+
+    for (f=0, same=cache->valid; f<nf && same; f++){
+      for (y=0; y<ny && same; y++) same = (cache->lsp[f*ny+y] == lsp[f].dat[y][p]);
+    }
+
+    if (same){
+      memcpy(target, cache->target, bap->Yn*sizeof(target_t));
+      return target;
+    }
+
+    for (f=0; f<nf; f++){
+      for (y=0; y<ny; y++) cache->lsp[f*ny+y] = lsp[f].dat[y][p];
+    }
+
+  }
+
   alloc((void**)&lsp_,   ny,      sizeof(float));
   
 
@@ -305,7 +428,12 @@ float *lsp_;
   }
 
   // Estimate function values for temporal scoring functions
-  target_function(bap, target);
+  target_function(bap, target, cache);
+
+  if (cache != NULL){
+    memcpy(cache->target, target, bap->Yn*sizeof(target_t));
+    cache->valid = true;
+  }
   
   free((void*)lsp_);
 
@@ -322,11 +450,14 @@ float *lsp_;
 bool pixel_is_water(ard_t *ard, int nt, int p){
 bool water = false;
 float n = 0, nwater = 0;
-int t;
+int t, k, nv;
+const int *obs = NULL;
 
 
-  for (t=0; t<nt; t++){
-    if (!ard[t].msk[p]) continue;
+  nv = valid_obs(ard, p, &obs);
+
+  for (k=0; k<nv; k++){
+    t = obs[k];
     if (get_water(ard[t].QAI, p)) nwater++;
     n++;
   }
@@ -341,53 +472,78 @@ int t;
 +++ observations of a given pixel to devaluate data artifacts or transient
 +++ phenomena during compositing. The function exits gracefully if the 
 +++ correlation score was disabled, i.e. the correlation score weight was
-+++ set to 0. The correlation is set to _NODATA_ for incomplete pairs.
++++ set to 0. Only pairs of valid observations are visited (see index_
++++ ard), other elements of the matrix are undefined.
++++ The observations are centered once, and the sum of squares is kept
++++ with each centered spectrum, such that each pair only needs one dot
++++ product over contiguous memory. The values are the same as with 
++++ centering per pair.
 --- ard:    ARD
 --- nt:     number of ARD products over time
 --- nb:     number of bands
 --- p:      pixel
+--- z:      buffer for the centered spectra, nt*(nb+1)
 --- cor:    correlation matrix of all observations (modified)
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int corr_matrix(ard_t *ard, int nt, int nb, int p, float **cor){
-int t, u, b, nodata = -9999;
-double xm, ym, xv, yv, cv;
+int corr_matrix(ard_t *ard, int nt, int nb, int p, double *z, float **cor){
+int t, u, k, l, b, nv, nodata = -9999;
+double xm, ym, xv, cv;
+double *x = NULL, *y = NULL;
+const int *obs = NULL;
 
 
-  for (t=0;     t<nt; t++){
-  for (u=(t+1); u<nt; u++){
+  nv = valid_obs(ard, p, &obs);
 
-    if (!ard[t].msk[p] || !ard[u].msk[p]){
+  // center each observation, last element is the sum of squares
+  for (k=0; k<nv; k++){
 
-      cor[t][u] = cor[u][t] = nodata;
+    t = obs[k];
 
-    } else {
+    x = z + (size_t)t*(nb+1);
 
-      for (b=0, xm=0, ym=0; b<nb; b++){
-        xm += ard[t].dat[b][p];
-        ym += ard[u].dat[b][p];
-      }
-      xm /= nb; ym /= nb;
+    for (b=0, xm=0; b<nb; b++) xm += ard[t].dat[b][p];
+    xm /= nb;
 
-      for (b=0, cv=0, xv=0, yv=0; b<nb; b++){
-        cv += (ard[t].dat[b][p]-xm)*(ard[u].dat[b][p]-ym);
-        xv += (ard[t].dat[b][p]-xm)*(ard[t].dat[b][p]-xm);
-        yv += (ard[u].dat[b][p]-ym)*(ard[u].dat[b][p]-ym);
-      }
+    for (b=0, xv=0; b<nb; b++){
+      x[b] = ard[t].dat[b][p]-xm;
+      xv += x[b]*x[b];
+    }
+    x[nb] = xv;
 
-      if (sqrt(xv*yv) == 0){
-        cor[t][u] = cor[u][t] = nodata;
-      } else {
-        cor[t][u] = cor[u][t] = (float)(cv/sqrt(xv*yv));
-      }
+  }
+
+  // the mean correlation is stored in the first column, which would hold
+  // the incomplete pair with the first product otherwise
+  if (nv > 0 && obs[0] != 0){
+    for (k=0; k<nv; k++) cor[obs[k]][0] = nodata;
+  }
+
+  for (k=0;     k<nv; k++){
+  for (l=(k+1); l<nv; l++){
+
+    t = obs[k];
+    u = obs[l];
 
+    x = z + (size_t)t*(nb+1);
+    y = z + (size_t)u*(nb+1);
+
+    for (b=0, cv=0; b<nb; b++) cv += x[b]*y[b];
+
+    if (sqrt(x[nb]*y[nb]) == 0){
+      cor[t][u] = cor[u][t] = nodata;
+    } else {
+      cor[t][u] = cor[u][t] = (float)(cv/sqrt(x[nb]*y[nb]));
     }
 
   }
   }
 
-  for (t=0;             t<nt; t++){
-  for (u=0, xm=0, ym=0; u<nt; u++){
+  for (k=0;             k<nv; k++){
+  for (l=0, xm=0, ym=0; l<nv; l++){
+
+    t = obs[k];
+    u = obs[l];
 
     if (t == u || cor[t][u] == nodata) continue;
 
@@ -415,12 +571,17 @@ double xm, ym, xv, yv, cv;
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int haze_stats(ard_t *ard, int nt, int p, par_scr_t *score, par_bap_t *bap, float *mean, float *sd){
 double n = 0, m = 0, v = 0;
-int t;
+int t, k, nv;
+const int *obs = NULL;
+
+
+  nv = valid_obs(ard, p, &obs);
+
+  for (k=0; k<nv; k++){
 
-  for (t=0; t<nt; t++){
+    t = obs[k];
     
-    if (!ard[t].msk[p] || 
-       (!bap->offsea && score[t].d < 0.01)) continue;
+    if (!bap->offsea && score[t].d < 0.01) continue;
 
     if (fequal(++n, 1)){
       m = score[t].h;
@@ -451,7 +612,8 @@ int t;
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int water_score(ard_t *ard, int nt, int p, par_scr_t *score){
-int t, sw2, nir;
+int t, k, nv, sw2, nir;
+const int *obs = NULL;
 float scale;
 
 
@@ -465,10 +627,12 @@ float scale;
   }
   
   scale = get_brick_scale(ard[0].DAT, 0);
+
+  nv = valid_obs(ard, p, &obs);
   
-  for (t=0; t<nt; t++){
+  for (k=0; k<nv; k++){
     
-    if (!ard[t].msk[p]) continue;
+    t = obs[k];
 
     // low SWIR gets high score
     score[t].t = (scale-ard[t].dat[sw2][p])/scale;
@@ -482,146 +646,155 @@ float scale;
 }
 
 
-/** This function computes the compositing scores for each observation,
-+++ i.e. the total sum (weighted sum of temporal and auxilliary scores),
-+++ temporal scores (DOY and Year scores), and auxilliary scores (cloud/
-+++ shadow, haze, correlation view zenith scores).
---- ard:    ARD
---- nt:     number of ARD products over time
---- p:      pixel
+/** This function computes the temporal scores of one observation, i.e.
++++ the DOY and Year scores, and the temporal distance to the target. The
++++ scores do not depend on the pixel if the target is static.
+--- ce:     date of the observation in continuous time
+--- year:   year of the observation
 --- target: target information
---- cor:    correlation matrix
---- score:  score parameters
---- tdist:  temporal distance to target
+--- score:  score parameters (DOY and year score are modified)
+--- tdist:  temporal distance to target (modified)
 --- bap:    bap parameters
-+++ Return: SUCCESS/FAILURE
++++ Return: false if the target is corrupt
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int parametric_score(ard_t *ard, int nt, int p, target_t *target, float **cor, par_scr_t *score, int *tdist, par_bap_t *bap){
-int t, y, y_;
-int ce;
+bool temporal_score(int ce, int year, target_t *target, par_scr_t *score, int *tdist, par_bap_t *bap){
+int y, y_;
 int slice, dy;
 int diff, ce_dist;
-float vz;
 
 
-  for (t=0; t<nt; t++){
+  // get closest year
+  ce_dist = INT_MAX; y = 0;
+  for (y_=0; y_<bap->Yn; y_++){
+    if ((diff = abs(ce-target[y_].ce[1])) < ce_dist){ ce_dist = diff; y = y_;}
+  }
+  ce_dist = ce-target[y].ce[1];
 
-    score[t].t = 0;
+  // if target is corrupt, skip pixel
+  if (target[y].ce[0] < 1900*365 || 
+      target[y].ce[1] < 1900*365 || 
+      target[y].ce[2] < 1900*365) return false;
 
-    // skip if no data
-    if (!ard[t].msk[p]) continue;
+  // difference between acquisition and target year
+  dy = abs(year - bap->Yt);
 
-    // get date in continuous time
-    ce = get_brick_ce(ard[t].DAT, 0);
 
-    // get closest year
-    ce_dist = INT_MAX; y = 0;
-    for (y_=0; y_<bap->Yn; y_++){
-      if ((diff = abs(ce-target[y_].ce[1])) < ce_dist){ ce_dist = diff; y = y_;}
-    }
-    ce_dist = ce-target[y].ce[1];
+  /** Seasonal suitability: DOY score
+  +++ Annual   suitability: Year score
+  +** *******************************************************************/
 
-    // if target is corrupt, skip pixel
-    if (target[y].ce[0] < 1900*365 || 
-        target[y].ce[1] < 1900*365 || 
-        target[y].ce[2] < 1900*365) continue;
+  if (bap->score_type == _SCR_TYPE_GAUSS_){
 
-    // difference between acquisition and target year
-    dy = abs(get_brick_year(ard[t].DAT, 0) - bap->Yt);
+    // use left tail of Gaussian if acquisition before target
+    if (ce < target[y].ce[1]){
 
+      // DOY score
+      score->d = bap->Ds[1] * exp(ce_dist*ce_dist/
+                              (-2*target[y].a*target[y].a));
 
-    /** Seasonal suitability: DOY score
-    +++ Annual   suitability: Year score
-    +** *****************************************************************/
+      // Year score
+      slice = (target[y].ce[1]-target[y].ce[0])/((bap->Yr+1)*bap->Yf);
+      score->y = bap->Ds[1] * exp(dy*slice*dy*slice/
+                              (-2*target[y].a*target[y].a));
 
-    if (bap->score_type == _SCR_TYPE_GAUSS_){
+    // use right tail of Gaussian if acquisition before target
+    } else {
 
-      // use left tail of Gaussian if acquisition before target
-      if (ce < target[y].ce[1]){
+      // DOY score
+      score->d = bap->Ds[1] * exp(ce_dist*ce_dist/
+                              (-2*target[y].b*target[y].b));
 
-        // DOY score
-        score[t].d = bap->Ds[1] * exp(ce_dist*ce_dist/
-                                (-2*target[y].a*target[y].a));
+      // Year score
+      slice = (target[y].ce[2]-target[y].ce[1])/((bap->Yr+1)*bap->Yf);
+      score->y = bap->Ds[1] * exp(dy*slice*dy*slice/
+                              (-2*target[y].b*target[y].b));
 
-        // Year score
-        slice = (target[y].ce[1]-target[y].ce[0])/((bap->Yr+1)*bap->Yf);
-        score[t].y = bap->Ds[1] * exp(dy*slice*dy*slice/
-                                (-2*target[y].a*target[y].a));
+    }
 
-      // use right tail of Gaussian if acquisition before target
-      } else {
+    // difference between acquisition and target
+    *tdist = ce_dist;
 
-        // DOY score
-        score[t].d = bap->Ds[1] * exp(ce_dist*ce_dist/
-                                (-2*target[y].b*target[y].b));
+  } else if (bap->score_type == _SCR_TYPE_SIG_DES_){
 
-        // Year score
-        slice = (target[y].ce[2]-target[y].ce[1])/((bap->Yr+1)*bap->Yf);
-        score[t].y = bap->Ds[1] * exp(dy*slice*dy*slice/
-                                (-2*target[y].b*target[y].b));
+    // use 0 weight if acquisition before target
+    if (ce < target[y].ce[0]){
 
-      }
+      score->d = score->y = 0;
 
-      // difference between acquisition and target
-      tdist[t] = ce_dist;
+    // use descending sigmoid if acquisition after target
+    } else {
 
-    } else if (bap->score_type == _SCR_TYPE_SIG_DES_){
+      // DOY score
+      score->d = bap->Ds[0] / (1 + 
+                 exp(target[y].a * ce_dist + target[y].b));
 
-      // use 0 weight if acquisition before target
-      if (ce < target[y].ce[0]){
+      // Year score
+      slice = (target[y].ce[1]-target[y].ce[0])/((bap->Yr+1)*bap->Yf);
+      score->y = bap->Ds[0] / (1 + exp(target[y].a * 
+                 (target[y].ce[0]+dy*slice-target[y].ce[1]) + target[y].b));
 
-        score[t].d = score[t].y = 0;
+    }
+    
+    // difference between acquisition and target
+    *tdist = ce - target[y].ce[0];
 
-      // use descending sigmoid if acquisition after target
-      } else {
+  } else if (bap->score_type == _SCR_TYPE_SIG_ASC_){
 
-        // DOY score
-        score[t].d = bap->Ds[0] / (1 + 
-                     exp(target[y].a * ce_dist + target[y].b));
+    // use 0 weight if acquisition after target
+    if (ce > target[y].ce[2]){
 
-        // Year score
-        slice = (target[y].ce[1]-target[y].ce[0])/((bap->Yr+1)*bap->Yf);
-        score[t].y = bap->Ds[0] / (1 + exp(target[y].a * 
-                    (target[y].ce[0]+dy*slice-target[y].ce[1]) + target[y].b));
+      score->d = score->y = 0;
 
-      }
-      
-      // difference between acquisition and target
-      tdist[t] = ce - target[y].ce[0];
+    // use ascending sigmoid if acquisition before target
+    } else {
 
-    } else if (bap->score_type == _SCR_TYPE_SIG_ASC_){
+    // DOY score
+      score->d = bap->Ds[2] / (1 + 
+                 exp(target[y].a * ce_dist + target[y].b));
 
-      // use 0 weight if acquisition after target
-      if (ce > target[y].ce[2]){
+      // Year score
+      slice = (target[y].ce[2]-target[y].ce[1])/((bap->Yr+1)*bap->Yf);
+      score->y = bap->Ds[2] / (1 + exp(target[y].a * 
+                 (target[y].ce[2]-dy*slice-target[y].ce[1]) + target[y].b));
 
-        score[t].d = score[t].y = 0;
+    }
 
-      // use ascending sigmoid if acquisition before target
-      } else {
+    // difference between acquisition and target
+    *tdist = ce - target[y].ce[2];
 
-      // DOY score
-        score[t].d = bap->Ds[2] / (1 + 
-                     exp(target[y].a * ce_dist + target[y].b));
+  }
 
-        // Year score
-        slice = (target[y].ce[2]-target[y].ce[1])/((bap->Yr+1)*bap->Yf);
-        score[t].y = bap->Ds[2] / (1 + exp(target[y].a * 
-                     (target[y].ce[2]-dy*slice-target[y].ce[1]) + target[y].b));
+  // doesn't make sense, but to be sure
+  if (bap->w.d == 0) score->d = 0.0;
+  if (bap->w.y == 0) score->y = 0.0;
 
-      }
+  return true;
+}
 
-      // difference between acquisition and target
-      tdist[t] = ce - target[y].ce[2];
 
-    }
+/** This function computes the auxilliary scores for each observation, 
++++ i.e. the cloud/shadow, haze, correlation and view zenith scores. They
++++ do not depend on the temporal target, and are thus shared between all
++++ targets.
+--- ard:    ARD
+--- nt:     number of ARD products over time
+--- p:      pixel
+--- cor:    correlation matrix
+--- score:  score parameters (auxilliary scores are modified)
+--- bap:    bap parameters
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int auxiliary_score(ard_t *ard, int nt, int p, float **cor, par_scr_t *score, par_bap_t *bap){
+int t, k, nv;
+float vz;
+const int *obs = NULL;
+
 
+  nv = valid_obs(ard, p, &obs);
 
-    /** Auxilliary scores
-    +** *****************************************************************/
+  for (k=0; k<nv; k++){
 
-    // doesn't make sense, but to be sure
-    if (bap->w.d == 0) score[t].d = 0.0;
-    if (bap->w.y == 0) score[t].y = 0.0;
+    t = obs[k];
 
     // cloud distance score
     if (bap->w.c > 0){
@@ -650,9 +823,41 @@ float vz;
       }
     } else score[t].v = 0.0;
 
+  }
+
+  return SUCCESS;
+}
+
+
+/** This function computes the compositing scores for each observation,
++++ i.e. the total sum (weighted sum of temporal and auxilliary scores),
++++ and the temporal scores (DOY and Year scores) for one target. The 
++++ auxilliary scores need to be computed beforehand.
+--- ard:    ARD
+--- nt:     number of ARD products over time
+--- p:      pixel
+--- target: target information
+--- score:  score parameters
+--- tdist:  temporal distance to target
+--- bap:    bap parameters
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int parametric_score(ard_t *ard, int nt, int p, target_t *target, par_scr_t *score, int *tdist, par_bap_t *bap){
+int t, k, nv;
+const int *obs = NULL;
+
+
+  for (t=0; t<nt; t++) score[t].t = 0;
 
-    /** Total score
-    +** *****************************************************************/
+  nv = valid_obs(ard, p, &obs);
+
+  for (k=0; k<nv; k++){
+
+    t = obs[k];
+
+    // DOY and Year score, skip if target is corrupt
+    if (!temporal_score(get_brick_ce(ard[t].DAT, 0), get_brick_year(ard[t].DAT, 0), 
+          target, &score[t], &tdist[t], bap)) continue;
 
     score[t].t += (bap->w.d * score[t].d);
     score[t].t += (bap->w.y * score[t].y);
@@ -692,14 +897,17 @@ float vz;
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int bap_compositing(ard_t *ard, level3_t *l3, int nt, int nb, short nodata, int p, par_scr_t *score, int *tdist, float hmean, float hsd, bool water, par_bap_t *bap){
-int t, max_t = -1, n = 0, b;
+int t, k, nv, max_t = -1, n = 0, b;
 float max_score = -1;
+const int *obs = NULL;
+
 
+  nv = valid_obs(ard, p, &obs);
 
-  // go through time
-  for (t=0; t<nt; t++){
+  // go through the valid observations
+  for (k=0; k<nv; k++){
 
-    if (!ard[t].msk[p]) continue;
+    t = obs[k];
 
     if (!bap->offsea && score[t].d < 0.01) continue;
     if (bap->w.h  > 0 && score[t].h  < 0.01 && 
@@ -44,13 +44,29 @@ typedef struct {
   float a, b; // fitted parameters for logistic S-curve or Gaussian
 } target_t;
 
-target_t *compile_target_static(par_bap_t *bap);
-target_t *compile_target_adaptive(par_bap_t *bap, ard_t *lsp, int p, short nodata);
+// cache for phenology-adaptive targets, one per thread
+typedef struct {
+  int size;        // number of slots for logistic fits
+  float *x0, *x2;  // centered dates of the cached logistic fits
+  float *a, *b;    // cached logistic parameters
+  bool *used;      // is slot used?
+  int nl;          // number of LSP values per pixel (3 x years)
+  short *lsp;      // LSP values of the last pixel
+  target_t *target; // targets of the last pixel
+  bool valid;      // is last pixel cached?
+} target_cache_t;
+
+target_t *compile_target_static(par_bap_t *bap, int k);
+target_t *compile_target_adaptive(par_bap_t *bap, ard_t *lsp, int p, short nodata, target_cache_t *cache);
+target_cache_t *allocate_target_cache(par_bap_t *bap, ard_t *lsp);
+void free_target_cache(target_cache_t *cache);
 bool pixel_is_water(ard_t *ard, int nt, int p);
-int corr_matrix(ard_t *ard, int nt, int nb, int p, float **cor);
+int corr_matrix(ard_t *ard, int nt, int nb, int p, double *z, float **cor);
 int haze_stats(ard_t *ard, int nt, int p, par_scr_t *score, par_bap_t *bap, float *mean, float *sd);
 int water_score(ard_t *ard, int nt, int p, par_scr_t *score);
-int parametric_score(ard_t *ard, int nt, int p, target_t *target, float **cor, par_scr_t *score, int *tdist, par_bap_t *bap);
+bool temporal_score(int ce, int year, target_t *target, par_scr_t *score, int *tdist, par_bap_t *bap);
+int auxiliary_score(ard_t *ard, int nt, int p, float **cor, par_scr_t *score, par_bap_t *bap);
+int parametric_score(ard_t *ard, int nt, int p, target_t *target, par_scr_t *score, int *tdist, par_bap_t *bap);
 int bap_compositing(ard_t *ard, level3_t *level3, int nt, int nb, short nodata, int p, par_scr_t *score, int *tdist, float hmean, float hsd, bool water, par_bap_t *bap);
 int bap_overview(level3_t *l3, int nx, int ny, int nb, double res, short nodata);
 
@@ -181,7 +181,7 @@ float **cf_tex_ = NULL;
 short **seasonal_avg_ = NULL;
 short **pred_ = NULL;
 int nprod = 0;
-int f, i, j, p, b, nx, ny, nc, nb_ard, npc;
+int f, p, b, nx, ny, nc, nb_ard, npc;
 int ny_cf, b_cf, y;
 short ard_nodata, cf_nodata;
 float **KDIST = NULL; // kernel distance
@@ -328,25 +328,13 @@ bool is_empty;
 
     }
 
-    #pragma omp parallel private(p,f) shared(ard_,ard_tex_,cf_,cf_tex_,pred_,cfi,ncf,ny,nx,npc,ard_nodata,cf_nodata,KDIST,nk,mink,phl,y) default(none)
-    {
-
-      #pragma omp for collapse(2) schedule(guided)
-      for (i=0; i<ny; i++){
-      for (j=0; j<nx; j++){
-
-        p = i*nx+j;
-
-        if (cf_[0][p] == cf_nodata) continue;
-
-        improphe(ard_, ard_tex_, cf_, cf_tex_, pred_, KDIST, ard_nodata, cf_nodata, i, j, p, 
-          nx, ny, phl->imp.ksize, npc, ncf, nk, mink);
-
-        for (f=0; f<ncf; f++) cfi.imp_[f][y][p] = pred_[f][p];
-
-      }
-      }
+    improphe(ard_, ard_tex_, cf_, cf_tex_, pred_, KDIST, ard_nodata, cf_nodata, 
+      nx, ny, phl->imp.ksize, npc, ncf, nk, mink);
 
+    #pragma omp parallel for private(f) shared(cf_,pred_,cfi,ncf,nc,cf_nodata,y) default(none)
+    for (p=0; p<nc; p++){
+      if (cf_[0][p] == cf_nodata) continue;
+      for (f=0; f<ncf; f++) cfi.imp_[f][y][p] = pred_[f][p];
     }
     
 
@@ -202,9 +202,11 @@ cso_t cs;
 brick_t **CSO;
 small *mask_ = NULL;
 int o, w, k, n, q, p, nprod = 0;
-int t, t_left;
+int t, t_left, i, nv;
 int d_ce, ce, ce_left;
 int *t0 = NULL, *t1 = NULL;
+int *ce_t = NULL;
+const int *obs = NULL;
 int month, year;
 int nc;
 int nw;
@@ -286,10 +288,15 @@ bool alloc_q_array = false;
 
 
   
+  // date of each observation
+  alloc((void**)&ce_t, nt, sizeof(int));
+  for (t=0; t<nt; t++) ce_t[t] = get_brick_ce(ard[t].QAI, 0);
+
+
   if (phl->cso.sta.quantiles || phl->cso.sta.iqr > -1) alloc_q_array = true;
   
 
-  #pragma omp parallel private(o,t,w,minimum,maximum,q,q_array,mean,var,skew,kurt,n,k,skewscaled,kurtscaled,q25_,q75_,d_ce,ce,ce_left) shared(mask_,cs,nc,nw,nt,nodata,alloc_q_array,phl,t0,t1,nprod,ard) default(none)
+  #pragma omp parallel private(o,t,w,minimum,maximum,q,q_array,mean,var,skew,kurt,n,k,skewscaled,kurtscaled,q25_,q75_,d_ce,ce,ce_left,i,nv,obs) shared(ard,mask_,cs,nc,nw,nt,nodata,alloc_q_array,phl,t0,t1,nprod,ce_t) default(none)
   {
 
     if (alloc_q_array) alloc((void**)&q_array, nt+1, sizeof(float));
@@ -304,6 +311,11 @@ bool alloc_q_array = false;
         continue;
       }
 
+      // the windows are consecutive, thus the valid observations are
+      // walked once for all windows, i.e. i is not reset per window
+      nv = valid_obs(ard, p, &obs);
+      i  = 0;
+
 
       for (w=0; w<nw; w++){
 
@@ -316,12 +328,14 @@ bool alloc_q_array = false;
 
           ce_left = cs.d_cso[w].ce;
 
-          for (t=t0[w]; t<=t1[w]; t++){
+          // skip clear-sky observations before the window
+          while (i < nv && obs[i] < t0[w]) i++;
 
-            // check nodata
-            if (!ard[t].msk[p]) continue;
-            
-            ce = get_brick_ce(ard[t].QAI, 0);
+          // clear-sky observations within the window
+          for (; i < nv && obs[i] <= t1[w]; i++){
+
+            ce = ce_t[obs[i]];
+            n++;
 
             // if current date is larger than previous date (incl. left window boundary),
             // include dt in stats
@@ -334,8 +348,6 @@ bool alloc_q_array = false;
               ce_left = ce;
             }
 
-            n++;
-
           }
 
           // if current date is smaller than right window boundary,
@@ -401,6 +413,7 @@ bool alloc_q_array = false;
   if (cs.d_cso != NULL){ free((void*)cs.d_cso); cs.d_cso = NULL;}
   free((void*)t0);
   free((void*)t1);
+  free((void*)ce_t);
 
 
   *nproduct = nprod;
@@ -28,164 +28,296 @@ This file contains functions for folding time series
 #include "fold-hl.h"
 
 
-enum { _YEAR_, _QUARTER_, _MONTH_, _WEEK_, _DOY_ };
+enum { _YEAR_, _QUARTER_, _MONTH_, _WEEK_, _DOY_, _FOLD_LENGTH_ };
 
-int fold(short **tsi_, date_t *d_tsi, small *mask_, int nc, int ni, short **fld_, date_t *d_fld, int nf, short nodata, int by, par_hl_t *phl);
+short fold_value(int type, int n, short minimum, short maximum, double mean, double var, double skew, double kurt, float *q_array);
+int fold_map(date_axis_t *ax_tsi, int ni, short **fld_, date_t *d_fld, int nf, int by, int bin0, fold_map_t *map);
+int fold(short *tsi_pm, small *mask_, int nc, int ni, fold_map_t *map, int nmap, int nbin, short nodata, int type);
+int fold_maps(tsa_t *ts, int ni, par_hl_t *phl, fold_map_t *map);
 
 
-/** This function folds the time series in a given aggregation period
---- tsi_:   interpolated image array
---- d_tsi_: interpolation dates
---- mask:   mask image
---- nc:     number of cells
+/** This function returns the date component that a folding period is
++++ aggregated by
+--- date:   date
+--- by:     folding period (0: year, 1: quarter, 2: month, 3: week, 4: doy)
++++ Return: key
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int fold_key(date_t *date, int by){
+
+  switch (by){
+    case _YEAR_:    return date->year;
+    case _QUARTER_: return date->quarter;
+    case _MONTH_:   return date->month;
+    case _WEEK_:    return date->week;
+    default:        return date->doy;
+  }
+
+}
+
+
+/** This function returns the date components of a date axis that a fold-
++++ ing period is aggregated by
+--- axis:   date axis
+--- by:     folding period (0: year, 1: quarter, 2: month, 3: week, 4: doy)
++++ Return: keys
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int *fold_axis(date_axis_t *axis, int by){
+
+  switch (by){
+    case _YEAR_:    return axis->year;
+    case _QUARTER_: return axis->quarter;
+    case _MONTH_:   return axis->month;
+    case _WEEK_:    return axis->week;
+    default:        return axis->doy;
+  }
+
+}
+
+
+/** This function computes the folding statistic of one fold
+--- type:    folding statistic
+--- n:       number of observations
+--- minimum: minimum
+--- maximum: maximum
+--- mean:    recurrence mean
+--- var:     recurrence variance
+--- skew:    recurrence skewness
+--- kurt:    recurrence kurtosis
+--- q_array: observations, for quantiles
++++ Return: folded value
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+short fold_value(int type, int n, short minimum, short maximum, double mean, double var, double skew, double kurt, float *q_array){
+double skewscaled, kurtscaled;
+
+
+  if (type >= _STA_Q01_ && type <= _STA_Q99_){
+    return (short)quantile(q_array, n, (type-_STA_Q01_+1)/100.0);
+  }
+
+  switch (type){
+    case _STA_NUM_:
+      return n;
+    case _STA_AVG_:
+      return (short)mean;
+    case _STA_MIN_:
+      return minimum;
+    case _STA_MAX_:
+      return maximum;
+    case _STA_RNG_:
+      return maximum-minimum;
+    case _STA_STD_:
+      return (short)standdev(var, n);
+    case _STA_SKW_:
+      skewscaled = skewness(var, skew, n)*1000;
+      if (skewscaled < -30000) skewscaled = -30000;
+      if (skewscaled >  30000) skewscaled =  30000;
+      return (short)skewscaled;
+    case _STA_KRT_:
+      kurtscaled = (kurtosis(var, kurt, n)-3)*1000;
+      if (kurtscaled < -30000) kurtscaled = -30000;
+      if (kurtscaled >  30000) kurtscaled =  30000;
+      return (short)kurtscaled;
+    case _STA_IQR_:
+      return (short)(quantile(q_array, n, 0.75)-quantile(q_array, n, 0.25));
+  }
+
+  return 0;
+}
+
+
+/** This function maps the interpolation steps to the folds of one aggre-
++++ gation period. The map is the same for every pixel. Folds with the 
++++ same date key as an earlier fold are not computed, but copied.
+--- ax_tsi: interpolation dates
 --- ni:     number of interpolation steps
---- fld_:   folded image array (returned)
+--- fld_:   folded image array
 --- d_fld:  dates of folded time series
 --- nf:     number of folds
---- nodata: nodata value
 --- by:     aggregation period
+--- bin0:   index of the first fold in all folds
+--- map:    folding map (returned)
++++ Return: number of folds
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int fold_map(date_axis_t *ax_tsi, int ni, short **fld_, date_t *d_fld, int nf, int by, int bin0, fold_map_t *map){
+int *key = fold_axis(ax_tsi, by);
+int f, g, t;
+
+
+  map->fld_ = fld_;
+  map->nf   = (fld_ != NULL) ? nf : 0;
+  map->bin0 = bin0;
+
+  alloc((void**)&map->bin_of, ni, sizeof(int));
+  alloc((void**)&map->first, map->nf+1, sizeof(int));
+
+  for (f=0; f<map->nf; f++){
+    for (g=0; g<f; g++){
+      if (fold_key(&d_fld[g], by) == fold_key(&d_fld[f], by)) break;
+    }
+    map->first[f] = g;
+  }
+
+  for (t=0; t<ni; t++){
+    map->bin_of[t] = -1;
+    for (f=0; f<map->nf; f++){
+      if (key[t] != fold_key(&d_fld[f], by)) continue;
+      map->bin_of[t] = bin0 + map->first[f];
+      break;
+    }
+  }
+
+  return map->nf;
+}
+
+
+/** This function maps the interpolation steps to the folds of all aggre-
++++ gation periods
+--- ts:     pointer to instantly useable TSA image arrays
+--- ni:     number of interpolation steps
 --- phl:    HL parameters
+--- map:    folding maps, one per aggregation period (returned)
++++ Return: number of folds in all folding maps
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int fold_maps(tsa_t *ts, int ni, par_hl_t *phl, fold_map_t *map){
+int nbin = 0;
+
+
+  nbin += fold_map(&ts->ax_tsi, ni, ts->fby_, ts->d_fby, phl->ny, _YEAR_,    nbin, &map[_YEAR_]);
+  nbin += fold_map(&ts->ax_tsi, ni, ts->fbq_, ts->d_fbq, phl->nq, _QUARTER_, nbin, &map[_QUARTER_]);
+  nbin += fold_map(&ts->ax_tsi, ni, ts->fbm_, ts->d_fbm, phl->nm, _MONTH_,   nbin, &map[_MONTH_]);
+  nbin += fold_map(&ts->ax_tsi, ni, ts->fbw_, ts->d_fbw, phl->nw, _WEEK_,    nbin, &map[_WEEK_]);
+  nbin += fold_map(&ts->ax_tsi, ni, ts->fbd_, ts->d_fbd, phl->nd, _DOY_,     nbin, &map[_DOY_]);
+
+  return nbin;
+}
+
+
+/** This function folds the time series in all requested aggregation pe-
++++ riods in one pass. Each interpolation step is added to one fold of 
++++ each aggregation period, following the precomputed folding maps.
+--- tsi_pm: interpolated time series, pixel-major
+--- mask:   mask image
+--- nc:     number of cells
+--- ni:     number of interpolation steps
+--- map:    folding maps
+--- nmap:   number of folding maps
+--- nbin:   number of folds in all folding maps
+--- nodata: nodata value
+--- type:   folding statistic
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int fold(short **tsi_, date_t *d_tsi, small *mask_, int nc, int ni, short **fld_, date_t *d_fld, int nf, short nodata, int by, par_hl_t *phl){
-int f, t, n, p;
-short minimum, maximum;
-double mean, var;
-double skew, kurt;
-double skewscaled, kurtscaled;
+int fold(short *tsi_pm, small *mask_, int nc, int ni, fold_map_t *map, int nmap, int nbin, short nodata, int type){
+int f, g, k, t, p;
+short v;
+int *n = NULL, *q_off = NULL;
+short *minimum = NULL, *maximum = NULL;
+double *mean = NULL, *var = NULL;
+double *skew = NULL, *kurt = NULL;
 float *q_array = NULL;
 bool alloc_q_array = false;
 
 
-  if (fld_ == NULL) return CANCEL;
+  if ((type >= _STA_Q01_ && type <= _STA_Q99_) || type == _STA_IQR_) alloc_q_array = true;
 
-  if ((phl->tsa.fld.type >= _STA_Q01_ && phl->tsa.fld.type <= _STA_Q99_) ||
-       phl->tsa.fld.type == _STA_IQR_) alloc_q_array = true;
+  // offset of each fold in the quantile array
+  if (alloc_q_array){
+    alloc((void**)&q_off, nbin+1, sizeof(int));
+    for (k=0; k<nmap; k++){
+      for (t=0; t<ni; t++){
+        if ((g = map[k].bin_of[t]) >= 0) q_off[g+1]++;
+      }
+    }
+    for (g=0; g<nbin; g++) q_off[g+1] += q_off[g];
+  }
   
 
-  #pragma omp parallel private(f,t,minimum,maximum,q_array,mean,var,skew,kurt,n,skewscaled,kurtscaled) shared(mask_,tsi_,fld_,d_fld,d_tsi,nc,ni,nf,by,nodata,phl,alloc_q_array) default(none)
+  #pragma omp parallel private(f,g,k,t,v,n,minimum,maximum,mean,var,skew,kurt,q_array) shared(mask_,tsi_pm,map,nmap,nbin,nc,ni,nodata,type,alloc_q_array,q_off) default(none)
   {
     
-    // initialize _STAts
-    if (alloc_q_array) alloc((void**)&q_array, ni, sizeof(float));
+    alloc((void**)&n,       nbin, sizeof(int));
+    alloc((void**)&minimum, nbin, sizeof(short));
+    alloc((void**)&maximum, nbin, sizeof(short));
+    alloc((void**)&mean,    nbin, sizeof(double));
+    alloc((void**)&var,     nbin, sizeof(double));
+    alloc((void**)&skew,    nbin, sizeof(double));
+    alloc((void**)&kurt,    nbin, sizeof(double));
+    if (alloc_q_array) alloc((void**)&q_array, q_off[nbin], sizeof(float));
 
     #pragma omp for
     for (p=0; p<nc; p++){
 
       if (mask_ != NULL && !mask_[p]){
-        for (f=0; f<nf; f++) fld_[f][p] = nodata;
+        for (k=0; k<nmap; k++){
+          for (f=0; f<map[k].nf; f++) map[k].fld_[f][p] = nodata;
+        }
         continue;
       }
 
+      for (g=0; g<nbin; g++){
+        mean[g] = var[g] = skew[g] = kurt[g] = n[g] = 0;
+        minimum[g] = SHRT_MAX; maximum[g] = SHRT_MIN;
+      }
 
-      for (f=0; f<nf; f++){
-
-        mean = var = skew = kurt = n = 0;
-        minimum = SHRT_MAX; maximum = SHRT_MIN;
-
-        // compute _STAts
-        for (t=0; t<ni; t++){
-
-          switch (by){
-            case _YEAR_:
-              if (d_tsi[t].year != d_fld[f].year) continue;
-              break;
-            case _QUARTER_:
-              if (d_tsi[t].quarter != d_fld[f].quarter) continue;
-    //printf("%d %d - Q FLD: %d, Q TSI: %d\n", f, t, d_fld[f].quarter, d_tsi[t].quarter);
-    //print_date(&d_fld[f]);
-    //print_date(&d_tsi[t]);
-              break;
-            case _MONTH_:
-              if (d_tsi[t].month != d_fld[f].month) continue;
-              break;
-            case _WEEK_:
-              if (d_tsi[t].week  != d_fld[f].week) continue;
-    //printf("%d %d - W FLD: %d, W TSI: %d\n", f, t, d_fld[f].week, d_tsi[t].week);
-    //print_date(&d_fld[f]);
-    //print_date(&d_tsi[t]);
-              break;
-            case _DOY_:
-              if (d_tsi[t].doy != d_fld[f].doy) continue;
-              break;
-          }
+      // add each step to its fold in every aggregation period
+      for (t=0; t<ni; t++){
 
-          if (tsi_[t][p] == nodata) continue;
+        if ((v = tsi_pm[(size_t)p*ni+t]) == nodata) continue;
+
+        for (k=0; k<nmap; k++){
+
+          if ((g = map[k].bin_of[t]) < 0) continue;
 
-          
           // range metrics
-          if (tsi_[t][p] < minimum) minimum = tsi_[t][p];
-          if (tsi_[t][p] > maximum) maximum = tsi_[t][p];
+          if (v < minimum[g]) minimum[g] = v;
+          if (v > maximum[g]) maximum[g] = v;
 
           // quantile metrics
-          if (alloc_q_array) q_array[n] = tsi_[t][p];
+          if (alloc_q_array) q_array[q_off[g]+n[g]] = v;
 
-          n++;
+          n[g]++;
 
           // moments metrics
-          kurt_recurrence(tsi_[t][p], &mean, &var, 
-                            &skew, &kurt, n);
+          kurt_recurrence(v, &mean[g], &var[g], &skew[g], &kurt[g], n[g]);
 
         }
 
-        
-        // fold by mean (0), min (1), max (2)
-        if (n > 0){
-
-          switch (phl->tsa.fld.type){
-            case _STA_NUM_:
-              fld_[f][p] = n;
-              break;
-            case _STA_AVG_:
-              fld_[f][p] = (short)mean;
-              break;
-            case _STA_MIN_:
-              fld_[f][p] = minimum;
-              break;
-            case _STA_MAX_:
-              fld_[f][p] = maximum;
-              break;
-            case _STA_RNG_:
-              fld_[f][p] = maximum-minimum;
-              break;
-            case _STA_STD_:
-              fld_[f][p] = (short)standdev(var, n);
-              break;
-            case _STA_SKW_:
-              skewscaled = skewness(var, skew, n)*1000;
-              if (skewscaled < -30000) skewscaled = -30000;
-              if (skewscaled >  30000) skewscaled =  30000;
-              fld_[f][p] = (short)skewscaled;
-              break;
-            case _STA_KRT_:
-              kurtscaled = (kurtosis(var, kurt, n)-3)*1000;
-              if (kurtscaled < -30000) kurtscaled = -30000;
-              if (kurtscaled >  30000) kurtscaled =  30000;
-              fld_[f][p] = (short)kurtscaled;
-              break;
-            case _STA_IQR_:
-              fld_[f][p] = (short)(quantile(q_array, n, 0.75)-quantile(q_array, n, 0.25));
-              break;
-          }
+      }
 
-          if (phl->tsa.fld.type >= _STA_Q01_ && phl->tsa.fld.type <= _STA_Q99_){
-            fld_[f][p] = (short)quantile(q_array, n, (phl->tsa.fld.type-_STA_Q01_+1)/100.0);
+      
+      for (k=0; k<nmap; k++){
+        for (f=0; f<map[k].nf; f++){
+
+          if (map[k].first[f] < f){
+            map[k].fld_[f][p] = map[k].fld_[map[k].first[f]][p];
+            continue;
           }
 
-        } else {
+          g = map[k].bin0 + f;
 
-          fld_[f][p] = nodata;
+          if (n[g] > 0){
+            map[k].fld_[f][p] = fold_value(type, n[g], minimum[g], maximum[g], 
+              mean[g], var[g], skew[g], kurt[g], alloc_q_array ? q_array+q_off[g] : NULL);
+          } else {
+            map[k].fld_[f][p] = nodata;
+          }
 
         }
-
       }
       
     }
    
+    free((void*)n);
+    free((void*)minimum);
+    free((void*)maximum);
+    free((void*)mean);
+    free((void*)var);
+    free((void*)skew);
+    free((void*)kurt);
     if (alloc_q_array) free((void*)q_array);
    
   }
-  
+
+  if (alloc_q_array) free((void*)q_off);
 
   return SUCCESS;
 }
@@ -205,14 +337,160 @@ bool alloc_q_array = false;
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int tsa_fold(tsa_t *ts, small *mask_, int nc, int ni, short nodata, par_hl_t *phl){
+fold_map_t map[_FOLD_LENGTH_];
+int k, nbin;
+
+
+  nbin = fold_maps(ts, ni, phl, map);
+
+  if (nbin > 0) fold(ts->tsi_pm, mask_, nc, ni, map, _FOLD_LENGTH_, nbin, nodata, phl->tsa.fld.type);
+
+  for (k=0; k<_FOLD_LENGTH_; k++){
+    free((void*)map[k].bin_of);
+    free((void*)map[k].first);
+  }
+
+  return SUCCESS;
+}
 
 
-  fold(ts->tsi_, ts->d_tsi, mask_, nc, ni, ts->fby_, ts->d_fby, phl->ny, nodata, _YEAR_,    phl);
-  fold(ts->tsi_, ts->d_tsi, mask_, nc, ni, ts->fbq_, ts->d_fbq, phl->nq, nodata, _QUARTER_, phl);
-  fold(ts->tsi_, ts->d_tsi, mask_, nc, ni, ts->fbm_, ts->d_fbm, phl->nm, nodata, _MONTH_,   phl);
-  fold(ts->tsi_, ts->d_tsi, mask_, nc, ni, ts->fbw_, ts->d_fbw, phl->nw, nodata, _WEEK_,    phl);
-  fold(ts->tsi_, ts->d_tsi, mask_, nc, ni, ts->fbd_, ts->d_fbd, phl->nd, nodata, _DOY_,     phl);
+/** This function prepares the folding of a time series that is interpola-
++++ ted window by window (see INT_WINDOW). Each fold holds running statis-
++++ tics per pixel, i.e. memory depends on the number of folds, not on the
++++ number of interpolation steps. Quantiles are not supported.
+--- ts:     pointer to instantly useable TSA image arrays
+--- nc:     number of cells
+--- ni:     number of interpolation steps
+--- phl:    HL parameters
+--- win:    windowed folds (returned, must be freed with term_fold_window)
++++ Return: number of folds in all folding maps
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int init_fold_window(tsa_t *ts, int nc, int ni, par_hl_t *phl, fold_window_t *win){
+
+
+  win->nbin = fold_maps(ts, ni, phl, win->map);
+  win->acc  = NULL;
+
+  if (win->nbin > 0){
+    alloc((void**)&win->acc, (size_t)nc*win->nbin, sizeof(run_stats_t));
+    init_run_stats(win->acc, (size_t)nc*win->nbin);
+  }
+
+  return win->nbin;
+}
+
+
+/** This function adds one temporal window of the interpolated time series
++++ to the running statistics of the folds. Each step is added to one fold
++++ of each aggregation period, in the same order as in fold().
+--- win:    windowed folds
+--- tsi_:   interpolated window (nw x nc)
+--- mask:   mask image
+--- nc:     number of cells
+--- i0:     first interpolation step of the window
+--- nw:     number of interpolation steps in the window
+--- nodata: nodata value
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int fold_window(fold_window_t *win, short **tsi_, small *mask_, int nc, int i0, int nw, short nodata){
+int g, k, t, p;
+short v;
+run_stats_t *acc = NULL;
+
+
+  if (win->nbin == 0) return CANCEL;
+
+  #pragma omp parallel private(g,k,t,v,acc) shared(win,tsi_,mask_,nc,i0,nw,nodata) default(none)
+  {
+
+    #pragma omp for
+    for (p=0; p<nc; p++){
+
+      if (mask_ != NULL && !mask_[p]) continue;
+
+      acc = win->acc + (size_t)p*win->nbin;
+
+      for (t=0; t<nw; t++){
+
+        if ((v = tsi_[t][p]) == nodata) continue;
+
+        for (k=0; k<_FOLD_LENGTH_; k++){
+          if ((g = win->map[k].bin_of[i0+t]) >= 0) add_run_stats(&acc[g], v);
+        }
+
+      }
+
+    }
+
+  }
 
   return SUCCESS;
 }
 
+
+/** This function computes the folds from the running statistics of a 
++++ windowed time series, and frees the windowed folds.
+--- win:    windowed folds
+--- mask:   mask image
+--- nc:     number of cells
+--- nodata: nodata value
+--- type:   folding statistic
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int term_fold_window(fold_window_t *win, small *mask_, int nc, short nodata, int type){
+fold_map_t *map = win->map;
+run_stats_t *acc = NULL;
+int f, g, k, p;
+
+
+  if (win->nbin > 0){
+
+    #pragma omp parallel private(f,g,k,acc) shared(win,map,mask_,nc,nodata,type) default(none)
+    {
+
+      #pragma omp for
+      for (p=0; p<nc; p++){
+
+        if (mask_ != NULL && !mask_[p]){
+          for (k=0; k<_FOLD_LENGTH_; k++){
+            for (f=0; f<map[k].nf; f++) map[k].fld_[f][p] = nodata;
+          }
+          continue;
+        }
+
+        acc = win->acc + (size_t)p*win->nbin;
+
+        for (k=0; k<_FOLD_LENGTH_; k++){
+          for (f=0; f<map[k].nf; f++){
+
+            if (map[k].first[f] < f){
+              map[k].fld_[f][p] = map[k].fld_[map[k].first[f]][p];
+              continue;
+            }
+
+            g = map[k].bin0 + f;
+
+            if (acc[g].n > 0){
+              map[k].fld_[f][p] = fold_value(type, acc[g].n, acc[g].minimum, acc[g].maximum, 
+                acc[g].mean, acc[g].var, acc[g].skew, acc[g].kurt, NULL);
+            } else {
+              map[k].fld_[f][p] = nodata;
+            }
+
+          }
+        }
+
+      }
+
+    }
+
+  }
+
+  for (k=0; k<_FOLD_LENGTH_; k++){
+    free((void*)map[k].bin_of);
+    free((void*)map[k].first);
+  }
+  free((void*)win->acc); win->acc = NULL;
+
+  return SUCCESS;
+}
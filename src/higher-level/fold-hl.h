@@ -39,7 +39,28 @@ Folding time series header
 extern "C" {
 #endif
 
+// folds of one aggregation period
+typedef struct {
+  short **fld_;   // folded image array
+  int nf;         // number of folds
+  int bin0;       // index of the first fold in all folds
+  int *bin_of;    // fold of each interpolation step (in all folds), -1: none
+  int *first;     // first fold with the same date key
+} fold_map_t;
+
+// folds of a time series that is interpolated window by window
+typedef struct {
+  fold_map_t map[_FLD_LENGTH_]; // folding maps, one per aggregation period
+  int nbin;                     // number of folds in all folding maps
+  run_stats_t *acc;             // running statistics (nc x nbin)
+} fold_window_t;
+
 int tsa_fold(tsa_t *ts, small *mask_, int nc, int ni, short nodata, par_hl_t *phl);
+int fold_key(date_t *date, int by);
+int *fold_axis(date_axis_t *axis, int by);
+int init_fold_window(tsa_t *ts, int nc, int ni, par_hl_t *phl, fold_window_t *win);
+int fold_window(fold_window_t *win, short **tsi_, small *mask_, int nc, int i0, int nw, short nodata);
+int term_fold_window(fold_window_t *win, small *mask_, int nc, short nodata, int type);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,350 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains the ImproPhe prediction on the GPU. One thread per
+pixel scans the kernel neighbourhood twice, like improphe_pixel in 
+improphe-hl.c: the first pass finds the ranges of the similarity measu-
+res, the second pass accumulates the weighted mean. The HR data and the
+validity flags of each block of pixels, plus a halo of the kernel ra-
+dius, are staged in shared memory, as the spectral distance is computed
+for all neighbours. If the tile does not fit, the kernel reads from glo-
+bal memory instead. Without FORCE_CUDA, this file is compiled as C++ and
+improphe_gpu always cancels.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "improphe-gpu-hl.h"
+
+#include <string.h>  // string handling functions
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define IMP_GPU_BLOCK  16      // block width
+#define IMP_GPU_SHARED 49152   // usable shared memory per block
+#define IMP_GPU_MAXB   16      // max. number of MR bands
+
+
+/** device functions and kernels
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+// see rescale_weight in improphe-hl.c
+__device__ double rescale_weight_device(double weight, double minweight, double maxweight){
+
+  if (weight == 0) return 1;
+  if (minweight == maxweight) return 1;
+
+  return 1+exp(25 * ((weight-minweight)/(maxweight-minweight))-7.5);
+}
+
+
+__global__ void improphe_kernel(const float *__restrict__ hr, const float *__restrict__ hr_tex, 
+  const float *__restrict__ mr, const float *__restrict__ mr_tex, const small *__restrict__ valid, 
+  const float *__restrict__ kdist, short *pred, int nx, int ny, int h, int nb_hr, int nb_mr, int mink, int tiled){
+extern __shared__ float tile[];
+int tw = blockDim.x+2*h, tn = tw*tw;
+small *vtile = (small*)(tile + (size_t)nb_hr*tn);
+int i0 = blockIdx.y*blockDim.y - h;
+int j0 = blockIdx.x*blockDim.x - h;
+int i  = blockIdx.y*blockDim.y + threadIdx.y;
+int j  = blockIdx.x*blockDim.x + threadIdx.x;
+size_t nc = (size_t)nx*ny, np, bs;
+const float *H = NULL;
+const small *V = NULL;
+int vw, oi, oj, ci, ni, nj, ni0, ni1, nj0, nj1, idx, k, b, s, Sc, wn = 0;
+double S, SS, TT, UU, T, U, W, sum;
+double Srange[2][IMP_NS], Trange[2][IMP_NS], Urange[2][IMP_GPU_MAXB][IMP_NS];
+double weightxdata[IMP_GPU_MAXB], weight[IMP_GPU_MAXB];
+const float Sthr[IMP_NS] = { 0.025, 0.05, 0.1, 0.2, 0.4 };
+int Sn[IMP_NS] = { 0, 0, 0, 0, 0 };
+
+
+  // stage HR data and validity of the block + halo
+  if (tiled){
+    for (k=threadIdx.y*blockDim.x+threadIdx.x; k<tn; k+=blockDim.x*blockDim.y){
+      ni = i0 + k/tw;
+      nj = j0 + k%tw;
+      if (ni < 0 || nj < 0 || ni >= ny || nj >= nx){ vtile[k] = 0; continue;}
+      np = (size_t)ni*nx+nj;
+      for (b=0; b<nb_hr; b++) tile[b*tn+k] = hr[b*nc+np];
+      vtile[k] = valid[np];
+    }
+    __syncthreads();
+  }
+
+  if (i >= ny || j >= nx) return;
+
+  if (tiled){
+    H = tile;  V = vtile; bs = tn; vw = tw; oi = i0; oj = j0;
+  } else {
+    H = hr;    V = valid; bs = nc; vw = nx; oi = 0;  oj = 0;
+  }
+
+  ci = (i-oi)*vw + (j-oj);
+  np = (size_t)i*nx+j;
+
+  // if any MR parameter == nodata, skip
+  if (!(V[ci] & IMP_MR_VALID)) return;
+
+  for (s=0; s<IMP_NS; s++){
+    Srange[0][s] = Trange[0][s] = INT_MAX; 
+    Srange[1][s] = Trange[1][s] = INT_MIN;
+    for (b=0; b<nb_mr; b++){ 
+      Urange[0][b][s] = INT_MAX; 
+      Urange[1][b][s] = INT_MIN;
+    }
+  }
+  for (b=0; b<nb_mr; b++) weightxdata[b] = weight[b] = 0.0;
+
+  ni0 = max(i-h, 0); ni1 = min(i+h, ny-1);
+  nj0 = max(j-h, 0); nj1 = min(j+h, nx-1);
+
+
+  // first pass: ranges of S, T and U
+  for (ni=ni0; ni<=ni1; ni++){
+  for (nj=nj0; nj<=nj1; nj++){
+
+    if (kdist[(ni-i+h)*(2*h+1) + (nj-j+h)] > h) continue;
+
+    idx = (ni-oi)*vw + (nj-oj);
+    if (V[idx] != (IMP_MR_VALID | IMP_HR_VALID)) continue;
+
+    for (b=0, sum=0; b<nb_hr; b++) sum += fabs((double)(H[b*bs+ci]-H[b*bs+idx]));
+    S = sum/(float)nb_hr;
+
+    for (s=0, Sc=-1; s<IMP_NS; s++){
+      if (S < Sthr[s]){ Sc = s; break;}
+    }
+    if (Sc < 0) continue;
+
+    np = (size_t)ni*nx+nj;
+
+    if (S > 0){
+      for (s=Sc; s<IMP_NS; s++){
+        if (S > Srange[1][s]) Srange[1][s] = S;
+        if (S < Srange[0][s]) Srange[0][s] = S;
+      }
+    }
+
+    T = hr_tex[np];
+    if (T > 0){
+      for (s=Sc; s<IMP_NS; s++){
+        if (T > Trange[1][s]) Trange[1][s] = T;
+        if (T < Trange[0][s]) Trange[0][s] = T;
+      }
+    }
+
+    for (b=0; b<nb_mr; b++){
+      U = mr_tex[b*nc+np];
+      if (U > 0){
+        for (s=Sc; s<IMP_NS; s++){
+          if (U > Urange[1][b][s]) Urange[1][b][s] = U;
+          if (U < Urange[0][b][s]) Urange[0][b][s] = U;
+        }
+      }
+    }
+
+    wn++;
+    for (s=Sc; s<IMP_NS; s++) Sn[s]++;
+
+  }
+  }
+
+  np = (size_t)i*nx+j;
+
+  // if no valid neighbour, use MR
+  if (wn == 0){
+    for (b=0; b<nb_mr; b++) pred[b*nc+np] = (short)mr[b*nc+np];
+    return;
+  }
+
+  for (s=0, Sc=-1; s<IMP_NS; s++){
+    if (Sn[s] >= mink){ Sc = s; break;}
+  }
+  if (Sc < 0) Sc = IMP_NS-1;
+
+
+  // second pass: weighted mean
+  for (ni=ni0; ni<=ni1; ni++){
+  for (nj=nj0; nj<=nj1; nj++){
+
+    if (kdist[(ni-i+h)*(2*h+1) + (nj-j+h)] > h) continue;
+
+    idx = (ni-oi)*vw + (nj-oj);
+    if (V[idx] != (IMP_MR_VALID | IMP_HR_VALID)) continue;
+
+    for (b=0, sum=0; b<nb_hr; b++) sum += fabs((double)(H[b*bs+ci]-H[b*bs+idx]));
+    S = sum/(float)nb_hr;
+
+    if (S >= Sthr[Sc]) continue;
+
+    np = (size_t)ni*nx+nj;
+
+    SS = rescale_weight_device(S, Srange[0][Sc], Srange[1][Sc]);
+    TT = rescale_weight_device(hr_tex[np], Trange[0][Sc], Trange[1][Sc]);
+
+    for (b=0; b<nb_mr; b++){
+      UU = rescale_weight_device(mr_tex[b*nc+np], Urange[0][b][Sc], Urange[1][b][Sc]);
+      W = 1/(SS*TT*UU);
+      weightxdata[b] += W*mr[b*nc+np];
+      weight[b] += W;
+    }
+
+  }
+  }
+
+  np = (size_t)i*nx+j;
+
+  for (b=0; b<nb_mr; b++) pred[b*nc+np] = (short)(float)(weightxdata[b]/weight[b]);
+
+  return;
+}
+
+#endif
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function predicts medium resolution data of a complete image on
++++ the GPU, see improphe in improphe-hl.c. Pixels with MR nodata are
++++ left untouched in pred_.
+--- hr_:       hr data
+--- hr_text_:  hr texture
+--- mr_:       mr data
+--- mr_tex_:   mr texture
+--- valid_:    validity of pixels (IMP_MR_VALID | IMP_HR_VALID)
+--- pred_:     prediction
+--- KDIST:     kernel distance
+--- nx:        number of columns
+--- ny:        number of rows
+--- h:         prediction radius
+--- nb_hr:     number of bands in hr_
+--- nb_mr:     number of bands in mr_
+--- mink:      minimum number of pixels for good prediction
++++ Return:    SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int improphe_gpu(float **hr_, float *hr_tex_, float **mr_, float **mr_tex_, small *valid_, short **pred_, float **KDIST, int nx, int ny, int h, int nb_hr, int nb_mr, int mink){
+#ifdef FORCE_CUDA
+gpu_stream_t stream = NULL;
+cudaStream_t s;
+float *hr = NULL, *hr_tex = NULL, *mr = NULL, *mr_tex = NULL, *kdist = NULL;
+float *kdist_ = NULL;
+small *valid = NULL;
+short *pred = NULL;
+int b, k, width = 2*h+1, block = IMP_GPU_BLOCK, tiled = true;
+size_t nc = (size_t)nx*ny, bytes_f, bytes_v, bytes_p, bytes_k, shared = 0;
+int error = 0;
+
+
+  if (nb_mr > IMP_GPU_MAXB) return CANCEL;
+
+  stream = claim_gpu_stream();
+  s = (cudaStream_t)gpu_cuda_stream(stream);
+
+  if (!gpu_enabled() || gpu_select(stream) == FAILURE) return CANCEL;
+
+  // largest block whose tile fits into shared memory
+  while (block >= 8){
+    shared = (size_t)(block+2*h)*(block+2*h)*(nb_hr*sizeof(float)+sizeof(small));
+    if (shared <= IMP_GPU_SHARED) break;
+    block /= 2;
+  }
+  if (block < 8){
+    block  = IMP_GPU_BLOCK;
+    shared = 0;
+    tiled  = false;
+  }
+
+  bytes_f = nc*sizeof(float);
+  bytes_v = nc*sizeof(small);
+  bytes_p = nc*sizeof(short);
+  bytes_k = (size_t)width*width*sizeof(float);
+
+  if ((hr     = (float*)gpu_alloc(bytes_f*nb_hr, stream)) == NULL) error++;
+  if ((hr_tex = (float*)gpu_alloc(bytes_f,       stream)) == NULL) error++;
+  if ((mr     = (float*)gpu_alloc(bytes_f*nb_mr, stream)) == NULL) error++;
+  if ((mr_tex = (float*)gpu_alloc(bytes_f*nb_mr, stream)) == NULL) error++;
+  if ((valid  = (small*)gpu_alloc(bytes_v,       stream)) == NULL) error++;
+  if ((pred   = (short*)gpu_alloc(bytes_p*nb_mr, stream)) == NULL) error++;
+  if ((kdist  = (float*)gpu_alloc(bytes_k,       stream)) == NULL) error++;
+
+  alloc((void**)&kdist_, width*width, sizeof(float));
+  for (k=0; k<width; k++) memcpy(kdist_+k*width, KDIST[k], width*sizeof(float));
+
+
+  if (!error){
+
+    for (b=0; b<nb_hr; b++) cudaMemcpyAsync(hr+b*nc, hr_[b], bytes_f, cudaMemcpyHostToDevice, s);
+    for (b=0; b<nb_mr; b++){
+      cudaMemcpyAsync(mr+b*nc,     mr_[b],     bytes_f, cudaMemcpyHostToDevice, s);
+      cudaMemcpyAsync(mr_tex+b*nc, mr_tex_[b], bytes_f, cudaMemcpyHostToDevice, s);
+      cudaMemcpyAsync(pred+b*nc,   pred_[b],   bytes_p, cudaMemcpyHostToDevice, s);
+    }
+    cudaMemcpyAsync(hr_tex, hr_tex_, bytes_f, cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(valid,  valid_,  bytes_v, cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(kdist,  kdist_,  bytes_k, cudaMemcpyHostToDevice, s);
+
+    dim3 threads(block, block);
+    dim3 blocks((nx+block-1)/block, (ny+block-1)/block);
+
+    improphe_kernel<<<blocks, threads, shared, s>>>(hr, hr_tex, mr, mr_tex, valid, 
+      kdist, pred, nx, ny, h, nb_hr, nb_mr, mink, tiled);
+
+    for (b=0; b<nb_mr; b++) cudaMemcpyAsync(pred_[b], pred+b*nc, bytes_p, cudaMemcpyDeviceToHost, s);
+
+    if (cudaGetLastError() != cudaSuccess){
+      printf("launching ImproPhe kernel failed. ");
+      error++;
+    }
+
+  }
+
+  if (gpu_sync(stream) == FAILURE) error++;
+
+  gpu_release(hr,     bytes_f*nb_hr, stream);
+  gpu_release(hr_tex, bytes_f,       stream);
+  gpu_release(mr,     bytes_f*nb_mr, stream);
+  gpu_release(mr_tex, bytes_f*nb_mr, stream);
+  gpu_release(valid,  bytes_v,       stream);
+  gpu_release(pred,   bytes_p*nb_mr, stream);
+  gpu_release(kdist,  bytes_k,       stream);
+
+  free((void*)kdist_);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
@@ -0,0 +1,57 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+ImproPhe on the GPU header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef IMPGPU_HL_H
+#define IMPGPU_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/gpu-cl.h"
+
+
+// number of spectral similarity cutoff thresholds
+#define IMP_NS 5
+
+// validity flags of ImproPhe pixels
+#define IMP_MR_VALID 1
+#define IMP_HR_VALID 2
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int improphe_gpu(float **hr_, float *hr_tex_, float **mr_, float **mr_tex_, small *valid_, short **pred_, float **KDIST, int nx, int ny, int h, int nb_hr, int nb_mr, int mink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
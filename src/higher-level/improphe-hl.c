@@ -28,22 +28,32 @@ This file contains functions for ImproPhing
 #include "improphe-hl.h"
 
 
-/** public functions
-+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+// workspace of one thread
+typedef struct {
+  double *Skernel;     // spectral distance of kernel pixels, -1 if not used
+  double *Srow;        // spectral distance sums of one kernel row
+  double *Urange;      // MR texture range, min and max of all bands x thresholds
+  double *weightxdata; // weighted sum of MR data
+  double *weight;      // sum of weights
+} imp_work_t;
 
+void improphe_pixel(float **hr_, float *hr_tex_, float **mr_, float **mr_tex_, small *valid_, short **pred_, float **KDIST, int i, int j, int p, int nx, int ny, int h, int nb_hr, int nb_mr, int mink, imp_work_t *work);
 
-/** Predict medium resolution data (ImproPhe method)
+
+/** Predict medium resolution data (ImproPhe method) of one pixel
 +++ This function is the core method of ImproPhe and predicts the HR data
 +++ on the basis of HR reflectance, HR texture, MR texture and the MR da-
 +++ ta. Neighboring pixels of the same class are used for the prediction.
++++ The spectral distances of one kernel row are computed band by band, 
++++ such that the compiler can vectorize along the row; they are kept in
++++ the workspace for the weighting pass, which avoids per-pixel records.
 --- hr_:       hr data
 --- hr_text_:  hr texture
 --- mr_:       mr data
 --- mr_tex_:   mr texture
+--- valid_:    validity of neighbours (IMP_MR_VALID | IMP_HR_VALID)
 --- pred_:     prediction
 --- KDIST:     kernel distance
---- nodata_hr: nodata of hr_
---- nodata_mr: nodata of mr_
 --- i:         row
 --- j:         column
 --- p:         pixel
@@ -52,56 +62,40 @@ This file contains functions for ImproPhing
 --- h:         prediction radius
 --- nb_hr:     number of bands in hr_
 --- nb_mr:     number of bands in mr_
---- nk:        number of kernel pixels
 --- mink:      minimum number of pixels for good prediction
-+++ Return:    SUCCESS/FAILURE
+--- work:      workspace
++++ Return:    void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int improphe(float **hr_, float *hr_tex_, float **mr_, float **mr_tex_, short **pred_, float **KDIST, float nodata_hr, short nodata_mr, int i, int j, int p, int nx, int ny, int h, int nb_hr, int nb_mr, int nk, int mink){
+void improphe_pixel(float **hr_, float *hr_tex_, float **mr_, float **mr_tex_, small *valid_, short **pred_, float **KDIST, int i, int j, int p, int nx, int ny, int h, int nb_hr, int nb_mr, int mink, imp_work_t *work){
 int ki, kj; // iterator for KDIST
 int ii, jj; // iterator for kernel relative to center
-int ni, nj, np; // pixel positions
+int jlo, jhi; // column range of kernel within image
+int ni, np; // pixel positions
 int b_hr, b_mr, s; // iterator for bands, MR parameters, cutoff-threshold
-int wn = 0, k; // iterator for neighbours
+int wn = 0; // number of neighbours
+int width = 2*h+1;
 
-double D;     // pixel distance
 double S, SS; // spectral similarity + rescaled S
 double T, TT; // subpixel heterogeneity + rescaled T
 double U, UU; // MR heterogeneity + rescaled U
 double W;     // pixel weight
 
-// S, T, U, C of all valid neighbours
-double *Srecord = NULL, *Trecord = NULL, **Urecord = NULL, **Mrecord = NULL;
 // S, T, U range of all valid neighbours
-double Srange[2][5], Trange[2][5], ***Urange = NULL;//[2][MAX_STR_LEN][5];
-
-double *weightxdata = NULL, *weight = NULL;
+double Srange[2][IMP_NS], Trange[2][IMP_NS];
+double *Urange_min = work->Urange, *Urange_max = work->Urange + nb_mr*IMP_NS;
 
-double sum;          // temporary variables to calculate S
-float Sthr[5] = { 0.025, 0.05, 0.1, 0.2, 0.4 }; // cutoff-threshold for S
-int Sn[5] = { 0, 0, 0, 0, 0 };  // number of neighbours for each cutoff-threshold
-int ns = 5, Sc, *Sclass;             // index for cutoff-threshold
-
-bool skip;
+double *weightxdata = work->weightxdata, *weight = work->weight;
+double *Srow = work->Srow, *Skernel = NULL;
 
+float hv;
+const float *src = NULL;
+float Sthr[IMP_NS] = { 0.025, 0.05, 0.1, 0.2, 0.4 }; // cutoff-threshold for S
+int Sn[IMP_NS] = { 0, 0, 0, 0, 0 };  // number of neighbours for each cutoff-threshold
+int ns = IMP_NS, Sc;                 // index for cutoff-threshold
 
 
   // if any MR parameter == nodata, skip
-  for (b_mr=0, skip=false; b_mr<nb_mr; b_mr++){
-    if (mr_[b_mr][p] == nodata_mr){
-      skip = true; break;}
-  }
-  if (skip) return SUCCESS;
-
-
-  // allocate
-  alloc((void**)&Sclass, nk, sizeof(int));
-  alloc((void**)&Srecord, nk, sizeof(double));
-  alloc((void**)&Trecord, nk, sizeof(double));
-  alloc_2D((void***)&Mrecord, nb_mr, nk, sizeof(double));
-  alloc_2D((void***)&Urecord, nb_mr, nk, sizeof(double));
-  alloc_3D((void****)&Urange, 2, nb_mr, ns, sizeof(double));
-  alloc((void**)&weightxdata, nb_mr, sizeof(double));
-  alloc((void**)&weight, nb_mr, sizeof(double));
+  if (!(valid_[p] & IMP_MR_VALID)) return;
 
 
   // initialize
@@ -109,98 +103,93 @@ bool skip;
     Srange[0][s] = Trange[0][s] = INT_MAX; 
     Srange[1][s] = Trange[1][s] = INT_MIN;
     for (b_mr=0; b_mr<nb_mr; b_mr++){ 
-      Urange[0][b_mr][s] = INT_MAX; 
-      Urange[1][b_mr][s] = INT_MIN;
+      Urange_min[b_mr*ns+s] = INT_MAX; 
+      Urange_max[b_mr*ns+s] = INT_MIN;
     }
   }
   for (b_mr=0; b_mr<nb_mr; b_mr++) weightxdata[b_mr] = weight[b_mr] = 0.0;
 
+  jlo = (j-h < 0)   ? -j       : -h;
+  jhi = (j+h >= nx) ? nx-1-j   :  h;
+
 
   /** for each neighbour **/
   for (ii=-h, ki=0; ii<=h; ii++, ki++){
-  for (jj=-h, kj=0; jj<=h; jj++, kj++){
-
-    ni  = i+ii; nj = j+jj;
-    if (ni < 0 || nj < 0 || ni >= ny || nj >= nx){
-      continue;}
-    np = nx*ni+nj;
 
-    // if not in circular kernel, skip
-    if ((D = KDIST[ki][kj]) > h) continue;
+    ni = i+ii;
+    if (ni < 0 || ni >= ny) continue;
 
-    // if HR == nodata, skip
-    if (hr_[0][np] == nodata_hr) continue;
+    Skernel = work->Skernel + ki*width + h;
 
-    // if any MR parameter == nodata, skip
-    for (b_mr=0, skip=false; b_mr<nb_mr; b_mr++){
-      if (mr_[b_mr][np] == nodata_mr){
-        skip = true; break;}
+    // specral distance (MAE) of the kernel row
+    for (jj=jlo; jj<=jhi; jj++) Srow[jj+h] = 0;
+    for (b_hr=0; b_hr<nb_hr; b_hr++){
+      hv  = hr_[b_hr][p];
+      src = hr_[b_hr] + nx*ni + j;
+      #pragma omp simd
+      for (jj=jlo; jj<=jhi; jj++) Srow[jj+h] += fabs(hv-src[jj]);
     }
-    if (skip) continue;
 
-    // specral distance (MAE)
-    for (b_hr=0, sum=0; b_hr<nb_hr; b_hr++) sum += fabs(hr_[b_hr][p]-hr_[b_hr][np]);
-    S = sum/(float)nb_hr;
+    for (jj=jlo, kj=jlo+h; jj<=jhi; jj++, kj++){
 
-    // get cutoff-threshold index for S
-    for (s=0, Sc=-1; s<ns; s++){
-      if (S < Sthr[s]){ Sc = s; break;}
-    }
-    if (Sc < 0) continue;
-    Sclass[wn] = Sc;
-
-    // keep S + determine range
-    Srecord[wn] = S;
-    if (S > 0){
-      for (s=Sc; s<ns; s++){
-        if (S > Srange[1][s]) Srange[1][s] = S;
-        if (S < Srange[0][s]) Srange[0][s] = S;
-      }
-    }
+      Skernel[jj] = -1;
+
+      np = nx*ni+j+jj;
+
+      // if not in circular kernel, skip
+      if (KDIST[ki][kj] > h) continue;
 
-    // keep MR data
-    for (b_mr=0; b_mr<nb_mr; b_mr++) Mrecord[b_mr][wn] = mr_[b_mr][np];
+      // if HR == nodata or any MR parameter == nodata, skip
+      if (valid_[np] != (IMP_MR_VALID | IMP_HR_VALID)) continue;
 
-    // keep HR texture + determine range
-    T = hr_tex_[np];
-    Trecord[wn] = T;
-    if (T > 0){
-      for (s=Sc; s<ns; s++){
-        if (T > Trange[1][s]) Trange[1][s] = T;
-        if (T < Trange[0][s]) Trange[0][s] = T;
+      S = Srow[kj]/(float)nb_hr;
+
+      // get cutoff-threshold index for S
+      for (s=0, Sc=-1; s<ns; s++){
+        if (S < Sthr[s]){ Sc = s; break;}
       }
-    }
+      if (Sc < 0) continue;
 
-    // keep MR texture + determine range
-    for (b_mr=0; b_mr<nb_mr; b_mr++){
-      U = mr_tex_[b_mr][np];
-      Urecord[b_mr][wn] = U;
-      if (U > 0){
+      // keep S + determine range
+      Skernel[jj] = S;
+      if (S > 0){
         for (s=Sc; s<ns; s++){
-          if (U > Urange[1][b_mr][s]) Urange[1][b_mr][s] = U;
-          if (U < Urange[0][b_mr][s]) Urange[0][b_mr][s] = U;
+          if (S > Srange[1][s]) Srange[1][s] = S;
+          if (S < Srange[0][s]) Srange[0][s] = S;
         }
       }
-    }
 
-    wn++; // number of valid neighbours
-    for (s=Sc; s<ns; s++) Sn[s]++; // number of valid neighbours in S-class
+      // HR texture range
+      T = hr_tex_[np];
+      if (T > 0){
+        for (s=Sc; s<ns; s++){
+          if (T > Trange[1][s]) Trange[1][s] = T;
+          if (T < Trange[0][s]) Trange[0][s] = T;
+        }
+      }
+
+      // MR texture range
+      for (b_mr=0; b_mr<nb_mr; b_mr++){
+        U = mr_tex_[b_mr][np];
+        if (U > 0){
+          for (s=Sc; s<ns; s++){
+            if (U > Urange_max[b_mr*ns+s]) Urange_max[b_mr*ns+s] = U;
+            if (U < Urange_min[b_mr*ns+s]) Urange_min[b_mr*ns+s] = U;
+          }
+        }
+      }
+
+      wn++; // number of valid neighbours
+      for (s=Sc; s<ns; s++) Sn[s]++; // number of valid neighbours in S-class
+
+    }
 
-  }
   }
 
   // if no valid neighbour... damn.. use MR
   if (wn == 0){
     for (b_mr=0; b_mr<nb_mr; b_mr++) pred_[b_mr][p] = mr_[b_mr][p];
-    free((void*)Sclass);
-    free((void*)Srecord);
-    free((void*)Trecord);
-    free_2D((void**)Urecord, nb_mr);
-    free_2D((void**)Mrecord, nb_mr);
-    free((void*)weightxdata);
-    free((void*)weight);
-    free_3D((void***)Urange, 2, nb_mr);
-    return SUCCESS;
+    return;
   }
 
   // determine the spectral similarity cutoff threshold
@@ -210,40 +199,126 @@ bool skip;
   if (Sc < 0) Sc = ns-1;
 
 
-  // compute pixel weight
-  for (k=0; k<wn; k++){
+  // compute pixel weight, in the same order as the neighbours were found
+  for (ii=-h, ki=0; ii<=h; ii++, ki++){
+
+    ni = i+ii;
+    if (ni < 0 || ni >= ny) continue;
+
+    Skernel = work->Skernel + ki*width + h;
+
+    for (jj=jlo; jj<=jhi; jj++){
 
-    if (Sclass[k] > Sc) continue;
+      if ((S = Skernel[jj]) < 0) continue;
+      if (S >= Sthr[Sc]) continue;
 
-    SS = rescale_weight(Srecord[k], Srange[0][Sc], Srange[1][Sc]);
-    TT = rescale_weight(Trecord[k], Trange[0][Sc], Trange[1][Sc]);
+      np = nx*ni+j+jj;
 
-    for (b_mr=0; b_mr<nb_mr; b_mr++){
+      SS = rescale_weight(S, Srange[0][Sc], Srange[1][Sc]);
+      TT = rescale_weight(hr_tex_[np], Trange[0][Sc], Trange[1][Sc]);
 
-      UU = rescale_weight(
-        Urecord[b_mr][k], Urange[0][b_mr][Sc], Urange[1][b_mr][Sc]);
+      for (b_mr=0; b_mr<nb_mr; b_mr++){
 
-      W = 1/(SS*TT*UU); 
+        UU = rescale_weight(
+          mr_tex_[b_mr][np], Urange_min[b_mr*ns+Sc], Urange_max[b_mr*ns+Sc]);
 
-      weightxdata[b_mr] += W*Mrecord[b_mr][k];
-      weight[b_mr] += W;
+        W = 1/(SS*TT*UU); 
+
+        weightxdata[b_mr] += W*mr_[b_mr][np];
+        weight[b_mr] += W;
+
+      }
 
     }
+
   }
 
   // prediction -> weighted mean
   for (b_mr=0; b_mr<nb_mr; b_mr++) pred_[b_mr][p] = (float)(weightxdata[b_mr]/weight[b_mr]);
 
+  return;
+}
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
-  // tidy up things
-  free((void*)Sclass);
-  free((void*)Srecord);
-  free((void*)Trecord);
-  free_2D((void**)Urecord, nb_mr);
-  free_2D((void**)Mrecord, nb_mr);
-  free((void*)weightxdata);
-  free((void*)weight);
-  free_3D((void***)Urange, 2, nb_mr);
+
+/** Predict medium resolution data (ImproPhe method) of a complete image
++++ The prediction is offloaded to the GPU if available, otherwise all 
++++ pixels are predicted in parallel on the CPU. Pixels with MR nodata 
++++ are left untouched in pred_.
+--- hr_:       hr data
+--- hr_text_:  hr texture
+--- mr_:       mr data
+--- mr_tex_:   mr texture
+--- pred_:     prediction
+--- KDIST:     kernel distance
+--- nodata_hr: nodata of hr_
+--- nodata_mr: nodata of mr_
+--- nx:        number of columns
+--- ny:        number of rows
+--- h:         prediction radius
+--- nb_hr:     number of bands in hr_
+--- nb_mr:     number of bands in mr_
+--- nk:        number of kernel pixels
+--- mink:      minimum number of pixels for good prediction
++++ Return:    SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int improphe(float **hr_, float *hr_tex_, float **mr_, float **mr_tex_, short **pred_, float **KDIST, float nodata_hr, short nodata_mr, int nx, int ny, int h, int nb_hr, int nb_mr, int nk, int mink){
+small *valid_ = NULL;
+imp_work_t work;
+int i, j, p, b, nc = nx*ny;
+
+
+  // validity of all pixels, tested once instead of once per neighbour
+  alloc((void**)&valid_, nc, sizeof(small));
+
+  #pragma omp parallel for private(b) shared(hr_,mr_,valid_,nc,nb_mr,nodata_hr,nodata_mr) default(none)
+  for (p=0; p<nc; p++){
+    if (hr_[0][p] != nodata_hr) valid_[p] |= IMP_HR_VALID;
+    for (b=0; b<nb_mr; b++){
+      if (mr_[b][p] == nodata_mr) break;
+    }
+    if (b == nb_mr) valid_[p] |= IMP_MR_VALID;
+  }
+
+  if (gpu_enabled() && improphe_gpu(hr_, hr_tex_, mr_, mr_tex_, valid_, pred_, KDIST, 
+        nx, ny, h, nb_hr, nb_mr, mink) == SUCCESS){
+    free((void*)valid_);
+    return SUCCESS;
+  }
+
+  #pragma omp parallel private(i,j,p,work) shared(hr_,hr_tex_,mr_,mr_tex_,valid_,pred_,KDIST,nx,ny,h,nb_hr,nb_mr,nk,mink) default(none)
+  {
+
+    alloc((void**)&work.Skernel,     nk,          sizeof(double));
+    alloc((void**)&work.Srow,       2*h+1,        sizeof(double));
+    alloc((void**)&work.Urange,     2*nb_mr*IMP_NS, sizeof(double));
+    alloc((void**)&work.weightxdata, nb_mr,       sizeof(double));
+    alloc((void**)&work.weight,      nb_mr,       sizeof(double));
+
+    #pragma omp for collapse(2) schedule(guided)
+    for (i=0; i<ny; i++){
+    for (j=0; j<nx; j++){
+
+      p = i*nx+j;
+
+      improphe_pixel(hr_, hr_tex_, mr_, mr_tex_, valid_, pred_, KDIST, 
+        i, j, p, nx, ny, h, nb_hr, nb_mr, mink, &work);
+
+    }
+    }
+
+    free((void*)work.Skernel);
+    free((void*)work.Srow);
+    free((void*)work.Urange);
+    free((void*)work.weightxdata);
+    free((void*)work.weight);
+
+  }
+
+  free((void*)valid_);
 
   return SUCCESS;
 }
@@ -447,6 +522,10 @@ double avg = 0, var = 0, k = 0;
 +++ This function computes the spatial standard deviation as a measure for
 +++ texture. If a multiband image is given, the pixel-based standard devi-
 +++ ation of the band with highest standard deviation is returned.
++++ The focal moments are taken from integral images of the number, sum 
++++ and sum of squares of valid pixels, thus the cost per pixel does not
++++ depend on the kernel radius. The data are centered on the band mean 
++++ to keep the sums of squares small.
 --- DAT:    single-/multi-band image
 --- nodata: nodata value of image
 --- h:      radius of kernel
@@ -457,9 +536,12 @@ double avg = 0, var = 0, k = 0;
 +++ Return: standard deviation
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 float *focal_sd(float **DAT, float nodata, int h, int nx, int ny, int nb, int bstart){
-int i, j, ii, jj, ni, nj, b, nc = nx*ny;
-double sd_0, sd_max;
-double avg, var, k, dat;
+int i, j, b, p, nc = nx*ny, nw = nx+1;
+int i0, i1, j0, j1;
+double *S1 = NULL, *S2 = NULL; // integral images of sum, and sum of squares
+int *N = NULL;                 // integral image of number of valid pixels
+double mean, dat, n, s1, s2, var, sd_0;
+int k;
 float *sd = NULL;
 
 
@@ -468,48 +550,87 @@ float *sd = NULL;
   #endif
 
   alloc((void**)&sd, nc, sizeof(float));
+  alloc((void**)&S1, (size_t)nw*(ny+1), sizeof(double));
+  alloc((void**)&S2, (size_t)nw*(ny+1), sizeof(double));
+  alloc((void**)&N,  (size_t)nw*(ny+1), sizeof(int));
 
-  #pragma omp parallel private(b, sd_0, sd_max, avg, var, k, dat, ii, jj, ni, nj) shared(bstart,h,nb,nx,ny,sd,DAT,nodata) default(none)
-  {
-
-    #pragma omp for collapse(2) schedule(dynamic,1)
-    for (i=0; i<ny; i++){
-    for (j=0; j<nx; j++){
+  for (b=bstart; b<(bstart+nb); b++){
 
-      for (b=bstart, sd_max=0; b<(bstart+nb); b++){
+    // band mean
+    mean = 0; k = 0;
 
-        avg = var = k = 0.0;
+    #pragma omp parallel for private(dat) shared(DAT,b,nc,nodata) reduction(+: mean, k) default(none)
+    for (p=0; p<nc; p++){
+      if ((dat = (double)DAT[b][p]) == nodata) continue;
+      mean += dat; k++;
+    }
 
-        for (ii=-h; ii<=h; ii++){
-        for (jj=-h; jj<=h; jj++){
+    if (k > 0) mean /= k;
 
-          ni = i+ii; nj = j+jj;
+    // integral images: prefix sums along rows, the first row and column stay 0
+    #pragma omp parallel for private(j,p,dat) shared(DAT,S1,S2,N,b,nx,ny,nw,nodata,mean) default(none)
+    for (i=0; i<ny; i++){
 
-          if (ni < 0 || nj < 0 || ni >= ny || nj >= nx){
-            continue;}
+      p = (i+1)*nw;
 
-          if ((dat = (double)DAT[b][ni*nx+nj]) == nodata){
-            continue;}
+      for (j=0; j<nx; j++, p++){
 
-          if (++k == 1){
-            avg = dat;
-          } else {
-            var_recurrence(dat, &avg, &var, k);
-          }
-        }
+        if ((dat = (double)DAT[b][i*nx+j]) == nodata){
+          S1[p+1] = S1[p];
+          S2[p+1] = S2[p];
+          N[p+1]  = N[p];
+        } else {
+          dat -= mean;
+          S1[p+1] = S1[p] + dat;
+          S2[p+1] = S2[p] + dat*dat;
+          N[p+1]  = N[p]  + 1;
         }
 
-        if ((sd_0 = standdev(var, k))  > sd_max) sd_max = sd_0;
+      }
+    }
 
+    // ... and along columns
+    #pragma omp parallel for private(i,p) shared(S1,S2,N,nx,ny,nw) default(none)
+    for (j=1; j<=nx; j++){
+      for (i=1, p=nw+j; i<=ny; i++, p+=nw){
+        S1[p] += S1[p-nw];
+        S2[p] += S2[p-nw];
+        N[p]  += N[p-nw];
       }
+    }
 
-      sd[nx*i+j] = sd_max;
+    // focal moments
+    #pragma omp parallel for private(j,p,i0,i1,j0,j1,n,s1,s2,var,sd_0) shared(S1,S2,N,sd,h,nx,ny,nw) default(none)
+    for (i=0; i<ny; i++){
 
-    }
+      i0 = (i-h < 0)   ? 0  : i-h;
+      i1 = (i+h >= ny) ? ny : i+h+1;
+
+      for (j=0; j<nx; j++){
+
+        j0 = (j-h < 0)   ? 0  : j-h;
+        j1 = (j+h >= nx) ? nx : j+h+1;
+
+        n = N[i1*nw+j1] - N[i0*nw+j1] - N[i1*nw+j0] + N[i0*nw+j0];
+        if (n < 2) continue;
+
+        s1 = S1[i1*nw+j1] - S1[i0*nw+j1] - S1[i1*nw+j0] + S1[i0*nw+j0];
+        s2 = S2[i1*nw+j1] - S2[i0*nw+j1] - S2[i1*nw+j0] + S2[i0*nw+j0];
+
+        if ((var = (s2 - s1*s1/n)/(n-1)) < 0) var = 0;
+
+        p = i*nx+j;
+        if ((sd_0 = sqrt(var)) > sd[p]) sd[p] = sd_0;
+
+      }
     }
 
   }
 
+  free((void*)S1);
+  free((void*)S2);
+  free((void*)N);
+
 
   #ifdef FORCE_CLOCK
   proctime_print("computing focal sd", TIME);
@@ -33,14 +33,16 @@ ImproPhe header
 
 #include "../cross-level/const-cl.h"
 #include "../cross-level/stats-cl.h"
+#include "../cross-level/gpu-cl.h"
 #include "../higher-level/read-ard-hl.h"
+#include "../higher-level/improphe-gpu-hl.h"
 
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-int improphe(float **hr_, float *hr_tex_, float **mr_, float **mr_tex_, short **pred_, float **KDIST, float nodata_hr, short nodata_mr, int i, int j, int p, int nx, int ny, int h, int nb_hr, int nb_mr, int nk, int mink);
+int improphe(float **hr_, float *hr_tex_, float **mr_, float **mr_tex_, short **pred_, float **KDIST, float nodata_hr, short nodata_mr, int nx, int ny, int h, int nb_hr, int nb_mr, int nk, int mink);
 double rescale_weight(double weight, double minweight, double maxweight);
 short **average_season(ard_t *ard, small *mask_, int nb, int nc, int nt, short nodata, int nwin, int *dwin, int ywin, bool *is_empty);
 int standardize_float(float *data, float nodata, int nc);
@@ -0,0 +1,288 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for caching the spectral index time series
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "index-cache-hl.h"
+
+#include <string.h>     // string handling functions
+#include <errno.h>      // error numbers
+#include <stddef.h>     // standard type definitions
+#include <sys/stat.h>   // file status
+#include <unistd.h>     // standard symbolic constants and types
+
+
+// magic number of index cache files
+#define CACHE_MAGIC "FORCETSS"
+
+// header of an index cache file, followed by nt dates (ce), and
+// nt x nc index values
+typedef struct {
+  char magic[8];
+  uint64_t key;
+  int nt, nc;
+} cache_header_t;
+
+
+uint64_t index_cache_key(ard_t *ard, int nt, int nc, int idx, short nodata, uint64_t version, par_hl_t *phl);
+int index_cache_filename(ard_t *ard, int idx, par_hl_t *phl, bool mkdir_, char *fname, int size);
+
+
+/** This function computes the key of a cached index time series. It com-
++++ bines everything the index values depend on: the ARD version, the da-
++++ tes and sensors of the datasets, the sensor dictionary, the QAI rules, 
++++ the mask, and the index definition. A cached time series is only used
++++ if the key matches.
+--- ard:     ARD
+--- nt:      number of ARD products over time
+--- nc:      number of cells
+--- idx:     index
+--- nodata:  nodata value
+--- version: ARD version (see version_ard)
+--- phl:     HL parameters
++++ Return:  key, 0 if the index cannot be cached
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+uint64_t index_cache_key(ard_t *ard, int nt, int nc, int idx, short nodata, uint64_t version, par_hl_t *phl){
+uint64_t key = HASH_INIT;
+index_def_t def;
+char sensor[NPOW_04];
+int t, s, ce, dim[4];
+size_t qai0, qai1;
+
+
+  if (version == 0) return 0;
+
+  if (index_definition(&phl->tsa, idx, &phl->sen, &def) == FAILURE) return 0;
+
+  // unmixing depends on an endmember file, which is not versioned
+  if (def.family == _INDEX_SMA_) return 0;
+
+  key = hash_bytes(key, &version, sizeof(uint64_t));
+
+  // tile, chunk and dimensions
+  dim[0] = get_brick_tilex(ard[0].DAT);
+  dim[1] = get_brick_tiley(ard[0].DAT);
+  dim[2] = get_brick_chunk(ard[0].DAT);
+  dim[3] = nc;
+  key = hash_bytes(key, dim, 4*sizeof(int));
+  key = hash_bytes(key, &nt, sizeof(int));
+  key = hash_bytes(key, &nodata, sizeof(short));
+
+  // dates and sensors of the datasets
+  for (t=0; t<nt; t++){
+    ce = get_brick_ce(ard[t].DAT, 0);
+    get_brick_sensor(ard[t].DAT, 0, sensor, NPOW_04);
+    key = hash_bytes(key, &ce, sizeof(int));
+    key = hash_bytes(key, sensor, strlen(sensor));
+  }
+
+  // sensor dictionary
+  for (s=0; s<phl->sen.n; s++) key = hash_bytes(key, phl->sen.sensor[s], strlen(phl->sen.sensor[s]));
+  key = hash_bytes(key, &phl->sen.spec_adjust, sizeof(int));
+
+  // QAI rules, i.e. the screening flags from off to below_noise
+  qai0 = offsetof(par_qai_t, off);
+  qai1 = offsetof(par_qai_t, below_noise) + sizeof(float);
+  key = hash_bytes(key, (const char*)&phl->qai + qai0, qai1 - qai0);
+  key = hash_bytes(key, &phl->psf, sizeof(int));
+  key = hash_bytes(key, &phl->prd.imp, sizeof(int));
+
+  // processing mask
+  key = hash_bytes(key, phl->d_mask, strlen(phl->d_mask));
+  key = hash_bytes(key, phl->b_mask, strlen(phl->b_mask));
+
+  // index definition
+  key = hash_bytes(key, phl->tsa.index_name[idx], strlen(phl->tsa.index_name[idx]));
+  key = hash_bytes(key, &def.family, sizeof(int));
+  key = hash_bytes(key, def.band, 6*sizeof(int));
+  key = hash_bytes(key, def.f, 4*sizeof(float));
+  key = hash_bytes(key, &def.opt, sizeof(int));
+
+  if (def.family == _INDEX_EXPR_){
+    key = hash_bytes(key, &def.expr->nop, sizeof(int));
+    key = hash_bytes(key, def.expr->op, def.expr->nop*sizeof(index_op_t));
+  }
+
+  if (key == 0) key = 1;
+
+  return key;
+}
+
+
+/** This function assembles the filename of a cached index time series, 
++++ i.e. <DIR_INDEX_CACHE>/<tile>/<index>_CHUNK<chunk>.tss
+--- ard:    ARD
+--- idx:    index
+--- phl:    HL parameters
+--- mkdir_: create the tile directory?
+--- fname:  filename (returned)
+--- size:   length of the buffer
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int index_cache_filename(ard_t *ard, int idx, par_hl_t *phl, bool mkdir_, char *fname, int size){
+char dname[NPOW_10];
+int nchar;
+
+
+  nchar = snprintf(dname, NPOW_10, "%s/X%04d_Y%04d", phl->tsa.d_cache,
+    get_brick_tilex(ard[0].DAT), get_brick_tiley(ard[0].DAT));
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling dirname\n"); return FAILURE;}
+
+  // tile directories are created by concurrent chunks
+  if (mkdir_ && mkdir(dname, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0 && errno != EEXIST){
+    printf("Unable to create %s. ", dname); return FAILURE;}
+
+  nchar = snprintf(fname, size, "%s/%s_CHUNK%04d.tss", dname, 
+    phl->tsa.index_name[idx], get_brick_chunk(ard[0].DAT));
+  if (nchar < 0 || nchar >= size){ 
+    printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+  return SUCCESS;
+}
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function reads a cached index time series into the TSS array, if
++++ the cache holds one for the same ARD, sensors, QAI rules, mask and in-
++++ dex definition (see index_cache_key).
+--- ard:     ARD
+--- ts:      pointer to instantly useable TSA image arrays
+--- nt:      number of ARD products over time
+--- nc:      number of cells
+--- idx:     index
+--- nodata:  nodata value
+--- version: ARD version (see version_ard)
+--- phl:     HL parameters
++++ Return:  true if the time series was read from the cache
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool read_index_cache(ard_t *ard, tsa_t *ts, int nt, int nc, int idx, short nodata, uint64_t version, par_hl_t *phl){
+char fname[NPOW_10];
+cache_header_t header;
+FILE *fp = NULL;
+int *ce = NULL;
+int t;
+uint64_t key;
+bool ok = true;
+
+
+  if (strcmp(phl->tsa.d_cache, "NULL") == 0 || ts->tss_ == NULL) return false;
+
+  if ((key = index_cache_key(ard, nt, nc, idx, nodata, version, phl)) == 0) return false;
+
+  if (index_cache_filename(ard, idx, phl, false, fname, NPOW_10) == FAILURE) return false;
+
+  if ((fp = fopen(fname, "rb")) == NULL) return false;
+
+  if (fread(&header, sizeof(cache_header_t), 1, fp) != 1 ||
+      memcmp(header.magic, CACHE_MAGIC, 8) != 0 ||
+      header.key != key || header.nt != nt || header.nc != nc){
+    fclose(fp); return false;}
+
+  alloc((void**)&ce, nt, sizeof(int));
+
+  if (fread(ce, sizeof(int), nt, fp) != (size_t)nt) ok = false;
+
+  for (t=0; t<nt && ok; t++){
+    if (ce[t] != ts->d_tss[t].ce) ok = false;
+  }
+
+  for (t=0; t<nt && ok; t++){
+    if (fread(ts->tss_[t], sizeof(short), nc, fp) != (size_t)nc) ok = false;
+  }
+
+  free((void*)ce);
+  fclose(fp);
+
+  #ifdef FORCE_DEBUG
+  printf("index cache %s: %s\n", fname, ok ? "hit" : "corrupt");
+  #endif
+
+  return ok;
+}
+
+
+/** This function writes the TSS array of an index to the cache. The file
++++ is written under a temporary name, and then renamed, such that concur-
++++ rent runs never read partial files.
+--- ard:     ARD
+--- ts:      pointer to instantly useable TSA image arrays
+--- nt:      number of ARD products over time
+--- nc:      number of cells
+--- idx:     index
+--- nodata:  nodata value
+--- version: ARD version (see version_ard)
+--- phl:     HL parameters
++++ Return:  SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_index_cache(ard_t *ard, tsa_t *ts, int nt, int nc, int idx, short nodata, uint64_t version, par_hl_t *phl){
+char fname[NPOW_10];
+char tname[NPOW_10];
+cache_header_t header;
+FILE *fp = NULL;
+int t;
+bool ok = true;
+int nchar;
+
+
+  if (strcmp(phl->tsa.d_cache, "NULL") == 0 || ts->tss_ == NULL) return CANCEL;
+
+  memset(&header, 0, sizeof(cache_header_t));
+  memcpy(header.magic, CACHE_MAGIC, 8);
+  header.nt = nt;
+  header.nc = nc;
+
+  if ((header.key = index_cache_key(ard, nt, nc, idx, nodata, version, phl)) == 0) return CANCEL;
+
+  if (index_cache_filename(ard, idx, phl, true, fname, NPOW_10) == FAILURE) return FAILURE;
+
+  nchar = snprintf(tname, NPOW_10, "%s.%d.tmp", fname, (int)getpid());
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+  if ((fp = fopen(tname, "wb")) == NULL){
+    printf("Unable to create %s. ", tname); return FAILURE;}
+
+  if (fwrite(&header, sizeof(cache_header_t), 1, fp) != 1) ok = false;
+
+  for (t=0; t<nt && ok; t++){
+    if (fwrite(&ts->d_tss[t].ce, sizeof(int), 1, fp) != 1) ok = false;
+  }
+
+  for (t=0; t<nt && ok; t++){
+    if (fwrite(ts->tss_[t], sizeof(short), nc, fp) != (size_t)nc) ok = false;
+  }
+
+  if (fclose(fp) != 0) ok = false;
+
+  if (!ok || rename(tname, fname) != 0){
+    printf("Unable to write index cache %s. ", fname);
+    unlink(tname); return FAILURE;}
+
+  return SUCCESS;
+}
@@ -0,0 +1,499 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for compiling and evaluating user-defined
+band-math index expressions, e.g. (NIR-SWIR1)/(NIR+SWIR1)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "index-expr-hl.h"
+
+
+// band names, in the order of the wavelength enum
+static const char *_EXPR_WVL_[_WVL_LENGTH_] = {
+  "BLUE", "GREEN", "RED", "RE1", "RE2", "RE3", "BNIR", 
+  "NIR", "SWIR0", "SWIR1", "SWIR2", "VV", "VH" };
+
+// state of the recursive-descent parser
+typedef struct {
+  const char *str;     // expression
+  const char *pos;     // current position
+  index_expr_t *expr;  // compiled expression
+  int depth;           // current stack depth
+  int error;           // number of errors
+} expr_parser_t;
+
+
+void expr_error(expr_parser_t *par, const char *msg);
+void expr_space(expr_parser_t *par);
+void expr_emit(expr_parser_t *par, int op, int arg, float val);
+void expr_sum(expr_parser_t *par);
+void expr_product(expr_parser_t *par);
+void expr_unary(expr_parser_t *par);
+void expr_power(expr_parser_t *par);
+void expr_primary(expr_parser_t *par);
+
+
+/** This function reports a parsing error, only the first one is printed
+--- par:    parser
+--- msg:    error message
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void expr_error(expr_parser_t *par, const char *msg){
+
+  if (par->error++ > 0) return;
+
+  printf("error in index expression %s at position %d: %s\n", 
+    par->str, (int)(par->pos-par->str)+1, msg);
+
+  return;
+}
+
+
+/** This function skips whitespace
+--- par:    parser
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void expr_space(expr_parser_t *par){
+
+  while (isspace((unsigned char)*par->pos)) par->pos++;
+
+  return;
+}
+
+
+/** This function appends an operation to the compiled expression, and
++++ keeps track of the stack depth needed for evaluation
+--- par:    parser
+--- op:     operation
+--- arg:    wavelength
+--- val:    constant
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void expr_emit(expr_parser_t *par, int op, int arg, float val){
+index_expr_t *expr = par->expr;
+
+
+  if (par->error > 0) return;
+
+  if (expr->nop >= IDX_EXPR_MAXOP){
+    expr_error(par, "expression too long"); return;}
+
+  switch (op){
+    case _EXPR_BAND_:
+    case _EXPR_CONST_:
+      par->depth++;
+      break;
+    case _EXPR_ADD_:
+    case _EXPR_SUB_:
+    case _EXPR_MUL_:
+    case _EXPR_DIV_:
+    case _EXPR_POW_:
+    case _EXPR_MIN_:
+    case _EXPR_MAX_:
+      par->depth--;
+      break;
+    default:
+      break;
+  }
+
+  if (par->depth > IDX_EXPR_STACK){
+    expr_error(par, "expression too deeply nested"); return;}
+
+  if (par->depth > expr->depth) expr->depth = par->depth;
+
+  expr->op[expr->nop].op  = op;
+  expr->op[expr->nop].arg = arg;
+  expr->op[expr->nop].val = val;
+  expr->nop++;
+
+  return;
+}
+
+
+/** This function parses a sum, i.e. product {(+|-) product}
+--- par:    parser
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void expr_sum(expr_parser_t *par){
+char c;
+
+
+  expr_product(par);
+
+  while (par->error == 0){
+
+    expr_space(par);
+    if ((c = *par->pos) != '+' && c != '-') break;
+    par->pos++;
+
+    expr_product(par);
+    expr_emit(par, (c == '+') ? _EXPR_ADD_ : _EXPR_SUB_, 0, 0);
+
+  }
+
+  return;
+}
+
+
+/** This function parses a product, i.e. unary {(*|/) unary}
+--- par:    parser
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void expr_product(expr_parser_t *par){
+char c;
+
+
+  expr_unary(par);
+
+  while (par->error == 0){
+
+    expr_space(par);
+    if ((c = *par->pos) != '*' && c != '/') break;
+    par->pos++;
+
+    expr_unary(par);
+    expr_emit(par, (c == '*') ? _EXPR_MUL_ : _EXPR_DIV_, 0, 0);
+
+  }
+
+  return;
+}
+
+
+/** This function parses a signed term, i.e. [-|+] unary, or power
+--- par:    parser
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void expr_unary(expr_parser_t *par){
+
+
+  expr_space(par);
+
+  if (*par->pos == '-'){
+    par->pos++;
+    expr_unary(par);
+    expr_emit(par, _EXPR_NEG_, 0, 0);
+  } else if (*par->pos == '+'){
+    par->pos++;
+    expr_unary(par);
+  } else {
+    expr_power(par);
+  }
+
+  return;
+}
+
+
+/** This function parses a power, i.e. primary [^ unary]. The exponent is
++++ right-associative, and binds tighter than the sign, i.e. -a^b = -(a^b)
+--- par:    parser
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void expr_power(expr_parser_t *par){
+
+
+  expr_primary(par);
+
+  expr_space(par);
+
+  if (par->error == 0 && *par->pos == '^'){
+    par->pos++;
+    expr_unary(par);
+    expr_emit(par, _EXPR_POW_, 0, 0);
+  }
+
+  return;
+}
+
+
+/** This function parses a primary, i.e. a number, a band, a function 
++++ call, or a parenthesized expression
+--- par:    parser
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void expr_primary(expr_parser_t *par){
+char name[NPOW_04];
+char *end = NULL;
+float val;
+int n = 0, w, op = -1, narg = 1, a;
+
+
+  if (par->error > 0) return;
+
+  expr_space(par);
+
+  // number
+  if (isdigit((unsigned char)*par->pos) || *par->pos == '.'){
+    val = strtof(par->pos, &end);
+    if (end == par->pos){
+      expr_error(par, "invalid number"); return;}
+    par->pos = end;
+    expr_emit(par, _EXPR_CONST_, 0, val);
+    return;
+  }
+
+  // parenthesized expression
+  if (*par->pos == '('){
+    par->pos++;
+    expr_sum(par);
+    expr_space(par);
+    if (par->error > 0) return;
+    if (*par->pos != ')'){
+      expr_error(par, "missing )"); return;}
+    par->pos++;
+    return;
+  }
+
+  if (!isalpha((unsigned char)*par->pos)){
+    expr_error(par, "band, number, function or ( expected"); return;}
+
+  while (isalnum((unsigned char)*par->pos)){
+    if (n < NPOW_04-1) name[n++] = toupper((unsigned char)*par->pos);
+    par->pos++;
+  }
+  name[n] = '\0';
+
+  // band
+  for (w=0; w<_WVL_LENGTH_; w++){
+    if (strcmp(name, _EXPR_WVL_[w]) == 0){
+      par->expr->wvl[w] = true;
+      expr_emit(par, _EXPR_BAND_, w, 0);
+      return;
+    }
+  }
+
+  // function
+  if (strcmp(name, "SQRT") == 0){ op = _EXPR_SQRT_;
+  } else if (strcmp(name, "ABS") == 0){ op = _EXPR_ABS_;
+  } else if (strcmp(name, "EXP") == 0){ op = _EXPR_EXP_;
+  } else if (strcmp(name, "LOG") == 0){ op = _EXPR_LOG_;
+  } else if (strcmp(name, "MIN") == 0){ op = _EXPR_MIN_; narg = 2;
+  } else if (strcmp(name, "MAX") == 0){ op = _EXPR_MAX_; narg = 2;
+  } else {
+    expr_error(par, "unknown band or function"); return;
+  }
+
+  expr_space(par);
+  if (*par->pos != '('){
+    expr_error(par, "missing ( after function"); return;}
+  par->pos++;
+
+  for (a=0; a<narg; a++){
+    if (a > 0){
+      expr_space(par);
+      if (par->error > 0) return;
+      if (*par->pos != ','){
+        expr_error(par, "missing , between function arguments"); return;}
+      par->pos++;
+    }
+    expr_sum(par);
+  }
+
+  expr_space(par);
+  if (par->error > 0) return;
+  if (*par->pos != ')'){
+    expr_error(par, "missing ) after function arguments"); return;}
+  par->pos++;
+
+  expr_emit(par, op, 0, 0);
+
+  return;
+}
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function compiles an index expression into a postfix program. 
++++ The expression may be prefixed with a short name, e.g. 
++++ NMI:(NIR-SWIR1)/(NIR+SWIR1); otherwise, the name is X01, X02, etc.
++++ Bands are given by their names (BLUE, GREEN, RED, RE1, RE2, RE3, BNIR,
++++ NIR, SWIR0, SWIR1, SWIR2, VV, VH), and combined with + - * / ^, and 
++++ the functions sqrt, abs, exp, log, min and max.
+--- string: index expression
+--- k:      number of the expression (for the default name)
+--- expr:   compiled expression (returned)
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int parse_index_expr(const char *string, int k, index_expr_t *expr){
+expr_parser_t par;
+const char *colon = NULL;
+int n, nchar;
+
+
+  memset(expr, 0, sizeof(index_expr_t));
+
+  par.str   = string;
+  par.pos   = string;
+  par.expr  = expr;
+  par.depth = 0;
+  par.error = 0;
+
+  if ((colon = strchr(string, ':')) != NULL){
+
+    n = (int)(colon-string);
+
+    if (n < 1 || n > NPOW_02-1){
+      printf("name of index expression %s must have 1-%d characters.\n", string, NPOW_02-1); 
+      return FAILURE;}
+
+    for (n=0; string+n < colon; n++){
+      if (!isalnum((unsigned char)string[n])){
+        printf("name of index expression %s must be alphanumeric.\n", string); 
+        return FAILURE;}
+      expr->name[n] = toupper((unsigned char)string[n]);
+    }
+    expr->name[n] = '\0';
+
+    par.pos = colon+1;
+
+  } else {
+
+    nchar = snprintf(expr->name, NPOW_02, "X%02d", k+1);
+    if (nchar < 0 || nchar >= NPOW_02){ 
+      printf("Buffer Overflow in assembling index name\n"); return FAILURE;}
+
+  }
+
+  expr_sum(&par);
+  expr_space(&par);
+
+  if (par.error == 0 && *par.pos != '\0') expr_error(&par, "unexpected character");
+
+  if (par.error == 0 && expr->nop == 0) expr_error(&par, "empty expression");
+
+  if (par.error > 0) return FAILURE;
+
+  return SUCCESS;
+}
+
+
+/** This function resolves the wavelengths of an index expression to the
++++ bands of the ARD, i.e. after the bandlist was filtered
+--- expr:   compiled expression
+--- band:   band of each wavelength
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void resolve_index_expr(index_expr_t *expr, int *band){
+int i;
+
+
+  for (i=0; i<expr->nop; i++){
+    if (expr->op[i].op == _EXPR_BAND_) expr->op[i].arg = band[expr->op[i].arg];
+  }
+
+  return;
+}
+
+
+/** This function evaluates an index expression for a block of pixels.
++++ Each operation is applied to the whole block, such that the inner 
++++ loops are branch-free, and can be vectorized. The bands are scaled to
++++ reflectance.
+--- expr:   compiled expression (resolved)
+--- dat:    ARD of one date
+--- p0:     first pixel of the block
+--- np:     number of pixels in the block (<= IDX_EXPR_BLOCK)
+--- stack:  evaluation stack, IDX_EXPR_STACK*IDX_EXPR_BLOCK values; the
+---         result is returned in the first IDX_EXPR_BLOCK values
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void eval_index_expr(const index_expr_t *expr, short **dat, int p0, int np, float *stack){
+const index_op_t *op = NULL;
+const short *b = NULL;
+float *x = NULL, *y = NULL;
+float c, scale = 1.0/10000.0;
+int i, k, d = 0;
+
+
+  for (k=0; k<expr->nop; k++){
+
+    op = &expr->op[k];
+
+    // x: top of stack, y: below top of stack
+    if (d > 0) x = stack + (size_t)(d-1)*IDX_EXPR_BLOCK;
+    if (d > 1) y = stack + (size_t)(d-2)*IDX_EXPR_BLOCK;
+
+    switch (op->op){
+      case _EXPR_BAND_:
+        x = stack + (size_t)(d++)*IDX_EXPR_BLOCK;
+        b = dat[op->arg] + p0;
+        for (i=0; i<np; i++) x[i] = b[i]*scale;
+        break;
+      case _EXPR_CONST_:
+        x = stack + (size_t)(d++)*IDX_EXPR_BLOCK;
+        c = op->val;
+        for (i=0; i<np; i++) x[i] = c;
+        break;
+      case _EXPR_ADD_:
+        for (i=0; i<np; i++) y[i] += x[i];
+        d--;
+        break;
+      case _EXPR_SUB_:
+        for (i=0; i<np; i++) y[i] -= x[i];
+        d--;
+        break;
+      case _EXPR_MUL_:
+        for (i=0; i<np; i++) y[i] *= x[i];
+        d--;
+        break;
+      case _EXPR_DIV_:
+        for (i=0; i<np; i++) y[i] /= x[i];
+        d--;
+        break;
+      case _EXPR_POW_:
+        for (i=0; i<np; i++) y[i] = powf(y[i], x[i]);
+        d--;
+        break;
+      case _EXPR_MIN_:
+        for (i=0; i<np; i++) y[i] = (x[i] < y[i]) ? x[i] : y[i];
+        d--;
+        break;
+      case _EXPR_MAX_:
+        for (i=0; i<np; i++) y[i] = (x[i] > y[i]) ? x[i] : y[i];
+        d--;
+        break;
+      case _EXPR_NEG_:
+        for (i=0; i<np; i++) x[i] = -x[i];
+        break;
+      case _EXPR_SQRT_:
+        for (i=0; i<np; i++) x[i] = sqrtf(x[i]);
+        break;
+      case _EXPR_ABS_:
+        for (i=0; i<np; i++) x[i] = fabsf(x[i]);
+        break;
+      case _EXPR_EXP_:
+        for (i=0; i<np; i++) x[i] = expf(x[i]);
+        break;
+      case _EXPR_LOG_:
+        for (i=0; i<np; i++) x[i] = logf(x[i]);
+        break;
+    }
+
+  }
+
+  return;
+}
@@ -0,0 +1,79 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Band-math index expression header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef INDEX_EXPR_HL_H
+#define INDEX_EXPR_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <stdbool.h> // boolean data type
+#include <string.h>  // string handling functions
+#include <ctype.h>   // transform individual characters
+#include <math.h>    // common mathematical functions
+
+#include "../cross-level/const-cl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IDX_EXPR_MAXOP   64 // max. number of operations in an expression
+#define IDX_EXPR_STACK   16 // max. depth of the evaluation stack
+#define IDX_EXPR_BLOCK  256 // number of pixels evaluated in one go
+
+// operations of the expression bytecode
+enum { _EXPR_BAND_, _EXPR_CONST_, _EXPR_ADD_, _EXPR_SUB_, _EXPR_MUL_, 
+       _EXPR_DIV_,  _EXPR_POW_,   _EXPR_MIN_, _EXPR_MAX_, _EXPR_NEG_, 
+       _EXPR_SQRT_, _EXPR_ABS_,   _EXPR_EXP_, _EXPR_LOG_, _EXPR_LENGTH_ };
+
+// one operation
+typedef struct {
+  int   op;   // operation
+  int   arg;  // wavelength (parsed), or band (resolved)
+  float val;  // constant
+} index_op_t;
+
+// a compiled index expression, in postfix order
+typedef struct {
+  char name[NPOW_02];            // short index name
+  int nop;                       // number of operations
+  index_op_t op[IDX_EXPR_MAXOP]; // operations
+  int depth;                     // required stack depth
+  bool wvl[_WVL_LENGTH_];        // wavelengths used in expression
+} index_expr_t;
+
+int parse_index_expr(const char *string, int k, index_expr_t *expr);
+void resolve_index_expr(index_expr_t *expr, int *band);
+void eval_index_expr(const index_expr_t *expr, short **dat, int p0, int np, float *stack);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -31,15 +31,43 @@ This file contains functions for computing spectral indices
 #include "gsl/gsl_blas.h"
 #include "gsl/gsl_linalg.h"
 
+#define SMA_BLOCK   256 // pixels per block for the batched unmixing
+#define SMA_MAX_EMB  31 // max. number of endmembers (passive sets are bitmasks)
+#define SMA_MAX_SET  10 // max. number of endmembers for precomputed passive sets
+#define LIN_BLOCK   256 // pixels per block for the linear transforms
+
+typedef struct {
+  int M, L, nb;    // number of endmembers, rows of Z, number of bands
+  int itmax;       // max. number of iterations in the active-set method
+  double tol;      // tolerance
+  double *Z;       // endmember matrix (L x M), row-major
+  double *ZtZ;     // crossproduct t(Z)Z (M x M)
+  double *inv_all; // inverse of t(Z)Z (M x M)
+  double *inv;     // inverse of t(Z)Z for each passive set (2^M x M x M), or NULL
+} sma_model_t;
+
+// Tasseled Cap coefficients (brightness, greenness, wetness x 6 bands)
+static const float tasseled_coef[3][6] = {
+{ 0.2043,  0.4158,  0.5524, 0.5741,  0.3124,  0.2303 },
+{-0.1603, -0.2819, -0.4934, 0.7940, -0.0002, -0.1446 },
+{ 0.0315,  0.2021,  0.3102, 0.1594, -0.6806, -0.6109 }};
 
-enum { TCB, TCG, TCW, TCD};
 
 void index_band(ard_t *ard, small *mask_, tsa_t *ts, int b, int nc, int nt, short nodata);
 void index_differenced(ard_t *ard, small *mask_, tsa_t *ts, int b1, int b2, int nc, int nt, short nodata);
 void index_kernelized(ard_t *ard, small *mask_, tsa_t *ts, int b1, int b2, int nc, int nt, short nodata);
 void index_resistance(ard_t *ard, small *mask_, tsa_t *ts, int n, int r, int b, float f1, float f2, float f3, float f4, bool rbc, int nc, int nt, short nodata);
+void tasseled_weight(int type, float w[3]);
 void index_tasseled(ard_t *ard, small *mask_, tsa_t *ts, int type, int b1, int b2, int b3, int b4, int b5, int b6, int nc, int nt, short nodata);
+int sma_passive_inverse(const sma_model_t *sm, unsigned int set, double *inv);
+sma_model_t *compile_sma_model(aux_emb_t *endmember, par_sma_t *sma);
+void free_sma_model(sma_model_t *sm);
+double sma_passive_solve(const sma_model_t *sm, unsigned int set, const double *Ztx, double *s, double *buf);
+void sma_active_set(const sma_model_t *sm, const double *Ztx, double *d, double *s, double *w, double *buf);
 void index_unmixed(ard_t *ard, small *mask_, tsa_t *ts, int nc, int nt, short nodata, par_sma_t *sma, aux_emb_t *endmember);
+short index_value(ard_t *ard, int p, index_def_t *def, short nodata);
+void index_fused(ard_t *ard, small *mask_, short ***tss_, index_def_t *def, int nidx, int nc, int nt, short nodata);
+void index_expression(ard_t *ard, small *mask_, tsa_t *ts, const index_expr_t *expr, int nc, int nt, short nodata);
 
 
 /** This function computes a spectral index time series, with band method,
@@ -413,8 +441,29 @@ float tmp, x = 0, nir, red, blue, ind, scale = 10000.0;
 }
 
 
+/** This function computes the weights of the Tasseled Cap components for
++++ one Tasseled Cap index. Brightness, greenness and wetness select one
++++ component, disturbance is brightness minus greenness minus wetness.
+--- type:   Tasseled Cap index
+--- w:      weights of the three components (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void tasseled_weight(int type, float w[3]){
+int i;
+
+
+  if (type == TCD){
+    w[0] = 1; w[1] = -1; w[2] = -1;
+  } else {
+    for (i=0; i<3; i++) w[i] = (i == type) ? 1 : 0;
+  }
+
+  return;
+}
+
+
 /** This function computes a spectral index time series, with Tasseled Cap
-+++ method
++++ method. This is a linear transform, see index_linear.
 --- ard:    ARD
 --- mask_:  mask image
 --- ts:     pointer to instantly useable TSA image arrays
@@ -431,45 +480,268 @@ float tmp, x = 0, nir, red, blue, ind, scale = 10000.0;
 +++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void index_tasseled(ard_t *ard, small *mask_, tsa_t *ts, int type, int b, int g, int r, int n, int s1, int s2, int nc, int nt, short nodata){
-int p, t, i, comp0 = type, comp1 = type+1;
-float tmp, x[3] = { 1, 1, 1 }, ind;
-float tc[3][6] = {
-{ 0.2043,  0.4158,  0.5524, 0.5741,  0.3124,  0.2303 },
-{-0.1603, -0.2819, -0.4934, 0.7940, -0.0002, -0.1446 },
-{ 0.0315,  0.2021,  0.3102, 0.1594, -0.6806, -0.6109 }};
+int band[6] = { b, g, r, n, s1, s2 };
+float w[3];
 
 
-  if (type == TCD){ comp0 = 0; comp1 = 3; x[1] = -1; x[2] = -1;}
+  tasseled_weight(type, w);
 
-  #pragma omp parallel private(t,i,tmp,ind) shared(ard,mask_,ts,b,g,r,n,s1,s2,nc,nt,nodata,x,tc,comp0,comp1) default(none)
-  {
+  index_linear(ard, mask_, &ts->tss_, band, 6, &tasseled_coef[0][0], 3, w, 1, nc, nt, nodata);
 
-    #pragma omp for
-    for (p=0; p<nc; p++){
+  return;
+}
 
-      if (mask_ != NULL && !mask_[p]){
-        for (t=0; t<nt; t++) ts->tss_[t][p] = nodata;
-        continue;
-      }
-      
-      for (t=0; t<nt; t++){
 
-        if (!ard[t].msk[p]){
-          ts->tss_[t][p] = nodata;
-        } else {
-          for (i=comp0, ind=0; i<comp1; i++){
-            tmp = tc[i][0]*ard[t].dat[b][p]  + tc[i][1]*ard[t].dat[g][p] + 
-                  tc[i][2]*ard[t].dat[r][p]  + tc[i][3]*ard[t].dat[n][p] + 
-                  tc[i][4]*ard[t].dat[s1][p] + tc[i][5]*ard[t].dat[s2][p];
-            ind += x[i]*tmp;
-          }
-          ts->tss_[t][p] = (short)ind;
+/** This function inverts the crossproduct of the endmember matrix for one
++++ passive set, i.e. for the subset of endmembers that are allowed to be
++++ non-zero. The inverse is stored compactly (nP x nP).
+--- sm:     SMA model
+--- set:    passive set (bitmask)
+--- inv:    inverse (returned)
++++ Return: number of passive elements
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int sma_passive_inverse(const sma_model_t *sm, unsigned int set, double *inv){
+int i, j, ik, jk, nP, sign;
+int M = sm->M;
+gsl_matrix *ZtZ_ = NULL;
+gsl_permutation *per = NULL;
+gsl_matrix_view inv_;
+
+
+  for (i=0, nP=0; i<M; i++) nP += (set >> i) & 1;
+
+  if (nP == 0) return 0;
+
+  ZtZ_ = gsl_matrix_alloc(nP, nP);
+  per  = gsl_permutation_alloc(nP);
+  inv_ = gsl_matrix_view_array(inv, nP, nP);
+
+  // subset the matrix according to the passive set
+  for (i=0, ik=0; i<M; i++){
+    if (!((set >> i) & 1)) continue;
+    for (j=0, jk=0; j<M; j++){
+      if (!((set >> j) & 1)) continue;
+      gsl_matrix_set(ZtZ_, ik, jk++, sm->ZtZ[i*M+j]);
+    }
+    ik++;
+  }
+
+  // LU decomposition + matrix inversion
+  gsl_linalg_LU_decomp(ZtZ_, per, &sign); 
+  gsl_linalg_LU_invert(ZtZ_, per, &inv_.matrix);
+
+  gsl_matrix_free(ZtZ_);
+  gsl_permutation_free(per);
+
+  return nP;
+}
+
+
+/** This function compiles the SMA model, i.e. everything that only 
++++ depends on the endmembers: the endmember matrix, its crossproduct, and
++++ the inverses of the crossproduct for all passive sets of the
++++ non-negative inversion (if the number of endmembers is small enough).
+--- endmember: endmember
+--- sma:       SMA parameters
++++ Return:    SMA model
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+sma_model_t *compile_sma_model(aux_emb_t *endmember, par_sma_t *sma){
+sma_model_t *sm = NULL;
+unsigned int set;
+int i, j, k, M, L;
+
+
+  if (endmember->ne > SMA_MAX_EMB){
+    printf("too many endmembers (max. %d).\n", SMA_MAX_EMB); exit(1);}
+
+  alloc((void**)&sm, 1, sizeof(sma_model_t));
+
+  sm->M  = M = endmember->ne;
+  sm->nb = endmember->nb;
+  sm->L  = L = (sma->sto) ? endmember->nb+1 : endmember->nb;
+  sm->itmax = 30*M;
+  sm->tol   = FLT_MIN;
+
+  alloc((void**)&sm->Z,       L*M, sizeof(double)); 
+  alloc((void**)&sm->ZtZ,     M*M, sizeof(double)); 
+  alloc((void**)&sm->inv_all, M*M, sizeof(double)); 
+
+  // copy endmember to row-major matrix; append a row of 1 for sum-to-one
+  for (i=0; i<L; i++){
+  for (j=0; j<M; j++){
+    sm->Z[i*M+j] = (i < endmember->nb) ? endmember->tab[i][j] : 1.0;
+  }
+  }
+
+  #ifdef FORCE_DEBUG
+  printf("Endmember matrix_:\n");
+  for (i=0; i<L; i++){
+  for (j=0; j<M; j++){
+    printf(" %.2f", sm->Z[i*M+j]);
+  }
+  printf("\n");
+  }
+  #endif
+
+  // pre-compute crossproduct of Z_: t(Z)Z
+  for (i=0; i<M; i++){
+  for (j=0; j<M; j++){
+    for (k=0; k<L; k++) sm->ZtZ[i*M+j] += sm->Z[k*M+i]*sm->Z[k*M+j];
+  }
+  }
+
+  // unconstrained inversion
+  sma_passive_inverse(sm, (1u << M) - 1, sm->inv_all);
+
+  // all passive sets of the constrained inversion
+  if (sma->pos && M <= SMA_MAX_SET){
+    alloc((void**)&sm->inv, (size_t)(1u << M)*M*M, sizeof(double));
+    for (set=1; set<(1u << M); set++) sma_passive_inverse(sm, set, sm->inv + (size_t)set*M*M);
+  }
+
+  return sm;
+}
+
+
+/** This function frees the SMA model
+--- sm:     SMA model
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_sma_model(sma_model_t *sm){
+
+  if (sm == NULL) return;
+
+  if (sm->Z       != NULL) free((void*)sm->Z);
+  if (sm->ZtZ     != NULL) free((void*)sm->ZtZ);
+  if (sm->inv_all != NULL) free((void*)sm->inv_all);
+  if (sm->inv     != NULL) free((void*)sm->inv);
+  free((void*)sm);
+
+  return;
+}
+
+
+/** This function solves the unconstrained least squares problem for the
++++ passive set, s = (t(Z)Z)^-1 t(Z)x, with active elements set to 0.
+--- sm:     SMA model
+--- set:    passive set (bitmask)
+--- Ztx:    crossproduct of endmember matrix and spectrum
+--- s:      solution (returned)
+--- buf:    buffer for the inverse (M x M), used if not precomputed
++++ Return: minimum of s in the passive set
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double sma_passive_solve(const sma_model_t *sm, unsigned int set, const double *Ztx, double *s, double *buf){
+int i, j, ik, jk, nP;
+int M = sm->M;
+const double *inv = NULL;
+double sum, s_min = 1;
+
+
+  if (sm->inv != NULL){
+    for (i=0, nP=0; i<M; i++) nP += (set >> i) & 1;
+    inv = sm->inv + (size_t)set*M*M;
+  } else {
+    nP = sma_passive_inverse(sm, set, buf);
+    inv = buf;
+  }
+
+  for (i=0, ik=0; i<M; i++){
+
+    if (!((set >> i) & 1)){
+      s[i] = 0;
+      continue;
+    }
+
+    for (j=0, jk=0, sum=0; j<M; j++){
+      if ((set >> j) & 1) sum += inv[ik*nP + jk++]*Ztx[j];
+    }
+
+    s[i] = sum;
+    if (ik == 0 || sum < s_min) s_min = sum;
+    ik++;
+
+  }
+
+  return s_min;
+}
+
+
+/** This function solves the non-negative least squares problem of one
++++ spectrum with the active-set method of Lawson & Hanson. It is only
++++ called for spectra where the unconstrained solution is negative.
+--- sm:     SMA model
+--- Ztx:    crossproduct of endmember matrix and spectrum
+--- d:      fractions (returned)
+--- s:      buffer (M)
+--- w:      buffer (M)
+--- buf:    buffer (M x M)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void sma_active_set(const sma_model_t *sm, const double *Ztx, double *d, double *s, double *w, double *buf){
+int i, j, m, it = 0, k = 0;
+int M = sm->M;
+unsigned int P = 0;            // passive set, complement is active set
+unsigned int all = (1u << M) - 1;
+double s_min, alpha, a, w_max;
+
+
+  // A_: initialization (A1-A4), w = t(Z)x - t(Z)Zd with d = 0
+  for (i=0; i<M; i++){
+    d[i] = 0;
+    w[i] = Ztx[i];
+  }
+
+  // B_: main loop (B1)
+  while (P != all && k++ < sm->itmax){
+
+    // index of maximum w in the active set (B2)
+    for (i=0, m=-1, w_max=0; i<M; i++){
+      if ((P >> i) & 1) continue;
+      if (m < 0 || w[i] > w_max){ m = i; w_max = w[i];}
+    }
+    if (w_max <= sm->tol) break;
+
+    // add to passive, remove from active set (B3)
+    P |= 1u << m;
+
+    // unconstrained inversion of the passive set (B4)
+    s_min = sma_passive_solve(sm, P, Ztx, s, buf);
 
+    // C_: inner loop (C1)
+    while (s_min <= 0 && it < sm->itmax){
+
+      it++;
+
+      // compute alpha = -min(d/d-s) of passive set (C2)
+      for (i=0, alpha=INT_MAX; i<M; i++){
+        if (((P >> i) & 1) && s[i] <= sm->tol){
+          a = d[i] / (d[i] - s[i]);
+          if (a < alpha) alpha = a;
         }
+      }
 
+      // compute new d = d + alpha(s-d) for all elements (C3)
+      for (i=0; i<M; i++) d[i] += alpha*(s[i]-d[i]);
+
+      // remove from passive and add to active set (C4)
+      for (i=0; i<M; i++){
+        if (((P >> i) & 1) && fabs(d[i]) < sm->tol) P &= ~(1u << i);
       }
 
+      // unconstrained inversion of the passive set (C5-6)
+      s_min = sma_passive_solve(sm, P, Ztx, s, buf);
+
     }
+
+    // update d with s (B5)
+    memcpy(d, s, M*sizeof(double));
+
+    // compute w = t(Z)x - t(Z)Zd for the active set (B6)
+    for (i=0; i<M; i++){
+      if ((P >> i) & 1) continue;
+      for (j=0, w[i]=Ztx[i]; j<M; j++) w[i] -= sm->ZtZ[i*M+j]*d[j];
+    }
+
   }
 
   return;
@@ -478,7 +750,11 @@ float tc[3][6] = {
 
 /** Compute spectral mixture analysis index
 +++ This function computes SMA fractions for one date. Only one fraction
-+++ is retained.
++++ is retained. The endmember model is compiled once (see 
++++ compile_sma_model). The pixels are processed in blocks: for each date,
++++ the valid spectra of a block are unmixed with matrix-matrix products,
++++ and the active-set correction of the non-negative inversion is only
++++ run for spectra with negative unconstrained fractions.
 --- ard:       ARD
 --- mask_:     mask image
 --- ts:        pointer to instantly useable TSA image arrays
@@ -490,567 +766,815 @@ float tc[3][6] = {
 +++ Return:    void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void index_unmixed(ard_t *ard, small *mask_, tsa_t *ts, int nc, int nt, short nodata, par_sma_t *sma, aux_emb_t *endmember){
-int p, t;
-int i, j, ik, jk;
-int it, itmax;
-int m, nP, sign;
-int M = endmember->ne;
-int L = endmember->nb;
-double tol = FLT_MIN;
-double s_min, alpha;
-double f = 1.0;
-double rsum, dsum, res;
+int p, p0, p1, t, n, nv;
+int i, j, M, L;
+bool neg;
+double f, rsum, res;
+double *d = NULL, *x = NULL;
+double *X = NULL, *ZTX = NULL, *D = NULL;
+double *s = NULL, *w = NULL, *buf = NULL;
+int *pix = NULL;
 float scale = 10000.0;
-
-gsl_matrix *Z   =  NULL;
-gsl_vector *x =    NULL;
-gsl_matrix *ZtZ =  NULL;
-gsl_vector *Ztx =  NULL;
-gsl_vector *P   =  NULL;
-gsl_vector *R   =  NULL;
-gsl_vector *d   =  NULL;
-gsl_vector *s   =  NULL;
-gsl_vector *w   =  NULL;
-gsl_vector *a   =  NULL;
+sma_model_t *sm = NULL;
+gsl_matrix_view X_, Z_, ZTX_, D_, inv_;
 
 
   if (endmember->nb != get_brick_nbands(ard[0].DAT)){
     printf("number of bands in endmember file and ARD is different.\n"); exit(1);}
+
+  sm = compile_sma_model(endmember, sma);
+  M = sm->M;
+  L = sm->L;
+
+
+  #pragma omp parallel private(p,p0,p1,t,n,nv,i,j,neg,f,rsum,res,d,x,X,ZTX,D,s,w,buf,pix,X_,Z_,ZTX_,D_,inv_) shared(ard,mask_,ts,sma,sm,nc,nt,nodata,L,M,scale) default(none)
+  {
+
+    // allocate working variables
+    alloc((void**)&X,   SMA_BLOCK*L, sizeof(double));
+    alloc((void**)&ZTX, SMA_BLOCK*M, sizeof(double));
+    alloc((void**)&D,   SMA_BLOCK*M, sizeof(double));
+    alloc((void**)&pix, SMA_BLOCK,   sizeof(int));
+    alloc((void**)&s,   M,   sizeof(double));
+    alloc((void**)&w,   M,   sizeof(double));
+    alloc((void**)&buf, M*M, sizeof(double));
+
+    Z_   = gsl_matrix_view_array(sm->Z,       L, M);
+    inv_ = gsl_matrix_view_array(sm->inv_all, M, M);
+
     
+    #pragma omp for schedule(dynamic,1)
+    for (p0=0; p0<nc; p0+=SMA_BLOCK){
 
-  itmax = 30*M;
+      p1 = (p0+SMA_BLOCK < nc) ? p0+SMA_BLOCK : nc;
 
-  if (sma->sto) L++;
+      for (t=0; t<nt; t++){
 
-  // allocate working variables
-  Z   = gsl_matrix_alloc(L, M);
-  ZtZ = gsl_matrix_alloc(M, M);
+        // gather the valid spectra of this block, and scale to reflectance
+        for (p=p0, nv=0; p<p1; p++){
 
+          if ((mask_ != NULL && !mask_[p]) || !ard[t].msk[p]){
+            ts->tss_[t][p] = nodata;
+            if (sma->orms) ts->rms_[t][p] = nodata;
+            continue;
+          }
 
-  // copy endmember to GSL matrix
-  for (i=0; i<endmember->nb; i++){
-  for (j=0; j<M; j++){
-    gsl_matrix_set(Z, i, j, endmember->tab[i][j]);
-  }
-  }
-  if (sma->sto){ // append a row of 1
-    for (j=0; j<M; j++) gsl_matrix_set(Z, i, j, 1);
+          x = X + nv*L;
+          for (i=0; i<sm->nb; i++) x[i] = ard[t].dat[i][p]/scale;
+          if (sma->sto) x[L-1] = 1;
+          pix[nv++] = p;
+
+        }
+
+        if (nv == 0) continue;
+
+        // crossproduct of Z and x_ for all spectra: t(Z)x
+        X_   = gsl_matrix_view_array(X,   nv, L);
+        ZTX_ = gsl_matrix_view_array(ZTX, nv, M);
+        D_   = gsl_matrix_view_array(D,   nv, M);
+        gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, &X_.matrix, &Z_.matrix, 0.0, &ZTX_.matrix);
+
+        // unconstrained inversion: d = (t(Z)Z)^-1 t(z)x
+        gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, &ZTX_.matrix, &inv_.matrix, 0.0, &D_.matrix);
+
+        for (n=0; n<nv; n++){
+
+          p = pix[n];
+          x = X + n*L;
+          d = D + n*M;
+
+          // constrained inversion (negative values are not allowed),
+          // the unconstrained solution is optimal if it is non-negative
+          if (sma->pos){
+            for (j=0, neg=false; j<M; j++){ if (d[j] < 0){ neg = true; break;}}
+            if (neg) sma_active_set(sm, ZTX + n*M, d, s, w, buf);
+          }
+
+          // RMSE
+          if (sma->orms){
+            for (i=0, rsum=0; i<L; i++){
+              for (j=0, res=x[i]; j<M; j++) res -= d[j]*sm->Z[i*M+j];
+              rsum += res*res;
+            }
+            ts->rms_[t][p] = (short)(sqrt(rsum/L)*scale);
+          }
+
+          // apply optional shade normalization (shade must be the last endmember)
+          if (sma->shn){
+            f = 1.0 / (1.0 - d[M-1]);
+            for (j=0; j<M-1; j++) d[j] *= f;
+            d[j] = 0;
+          }
+
+          // retain one fraction
+          ts->tss_[t][p] = (short)(d[sma->emb-1]*scale);
+
+        }
+
+      }
+
+    }
+
+
+    // free working variables
+    free((void*)X);
+    free((void*)ZTX);
+    free((void*)D);
+    free((void*)pix);
+    free((void*)s);
+    free((void*)w);
+    free((void*)buf);
+    
   }
+  
+  free_sma_model(sm);
+
+  return;
+}
+
+
+/** This function computes a spectral index time series from a compiled
++++ band-math expression. The pixels are processed in blocks, and the
++++ expression is evaluated for the whole block one operation at a time
++++ (see eval_index_expr), such that the interpretation overhead is spent
++++ once per block. The bands are scaled to reflectance, and the result is
++++ scaled by 10000, like the built-in indices. Results that are not finite
++++ or exceed the range of short are set to nodata.
+--- ard:    ARD
+--- mask_:  mask image
+--- ts:     pointer to instantly useable TSA image arrays
+--- expr:   compiled expression
+--- nc:     number of cells
+--- nt:     number of ARD products over time
+--- nodata: nodata value
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void index_expression(ard_t *ard, small *mask_, tsa_t *ts, const index_expr_t *expr, int nc, int nt, short nodata){
+int p, p0, np, t;
+bool valid;
+float ind, scale = 10000.0;
+
+
+  #pragma omp parallel private(p,np,t,valid,ind) shared(ard,mask_,ts,expr,nc,nt,nodata,scale) default(none)
+  {
+
+    float stack[IDX_EXPR_STACK*IDX_EXPR_BLOCK];
+
+    #pragma omp for schedule(static)
+    for (p0=0; p0<nc; p0+=IDX_EXPR_BLOCK){
+
+      np = (p0+IDX_EXPR_BLOCK < nc) ? IDX_EXPR_BLOCK : nc-p0;
+
+      for (p=p0, valid=false; p<p0+np; p++){
+        if (mask_ == NULL || mask_[p]){ valid = true; break;}
+      }
+
+      if (!valid){
+        for (t=0; t<nt; t++){
+          for (p=p0; p<p0+np; p++) ts->tss_[t][p] = nodata;
+        }
+        continue;
+      }
+
+      for (t=0; t<nt; t++){
+
+        eval_index_expr(expr, ard[t].dat, p0, np, stack);
+
+        for (p=p0; p<p0+np; p++){
+          ind = stack[p-p0]*scale;
+          if ((mask_ != NULL && !mask_[p]) || !ard[t].msk[p] ||
+              !(ind >= SHRT_MIN && ind <= SHRT_MAX)){
+            ts->tss_[t][p] = nodata;
+          } else {
+            ts->tss_[t][p] = (short)ind;
+          }
+        }
+
+      }
+
+    }
 
-  #ifdef FORCE_DEBUG
-  printf("Endmember matrix_:\n");
-  for (i=0; i<L; i++){
-  for (j=0; j<M; j++){
-    printf(" %.2f", gsl_matrix_get(Z, i, j));
   }
-  printf("\n");
+
+  return;
+}
+
+
+/** This function computes one value of a spectral index, for one pixel
++++ and date. The arithmetic is the same as in the index_* functions above,
++++ i.e. index_fused gives the same values as the single-index functions.
+--- ard:    ARD of one date
+--- p:      pixel
+--- def:    index definition
+--- nodata: nodata value
++++ Return: index value
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+short index_value(ard_t *ard, int p, index_def_t *def, short nodata){
+int *b = def->band;
+float *f = def->f;
+float tmp, ind, x, sigma, diff, upper, lower, nir, red, blue;
+int i, comp0, comp1;
+float xtc[3] = { 1, 1, 1 };
+float scale = 10000.0;
+const float (*tc)[6] = tasseled_coef;
+
+
+  switch (def->family){
+
+    case _INDEX_BAND_:
+      return ard->dat[b[0]][p];
+
+    case _INDEX_DIFF_:
+      tmp = (ard->dat[b[0]][p]+ard->dat[b[1]][p]);
+      ind = (ard->dat[b[0]][p]-ard->dat[b[1]][p])/tmp;
+      if (tmp == 0 || ind < -1 || ind > 1) return nodata;
+      return (short)(ind*scale);
+
+    case _INDEX_RATIO_:
+      scale = 1000.0;
+      ind = (ard->dat[b[0]][p] / (float)ard->dat[b[1]][p]) - 1.0;
+      if (ard->dat[b[1]][p] == 0 || ind*scale > SHRT_MAX || ind*scale < SHRT_MIN) return nodata;
+      return (short)(ind*scale);
+
+    case _INDEX_MSRRE_:
+      if (ard->dat[b[1]][p] == 0) return nodata;
+      upper = (ard->dat[b[0]][p] / (float)ard->dat[b[1]][p]) - 1.0;
+      lower = sqrt((ard->dat[b[0]][p] / (float)ard->dat[b[1]][p]) + 1.0);
+      ind = upper/lower;
+      if (lower == 0 || ind*scale > SHRT_MAX || ind*scale < SHRT_MIN) return nodata;
+      return (short)(ind*scale);
+
+    case _INDEX_KERNEL_:
+      if (ard->dat[b[0]][p] <= 0 || ard->dat[b[1]][p] <= 0) return nodata;
+      sigma = 0.5 * (ard->dat[b[0]][p] + ard->dat[b[1]][p]);
+      diff  = ard->dat[b[0]][p] - ard->dat[b[1]][p];
+      tmp   = exp(-(diff*diff) / (2*sigma*sigma));
+      ind   = (1-tmp) / (1+tmp);
+      return (short)(ind*scale);
+
+    case _INDEX_RESIST_:
+      x    = (def->opt) ? 1.0 : 0.0;
+      nir  = ard->dat[b[0]][p];
+      red  = ard->dat[b[1]][p];
+      blue = ard->dat[b[2]][p];
+      red -= x*(blue-red);
+      tmp = nir+f[1]*red-f[2]*blue+f[3]*scale;
+      ind = f[0]*(nir-red)/tmp;
+      if (tmp == 0) return nodata;
+      return (short)(ind*scale);
+
+    case _INDEX_TASSEL_:
+      comp0 = def->opt; comp1 = def->opt+1;
+      if (def->opt == TCD){ comp0 = 0; comp1 = 3; xtc[1] = -1; xtc[2] = -1;}
+      for (i=comp0, ind=0; i<comp1; i++){
+        tmp = tc[i][0]*ard->dat[b[0]][p] + tc[i][1]*ard->dat[b[1]][p] + 
+              tc[i][2]*ard->dat[b[2]][p] + tc[i][3]*ard->dat[b[3]][p] + 
+              tc[i][4]*ard->dat[b[4]][p] + tc[i][5]*ard->dat[b[5]][p];
+        ind += xtc[i]*tmp;
+      }
+      return (short)ind;
+
+    case _INDEX_CONTREM_:
+      tmp = (ard->dat[b[1]][p] * (f[2] - f[0]) + 
+             ard->dat[b[2]][p] * (f[0] - f[1])) / 
+            (f[2] - f[1]);
+      return (short)(ard->dat[b[0]][p] - tmp);
+
   }
-  #endif
 
-  // pre-compute crossproduct of Z_: t(Z)Z
-  gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, Z, Z, 0.0, ZtZ);
+  return nodata;
+}
 
 
-  #pragma omp parallel firstprivate(f) private(t,i,j,ik,jk,it,x,Ztx,P,R,d,s,w,a,nP,m,alpha,s_min,sign,dsum,rsum,res) shared(ard,mask_,ts,sma,nc,nt,nodata,itmax,tol,L,M,Z,ZtZ,stdout,scale,endmember) default(none)
-  {
+/** This function computes several spectral index time series in one pass
++++ over the ARD. For each pixel and date, the mask is checked once, and
++++ all indices are computed while the reflectance values are in cache.
++++ SMA is not supported, see tsa_spectral_indices.
+--- ard:    ARD
+--- mask_:  mask image
+--- tss_:   index time series, one per index
+--- def:    index definitions
+--- nidx:   number of indices
+--- nc:     number of cells
+--- nt:     number of ARD products over time
+--- nodata: nodata value
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void index_fused(ard_t *ard, small *mask_, short ***tss_, index_def_t *def, int nidx, int nc, int nt, short nodata){
+int p, t, j;
 
-    // allocate working variables
-    x   = gsl_vector_alloc(L);
-    Ztx = gsl_vector_alloc(M);
-    P   = gsl_vector_alloc(M);
-    R   = gsl_vector_alloc(M);
-    d   = gsl_vector_alloc(M);
-    s   = gsl_vector_alloc(M);
-    w   = gsl_vector_alloc(M);
-    a   = gsl_vector_alloc(M);
-    
-    // set last element of spectral vector to 1
-    if (sma->sto) gsl_vector_set(x, L-1, 1);
 
-    
-    #pragma omp for schedule(dynamic,1)
+  #pragma omp parallel private(t,j) shared(ard,mask_,tss_,def,nidx,nc,nt,nodata) default(none)
+  {
+
+    #pragma omp for
     for (p=0; p<nc; p++){
 
       if (mask_ != NULL && !mask_[p]){
-        for (t=0; t<nt; t++) ts->tss_[t][p] = nodata;
+        for (j=0; j<nidx; j++){
+          for (t=0; t<nt; t++) tss_[j][t][p] = nodata;
+        }
         continue;
       }
-      
+
       for (t=0; t<nt; t++){
 
         if (!ard[t].msk[p]){
-          ts->tss_[t][p] = nodata;
-          if (sma->orms) ts->rms_[t][p] = nodata;
+          for (j=0; j<nidx; j++) tss_[j][t][p] = nodata;
         } else {
+          for (j=0; j<nidx; j++) tss_[j][t][p] = index_value(&ard[t], p, &def[j], nodata);
+        }
 
-          it = 0;
+      }
 
-          // copy spectrum to GSL vector
-          for (i=0; i<endmember->nb; i++) gsl_vector_set(x, i, (double)(ard[t].dat[i][p]/scale));
+    }
+  }
 
-          // compute crossproduct of Z and x_: t(Z)x
-          gsl_blas_dgemv(CblasTrans, 1.0, Z, x, 0.0, Ztx);
+  return;
+}
 
-          /** unconstrained inversion (negative values are allowed) **/
-          if (!sma->pos){
 
-            // allocate working variables
-            gsl_matrix *ZtZ_ = gsl_matrix_alloc(M, M);
-            gsl_matrix *inv = gsl_matrix_alloc(M, M);
-            gsl_permutation *per = gsl_permutation_alloc(M);
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
-            // copy t(Z)Z, as it will be modified by the inversion
-            gsl_matrix_memcpy(ZtZ_, ZtZ);
-            
-            // LU decomposition + matrix inversion
-            gsl_linalg_LU_decomp(ZtZ_, per, &sign); 
-            gsl_linalg_LU_invert(ZtZ_, per, inv);
 
-            // d = (t(Z)Z)^-1 t(z)x
-            gsl_blas_dgemv(CblasNoTrans, 1.0, inv, Ztx, 0.0, d);
+/** This function computes linear band transforms, e.g. Tasseled Cap, PCA
++++ projections or user-defined transforms. The components are the matrix
++++ product of the coefficients (nk x nb) with the band vector, and each
++++ output is a weighted sum of the components. All outputs are computed
++++ in one pass: for blocks of pixels, the bands are gathered into a small
++++ matrix (nb x LIN_BLOCK), which is multiplied with the coefficients, 
++++ such that the innermost loop runs over contiguous pixels.
+--- ard:    ARD
+--- mask_:  mask image
+--- tss_:   output time series, one per output
+--- band:   bands (nb)
+--- nb:     number of bands
+--- coef:   coefficients (nk x nb), row-major
+--- nk:     number of components
+--- weight: weights of the components (nidx x nk), row-major
+--- nidx:   number of outputs
+--- nc:     number of cells
+--- nt:     number of ARD products over time
+--- nodata: nodata value
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void index_linear(ard_t *ard, small *mask_, short ***tss_, const int *band, int nb, const float *coef, int nk, const float *weight, int nidx, int nc, int nt, short nodata){
+int p0, p, q, t, i, j, k, np;
+float *x = NULL, *y = NULL;
+float ind;
 
-            // free working variables
-            gsl_matrix_free(ZtZ_);
-            gsl_permutation_free(per);
-            gsl_matrix_free(inv);
 
-          /** constrained inversion (negative values are not allowed) **/
-          } else {
+  #pragma omp parallel private(p,q,t,i,j,k,np,x,y,ind) shared(ard,mask_,tss_,band,nb,coef,nk,weight,nidx,nc,nt,nodata) default(none)
+  {
 
-            // A_: initialization (A1-A3)
-            for (i=0; i<M; i++){
-              gsl_vector_set(P, i, 0);
-              gsl_vector_set(R, i, 1);
-              gsl_vector_set(d, i, 0);
-              gsl_vector_set(s, i, 0);
-              gsl_vector_set(a, i, INT_MAX);
-            }
+    alloc((void**)&x, nb*LIN_BLOCK, sizeof(float));
+    alloc((void**)&y, nk*LIN_BLOCK, sizeof(float));
 
-            // compute w = t(Z)x - t(Z)Zd (A4)
-            gsl_blas_dgemv(CblasNoTrans, 1.0, ZtZ, d, 0.0, w);
-            for (i=0; i<M; i++) gsl_vector_set(w, i, 
-              gsl_vector_get(Ztx, i) - gsl_vector_get(w, i));
-
-            // B_: main loop (B1)
-            while (gsl_vector_max(R) > 0 && 
-                   gsl_vector_max(w) > tol){
-
-              // index of maximum w (B2)
-              m = gsl_vector_max_index(w);
-
-              // add to passive, remove from active set (B3)
-              gsl_vector_set(P, m, 1);
-              gsl_vector_set(R, m, 0);
-
-              // number of passive elements
-              nP = gsl_blas_dasum(P);
-
-              // allocate subsets for the matrices
-              gsl_matrix *ZtZ_ = gsl_matrix_alloc(nP, nP);
-              gsl_vector *Ztx_ = gsl_vector_alloc(nP);
-              gsl_vector *s_ = gsl_vector_alloc(nP);
-              gsl_matrix *inv = gsl_matrix_alloc(nP, nP);
-              gsl_permutation *per = gsl_permutation_alloc(nP);          
-
-              // subset the matrices according to the passive set
-              for (i=0, ik=0; i<M; i++){
-                if (gsl_vector_get(P, i) == 1){
-                  gsl_vector_set(Ztx_, ik, gsl_vector_get(Ztx, i));
-                  for (j=0, jk=0; j<M; j++){
-                    if (gsl_vector_get(P, j) == 1){
-                      gsl_matrix_set(ZtZ_, ik, jk, gsl_matrix_get(ZtZ, i, j));
-                      jk++;
-                    }
-                  }
-                  ik++;
-                }
-              }
-
-              // unconstrained inversion of the passive set (B4)
-
-              // LU decomposition + matrix inversion
-              gsl_linalg_LU_decomp(ZtZ_, per, &sign); 
-              gsl_linalg_LU_invert(ZtZ_, per, inv);
-
-              // compute s = (t(Z)Z)^-1 t(z)x for the passive subset
-              gsl_blas_dgemv(CblasNoTrans, 1.0, inv, Ztx_, 0.0, s_);
-
-              // minimum of s in the passive set
-              s_min = gsl_vector_min(s_);
-
-              // copy subsetted s to complete s, set active elements to 0
-              for (i=0, ik=0; i<M; i++){
-                if (gsl_vector_get(P, i) == 1){
-                  gsl_vector_set(s, i, gsl_vector_get(s_, ik++));
-                } else {
-                  gsl_vector_set(s, i, 0);
-                }
-              }
-
-              // free working variables
-              gsl_matrix_free(ZtZ_);
-              gsl_vector_free(Ztx_);
-              gsl_vector_free(s_);
-              gsl_permutation_free(per);
-              gsl_matrix_free(inv);
-
-              // C_: inner loop (C1)
-              while (s_min <= 0 && it < itmax){
-
-                it++;
-
-                // compute alpha = -min(d/d-s) of passive set (C2)
-                for (i=0; i<M; i++){
-                  if (gsl_vector_get(s, i) <= tol && gsl_vector_get(P, i) == 1){
-                    gsl_vector_set(a, i, gsl_vector_get(d, i) / 
-                        (gsl_vector_get(d, i) - gsl_vector_get(s, i)));
-                  } else {
-                    gsl_vector_set(a, i, INT_MAX);
-                  }
-                }
-                alpha = gsl_vector_min(a);
-
-                // compute new d = d + alpha(s-d) for all elements (C3)
-                for (i=0; i<M; i++) gsl_vector_set(d, i, gsl_vector_get(d, i) + 
-                  alpha*(gsl_vector_get(s, i)-gsl_vector_get(d, i)));
-
-                // remove from passive and add to active set (C4)
-                for (i=0; i<M; i++){
-                  if (fabs(gsl_vector_get(d, i)) < tol && gsl_vector_get(P, i) == 1){
-                    gsl_vector_set(P, i, 0);
-                    gsl_vector_set(R, i, 1);
-                  }
-                }
-
-                // number of passive elements
-                nP = gsl_blas_dasum(P);
-
-                // allocate subsets for the matrices
-                gsl_matrix *ZtZ_ = gsl_matrix_alloc(nP, nP);
-                gsl_vector *Ztx_ = gsl_vector_alloc(nP);
-                gsl_vector *s_ = gsl_vector_alloc(nP);
-                gsl_matrix *inv = gsl_matrix_alloc(nP, nP);
-                gsl_permutation *per = gsl_permutation_alloc(nP);
-
-                // subset the matrices according to the passive set
-                for (i=0, ik=0; i<M; i++){
-                  if (gsl_vector_get(P, i) == 1){
-                    gsl_vector_set(Ztx_, ik, gsl_vector_get(Ztx, i));
-                    for (j=0, jk=0; j<M; j++){
-                      if (gsl_vector_get(P, j) == 1){
-                        gsl_matrix_set(ZtZ_, ik, jk, gsl_matrix_get(ZtZ, i, j));
-                        jk++;
-                      }
-                    }
-                    ik++;
-                  }
-                }
-
-                // unconstrained inversion of the passive set (C5)
-
-                // LU decomposition + matrix inversion
-                gsl_linalg_LU_decomp(ZtZ_, per, &sign); 
-                gsl_linalg_LU_invert(ZtZ_, per, inv);
-
-                // compute s = (t(Z)Z)^-1 t(z)x for the passive subset
-                gsl_blas_dgemv(CblasNoTrans, 1.0, inv, Ztx_, 0.0, s_);
-
-                // minimum of s in the passive set
-                s_min = gsl_vector_min(s_);
-
-                // copy subsetted s to complete s, set active elements to 0 (C5-6)
-                for (i=0, ik=0; i<M; i++){
-                  if (gsl_vector_get(P, i) == 1){
-                    gsl_vector_set(s, i, gsl_vector_get(s_, ik++));
-                  } else {
-                    gsl_vector_set(s, i, 0);
-                  }
-                }
-
-                // free working variables
-                gsl_matrix_free(ZtZ_);
-                gsl_vector_free(Ztx_);
-                gsl_vector_free(s_);
-                gsl_permutation_free(per);
-                gsl_matrix_free(inv);
-
-
-              }
-
-              // update d with s (B5)
-              gsl_vector_memcpy(d, s);
-
-              // compute w = t(Z)x - t(Z)Zd (B6)
-              // set passive elements to -1, such that the 
-              // looping condition is constrained to the active set
-              gsl_blas_dgemv(CblasNoTrans, 1.0, ZtZ, d, 0.0, w);
-              for (i=0; i<M; i++){
-                if (gsl_vector_get(R, i) == 1){
-                  gsl_vector_set(w, i, 
-                    gsl_vector_get(Ztx, i) - gsl_vector_get(w, i));
-                } else {
-                  gsl_vector_set(w, i, -1);
-                }
-              }
+    #pragma omp for schedule(static)
+    for (p0=0; p0<nc; p0+=LIN_BLOCK){
 
-            }
+      np = (p0+LIN_BLOCK < nc) ? LIN_BLOCK : nc-p0;
 
-          }
+      for (t=0; t<nt; t++){
 
+        // gather the bands of this block
+        for (j=0; j<nb; j++){
+          for (q=0; q<np; q++) x[j*LIN_BLOCK+q] = ard[t].dat[band[j]][p0+q];
+        }
 
-          // RMSE
-          rsum = 0;
-          for (i=0; i<L; i++){
-            dsum = 0;
-            for (j=0; j<M; j++){
-              dsum += gsl_vector_get(d, j)*gsl_matrix_get(Z, i, j);
-            }
-            res = gsl_vector_get(x, i)-dsum;
-            rsum += res*res;
+        // components = coefficients x bands
+        for (k=0; k<nk; k++){
+          for (q=0; q<np; q++) y[k*LIN_BLOCK+q] = 0;
+          for (j=0; j<nb; j++){
+            for (q=0; q<np; q++) y[k*LIN_BLOCK+q] += coef[k*nb+j]*x[j*LIN_BLOCK+q];
           }
-          if (sma->orms) ts->rms_[t][p] = (short)(sqrt(rsum/L)*scale);
+        }
 
+        // outputs = weighted sums of the components
+        for (q=0; q<np; q++){
 
-          // apply optional shade normalization (shade must be the last endmember)
-          if (sma->shn){
-            f = 1.0 / (1.0 - gsl_vector_get(d, M-1));
-            for (i=0; i<M-1; i++) gsl_vector_set(d, i, gsl_vector_get(d, i)*f);
-            gsl_vector_set(d, i, 0);
+          p = p0+q;
 
+          if ((mask_ != NULL && !mask_[p]) || !ard[t].msk[p]){
+            for (i=0; i<nidx; i++) tss_[i][t][p] = nodata;
+            continue;
+          }
+
+          for (i=0; i<nidx; i++){
+            for (k=0, ind=0; k<nk; k++) ind += weight[i*nk+k]*y[k*LIN_BLOCK+q];
+            tss_[i][t][p] = (short)ind;
           }
 
-          // retain one fraction
-          ts->tss_[t][p] = (short)(gsl_vector_get(d, sma->emb-1)*scale);
-          
         }
 
       }
-      
+
     }
 
+    free((void*)x);
+    free((void*)y);
 
-    // free working variables
-    gsl_vector_free(x);
-    gsl_vector_free(Ztx);
-    gsl_vector_free(P);
-    gsl_vector_free(R);
-    gsl_vector_free(d);
-    gsl_vector_free(s);
-    gsl_vector_free(w);
-    gsl_vector_free(a);
-    
   }
-  
-  gsl_matrix_free(Z);
-  gsl_matrix_free(ZtZ);
 
   return;
 }
 
 
-/** public functions
+/** This function resolves a spectral index to its index family, and the
++++ bands and factors that the family is computed with. This is the one
++++ place where indices are defined; tsa_spectral_index and the device
++++ kernels (see tsa-gpu-hl.cu) both dispatch on the family.
+--- tsa:    TSA parameters
+--- idx:    spectral index
+--- sen:    sensor parameters
+--- def:    index definition (returned)
++++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int index_definition(par_tsa_t *tsa, int idx, par_sen_t *sen, index_def_t *def){
+int j, k;
 
 
-/** This function computes a spectral index time series
---- ard:       ARD
---- ts:        pointer to instantly useable TSA image arrays
---- mask_:     mask image
---- nc:        number of cells
---- nt:        number of ARD products over time
---- idx:       spectral index
---- nodata:    nodata value
---- tsa:       TSA parameters
---- sen:       sensor parameters
---- endmember: endmember (if SMA was selected)
-+++ Return:    SUCCESS/FAILURE
-+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int tsa_spectral_index(ard_t *ard, tsa_t *ts, small *mask_, int nc, int nt, int idx, short nodata, par_tsa_t *tsa, par_sen_t *sen, aux_emb_t *endmember){
-
+  memset(def, 0, sizeof(index_def_t));
 
   switch (tsa->index[idx]){
     case _IDX_BLU_:
-      index_band(ard, mask_, ts, sen->blue, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->blue;
       break;
     case _IDX_GRN_:
-      index_band(ard, mask_, ts, sen->green, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->green;
       break;
     case _IDX_RED_:
-      index_band(ard, mask_, ts, sen->red, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->red;
       break;
     case _IDX_NIR_:
-      index_band(ard, mask_, ts, sen->nir, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->nir;
       break;
     case _IDX_SW0_:
-      index_band(ard, mask_, ts, sen->swir0, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->swir0;
       break;
     case _IDX_SW1_:
-      index_band(ard, mask_, ts, sen->swir1, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->swir1;
       break;
     case _IDX_SW2_:
-      index_band(ard, mask_, ts, sen->swir2, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->swir2;
       break;
     case _IDX_RE1_:
-      index_band(ard, mask_, ts, sen->rededge1, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->rededge1;
       break;
     case _IDX_RE2_:
-      index_band(ard, mask_, ts, sen->rededge2, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->rededge2;
       break;
     case _IDX_RE3_:
-      index_band(ard, mask_, ts, sen->rededge3, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->rededge3;
       break;
     case _IDX_BNR_:
-      index_band(ard, mask_, ts, sen->bnir, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->bnir;
       break;
     case _IDX_NDV_:
       cite_me(_CITE_NDVI_);
-      index_differenced(ard, mask_, ts, sen->nir, sen->red, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->nir; def->band[1] = sen->red;
       break;
     case _IDX_EVI_:
       cite_me(_CITE_EVI_);
-      index_resistance(ard, mask_, ts, sen->nir, sen->red, sen->blue, 
-                       2.5, 6.0, 7.5, 1.0, false, nc, nt, nodata);
+      def->family = _INDEX_RESIST_;
+      def->band[0] = sen->nir; def->band[1] = sen->red; def->band[2] = sen->blue;
+      def->f[0] = 2.5; def->f[1] = 6.0; def->f[2] = 7.5; def->f[3] = 1.0;
+      def->opt = false;
       break;
     case _IDX_NBR_:
-       cite_me(_CITE_NBR_);
-      index_differenced(ard, mask_, ts, sen->nir, sen->swir2, nc, nt, nodata);
+      cite_me(_CITE_NBR_);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->nir; def->band[1] = sen->swir2;
       break;
     case _IDX_ARV_:
       cite_me(_CITE_SARVI_);
-      index_resistance(ard, mask_, ts, sen->nir, sen->red, sen->blue, 
-                       1.0, 1.0, 0.0, 0.0, true, nc, nt, nodata);
+      def->family = _INDEX_RESIST_;
+      def->band[0] = sen->nir; def->band[1] = sen->red; def->band[2] = sen->blue;
+      def->f[0] = 1.0; def->f[1] = 1.0; def->f[2] = 0.0; def->f[3] = 0.0;
+      def->opt = true;
       break;
     case _IDX_SAV_:
       cite_me(_CITE_SARVI_);
-      index_resistance(ard, mask_, ts, sen->nir, sen->red, sen->blue, 
-                       1.5, 1.0, 0.0, 0.5, false, nc, nt, nodata);
+      def->family = _INDEX_RESIST_;
+      def->band[0] = sen->nir; def->band[1] = sen->red; def->band[2] = sen->blue;
+      def->f[0] = 1.5; def->f[1] = 1.0; def->f[2] = 0.0; def->f[3] = 0.5;
+      def->opt = false;
       break;
     case _IDX_SRV_:
       cite_me(_CITE_SARVI_);
-      index_resistance(ard, mask_, ts, sen->nir, sen->red, sen->blue, 
-                       1.5, 1.0, 0.0, 0.5, true, nc, nt, nodata);
+      def->family = _INDEX_RESIST_;
+      def->band[0] = sen->nir; def->band[1] = sen->red; def->band[2] = sen->blue;
+      def->f[0] = 1.5; def->f[1] = 1.0; def->f[2] = 0.0; def->f[3] = 0.5;
+      def->opt = true;
       break;
     case _IDX_TCB_:
       cite_me(_CITE_TCAP_);
-      index_tasseled(ard, mask_, ts, TCB, sen->blue, sen->green, sen->red, 
-                     sen->nir, sen->swir1, sen->swir2, nc, nt, nodata);
+      def->family = _INDEX_TASSEL_;
+      def->opt = TCB;
+      def->band[0] = sen->blue; def->band[1] = sen->green; def->band[2] = sen->red;
+      def->band[3] = sen->nir; def->band[4] = sen->swir1; def->band[5] = sen->swir2;
       break;
     case _IDX_TCG_:
       cite_me(_CITE_TCAP_);
-      index_tasseled(ard, mask_, ts, TCG, sen->blue, sen->green, sen->red, 
-                     sen->nir, sen->swir1, sen->swir2, nc, nt, nodata);
+      def->family = _INDEX_TASSEL_;
+      def->opt = TCG;
+      def->band[0] = sen->blue; def->band[1] = sen->green; def->band[2] = sen->red;
+      def->band[3] = sen->nir; def->band[4] = sen->swir1; def->band[5] = sen->swir2;
       break;
     case _IDX_TCW_:
       cite_me(_CITE_TCAP_);
-      index_tasseled(ard, mask_, ts, TCW, sen->blue, sen->green, sen->red, 
-                     sen->nir, sen->swir1, sen->swir2, nc, nt, nodata);
+      def->family = _INDEX_TASSEL_;
+      def->opt = TCW;
+      def->band[0] = sen->blue; def->band[1] = sen->green; def->band[2] = sen->red;
+      def->band[3] = sen->nir; def->band[4] = sen->swir1; def->band[5] = sen->swir2;
       break;
     case _IDX_TCD_:
       cite_me(_CITE_DISTURBANCE_);
-      index_tasseled(ard, mask_, ts, TCD, sen->blue, sen->green, sen->red, 
-                     sen->nir, sen->swir1, sen->swir2, nc, nt, nodata);
+      def->family = _INDEX_TASSEL_;
+      def->opt = TCD;
+      def->band[0] = sen->blue; def->band[1] = sen->green; def->band[2] = sen->red;
+      def->band[3] = sen->nir; def->band[4] = sen->swir1; def->band[5] = sen->swir2;
       break;
     case _IDX_NDB_:
       cite_me(_CITE_NDBI_);
-      index_differenced(ard, mask_, ts, sen->swir1, sen->nir, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->swir1; def->band[1] = sen->nir;
       break;
     case _IDX_NDW_:
       cite_me(_CITE_NDWI_);
-      index_differenced(ard, mask_, ts, sen->green, sen->nir, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->green; def->band[1] = sen->nir;
       break;
     case _IDX_MNW_:
       cite_me(_CITE_MNDWI_);
-      index_differenced(ard, mask_, ts, sen->green, sen->swir1, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->green; def->band[1] = sen->swir1;
       break;
     case _IDX_NDS_:
       cite_me(_CITE_NDSI_);
-      index_differenced(ard, mask_, ts, sen->green, sen->swir1, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->green; def->band[1] = sen->swir1;
       break;
     case _IDX_SMA_:
       cite_me(_CITE_SMA_);
-      index_unmixed(ard, mask_, ts, nc, nt, nodata, &tsa->sma, endmember);
+      def->family = _INDEX_SMA_;
       break;
     case _IDX_BVV_:
-      index_band(ard, mask_, ts, sen->vv, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->vv;
       break;
     case _IDX_BVH_:
-      index_band(ard, mask_, ts, sen->vh, nc, nt, nodata);
+      def->family = _INDEX_BAND_;
+      def->band[0] = sen->vh;
       break;
     case _IDX_NDT_:
       cite_me(_CITE_NDTI_);
-      index_differenced(ard, mask_, ts, sen->swir1, sen->swir2, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->swir1; def->band[1] = sen->swir2;
       break;
     case _IDX_NDM_:
       cite_me(_CITE_NDMI_);
-      index_differenced(ard, mask_, ts, sen->nir, sen->swir1, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->nir; def->band[1] = sen->swir1;
       break;
     case _IDX_KNV_:
       cite_me(_CITE_KNDVI_);
-      index_kernelized(ard, mask_, ts, sen->nir, sen->red, nc, nt, nodata);
+      def->family = _INDEX_KERNEL_;
+      def->band[0] = sen->nir; def->band[1] = sen->red;
       break;
     case _IDX_ND1_:
       cite_me(_CITE_NDRE1_);
-      index_differenced(ard, mask_, ts, sen->rededge2, sen->rededge1, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->rededge2; def->band[1] = sen->rededge1;
       break;
     case _IDX_ND2_:
       cite_me(_CITE_NDRE2_);
-      index_differenced(ard, mask_, ts, sen->rededge3, sen->rededge1, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->rededge3; def->band[1] = sen->rededge1;
       break;
     case _IDX_CRE_:
       cite_me(_CITE_CIre_);
-      index_ratio_minus1(ard, mask_, ts, sen->rededge3, sen->rededge1, nc, nt, nodata);
+      def->family = _INDEX_RATIO_;
+      def->band[0] = sen->rededge3; def->band[1] = sen->rededge1;
       break;
     case _IDX_NR1_:
       cite_me(_CITE_NDVIre1_);
-      index_differenced(ard, mask_, ts, sen->bnir, sen->rededge1, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->bnir; def->band[1] = sen->rededge1;
       break;
     case _IDX_NR2_:
       cite_me(_CITE_NDVIre2_);
-      index_differenced(ard, mask_, ts, sen->bnir, sen->rededge2, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->bnir; def->band[1] = sen->rededge2;
       break;
     case _IDX_NR3_:
       cite_me(_CITE_NDVIre3_);
-      index_differenced(ard, mask_, ts, sen->bnir, sen->rededge3, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->bnir; def->band[1] = sen->rededge3;
       break;
     case _IDX_N1n_:
       cite_me(_CITE_NDVIre1n_);
-      index_differenced(ard, mask_, ts, sen->nir, sen->rededge1, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->nir; def->band[1] = sen->rededge1;
       break;
     case _IDX_N2n_:
       cite_me(_CITE_NDVIre2n_);
-      index_differenced(ard, mask_, ts, sen->nir, sen->rededge2, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->nir; def->band[1] = sen->rededge2;
       break;
     case _IDX_N3n_:
       cite_me(_CITE_NDVIre3n_);
-      index_differenced(ard, mask_, ts, sen->nir, sen->rededge3, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->nir; def->band[1] = sen->rededge3;
       break;
     case _IDX_Mre_:
       cite_me(_CITE_MSRre_);
-      index_msrre(ard, mask_, ts, sen->bnir, sen->rededge1, nc, nt, nodata);
+      def->family = _INDEX_MSRRE_;
+      def->band[0] = sen->bnir; def->band[1] = sen->rededge1;
       break;
     case _IDX_Mrn_:
       cite_me(_CITE_MSRren_);
-      index_msrre(ard, mask_, ts, sen->nir, sen->rededge1, nc, nt, nodata);
+      def->family = _INDEX_MSRRE_;
+      def->band[0] = sen->nir; def->band[1] = sen->rededge1;
       break;
     case _IDX_CCI_:
       cite_me(_CITE_CCI_);
-      index_differenced(ard, mask_, ts, sen->green, sen->red, nc, nt, nodata);
+      def->family = _INDEX_DIFF_;
+      def->band[0] = sen->green; def->band[1] = sen->red;
       break;
     case _IDX_EV2_:
       cite_me(_CITE_EV2_);
-      index_resistance(ard, mask_, ts, sen->nir, sen->red, sen->red, 
-                       2.4, 1.0, 0.0, 1.0, false, nc, nt, nodata);
+      def->family = _INDEX_RESIST_;
+      def->band[0] = sen->nir; def->band[1] = sen->red; def->band[2] = sen->red;
+      def->f[0] = 2.4; def->f[1] = 1.0; def->f[2] = 0.0; def->f[3] = 1.0;
+      def->opt = false;
       break;
     case _IDX_CSW_:
-      index_cont_remove(ard, mask_, ts, sen->swir1, sen->nir, sen->swir2, 
-                        sen->w_swir1, sen->w_nir, sen->w_swir2, nc, nt, nodata);
+      def->family = _INDEX_CONTREM_;
+      def->band[0] = sen->swir1; def->band[1] = sen->nir; def->band[2] = sen->swir2;
+      def->f[0] = sen->w_swir1; def->f[1] = sen->w_nir; def->f[2] = sen->w_swir2;
+      break;
+    case _IDX_EXP_:
+      // the k-th EXPRESSION in INDEX is the k-th INDEX_EXPRESSION
+      for (j=0, k=0; j<idx; j++){ if (tsa->index[j] == _IDX_EXP_) k++;}
+      if (k >= tsa->nexpr){
+        printf("no INDEX_EXPRESSION for this EXPRESSION\n"); return FAILURE;}
+      def->family = _INDEX_EXPR_;
+      def->opt  = k;
+      def->expr = &tsa->expr[k];
       break;
     default:
       printf("unknown INDEX\n");
-      break;      
+      return FAILURE;
+  }
+
+  return SUCCESS;
+}
+
+
+/** This function computes a spectral index time series. Most index fami-
++++ lies are computed with specialized kernels (see index-kernel-hl.cpp),
++++ the others with the generic functions
+--- ard:       ARD
+--- ts:        pointer to instantly useable TSA image arrays
+--- mask_:     mask image
+--- nc:        number of cells
+--- nt:        number of ARD products over time
+--- idx:       spectral index
+--- nodata:    nodata value
+--- tsa:       TSA parameters
+--- sen:       sensor parameters
+--- endmember: endmember (if SMA was selected)
++++ Return:    SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int tsa_spectral_index(ard_t *ard, tsa_t *ts, small *mask_, int nc, int nt, int idx, short nodata, par_tsa_t *tsa, par_sen_t *sen, aux_emb_t *endmember){
+index_def_t def;
+int *b = def.band;
+float *f = def.f;
+
+
+  if (index_definition(tsa, idx, sen, &def) == FAILURE) return SUCCESS;
+
+  // kernels that are specialized per index family at compile time
+  if (index_specialized(ard, mask_, ts, &def, nc, nt, nodata) == SUCCESS) return SUCCESS;
+
+  // generic fallback
+  switch (def.family){
+    case _INDEX_BAND_:
+      index_band(ard, mask_, ts, b[0], nc, nt, nodata);
+      break;
+    case _INDEX_DIFF_:
+      index_differenced(ard, mask_, ts, b[0], b[1], nc, nt, nodata);
+      break;
+    case _INDEX_RATIO_:
+      index_ratio_minus1(ard, mask_, ts, b[0], b[1], nc, nt, nodata);
+      break;
+    case _INDEX_MSRRE_:
+      index_msrre(ard, mask_, ts, b[0], b[1], nc, nt, nodata);
+      break;
+    case _INDEX_KERNEL_:
+      index_kernelized(ard, mask_, ts, b[0], b[1], nc, nt, nodata);
+      break;
+    case _INDEX_RESIST_:
+      index_resistance(ard, mask_, ts, b[0], b[1], b[2], 
+                       f[0], f[1], f[2], f[3], def.opt, nc, nt, nodata);
+      break;
+    case _INDEX_TASSEL_:
+      index_tasseled(ard, mask_, ts, def.opt, b[0], b[1], b[2], 
+                     b[3], b[4], b[5], nc, nt, nodata);
+      break;
+    case _INDEX_CONTREM_:
+      index_cont_remove(ard, mask_, ts, b[0], b[1], b[2], 
+                        f[0], f[1], f[2], nc, nt, nodata);
+      break;
+    case _INDEX_SMA_:
+      index_unmixed(ard, mask_, ts, nc, nt, nodata, &tsa->sma, endmember);
+      break;
+    case _INDEX_EXPR_:
+      index_expression(ard, mask_, ts, def.expr, nc, nt, nodata);
+      break;
   }
 
   
   return SUCCESS;
 }
 
+
+/** This function computes several spectral index time series. All indices
++++ but SMA and expressions are computed in one pass over the ARD (see 
++++ index_fused), i.e. each reflectance value is read once, instead of 
++++ once per index. All Tasseled Cap indices share one linear transform 
++++ (see index_linear), i.e. the components are computed once.
+--- ard:       ARD
+--- ts:        pointer to instantly useable TSA image arrays, one per index
+--- nidx:      number of indices
+--- mask_:     mask image
+--- nc:        number of cells
+--- nt:        number of ARD products over time
+--- idx:       first spectral index
+--- nodata:    nodata value
+--- tsa:       TSA parameters
+--- sen:       sensor parameters
+--- endmember: endmember (if SMA was selected)
++++ Return:    SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int tsa_spectral_indices(ard_t *ard, tsa_t *ts, int nidx, small *mask_, int nc, int nt, int idx, short nodata, par_tsa_t *tsa, par_sen_t *sen, aux_emb_t *endmember){
+index_def_t *def = NULL;
+short ***tss_ = NULL;
+short ***tc_tss_ = NULL;
+float *tc_w = NULL;
+int tc_band[6];
+int j, n = 0, ntc = 0;
+
+
+  if (nidx == 1) return tsa_spectral_index(ard, ts, mask_, nc, nt, idx, nodata, tsa, sen, endmember);
+
+  alloc((void**)&def, nidx, sizeof(index_def_t));
+  alloc((void**)&tss_, nidx, sizeof(short**));
+  alloc((void**)&tc_tss_, nidx, sizeof(short**));
+  alloc((void**)&tc_w, nidx*3, sizeof(float));
+
+  for (j=0; j<nidx; j++){
+
+    if (index_definition(tsa, idx+j, sen, &def[n]) == FAILURE) continue;
+
+    if (def[n].family == _INDEX_SMA_){
+      index_unmixed(ard, mask_, &ts[j], nc, nt, nodata, &tsa->sma, endmember);
+    } else if (def[n].family == _INDEX_EXPR_){
+      index_expression(ard, mask_, &ts[j], def[n].expr, nc, nt, nodata);
+    } else if (def[n].family == _INDEX_TASSEL_){
+      tasseled_weight(def[n].opt, &tc_w[ntc*3]);
+      tc_tss_[ntc++] = ts[j].tss_;
+      memcpy(tc_band, def[n].band, 6*sizeof(int));
+    } else {
+      tss_[n++] = ts[j].tss_;
+    }
+
+  }
+
+  if (ntc > 0) index_linear(ard, mask_, tc_tss_, tc_band, 6, 
+                            &tasseled_coef[0][0], 3, tc_w, ntc, nc, nt, nodata);
+
+  if (n > 0) index_fused(ard, mask_, tss_, def, n, nc, nt, nodata);
+
+  free((void*)def);
+  free((void*)tss_);
+  free((void*)tc_tss_);
+  free((void*)tc_w);
+
+  return SUCCESS;
+}
+
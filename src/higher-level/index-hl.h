@@ -35,6 +35,7 @@ Spectral index header
 #include "../higher-level/read-ard-hl.h"
 #include "../higher-level/param-hl.h"
 #include "../higher-level/tsa-hl.h"
+#include "../higher-level/index-kernel-hl.h"
 
 
 #ifdef __cplusplus
@@ -42,6 +43,9 @@ extern "C" {
 #endif
 
 int tsa_spectral_index(ard_t *ard, tsa_t *ts, small *mask_, int nc, int nt, int idx, short nodata, par_tsa_t *tsa, par_sen_t *sen, aux_emb_t *endmember);
+int tsa_spectral_indices(ard_t *ard, tsa_t *ts, int nidx, small *mask_, int nc, int nt, int idx, short nodata, par_tsa_t *tsa, par_sen_t *sen, aux_emb_t *endmember);
+int index_definition(par_tsa_t *tsa, int idx, par_sen_t *sen, index_def_t *def);
+void index_linear(ard_t *ard, small *mask_, short ***tss_, const int *band, int nb, const float *coef, int nk, const float *weight, int nidx, int nc, int nt, short nodata);
 
 #ifdef __cplusplus
 }
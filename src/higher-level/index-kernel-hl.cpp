@@ -0,0 +1,257 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains specialized kernels for computing spectral indices
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "index-kernel-hl.h"
+
+#include <cmath>
+
+
+/** The index kernels are instantiated per index family at compile time.
++++ Each family is an operator that binds the bands of one date, and com-
++++ putes the index of one pixel. The scale factors are constant, and the
++++ band pointers are hoisted out of the pixel loop, thus the pixel loop
++++ is contiguous and can be vectorized. The operators reproduce the ge-
++++ neric functions in index-hl.c, which remain as fallback for the 
++++ families that are not specialized here.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+#define IDX_KERNEL_BLOCK 4096 // pixels per block
+
+
+// band method, e.g. BLUE
+struct index_band_op {
+  const short *b;
+  static constexpr float scale = 1.0;
+  index_band_op(short **dat, const index_def_t *def) : b(dat[def->band[0]]) {}
+  inline bool operator()(int p, float *ind) const {
+    *ind = b[p];
+    return true;
+  }
+};
+
+// normalized differenced method, e.g. NDVI: (b1-b2)/(b1+b2)
+struct index_diff_op {
+  const short *b1, *b2;
+  static constexpr float scale = 10000.0;
+  index_diff_op(short **dat, const index_def_t *def) : b1(dat[def->band[0]]), b2(dat[def->band[1]]) {}
+  inline bool operator()(int p, float *ind) const {
+    float tmp = b1[p]+b2[p];
+    *ind = (b1[p]-b2[p])/tmp;
+    return !((tmp == 0) | (*ind < -1) | (*ind > 1));
+  }
+};
+
+// ratio - 1, e.g. CIre: (b1/b2)-1
+struct index_ratio_op {
+  const short *b1, *b2;
+  static constexpr float scale = 1000.0;
+  index_ratio_op(short **dat, const index_def_t *def) : b1(dat[def->band[0]]), b2(dat[def->band[1]]) {}
+  inline bool operator()(int p, float *ind) const {
+    *ind = (b1[p] / (float)b2[p]) - 1.0f;
+    return !((b2[p] == 0) | (*ind*scale > SHRT_MAX) | (*ind*scale < SHRT_MIN));
+  }
+};
+
+// MSRre-like: ((b1/b2)-1)/sqrt((b1/b2)+1)
+struct index_msrre_op {
+  const short *b1, *b2;
+  static constexpr float scale = 10000.0;
+  index_msrre_op(short **dat, const index_def_t *def) : b1(dat[def->band[0]]), b2(dat[def->band[1]]) {}
+  inline bool operator()(int p, float *ind) const {
+    float ratio = b1[p] / (float)b2[p];
+    float upper = ratio - 1.0f;
+    float lower = (float)std::sqrt(ratio + 1.0);
+    *ind = upper/lower;
+    return !((b2[p] == 0) | (lower == 0) | (*ind*scale > SHRT_MAX) | (*ind*scale < SHRT_MIN));
+  }
+};
+
+// kernelized normalized differenced method, e.g. kNDVI
+struct index_kernel_op {
+  const short *b1, *b2;
+  static constexpr float scale = 10000.0;
+  index_kernel_op(short **dat, const index_def_t *def) : b1(dat[def->band[0]]), b2(dat[def->band[1]]) {}
+  inline bool operator()(int p, float *ind) const {
+    float sigma = 0.5 * (b1[p] + b2[p]);
+    float diff  = b1[p] - b2[p];
+    float tmp   = (float)std::exp((double)(-(diff*diff) / (2*sigma*sigma)));
+    *ind = (1-tmp) / (1+tmp);
+    return !((b1[p] <= 0) | (b2[p] <= 0));
+  }
+};
+
+// normalized differenced method with resistance terms, e.g. EVI, SARVI:
+// f1*(nir-red)/(nir+f2*red-f3*blue+f4*scale), with optional red-blue 
+// correction: red -= (blue-red)
+template <bool RBC>
+struct index_resist_op {
+  const short *n, *r, *b;
+  float f1, f2, f3, f4;
+  static constexpr float scale = 10000.0;
+  index_resist_op(short **dat, const index_def_t *def) : 
+    n(dat[def->band[0]]), r(dat[def->band[1]]), b(dat[def->band[2]]),
+    f1(def->f[0]), f2(def->f[1]), f3(def->f[2]), f4(def->f[3]) {}
+  inline bool operator()(int p, float *ind) const {
+    float nir = n[p], red = r[p], blue = b[p], tmp;
+    if (RBC) red -= (blue-red);
+    tmp = nir+f2*red-f3*blue+f4*scale;
+    *ind = f1*(nir-red)/tmp;
+    return tmp != 0;
+  }
+};
+
+// continuum removal, e.g. CSWIR
+struct index_contrem_op {
+  const short *b_, *b1, *b2;
+  float w_, w1, w2;
+  static constexpr float scale = 1.0;
+  index_contrem_op(short **dat, const index_def_t *def) : 
+    b_(dat[def->band[0]]), b1(dat[def->band[1]]), b2(dat[def->band[2]]),
+    w_(def->f[0]), w1(def->f[1]), w2(def->f[2]) {}
+  inline bool operator()(int p, float *ind) const {
+    float tmp = (b1[p] * (w2 - w_) + b2[p] * (w_ - w1)) / (w2 - w1);
+    *ind = b_[p] - tmp;
+    return true;
+  }
+};
+
+
+/** This function computes a spectral index time series with one of the
++++ index operators. The dates and pixel blocks are distributed over the
++++ threads; within a block, the pixel loop is vectorized.
+--- ard:    ARD
+--- mask_:  mask image (only used if MASKED)
+--- ts:     pointer to instantly useable TSA image arrays
+--- def:    index definition
+--- nc:     number of cells
+--- nt:     number of ARD products over time
+--- nodata: nodata value
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+template <typename Op, bool MASKED>
+void index_kernel(ard_t *ard, const small *mask_, tsa_t *ts, const index_def_t *def, int nc, int nt, short nodata){
+int nblock = (nc + IDX_KERNEL_BLOCK - 1) / IDX_KERNEL_BLOCK;
+
+
+  #pragma omp parallel for collapse(2) schedule(static) shared(ard,mask_,ts,def,nc,nt,nodata,nblock) default(none)
+  for (int t=0; t<nt; t++){
+  for (int k=0; k<nblock; k++){
+
+    const Op op(ard[t].dat, def);
+    const small *msk = ard[t].msk;
+    short *out = ts->tss_[t];
+    int p0 = k*IDX_KERNEL_BLOCK;
+    int p1 = (p0+IDX_KERNEL_BLOCK < nc) ? p0+IDX_KERNEL_BLOCK : nc;
+
+    #pragma omp simd
+    for (int p=p0; p<p1; p++){
+      float ind;
+      bool valid = op(p, &ind) & (msk[p] != 0) & (!MASKED || mask_[p] != 0);
+      // converted unconditionally, and blended with integer masks:
+      // a float select would keep the loop from being vectorized
+      short val  = (short)(ind*Op::scale);
+      short keep = -(short)valid;
+      out[p] = (short)((val & keep) | (nodata & ~keep));
+    }
+
+  }
+  }
+
+  return;
+}
+
+
+/** This function dispatches an index family to its specialized kernel
+--- ard:    ARD
+--- mask_:  mask image
+--- ts:     pointer to instantly useable TSA image arrays
+--- def:    index definition
+--- nc:     number of cells
+--- nt:     number of ARD products over time
+--- nodata: nodata value
++++ Return: SUCCESS, or FAILURE if the family is not specialized
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+template <bool MASKED>
+int index_dispatch(ard_t *ard, const small *mask_, tsa_t *ts, const index_def_t *def, int nc, int nt, short nodata){
+
+
+  switch (def->family){
+    case _INDEX_BAND_:
+      index_kernel<index_band_op, MASKED>(ard, mask_, ts, def, nc, nt, nodata);
+      return SUCCESS;
+    case _INDEX_DIFF_:
+      index_kernel<index_diff_op, MASKED>(ard, mask_, ts, def, nc, nt, nodata);
+      return SUCCESS;
+    case _INDEX_RATIO_:
+      index_kernel<index_ratio_op, MASKED>(ard, mask_, ts, def, nc, nt, nodata);
+      return SUCCESS;
+    case _INDEX_MSRRE_:
+      index_kernel<index_msrre_op, MASKED>(ard, mask_, ts, def, nc, nt, nodata);
+      return SUCCESS;
+    case _INDEX_KERNEL_:
+      index_kernel<index_kernel_op, MASKED>(ard, mask_, ts, def, nc, nt, nodata);
+      return SUCCESS;
+    case _INDEX_RESIST_:
+      if (def->opt){
+        index_kernel<index_resist_op<true>,  MASKED>(ard, mask_, ts, def, nc, nt, nodata);
+      } else {
+        index_kernel<index_resist_op<false>, MASKED>(ard, mask_, ts, def, nc, nt, nodata);
+      }
+      return SUCCESS;
+    case _INDEX_CONTREM_:
+      index_kernel<index_contrem_op, MASKED>(ard, mask_, ts, def, nc, nt, nodata);
+      return SUCCESS;
+    default:
+      return FAILURE;
+  }
+
+}
+
+
+/** This function computes a spectral index time series with a specialized
++++ kernel. Tasseled Cap, SMA and expressions are not specialized, and 
++++ need to be computed with the generic functions.
+--- ard:    ARD
+--- mask_:  mask image
+--- ts:     pointer to instantly useable TSA image arrays
+--- def:    index definition
+--- nc:     number of cells
+--- nt:     number of ARD products over time
+--- nodata: nodata value
++++ Return: SUCCESS, or FAILURE if the family is not specialized
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int index_specialized(ard_t *ard, small *mask_, tsa_t *ts, const index_def_t *def, int nc, int nt, short nodata){
+
+
+  if (mask_ == NULL){
+    return index_dispatch<false>(ard, mask_, ts, def, nc, nt, nodata);
+  } else {
+    return index_dispatch<true>(ard, mask_, ts, def, nc, nt, nodata);
+  }
+
+}
+
@@ -33,14 +33,21 @@ This file contains functions for time series interpolation
 
 /** GNU Scientific Library (GSL) **/
 #include <gsl/gsl_multifit.h> // Linear Least Squares Fitting
+#include <gsl/gsl_blas.h>     // Basic Linear Algebra Subprograms
 
 
+int series_obs(tsa_t *ts, int p, int nt, const int *all, const int **obs);
 int interpolate_none(tsa_t *ts, small *mask_, int nc, int nt);
 int interpolate_linear(tsa_t *ts, small *mask_, int nc, int nt, int ni, short nodata);
 int interpolate_moving(tsa_t *ts, small *mask_, int nc, int nt, int ni, short nodata, par_tsi_t *tsi);
 int interpolate_rbf(tsa_t *ts, small *mask_, int nc, int nt, int ni, short nodata, par_tsi_t *tsi);
 rbf_t *rbf_kernel(par_tsi_t *tsi);
 void free_rbf(rbf_t *rbf);
+void harmonic_basis(double *x, int ce, double ce_ref, int ncoef);
+int cmp_harm_pattern(const void *a, const void *b);
+bool same_harm_pattern(tsa_t *ts, bool *fit, int nt, int p, int q, short nodata);
+void harmonic_predict(tsa_t *ts, int p, gsl_vector *c, double **x_tss, double **x_tsi, int nt, int ni, int ncoef, short nodata, par_tsi_t *tsi);
+int interpolate_harmonic_state(tsa_t *ts, small *mask_, int nc, int nt, int ni, short nodata, par_tsi_t *tsi, int ncoef, double **x_tss, double **x_tsi);
 
 
 /** This function "interpolates" the time series with the NONE option:
@@ -74,7 +81,11 @@ int t, p;
 }
 
 
-/** This function interpolates the time series linearly.
+/** This function interpolates the time series linearly. The observations
++++ and the interpolation steps are both sorted in time, thus they are 
++++ merged in a single sweep: the left and right neighbours are carried 
++++ from one interpolation step to the next, and each observation is only
++++ visited once, i.e. O(nt+ni) per pixel.
 --- ts:     pointer to instantly useable TSA image arrays
 --- mask:   mask image
 --- nc:     number of cells
@@ -84,12 +95,17 @@ int t, p;
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int interpolate_linear(tsa_t *ts, small *mask_, int nc, int nt, int ni, short nodata){
-int t, t_left, i, p;
+int t, k, nv, i, p;
 float x_left, x_right, x;
 float y_left, y_right, y;
+int *all = NULL;
+const int *obs = NULL;
 
 
-  #pragma omp parallel private(t,t_left,i,x_left,x_right,x,y_left,y_right,y) shared(mask_,ts,nc,nt,ni,nodata) default(none)
+  alloc((void**)&all, nt, sizeof(int));
+  for (t=0; t<nt; t++) all[t] = t;
+
+  #pragma omp parallel private(t,k,nv,obs,i,x_left,x_right,x,y_left,y_right,y) shared(mask_,ts,nc,nt,ni,nodata,all) default(none)
   {
 
     #pragma omp for
@@ -101,46 +117,45 @@ float y_left, y_right, y;
       }
 
 
-      // interpolate for each equidistant timestep
-      for (i=0, t_left=0; i<ni; i++){
-
-        // current time
-        x = ts->d_tsi[i].ce;
-
-        x_left = x_right = INT_MIN;
-        y_left = y_right = nodata;
+      nv = series_obs(ts, p, nt, all, &obs);
 
-        // find previous and next point
-        for (t=t_left; t<nt; t++){
+      x_left = INT_MIN;
+      y_left = nodata;
 
-          if (ts->tss_[t][p] == nodata) continue;
+      // interpolate for each equidistant timestep
+      for (i=0, k=0; i<ni; i++){
 
-          if (ts->d_tss[t].ce < x){
-            x_left = ts->d_tss[t].ce;
-            y_left = ts->tss_[t][p];
-            t_left = t;
-          } else if (ts->d_tss[t].ce == x){
-            x_left = x_right = x;
-            y_left = y_right = ts->tss_[t][p];
-            t_left = t;
-            break;
-          } else if (ts->d_tss[t].ce > x){
-            x_right = ts->d_tss[t].ce;
-            y_right = ts->tss_[t][p];
-            break;
-          }
+        // current time
+        x = ts->ax_tsi.ce[i];
+
+        // move observations before current time to the left
+        while (k < nv){
+          t = obs[k];
+          if (ts->tss_[t][p] == nodata){ k++; continue; }
+          if (ts->ax_tss.ce[t] >= x) break;
+          x_left = ts->ax_tss.ce[t];
+          y_left = ts->tss_[t][p];
+          k++;
+        }
 
+        // next observation is on the right
+        if (k < nv){
+          x_right = ts->ax_tss.ce[obs[k]];
+          y_right = ts->tss_[obs[k]][p];
+        } else {
+          x_right = INT_MIN;
+          y_right = nodata;
         }
 
         // set nodata, copy value or interpolate
-        if (x_left < 0 && x_right < 0){
+        if (x_right == x){
+          y = y_right;
+        } else if (x_left < 0 && x_right < 0){
           y = nodata;
         } else if (x_left < 0){
           y = y_right;
         } else if (x_right < 0){
           y = y_left;
-        } else if (x_left == x_right){
-          y = (y_left+y_right)/2.0;
         } else {
           y = (y_left*(x_right-x) + y_right*(x-x_left))/(x_right-x_left);
         }
@@ -153,12 +168,44 @@ float y_left, y_right, y;
     
   }
 
+  free((void*)all);
+
 
   return SUCCESS;
 }
 
 
+/** This function returns the observations of a pixel that need to be 
++++ visited, i.e. the valid observations if the ARD were indexed (see 
++++ index_ard), or all observations otherwise. Observations that are not
++++ listed are nodata in the time series.
+--- ts:     pointer to instantly useable TSA image arrays
+--- p:      pixel
+--- nt:     number of time steps
+--- all:    all time steps, i.e. 0...nt-1
+--- obs:    observations (returned)
++++ Return: number of observations
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int series_obs(tsa_t *ts, int p, int nt, const int *all, const int **obs){
+
+
+  if (ts->valid == NULL){
+    *obs = all;
+    return nt;
+  }
+
+  *obs = ts->valid->idx + ts->valid->off[p];
+
+  return ts->valid->off[p+1] - ts->valid->off[p];
+}
+
+
 /** This function interpolates the time series using a moving average.
++++ The window is moved along the sorted interpolation steps with two 
++++ pointers: observations are added to a running sum when they enter the
++++ window, and subtracted when they leave it, i.e. each observation is 
++++ visited twice, O(nt+ni) per pixel. The sums are integers, thus the 
++++ running sum is exact.
 --- ts:     pointer to instantly useable TSA image arrays
 --- mask:   mask image
 --- nc:     number of cells
@@ -169,12 +216,17 @@ float y_left, y_right, y;
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int interpolate_moving(tsa_t *ts, small *mask_, int nc, int nt, int ni, short nodata, par_tsi_t *tsi){
-int t, t_left, i, p;
-float x, x_;
+int t, k_lo, k_hi, nv, i, p;
+float x;
 double sum, num;
+int *all = NULL;
+const int *obs = NULL;
+
 
+  alloc((void**)&all, nt, sizeof(int));
+  for (t=0; t<nt; t++) all[t] = t;
 
-  #pragma omp parallel private(t,t_left,i,x, x_,sum,num) shared(mask_,ts,nc,nt,ni,tsi,nodata) default(none)
+  #pragma omp parallel private(t,k_lo,k_hi,nv,obs,i,x,sum,num) shared(mask_,ts,nc,nt,ni,tsi,nodata,all) default(none)
   {
 
     #pragma omp for
@@ -186,31 +238,32 @@ double sum, num;
       }
 
 
-      // interpolate for each equidistant timestep
-      for (i=0, t_left=0; i<ni; i++){
+      nv = series_obs(ts, p, nt, all, &obs);
 
-        // current time
-        x = ts->d_tsi[i].ce;
+      sum = num = 0.0;
 
-        sum = num = 0.0;
+      // interpolate for each equidistant timestep
+      for (i=0, k_lo=0, k_hi=0; i<ni; i++){
 
-        // use all points within temporal window
-        for (t=t_left; t<nt; t++){
+        // current time
+        x = ts->ax_tsi.ce[i];
 
+        // add points that entered the temporal window
+        for (; k_hi<nv; k_hi++){
+          t = obs[k_hi];
           if (ts->tss_[t][p] == nodata) continue;
+          if (ts->ax_tss.ce[t]-x > tsi->mov_max) break;
+          sum += ts->tss_[t][p];
+          num++;
+        }
 
-          x_ = ts->d_tss[t].ce;
-
-          if (x-x_ > tsi->mov_max){ // earlier than window
-            t_left = t;
-            continue;
-          } else if (x_-x > tsi->mov_max){ // later than window
-            break;
-          } else { // in window
-            sum += ts->tss_[t][p]; 
-            num++;
-          }
-
+        // remove points that left the temporal window
+        for (; k_lo<k_hi; k_lo++){
+          t = obs[k_lo];
+          if (ts->tss_[t][p] == nodata) continue;
+          if (x-ts->ax_tss.ce[t] <= tsi->mov_max) break;
+          sum -= ts->tss_[t][p];
+          num--;
         }
 
         // interpolate with moving mean, or use nodata
@@ -226,6 +279,8 @@ double sum, num;
     
   }
 
+  free((void*)all);
+
 
   return SUCCESS;
 }
@@ -246,6 +301,11 @@ double sum, num;
 +++ basis functions. The ensembles are weighted according to data 
 +++ availability. The RBF interpolation was adpoted from the python 
 +++ routine 'RBF_fitting_large_scale.py', Copyright (C) 2018 Andreas Rabe
++++ The kernel windows only depend on the dates, thus they are rasterized
++++ once (see rbf_bank), and RBF_LANES pixels are interpolated together, 
++++ such that the accumulation vectorizes across pixels. For each pixel,
++++ the sums are accumulated in the same order as before, i.e. results do
++++ not depend on the number of lanes.
 --- ts:     pointer to instantly useable TSA image arrays
 --- mask:   mask image
 --- nc:     number of cells
@@ -256,106 +316,198 @@ double sum, num;
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int interpolate_rbf(tsa_t *ts, small *mask_, int nc, int nt, int ni, short nodata, par_tsi_t *tsi){
-int t, *t_left = NULL, i, k, p;
-int x, x_;
-float y;
+int i, k, e, l, nl, p0;
+const short *y_ = NULL;
+float w, y;
 double *sum_yw = NULL, *sum_w = NULL;
-double sum_kd, sum_d;
-rbf_t *rbf = NULL;
+double *sum_kd = NULL, *sum_d = NULL;
+rbf_bank_t *bank = NULL;
 
 
-  rbf = rbf_kernel(tsi);
+  bank = rbf_bank(ts, nt, ni, tsi);
 
-  #pragma omp parallel private(k,i,t,t_left,x, x_,sum_yw,sum_w,sum_kd,sum_d,y) shared(mask_,ts,nc,nt,ni,rbf,tsi,nodata) default(none)
+  #pragma omp parallel private(i,k,e,l,nl,y_,w,y,sum_yw,sum_w,sum_kd,sum_d) shared(mask_,ts,nc,ni,bank,nodata) default(none)
   {
 
-    alloc((void**)&t_left, rbf->nk, sizeof(int));
-    alloc((void**)&sum_yw, rbf->nk, sizeof(double));
-    alloc((void**)&sum_w,  rbf->nk, sizeof(double));
+    alloc((void**)&sum_yw, RBF_LANES, sizeof(double));
+    alloc((void**)&sum_w,  RBF_LANES, sizeof(double));
+    alloc((void**)&sum_kd, RBF_LANES, sizeof(double));
+    alloc((void**)&sum_d,  RBF_LANES, sizeof(double));
 
 
     #pragma omp for
-    for (p=0; p<nc; p++){
-
-      if (mask_ != NULL && !mask_[p]){
-        for (i=0; i<ni; i++) ts->tsi_[i][p] = nodata;
-        continue;
-      }
-
-      for (k=0; k<rbf->nk; k++) t_left[k] = 0;
+    for (p0=0; p0<nc; p0+=RBF_LANES){
 
+      nl = (nc-p0 < RBF_LANES) ? nc-p0 : RBF_LANES;
 
       // interpolate for each equidistant timestep
       for (i=0; i<ni; i++){
 
-        // current time
-        x = ts->d_tsi[i].ce;
+        for (l=0; l<nl; l++) sum_kd[l] = sum_d[l] = 0.0;
 
-        for (k=0; k<rbf->nk; k++){
+        for (k=0; k<bank->nk; k++){
 
-          sum_yw[k] = sum_w[k] = 0.0;
+          for (l=0; l<nl; l++) sum_yw[l] = sum_w[l] = 0.0;
 
           // use all points within temporal window
-          for (t=t_left[k]; t<nt; t++){
-
-            x_ = ts->d_tss[t].ce;
-
-            if (x-x_ > rbf->max_ce[k]){ // earlier than window
-              t_left[k] = t;
-              continue;
-            } else if (x_-x > rbf->max_ce[k]){ // later than window
-              break;
-            } else { // in window
-              if (ts->tss_[t][p] == nodata) continue;
-              sum_yw[k] += ts->tss_[t][p]*rbf->kernel[k][x_-x+rbf->hbin];
-              sum_w[k]  += rbf->kernel[k][x_-x+rbf->hbin];
+          for (e=bank->off[i*bank->nk+k]; e<bank->off[i*bank->nk+k]+bank->n[i*bank->nk+k]; e++){
+
+            y_ = ts->tss_[bank->t[e]] + p0;
+            w  = bank->w[e];
+
+            #pragma omp simd
+            for (l=0; l<nl; l++){
+              sum_yw[l] += (y_[l] != nodata) ? y_[l]*w : 0.0f;
+              sum_w[l]  += (y_[l] != nodata) ? w : 0.0f;
             }
 
           }
 
-        }
-
-        // compute weighted average + 
-        // weight the kernels with their data availability (weighted with 
-        //        the same kernel as the time series)
-        for (k=0, sum_kd=0, sum_d=0; k<rbf->nk; k++){
-          if (sum_w[k] > 0){
-            // weighted average * weighted data availability (weighted fractions of days)
-            // sum_kd += sum_yw[k]/sum_w[k] * sum_w[k]/max_w[k];
-            // this reduces to:
-            sum_kd += sum_yw[k]/rbf->max_w[k];
-            sum_d  += sum_w[k]/rbf->max_w[k];
+          // compute weighted average + 
+          // weight the kernels with their data availability (weighted with 
+          //        the same kernel as the time series)
+          // sum_kd += sum_yw[k]/sum_w[k] * sum_w[k]/max_w[k] reduces to:
+          #pragma omp simd
+          for (l=0; l<nl; l++){
+            if (sum_w[l] > 0){
+              sum_kd[l] += sum_yw[l]/bank->max_w[k];
+              sum_d[l]  += sum_w[l]/bank->max_w[k];
+            }
           }
+
         }
 
         // ensemble fit
-        if (sum_d > 0){
-          y = sum_kd/sum_d;
-        } else {
-          y = nodata;
+        for (l=0; l<nl; l++){
+          if (mask_ != NULL && !mask_[p0+l]){
+            ts->tsi_[i][p0+l] = nodata;
+          } else if (sum_d[l] > 0){
+            y = sum_kd[l]/sum_d[l];
+            ts->tsi_[i][p0+l] = (short)y;
+          } else {
+            ts->tsi_[i][p0+l] = nodata;
+          }
         }
 
-        ts->tsi_[i][p] = (short)y;
-
       }
       
     }
 
     // clean
-    free((void*)t_left);
     free((void*)sum_yw);
     free((void*)sum_w);
+    free((void*)sum_kd);
+    free((void*)sum_d);
     
   }
 
   
-  free_rbf(rbf);
+  free_rbf_bank(bank);
   
   
   return SUCCESS;
 }
 
 
+/** This function rasterizes the RBF kernels onto the dates of the time 
++++ series. For each interpolation step and kernel, the observations 
++++ within the kernel window are listed with their kernel weights, in the
++++ order they are visited by the window search, i.e. the bank is one 
++++ band of the convolution matrix per kernel. The bank only depends on
++++ the dates, and is shared by all pixels.
+--- ts:     pointer to instantly useable TSA image arrays
+--- nt:     number of time steps
+--- ni:     number of interpolation steps
+--- tsi:    interpolation parameters
++++ Return: RBF kernel bank (must be freed with free_rbf_bank)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+rbf_bank_t *rbf_bank(tsa_t *ts, int nt, int ni, par_tsi_t *tsi){
+rbf_t *rbf = NULL;
+rbf_bank_t *bank = NULL;
+int *t_left = NULL;
+int i, k, t, x, x_, size;
+
+
+  rbf = rbf_kernel(tsi);
+
+  alloc((void**)&bank, 1, sizeof(rbf_bank_t));
+  bank->nk = rbf->nk;
+  bank->ni = ni;
+
+  alloc((void**)&bank->off,   ni*rbf->nk, sizeof(int));
+  alloc((void**)&bank->n,     ni*rbf->nk, sizeof(int));
+  alloc((void**)&bank->max_w, rbf->nk,    sizeof(float));
+  for (k=0; k<rbf->nk; k++) bank->max_w[k] = rbf->max_w[k];
+
+  size = nt+1;
+  alloc((void**)&bank->t, size, sizeof(int));
+  alloc((void**)&bank->w, size, sizeof(float));
+
+  alloc((void**)&t_left, rbf->nk, sizeof(int));
+
+  for (i=0; i<ni; i++){
+
+    // current time
+    x = ts->ax_tsi.ce[i];
+
+    for (k=0; k<rbf->nk; k++){
+
+      bank->off[i*rbf->nk+k] = bank->len;
+
+      for (t=t_left[k]; t<nt; t++){
+
+        x_ = ts->ax_tss.ce[t];
+
+        if (x-x_ > rbf->max_ce[k]){ // earlier than window
+          t_left[k] = t;
+          continue;
+        } else if (x_-x > rbf->max_ce[k]){ // later than window
+          break;
+        } else { // in window
+          if (bank->len == size){
+            re_alloc((void**)&bank->t, size, size*2, sizeof(int));
+            re_alloc((void**)&bank->w, size, size*2, sizeof(float));
+            size *= 2;
+          }
+          bank->t[bank->len] = t;
+          bank->w[bank->len] = rbf->kernel[k][x_-x+rbf->hbin];
+          bank->len++;
+        }
+
+      }
+
+      bank->n[i*rbf->nk+k] = bank->len - bank->off[i*rbf->nk+k];
+
+    }
+
+  }
+
+  free((void*)t_left);
+  free_rbf(rbf);
+
+  return bank;
+}
+
+
+/** This function frees an RBF kernel bank.
+--- bank:   RBF kernel bank
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_rbf_bank(rbf_bank_t *bank){
+
+  if (bank == NULL) return;
+
+  free((void*)bank->off);
+  free((void*)bank->n);
+  free((void*)bank->t);
+  free((void*)bank->w);
+  free((void*)bank->max_w);
+  free((void*)bank);
+
+  return;
+}
+
+
 /** This function compiles the RBF kernels.
 --- tsi:    interpolation parameters
 +++ Return: RBF kernels (must be free with free_rbf)
@@ -441,27 +593,225 @@ void free_rbf(rbf_t *rbf){
 }
 
 
+/** This function computes the harmonic basis functions of one date. The
++++ trend term is given in decades relative to a reference date, such that
++++ all coefficients are in the units of the index, and can be stored as
++++ NRT state (see harmonic_predict).
+--- x:      basis (row of the design matrix)
+--- ce:     continuous days since epoch
+--- ce_ref: reference date (continuous days since epoch)
+--- ncoef:  number of coefficients
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void harmonic_basis(double *x, int ce, double ce_ref, int ncoef){
+
+
+  x[0] = 1.0;
+  x[1] = (ce - ce_ref) / 3652.5;
+  x[2] = cos(2 * M_PI / 365 * ce);
+  x[3] = sin(2 * M_PI / 365 * ce);
+  if (ncoef > 4) x[4] = cos(4 * M_PI / 365 * ce);
+  if (ncoef > 5) x[5] = sin(4 * M_PI / 365 * ce);
+  if (ncoef > 6) x[6] = cos(6 * M_PI / 365 * ce);
+  if (ncoef > 7) x[7] = sin(6 * M_PI / 365 * ce);
+
+  return;
+}
+
+
+/** This function compares the observation patterns of two pixels to be
++++ used with qsort. Pixels are ordered by number of observations, then
++++ by pattern signature, then by pixel index, such that pixels with the
++++ same pattern are neighbours.
+--- a:      observation pattern 1
+--- b:      observation pattern 2
++++ Return: -1, 0, 1
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int cmp_harm_pattern(const void *a, const void *b){
+const harm_pattern_t *pa = (const harm_pattern_t*)a;
+const harm_pattern_t *pb = (const harm_pattern_t*)b;
+
+
+  if (pa->nk   != pb->nk)   return (pa->nk   < pb->nk)   ? -1 : 1;
+  if (pa->hash != pb->hash) return (pa->hash < pb->hash) ? -1 : 1;
+  if (pa->p    != pb->p)    return (pa->p    < pb->p)    ? -1 : 1;
+
+  return 0;
+}
+
+
+/** This function tests whether two pixels have valid observations at 
++++ exactly the same dates within the fitting range
+--- ts:     pointer to instantly useable TSA image arrays
+--- fit:    date within fitting range?
+--- nt:     number of time steps
+--- p:      pixel 1
+--- q:      pixel 2
+--- nodata: nodata value
++++ Return: true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool same_harm_pattern(tsa_t *ts, bool *fit, int nt, int p, int q, short nodata){
+int t;
+
+
+  for (t=0; t<nt; t++){
+    if (!fit[t]) continue;
+    if ((ts->tss_[t][p] == nodata) != (ts->tss_[t][q] == nodata)) return false;
+  }
+
+  return true;
+}
+
+
+/** This function predicts the interpolated time series and the near-real
++++ time residuals of one pixel from its harmonic coefficients. If the NRT
++++ state should be output, the coefficients are stored, too.
+--- ts:     pointer to instantly useable TSA image arrays
+--- p:      pixel
+--- c:      harmonic coefficients
+--- x_tss:  basis functions of the observations
+--- x_tsi:  basis functions of the interpolation steps
+--- nt:     number of time steps
+--- ni:     number of interpolation steps
+--- ncoef:  number of coefficients
+--- nodata: nodata value
+--- tsi:    interpolation parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void harmonic_predict(tsa_t *ts, int p, gsl_vector *c, double **x_tss, double **x_tsi, int nt, int ni, int ncoef, short nodata, par_tsi_t *tsi){
+int i, t, k, j;
+double y_pred, v;
+gsl_vector_view x_pred;
+
+
+  // interpolate for each equidistant timestep
+  for (i=0; i<ni; i++){
+    x_pred = gsl_vector_view_array(x_tsi[i], ncoef);
+    gsl_blas_ddot(&x_pred.vector, c, &y_pred);
+    ts->tsi_[i][p] = (short)y_pred;
+  }
+
+
+  if (tsi->onrt){
+
+    for (t=0, k=0; t<nt; t++){
+
+      if (ts->ax_tss.ce[t] <= tsi->harm_fit_range[_MAX_].ce) continue;
+
+      if (ts->tss_[t][p] == nodata){
+
+        ts->nrt_[k][p] = (short)nodata;
+
+      } else {
+
+        x_pred = gsl_vector_view_array(x_tss[t], ncoef);
+        gsl_blas_ddot(&x_pred.vector, c, &y_pred);
+        ts->nrt_[k][p] = (short)(ts->tss_[t][p] - y_pred);
+
+      }
+
+      k++;
+
+    }
+
+  }
+
+
+  if (tsi->onst && ts->hcf_ != NULL){
+
+    for (j=0; j<ncoef; j++){
+      v = round(gsl_vector_get(c, j));
+      if (v < SHRT_MIN || v > SHRT_MAX || v == nodata) break;
+      ts->hcf_[j][p] = (short)v;
+    }
+
+    // coefficients that cannot be stored invalidate the model
+    if (j < ncoef){
+      for (j=0; j<ncoef; j++) ts->hcf_[j][p] = nodata;
+    }
+
+  }
+
+  return;
+}
+
+
+/** This function predicts the interpolated time series and the near-real
++++ time residuals from the harmonic coefficients of a previous run (NRT 
++++ state), i.e. without refitting the models. Only the new observations
++++ need to be read. Without state, nodata is predicted.
+--- ts:     pointer to instantly useable TSA image arrays
+--- mask:   mask image
+--- nc:     number of cells
+--- nt:     number of time steps
+--- ni:     number of interpolation steps
+--- nodata: nodata value
+--- tsi:    interpolation parameters
+--- ncoef:  number of coefficients
+--- x_tss:  basis functions of the observations
+--- x_tsi:  basis functions of the interpolation steps
++++ Return: SUCCESS
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int interpolate_harmonic_state(tsa_t *ts, small *mask_, int nc, int nt, int ni, short nodata, par_tsi_t *tsi, int ncoef, double **x_tss, double **x_tsi){
+int p, i, j, k;
+gsl_vector *c = NULL;
+
+
+  #pragma omp parallel private(i,j,k,c) shared(mask_,ts,nc,nt,ni,nodata,tsi,ncoef,x_tss,x_tsi) default(none)
+  {
+
+    c = gsl_vector_alloc(ncoef);
+
+    #pragma omp for
+    for (p=0; p<nc; p++){
+
+      if (ts->hcf_ == NULL || (mask_ != NULL && !mask_[p]) || ts->hcf_[0][p] == nodata){
+        for (i=0; i<ni; i++) ts->tsi_[i][p] = nodata;
+        if (tsi->onrt){
+          for (k=0; k<nt; k++){
+            if (ts->ax_tss.ce[k] > tsi->harm_fit_range[_MAX_].ce) break;
+          }
+          for (i=0; k<nt; k++, i++) ts->nrt_[i][p] = nodata;
+        }
+        continue;
+      }
+
+      for (j=0; j<ncoef; j++) gsl_vector_set(c, j, ts->hcf_[j][p]);
+
+      harmonic_predict(ts, p, c, x_tss, x_tsi, nt, ni, ncoef, nodata, tsi);
+
+    }
+
+    gsl_vector_free(c);
+
+  }
+
+  return SUCCESS;
+}
+
+
 int irls_fit(const gsl_matrix *X, const gsl_vector *y,
-             gsl_vector *c, gsl_matrix *cov){
+             gsl_vector *c, gsl_matrix *cov, gsl_multifit_robust_workspace *work){
 int s;
 
 
-  gsl_multifit_robust_workspace *work = 
-    gsl_multifit_robust_alloc(gsl_multifit_robust_bisquare, X->size1, X->size2);
-
   //gsl_multifit_robust_maxiter(1000, work);
 
   s = gsl_multifit_robust(X, y, c, cov, work);
 
   //if (s == GSL_EMAXITER) printf("max iter reached.\n");
 
-  gsl_multifit_robust_free(work);
-
   return s;
 }
 
 
-/** This function interpolates the time series using harmonic models
+/** This function interpolates the time series using harmonic models.
++++ The basis functions are computed once for all dates. Pixels are pro-
++++ cessed in blocks, and sorted by their valid-observation pattern, such
++++ that pixels with the same pattern share the design matrix, and all 
++++ pixels with the same number of observations share the robust fitting
++++ workspace. If the NRT state of a previous run is input, the models are
++++ not refitted (see interpolate_harmonic_state).
 --- ts:     pointer to instantly useable TSA image arrays
 --- mask:   mask image
 --- nc:     number of cells
@@ -472,11 +822,19 @@ int s;
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int interpolate_harmonic(tsa_t *ts, small *mask_, int nc, int nt, int nr, int ni, short nodata, par_tsi_t *tsi){
-int t, i, k, nk, p;
-int ncoef;
-double y_pred, y_err;
-gsl_matrix *x = NULL, *cov = NULL;
-gsl_vector *y = NULL, *c = NULL, *x_pred = NULL;
+int b, nb, j, n, np, g, t, i, k, nk, p, work_n;
+int ncoef, status = SUCCESS;
+bool same, *fit = NULL;
+unsigned long hash;
+double ce_ref;
+double **x_tss = NULL, **x_tsi = NULL;
+double *x_buf = NULL, *y_buf = NULL;
+harm_pattern_t *pattern = NULL;
+gsl_matrix *cov = NULL;
+gsl_vector *c = NULL;
+gsl_matrix_view x;
+gsl_vector_view y;
+gsl_multifit_robust_workspace *work = NULL;
 
 
   if ((ncoef = tsi->harm_nmodes*2 + 2) < 4){
@@ -487,132 +845,137 @@ gsl_vector *y = NULL, *c = NULL, *x_pred = NULL;
 
   gsl_set_error_handler_off();
 
-  #pragma omp parallel private(i,t,k,nk,x,cov,y,c,x_pred,y_pred,y_err) shared(mask_,ts,nc,nt,nr,ni,tsi,nodata,ncoef) default(none)
+  // basis functions, shared by all pixels; the trend is relative to the 
+  // center of the fitting range, which is the same in all runs that share
+  // the NRT state
+  alloc((void**)&fit, nt, sizeof(bool));
+  alloc_2D((void***)&x_tss, nt, ncoef, sizeof(double));
+  alloc_2D((void***)&x_tsi, ni, ncoef, sizeof(double));
+
+  ce_ref = 0.5*(tsi->harm_fit_range[_MIN_].ce + tsi->harm_fit_range[_MAX_].ce);
+
+  for (t=0; t<nt; t++){
+    harmonic_basis(x_tss[t], ts->ax_tss.ce[t], ce_ref, ncoef);
+    fit[t] = ts->ax_tss.ce[t] >= tsi->harm_fit_range[_MIN_].ce &&
+             ts->ax_tss.ce[t] <= tsi->harm_fit_range[_MAX_].ce;
+  }
+
+  for (i=0; i<ni; i++) harmonic_basis(x_tsi[i], ts->ax_tsi.ce[i], ce_ref, ncoef);
+
+  if (tsi->inst){
+    status = interpolate_harmonic_state(ts, mask_, nc, nt, ni, nodata, tsi, ncoef, x_tss, x_tsi);
+    free((void*)fit);
+    free_2D((void**)x_tss, nt);
+    free_2D((void**)x_tsi, ni);
+    gsl_set_error_handler(NULL);
+    return status;
+  }
+
+  nb = (nc + HARM_BLOCK - 1) / HARM_BLOCK;
+
+  #pragma omp parallel private(b,j,n,np,g,i,t,k,nk,p,same,hash,work_n,x,y,x_buf,y_buf,pattern,c,cov,work) shared(mask_,ts,nc,nt,nr,ni,nb,tsi,nodata,ncoef,fit,x_tss,x_tsi) default(none)
   {
 
+    alloc((void**)&x_buf, nt*ncoef, sizeof(double));
+    alloc((void**)&y_buf, nt, sizeof(double));
+    alloc((void**)&pattern, HARM_BLOCK, sizeof(harm_pattern_t));
     c = gsl_vector_alloc (ncoef);
     cov = gsl_matrix_alloc (ncoef, ncoef);
-    x_pred = gsl_vector_alloc(ncoef);
+    work = NULL;
+    work_n = 0;
 
     #pragma omp for
-    for (p=0; p<nc; p++){
+    for (b=0; b<nb; b++){
 
-      if (mask_ != NULL && !mask_[p]){
-        for (i=0; i<ni; i++) ts->tsi_[i][p] = nodata;
-        continue;
-      }
-
-      for (t=0, nk=0; t<nt; t++){
-
-        if (ts->tss_[t][p] == nodata || 
-            ts->d_tss[t].ce < tsi->harm_fit_range[_MIN_].ce ||
-            ts->d_tss[t].ce > tsi->harm_fit_range[_MAX_].ce){
-          continue;
-        } else {
-          nk++;
-        }
+      n = (b == nb-1) ? nc - b*HARM_BLOCK : HARM_BLOCK;
 
-      }
+      // observation pattern of each pixel in this block
+      for (j=0, np=0; j<n; j++){
 
-      //if (nk == 0){
-      if (nk < ncoef){
-        for (i=0; i<ni; i++) ts->tsi_[i][p] = nodata;
-        continue;
-      }
+        p = b*HARM_BLOCK + j;
 
-//printf("nk: %d\n", nk);
-      x = gsl_matrix_alloc(nk, ncoef);
-      y = gsl_vector_alloc(nk);
+        if (ts->hcf_ != NULL){
+          for (k=0; k<ncoef; k++) ts->hcf_[k][p] = nodata;
+        }
 
+        if (mask_ != NULL && !mask_[p]){
+          for (i=0; i<ni; i++) ts->tsi_[i][p] = nodata;
+          continue;
+        }
 
-      for (t=0, k=0; t<nt; t++){
+        for (t=0, nk=0, hash=14695981039346656037UL; t<nt; t++){
+          if (!fit[t] || ts->tss_[t][p] == nodata) continue;
+          hash = (hash ^ (unsigned long)t) * 1099511628211UL;
+          nk++;
+        }
 
-        if (ts->tss_[t][p] == nodata || 
-            ts->d_tss[t].ce < tsi->harm_fit_range[_MIN_].ce ||
-            ts->d_tss[t].ce > tsi->harm_fit_range[_MAX_].ce){
+        if (nk < ncoef){
+          for (i=0; i<ni; i++) ts->tsi_[i][p] = nodata;
           continue;
-        } else {
-          gsl_matrix_set(x, k, 0, 1.0);
-          gsl_matrix_set(x, k, 1, ts->d_tss[t].ce);
-          gsl_matrix_set(x, k, 2, cos(2 * M_PI / 365 * ts->d_tss[t].ce));
-          gsl_matrix_set(x, k, 3, sin(2 * M_PI / 365 * ts->d_tss[t].ce));
-          if (ncoef > 4) gsl_matrix_set(x, k, 4, cos(4 * M_PI / 365 * ts->d_tss[t].ce));
-          if (ncoef > 5) gsl_matrix_set(x, k, 5, sin(4 * M_PI / 365 * ts->d_tss[t].ce));
-          if (ncoef > 6) gsl_matrix_set(x, k, 6, cos(6 * M_PI / 365 * ts->d_tss[t].ce));
-          if (ncoef > 7) gsl_matrix_set(x, k, 7, sin(6 * M_PI / 365 * ts->d_tss[t].ce));
-          gsl_vector_set(y, k, ts->tss_[t][p]);
-          k++;
         }
 
+        pattern[np].p    = p;
+        pattern[np].nk   = nk;
+        pattern[np].hash = hash;
+        np++;
 
       }
 
-      // Iteratively Reweighted Least Squares (IRLS)
-      irls_fit(x, y, c, cov);
-
-      // interpolate for each equidistant timestep
-      for (i=0; i<ni; i++){
-
-        gsl_vector_set(x_pred, 0, 1.0);
-        gsl_vector_set(x_pred, 1, ts->d_tsi[i].ce);
-        gsl_vector_set(x_pred, 2, cos(2 * M_PI / 365 * ts->d_tsi[i].ce));
-        gsl_vector_set(x_pred, 3, sin(2 * M_PI / 365 * ts->d_tsi[i].ce));
-        if (ncoef > 4) gsl_vector_set(x_pred, 4, cos(4 * M_PI / 365 * ts->d_tsi[i].ce));
-        if (ncoef > 5) gsl_vector_set(x_pred, 5, sin(4 * M_PI / 365 * ts->d_tsi[i].ce));
-        if (ncoef > 6) gsl_vector_set(x_pred, 6, cos(6 * M_PI / 365 * ts->d_tsi[i].ce));
-        if (ncoef > 7) gsl_vector_set(x_pred, 7, sin(6 * M_PI / 365 * ts->d_tsi[i].ce));
+      qsort(pattern, np, sizeof(harm_pattern_t), cmp_harm_pattern);
 
-        gsl_multifit_robust_est(x_pred, c, cov, &y_pred, &y_err);
-        ts->tsi_[i][p] = (short)y_pred;
 
-      }
+      for (g=0; g<np; g++){
 
+        p  = pattern[g].p;
+        nk = pattern[g].nk;
 
-      if (tsi->onrt){
+        same = g > 0 && 
+               pattern[g-1].nk   == nk && 
+               pattern[g-1].hash == pattern[g].hash &&
+               same_harm_pattern(ts, fit, nt, pattern[g-1].p, p, nodata);
 
         for (t=0, k=0; t<nt; t++){
 
-          if (ts->d_tss[t].ce <= tsi->harm_fit_range[_MAX_].ce) continue;
-
-          if (ts->tss_[t][p] == nodata){
-
-            ts->nrt_[k][p] = (short)nodata;
+          if (!fit[t] || ts->tss_[t][p] == nodata) continue;
 
-          } else {
+          if (!same) memcpy(x_buf + k*ncoef, x_tss[t], ncoef*sizeof(double));
+          y_buf[k] = ts->tss_[t][p];
+          k++;
 
-            gsl_vector_set(x_pred, 0, 1.0);
-            gsl_vector_set(x_pred, 1, ts->d_tss[t].ce);
-            gsl_vector_set(x_pred, 2, cos(2 * M_PI / 365 * ts->d_tss[t].ce));
-            gsl_vector_set(x_pred, 3, sin(2 * M_PI / 365 * ts->d_tss[t].ce));
-            if (ncoef > 4) gsl_vector_set(x_pred, 4, cos(4 * M_PI / 365 * ts->d_tss[t].ce));
-            if (ncoef > 5) gsl_vector_set(x_pred, 5, sin(4 * M_PI / 365 * ts->d_tss[t].ce));
-            if (ncoef > 6) gsl_vector_set(x_pred, 6, cos(6 * M_PI / 365 * ts->d_tss[t].ce));
-            if (ncoef > 7) gsl_vector_set(x_pred, 7, sin(6 * M_PI / 365 * ts->d_tss[t].ce));
+        }
 
-            gsl_multifit_robust_est(x_pred, c, cov, &y_pred, &y_err);
-            ts->nrt_[k][p] = (short)(ts->tss_[t][p] - y_pred);
+        // robust workspace depends on the number of observations
+        if (nk != work_n){
+          if (work != NULL) gsl_multifit_robust_free(work);
+          work = gsl_multifit_robust_alloc(gsl_multifit_robust_bisquare, nk, ncoef);
+          work_n = nk;
+        }
 
-          }
+        x = gsl_matrix_view_array(x_buf, nk, ncoef);
+        y = gsl_vector_view_array(y_buf, nk);
 
-          k++;
+        // Iteratively Reweighted Least Squares (IRLS)
+        irls_fit(&x.matrix, &y.vector, c, cov, work);
 
-        }
+        harmonic_predict(ts, p, c, x_tss, x_tsi, nt, ni, ncoef, nodata, tsi);
 
       }
 
-      
-
-      gsl_matrix_free (x);
-      gsl_vector_free (y);
-
     }
 
+    if (work != NULL) gsl_multifit_robust_free(work);
     gsl_vector_free (c);
     gsl_matrix_free (cov);
-    gsl_vector_free (x_pred);
+    free((void*)x_buf);
+    free((void*)y_buf);
+    free((void*)pattern);
 
   }
 
+  free((void*)fit);
+  free_2D((void**)x_tss, nt);
+  free_2D((void**)x_tsi, ni);
+
   gsl_set_error_handler(NULL);
   
   return SUCCESS;
@@ -665,3 +1028,45 @@ int tsa_interpolation(tsa_t *ts, small *mask_, int nc, int nt, int nr, int ni, s
   return SUCCESS;
 }
 
+
+/** This function interpolates one temporal window of the time series, 
++++ i.e. the interpolation steps i0...i0+nw-1, from all observations. The
++++ window is interpolated into tsi_, instead of the TSI brick, such that
++++ only nw steps are held in memory. Only LINEAR, MOVING and RBF are sup-
++++ ported, as they only depend on the dates of each step.
+--- ts:     pointer to instantly useable TSA image arrays
+--- mask:   mask image
+--- nc:     number of cells
+--- nt:     number of time steps
+--- i0:     first interpolation step of the window
+--- nw:     number of interpolation steps in the window
+--- nodata: nodata value
+--- tsi:    interpolation parameters
+--- tsi_:   interpolated window (nw x nc)
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int interpolate_window(tsa_t *ts, small *mask_, int nc, int nt, int i0, int nw, short nodata, par_tsi_t *tsi, short **tsi_){
+tsa_t win = *ts;
+
+
+  // shallow copy, shifted to the window
+  win.tsi_ = tsi_;
+  win.ax_tsi.ce = ts->ax_tsi.ce + i0;
+
+  switch (tsi->method){
+    case _INT_LINEAR_:
+      interpolate_linear(&win, mask_, nc, nt, nw, nodata);
+      break;
+    case _INT_MOVING_:
+      interpolate_moving(&win, mask_, nc, nt, nw, nodata, tsi);
+      break;
+    case _INT_RBF_:
+      if (i0 == 0) cite_me(_CITE_RBF_);
+      interpolate_rbf(&win, mask_, nc, nt, nw, nodata, tsi);
+      break;
+    default:
+      return CANCEL;
+  }
+
+  return SUCCESS;
+}
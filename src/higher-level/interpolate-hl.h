@@ -30,6 +30,8 @@ Time series interpolation header
 
 #include <stdio.h>   // core input and output functions
 #include <stdlib.h>  // standard general utilities library
+#include <math.h>    // common mathematical functions
+#include <limits.h>  // macro constants of the integer types
 
 #include "../cross-level/cite-cl.h"
 #include "../higher-level/param-hl.h"
@@ -49,7 +51,35 @@ typedef struct {
   float   *max_w;
 } rbf_t;
 
+// RBF kernels, rasterized onto the dates of a time series, i.e. the bands
+// of the convolution matrix: for each interpolation step and kernel, the
+// observations within the kernel window, and their weights
+typedef struct {
+  int    nk;       // number of kernels
+  int    ni;       // number of interpolation steps
+  int    len;      // number of entries
+  int   *off;      // first entry of step i and kernel k, at [i*nk+k]
+  int   *n;        // number of entries of step i and kernel k
+  int   *t;        // observation of entry
+  float *w;        // kernel weight of entry
+  float *max_w;    // max. weight of each kernel
+} rbf_bank_t;
+
+// number of pixels that are interpolated together (SIMD lanes)
+#define RBF_LANES 64
+
+// number of pixels that are sorted by observation pattern for harmonic fitting
+#define HARM_BLOCK 256
+
+typedef struct {
+  int p, nk;          // pixel, number of observations
+  unsigned long hash; // signature of the valid-observation pattern
+} harm_pattern_t;
+
 int tsa_interpolation(tsa_t *ts, small *mask_, int nc, int nt, int nr, int ni, short nodata, par_tsi_t *tsi);
+int interpolate_window(tsa_t *ts, small *mask_, int nc, int nt, int i0, int nw, short nodata, par_tsi_t *tsi, short **tsi_);
+rbf_bank_t *rbf_bank(tsa_t *ts, int nt, int ni, par_tsi_t *tsi);
+void free_rbf_bank(rbf_bank_t *bank);
 
 #ifdef __cplusplus
 }
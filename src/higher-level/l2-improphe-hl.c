@@ -165,7 +165,7 @@ float *hr_tex_ = NULL;
 float **mr_tex_ = NULL;
 short **seasonal_avg_ = NULL;
 int nprod = 0;
-int t, i, j, p, b, nx, ny, nc, nb_hr, nb_mr, npc;
+int t, p, b, nx, ny, nc, nb_hr, nb_mr, npc;
 short nodata;
 float **KDIST = NULL; // kernel distance
 int width, nk, mink; // number of kernel pixels, and minimum number of pixels for good prediction
@@ -304,24 +304,8 @@ bool is_empty;
         return NULL;}
     }
 
-    #pragma omp parallel private(p) shared(hr_,hr_tex_,mr_,mr_tex_,l2i,t,ny,nx,npc,nb_mr,nodata,KDIST,nk,mink,phl) default(none)
-    {
-
-      #pragma omp for collapse(2) schedule(guided)
-      for (i=0; i<ny; i++){
-      for (j=0; j<nx; j++){
-
-        p = i*nx+j;
-
-        if (mr_[0][p] == nodata) continue;
-
-        improphe(hr_, hr_tex_, mr_, mr_tex_, l2i.imp_[t], KDIST, nodata, nodata, i, j, p, 
-          nx, ny, phl->imp.ksize, npc, nb_mr, nk, mink);
-
-      }
-      }
-
-    }
+    improphe(hr_, hr_tex_, mr_, mr_tex_, l2i.imp_[t], KDIST, nodata, nodata, 
+      nx, ny, phl->imp.ksize, npc, nb_mr, nk, mink);
     
     free_2D((void**)mr_,     nb_mr);
     free_2D((void**)mr_tex_, nb_mr);
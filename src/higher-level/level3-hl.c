@@ -28,15 +28,19 @@ This file contains functions for Level 3 processing
 #include "level3-hl.h"
 
 
-brick_t *compile_level3_brick(brick_t *ard, int nb, bool explode, bool fullres, char *prodname, par_hl_t *phl);
+brick_t *compile_level3_brick(brick_t *ard, int nb, bool explode, bool fullres, char *prodname, int k, par_hl_t *phl);
+enum { _aux_qai_, _aux_dst_, _aux_hot_, _aux_vzn_ };
+
 brick_t **compile_level3(ard_t *ard, level3_t *l3, par_hl_t *phl, cube_t *cube, int *nproduct);
+gpu_brick_t **upload_level3_aux(ard_t *ard, int nt, int type, const short **ptr, gpu_stream_t stream);
+int level3_device(ard_t *ard, level3_t *l3, brick_t *mask, int nt, int nb, int nc, short nodata, par_hl_t *phl);
 
 
 /** This function compiles the bricks, in which L3 results are stored. 
 +++ It also sets metadata and sets pointers to instantly useable image 
-+++ arrays.
++++ arrays. One set of products is compiled for each target.
 --- ard:      ARD
---- l3:       pointer to instantly useable L3 image arrays
+--- l3:       pointer to instantly useable L3 image arrays (one per target)
 --- phl:      HL parameters
 --- cube:     datacube definition
 --- nproduct: number of output bricks (returned)
@@ -45,7 +49,7 @@ brick_t **compile_level3(ard_t *ard, level3_t *l3, par_hl_t *phl, cube_t *cube,
 brick_t **compile_level3(ard_t *ard, level3_t *l3, par_hl_t *phl, cube_t *cube, int *nproduct){
 brick_t **LEVEL3 = NULL;
 int b, nb, nbands;
-int o, nprod = 4;
+int k, o, p, nprod;
 int error = 0;
 enum { _ref_, _inf_, _scr_, _ovv_ };
 char prodname[4][NPOW_02] = { "BAP", "INF", "SCR", "OVV" };
@@ -54,45 +58,55 @@ bool explode[4] = { false, phl->explode, phl->explode, false };
 int prodlen[4] = { 0, _INF_LENGTH_, _SCR_LENGTH_, _RGB_LENGTH_ };
 int prodtype[4] = { _ref_, _inf_, _scr_, _ovv_ };
 bool enable[4] = { phl->bap.obap, phl->bap.oinf, phl->bap.oscr, phl->bap.oovv };
-short ***ptr[4] = { &l3->bap, &l3->inf, &l3->scr, &l3->ovv };
+short ***ptr[4];
 
   nb = get_brick_nbands(ard[0].DAT);
+  nprod = 4*phl->bap.ntarget;
 
   alloc((void**)&LEVEL3, nprod, sizeof(brick_t*));
 
 
-  for (o=0; o<nprod; o++){
-    if (enable[o]){
-      if ((nbands = prodlen[o]) == 0) nbands = nb;
-      if ((LEVEL3[o] = compile_level3_brick(ard[0].DAT, nbands, explode[o], fullres[o], prodname[o], phl)) == NULL || (  *ptr[o] = get_bands_short(LEVEL3[o])) == NULL){
-        printf("Error compiling %s product. ", prodname[o]); error++;
-      } else {
-        for (b=0; b<prodlen[prodtype[o]]; b++){
-          switch (prodtype[o]){
-            case _ref_:
-              break;
-            case _inf_:
-              set_brick_domain(LEVEL3[o], b, _TAGGED_ENUM_INF_[b].tag);
-              set_brick_bandname(LEVEL3[o], b, _TAGGED_ENUM_INF_[b].tag);
-              break;
-            case _scr_:
-              set_brick_domain(LEVEL3[o], b, _TAGGED_ENUM_SCR_[b].tag);
-              set_brick_bandname(LEVEL3[o], b, _TAGGED_ENUM_SCR_[b].tag);
-              break;
-            case _ovv_:
-              set_brick_domain(LEVEL3[o], b, _TAGGED_ENUM_RGB_[b].tag);
-              set_brick_bandname(LEVEL3[o], b, _TAGGED_ENUM_RGB_[b].tag);
-              break;
-            default:
-              printf("unknown level3 type.\n"); error++;
-              break;
+  for (k=0, p=0; k<phl->bap.ntarget; k++){
+
+    ptr[_ref_] = &l3[k].bap;
+    ptr[_inf_] = &l3[k].inf;
+    ptr[_scr_] = &l3[k].scr;
+    ptr[_ovv_] = &l3[k].ovv;
+
+    for (o=0; o<4; o++, p++){
+      if (enable[o]){
+        if ((nbands = prodlen[o]) == 0) nbands = nb;
+        if ((LEVEL3[p] = compile_level3_brick(ard[0].DAT, nbands, explode[o], fullres[o], prodname[o], k, phl)) == NULL || (  *ptr[o] = get_bands_short(LEVEL3[p])) == NULL){
+          printf("Error compiling %s product. ", prodname[o]); error++;
+        } else {
+          for (b=0; b<prodlen[prodtype[o]]; b++){
+            switch (prodtype[o]){
+              case _ref_:
+                break;
+              case _inf_:
+                set_brick_domain(LEVEL3[p], b, _TAGGED_ENUM_INF_[b].tag);
+                set_brick_bandname(LEVEL3[p], b, _TAGGED_ENUM_INF_[b].tag);
+                break;
+              case _scr_:
+                set_brick_domain(LEVEL3[p], b, _TAGGED_ENUM_SCR_[b].tag);
+                set_brick_bandname(LEVEL3[p], b, _TAGGED_ENUM_SCR_[b].tag);
+                break;
+              case _ovv_:
+                set_brick_domain(LEVEL3[p], b, _TAGGED_ENUM_RGB_[b].tag);
+                set_brick_bandname(LEVEL3[p], b, _TAGGED_ENUM_RGB_[b].tag);
+                break;
+              default:
+                printf("unknown level3 type.\n"); error++;
+                break;
+            }
           }
         }
+      } else {
+        LEVEL3[p] = NULL;
+        *ptr[o]   = NULL;
       }
-    } else {
-      LEVEL3[o] = NULL;
-      *ptr[o]   = NULL;
     }
+
   }
   
   if (error > 0){
@@ -110,10 +124,11 @@ short ***ptr[4] = { &l3->bap, &l3->inf, &l3->scr, &l3->ovv };
 --- from:      brick from which most attributes are copied
 --- nb:        number of bands in brick
 --- prodname:  product name
+--- k:         target
 --- phl:       HL parameters
 +++ Return:    brick for L3 result
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-brick_t *compile_level3_brick(brick_t *from, int nb, bool explode, bool fullres, char *prodname, par_hl_t *phl){
+brick_t *compile_level3_brick(brick_t *from, int nb, bool explode, bool fullres, char *prodname, int k, par_hl_t *phl){
 int b, m, d;
 brick_t *brick = NULL;
 date_t date;
@@ -125,9 +140,9 @@ int nx, ny, nx_, ny_;
 int cx, cy, cx_, cy_, cc_; 
 
 
-  if (phl->bap.score_type == _SCR_TYPE_SIG_DES_) doy2md(phl->bap.Dt[0], &m, &d);
-  if (phl->bap.score_type == _SCR_TYPE_GAUSS_)   doy2md(phl->bap.Dt[1], &m, &d);
-  if (phl->bap.score_type == _SCR_TYPE_SIG_ASC_) doy2md(phl->bap.Dt[2], &m, &d);
+  if (phl->bap.score_type == _SCR_TYPE_SIG_DES_) doy2md(phl->bap.Dt[k*3+0], &m, &d);
+  if (phl->bap.score_type == _SCR_TYPE_GAUSS_)   doy2md(phl->bap.Dt[k*3+1], &m, &d);
+  if (phl->bap.score_type == _SCR_TYPE_SIG_ASC_) doy2md(phl->bap.Dt[k*3+2], &m, &d);
   
   date.year = phl->bap.Yt;
   date.month = m;
@@ -200,6 +215,208 @@ int cx, cy, cx_, cy_, cc_;
 }
 
 
+/** This function copies one auxiliary ARD product (QAI, DST, HOT, VZN)
++++ of all dates to the device.
+--- ard:    ARD
+--- nt:     number of ARD products over time
+--- type:   product (_aux_qai_, _aux_dst_, _aux_hot_, _aux_vzn_)
+--- ptr:    device pointers of the products (returned)
+--- stream: stream of the processing unit
++++ Return: device copies (or NULL)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+gpu_brick_t **upload_level3_aux(ard_t *ard, int nt, int type, const short **ptr, gpu_stream_t stream){
+gpu_brick_t **AUX = NULL;
+brick_t *from = NULL;
+int t;
+
+
+  alloc((void**)&AUX, nt, sizeof(gpu_brick_t*));
+
+  for (t=0; t<nt; t++){
+
+    switch (type){
+      case _aux_qai_: from = ard[t].QAI; break;
+      case _aux_dst_: from = ard[t].DST; break;
+      case _aux_hot_: from = ard[t].HOT; break;
+      case _aux_vzn_: from = ard[t].VZN; break;
+      default:        from = NULL;       break;
+    }
+
+    if (from == NULL ||
+       (AUX[t] = allocate_gpu_brick(from, stream)) == NULL ||
+        upload_brick(from, AUX[t]) == FAILURE){
+      gpu_sync(stream);
+      for (t=0; t<nt; t++) free_gpu_brick(AUX[t]);
+      free((void*)AUX);
+      return NULL;
+    }
+
+    ptr[t] = (const short*)get_gpu_band(AUX[t], 0);
+
+  }
+
+  return AUX;
+}
+
+
+/** This function runs the BAP scoring and selection on the GPU. The ARD
++++ was copied to the device by the read stage; the masks and auxiliary
++++ products are copied here, once for all targets. The temporal scores 
++++ are computed on the host, as they only depend on the date with a 
++++ static target. Phenology-adaptive compositing is left to the CPU.
+--- ard:    ARD
+--- l3:     pointer to instantly useable L3 image arrays (one per target)
+--- mask:   mask image
+--- nt:     number of ARD products over time
+--- nb:     number of bands
+--- nc:     number of cells
+--- nodata: nodata value
+--- phl:    HL parameters
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int level3_device(ard_t *ard, level3_t *l3, brick_t *mask, int nt, int nb, int nc, short nodata, par_hl_t *phl){
+bap_gpu_t job;
+gpu_brick_t **MSK = NULL, **QAI = NULL, **DST = NULL, **HOT = NULL, **VZN = NULL;
+gpu_brick_t *PMASK = NULL;
+gpu_stream_t stream;
+target_t *target = NULL;
+par_scr_t score;
+int k, t, status = SUCCESS;
+
+
+  if (!phl->gpu || phl->bap.pac.lsp) return CANCEL;
+
+  if (l3->bap == NULL && l3->inf == NULL && l3->scr == NULL) return CANCEL;
+
+  for (t=0; t<nt; t++){
+    if (ard[t].GPU == NULL || ard[t].MSK == NULL) return CANCEL;
+  }
+
+
+  memset(&job, 0, sizeof(bap_gpu_t));
+  job.nc     = nc;
+  job.nt     = nt;
+  job.nb     = nb;
+  job.stride = get_brick_stride(ard[0].DAT);
+  job.nodata = nodata;
+  job.w      = phl->bap.w;
+  job.dreq   = phl->bap.dreq;
+  job.vreq   = phl->bap.vreq;
+  job.offsea = phl->bap.offsea;
+  job.sw2    = find_domain(ard[0].DAT, "SWIR2");
+  job.nir    = find_domain(ard[0].DAT, "NIR");
+  job.scale  = get_brick_scale(ard[0].DAT, 0);
+
+  alloc((void**)&job.score_d, nt, sizeof(float));
+  alloc((void**)&job.score_y, nt, sizeof(float));
+  alloc((void**)&job.tdist,   nt, sizeof(int));
+  alloc((void**)&job.valid,   nt, sizeof(small));
+  alloc((void**)&job.doy,     nt, sizeof(int));
+  alloc((void**)&job.year,    nt, sizeof(int));
+  alloc((void**)&job.sensor,  nt, sizeof(int));
+
+  for (t=0; t<nt; t++){
+    job.doy[t]     = get_brick_doy(ard[t].DAT, 0);
+    job.year[t]    = get_brick_year(ard[t].DAT, 0);
+    job.sensor[t]  = get_brick_sensorid(ard[t].DAT)+1;
+  }
+
+
+  // the masks are final after screening, copy them in the ARD stream,
+  // i.e. to the device that holds the ARD of this unit
+  stream = ard[0].GPU->stream;
+
+  alloc((void**)&job.ard, nt, sizeof(short*));
+  alloc((void**)&job.msk, nt, sizeof(small*));
+  alloc((void**)&job.qai, nt, sizeof(short*));
+  if (phl->bap.w.c > 0) alloc((void**)&job.dst, nt, sizeof(short*));
+  if (phl->bap.w.h > 0) alloc((void**)&job.hot, nt, sizeof(short*));
+  if (phl->bap.w.v > 0) alloc((void**)&job.vzn, nt, sizeof(short*));
+  alloc((void**)&MSK, nt, sizeof(gpu_brick_t*));
+
+  for (t=0; t<nt && status == SUCCESS; t++){
+    if ((MSK[t] = allocate_gpu_brick(ard[t].MSK, stream)) == NULL ||
+        upload_brick(ard[t].MSK, MSK[t]) == FAILURE){
+      status = FAILURE; break;}
+    job.ard[t] = (const short*)get_gpu_band(ard[t].GPU, 0);
+    job.msk[t] = (const small*)get_gpu_band(MSK[t], 0);
+  }
+
+  if (status == SUCCESS &&
+      (QAI = upload_level3_aux(ard, nt, _aux_qai_, job.qai, stream)) == NULL) status = FAILURE;
+  if (status == SUCCESS && job.dst != NULL &&
+      (DST = upload_level3_aux(ard, nt, _aux_dst_, job.dst, stream)) == NULL) status = FAILURE;
+  if (status == SUCCESS && job.hot != NULL &&
+      (HOT = upload_level3_aux(ard, nt, _aux_hot_, job.hot, stream)) == NULL) status = FAILURE;
+  if (status == SUCCESS && job.vzn != NULL &&
+      (VZN = upload_level3_aux(ard, nt, _aux_vzn_, job.vzn, stream)) == NULL) status = FAILURE;
+
+  if (status == SUCCESS && mask != NULL){
+    if ((PMASK = allocate_gpu_brick(mask, stream)) == NULL ||
+        upload_brick(mask, PMASK) == FAILURE){
+      status = FAILURE;
+    } else {
+      job.mask = (const small*)get_gpu_band(PMASK, 0);
+    }
+  }
+
+  // scoring and selection for each target, the device copies are shared
+  for (k=0; k<phl->bap.ntarget && status == SUCCESS; k++){
+
+    job.bap = (l3[k].bap != NULL) ? l3[k].bap[0] : NULL;
+    job.inf = (l3[k].inf != NULL) ? l3[k].inf[0] : NULL;
+    job.scr = (l3[k].scr != NULL) ? l3[k].scr[0] : NULL;
+
+    // temporal scores of each date
+    target = compile_target_static(&phl->bap, k);
+
+    for (t=0; t<nt; t++){
+      job.valid[t]   = temporal_score(get_brick_ce(ard[t].DAT, 0), get_brick_year(ard[t].DAT, 0), 
+                         target, &score, &job.tdist[t], &phl->bap);
+      job.score_d[t] = score.d;
+      job.score_y[t] = score.y;
+    }
+
+    free((void*)target);
+
+    status = bap_gpu(&job, stream);
+
+  }
+
+  if (status != SUCCESS) gpu_sync(stream);
+
+
+  for (t=0; t<nt; t++){
+    free_gpu_brick(MSK[t]);
+    if (QAI != NULL) free_gpu_brick(QAI[t]);
+    if (DST != NULL) free_gpu_brick(DST[t]);
+    if (HOT != NULL) free_gpu_brick(HOT[t]);
+    if (VZN != NULL) free_gpu_brick(VZN[t]);
+  }
+  free_gpu_brick(PMASK);
+  free((void*)MSK);
+  free((void*)QAI);
+  free((void*)DST);
+  free((void*)HOT);
+  free((void*)VZN);
+  free((void*)job.ard);
+  free((void*)job.msk);
+  free((void*)job.qai);
+  free((void*)job.dst);
+  free((void*)job.hot);
+  free((void*)job.vzn);
+  free((void*)job.score_d);
+  free((void*)job.score_y);
+  free((void*)job.tdist);
+  free((void*)job.valid);
+  free((void*)job.doy);
+  free((void*)job.year);
+  free((void*)job.sensor);
+
+  return status;
+}
+
+
 /** public functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
@@ -216,18 +433,20 @@ int cx, cy, cx_, cy_, cc_;
 +++ Return:    bricks with L3 results
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 brick_t **level3(ard_t *ard, ard_t *lsp, brick_t *mask, int nt, int nlsp, par_hl_t *phl, cube_t *cube, int *nproduct){
-level3_t l3;
+level3_t *l3 = NULL;
 brick_t **LEVEL3;
 small *mask_ = NULL;
 int nprod = 0;
-int p, nx, ny, nc, nb;
+int k, p, nx, ny, nc, nb;
 double res;
 short nodata;
 short lsp_nodata = SHRT_MIN;
-target_t *target = NULL;
+target_t **target = NULL;
+target_cache_t *cache = NULL;
 int *tdist = NULL;
 par_scr_t *score = NULL;
 float **cor = NULL;
+double *z = NULL;
 float hmean, hsd;
 bool water;
 
@@ -240,13 +459,18 @@ bool water;
     return NULL;
   }
   
-  // compile products + bricks
-  if ((LEVEL3 = compile_level3(ard, &l3, phl, cube, &nprod)) == NULL || nprod == 0){
+  // compile products + bricks, one set per target
+  alloc((void**)&l3, phl->bap.ntarget, sizeof(level3_t));
+
+  if ((LEVEL3 = compile_level3(ard, l3, phl, cube, &nprod)) == NULL || nprod == 0){
     printf("Unable to compile L3 products!\n"); 
+    free((void*)l3);
     *nproduct = 0;
     return NULL;
   }
 
+  lap_profile("bap_compile");
+
 
   // import bricks
   nx  = get_brick_chunkncols(ard[0].DAT);
@@ -272,15 +496,36 @@ bool water;
   }
 
 
-  #pragma omp parallel private(tdist,score,cor,hmean,hsd,water) firstprivate(target) shared(ard,lsp,l3,nt,nb,nc,lsp_nodata,nodata,mask_,phl,LEVEL3) default(none)
+  // scoring and selection on the GPU if possible, otherwise on the CPU
+  if (level3_device(ard, l3, mask, nt, nb, nc, nodata, phl) == SUCCESS){
+    lap_profile("bap_device");
+    for (k=0; k<phl->bap.ntarget; k++) bap_overview(&l3[k], nx, ny, nb, res, nodata);
+    lap_profile("bap_overview");
+    free((void*)l3);
+    *nproduct = nprod;
+    return LEVEL3;
+  }
+
+
+  #pragma omp parallel private(k,tdist,score,cor,z,hmean,hsd,water,target,cache) shared(ard,lsp,l3,nt,nb,nc,lsp_nodata,nodata,mask_,phl,LEVEL3) default(none)
   {
 
-    if (phl->bap.w.r > 0) alloc_2D((void***)&cor, nt, nt, sizeof(float));
+    // the correlation matrix is only needed if it is scored
+    if (phl->bap.w.r > 0){
+      alloc_2D((void***)&cor, nt, nt, sizeof(float));
+      alloc((void**)&z, (size_t)nt*(nb+1), sizeof(double));
+    }
     alloc((void**)&tdist, nt, sizeof(int));
     alloc((void**)&score,  nt, sizeof(par_scr_t));
 
-    // static target
-    if (!phl->bap.pac.lsp) target = compile_target_static(&phl->bap);
+    // static targets
+    alloc((void**)&target, phl->bap.ntarget, sizeof(target_t*));
+    if (!phl->bap.pac.lsp){
+      for (k=0; k<phl->bap.ntarget; k++) target[k] = compile_target_static(&phl->bap, k);
+    }
+
+    // adaptive targets, reused for same phenology
+    cache = (phl->bap.pac.lsp) ? allocate_target_cache(&phl->bap, lsp) : NULL;
 
     #pragma omp for
     for (p=0; p<nc; p++){
@@ -288,40 +533,59 @@ bool water;
       // skip pixels that are masked
       if (mask_ != NULL && !mask_[p]) continue;
       
-      if (phl->bap.pac.lsp) target = compile_target_adaptive(&phl->bap, lsp, p, lsp_nodata);
+      if (phl->bap.pac.lsp) target[0] = compile_target_adaptive(&phl->bap, lsp, p, lsp_nodata, cache);
 
       // water or land pixel?
       water = pixel_is_water(ard, nt, p);
 
       // compute correlation matrix
-      if (phl->bap.w.r > 0) corr_matrix(ard, nt, nb, p, cor);
+      if (phl->bap.w.r > 0) corr_matrix(ard, nt, nb, p, z, cor);
 
-      // compute parametric scores
-      parametric_score(ard, nt, p, target, cor, score, tdist, &phl->bap);
+      // compute auxilliary scores, these are shared by all targets
+      auxiliary_score(ard, nt, p, cor, score, &phl->bap);
 
-      // override total score in case of water
-      if (water) water_score(ard, nt, p, score);
+      for (k=0; k<phl->bap.ntarget; k++){
 
-      // mean and sd of haze score
-      haze_stats(ard, nt, p, score, &phl->bap, &hmean, &hsd);
+        // compute parametric scores
+        parametric_score(ard, nt, p, target[k], score, tdist, &phl->bap);
 
-      // compute BAP
-      bap_compositing(ard, &l3, nt, nb, nodata, p, score, tdist, hmean, hsd, water, &phl->bap);
+        // override total score in case of water
+        if (water) water_score(ard, nt, p, score);
 
-      if (phl->bap.pac.lsp) free((void*)target);
+        // mean and sd of haze score
+        haze_stats(ard, nt, p, score, &phl->bap, &hmean, &hsd);
+
+        // compute BAP
+        bap_compositing(ard, &l3[k], nt, nb, nodata, p, score, tdist, hmean, hsd, water, &phl->bap);
+
+      }
+
+      if (phl->bap.pac.lsp) free((void*)target[0]);
 
     }
     
 
     // clean
-    if (!phl->bap.pac.lsp) free((void*)target);
-    if (phl->bap.w.r > 0) free_2D((void**)cor, nt);
+    if (!phl->bap.pac.lsp){
+      for (k=0; k<phl->bap.ntarget; k++) free((void*)target[k]);
+    }
+    free((void*)target);
+    free_target_cache(cache);
+    if (phl->bap.w.r > 0){
+      free_2D((void**)cor, nt);
+      free((void*)z);
+    }
     free((void*)tdist);
     free((void*)score);
 
   }
+
+  lap_profile("bap_score");
   
-  bap_overview(&l3, nx, ny, nb, res, nodata);
+  for (k=0; k<phl->bap.ntarget; k++) bap_overview(&l3[k], nx, ny, nb, res, nodata);
+  free((void*)l3);
+
+  lap_profile("bap_overview");
   
 
   *nproduct = nprod;
@@ -34,7 +34,9 @@ Level 3 Processing header
 #include "../cross-level/const-cl.h"
 #include "../cross-level/stats-cl.h"
 #include "../cross-level/cite-cl.h"
+#include "../cross-level/profile-cl.h"
 #include "../higher-level/read-ard-hl.h"
+#include "../higher-level/bap-gpu-hl.h"
 
 
 #ifdef __cplusplus
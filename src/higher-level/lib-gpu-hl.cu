@@ -0,0 +1,226 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains the library completeness test on the GPU. One thread
+per pixel compares the features with all samples of each library by 
+brute force, like the k-d tree search in lib-hl.c, and keeps the minimum
+mean absolute error. The samples are staged in shared memory, tile by 
+tile. Without FORCE_CUDA, this file is compiled as C++ and lib_gpu 
+always cancels.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "lib-gpu-hl.h"
+
+#include <string.h>  // string handling functions
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define GPU_NTHREAD 256
+#define GPU_NTILE   128 // samples per shared memory tile
+
+
+/** kernels
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+// minimum MAE of each pixel to the samples of each library; the libraries
+// are concatenated (off), mean and sd are NULL if not rescaled
+__global__ void lib_kernel(const short * const *feature, const unsigned int *use, int nc, int nf,
+  int nlib, const int *off, const int *ns, const double *tab, const double *mean, const double *sd, double *mae){
+__shared__ double tile[GPU_NTILE*LIB_GPU_MAXF];
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+unsigned int u = (p < nc) ? use[p] : 0;
+double x[LIB_GPU_MAXF];
+double d, k = 0, min_mae;
+int l, s, s0, n, f, i;
+
+
+  for (f=0; f<nf; f++) if (u & (1u << f)) k++;
+
+  for (l=0; l<nlib; l++){
+
+    for (f=0; f<nf && u; f++){
+      if (mean != NULL){
+        x[f] = ((double)feature[f][p] - mean[l*nf+f]) / sd[l*nf+f];
+      } else {
+        x[f] = (double)feature[f][p];
+      }
+    }
+
+    min_mae = SHRT_MAX;
+
+    // all threads stage the tiles, even if the pixel is skipped
+    for (s0=0; s0<ns[l]; s0+=GPU_NTILE){
+
+      n = (ns[l]-s0 < GPU_NTILE) ? ns[l]-s0 : GPU_NTILE;
+
+      for (i=threadIdx.x; i<n*nf; i+=blockDim.x) tile[i] = tab[(size_t)(off[l]+s0)*nf+i];
+      __syncthreads();
+
+      for (s=0; s<n && u; s++){
+
+        for (f=0, d=0; f<nf; f++){
+          if (u & (1u << f)) d += fabs(tile[s*nf+f] - x[f]);
+        }
+
+        if (d/k < min_mae) min_mae = d/k;
+
+      }
+
+      __syncthreads();
+
+    }
+
+    if (p < nc) mae[(size_t)l*nc+p] = min_mae;
+
+  }
+
+  return;
+}
+
+#endif
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function computes the minimum distance of each pixel to several
++++ libraries on the GPU. The features (job->feature) must already be on
++++ the device, enqueued in the same stream. The libraries are copied to
++++ the device in one buffer. Pixels that are skipped get SHRT_MAX, like
++++ pixels without valid features on the CPU. The function returns after
++++ the downloads are complete.
+--- job:    library job
+--- stream: stream of the processing unit
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int lib_gpu(lib_gpu_t *job, gpu_stream_t stream){
+#ifdef FORCE_CUDA
+cudaStream_t st = (cudaStream_t)gpu_cuda_stream(stream);
+size_t bytes_ptr, bytes_u, bytes_n, bytes_tab, bytes_ms = 0, bytes_mae;
+const short **d_ptr = NULL;
+unsigned int *d_u = NULL;
+int *d_off = NULL, *off = NULL;
+double *d_tab = NULL, *d_mean = NULL, *d_sd = NULL, *d_mae = NULL;
+double *buf = NULL;
+int nblock, l, s, ntot = 0, nc = job->nc, nf = job->nf;
+int error = 0;
+
+
+  if (nf > LIB_GPU_MAXF) return CANCEL;
+
+  if (!gpu_enabled() || gpu_select(stream) == FAILURE) return CANCEL;
+
+  nblock = (nc + GPU_NTHREAD - 1) / GPU_NTHREAD;
+
+  // offsets of the concatenated libraries, followed by the sample counts
+  off = (int*)malloc(2*job->nlib*sizeof(int));
+  for (l=0; l<job->nlib; l++){
+    off[l] = ntot;
+    off[job->nlib+l] = job->ns[l];
+    ntot += job->ns[l];
+  }
+
+  bytes_ptr = nf*sizeof(short*);
+  bytes_u   = nc*sizeof(unsigned int);
+  bytes_n   = 2*job->nlib*sizeof(int);
+  bytes_tab = (size_t)ntot*nf*sizeof(double);
+  bytes_mae = (size_t)job->nlib*nc*sizeof(double);
+  if (job->mean != NULL) bytes_ms = (size_t)job->nlib*nf*sizeof(double);
+
+  if ((d_ptr = (const short**)gpu_alloc(bytes_ptr, stream)) == NULL) error++;
+  if ((d_u   = (unsigned int*)gpu_alloc(bytes_u, stream)) == NULL) error++;
+  if ((d_off = (int*)gpu_alloc(bytes_n, stream)) == NULL) error++;
+  if ((d_tab = (double*)gpu_alloc(bytes_tab, stream)) == NULL) error++;
+  if ((d_mae = (double*)gpu_alloc(bytes_mae, stream)) == NULL) error++;
+  if (bytes_ms > 0 && (d_mean = (double*)gpu_alloc(bytes_ms, stream)) == NULL) error++;
+  if (bytes_ms > 0 && (d_sd   = (double*)gpu_alloc(bytes_ms, stream)) == NULL) error++;
+
+  if (!error){
+
+    // samples, then mean and sd, in one host buffer
+    buf = (double*)malloc(bytes_tab + 2*bytes_ms);
+
+    for (l=0; l<job->nlib; l++){
+      for (s=0; s<job->ns[l]; s++) memcpy(buf+(size_t)(off[l]+s)*nf, job->tab[l][s], nf*sizeof(double));
+      if (bytes_ms > 0){
+        memcpy(buf+(size_t)ntot*nf+l*nf,              job->mean[l], nf*sizeof(double));
+        memcpy(buf+(size_t)ntot*nf+(job->nlib+l)*nf, job->sd[l],   nf*sizeof(double));
+      }
+    }
+
+    cudaMemcpyAsync(d_ptr, job->feature, bytes_ptr, cudaMemcpyHostToDevice, st);
+    cudaMemcpyAsync(d_u,   job->use,     bytes_u,   cudaMemcpyHostToDevice, st);
+    cudaMemcpyAsync(d_off, off,          bytes_n,   cudaMemcpyHostToDevice, st);
+    cudaMemcpyAsync(d_tab, buf,          bytes_tab, cudaMemcpyHostToDevice, st);
+    if (bytes_ms > 0){
+      cudaMemcpyAsync(d_mean, buf+(size_t)ntot*nf,             bytes_ms, cudaMemcpyHostToDevice, st);
+      cudaMemcpyAsync(d_sd,   buf+(size_t)(ntot+job->nlib)*nf, bytes_ms, cudaMemcpyHostToDevice, st);
+    }
+
+    lib_kernel<<<nblock, GPU_NTHREAD, 0, st>>>(
+      d_ptr, d_u, nc, nf, job->nlib, d_off, d_off+job->nlib, d_tab, d_mean, d_sd, d_mae);
+
+    if (cudaGetLastError() != cudaSuccess){
+      printf("launching library kernel failed. ");
+      error++;
+    }
+
+  }
+
+  if (!error){
+    for (l=0; l<job->nlib; l++){
+      cudaMemcpyAsync(job->mae[l], d_mae+(size_t)l*nc, nc*sizeof(double), cudaMemcpyDeviceToHost, st);
+    }
+  }
+
+  if (gpu_sync(stream) == FAILURE) error++;
+
+  free((void*)off);
+  free((void*)buf);
+
+  gpu_release(d_ptr,  bytes_ptr, stream);
+  gpu_release(d_u,    bytes_u,   stream);
+  gpu_release(d_off,  bytes_n,   stream);
+  gpu_release(d_tab,  bytes_tab, stream);
+  gpu_release(d_mae,  bytes_mae, stream);
+  gpu_release(d_mean, bytes_ms,  stream);
+  gpu_release(d_sd,   bytes_ms,  stream);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
@@ -0,0 +1,66 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Library completeness on the GPU header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef LIBGPU_HL_H
+#define LIBGPU_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/gpu-cl.h"
+
+
+// max. number of features for the brute-force search on the device,
+// the features used by a pixel are flagged in one 32-bit word
+#define LIB_GPU_MAXF 32
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// minimum distance to several libraries on the device
+typedef struct {
+  int nc, nf;             // number of cells, features
+  const short **feature;  // feature bands (device pointers, host array of nf)
+  const unsigned int *use; // host: features used by pixel (bit f), 0: skip pixel
+  int nlib;               // number of libraries
+  const int *ns;          // number of samples per library
+  double ***tab;          // libraries [lib][sample][feature] (host)
+  double **mean, **sd;    // rescaling per library and feature (host), NULL: none
+  double **mae;           // host: minimum MAE per library (nlib x nc)
+} lib_gpu_t;
+
+int lib_gpu(lib_gpu_t *job, gpu_stream_t stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -30,6 +30,11 @@ This file contains functions for library completeness testing
 
 brick_t **compile_lib(ard_t *features, lib_t *lib, par_hl_t *phl, aux_lib_t *library, cube_t *cube, int *nproduct);
 brick_t *compile_lib_brick(brick_t *ard, int nb, bool write, char *prodname, par_hl_t *phl);
+int count_lib_nodes(int n);
+int build_lib_node(lib_tree_t *tree, int *idx, double **tab, int node, int *next, int lo, int hi);
+void search_lib_tree(const lib_tree_t *tree, int node, const double *x, const bool *use, double *off, double rd, double *min);
+double nearest_lib_sample(const lib_tree_t *tree, const double *x, const bool *use, double *off, double k);
+int lib_device(ard_t *features, small *mask_, int nf, int nc, par_hl_t *phl, aux_lib_t *library, double ***mae);
 
 
 /** This function compiles the bricks, in which LIB results are stored.
@@ -155,10 +160,316 @@ int nchar;
 }
 
 
+/** This function counts the nodes of a k-d tree with n samples. Nodes
++++ with more than LIB_LEAF samples are split in halves.
+--- n:      number of samples
++++ Return: number of nodes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int count_lib_nodes(int n){
+
+  if (n <= LIB_LEAF) return 1;
+
+  return 1 + count_lib_nodes(n/2) + count_lib_nodes(n-n/2);
+}
+
+
+/** This function builds a node of a k-d tree, and its children. The 
++++ samples are split at the median of the feature with the largest 
++++ spread; the samples of the left child are smaller or equal, the 
++++ samples of the right child are larger or equal than the split value.
+--- tree:   k-d tree
+--- idx:    sample permutation
+--- tab:    library
+--- node:   node
+--- next:   next free node
+--- lo:     first sample of node
+--- hi:     last sample of node + 1
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int build_lib_node(lib_tree_t *tree, int *idx, double **tab, int node, int *next, int lo, int hi){
+int f, s, d = 0, mid, a, b, i, j, tmp;
+double min, max, spread = -1, v;
+
+
+  tree->lo[node] = lo;
+  tree->hi[node] = hi;
+
+  if (hi-lo <= LIB_LEAF){
+    tree->dim[node] = -1;
+    return SUCCESS;
+  }
+
+  for (f=0; f<tree->nf; f++){
+    for (s=lo, min=max=tab[idx[lo]][f]; s<hi; s++){
+      if (tab[idx[s]][f] < min) min = tab[idx[s]][f];
+      if (tab[idx[s]][f] > max) max = tab[idx[s]][f];
+    }
+    if (max-min > spread){ spread = max-min; d = f;}
+  }
+
+  // select the median (Hoare)
+  mid = lo + (hi-lo)/2;
+  a = lo; b = hi-1;
+
+  while (a < b){
+
+    v = tab[idx[mid]][d];
+    i = a; j = b;
+
+    do {
+      while (tab[idx[i]][d] < v) i++;
+      while (v < tab[idx[j]][d]) j--;
+      if (i <= j){ tmp = idx[i]; idx[i] = idx[j]; idx[j] = tmp; i++; j--;}
+    } while (i <= j);
+
+    if (j < mid) a = i;
+    if (mid < i) b = j;
+
+  }
+
+  tree->dim[node]   = d;
+  tree->split[node] = tab[idx[mid]][d];
+  tree->left[node]  = *next;
+  *next += 2;
+
+  if (build_lib_node(tree, idx, tab, tree->left[node],   next, lo,  mid) == FAILURE) return FAILURE;
+  if (build_lib_node(tree, idx, tab, tree->left[node]+1, next, mid, hi)  == FAILURE) return FAILURE;
+
+  return SUCCESS;
+}
+
+
+/** This function searches a node of a k-d tree for the sample with the 
++++ smallest L1 distance. Only the flagged features are used. The lower
++++ bound of the distance to the node is updated incrementally with the
++++ offset of each feature (Arya & Mount 1993). The distances of the 
++++ samples are summed in the same order as by brute force.
+--- tree:   k-d tree
+--- node:   node
+--- x:      features
+--- use:    use feature?
+--- off:    offset of each feature to the node
+--- rd:     lower bound of distance to the node
+--- min:    smallest distance (modified)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void search_lib_tree(const lib_tree_t *tree, int node, const double *x, const bool *use, double *off, double rd, double *min){
+int s, f, d, near, far;
+const double *y = NULL;
+double dist, old, diff;
+
+
+  if ((d = tree->dim[node]) < 0){
+
+    for (s=tree->lo[node]; s<tree->hi[node]; s++){
+      y = tree->tab + (size_t)s*tree->nf;
+      for (f=0, dist=0; f<tree->nf; f++){
+        if (use[f]) dist += fabs(y[f] - x[f]);
+      }
+      if (dist < *min) *min = dist;
+    }
+
+    return;
+  }
+
+  diff = x[d] - tree->split[node];
+  near = (diff < 0) ? tree->left[node] : tree->left[node]+1;
+  far  = (diff < 0) ? tree->left[node]+1 : tree->left[node];
+
+  search_lib_tree(tree, near, x, use, off, rd, min);
+
+  if (!use[d]){
+    search_lib_tree(tree, far, x, use, off, rd, min);
+    return;
+  }
+
+  old = off[d];
+  rd += fabs(diff) - old;
+
+  // a small tolerance for the rounding of the incremental bound
+  if (rd <= *min * (1.0 + 1e-12)){
+    off[d] = fabs(diff);
+    search_lib_tree(tree, far, x, use, off, rd, min);
+    off[d] = old;
+  }
+
+  return;
+}
+
+
+/** This function finds the smallest mean absolute error of a pixel to 
++++ the samples of a library.
+--- tree:   k-d tree
+--- x:      features
+--- use:    use feature?
+--- off:    buffer for the offsets of each feature (nf)
+--- k:      number of used features
++++ Return: smallest MAE, SHRT_MAX if no feature is used
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double nearest_lib_sample(const lib_tree_t *tree, const double *x, const bool *use, double *off, double k){
+double min = SHRT_MAX*k;
+
+
+  if (k == 0) return SHRT_MAX;
+
+  memset(off, 0, tree->nf*sizeof(double));
+
+  search_lib_tree(tree, 0, x, use, off, 0.0, &min);
+
+  if (min/k < SHRT_MAX) return min/k;
+
+  return SHRT_MAX;
+}
+
+
+/** This function computes the minimum distances of a chunk to all li-
++++ braries on the GPU. The feature bricks must have device copies, and
++++ the number of features must be small enough for the brute-force 
++++ search. Otherwise, the k-d trees are searched on the CPU.
+--- features: input features
+--- mask_:    mask image (or NULL)
+--- nf:       number of features
+--- nc:       number of cells
+--- phl:      HL parameters
+--- library:  libraries
+--- mae:      minimum MAE per library (returned, nlib x nc)
++++ Return:   SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int lib_device(ard_t *features, small *mask_, int nf, int nc, par_hl_t *phl, aux_lib_t *library, double ***mae){
+lib_gpu_t job;
+const short **ptr = NULL;
+unsigned int *use = NULL;
+bool valid;
+int f, p;
+int status = SUCCESS;
+
+
+  *mae = NULL;
+
+  if (!phl->gpu || nf > LIB_GPU_MAXF) return CANCEL;
+
+  for (f=0; f<nf; f++){
+    if (features[f].GPU == NULL) return CANCEL;
+  }
+
+
+  alloc((void**)&ptr, nf, sizeof(short*));
+  alloc((void**)&use, nc, sizeof(unsigned int));
+
+  for (f=0; f<nf; f++) ptr[f] = (const short*)get_gpu_band(features[f].GPU, 0);
+
+  for (p=0; p<nc; p++){
+
+    if (mask_ != NULL && !mask_[p]) continue;
+
+    for (f=0, valid=true; f<nf; f++){
+      if (!features[f].msk[p] && phl->ftr.exclude) valid = false;
+    }
+    if (!valid) continue;
+
+    for (f=0; f<nf; f++){
+      if (features[f].msk[p]) use[p] |= 1u << f;
+    }
+
+  }
+
+  alloc_2D((void***)mae, library->n, nc, sizeof(double));
+
+  memset(&job, 0, sizeof(lib_gpu_t));
+  job.nc      = nc;
+  job.nf      = nf;
+  job.feature = ptr;
+  job.use     = use;
+  job.nlib    = library->n;
+  job.ns      = library->ns;
+  job.tab     = library->tab;
+  job.mean    = (phl->lib.rescale) ? library->mean : NULL;
+  job.sd      = (phl->lib.rescale) ? library->sd   : NULL;
+  job.mae     = *mae;
+
+  // the features were copied in this stream
+  status = lib_gpu(&job, features[0].GPU->stream);
+
+  free((void*)ptr);
+  free((void*)use);
+
+  if (status != SUCCESS){
+    free_2D((void**)*mae, library->n);
+    *mae = NULL;
+  }
+
+  return status;
+}
+
+
 /** public functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
 
+/** This function builds a k-d tree for nearest-neighbour queries in a 
++++ library. The tree is built once per run, and holds a copy of the 
++++ samples in tree order, such that leaves are contiguous in memory.
+--- tab:    library
+--- ns:     number of samples
+--- nf:     number of features
++++ Return: k-d tree (must be freed with free_lib_tree), NULL on failure
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+lib_tree_t *build_lib_tree(double **tab, int ns, int nf){
+lib_tree_t *tree = NULL;
+int *idx = NULL;
+int s, next = 1;
+
+
+  if (ns < 1 || nf < 1) return NULL;
+
+  alloc((void**)&tree, 1, sizeof(lib_tree_t));
+  tree->nf    = nf;
+  tree->nnode = count_lib_nodes(ns);
+
+  alloc((void**)&tree->dim,   tree->nnode, sizeof(int));
+  alloc((void**)&tree->split, tree->nnode, sizeof(double));
+  alloc((void**)&tree->lo,    tree->nnode, sizeof(int));
+  alloc((void**)&tree->hi,    tree->nnode, sizeof(int));
+  alloc((void**)&tree->left,  tree->nnode, sizeof(int));
+  alloc((void**)&tree->tab,   (size_t)ns*nf, sizeof(double));
+
+  alloc((void**)&idx, ns, sizeof(int));
+  for (s=0; s<ns; s++) idx[s] = s;
+
+  if (build_lib_node(tree, idx, tab, 0, &next, 0, ns) == FAILURE){
+    free((void*)idx);
+    free_lib_tree(tree);
+    return NULL;
+  }
+
+  for (s=0; s<ns; s++) memcpy(tree->tab+(size_t)s*nf, tab[idx[s]], nf*sizeof(double));
+
+  free((void*)idx);
+
+  return tree;
+}
+
+
+/** This function frees a k-d tree
+--- tree:   k-d tree
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_lib_tree(lib_tree_t *tree){
+
+  if (tree == NULL) return;
+
+  free((void*)tree->dim);
+  free((void*)tree->split);
+  free((void*)tree->lo);
+  free((void*)tree->hi);
+  free((void*)tree->left);
+  free((void*)tree->tab);
+  free((void*)tree);
+
+  return;
+}
+
+
 /** This function is the entry point to the library completeness testing
 +++ module
 --- features:  input features
@@ -174,11 +485,12 @@ lib_t lib;
 brick_t **LIB;
 small *mask_ = NULL;
 int nprod = 0;
-int l, s, f, p, nc;
+int l, f, p, nc;
 short nodata;
-double *newfeatures = NULL;
-bool valid;
-double mae, min_mae, min_mae_all, k;
+double *newfeatures = NULL, *off = NULL;
+bool *use = NULL, valid;
+double min_mae, min_mae_all, k;
+double **dev_mae = NULL;
 
 
   // import bricks
@@ -206,13 +518,19 @@ double mae, min_mae, min_mae_all, k;
     return NULL;
   }
 
+  // minimum distances of the whole chunk on the device, if possible,
+  // otherwise search the k-d trees
+  lib_device(features, mask_, nf, nc, phl, library, &dev_mae);
+
   
-  #pragma omp parallel private(newfeatures,valid,mae,min_mae,min_mae_all,k,f,l,s) shared(lib,phl,features,library,mask_,nc,nf,nodata) default(none)
+  #pragma omp parallel private(newfeatures,use,off,valid,min_mae,min_mae_all,k,f,l) shared(lib,phl,features,library,mask_,nc,nf,nodata,dev_mae) default(none)
   {
 
     alloc((void**)&newfeatures, nf, sizeof(double));
+    alloc((void**)&use,         nf, sizeof(bool));
+    alloc((void**)&off,         nf, sizeof(double));
     
-    #pragma omp for
+    #pragma omp for schedule(dynamic)
     for (p=0; p<nc; p++){
       
       for (l=0; l<=library->n; l++) lib.mae_[l][p] = nodata;
@@ -224,38 +542,31 @@ double mae, min_mae, min_mae_all, k;
       }
       if (!valid) continue;
 
+      for (f=0, k=0; f<nf; f++){
+        if ((use[f] = features[f].msk[p])) k++;
+      }
+
 
       
       min_mae_all = SHRT_MAX;
       
       for (l=0; l<library->n; l++){
         
-        min_mae = SHRT_MAX;
+        if (dev_mae != NULL){
 
-        for (f=0; f<nf; f++){
-          if (phl->lib.rescale){
-            newfeatures[f] = ((double)features[f].dat[0][p] - library->mean[l][f]) / library->sd[l][f];
-          } else {
-            newfeatures[f] = (double)features[f].dat[0][p];
-          }
-        }
+          min_mae = dev_mae[l][p];
 
-        for (s=0; s<library->ns[l]; s++){
-          
-          mae = k = 0;
+        } else {
 
           for (f=0; f<nf; f++){
-            
-            if (!features[f].msk[p]) continue;
-
-            mae += fabs(library->tab[l][s][f] - newfeatures[f]);
-            k++;
-
+            if (phl->lib.rescale){
+              newfeatures[f] = ((double)features[f].dat[0][p] - library->mean[l][f]) / library->sd[l][f];
+            } else {
+              newfeatures[f] = (double)features[f].dat[0][p];
+            }
           }
-          
-          if (k == 0) continue; else mae /= k;
-          
-          if (mae < min_mae) min_mae = mae;
+
+          min_mae = nearest_lib_sample(library->tree[l], newfeatures, use, off, k);
 
         }
         
@@ -272,9 +583,13 @@ double mae, min_mae, min_mae_all, k;
     
     
     free((void*)newfeatures);
+    free((void*)use);
+    free((void*)off);
     
   }
 
+  if (dev_mae != NULL) free_2D((void**)dev_mae, library->n);
+
   *nproduct = nprod;
   return LIB;
 }
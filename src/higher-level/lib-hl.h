@@ -36,11 +36,26 @@ Library completeness header
 #include "../cross-level/string-cl.h"
 #include "../cross-level/stats-cl.h"
 #include "../higher-level/read-ard-hl.h"
+#include "../higher-level/lib-gpu-hl.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// number of library samples in a leaf of the k-d tree
+#define LIB_LEAF 16
+
+// k-d tree of one library for nearest-neighbour queries (L1 distance)
+typedef struct {
+  int nf;        // number of features
+  int nnode;     // number of nodes
+  int *dim;      // split feature of node, -1: leaf
+  double *split; // split value of node
+  int *lo, *hi;  // samples of node in tree order, [lo,hi)
+  int *left;     // left child of node, right child is left+1
+  double *tab;   // samples in tree order (ns x nf)
+} lib_tree_t;
+
 typedef struct {
   double ***tab; // table
   int n;         // number of tables
@@ -49,12 +64,15 @@ typedef struct {
   bool scaled; // flag if table was cleaned
   double **mean; // mean per table and feature
   double **sd;   // sd   per table and feature
+  lib_tree_t **tree; // k-d tree per table
 } aux_lib_t;
 
 typedef struct {
   short **mae_;
 } lib_t;
 
+lib_tree_t *build_lib_tree(double **tab, int ns, int nf);
+void free_lib_tree(lib_tree_t *tree);
 brick_t **library_completeness(ard_t *features, brick_t *mask, int nf, par_hl_t *phl, aux_lib_t *library, cube_t *cube, int *nproduct);
 
 #ifdef __cplusplus
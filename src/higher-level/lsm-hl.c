@@ -36,6 +36,53 @@ brick_t *compile_lsm_brick(brick_t *ard, int nb, bool write, char *prodname, par
 
 int test_objects(small *cld_, int nx, int ny, int **OBJ, int **SIZE, int *nobj);
 
+// object table of one feature, shared by all metrics
+typedef struct {
+  int nobj;               // number of patches
+  int *ccl;               // patch of each pixel, 0: no patch
+  small *edges;           // class edges of each pixel (LSM_EDGE_* bits), or NULL
+} lsm_obj_t;
+
+// sliding window of landscape metrics along one row
+typedef struct {
+  int r;                  // radius of kernel
+  int *hw;                // half-width of each kernel row (2r+1), -1: empty
+  const small *binary;    // class pixels
+  const small *edges;     // class edges of each pixel (LSM_EDGE_* bits)
+  const int *ccl;         // patch of each pixel
+  int *cnt;               // pixels of each patch in window (nobj+1)
+  int *edge;              // edges of each patch in window (nobj+1)
+  int *active;            // patches in window
+  int *pos;               // position of each patch in active list (nobj+1)
+  int nact;               // number of patches in window
+  int ncnt, nedge;        // pixels and edges of all patches in window
+} lsm_window_t;
+
+// row-wise summed-area tables of the values of class pixels (ny x nx+1)
+typedef struct {
+  int *nval;              // number of values, nodata excluded
+  int64_t *sum, *sumsq;   // sum of values and squared values
+  int *nlog;              // number of positive values
+  double *log;            // sum of log of positive values
+} lsm_sat_t;
+
+#define LSM_EDGE_UP    1
+#define LSM_EDGE_DOWN  2
+#define LSM_EDGE_LEFT  4
+#define LSM_EDGE_RIGHT 8
+
+small *lsm_edges(small *binary, int nx, int ny);
+int lsm_objects(small *binary, int nx, int ny, int nmin, bool edges, lsm_obj_t *obj);
+void free_lsm_objects(lsm_obj_t *obj);
+void lsm_tables(short *dat, small *binary, int nx, int ny, short nodata, lsm_sat_t *sat);
+void free_lsm_tables(lsm_sat_t *sat);
+void lsm_window_pixel(lsm_window_t *win, int p, int ii, int sign);
+void lsm_window_border(lsm_window_t *win, int i, int j, int nx, int ny, int sign);
+void lsm_window_first(lsm_window_t *win, int i, int nx, int ny);
+void lsm_window_slide(lsm_window_t *win, int i, int j, int nx, int ny);
+void lsm_window_metrics(lsm_window_t *win, float *area, float *perim, int ksize, int i, int j, int nx, int ny, int f, lsm_t *lsm, par_hl_t *phl);
+void lsm_value_metrics(lsm_sat_t *sat, short *maxv, morph_elem_t *elem, int i, int j, int nx, int ny, int f, lsm_t *lsm, par_hl_t *phl);
+
 
 /** This function compiles the bricks, in which LSM results are stored.
 +++ It also sets metadata and sets pointers to instantly useable image
@@ -160,6 +207,465 @@ int nchar;
 }
 
 
+/** This function flags the edges of the class pixels, i.e. the sides 
++++ that neighbour a non-class pixel within the image.
+--- binary: class pixels
+--- nx:     number of columns
+--- ny:     number of rows
++++ Return: edges of each pixel (LSM_EDGE_* bits)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+small *lsm_edges(small *binary, int nx, int ny){
+small *edges = NULL;
+int i, j, p;
+
+
+  alloc((void**)&edges, nx*ny, sizeof(small));
+
+  #pragma omp parallel for private(j,p) shared(binary,edges,nx,ny) default(none)
+  for (i=0; i<ny; i++){
+  for (j=0; j<nx; j++){
+
+    p = i*nx+j;
+
+    if (!binary[p]) continue;
+
+    if (i-1 >= 0 && !binary[p-nx]) edges[p] |= LSM_EDGE_UP;
+    if (i+1 < ny && !binary[p+nx]) edges[p] |= LSM_EDGE_DOWN;
+    if (j-1 >= 0 && !binary[p-1])  edges[p] |= LSM_EDGE_LEFT;
+    if (j+1 < nx && !binary[p+1])  edges[p] |= LSM_EDGE_RIGHT;
+
+  }
+  }
+
+  return edges;
+}
+
+
+/** This function builds the object table of one feature, which is shared
++++ by all metrics. The class pixels are labelled once; patches smaller 
++++ than nmin are removed from the class pixels, and the remaining patches
++++ are renumbered in the order of their first pixel. This gives the same
++++ IDs as labelling the cleaned class pixels again.
+--- binary: class pixels (small patches are removed)
+--- nx:     number of columns
+--- ny:     number of rows
+--- nmin:   minimum patch size
+--- edges:  flag the class edges (needed by the patch metrics)?
+--- obj:    object table (returned)
++++ Return: number of patches
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int lsm_objects(small *binary, int nx, int ny, int nmin, bool edges, lsm_obj_t *obj){
+int *size = NULL, *id = NULL;
+int k, p, no, n = 0, nc = nx*ny;
+
+
+  obj->nobj  = 0;
+  obj->ccl   = NULL;
+  obj->edges = NULL;
+
+  if (nc < 1) return 0;
+
+  alloc((void**)&obj->ccl, nc, sizeof(int));
+
+  // to ensure that 1st object gets ID=1
+  binary[0] = false;
+
+  if ((no = connectedcomponents_(binary, obj->ccl, nx, ny)) < 1){
+    free_lsm_objects(obj);
+    return 0;
+  }
+
+  alloc((void**)&size, no+1, sizeof(int));
+  alloc((void**)&id,   no+1, sizeof(int));
+
+  for (p=0; p<nc; p++){
+    if (binary[p]) size[obj->ccl[p]]++;
+  }
+
+  for (k=1; k<=no; k++) id[k] = (size[k] >= nmin) ? ++n : 0;
+
+  #pragma omp parallel for shared(binary,obj,id,nc) default(none)
+  for (p=0; p<nc; p++){
+    if (!binary[p]){ obj->ccl[p] = 0; continue;}
+    if ((obj->ccl[p] = id[obj->ccl[p]]) == 0) binary[p] = false;
+  }
+
+  free((void*)size);
+  free((void*)id);
+
+  if ((obj->nobj = n) < 1){
+    free_lsm_objects(obj);
+    return 0;
+  }
+
+  if (edges) obj->edges = lsm_edges(binary, nx, ny);
+
+  return obj->nobj;
+}
+
+
+/** This function frees the object table
+--- obj:    object table
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_lsm_objects(lsm_obj_t *obj){
+
+  if (obj->ccl   != NULL) free((void*)obj->ccl);
+  if (obj->edges != NULL) free((void*)obj->edges);
+  obj->ccl   = NULL;
+  obj->edges = NULL;
+  obj->nobj  = 0;
+
+  return;
+}
+
+
+/** This function computes row-wise summed-area tables of the values of
++++ the class pixels. The sum over a row segment is the difference of 
++++ two table entries.
+--- dat:    values
+--- binary: class pixels
+--- nx:     number of columns
+--- ny:     number of rows
+--- nodata: nodata value
+--- sat:    summed-area tables (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void lsm_tables(short *dat, small *binary, int nx, int ny, short nodata, lsm_sat_t *sat){
+int i, j, p, q;
+size_t n = (size_t)ny*(nx+1);
+
+
+  alloc((void**)&sat->nval,  n, sizeof(int));
+  alloc((void**)&sat->sum,   n, sizeof(int64_t));
+  alloc((void**)&sat->sumsq, n, sizeof(int64_t));
+  alloc((void**)&sat->nlog,  n, sizeof(int));
+  alloc((void**)&sat->log,   n, sizeof(double));
+
+  #pragma omp parallel for private(j,p,q) shared(dat,binary,sat,nx,ny,nodata) default(none)
+  for (i=0; i<ny; i++){
+  for (j=0; j<nx; j++){
+
+    p = i*nx+j;
+    q = i*(nx+1)+j;
+
+    sat->nval[q+1]  = sat->nval[q];
+    sat->sum[q+1]   = sat->sum[q];
+    sat->sumsq[q+1] = sat->sumsq[q];
+    sat->nlog[q+1]  = sat->nlog[q];
+    sat->log[q+1]   = sat->log[q];
+
+    if (!binary[p]) continue;
+
+    if (dat[p] != nodata){
+      sat->nval[q+1]++;
+      sat->sum[q+1]   += dat[p];
+      sat->sumsq[q+1] += (int64_t)dat[p]*dat[p];
+    }
+
+    // natural log is undefined for 0 or negative values
+    if (dat[p] > 0){
+      sat->nlog[q+1]++;
+      sat->log[q+1] += log(dat[p]);
+    }
+
+  }
+  }
+
+  return;
+}
+
+
+/** This function frees the summed-area tables
+--- sat:    summed-area tables
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_lsm_tables(lsm_sat_t *sat){
+
+  free((void*)sat->nval);
+  free((void*)sat->sum);
+  free((void*)sat->sumsq);
+  free((void*)sat->nlog);
+  free((void*)sat->log);
+
+  return;
+}
+
+
+/** This function adds a pixel to, or removes a pixel from the window. 
++++ Edges to the rows above and below only count if the pixel is not in
++++ the first or last kernel row, respectively. Edges to the left and 
++++ right are corrected with lsm_window_border.
+--- win:    sliding window
+--- p:      pixel
+--- ii:     kernel row of the pixel, relative to center
+--- sign:   +1: add, -1: remove
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void lsm_window_pixel(lsm_window_t *win, int p, int ii, int sign){
+int c, e = 0;
+
+
+  if (!win->binary[p]) return;
+
+  c = win->ccl[p];
+
+  if ((win->edges[p] & LSM_EDGE_UP)   && ii != -win->r) e++;
+  if ((win->edges[p] & LSM_EDGE_DOWN) && ii !=  win->r) e++;
+  if  (win->edges[p] & LSM_EDGE_LEFT)  e++;
+  if  (win->edges[p] & LSM_EDGE_RIGHT) e++;
+
+  if (sign > 0){
+    if (win->cnt[c]++ == 0){
+      win->pos[c] = win->nact;
+      win->active[win->nact++] = c;
+    }
+  } else {
+    if (--win->cnt[c] == 0){
+      win->nact--;
+      win->active[win->pos[c]] = win->active[win->nact];
+      win->pos[win->active[win->nact]] = win->pos[c];
+    }
+  }
+
+  win->edge[c] += sign*e;
+  win->ncnt    += sign;
+  win->nedge   += sign*e;
+
+  return;
+}
+
+
+/** This function removes (or restores) the edges that point out of the 
++++ kernel to the left and right, i.e. of the first and last pixel in all
++++ kernel rows that span the full kernel width.
+--- win:    sliding window
+--- i:      row of window center
+--- j:      column of window center
+--- nx:     number of columns
+--- ny:     number of rows
+--- sign:   -1: remove, +1: restore
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void lsm_window_border(lsm_window_t *win, int i, int j, int nx, int ny, int sign){
+int d, p;
+
+
+  for (d=0; d<2*win->r+1; d++){
+
+    if (win->hw[d] != win->r) continue;
+    if (i+d-win->r < 0 || i+d-win->r >= ny) continue;
+
+    p = (i+d-win->r)*nx;
+
+    if (j-win->r >= 0 && win->binary[p+j-win->r] && 
+       (win->edges[p+j-win->r] & LSM_EDGE_LEFT)){
+      win->edge[win->ccl[p+j-win->r]] += sign;
+      win->nedge += sign;
+    }
+
+    if (j+win->r < nx && win->binary[p+j+win->r] && 
+       (win->edges[p+j+win->r] & LSM_EDGE_RIGHT)){
+      win->edge[win->ccl[p+j+win->r]] += sign;
+      win->nedge += sign;
+    }
+
+  }
+
+  return;
+}
+
+
+/** This function empties the window, and fills it for the first pixel
++++ of a row.
+--- win:    sliding window
+--- i:      row
+--- nx:     number of columns
+--- ny:     number of rows
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void lsm_window_first(lsm_window_t *win, int i, int nx, int ny){
+int d, y, x, u;
+
+
+  for (u=0; u<win->nact; u++){
+    win->cnt[win->active[u]]  = 0;
+    win->edge[win->active[u]] = 0;
+  }
+  win->nact = win->ncnt = win->nedge = 0;
+
+  for (d=0; d<2*win->r+1; d++){
+    if ((y = i+d-win->r) < 0 || y >= ny) continue;
+    for (x=0; x<=win->hw[d] && x<nx; x++) lsm_window_pixel(win, y*nx+x, d-win->r, +1);
+  }
+
+  return;
+}
+
+
+/** This function slides the window by one column, i.e. only the pixels
++++ that leave and enter the kernel rows are updated.
+--- win:    sliding window
+--- i:      row
+--- j:      new column of window center
+--- nx:     number of columns
+--- ny:     number of rows
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void lsm_window_slide(lsm_window_t *win, int i, int j, int nx, int ny){
+int d, y, x;
+
+
+  for (d=0; d<2*win->r+1; d++){
+
+    if (win->hw[d] < 0) continue;
+    if ((y = i+d-win->r) < 0 || y >= ny) continue;
+
+    if ((x = j-1-win->hw[d]) >= 0) lsm_window_pixel(win, y*nx+x, d-win->r, -1);
+    if ((x = j+win->hw[d])   < nx) lsm_window_pixel(win, y*nx+x, d-win->r, +1);
+
+  }
+
+  return;
+}
+
+
+/** This function computes the patch metrics of one window, which are
++++ taken from the sliding window.
+--- win:    sliding window
+--- area:   area of n pixels, summed as in the kernel scan (kernel size+1)
+--- perim:  length of n edges, summed as in the kernel scan (4 x kernel size+1)
+--- ksize:  number of pixels in square kernel
+--- i:      row of window center
+--- j:      column of window center
+--- nx:     number of columns
+--- ny:     number of rows
+--- f:      feature
+--- lsm:    pointer to instantly useable LSM image arrays
+--- phl:    HL parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void lsm_window_metrics(lsm_window_t *win, float *area, float *perim, int ksize, int i, int j, int nx, int ny, int f, lsm_t *lsm, par_hl_t *phl){
+int t, c, p = i*nx+j;
+double sumFractalDims = 0;
+float totalClassArea, totaledgelength;
+float share, sumarea, sumshare;
+float unit_area, unit_perim;
+
+
+  if (phl->lsm.ouci) lsm->uci_[f][p] = win->ccl[p];
+
+  // edges that point out of the kernel do not count
+  lsm_window_border(win, i, j, nx, ny, -1);
+
+  totalClassArea  = area[win->ncnt];
+  totaledgelength = perim[win->nedge];
+
+  // area weight. share of patch area in total class area
+  sumarea = sumshare = 0;
+
+  for (t=0; t<win->nact; t++){
+    c = win->active[t];
+    share = area[win->cnt[c]] / totalClassArea;
+    sumarea  += share * area[win->cnt[c]];
+    sumshare += share;
+  }
+
+  if (phl->lsm.ompa){
+    if (sumshare > 0){
+      lsm->mpa_[f][p] = (short)(sumarea/sumshare*10000);
+    } else lsm->mpa_[f][p] = 0;
+  }
+
+  if (phl->lsm.oedd) lsm->edd_[f][p] = (short)(totaledgelength / sqrt(ksize) * 10000);
+  if (phl->lsm.onbr) lsm->nbr_[f][p] = win->nact;
+  if (phl->lsm.oems) lsm->ems_[f][p] = (short)(totalClassArea * totalClassArea * 10000);
+
+  // weighted sum of fractal dimensions
+  sumshare = 0;
+
+  for (t=0; t<win->nact; t++){
+
+    c = win->active[t];
+
+    // log(1) = 0 for patches of one pixel
+    if (win->cnt[c] == 1) continue;
+
+    unit_area  = area[win->cnt[c]]*ksize;
+    unit_perim = perim[win->edge[c]]*sqrt(ksize);
+
+    sumshare += area[win->cnt[c]];
+    sumFractalDims += area[win->cnt[c]] * 
+      (2.0 * log(0.25 * unit_perim)) / log(unit_area);
+
+  }
+
+  //  weighted mean fractal index
+  if (phl->lsm.ofdi){
+    if (win->nact != 0){
+      lsm->fdi_[f][p] = (short)(sumFractalDims / sumshare * 10000);
+    } else lsm->fdi_[f][p] = 0;
+  }
+
+  lsm_window_border(win, i, j, nx, ny, +1);
+
+  return;
+}
+
+
+/** This function computes the value metrics of one kernel. The value 
++++ statistics are taken from the summed-area tables, and the maximum from
++++ the dilated values.
+--- sat:    summed-area tables
+--- maxv:   maximum value in kernel (or NULL)
+--- elem:   kernel
+--- i:      row of kernel center
+--- j:      column of kernel center
+--- nx:     number of columns
+--- ny:     number of rows
+--- f:      feature
+--- lsm:    pointer to instantly useable LSM image arrays
+--- phl:    HL parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void lsm_value_metrics(lsm_sat_t *sat, short *maxv, morph_elem_t *elem, int i, int j, int nx, int ny, int f, lsm_t *lsm, par_hl_t *phl){
+int d, y, x0, x1, q, p = i*nx+j;
+int nval = 0, nlog = 0;
+int64_t sum = 0, sumsq = 0;
+double logsum = 0, mx = 0, vx = 0;
+
+
+  // value statistics of all kernel rows
+  for (d=0; d<2*elem->r+1; d++){
+
+    if (elem->hw[d] < 0) continue;
+    if ((y = i+d-elem->r) < 0 || y >= ny) continue;
+
+    if ((x0 = j-elem->hw[d]) < 0)   x0 = 0;
+    if ((x1 = j+elem->hw[d]) >= nx) x1 = nx-1;
+    q = y*(nx+1);
+
+    nval   += sat->nval[q+x1+1]  - sat->nval[q+x0];
+    sum    += sat->sum[q+x1+1]   - sat->sum[q+x0];
+    sumsq  += sat->sumsq[q+x1+1] - sat->sumsq[q+x0];
+    nlog   += sat->nlog[q+x1+1]  - sat->nlog[q+x0];
+    logsum += sat->log[q+x1+1]   - sat->log[q+x0];
+
+  }
+
+  if (nval > 0) mx = (double)sum/nval;
+  if (nval > 1) vx = (double)(nval*sumsq - sum*sum)/nval;
+
+  if (phl->lsm.oavg) lsm->avg_[f][p] = mx;
+  if (phl->lsm.ogeo) lsm->geo_[f][p] = exp((float)logsum / (float)nlog);
+  if (phl->lsm.omax) lsm->max_[f][p] = (maxv[p] > 0) ? maxv[p] : 0;
+  if (phl->lsm.oare) lsm->are_[f][p] = (nval <= SHRT_MAX) ? nval : SHRT_MAX;
+  if (phl->lsm.ostd) lsm->std_[f][p] = standdev(vx, nval);
+
+  return;
+}
+
+
 /** public functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
@@ -178,41 +684,29 @@ lsm_t lsm;
 brick_t **LSM;
 small *mask_ = NULL;
 int nprod = 0;
-int f, i, j, p, t, nx, ny, nc, ni, nj, np, u;
+int f, i, j, p, n, nx, ny, nc;
 int ki, kj; // iterator for KDIST
-int ii, jj; // iterator for kernel relative to center
-int nobj = 0;
 short nodata;
-float share = 0;
-int ccl = 0;
-int *CCL = NULL;
-int *SIZE = NULL;
-int *exists = NULL;
 float **KDIST = NULL;
-int numberOfuniquePatches = 0;
-int *uniquePatches;
-float *patchperimeters;
-float *patchAreas;
-float totalClassArea = 0;
-float totaledgelength = 0;
-double sumFractalDims = 0;
-float logSum = 0;
-float sumarea = 0;
-float sumshare = 0;
-int maxVal = 0;
-int logCounter = 0;
-int validDataPixels = 0;
 int kernelSize = (phl->lsm.radius * 2 + 1) * (phl->lsm.radius * 2 + 1);
 int minPatchSize = phl->lsm.minpatchsize;
 int width;
 small *newFeatures = NULL;
-double mx, vx;
 float kfraction, sqkfraction;
-float unit_area = 0;
-float unit_perim = 0;
+float *area = NULL, *perim = NULL;
+short *maxv = NULL, *maxv_ = NULL;
+morph_elem_t elem;
+lsm_window_t win;
+lsm_sat_t sat;
+lsm_obj_t obj;
+bool value, patch;
 
   cite_me(_CITE_LSM_);
 
+  // metrics of the values, and of the patches, are independent passes
+  value = phl->lsm.oavg || phl->lsm.ostd || phl->lsm.ogeo || phl->lsm.omax || phl->lsm.oare;
+  patch = phl->lsm.ompa || phl->lsm.ouci || phl->lsm.ofdi || phl->lsm.oedd || phl->lsm.onbr || phl->lsm.oems;
+
   // import bricks
   nx = get_brick_chunkncols(features[0].DAT);
   ny = get_brick_chunknrows(features[0].DAT);
@@ -234,6 +728,8 @@ float unit_perim = 0;
     return NULL;
   }
 
+  lap_profile("lsm_compile");
+
 
   // pre-compute kernel distances
   width = phl->lsm.radius*2+1;
@@ -242,6 +738,29 @@ float unit_perim = 0;
   kfraction = 1.0/(float)kernelSize;
   sqkfraction = sqrt(kfraction);
 
+  // kernel as horizontal chords
+  elem.r = phl->lsm.radius;
+  alloc((void**)&elem.hw, width, sizeof(int));
+
+  for (ki=0; ki<width; ki++){
+    for (kj=0, n=0; kj<width; kj++){
+      if (phl->lsm.kernel != _KERNEL_CIRCLE_ || 
+          KDIST[ki][kj] <= phl->lsm.radius) n++;
+    }
+    elem.hw[ki] = (n > 0) ? (n-1)/2 : -1;
+  }
+
+  // area and edge length of n pixels, summed up pixel by pixel
+  alloc((void**)&area,  kernelSize+1,   sizeof(float));
+  alloc((void**)&perim, 4*kernelSize+1, sizeof(float));
+  for (n=1; n<=kernelSize;   n++) area[n]  = area[n-1]  + kfraction;
+  for (n=1; n<=4*kernelSize; n++) perim[n] = perim[n-1] + sqkfraction;
+
+  if (phl->lsm.omax){
+    alloc((void**)&maxv,  nc, sizeof(short));
+    alloc((void**)&maxv_, nc, sizeof(short));
+  }
+
 
   // based on parameter input: range of numbers that are considered one class
   // --> derive new array with binaries from input features
@@ -297,20 +816,21 @@ float unit_perim = 0;
 
     }
 
-    // make objects and delete small ones
-    binary_to_objects(newFeatures, nx, ny, minPatchSize, &CCL, &SIZE, &nobj);
-    if (nobj < 1) continue;
+    // object table, shared by all metrics; small patches are deleted
+    if (lsm_objects(newFeatures, nx, ny, minPatchSize, patch, &obj) < 1) continue;
 
 
-    #pragma omp parallel firstprivate(kernelSize,numberOfuniquePatches) private(p,u,uniquePatches,ccl,patchperimeters,patchAreas,totalClassArea,totaledgelength,sumFractalDims,mx,vx,validDataPixels,maxVal,logSum,logCounter,ii,jj,ni,nj,np,exists,t,share,kj,ki,sumarea,sumshare,unit_area,unit_perim) shared(ny,nx,nobj,f,nodata,lsm,mask_,CCL,features,phl,newFeatures,KDIST,kfraction,sqkfraction) default(none)
-    {
+    // value metrics from the value tables and maximum of the feature
+    if (value){
 
-      alloc((void**)&uniquePatches, kernelSize, sizeof(int));
-      alloc((void**)&patchperimeters, nobj+1, sizeof(float));
-      alloc((void**)&patchAreas,      nobj+1, sizeof(float));
-      alloc((void**)&exists,          nobj+1, sizeof(int));
+      lsm_tables(features[f].dat[0], newFeatures, nx, ny, nodata, &sat);
 
-      #pragma omp for collapse(2) schedule(guided)
+      if (phl->lsm.omax){
+        for (p=0; p<nc; p++) maxv[p] = (newFeatures[p] && features[f].dat[0][p] != nodata) ? features[f].dat[0][p] : SHRT_MIN;
+        morph_filter(maxv, maxv_, nx, ny, &elem, true, 1);
+      }
+
+      #pragma omp parallel for private(j,p) shared(ny,nx,f,lsm,mask_,features,phl,newFeatures,elem,sat,maxv_) schedule(dynamic,1) default(none)
       for (i=0; i<ny; i++){
       for (j=0; j<nx; j++){
 
@@ -320,190 +840,78 @@ float unit_perim = 0;
         if (!features[f].msk[p] && phl->ftr.exclude) continue;
         if (!newFeatures[p] && !phl->lsm.allpx) continue;
 
-        // loop through a kernel of given size
-        for (u=0; u<numberOfuniquePatches; u++){
-          patchperimeters[uniquePatches[u]] = 0;
-          patchAreas[uniquePatches[u]] = 0;
-          exists[uniquePatches[u]]     = 0;
-          uniquePatches[u] = 0;
-        }
-        numberOfuniquePatches = 0;
-        totalClassArea = 0;
-        totaledgelength = 0;
-        sumFractalDims = 0;
-        logSum = 0;
-        logCounter = 0;
-        validDataPixels = 0;
-        maxVal = 0;
-        mx = vx = 0;
-
+        lsm_value_metrics(&sat, maxv_, &elem, i, j, nx, ny, f, &lsm, phl);
 
-        for (ii=-phl->lsm.radius, ki=0; ii<=phl->lsm.radius; ii++, ki++){
-        for (jj=-phl->lsm.radius, kj=0; jj<=phl->lsm.radius; jj++, kj++){
+      }
+      }
 
-          ni = i+ii; nj = j+jj;
-          np = ni*nx+nj;
-          
-          // if not in circular kernel, skip
-          if (phl->lsm.kernel == _KERNEL_CIRCLE_ && 
-              KDIST[ki][kj] > phl->lsm.radius) continue;
+      free_lsm_tables(&sat);
 
+    }
 
-          // if invalid pixel
-          if (ni < 0 || nj < 0 || ni >= ny || nj >= nx) continue;
 
-          // if not in processing mask
-          if (mask_ != NULL && !mask_[np]) continue;
+    // patch metrics, the window slides along each row
+    if (patch){
 
-          // if nodata
-          if (!features[f].msk[np] && phl->ftr.exclude) continue;
+      #pragma omp parallel private(j,p,win) shared(ny,nx,f,lsm,mask_,obj,features,phl,newFeatures,elem,area,perim,kernelSize) default(none)
+      {
 
-          // if inactive pixel
-          if (!newFeatures[np]) continue;
+        win.r      = elem.r;
+        win.hw     = elem.hw;
+        win.binary = newFeatures;
+        win.edges  = obj.edges;
+        win.ccl    = obj.ccl;
+        win.nact   = 0;
+        alloc((void**)&win.cnt,    obj.nobj+1, sizeof(int));
+        alloc((void**)&win.edge,   obj.nobj+1, sizeof(int));
+        alloc((void**)&win.active, obj.nobj+1, sizeof(int));
+        alloc((void**)&win.pos,    obj.nobj+1, sizeof(int));
 
-          //do not incorporate nodata values in sum
-          if (features[f].dat[0][np] != nodata){
+        #pragma omp for schedule(dynamic,1)
+        for (i=0; i<ny; i++){
 
-            validDataPixels++;
-            if (validDataPixels == 1){
-              mx = features[f].dat[0][np];
-            } else {
-              var_recurrence(features[f].dat[0][np], &mx, &vx, validDataPixels);
-            }
+          lsm_window_first(&win, i, nx, ny);
 
-            if (maxVal < features[f].dat[0][np]) maxVal = features[f].dat[0][np];
+          for (j=0; j<nx; j++){
 
-          }
+            if (j > 0) lsm_window_slide(&win, i, j, nx, ny);
 
-          // natural log is undefined for 0 or negative values
-          if (features[f].dat[0][np] > 0){
-            logSum += (float)log(features[f].dat[0][np]);
-            logCounter++;
-          }
+            p = i*nx+j;
 
+            if (mask_ != NULL && !mask_[p]) continue;
+            if (!features[f].msk[p] && phl->ftr.exclude) continue;
+            if (!newFeatures[p] && !phl->lsm.allpx) continue;
 
-          ccl = CCL[np];
+            lsm_window_metrics(&win, area, perim, kernelSize, i, j, nx, ny, f, &lsm, phl);
 
-          if (ccl > 0 && !exists[ccl]){
-            uniquePatches[numberOfuniquePatches] = ccl;
-            numberOfuniquePatches++;
-            exists[ccl] = true;
-          }
-          if (numberOfuniquePatches == 0) continue;
-      
-          // Increase patch area for that class
-          patchAreas[ccl] += kfraction;
-      
-          // add total class area
-          if (newFeatures[np]) totalClassArea += kfraction;
-
-
-          // At that same position in the patchperimeters array, add edge length
-          if (ii != phl->lsm.radius && ni+1 < ny &&
-              newFeatures[np] != newFeatures[(ni+1)*nx+nj]){
-              patchperimeters[ccl] += sqkfraction;
-              totaledgelength += sqkfraction;
           }
 
-          if (ii != -phl->lsm.radius && ni-1 >= 0 &&
-              newFeatures[np] != newFeatures[(ni-1)*nx+nj]){
-              patchperimeters[ccl] += sqkfraction;
-              totaledgelength += sqkfraction;
-          }
-
-          if (jj != phl->lsm.radius && nj+1 < nx &&
-              newFeatures[np] != newFeatures[ni*nx+(nj+1)]){
-              patchperimeters[ccl] += sqkfraction;
-              totaledgelength += sqkfraction;
         }
-  
-          if (jj != -phl->lsm.radius && nj-1 >= 0 &&
-              newFeatures[np] != newFeatures[ni*nx+(nj-1)]){
-              patchperimeters[ccl] += sqkfraction;
-              totaledgelength += sqkfraction;
-          }
-        
-        }
-        }
-
-
-        if (phl->lsm.ouci) lsm.uci_[f][p] = CCL[p];
-        if (phl->lsm.oavg) lsm.avg_[f][p] = mx;
-        if (phl->lsm.ogeo) lsm.geo_[f][p] = exp(logSum / (float)logCounter);
-        if (phl->lsm.omax) lsm.max_[f][p] = maxVal;
-        if (phl->lsm.oare){
-            if (validDataPixels <= SHRT_MAX) {
-                lsm.are_[f][p] = validDataPixels;
-            } else {
-                lsm.are_[f][p] = SHRT_MAX;
-            }
-            
-        }
-        if (phl->lsm.ostd) lsm.std_[f][p] = standdev(vx, validDataPixels);
-
-
-        // area weight. share of patch area in total class area
-        sumarea = sumshare = 0;
-      
-        for (t=0; t<numberOfuniquePatches; t++){
-          share = patchAreas[uniquePatches[t]] / totalClassArea;
-      
-          sumarea  += share * patchAreas[uniquePatches[t]];
-          sumshare += share;
-      
-        }
-        
-        if (phl->lsm.ompa){
-          if (sumshare > 0){
-                lsm.mpa_[f][p] = (short)(sumarea/sumshare*10000);
-          } else lsm.mpa_[f][p] = 0;
-        }
-
-  
-        if (phl->lsm.oedd) lsm.edd_[f][p] = (short)(totaledgelength / sqrt(kernelSize) * 10000);
-        if (phl->lsm.onbr) lsm.nbr_[f][p] = numberOfuniquePatches;
-        if (phl->lsm.oems) lsm.ems_[f][p] = (short)(totalClassArea * totalClassArea * 10000);
 
-        sumshare = 0;
-        // weighted sum of fractal dimensions
-        for (t=0; t<numberOfuniquePatches; t++){
+        free((void*)win.cnt);
+        free((void*)win.edge);
+        free((void*)win.active);
+        free((void*)win.pos);
 
-          if (patchAreas[uniquePatches[t]]*kernelSize == 1) continue;
-
-            unit_area  = patchAreas[uniquePatches[t]]*kernelSize;
-            unit_perim = patchperimeters[uniquePatches[t]]*sqrt(kernelSize);
-
-            sumshare += patchAreas[uniquePatches[t]];
-            sumFractalDims += patchAreas[uniquePatches[t]] * 
-              (2.0 * log(0.25 * unit_perim)) / log(unit_area);
-
-        }
-
-        //  weighted mean fractal index
-        if (numberOfuniquePatches != 0){
-          if (phl->lsm.ofdi) lsm.fdi_[f][p] = (short) (sumFractalDims / sumshare * 10000);
-        } else{
-          if (phl->lsm.ofdi) lsm.fdi_[f][p] = 0;
-        }
-
-
-      }
       }
 
-      free((void*)uniquePatches);
-      free((void*)patchperimeters);
-      free((void*)patchAreas);
-      free((void*)exists);
-
     }
 
-    free((void*)CCL);
-    free((void*)SIZE);
+    free_lsm_objects(&obj);
 
   }
 
   free((void*)newFeatures);
   free_2D((void**)KDIST, width);
+  free((void*)elem.hw);
+  free((void*)area);
+  free((void*)perim);
+  if (phl->lsm.omax){
+    free((void*)maxv);
+    free((void*)maxv_);
+  }
+
+  lap_profile("lsm_metrics");
 
   *nproduct = nprod;
   return LSM;
@@ -34,16 +34,20 @@ Contact: franz.schug@geo.hu-berlin.de
 #include <stdio.h>   // core input and output functions
 #include <stdlib.h>  // standard general utilities library
 #include <limits.h>  // macro constants of the integer types
+#include <stdint.h>  // fixed-width integer types
+#include <math.h>    // common mathematical functions
 
 
 // check if all needed
 #include "../cross-level/brick-cl.h"
+#include "../cross-level/profile-cl.h"
 #include "../cross-level/cube-cl.h"
 #include "../cross-level/quality-cl.h"
 #include "../cross-level/stats-cl.h"
 #include "../cross-level/cite-cl.h"
 #include "../higher-level/param-hl.h"
 #include "../higher-level/read-ard-hl.h"
+#include "../higher-level/morph-hl.h"
 
 #ifdef __cplusplus
 extern "C" {
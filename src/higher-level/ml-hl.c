@@ -35,6 +35,38 @@ using namespace cv::ml;
 brick_t **compile_ml(ard_t *features, ml_t *ml, par_hl_t *phl, cube_t *cube, int *nproduct);
 brick_t *compile_ml_brick(brick_t *ard, int nb, bool write, char *prodname, par_hl_t *phl);
 
+#define ML_BLOCK 4096 // pixels per block for batched prediction
+
+// block of pixels that is predicted at once
+typedef struct {
+  int n;                  // number of pixels
+  int nmodel, nclass;     // max. number of models and classes per modelset
+  int *pix;               // pixel of each row
+  int *row;               // rows that are still predicted
+  int *nused;             // number of models used for each row
+  int *ipred;             // discrete predictions (n x nmodel)
+  double *mean;           // mean of regression
+  double *mean_old;       // mean of previous model
+  double *var;            // variance of regression
+  double *prob;           // sum of RF votes (n x nclass)
+  int *ntree;             // number of RF votes
+  float *f;               // predictions of one model for the active rows
+  int *vote;              // RF votes of one model for the active rows (n x nclass)
+} ml_block_t;
+
+// predictions of a whole chunk on the device
+typedef struct {
+  int nc;                 // number of cells
+  float **pred;           // prediction of each model (nmodel x nc)
+  int **votes;            // RF votes summed over each modelset (nclass x nc)
+} ml_gpu_t;
+
+void ml_nodata(ml_t *ml, int p, short nodata, par_hl_t *phl);
+int ml_device(ard_t *features, small *mask_, int nf, int nc, par_hl_t *phl, aux_ml_t *mod, bool rfprob, ml_gpu_t *dev);
+void free_ml_device(ml_gpu_t *dev, par_hl_t *phl);
+void predict_ml_model(aux_ml_t *mod, ml_gpu_t *dev, ml_block_t *blk, Mat &samples, int k, int nact, int nclass, bool rf, bool rfprob);
+void predict_ml_set(ml_t *ml, aux_ml_t *mod, ml_gpu_t *dev, ml_block_t *blk, Mat &samples, int s, int k0, int sc0, bool regression, bool rf, bool rfprob, par_hl_t *phl);
+
 
 /** This function compiles the bricks, in which ML results are stored. 
 +++ It also sets metadata and sets pointers to instantly useable image 
@@ -181,6 +213,367 @@ int nchar;
 }
 
 
+/** This function writes nodata to all ML outputs of one pixel
+--- ml:     pointer to instantly useable ML image arrays
+--- p:      pixel
+--- nodata: nodata value
+--- phl:    HL parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void ml_nodata(ml_t *ml, int p, short nodata, par_hl_t *phl){
+int s, c, sc;
+
+
+  for (s=0, sc=0; s<phl->mcl.nmodelset; s++){
+    if (ml->mlp_ != NULL) ml->mlp_[s][p] = nodata;
+    if (ml->mli_ != NULL) ml->mli_[s][p] = nodata;
+    if (ml->mlu_ != NULL) ml->mlu_[s][p] = nodata;
+    if (ml->rfm_ != NULL) ml->rfm_[s][p] = nodata;
+    for (c=0; c<phl->mcl.nclass[s]; c++, sc++){
+      if (ml->rfp_ != NULL) ml->rfp_[sc][p] = nodata;
+    }
+  }
+
+  return;
+}
+
+
+/** This function predicts one model for the active pixels of a block.
++++ The predictions come from the device if the chunk was predicted on
++++ the GPU, from the flat random forest if available, and from OpenCV
++++ otherwise. For RF probabilities, the winning class is predicted, and
++++ the votes are returned.
+--- mod:     machine learning model
+--- dev:     predictions of the device (or NULL)
+--- blk:     block of pixels (f and vote are returned)
+--- samples: features of the block (one row per pixel)
+--- k:       model
+--- nact:    number of active pixels
+--- nclass:  number of classes
+--- rf:      random forest or SVM?
+--- rfprob:  compute RF class probabilities?
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void predict_ml_model(aux_ml_t *mod, ml_gpu_t *dev, ml_block_t *blk, Mat &samples, int k, int nact, int nclass, bool rf, bool rfprob){
+int j, c, vt, max_prob, win_class;
+Mat input, result, vote;
+
+
+  // chunk was predicted on the device
+  if (dev != NULL){
+    for (j=0; j<nact; j++) blk->f[j] = dev->pred[k][blk->pix[blk->row[j]]];
+    return;
+  }
+
+  // flat random forest
+  if (rf && mod->rf_flat[k] != NULL){
+    rf_flat_predict(mod->rf_flat[k], samples.ptr<float>(0), blk->row, nact, blk->f, (rfprob) ? blk->vote : NULL);
+    return;
+  }
+
+
+  // pixels that are still active
+  if (nact == blk->n){
+    input = samples.rowRange(0, nact);
+  } else {
+    input = Mat(nact, samples.cols, CV_32F);
+    for (j=0; j<nact; j++) samples.row(blk->row[j]).copyTo(input.row(j));
+  }
+
+  if (rfprob){
+
+    // 1st row: class labels, then one row per sample
+    mod->rf_model[k]->getVotes(input, vote, 0);
+
+    for (j=0; j<nact; j++){
+
+      win_class = 0;
+      max_prob  = 0;
+
+      for (c=0; c<nclass; c++){
+        vt = vote.at<int>(j+1,c);
+        blk->vote[j*nclass+c] = vt;
+        if (vt > max_prob){
+          win_class = vote.at<int>(0,c);
+          max_prob  = vt;
+        }
+      }
+
+      blk->f[j] = win_class;
+
+    }
+
+  } else {
+
+    if (rf){
+      mod->rf_model[k]->predict(input, result);
+    } else {
+      mod->sv_model[k]->predict(input, result);
+    }
+
+    for (j=0; j<nact; j++) blk->f[j] = result.at<float>(j,0);
+
+  }
+
+  return;
+}
+
+
+/** This function predicts one modelset for a block of pixels. Each model
++++ is called once for all pixels of the block. In case of regression, 
++++ pixels whose mean prediction converged are removed from the block 
++++ before the next model is called.
+--- ml:         pointer to instantly useable ML image arrays
+--- mod:        machine learning model
+--- dev:        predictions of the device (or NULL)
+--- blk:        block of pixels
+--- samples:    features of the block (one row per pixel)
+--- s:          modelset
+--- k0:         index of first model of the modelset
+--- sc0:        index of first class of the modelset
+--- regression: regression or classification?
+--- rf:         random forest or SVM?
+--- rfprob:     compute RF class probabilities?
+--- phl:        HL parameters
++++ Return:     void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void predict_ml_set(ml_t *ml, aux_ml_t *mod, ml_gpu_t *dev, ml_block_t *blk, Mat &samples, int s, int k0, int sc0, bool regression, bool rf, bool rfprob, par_hl_t *phl){
+int i, j, n, m, c, p, nact;
+int max_prob, max2_prob;
+double mn, std, f;
+double *prob = NULL;
+
+
+  for (i=0; i<blk->n; i++){
+    blk->row[i]  = i;
+    blk->nused[i] = 0;
+    blk->mean[i] = blk->mean_old[i] = blk->var[i] = 0;
+  }
+
+  if (rfprob){
+    memset(blk->prob,  0, blk->n*blk->nclass*sizeof(double));
+    memset(blk->ntree, 0, blk->n*sizeof(int));
+  }
+
+  nact = blk->n;
+
+  for (m=0; m<phl->mcl.nmodel[s] && nact > 0; m++){
+
+    predict_ml_model(mod, dev, blk, samples, k0+m, nact, phl->mcl.nclass[s], rf, rfprob);
+
+    for (j=0, n=0; j<nact; j++){
+
+      i = blk->row[j];
+      f = blk->f[j];
+
+      blk->ipred[i*blk->nmodel+m] = (int)f;
+      blk->nused[i] = m+1;
+
+      if (rfprob && dev == NULL){
+        prob = blk->prob + i*blk->nclass;
+        for (c=0; c<phl->mcl.nclass[s]; c++){
+          prob[c] += blk->vote[j*phl->mcl.nclass[s]+c];
+          blk->ntree[i] += blk->vote[j*phl->mcl.nclass[s]+c];
+        }
+      }
+
+      if (regression){
+
+        if (m == 0){
+          blk->mean[i] = f;
+        } else {
+          var_recurrence(f, &blk->mean[i], &blk->var[i], m+1);
+        }
+
+        // converged, remove pixel from block
+        if (m > 1 && fabs(blk->mean[i]-blk->mean_old[i]) < phl->mcl.converge) continue;
+        blk->mean_old[i] = blk->mean[i];
+
+      }
+
+      blk->row[n++] = i;
+
+    }
+
+    nact = n;
+
+  }
+
+  // votes were summed over the modelset on the device
+  if (rfprob && dev != NULL){
+    for (i=0; i<blk->n; i++){
+      p    = blk->pix[i];
+      prob = blk->prob + i*blk->nclass;
+      for (c=0; c<phl->mcl.nclass[s]; c++){
+        prob[c] = dev->votes[s][(size_t)c*dev->nc+p];
+        blk->ntree[i] += dev->votes[s][(size_t)c*dev->nc+p];
+      }
+    }
+  }
+
+
+  for (i=0; i<blk->n; i++){
+
+    p = blk->pix[i];
+    m = blk->nused[i];
+
+    if (regression){
+      mn  = blk->mean[i]*phl->mcl.scale;
+      if (mn > SHRT_MAX) mn = SHRT_MAX;
+      if (mn < SHRT_MIN) mn = SHRT_MIN;
+      if (ml->mlp_ != NULL) ml->mlp_[s][p] = (short)mn;  
+      std = standdev(blk->var[i], m)*10000.0;
+      if (std > SHRT_MAX) std = SHRT_MAX;
+      if (ml->mlu_ != NULL) ml->mlu_[s][p] = (short)(std);
+    } else {
+      if (ml->mlp_ != NULL) ml->mlp_[s][p] = (short)mode(blk->ipred+i*blk->nmodel, phl->mcl.nmodel[s]);
+    }
+
+    if (ml->mli_ != NULL) ml->mli_[s][p] = m;
+
+    if (rfprob){
+
+      prob = blk->prob + i*blk->nclass;
+
+      for (c=0; c<phl->mcl.nclass[s]; c++) prob[c] /= (blk->ntree[i]*0.0001);
+
+      if (ml->rfp_ != NULL){
+        for (c=0; c<phl->mcl.nclass[s]; c++) ml->rfp_[sc0+c][p] = (short)prob[c];
+      }
+      
+      if (ml->rfm_ != NULL){
+        max_prob = max2_prob  = 0;
+        for (c=0; c<phl->mcl.nclass[s]; c++){
+          if (prob[c] > max_prob) max_prob = prob[c];
+        }
+        for (c=0; c<phl->mcl.nclass[s]; c++){
+          if (prob[c] > max2_prob && prob[c] < max_prob) max2_prob = prob[c];
+        }
+        ml->rfm_[s][p] = max_prob-max2_prob;
+      }
+
+    }
+
+  }
+
+  return;
+}
+
+
+/** This function predicts all random forests of a chunk on the GPU. The 
++++ feature bricks must have device copies. All models are evaluated, the
++++ convergence of regressions is applied when the predictions are 
++++ collected. Without GPU, or if any forest could not be flattened, the
++++ chunk is predicted on the CPU.
+--- features: input features
+--- mask_:    mask image (or NULL)
+--- nf:       number of features
+--- nc:       number of cells
+--- phl:      HL parameters
+--- mod:      machine learning model
+--- rfprob:   compute RF class probabilities?
+--- dev:      predictions of the device (returned)
++++ Return:   SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int ml_device(ard_t *features, small *mask_, int nf, int nc, par_hl_t *phl, aux_ml_t *mod, bool rfprob, ml_gpu_t *dev){
+rf_gpu_t job;
+const short **ptr = NULL;
+small *valid = NULL;
+int f, s, k, p, nmodel = 0;
+int status = SUCCESS;
+
+
+  memset(dev, 0, sizeof(ml_gpu_t));
+
+  if (!phl->gpu) return CANCEL;
+
+  if (phl->mcl.method != _ML_RFR_ && phl->mcl.method != _ML_RFC_) return CANCEL;
+
+  for (s=0; s<phl->mcl.nmodelset; s++) nmodel += phl->mcl.nmodel[s];
+
+  for (k=0; k<nmodel; k++){
+    if (mod->rf_flat[k] == NULL) return CANCEL;
+  }
+
+  for (f=0; f<nf; f++){
+    if (features[f].GPU == NULL) return CANCEL;
+  }
+
+
+  alloc((void**)&ptr,   nf, sizeof(short*));
+  alloc((void**)&valid, nc, sizeof(small));
+
+  for (f=0; f<nf; f++) ptr[f] = (const short*)get_gpu_band(features[f].GPU, 0);
+
+  for (p=0; p<nc; p++){
+    valid[p] = (mask_ == NULL || mask_[p]);
+    for (f=0; f<nf && valid[p]; f++){
+      if (!features[f].msk[p] && phl->ftr.exclude) valid[p] = false;
+    }
+  }
+
+  dev->nc = nc;
+  alloc_2D((void***)&dev->pred, nmodel, nc, sizeof(float));
+  alloc((void**)&dev->votes, phl->mcl.nmodelset, sizeof(int*));
+
+
+  for (s=0, k=0; s<phl->mcl.nmodelset && status == SUCCESS; s++){
+
+    if (rfprob) alloc((void**)&dev->votes[s], phl->mcl.nclass[s]*nc, sizeof(int));
+
+    memset(&job, 0, sizeof(rf_gpu_t));
+    job.nc      = nc;
+    job.nf      = nf;
+    job.feature = ptr;
+    job.valid   = valid;
+    job.nmodel  = phl->mcl.nmodel[s];
+    job.rf      = mod->rf_flat.data()+k;
+    job.nclass  = (phl->mcl.method == _ML_RFC_) ? phl->mcl.nclass[s] : 0;
+    job.pred    = dev->pred+k;
+    job.votes   = dev->votes[s];
+
+    // the features were copied in this stream
+    status = rf_gpu(&job, features[0].GPU->stream);
+
+    k += phl->mcl.nmodel[s];
+
+  }
+
+  free((void*)ptr);
+  free((void*)valid);
+
+  if (status != SUCCESS) free_ml_device(dev, phl);
+
+  return status;
+}
+
+
+/** This function frees the predictions of the device
+--- dev:    predictions of the device
+--- phl:    HL parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_ml_device(ml_gpu_t *dev, par_hl_t *phl){
+int s, nmodel = 0;
+
+
+  for (s=0; s<phl->mcl.nmodelset; s++) nmodel += phl->mcl.nmodel[s];
+
+  if (dev->pred != NULL) free_2D((void**)dev->pred, nmodel);
+  
+  if (dev->votes != NULL){
+    for (s=0; s<phl->mcl.nmodelset; s++){
+      if (dev->votes[s] != NULL) free((void*)dev->votes[s]);
+    }
+    free((void*)dev->votes);
+  }
+
+  memset(dev, 0, sizeof(ml_gpu_t));
+
+  return;
+}
+
+
 /** public functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
@@ -202,14 +595,16 @@ brick_t **ML;
 small *mask_ = NULL;
 bool regression;
 bool rf, rfprob;
-float **fpred = NULL;
-int   **ipred = NULL;
+ml_block_t blk;
+ml_gpu_t dev;
+ml_gpu_t *dev_ = NULL;
+float *row = NULL;
+int *pix = NULL, *nvalid = NULL;
+int *k0 = NULL, *sc0 = NULL;
 int nprod = 0;
-int mmax = -1;
-int f, s, m, k, c, sc, p, nc;
-double mean, mean_old, var, std, mn;
-double *mean_prob;
-int max_prob, max2_prob, win_class, ntree;
+int mmax = -1, cmax = 0;
+int f, s, k, sc, b, n, p, p0, p1, nc, nblock;
+int ncv;
 short nodata;
 bool valid;
 
@@ -234,6 +629,8 @@ bool valid;
     return NULL;
   }
 
+  lap_profile("ml_compile");
+
   
   if (phl->mcl.method == _ML_SVR_ || phl->mcl.method == _ML_RFR_) regression = true; else regression = false;
   if (phl->mcl.method == _ML_RFR_ || phl->mcl.method == _ML_RFC_) rf = true; else rf = false;
@@ -243,6 +640,7 @@ bool valid;
   // maximum number of models
   for (s=0; s<phl->mcl.nmodelset; s++){
     if (phl->mcl.nmodel[s] > mmax) mmax = phl->mcl.nmodel[s];
+    if (phl->mcl.nclass[s] > cmax) cmax = phl->mcl.nclass[s];
   }
 
   if (mmax < 0){
@@ -253,150 +651,137 @@ bool valid;
 
 
 
-  #pragma omp parallel private(f,s,m,k,c,sc,mean,mn,mean_old,var,std,fpred,ipred,mean_prob,max_prob,max2_prob,win_class,ntree,valid) shared(features,mod,regression,rf,rfprob,ml,nf,nc,mask_,phl,ML,nodata,mmax) default(none)
-  {
+  // predict the whole chunk on the device, if possible
+  if (ml_device(features, mask_, nf, nc, phl, mod, rfprob, &dev) == SUCCESS){
+    dev_ = &dev;
+    lap_profile("ml_device");
+  }
+
+
+  // first model and class of each modelset
+  alloc((void**)&k0,  phl->mcl.nmodelset, sizeof(int));
+  alloc((void**)&sc0, phl->mcl.nmodelset, sizeof(int));
+
+  for (s=0, k=0, sc=0; s<phl->mcl.nmodelset; s++){
+    k0[s]  = k;  k  += phl->mcl.nmodel[s];
+    sc0[s] = sc; sc += phl->mcl.nclass[s];
+  }
+
+
+  // convert the features once for all modelsets; the valid pixels of 
+  // each block are stored at the beginning of the block's rows
+  nblock = (nc + ML_BLOCK - 1) / ML_BLOCK;
+
+  Mat samples(nc, nf, CV_32F);
+  alloc((void**)&pix,    nc,     sizeof(int));
+  alloc((void**)&nvalid, nblock, sizeof(int));
+
+  #pragma omp parallel for private(f,p,p0,p1,n,valid,row) shared(features,samples,pix,nvalid,ml,nf,nc,mask_,phl,nodata,nblock) schedule(dynamic,1) default(none)
+  for (b=0; b<nblock; b++){
 
-    alloc_2D((void***)&fpred, phl->mcl.nmodelset, mmax, sizeof(float));
-    alloc_2D((void***)&ipred, phl->mcl.nmodelset, mmax, sizeof(int));
-    if (rfprob) alloc((void**)&mean_prob, phl->mcl.nclass_all_sets, sizeof(double));
+    p0 = b*ML_BLOCK;
+    if ((p1 = p0+ML_BLOCK) > nc) p1 = nc;
 
-    #pragma omp for schedule(dynamic,1)
-    for (p=0; p<nc; p++){
+    for (p=p0, n=p0; p<p1; p++){
 
       // skip pixels that are masked
       if (mask_ != NULL && !mask_[p]){
-        for (s=0, sc=0; s<phl->mcl.nmodelset; s++){
-          if (ml.mlp_ != NULL) ml.mlp_[s][p] = nodata;
-          if (ml.mli_ != NULL) ml.mli_[s][p] = nodata;
-          if (ml.mlu_ != NULL) ml.mlu_[s][p] = nodata;
-          if (ml.rfm_ != NULL) ml.rfm_[s][p] = nodata;
-          for (c=0; c<phl->mcl.nclass[s]; c++, sc++){
-            if (ml.rfp_ != NULL) ml.rfp_[sc][p] = nodata;
-          }
-        }
+        ml_nodata(&ml, p, nodata, phl);
         continue;
       }
 
-      Mat sample(1, nf, CV_32F);
+      row = samples.ptr<float>(n);
       for (f=0, valid=true; f<nf; f++){
-        sample.at<float>(0,f) = features[f].dat[0][p]/10000.0;
+        row[f] = features[f].dat[0][p]/10000.0;
         if (!features[f].msk[p] && phl->ftr.exclude) valid=false;
       }
 
       if (!valid){
-        for (s=0, sc=0; s<phl->mcl.nmodelset; s++){
-          if (ml.mlp_ != NULL) ml.mlp_[s][p] = nodata;
-          if (ml.mli_ != NULL) ml.mli_[s][p] = nodata;
-          if (ml.mlu_ != NULL) ml.mlu_[s][p] = nodata;
-          if (ml.rfm_ != NULL) ml.rfm_[s][p] = nodata;
-          for (c=0; c<phl->mcl.nclass[s]; c++, sc++){
-            if (ml.rfp_ != NULL) ml.rfp_[sc][p] = nodata;
-          }
-        }
+        ml_nodata(&ml, p, nodata, phl);
         continue;
       }
 
-      for (s=0, k=0, sc=0; s<phl->mcl.nmodelset; s++){
-        
-        mean = mean_old = var = 0;
-        ntree = 0;
-        if (rfprob) memset(mean_prob, 0, phl->mcl.nclass_all_sets*sizeof(double));
-
-        for (m=0; m<phl->mcl.nmodel[s]; m++, k++){
-
-          if (rfprob){
-
-            Mat vote;
-            mod->rf_model[k]->getVotes(sample, vote, 0);
-
-            win_class = 0;
-            max_prob  = 0;
-
-            for (c=0; c<phl->mcl.nclass[s]; c++){
-              mean_prob[c] += vote.at<int>(1,c);
-              ntree += vote.at<int>(1,c);
-              if (vote.at<int>(1,c) > max_prob){
-                win_class = vote.at<int>(0,c);
-                max_prob  = vote.at<int>(1,c);
-              }
-            }
-
-
-            ipred[s][m] = win_class;
+      pix[n++] = p;
 
-          } else {
-
-            if (rf){
-              fpred[s][m] = mod->rf_model[k]->predict(sample);
-            } else {
-              fpred[s][m] = mod->sv_model[k]->predict(sample);
-            }
-            ipred[s][m] = (int)fpred[s][m];
-
-          }
-
-          if (regression){
+    }
 
-            if (m == 0){
-              mean = fpred[s][m];
-            } else {
-              var_recurrence(fpred[s][m], &mean, &var, m+1);
-            }
+    nvalid[b] = n-p0;
 
-            if (m > 1 && fabs(mean-mean_old) < phl->mcl.converge){ k += phl->mcl.nmodel[s]-m; m++; break;}
-            mean_old = mean;
+  }
 
-          }
+  lap_profile("ml_features");
 
-        }
 
-        if (regression){
-          mn  = mean*phl->mcl.scale;
-          if (mn > SHRT_MAX) mn = SHRT_MAX;
-          if (mn < SHRT_MIN) mn = SHRT_MIN;
-          if (ml.mlp_ != NULL) ml.mlp_[s][p] = (short)mn;  
-          std = standdev(var, m)*10000.0;
-          if (std > SHRT_MAX) std = SHRT_MAX;
-          if (ml.mlu_ != NULL) ml.mlu_[s][p] = (short)(std);
-        } else {
-          if (ml.mlp_ != NULL) ml.mlp_[s][p] = (short)mode(ipred[s], phl->mcl.nmodel[s]);
-        }
+  // OpenCV threads are disabled, each modelset of each pixel block is
+  // an independent task
+  ncv = getNumThreads();
+  setNumThreads(0);
 
-        if (ml.mli_ != NULL) ml.mli_[s][p] = m;
 
-        if (rfprob){
+  #pragma omp parallel private(b,s,blk) shared(samples,pix,nvalid,k0,sc0,mod,dev_,regression,rf,rfprob,ml,phl,nblock,mmax,cmax) default(none)
+  {
 
-          for (c=0; c<phl->mcl.nclass[s]; c++) mean_prob[c] /= (ntree*0.0001);
+    Mat block;
+
+    blk.nmodel = mmax;
+    blk.nclass = cmax;
+    alloc((void**)&blk.row,      ML_BLOCK, sizeof(int));
+    alloc((void**)&blk.nused,    ML_BLOCK, sizeof(int));
+    alloc((void**)&blk.ipred,    ML_BLOCK*mmax, sizeof(int));
+    alloc((void**)&blk.mean,     ML_BLOCK, sizeof(double));
+    alloc((void**)&blk.mean_old, ML_BLOCK, sizeof(double));
+    alloc((void**)&blk.var,      ML_BLOCK, sizeof(double));
+    alloc((void**)&blk.f,        ML_BLOCK, sizeof(float));
+    alloc((void**)&blk.vote,     ML_BLOCK*cmax, sizeof(int));
+    if (rfprob){
+      alloc((void**)&blk.prob,  ML_BLOCK*cmax, sizeof(double));
+      alloc((void**)&blk.ntree, ML_BLOCK, sizeof(int));
+    } else {
+      blk.prob  = NULL;
+      blk.ntree = NULL;
+    }
 
-          if (ml.rfp_ != NULL){
-            for (c=0; c<phl->mcl.nclass[s]; c++) ml.rfp_[sc++][p] = (short)mean_prob[c];
-          }
-          
-          if (ml.rfm_ != NULL){
-            max_prob = max2_prob  = 0;
-            for (c=0; c<phl->mcl.nclass[s]; c++){
-              if (mean_prob[c] > max_prob) max_prob = mean_prob[c];
-            }
-            for (c=0; c<phl->mcl.nclass[s]; c++){
-              if (mean_prob[c] > max2_prob && mean_prob[c] < max_prob) max2_prob = mean_prob[c];
-            }
-            ml.rfm_[s][p] = max_prob-max2_prob;
-          }
+    #pragma omp for collapse(2) schedule(dynamic,1)
+    for (b=0; b<nblock; b++){
+    for (s=0; s<phl->mcl.nmodelset; s++){
 
-        }
+      if ((blk.n = nvalid[b]) == 0) continue;
 
-      }
+      blk.pix = pix + b*ML_BLOCK;
+      block   = samples.rowRange(b*ML_BLOCK, b*ML_BLOCK+blk.n);
 
+      predict_ml_set(&ml, mod, dev_, &blk, block, s, k0[s], sc0[s], regression, rf, rfprob, phl);
 
     }
+    }
     
     
-    free_2D((void**)fpred, phl->mcl.nmodelset);
-    free_2D((void**)ipred, phl->mcl.nmodelset);
-    if (rfprob) free((void*)mean_prob);
+    free((void*)blk.row);
+    free((void*)blk.nused);
+    free((void*)blk.ipred);
+    free((void*)blk.mean);
+    free((void*)blk.mean_old);
+    free((void*)blk.var);
+    free((void*)blk.f);
+    free((void*)blk.vote);
+    if (rfprob){
+      free((void*)blk.prob);
+      free((void*)blk.ntree);
+    }
 
   }
 
+  setNumThreads(ncv);
+
+  if (dev_ != NULL) free_ml_device(dev_, phl);
+
+  lap_profile("ml_predict");
+
+  free((void*)pix);
+  free((void*)nvalid);
+  free((void*)k0);
+  free((void*)sc0);
+
   *nproduct = nprod;
   return ML;
 }
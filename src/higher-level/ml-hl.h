@@ -36,9 +36,12 @@ Machine learning header
 #include "../cross-level/const-cl.h"
 #include "../cross-level/string-cl.h"
 #include "../cross-level/brick-cl.h"
+#include "../cross-level/profile-cl.h"
 #include "../cross-level/stats-cl.h"
 #include "../higher-level/param-hl.h"
 #include "../higher-level/read-ard-hl.h"
+#include "../higher-level/rf-hl.h"
+#include "../higher-level/rf-gpu-hl.h"
 
 
 #ifdef __cplusplus
@@ -49,6 +52,7 @@ typedef struct {
   //std::vector<cv::Ptr<cv::ml::StatModel>> model;
   std::vector<cv::Ptr<cv::ml::RTrees>> rf_model;
   std::vector<cv::Ptr<cv::ml::SVM>> sv_model;
+  std::vector<rf_flat_t*> rf_flat; // flat copies of rf_model, NULL: not available
 } aux_ml_t;
 
 typedef struct {
@@ -0,0 +1,331 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains grey-level morphology on the GPU. The kernels mirror
+morph_erode and chord_erode in morph-hl.c: one thread per row segment 
+computes the van Herk/Gil-Werman running minima, and one thread per 
+pixel folds the chords of all element rows with the same width. Without
+FORCE_CUDA, this file is compiled as C++ and morph_gpu always cancels.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "morph-gpu-hl.h"
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define GPU_NTHREAD 256
+
+// device buffers of one job
+typedef struct {
+  int nx, ny, r;          // number of columns, rows, radius of element
+  int wmax, stride;       // max. chord half-width, row stride of g and h
+  const int *dy;          // row offsets, grouped by chord width (device)
+  int *off, *cnt;         // first offset and number of offsets per width (host)
+  short *A, *B;           // ping-pong images
+  short *g, *h;           // running minima (ny x stride)
+} gpu_morph_t;
+
+
+/** kernels
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+__global__ void fill_kernel(short *img, int n, short value){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+
+  if (p < n) img[p] = value;
+}
+
+
+__global__ void complement_kernel(const short *src, short *dst, int n){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+
+  if (p < n) dst[p] = ~src[p];
+}
+
+
+// running minima of one segment of one padded row, see chord_erode
+__global__ void segment_kernel(const short *src, int nx, int ny, int w, int nseg, int stride, short *g, short *h){
+int i = blockIdx.x*blockDim.x + threadIdx.x;
+int k = 2*w+1;
+int ys, b, j;
+short v, m;
+const short *row = NULL;
+
+
+  if (i >= nseg*ny) return;
+
+  ys  = i / nseg;
+  b   = (i % nseg)*k;
+  row = src + (size_t)ys*nx;
+  g  += (size_t)ys*stride;
+  h  += (size_t)ys*stride;
+
+  for (j=b, m=SHRT_MAX; j<b+k; j++){
+    v = (j < w || j >= nx+w) ? SHRT_MAX : row[j-w];
+    if (v < m) m = v;
+    g[j] = m;
+  }
+
+  for (j=b+k-1, m=SHRT_MAX; j>=b; j--){
+    v = (j < w || j >= nx+w) ? SHRT_MAX : row[j-w];
+    if (v < m) m = v;
+    h[j] = m;
+  }
+
+  return;
+}
+
+
+// fold the chords of width w into the eroded image, see morph_erode
+__global__ void fold_kernel(const short *g, const short *h, int nx, int ny, int w, int stride, const int *dy, int ndy, short *dst){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+int x, y, ys, i, k = 2*w+1;
+size_t q;
+short v;
+
+
+  if (p >= nx*ny) return;
+
+  x = p % nx;
+  y = p / nx;
+  v = dst[p];
+
+  for (i=0; i<ndy; i++){
+    if ((ys = y+dy[i]) < 0 || ys >= ny) continue;
+    q = (size_t)ys*stride+x;
+    if (h[q]     < v) v = h[q];
+    if (g[q+k-1] < v) v = g[q+k-1];
+  }
+
+  dst[p] = v;
+
+  return;
+}
+
+
+/** This function erodes an image once on the device
+--- m:      device buffers
+--- src:    image (device)
+--- dst:    eroded image (device, returned)
+--- s:      CUDA stream
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void erode_device(gpu_morph_t *m, const short *src, short *dst, cudaStream_t s){
+int w, k, nseg, n = m->nx*m->ny;
+
+
+  fill_kernel<<<(n+GPU_NTHREAD-1)/GPU_NTHREAD, GPU_NTHREAD, 0, s>>>(dst, n, SHRT_MAX);
+
+  for (w=0; w<=m->wmax; w++){
+
+    if (m->cnt[w] == 0) continue;
+
+    // segments of the padded row
+    k = 2*w+1;
+    nseg = (m->nx+2*w+k-1)/k;
+
+    segment_kernel<<<(nseg*m->ny+GPU_NTHREAD-1)/GPU_NTHREAD, GPU_NTHREAD, 0, s>>>(
+      src, m->nx, m->ny, w, nseg, m->stride, m->g, m->h);
+
+    fold_kernel<<<(n+GPU_NTHREAD-1)/GPU_NTHREAD, GPU_NTHREAD, 0, s>>>(
+      m->g, m->h, m->nx, m->ny, w, m->stride, m->dy+m->off[w], m->cnt[w], dst);
+
+  }
+
+  return;
+}
+
+
+/** This function computes an iterated erosion or dilation on the device,
++++ see morph_filter
+--- m:      device buffers
+--- src:    image (device)
+--- dst:    filtered image (device, returned), may not be src, A or B
+--- dilate: dilate or erode?
+--- iter:   number of iterations
+--- s:      CUDA stream
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void filter_device(gpu_morph_t *m, const short *src, short *dst, bool dilate, int iter, cudaStream_t s){
+int it, n = m->nx*m->ny, nblock = (n+GPU_NTHREAD-1)/GPU_NTHREAD;
+const short *cur = src;
+short *next = NULL;
+
+
+  if (iter < 1){
+    cudaMemcpyAsync(dst, src, n*sizeof(short), cudaMemcpyDeviceToDevice, s);
+    return;
+  }
+
+  if (dilate){
+    complement_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(src, m->B, n);
+    cur = m->B;
+  }
+
+  for (it=0; it<iter; it++){
+    next = (cur == m->A) ? m->B : m->A;
+    erode_device(m, cur, next, s);
+    cur = next;
+  }
+
+  if (dilate){
+    complement_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(cur, dst, n);
+  } else {
+    cudaMemcpyAsync(dst, cur, n*sizeof(short), cudaMemcpyDeviceToDevice, s);
+  }
+
+  return;
+}
+
+#endif
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function computes the morphological products of an image on the
++++ GPU, see morph_products. The image (job->src) must already be on the
++++ device, enqueued in the same stream. The function returns after the
++++ downloads are complete.
+--- job:    morphology job
+--- stream: stream of the processing unit
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int morph_gpu(morph_gpu_t *job, gpu_stream_t stream){
+#ifdef FORCE_CUDA
+cudaStream_t s = (cudaStream_t)gpu_cuda_stream(stream);
+gpu_morph_t m;
+int *dy = NULL;
+int d, w, i, nd;
+size_t bytes_img, bytes_row, bytes_dy;
+short *E = NULL, *D = NULL, *T = NULL;
+int error = 0;
+
+
+  if (!gpu_enabled() || gpu_select(stream) == FAILURE) return CANCEL;
+
+  memset(&m, 0, sizeof(gpu_morph_t));
+  m.nx = job->nx;
+  m.ny = job->ny;
+  m.r  = job->elem->r;
+  nd   = 2*m.r+1;
+
+  for (d=0, m.wmax=-1; d<nd; d++){
+    if (job->elem->hw[d] > m.wmax) m.wmax = job->elem->hw[d];
+  }
+  if (m.wmax < 0) return CANCEL;
+
+  m.stride = m.nx+4*m.wmax+1;
+
+  // row offsets of the element, grouped by chord width
+  alloc((void**)&dy,    nd,       sizeof(int));
+  alloc((void**)&m.off, m.wmax+1, sizeof(int));
+  alloc((void**)&m.cnt, m.wmax+1, sizeof(int));
+
+  for (w=0, i=0; w<=m.wmax; w++){
+    m.off[w] = i;
+    for (d=0; d<nd; d++){
+      if (job->elem->hw[d] == w) dy[i++] = d-m.r;
+    }
+    m.cnt[w] = i-m.off[w];
+  }
+
+  bytes_img = (size_t)m.nx*m.ny*sizeof(short);
+  bytes_row = (size_t)m.stride*m.ny*sizeof(short);
+  bytes_dy  = nd*sizeof(int);
+
+  if ((m.A = (short*)gpu_alloc(bytes_img, stream)) == NULL) error++;
+  if ((m.B = (short*)gpu_alloc(bytes_img, stream)) == NULL) error++;
+  if ((T   = (short*)gpu_alloc(bytes_img, stream)) == NULL) error++;
+  if ((m.g = (short*)gpu_alloc(bytes_row, stream)) == NULL) error++;
+  if ((m.h = (short*)gpu_alloc(bytes_row, stream)) == NULL) error++;
+  if ((m.dy = (const int*)gpu_alloc(bytes_dy, stream)) == NULL) error++;
+  if ((job->out.ero != NULL || job->out.opn != NULL) &&
+      (E = (short*)gpu_alloc(bytes_img, stream)) == NULL) error++;
+  if ((job->out.dil != NULL || job->out.cls != NULL) &&
+      (D = (short*)gpu_alloc(bytes_img, stream)) == NULL) error++;
+
+
+  if (!error){
+
+    cudaMemcpyAsync((void*)m.dy, dy, bytes_dy, cudaMemcpyHostToDevice, s);
+
+    if (E != NULL){
+      filter_device(&m, job->src, E, false, job->iter, s);
+      if (job->out.ero != NULL) cudaMemcpyAsync(job->out.ero, E, bytes_img, cudaMemcpyDeviceToHost, s);
+      if (job->out.opn != NULL){
+        filter_device(&m, E, T, true, job->iter, s);
+        cudaMemcpyAsync(job->out.opn, T, bytes_img, cudaMemcpyDeviceToHost, s);
+      }
+    }
+
+    // T is only recycled after its download, the stream is in order
+    if (D != NULL){
+      filter_device(&m, job->src, D, true, job->iter, s);
+      if (job->out.dil != NULL) cudaMemcpyAsync(job->out.dil, D, bytes_img, cudaMemcpyDeviceToHost, s);
+      if (job->out.cls != NULL){
+        filter_device(&m, D, T, false, job->iter, s);
+        cudaMemcpyAsync(job->out.cls, T, bytes_img, cudaMemcpyDeviceToHost, s);
+      }
+    }
+
+    if (cudaGetLastError() != cudaSuccess){
+      printf("launching morphology kernels failed. ");
+      error++;
+    }
+
+  }
+
+  if (gpu_sync(stream) == FAILURE) error++;
+
+
+  gpu_release(m.A,         bytes_img, stream);
+  gpu_release(m.B,         bytes_img, stream);
+  gpu_release(T,           bytes_img, stream);
+  gpu_release(m.g,         bytes_row, stream);
+  gpu_release(m.h,         bytes_row, stream);
+  gpu_release((void*)m.dy, bytes_dy,  stream);
+  gpu_release(E,           bytes_img, stream);
+  gpu_release(D,           bytes_img, stream);
+
+  free((void*)dy);
+  free((void*)m.off);
+  free((void*)m.cnt);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
@@ -0,0 +1,59 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Morphology on the GPU header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef MORPHGPU_HL_H
+#define MORPHGPU_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/gpu-cl.h"
+#include "../higher-level/morph-hl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// morphological products of one image on the device
+typedef struct {
+  int nx, ny;             // number of columns, rows
+  morph_elem_t *elem;     // structuring element (host)
+  int iter;               // number of iterations
+  const short *src;       // image (device pointer)
+  morph_t out;            // host: products, only the non-NULL ones are computed
+} morph_gpu_t;
+
+int morph_gpu(morph_gpu_t *job, gpu_stream_t stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,239 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for grey-level morphology with arbitrary 
+convex structuring elements. The element is decomposed into horizontal
+chords. Each chord is a 1D erosion that is computed with the van Herk/
+Gil-Werman algorithm (3 comparisons per pixel, independent of the 
+width), and the chords are combined with the vertical offset of their
+row. Thus, the cost grows with the radius, not with the area of the 
+element. Pixels outside of the image are ignored as in OpenCV, and 
+dilation is computed as erosion of the bitwise complement.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "morph-hl.h"
+
+
+void chord_erode(const short *src, short *dst, int n, int w, short *pad, short *g, short *h);
+void morph_erode(const short *src, short *dst, int nx, int ny, morph_elem_t *elem, short *row, short *pad, short *g, short *h);
+
+
+/** This function erodes one row with a chord of half-width w (van Herk/
++++ Gil-Werman). The padded row is split into segments of the window
++++ length; each window covers the end of one segment and the start of 
++++ the next one.
+--- src:    row
+--- dst:    eroded row (returned)
+--- n:      length of row
+--- w:      half-width of chord
+--- pad:    buffer for padded row
+--- g:      buffer for running minimum from segment start
+--- h:      buffer for running minimum from segment end
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void chord_erode(const short *src, short *dst, int n, int w, short *pad, short *g, short *h){
+int i, b, k = 2*w+1, len;
+
+
+  if (w == 0){
+    memcpy(dst, src, n*sizeof(short));
+    return;
+  }
+
+  // pad with +inf, and fill up to full segments
+  len = ((n+2*w+k-1)/k)*k;
+  for (i=0; i<w; i++) pad[i] = SHRT_MAX;
+  memcpy(pad+w, src, n*sizeof(short));
+  for (i=n+w; i<len; i++) pad[i] = SHRT_MAX;
+
+  for (b=0; b<len; b+=k){
+    g[b] = pad[b];
+    for (i=b+1; i<b+k; i++) g[i] = (pad[i] < g[i-1]) ? pad[i] : g[i-1];
+    h[b+k-1] = pad[b+k-1];
+    for (i=b+k-2; i>=b; i--) h[i] = (pad[i] < h[i+1]) ? pad[i] : h[i+1];
+  }
+
+  for (i=0; i<n; i++) dst[i] = (h[i] < g[i+k-1]) ? h[i] : g[i+k-1];
+
+  return;
+}
+
+
+/** This function erodes an image once. Each row of the image is eroded
++++ once for each distinct chord width, and folded into all output rows
++++ whose element has a chord of this width at the corresponding offset.
+--- src:    image
+--- dst:    eroded image (returned)
+--- nx:     number of columns
+--- ny:     number of rows
+--- elem:   structuring element
+--- row:    buffer for eroded row
+--- pad:    buffer for padded row
+--- g:      buffer for running minimum from segment start
+--- h:      buffer for running minimum from segment end
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void morph_erode(const short *src, short *dst, int nx, int ny, morph_elem_t *elem, short *row, short *pad, short *g, short *h){
+int w, wmax = -1, d, x, y, ys, nd = 2*elem->r+1;
+bool used;
+short *out = NULL;
+
+
+  for (d=0; d<nd; d++){
+    if (elem->hw[d] > wmax) wmax = elem->hw[d];
+  }
+
+  for (x=0; x<nx*ny; x++) dst[x] = SHRT_MAX;
+
+  for (w=0; w<=wmax; w++){
+
+    for (d=0, used=false; d<nd; d++){
+      if (elem->hw[d] == w) used = true;
+    }
+    if (!used) continue;
+
+    for (ys=0; ys<ny; ys++){
+
+      chord_erode(src+(size_t)ys*nx, row, nx, w, pad, g, h);
+
+      // row d of the element reads the image at y+d-r
+      for (d=0; d<nd; d++){
+
+        if (elem->hw[d] != w) continue;
+        if ((y = ys-d+elem->r) < 0 || y >= ny) continue;
+
+        out = dst+(size_t)y*nx;
+        for (x=0; x<nx; x++){
+          if (row[x] < out[x]) out[x] = row[x];
+        }
+
+      }
+
+    }
+
+  }
+
+  return;
+}
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function computes an iterated erosion or dilation of an image.
+--- src:    image
+--- dst:    filtered image (returned), may not be src
+--- nx:     number of columns
+--- ny:     number of rows
+--- elem:   structuring element
+--- dilate: dilate or erode?
+--- iter:   number of iterations
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void morph_filter(const short *src, short *dst, int nx, int ny, morph_elem_t *elem, bool dilate, int iter){
+int it, d, w = 0, nbuf;
+size_t p, nc = (size_t)nx*ny;
+short *A = NULL, *B = NULL;
+short *row = NULL, *pad = NULL, *g = NULL, *h = NULL;
+const short *cur = src;
+short *next = NULL;
+
+
+  if (iter < 1){
+    memcpy(dst, src, nc*sizeof(short));
+    return;
+  }
+
+  for (d=0; d<2*elem->r+1; d++){
+    if (elem->hw[d] > w) w = elem->hw[d];
+  }
+  nbuf = nx+4*w+1;
+
+  alloc((void**)&A,   nc,   sizeof(short));
+  alloc((void**)&B,   nc,   sizeof(short));
+  alloc((void**)&row, nx,   sizeof(short));
+  alloc((void**)&pad, nbuf, sizeof(short));
+  alloc((void**)&g,   nbuf, sizeof(short));
+  alloc((void**)&h,   nbuf, sizeof(short));
+
+  // complement reverses the order, max(a,b) = ~min(~a,~b)
+  if (dilate){
+    for (p=0; p<nc; p++) B[p] = ~src[p];
+    cur = B;
+  }
+
+  for (it=0; it<iter; it++){
+    next = (cur == A) ? B : A;
+    morph_erode(cur, next, nx, ny, elem, row, pad, g, h);
+    cur = next;
+  }
+
+  if (dilate){
+    for (p=0; p<nc; p++) dst[p] = ~cur[p];
+  } else {
+    memcpy(dst, cur, nc*sizeof(short));
+  }
+
+  free((void*)A);   free((void*)B);
+  free((void*)row); free((void*)pad);
+  free((void*)g);   free((void*)h);
+
+  return;
+}
+
+
+/** This function computes the morphological products of an image. The
++++ erosion and dilation are computed once, and opening and closing are
++++ derived from them.
+--- src:    image
+--- nx:     number of columns
+--- ny:     number of rows
+--- elem:   structuring element
+--- iter:   number of iterations
+--- out:    products, only the non-NULL ones are computed (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void morph_products(const short *src, int nx, int ny, morph_elem_t *elem, int iter, morph_t *out){
+size_t nc = (size_t)nx*ny;
+short *E = out->ero, *D = out->dil;
+
+
+  if (out->ero != NULL || out->opn != NULL){
+    if (E == NULL) alloc((void**)&E, nc, sizeof(short));
+    morph_filter(src, E, nx, ny, elem, false, iter);
+    if (out->opn != NULL) morph_filter(E, out->opn, nx, ny, elem, true, iter);
+    if (out->ero == NULL) free((void*)E);
+  }
+
+  if (out->dil != NULL || out->cls != NULL){
+    if (D == NULL) alloc((void**)&D, nc, sizeof(short));
+    morph_filter(src, D, nx, ny, elem, true, iter);
+    if (out->cls != NULL) morph_filter(D, out->cls, nx, ny, elem, false, iter);
+    if (out->dil == NULL) free((void*)D);
+  }
+
+  return;
+}
+
@@ -0,0 +1,68 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Morphology header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef MORPH_HL_H
+#define MORPH_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <stdbool.h> // boolean data type
+#include <string.h>  // string handling functions
+#include <limits.h>  // macro constants of the integer types
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/alloc-cl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// structuring element, given as one horizontal chord per row; the chords
+// are centered on the anchor
+typedef struct {
+  int r;              // radius, the element spans the rows -r..r
+  int *hw;            // half-width of the chord of each row (2r+1), -1: empty
+} morph_elem_t;
+
+// morphological products of one image
+typedef struct {
+  short *ero;         // erosion  (or NULL)
+  short *dil;         // dilation (or NULL)
+  short *opn;         // opening  (or NULL)
+  short *cls;         // closing  (or NULL)
+} morph_t;
+
+void morph_filter(const short *src, short *dst, int nx, int ny, morph_elem_t *elem, bool dilate, int iter);
+void morph_products(const short *src, int nx, int ny, morph_elem_t *elem, int iter, morph_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
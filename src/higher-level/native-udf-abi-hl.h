@@ -0,0 +1,111 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Native UDF plug-in ABI header
++++ This header is self-contained, and is the only FORCE header a native
++++ UDF needs to include. Plug-ins are shared objects that export the
++++ functions declared below with C linkage. They may be written in C or
++++ C++, and may use OpenMP, SIMD or GPU code internally.
++++ All calls are issued from one thread at a time. Pointers handed to
++++ the plug-in are only valid during the call.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef NATIVE_UDF_ABI_HL_H
+#define NATIVE_UDF_ABI_HL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bump whenever a struct below changes its layout
+#define FORCE_UDF_ABI_VERSION 1
+
+#if defined(__GNUC__)
+#define FORCE_UDF_EXPORT __attribute__((visibility("default")))
+#else
+#define FORCE_UDF_EXPORT
+#endif
+
+
+// acquisition date of one ARD layer
+typedef struct {
+  int year;
+  int month;
+  int day;
+  int doy;
+  int ce;      // days since 0000-01-01
+} force_udf_date_t;
+
+// description of the input time series, constant within one chunk
+typedef struct {
+  int abi_version;               // FORCE_UDF_ABI_VERSION of FORCE
+  int nt;                        // number of dates
+  int nb;                        // number of input bands
+  short nodata;                  // nodata value of input and output
+  int nthread;                   // number of compute threads the plug-in may use
+  const force_udf_date_t *date;  // [nt] acquisition dates
+  const char *const *sensor;     // [nt] sensor names
+  const char *const *bandname;   // [nb] input band names
+} force_udf_meta_t;
+
+// one processing chunk
+typedef struct {
+  int nx;                           // number of columns
+  int ny;                           // number of rows
+  int nc;                           // number of cells, nx*ny
+  const short *const *const *ard;   // [nt][nb][nc] ARD values, not masked
+  const unsigned char *const *valid;// [nt][nc] 1 if the ARD value is valid
+  const unsigned char *mask;        // [nc] processing mask (0: skip), or NULL
+  int nout;                         // number of output bands
+  short *const *out;                // [nout][nc] output, prefilled with nodata
+} force_udf_chunk_t;
+
+
+/** Returns the ABI version the plug-in was compiled against. FORCE
++++ refuses to load plug-ins with a different version.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+FORCE_UDF_EXPORT int force_udf_abi_version(void);
+
+/** Called before each chunk. Returns the output band names, and their
++++ number in nout. The names must stay valid until the next call of
++++ force_udf_init or force_udf_term. Band names that start with a 
++++ YYYYMMDD date are used to date the output bands.
++++ Return NULL to abort processing.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+FORCE_UDF_EXPORT const char *const *force_udf_init(const force_udf_meta_t *meta, int *nout);
+
+/** Called once per chunk. Fills chunk->out. Returns 0 on success.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+FORCE_UDF_EXPORT int force_udf_chunk(const force_udf_meta_t *meta, const force_udf_chunk_t *chunk);
+
+/** Optional. Called once before the plug-in is unloaded.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+FORCE_UDF_EXPORT void force_udf_term(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
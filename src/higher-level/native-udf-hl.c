@@ -0,0 +1,302 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for native UDF plug-ins
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "native-udf-hl.h"
+
+#include <dlfcn.h>   // dynamic loading of shared objects
+
+
+typedef struct {
+  void *handle;
+  int (*abi_version)(void);
+  const char *const *(*init)(const force_udf_meta_t *meta, int *nout);
+  int (*chunk)(const force_udf_meta_t *meta, const force_udf_chunk_t *chunk);
+  void (*term)(void);
+  force_udf_meta_t  meta;
+  force_udf_date_t *date;
+  char **sensor;
+  char **bandname;
+} nat_plugin_t;
+
+
+void *native_symbol(nat_plugin_t *nat, const char *name, int required);
+
+
+/** This function looks up a symbol in the native plug-in
+--- nat:      native plug-in
+--- name:     symbol name
+--- required: fail if the symbol is missing?
++++ Return:   symbol address, or NULL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void *native_symbol(nat_plugin_t *nat, const char *name, int required){
+void *sym = NULL;
+
+
+  dlerror();
+  sym = dlsym(nat->handle, name);
+
+  if (sym == NULL && required){
+    printf("native UDF does not export %s: %s\n", name, dlerror());
+    exit(FAILURE);
+  }
+
+  return sym;
+}
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function loads the native UDF plug-in. It is called once,
++++ the plug-in stays loaded until deregister_native
+--- phl:    HL parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void register_native(par_hl_t *phl){
+par_udf_t *udf = &phl->udf.nat;
+nat_plugin_t *nat = NULL;
+int version;
+
+
+  #ifdef FORCE_DEBUG
+  printf("starting to register native UDF plug-in\n");
+  #endif
+
+  udf->plugin = NULL;
+
+  if (phl->type != _HL_UDF_ || !udf->out) return;
+
+  alloc((void**)&nat, 1, sizeof(nat_plugin_t));
+
+  if ((nat->handle = dlopen(udf->f_code, RTLD_NOW | RTLD_LOCAL)) == NULL){
+    printf("Unable to load native UDF: %s\n", dlerror());
+    exit(FAILURE);
+  }
+
+  *(void**)(&nat->abi_version) = native_symbol(nat, "force_udf_abi_version", true);
+  *(void**)(&nat->init)        = native_symbol(nat, "force_udf_init",        true);
+  *(void**)(&nat->chunk)       = native_symbol(nat, "force_udf_chunk",       true);
+  *(void**)(&nat->term)        = native_symbol(nat, "force_udf_term",        false);
+
+  if ((version = nat->abi_version()) != FORCE_UDF_ABI_VERSION){
+    printf("native UDF was compiled for ABI version %d, but FORCE uses version %d.\n", 
+      version, FORCE_UDF_ABI_VERSION);
+    exit(FAILURE);
+  }
+
+  udf->plugin = nat;
+
+  #ifdef FORCE_DEBUG
+  printf("finished to register native UDF plug-in\n");
+  #endif
+
+  return;
+}
+
+
+/** This function unloads the native UDF plug-in
+--- phl:    HL parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void deregister_native(par_hl_t *phl){
+par_udf_t *udf = &phl->udf.nat;
+nat_plugin_t *nat = (nat_plugin_t*)udf->plugin;
+
+
+  if (nat == NULL) return;
+
+  if (nat->term != NULL) nat->term();
+  dlclose(nat->handle);
+
+  free((void*)nat);
+  udf->plugin = NULL;
+
+  return;
+}
+
+
+/** This function describes the time series of the current chunk to the
++++ native plug-in, and retrieves the number and names of output bands.
+--- ard:     ARD
+--- nb:      number of bands
+--- nt:      number of time steps
+--- nodata:  nodata value
+--- cthread: number of computing threads
+--- udf:     user-defined code parameters
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void init_nat(ard_t *ard, int nb, int nt, short nodata, int cthread, par_udf_t *udf){
+nat_plugin_t *nat = (nat_plugin_t*)udf->plugin;
+const char *const *bandname = NULL;
+date_t date;
+int t, b;
+
+
+  //make sure bandnames and dates are NULL-initialized
+  udf->bandname = NULL;
+  udf->date     = NULL;
+
+  if (!udf->out || nat == NULL){
+    udf->nb = 1;
+    return;
+  }
+
+  alloc((void**)&nat->date, nt, sizeof(force_udf_date_t));
+  alloc_2D((void***)&nat->sensor, nt, NPOW_04, sizeof(char));
+  alloc_2D((void***)&nat->bandname, nb, NPOW_10, sizeof(char));
+
+  for (t=0; t<nt; t++){
+    date = get_brick_date(ard[t].DAT, 0);
+    nat->date[t].year  = date.year;
+    nat->date[t].month = date.month;
+    nat->date[t].day   = date.day;
+    nat->date[t].doy   = date.doy;
+    nat->date[t].ce    = date.ce;
+    get_brick_sensor(ard[t].DAT, 0, nat->sensor[t], NPOW_04);
+  }
+
+  for (b=0; b<nb; b++) get_brick_bandname(ard[0].DAT, b, nat->bandname[b], NPOW_10);
+
+  nat->meta.abi_version = FORCE_UDF_ABI_VERSION;
+  nat->meta.nt          = nt;
+  nat->meta.nb          = nb;
+  nat->meta.nodata      = nodata;
+  nat->meta.nthread     = cthread;
+  nat->meta.date        = nat->date;
+  nat->meta.sensor      = (const char *const *)nat->sensor;
+  nat->meta.bandname    = (const char *const *)nat->bandname;
+
+  if ((bandname = nat->init(&nat->meta, &udf->nb)) == NULL || udf->nb < 1){
+    printf("force_udf_init failed. Check the native UDF code!\n");
+    exit(FAILURE);}
+
+  alloc_2D((void***)&udf->bandname, udf->nb, NPOW_10, sizeof(char));
+  alloc((void**)&udf->date, udf->nb, sizeof(date_t));
+
+  for (b=0; b<udf->nb; b++){
+    copy_string(udf->bandname[b], NPOW_10, bandname[b]);
+    date_from_bandname(&udf->date[b], udf->bandname[b]);
+  }
+
+  return;
+}
+
+
+/** This function frees the per-chunk description of the native plug-in
+--- udf:    user-defined code parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void term_nat(par_udf_t *udf){
+nat_plugin_t *nat = (nat_plugin_t*)udf->plugin;
+
+
+  if (udf->bandname != NULL){
+    free_2D((void**)udf->bandname, udf->nb); 
+    udf->bandname = NULL;
+  }
+
+  if (udf->date != NULL){
+    free((void*)udf->date); 
+    udf->date = NULL;
+  }
+
+  if (nat == NULL) return;
+
+  if (nat->date != NULL){
+    free((void*)nat->date);
+    nat->date = NULL;
+  }
+
+  if (nat->sensor != NULL){
+    free_2D((void**)nat->sensor, nat->meta.nt);
+    nat->sensor = NULL;
+  }
+
+  if (nat->bandname != NULL){
+    free_2D((void**)nat->bandname, nat->meta.nb);
+    nat->bandname = NULL;
+  }
+
+  return;
+}
+
+
+/** This function hands one chunk of ARD to the native plug-in. The ARD
++++ is passed without copying, the output is written to the UDF bricks
++++ directly.
+--- ard:    ARD
+--- udf_:   pointer to instantly useable UDF image arrays
+--- mask_:  processing mask, or NULL
+--- nx:     number of columns
+--- ny:     number of rows
+--- nc:     number of cells
+--- nt:     number of time steps
+--- udf:    user-defined code parameters
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int native_udf(ard_t *ard, udf_t *udf_, small *mask_, int nx, int ny, int nc, int nt, par_udf_t *udf){
+nat_plugin_t *nat = (nat_plugin_t*)udf->plugin;
+force_udf_chunk_t chunk;
+const short ***dat = NULL;
+const small **valid = NULL;
+int t, b, p;
+
+
+  if (udf_->nat_ == NULL || nat == NULL) return CANCEL;
+
+  alloc((void**)&dat,   nt, sizeof(short**));
+  alloc((void**)&valid, nt, sizeof(small*));
+
+  for (t=0; t<nt; t++){
+    dat[t]   = (const short**)ard[t].dat;
+    valid[t] = ard[t].msk;
+  }
+
+  for (b=0; b<udf->nb; b++){
+    for (p=0; p<nc; p++) udf_->nat_[b][p] = nat->meta.nodata;
+  }
+
+  chunk.nx    = nx;
+  chunk.ny    = ny;
+  chunk.nc    = nc;
+  chunk.ard   = (const short *const *const *)dat;
+  chunk.valid = (const unsigned char *const *)valid;
+  chunk.mask  = mask_;
+  chunk.nout  = udf->nb;
+  chunk.out   = udf_->nat_;
+
+  if (nat->chunk(&nat->meta, &chunk) != 0){
+    printf("force_udf_chunk failed. Check the native UDF code!\n");
+    exit(FAILURE);}
+
+  free((void*)dat);
+  free((void*)valid);
+
+  return SUCCESS;
+}
+
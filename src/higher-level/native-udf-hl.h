@@ -0,0 +1,53 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Native UDF plug-in header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef NATIVE_UDF_HL_H
+#define NATIVE_UDF_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include "../higher-level/native-udf-abi-hl.h"
+#include "../higher-level/udf-hl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void register_native(par_hl_t *phl);
+void deregister_native(par_hl_t *phl);
+void init_nat(ard_t *ard, int nb, int nt, short nodata, int cthread, par_udf_t *udf);
+void term_nat(par_udf_t *udf);
+int native_udf(ard_t *ard, udf_t *udf_, small *mask_, int nx, int ny, int nc, int nt, par_udf_t *udf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -56,6 +56,10 @@ int parse_txt(par_txt_t *txt);
 int parse_lsm(par_lsm_t *lsm);
 int parse_quality(par_qai_t *qai);
 int parse_sensor(par_sen_t *sen);
+void compile_band_map(par_sen_t *sen);
+void free_sensor(par_sen_t *sen);
+int check_submodule(par_hl_t *phl, par_hl_t *sub);
+int preview_param_higher(par_hl_t *phl);
 
 
 /** This function registers common higher level parameters that are parsed
@@ -76,13 +80,26 @@ void register_higher(params_t *params, par_hl_t *phl){
   register_intvec_par(params,  "Y_TILE_RANGE", -999, 9999, &phl->ty, &phl->nty);
   register_double_par(params,  "RESOLUTION", 0, FLT_MAX, &phl->res);
   register_double_par(params,  "BLOCK_SIZE", 0, FLT_MAX, &phl->blocksize);
+  register_bool_par(params,    "BLOCK_SIZE_AUTO", &phl->ablock);
   register_char_par(params,    "FILE_OUTPUT_OPTIONS",   _CHAR_TEST_NULL_OR_EXIST_, &phl->f_gdalopt);
   register_enum_par(params,    "OUTPUT_FORMAT",  _TAGGED_ENUM_FMT_, _FMT_LENGTH_, &phl->format);
   register_bool_par(params,    "OUTPUT_EXPLODE", &phl->explode);
+  register_bool_par(params,    "OUTPUT_VRT",     &phl->vrt);
   //register_bool_par(params,    "OUTPUT_OVERWRITE", &phl->owr);
   register_int_par(params,     "NTHREAD_READ",    1, INT_MAX, &phl->ithread);
   register_int_par(params,     "NTHREAD_WRITE",   1, INT_MAX, &phl->othread);
   register_int_par(params,     "NTHREAD_COMPUTE", 1, INT_MAX, &phl->cthread);
+  register_bool_par(params,    "NTHREAD_AUTO",    &phl->athread);
+  register_enum_par(params,    "STREAM_SCHEDULER", _TAGGED_ENUM_STREAM_, _STREAM_LENGTH_, &phl->stream_mode);
+  register_enum_par(params,    "NUMA_MODE",       _TAGGED_ENUM_NUMA_, _NUMA_LENGTH_, &phl->numa_mode);
+  register_enum_par(params,    "HUGE_PAGES",      _TAGGED_ENUM_HUGE_, _HUGE_LENGTH_, &phl->huge_pages);
+  register_enum_par(params,    "TILE_ORDER",      _TAGGED_ENUM_ORDER_, _ORDER_LENGTH_, &phl->tile_order);
+  register_int_par(params,     "STREAM_DEPTH",    1, 64,      &phl->stream_depth);
+  register_double_par(params,  "MEMORY_BUDGET",   0, FLT_MAX, &phl->mem_budget);
+  register_char_par(params,    "DIR_DISTRIBUTE", _CHAR_TEST_NULL_OR_EXIST_, &phl->d_dist);
+  register_char_par(params,    "FILE_TELEMETRY", _CHAR_TEST_NONE_, &phl->f_telemetry);
+  register_char_par(params,    "FILE_JOURNAL",   _CHAR_TEST_NONE_, &phl->f_journal);
+  register_intvec_par(params,  "GPU_DEVICES", -1, GPU_MAXDEVICE-1, &phl->gpu_device, &phl->ngpu_device);
 
   return;
 }
@@ -99,6 +116,7 @@ void register_ard1(params_t *params, par_hl_t *phl){
   register_enumvec_par(params, "SENSORS", _TAGGED_ENUM_SEN_, _SEN_LENGTH_, &phl->sen.senid, &phl->sen.n);
   register_bool_par(params,    "SPECTRAL_ADJUST", &phl->sen.spec_adjust);
   register_enumvec_par(params, "SCREEN_QAI", _TAGGED_ENUM_QAI_, _QAI_LENGTH_, &phl->qai.flags, &phl->qai.nflags);
+  register_enum_par(params,    "MERGE_SAMEDAY", _TAGGED_ENUM_MERGE_, _MERGE_LENGTH_, &phl->merge);
   register_datevec_par(params, "DATE_RANGE", "1900-01-01", "2099-12-31", &phl->date_range, &phl->ndate);
   register_intvec_par(params,  "DOY_RANGE", 1, 365, &phl->doy_range, &phl->ndoy);
 
@@ -177,8 +195,10 @@ void register_tsa(params_t *params, par_hl_t *phl){
 
   // TS parameters
   register_enumvec_par(params, "INDEX", _TAGGED_ENUM_IDX_, _IDX_LENGTH_, &phl->tsa.index, &phl->tsa.n);
+  register_charvec_par(params, "INDEX_EXPRESSION", _CHAR_TEST_NONE_, &phl->tsa.expression, &phl->tsa.nexpression);
   register_enum_par(params,    "STANDARDIZE_TSS", _TAGGED_ENUM_STD_, _STD_LENGTH_, &phl->tsa.standard);
   register_bool_par(params,    "OUTPUT_TSS", &phl->tsa.otss);
+  register_char_par(params,    "DIR_INDEX_CACHE", _CHAR_TEST_NULL_OR_EXIST_, &phl->tsa.d_cache);
 
   // SMA parameters
   register_char_par(params, "FILE_ENDMEM",    _CHAR_TEST_NULL_OR_EXIST_, &phl->tsa.sma.f_emb);
@@ -196,9 +216,12 @@ void register_tsa(params_t *params, par_hl_t *phl){
   register_int_par(params,     "HARMONIC_MODES",  1, 3, &phl->tsa.tsi.harm_nmodes);
   register_datevec_par(params, "HARMONIC_FIT_RANGE", "1900-01-01", "2099-12-31", &phl->tsa.tsi.harm_fit_range, &phl->tsa.tsi.harm_fit_nrange);
   register_int_par(params,     "INT_DAY",     1, INT_MAX, &phl->tsa.tsi.step);
+  register_int_par(params,     "INT_WINDOW",  0, INT_MAX, &phl->tsa.tsi.window);
   register_enum_par(params,    "STANDARDIZE_TSI", _TAGGED_ENUM_STD_, _STD_LENGTH_, &phl->tsa.tsi.standard);
   register_bool_par(params,    "OUTPUT_TSI",  &phl->tsa.tsi.otsi);
   register_bool_par(params,    "OUTPUT_NRT",  &phl->tsa.tsi.onrt);
+  register_bool_par(params,    "OUTPUT_NRT_STATE", &phl->tsa.tsi.onst);
+  register_bool_par(params,    "INPUT_NRT_STATE",  &phl->tsa.tsi.inst);
 
   // STM parameters
   register_enumvec_par(params, "STM", _TAGGED_ENUM_STA_, _STA_LENGTH_, &phl->tsa.stm.sta.metrics, &phl->tsa.stm.sta.nmetrics);
@@ -383,11 +406,16 @@ int i;
 void register_smp(params_t *params, par_hl_t *phl){
 
 
-  register_char_par(params, "FILE_POINTS",      _CHAR_TEST_EXIST_,     &phl->smp.f_coord);
+  register_enum_par(params, "SAMPLE_MODE",      _TAGGED_ENUM_SMP_, _SMP_LENGTH_, &phl->smp.mode);
+  register_char_par(params, "FILE_POINTS",      _CHAR_TEST_NULL_OR_EXIST_, &phl->smp.f_coord);
+  register_char_par(params, "FILE_ZONES",       _CHAR_TEST_NULL_OR_EXIST_, &phl->smp.f_zones);
+  register_char_par(params, "ZONE_ATTRIBUTE",   _CHAR_TEST_NONE_,      &phl->smp.zone_attr);
+  register_intvec_par(params, "ZONE_PERCENTILES", 0, 100, &phl->smp.zone_pct, &phl->smp.nzone_pct);
   register_char_par(params, "FILE_SAMPLE",      _CHAR_TEST_NOT_EXIST_, &phl->smp.f_sample);
   register_char_par(params, "FILE_RESPONSE",    _CHAR_TEST_NOT_EXIST_, &phl->smp.f_response);
   register_char_par(params, "FILE_COORDINATES", _CHAR_TEST_NOT_EXIST_, &phl->smp.f_coords);
   register_bool_par(params, "PROJECTED",        &phl->smp.projected);
+  register_enum_par(params, "SAMPLE_FORMAT",    _TAGGED_ENUM_TABLE_, _TABLE_LENGTH_, &phl->smp.format);
 
   return;
 }
@@ -460,6 +488,10 @@ void register_udf(params_t *params, par_hl_t *phl){
   register_enum_par(params,    "PYTHON_TYPE",  _TAGGED_ENUM_UDF_, _UDF_LENGTH_, &phl->udf.pyp.type);
   register_bool_par(params,    "OUTPUT_PYP",    &phl->udf.pyp.out);
 
+  // native UDF plug-in parameters
+  register_char_par(params,    "FILE_NATIVE",  _CHAR_TEST_NULL_OR_EXIST_, &phl->udf.nat.f_code);
+  register_bool_par(params,    "OUTPUT_NAT",    &phl->udf.nat.out);
+
   // R UDF plug-in parameters
   //register_char_par(params,    "FILE_RSTATS",  _CHAR_TEST_NULL_OR_EXIST_, &phl->udf.rsp.f_code);
   //register_enum_par(params,    "RSTATS_TYPE",  _TAGGED_ENUM_UDF_, _UDF_LENGTH_, &phl->udf.rsp.type);
@@ -476,7 +508,7 @@ void register_udf(params_t *params, par_hl_t *phl){
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int check_bandlist(par_tsa_t *tsa, par_sen_t *sen){
-int idx, b, nb = _WVL_LENGTH_, k, s;
+int idx, b, nb = _WVL_LENGTH_, k, s, e = 0, i;
 bool v[_WVL_LENGTH_] = { 
   false, false, false, false, false,
   false, false, false, false, false,
@@ -486,10 +518,24 @@ int *band_ptr[_WVL_LENGTH_] = {
   &sen->rededge1, &sen->rededge2, &sen->rededge3,
   &sen->bnir, &sen->nir, &sen->swir0, &sen->swir1, &sen->swir2,
   &sen->vv, &sen->vh };
+int band[_WVL_LENGTH_];
 
 
   alloc_2D((void***)&tsa->index_name, tsa->n, NPOW_02, sizeof(char));
 
+  // compile the index expressions once, they are evaluated per pixel block
+  if (tsa->nexpression == 1 && strcmp(tsa->expression[0], "NULL") == 0){
+    tsa->nexpr = 0;
+  } else {
+    tsa->nexpr = tsa->nexpression;
+  }
+
+  if (tsa->nexpr > 0) alloc((void**)&tsa->expr, tsa->nexpr, sizeof(index_expr_t));
+
+  for (k=0; k<tsa->nexpr; k++){
+    if (parse_index_expr(tsa->expression[k], k, &tsa->expr[k]) == FAILURE) return FAILURE;
+  }
+
   // for each requested index, flag required wavelength, 
   // set short index name for filename
   for (idx=0; idx<tsa->n; idx++){
@@ -680,6 +726,19 @@ int *band_ptr[_WVL_LENGTH_] = {
         v[_WVL_NIR_] = v[_WVL_SWIR1_] = v[_WVL_SWIR2_] = true;
         copy_string(tsa->index_name[idx], NPOW_02, "CSW");
         break;
+      case _IDX_EXP_:
+        if (e >= tsa->nexpr){
+          printf("INDEX requests more EXPRESSIONs than given in INDEX_EXPRESSION. ");
+          return FAILURE;}
+        for (b=0; b<nb; b++) v[b] = v[b] || tsa->expr[e].wvl[b];
+        copy_string(tsa->index_name[idx], NPOW_02, tsa->expr[e].name);
+        for (i=0; i<idx; i++){
+          if (strcmp(tsa->index_name[i], tsa->index_name[idx]) == 0){
+            printf("index name %s is not unique. ", tsa->index_name[idx]);
+            return FAILURE;}
+        }
+        e++;
+        break;
       default:
         printf("unknown INDEX\n");
         break;
@@ -699,6 +758,11 @@ int *band_ptr[_WVL_LENGTH_] = {
     }
   }
 
+  if (e < tsa->nexpr){
+    printf("INDEX_EXPRESSION given, but not requested as EXPRESSION in INDEX. ");
+    return FAILURE;
+  }
+
   // set target bands
   if (sen->spec_adjust){
     for (b=0; b<nb; b++) v[b] = (*band_ptr[b] >= 0);
@@ -708,6 +772,10 @@ int *band_ptr[_WVL_LENGTH_] = {
     }
   }
 
+  // resolve the wavelengths of the index expressions to the target bands
+  for (b=0; b<nb; b++) band[b] = *band_ptr[b];
+  for (k=0; k<tsa->nexpr; k++) resolve_index_expr(&tsa->expr[k], band);
+
   #ifdef FORCE_DEBUG
   printf("filtered bandlist with requested indices:\n");
   for (s=0; s<sen->n; s++){
@@ -1212,10 +1280,150 @@ int *band_ptr[_WVL_LENGTH_] = {
 }
 
 
+/** This function compiles the band map of each sensor, i.e. the bands 
++++ on disc that need to be read, in the order of the target bands. This 
++++ is done once, after the sensor dictionary is final, such that reading
++++ an ARD image does not need to assemble the map per file. Target bands
++++ that a sensor does not have (gaps) are not in the map, but are counted
++++ in the number of target bands.
+--- sen:    sensor parameters (modified)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void compile_band_map(par_sen_t *sen){
+int s, b;
+
+
+  alloc((void**)&sen->nread,   sen->n, sizeof(int));
+  alloc((void**)&sen->ntarget, sen->n, sizeof(int));
+  alloc_2D((void***)&sen->map, sen->n, sen->nb, sizeof(int));
+
+  for (s=0; s<sen->n; s++){
+    for (b=0; b<sen->nb; b++){
+      if (sen->band[s][b] >= 0) sen->ntarget[s]++;
+      if (sen->band[s][b] >  0) sen->map[s][sen->nread[s]++] = sen->band[s][b];
+    }
+  }
+
+  #ifdef FORCE_DEBUG
+  printf("band map:\n");
+  for (s=0; s<sen->n; s++){
+    printf("%s (%d of %d bands): ", sen->sensor[s], sen->nread[s], sen->ntarget[s]);
+    for (b=0; b<sen->nread[s]; b++) printf("%2d ", sen->map[s][b]); 
+    printf("\n");
+  }
+  #endif
+
+  return;
+}
+
+
+/** This function frees the sensor dictionary
+--- sen:    sensor parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_sensor(par_sen_t *sen){
+
+
+  free_2D((void**)sen->sensor, sen->n);
+  free_2D((void**)sen->band,   sen->n);
+  free_2D((void**)sen->domain, sen->nb);
+  if (sen->map != NULL) free_2D((void**)sen->map, sen->n);
+  free((void*)sen->nread);
+  free((void*)sen->ntarget);
+
+  return;
+}
+
+
 /** public functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
 
+/** This function checks whether a submodule can be run on the input of 
++++ the main module, i.e. whether all parameters that control the reading
++++ and screening of the data are the same. Only modules that work on ARD
++++ (reflectance or QAI) without secondary input can be combined. Modules
++++ that work on features are chained, i.e. they use the products of the
++++ preceding modules as features, and only need to match the geometry.
+--- phl:    HL parameters of the main module
+--- sub:    HL parameters of the submodule
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int check_submodule(par_hl_t *phl, par_hl_t *sub){
+int s, npy = 0;
+par_hl_t *mod = NULL;
+bool chain;
+
+
+  chain = (sub->input_level1 == _INP_FTR_);
+
+  if ((phl->input_level1 != _INP_ARD_ && phl->input_level1 != _INP_QAI_) ||
+      (sub->input_level1 != _INP_ARD_ && sub->input_level1 != _INP_QAI_ && !chain) ||
+       phl->input_level2 != _INP_NONE_ || sub->input_level2 != _INP_NONE_){
+    printf("submodules must work on Level 2 ARD or on features without secondary input (%s). ", sub->f_par); 
+    return FAILURE;}
+
+  if (strcmp(phl->d_mask,  sub->d_mask)  != 0 ||
+      strcmp(phl->b_mask,  sub->b_mask)  != 0 ||
+      strcmp(phl->f_tile,  sub->f_tile)  != 0 ||
+      (strcmp(phl->d_lower, sub->d_lower) != 0 && !chain)){
+    printf("DIR_LOWER, DIR_MASK, BASE_MASK and FILE_TILE must match (%s). ", sub->f_par); 
+    return FAILURE;}
+
+  if (phl->tx[_MIN_] != sub->tx[_MIN_] || phl->tx[_MAX_] != sub->tx[_MAX_] ||
+      phl->ty[_MIN_] != sub->ty[_MIN_] || phl->ty[_MAX_] != sub->ty[_MAX_] ||
+      phl->res != sub->res || phl->blocksize != sub->blocksize ||
+      phl->radius != sub->radius){
+    printf("tile range, RESOLUTION, BLOCK_SIZE and kernel radius must match (%s). ", sub->f_par); 
+    return FAILURE;}
+
+  if (sub->type == _HL_L2I_ || sub->type == _HL_CFI_ || (sub->type == _HL_SMP_ && !chain)){
+    printf("this module cannot be used as submodule (%s). ", sub->f_par); 
+    return FAILURE;}
+
+  // reading and screening of ARD, chained modules do not read ARD
+  if (!chain){
+
+    if (phl->sen.n != sub->sen.n || phl->sen.spec_adjust != sub->sen.spec_adjust){
+      printf("SENSORS and SPECTRAL_ADJUST must match (%s). ", sub->f_par); 
+      return FAILURE;}
+
+    for (s=0; s<phl->sen.n; s++){
+      if (strcmp(phl->sen.sensor[s], sub->sen.sensor[s]) != 0){
+        printf("SENSORS must match (%s). ", sub->f_par); 
+        return FAILURE;}
+    }
+
+    // QAI rules, everything but the list of flags they were parsed from
+    if (memcmp(&phl->qai.off, &sub->qai.off, sizeof(par_qai_t)-offsetof(par_qai_t, off)) != 0){
+      printf("SCREEN_QAI, ABOVE_NOISE and BELOW_NOISE must match (%s). ", sub->f_par); 
+      return FAILURE;}
+
+    if (phl->merge != sub->merge){
+      printf("MERGE_SAMEDAY must match (%s). ", sub->f_par); 
+      return FAILURE;}
+
+    if (phl->input_level1 == _INP_ARD_ && sub->input_level1 == _INP_ARD_ &&
+       (phl->psf != sub->psf || phl->prd.imp != sub->prd.imp)){
+      printf("REDUCE_PSF and USE_L2_IMPROPHE must match (%s). ", sub->f_par); 
+      return FAILURE;}
+
+  }
+
+  // there is one Python interpreter
+  for (s=-1; s<=phl->nsub; s++){
+    mod = (s < 0) ? phl : (s < phl->nsub) ? phl->sub[s] : sub;
+    if (mod->tsa.pyp.out || mod->udf.pyp.out) npy++;
+  }
+
+  if (npy > 1){
+    printf("only one module can use a Python UDF (%s). ", sub->f_par); 
+    return FAILURE;}
+
+  return SUCCESS;
+}
+
+
 /** This function allocates the higher level parameters
 +++ Return: HL parameters (must be freed with free_param_higher)
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
@@ -1234,26 +1442,28 @@ par_hl_t *phl = NULL;
 +++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void free_param_higher(par_hl_t *phl){
+int s;
+
 
   if (phl == NULL) return;
 
+  for (s=0; s<phl->nsub; s++) free_param_higher(phl->sub[s]);
+  if (phl->sub != NULL) free((void*)phl->sub);
+
   free_params(phl->params);
 
   if (phl->input_level1 == _INP_QAI_ ||
       phl->input_level1 == _INP_ARD_){
-    free_2D((void**)phl->sen.sensor, phl->sen.n);
-    free_2D((void**)phl->sen.band,   phl->sen.n);
-    free_2D((void**)phl->sen.domain, phl->sen.nb);
+    free_sensor(&phl->sen);
   }
 
   if (phl->input_level2 == _INP_QAI_ ||
       phl->input_level2 == _INP_ARD_){
-    free_2D((void**)phl->sen2.sensor, phl->sen2.n);
-    free_2D((void**)phl->sen2.band,   phl->sen2.n);
-    free_2D((void**)phl->sen2.domain, phl->sen2.nb);
+    free_sensor(&phl->sen2);
   }
 
   if (phl->type == _HL_TSA_) free_2D((void**)phl->tsa.index_name, phl->tsa.n); 
+  if (phl->type == _HL_TSA_) free((void*)phl->tsa.expr); 
 
   if (phl->type == _HL_ML_) free_mcl(&phl->mcl);
 
@@ -1274,6 +1484,7 @@ int parse_param_higher(par_hl_t *phl){
 FILE *fpar;
 char  buffer[NPOW_16] = "\0";
 int d, w, m, q, y, tmp;
+int k, k_, anchor;
 double tol = 5e-3;
   
 
@@ -1432,6 +1643,12 @@ double tol = 5e-3;
   if (phl->type == _HL_TSA_ && check_bandlist(&phl->tsa, &phl->sen) == FAILURE){
     printf("sth wrong with bandlist."); return FAILURE;}
 
+  if (phl->input_level1 == _INP_QAI_ ||
+      phl->input_level1 == _INP_ARD_) compile_band_map(&phl->sen);
+
+  if (phl->input_level2 == _INP_QAI_ ||
+      phl->input_level2 == _INP_ARD_) compile_band_map(&phl->sen2);
+
   if (phl->type == _HL_TSA_) parse_sta(&phl->tsa.stm.sta);
   if (phl->type == _HL_CSO_) parse_sta(&phl->cso.sta);
   
@@ -1501,6 +1718,10 @@ double tol = 5e-3;
   }
 
 
+  // preview: coarsen the resolution before radii are converted to pixels
+  if (phl->preview > 1 && preview_param_higher(phl) == FAILURE) return FAILURE;
+
+
   if (phl->type == _HL_TXT_){
     phl->radius = phl->txt.radius*phl->txt.iter;
     phl->txt.radius = (int)(phl->txt.radius/phl->res);
@@ -1519,11 +1740,23 @@ double tol = 5e-3;
     phl->radius = 0;
   }
 
+  // in a preview, the halo is rounded up to the coarser pixels
+  if (phl->preview > 1) phl->radius = ceil(phl->radius/phl->res)*phl->res;
+
   if (phl->radius != 0 && fmod(phl->radius, phl->res) > tol){
     printf("requested RADIUS %f must be a multiple of RESOLUTION %f\n", phl->radius, phl->res);
     return FAILURE;
   }
 
+  if (phl->type == _HL_SMP_){
+    if (phl->smp.mode == _SMP_POINTS_ && strcmp(phl->smp.f_coord, "NULL") == 0){
+      printf("FILE_POINTS needs to be given for SAMPLE_MODE = POINTS\n");
+      return FAILURE;}
+    if (phl->smp.mode == _SMP_ZONES_ && strcmp(phl->smp.f_zones, "NULL") == 0){
+      printf("FILE_ZONES needs to be given for SAMPLE_MODE = ZONES\n");
+      return FAILURE;}
+  }
+
   if (phl->type == _HL_L2I_ || phl->type == _HL_CFI_){
     if ((phl->imp.nwin = phl->imp.bwin-1) <= 0){
       printf("at least two breakpoints need to be given for SEASONAL_WINDOW\n");
@@ -1543,6 +1776,14 @@ double tol = 5e-3;
     // number of years
     phl->bap.Yn = (phl->bap.Yr*2)+1;
 
+    // number of targets, each target is a triplet of DOYs
+    if (phl->bap.nDt == 0 || phl->bap.nDt % 3 != 0){
+      printf("DOY_STATIC needs to be a list of 3 DOYs (or of several triplets for multiple targets).\n"); return FAILURE;}
+    phl->bap.ntarget = phl->bap.nDt/3;
+
+    if (phl->bap.pac.lsp && phl->bap.ntarget > 1){
+      printf("Multiple targets (DOY_STATIC) are not supported with phenology-adaptive compositing.\n"); return FAILURE;}
+
     // choose type of scoring function
     if (phl->bap.Ds[1] > phl->bap.Ds[0] &&
         phl->bap.Ds[1] > phl->bap.Ds[2]){
@@ -1553,10 +1794,23 @@ double tol = 5e-3;
       phl->bap.score_type = _SCR_TYPE_SIG_ASC_; // ascending sigmoid
     }
 
+    // the target date is part of the filename, thus needs to be unique
+    if (phl->bap.score_type == _SCR_TYPE_SIG_DES_) anchor = 0;
+    else if (phl->bap.score_type == _SCR_TYPE_SIG_ASC_) anchor = 2;
+    else anchor = 1;
+    for (k=0; k<phl->bap.ntarget; k++){
+    for (k_=0; k_<k; k_++){
+      if (phl->bap.Dt[k*3+anchor] == phl->bap.Dt[k_*3+anchor]){
+        printf("Targets %d and %d have the same target date (DOY_STATIC). "
+               "This is not allowed.\n", k_+1, k+1); return FAILURE;}
+    }
+    }
+
     // choose products
     if (phl->bap.w.c > 0) phl->prd.dst = true;
     if (phl->bap.w.h > 0) phl->prd.hot = true;
     if (phl->bap.w.v > 0) phl->prd.vzn = true;
+    phl->prd.qaibits = true;
     
     if (phl->bap.pac.lsp) phl->input_level2 = _INP_CON_;
 
@@ -1615,6 +1869,17 @@ double tol = 5e-3;
       printf("Warning: will not output NRT product as harmonic does not include a forecast period. Proceed.\n");
     }
 
+    if (phl->tsa.tsi.onst && phl->tsa.tsi.method != _INT_HARMONIC_){
+      phl->tsa.tsi.onst = false;
+      printf("Warning: will not output NRT state as interpolation method is not harmonic. Proceed.\n");
+    }
+
+    if (phl->tsa.tsi.inst && phl->tsa.tsi.method != _INT_HARMONIC_){
+      printf("INPUT_NRT_STATE requires INTERPOLATE = HARMONIC.\n"); return FAILURE;}
+
+    if (phl->tsa.tsi.inst && phl->tsa.tsi.onst){
+      printf("OUTPUT_NRT_STATE and INPUT_NRT_STATE cannot both be true.\n"); return FAILURE;}
+
     if (phl->tsa.tsi.harm_fit_range[_MIN_].ce == phl->tsa.tsi.harm_fit_range[_MAX_].ce){
       set_date(&phl->tsa.tsi.harm_fit_range[_MIN_], 1900,  1,  1);
       set_date(&phl->tsa.tsi.harm_fit_range[_MAX_], 2100, 12, 31);
@@ -1694,6 +1959,14 @@ double tol = 5e-3;
       copy_string(phl->udf.pyp.f_code, NPOW_10, "NULL");
       printf("Warning: python code provided, but OUTPUT_PYP = FALSE. Ignore Python UDF plug-in. Proceed.\n");}
 
+    if (phl->udf.nat.out && strcmp(phl->udf.nat.f_code, "NULL") == 0){
+      phl->udf.nat.out = false;
+      printf("Warning: no native plug-in provided. OUTPUT_NAT ignored. Proceed.\n");}
+
+    if (!phl->udf.nat.out && strcmp(phl->udf.nat.f_code, "NULL") != 0){
+      copy_string(phl->udf.nat.f_code, NPOW_10, "NULL");
+      printf("Warning: native plug-in provided, but OUTPUT_NAT = FALSE. Ignore native UDF plug-in. Proceed.\n");}
+
     /**
     if (phl->udf.rsp.out && strcmp(phl->udf.rsp.f_code, "NULL") == 0){
       phl->udf.rsp.out = false;
@@ -1736,7 +2009,143 @@ double tol = 5e-3;
     }
   }
 
+  // temporal window that is read, submodules may extend it
+  temporal_window(phl, &phl->read_range[_MIN_], &phl->read_range[_MAX_]);
+  memcpy(phl->read_doys, phl->date_doys, sizeof(phl->date_doys));
+
+
+  return SUCCESS;
+}
+
+
+/** This function adds a submodule, which is run on the same input as the
++++ main module, such that the ARD is read only once for several modules.
++++ The main module reads the union of the Level 2 products needed by all
++++ modules, and the union of their temporal windows.
+--- phl:    HL parameters of the main module
+--- f_par:  parameter file of the submodule
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int add_submodule(par_hl_t *phl, const char *f_par){
+par_hl_t *sub = NULL;
+int d;
+
+
+  sub = allocate_param_higher();
+  copy_string(sub->f_par, NPOW_10, f_par);
+  sub->preview = phl->preview;
+
+  if (parse_param_higher(sub) == FAILURE){
+    printf("Reading parameter file %s failed! ", f_par); return FAILURE;}
+
+  if (check_submodule(phl, sub) == FAILURE){
+    free_param_higher(sub); return FAILURE;}
+
+  // reflectance parameters are only parsed for reflectance input
+  if (phl->input_level1 == _INP_QAI_ && sub->input_level1 == _INP_ARD_){
+    phl->input_level1 = _INP_ARD_;
+    phl->psf = sub->psf;
+    phl->prd.imp = sub->prd.imp;
+  }
+
+  phl->prd.ref |= sub->prd.ref;
+  phl->prd.qai |= sub->prd.qai;
+  phl->prd.dst |= sub->prd.dst;
+  phl->prd.aod |= sub->prd.aod;
+  phl->prd.hot |= sub->prd.hot;
+  phl->prd.vzn |= sub->prd.vzn;
+  phl->prd.wvp |= sub->prd.wvp;
+  phl->prd.qaibits |= sub->prd.qaibits;
+
+  // the main module reads the union of the temporal windows
+  if (sub->input_level1 != _INP_FTR_){
+    if (sub->read_range[_MIN_] < phl->read_range[_MIN_]) phl->read_range[_MIN_] = sub->read_range[_MIN_];
+    if (sub->read_range[_MAX_] > phl->read_range[_MAX_]) phl->read_range[_MAX_] = sub->read_range[_MAX_];
+    for (d=0; d<366; d++) phl->read_doys[d] |= sub->read_doys[d];
+  }
+
+  re_alloc((void**)&phl->sub, phl->nsub, phl->nsub+1, sizeof(par_hl_t*));
+  phl->sub[phl->nsub++] = sub;
 
   return SUCCESS;
 }
 
+
+/** This function switches a module to a preview, i.e. RESOLUTION is 
++++ coarsened by the preview factor, and the outputs are written to the 
++++ subdirectory PREVIEW-<factor>X of DIR_HIGHER, such that products at 
++++ full resolution are not overwritten. The ARD are read at the coarser
++++ resolution, i.e. from the overviews if the images have them (nearest
++++ neighbor), or with the point spread function (USE_PSF).
+--- phl:    HL parameters
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int preview_param_higher(par_hl_t *phl){
+char dname[NPOW_10];
+int nchar;
+
+
+  nchar = snprintf(dname, NPOW_10, "%s/PREVIEW-%dX", phl->d_higher, phl->preview);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling dirname\n"); return FAILURE;}
+
+  createdir(dname);
+
+  // the directory is owned by the registered parameter, thus replace it
+  free((void*)phl->d_higher);
+  alloc((void**)&phl->d_higher, nchar+1, sizeof(char));
+  copy_string(phl->d_higher, nchar+1, dname);
+
+  phl->res *= phl->preview;
+
+  printf("Preview at %.2f resolution, written to %s\n", phl->res, phl->d_higher);
+
+  return SUCCESS;
+}
+
+
+/** This function returns the temporal window of a module, i.e. the range
++++ of dates that its outputs depend on. This is DATE_RANGE, narrowed to
++++ the compositing period for BAP (target year +- bracketing years, plus
++++ one year on each side for targets that extend over the turn of the 
++++ year). Observations outside of this window are not read.
+--- phl:    HL parameters
+--- cemin:  start of window in days since CE (returned)
+--- cemax:  end   of window in days since CE (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void temporal_window(par_hl_t *phl, int *cemin, int *cemax){
+int ce;
+
+
+  *cemin = phl->date_range[_MIN_].ce;
+  *cemax = phl->date_range[_MAX_].ce;
+
+  if (phl->type == _HL_BAP_){
+    if ((ce = doy2ce(1,   phl->bap.Yt-phl->bap.Yr-1)) > *cemin) *cemin = ce;
+    if ((ce = doy2ce(365, phl->bap.Yt+phl->bap.Yr+1)) < *cemax) *cemax = ce;
+  }
+
+  return;
+}
+
+
+/** This function tests whether a date is within the temporal window of a
++++ module, i.e. within its window (see temporal_window) and DOY_RANGE. If
++++ submodules extend the window that is read, each module only gets the
++++ observations within its own window.
+--- phl:    HL parameters
+--- date:   date
++++ Return: true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool in_temporal_window(par_hl_t *phl, date_t *date){
+int cemin, cemax;
+
+
+  temporal_window(phl, &cemin, &cemax);
+
+  if (date->ce < cemin || date->ce > cemax) return false;
+  if (!phl->date_doys[date->doy]) return false;
+
+  return true;
+}
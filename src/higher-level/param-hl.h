@@ -32,11 +32,13 @@ Higher Level Processing paramater header
 #include <stdlib.h>  // standard general utilities library
 #include <ctype.h>   // transform individual characters
 #include <float.h>   // macro constants of the floating-point library
+#include <stddef.h>  // standard type definitions
 
 #include "../cross-level/const-cl.h"
 #include "../cross-level/string-cl.h"
 #include "../cross-level/param-cl.h"
 #include "../cross-level/gdalopt-cl.h"
+#include "../higher-level/index-expr-hl.h"
 
 
 #ifdef __cplusplus
@@ -78,6 +80,10 @@ typedef struct {
   char **sensor;
   char   target[NPOW_10];
 
+  int  *nread;   // number of bands on disc, per sensor (see compile_band_map)
+  int **map;     // bands on disc to read (starting at 1), per sensor
+  int  *ntarget; // number of target bands, per sensor
+
   int spec_adjust; // spectral band adjustment to S2A?
 
   int blue;
@@ -134,8 +140,9 @@ typedef struct {
   int Yr;               // number of bracketing years
   int Yn;               // number of years
   float Yf;             // Y-factos
-  int *Dt;            // target DOYs
+  int *Dt;            // target DOYs, triplet for each target
   int nDt, nDs;
+  int ntarget;          // number of targets
   float *Ds;           // function values for target DOYs
   int offsea; // use off-season data?
 
@@ -177,6 +184,7 @@ typedef struct {
 typedef struct {
   int method;            // interpolation method
   int step;              // interpolate each n days
+  int window;            // interpolation steps per temporal window, 0: all
   int mov_max;                // max temp. dist for moving stats filter
   int rbf_nk;                 // number of kernels for RBF fit
   int *rbf_sigma; // sigmas for RBF fit
@@ -186,6 +194,8 @@ typedef struct {
   int harm_fit_nrange; // number of dates for fitting harmonic
   int otsi;           // flag: output time series interpolation
   int onrt;           // flag: output near-real time product
+  int onst;           // flag: output near-real time state
+  int inst;           // flag: input near-real time state
   int standard;
 } par_tsi_t;
 
@@ -261,6 +271,8 @@ typedef struct {
   char  **bandname;
   date_t *date;
   int     type;
+  void   *labels; // dimension labels, kept from init_pyp to term_pyp
+  void   *plugin; // native plug-in, kept from register_native to deregister_native
 } par_udf_t;
 
 // aggregation statistics
@@ -298,7 +310,12 @@ typedef struct {
   int n;                 // number of indices
   int  *index;           // index type
   char **index_name;     // short name index type
+  char **expression;     // band-math index expressions
+  int nexpression;       // number of index expressions (parsed)
+  index_expr_t *expr;    // compiled index expressions
+  int nexpr;             // number of index expressions (compiled)
   int otss;           // flag: output time series brick
+  char *d_cache;         // directory of the index cache (see index-cache-hl.c)
   int standard;
 
   par_stm_t stm;
@@ -352,11 +369,16 @@ typedef struct {
 
 // sample
 typedef struct {
+  int  mode;
   char *f_coord;
+  char *f_zones;
+  char *zone_attr;
+  int  *zone_pct, nzone_pct;
   char *f_sample;
   char *f_response;
   char *f_coords;
   int  projected;
+  int  format;
 } par_smp_t;
 
 // texture
@@ -413,6 +435,7 @@ typedef struct {
 typedef struct {
   par_udf_t pyp;
   par_udf_t rsp;
+  par_udf_t nat;
 } par_udp_t;
 
 // improphe core
@@ -440,10 +463,11 @@ typedef struct {
   int vzn;
   int wvp;
   int imp;
+  int qaibits; // QAI bits are used beyond QAI screening
 } par_prd_t;
 
 // higher level parameters
-typedef struct {
+typedef struct par_hl_s {
 
   params_t *params;
   int type;
@@ -455,6 +479,9 @@ typedef struct {
   char *d_mask;   // mask directory
   char *b_mask;   // mask basename
   char *f_tile;   // tile allow-list
+  char *d_dist;   // shared directory for distributed processing
+  char *f_telemetry; // telemetry file
+  char *f_journal;   // journal of completed blocks
 
   // spatial variables
   int *tx;
@@ -463,6 +490,7 @@ typedef struct {
   double radius;
   double res;
   double blocksize;
+  int ablock;          // flag: choose block size automatically
   int psf;             // flag: point spread function
 
   // sensors
@@ -477,6 +505,7 @@ typedef struct {
 
   // QAI screening
   par_qai_t qai;
+  int merge;         // merging of same-day observations
   
   // level of input data
   int input_level1;
@@ -491,16 +520,30 @@ typedef struct {
   int date_months[13];
   int date_quarters[5];
   int nd, nw, nm, nq, ny;
+  int read_range[2];         // date range that is read (ce), union of all modules (see temporal_window)
+  int read_doys[366];        // doys that are read, union of all modules
 
   // miscellaneous
   char *f_gdalopt;   // file for GDAL options
   gdalopt_t gdalopt; // GDAL output options
   int format;        // output format
   int explode;
+  int vrt;             // flag: stack exploded bands in a VRT
   int owr;             // flag: overwrite output
   int ithread;
   int othread;
   int cthread;
+  int athread;       // flag: tune thread split on the fly
+  int stream_mode;   // streaming scheduler
+  int stream_depth;  // number of PUs buffered between teams
+  int numa_mode;     // NUMA placement
+  int huge_pages;    // huge page mode
+  int tile_order;    // traversal order of tiles
+  double mem_budget; // memory budget for buffered PUs (GB)
+  int *gpu_device;   // CUDA devices, -1: none
+  int ngpu_device;   // number of CUDA devices
+  int gpu;           // flag: offload to GPU (not a parameter)
+  int preview;       // preview factor, coarsens RESOLUTION (not a parameter)
 
   // products
   par_prd_t prd;
@@ -518,11 +561,18 @@ typedef struct {
   par_lib_t lib;
   par_udp_t udf;
 
+  // submodules, run on the same input (not parameters)
+  struct par_hl_s **sub;
+  int nsub;
+
 } par_hl_t;
 
 par_hl_t *allocate_param_higher();
 void free_param_higher(par_hl_t *phl);
 int parse_param_higher(par_hl_t *phl);
+int add_submodule(par_hl_t *phl, const char *f_par);
+void temporal_window(par_hl_t *phl, int *cemin, int *cemax);
+bool in_temporal_window(par_hl_t *phl, date_t *date);
 
 #ifdef __cplusplus
 }
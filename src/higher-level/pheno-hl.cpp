@@ -34,9 +34,46 @@ This file contains functions for phenometrics
 
 using namespace splits;
 
+int pheno_window(tsa_t *ts, int ni, int first, int last, par_lsp_t *lsp, int *i0, int *i1);
 int pheno(tsa_t *ts, small *mask_, int nc, int ni, short nodata, int y_index, int year_min, par_lsp_t *lsp);
 int pheno_ts(tsa_t *ts, small *mask_, int nc, int ni, short nodata, int year_min, int year_max, par_lsp_t *lsp);
 
+
+/** This function finds the interpolation steps that are used for fitting
++++ the spline, i.e. from DOY dprev in the first year to DOY dnext in the
++++ last year. The steps are consecutive, and the same for every pixel.
+--- ts:     pointer to instantly useable TSA image arrays
+--- ni:     number of interpolation steps
+--- first:  first year
+--- last:   last year
+--- lsp:    pheno parameters
+--- i0:     first step (returned, -1 if none)
+--- i1:     last step (returned, -1 if none)
++++ Return: number of steps
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int pheno_window(tsa_t *ts, int ni, int first, int last, par_lsp_t *lsp, int *i0, int *i1){
+int i;
+
+
+  *i0 = *i1 = -1;
+
+  for (i=0; i<ni; i++){
+
+    // subset by time
+    if ((ts->d_tsi[i].year > first && ts->d_tsi[i].year < last) ||
+        (ts->d_tsi[i].year == first && ts->d_tsi[i].doy >= lsp->dprev) || 
+        (ts->d_tsi[i].year == last  && ts->d_tsi[i].doy <= lsp->dnext)){
+      if (*i0 < 0) *i0 = i;
+      *i1 = i;
+    }
+
+  }
+
+  if (*i0 < 0) return 0;
+
+  return *i1 - *i0 + 1;
+}
+
 /** This function derives phenometrics from an interpolated time series
 +++ for one target year.
 --- ts:       pointer to instantly useable TSA image arrays
@@ -53,7 +90,8 @@ int pheno(tsa_t *ts, small *mask_, int nc, int ni, short nodata, int y_index, in
 int l, nlsp = 26;
 int year;
 int p;
-int i, ii, i_, i0, i1, ni_;
+int i, ii, i_, i0, i1, ni_, i_prev;
+int *i_next = NULL;
 char cdat0[NPOW_10];
 char cdat1[NPOW_10];
 int nchar, error = 0;
@@ -99,7 +137,33 @@ Spline *spl;
   year = year_min+y_index+1;
   
 
-  #pragma omp parallel private(l,i,ii,i0,i1,ni_,x_left,x_right,y_left,y_right,valid,doymax,yoff,x,i_,ymax,y,yhat,w,doy,dce,ce0,cdat0,cdat1,spl,nchar) firstprivate(southern) shared(mask_,ts,nc,ni,y_index,year_min,nodata,lsp,nseg,year,nlsp) reduction(+: error) default(none)
+  // steps used for fitting the spline, the same for every pixel
+  if ((ni_ = pheno_window(ts, ni, year-1, year+1, lsp, &i0, &i1)) == 0){
+    for (p=0; p<nc; p++){
+      for (l=0; l<nlsp; l++){
+        if (ts->lsp_[l] != NULL){
+          ts->lsp_[l][y_index][p] = nodata;
+        }
+      }
+    }
+    return SUCCESS;
+  }
+
+  /** time step in days, and first day **/
+  dce   = ts->d_tsi[i1].ce - ts->d_tsi[i0].ce;
+  ce0   = ts->d_tsi[i0].ce - year_min*365-365;
+  //printf("ce0, dce: %f, %f\n", ce0, dce);
+
+  /** compile temporal domain **/
+  nchar = snprintf(cdat0, NPOW_10, "%d/%d", ts->d_tsi[i0].doy, ts->d_tsi[i0].year);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling date\n"); return FAILURE;}
+  nchar = snprintf(cdat1, NPOW_10, "%d/%d", ts->d_tsi[i1].doy, ts->d_tsi[i1].year);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling date\n"); return FAILURE;}
+  
+
+  #pragma omp parallel private(l,i,ii,x_left,x_right,y_left,y_right,valid,doymax,yoff,x,i_,i_prev,i_next,ymax,y,yhat,w,doy,spl) firstprivate(southern) shared(mask_,ts,nc,ni,y_index,year_min,nodata,lsp,nseg,year,nlsp,i0,i1,ni_,dce,ce0,cdat0,cdat1) reduction(+: error) default(none)
   {
 
     // allocate
@@ -107,6 +171,15 @@ Spline *spl;
     alloc((void**)&yhat, ni,  sizeof(float));
     alloc((void**)&w,    ni,  sizeof(float));
     alloc((void**)&doy,  ni,  sizeof(float));
+    alloc((void**)&i_next, ni_, sizeof(int));
+
+    // temporal domain, the same for every pixel
+    for (ii=0; ii<ni_; ii++) doy[ii] = ts->d_tsi[i0+ii].doy;
+
+    Date dat0(cdat0); 
+    Date dat1(cdat1); 
+    Domain domain(dat0, dat1, doy, ni_);
+    //printf("Domain: %s - %s\n", cdat0, cdat1);
     
    
     #pragma omp for
@@ -121,114 +194,71 @@ Spline *spl;
 
 
       
-      i0 = -1; i1 = -1;
       ymax = INT_MIN;
       valid = false;
       doymax = 182;
       yoff = 0;
 
-      /** copy x/y/w to working variables **/
-      for (i=0, ii=0; i<ni; i++){
-
-        // subset by time
-        if (ts->d_tsi[i].year == year ||
-           (ts->d_tsi[i].year == year-1 && ts->d_tsi[i].doy >= lsp->dprev) || 
-           (ts->d_tsi[i].year == year+1 && ts->d_tsi[i].doy <= lsp->dnext)){
-
-          if (i0 < 0) i0 = i;
-          i1 = i;
-
-          // copy DOY
-          doy[ii] = ts->d_tsi[i].doy;
-
-          // linearly interpolate y-value, give half weight
-          // if nothing to interpolate, assign nodata, and give 0 weight
-          if (ts->tsi_[i][p] == nodata){
-            
-            x_left = x_right = INT_MIN;
-            y_left = y_right = nodata;
-            x = ts->d_tsi[i].ce;
-            
-            for (i_=i-1; i_>=0; i_--){
-              if (ts->d_tsi[i_].year < year-1 ||
-                 (ts->d_tsi[i_].year == year-1 && ts->d_tsi[i_].doy < lsp->dprev)){
-                break;
-              }
-              if (ts->tsi_[i_][p] != nodata){
-                x_left = ts->d_tsi[i_].ce;
-                y_left = ts->tsi_[i_][p];
-                break;
-              }
-            }
-            for (i_=i+1; i_<ni; i_++){
-              if (ts->d_tsi[i_].year > year+1 ||
-                 (ts->d_tsi[i_].year == year+1 && ts->d_tsi[i_].doy > lsp->dnext)){
-                break;
-              }
-              if (ts->tsi_[i_][p] != nodata){
-                x_right = ts->d_tsi[i_].ce;
-                y_right = ts->tsi_[i_][p];
-                break;
-              }
-            }
-            
-            if (x_left > 0 && x_right > 0){
-              y[ii] = (y_left*(x_right-x) + y_right*(x-x_left))/(x_right-x_left);
-              w[ii] = 0.5;
-            } else {
-              y[ii] = nodata;
-              w[ii] = 0.0;
-            }
-
-          // copy y-value, determine max y, give max weight
+      // next valid step
+      for (ii=ni_-1, i_=-1; ii>=0; ii--){
+        i_next[ii] = i_;
+        if (ts->tsi_pm[(size_t)p*ni+i0+ii] != nodata) i_ = i0+ii;
+      }
+
+      /** copy y/w to working variables **/
+      for (ii=0, i=i0, i_prev=-1; ii<ni_; ii++, i++){
+
+        // linearly interpolate y-value, give half weight
+        // if nothing to interpolate, assign nodata, and give 0 weight
+        if (ts->tsi_pm[(size_t)p*ni+i] == nodata){
+          
+          x_left = x_right = INT_MIN;
+          y_left = y_right = nodata;
+          x = ts->d_tsi[i].ce;
+          
+          if ((i_ = i_prev) >= 0){
+            x_left = ts->d_tsi[i_].ce;
+            y_left = ts->tsi_pm[(size_t)p*ni+i_];
+          }
+          if ((i_ = i_next[ii]) >= 0){
+            x_right = ts->d_tsi[i_].ce;
+            y_right = ts->tsi_pm[(size_t)p*ni+i_];
+          }
+          
+          if (x_left > 0 && x_right > 0){
+            y[ii] = (y_left*(x_right-x) + y_right*(x-x_left))/(x_right-x_left);
+            w[ii] = 0.5;
           } else {
+            y[ii] = nodata;
+            w[ii] = 0.0;
+          }
 
-            y[ii] = ts->tsi_[i][p];
-            w[ii] = 1.0;
+        // copy y-value, determine max y, give max weight
+        } else {
 
-            if (y[ii] > ymax){
-              ymax = y[ii];
-              doymax = ts->d_tsi[i].doy;
-            }
+          y[ii] = ts->tsi_pm[(size_t)p*ni+i];
+          w[ii] = 1.0;
 
+          if (y[ii] > ymax){
+            ymax = y[ii];
+            doymax = ts->d_tsi[i].doy;
           }
 
-          ii++;
+          i_prev = i;
 
         }
 
       }
 
-      // length of compiled time series
-      ni_ = ii;
-
 
 
       if (ymax > lsp->minval){
 
-        /** time step in days, and first day **/
-        dce   = ts->d_tsi[i1].ce - ts->d_tsi[i0].ce;
-        ce0   = ts->d_tsi[i0].ce - year_min*365-365;
-        //printf("ce0, dce: %f, %f\n", ce0, dce);
-
         /** allow switching hemispheres **/
         if (lsp->hemi == _HEMI_MIXED_ && (doymax < 90 || doymax > 275)){
           southern = true;}
         if (southern) yoff = -1;
         //printf("doymax: %d\n", doymax);
-
-        /** compile temporal domaion **/
-        nchar = snprintf(cdat0, NPOW_10, "%d/%d", ts->d_tsi[i0].doy, ts->d_tsi[i0].year);
-        if (nchar < 0 || nchar >= NPOW_10){ 
-          printf("Buffer Overflow in assembling date\n"); error++; continue;}
-        nchar = snprintf(cdat1, NPOW_10, "%d/%d", ts->d_tsi[i1].doy, ts->d_tsi[i1].year);
-        if (nchar < 0 || nchar >= NPOW_10){ 
-          printf("Buffer Overflow in assembling date\n"); error++; continue;}
-
-        Date dat0(cdat0); 
-        Date dat1(cdat1); 
-        Domain domain(dat0, dat1, doy, ni_);
-        //printf("Domain: %s - %s\n", cdat0, cdat1);
       
         /** fit spline **/
         if ((spl = create_spline(domain, y, w, UNIFORM_BSPLINE, nseg, 3)) == NULL){
@@ -294,6 +324,7 @@ Spline *spl;
     /** clean **/
     free((void*)y); free((void*)yhat);
     free((void*)w); free((void*)doy);
+    free((void*)i_next);
 
   }
 
@@ -319,7 +350,8 @@ int pheno_ts(tsa_t *ts, small *mask_, int nc, int ni, short nodata, int year_min
 int l, nlsp = 26;
 int year;
 int p;
-int i, ii, i_, i0, i1, ni_;
+int i, ii, i_, i0, i1, ni_, i_prev;
+int *i_next = NULL;
 char cdat0[NPOW_10];
 char cdat1[NPOW_10];
 int nchar, error = 0;
@@ -363,7 +395,33 @@ Spline *spl;
   nseg = (int)round((365-lsp->dprev)*dseg + lsp->nseg*lsp->ny + lsp->dnext*dseg);
 
 
-  #pragma omp parallel private(l,i,ii,i0,i1,ni_,x_left,x_right,y_left,y_right,year,valid,doymax,yoff,x,i_,ymax,y,yhat,w,doy,dce,ce0,cdat0,cdat1,spl,nchar) firstprivate(southern) shared(mask_,ts,nc,ni,year_min,year_max,nodata,lsp,nseg,nlsp) reduction(+: error) default(none)
+  // steps used for fitting the spline, the same for every pixel
+  if ((ni_ = pheno_window(ts, ni, year_min, year_max, lsp, &i0, &i1)) == 0){
+    for (p=0; p<nc; p++){
+      for (l=0; l<nlsp; l++){
+        if (ts->lsp_[l] != NULL){
+          for (year=0; year<lsp->ny; year++) ts->lsp_[l][year][p] = nodata;
+        }
+      }
+    }
+    return SUCCESS;
+  }
+
+  /** time step in days, and first day **/
+  dce   = ts->d_tsi[i1].ce - ts->d_tsi[i0].ce;
+  ce0   = ts->d_tsi[i0].ce - year_min*365-365;
+  //printf("ce0, dce: %f, %f\n", ce0, dce);
+
+  /** compile temporal domain **/
+  nchar = snprintf(cdat0, NPOW_10, "%d/%d", ts->d_tsi[i0].doy, ts->d_tsi[i0].year);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling date\n"); return FAILURE;}
+  nchar = snprintf(cdat1, NPOW_10, "%d/%d", ts->d_tsi[i1].doy, ts->d_tsi[i1].year);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling date\n"); return FAILURE;}
+  
+
+  #pragma omp parallel private(l,i,ii,x_left,x_right,y_left,y_right,year,valid,doymax,yoff,x,i_,i_prev,i_next,ymax,y,yhat,w,doy,spl) firstprivate(southern) shared(mask_,ts,nc,ni,year_min,year_max,nodata,lsp,nseg,nlsp,i0,i1,ni_,dce,ce0,cdat0,cdat1) reduction(+: error) default(none)
   {
 
     // allocate
@@ -371,6 +429,15 @@ Spline *spl;
     alloc((void**)&yhat, ni,  sizeof(float));
     alloc((void**)&w,    ni,  sizeof(float));
     alloc((void**)&doy,  ni,  sizeof(float));
+    alloc((void**)&i_next, ni_, sizeof(int));
+
+    // temporal domain, the same for every pixel
+    for (ii=0; ii<ni_; ii++) doy[ii] = ts->d_tsi[i0+ii].doy;
+
+    Date dat0(cdat0); 
+    Date dat1(cdat1); 
+    Domain domain(dat0, dat1, doy, ni_);
+    //printf("Domain: %s - %s\n", cdat0, cdat1);
     
    
     #pragma omp for
@@ -386,86 +453,61 @@ Spline *spl;
       }
 
       
-      i0 = -1; i1 = -1;
       ymax = INT_MIN;
       doymax = 182;
       yoff = 0;
 
-      /** copy x/y/w to working variables **/
-      for (i=0, ii=0; i<ni; i++){
-
-        // subset by time
-        if ((ts->d_tsi[i].year > year_min && ts->d_tsi[i].year < year_max) ||
-           (ts->d_tsi[i].year == year_min && ts->d_tsi[i].doy >= lsp->dprev) || 
-           (ts->d_tsi[i].year == year_max && ts->d_tsi[i].doy <= lsp->dnext)){
-
-          if (i0 < 0) i0 = i;
-          i1 = i;
-
-          // copy DOY
-          doy[ii] = ts->d_tsi[i].doy;
-
-          // linearly interpolate y-value, give half weight
-          // if nothing to interpolate, assign nodata, and give 0 weight
-          if (ts->tsi_[i][p] == nodata){
-            
-            x_left = x_right = INT_MIN;
-            y_left = y_right = nodata;
-            x = ts->d_tsi[i].ce;
-            
-            for (i_=i-1; i_>=0; i_--){
-              if (ts->d_tsi[i_].year < year_min ||
-                 (ts->d_tsi[i_].year == year_min && ts->d_tsi[i_].doy < lsp->dprev)){
-                break;
-              }
-              if (ts->tsi_[i_][p] != nodata){
-                x_left = ts->d_tsi[i_].ce;
-                y_left = ts->tsi_[i_][p];
-                break;
-              }
-            }
-            for (i_=i+1; i_<ni; i_++){
-              if (ts->d_tsi[i_].year > year_max ||
-                 (ts->d_tsi[i_].year == year_max && ts->d_tsi[i_].doy > lsp->dnext)){
-                break;
-              }
-              if (ts->tsi_[i_][p] != nodata){
-                x_right = ts->d_tsi[i_].ce;
-                y_right = ts->tsi_[i_][p];
-                break;
-              }
-            }
-            
-            if (x_left > 0 && x_right > 0){
-              y[ii] = (y_left*(x_right-x) + y_right*(x-x_left))/(x_right-x_left);
-              w[ii] = 0.5;
-            } else {
-              y[ii] = nodata;
-              w[ii] = 0.0;
-            }
-
-          // copy y-value, determine max y, give max weight
+      // next valid step
+      for (ii=ni_-1, i_=-1; ii>=0; ii--){
+        i_next[ii] = i_;
+        if (ts->tsi_pm[(size_t)p*ni+i0+ii] != nodata) i_ = i0+ii;
+      }
+
+      /** copy y/w to working variables **/
+      for (ii=0, i=i0, i_prev=-1; ii<ni_; ii++, i++){
+
+        // linearly interpolate y-value, give half weight
+        // if nothing to interpolate, assign nodata, and give 0 weight
+        if (ts->tsi_pm[(size_t)p*ni+i] == nodata){
+          
+          x_left = x_right = INT_MIN;
+          y_left = y_right = nodata;
+          x = ts->d_tsi[i].ce;
+          
+          if ((i_ = i_prev) >= 0){
+            x_left = ts->d_tsi[i_].ce;
+            y_left = ts->tsi_pm[(size_t)p*ni+i_];
+          }
+          if ((i_ = i_next[ii]) >= 0){
+            x_right = ts->d_tsi[i_].ce;
+            y_right = ts->tsi_pm[(size_t)p*ni+i_];
+          }
+          
+          if (x_left > 0 && x_right > 0){
+            y[ii] = (y_left*(x_right-x) + y_right*(x-x_left))/(x_right-x_left);
+            w[ii] = 0.5;
           } else {
+            y[ii] = nodata;
+            w[ii] = 0.0;
+          }
 
-            y[ii] = ts->tsi_[i][p];
-            w[ii] = 1.0;
+        // copy y-value, determine max y, give max weight
+        } else {
 
-            if (y[ii] > ymax){
-              ymax = y[ii];
-              doymax = ts->d_tsi[i].doy;
-            }
+          y[ii] = ts->tsi_pm[(size_t)p*ni+i];
+          w[ii] = 1.0;
 
+          if (y[ii] > ymax){
+            ymax = y[ii];
+            doymax = ts->d_tsi[i].doy;
           }
 
-          ii++;
+          i_prev = i;
 
         }
 
       }
 
-      // length of compiled time series
-      ni_ = ii;
-
 
 
       /** nodata if deriving LSP failed **/
@@ -479,29 +521,11 @@ Spline *spl;
       /** derive LSP **/
       if (ymax > lsp->minval){
 
-        /** time step in days, and first day **/
-        dce   = ts->d_tsi[i1].ce - ts->d_tsi[i0].ce;
-        ce0   = ts->d_tsi[i0].ce - year_min*365-365;
-        //printf("ce0, dce: %f, %f\n", ce0, dce);
-
         /** allow switching hemispheres **/
         if (lsp->hemi == _HEMI_MIXED_ && (doymax < 90 || doymax > 275)){
           southern = true;}
         if (southern) yoff = -1;
         //printf("doymax: %d\n", doymax);
-
-        /** compile temporal domaion **/
-        nchar = snprintf(cdat0, NPOW_10, "%d/%d", ts->d_tsi[i0].doy, ts->d_tsi[i0].year);
-        if (nchar < 0 || nchar >= NPOW_10){ 
-          printf("Buffer Overflow in assembling date\n"); error++; continue;}
-        nchar = snprintf(cdat1, NPOW_10, "%d/%d", ts->d_tsi[i1].doy, ts->d_tsi[i1].year);
-        if (nchar < 0 || nchar >= NPOW_10){ 
-          printf("Buffer Overflow in assembling date\n"); error++; continue;}
-        
-        Date dat0(cdat0); 
-        Date dat1(cdat1); 
-        Domain domain(dat0, dat1, doy, ni_);
-        //printf("Domain: %s - %s\n", cdat0, cdat1);
       
         /** fit spline **/
         if ((spl = create_spline(domain, y, w, UNIFORM_BSPLINE, nseg, 3)) == NULL){
@@ -573,6 +597,7 @@ Spline *spl;
     /** clean **/
     free((void*)y); free((void*)yhat);
     free((void*)w); free((void*)doy);
+    free((void*)i_next);
 
   }
 
@@ -0,0 +1,298 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for planning higher level jobs, i.e. runtime,
+memory and output size are estimated without reading any pixels
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "plan-hl.h"
+
+
+// maximum number of columns in the benchmark file
+#define PLAN_MAXCOL 32
+
+// columns of the benchmark file
+enum { _COL_MODULE_, _COL_STAGE_, _COL_BACKEND_, _COL_NT_, _COL_NC_, 
+       _COL_THREADS_, _COL_WALL_, _COL_OUTPUT_, _COL_LENGTH_ };
+
+const char *_COL_NAME_[_COL_LENGTH_] = {
+  "module", "stage", "backend", "nt", "nc", "threads", "wall", "output_bytes" };
+
+// cost coefficients of a module
+typedef struct {
+  int nrow;   // number of benchmark rows
+  int nrep;   // number of benchmark repetitions
+  double sec; // wall-clock seconds per pixel and observation
+  double out; // output bytes per pixel
+} coef_t;
+
+
+int split_csv(char *line, char **field, int max);
+int read_coef(char *fbench, par_hl_t *phl, coef_t *coef);
+int count_observations(int tx, int ty, par_hl_t *phl);
+
+
+/** This function returns the name of a higher level module
+--- type:   module
++++ Return: name
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+const char *module_name(int type){
+
+  switch (type){
+    case _HL_BAP_: return "LEVEL3";
+    case _HL_TSA_: return "TSA";
+    case _HL_CSO_: return "CSO";
+    case _HL_CFI_: return "CFIMP";
+    case _HL_L2I_: return "L2IMP";
+    case _HL_ML_:  return "ML";
+    case _HL_SMP_: return "SMP";
+    case _HL_TXT_: return "TXT";
+    case _HL_LSM_: return "LSM";
+    case _HL_LIB_: return "LIB";
+    case _HL_UDF_: return "UDF";
+    default:       return "UNKNOWN";
+  }
+
+}
+
+
+/** This function splits a line of a CSV file into its fields. The line 
++++ is modified.
+--- line:   line
+--- field:  fields (returned)
+--- max:    maximum number of fields
++++ Return: number of fields
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int split_csv(char *line, char **field, int max){
+char *ptr = NULL, *saveptr = NULL;
+int n = 0;
+
+
+  ptr = strtok_r(line, ",\r\n", &saveptr);
+
+  while (ptr != NULL && n < max){
+    field[n++] = ptr;
+    ptr = strtok_r(NULL, ",\r\n", &saveptr);
+  }
+
+  return n;
+}
+
+
+/** This function derives the cost coefficients of the module from a
++++ force-bench profile. All stages of a repetition are summed up, and the
++++ repetitions are averaged. The timings are scaled linearly to the num-
++++ ber of compute threads. The random forest microbenchmark is skipped.
+--- fbench: benchmark file (CSV written by force-bench)
+--- phl:    HL parameters
+--- coef:   cost coefficients (returned)
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int read_coef(char *fbench, par_hl_t *phl, coef_t *coef){
+FILE *fp = NULL;
+char line[NPOW_10];
+char stage[NPOW_08] = "";
+char *field[PLAN_MAXCOL];
+int col[_COL_LENGTH_];
+int ncol, c;
+double nt, nc, threads, wall;
+
+
+  memset(coef, 0, sizeof(coef_t));
+
+  if ((fp = fopen(fbench, "r")) == NULL){
+    printf("Unable to open benchmark file %s.\n", fbench); return FAILURE;}
+
+  if (fgets(line, NPOW_10, fp) == NULL){
+    printf("Benchmark file %s is empty.\n", fbench); fclose(fp); return FAILURE;}
+
+  ncol = split_csv(line, field, PLAN_MAXCOL);
+
+  for (c=0; c<_COL_LENGTH_; c++){
+    for (col[c]=ncol-1; col[c]>=0; col[c]--){
+      if (strcmp(field[col[c]], _COL_NAME_[c]) == 0) break;
+    }
+    // output size is optional, older profiles do not have it
+    if (col[c] < 0 && c != _COL_OUTPUT_){
+      printf("Column %s is missing in benchmark file %s. "
+             "Use a profile of force-bench without -p.\n", _COL_NAME_[c], fbench);
+      fclose(fp); return FAILURE;
+    }
+  }
+
+  while (fgets(line, NPOW_10, fp) != NULL){
+
+    if (split_csv(line, field, PLAN_MAXCOL) != ncol) continue;
+
+    if (strcmp(field[col[_COL_MODULE_]],  module_name(phl->type)) != 0) continue;
+    if (strcmp(field[col[_COL_BACKEND_]], (phl->gpu) ? "gpu" : "cpu") != 0) continue;
+    if (strcmp(field[col[_COL_STAGE_]],   "rf_predict") == 0) continue;
+
+    nt      = atof(field[col[_COL_NT_]]);
+    nc      = atof(field[col[_COL_NC_]]);
+    threads = atof(field[col[_COL_THREADS_]]);
+    wall    = atof(field[col[_COL_WALL_]]);
+
+    if (nt <= 0 || nc <= 0 || threads <= 0) continue;
+
+    // each repetition starts with the same stage
+    if (stage[0] == '\0') copy_string(stage, NPOW_08, field[col[_COL_STAGE_]]);
+    if (strcmp(stage, field[col[_COL_STAGE_]]) == 0) coef->nrep++;
+
+    coef->sec += wall * threads / phl->cthread / (nt * nc);
+    if (col[_COL_OUTPUT_] >= 0) coef->out += atof(field[col[_COL_OUTPUT_]]) / nc;
+    coef->nrow++;
+
+  }
+
+  fclose(fp);
+
+  if (coef->nrep == 0){
+    printf("No %s benchmark of %s in %s.\n", 
+      (phl->gpu) ? "GPU" : "CPU", module_name(phl->type), fbench);
+    return FAILURE;
+  }
+
+  coef->sec /= coef->nrep;
+  coef->out /= coef->nrow;
+
+  return SUCCESS;
+}
+
+
+/** This function counts the observations of one tile, i.e. the ARD data-
++++ sets that would be read, or the number of features
+--- tx:     tile X-ID
+--- ty:     tile Y-ID
+--- phl:    HL parameters
++++ Return: number of observations
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int count_observations(int tx, int ty, par_hl_t *phl){
+int nt = 0;
+
+
+  if (phl->input_level1 == _INP_ARD_ || phl->input_level1 == _INP_QAI_){
+    nt += count_ard(tx, ty, &phl->sen, phl);
+  } else if (phl->input_level1 == _INP_FTR_){
+    nt += phl->ftr.nfeature;
+  }
+
+  if (phl->input_level2 == _INP_ARD_ || phl->input_level2 == _INP_QAI_){
+    nt += count_ard(tx, ty, &phl->sen2, phl);
+  } else if (phl->input_level2 == _INP_FTR_){
+    nt += phl->ftr.nfeature;
+  }
+
+  return nt;
+}
+
+
+/** This function plans a higher level job without reading any pixels. 
++++ The observations per tile are counted from the ARD listing, and the
++++ input memory per chunk is estimated like for the memory budget. If a
++++ force-bench profile is given, runtime and output size are estimated
++++ with the cost coefficients of the module. One CSV row is written per
++++ tile, and a summary is printed.
+--- cube:   datacube definition
+--- phl:    HL parameters
+--- fplan:  plan file (CSV)
+--- fbench: benchmark file (CSV written by force-bench), or NULL
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int plan_higher_level(cube_t *cube, par_hl_t *phl, char *fplan, char *fbench){
+FILE *fp = NULL;
+coef_t coef;
+bool cost = false;
+int tile, nt, nactive = 0;
+double input, output = 0, memory, memory_max = 0, nobs = 0;
+double secs = 0, secs_total = 0, disk = 0, disk_total = 0;
+
+
+  if (fbench != NULL){
+    if (read_coef(fbench, phl, &coef) == FAILURE) return FAILURE;
+    cost = true;
+  }
+
+  if ((fp = fopen(fplan, "w")) == NULL){
+    printf("Unable to open plan file %s.\n", fplan); return FAILURE;}
+
+  fprintf(fp, "tile,chunks,observations,input_mb,output_mb,memory_mb,seconds,disk_mb\n");
+
+  for (tile=0; tile<cube->tn; tile++){
+
+    nt = count_observations(cube->tx[tile], cube->ty[tile], phl);
+
+    if (nt > 0){
+      input = estimate_input_memory(cube->tx[tile], cube->ty[tile], cube, phl);
+      nactive++;
+    } else input = 0;
+
+    if (cost && nt > 0){
+      output = coef.out * cube->cc;
+      secs   = coef.sec * nt * cube->cc * cube->cn;
+      disk   = output * cube->cn;
+    } else if (cost){
+      output = secs = disk = 0;
+    }
+
+    memory = input + output;
+    if (memory > memory_max) memory_max = memory;
+
+    nobs       += nt;
+    secs_total += secs;
+    disk_total += disk;
+
+    if (cost){
+      fprintf(fp, "X%04d_Y%04d,%d,%d,%.1f,%.1f,%.1f,%.1f,%.1f\n", 
+        cube->tx[tile], cube->ty[tile], cube->cn, nt, input/1048576.0, 
+        output/1048576.0, memory/1048576.0, secs, disk/1048576.0);
+    } else {
+      fprintf(fp, "X%04d_Y%04d,%d,%d,%.1f,NA,%.1f,NA,NA\n", 
+        cube->tx[tile], cube->ty[tile], cube->cn, nt, input/1048576.0, 
+        memory/1048576.0);
+    }
+
+  }
+
+  fclose(fp);
+
+
+  printf("Dry run of %s: %d of %d tiles have data, %d chunks per tile, %.0f observations\n",
+    module_name(phl->type), nactive, cube->tn, cube->cn, nobs);
+  printf("Input and output memory per chunk: up to %.0f MB, STREAM_DEPTH = %d\n",
+    memory_max/1048576.0, phl->stream_depth);
+
+  if (cost){
+    printf("Runtime: ~%.2f h with %d compute threads (%s)\n",
+      secs_total/3600.0, phl->cthread, (phl->gpu) ? "GPU" : "CPU");
+    printf("Output size: ~%.1f GB (uncompressed)\n", disk_total/1073741824.0);
+  } else {
+    printf("Runtime and output size are not estimated, no benchmark file is given\n");
+  }
+
+  printf("Plan per tile written to %s\n", fplan);
+
+  return SUCCESS;
+}
+
@@ -0,0 +1,55 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Dry-run planner header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef PLAN_HL_H
+#define PLAN_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <string.h>  // string handling functions
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/cube-cl.h"
+#include "../cross-level/dir-cl.h"
+#include "../higher-level/param-hl.h"
+#include "../higher-level/read-ard-hl.h"
+#include "../higher-level/tasks-hl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char *module_name(int type);
+int plan_higher_level(cube_t *cube, par_hl_t *phl, char *fplan, char *fbench);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -305,7 +305,8 @@ float sum;
 int polar_ts(tsa_t *ts, small *mask_, int nc, int ni, short nodata, int year_min, int year_max, par_tsi_t *tsi, par_pol_t *pol){
 int l;
 int p;
-int i, i_, i0;
+int i, i_, i0, i_prev;
+int *i_next = NULL;
 int s, y;
 float r, v;
 bool valid;
@@ -328,6 +329,8 @@ double integral[_INTEGRAL_LEN_];
 
 polar_t *polar = NULL;
 polar_t *theta0 = NULL;
+polar_t *polar_date = NULL;
+double *cos_r = NULL, *sin_r = NULL;
 float green_val, base_val;
 
 
@@ -339,13 +342,25 @@ float green_val, base_val;
   if (!valid) return CANCEL;
 
 
+  // polar coordinates of the interpolation dates, shared by all pixels
+  alloc((void**)&polar_date, ni, sizeof(polar_t));
+  alloc((void**)&cos_r, ni, sizeof(double));
+  alloc((void**)&sin_r, ni, sizeof(double));
+
+  for (i=0; i<ni; i++){
+    r = ts->ax_tsi.doy[i]/365.0*2.0*M_PI;
+    polar_coords(r, 0, ts->ax_tsi.year[i]-year_min, &polar_date[i]);
+    cos_r[i] = cos(r);
+    sin_r[i] = sin(r);
+  }
 
 
-  #pragma omp parallel private(l,i,i0,i_,ce_left,ce_right,v_left,v_right,valid,ce,v,s,y,r,timing,vector,mean_window,n_window,max_rate,mean_rate,rate,recurrence,integral,polar,theta0,green_val,base_val) shared(mask_,ts,nc,ni,year_min,nodata,pol,tsi) default(none)
+  #pragma omp parallel private(l,i,i0,i_,i_prev,i_next,ce_left,ce_right,v_left,v_right,valid,ce,v,s,y,timing,vector,mean_window,n_window,max_rate,mean_rate,rate,recurrence,integral,polar,theta0,green_val,base_val) shared(mask_,ts,nc,ni,nodata,pol,tsi,polar_date,cos_r,sin_r) default(none)
   {
 
     // allocate
     alloc((void**)&polar, ni, sizeof(polar_t));
+    alloc((void**)&i_next, ni, sizeof(int));
 
 
     #pragma omp for
@@ -366,30 +381,31 @@ float green_val, base_val;
       memset(mean_window[_ALPHA_], 0, 2*sizeof(float));
 
 
+      // next valid step
+      for (i=ni-1, i_=ni; i>=0; i--){
+        i_next[i] = i_;
+        if (ts->tsi_pm[(size_t)p*ni+i] != nodata) i_ = i;
+      }
+
+
       /** copy doy/v to working variables 
       +++ and interpolate linearly to make sure **/
-      for (i=0; i<ni; i++){
+      for (i=0, i_prev=-1; i<ni; i++){
 
         // linearly interpolate v-value
-        if (ts->tsi_[i][p] == nodata){
+        if (ts->tsi_pm[(size_t)p*ni+i] == nodata){
           
           ce_left = ce_right = INT_MIN;
           v_left = v_right = nodata;
-          ce = ts->d_tsi[i].ce;
+          ce = ts->ax_tsi.ce[i];
           
-          for (i_=i-1; i_>=0; i_--){
-            if (ts->tsi_[i_][p] != nodata){
-              ce_left = ts->d_tsi[i_].ce;
-              v_left = ts->tsi_[i_][p];
-              break;
-            }
+          if ((i_ = i_prev) >= 0){
+            ce_left = ts->ax_tsi.ce[i_];
+            v_left = ts->tsi_pm[(size_t)p*ni+i_];
           }
-          for (i_=i+1; i_<ni; i_++){
-            if (ts->tsi_[i_][p] != nodata){
-              ce_right = ts->d_tsi[i_].ce;
-              v_right = ts->tsi_[i_][p];
-              break;
-            }
+          if ((i_ = i_next[i]) < ni){
+            ce_right = ts->ax_tsi.ce[i_];
+            v_right = ts->tsi_pm[(size_t)p*ni+i_];
           }
           
           if (ce_left > 0 && ce_right > 0){
@@ -406,14 +422,17 @@ float green_val, base_val;
         // copy v-value
         } else {
 
-          v = ts->tsi_[i][p];
+          v = ts->tsi_pm[(size_t)p*ni+i];
+          i_prev = i;
 
         }
 
-        r = ts->d_tsi[i].doy/365.0*2.0*M_PI;
         if (v < 0) v = 0;
 
-        polar_coords(r, v, ts->d_tsi[i].year-year_min, &polar[i]);
+        memcpy(&polar[i], &polar_date[i], sizeof(polar_t));
+        polar[i].val = v;
+        polar[i].pcx = v*cos_r[i];
+        polar[i].pcy = v*sin_r[i];
 
         
         if (pol->opct) ts->pcx_[i][p] = (short)polar[i].pcx;
@@ -660,9 +679,14 @@ float green_val, base_val;
     }
 
     free((void*)polar);
+    free((void*)i_next);
 
   }
 
+  free((void*)polar_date);
+  free((void*)cos_r);
+  free((void*)sin_r);
+
 
   return SUCCESS;
 }
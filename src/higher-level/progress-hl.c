@@ -27,19 +27,48 @@ This file contains functions for progress monitoring
 
 #include "progress-hl.h"
 
+#include <unistd.h> // standard symbolic constants and types 
+#include <fcntl.h>  // manipulate file descriptor
+#include <errno.h>  // error numbers
+#include <sys/resource.h> // resource usage
+
+/** OpenMP **/
+#include <omp.h> // multi-platform shared memory multiprocessing
+
+/** Geospatial Data Abstraction Library (GDAL) **/
+#include "cpl_conv.h"       // various convenience functions for CPL
+
 
 #define MAX_(a,b) (((a)>(b))? (a) : (b))
 
+// polling interval when a team waits for another team (microseconds)
+#define POLL_USEC 10000
+
+// number of PUs between two adjustments of the thread split
+#define TUNE_UNITS 4
+
 void rewind_stdout(progress_t *pro);
-void processing_unit(progress_t *pro);
-void reset_time(progress_t *pro);
-void bound_time(progress_t *pro);
+void processing_unit(progress_t *pro, int task, int pu);
+bool unit_ready(progress_t *pro, int task, int pu);
 void add_time(progress_t *pro);
 void eta(progress_t *pro);
 void percent_done(progress_t *pro);
 void print_progress_summary(progress_t *pro);
 void print_progress_details(progress_t *pro);
 void print_progress_runtime(progress_t *pro);
+void gather_progress(progress_t *pro);
+int stage_unit(progress_t *pro, int task);
+void move_thread(progress_t *pro, int from, int to);
+void read_journal(progress_t *pro, char *fname);
+void order_tiles(progress_t *pro, int ntile, int order);
+unsigned long curve_index(int x, int y, int n, int order);
+int compare_curve(const void *a, const void *b);
+
+// position of a tile on the traversal curve
+typedef struct {
+  unsigned long d;
+  int x, y;
+} curve_t;
 
 
 /** This function measures the progress
@@ -49,16 +78,149 @@ void print_progress_runtime(progress_t *pro);
 +++ Return:   void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void measure_progress(progress_t *pro, int task, int clock){
+int pu;
   
   
   if (clock == _CLOCK_NULL_) pro->secs[task] = 0;
   if (clock == _CLOCK_TICK_) time(&pro->TIME[task]);
   if (clock == _CLOCK_TOCK_) pro->secs[task] = proctime(pro->TIME[task]);
+
+  if (clock == _CLOCK_TICK_) pro->wall[task] = omp_get_wtime();
+  if (clock == _CLOCK_TOCK_ && pro->record != NULL && (pu = stage_unit(pro, task)) >= 0){
+    pro->record[pu].secs[task] = omp_get_wtime() - pro->wall[task];
+  }
   
   return;
 }
 
 
+/** This function returns the processing unit that a team is working on
+--- pro:      progress handle
+--- task:     team (input, compute, output)
++++ Return:   processing unit, -1 if none
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int stage_unit(progress_t *pro, int task){
+
+
+  switch (task){
+    case _TASK_INPUT_:   return pro->pu_next;
+    case _TASK_COMPUTE_: return pro->pu;
+    case _TASK_OUTPUT_:  return pro->pu_prev;
+    default:             return -1;
+  }
+
+}
+
+
+/** This function computes the position of a tile on a space-filling
++++ curve. Z-order interleaves the bits of X and Y, the Hilbert curve
++++ additionally rotates the quadrants, such that consecutive tiles are
++++ always neighbors.
+--- x:        tile X, relative to the first tile
+--- y:        tile Y, relative to the first tile
+--- n:        side length of the curve (power of 2)
+--- order:    traversal order
++++ Return:   position on the curve
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+unsigned long curve_index(int x, int y, int n, int order){
+unsigned long d = 0;
+int s, rx, ry, tmp;
+
+
+  if (order == _ORDER_ZORDER_){
+    for (s=n/2; s>0; s/=2){
+      d = (d << 2) | ((y & s) ? 2 : 0) | ((x & s) ? 1 : 0);
+    }
+    return d;
+  }
+
+  for (s=n/2; s>0; s/=2){
+
+    rx = (x & s) > 0;
+    ry = (y & s) > 0;
+    d += (unsigned long)s * s * ((3 * rx) ^ ry);
+
+    // rotate the quadrant
+    if (ry == 0){
+      if (rx == 1){ x = n-1 - x; y = n-1 - y;}
+      tmp = x; x = y; y = tmp;
+    }
+
+  }
+
+  return d;
+}
+
+
+/** This function compares two tiles by their position on the curve, 
++++ ties are broken by Y and X, such that all processes of a distributed
++++ run arrive at the same order.
+--- a:        tile 1
+--- b:        tile 2
++++ Return:   comparison result
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int compare_curve(const void *a, const void *b){
+const curve_t *t1 = (const curve_t*)a;
+const curve_t *t2 = (const curve_t*)b;
+
+
+  if (t1->d < t2->d) return -1;
+  if (t1->d > t2->d) return  1;
+  if (t1->y != t2->y) return (t1->y < t2->y) ? -1 : 1;
+  if (t1->x != t2->x) return (t1->x < t2->x) ? -1 : 1;
+  return 0;
+}
+
+
+/** This function reorders the tiles along a space-filling curve, such 
++++ that consecutive processing units are spatially close. Neighboring
++++ tiles share the same ARD files, halo data, and cached datasets. The
++++ chunks of a tile are still processed in sequence.
+--- pro:      progress handle
+--- ntile:    number of tiles
+--- order:    traversal order
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void order_tiles(progress_t *pro, int ntile, int order){
+curve_t *curve = NULL;
+int tile, xmin, ymin, xmax, ymax, n = 1;
+
+
+  if (order == _ORDER_NONE_ || ntile < 3) return;
+
+  xmin = xmax = pro->tiles_x[0];
+  ymin = ymax = pro->tiles_y[0];
+
+  for (tile=1; tile<ntile; tile++){
+    if (pro->tiles_x[tile] < xmin) xmin = pro->tiles_x[tile];
+    if (pro->tiles_x[tile] > xmax) xmax = pro->tiles_x[tile];
+    if (pro->tiles_y[tile] < ymin) ymin = pro->tiles_y[tile];
+    if (pro->tiles_y[tile] > ymax) ymax = pro->tiles_y[tile];
+  }
+
+  while (n <= xmax-xmin || n <= ymax-ymin) n *= 2;
+
+  alloc((void**)&curve, ntile, sizeof(curve_t));
+
+  for (tile=0; tile<ntile; tile++){
+    curve[tile].x = pro->tiles_x[tile];
+    curve[tile].y = pro->tiles_y[tile];
+    curve[tile].d = curve_index(curve[tile].x-xmin, curve[tile].y-ymin, n, order);
+  }
+
+  qsort(curve, ntile, sizeof(curve_t), compare_curve);
+
+  for (tile=0; tile<ntile; tile++){
+    pro->tiles_x[tile] = curve[tile].x;
+    pro->tiles_y[tile] = curve[tile].y;
+  }
+
+  free((void*)curve);
+
+  return;
+}
+
+
 /** This function initializes the progress handle
 --- pro:      progress handle
 --- cube:     datacube definition
@@ -77,18 +239,67 @@ void init_progess(progress_t *pro, cube_t *cube, par_hl_t *phl){
   pro->thread[_TASK_RUNTIME_] = phl->ithread+phl->cthread+phl->othread;
 
   pro->npu = cube->tn*cube->cn;
+  pro->mode  = phl->stream_mode;
+  pro->depth = phl->stream_depth;
 
   alloc((void**)&pro->tiles_x, cube->tn, sizeof(int));
   alloc((void**)&pro->tiles_y, cube->tn, sizeof(int));
   memmove(pro->tiles_x, cube->tx, cube->tn*sizeof(int));
   memmove(pro->tiles_y, cube->ty, cube->tn*sizeof(int));
+  order_tiles(pro, cube->tn, phl->tile_order);
+
+  alloc((void**)&pro->unit, pro->npu, sizeof(int));
+  pro->nunit_max = pro->npu;
+  pro->claim     = 0;
+  pro->claim_tile = -1;
+  if (strcmp(phl->d_dist, "NULL") != 0){
+    pro->d_claim = phl->d_dist;
+  } else pro->d_claim = NULL;
+
+  pro->record = NULL;
+  pro->ftel   = NULL;
+
+  pro->fjournal = NULL;
+  pro->nskip    = 0;
+  alloc((void**)&pro->skip, pro->npu, sizeof(bool));
+
+  if (strcmp(phl->f_journal, "NULL") != 0){
+    read_journal(pro, phl->f_journal);
+    pro->nunit_max = pro->npu - pro->nskip;
+    if ((pro->fjournal = fopen(phl->f_journal, "a")) == NULL){
+      printf("Unable to open journal %s. Completed blocks won't be recorded.\n", phl->f_journal);
+    }
+  }
+
+  pro->tune      = phl->athread;
+  pro->tune_unit = 0;
+  pro->tune_bound[_TASK_INPUT_]   = 0;
+  pro->tune_bound[_TASK_COMPUTE_] = 0;
+  pro->tune_bound[_TASK_OUTPUT_]  = 0;
+  pro->tune_bound[_TASK_ALL_]     = 0;
+  pro->tune_bound[_TASK_RUNTIME_] = 0;
+
+  if (strcmp(phl->f_telemetry, "NULL") != 0){
+    if ((pro->ftel = fopen(phl->f_telemetry, "a")) == NULL){
+      printf("Unable to open telemetry file %s. Telemetry is disabled.\n", phl->f_telemetry);
+    } else {
+      alloc((void**)&pro->record, pro->npu, sizeof(unit_record_t));
+      enable_mem_accounting(true);
+    }
+  }
 
 
-  pro->pu       = -2; // init processing unit at -2!
-  pro->pu_prev  =  0;
-  pro->pu_next  =  0;
+  pro->pu       = -1;
+  pro->pu_prev  = -1;
+  pro->pu_next  = -1;
   pro->done     =  0;
 
+  pro->nunit[_TASK_INPUT_]   = 0;
+  pro->nunit[_TASK_COMPUTE_] = 0;
+  pro->nunit[_TASK_OUTPUT_]  = 0;
+  pro->nunit[_TASK_ALL_]     = 0;
+  pro->nunit[_TASK_RUNTIME_] = 0;
+
   pro->tile      = 0;
   pro->tile_prev = 0;
   pro->tile_next = 0;
@@ -125,6 +336,15 @@ void init_progess(progress_t *pro, cube_t *cube, par_hl_t *phl){
   pro->secs_bound[_TASK_ALL_]     = 0;
   pro->secs_bound[_TASK_RUNTIME_] = 0;
 
+  pro->mem[_TASK_INPUT_]   = 0; 
+  pro->mem[_TASK_COMPUTE_] = 0; 
+  pro->mem[_TASK_OUTPUT_]  = 0;
+  pro->mem[_TASK_ALL_]     = 0;
+  pro->mem[_TASK_RUNTIME_] = 0;
+  pro->mem_peak = 0;
+  pro->mem_budget = phl->mem_budget*1073741824.0;
+  pro->mem_warned = false;
+
   init_date(&pro->eta);
   init_date(&pro->runtime);
   init_date(&pro->saved);
@@ -143,6 +363,9 @@ void init_progess(progress_t *pro, cube_t *cube, par_hl_t *phl){
   
   printf("number of processing units: %d\n", pro->npu);
   printf(" (active tiles: %d, chunks per tile: %d)\n", cube->tn, cube->cn);
+  printf(" (buffered PUs between teams: %d)\n", pro->depth);
+  if (pro->d_claim != NULL) printf(" (PUs are shared with other processes via %s)\n", pro->d_claim);
+  if (pro->fjournal != NULL) printf(" (PUs completed in previous runs: %d)\n", pro->nskip);
   
   return;
 }
@@ -156,7 +379,7 @@ void rewind_stdout(progress_t *pro){
   
 #ifndef FORCE_DEBUG
 
-int line, nline = 12;
+int line, nline = 14;
 
   if (pro->pu >=0){
     for (line=0; line<=nline; line++) printf("\033[A\r");
@@ -169,120 +392,618 @@ int line, nline = 12;
 }
 
 
-/** This function sets the current processing units
+/** This function sets the current processing unit of one team
 --- pro:      progress handle
---- cube:     datacube definition
---- phl:      HL parameters
+--- task:     team (input, compute, output)
+--- pu:       processing unit, -1 if the team is done
 +++ Return:   void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-void processing_unit(progress_t *pro){
-  
-  pro->pu++;
-  pro->pu_prev  = pro->pu-1;
-  pro->pu_next  = pro->pu+1;
+void processing_unit(progress_t *pro, int task, int pu){
+int tile, chunk, tx, ty;
 
-  if (pro->pu >= 0 && pro->pu < pro->npu){
-    pro->tile = floor(pro->pu      / (float)pro->nchunk);
-  } else pro->tile = -1;
 
-  if (pro->pu_next >= 0 && pro->pu_next < pro->npu){
-    pro->tile_next = floor(pro->pu_next / (float)pro->nchunk);
-  } else pro->tile_next = -1;
-  
-  if (pro->pu_prev >= 0 && pro->pu_prev < pro->npu){
-    pro->tile_prev = floor(pro->pu_prev / (float)pro->nchunk);
-  } else pro->tile_prev = -1;
+  if (pu >= 0 && pu < pro->npu){
+    tile  = floor(pu / (float)pro->nchunk);
+    chunk = pu - (tile * pro->nchunk);
+    tx    = pro->tiles_x[tile];
+    ty    = pro->tiles_y[tile];
+  } else {
+    pu = tile = chunk = tx = ty = -1;
+  }
 
+  switch (task){
+    case _TASK_INPUT_:
+      pro->pu_next    = pu;
+      pro->tile_next  = tile;
+      pro->chunk_next = chunk;
+      pro->tx_next    = tx;
+      pro->ty_next    = ty;
+      break;
+    case _TASK_COMPUTE_:
+      pro->pu    = pu;
+      pro->tile  = tile;
+      pro->chunk = chunk;
+      pro->tx    = tx;
+      pro->ty    = ty;
+      break;
+    case _TASK_OUTPUT_:
+      pro->pu_prev    = pu;
+      pro->tile_prev  = tile;
+      pro->chunk_prev = chunk;
+      pro->tx_prev    = tx;
+      pro->ty_prev    = ty;
+      break;
+    default:
+      printf("unknown task\n");
+      break;
+  }
 
-  if (pro->tile > -1){
-    pro->chunk = pro->pu - (pro->tile * pro->nchunk);
-  } else pro->chunk  = -1;
-  
-  if (pro->tile_next > -1){
-    pro->chunk_next = pro->pu_next - (pro->tile_next * pro->nchunk);
-  } else pro->chunk_next = -1;
-  
-  if (pro->tile_prev > -1){
-    pro->chunk_prev = pro->pu_prev - (pro->tile_prev * pro->nchunk);
-  } else pro->chunk_prev = -1;
+  return;
+}
 
 
-  if (pro->tile > -1){
-    pro->tx = pro->tiles_x[pro->tile]; 
-  } else pro->tx = -1;
+/** This function returns the number of processing units that were fi-
++++ nished by one team. The counter is shared between the teams.
+--- pro:      progress handle
+--- task:     team (input, compute, output)
++++ Return:   number of finished processing units
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int get_unit_count(progress_t *pro, int task){
+int n;
+
 
-  if (pro->tile > -1){
-    pro->ty = pro->tiles_y[pro->tile];
-  } else pro->ty = -1;
+  #pragma omp atomic read seq_cst
+  n = pro->nunit[task];
 
-  if (pro->tile_next > -1){
-    pro->tx_next = pro->tiles_x[pro->tile_next]; 
-  } else pro->tx_next = -1;
+  return n;
+}
 
-  if (pro->tile_next > -1){
-    pro->ty_next = pro->tiles_y[pro->tile_next];
-  } else pro->ty_next = -1;
 
-  if (pro->tile_prev > -1){
-    pro->tx_prev = pro->tiles_x[pro->tile_prev]; 
-  } else pro->tx_prev = -1;
+/** This function returns the number of processing units of this process.
++++ In distributed mode, this is an upper bound until all units were
++++ claimed.
+--- pro:      progress handle
++++ Return:   number of processing units
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int get_unit_max(progress_t *pro){
+int n;
+
+
+  #pragma omp atomic read seq_cst
+  n = pro->nunit_max;
+
+  return n;
+}
+
+
+/** This function sets the number of processing units of this process
+--- pro:      progress handle
+--- n:        number of processing units
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void set_unit_max(progress_t *pro, int n){
+
+
+  #pragma omp atomic write seq_cst
+  pro->nunit_max = n;
 
-  if (pro->tile_prev > -1){
-    pro->ty_prev = pro->tiles_y[pro->tile_prev];
-  } else pro->ty_prev = -1;
-  
   return;
 }
 
 
-/** This function resets the clock
+/** This function claims the next processing unit. Without distributed 
++++ processing, all units are processed in order. In distributed mode, 
++++ several processes - possibly on different nodes - share the tiles via
++++ a shared directory. A tile is claimed by exclusively creating a claim
++++ file, tiles claimed by other processes are skipped. Whole tiles are 
++++ claimed, such that the chunks of an output file are written by one 
++++ process, and in order. This function is only called by the input team.
+--- pro:      progress handle
++++ Return:   processing unit, -1 if all units are claimed
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int claim_unit(progress_t *pro){
+int pu, tile;
+char fname[NPOW_10];
+char host[NPOW_08];
+int nchar, fd;
+
+
+  while (pro->claim < pro->npu){
+
+    pu = pro->claim++;
+
+    if (pro->skip[pu]) continue;
+
+    if (pro->d_claim == NULL) return pu;
+
+    tile = floor(pu / (float)pro->nchunk);
+
+    if (tile == pro->claim_tile) return pu;
+
+    nchar = snprintf(fname, NPOW_10, "%s/X%04d_Y%04d.claim", 
+      pro->d_claim, pro->tiles_x[tile], pro->tiles_y[tile]);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); exit(FAILURE);}
+
+    if ((fd = open(fname, O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0){
+      // tile belongs to another process, skip all of its chunks
+      if (errno == EEXIST){ pro->claim = (tile+1)*pro->nchunk; continue;}
+      printf("Unable to claim %s. ", fname); exit(FAILURE);
+    }
+
+    pro->claim_tile = tile;
+
+    if (gethostname(host, NPOW_08) != 0) copy_string(host, NPOW_08, "unknown");
+    host[NPOW_08-1] = '\0';
+    dprintf(fd, "%s %d\n", host, (int)getpid());
+    close(fd);
+
+    return pu;
+
+  }
+
+  return -1;
+}
+
+
+/** This function tells whether a team can start to work on a processing 
++++ unit. Input may run ahead of compute by depth PUs, compute needs the
++++ input and may run ahead of output by depth PUs, output needs the com-
++++ puted results.
+--- pro:      progress handle
+--- task:     team (input, compute, output)
+--- i:        index of processing unit in this process
++++ Return:   true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool unit_ready(progress_t *pro, int task, int i){
+
+
+  switch (task){
+    case _TASK_INPUT_:
+      return (i - get_unit_count(pro, _TASK_COMPUTE_) <= pro->depth);
+    case _TASK_COMPUTE_:
+      return (i < get_unit_count(pro, _TASK_INPUT_) &&
+              i - get_unit_count(pro, _TASK_OUTPUT_) <= pro->depth);
+    case _TASK_OUTPUT_:
+      return (i < get_unit_count(pro, _TASK_COMPUTE_));
+    default:
+      printf("unknown task\n");
+      return false;
+  }
+
+}
+
+
+/** This function waits until a team can work on its next processing 
++++ unit, and sets this unit. The input team claims the unit, the other
++++ teams follow in the same order. The waiting time is booked as bound 
++++ time: compute waiting for input is I-bound, compute waiting for out-
++++ put is O-bound, input waiting for compute is C-bound.
 --- pro:      progress handle
+--- task:     team (input, compute, output)
++++ Return:   true if there is a unit to work on, false if the team is done
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool next_unit(progress_t *pro, int task){
+int i, pu;
+double start, wait;
+bool input, done = false;
+
+
+  i = get_unit_count(pro, task);
+
+  start = omp_get_wtime();
+
+  if (task == _TASK_COMPUTE_){
+    input = (i >= get_unit_count(pro, _TASK_INPUT_));
+  } else input = false;
+
+  // the input team finishes the process when no unit is left to claim,
+  // the other teams when they have caught up with the input team
+  while (!(done = (i >= get_unit_max(pro))) && !unit_ready(pro, task, i)){
+    usleep(POLL_USEC);
+  }
+
+  if (!done && task == _TASK_INPUT_){
+    if ((pu = claim_unit(pro)) < 0){
+      set_unit_max(pro, i);
+      done = true;
+    } else {
+      pro->unit[i] = pu;
+    }
+  }
+
+  if (done){
+    processing_unit(pro, task, -1);
+    return false;
+  }
+
+  wait = omp_get_wtime() - start;
+
+  if (task == _TASK_INPUT_){
+    pro->secs_bound[_TASK_COMPUTE_] += wait;
+  } else if (task == _TASK_COMPUTE_ && input){
+    pro->secs_bound[_TASK_INPUT_] += wait;
+  } else if (task == _TASK_COMPUTE_){
+    pro->secs_bound[_TASK_OUTPUT_] += wait;
+  }
+
+  processing_unit(pro, task, pro->unit[i]);
+
+  return true;
+}
+
+
+/** This function marks the current processing unit of a team as finished
+--- pro:      progress handle
+--- task:     team (input, compute, output)
 +++ Return:   void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-void reset_time(progress_t *pro){
+void done_unit(progress_t *pro, int task){
 
 
-  measure_progress(pro, _TASK_INPUT_,   _CLOCK_NULL_);
-  measure_progress(pro, _TASK_COMPUTE_, _CLOCK_NULL_);
-  measure_progress(pro, _TASK_OUTPUT_,  _CLOCK_NULL_);
-  
+  pro->secs_total[task] += pro->secs[task];
+
+  #pragma omp atomic update seq_cst
+  pro->nunit[task]++;
+
   return;
 }
 
 
-/** This function computes task-bound time
+/** This function initializes a private progress handle for one process-
++++ ing unit. This is used by the task scheduler, where several units of 
++++ the same team may be worked on at the same time.
 --- pro:      progress handle
+--- unit:     private progress handle (returned)
+--- task:     team (input, compute, output)
+--- pu:       processing unit
 +++ Return:   void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-void bound_time(progress_t *pro){
+void unit_handle(progress_t *pro, progress_t *unit, int task, int pu){
+
+
+  *unit = *pro;
 
+  processing_unit(unit, task, pu);
+  measure_progress(unit, task, _CLOCK_NULL_);
 
-  pro->secs_bound[_TASK_INPUT_] += 
-    MAX_(0, pro->secs[_TASK_INPUT_] - 
-    MAX_(pro->secs[_TASK_COMPUTE_], pro->secs[_TASK_OUTPUT_]));
+  return;
+}
 
-  pro->secs_bound[_TASK_COMPUTE_] += 
-    MAX_(0, pro->secs[_TASK_COMPUTE_] - 
-    MAX_(pro->secs[_TASK_INPUT_], pro->secs[_TASK_OUTPUT_]));
 
-  pro->secs_bound[_TASK_OUTPUT_] += 
-    MAX_(0, pro->secs[_TASK_OUTPUT_] - 
-    MAX_(pro->secs[_TASK_INPUT_], pro->secs[_TASK_COMPUTE_]));
+/** This function marks a processing unit that was worked on with a pri-
++++ vate progress handle as finished
+--- pro:      progress handle
+--- unit:     private progress handle
+--- task:     team (input, compute, output)
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void done_unit_handle(progress_t *pro, progress_t *unit, int task){
+
+
+  #pragma omp atomic update seq_cst
+  pro->secs_total[task] += unit->secs[task];
+
+  #pragma omp atomic update seq_cst
+  pro->nunit[task]++;
 
   return;
 }
 
 
-/** This function adds the task-time
+/** This function books memory that is held by buffered processing units.
++++ Input memory is held from reading until computing is done, output me-
++++ mory from computing until writing is done.
+--- pro:      progress handle
+--- task:     team that holds the memory (input or output)
+--- bytes:    memory, positive when allocated, negative when freed
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void account_memory(progress_t *pro, int task, double bytes){
+
+
+  #pragma omp critical (account_memory)
+  {
+    pro->mem[task] += bytes;
+    pro->mem[_TASK_ALL_] = pro->mem[_TASK_INPUT_] + pro->mem[_TASK_OUTPUT_];
+    if (pro->mem[_TASK_ALL_] > pro->mem_peak) pro->mem_peak = pro->mem[_TASK_ALL_];
+  }
+
+  return;
+}
+
+
+/** This function reserves the memory that is needed for reading a process-
++++ ing unit. If the memory held by the buffered units plus the reservation
++++ would exceed the budget, this function waits until enough memory was 
++++ released. If nothing is buffered, the unit is read in any case. The 
++++ waiting time is booked as C-bound time.
+--- pro:      progress handle
+--- bytes:    estimated memory
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void reserve_memory(progress_t *pro, double bytes){
+double held, start;
+
+
+  if (pro->mem_budget <= 0) return;
+
+  if (bytes > pro->mem_budget && !pro->mem_warned){
+    printf("Warning: a block needs ~%.0f MB, which exceeds MEMORY_BUDGET. "
+           "Consider reducing BLOCK_SIZE.\n", bytes/1048576.0);
+    pro->mem_warned = true;
+  }
+
+  start = omp_get_wtime();
+
+  while (true){
+
+    #pragma omp critical (account_memory)
+    held = pro->mem[_TASK_ALL_];
+
+    // tolerate rounding errors when nothing is held anymore
+    if (held < 1 || held + bytes <= pro->mem_budget) break;
+
+    #pragma omp taskyield
+    usleep(POLL_USEC);
+
+  }
+
+  pro->secs_bound[_TASK_COMPUTE_] += omp_get_wtime() - start;
+
+  account_memory(pro, _TASK_INPUT_, bytes);
+
+  return;
+}
+
+
+/** This function records the input of a processing unit for telemetry
+--- pro:      progress handle
+--- nt:       number of input datasets
+--- bytes:    bytes read
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void record_input(progress_t *pro, int nt, double bytes){
+
+
+  if (pro->record == NULL || pro->pu_next < 0) return;
+
+  pro->record[pro->pu_next].nt    = nt;
+  pro->record[pro->pu_next].bytes = bytes;
+
+  return;
+}
+
+
+/** This function records the time of a compute sub-task for telemetry
+--- pro:      progress handle
+--- sub:      sub-task
+--- start:    wall-clock start of sub-task (omp_get_wtime)
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void record_subtask(progress_t *pro, int sub, double start){
+
+
+  if (pro->record == NULL || pro->pu < 0) return;
+
+  pro->record[pro->pu].secs_sub[sub] += omp_get_wtime() - start;
+
+  return;
+}
+
+
+/** This function writes the telemetry record of a finished processing 
++++ unit as one JSON line. The memory accounting is appended, i.e. the 
++++ bytes held by each owner (live), and the peak since the previous re-
++++ cord. With buffered units, the memory belongs to several units.
+--- pro:      progress handle
+--- pu:       processing unit
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void write_telemetry(progress_t *pro, int pu){
+int tile, chunk, k, nowner;
+struct rusage usage;
+unit_record_t *rec = NULL;
+char owner[MEM_OWNER_LENGTH];
+double live, peak;
+
+
+  if (pro->record == NULL || pu < 0) return;
+
+  rec   = &pro->record[pu];
+  tile  = floor(pu / (float)pro->nchunk);
+  chunk = pu - (tile * pro->nchunk);
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0) usage.ru_maxrss = -1;
+
+  #pragma omp critical (telemetry)
+  {
+    fprintf(pro->ftel, "{\"tile_x\": %d, \"tile_y\": %d, \"chunk\": %d, "
+      "\"nt\": %d, \"bytes_read\": %.0f, "
+      "\"secs_input\": %.3f, \"secs_compute\": %.3f, \"secs_output\": %.3f, "
+      "\"secs_screen_qai\": %.3f, \"secs_screen_noise\": %.3f, "
+      "\"secs_spectral_adjust\": %.3f, \"secs_module\": %.3f, "
+      "\"threads_input\": %d, \"threads_compute\": %d, \"threads_output\": %d, "
+      "\"peak_rss_kb\": %ld, ",
+      pro->tiles_x[tile], pro->tiles_y[tile], chunk,
+      rec->nt, rec->bytes,
+      rec->secs[_TASK_INPUT_], rec->secs[_TASK_COMPUTE_], rec->secs[_TASK_OUTPUT_],
+      rec->secs_sub[_SUBTASK_QAI_], rec->secs_sub[_SUBTASK_NOISE_],
+      rec->secs_sub[_SUBTASK_ADJUST_], rec->secs_sub[_SUBTASK_MODULE_],
+      pro->thread[_TASK_INPUT_], pro->thread[_TASK_COMPUTE_], pro->thread[_TASK_OUTPUT_],
+      (long)usage.ru_maxrss);
+
+    get_mem_total(&live, &peak);
+    fprintf(pro->ftel, "\"mem_live\": %.0f, \"mem_peak\": %.0f, \"mem_owner\": {", live, peak);
+    nowner = get_mem_owner_count();
+    for (k=0; k<nowner; k++){
+      get_mem_owner(k, owner, MEM_OWNER_LENGTH, &live, &peak);
+      fprintf(pro->ftel, "%s\"%s\": [%.0f, %.0f]", (k > 0) ? ", " : "", owner, live, peak);
+    }
+    fprintf(pro->ftel, "}}\n");
+    reset_mem_peak();
+
+    fflush(pro->ftel);
+  }
+
+  return;
+}
+
+
+/** This function reads the journal of a previous run, and marks the pro-
++++ cessing units that were completed, such that they are skipped. Each
++++ line of the journal holds the tile, chunk, and number of products.
+--- pro:      progress handle
+--- fname:    journal file
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void read_journal(progress_t *pro, char *fname){
+FILE *fp = NULL;
+char line[NPOW_10];
+int x, y, chunk, nprod, tile, ntile;
+
+
+  pro->nskip = 0;
+
+  if ((fp = fopen(fname, "r")) == NULL) return;
+
+  ntile = pro->npu / pro->nchunk;
+
+  while (fgets(line, NPOW_10, fp) != NULL){
+
+    if (sscanf(line, "X%d_Y%d C%d %d", &x, &y, &chunk, &nprod) != 4) continue;
+    if (chunk < 0 || chunk >= pro->nchunk) continue;
+
+    for (tile=0; tile<ntile; tile++){
+      if (pro->tiles_x[tile] == x && pro->tiles_y[tile] == y) break;
+    }
+    if (tile == ntile) continue;
+
+    if (!pro->skip[tile*pro->nchunk + chunk]) pro->nskip++;
+    pro->skip[tile*pro->nchunk + chunk] = true;
+
+  }
+
+  fclose(fp);
+
+  return;
+}
+
+
+/** This function records a processing unit in the journal after all of its
++++ products were written successfully. The journal is flushed to disk
++++ right away, such that a killed run can be resumed.
+--- pro:      progress handle
+--- pu:       processing unit
+--- nprod:    number of products written
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void journal_unit(progress_t *pro, int pu, int nprod){
+int tile, chunk;
+
+
+  if (pro->fjournal == NULL || pu < 0) return;
+
+  tile  = floor(pu / (float)pro->nchunk);
+  chunk = pu - (tile * pro->nchunk);
+
+  #pragma omp critical (journal)
+  {
+    fprintf(pro->fjournal, "X%04d_Y%04d C%04d %d\n", 
+      pro->tiles_x[tile], pro->tiles_y[tile], chunk, nprod);
+    fflush(pro->fjournal);
+    fsync(fileno(pro->fjournal));
+  }
+
+  return;
+}
+
+
+/** This function returns the number of threads of one team
+--- pro:      progress handle
+--- task:     team (input, compute, output)
++++ Return:   number of threads
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int get_threads(progress_t *pro, int task){
+int n;
+
+
+  #pragma omp atomic read
+  n = pro->thread[task];
+
+  return n;
+}
+
+
+/** This function moves one thread between two teams
+--- pro:      progress handle
+--- from:     team that gives a thread
+--- to:       team that gets a thread
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void move_thread(progress_t *pro, int from, int to){
+
+
+  if (pro->thread[from] <= 1) return;
+
+  #pragma omp atomic update
+  pro->thread[from]--;
+
+  #pragma omp atomic update
+  pro->thread[to]++;
+
+  return;
+}
+
+
+/** This function tunes the split of threads between the teams. Every 
++++ TUNE_UNITS processing units, the bound time of the last window is 
++++ evaluated, and one thread is moved to the team that was the bottle-
++++ neck. The thread is taken from the team with the most threads. The
++++ total number of threads remains the same. This function needs to be
++++ called by the compute team.
+--- pro:      progress handle
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void tune_threads(progress_t *pro){
+double delta[_TASK_LENGTH_];
+int n, task, bottleneck = -1, donor = -1;
+double max = 0;
+
+
+  if (!pro->tune) return;
+
+  n = get_unit_count(pro, _TASK_COMPUTE_);
+  if (n - pro->tune_unit < TUNE_UNITS) return;
+
+  for (task=_TASK_INPUT_; task<=_TASK_OUTPUT_; task++){
+    delta[task] = pro->secs_bound[task] - pro->tune_bound[task];
+    pro->tune_bound[task] = pro->secs_bound[task];
+    if (delta[task] > max){ max = delta[task]; bottleneck = task;}
+  }
+
+  pro->tune_unit = n;
+
+  if (bottleneck < 0) return;
+
+  for (task=_TASK_INPUT_; task<=_TASK_OUTPUT_; task++){
+    if (task == bottleneck) continue;
+    if (donor < 0 || pro->thread[task] > pro->thread[donor]) donor = task;
+  }
+
+  move_thread(pro, donor, bottleneck);
+
+  return;
+}
+
+
+/** This function sums up the task-time
 --- pro:      progress handle
 +++ Return:   void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void add_time(progress_t *pro){
 
 
-  pro->secs_total[_TASK_INPUT_]   += pro->secs[_TASK_INPUT_];
-  pro->secs_total[_TASK_COMPUTE_] += pro->secs[_TASK_COMPUTE_];
-  pro->secs_total[_TASK_OUTPUT_]  += pro->secs[_TASK_OUTPUT_];
   pro->secs_total[_TASK_ALL_] = pro->secs_total[_TASK_INPUT_]   + 
                                 pro->secs_total[_TASK_COMPUTE_] + 
                                 pro->secs_total[_TASK_OUTPUT_];
@@ -296,11 +1017,12 @@ void add_time(progress_t *pro){
 +++ Return:   void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void eta(progress_t *pro){
+int n = get_unit_count(pro, _TASK_COMPUTE_);
 
 
-  if (pro->pu > 0 && pro->secs_total[_TASK_ALL_] > 0){
-    set_secs(&pro->eta, (pro->npu-pro->pu) * 
-                        (pro->secs_total[_TASK_ALL_]/pro->pu));
+  if (n > 0 && pro->secs_total[_TASK_ALL_] > 0){
+    set_secs(&pro->eta, (get_unit_max(pro)-n) * 
+                        (pro->secs_total[_TASK_ALL_]/n));
   } else {
     set_secs(&pro->eta, 0);
   }
@@ -316,11 +1038,7 @@ void eta(progress_t *pro){
 void percent_done(progress_t *pro){
 
 
-  if (pro->pu >= 0){
-    pro->done = (float)pro->pu/pro->npu*100.0;
-  } else {
-    pro->done = 0;
-  }
+  pro->done = (float)get_unit_count(pro, _TASK_OUTPUT_)/get_unit_max(pro)*100.0;
 
   return;
 }
@@ -349,7 +1067,7 @@ void print_progress_summary(progress_t *pro){
     printf("Time for I/C/O:        not available yet\n");
   }
 
-  if (pro->pu > 0 && pro->secs_total[_TASK_ALL_] > 0){
+  if (get_unit_count(pro, _TASK_COMPUTE_) > 0 && pro->secs_total[_TASK_ALL_] > 0){
     printf("ETA:             %02dy %02dm %02dd %02dh %02dm %02ds\n", 
       pro->eta.year, pro->eta.month, 
       pro->eta.day,  pro->eta.hh, 
@@ -384,6 +1102,13 @@ void print_progress_details(progress_t *pro){
   printf("Chunk ID:        %7d %7d %7d\n", 
     pro->chunk_next, pro->chunk, pro->chunk_prev);
   
+  printf("Buffered PUs:    %7d %7s %7d\n", 
+    get_unit_count(pro, _TASK_INPUT_)   - get_unit_count(pro, _TASK_COMPUTE_), "-",
+    get_unit_count(pro, _TASK_COMPUTE_) - get_unit_count(pro, _TASK_OUTPUT_));
+
+  printf("Memory (MB):     %7.0f %7s %7.0f\n", 
+    pro->mem[_TASK_INPUT_]/1048576.0, "-", pro->mem[_TASK_OUTPUT_]/1048576.0);
+
   printf("Threads:         %7d %7d %7d\n", 
     pro->thread[_TASK_INPUT_], pro->thread[_TASK_COMPUTE_], pro->thread[_TASK_OUTPUT_]);
 
@@ -436,6 +1161,8 @@ void print_progress_runtime(progress_t *pro){
     pro->saved.day,  pro->saved.hh, 
     pro->saved.mm,   pro->saved.ss);
 
+  printf("Peak memory:     %.0f MB (buffered PUs)\n", pro->mem_peak/1048576.0);
+
   printf("\n________________________________________\n");
   printf("Virtual I-time:  %02dy %02dm %02dd %02dh %02dm %02ds\n", 
     pro->sequential[_TASK_INPUT_].year, pro->sequential[_TASK_INPUT_].month, 
@@ -472,6 +1199,97 @@ void print_progress_runtime(progress_t *pro){
 }
 
 
+/** This function gathers the timing of all processes that share the pro-
++++ cessing units in distributed mode. Each process appends its timing to 
++++ a summary file in the shared directory, and prints the summary of all
++++ processes that have finished so far. The last process that finishes
++++ prints the complete summary.
+--- pro:      progress handle
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void gather_progress(progress_t *pro){
+char fname[NPOW_10];
+char host[NPOW_08];
+char line[NPOW_10];
+lock_t *lock = NULL;
+FILE *fp = NULL;
+int nchar, n, nproc = 0, nunit = 0;
+double secs[_TASK_LENGTH_];
+double total[_TASK_LENGTH_] = { 0 };
+date_t sum[_TASK_LENGTH_];
+int task;
+
+
+  nchar = snprintf(fname, NPOW_10, "%s/timing.txt", pro->d_claim);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return;}
+
+  if ((lock = lock_file(fname, 60)) == NULL){
+    printf("Unable to lock %s (timeout: %ds).\n", fname, 60); return;}
+
+  if (gethostname(host, NPOW_08) != 0) copy_string(host, NPOW_08, "unknown");
+  host[NPOW_08-1] = '\0';
+
+  if ((fp = fopen(fname, "a")) != NULL){
+    fprintf(fp, "%s %d %d %f %f %f %f\n", host, (int)getpid(), 
+      get_unit_count(pro, _TASK_OUTPUT_),
+      pro->secs_total[_TASK_INPUT_], pro->secs_total[_TASK_COMPUTE_],
+      pro->secs_total[_TASK_OUTPUT_], pro->secs_total[_TASK_RUNTIME_]);
+    fclose(fp);
+  }
+
+  if ((fp = fopen(fname, "r")) != NULL){
+    while (fgets(line, NPOW_10, fp) != NULL){
+      if (sscanf(line, "%*s %*d %d %lf %lf %lf %lf", &n, 
+            &secs[_TASK_INPUT_], &secs[_TASK_COMPUTE_], 
+            &secs[_TASK_OUTPUT_], &secs[_TASK_RUNTIME_]) != 5) continue;
+      nproc++;
+      nunit += n;
+      for (task=0; task<_TASK_LENGTH_; task++){
+        if (task == _TASK_ALL_) continue;
+        total[task] += secs[task];
+      }
+    }
+    fclose(fp);
+  }
+
+  unlock_file(lock);
+
+  total[_TASK_ALL_] = total[_TASK_INPUT_] + total[_TASK_COMPUTE_] + total[_TASK_OUTPUT_];
+  for (task=0; task<_TASK_LENGTH_; task++) set_secs(&sum[task], total[task]);
+
+  printf("\n________________________________________\n");
+  printf("Distributed processing: %d of %d PUs by %d processes\n", nunit, pro->npu, nproc);
+
+  printf("Summed real time:    %02dy %02dm %02dd %02dh %02dm %02ds\n", 
+    sum[_TASK_RUNTIME_].year, sum[_TASK_RUNTIME_].month,
+    sum[_TASK_RUNTIME_].day,  sum[_TASK_RUNTIME_].hh, 
+    sum[_TASK_RUNTIME_].mm,   sum[_TASK_RUNTIME_].ss);
+
+  printf("Summed virtual time: %02dy %02dm %02dd %02dh %02dm %02ds\n", 
+    sum[_TASK_ALL_].year, sum[_TASK_ALL_].month,
+    sum[_TASK_ALL_].day,  sum[_TASK_ALL_].hh, 
+    sum[_TASK_ALL_].mm,   sum[_TASK_ALL_].ss);
+
+  printf("Summed I-time:       %02dy %02dm %02dd %02dh %02dm %02ds\n", 
+    sum[_TASK_INPUT_].year, sum[_TASK_INPUT_].month,
+    sum[_TASK_INPUT_].day,  sum[_TASK_INPUT_].hh, 
+    sum[_TASK_INPUT_].mm,   sum[_TASK_INPUT_].ss);
+
+  printf("Summed C-time:       %02dy %02dm %02dd %02dh %02dm %02ds\n", 
+    sum[_TASK_COMPUTE_].year, sum[_TASK_COMPUTE_].month,
+    sum[_TASK_COMPUTE_].day,  sum[_TASK_COMPUTE_].hh, 
+    sum[_TASK_COMPUTE_].mm,   sum[_TASK_COMPUTE_].ss);
+
+  printf("Summed O-time:       %02dy %02dm %02dd %02dh %02dm %02ds\n", 
+    sum[_TASK_OUTPUT_].year, sum[_TASK_OUTPUT_].month,
+    sum[_TASK_OUTPUT_].day,  sum[_TASK_OUTPUT_].hh, 
+    sum[_TASK_OUTPUT_].mm,   sum[_TASK_OUTPUT_].ss);
+
+  return;
+}
+
+
 /** This function tells whether this chunk should be input
 --- pro:      progress handle
 +++ Return:   true/false
@@ -502,30 +1320,38 @@ bool write_this_chunk(progress_t *pro, int *nprod){
 }
 
 
-/** This function handles and prints progress
+/** This function prints progress. It is called by the compute team before
++++ each processing unit. When all processing units were output, the run-
++++ time summary is printed, and the progress handle is freed.
 --- pro:      progress handle
 +++ Return:   true/false
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 bool progress(progress_t *pro){
 
 
-  processing_unit(pro);
-
   rewind_stdout(pro);
 
-  bound_time(pro);
   add_time(pro);
 
 
-  if (pro->pu > pro->npu){
+  if (get_unit_count(pro, _TASK_OUTPUT_) >= get_unit_max(pro)){
 
     measure_progress(pro, _TASK_RUNTIME_, _CLOCK_TOCK_);
 
+    percent_done(pro);
+
     print_progress_summary(pro);
     print_progress_runtime(pro);
 
+    if (pro->d_claim != NULL) gather_progress(pro);
+
     free((void*)pro->tiles_x);
     free((void*)pro->tiles_y);
+    free((void*)pro->unit);
+    free((void*)pro->skip);
+    if (pro->fjournal != NULL) fclose(pro->fjournal);
+    if (pro->record != NULL) free((void*)pro->record);
+    if (pro->ftel != NULL) fclose(pro->ftel);
     
     return false;
   
@@ -537,12 +1363,9 @@ bool progress(progress_t *pro){
     print_progress_summary(pro);
     print_progress_details(pro);
 
-    reset_time(pro);
-    
     return true;
 
   }
 
 }
 
-
@@ -44,19 +44,47 @@ Progress header
 extern "C" {
 #endif
 
+typedef struct {
+  int nt;                           // number of input datasets
+  double bytes;                     // bytes read
+  double secs[_TASK_LENGTH_];       // wall-clock seconds per task
+  double secs_sub[_SUBTASK_LENGTH_]; // wall-clock seconds per compute sub-task
+} unit_record_t;
+
 typedef struct {
   int thread[_TASK_LENGTH_];
+  int mode;                 // streaming scheduler
+  int depth;                // number of PUs buffered between teams
+  int nunit[_TASK_LENGTH_]; // number of PUs finished by each team
   int pu, pu_next, pu_prev, npu;
   int tile, tile_next, tile_prev;
   int chunk, chunk_next, chunk_prev, nchunk;
   int tx, tx_next, tx_prev;
   int ty, ty_next, ty_prev;
   int *tiles_x, *tiles_y;
+  char *d_claim;            // shared directory for distributed processing
+  int *unit;                // PUs claimed by this process, in order
+  int nunit_max;            // number of PUs of this process
+  int claim;                // next PU to claim
+  int claim_tile;           // tile claimed by this process (distributed)
   float done;
   time_t TIME[_TASK_LENGTH_];
   double secs[_TASK_LENGTH_];
   double secs_total[_TASK_LENGTH_];
   double secs_bound[_TASK_LENGTH_];
+  double mem[_TASK_LENGTH_];  // memory held by buffered PUs (bytes)
+  double mem_peak;            // peak of buffered memory (bytes)
+  double mem_budget;          // memory budget for buffered PUs (bytes)
+  bool mem_warned;            // warned that a PU exceeds the budget?
+  double wall[_TASK_LENGTH_]; // wall-clock start of task
+  unit_record_t *record;      // per-PU telemetry records
+  FILE *ftel;                 // telemetry file
+  FILE *fjournal;             // journal of completed PUs
+  bool *skip;                 // PUs completed in a previous run
+  int nskip;                  // number of PUs completed in a previous run
+  bool tune;                  // tune the thread split on the fly?
+  int tune_unit;              // PUs computed at last tuning
+  double tune_bound[_TASK_LENGTH_]; // bound time at last tuning
   date_t eta, runtime, saved;
   date_t bound[_TASK_LENGTH_];
   date_t sequential[_TASK_LENGTH_];
@@ -67,6 +95,22 @@ void init_progess(progress_t *pro, cube_t *cube, par_hl_t *phl);
 bool read_this_chunk(progress_t *pro);
 bool compute_this_chunk(progress_t *pro);
 bool write_this_chunk(progress_t *pro, int *nprod);
+int  get_unit_count(progress_t *pro, int task);
+int  get_unit_max(progress_t *pro);
+void set_unit_max(progress_t *pro, int n);
+int  claim_unit(progress_t *pro);
+bool next_unit(progress_t *pro, int task);
+void done_unit(progress_t *pro, int task);
+void unit_handle(progress_t *pro, progress_t *unit, int task, int pu);
+void done_unit_handle(progress_t *pro, progress_t *unit, int task);
+void account_memory(progress_t *pro, int task, double bytes);
+void reserve_memory(progress_t *pro, double bytes);
+void record_input(progress_t *pro, int nt, double bytes);
+void record_subtask(progress_t *pro, int sub, double start);
+void write_telemetry(progress_t *pro, int pu);
+void journal_unit(progress_t *pro, int pu, int nprod);
+int  get_threads(progress_t *pro, int task);
+void tune_threads(progress_t *pro);
 bool progress(progress_t *pro);
 
 #ifdef __cplusplus
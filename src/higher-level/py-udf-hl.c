@@ -50,7 +50,11 @@ typedef struct {
 
 
 py_dimlab_t python_label_dimensions(ard_t *ard, tsa_t *ts, int submodule, char *idx_name, int nb, int nt, par_udf_t *udf);
-int date_from_bandname(date_t *date, char *bandname);
+void free_label_dimensions(py_dimlab_t *pylab);
+size_t band_stride(short **band, int n, int nc);
+
+// keep the interpreter alive across runs (service mode)
+bool python_persistent = false;
 
 /** public functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
@@ -79,11 +83,26 @@ par_udf_t *udf;
   }
 
 
-  Py_Initialize();
+  // numpy cannot be initialized twice in the same process,
+  // thus a persistent interpreter is reused for later runs
+  if (!Py_IsInitialized()){
+
+    Py_Initialize();
 
-  import_array();
+    import_array();
+
+  } else {
+
+    // forget the UDF of the previous run
+    PyRun_SimpleString(
+      "for f in ('forcepy_init', 'forcepy_pixel', 'forcepy_batch', 'forcepy_block'): \n"
+      "    globals().pop(f, None)                                                    \n");
+
+  }
 
   PyRun_SimpleString("from multiprocessing.pool import Pool");
+  PyRun_SimpleString("from multiprocessing import get_context");
+  PyRun_SimpleString("import mmap");
   PyRun_SimpleString("import numpy as np");
   PyRun_SimpleString("from datetime import date as Date");
   PyRun_SimpleString("import traceback");
@@ -94,12 +113,28 @@ par_udf_t *udf;
                      "    signal.signal(signal.SIGINT, signal.SIG_DFL)             \n");
   PyRun_SimpleString("init()");
 
+  // pixel and batch functions run in forked worker processes, which 
+  // inherit the input block, and write into an output block in shared
+  // memory. Each worker receives a batch of rows as [time, band, pixel]
+  // array; pixel functions are vectorized by looping over the batch.
   PyRun_SimpleString(
-    "def forcepy_wrapper(args):                                                    \n"
-    "    forcepy_udf, inarray, nband, date, sensor, bandname, nodata, nproc = args \n"
-    "    outarray = np.full(shape=(nband,), fill_value=nodata, dtype=np.int16)     \n"
-    "    forcepy_udf(inarray, outarray, date, sensor, bandname, nodata, nproc)     \n"
-    "    return outarray                                                           \n");
+    "forcepy_shared_ = None                                                        \n"
+    "forcepy_kernel_ = None                                                        \n"
+    "def forcepy_pixel_batch_(inarray, outarray, date, sensor, bandname, nodata, nproc): \n"
+    "    pixel = np.empty(shape=(outarray.shape[0],), dtype=np.int16)              \n"
+    "    for p in range(inarray.shape[2]):                                         \n"
+    "        pixel[:] = nodata                                                     \n"
+    "        forcepy_pixel(inarray[:, :, p:p+1, None], pixel, date, sensor, bandname, nodata, 1) \n"
+    "        outarray[:, p] = pixel                                                \n"
+    "def forcepy_rows_(rows):                                                      \n"
+    "    iblock, oblock, date, sensor, bandname, nodata = forcepy_shared_          \n"
+    "    nDates, nBands, nY, nX = iblock.shape                                     \n"
+    "    ny = rows[1] - rows[0]                                                    \n"
+    "    inarray = iblock[:, :, rows[0]:rows[1], :].reshape(nDates, nBands, ny*nX) \n"
+    "    outarray = np.full(shape=(oblock.shape[0], ny*nX), fill_value=nodata, dtype=np.int16) \n"
+    "    forcepy_kernel_(inarray, outarray, date, sensor, bandname, nodata, 1)     \n"
+    "    oblock[:, rows[0]:rows[1], :] = outarray.reshape(oblock.shape[0], ny, nX) \n"
+    "    return ny                                                                 \n");
 
   PyRun_SimpleString(
     "def forcepy_date2epoch(year, month, day):                                                  \n"
@@ -128,32 +163,47 @@ par_udf_t *udf;
     "        return None                                           \n");
 
   if (udf->type == _UDF_PIXEL_){
+    PyRun_SimpleString(
+      "def forcepy_kernel_select_():                       \n"
+      "    if 'forcepy_pixel' not in globals():            \n"
+      "        print('forcepy_pixel not found.')           \n"
+      "        return None                                 \n"
+      "    return forcepy_pixel_batch_                     \n");
+  } else if (udf->type == _UDF_BATCH_){
+    PyRun_SimpleString(
+      "def forcepy_kernel_select_():                       \n"
+      "    if 'forcepy_batch' not in globals():            \n"
+      "        print('forcepy_batch not found.')           \n"
+      "        return None                                 \n"
+      "    return forcepy_batch                            \n");
+  }
+
+  if (udf->type == _UDF_PIXEL_ || udf->type == _UDF_BATCH_){
     PyRun_SimpleString(
       "def forcepy_(iblock, year, month, day, sensor, bandname, nodata, nband, nproc):           \n"
       "    try:                                                                                  \n"
-      "        if 'forcepy_pixel' not in globals():                                              \n"
-      "            print('forcepy_pixel not found.')                                             \n"
-      "            return None                                                                   \n"
+      "        global forcepy_shared_, forcepy_kernel_                                           \n"
+      "        forcepy_kernel_ = forcepy_kernel_select_()                                        \n"
+      "        if forcepy_kernel_ is None: return None                                           \n"
       "        nDates, nBands, nY, nX = iblock.shape                                             \n"
-      "        pool = Pool(nproc, initializer=init)                                              \n"
       "        date = forcepy_date2epoch(year, month, day)                                       \n"
-      "        argss = list()                                                                    \n"
-      "        for yi in range(nY):                                                              \n"
-      "            for xi in range(nX):                                                          \n"
-      "                inarray = iblock[:, :, yi:yi+1, xi:xi+1]                                  \n"
-      "                args = (forcepy_pixel, inarray, nband, date, sensor, bandname, nodata, 1) \n"
-      "                argss.append(args)                                                        \n"
-      "        res = pool.map(func=forcepy_wrapper, iterable=argss)                              \n"
-      "        pool.close()                                                                      \n"
-      "        del pool                                                                          \n"
-      "        # reshape space dimensions                                                        \n"
-      "        oblock = np.full(shape=(nband, nY, nX), fill_value=nodata, dtype=np.int16)        \n"
-      "        i = 0                                                                             \n"
-      "        for yi in range(nY):                                                              \n"
-      "            for xi in range(nX):                                                          \n"
-      "                oblock[:, yi, xi] = res[i]                                                \n"
-      "                i += 1                                                                    \n"
-      "        return oblock                                                                     \n"
+      "        buffer = mmap.mmap(-1, max(nband*nY*nX*2, 1))                                     \n"
+      "        oblock = np.frombuffer(buffer, dtype=np.int16, count=nband*nY*nX)                 \n"
+      "        oblock = oblock.reshape(nband, nY, nX)                                            \n"
+      "        oblock[:] = nodata                                                                \n"
+      "        forcepy_shared_ = (iblock, oblock, date, sensor, bandname, nodata)                \n"
+      "        step = max(1, -(-nY // (nproc*4)))                                                \n"
+      "        rows = [(y, min(y+step, nY)) for y in range(0, nY, step)]                         \n"
+      "        if nproc > 1:                                                                     \n"
+      "            with get_context('fork').Pool(nproc, initializer=init) as pool:               \n"
+      "                pool.map(forcepy_rows_, rows)                                             \n"
+      "        else:                                                                             \n"
+      "            for r in rows: forcepy_rows_(r)                                               \n"
+      "        result = oblock.copy()                                                            \n"
+      "        forcepy_shared_ = None                                                            \n"
+      "        del oblock                                                                        \n"
+      "        buffer.close()                                                                    \n"
+      "        return result                                                                     \n"
       "    except:                                                                               \n"
       "        print(traceback.format_exc())                                                     \n"
       "        return None                                                                       \n");
@@ -185,6 +235,30 @@ par_udf_t *udf;
 }
 
 
+/** This function keeps the python interpreter alive across runs, i.e. 
++++ deregister_python does not finalize it anymore. This is needed when
++++ several jobs are run in the same process (service mode).
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void persist_python(){
+
+  python_persistent = true;
+
+  return;
+}
+
+
+/** This function finalizes a persistent python interpreter
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void finalize_python(){
+
+  if (python_persistent && Py_IsInitialized()) Py_Finalize();
+
+  return;
+}
+
+
 /** This function cleans up the python interpreter
 +++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
@@ -204,7 +278,7 @@ par_udf_t *udf;
     return;
   }
 
-  if (udf->out) Py_Finalize();
+  if (udf->out && !python_persistent) Py_Finalize();
 
   #ifdef FORCE_DEBUG
   printf("finished to deregister python interface\n");
@@ -279,7 +353,7 @@ date_t d;
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void init_pyp(ard_t *ard, tsa_t *ts, int submodule, char *idx_name, int nb, int nt, par_udf_t *udf){
 FILE *fpy             = NULL;
-py_dimlab_t pylab;
+py_dimlab_t *pylab    = NULL;
 PyObject *main_module = NULL;
 PyObject *main_dict   = NULL;
 PyObject *py_fun      = NULL;
@@ -295,9 +369,10 @@ int b;
   printf("starting to initialize python interface\n");
   #endif
 
-  //make sure bandnames and dates are NULL-initialized
+  //make sure bandnames, dates and labels are NULL-initialized
   udf->bandname = NULL;
   udf->date     = NULL;
+  udf->labels   = NULL;
 
   if (!udf->out){
     udf->nb = 1;
@@ -308,7 +383,10 @@ int b;
   main_module = PyImport_AddModule("__main__");
   main_dict   = PyModule_GetDict(main_module);
 
-  pylab = python_label_dimensions(ard, ts, submodule, idx_name, nb, nt, udf);
+  // the labels are created once, and re-used by python_udf
+  alloc((void**)&pylab, 1, sizeof(py_dimlab_t));
+  *pylab = python_label_dimensions(ard, ts, submodule, idx_name, nb, nt, udf);
+  udf->labels = pylab;
 
   // parse the provided python function
   fpy = fopen(udf->f_code, "r");
@@ -321,9 +399,9 @@ int b;
 
   py_return = PyObject_CallFunctionObjArgs(
     py_fun, 
-    pylab.year, pylab.month, pylab.day, 
-    pylab.sensor, 
-    pylab.bandname, 
+    pylab->year, pylab->month, pylab->day, 
+    pylab->sensor, 
+    pylab->bandname, 
     NULL);
 
   if (py_return == Py_None){
@@ -362,11 +440,6 @@ int b;
   }
 
 
-  Py_DECREF(pylab.year);
-  Py_DECREF(pylab.month);
-  Py_DECREF(pylab.day);
-  Py_DECREF(pylab.bandname);
-  Py_DECREF(pylab.sensor);
   Py_DECREF(py_return);
   
   fclose(fpy);
@@ -400,6 +473,12 @@ void term_pyp(par_udf_t *udf){
     udf->date = NULL;
   }
 
+  if (udf->labels != NULL){
+    free_label_dimensions((py_dimlab_t*)udf->labels);
+    free(udf->labels);
+    udf->labels = NULL;
+  }
+
   #ifdef FORCE_DEBUG
   printf("finished to terminate python interface\n");
   #endif
@@ -496,7 +575,53 @@ char bandname[NPOW_10];
 }
 
 
-/** This function connects FORCE to plug-in python UDFs
+/** This function releases the dimension labels
+--- pylab:  dimension labels
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_label_dimensions(py_dimlab_t *pylab){
+
+
+  Py_DECREF(pylab->year);
+  Py_DECREF(pylab->month);
+  Py_DECREF(pylab->day);
+  Py_DECREF(pylab->bandname);
+  Py_DECREF(pylab->sensor);
+
+  return;
+}
+
+
+/** This function tests whether bands are evenly spaced in memory, i.e.
++++ whether they can be exposed as one strided array.
+--- band:   bands
+--- n:      number of bands
+--- nc:     number of cells per band
++++ Return: distance between bands in cells, 0 if not evenly spaced
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+size_t band_stride(short **band, int n, int nc){
+ptrdiff_t stride;
+int b;
+
+
+  if (n < 2) return nc;
+
+  stride = band[1]-band[0];
+
+  if (stride < nc) return 0;
+
+  for (b=2; b<n; b++){
+    if (band[b]-band[b-1] != stride) return 0;
+  }
+
+  return (size_t)stride;
+}
+
+
+/** This function connects FORCE to plug-in python UDFs. The interpolated
++++ time series of the TSA submodule are handed to python as a read-only
++++ view, without copying, if the bands are evenly spaced in memory. ARD
++++ are copied, as the dates are separate bricks and need to be masked.
 --- ard:       pointer to instantly useable ARD image arrays
 --- udf:       pointer to instantly useable UDF image arrays
 --- ts:        pointer to instantly useable TSA image arrays
@@ -515,9 +640,10 @@ char bandname[NPOW_10];
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int python_udf(ard_t *ard, udf_t *udf_, tsa_t *ts, small *mask_, int submodule, char *idx_name, int nx, int ny, int nc, int nb, int nt, short nodata, par_udf_t *udf, int cthread){
 int b, t, p;
-size_t k;
+size_t stride;
 py_dimlab_t pylab;
 npy_intp dim_data[4] = { nt, nb, ny, nx };
+npy_intp str_data[4];
 FILE     *fpy         = NULL;
 PyObject *main_module = NULL;
 PyObject *main_dict   = NULL;
@@ -542,7 +668,12 @@ short* return_  = NULL;
   main_module = PyImport_AddModule("__main__");
   main_dict   = PyModule_GetDict(main_module);
 
-  pylab = python_label_dimensions(ard, ts, submodule, idx_name, nb, nt, udf);
+  // labels of this chunk were created by init_pyp
+  if (udf->labels != NULL){
+    pylab = *(py_dimlab_t*)udf->labels;
+  } else {
+    pylab = python_label_dimensions(ard, ts, submodule, idx_name, nb, nt, udf);
+  }
 
   fpy = fopen(udf->f_code, "r");
   PyRun_SimpleFile(fpy, udf->f_code);
@@ -556,28 +687,40 @@ short* return_  = NULL;
   py_nproc = PyLong_FromLong(cthread);
   py_nband = PyLong_FromLong(udf->nb);
 
-  py_data     = (PyArrayObject *) PyArray_SimpleNew(4, dim_data, NPY_INT16);
-  data_     = (short*)PyArray_DATA(py_data);
-
-
-  // copy C data to python objects
+  // hand C data to python objects
   
   if (submodule == _HL_UDF_){
 
-    for (t=0, k=0; t<nt; t++){
+    py_data = (PyArrayObject *) PyArray_SimpleNew(4, dim_data, NPY_INT16);
+    data_   = (short*)PyArray_DATA(py_data);
+
+    #pragma omp parallel for private(b,p) firstprivate(data_) shared(ard,nt,nb,nc,nodata) collapse(2) num_threads(cthread) default(none)
+    for (t=0; t<nt; t++){
       for (b=0; b<nb; b++){
+        short *dst = data_ + ((size_t)t*nb+b)*nc;
+        memcpy(dst, ard[t].dat[b], sizeof(short)*nc);
         for (p=0; p<nc; p++){
-          if (!ard[t].msk[p]){
-            data_[k++] = nodata;
-          } else {
-            data_[k++] = ard[t].dat[b][p];
-          }
+          if (!ard[t].msk[p]) dst[p] = nodata;
         }
       }
     }
 
+  } else if (submodule == _HL_TSA_ && nb == 1 && (stride = band_stride(ts->tsi_, nt, nc)) > 0){
+
+    // read-only view on the interpolated time series
+    str_data[0] = stride*sizeof(short);
+    str_data[1] = nt*stride*sizeof(short);
+    str_data[2] = nx*sizeof(short);
+    str_data[3] = sizeof(short);
+
+    py_data = (PyArrayObject *) PyArray_New(&PyArray_Type, 4, dim_data, NPY_INT16, 
+      str_data, ts->tsi_[0], sizeof(short), NPY_ARRAY_ALIGNED, NULL);
+
   } else if (submodule == _HL_TSA_){
 
+    py_data = (PyArrayObject *) PyArray_SimpleNew(4, dim_data, NPY_INT16);
+    data_   = (short*)PyArray_DATA(py_data);
+
     for (t=0; t<nt; t++){
       memcpy(data_, ts->tsi_[t], sizeof(short)*nc);
       data_ += nc;
@@ -636,11 +779,7 @@ short* return_  = NULL;
   Py_DECREF(py_nodata);
   Py_DECREF(py_nband);
   Py_DECREF(py_nproc);
-  Py_DECREF(pylab.year);
-  Py_DECREF(pylab.month);
-  Py_DECREF(pylab.day);
-  Py_DECREF(pylab.bandname);
-  Py_DECREF(pylab.sensor);
+  if (udf->labels == NULL) free_label_dimensions(&pylab);
 
 
   fclose(fpy);
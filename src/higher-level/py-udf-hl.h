@@ -30,6 +30,7 @@ Python UDF plug-in header
 
 #include <stdio.h>   // core input and output functions
 #include <stdlib.h>  // standard general utilities library
+#include <stddef.h>  // standard type definitions
 
 #include "../higher-level/tsa-hl.h"
 #include "../higher-level/udf-hl.h"
@@ -41,8 +42,11 @@ extern "C" {
 
 void register_python(par_hl_t *phl);
 void deregister_python(par_hl_t *phl);
+void persist_python();
+void finalize_python();
 void init_pyp(ard_t *ard, tsa_t *ts, int submodule, char *idx_name, int nb, int nt, par_udf_t *udf);
 void term_pyp(par_udf_t *udf);
+int date_from_bandname(date_t *date, char *bandname);
 int python_udf(ard_t *ard, udf_t *udf_, tsa_t *ts, small *mask_, int submodule, char *idx_name, int nx, int ny, int nc, int nb, int nt, short nodata, par_udf_t *udf, int cthread);
 
 #ifdef __cplusplus
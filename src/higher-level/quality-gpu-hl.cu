@@ -0,0 +1,257 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains the noise screening on the GPU. One thread per pixel
+compacts the valid observations, removes outliers and restores inliers,
+like screen_noise in quality-hl.c. The compacted lists are stored with
+the k-th observation of all pixels contiguous, and the pixels are pro-
+cessed in batches to bound the device memory. Multiplications and ad-
+ditions are not contracted, such that the masks are identical to the
+CPU's. Without FORCE_CUDA, this file is compiled as C++ and noise_gpu
+always cancels.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "quality-gpu-hl.h"
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#include <climits>        // integer limits
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define GPU_NTHREAD 256
+#define GPU_NOISE_SCRATCH 268435456 // max. bytes of compacted lists per batch
+
+
+/** Residual of an observation from the line through its neighbours, see
++++ noise_residual in quality-hl.c
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+__device__ float noise_residual_gpu(int y_left, int y_mid, int y_right, int ce_left, int ce_mid, int ce_right){
+int dce, slope;
+
+
+  dce   = (ce_right == ce_left) ? 1 : ce_right-ce_left;
+  slope = (int)__ddiv_rn((double)(y_right-y_left), (double)dce);
+
+  if (ce_right == ce_left) return (float)fabs(y_mid - (y_right-y_left) / 2.0);
+
+  return (float)fabs((double)(y_mid - slope*(ce_mid-ce_left) - y_left));
+}
+
+
+/** Noise screening kernel, one thread per pixel of the batch
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+__global__ void noise_kernel(const short * const *ard, small * const *msk, const small *mask, 
+  const int *ce, int *list, small *removed, int p0, int nb, noise_gpu_t job){
+int j = blockIdx.x*blockDim.x + threadIdx.x;
+int p = p0 + j;
+int t, k, k_max, kmax, n, m, t_left, t_right;
+int y_l, y_m, y_r;
+float y_hat, maxr, ssqr, noise, rel_noise;
+bool again;
+
+
+  if (j >= nb) return;
+  if (mask != NULL && !mask[p]) return;
+
+  // compact the valid observations
+  for (t=0, m=0; t<job.nt; t++){
+    removed[(size_t)t*nb+j] = false;
+    if (msk[t][p]) list[(size_t)(m++)*nb+j] = t;
+  }
+
+  noise = INT_MAX;
+
+  // remove outliers
+  do {
+
+    n = m-2;
+
+    if (n < 2) break;
+
+    maxr = 0;
+    ssqr = 0;
+    kmax = 0;
+
+    for (k=1; k<(m-1); k++){
+
+      y_l = ard[list[(size_t)(k-1)*nb+j]][p];
+      y_m = ard[list[(size_t)k*nb+j]][p];
+      y_r = ard[list[(size_t)(k+1)*nb+j]][p];
+
+      y_hat = noise_residual_gpu(y_l, y_m, y_r, 
+        ce[list[(size_t)(k-1)*nb+j]], ce[list[(size_t)k*nb+j]], ce[list[(size_t)(k+1)*nb+j]]);
+
+      k_max = k;
+
+      if (k == 1 && abs(y_l - y_r) > abs(y_m - y_r)){
+        k_max = k-1;
+      } else if (k == m-2 && abs(y_l - y_r) > abs(y_m - y_l)){
+        k_max = k+1;
+      }
+
+      if (y_hat > maxr){
+        maxr = y_hat;
+        kmax = k_max;
+      }
+
+      ssqr = __fadd_rn(ssqr, __fmul_rn(y_hat, y_hat));
+
+    }
+
+    noise = (float)sqrt((double)__fdiv_rn(ssqr, (float)n));
+    rel_noise = __fdiv_rn(maxr, noise);
+
+    again = (rel_noise > job.above_noise && n > 2);
+
+    if (rel_noise > job.above_noise){
+
+      t = list[(size_t)kmax*nb+j];
+      msk[t][p] = false;
+      removed[(size_t)t*nb+j] = true;
+
+      for (k=kmax+1; k<m; k++) list[(size_t)(k-1)*nb+j] = list[(size_t)k*nb+j];
+      m--;
+
+    }
+
+  } while (again);
+
+  if (noise == INT_MAX) return;
+
+  // restore inliers
+  t_left = -1;
+
+  for (t=0, k=0; t<(job.nt-1) && k<m; t++){
+
+    if (list[(size_t)k*nb+j] == t){
+      t_left = t; k++; continue;}
+
+    if (t_left < 0 || ard[t][p] == job.nodata || removed[(size_t)t*nb+j]) continue;
+
+    t_right = list[(size_t)k*nb+j];
+
+    y_hat = noise_residual_gpu(ard[t_left][p], ard[t][p], ard[t_right][p],
+      ce[t_left], ce[t], ce[t_right]);
+
+    if (__fdiv_rn(y_hat, noise) < job.below_noise){
+      msk[t][p] = true;
+      t_left = t;
+    }
+
+  }
+
+  return;
+}
+
+#endif
+
+
+/** This function screens the noise of a processing unit on the GPU. The
++++ ARD and masks must already be on the device, the masks are screened
++++ in place.
+--- job:    noise screening
+--- stream: stream of the device copy of the ARD
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int noise_gpu(noise_gpu_t *job, gpu_stream_t stream){
+#ifdef FORCE_CUDA
+cudaStream_t s = (cudaStream_t)gpu_cuda_stream(stream);
+size_t bytes_ptr, bytes_ce, bytes_list, bytes_rem;
+void **ptr = NULL, **d_ptr = NULL;
+int *d_ce = NULL, *d_list = NULL;
+small *d_rem = NULL;
+int t, p0, nb, batch, nblock;
+int error = 0;
+
+
+  if (!gpu_enabled() || gpu_select(stream) == FAILURE) return CANCEL;
+
+  // pixels per batch, such that the compacted lists fit into the scratch
+  batch = GPU_NOISE_SCRATCH / (job->nt*(sizeof(int)+sizeof(small)));
+  batch = (batch / GPU_NTHREAD) * GPU_NTHREAD;
+  if (batch < GPU_NTHREAD) batch = GPU_NTHREAD;
+  if (batch > job->nc) batch = job->nc;
+
+  bytes_ptr  = 2*job->nt*sizeof(void*);
+  bytes_ce   = job->nt*sizeof(int);
+  bytes_list = (size_t)job->nt*batch*sizeof(int);
+  bytes_rem  = (size_t)job->nt*batch*sizeof(small);
+
+  // device pointers of ARD and masks
+  alloc((void**)&ptr, 2*job->nt, sizeof(void*));
+  for (t=0; t<job->nt; t++){
+    ptr[t]         = (void*)job->ard[t];
+    ptr[job->nt+t] = (void*)job->msk[t];
+  }
+
+  if ((d_ptr  = (void**)gpu_alloc(bytes_ptr,  stream)) == NULL) error++;
+  if ((d_ce   = (int*)gpu_alloc(bytes_ce,     stream)) == NULL) error++;
+  if ((d_list = (int*)gpu_alloc(bytes_list,   stream)) == NULL) error++;
+  if ((d_rem  = (small*)gpu_alloc(bytes_rem,  stream)) == NULL) error++;
+
+  if (!error){
+
+    cudaMemcpyAsync(d_ptr, ptr,     bytes_ptr, cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_ce,  job->ce, bytes_ce,  cudaMemcpyHostToDevice, s);
+
+    for (p0=0; p0<job->nc && !error; p0+=batch){
+
+      nb = (p0+batch > job->nc) ? job->nc-p0 : batch;
+      nblock = (nb + GPU_NTHREAD - 1) / GPU_NTHREAD;
+
+      noise_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(
+        (const short * const*)d_ptr, (small * const*)(d_ptr+job->nt), 
+        job->mask, d_ce, d_list, d_rem, p0, nb, *job);
+
+      if (cudaGetLastError() != cudaSuccess){
+        printf("launching noise screening kernel failed. ");
+        error++;
+      }
+
+    }
+
+  }
+
+  if (gpu_sync(stream) == FAILURE) error++;
+
+  gpu_release(d_ptr,  bytes_ptr,  stream);
+  gpu_release(d_ce,   bytes_ce,   stream);
+  gpu_release(d_list, bytes_list, stream);
+  gpu_release(d_rem,  bytes_rem,  stream);
+  free((void*)ptr);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
@@ -0,0 +1,61 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Noise screening on the GPU header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef QUALITYGPU_HL_H
+#define QUALITYGPU_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/gpu-cl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// noise screening of a processing unit on the device
+typedef struct {
+  int nc, nt;            // number of cells, ARD dates
+  short nodata;          // nodata value
+  float above_noise;     // remove outliers above this relative noise
+  float below_noise;     // restore inliers below this relative noise
+  const short **ard;     // ARD band slabs, first band is used (device pointers, host array)
+  small **msk;           // ARD masks, screened in place (device pointers, host array)
+  const small *mask;     // processing mask (device, optional)
+  const int *ce;         // dates of ARD (host)
+} noise_gpu_t;
+
+int noise_gpu(noise_gpu_t *job, gpu_stream_t stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -28,41 +28,62 @@ This file contains functions for screening quality bit files
 #include "quality-hl.h"
 
 
-bool use_this_pixel(brick_t *qai, int p, par_qai_t *qai_rule, bool is_ard);
-
-
-/** Decide whether to use this pixel
-+++ This function checks the QAI layer against the user-defined QAI crite-
-+++ ria.
---- qai:      Quality Assurance Information
---- p:        pixel
+// number of pixels that are screened for noise in lockstep
+#define _NOISE_BLOCK_ 64
+
+// compacted time series of a block of pixels
+typedef struct {
+  int   *t;       // ARD index of valid observations
+  int   *ce;      // date of valid observations
+  int   *y;       // value of valid observations
+  bool  *removed; // observation was removed as outlier, [t][pixel]
+  int    n[_NOISE_BLOCK_];      // number of valid observations
+  bool   active[_NOISE_BLOCK_]; // pixel is still screened for outliers
+  float  noise[_NOISE_BLOCK_];  // noise of the time series
+} noise_block_t;
+
+#pragma omp declare simd
+float noise_residual(int y_left, int y_mid, int y_right, int ce_left, int ce_mid, int ce_right);
+void noise_compact(noise_block_t *blk, ard_t *ard, int nt, int *ce, small *mask_, int p0, int nb);
+void noise_remove(noise_block_t *blk, ard_t *ard, int p0, int nb, par_qai_t *qai_rule);
+void noise_restore(noise_block_t *blk, ard_t *ard, int nt, int *ce, short nodata, int p0, int nb, par_qai_t *qai_rule);
+int screen_noise_gpu(ard_t *ard, int nt, brick_t *mask, int *ce, short nodata, par_qai_t *qai_rule);
+
+
+/** Compile the QAI ruleset
++++ This function translates the user-defined QAI criteria into masks, 
++++ such that a QAI word can be screened without evaluating every rule 
++++ separately. 1-bit flags are collected in one reject mask. For the 2-
++++ bit fields, each rejected value sets one bit in a small lookup mask.
 --- qai_rule: ruleset for QAI filtering
-+++ Return:   true/false
+--- is_ard:   are we screening ARD, i.e. is the off flag a valid rule?
++++ Return:   compiled ruleset
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-bool use_this_pixel(brick_t *qai, int p, par_qai_t *qai_rule, bool is_ard){
+qai_screen_t compile_qai_rule(par_qai_t *qai_rule, bool is_ard){
+qai_screen_t scr = { 0, 0, 0, 0 };
+
   
-  if (!is_ard            && get_off(qai, p))               return false;
-
-  if (qai_rule->off      && get_off(qai, p))               return false;
-  if (qai_rule->cld_unc  && get_cloud(qai, p) == 1)        return false;
-  if (qai_rule->cld_opq  && get_cloud(qai, p) == 2)        return false;
-  if (qai_rule->cld_cir  && get_cloud(qai, p) == 3)        return false;
-  if (qai_rule->shd      && get_shadow(qai, p))            return false;
-  if (qai_rule->snw      && get_snow(qai, p))              return false;
-  if (qai_rule->wtr      && get_water(qai, p))             return false;
-  if (qai_rule->aod_int  && get_aerosol(qai, p) == 1)      return false;
-  if (qai_rule->aod_high && get_aerosol(qai, p) == 2)      return false;
-  if (qai_rule->aod_fill && get_aerosol(qai, p) == 3)      return false;
-  if (qai_rule->sub      && get_subzero(qai, p))           return false;
-  if (qai_rule->sat      && get_saturation(qai, p))        return false;
-  if (qai_rule->sun      && get_lowsun(qai, p))            return false;
-  if (qai_rule->ill_low  && get_illumination(qai, p) == 1) return false;
-  if (qai_rule->ill_poor && get_illumination(qai, p) == 2) return false;
-  if (qai_rule->ill_shd  && get_illumination(qai, p) == 3) return false;
-  if (qai_rule->slp      && get_slope(qai, p))             return false;
-  if (qai_rule->wvp      && get_vaporfill(qai, p))         return false;
-
-  return true;
+  if (!is_ard || qai_rule->off) scr.bits |= 1 << _QAI_BIT_OFF_;
+  if (qai_rule->shd)            scr.bits |= 1 << _QAI_BIT_SHD_;
+  if (qai_rule->snw)            scr.bits |= 1 << _QAI_BIT_SNW_;
+  if (qai_rule->wtr)            scr.bits |= 1 << _QAI_BIT_WTR_;
+  if (qai_rule->sub)            scr.bits |= 1 << _QAI_BIT_SUB_;
+  if (qai_rule->sat)            scr.bits |= 1 << _QAI_BIT_SAT_;
+  if (qai_rule->sun)            scr.bits |= 1 << _QAI_BIT_SUN_;
+  if (qai_rule->slp)            scr.bits |= 1 << _QAI_BIT_SLP_;
+  if (qai_rule->wvp)            scr.bits |= 1 << _QAI_BIT_WVP_;
+
+  if (qai_rule->cld_unc)  scr.cld |= 1 << 1;
+  if (qai_rule->cld_opq)  scr.cld |= 1 << 2;
+  if (qai_rule->cld_cir)  scr.cld |= 1 << 3;
+  if (qai_rule->aod_int)  scr.aod |= 1 << 1;
+  if (qai_rule->aod_high) scr.aod |= 1 << 2;
+  if (qai_rule->aod_fill) scr.aod |= 1 << 3;
+  if (qai_rule->ill_low)  scr.ill |= 1 << 1;
+  if (qai_rule->ill_poor) scr.ill |= 1 << 2;
+  if (qai_rule->ill_shd)  scr.ill |= 1 << 3;
+
+  return scr;
 }
 
 
@@ -83,6 +104,7 @@ int t, p, nc;
 int error = 0;
 bool is_ard = false;
 small *mask_ = NULL;
+qai_screen_t scr;
 
 
 
@@ -120,16 +142,28 @@ small *mask_ = NULL;
 
   nc = get_brick_chunkncells(ard[0].MSK);
 
-  #pragma omp parallel private(t) shared(ard,mask_,nt,nc,qai_rule,is_ard) default(none)
+  scr = compile_qai_rule(qai_rule, is_ard);
+
+  #pragma omp parallel private(t) shared(ard,mask_,nt,nc,scr) default(none)
   {
 
-    #pragma omp for
-    for (p=0; p<nc; p++){
+    // screen whole QAI layers, branch-free to allow vectorization
+    for (t=0; t<nt; t++){
+
+      short *qai_ = ard[t].qai;
+      small *msk_ = ard[t].msk;
+
+      #pragma omp for simd schedule(static)
+      for (p=0; p<nc; p++){
+
+        unsigned short q = (unsigned short)qai_[p];
+
+        msk_[p] = ((q & scr.bits) == 0) &
+                  (((scr.cld >> ((q >> _QAI_BIT_CLD_) & 3)) & 1) == 0) &
+                  (((scr.aod >> ((q >> _QAI_BIT_AOD_) & 3)) & 1) == 0) &
+                  (((scr.ill >> ((q >> _QAI_BIT_ILL_) & 3)) & 1) == 0) &
+                  (mask_ == NULL || mask_[p]);
 
-      if (mask_ != NULL && !mask_[p]){
-        for (t=0; t<nt; t++) ard[t].msk[p] = false;
-      } else {
-        for (t=0; t<nt; t++) ard[t].msk[p] = use_this_pixel(ard[t].QAI, p, qai_rule, is_ard);
       }
 
     }
@@ -145,30 +179,288 @@ small *mask_ = NULL;
 }
 
 
+/** This function tests whether a QAI layer has at least one pixel that
++++ passes the user-defined QAI criteria. This is used to skip reading 
++++ the other products of observations without any usable pixel.
+--- qai:      QAI layer
+--- nc:       number of cells
+--- qai_rule: ruleset for QAI filtering
+--- is_ard:   are we screening ARD, i.e. is the off flag a valid rule?
++++ Return:   true if there is a usable pixel, false otherwise
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool usable_qai(short *qai, int nc, par_qai_t *qai_rule, bool is_ard){
+int p;
+qai_screen_t scr;
+unsigned short q;
+
+
+  scr = compile_qai_rule(qai_rule, is_ard);
+
+  for (p=0; p<nc; p++){
+
+    q = (unsigned short)qai[p];
+
+    if ((q & scr.bits) == 0 &&
+        ((scr.cld >> ((q >> _QAI_BIT_CLD_) & 3)) & 1) == 0 &&
+        ((scr.aod >> ((q >> _QAI_BIT_AOD_) & 3)) & 1) == 0 &&
+        ((scr.ill >> ((q >> _QAI_BIT_ILL_) & 3)) & 1) == 0) return true;
+
+  }
+
+  return false;
+}
+
+
+/** This function computes the residual of an observation from the line
++++ that connects its left and right neighbours. Integer arithmetic is
++++ kept as in the original formulation: the slope is truncated, which is
++++ exact with double division for the value range of the ARD.
+--- y_left:   value of left neighbour
+--- y_mid:    value of observation
+--- y_right:  value of right neighbour
+--- ce_left:  date of left neighbour
+--- ce_mid:   date of observation
+--- ce_right: date of right neighbour
++++ Return:   absolute residual
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+#pragma omp declare simd
+float noise_residual(int y_left, int y_mid, int y_right, int ce_left, int ce_mid, int ce_right){
+int dce, slope;
+double same, diff;
+
+
+  dce   = (ce_right == ce_left) ? 1 : ce_right-ce_left;
+  slope = (int)((double)(y_right-y_left) / dce);
+
+  same = fabs(y_mid - (y_right-y_left) / 2.0);
+  diff = fabs((double)(y_mid - slope*(ce_mid-ce_left) - y_left));
+
+  return (float)((ce_right == ce_left) ? same : diff);
+}
+
+
+/** This function compacts the valid observations of a block of pixels,
++++ such that the neighbours of an observation are its neighbours in the
++++ list. Position k of pixel j is stored at k*_NOISE_BLOCK_+j, i.e. the
++++ k-th observation of all pixels is contiguous.
+--- blk:    block of pixels
+--- ard:    ARD
+--- nt:     number of ARD products over time
+--- ce:     dates of ARD
+--- mask_:  processing mask (or NULL)
+--- p0:     first pixel of block
+--- nb:     number of pixels in block
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void noise_compact(noise_block_t *blk, ard_t *ard, int nt, int *ce, small *mask_, int p0, int nb){
+int j, t, k, p;
+int b = 0; // use shortest wavelength
+
+
+  for (j=0; j<nb; j++){
+    blk->n[j]      = 0;
+    blk->active[j] = (mask_ == NULL || mask_[p0+j]);
+    blk->noise[j]  = INT_MAX;
+  }
+  
+  memset(blk->removed, 0, nt*_NOISE_BLOCK_*sizeof(bool));
+
+  for (t=0; t<nt; t++){
+    for (j=0, p=p0; j<nb; j++, p++){
+      if (!blk->active[j] || !ard[t].msk[p]) continue;
+      k = blk->n[j]++;
+      blk->t[k*_NOISE_BLOCK_+j]  = t;
+      blk->ce[k*_NOISE_BLOCK_+j] = ce[t];
+      blk->y[k*_NOISE_BLOCK_+j]  = ard[t].dat[b][p];
+    }
+  }
+
+  return;
+}
+
+
+/** This function removes outliers from a block of pixels. In each pass,
++++ the residual of each observation from its neighbours is computed for
++++ all pixels in lockstep, the largest residual of each pixel is removed
++++ if it is larger than the noise, and the lists are compacted. Pixels
++++ drop out of the block when no further outlier is found.
+--- blk:      block of pixels
+--- ard:      ARD
+--- p0:       first pixel of block
+--- nb:       number of pixels in block
+--- qai_rule: ruleset for QAI filtering
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void noise_remove(noise_block_t *blk, ard_t *ard, int p0, int nb, par_qai_t *qai_rule){
+int j, k, k_max, n, n_max, t, nactive;
+int l, m, r, ll, rr;
+float y_hat, rel_noise;
+float maxr[_NOISE_BLOCK_];
+float ssqr[_NOISE_BLOCK_];
+int   kmax[_NOISE_BLOCK_];
+bool  use;
+
+
+  for (j=0, nactive=0; j<nb; j++) nactive += blk->active[j];
+
+  while (nactive > 0){
+
+    for (j=0, n_max=0; j<nb; j++){
+      maxr[j] = 0;
+      ssqr[j] = 0;
+      kmax[j] = 0;
+      if (blk->active[j] && blk->n[j] > n_max) n_max = blk->n[j];
+    }
+
+    // residual of the k-th observation, all pixels in lockstep
+    for (k=1; k<(n_max-1); k++){
+
+      m  = k*_NOISE_BLOCK_;
+      l  = m-_NOISE_BLOCK_;
+      r  = m+_NOISE_BLOCK_;
+
+      #pragma omp simd private(y_hat,k_max,use,ll,rr)
+      for (j=0; j<nb; j++){
+
+        use = blk->active[j] && k < blk->n[j]-1;
+
+        ll = use ? l+j : j;
+        rr = use ? r+j : j;
+
+        y_hat = noise_residual(blk->y[ll], blk->y[m+j], blk->y[rr], 
+                               blk->ce[ll], blk->ce[m+j], blk->ce[rr]);
+
+        k_max = k;
+
+        // the end points can only be judged from the first and last triplet
+        if (k == 1 && 
+            abs(blk->y[ll] - blk->y[rr]) > abs(blk->y[m+j] - blk->y[rr])){
+          k_max = k-1;
+        } else if (k == blk->n[j]-2 &&
+            abs(blk->y[ll] - blk->y[rr]) > abs(blk->y[m+j] - blk->y[ll])){
+          k_max = k+1;
+        }
+
+        if (use && y_hat > maxr[j]){
+          maxr[j] = y_hat;
+          kmax[j] = k_max;
+        }
+
+        if (use) ssqr[j] += y_hat*y_hat;
+
+      }
+
+    }
+
+    // remove the largest residual, and compact the list
+    for (j=0, nactive=0; j<nb; j++){
+
+      if (!blk->active[j]) continue;
+
+      n = blk->n[j]-2;
+
+      if (n < 2){ blk->active[j] = false; continue;}
+
+      blk->noise[j] = sqrt(ssqr[j]/n);
+      rel_noise = maxr[j]/blk->noise[j];
+
+      if (rel_noise > qai_rule->above_noise){
+
+        t = blk->t[kmax[j]*_NOISE_BLOCK_+j];
+        ard[t].msk[p0+j] = false;
+        blk->removed[t*_NOISE_BLOCK_+j] = true;
+
+        for (k=kmax[j]+1; k<blk->n[j]; k++){
+          blk->t[(k-1)*_NOISE_BLOCK_+j]  = blk->t[k*_NOISE_BLOCK_+j];
+          blk->ce[(k-1)*_NOISE_BLOCK_+j] = blk->ce[k*_NOISE_BLOCK_+j];
+          blk->y[(k-1)*_NOISE_BLOCK_+j]  = blk->y[k*_NOISE_BLOCK_+j];
+        }
+        blk->n[j]--;
+
+      }
+
+      blk->active[j] = (rel_noise > qai_rule->above_noise && n > 2);
+      nactive += blk->active[j];
+
+    }
+
+  }
+
+  return;
+}
+
+
+/** This function restores inliers of a block of pixels, i.e. observations
++++ that were flagged by the QAI screening, but are well within the noise
++++ of the time series. Restored observations serve as left neighbour of
++++ the next candidate.
+--- blk:      block of pixels
+--- ard:      ARD
+--- nt:       number of ARD products over time
+--- ce:       dates of ARD
+--- nodata:   nodata value
+--- p0:       first pixel of block
+--- nb:       number of pixels in block
+--- qai_rule: ruleset for QAI filtering
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void noise_restore(noise_block_t *blk, ard_t *ard, int nt, int *ce, short nodata, int p0, int nb, par_qai_t *qai_rule){
+int j, k, p, t, t_left, t_right;
+int b = 0; // use shortest wavelength
+float y_hat;
+
+
+  for (j=0, p=p0; j<nb; j++, p++){
+
+    if (blk->noise[j] == INT_MAX) continue;
+
+    t_left = -1;
+
+    for (t=0, k=0; t<(nt-1) && k<blk->n[j]; t++){
+
+      // valid observation, next left neighbour
+      if (blk->t[k*_NOISE_BLOCK_+j] == t){
+        t_left = t; k++; continue;}
+
+      if (t_left < 0 || ard[t].dat[b][p] == nodata || 
+          blk->removed[t*_NOISE_BLOCK_+j]) continue;
+
+      t_right = blk->t[k*_NOISE_BLOCK_+j];
+
+      y_hat = noise_residual(ard[t_left].dat[b][p], ard[t].dat[b][p], ard[t_right].dat[b][p],
+                             ce[t_left], ce[t], ce[t_right]);
+
+      if (y_hat/blk->noise[j] < qai_rule->below_noise){
+        ard[t].msk[p] = true;
+        t_left = t;
+      }
+
+    }
+
+  }
+
+  return;
+}
+
+
 /** This function re-evaluated the quality masks of the ARD, and removes
 +++ outliers (that are larger than the time series noise), and restores
-+++ inliers (that are well within the time series noise).
++++ inliers (that are well within the time series noise). Pixels are 
++++ screened in blocks, with compacted lists of valid observations. If
++++ the ARD were copied to the GPU, the screening is done on the device.
 --- ard:      ARD
 --- nt:       number of ARD products over time
+--- mask:     processing mask
 --- qai_rule: ruleset for QAI filtering
 +++ Return:   SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int screen_noise(ard_t *ard, int nt, brick_t *mask, par_qai_t *qai_rule){
-int p, nc;
-int b = 0; // use shortest wavelength
-int t, t_left, t_mid, t_right, t_first, t_last, t_max, n;
-bool valid_left, valid_right;
+int p, nc, nb, t;
 int *ce = NULL;
 short nodata;
-int nout, nadd;
-float y_hat;
-int t_maxr;
-float maxr;
-float ssqr;
-float noise;
-float rel_noise;
-bool *removed = NULL;
 small *mask_ = NULL;
+noise_block_t blk;
+int status;
 
 
   #ifdef FORCE_CLOCK
@@ -188,186 +480,129 @@ small *mask_ = NULL;
   nodata = get_brick_nodata(ard[0].DAT, 0);
 
   alloc((void**)&ce, nt, sizeof(int));
-  for (t_mid=0; t_mid<nt; t_mid++) ce[t_mid] = get_brick_ce(ard[t_mid].DAT, 0);
+  for (t=0; t<nt; t++) ce[t] = get_brick_ce(ard[t].DAT, 0);
 
 
-  #pragma omp parallel private(t,t_mid,t_left,t_right,t_first,t_last,t_max,n,valid_left,valid_right,y_hat,maxr,t_maxr,ssqr,noise,rel_noise,removed,nout,nadd) shared(ard,mask_,nc,nt,ce,nodata,qai_rule,b) default(none)
-  {
-
-    alloc((void**)&removed, nt, sizeof(bool));
+  // screen on the device, if the ARD are there
+  if ((status = screen_noise_gpu(ard, nt, mask, ce, nodata, qai_rule)) != CANCEL){
+    free((void*)ce);
+    return status;
+  }
 
-    #pragma omp for
-    for (p=0; p<nc; p++){
-
-      if (mask_ != NULL && !mask_[p]) continue;
-      
-      rel_noise = INT_MAX;
-      noise = INT_MAX;
-      n = nt;
-      
-      nout = 0;
-      nadd = 0;
-      
-      memset(removed, 0, nt*sizeof(bool));
-      
-      while (rel_noise > qai_rule->above_noise && n > 2){
-
-        t_left  = 0;
-        t_right = 0;
-        t_first = 0;
-        t_last  = 0;
-        n = 0;
-        maxr = 0;
-        ssqr = 0;
-        t_maxr = 0;
-
-        for (t_mid=1; t_mid<(nt-1); t_mid++){
-
-          if (!ard[t_mid].msk[p]) continue;
-
-          valid_left  = false;
-          valid_right = false;
-
-          // find previous and next point
-          for (t=t_left; t<nt; t++){
-
-            if (!ard[t].msk[p]) continue;
-
-            if (t < t_mid){
-              t_left = t;
-              if (!valid_left) t_first = t;
-              valid_left = true;
-            } else if (t == t_mid){
-              continue;
-            } else if (t > t_mid){
-              if (!valid_right){
-                t_right = t;
-                t_last  = t;
-                valid_right = true;
-              } else {
-                t_last  = t;
-                break;
-              }
-            }
-
-          }
-
-          if (!valid_left || !valid_right) continue;
-
-
-          if (ce[t_right] == ce[t_left]){
-            y_hat = fabs(ard[t_mid].dat[b][p] - 
-                        (ard[t_right].dat[b][p]-ard[t_left].dat[b][p]) / 2.0);
-          } else {
-            y_hat = fabs(ard[t_mid].dat[b][p] - 
-                        (ard[t_right].dat[b][p]-ard[t_left].dat[b][p]) / 
-                        (ce[t_right]-ce[t_left]) * (ce[t_mid]-ce[t_left]) - 
-                        ard[t_left].dat[b][p]);
-          }
-          t_max = t_mid;
-          
-          if (t_left == t_first &&
-             fabs(ard[t_left].dat[b][p] - ard[t_right].dat[b][p]) >
-             fabs(ard[t_mid].dat[b][p]  - ard[t_right].dat[b][p])){
-              t_max = t_left;
-
-          } else if (t_right == t_last &&
-              fabs(ard[t_left].dat[b][p] - ard[t_right].dat[b][p]) >
-              fabs(ard[t_mid].dat[b][p]  - ard[t_left].dat[b][p])){
-              t_max = t_right;
-          }
-
-          if (y_hat > maxr){
-            maxr = y_hat;
-            t_maxr = t_max;
-          }
-          
-          ssqr += y_hat*y_hat;
-          n++;
 
-        }
-        
+  #pragma omp parallel private(p,nb,blk) shared(ard,mask_,nc,nt,ce,nodata,qai_rule) default(none)
+  {
 
-        if (n < 2) continue;
+    alloc((void**)&blk.t,       nt*_NOISE_BLOCK_, sizeof(int));
+    alloc((void**)&blk.ce,      nt*_NOISE_BLOCK_, sizeof(int));
+    alloc((void**)&blk.y,       nt*_NOISE_BLOCK_, sizeof(int));
+    alloc((void**)&blk.removed, nt*_NOISE_BLOCK_, sizeof(bool));
 
-        noise = sqrt(ssqr/n);
-        rel_noise = maxr/noise;
-        
-        //printf("max. residual is %f at time %d, relative to noise %f\n", maxr, t_maxr, rel_noise);
+    #pragma omp for schedule(dynamic)
+    for (p=0; p<nc; p+=_NOISE_BLOCK_){
 
-        if (rel_noise > qai_rule->above_noise){ 
-          ard[t_maxr].msk[p] = false; 
-          removed[t_maxr] = true; 
-          nout++;
-        }
+      nb = (p+_NOISE_BLOCK_ > nc) ? nc-p : _NOISE_BLOCK_;
 
-      }
-      
-      
-      if (noise == INT_MAX) continue;
+      noise_compact(&blk, ard, nt, ce, mask_, p, nb);
+      noise_remove(&blk, ard, p, nb, qai_rule);
+      noise_restore(&blk, ard, nt, ce, nodata, p, nb, qai_rule);
 
-      t_left = 0;
+    }
 
-      for (t_mid=1; t_mid<(nt-1); t_mid++){
+    free((void*)blk.t);
+    free((void*)blk.ce);
+    free((void*)blk.y);
+    free((void*)blk.removed);
 
-        if (ard[t_mid].msk[p] || ard[t_mid].dat[b][p] == nodata || removed[t_mid]) continue;
+  }
 
-        valid_left  = false;
-        valid_right = false;
 
-        // find previous and next point
-        for (t=t_left; t<nt; t++){
+  free((void*)ce);
 
-          if (!ard[t].msk[p]) continue;
+  #ifdef FORCE_CLOCK
+  proctime_print("screen QAI", TIME);
+  #endif
 
-          if (t < t_mid){
-            t_left = t;
-            valid_left = true;
-          } else if (t == t_mid){
-            continue;
-          } else if (t > t_mid){
-            t_right = t;
-            valid_right = true;
-            break;
-          }
 
-        }
+  return SUCCESS;
+}
 
-        if (!valid_left || !valid_right) continue;
 
-        if (ce[t_right] == ce[t_left]){
-          y_hat = fabs(ard[t_mid].dat[b][p] - 
-                      (ard[t_right].dat[b][p]-ard[t_left].dat[b][p]) / 2.0);
-        } else {
-          y_hat = fabs(ard[t_mid].dat[b][p] - 
-                      (ard[t_right].dat[b][p]-ard[t_left].dat[b][p]) / 
-                      (ce[t_right]-ce[t_left]) * (ce[t_mid]-ce[t_left]) - 
-                      ard[t_left].dat[b][p]);
-        }
+/** This function screens the noise on the GPU, if the ARD were copied to
++++ the device. The masks are copied to the device, screened with the 
++++ same logic as on the CPU, and copied back. If the device cannot be 
++++ used, the screening is cancelled, and done on the CPU.
+--- ard:      ARD
+--- nt:       number of ARD products over time
+--- mask:     processing mask
+--- ce:       dates of ARD
+--- nodata:   nodata value
+--- qai_rule: ruleset for QAI filtering
++++ Return:   SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int screen_noise_gpu(ard_t *ard, int nt, brick_t *mask, int *ce, short nodata, par_qai_t *qai_rule){
+int t;
+noise_gpu_t job;
+gpu_brick_t **MSK = NULL;
+gpu_brick_t *PMASK = NULL;
+gpu_stream_t stream;
+int status = SUCCESS;
 
-        rel_noise = y_hat/noise;
 
-        if (rel_noise < qai_rule->below_noise){ ard[t_mid].msk[p] = true; nadd++;}
+  for (t=0; t<nt; t++){
+    if (ard[t].GPU == NULL || ard[t].MSK == NULL) return CANCEL;
+  }
 
-      }
+  memset(&job, 0, sizeof(noise_gpu_t));
+  job.nc     = get_brick_chunkncells(ard[0].MSK);
+  job.nt     = nt;
+  job.nodata = nodata;
+  job.above_noise = qai_rule->above_noise;
+  job.below_noise = qai_rule->below_noise;
+  job.ce     = ce;
+
+  // copy the masks in the ARD stream, i.e. to the device of this unit
+  stream = ard[0].GPU->stream;
+
+  alloc((void**)&job.ard, nt, sizeof(short*));
+  alloc((void**)&job.msk, nt, sizeof(small*));
+  alloc((void**)&MSK,     nt, sizeof(gpu_brick_t*));
+
+  for (t=0; t<nt && status == SUCCESS; t++){
+    if ((MSK[t] = allocate_gpu_brick(ard[t].MSK, stream)) == NULL ||
+        upload_brick(ard[t].MSK, MSK[t]) == FAILURE){
+      status = CANCEL; break;}
+    job.ard[t] = (const short*)get_gpu_band(ard[t].GPU, 0);
+    job.msk[t] = (small*)get_gpu_band(MSK[t], 0);
+  }
 
-      //printf("removed/added %d/%d observations\n", nout, nadd);
-      
+  if (status == SUCCESS && mask != NULL){
+    if ((PMASK = allocate_gpu_brick(mask, stream)) == NULL ||
+        upload_brick(mask, PMASK) == FAILURE){
+      status = CANCEL;
+    } else {
+      job.mask = (const small*)get_gpu_band(PMASK, 0);
     }
+  }
 
+  if (status == SUCCESS) status = noise_gpu(&job, stream);
 
-    free((void*)removed);
-  
+  // the host masks are only touched if the device screening succeeded
+  if (status == SUCCESS){
+    for (t=0; t<nt; t++){
+      if (download_brick(MSK[t], ard[t].MSK) == FAILURE) status = FAILURE;
+    }
   }
 
+  if (gpu_sync(stream) == FAILURE && status == SUCCESS) status = FAILURE;
 
-  free((void*)ce);
 
-  #ifdef FORCE_CLOCK
-  proctime_print("screen QAI", TIME);
-  #endif
+  for (t=0; t<nt; t++) free_gpu_brick(MSK[t]);
+  free_gpu_brick(PMASK);
+  free((void*)MSK);
+  free((void*)job.ard);
+  free((void*)job.msk);
 
-
-  return SUCCESS;
+  return status;
 }
 
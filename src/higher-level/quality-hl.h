@@ -34,15 +34,27 @@ Higher Level quality screening
 
 #include "../cross-level/quality-cl.h"
 #include "../cross-level/brick-cl.h"
+#include "../cross-level/gpu-cl.h"
 #include "../higher-level/read-ard-hl.h"
+#include "../higher-level/quality-gpu-hl.h"
 
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// QAI rule set, compiled into bit masks
+typedef struct {
+  unsigned short bits; // reject if any of these 1-bit flags is set
+  unsigned short cld;  // rejected values of 2-bit cloud field (bit set per value)
+  unsigned short aod;  // rejected values of 2-bit aerosol field
+  unsigned short ill;  // rejected values of 2-bit illumination field
+} qai_screen_t;
+
+qai_screen_t compile_qai_rule(par_qai_t *qai_rule, bool is_ard);
 int screen_qai(ard_t *ard, int nt, brick_t *mask, par_qai_t *qai_rule, int input_level);
 int screen_noise(ard_t *ard, int nt, brick_t *mask, par_qai_t *qai_rule);
+bool usable_qai(short *qai, int nc, par_qai_t *qai_rule, bool is_ard);
 
 #ifdef __cplusplus
 }
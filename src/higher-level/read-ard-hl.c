@@ -26,10 +26,125 @@ This file contains functions for reading ARD
 
 
 #include "read-ard-hl.h"
+#include "quality-hl.h"
+
+#include <sys/stat.h> // file status
+#include <pthread.h>  // POSIX threads
+#include <stdint.h>   // fixed-width integer types
+#include <unistd.h>   // standard symbolic constants and types
 
 /** Geospatial Data Abstraction Library (GDAL) **/
 #include "cpl_conv.h"       // various convenience functions for CPL
 #include "gdal.h"           // public (C callable) GDAL entry points
+#include "cpl_string.h"     // various convenience functions for strings
+#include "cpl_vsi.h"        // GDAL virtual file system
+
+/** OpenMP **/
+#include <omp.h> // multi-platform shared memory multiprocessing
+
+
+// number of tile directories held in the ARD catalog
+#define CATALOG_NTILE 16
+
+// automatic block size: max. number of tiles that are probed for data,
+// and max. share of per-call latency in the reading time of a block
+#define PROBE_NTILE 64
+#define PROBE_LATENCY 0.1
+
+// pixels that are indexed together, see index_ard
+#define VALID_BLOCK 4096
+
+// number of GDAL datasets that are kept open for the next chunk
+#define DATASET_POOL 64
+
+// requested bands of a feature file that are at most this many bands
+// apart are read with one call, see read_features
+#define FEATURE_GAP 4
+
+// catalog of the ARD main products in one tile directory
+typedef struct {
+  char dname[NPOW_10];  // directory name
+  struct timespec mtime; // modification time of directory at scan
+  long used;            // last use, for replacement
+  int n;                // number of main products
+  char **list;          // main products
+  date_t *date;         // dates of main products
+} catalog_t;
+
+catalog_t ard_catalog[CATALOG_NTILE];
+long ard_catalog_clock = 0;
+pthread_mutex_t ard_catalog_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// background listing of the next tile directory
+pthread_t ard_prefetch_thread;
+bool ard_prefetch_running = false;
+pthread_mutex_t ard_prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// halo rows of a file, kept for the next chunk of the same tile
+typedef struct {
+  char fname[NPOW_10];  // filename (of the central tile)
+  int tx, ty;           // tile
+  int chunk;            // chunk, for which the halo is kept
+  int nb, nx, pix;      // bands, columns, halo rows
+  int datatype;         // datatype
+  size_t byte;          // bytes per value
+  char **rows;          // halo rows [nb][pix*nx*byte]
+} halo_t;
+
+halo_t *halo_cache = NULL;
+int halo_ncache = 0;
+
+// footprint summary of a file, i.e. valid pixels per chunk
+typedef struct {
+  char fname[NPOW_10];  // filename
+  int cx, cy;           // chunk size in pixels (0 if no summary)
+  int ncx, ncy;         // number of chunks
+  int ny;               // number of rows
+  double res;           // resolution
+  int *count;           // valid pixels per chunk [ncy*ncx]
+} footprint_t;
+
+footprint_t *footprint_cache = NULL;
+int footprint_ncache = 0;
+int footprint_tx = -1, footprint_ty = -1;
+
+// decoded block, kept for repeated runs (service mode)
+typedef struct {
+  char fname[NPOW_10];   // filename
+  uint64_t key;          // hash of the reading parameters
+  struct timespec mtime; // modification time of file when read
+  off_t size;            // size of file when read
+  long used;             // last use, for replacement
+  size_t bytes;          // memory held by brick
+  brick_t *brick;        // decoded block
+} block_t;
+
+block_t *block_cache = NULL;
+int block_ncache = 0;
+size_t block_cache_bytes  = 0; // memory held by the cache
+size_t block_cache_budget = 0; // 0: cache is disabled
+long block_cache_clock = 0;
+pthread_mutex_t block_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// feature in reading order, i.e. sorted by file and band
+typedef struct {
+  const char *bname;     // basename of file
+  int band;              // band in file
+  int f;                 // index of feature
+} ftr_order_t;
+
+// open GDAL dataset, kept for the next chunk of the same tile
+typedef struct {
+  char fname[NPOW_10];   // filename
+  long used;             // last use, for replacement
+  GDALDatasetH dataset;  // dataset (not in use while pooled)
+} pooled_t;
+
+pooled_t dataset_pool[DATASET_POOL];
+int dataset_npool = 0;
+int dataset_pool_tx = -1, dataset_pool_ty = -1;
+long dataset_pool_clock = 0;
+pthread_mutex_t dataset_pool_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 int reduce_psf(short *hr, int nx, int ny, int nc, short *lr, int NX, int NY, int NC, short nodata);
@@ -39,12 +154,40 @@ int sensor_ard(int *sid, par_sen_t *sen, char *bname);
 int list_mask(int tx, int ty, par_hl_t *phl, dir_t *dir);
 int list_ard(int tx, int ty, par_sen_t *sen, par_hl_t *phl, dir_t *dir);
 int list_ard_filter_ce(int cemin, int cemax, dir_t dir);
+int probe_ard(char *fname, double *align, double *latency, double *rate);
+int scan_catalog(catalog_t *cat, char *dname, struct timespec mtime);
+int lookup_catalog(char *dname, char ***list, date_t **date);
+void *prefetch_catalog(void *dname);
+int cmp_vsi_name(const void *a, const void *b);
+int cmp_feature(const void *a, const void *b);
+void read_footprint(char *fname, int tx, int ty, cube_t *cube, footprint_t *fp);
+bool empty_footprint(footprint_t *fp, int chunk, cube_t *cube);
+bool empty_chunk(dir_t dir, int tx, int ty, int chunk, cube_t *cube);
+void identify_block(char *file, int ard_type, par_sen_t *sen, date_t *date, char prd[], int size, int *sid);
+void compile_block(brick_t *brick, char *file, char *prd, int sid, date_t date, par_sen_t *sen, short nodata, int chunk, int tx, int ty, cube_t *cube, double geotran[6]);
+uint64_t block_key(char *file, int ard_type, par_sen_t *sen, int sid, int read_b, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube, bool psf, double partial_x, double partial_y);
+brick_t *duplicate_block(brick_t *from);
+brick_t *take_block(char *file, uint64_t key, struct stat *st);
+void keep_block(char *file, uint64_t key, struct stat *st, brick_t *brick);
+void flush_dataset_pool();
+GDALDatasetH take_dataset(char *file, int tx, int ty);
+void keep_dataset(char *file, int tx, int ty, GDALDatasetH dataset);
+brick_t *screened_block(bool usable, char *file, int ard_type, par_sen_t *sen, int read_b, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube, bool psf);
+brick_t *template_ard(ard_t *ard);
+int merge_ard(ard_t *ard, int nt, par_hl_t *phl);
+bool take_halo(char *fname, int tx, int ty, int chunk, int pix, brick_t *brick);
+void keep_halo(char *fname, int tx, int ty, int chunk, int pix, int cy, brick_t *brick);
 
 
 /** Reduce spatial resolution using an approximate Point Spread Function
 +++ This function will convolve the full-res image with a Gaussian Lowpass
 +++ with filter size based upon the two resolutions. Afterward, the image
 +++ is reduced using boxcar averaging.
++++ The Gaussian is separable, thus the convolution is done in one hori-
++++ zontal and one vertical pass with a 1D kernel. Nodata is handled with a
++++ 0/1 mask, which is convolved alongside the data, such that the result
++++ is normalized by the sum of valid weights (as with the 2D kernel). Both
++++ passes operate on whole rows without branches, and are vectorized.
 --- hr:     full-res image
 --- nx:     number of x-pixels (full-res)
 --- ny:     number of y-pixels (full-res)
@@ -57,15 +200,16 @@ int list_ard_filter_ce(int cemin, int cemax, dir_t dir);
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int reduce_psf(short *hr, int nx, int ny, int nc, short *lr, int NX, int NY, int NC, short nodata){
-int nk;
+int nk, k, d, j0_, j1_;
 int i, j, ii, jj, ni, nj, p, np;
 double sum, num, scale = 10000.0;
-float **kernel = NULL;
+float *kernel = NULL;
 float *GAUSS= NULL;
-float sigma, r;
+float *val = NULL, *msk = NULL;
+float *hval = NULL, *hmsk = NULL;
+float sigma, sig, r;
 float i0, i1, j0, j1, iw, jw, w;
 
-//printf("reduce_psf: no need to convolve the complete image\n");
 
   /** Convolute band with gaussian kernel **/
 
@@ -74,50 +218,87 @@ float i0, i1, j0, j1, iw, jw, w;
   if ((nk = r*2) % 2 == 0) nk++;
 
   sigma = find_sigma(r);
+  sig = sigma*sigma*2;
 
-  if (gauss_kernel(nk, sigma, &kernel) != SUCCESS){
-    printf("Could not generate kernel. "); return FAILURE;}
+  // 1D kernel, the normalization cancels out
+  alloc((void**)&kernel, nk, sizeof(float));
+  for (k=0; k<nk; k++){
+    d = -(nk-1)/2 + k;
+    kernel[k] = exp(-(d*d)/sig);
+  }
 
   alloc((void**)&GAUSS, nc, sizeof(float));
+  alloc((void**)&val,   nc, sizeof(float));
+  alloc((void**)&msk,   nc, sizeof(float));
+  alloc((void**)&hval,  nc, sizeof(float));
+  alloc((void**)&hmsk,  nc, sizeof(float));
 
-  #pragma omp parallel private(p,np,ii,jj,ni,nj,sum,num) shared(nx,ny,GAUSS,hr,kernel,nk,nodata,scale) default(none)
+
+  #pragma omp parallel private(p,i,j,k,d,j0_,j1_,ni,np) shared(nx,ny,nk,nc,hr,kernel,nodata,scale,val,msk,hval,hmsk,GAUSS) default(none)
   {
 
-    #pragma omp for collapse(2) schedule(dynamic,1)
+    // masked values
+    #pragma omp for simd
+    for (p=0; p<nc; p++){
+      msk[p] = (hr[p] != nodata);
+      val[p] = msk[p]*(hr[p]/(float)scale);
+    }
+
+    // horizontal pass, kernel tap by tap over whole rows
+    #pragma omp for schedule(static)
     for (i=0; i<ny; i++){
-    for (j=0; j<nx; j++){
 
-      p = i*nx+j;
-      
-      GAUSS[p] = nodata;
+      for (k=0; k<nk; k++){
 
-      if (hr[p] == nodata) continue;
+        d = -(nk-1)/2 + k;
+        j0_ = (d < 0) ? -d : 0;
+        j1_ = (d > 0) ? nx-d : nx;
 
-      sum = num = 0;
+        #pragma omp simd
+        for (j=j0_; j<j1_; j++){
+          hval[i*nx+j] += kernel[k]*val[i*nx+j+d];
+          hmsk[i*nx+j] += kernel[k]*msk[i*nx+j+d];
+        }
 
-      for (ii=0; ii<nk; ii++){
-      for (jj=0; jj<nk; jj++){
+      }
 
-        ni = -(nk-1)/2 + ii + i; nj = -(nk-1)/2 + jj + j;
-        if (ni < 0 || ni >= ny || nj < 0 || nj >= nx) continue;
-        np = ni*nx+nj;
-        
-        if (hr[np] == nodata) continue;
+    }
+
+    // vertical pass, re-use the masked value buffers
+    #pragma omp for schedule(static)
+    for (i=0; i<ny; i++){
 
-        sum += (hr[np]/scale)*kernel[ii][jj];
-        num += kernel[ii][jj];
+      #pragma omp simd
+      for (j=0; j<nx; j++) val[i*nx+j] = msk[i*nx+j] = 0;
+
+      for (k=0; k<nk; k++){
+
+        d = -(nk-1)/2 + k;
+        ni = i+d;
+        if (ni < 0 || ni >= ny) continue;
+        np = ni*nx;
+
+        #pragma omp simd
+        for (j=0; j<nx; j++){
+          val[i*nx+j] += kernel[k]*hval[np+j];
+          msk[i*nx+j] += kernel[k]*hmsk[np+j];
+        }
 
-      }
       }
 
-      if (num > 0) GAUSS[p] = sum/num;
+      #pragma omp simd
+      for (j=0; j<nx; j++){
+        GAUSS[i*nx+j] = (hr[i*nx+j] != nodata && msk[i*nx+j] > 0) ? 
+                         val[i*nx+j]/msk[i*nx+j] : nodata;
+      }
 
     }
-    }
-    
+
   }
 
-  free_2D((void**)kernel, nk);
+  free((void*)kernel);
+  free((void*)val);  free((void*)msk);
+  free((void*)hval); free((void*)hmsk);
 
 
   /** Reduce spatial resolution **/
@@ -268,8 +449,8 @@ char cs[6];
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int list_mask(int tx, int ty, par_hl_t *phl, dir_t *dir){
-int m;
 int nchar;
+char fname[NPOW_10];
 dir_t d;
 
 
@@ -278,29 +459,18 @@ dir_t d;
   if (nchar < 0 || nchar >= NPOW_10){ 
     printf("Buffer Overflow in assembling dirname\n"); return FAILURE;}
 
-  // directory listing
-  if ((d.N = scandir(d.name, &d.LIST, 0, alphasort)) < 0){
-    return FAILURE;}
+  // the mask name is known, thus test for the file instead of scanning
+  nchar = snprintf(fname, NPOW_10, "%s/%s", d.name, phl->b_mask);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+  if (!fileexist(fname)) return FAILURE;
 
   // masks
+  d.N = d.n = 1;
   alloc_2D((void***)&d.list, d.N, NPOW_10, sizeof(char));
-
-  for (m=0, d.n=0; m<d.N; m++){
-
-    if (strcmp(d.LIST[m]->d_name, phl->b_mask) == 0){
-      copy_string(d.list[d.n++], NPOW_10, d.LIST[m]->d_name);
-      break;
-    }
-
-  }
-
-  if (d.n<1){
-    free_2D((void**)d.list, d.N);
-    free_2D((void**)d.LIST, d.N);
-    d.list = NULL;
-    d.LIST = NULL;
-    return FAILURE;
-  }
+  alloc((void**)&d.LIST, d.N, sizeof(struct dirent*));
+  copy_string(d.list[0], NPOW_10, phl->b_mask);
 
   *dir = d;
   return SUCCESS;
@@ -309,7 +479,8 @@ dir_t d;
 
 /** This function lists all ARD main products (BAP, BOA, TOA, SIG) files 
 +++ in the lower level directory. Only requested sensors are listed. Only 
-+++ the requested time frame is listed. The dir_t struct must be freed on 
++++ the requested time frame is listed, i.e. the temporal windows of all
++++ modules (see temporal_window). The dir_t struct must be freed on 
 +++ success.
 --- tx:     tile X-ID
 --- ty:     tile Y-ID
@@ -319,11 +490,11 @@ dir_t d;
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int list_ard(int tx, int ty, par_sen_t *sen, par_hl_t *phl, dir_t *dir){
-int t, s;
+int t, s, n = 0;
 bool vs;
-date_t date;
 dir_t d;
-char ext[NPOW_10];
+char **list = NULL;
+date_t *date = NULL;
 int nchar;
 
 
@@ -333,58 +504,47 @@ int nchar;
     printf("Buffer Overflow in assembling dirname\n"); return FAILURE;}
 
   #ifdef FORCE_DEBUG
-  printf("scanning %s for files\n", d.name);
+  printf("looking up %s in catalog\n", d.name);
   #endif
 
-  // directory listing
-  if ((d.N = scandir(d.name, &d.LIST, 0, alphasort)) < 0){
-    return FAILURE;}
+  if ((n = lookup_catalog(d.name, &list, &date)) < 0) return FAILURE;
+
+  if (n < 1) return FAILURE;
 
   #ifdef FORCE_DEBUG
-  printf("found %d files, filtering now\n");
+  printf("found %d main products, filtering now\n", n);
   #endif
 
-  // reflectance products
+  d.N = n;
   alloc_2D((void***)&d.list, d.N, NPOW_10, sizeof(char));
+  alloc((void**)&d.LIST, d.N, sizeof(struct dirent*));
 
-  for (t=0, d.n=0; t<d.N; t++){
-    
-    extension(d.LIST[t]->d_name, ext, NPOW_10);
+  for (t=0, d.n=0; t<n; t++){
 
-    if ((strcmp(ext, ".dat") == 0 ||
-         strcmp(ext, ".bsq") == 0 ||
-         strcmp(ext, ".bil") == 0 ||
-         strcmp(ext, ".tif") == 0 ||
-         strcmp(ext, ".vrt") == 0) &&
-        (strstr(d.LIST[t]->d_name, "BOA")  != NULL ||
-         strstr(d.LIST[t]->d_name, "TOA")  != NULL ||
-         strstr(d.LIST[t]->d_name, "BAP")  != NULL ||
-         strstr(d.LIST[t]->d_name, "SIG")  != NULL)){
-
-      // check against sensor list
-      for (s=0, vs=false; s<sen->n; s++){
-        if (strstr(d.LIST[t]->d_name, sen->sensor[s]) != NULL){
-          #ifdef FORCE_DEBUG
-          printf("sensor is: %s\n", sen->sensor[s]);
-          #endif
-          vs = true; 
-          break;
-        }
+    // check against sensor list
+    for (s=0, vs=false; s<sen->n; s++){
+      if (strstr(list[t], sen->sensor[s]) != NULL){
+        #ifdef FORCE_DEBUG
+        printf("sensor is: %s\n", sen->sensor[s]);
+        #endif
+        vs = true; 
+        break;
       }
+    }
 
-      // extract and filter date
-      date_ard(&date, d.LIST[t]->d_name);
-      if (date.ce < phl->date_range[_MIN_].ce) vs = false;
-      if (date.ce > phl->date_range[_MAX_].ce) vs = false;
-      if (!phl->date_doys[date.doy])  vs = false;
-
-      // allow-list image
-      if (vs) copy_string(d.list[d.n++], NPOW_10, d.LIST[t]->d_name);
+    // filter date, i.e. the union of the temporal windows of all modules
+    if (date[t].ce < phl->read_range[_MIN_]) vs = false;
+    if (date[t].ce > phl->read_range[_MAX_]) vs = false;
+    if (!phl->read_doys[date[t].doy])  vs = false;
 
-    }
+    // allow-list image
+    if (vs) copy_string(d.list[d.n++], NPOW_10, list[t]);
 
   }
 
+  free_2D((void**)list, n);
+  free((void*)date);
+
   if (d.n<1){
     free_2D((void**)d.list, d.N);
     free_2D((void**)d.LIST, d.N);
@@ -402,880 +562,759 @@ int nchar;
 }
 
 
-/** This function filters the ARD list. All datasets that are within
-+++ the requested temporal range are retained. The range must be given in
-+++ days since CE (no-leap-year approximation). The ARD list is modi-
-+++ fied (re-ordered and shortened). If there is no dataset left, FAILURE
-+++ is returned. The dir_t struct must be freed on success.
---- cemin:  start of range
---- cemax:  end of range
---- dir:    directory listing
-+++ Return: SUCCESS/FAILURE
+/** This function looks up a tile directory in the ARD catalog, and re-
++++ turns a copy of its main products and dates. The directory is scanned
++++ if it is not in the catalog yet, or if it was modified since the last 
++++ scan. The scan is done outside of the catalog lock, such that other
++++ threads can look up other directories meanwhile.
+--- dname:  tile directory
+--- list:   main products (returned, may be NULL)
+--- date:   dates of main products (returned, may be NULL)
++++ Return: number of main products, -1 on failure
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int list_ard_filter_ce(int cemin, int cemax, dir_t dir){
-int t;
-date_t date;
-char **list;
-int n;
+int lookup_catalog(char *dname, char ***list, date_t **date){
+int c, t, n = 0;
+struct stat st;
+catalog_t *cat = NULL;
+catalog_t scan;
+bool fresh = false;
 
 
-  alloc_2D((void***)&list, dir.n, NPOW_10, sizeof(char));
+  if (is_remote_path(dname)){
+    // object stores have no directory mtime, and every stat is a request:
+    // list once, and keep the catalog for the remaining chunks
+    memset(&st, 0, sizeof(struct stat));
+  } else if (stat(dname, &st) != 0) return -1;
 
-  for (t=0, n=0; t<dir.n; t++){
-    date_ard(&date, dir.list[t]);
-    if (date.ce < cemin || date.ce > cemax) continue;
-    copy_string(list[n++], NPOW_10, dir.list[t]);
-  }
+  memset(&scan, 0, sizeof(catalog_t));
 
-  for (t=0; t<dir.n; t++){
-    if (t >= n){
-      copy_string(dir.list[t], NPOW_10, "NULL");
-    } else {
-      copy_string(dir.list[t], NPOW_10, list[t]);
-    }
-  }
-  free_2D((void**)list, dir.n);
 
-  if ((dir.n = n)<1){
-    free_2D((void**)dir.list, dir.N);
-    free_2D((void**)dir.LIST, dir.N);
-    return FAILURE;
+  pthread_mutex_lock(&ard_catalog_lock);
+
+  for (c=0; c<CATALOG_NTILE; c++){
+    if (strcmp(ard_catalog[c].dname, dname) == 0){ cat = &ard_catalog[c]; break;}
   }
 
-  #ifdef FORCE_DEBUG
-  printf("\n%d datasets within ce limits\n", dir.n);
-  #endif
+  fresh = (cat != NULL &&
+           cat->mtime.tv_sec  == st.st_mtim.tv_sec && 
+           cat->mtime.tv_nsec == st.st_mtim.tv_nsec);
 
-  return SUCCESS;
-}
+  pthread_mutex_unlock(&ard_catalog_lock);
 
 
-/** public functions
-+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  // scan unlocked, then install into the catalog
+  if (!fresh){
 
+    if (scan_catalog(&scan, dname, st.st_mtim) != SUCCESS) return -1;
 
-/** This function reads the processing mask (if given).
---- success: success of the mask retrieval
---- tx:      tile X-ID
---- ty:      tile Y-ID
---- chunk:   block number
---- cube:    datacube parameters, e.g. resolution
---- phl:     HL parameters
-+++ Return: image brick
-+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-brick_t *read_mask(int *success, int tx, int ty, int chunk, cube_t *cube, par_hl_t *phl){
-brick_t *MASK = NULL;
-small *mask_ = NULL;
-int nc, p;
-char fname[NPOW_10];
-int nchar;
-dir_t dir;
-int n = 0;
+    pthread_mutex_lock(&ard_catalog_lock);
 
+    for (c=0, cat=NULL; c<CATALOG_NTILE; c++){
+      if (strcmp(ard_catalog[c].dname, dname) == 0){ cat = &ard_catalog[c]; break;}
+    }
 
-  #ifdef FORCE_CLOCK
-  time_t TIME; time(&TIME);
-  #endif
+    if (cat == NULL){
+      for (c=0, cat=&ard_catalog[0]; c<CATALOG_NTILE; c++){
+        if (ard_catalog[c].used < cat->used) cat = &ard_catalog[c];
+      }
+    }
 
-  #ifdef FORCE_DEBUG
-  printf("Reading mask X%04d_Y%04d\n", tx, ty);
-  #endif
+    if (cat->n > 0){
+      free_2D((void**)cat->list, cat->n);
+      free((void*)cat->date);
+    }
 
-  if (strcmp(phl->d_mask, "NULL") == 0){
-    *success = SUCCESS;
-    return NULL;
-  }
+    *cat = scan;
+    cat->used = ++ard_catalog_clock;
+
+    pthread_mutex_unlock(&ard_catalog_lock);
 
-  // get mask file listing, skip if tile is empty
-  if (list_mask(tx, ty, phl, &dir) == FAILURE){
-    #ifdef FORCE_DEBUG
-    printf("No data in here (no mask). Skip.\n");
-    #endif
-    *success = CANCEL;
-    return NULL;
   }
 
 
-  // filename
-  nchar = snprintf(fname, NPOW_10, "%s/%s", dir.name, dir.list[0]);
-  if (nchar < 0 || nchar >= NPOW_10){ 
-    printf("Buffer Overflow in assembling filename\n"); 
-    *success = FAILURE; 
-    return NULL;
-  }
-  
+  // take a copy of the catalog
+  pthread_mutex_lock(&ard_catalog_lock);
 
-  // read mask
-  if ((MASK = read_block(fname, _ARD_MSK_, NULL, 1, 1, 255, _DT_SMALL_, chunk, tx, ty, cube, false, 0, 0)) == NULL){
-      printf("Error reading mask %s. ", fname); *success = FAILURE; return NULL;}
-  if (phl->radius > 0){
-    if ((MASK = add_blocks(fname, _ARD_MSK_, NULL, 1, 1, 255, _DT_SMALL_, chunk, tx, ty, cube, false, phl->radius, MASK)) == NULL){
-      printf("Error adding masks %s. ", fname); *success = FAILURE; return NULL;}
+  for (c=0, cat=NULL; c<CATALOG_NTILE; c++){
+    if (strcmp(ard_catalog[c].dname, dname) == 0){ cat = &ard_catalog[c]; break;}
   }
-  //if ((MASK = read_mask_block(fname, 255, chunk, tx, ty, cube)) == NULL){
-  //    printf("Error reading mask %s. ", fname); *success = FAILURE; return NULL;}
 
-  free_2D((void**)dir.list, dir.N); dir.list = NULL;
-  free_2D((void**)dir.LIST, dir.N); dir.LIST = NULL;
+  if (cat != NULL){
 
-  nc = get_brick_chunkncells(MASK);
-  if ((mask_ = get_band_small(MASK, 0)) == NULL){
-    printf("Error getting processing mask."); 
-    free_brick(MASK);
-    *success = FAILURE; return NULL;}
+    cat->used = ++ard_catalog_clock;
 
-  // count and make sure that mask_ is binary
-  for (p=0; p<nc; p++){
-    if (mask_[p] == 1){
-      n++;
-    } else {
-      mask_[p] = 0;
+    if ((n = cat->n) > 0 && list != NULL && date != NULL){
+      alloc_2D((void***)list, n, NPOW_10, sizeof(char));
+      alloc((void**)date, n, sizeof(date_t));
+      for (t=0; t<n; t++) copy_string((*list)[t], NPOW_10, cat->list[t]);
+      memcpy(*date, cat->date, n*sizeof(date_t));
     }
-  }
 
-  if (n == 0){
-    //printf("no valid pixel in mask in this block. skip this block!\n");
-    free_brick(MASK);
-    *success = CANCEL;
-    return NULL;
   }
 
-  #ifdef FORCE_CLOCK
-  proctime_print("read mask", TIME);
-  #endif
+  pthread_mutex_unlock(&ard_catalog_lock);
 
-  *success = SUCCESS;
-  return MASK;
+  // evicted by another thread in the meantime, very unlikely
+  if (cat == NULL) return lookup_catalog(dname, list, date);
+
+  return n;
 }
 
 
-/** This function reads the features.
---- nt:     number of features read (returned)
+/** This function is run by the background thread, which lists a tile 
++++ directory into the ARD catalog.
+--- dname:  tile directory (freed within)
++++ Return: NULL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void *prefetch_catalog(void *dname){
+
+
+  lookup_catalog((char*)dname, NULL, NULL);
+  free(dname);
+
+  return NULL;
+}
+
+
+/** This function lists the ARD tile directory of an upcoming tile in the
++++ background, while the current tile is processed. When the tile is 
++++ read, its listing is already in the ARD catalog. At most one listing 
++++ is prefetched at a time.
 --- tx:     tile X-ID
 --- ty:     tile Y-ID
---- chunk:  block number
---- cube:   datacube parameters, e.g. resolution
 --- phl:    HL parameters
-+++ Return: ARD
++++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-ard_t *read_features(int *nt, int tx, int ty, int chunk, cube_t *cube, par_hl_t *phl){
-int f, p, nc;
-char fname[NPOW_10];
+void prefetch_ard(int tx, int ty, par_hl_t *phl){
+char *dname = NULL;
 int nchar;
-ard_t *features = NULL;
-int error = 0;
-
 
-  #ifdef FORCE_CLOCK
-  time_t TIME; time(&TIME);
-  #endif
 
-  #ifdef FORCE_DEBUG
-  printf("Reading X%04d_Y%04d\n", tx, ty);
-  #endif
+  alloc((void**)&dname, NPOW_10, sizeof(char));
 
+  nchar = snprintf(dname, NPOW_10, "%s/X%04d_Y%04d", phl->d_lower, tx, ty);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling dirname\n"); free((void*)dname); return;}
 
-  // check if all features do exist
-  for (f=0; f<phl->ftr.nfeature; f++){
-    nchar = snprintf(fname, NPOW_10, "%s/X%04d_Y%04d/%s", phl->d_lower, tx, ty, phl->ftr.bname[f]);
-    if (nchar < 0 || nchar >= NPOW_10){ 
-      printf("Buffer Overflow in assembling filename\n"); 
-      *nt = 0; 
-      return NULL;
-    }
-    if (!fileexist(fname)){
-      *nt = 0;
-      return NULL;
-    }
-  }
+  pthread_mutex_lock(&ard_prefetch_lock);
 
+  if (ard_prefetch_running) pthread_join(ard_prefetch_thread, NULL);
 
-  alloc((void**)&features, phl->ftr.nfeature, sizeof(ard_t));
+  ard_prefetch_running = 
+    (pthread_create(&ard_prefetch_thread, NULL, prefetch_catalog, dname) == 0);
 
+  if (!ard_prefetch_running) free((void*)dname);
 
-  #pragma omp parallel private(fname,p,nchar) shared(features,phl,cube,chunk,tx,ty,nc) reduction(+: error) default(none)
-  {
+  pthread_mutex_unlock(&ard_prefetch_lock);
 
-    #pragma omp for
-    for (f=0; f<phl->ftr.nfeature; f++){
-      
-      nchar = snprintf(fname, NPOW_10, "%s/X%04d_Y%04d/%s", phl->d_lower, tx, ty, phl->ftr.bname[f]);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling filename\n"); error++;}
-  
+  return;
+}
 
-      // read feature
-      if ((features[f].DAT = read_block(fname, _ARD_FTR_, NULL, phl->ftr.band[f], 1, phl->ftr.nodata, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, 0, 0)) == NULL ||
-          (features[f].dat = get_bands_short(features[f].DAT)) == NULL){
-        printf("Error reading feature %s. ", fname); error++;}
-      if (phl->radius > 0){
-        if ((features[f].DAT = add_blocks(fname, _ARD_FTR_, NULL, phl->ftr.band[f], 1, phl->ftr.nodata, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, features[f].DAT)) == NULL ||
-            (features[f].dat = get_bands_short(features[f].DAT)) == NULL){
-          printf("Error adding feature %s. ", fname); error++;}
-      }
-      
-      // compile a 0-filled QAI brick, processing must continue..
-      if ((features[f].QAI = copy_brick(features[f].DAT, 1, _DT_SHORT_)) == NULL || 
-          (features[f].qai = get_band_short(features[f].QAI, 0)) == NULL){
-        printf("Error compiling feature %s.", fname); error++;}
-        
-      nc = get_brick_chunkncells(features[f].DAT);
-      
-      for (p=0; p<nc; p++){
-        if (features[f].dat[0][p] == phl->ftr.nodata) set_off(features[f].QAI, p, true);
-      }
 
-      features[f].DST = NULL; features[f].dst = NULL;
-      features[f].AOD = NULL; features[f].aod = NULL;
-      features[f].HOT = NULL; features[f].hot = NULL;
-      features[f].VZN = NULL; features[f].vzn = NULL;
-      features[f].WVP = NULL; features[f].wvp = NULL;
+/** This function scans a tile directory for ARD main products (BAP, BOA,
++++ TOA, SIG), and stores them with their dates in the catalog. The cata-
++++ log is re-used for all chunks of the tile, and for primary and secon-
++++ dary ARD. It is refreshed when the directory was modified, e.g. when
++++ new products were written by force-level2. The catalog entry is not
++++ locked, thus scan into a private entry, and install it afterwards.
+--- cat:    catalog entry (modified)
+--- dname:  tile directory
+--- mtime:  modification time of directory
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int scan_catalog(catalog_t *cat, char *dname, struct timespec mtime){
+int t, N;
+struct dirent **LIST = NULL;
+char **VSI_LIST = NULL;
+char *name = NULL;
+char ext[NPOW_10];
+bool remote = is_remote_path(dname);
 
-    }
 
+  if (cat->n > 0){
+    free_2D((void**)cat->list, cat->n);
+    free((void*)cat->date);
   }
-  
-  
-  if (error > 0){
-    printf("%d reading errors. ", error); 
-    free_ard(features, phl->ftr.nfeature);
-    *nt = -1;
-    return NULL;
-  }
+  cat->n    = 0;
+  cat->list = NULL;
+  cat->date = NULL;
+  copy_string(cat->dname, NPOW_10, dname);
+  cat->mtime = mtime;
 
-  #ifdef FORCE_CLOCK
-  proctime_print("read features", TIME);
+  #ifdef FORCE_DEBUG
+  printf("scanning %s for files\n", dname);
   #endif
 
-  *nt = phl->ftr.nfeature;
-  return features;
+  // directory listing
+  if (remote){
+    if ((VSI_LIST = VSIReadDir(dname)) == NULL) return FAILURE;
+    N = CSLCount(VSI_LIST);
+    qsort(VSI_LIST, N, sizeof(char*), cmp_vsi_name);
+  } else if ((N = scandir(dname, &LIST, 0, alphasort)) < 0) return FAILURE;
+
+  if (N > 0){
+    alloc_2D((void***)&cat->list, N, NPOW_10, sizeof(char));
+    alloc((void**)&cat->date, N, sizeof(date_t));
+  }
+
+  for (t=0; t<N; t++){
+
+    if (remote) name = VSI_LIST[t]; else name = LIST[t]->d_name;
+    
+    extension(name, ext, NPOW_10);
+
+    if ((strcmp(ext, ".dat") == 0 ||
+         strcmp(ext, ".bsq") == 0 ||
+         strcmp(ext, ".bil") == 0 ||
+         strcmp(ext, ".tif") == 0 ||
+         strcmp(ext, ".vrt") == 0 ||
+         strcmp(ext, ".fcf") == 0) &&
+        (strstr(name, "BOA")  != NULL ||
+         strstr(name, "TOA")  != NULL ||
+         strstr(name, "BAP")  != NULL ||
+         strstr(name, "SIG")  != NULL)){
+
+      copy_string(cat->list[cat->n], NPOW_10, name);
+      date_ard(&cat->date[cat->n], name);
+      cat->n++;
+
+    }
+
+  }
+
+  // the arrays were sized for all files, thus free with N
+  if (cat->n == 0 && N > 0){
+    free_2D((void**)cat->list, N);
+    free((void*)cat->date);
+    cat->list = NULL;
+    cat->date = NULL;
+  } else if (cat->n < N){
+    for (t=cat->n; t<N; t++) free((void*)cat->list[t]);
+  }
+
+  if (remote) CSLDestroy(VSI_LIST); else free_2D((void**)LIST, N);
+
+  return SUCCESS;
 }
 
 
-/** This function reads continuous field images, e.g. LSP.
---- nt:     number of images read (returned)
+/** Comparison function for sorting a VSI directory listing by name, in
++++ the same order as the alphasort'ed local listing
++++ Return: string comparison result
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int cmp_vsi_name(const void *a, const void *b){
+
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+
+/** This function reads the footprint summary of a file, which is written
++++ by FORCE L2PS (number of valid pixels per chunk). If there is no sum-
++++ mary, or the file is not aligned with the tile, the chunk size is set
++++ to 0, i.e. the footprint is unknown.
+--- fname:  filename
 --- tx:     tile X-ID
 --- ty:     tile Y-ID
+--- cube:   datacube parameters
+--- fp:     footprint (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void read_footprint(char *fname, int tx, int ty, cube_t *cube, footprint_t *fp){
+GDALDatasetH dataset = NULL;
+const char *size = NULL;
+const char *summary = NULL;
+char *end = NULL;
+double geotran[6];
+int c;
+
+
+  copy_string(fp->fname, NPOW_10, fname);
+  fp->cx = fp->cy = 0;
+  fp->ncx = fp->ncy = 0;
+  fp->count = NULL;
+
+  if (is_chunk_store(fname)) return;
+
+  if ((dataset = GDALOpenEx(fname, GDAL_OF_READONLY, NULL, NULL, NULL)) == NULL) return;
+
+  if ((size    = GDALGetMetadataItem(dataset, "FORCE_chunk_size",  "FORCE")) == NULL ||
+      (summary = GDALGetMetadataItem(dataset, "FORCE_chunk_valid", "FORCE")) == NULL ||
+      GDALGetGeoTransform(dataset, geotran) != CE_None ||
+      sscanf(size, "%d %d", &fp->cx, &fp->cy) != 2 || fp->cx <= 0 || fp->cy <= 0){
+    fp->cx = fp->cy = 0;
+    GDALClose(dataset);
+    return;
+  }
+
+  fp->res = geotran[1];
+  fp->ny  = GDALGetRasterYSize(dataset);
+  fp->ncx = (GDALGetRasterXSize(dataset) + fp->cx - 1) / fp->cx;
+  fp->ncy = (fp->ny + fp->cy - 1) / fp->cy;
+
+  // the summary refers to the file grid, which must start at the tile
+  if (fabs(geotran[0] - (cube->origin_map.x + tx*cube->tilesize)) > fp->res/2 ||
+      fabs(geotran[3] - (cube->origin_map.y - ty*cube->tilesize)) > fp->res/2){
+    fp->cx = fp->cy = 0;
+    GDALClose(dataset);
+    return;
+  }
+
+  alloc((void**)&fp->count, fp->ncx*fp->ncy, sizeof(int));
+
+  for (c=0; c<fp->ncx*fp->ncy; c++){
+    fp->count[c] = strtol(summary, &end, 10);
+    if (end == summary) break;
+    summary = end;
+  }
+
+  // incomplete summary
+  if (c < fp->ncx*fp->ncy){
+    free((void*)fp->count);
+    fp->count = NULL;
+    fp->cx = fp->cy = 0;
+  }
+
+  GDALClose(dataset);
+
+  return;
+}
+
+
+/** This function tests whether a file has no valid pixel in the requested
++++ chunk, based on its footprint summary. Unknown footprints are never
++++ empty.
+--- fp:     footprint
 --- chunk:  block number
---- cube:   datacube parameters, e.g. resolution
---- phl:    HL parameters
-+++ Return: ARD
+--- cube:   datacube parameters
++++ Return: true if the chunk is empty, false otherwise
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-ard_t *read_confield(int *nt, int tx, int ty, int chunk, cube_t *cube, par_hl_t *phl){
-int f;
+bool empty_footprint(footprint_t *fp, int chunk, cube_t *cube){
+int i0, i1, ci, cj;
+double tol = 5e-3;
+
+
+  if (fp->cx <= 0 || fp->cy <= 0) return false;
+
+  // rows of the chunk in the file
+  i0 = (int)floor(chunk*cube->chunksize/fp->res + tol);
+  i1 = (int)ceil((chunk+1)*cube->chunksize/fp->res - tol);
+  if (i1 > fp->ny) i1 = fp->ny;
+
+  for (ci=i0/fp->cy; i0<i1 && ci<=(i1-1)/fp->cy; ci++){
+  for (cj=0; cj<fp->ncx; cj++){
+    if (fp->count[ci*fp->ncx+cj] > 0) return false;
+  }
+  }
+
+  return true;
+}
+
+
+/** This function tests whether none of the listed datasets has any valid
++++ pixel in the requested chunk. The footprint summaries are read once 
++++ per tile, and are cached for the subsequent chunks. A single dataset
++++ with unknown footprint makes the chunk non-empty.
+--- dir:    directory listing
+--- tx:     tile X-ID
+--- ty:     tile Y-ID
+--- chunk:  block number
+--- cube:   datacube parameters
++++ Return: true if the chunk is empty, false otherwise
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool empty_chunk(dir_t dir, int tx, int ty, int chunk, cube_t *cube){
+int t;
 char fname[NPOW_10];
 int nchar;
-ard_t *con = NULL;
-int error = 0;
 
 
-  #ifdef FORCE_CLOCK
-  time_t TIME; time(&TIME);
-  #endif
+  // new tile, drop the cache
+  if (tx != footprint_tx || ty != footprint_ty) free_footprint_cache();
+  footprint_tx = tx;
+  footprint_ty = ty;
 
-  #ifdef FORCE_DEBUG
-  printf("Reading X%04d_Y%04d\n", tx, ty);
-  #endif
+  if (footprint_ncache < dir.n){
+    re_alloc((void**)&footprint_cache, footprint_ncache, dir.n, sizeof(footprint_t));
+    footprint_ncache = dir.n;
+  }
 
+  for (t=0; t<dir.n; t++){
 
-  // check if all features do exist
-  for (f=0; f<phl->con.n; f++){
-    nchar = snprintf(fname, NPOW_10, "%s/X%04d_Y%04d/%s", phl->con.dname, tx, ty, phl->con.fname[f]);
-    if (nchar < 0 || nchar >= NPOW_10){ 
-      printf("Buffer Overflow in assembling filename\n"); 
-      *nt = 0; 
-      return NULL;
-    }
-    if (!fileexist(fname)){
-      *nt = 0;
-      return NULL;
+    nchar = snprintf(fname, NPOW_10, "%s/%s", dir.name, dir.list[t]);
+    if (nchar < 0 || nchar >= NPOW_10) return false;
+
+    if (strcmp(footprint_cache[t].fname, fname) != 0){
+      if (footprint_cache[t].count != NULL) free((void*)footprint_cache[t].count);
+      read_footprint(fname, tx, ty, cube, &footprint_cache[t]);
     }
-  }
 
+    if (!empty_footprint(&footprint_cache[t], chunk, cube)) return false;
 
-  alloc((void**)&con, phl->con.n, sizeof(ard_t));
+  }
 
+  return true;
+}
 
-  #pragma omp parallel private(fname,nchar) shared(con,phl,cube,chunk,tx,ty) reduction(+: error) default(none)
-  {
 
-    #pragma omp for
-    for (f=0; f<phl->con.n; f++){
+/** This function looks up the halo cache for the upper halo of a chunk.
++++ These rows were the lower edge of the previous chunk, i.e. they were
++++ already in memory, and do not need to be read again. On success, the
++++ rows are copied into the upper halo of the brick (full width, i.e. in-
++++ cluding the corners from the neighboring tiles), and the entry is re-
++++ moved from the cache.
+--- fname:  filename (of the central tile)
+--- tx:     tile X-ID
+--- ty:     tile Y-ID
+--- chunk:  block number
+--- pix:    halo width in pixels
+--- brick:  brick with halo (modified)
++++ Return: true if the halo was copied, false otherwise
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool take_halo(char *fname, int tx, int ty, int chunk, int pix, brick_t *brick){
+int c, b;
+bool found = false;
+halo_t halo;
+int nb = get_brick_nbands(brick);
+int nx = get_brick_chunkncols(brick);
+int datatype = get_brick_datatype(brick);
 
-      nchar = snprintf(fname, NPOW_10, "%s/X%04d_Y%04d/%s", phl->con.dname, tx, ty, phl->con.fname[f]);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling filename\n"); error++;}
 
-      // read continuous field
-      if ((con[f].DAT = read_block(fname, _ARD_FTR_, NULL, 1, -1, phl->con.nodata, _DT_SHORT_, chunk, tx, ty, cube, false, 0, 0)) == NULL ||
-          (con[f].dat = get_bands_short(con[f].DAT)) == NULL){
-        printf("Error reading continuous field %s. ", fname); error++;}
-      if (phl->radius > 0){
-        if ((con[f].DAT = add_blocks(fname, _ARD_FTR_, NULL, 1, -1, phl->con.nodata, _DT_SHORT_, chunk, tx, ty, cube, false, phl->radius, con[f].DAT)) == NULL ||
-            (con[f].dat = get_bands_short(con[f].DAT)) == NULL){
-          printf("Error adding continuous field products %s. ", fname); error++;}
-      }
-      
-      // compile a 0-filled QAI brick, processing must continue..
-      if ((con[f].QAI = copy_brick(con[f].DAT, 1, _DT_SHORT_)) == NULL || 
-          (con[f].qai = get_band_short(con[f].QAI, 0)) == NULL){
-        printf("Error compiling continuous field %s.", fname); error++;}
+  #pragma omp critical (halo_cache)
+  {
 
+    for (c=0; c<halo_ncache; c++){
+      if (halo_cache[c].tx == tx && halo_cache[c].ty == ty && 
+          halo_cache[c].chunk == chunk && 
+          strcmp(halo_cache[c].fname, fname) == 0){
+        halo = halo_cache[c];
+        halo_cache[c] = halo_cache[--halo_ncache];
+        found = true;
+        break;
+      }
+    }
 
-      con[f].DST = NULL; con[f].dst = NULL;
-      con[f].AOD = NULL; con[f].aod = NULL;
-      con[f].HOT = NULL; con[f].hot = NULL;
-      con[f].VZN = NULL; con[f].vzn = NULL;
-      con[f].WVP = NULL; con[f].wvp = NULL;
+  }
 
-    }
+  if (!found) return false;
 
+  if (halo.nb != nb || halo.nx != nx || halo.pix != pix || halo.datatype != datatype){
+    free_2D((void**)halo.rows, halo.nb);
+    return false;
   }
-  
-  
-  if (error > 0){
-    printf("%d reading errors. ", error); 
-    free_ard(con, phl->con.n);
-    *nt = -1;
-    return NULL;
+
+  for (b=0; b<nb; b++){
+    if (datatype == _DT_SMALL_){
+      memcpy(get_band_small(brick, b), halo.rows[b], halo.byte*pix*nx);
+    } else {
+      memcpy(get_band_short(brick, b), halo.rows[b], halo.byte*pix*nx);
+    }
   }
 
-  #ifdef FORCE_CLOCK
-  proctime_print("read con", TIME);
-  #endif
+  free_2D((void**)halo.rows, halo.nb);
 
-  *nt = phl->con.n;
-  return con;
+  return true;
 }
 
 
-/** This function reads all L2 ARD, which are needed to do the required
-+++ processing.
---- nt:     number of datasets read (returned)
+/** This function keeps the lower edge of a chunk in the halo cache, such
++++ that it can be used as upper halo of the next chunk of the same tile.
++++ Outdated entries, i.e. of this file from a chunk that was skipped, or
++++ of a tile that was already completed, are dropped.
+--- fname:  filename (of the central tile)
 --- tx:     tile X-ID
 --- ty:     tile Y-ID
 --- chunk:  block number
---- cube:   datacube parameters, e.g. resolution
---- sen:    sensor parameters
---- phl:    HL parameters
-+++ Return: ARD
+--- pix:    halo width in pixels
+--- cy:     number of rows in chunk (without halo)
+--- brick:  brick with halo
++++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-ard_t *read_ard(int *nt, int tx, int ty, int chunk, cube_t *cube, par_sen_t *sen, par_hl_t *phl){
-int t, b, p, nb, nc;
-char fname[NPOW_10], *pch = NULL;
-char temp[NPOW_10];
-int nchar;
-dir_t dir;
-ard_t *ard = NULL;
-int error = 0;
-bool radar  = false;
-bool level3 = false;
-
+void keep_halo(char *fname, int tx, int ty, int chunk, int pix, int cy, brick_t *brick){
+int c, b;
+halo_t halo;
+char *band = NULL;
+
+
+  if (pix < 1 || pix > cy) return;
+
+  copy_string(halo.fname, NPOW_10, fname);
+  halo.tx = tx;
+  halo.ty = ty;
+  halo.chunk = chunk+1;
+  halo.nb  = get_brick_nbands(brick);
+  halo.nx  = get_brick_chunkncols(brick);
+  halo.pix = pix;
+  halo.datatype = get_brick_datatype(brick);
+  halo.byte = get_brick_byte(brick);
+
+  // the last pix rows of the chunk, the lower halo itself is skipped
+  alloc_2D((void***)&halo.rows, halo.nb, pix*halo.nx*halo.byte, sizeof(char));
+  for (b=0; b<halo.nb; b++){
+    if (halo.datatype == _DT_SMALL_){
+      band = (char*)get_band_small(brick, b);
+    } else {
+      band = (char*)get_band_short(brick, b);
+    }
+    memcpy(halo.rows[b], band + (size_t)cy*halo.nx*halo.byte, pix*halo.nx*halo.byte);
+  }
 
-  #ifdef FORCE_CLOCK
-  time_t TIME; time(&TIME);
-  #endif
+  #pragma omp critical (halo_cache)
+  {
 
-  #ifdef FORCE_DEBUG
-  printf("Reading X%04d_Y%04d\n", tx, ty);
-  #endif
+    for (c=0; c<halo_ncache; c++){
+      if (halo_cache[c].tx != tx || halo_cache[c].ty != ty || 
+          strcmp(halo_cache[c].fname, fname) == 0){
+        free_2D((void**)halo_cache[c].rows, halo_cache[c].nb);
+        halo_cache[c--] = halo_cache[--halo_ncache];
+      }
+    }
 
+    re_alloc((void**)&halo_cache, halo_ncache, halo_ncache+1, sizeof(halo_t));
+    halo_cache[halo_ncache++] = halo;
 
-  // get ARD file listing, skip if tile is empty
-  if (list_ard(tx, ty, sen, phl, &dir) == FAILURE){
-    #ifdef FORCE_DEBUG
-    printf("No data in here (datasets). Skip.\n");
-    #endif
-    *nt = 0;
-    return NULL;
   }
 
+  return;
+}
 
-  alloc((void**)&ard, dir.n, sizeof(ard_t));
 
-  // open threads
-  //omp_set_num_threads(par.cpu); --> should be done in main
-//printf("alert. nodata was changed to 0. remove again..\n");
-  #pragma omp parallel private(fname,nchar,temp,pch,p,b,nc,nb) firstprivate(radar,level3) shared(ard,dir,phl,sen,cube,chunk,tx,ty) reduction(+: error) default(none)
-  {
+/** This function frees the halo cache
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_halo_cache(){
+int c;
 
-    #pragma omp for
-    for (t=0; t<dir.n; t++){
 
-      // filename
-      nchar = snprintf(fname, NPOW_10, "%s/%s", dir.name, dir.list[t]);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling filename\n"); error++;}
-      
+  for (c=0; c<halo_ncache; c++) free_2D((void**)halo_cache[c].rows, halo_cache[c].nb);
+  if (halo_cache != NULL) free((void*)halo_cache);
+  halo_cache = NULL;
+  halo_ncache = 0;
 
-      // use improphed product?
-      if (phl->prd.imp){
-        
-        // backup filename
-        copy_string(temp, NPOW_10, fname);
+  return;
+}
 
 
-        // new filename
-        if (strstr(fname, "BOA")  != NULL) pch = strstr(fname, "BOA");
-        if (strstr(fname, "TOA")  != NULL) pch = strstr(fname, "TOA");
-        if (strstr(fname, "BAP")  != NULL) pch = strstr(fname, "BAP");
-        strncpy(pch, "IMP", 3);
+/** This function enables the block cache. Decoded blocks are kept in me-
++++ mory, such that repeated runs on the same data (service mode) do not
++++ need to read them again.
+--- bytes:  memory budget of the cache (0: disabled)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void init_block_cache(size_t bytes){
 
-        // if no improphed product exists, use normal one
-        if (!fileexist(fname)) copy_string(fname, NPOW_10, temp);
+  pthread_mutex_lock(&block_cache_lock);
+  block_cache_budget = bytes;
+  pthread_mutex_unlock(&block_cache_lock);
 
-      }
+  return;
+}
 
-      // read BOA / TOA / IMP reflectance // SIG backscatter
-      if (phl->prd.ref){
-        if ((ard[t].DAT = read_block(fname, _ARD_REF_, sen, 0, 0, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, 0, 0)) == NULL ||
-            (ard[t].dat = get_bands_short(ard[t].DAT)) == NULL){
-          printf("Error reading main product %s. ", fname); error++;}
-        if (phl->radius > 0){
-          if ((ard[t].DAT = add_blocks(fname, _ARD_REF_, sen, 0, 0, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].DAT)) == NULL ||
-              (ard[t].dat = get_bands_short(ard[t].DAT)) == NULL){
-            printf("Error adding main products %s. ", fname); error++;}
-        }
-      } else {
-        ard[t].DAT = NULL;
-        ard[t].dat = NULL;
-      }
 
-      // read Quality Assurance Information
-      if (strstr(fname, "BOA")  != NULL) pch = strstr(fname, "BOA");
-      if (strstr(fname, "TOA")  != NULL) pch = strstr(fname, "TOA");
-      if (strstr(fname, "BAP")  != NULL){ pch = strstr(fname, "BAP"); level3 = true;}
-      if (strstr(fname, "IMP")  != NULL) pch = strstr(fname, "IMP");
-      if (strstr(fname, "SIG")  != NULL){ pch = strstr(fname, "SIG"); radar = true;}
-      if (level3) strncpy(pch, "INF", 3); else strncpy(pch, "QAI", 3);
+/** This function frees the block cache
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_block_cache(){
+int c;
 
-      if (phl->prd.qai){
-        if (!radar){
-          if ((ard[t].QAI = read_block(fname, _ARD_AUX_, sen, 1, 1, 1, _DT_SHORT_, chunk, tx, ty, cube, false, 0, 0)) == NULL ||
-              (ard[t].qai = get_band_short(ard[t].QAI, 0)) == NULL){
-            printf("Error reading QAI product %s. ", fname); error++;}
-          if (phl->radius > 0){
-            if ((ard[t].QAI = add_blocks(fname, _ARD_AUX_, sen, 1, 1, 1, _DT_SHORT_, chunk, tx, ty, cube, false, phl->radius, ard[t].QAI)) == NULL ||
-                (ard[t].qai = get_band_short(ard[t].QAI, 0)) == NULL){
-              printf("Error adding QAI products %s. ", fname); error++;}
-          }
-        } else {
-          if ((ard[t].QAI = copy_brick(ard[t].DAT, 1, _DT_SHORT_)) == NULL || 
-              (ard[t].qai = get_band_short(ard[t].QAI, 0)) == NULL){
-            printf("Error compiling feature %s.", fname); error++;}
-            
-          nc = get_brick_chunkncells(ard[t].DAT);
-          nb = get_brick_nbands(ard[t].DAT);
-          
-          for (p=0; p<nc; p++){
-          for (b=0; b<nb; b++){
-            if (ard[t].dat[b][p] == -9999) set_off(ard[t].QAI, p, true);
-          }
-          }
 
-        }
-      } else {
-        ard[t].QAI = NULL;
-        ard[t].qai = NULL;
-      }
+  pthread_mutex_lock(&block_cache_lock);
 
-      // read Cloud distance
-      if (level3) pch = strstr(fname, "INF"); else pch = strstr(fname, "QAI");
-      strncpy(pch, "DST", 3);
+  for (c=0; c<block_ncache; c++) free_brick(block_cache[c].brick);
+  if (block_cache != NULL) free((void*)block_cache);
+  block_cache = NULL;
+  block_ncache = 0;
+  block_cache_bytes = 0;
 
-      // backward compatibility
-      if (!fileexist(fname)) strncpy(pch, "CLD", 3);
-      
-      if (phl->prd.dst){
-        if ((ard[t].DST = read_block(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, 0, 0)) == NULL ||
-            (ard[t].dst = get_band_short(ard[t].DST, 0)) == NULL){
-          printf("Error reading DST product %s. ", fname); error++;}
-        if (phl->radius > 0){
-          if ((ard[t].DST = add_blocks(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].DST)) == NULL ||
-              (ard[t].dst = get_band_short(ard[t].DST, 0)) == NULL){
-            printf("Error adding DST products %s. ", fname); error++;}
-        }
-      } else {
-        ard[t].DST = NULL;
-        ard[t].dst = NULL;
-      }
+  pthread_mutex_unlock(&block_cache_lock);
 
-      // read Aerosol Optical Depth
-      pch = strstr(fname, "DST"); 
-      
-      // backward compatibility
-      if (pch == NULL) pch = strstr(fname, "CLD"); 
+  return;
+}
 
-      strncpy(pch, "AOD", 3);
-      
-      if (phl->prd.aod){
-        if ((ard[t].AOD = read_block(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, 0, 0)) == NULL ||
-            (ard[t].aod = get_band_short(ard[t].AOD, 0)) == NULL){
-          printf("Error reading AOD product %s. ", fname); error++;}
-        if (phl->radius > 0){
-          if ((ard[t].AOD = add_blocks(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].AOD)) == NULL ||
-              (ard[t].aod = get_band_short(ard[t].AOD, 0)) == NULL){
-            printf("Error adding AOD products %s. ", fname); error++;}
-        }
-      } else {
-        ard[t].AOD = NULL;
-        ard[t].aod = NULL;
-      }
 
-      // read Haze Optimized Transformation
-      pch = strstr(fname, "AOD"); strncpy(pch, "HOT", 3);
-      if (phl->prd.hot){
-        if ((ard[t].HOT = read_block(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, 0, 0)) == NULL ||
-            (ard[t].hot = get_band_short(ard[t].HOT, 0)) == NULL){
-          printf("Error reading HOT product %s. ", fname); error++;}
-        if (phl->radius > 0){
-          if ((ard[t].HOT = add_blocks(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].HOT)) == NULL ||
-              (ard[t].hot = get_band_short(ard[t].HOT, 0)) == NULL){
-            printf("Error adding HOT products %s. ", fname); error++;}
-        }
-      } else {
-        ard[t].HOT = NULL;
-        ard[t].hot = NULL;
-      }
+/** This function frees the footprint cache
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_footprint_cache(){
+int c;
 
-      // read View Zenith Angle
-      pch = strstr(fname, "HOT"); strncpy(pch, "VZN", 3);
-      if (phl->prd.vzn){
-        if ((ard[t].VZN = read_block(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, 0, 0)) == NULL ||
-            (ard[t].vzn = get_band_short(ard[t].VZN, 0)) == NULL){
-          printf("Error reading VZN product %s. ", fname); error++;}
-        if (phl->radius > 0){
-          if ((ard[t].VZN = add_blocks(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].VZN)) == NULL ||
-              (ard[t].vzn = get_band_short(ard[t].VZN, 0)) == NULL){
-            printf("Error adding VZN products %s. ", fname); error++;}
-        }
-      } else {
-        ard[t].VZN = NULL;
-        ard[t].vzn = NULL;
-      }
 
-      // read Water Vapor
-      pch = strstr(fname, "VZN"); strncpy(pch, "WVP", 3);
-      if (phl->prd.wvp){
-        if ((ard[t].WVP = read_block(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, 0, 0)) == NULL ||
-            (ard[t].wvp = get_band_short(ard[t].WVP, 0)) == NULL){
-          printf("Error reading WVP product %s. ", fname); error++;}
-        if (phl->radius > 0){
-          if ((ard[t].WVP = add_blocks(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].WVP)) == NULL ||
-              (ard[t].wvp = get_band_short(ard[t].WVP, 0)) == NULL){
-            printf("Error adding WVP products %s. ", fname); error++;}
-        }
-      } else {
-        ard[t].WVP = NULL;
-        ard[t].wvp = NULL;
-      }
+  for (c=0; c<footprint_ncache; c++){
+    if (footprint_cache[c].count != NULL) free((void*)footprint_cache[c].count);
+  }
+  if (footprint_cache != NULL) free((void*)footprint_cache);
+  footprint_cache = NULL;
+  footprint_ncache = 0;
+  footprint_tx = footprint_ty = -1;
 
-    }
+  return;
+}
 
-  }
-  
-  // copy all provenance to 1st date
-  get_brick_provenance(ard[0].DAT, 0, temp, NPOW_10);
-  set_brick_nprovenance(ard[0].DAT, dir.n);
-  set_brick_provenance(ard[0].DAT, 0, temp);
-  for (t=1; t<dir.n; t++){
-    get_brick_provenance(ard[t].DAT, 0, temp, NPOW_10);
-    set_brick_provenance(ard[0].DAT, t, temp);
-  }
 
-  free_2D((void**)dir.list, dir.N); dir.list = NULL;
-  free_2D((void**)dir.LIST, dir.N); dir.LIST = NULL;
-  
-  if (error > 0){
-    printf("%d reading errors. ", error); 
-    free_ard(ard, dir.n);
-    *nt = -1;
-    return NULL;
-  }
+/** This function closes all datasets in the dataset pool. The lock must
++++ be held by the caller.
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void flush_dataset_pool(){
+int c;
 
-  #ifdef FORCE_CLOCK
-  proctime_print("read ARD", TIME);
-  #endif
 
-  *nt = dir.n;
-  return ard;
+  for (c=0; c<dataset_npool; c++) GDALClose(dataset_pool[c].dataset);
+  dataset_npool = 0;
+
+  return;
 }
 
 
-/** This function reads a block of ARD-styled data, and returns a brick. 
-+++ GDAL takes care of image decimation / replication if the image has a 
-+++ different spatial resolution than expected. A PSF aggregation can also
-+++ be used.
---- file:      filename
---- ard_type:  type of ARD, e.g. L2 reflectance or feature
---- sen:       sensor parameters
---- read_b:    if not ARD reflectance, what is the first band to read?
---- read_nb:   if not ARD reflectance, how many bands to read?
---- nodata:    nodata value
---- datatype:  datatype for brick
---- chunk:     block number
---- tx:        tile X-ID
---- ty:        tile Y-ID
---- cube:      datacube parameters, e.g. resolution
---- psf:       use PSF?
---- partial_x: only read part of the block (width)
---- partial_y: only read part of the block (height)
-+++ Return:    image brick
+/** This function frees the dataset pool
++++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-brick_t *read_block(char *file, int ard_type, par_sen_t *sen, int read_b, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube, bool psf, double partial_x, double partial_y){
-brick_t *brick  = NULL;
-short   *brick_short_ = NULL;
-small   *brick_small_ = NULL;
-GDALDatasetH dataset;
-GDALRasterBandH band;
-gdalopt_t format;
+void free_dataset_pool(){
 
-short *read_buf  = NULL;
-short *psf_buf   = NULL;
 
-int sid = 0;
+  pthread_mutex_lock(&dataset_pool_lock);
+  flush_dataset_pool();
+  dataset_pool_tx = dataset_pool_ty = -1;
+  pthread_mutex_unlock(&dataset_pool_lock);
 
-int b, nbands, nb = 0, offb = read_b, p;
-int nx, ny, nc;
-int xoff_disc, yoff_disc;
-int nx_read, ny_read, nc_read;
-int b_brick;
-int b_disc;
-int nx_disc, ny_disc, nc_disc;
-double res_disc;
-double geotran_disc[6];
+  return;
+}
 
-char bname[NPOW_10];
-char prd[NPOW_02] = "TBD";
-date_t date;
 
-double width, height, x_offset, y_offset;
-double tol = 5e-3;
+/** This function frees the ARD catalog
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_ard_catalog(){
+int c;
 
 
-  //CPLSetConfigOption("GDAL_PAM_ENABLED", "NO");
-  //CPLPushErrorHandler(CPLQuietErrorHandler);
+  pthread_mutex_lock(&ard_prefetch_lock);
+  if (ard_prefetch_running) pthread_join(ard_prefetch_thread, NULL);
+  ard_prefetch_running = false;
+  pthread_mutex_unlock(&ard_prefetch_lock);
 
-  width  = cube->tilesize;
-  height = cube->chunksize;
-  x_offset = 0;
-  y_offset = chunk*cube->chunksize;
+  for (c=0; c<CATALOG_NTILE; c++){
+    if (ard_catalog[c].n > 0){
+      free_2D((void**)ard_catalog[c].list, ard_catalog[c].n);
+      free((void*)ard_catalog[c].date);
+    }
+    ard_catalog[c].n = 0;
+    ard_catalog[c].list = NULL;
+    ard_catalog[c].date = NULL;
+    ard_catalog[c].dname[0] = '\0';
+    ard_catalog[c].used = 0;
+  }
 
-  if (fabs(partial_x) > tol){
-    width = fabs(partial_x);
-    if (partial_x < 0) x_offset = cube->tilesize+partial_x;
+  return;
+}
+
+
+/** This function filters the ARD list. All datasets that are within
++++ the requested temporal range are retained. The range must be given in
++++ days since CE (no-leap-year approximation). The ARD list is modi-
++++ fied (re-ordered and shortened). If there is no dataset left, FAILURE
++++ is returned. The dir_t struct must be freed on success.
+--- cemin:  start of range
+--- cemax:  end of range
+--- dir:    directory listing
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int list_ard_filter_ce(int cemin, int cemax, dir_t dir){
+int t;
+date_t date;
+char **list;
+int n;
+
+
+  alloc_2D((void***)&list, dir.n, NPOW_10, sizeof(char));
+
+  for (t=0, n=0; t<dir.n; t++){
+    date_ard(&date, dir.list[t]);
+    if (date.ce < cemin || date.ce > cemax) continue;
+    copy_string(list[n++], NPOW_10, dir.list[t]);
   }
-  
-  if (fabs(partial_y) > tol){
-    height = fabs(partial_y);
-    if (partial_y < 0) y_offset = y_offset+cube->chunksize+partial_y;
+
+  for (t=0; t<dir.n; t++){
+    if (t >= n){
+      copy_string(dir.list[t], NPOW_10, "NULL");
+    } else {
+      copy_string(dir.list[t], NPOW_10, list[t]);
+    }
+  }
+  free_2D((void**)list, dir.n);
+
+  if ((dir.n = n)<1){
+    free_2D((void**)dir.list, dir.N);
+    free_2D((void**)dir.LIST, dir.N);
+    return FAILURE;
   }
 
+  #ifdef FORCE_DEBUG
+  printf("\n%d datasets within ce limits\n", dir.n);
+  #endif
+
+  return SUCCESS;
+}
+
+
+/** This function identifies an ARD file by its basename, i.e. date, 
++++ product and sensor. Other files (e.g. masks) do not have a date.
+--- file:     filename
+--- ard_type: type of ARD, e.g. L2 reflectance or feature
+--- sen:      sensor parameters
+--- date:     date (returned)
+--- prd:      product (returned)
+--- size:     length of product buffer
+--- sid:      sensor ID (returned)
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void identify_block(char *file, int ard_type, par_sen_t *sen, date_t *date, char prd[], int size, int *sid){
+char bname[NPOW_10];
 
 
   basename_with_ext(file, bname, NPOW_10);
   
   if (ard_type == _ARD_REF_ || ard_type == _ARD_AUX_){
-    if (date_ard(&date, bname) != SUCCESS){
+    if (date_ard(date, bname) != SUCCESS){
       printf("getting date of ARD failed (%s)\n", bname); 
       exit(FAILURE);
     }
-    if (product_ard(prd, NPOW_02, bname) != SUCCESS){
+    if (product_ard(prd, size, bname) != SUCCESS){
       printf("getting product of ARD failed (%s)\n", bname); 
       exit(FAILURE);
     }
     if (sen != NULL){
-      if (sensor_ard(&sid, sen, bname) != SUCCESS){
+      if (sensor_ard(sid, sen, bname) != SUCCESS){
         printf("getting sensor of ARD failed (%s)\n", bname); 
         exit(FAILURE);
       }
     }
-  } else init_date(&date);
-    
-
-  if (fmod(width, cube->res) > tol){
-    printf("requested width %f must be a multiple of RESOLUTION %f (%f > %f). ", width, cube->res, fmod(width, cube->res), tol);
-    return NULL;
-  }
-  if (fmod(height, cube->res) > tol){
-    printf("requested height %f must be a multiple of RESOLUTION %f (%f > %f). ", height, cube->res, fmod(height, cube->res), tol);
-    return NULL;
-  }
-  
-  nx = (int)(width/cube->res);
-  ny = (int)(height/cube->res);
-  nc = nx*ny;
-
-  
-
-  if (ard_type == _ARD_REF_){
-    for (b=0; b<sen->nb; b++){
-      if (sen->band[sid][b] >= 0) nb++;
-    }
-    nbands = sen->nb;
-  } else {
-    nb     = read_nb;
-    nbands = read_nb;
-  }
-  #ifdef FORCE_DEBUG
-  printf("reading %d bands.\n", nb);
-  #endif
+  } else init_date(date);
 
+  return;
+}
 
 
-  /** read data
-  +++ case 1: target res = image res:
-  +++         read @ target res using NN
-  +++ case 2: target res < image res && psf = false:
-  +++         read @ target res using NN
-  +++ case 3: target res < image res && psf = true:
-  +++         read @ image res using NN,
-  +++         reduce to target res using PSF
-  +++ case 4: target res > image res:
-  +++         read @ target res using NN
-  +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-  
-  dataset = GDALOpenEx(file, GDAL_OF_READONLY, NULL, NULL, NULL);
-  //CPLPopErrorHandler();
-  
-  if (dataset == NULL){
-    printf("unable to open %s. ", file); return NULL;}
-
-  if (nb < 0 || nbands < 0){
-    nb = nbands = GDALGetRasterCount(dataset);
-    offb = 1;
-  }
-
-  // number of pixels, resolution and projection in image on disc
-
-  GDALGetGeoTransform(dataset, geotran_disc); 
-  res_disc = geotran_disc[1];
-
-  #ifdef FORCE_DEBUG
-  print_dvector(geotran_disc, "Geotransformation", 6, 10, 2);
-  #endif
-  
-  if (fmod(width, res_disc) > tol){
-    printf("requested image width %f must be a multiple of image resolution %f (%f > %f). ", width, res_disc, fmod(width, res_disc), tol);
-    return NULL;
-  }
-  if (fmod(height, res_disc) > tol){
-    printf("requested image height %f must be a multiple of image resolution %f (%f > %f). ", height, res_disc, fmod(height, res_disc), tol);
-    return NULL;
-  }
-  if (fmod(y_offset, res_disc) > tol){
-    printf("requested image offset %f must be a multiple of image resolution %f (%f > %f). ", y_offset, res_disc, fmod(y_offset, res_disc), tol);
-    return NULL;
-  }
-  if (fmod(x_offset, res_disc) > tol){
-    printf("requested image offset %f must be a multiple of image resolution %f (%f > %f). ", x_offset, res_disc, fmod(x_offset, res_disc), tol);
-    return NULL;
-  }
-
-  nx_disc = (int)(width/res_disc);
-  ny_disc = (int)(height/res_disc);
-  nc_disc = nx_disc*ny_disc;
-  xoff_disc = (int)(x_offset/res_disc);
-  yoff_disc = (int)(y_offset/res_disc);
-  
-
-  #ifdef FORCE_DEBUG
-  printf("read %d x %d pixels with offset %d / %d at resolution %f\n", nx_disc, ny_disc, xoff_disc, yoff_disc, res_disc);
-  printf("copy to %d x %d pixels with offset %d / %d at resolution %f\n", nx, ny, 0, 0, cube->res);
-  #endif
-
-
-  // depending on PSF flag, read image part at full or reduced resolution
-  if (psf && nc_disc > nc){
-    nx_read = nx_disc; ny_read = ny_disc; nc_read = nc_disc;
-    alloc((void**)&psf_buf, nc, sizeof(short));
-    #ifdef FORCE_DEBUG
-    printf("reduce with psf: %s\n", bname);
-    #endif
-  } else {
-    nx_read = nx; ny_read = ny; nc_read = nc;
-    #ifdef FORCE_DEBUG
-    printf("input using NN:  %s\n", bname);
-    #endif
-  }
-
-  #ifdef FORCE_DEBUG
-  printf("reading %d pixels, converting them into %d RAM pixels\n", nc_read, nc);
-  #endif
-
-  alloc((void**)&read_buf, nc_read, sizeof(short));
-  brick = allocate_brick(nb, nc, datatype);
-
-  for (b=0, b_brick=0; b<nbands; b++){
-
-    if (ard_type == _ARD_REF_){
-      if ((b_disc = sen->band[sid][b])  < 0) continue;
-      if ((b_disc = sen->band[sid][b]) == 0){
-        set_brick_domain(brick, b_brick, sen->domain[b]);
-        b_brick++;
-        continue;
-      }
-    } else {
-      b_disc = offb+b;
-    }
-
-    #ifdef FORCE_DEBUG
-    printf("read band %d to %d, %d bands in total\n", b_disc, b_brick, nb);
-    #endif
-
-    if (datatype == _DT_SMALL_){
-      if ((brick_small_ = get_band_small(brick, b_brick)) == NULL) return NULL;
-    } else if (datatype == _DT_SHORT_){
-      if ((brick_short_ = get_band_short(brick, b_brick)) == NULL) return NULL;
-    } else {
-      printf("unsupported datatype. "); return NULL;
-    }
-
-    for (p=0; p<nc_read; p++) read_buf[p] = nodata;
-
-    band = GDALGetRasterBand(dataset, b_disc);
-    if (GDALRasterIO(band, GF_Read, 
-      xoff_disc, yoff_disc, nx_disc, ny_disc, 
-      read_buf, nx_read, ny_read, GDT_Int16, 0, 0) == CE_Failure){
-      printf("could not read image.\n"); return NULL;}
-
-    if (psf && nc_disc > nc){
-      for (p=0; p<nc; p++) psf_buf[p] = nodata;
-      reduce_psf(read_buf, nx_disc, ny_disc, nc_disc, psf_buf, nx, ny, nc, nodata);
-      if (datatype == _DT_SMALL_){
-        for (p=0; p<nc; p++) brick_small_[p] = psf_buf[p];
-      } else if (datatype == _DT_SHORT_){
-        for (p=0; p<nc; p++) brick_short_[p] = psf_buf[p];
-      } else {
-        printf("unsupported datatype. "); return NULL;
-      }
-    } else {
-      if (datatype == _DT_SMALL_){
-        for (p=0; p<nc; p++) brick_small_[p] = read_buf[p];
-      } else if (datatype == _DT_SHORT_){
-        for (p=0; p<nc; p++) brick_short_[p] = read_buf[p];
-      } else {
-        printf("unsupported datatype. "); return NULL;
-      }
-    }
-    
-    if (ard_type == _ARD_REF_){
-      set_brick_domain(brick, b_brick, sen->domain[b]);
-      set_brick_bandname(brick, b_brick, sen->domain[b]);
-    }
-
-    b_brick++;
-
-  }
-
-  GDALClose(dataset);
-  if (read_buf != NULL){ free((void*)read_buf); read_buf = NULL;}
-  if (psf_buf  != NULL){ free((void*)psf_buf);  psf_buf  = NULL;}
+/** This function compiles the metadata of a block of ARD-styled data
+--- brick:    image brick (modified)
+--- file:     filename
+--- prd:      product
+--- sid:      sensor ID
+--- date:     date
+--- sen:      sensor parameters
+--- nodata:   nodata value
+--- chunk:    block number
+--- tx:       tile X-ID
+--- ty:       tile Y-ID
+--- cube:     datacube parameters, e.g. resolution
+--- geotran:  geotransformation of the tile
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void compile_block(brick_t *brick, char *file, char *prd, int sid, date_t date, par_sen_t *sen, short nodata, int chunk, int tx, int ty, cube_t *cube, double geotran[6]){
+int b, nb = get_brick_nbands(brick);
+gdalopt_t format;
 
-  //CSLDestroy(open_options);
 
   // compile brick correctly
-  set_brick_geotran(brick,    geotran_disc);
+  set_brick_geotran(brick,    geotran);
   set_brick_res(brick,        cube->res);
   set_brick_proj(brick,       cube->proj);
   set_brick_ncols(brick,      cube->nx);
@@ -1310,139 +1349,1831 @@ double tol = 5e-3;
   if(sen != NULL){
     for (b=0; b<nb; b++) set_brick_sensor(brick, b, sen->sensor[sid]);
   }
-   
-  return brick;
+
+  return;
 }
 
 
-/** This function adds a partial block of ARD-styled data to the brick we
-+++ already have. This is needed for functions that use kernel based pro-
-+++ cessing and need to incorporate data from neighoring blocks and/or
-+++ tiles to generate seamless output.
---- file:     filename
---- ard_type: type of ARD, e.g. L2 reflectance or feature
---- sen:      sensor parameters
---- read_b:   if not ARD reflectance, what is the first band to read?
---- read_nb:  if not ARD reflectance, how many bands to read?
---- nodata:   nodata value
---- datatype: datatype for brick
---- chunk:    block number
---- tx:       tile X-ID
---- ty:       tile Y-ID
---- cube:     datacube parameters, e.g. resolution
---- psf:      use PSF?
---- radius:   distance (in projection units) that need to be added
---- ARD:      image brick we already have in memory (freed within)
-+++ Return:   extended image brick
+/** This function hashes the parameters that determine the content of a
++++ block, which is read from a file (FNV-1a).
+--- file...:  see read_block
+--- sid:      sensor ID
++++ Return:   hash
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-brick_t *add_blocks(char *file, int ard_type, par_sen_t *sen, int read_b, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube, bool psf, double radius, brick_t *ARD){
-brick_t *add  = NULL;
-small  **add_small_ = NULL;
-short  **add_short_ = NULL;
-brick_t *brick  = NULL;
-small  **brick_small_ = NULL;
-short  **brick_short_ = NULL;
-double res;
-int pix;
-int b, nb;
-int i_off = 0, j_off = 0, p, nx, ny, nc;
-int i_add, j_add, p_add, nx_add = 0, ny_add = 0;
-int block_i, block_j, chunk_add, nchunk, tx_add, ty_add;
-char fname[NPOW_10], *pch = NULL;;
-char c_tc[NPOW_04];
-char c_tn[NPOW_04];
-int nchar;
+uint64_t block_key(char *file, int ard_type, par_sen_t *sen, int sid, int read_b, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube, bool psf, double partial_x, double partial_y){
+uint64_t h = 14695981039346656037ULL;
+double par[14];
+size_t i;
+int b;
+const unsigned char *c = NULL;
 
 
-  nb = get_brick_nbands(ARD);
-  res = get_brick_res(ARD);
-  
-  pix = (int)(radius/res);
+  par[0]  = ard_type;  par[1]  = read_b;    par[2]  = read_nb;
+  par[3]  = nodata;    par[4]  = datatype;  par[5]  = chunk;
+  par[6]  = tx;        par[7]  = ty;        par[8]  = psf;
+  par[9]  = partial_x; par[10] = partial_y; par[11] = cube->res;
+  par[12] = cube->chunksize; par[13] = cube->tilesize;
 
-  nx = cube->cx + pix*2;
-  ny = cube->cy + pix*2;
-  nc = nx*ny;
-  
-  #ifdef FORCE_DEBUG
-  printf("brick with added edges has %d x %d pixels = %d cells\n",
-    nx, ny, nc);
-  #endif
-  
-  nchunk = cube->cn;
+  for (c=(const unsigned char*)file; *c != '\0'; c++){ h ^= *c; h *= 1099511628211ULL;}
 
-  brick = copy_brick(ARD, nb, _DT_NONE_);
-  set_brick_chunkncols(brick, nx);
-  set_brick_chunknrows(brick, ny);
-  allocate_brick_bands(brick, nb, nc, datatype);
-  if (datatype == _DT_SMALL_){
-    if ((brick_small_ = get_bands_small(brick)) == NULL) return NULL;
-  } else if (datatype == _DT_SHORT_){
-    if ((brick_short_ = get_bands_short(brick)) == NULL) return NULL;
-  } else {
-    printf("unsupported datatype. "); return NULL;
+  c = (const unsigned char*)par;
+  for (i=0; i<sizeof(par); i++){ h ^= c[i]; h *= 1099511628211ULL;}
+
+  // band mapping depends on the sensor dictionary
+  if (ard_type == _ARD_REF_){
+    for (b=0; b<sen->nb; b++){ h ^= (uint64_t)(sen->band[sid][b]+1); h *= 1099511628211ULL;}
   }
-  
-  // copy file name
-  copy_string(fname, NPOW_10, file);
-  
-  nchar = snprintf(c_tc, NPOW_04, "X%04d_Y%04d", tx, ty);
-  if (nchar < 0 || nchar >= NPOW_04){ 
-    printf("Buffer Overflow in assembling tile\n"); return NULL;}
 
+  return h;
+}
 
-  for (block_i=-1; block_i<=1; block_i++){
-  for (block_j=-1; block_j<=1; block_j++){
-    
-    if (block_i < 0){
-      chunk_add = chunk-1;
-    } else if (block_i > 0){
-      chunk_add = chunk+1;
-    } else {
-      chunk_add = chunk;
-    }
 
-    if (chunk_add < 0){
-      chunk_add = nchunk-1;
-      ty_add = ty-1;
-    } else if (chunk_add >= nchunk){
-      chunk_add = 0;
-      ty_add = ty+1;
-    } else {
-      ty_add = ty;
-    }
-    
-    if (block_j < 0){
-      tx_add = tx-1;
-    } else if (block_j > 0){
-      tx_add = tx+1;
+/** This function duplicates a block, including the data
+--- from:     block
++++ Return:   copy of block
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t *duplicate_block(brick_t *from){
+brick_t *brick = NULL;
+int b, nb = get_brick_nbands(from);
+int datatype = get_brick_datatype(from);
+size_t bytes = (size_t)get_brick_chunkncells(from)*get_brick_byte(from);
+
+
+  if ((brick = copy_brick(from, nb, datatype)) == NULL) return NULL;
+
+  for (b=0; b<nb; b++){
+    if (datatype == _DT_SMALL_){
+      memcpy(get_band_small(brick, b), get_band_small(from, b), bytes);
     } else {
-      tx_add = tx;
+      memcpy(get_band_short(brick, b), get_band_short(from, b), bytes);
     }
+  }
 
-    if (block_i == 0 && block_j == 0){
+  return brick;
+}
 
-      add = ARD;
-      if (datatype == _DT_SMALL_){
-        if ((add_small_ = get_bands_small(ARD)) == NULL) return NULL;
-      } else if (datatype == _DT_SHORT_){
-        if ((add_short_ = get_bands_short(ARD)) == NULL) return NULL;
-      } else {
-        printf("unsupported datatype. "); return NULL;
-      }
 
-    } else {
+/** This function takes a copy of a block from the block cache. Entries of
++++ files that were modified since they were read are dropped.
+--- file:     filename
+--- key:      hash of the reading parameters
+--- st:       file status
++++ Return:   copy of cached block, or NULL if not cached
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t *take_block(char *file, uint64_t key, struct stat *st){
+int c;
+brick_t *brick = NULL;
 
-      // new filename
-      nchar = snprintf(c_tn, NPOW_04, "X%04d_Y%04d", tx_add, ty_add);
-      if (nchar < 0 || nchar >= NPOW_04){ 
-        printf("Buffer Overflow in assembling tile\n"); return NULL;}
-      
-      if ((pch = strstr(fname, c_tc)) == NULL){
-        printf("error in assembling filename for neighboring block.\n"); return NULL;
-      } else strncpy(pch, c_tn, 11);
 
-      copy_string(c_tc, NPOW_04, c_tn);
-          
+  pthread_mutex_lock(&block_cache_lock);
+
+  for (c=0; c<block_ncache; c++){
+
+    if (block_cache[c].key != key || strcmp(block_cache[c].fname, file) != 0) continue;
+
+    if (block_cache[c].size != st->st_size ||
+        block_cache[c].mtime.tv_sec  != st->st_mtim.tv_sec ||
+        block_cache[c].mtime.tv_nsec != st->st_mtim.tv_nsec){
+      block_cache_bytes -= block_cache[c].bytes;
+      free_brick(block_cache[c].brick);
+      block_cache[c] = block_cache[--block_ncache];
+      break;
+    }
+
+    block_cache[c].used = ++block_cache_clock;
+    brick = duplicate_block(block_cache[c].brick);
+    break;
+
+  }
+
+  pthread_mutex_unlock(&block_cache_lock);
+
+  return brick;
+}
+
+
+/** This function keeps a copy of a block in the block cache. The least
++++ recently used blocks are dropped, when the cache exceeds its budget.
+--- file:     filename
+--- key:      hash of the reading parameters
+--- st:       file status
+--- brick:    block
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void keep_block(char *file, uint64_t key, struct stat *st, brick_t *brick){
+int c, lru;
+block_t block;
+
+
+  block.bytes = get_brick_memory(brick);
+
+  if (block.bytes > block_cache_budget/4) return;
+
+  if ((block.brick = duplicate_block(brick)) == NULL) return;
+
+  copy_string(block.fname, NPOW_10, file);
+  block.key   = key;
+  block.mtime = st->st_mtim;
+  block.size  = st->st_size;
+
+  pthread_mutex_lock(&block_cache_lock);
+
+  // make room
+  while (block_ncache > 0 && block_cache_bytes + block.bytes > block_cache_budget){
+    for (c=1, lru=0; c<block_ncache; c++){
+      if (block_cache[c].used < block_cache[lru].used) lru = c;
+    }
+    block_cache_bytes -= block_cache[lru].bytes;
+    free_brick(block_cache[lru].brick);
+    block_cache[lru] = block_cache[--block_ncache];
+  }
+
+  block.used = ++block_cache_clock;
+  re_alloc((void**)&block_cache, block_ncache, block_ncache+1, sizeof(block_t));
+  block_cache[block_ncache++] = block;
+  block_cache_bytes += block.bytes;
+
+  pthread_mutex_unlock(&block_cache_lock);
+
+  return;
+}
+
+
+/** This function takes an open dataset from the dataset pool. The data-
++++ set is removed from the pool, thus it is used by one thread only. The
++++ pool only holds datasets of one tile, and is flushed when a dataset
++++ of another tile is requested.
+--- file:     filename
+--- tx:       tile X-ID
+--- ty:       tile Y-ID
++++ Return:   dataset, or NULL if not pooled
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+GDALDatasetH take_dataset(char *file, int tx, int ty){
+GDALDatasetH dataset = NULL;
+int c;
+
+
+  pthread_mutex_lock(&dataset_pool_lock);
+
+  // new tile, drop the pool
+  if (tx != dataset_pool_tx || ty != dataset_pool_ty){
+    flush_dataset_pool();
+    dataset_pool_tx = tx;
+    dataset_pool_ty = ty;
+  }
+
+  for (c=0; c<dataset_npool; c++){
+    if (strcmp(dataset_pool[c].fname, file) != 0) continue;
+    dataset = dataset_pool[c].dataset;
+    dataset_pool[c] = dataset_pool[--dataset_npool];
+    break;
+  }
+
+  pthread_mutex_unlock(&dataset_pool_lock);
+
+  return dataset;
+}
+
+
+/** This function returns a dataset to the dataset pool, such that the 
++++ next chunk of the same file does not need to open it again, i.e. the
++++ header is not parsed again. The least recently used dataset is closed
++++ when the pool is full. Datasets of another tile are closed directly.
+--- file:     filename
+--- tx:       tile X-ID
+--- ty:       tile Y-ID
+--- dataset:  dataset
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void keep_dataset(char *file, int tx, int ty, GDALDatasetH dataset){
+int c, lru;
+
+
+  pthread_mutex_lock(&dataset_pool_lock);
+
+  if (tx != dataset_pool_tx || ty != dataset_pool_ty){
+    pthread_mutex_unlock(&dataset_pool_lock);
+    GDALClose(dataset);
+    return;
+  }
+
+  // make room
+  if (dataset_npool == DATASET_POOL){
+    for (c=1, lru=0; c<dataset_npool; c++){
+      if (dataset_pool[c].used < dataset_pool[lru].used) lru = c;
+    }
+    GDALClose(dataset_pool[lru].dataset);
+    dataset_pool[lru] = dataset_pool[--dataset_npool];
+  }
+
+  copy_string(dataset_pool[dataset_npool].fname, NPOW_10, file);
+  dataset_pool[dataset_npool].used    = ++dataset_pool_clock;
+  dataset_pool[dataset_npool].dataset = dataset;
+  dataset_npool++;
+
+  pthread_mutex_unlock(&dataset_pool_lock);
+
+  return;
+}
+
+
+/** This function reads a block of ARD-styled data, or creates a nodata
++++ block without accessing the file, if the observation has no usable 
++++ pixel in the block.
+--- usable:   is there any usable pixel in the block?
+--- file...:  see read_block
++++ Return:   image brick
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t *screened_block(bool usable, char *file, int ard_type, par_sen_t *sen, int read_b, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube, bool psf){
+
+
+  if (usable){
+    return read_block(file, ard_type, sen, read_b, read_nb, nodata, datatype, chunk, tx, ty, cube, psf, 0, 0);
+  } else {
+    return nodata_block(file, ard_type, sen, read_nb, nodata, datatype, chunk, tx, ty, cube);
+  }
+
+}
+
+
+/** This function returns the first product of an ARD dataset that was 
++++ read, which holds the metadata of the observation, e.g. date and sen-
++++ sor.
+--- ard:    ARD dataset
++++ Return: image brick (or NULL)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t *template_ard(ard_t *ard){
+
+
+  if (ard->DAT != NULL) return ard->DAT;
+  if (ard->QAI != NULL) return ard->QAI;
+  if (ard->DST != NULL) return ard->DST;
+  if (ard->AOD != NULL) return ard->AOD;
+  if (ard->HOT != NULL) return ard->HOT;
+  if (ard->VZN != NULL) return ard->VZN;
+  return ard->WVP;
+}
+
+
+/** This function merges the observations of the same sensor and day, e.g.
++++ adjacent granules or scenes of the same orbit, which are mostly nodata
++++ in the area of each other. The observations are merged into the first
++++ one, pixel by pixel and all products at once, like the neighboring 
++++ blocks in add_blocks. FIRST keeps the first valid pixel. QAI replaces a
++++ pixel that fails the QAI rules with a valid pixel that passes them. The
++++ merged observations are freed, and the ARD is compacted.
+--- ard:    ARD
+--- nt:     number of datasets
+--- phl:    HL parameters
++++ Return: number of datasets after merging
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int merge_ard(ard_t *ard, int nt, par_hl_t *phl){
+int t, k, b, p, nb = 0, nc, n;
+int *into = NULL;
+brick_t *from = NULL, *to = NULL;
+char product[NPOW_02];
+bool rank = false;
+qai_screen_t scr;
+
+
+  if (nt < 2 || (to = template_ard(&ard[0])) == NULL) return nt;
+
+  nc = get_brick_chunkncells(to);
+  if (ard[0].DAT != NULL) nb = get_brick_nbands(ard[0].DAT);
+
+  // Level 3 inputs come with INF instead of QAI, keep the first pixel then
+  if (phl->merge == _MERGE_QAI_ && ard[0].QAI != NULL){
+    get_brick_product(ard[0].QAI, product, NPOW_02);
+    rank = strcmp(product, "INF") != 0;
+  }
+
+  scr = compile_qai_rule(&phl->qai, true);
+
+
+  // find the first observation of the same sensor and day
+  alloc((void**)&into, nt, sizeof(int));
+
+  for (t=0; t<nt; t++){
+
+    into[t] = t;
+    if ((from = template_ard(&ard[t])) == NULL) continue;
+
+    for (k=0; k<t; k++){
+      if (into[k] != k) continue;
+      to = template_ard(&ard[k]);
+      if (get_brick_ce(to, 0)        == get_brick_ce(from, 0) &&
+          get_brick_sensorid(to)     == get_brick_sensorid(from) &&
+          get_brick_chunkncells(to)  == nc &&
+          get_brick_chunkncells(from) == nc){
+        into[t] = k;
+        break;
+      }
+    }
+
+  }
+
+
+  for (t=0; t<nt; t++){
+
+    if ((k = into[t]) == t) continue;
+
+    #ifdef FORCE_DEBUG
+    printf("merging observation %d into %d\n", t, k);
+    #endif
+
+    #pragma omp parallel for private(b) shared(ard,t,k,nb,nc,rank,scr) default(none)
+    for (p=0; p<nc; p++){
+
+      bool valid_to, valid_from, take;
+      bool good_to = true, good_from = true;
+      unsigned short q;
+
+      if (ard[k].dat != NULL){
+        valid_to   = ard[k].dat[0][p] != -9999;
+        valid_from = ard[t].dat[0][p] != -9999;
+      } else {
+        valid_to   = !get_off(ard[k].QAI, p);
+        valid_from = !get_off(ard[t].QAI, p);
+      }
+
+      if (rank){
+        q = (unsigned short)ard[k].qai[p];
+        good_to = (q & scr.bits) == 0 &&
+                  ((scr.cld >> ((q >> _QAI_BIT_CLD_) & 3)) & 1) == 0 &&
+                  ((scr.aod >> ((q >> _QAI_BIT_AOD_) & 3)) & 1) == 0 &&
+                  ((scr.ill >> ((q >> _QAI_BIT_ILL_) & 3)) & 1) == 0;
+        q = (unsigned short)ard[t].qai[p];
+        good_from = (q & scr.bits) == 0 &&
+                    ((scr.cld >> ((q >> _QAI_BIT_CLD_) & 3)) & 1) == 0 &&
+                    ((scr.aod >> ((q >> _QAI_BIT_AOD_) & 3)) & 1) == 0 &&
+                    ((scr.ill >> ((q >> _QAI_BIT_ILL_) & 3)) & 1) == 0;
+      }
+
+      take = valid_from && (!valid_to || (good_from && !good_to));
+
+      if (!take) continue;
+
+      if (ard[k].dat != NULL){
+        for (b=0; b<nb; b++) ard[k].dat[b][p] = ard[t].dat[b][p];
+      }
+      if (ard[k].qai != NULL) ard[k].qai[p] = ard[t].qai[p];
+      if (ard[k].dst != NULL) ard[k].dst[p] = ard[t].dst[p];
+      if (ard[k].aod != NULL) ard[k].aod[p] = ard[t].aod[p];
+      if (ard[k].hot != NULL) ard[k].hot[p] = ard[t].hot[p];
+      if (ard[k].vzn != NULL) ard[k].vzn[p] = ard[t].vzn[p];
+      if (ard[k].wvp != NULL) ard[k].wvp[p] = ard[t].wvp[p];
+
+    }
+
+    free_brick(ard[t].DAT); ard[t].DAT = NULL;
+    free_brick(ard[t].QAI); ard[t].QAI = NULL;
+    free_brick(ard[t].DST); ard[t].DST = NULL;
+    free_brick(ard[t].AOD); ard[t].AOD = NULL;
+    free_brick(ard[t].HOT); ard[t].HOT = NULL;
+    free_brick(ard[t].VZN); ard[t].VZN = NULL;
+    free_brick(ard[t].WVP); ard[t].WVP = NULL;
+
+  }
+
+
+  // compact the ARD, the first observation is always kept
+  for (t=0, n=0; t<nt; t++){
+    if (into[t] == t) ard[n++] = ard[t];
+  }
+
+  free((void*)into);
+
+  #ifdef FORCE_DEBUG
+  printf("merged %d observations into %d\n", nt, n);
+  #endif
+
+  return n;
+}
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function reads the processing mask (if given).
+--- success: success of the mask retrieval
+--- tx:      tile X-ID
+--- ty:      tile Y-ID
+--- chunk:   block number
+--- cube:    datacube parameters, e.g. resolution
+--- phl:     HL parameters
++++ Return: image brick
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t *read_mask(int *success, int tx, int ty, int chunk, cube_t *cube, par_hl_t *phl){
+brick_t *MASK = NULL;
+small *mask_ = NULL;
+int nc, p;
+char fname[NPOW_10];
+int nchar;
+dir_t dir;
+int n = 0;
+
+
+  #ifdef FORCE_CLOCK
+  time_t TIME; time(&TIME);
+  #endif
+
+  #ifdef FORCE_DEBUG
+  printf("Reading mask X%04d_Y%04d\n", tx, ty);
+  #endif
+
+  if (strcmp(phl->d_mask, "NULL") == 0){
+    *success = SUCCESS;
+    return NULL;
+  }
+
+  // get mask file listing, skip if tile is empty
+  if (list_mask(tx, ty, phl, &dir) == FAILURE){
+    #ifdef FORCE_DEBUG
+    printf("No data in here (no mask). Skip.\n");
+    #endif
+    *success = CANCEL;
+    return NULL;
+  }
+
+
+  // filename
+  nchar = snprintf(fname, NPOW_10, "%s/%s", dir.name, dir.list[0]);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); 
+    *success = FAILURE; 
+    return NULL;
+  }
+  
+
+  // read mask
+  if ((MASK = read_block(fname, _ARD_MSK_, NULL, 1, 1, 255, _DT_SMALL_, chunk, tx, ty, cube, false, 0, 0)) == NULL){
+      printf("Error reading mask %s. ", fname); *success = FAILURE; return NULL;}
+  if (phl->radius > 0){
+    if ((MASK = add_blocks(fname, _ARD_MSK_, NULL, 1, 1, 255, _DT_SMALL_, chunk, tx, ty, cube, false, phl->radius, MASK)) == NULL){
+      printf("Error adding masks %s. ", fname); *success = FAILURE; return NULL;}
+  }
+  //if ((MASK = read_mask_block(fname, 255, chunk, tx, ty, cube)) == NULL){
+  //    printf("Error reading mask %s. ", fname); *success = FAILURE; return NULL;}
+
+  free_2D((void**)dir.list, dir.N); dir.list = NULL;
+  free_2D((void**)dir.LIST, dir.N); dir.LIST = NULL;
+
+  nc = get_brick_chunkncells(MASK);
+  if ((mask_ = get_band_small(MASK, 0)) == NULL){
+    printf("Error getting processing mask."); 
+    free_brick(MASK);
+    *success = FAILURE; return NULL;}
+
+  // count and make sure that mask_ is binary
+  for (p=0; p<nc; p++){
+    if (mask_[p] == 1){
+      n++;
+    } else {
+      mask_[p] = 0;
+    }
+  }
+
+  if (n == 0){
+    //printf("no valid pixel in mask in this block. skip this block!\n");
+    free_brick(MASK);
+    *success = CANCEL;
+    return NULL;
+  }
+
+  #ifdef FORCE_CLOCK
+  proctime_print("read mask", TIME);
+  #endif
+
+  *success = SUCCESS;
+  return MASK;
+}
+
+
+/** This function compares two features by file, band, and position in
++++ the feature list, to sort them for reading
+--- a:      feature 1
+--- b:      feature 2
++++ Return: comparison result
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int cmp_feature(const void *a, const void *b){
+const ftr_order_t *f1 = (const ftr_order_t*)a;
+const ftr_order_t *f2 = (const ftr_order_t*)b;
+int cmp;
+
+
+  if ((cmp = strcmp(f1->bname, f2->bname)) != 0) return cmp;
+  if (f1->band != f2->band) return (f1->band < f2->band) ? -1 : 1;
+  if (f1->f    != f2->f)    return (f1->f    < f2->f)    ? -1 : 1;
+  return 0;
+}
+
+
+/** This function reads the features. Features are grouped by file, and
++++ nearby bands of the same file are read with one multi-band call. The
++++ groups are read in parallel.
+--- nt:     number of features read (returned)
+--- tx:     tile X-ID
+--- ty:     tile Y-ID
+--- chunk:  block number
+--- cube:   datacube parameters, e.g. resolution
+--- phl:    HL parameters
++++ Return: ARD
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+ard_t *read_features(int *nt, int tx, int ty, int chunk, cube_t *cube, par_hl_t *phl){
+int f, r, e, p, nc, b0, nb, nrun = 0;
+char fname[NPOW_10];
+int nchar;
+ftr_order_t *order = NULL;
+int *run = NULL;
+ard_t *features = NULL;
+brick_t *RUN = NULL;
+int error = 0;
+
+
+  #ifdef FORCE_CLOCK
+  time_t TIME; time(&TIME);
+  #endif
+
+  #ifdef FORCE_DEBUG
+  printf("Reading X%04d_Y%04d\n", tx, ty);
+  #endif
+
+
+  // check if all features do exist
+  for (f=0; f<phl->ftr.nfeature; f++){
+    nchar = snprintf(fname, NPOW_10, "%s/X%04d_Y%04d/%s", phl->d_lower, tx, ty, phl->ftr.bname[f]);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); 
+      *nt = 0; 
+      return NULL;
+    }
+    if (!fileexist(fname)){
+      *nt = 0;
+      return NULL;
+    }
+  }
+
+
+  // sort the features by file and band, and split them into runs of
+  // nearby bands in the same file
+  alloc((void**)&order, phl->ftr.nfeature,   sizeof(ftr_order_t));
+  alloc((void**)&run,   phl->ftr.nfeature+1, sizeof(int));
+
+  for (f=0; f<phl->ftr.nfeature; f++){
+    order[f].bname = phl->ftr.bname[f];
+    order[f].band  = phl->ftr.band[f];
+    order[f].f     = f;
+  }
+
+  qsort(order, phl->ftr.nfeature, sizeof(ftr_order_t), cmp_feature);
+
+  for (f=0; f<phl->ftr.nfeature; f++){
+    if (f == 0 || strcmp(order[f].bname, order[f-1].bname) != 0 ||
+        order[f].band - order[f-1].band > FEATURE_GAP) run[nrun++] = f;
+  }
+  run[nrun] = phl->ftr.nfeature;
+
+
+  alloc((void**)&features, phl->ftr.nfeature, sizeof(ard_t));
+
+
+  #pragma omp parallel private(fname,nchar,RUN,b0,nb,e,f,p,nc) shared(features,phl,cube,chunk,tx,ty,order,run,nrun) reduction(+: error) default(none)
+  {
+
+    #pragma omp for schedule(dynamic)
+    for (r=0; r<nrun; r++){
+
+      b0 = order[run[r]].band;
+      nb = order[run[r+1]-1].band - b0 + 1;
+
+      nchar = snprintf(fname, NPOW_10, "%s/X%04d_Y%04d/%s", phl->d_lower, tx, ty, order[run[r]].bname);
+      if (nchar < 0 || nchar >= NPOW_10){ 
+        printf("Buffer Overflow in assembling filename\n"); error++; continue;}
+
+      // read all bands of the run
+      if ((RUN = read_block(fname, _ARD_FTR_, NULL, b0, nb, phl->ftr.nodata, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, 0, 0)) == NULL){
+        printf("Error reading feature %s. ", fname); error++; continue;}
+      if (phl->radius > 0){
+        if ((RUN = add_blocks(fname, _ARD_FTR_, NULL, b0, nb, phl->ftr.nodata, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, RUN)) == NULL){
+          printf("Error adding feature %s. ", fname); error++; continue;}
+      }
+
+      nc = get_brick_chunkncells(RUN);
+
+      for (e=run[r]; e<run[r+1]; e++){
+
+        f = order[e].f;
+
+        // a single band is taken as is, the bands of a run are copied
+        if (nb == 1 && run[r+1]-run[r] == 1){
+          features[f].DAT = RUN;
+          RUN = NULL;
+        } else if ((features[f].DAT = copy_brick(RUN, 1, _DT_SHORT_)) != NULL){
+          copy_brick_band(features[f].DAT, 0, RUN, order[e].band-b0);
+          memcpy(get_band_short(features[f].DAT, 0), get_band_short(RUN, order[e].band-b0), nc*sizeof(short));
+        }
+
+        if (features[f].DAT == NULL || (features[f].dat = get_bands_short(features[f].DAT)) == NULL){
+          printf("Error reading feature %s. ", fname); error++; continue;}
+
+        // compile a 0-filled QAI brick, processing must continue..
+        if ((features[f].QAI = copy_brick(features[f].DAT, 1, _DT_SHORT_)) == NULL || 
+            (features[f].qai = get_band_short(features[f].QAI, 0)) == NULL){
+          printf("Error compiling feature %s.", fname); error++; continue;}
+
+        for (p=0; p<nc; p++){
+          if (features[f].dat[0][p] == phl->ftr.nodata) set_off(features[f].QAI, p, true);
+        }
+
+        features[f].DST = NULL; features[f].dst = NULL;
+        features[f].AOD = NULL; features[f].aod = NULL;
+        features[f].HOT = NULL; features[f].hot = NULL;
+        features[f].VZN = NULL; features[f].vzn = NULL;
+        features[f].WVP = NULL; features[f].wvp = NULL;
+
+      }
+
+      free_brick(RUN);
+      RUN = NULL;
+
+    }
+
+  }
+
+  free((void*)order);
+  free((void*)run);
+  
+  
+  if (error > 0){
+    printf("%d reading errors. ", error); 
+    free_ard(features, phl->ftr.nfeature);
+    *nt = -1;
+    return NULL;
+  }
+
+  #ifdef FORCE_CLOCK
+  proctime_print("read features", TIME);
+  #endif
+
+  *nt = phl->ftr.nfeature;
+  return features;
+}
+
+
+/** This function compiles the features from the products that preceding
++++ modules computed for the same chunk, i.e. nothing is read from disk
++++ (chained submodules). The features are referenced like the files that
++++ would have been written: basename of the product and band number, or
++++ basename of the band file if the products are exploded.
+--- nt:     number of features (returned)
+--- OUTPUT: products of the preceding modules
+--- nprod:  number of products
+--- used:   products that are used as features (returned)
+--- phl:    HL parameters of the chained module
++++ Return: features
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+ard_t *chain_features(int *nt, brick_t **OUTPUT, int nprod, bool *used, par_hl_t *phl){
+int f, o, b, k, p, nc, nodata;
+char base[NPOW_10];
+char fname[NPOW_10];
+char bname[NPOW_10];
+char ename[NPOW_10];
+char *dot = NULL;
+int nchar;
+int *product = NULL, *band = NULL;
+ard_t *features = NULL;
+float value;
+int error = 0;
+
+
+  alloc((void**)&product, phl->ftr.nfeature, sizeof(int));
+  alloc((void**)&band,    phl->ftr.nfeature, sizeof(int));
+
+  // find the product and band of each feature,
+  // the k-th saved band of a product is band k of the file
+  for (f=0; f<phl->ftr.nfeature; f++){
+
+    copy_string(base, NPOW_10, phl->ftr.bname[f]);
+    if ((dot = strrchr(base, '.')) != NULL) *dot = '\0';
+
+    product[f] = -1;
+
+    for (o=0; o<nprod && product[f] < 0; o++){
+
+      if (OUTPUT[o] == NULL) continue;
+
+      get_brick_filename(OUTPUT[o], fname, NPOW_10);
+
+      for (b=0, k=0; b<get_brick_nbands(OUTPUT[o]); b++){
+
+        if (!get_brick_save(OUTPUT[o], b)) continue;
+        k++;
+
+        if (strcmp(base, fname) == 0 && k == phl->ftr.band[f]){
+          product[f] = o; band[f] = b; break;}
+
+        get_brick_bandname(OUTPUT[o], b, bname, NPOW_10);
+        nchar = snprintf(ename, NPOW_10, "%s_%s", fname, bname);
+        if (nchar < 0 || nchar >= NPOW_10) continue;
+
+        if (strcmp(base, ename) == 0 && phl->ftr.band[f] == 1){
+          product[f] = o; band[f] = b; break;}
+
+      }
+
+    }
+
+    if (product[f] < 0){
+      printf("Feature %s (band %d) is not computed by the preceding modules. ", 
+        phl->ftr.bname[f], phl->ftr.band[f]); 
+      error++;
+    }
+
+  }
+
+  if (error > 0){
+    free((void*)product);
+    free((void*)band);
+    *nt = -1;
+    return NULL;
+  }
+
+
+  alloc((void**)&features, phl->ftr.nfeature, sizeof(ard_t));
+
+  #pragma omp parallel private(p,nc,nodata,value) shared(features,phl,OUTPUT,product,band) reduction(+: error) default(none)
+  {
+
+    #pragma omp for
+    for (f=0; f<phl->ftr.nfeature; f++){
+
+      if ((features[f].DAT = copy_brick(OUTPUT[product[f]], 1, _DT_SHORT_)) == NULL ||
+          (features[f].dat = get_bands_short(features[f].DAT)) == NULL){
+        printf("Error compiling feature %s. ", phl->ftr.bname[f]); error++; continue;}
+
+      set_brick_nodata(features[f].DAT, 0, phl->ftr.nodata);
+
+      nodata = get_brick_nodata(OUTPUT[product[f]], band[f]);
+      nc = get_brick_chunkncells(features[f].DAT);
+
+      for (p=0; p<nc; p++){
+        value = get_brick(OUTPUT[product[f]], band[f], p);
+        features[f].dat[0][p] = (value == nodata) ? phl->ftr.nodata : (short)value;
+      }
+
+      // compile a 0-filled QAI brick, processing must continue..
+      if ((features[f].QAI = copy_brick(features[f].DAT, 1, _DT_SHORT_)) == NULL || 
+          (features[f].qai = get_band_short(features[f].QAI, 0)) == NULL){
+        printf("Error compiling feature %s.", phl->ftr.bname[f]); error++; continue;}
+
+      for (p=0; p<nc; p++){
+        if (features[f].dat[0][p] == phl->ftr.nodata) set_off(features[f].QAI, p, true);
+      }
+
+      features[f].DST = NULL; features[f].dst = NULL;
+      features[f].AOD = NULL; features[f].aod = NULL;
+      features[f].HOT = NULL; features[f].hot = NULL;
+      features[f].VZN = NULL; features[f].vzn = NULL;
+      features[f].WVP = NULL; features[f].wvp = NULL;
+
+    }
+
+  }
+
+
+  if (error > 0){
+    printf("%d chaining errors. ", error); 
+    free_ard(features, phl->ftr.nfeature);
+    free((void*)product);
+    free((void*)band);
+    *nt = -1;
+    return NULL;
+  }
+
+  for (f=0; f<phl->ftr.nfeature; f++) used[product[f]] = true;
+
+  free((void*)product);
+  free((void*)band);
+
+  *nt = phl->ftr.nfeature;
+  return features;
+}
+
+
+/** This function reads continuous field images, e.g. LSP.
+--- nt:     number of images read (returned)
+--- tx:     tile X-ID
+--- ty:     tile Y-ID
+--- chunk:  block number
+--- cube:   datacube parameters, e.g. resolution
+--- phl:    HL parameters
++++ Return: ARD
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+ard_t *read_confield(int *nt, int tx, int ty, int chunk, cube_t *cube, par_hl_t *phl){
+int f;
+char fname[NPOW_10];
+int nchar;
+ard_t *con = NULL;
+int error = 0;
+
+
+  #ifdef FORCE_CLOCK
+  time_t TIME; time(&TIME);
+  #endif
+
+  #ifdef FORCE_DEBUG
+  printf("Reading X%04d_Y%04d\n", tx, ty);
+  #endif
+
+
+  // check if all features do exist
+  for (f=0; f<phl->con.n; f++){
+    nchar = snprintf(fname, NPOW_10, "%s/X%04d_Y%04d/%s", phl->con.dname, tx, ty, phl->con.fname[f]);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); 
+      *nt = 0; 
+      return NULL;
+    }
+    if (!fileexist(fname)){
+      *nt = 0;
+      return NULL;
+    }
+  }
+
+
+  alloc((void**)&con, phl->con.n, sizeof(ard_t));
+
+
+  #pragma omp parallel private(fname,nchar) shared(con,phl,cube,chunk,tx,ty) reduction(+: error) default(none)
+  {
+
+    #pragma omp for
+    for (f=0; f<phl->con.n; f++){
+
+      nchar = snprintf(fname, NPOW_10, "%s/X%04d_Y%04d/%s", phl->con.dname, tx, ty, phl->con.fname[f]);
+      if (nchar < 0 || nchar >= NPOW_10){ 
+        printf("Buffer Overflow in assembling filename\n"); error++;}
+
+      // read continuous field
+      if ((con[f].DAT = read_block(fname, _ARD_FTR_, NULL, 1, -1, phl->con.nodata, _DT_SHORT_, chunk, tx, ty, cube, false, 0, 0)) == NULL ||
+          (con[f].dat = get_bands_short(con[f].DAT)) == NULL){
+        printf("Error reading continuous field %s. ", fname); error++;}
+      if (phl->radius > 0){
+        if ((con[f].DAT = add_blocks(fname, _ARD_FTR_, NULL, 1, -1, phl->con.nodata, _DT_SHORT_, chunk, tx, ty, cube, false, phl->radius, con[f].DAT)) == NULL ||
+            (con[f].dat = get_bands_short(con[f].DAT)) == NULL){
+          printf("Error adding continuous field products %s. ", fname); error++;}
+      }
+      
+      // compile a 0-filled QAI brick, processing must continue..
+      if ((con[f].QAI = copy_brick(con[f].DAT, 1, _DT_SHORT_)) == NULL || 
+          (con[f].qai = get_band_short(con[f].QAI, 0)) == NULL){
+        printf("Error compiling continuous field %s.", fname); error++;}
+
+
+      con[f].DST = NULL; con[f].dst = NULL;
+      con[f].AOD = NULL; con[f].aod = NULL;
+      con[f].HOT = NULL; con[f].hot = NULL;
+      con[f].VZN = NULL; con[f].vzn = NULL;
+      con[f].WVP = NULL; con[f].wvp = NULL;
+
+    }
+
+  }
+  
+  
+  if (error > 0){
+    printf("%d reading errors. ", error); 
+    free_ard(con, phl->con.n);
+    *nt = -1;
+    return NULL;
+  }
+
+  #ifdef FORCE_CLOCK
+  proctime_print("read con", TIME);
+  #endif
+
+  *nt = phl->con.n;
+  return con;
+}
+
+
+/** This function reads all L2 ARD, which are needed to do the required
++++ processing.
+--- nt:     number of datasets read (returned)
+--- tx:     tile X-ID
+--- ty:     tile Y-ID
+--- chunk:  block number
+--- cube:   datacube parameters, e.g. resolution
+--- sen:    sensor parameters
+--- phl:    HL parameters
++++ Return: ARD
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+ard_t *read_ard(int *nt, int tx, int ty, int chunk, cube_t *cube, par_sen_t *sen, par_hl_t *phl){
+int t, b, p, nb, nc;
+char fname[NPOW_10], *pch = NULL;
+char temp[NPOW_10];
+int nchar;
+dir_t dir;
+ard_t *ard = NULL;
+int error = 0;
+bool radar  = false;
+bool level3 = false;
+bool twophase, usable, screened;
+
+
+  #ifdef FORCE_CLOCK
+  time_t TIME; time(&TIME);
+  #endif
+
+  #ifdef FORCE_DEBUG
+  printf("Reading X%04d_Y%04d\n", tx, ty);
+  #endif
+
+
+  // get ARD file listing, skip if tile is empty
+  if (list_ard(tx, ty, sen, phl, &dir) == FAILURE){
+    #ifdef FORCE_DEBUG
+    printf("No data in here (datasets). Skip.\n");
+    #endif
+    *nt = 0;
+    return NULL;
+  }
+
+  // skip chunk if no dataset has data in here (halo needs neighbours)
+  if (phl->radius <= 0 && empty_chunk(dir, tx, ty, chunk, cube)){
+    #ifdef FORCE_DEBUG
+    printf("No data in here (footprint). Skip.\n");
+    #endif
+    free_2D((void**)dir.list, dir.N); dir.list = NULL;
+    free_2D((void**)dir.LIST, dir.N); dir.LIST = NULL;
+    *nt = 0;
+    return NULL;
+  }
+
+
+  // read QAI first, and skip reading the other products of observations
+  // without any usable pixel. Not possible if masked pixels can be re-
+  // stored by the noise filter, or if neighbouring blocks are needed
+  twophase = phl->prd.qai && phl->qai.below_noise <= 0 && phl->radius <= 0;
+
+
+  alloc((void**)&ard, dir.n, sizeof(ard_t));
+
+  // open threads
+  //omp_set_num_threads(par.cpu); --> should be done in main
+//printf("alert. nodata was changed to 0. remove again..\n");
+  #pragma omp parallel private(fname,nchar,temp,pch,p,b,nc,nb,usable,screened) firstprivate(radar,level3) shared(ard,dir,phl,sen,cube,chunk,tx,ty,twophase) reduction(+: error) default(none)
+  {
+
+    #pragma omp for
+    for (t=0; t<dir.n; t++){
+
+      // filename
+      nchar = snprintf(fname, NPOW_10, "%s/%s", dir.name, dir.list[t]);
+      if (nchar < 0 || nchar >= NPOW_10){ 
+        printf("Buffer Overflow in assembling filename\n"); error++;}
+      
+
+      // use improphed product?
+      if (phl->prd.imp){
+        
+        // backup filename
+        copy_string(temp, NPOW_10, fname);
+
+
+        // new filename
+        if (strstr(fname, "BOA")  != NULL) pch = strstr(fname, "BOA");
+        if (strstr(fname, "TOA")  != NULL) pch = strstr(fname, "TOA");
+        if (strstr(fname, "BAP")  != NULL) pch = strstr(fname, "BAP");
+        strncpy(pch, "IMP", 3);
+
+        // if no improphed product exists, use normal one
+        if (!fileexist(fname)) copy_string(fname, NPOW_10, temp);
+
+      }
+
+      // screen QAI before reading anything else (Level 2 ARD only)
+      usable   = true;
+      screened = false;
+      
+      if (twophase && strstr(fname, "SIG") == NULL && strstr(fname, "BAP") == NULL){
+
+        copy_string(temp, NPOW_10, fname);
+        if ((pch = strstr(temp, "BOA")) == NULL &&
+            (pch = strstr(temp, "TOA")) == NULL) pch = strstr(temp, "IMP");
+
+        if (pch != NULL){
+          strncpy(pch, "QAI", 3);
+          if ((ard[t].QAI = read_block(temp, _ARD_AUX_, sen, 1, 1, 1, _DT_SHORT_, chunk, tx, ty, cube, false, 0, 0)) == NULL ||
+              (ard[t].qai = get_band_short(ard[t].QAI, 0)) == NULL){
+            printf("Error reading QAI product %s. ", temp); error++;
+          } else {
+            usable = usable_qai(ard[t].qai, get_brick_chunkncells(ard[t].QAI), &phl->qai, true);
+            screened = true;
+          }
+        }
+
+      }
+
+      // read BOA / TOA / IMP reflectance // SIG backscatter
+      if (phl->prd.ref){
+        if ((ard[t].DAT = screened_block(usable, fname, _ARD_REF_, sen, 0, 0, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf)) == NULL ||
+            (ard[t].dat = get_bands_short(ard[t].DAT)) == NULL){
+          printf("Error reading main product %s. ", fname); error++;}
+        if (phl->radius > 0){
+          if ((ard[t].DAT = add_blocks(fname, _ARD_REF_, sen, 0, 0, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].DAT)) == NULL ||
+              (ard[t].dat = get_bands_short(ard[t].DAT)) == NULL){
+            printf("Error adding main products %s. ", fname); error++;}
+        }
+      } else {
+        ard[t].DAT = NULL;
+        ard[t].dat = NULL;
+      }
+
+      // read Quality Assurance Information
+      if (strstr(fname, "BOA")  != NULL) pch = strstr(fname, "BOA");
+      if (strstr(fname, "TOA")  != NULL) pch = strstr(fname, "TOA");
+      if (strstr(fname, "BAP")  != NULL){ pch = strstr(fname, "BAP"); level3 = true;}
+      if (strstr(fname, "IMP")  != NULL) pch = strstr(fname, "IMP");
+      if (strstr(fname, "SIG")  != NULL){ pch = strstr(fname, "SIG"); radar = true;}
+      if (level3) strncpy(pch, "INF", 3); else strncpy(pch, "QAI", 3);
+
+      if (phl->prd.qai){
+        if (screened){
+          // already read
+        } else if (!radar){
+          if ((ard[t].QAI = read_block(fname, _ARD_AUX_, sen, 1, 1, 1, _DT_SHORT_, chunk, tx, ty, cube, false, 0, 0)) == NULL ||
+              (ard[t].qai = get_band_short(ard[t].QAI, 0)) == NULL){
+            printf("Error reading QAI product %s. ", fname); error++;}
+          if (phl->radius > 0){
+            if ((ard[t].QAI = add_blocks(fname, _ARD_AUX_, sen, 1, 1, 1, _DT_SHORT_, chunk, tx, ty, cube, false, phl->radius, ard[t].QAI)) == NULL ||
+                (ard[t].qai = get_band_short(ard[t].QAI, 0)) == NULL){
+              printf("Error adding QAI products %s. ", fname); error++;}
+          }
+        } else {
+          if ((ard[t].QAI = copy_brick(ard[t].DAT, 1, _DT_SHORT_)) == NULL || 
+              (ard[t].qai = get_band_short(ard[t].QAI, 0)) == NULL){
+            printf("Error compiling feature %s.", fname); error++;}
+            
+          nc = get_brick_chunkncells(ard[t].DAT);
+          nb = get_brick_nbands(ard[t].DAT);
+          
+          for (p=0; p<nc; p++){
+          for (b=0; b<nb; b++){
+            if (ard[t].dat[b][p] == -9999) set_off(ard[t].QAI, p, true);
+          }
+          }
+
+        }
+      } else {
+        ard[t].QAI = NULL;
+        ard[t].qai = NULL;
+      }
+
+      // read Cloud distance
+      if (level3) pch = strstr(fname, "INF"); else pch = strstr(fname, "QAI");
+      strncpy(pch, "DST", 3);
+
+      // backward compatibility
+      if (!fileexist(fname)) strncpy(pch, "CLD", 3);
+      
+      if (phl->prd.dst){
+        if ((ard[t].DST = screened_block(usable, fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf)) == NULL ||
+            (ard[t].dst = get_band_short(ard[t].DST, 0)) == NULL){
+          printf("Error reading DST product %s. ", fname); error++;}
+        if (phl->radius > 0){
+          if ((ard[t].DST = add_blocks(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].DST)) == NULL ||
+              (ard[t].dst = get_band_short(ard[t].DST, 0)) == NULL){
+            printf("Error adding DST products %s. ", fname); error++;}
+        }
+      } else {
+        ard[t].DST = NULL;
+        ard[t].dst = NULL;
+      }
+
+      // read Aerosol Optical Depth
+      pch = strstr(fname, "DST"); 
+      
+      // backward compatibility
+      if (pch == NULL) pch = strstr(fname, "CLD"); 
+
+      strncpy(pch, "AOD", 3);
+      
+      if (phl->prd.aod){
+        if ((ard[t].AOD = screened_block(usable, fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf)) == NULL ||
+            (ard[t].aod = get_band_short(ard[t].AOD, 0)) == NULL){
+          printf("Error reading AOD product %s. ", fname); error++;}
+        if (phl->radius > 0){
+          if ((ard[t].AOD = add_blocks(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].AOD)) == NULL ||
+              (ard[t].aod = get_band_short(ard[t].AOD, 0)) == NULL){
+            printf("Error adding AOD products %s. ", fname); error++;}
+        }
+      } else {
+        ard[t].AOD = NULL;
+        ard[t].aod = NULL;
+      }
+
+      // read Haze Optimized Transformation
+      pch = strstr(fname, "AOD"); strncpy(pch, "HOT", 3);
+      if (phl->prd.hot){
+        if ((ard[t].HOT = screened_block(usable, fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf)) == NULL ||
+            (ard[t].hot = get_band_short(ard[t].HOT, 0)) == NULL){
+          printf("Error reading HOT product %s. ", fname); error++;}
+        if (phl->radius > 0){
+          if ((ard[t].HOT = add_blocks(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].HOT)) == NULL ||
+              (ard[t].hot = get_band_short(ard[t].HOT, 0)) == NULL){
+            printf("Error adding HOT products %s. ", fname); error++;}
+        }
+      } else {
+        ard[t].HOT = NULL;
+        ard[t].hot = NULL;
+      }
+
+      // read View Zenith Angle
+      pch = strstr(fname, "HOT"); strncpy(pch, "VZN", 3);
+      if (phl->prd.vzn){
+        if ((ard[t].VZN = screened_block(usable, fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf)) == NULL ||
+            (ard[t].vzn = get_band_short(ard[t].VZN, 0)) == NULL){
+          printf("Error reading VZN product %s. ", fname); error++;}
+        if (phl->radius > 0){
+          if ((ard[t].VZN = add_blocks(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].VZN)) == NULL ||
+              (ard[t].vzn = get_band_short(ard[t].VZN, 0)) == NULL){
+            printf("Error adding VZN products %s. ", fname); error++;}
+        }
+      } else {
+        ard[t].VZN = NULL;
+        ard[t].vzn = NULL;
+      }
+
+      // read Water Vapor
+      pch = strstr(fname, "VZN"); strncpy(pch, "WVP", 3);
+      if (phl->prd.wvp){
+        if ((ard[t].WVP = screened_block(usable, fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf)) == NULL ||
+            (ard[t].wvp = get_band_short(ard[t].WVP, 0)) == NULL){
+          printf("Error reading WVP product %s. ", fname); error++;}
+        if (phl->radius > 0){
+          if ((ard[t].WVP = add_blocks(fname, _ARD_AUX_, sen, 1, 1, -9999, _DT_SHORT_, chunk, tx, ty, cube, phl->psf, phl->radius, ard[t].WVP)) == NULL ||
+              (ard[t].wvp = get_band_short(ard[t].WVP, 0)) == NULL){
+            printf("Error adding WVP products %s. ", fname); error++;}
+        }
+      } else {
+        ard[t].WVP = NULL;
+        ard[t].wvp = NULL;
+      }
+
+    }
+
+  }
+  
+  // copy all provenance to 1st date
+  get_brick_provenance(ard[0].DAT, 0, temp, NPOW_10);
+  set_brick_nprovenance(ard[0].DAT, dir.n);
+  set_brick_provenance(ard[0].DAT, 0, temp);
+  for (t=1; t<dir.n; t++){
+    get_brick_provenance(ard[t].DAT, 0, temp, NPOW_10);
+    set_brick_provenance(ard[0].DAT, t, temp);
+  }
+
+  free_2D((void**)dir.list, dir.N); dir.list = NULL;
+  free_2D((void**)dir.LIST, dir.N); dir.LIST = NULL;
+  
+  if (error > 0){
+    printf("%d reading errors. ", error); 
+    free_ard(ard, dir.n);
+    *nt = -1;
+    return NULL;
+  }
+
+  // merge observations of the same sensor and day
+  if (phl->merge != _MERGE_NONE_) dir.n = merge_ard(ard, dir.n, phl);
+
+  #ifdef FORCE_CLOCK
+  proctime_print("read ARD", TIME);
+  #endif
+
+  *nt = dir.n;
+  return ard;
+}
+
+
+/** This function reads a block of ARD-styled data, and returns a brick. 
++++ GDAL takes care of image decimation / replication if the image has a 
++++ different spatial resolution than expected. A PSF aggregation can also
++++ be used.
+--- file:      filename
+--- ard_type:  type of ARD, e.g. L2 reflectance or feature
+--- sen:       sensor parameters
+--- read_b:    if not ARD reflectance, what is the first band to read?
+--- read_nb:   if not ARD reflectance, how many bands to read?
+--- nodata:    nodata value
+--- datatype:  datatype for brick
+--- chunk:     block number
+--- tx:        tile X-ID
+--- ty:        tile Y-ID
+--- cube:      datacube parameters, e.g. resolution
+--- psf:       use PSF?
+--- partial_x: only read part of the block (width)
+--- partial_y: only read part of the block (height)
++++ Return:    image brick
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t *read_block(char *file, int ard_type, par_sen_t *sen, int read_b, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube, bool psf, double partial_x, double partial_y){
+brick_t *brick  = NULL;
+short   *brick_short_ = NULL;
+small   *brick_small_ = NULL;
+GDALDatasetH dataset = NULL;
+chunk_store_t *store = NULL;
+raw_image_t *raw = NULL;
+
+short *read_buf  = NULL;
+short *band_buf  = NULL;
+short *psf_buf   = NULL;
+short *full_buf  = NULL;
+int   *band_map  = NULL;
+size_t space;
+bool direct;
+
+int sid = 0;
+
+int b, nbands, nb = 0, offb = read_b, p;
+int nread = 0, k;
+int nx, ny, nc;
+int xoff_disc, yoff_disc;
+int nx_read, ny_read, nc_read;
+int b_brick;
+int b_disc;
+int nx_disc, ny_disc, nc_disc;
+int x, y, fx, fy;
+double res_disc;
+double geotran_disc[6];
+
+char prd[NPOW_02] = "TBD";
+date_t date;
+
+struct stat st;
+uint64_t key = 0;
+bool cache = false;
+
+double width, height, x_offset, y_offset;
+double tol = 5e-3;
+
+
+  //CPLSetConfigOption("GDAL_PAM_ENABLED", "NO");
+  //CPLPushErrorHandler(CPLQuietErrorHandler);
+
+  width  = cube->tilesize;
+  height = cube->chunksize;
+  x_offset = 0;
+  y_offset = chunk*cube->chunksize;
+
+  if (fabs(partial_x) > tol){
+    width = fabs(partial_x);
+    if (partial_x < 0) x_offset = cube->tilesize+partial_x;
+  }
+  
+  if (fabs(partial_y) > tol){
+    height = fabs(partial_y);
+    if (partial_y < 0) y_offset = y_offset+cube->chunksize+partial_y;
+  }
+
+
+
+  identify_block(file, ard_type, sen, &date, prd, NPOW_02, &sid);
+
+  // repeated runs: take decoded block from cache
+  if (block_cache_budget > 0 && stat(file, &st) == 0){
+    key = block_key(file, ard_type, sen, sid, read_b, read_nb, nodata, datatype, 
+      chunk, tx, ty, cube, psf, partial_x, partial_y);
+    if ((brick = take_block(file, key, &st)) != NULL) return brick;
+    cache = true;
+  }
+    
+
+  if (fmod(width, cube->res) > tol){
+    printf("requested width %f must be a multiple of RESOLUTION %f (%f > %f). ", width, cube->res, fmod(width, cube->res), tol);
+    return NULL;
+  }
+  if (fmod(height, cube->res) > tol){
+    printf("requested height %f must be a multiple of RESOLUTION %f (%f > %f). ", height, cube->res, fmod(height, cube->res), tol);
+    return NULL;
+  }
+  
+  nx = (int)(width/cube->res);
+  ny = (int)(height/cube->res);
+  nc = nx*ny;
+
+  
+
+  if (ard_type == _ARD_REF_){
+    nb     = sen->ntarget[sid];
+    nbands = sen->nb;
+  } else {
+    nb     = read_nb;
+    nbands = read_nb;
+  }
+  #ifdef FORCE_DEBUG
+  printf("reading %d bands.\n", nb);
+  #endif
+
+
+
+  /** read data
+  +++ case 1: target res = image res:
+  +++         read @ target res using NN
+  +++ case 2: target res < image res && psf = false:
+  +++         read @ target res using NN
+  +++ case 3: target res < image res && psf = true:
+  +++         read @ image res using NN,
+  +++         reduce to target res using PSF
+  +++ case 4: target res > image res:
+  +++         read @ target res using NN
+  +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  
+  // FORCE chunk format is mapped into memory, everything else goes via GDAL
+  if (is_chunk_store(file)){
+
+    if ((store = open_chunk_store(file)) == NULL){
+      printf("unable to open %s. ", file); return NULL;}
+
+    if (nb < 0 || nbands < 0){
+      nb = nbands = store->head.nb;
+      offb = 1;
+    }
+
+    memcpy(geotran_disc, store->head.geotran, 6*sizeof(double));
+
+  } else if (!is_remote_path(file) && (raw = open_raw_image(file)) != NULL && 
+             fabs(raw->geotran[1]-cube->res) < tol && fabs(raw->geotran[5]+cube->res) < tol){
+
+    // uncompressed images at target resolution are read without GDAL,
+    // i.e. without a detour through its block cache
+    if (nb < 0 || nbands < 0){
+      nb = nbands = raw->nb;
+      offb = 1;
+    }
+
+    memcpy(geotran_disc, raw->geotran, 6*sizeof(double));
+
+  } else {
+
+    if (raw != NULL){ close_raw_image(raw); raw = NULL;}
+
+    // datasets are kept open across the chunks of a tile
+    if ((dataset = take_dataset(file, tx, ty)) == NULL){
+      dataset = GDALOpenEx(file, GDAL_OF_READONLY, NULL, NULL, NULL);
+    }
+    //CPLPopErrorHandler();
+    
+    if (dataset == NULL){
+      printf("unable to open %s. ", file); return NULL;}
+
+    if (nb < 0 || nbands < 0){
+      nb = nbands = GDALGetRasterCount(dataset);
+      offb = 1;
+    }
+
+    GDALGetGeoTransform(dataset, geotran_disc); 
+
+  }
+
+  // number of pixels, resolution and projection in image on disc
+  res_disc = geotran_disc[1];
+
+  #ifdef FORCE_DEBUG
+  print_dvector(geotran_disc, "Geotransformation", 6, 10, 2);
+  #endif
+  
+  if (fmod(width, res_disc) > tol){
+    printf("requested image width %f must be a multiple of image resolution %f (%f > %f). ", width, res_disc, fmod(width, res_disc), tol);
+    return NULL;
+  }
+  if (fmod(height, res_disc) > tol){
+    printf("requested image height %f must be a multiple of image resolution %f (%f > %f). ", height, res_disc, fmod(height, res_disc), tol);
+    return NULL;
+  }
+  if (fmod(y_offset, res_disc) > tol){
+    printf("requested image offset %f must be a multiple of image resolution %f (%f > %f). ", y_offset, res_disc, fmod(y_offset, res_disc), tol);
+    return NULL;
+  }
+  if (fmod(x_offset, res_disc) > tol){
+    printf("requested image offset %f must be a multiple of image resolution %f (%f > %f). ", x_offset, res_disc, fmod(x_offset, res_disc), tol);
+    return NULL;
+  }
+
+  nx_disc = (int)(width/res_disc);
+  ny_disc = (int)(height/res_disc);
+  nc_disc = nx_disc*ny_disc;
+  xoff_disc = (int)(x_offset/res_disc);
+  yoff_disc = (int)(y_offset/res_disc);
+  
+
+  #ifdef FORCE_DEBUG
+  printf("read %d x %d pixels with offset %d / %d at resolution %f\n", nx_disc, ny_disc, xoff_disc, yoff_disc, res_disc);
+  printf("copy to %d x %d pixels with offset %d / %d at resolution %f\n", nx, ny, 0, 0, cube->res);
+  #endif
+
+
+  // depending on PSF flag, read image part at full or reduced resolution
+  if (psf && nc_disc > nc){
+    nx_read = nx_disc; ny_read = ny_disc; nc_read = nc_disc;
+    alloc((void**)&psf_buf, nc, sizeof(short));
+    #ifdef FORCE_DEBUG
+    printf("reduce with psf: %s\n", bname);
+    #endif
+  } else {
+    nx_read = nx; ny_read = ny; nc_read = nc;
+    #ifdef FORCE_DEBUG
+    printf("input using NN:  %s\n", bname);
+    #endif
+  }
+
+  #ifdef FORCE_DEBUG
+  printf("reading %d pixels, converting them into %d RAM pixels\n", nc_read, nc);
+  #endif
+
+  // map of bands on disc, such that all bands can be read with one call, 
+  // instead of accessing the dataset band by band. The map of each sensor
+  // is compiled once (compile_band_map), other ARD is read in order
+  if (ard_type == _ARD_REF_){
+    band_map = sen->map[sid];
+    nread    = sen->nread[sid];
+  } else {
+    alloc((void**)&band_map, nbands, sizeof(int));
+    for (b=0; b<nbands; b++) band_map[nread++] = offb+b;
+  }
+
+  brick = allocate_brick(nb, nc, datatype);
+
+  // shorts without gaps at target resolution need no conversion, 
+  // thus they are read straight into the brick
+  direct = (datatype == _DT_SHORT_ && nread == nb && nc_read == nc);
+
+  if (nread > 0){
+
+    if (direct){
+      read_buf = get_band_short(brick, 0);
+      space    = get_brick_stride(brick);
+    } else {
+      alloc((void**)&read_buf, (size_t)nread*nc_read, sizeof(short));
+      space    = nc_read;
+    }
+
+    if (store != NULL){
+
+      // chunk stores are written in the cube's grid, coarser resolutions 
+      // (e.g. previews) are subsampled using NN, as GDAL does
+      if (nx_read == nx_disc && ny_read == ny_disc){
+
+        if (read_chunk_store(store, band_map, nread, 
+          xoff_disc, yoff_disc, nx_disc, ny_disc, space, read_buf) == FAILURE){
+          printf("could not read image.\n"); return NULL;}
+
+      } else {
+
+        if (nx_read > nx_disc || ny_read > ny_disc || 
+            nx_disc % nx_read != 0 || ny_disc % ny_read != 0){
+          printf("chunk store %s does not match the datacube resolution. ", file); return NULL;}
+
+        fx = nx_disc/nx_read;
+        fy = ny_disc/ny_read;
+
+        alloc((void**)&full_buf, (size_t)nread*nc_disc, sizeof(short));
+
+        if (read_chunk_store(store, band_map, nread, 
+          xoff_disc, yoff_disc, nx_disc, ny_disc, nc_disc, full_buf) == FAILURE){
+          printf("could not read image.\n"); free((void*)full_buf); return NULL;}
+
+        for (k=0; k<nread; k++){
+        for (y=0; y<ny_read; y++){
+        for (x=0; x<nx_read; x++){
+          read_buf[k*space + y*nx_read + x] = 
+            full_buf[(size_t)k*nc_disc + (size_t)(y*fy + fy/2)*nx_disc + x*fx + fx/2];
+        }
+        }
+        }
+
+        free((void*)full_buf); full_buf = NULL;
+
+      }
+
+    } else if (raw != NULL){
+
+      if (read_raw_image(raw, band_map, nread, 
+        xoff_disc, yoff_disc, nx_disc, ny_disc, space, read_buf) == FAILURE){
+        printf("could not read image.\n"); return NULL;}
+
+    } else {
+
+      // object store: announce the window, such that GDAL can fetch all 
+      // blocks of all bands with few merged range requests, instead of 
+      // one round-trip per block and band
+      if (is_remote_path(file)){
+        GDALDatasetAdviseRead(dataset, xoff_disc, yoff_disc, nx_disc, ny_disc, 
+          nx_read, ny_read, GDT_Int16, nread, band_map, NULL);
+      }
+
+      if (GDALDatasetRasterIO(dataset, GF_Read, 
+        xoff_disc, yoff_disc, nx_disc, ny_disc, 
+        read_buf, nx_read, ny_read, GDT_Int16, 
+        nread, band_map, 0, 0, space*sizeof(short)) == CE_Failure){
+        printf("could not read image.\n"); return NULL;}
+
+    }
+
+  }
+
+  for (b=0, b_brick=0, k=0; b<nbands; b++){
+
+    if (ard_type == _ARD_REF_){
+      if ((b_disc = sen->band[sid][b])  < 0) continue;
+      if ((b_disc = sen->band[sid][b]) == 0){
+        set_brick_domain(brick, b_brick, sen->domain[b]);
+        b_brick++;
+        continue;
+      }
+    } else {
+      b_disc = offb+b;
+    }
+
+    #ifdef FORCE_DEBUG
+    printf("read band %d to %d, %d bands in total\n", b_disc, b_brick, nb);
+    #endif
+
+    if (!direct){
+
+      if (datatype == _DT_SMALL_){
+        if ((brick_small_ = get_band_small(brick, b_brick)) == NULL) return NULL;
+      } else if (datatype == _DT_SHORT_){
+        if ((brick_short_ = get_band_short(brick, b_brick)) == NULL) return NULL;
+      } else {
+        printf("unsupported datatype. "); return NULL;
+      }
+
+      band_buf = read_buf + (size_t)(k++)*nc_read;
+
+      if (psf && nc_disc > nc){
+        for (p=0; p<nc; p++) psf_buf[p] = nodata;
+        reduce_psf(band_buf, nx_disc, ny_disc, nc_disc, psf_buf, nx, ny, nc, nodata);
+        if (datatype == _DT_SMALL_){
+          for (p=0; p<nc; p++) brick_small_[p] = psf_buf[p];
+        } else if (datatype == _DT_SHORT_){
+          for (p=0; p<nc; p++) brick_short_[p] = psf_buf[p];
+        } else {
+          printf("unsupported datatype. "); return NULL;
+        }
+      } else {
+        if (datatype == _DT_SMALL_){
+          for (p=0; p<nc; p++) brick_small_[p] = band_buf[p];
+        } else if (datatype == _DT_SHORT_){
+          memcpy(brick_short_, band_buf, nc*sizeof(short));
+        } else {
+          printf("unsupported datatype. "); return NULL;
+        }
+      }
+
+    }
+    
+    if (ard_type == _ARD_REF_){
+      set_brick_domain(brick, b_brick, sen->domain[b]);
+      set_brick_bandname(brick, b_brick, sen->domain[b]);
+    }
+
+    b_brick++;
+
+  }
+
+  if (store != NULL){
+    close_chunk_store(store);
+  } else if (raw != NULL){
+    close_raw_image(raw);
+  } else {
+    keep_dataset(file, tx, ty, dataset);
+  }
+  if (read_buf != NULL && !direct){ free((void*)read_buf); read_buf = NULL;}
+  if (psf_buf  != NULL){ free((void*)psf_buf);  psf_buf  = NULL;}
+  if (band_map != NULL && ard_type != _ARD_REF_){ free((void*)band_map); band_map = NULL;}
+
+  //CSLDestroy(open_options);
+
+  compile_block(brick, file, prd, sid, date, sen, nodata, chunk, tx, ty, cube, geotran_disc);
+
+  if (cache) keep_block(file, key, &st, brick);
+   
+  return brick;
+}
+
+
+/** This function creates a block of ARD-styled data, which is filled with
++++ nodata. The metadata are the same as if the block was read from disc
++++ with read_block, but the file is not accessed. This is used for ob-
++++ servations without any usable pixel in the block.
+--- file:     filename
+--- ard_type: type of ARD, e.g. L2 reflectance or feature
+--- sen:      sensor parameters
+--- read_nb:  if not ARD reflectance, how many bands to read?
+--- nodata:   nodata value
+--- datatype: datatype for brick
+--- chunk:    block number
+--- tx:       tile X-ID
+--- ty:       tile Y-ID
+--- cube:     datacube parameters, e.g. resolution
++++ Return:   image brick
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t *nodata_block(char *file, int ard_type, par_sen_t *sen, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube){
+brick_t *brick = NULL;
+short *brick_short_ = NULL;
+small *brick_small_ = NULL;
+int sid = 0;
+int b, b_brick, nb = 0, p, nc;
+char prd[NPOW_02] = "TBD";
+date_t date;
+double geotran[6];
+
+
+  identify_block(file, ard_type, sen, &date, prd, NPOW_02, &sid);
+
+  if (ard_type == _ARD_REF_){
+    nb = sen->ntarget[sid];
+  } else {
+    nb = read_nb;
+  }
+
+  if (nb < 1){
+    printf("number of bands unknown for %s. ", file); return NULL;}
+
+  nc = (int)(cube->tilesize/cube->res) * (int)(cube->chunksize/cube->res);
+
+  brick = allocate_brick(nb, nc, datatype);
+
+  for (b=0; b<nb; b++){
+    if (datatype == _DT_SMALL_){
+      if ((brick_small_ = get_band_small(brick, b)) == NULL) return NULL;
+      for (p=0; p<nc; p++) brick_small_[p] = nodata;
+    } else if (datatype == _DT_SHORT_){
+      if ((brick_short_ = get_band_short(brick, b)) == NULL) return NULL;
+      for (p=0; p<nc; p++) brick_short_[p] = nodata;
+    } else {
+      printf("unsupported datatype. "); return NULL;
+    }
+  }
+
+  if (ard_type == _ARD_REF_){
+    for (b=0, b_brick=0; b<sen->nb; b++){
+      if (sen->band[sid][b] < 0) continue;
+      set_brick_domain(brick, b_brick, sen->domain[b]);
+      if (sen->band[sid][b] > 0) set_brick_bandname(brick, b_brick, sen->domain[b]);
+      b_brick++;
+    }
+  }
+
+  geotran[0] = cube->origin_map.x + tx*cube->tilesize;
+  geotran[1] = cube->res;
+  geotran[2] = 0;
+  geotran[3] = cube->origin_map.y - ty*cube->tilesize;
+  geotran[4] = 0;
+  geotran[5] = -cube->res;
+
+  compile_block(brick, file, prd, sid, date, sen, nodata, chunk, tx, ty, cube, geotran);
+
+  return brick;
+}
+
+
+/** This function adds a partial block of ARD-styled data to the brick we
++++ already have. This is needed for functions that use kernel based pro-
++++ cessing and need to incorporate data from neighoring blocks and/or
++++ tiles to generate seamless output.
+--- file:     filename
+--- ard_type: type of ARD, e.g. L2 reflectance or feature
+--- sen:      sensor parameters
+--- read_b:   if not ARD reflectance, what is the first band to read?
+--- read_nb:  if not ARD reflectance, how many bands to read?
+--- nodata:   nodata value
+--- datatype: datatype for brick
+--- chunk:    block number
+--- tx:       tile X-ID
+--- ty:       tile Y-ID
+--- cube:     datacube parameters, e.g. resolution
+--- psf:      use PSF?
+--- radius:   distance (in projection units) that need to be added
+--- ARD:      image brick we already have in memory (freed within)
++++ Return:   extended image brick
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t *add_blocks(char *file, int ard_type, par_sen_t *sen, int read_b, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube, bool psf, double radius, brick_t *ARD){
+brick_t *add  = NULL;
+small  **add_small_ = NULL;
+short  **add_short_ = NULL;
+brick_t *brick  = NULL;
+small  **brick_small_ = NULL;
+short  **brick_short_ = NULL;
+double res;
+int pix;
+int b, nb;
+int i_off = 0, j_off = 0, p, nx, ny, nc;
+int i_add, j_add, p_add, nx_add = 0, ny_add = 0;
+int block_i, block_j, chunk_add, nchunk, tx_add, ty_add;
+char fname[NPOW_10], *pch = NULL;;
+char c_tc[NPOW_04];
+char c_tn[NPOW_04];
+int nchar;
+bool halo_cached = false;
+
+
+  nb = get_brick_nbands(ARD);
+  res = get_brick_res(ARD);
+  
+  pix = (int)(radius/res);
+
+  nx = cube->cx + pix*2;
+  ny = cube->cy + pix*2;
+  nc = nx*ny;
+  
+  #ifdef FORCE_DEBUG
+  printf("brick with added edges has %d x %d pixels = %d cells\n",
+    nx, ny, nc);
+  #endif
+  
+  nchunk = cube->cn;
+
+  brick = copy_brick(ARD, nb, _DT_NONE_);
+  set_brick_chunkncols(brick, nx);
+  set_brick_chunknrows(brick, ny);
+  allocate_brick_bands(brick, nb, nc, datatype);
+  if (datatype == _DT_SMALL_){
+    if ((brick_small_ = get_bands_small(brick)) == NULL) return NULL;
+  } else if (datatype == _DT_SHORT_){
+    if ((brick_short_ = get_bands_short(brick)) == NULL) return NULL;
+  } else {
+    printf("unsupported datatype. "); return NULL;
+  }
+  
+  // copy file name
+  copy_string(fname, NPOW_10, file);
+  
+  nchar = snprintf(c_tc, NPOW_04, "X%04d_Y%04d", tx, ty);
+  if (nchar < 0 || nchar >= NPOW_04){ 
+    printf("Buffer Overflow in assembling tile\n"); return NULL;}
+
+  // upper halo is the lower edge of the previous chunk, which might have
+  // been kept in memory
+  if (chunk > 0) halo_cached = take_halo(file, tx, ty, chunk, pix, brick);
+
+
+  for (block_i=-1; block_i<=1; block_i++){
+  for (block_j=-1; block_j<=1; block_j++){
+
+    if (block_i < 0 && halo_cached) continue;
+    
+    if (block_i < 0){
+      chunk_add = chunk-1;
+    } else if (block_i > 0){
+      chunk_add = chunk+1;
+    } else {
+      chunk_add = chunk;
+    }
+
+    if (chunk_add < 0){
+      chunk_add = nchunk-1;
+      ty_add = ty-1;
+    } else if (chunk_add >= nchunk){
+      chunk_add = 0;
+      ty_add = ty+1;
+    } else {
+      ty_add = ty;
+    }
+    
+    if (block_j < 0){
+      tx_add = tx-1;
+    } else if (block_j > 0){
+      tx_add = tx+1;
+    } else {
+      tx_add = tx;
+    }
+
+    if (block_i == 0 && block_j == 0){
+
+      add = ARD;
+      if (datatype == _DT_SMALL_){
+        if ((add_small_ = get_bands_small(ARD)) == NULL) return NULL;
+      } else if (datatype == _DT_SHORT_){
+        if ((add_short_ = get_bands_short(ARD)) == NULL) return NULL;
+      } else {
+        printf("unsupported datatype. "); return NULL;
+      }
+
+    } else {
+
+      // new filename
+      nchar = snprintf(c_tn, NPOW_04, "X%04d_Y%04d", tx_add, ty_add);
+      if (nchar < 0 || nchar >= NPOW_04){ 
+        printf("Buffer Overflow in assembling tile\n"); return NULL;}
+      
+      if ((pch = strstr(fname, c_tc)) == NULL){
+        printf("error in assembling filename for neighboring block.\n"); return NULL;
+      } else strncpy(pch, c_tn, 11);
+
+      copy_string(c_tc, NPOW_04, c_tn);
+          
       
       #ifdef FORCE_DEBUG
       printf("\nneighboring block %d %d:\n", block_j, block_i);
@@ -1452,110 +3183,748 @@ int nchar;
       printf("%s\n", fname);
       #endif
 
-      
-      // read the strip
-      if (fileexist(fname)){
-        #ifdef FORCE_DEBUG
-        printf("file exists. read block.\n");
-        #endif
-        if ((add  = read_block(fname, ard_type, sen, read_b, read_nb, nodata, datatype, chunk_add, tx, ty, cube, psf, block_j*radius, block_i*radius)) == NULL){
-          printf("Error reading neighoring product %s. ", fname); return NULL;}
-        if (datatype == _DT_SMALL_){
-          if ((add_small_ = get_bands_small(add)) == NULL) return NULL;
-        } else if (datatype == _DT_SHORT_){
-          if ((add_short_ = get_bands_short(add)) == NULL) return NULL;
-        } else {
-          printf("unsupported datatype. "); return NULL;
-        }
-      } else {
-        #ifdef FORCE_DEBUG
-        printf("file doesn't exists. NULL.\n");
-        #endif
-        add = NULL;
-        add_small_ = NULL;
-        add_short_ = NULL;
+      
+      // read the strip
+      if (fileexist(fname)){
+        #ifdef FORCE_DEBUG
+        printf("file exists. read block.\n");
+        #endif
+        if ((add  = read_block(fname, ard_type, sen, read_b, read_nb, nodata, datatype, chunk_add, tx, ty, cube, psf, block_j*radius, block_i*radius)) == NULL){
+          printf("Error reading neighoring product %s. ", fname); return NULL;}
+        if (datatype == _DT_SMALL_){
+          if ((add_small_ = get_bands_small(add)) == NULL) return NULL;
+        } else if (datatype == _DT_SHORT_){
+          if ((add_short_ = get_bands_short(add)) == NULL) return NULL;
+        } else {
+          printf("unsupported datatype. "); return NULL;
+        }
+      } else {
+        #ifdef FORCE_DEBUG
+        printf("file doesn't exists. NULL.\n");
+        #endif
+        add = NULL;
+        add_small_ = NULL;
+        add_short_ = NULL;
+      }
+      
+    }
+
+
+    if (block_j <  0){ nx_add = pix;      j_off = 0; }
+    if (block_j == 0){ nx_add = cube->cx; j_off = pix; }
+    if (block_j >  0){ nx_add = pix;      j_off = nx-pix; }
+    if (block_i <  0){ ny_add = pix;      i_off = 0; }
+    if (block_i == 0){ ny_add = cube->cy; i_off = pix; }
+    if (block_i >  0){ ny_add = pix;      i_off = ny-pix; }
+
+
+    #ifdef FORCE_DEBUG
+    printf("adding %d x %d pixels with %d / %d offset\n", nx_add, ny_add, j_off, i_off); 
+    #endif
+
+
+    // copy the values
+    for (i_add=0; i_add<ny_add; i_add++){
+    for (j_add=0; j_add<nx_add; j_add++){
+
+      p_add = i_add*nx_add + j_add;
+      p = (i_add+i_off)*nx + j_add+j_off;
+
+      if (datatype == _DT_SMALL_){
+        if (add_small_ == NULL){
+          for (b=0; b<nb; b++) brick_small_[b][p] = nodata;
+        } else {
+          for (b=0; b<nb; b++) brick_small_[b][p] = add_small_[b][p_add];
+        }
+      } else if (datatype == _DT_SHORT_){
+        if (add_short_ == NULL){
+          for (b=0; b<nb; b++) brick_short_[b][p] = nodata;
+        } else {
+          for (b=0; b<nb; b++) brick_short_[b][p] = add_short_[b][p_add];
+        }
+      } else {
+        printf("unsupported datatype. "); return NULL;
+      }
+
+    }
+    }
+
+    free_brick(add);
+    add = NULL;
+    add_small_ = NULL;
+    add_short_ = NULL;
+
+  }
+  }
+
+
+  // keep the lower edge for the next chunk
+  if (chunk+1 < nchunk) keep_halo(file, tx, ty, chunk, pix, cube->cy, brick);
+
+  #ifdef FORCE_DEBUG
+  printf("\ndone adding this dataset\n\n");
+  #endif
+
+  return brick;
+}
+
+
+/** This function frees the ARD
+--- ard:    ARD
+--- nt:     number of datasets
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int free_ard(ard_t *ard, int nt){
+int t;
+
+  for (t=0; t<nt; t++){
+    if (ard[t].DAT != NULL){ free_brick(ard[t].DAT); ard[t].DAT = NULL;}
+    if (ard[t].QAI != NULL){ free_brick(ard[t].QAI); ard[t].QAI = NULL;}
+    if (ard[t].DST != NULL){ free_brick(ard[t].DST); ard[t].DST = NULL;}
+    if (ard[t].AOD != NULL){ free_brick(ard[t].AOD); ard[t].AOD = NULL;}
+    if (ard[t].HOT != NULL){ free_brick(ard[t].HOT); ard[t].HOT = NULL;}
+    if (ard[t].VZN != NULL){ free_brick(ard[t].VZN); ard[t].VZN = NULL;}
+    if (ard[t].WVP != NULL){ free_brick(ard[t].WVP); ard[t].WVP = NULL;}
+    if (ard[t].MSK != NULL){ free_brick(ard[t].MSK); ard[t].MSK = NULL;}
+    if (ard[t].GPU != NULL){ free_gpu_brick(ard[t].GPU); ard[t].GPU = NULL;}
+  }
+  if (nt > 0) free_valid(ard[0].valid);
+  free((void*)ard);
+  ard = NULL;
+
+  return SUCCESS;
+}
+
+
+/** This function probes an ARD file for its internal tiling, and measures
++++ the read performance. Two reads of different size are timed, which
++++ gives the fixed cost per GDAL call, and the throughput.
+--- fname:   ARD file
+--- align:   height of the internal blocks in map units (returned)
+--- latency: time per read call in seconds (returned)
+--- rate:    throughput in bytes per second (returned)
++++ Return:  SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int probe_ard(char *fname, double *align, double *latency, double *rate){
+GDALDatasetH fp;
+GDALRasterBandH band;
+double geotran[6];
+double start, t1, t4;
+int bx, by, nx, ny, n1, n4;
+short *buf = NULL;
+
+
+  if ((fp = GDALOpen(fname, GA_ReadOnly)) == NULL) return FAILURE;
+
+  band = GDALGetRasterBand(fp, 1);
+  GDALGetBlockSize(band, &bx, &by);
+  GDALGetGeoTransform(fp, geotran);
+  nx = GDALGetRasterXSize(fp);
+  ny = GDALGetRasterYSize(fp);
+
+  *align = by*geotran[1];
+
+  // one row of internal blocks, then four rows further down
+  n1 = (by < ny) ? by : ny;
+  n4 = (4*by < ny-n1) ? 4*by : ny-n1;
+
+  if (n4 <= n1){ GDALClose(fp); return FAILURE;}
+
+  alloc((void**)&buf, (size_t)nx*n4, sizeof(short));
+
+  start = omp_get_wtime();
+  if (GDALRasterIO(band, GF_Read, 0, 0, nx, n1, buf, nx, n1, GDT_Int16, 0, 0) != CE_None){
+    free((void*)buf); GDALClose(fp); return FAILURE;}
+  t1 = omp_get_wtime()-start;
+
+  start = omp_get_wtime();
+  if (GDALRasterIO(band, GF_Read, 0, n1, nx, n4, buf, nx, n4, GDT_Int16, 0, 0) != CE_None){
+    free((void*)buf); GDALClose(fp); return FAILURE;}
+  t4 = omp_get_wtime()-start;
+
+  free((void*)buf);
+  GDALClose(fp);
+
+  // t = latency + bytes/rate
+  *rate    = (double)(n4-n1)*nx*sizeof(short) / ((t4 > t1+1e-6) ? t4-t1 : 1e-6);
+  *latency = t1 - (double)n1*nx*sizeof(short) / *rate;
+  if (*latency < 0) *latency = 0;
+
+  return SUCCESS;
+}
+
+
+/** This function chooses the block size automatically. The candidates
++++ divide the tile without remainder, are multiples of the analysis reso-
++++ lution, and are aligned to the internal blocks of the ARD files, such
++++ that no compressed block is decoded twice. The number of datasets and
++++ the enabled products of the first tile with data give the memory per
++++ block, which must fit into the memory budget with all buffered blocks.
++++ The smallest candidate is chosen, for which the per-call latency is
++++ negligible compared to the reading time; smaller blocks need less me-
++++ mory and give a better overlap of reading, computing and writing. 
+--- phl:    HL parameters
++++ Return: block size, or 0 if it cannot be determined
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double auto_blocksize(par_hl_t *phl){
+cube_t *cube = NULL;
+dir_t dir;
+char fname[NPOW_10];
+int tx, ty, n = 0, cn, nchar;
+bool found = false;
+double tol = 5e-3;
+double align, latency, rate;
+double budget, bytes, cells, cells_min;
+double blocksize = 0, fallback = 0, smallest = 0;
+
+
+  if ((cube = read_datacube_def(phl->d_lower)) == NULL) return 0;
+
+  // first tile with data
+  for (ty=phl->ty[_MIN_]; ty<=phl->ty[_MAX_] && !found && n<PROBE_NTILE; ty++){
+  for (tx=phl->tx[_MIN_]; tx<=phl->tx[_MAX_] && !found && n<PROBE_NTILE; tx++, n++){
+    if (list_ard(tx, ty, &phl->sen, phl, &dir) == SUCCESS) found = true;
+  }
+  }
+
+  if (!found){ free_datacube(cube); return 0;}
+  tx--; ty--;
+
+  nchar = snprintf(fname, NPOW_10, "%s/%s", dir.name, dir.list[dir.n/2]);
+  free_2D((void**)dir.list, dir.N);
+  free_2D((void**)dir.LIST, dir.N);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); 
+    free_datacube(cube); return 0;}
+
+  if (probe_ard(fname, &align, &latency, &rate) == FAILURE){
+    free_datacube(cube); return 0;}
+
+  // align to the ARD blocks, unless they exceed the tile
+  if (align < phl->res || align >= cube->tilesize) align = phl->res;
+
+  // all blocks that may be held at the same time: reading, 
+  // buffered, and computing; output is assumed to be of similar size
+  if (phl->mem_budget > 0){
+    budget = phl->mem_budget*1073741824.0;
+  } else {
+    budget = (double)sysconf(_SC_PHYS_PAGES) * (double)sysconf(_SC_PAGESIZE) / 4;
+  }
+  budget /= 2*(phl->stream_depth+2);
+
+  // min. number of cells per band, such that latency is negligible
+  cells_min = latency*rate / PROBE_LATENCY / sizeof(short);
+
+  cube->res = phl->res;
+  cube->nx = cube->ny = (int)(cube->tilesize/cube->res);
+  cube->nc = cube->nx*cube->ny;
+  cube->cx = cube->nx;
+
+  // candidates from large to small
+  for (cn=1; cn<=cube->ny; cn++){
+
+    cube->chunksize = cube->tilesize/cn;
+
+    if (fabs(cube->chunksize*cn - cube->tilesize) > tol) continue;
+    if (fmod(cube->chunksize, phl->res) > tol && 
+        phl->res - fmod(cube->chunksize, phl->res) > tol) continue;
+    if (fmod(cube->chunksize, align) > tol &&
+        align - fmod(cube->chunksize, align) > tol) continue;
+
+    cube->cy = (int)round(cube->chunksize/cube->res);
+    cube->cc = cube->cx*cube->cy;
+
+    bytes = estimate_ard_memory(tx, ty, cube, &phl->sen, phl);
+    cells = cube->cc;
+
+    smallest = cube->chunksize;
+    if (bytes > budget) continue;
+    if (fallback == 0) fallback = cube->chunksize;
+    if (cells >= cells_min) blocksize = cube->chunksize;
+
+  }
+
+  if (blocksize == 0) blocksize = (fallback > 0) ? fallback : smallest;
+
+  printf("Automatic BLOCK_SIZE: %.2f (ARD blocks: %.2f, latency: %.1f ms, "
+         "throughput: %.0f MB/s)\n", blocksize, align, latency*1e3, rate/1048576.0);
+
+  free_datacube(cube);
+
+  return blocksize;
+}
+
+
+/** This function estimates the memory that will be needed for reading 
++++ the ARD of one chunk. The estimate is based on the ARD file listing,
++++ the number of bands, and the products that are used.
+--- tx:     tile X-ID
+--- ty:     tile Y-ID
+--- cube:   datacube parameters, e.g. resolution
+--- sen:    sensor parameters
+--- phl:    HL parameters
++++ Return: memory in bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double estimate_ard_memory(int tx, int ty, cube_t *cube, par_sen_t *sen, par_hl_t *phl){
+dir_t dir;
+int nb = 0, nref, halo = 0, s, b;
+double nc, bytes;
+
+
+  if (list_ard(tx, ty, sen, phl, &dir) == FAILURE) return 0;
+
+  // only count the bands that are read, unused bands were
+  // removed from the sensor dictionary (check_bandlist)
+  if (phl->prd.ref){
+    for (s=0; s<sen->n; s++){
+      for (b=0, nref=0; b<sen->nb; b++){
+        if (sen->band[s][b] >= 0) nref++;
       }
-      
+      if (nref > nb) nb = nref;
     }
+  }
+  if (phl->prd.qai) nb++;
+  if (phl->prd.dst) nb++;
+  if (phl->prd.aod) nb++;
+  if (phl->prd.hot) nb++;
+  if (phl->prd.vzn) nb++;
+  if (phl->prd.wvp) nb++;
 
+  if (phl->radius > 0) halo = (int)ceil(phl->radius/cube->res);
+  nc = (double)(cube->cx + 2*halo) * (cube->cy + 2*halo);
 
-    if (block_j <  0){ nx_add = pix;      j_off = 0; }
-    if (block_j == 0){ nx_add = cube->cx; j_off = pix; }
-    if (block_j >  0){ nx_add = pix;      j_off = nx-pix; }
-    if (block_i <  0){ ny_add = pix;      i_off = 0; }
-    if (block_i == 0){ ny_add = cube->cy; i_off = pix; }
-    if (block_i >  0){ ny_add = pix;      i_off = ny-pix; }
+  bytes = (double)dir.n * nb * nc * sizeof(short);
 
+  free_2D((void**)dir.list, dir.N);
+  free_2D((void**)dir.LIST, dir.N);
 
-    #ifdef FORCE_DEBUG
-    printf("adding %d x %d pixels with %d / %d offset\n", nx_add, ny_add, j_off, i_off); 
-    #endif
+  return bytes;
+}
 
 
-    // copy the values
-    for (i_add=0; i_add<ny_add; i_add++){
-    for (j_add=0; j_add<nx_add; j_add++){
+/** This function counts the ARD datasets of one tile that would be read,
++++ based on the ARD file listing.
+--- tx:     tile X-ID
+--- ty:     tile Y-ID
+--- sen:    sensor parameters
+--- phl:    HL parameters
++++ Return: number of datasets
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int count_ard(int tx, int ty, par_sen_t *sen, par_hl_t *phl){
+dir_t dir;
+int n;
 
-      p_add = i_add*nx_add + j_add;
-      p = (i_add+i_off)*nx + j_add+j_off;
 
-      if (datatype == _DT_SMALL_){
-        if (add_small_ == NULL){
-          for (b=0; b<nb; b++) brick_small_[b][p] = nodata;
-        } else {
-          for (b=0; b<nb; b++) brick_small_[b][p] = add_small_[b][p_add];
-        }
-      } else if (datatype == _DT_SHORT_){
-        if (add_short_ == NULL){
-          for (b=0; b<nb; b++) brick_short_[b][p] = nodata;
-        } else {
-          for (b=0; b<nb; b++) brick_short_[b][p] = add_short_[b][p_add];
+  if (list_ard(tx, ty, sen, phl, &dir) == FAILURE) return 0;
+
+  n = dir.n;
+
+  free_2D((void**)dir.list, dir.N);
+  free_2D((void**)dir.LIST, dir.N);
+
+  return n;
+}
+
+
+/** This function computes the version of the ARD of one tile that would
++++ be read, i.e. a hash of the listed datasets. For local datasets, file
++++ size and modification time are included, such that re-processed ARD
++++ yield a new version. Remote datasets are versioned by name only.
+--- tx:     tile X-ID
+--- ty:     tile Y-ID
+--- sen:    sensor parameters
+--- phl:    HL parameters
++++ Return: version, 0 if there are no datasets
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+uint64_t version_ard(int tx, int ty, par_sen_t *sen, par_hl_t *phl){
+dir_t dir;
+int t;
+uint64_t version = HASH_INIT;
+char fname[NPOW_10];
+struct stat st;
+bool remote;
+int nchar;
+
+
+  if (list_ard(tx, ty, sen, phl, &dir) == FAILURE) return 0;
+
+  remote = is_remote_path(dir.name);
+
+  for (t=0; t<dir.n; t++){
+
+    version = hash_bytes(version, dir.list[t], strlen(dir.list[t]));
+
+    if (remote) continue;
+
+    nchar = snprintf(fname, NPOW_10, "%s/%s", dir.name, dir.list[t]);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); version = 0; break;}
+
+    if (stat(fname, &st) != 0) continue;
+
+    version = hash_bytes(version, &st.st_size, sizeof(st.st_size));
+    version = hash_bytes(version, &st.st_mtim, sizeof(st.st_mtim));
+
+  }
+
+  free_2D((void**)dir.list, dir.N);
+  free_2D((void**)dir.LIST, dir.N);
+
+  return version;
+}
+
+
+/** This function compacts the ARD after quality screening. The screening
++++ condensed the QAI bits into the processing mask, thus the QAI bands are
++++ released when no submodule evaluates individual QAI bits afterwards. 
++++ The QAI brick itself is retained, as it is still used as metadata tem-
++++ plate, e.g. for dates and dimensions.
+--- ard:    ARD
+--- nt:     number of datasets
+--- phl:    HL parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void compact_ard(ard_t *ard, int nt, par_hl_t *phl){
+int t;
+
+
+  if (ard == NULL || phl->prd.qaibits) return;
+
+  for (t=0; t<nt; t++){
+    if (ard[t].MSK == NULL) continue;
+    free_brick_bands(ard[t].QAI);
+    ard[t].qai = NULL;
+  }
+
+  return;
+}
+
+
+/** This function indexes the valid observations of each pixel, once the
++++ masks are final, i.e. after quality screening. The index is stored in
++++ compressed sparse rows, and is shared by all ARD products, such that 
++++ the pixel-wise kernels only visit the valid observations instead of 
++++ testing the mask of all products. Pixels outside of the processing
++++ mask have no valid observations.
+--- ard:    ARD
+--- nt:     number of datasets
+--- mask:   processing mask (or NULL)
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int index_ard(ard_t *ard, int nt, brick_t *mask){
+valid_t *valid = NULL;
+small *mask_ = NULL;
+int *cur = NULL;
+int t, p, p0, p1, nc;
+
+
+  if (ard == NULL || nt < 1) return FAILURE;
+
+  if (mask != NULL){
+    if ((mask_ = get_band_small(mask, 0)) == NULL){
+      printf("Error getting processing mask."); return FAILURE;}
+  }
+
+  nc = get_brick_chunkncells(ard[0].MSK);
+
+  free_valid(ard[0].valid);
+
+  alloc((void**)&valid, 1, sizeof(valid_t));
+  alloc((void**)&valid->off, nc+1, sizeof(int));
+  valid->nc = nc;
+
+
+  // count the valid observations, products are visited in the outer loop
+  #pragma omp parallel for private(t,p,p1) shared(ard,mask_,nt,nc,valid) schedule(static) default(none)
+  for (p0=0; p0<nc; p0+=VALID_BLOCK){
+
+    if ((p1 = p0+VALID_BLOCK) > nc) p1 = nc;
+
+    for (t=0; t<nt; t++){
+      for (p=p0; p<p1; p++) valid->off[p+1] += ard[t].msk[p];
+    }
+
+    if (mask_ != NULL){
+      for (p=p0; p<p1; p++){
+        if (!mask_[p]) valid->off[p+1] = 0;
+      }
+    }
+
+  }
+
+  for (p=0; p<nc; p++) valid->off[p+1] += valid->off[p];
+
+  alloc((void**)&valid->idx, (valid->off[nc] > 0) ? valid->off[nc] : 1, sizeof(int));
+
+
+  // list the valid observations
+  #pragma omp parallel private(t,p,p0,p1,cur) shared(ard,mask_,nt,nc,valid) default(none)
+  {
+
+    alloc((void**)&cur, VALID_BLOCK, sizeof(int));
+
+    #pragma omp for schedule(static)
+    for (p0=0; p0<nc; p0+=VALID_BLOCK){
+
+      if ((p1 = p0+VALID_BLOCK) > nc) p1 = nc;
+
+      for (p=p0; p<p1; p++) cur[p-p0] = valid->off[p];
+
+      for (t=0; t<nt; t++){
+        for (p=p0; p<p1; p++){
+          if (cur[p-p0] < valid->off[p+1] && ard[t].msk[p]) valid->idx[cur[p-p0]++] = t;
         }
-      } else {
-        printf("unsupported datatype. "); return NULL;
       }
 
     }
-    }
 
-    free_brick(add);
-    add = NULL;
-    add_small_ = NULL;
-    add_short_ = NULL;
+    free((void*)cur);
 
   }
-  }
 
 
-  #ifdef FORCE_DEBUG
-  printf("\ndone adding this dataset\n\n");
-  #endif
+  for (t=0; t<nt; t++) ard[t].valid = valid;
 
-  return brick;
+  return SUCCESS;
 }
 
 
-/** This function frees the ARD
+/** This function returns the valid observations of one pixel, see
++++ index_ard.
+--- ard:    ARD
+--- p:      pixel
+--- obs:    valid ARD products, ascending (returned)
++++ Return: number of valid observations
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int valid_obs(ard_t *ard, int p, const int **obs){
+
+
+  *obs = ard[0].valid->idx + ard[0].valid->off[p];
+
+  return ard[0].valid->off[p+1] - ard[0].valid->off[p];
+}
+
+
+/** This function frees the index of valid observations
+--- valid:  valid observations
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_valid(valid_t *valid){
+
+
+  if (valid == NULL) return;
+
+  free((void*)valid->off);
+  free((void*)valid->idx);
+  free((void*)valid);
+
+  return;
+}
+
+
+/** This function selects the ARD within the temporal window of a module,
++++ if the ARD were read for the union of several modules' windows (see
++++ add_submodule). The selection is a shallow copy, i.e. the products are
++++ shared with the ARD, and only the index of valid observations is re-
++++ built. NULL is returned if all ARD are within the window, i.e. if the
++++ ARD can be used as is.
 --- ard:    ARD
 --- nt:     number of datasets
+--- mask:   processing mask (or NULL)
+--- phl:    HL parameters of the module
+--- nw:     number of datasets in window (returned)
++++ Return: ARD in window (free with free_window), or NULL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+ard_t *window_ard(ard_t *ard, int nt, brick_t *mask, par_hl_t *phl, int *nw){
+ard_t *win = NULL;
+date_t date;
+bool *in = NULL;
+int t, n = 0;
+
+
+  *nw = nt;
+
+  if (ard == NULL || nt < 1) return NULL;
+
+  alloc((void**)&in, nt, sizeof(bool));
+
+  for (t=0; t<nt; t++){
+    date = get_brick_date(ard[t].QAI, 0);
+    if ((in[t] = in_temporal_window(phl, &date))) n++;
+  }
+
+  if (n == nt){
+    free((void*)in);
+    return NULL;
+  }
+
+  *nw = n;
+
+  if (n > 0){
+
+    alloc((void**)&win, n, sizeof(ard_t));
+
+    for (t=0, n=0; t<nt; t++){
+      if (!in[t]) continue;
+      win[n] = ard[t];
+      win[n++].valid = NULL;
+    }
+
+    if (ard[0].valid != NULL) index_ard(win, n, mask);
+
+  }
+
+  free((void*)in);
+
+  return win;
+}
+
+
+/** This function frees the ARD selected for a temporal window. The pro-
++++ ducts are owned by the ARD they were selected from, and are kept.
+--- win:    ARD in window
+--- nw:     number of datasets in window
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_window(ard_t *win, int nw){
+
+
+  if (win == NULL) return;
+
+  if (nw > 0) free_valid(win[0].valid);
+  free((void*)win);
+
+  return;
+}
+
+
+/** This function copies the ARD data to the GPU. The band slabs are 
++++ pinned, and the copies are enqueued in the stream of the processing
++++ unit, i.e. they run on the device of this stream while the previous
++++ unit is being computed. The
++++ stream needs to be synchronized before using ard[t].GPU. If any copy
++++ cannot be set up, no device copies are kept, and the unit is computed
++++ on the CPU.
+--- ard:    ARD
+--- nt:     number of ARD products
+--- stream: stream of the processing unit
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int free_ard(ard_t *ard, int nt){
+int upload_ard(ard_t *ard, int nt, gpu_stream_t stream){
 int t;
 
+
+  if (ard == NULL || !gpu_enabled()) return FAILURE;
+
   for (t=0; t<nt; t++){
-    if (ard[t].DAT != NULL){ free_brick(ard[t].DAT); ard[t].DAT = NULL;}
-    if (ard[t].QAI != NULL){ free_brick(ard[t].QAI); ard[t].QAI = NULL;}
-    if (ard[t].DST != NULL){ free_brick(ard[t].DST); ard[t].DST = NULL;}
-    if (ard[t].AOD != NULL){ free_brick(ard[t].AOD); ard[t].AOD = NULL;}
-    if (ard[t].HOT != NULL){ free_brick(ard[t].HOT); ard[t].HOT = NULL;}
-    if (ard[t].VZN != NULL){ free_brick(ard[t].VZN); ard[t].VZN = NULL;}
-    if (ard[t].WVP != NULL){ free_brick(ard[t].WVP); ard[t].WVP = NULL;}
-    if (ard[t].MSK != NULL){ free_brick(ard[t].MSK); ard[t].MSK = NULL;}
+
+    if (ard[t].DAT == NULL) continue;
+
+    pin_brick(ard[t].DAT);
+
+    if ((ard[t].GPU = allocate_gpu_brick(ard[t].DAT, stream)) == NULL ||
+        upload_brick(ard[t].DAT, ard[t].GPU) == FAILURE){
+      gpu_sync(stream);
+      for (t=0; t<nt; t++){
+        if (ard[t].GPU != NULL){ free_gpu_brick(ard[t].GPU); ard[t].GPU = NULL;}
+      }
+      return FAILURE;
+    }
+
   }
-  free((void*)ard);
-  ard = NULL;
 
   return SUCCESS;
 }
 
+
+/** This function gets the memory held by the ARD
+--- ard:    ARD
+--- nt:     number of datasets
++++ Return: memory in bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+size_t get_ard_memory(ard_t *ard, int nt){
+int t;
+size_t bytes = 0;
+
+  if (ard == NULL) return 0;
+
+  for (t=0; t<nt; t++){
+    bytes += get_brick_memory(ard[t].DAT);
+    bytes += get_brick_memory(ard[t].QAI);
+    bytes += get_brick_memory(ard[t].DST);
+    bytes += get_brick_memory(ard[t].AOD);
+    bytes += get_brick_memory(ard[t].HOT);
+    bytes += get_brick_memory(ard[t].VZN);
+    bytes += get_brick_memory(ard[t].WVP);
+    bytes += get_brick_memory(ard[t].MSK);
+  }
+
+  if (nt > 0 && ard[0].valid != NULL){
+    bytes += (size_t)(ard[0].valid->nc+1+ard[0].valid->off[ard[0].valid->nc])*sizeof(int);
+  }
+
+  return bytes;
+}
+
+
+/** This function sets the memory owner of the ARD (see set_brick_owner)
+--- ard:    ARD
+--- nt:     number of datasets
+--- owner:  owner
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void set_ard_owner(ard_t *ard, int nt, const char *owner){
+int t;
+
+  if (ard == NULL) return;
+
+  for (t=0; t<nt; t++){
+    set_brick_owner(ard[t].DAT, owner);
+    set_brick_owner(ard[t].QAI, owner);
+    set_brick_owner(ard[t].DST, owner);
+    set_brick_owner(ard[t].AOD, owner);
+    set_brick_owner(ard[t].HOT, owner);
+    set_brick_owner(ard[t].VZN, owner);
+    set_brick_owner(ard[t].WVP, owner);
+    set_brick_owner(ard[t].MSK, owner);
+  }
+
+  return;
+}
+
+
+/** This function tunes GDAL's virtual file system for reading ARD from
++++ object stores (/vsis3/, /vsigs/, /vsiaz/ etc.). Directory listings on
++++ open are disabled (they are expensive and not needed for ARD), range
++++ requests are merged and multiplexed over HTTP/2, and the VSI block 
++++ cache is enabled. Options given by the user (environment or --config)
++++ are never overridden. Nothing is done for local file systems.
+--- phl:    HL parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void configure_remote_ard(par_hl_t *phl){
+int o;
+const char *options[5][2] = {
+  { "GDAL_DISABLE_READDIR_ON_OPEN",       "EMPTY_DIR" },
+  { "GDAL_HTTP_MULTIPLEX",                "YES" },
+  { "GDAL_HTTP_VERSION",                  "2" },
+  { "GDAL_HTTP_MERGE_CONSECUTIVE_RANGES", "YES" },
+  { "VSI_CACHE",                          "TRUE" } };
+
+
+  if (!is_remote_path(phl->d_lower) && 
+      (strcmp(phl->d_mask, "NULL") == 0 || !is_remote_path(phl->d_mask))) return;
+
+  for (o=0; o<5; o++){
+    if (CPLGetConfigOption(options[o][0], NULL) == NULL){
+      CPLSetConfigOption(options[o][0], options[o][1]);
+    }
+  }
+
+  #ifdef FORCE_DEBUG
+  printf("reading ARD from object store, GDAL VSI options tuned.\n");
+  #endif
+
+  return;
+}
+
@@ -34,8 +34,12 @@ Reading ARD header
 #include "../cross-level/const-cl.h"
 #include "../cross-level/string-cl.h"
 #include "../cross-level/brick-cl.h"
+#include "../cross-level/chunk-cl.h"
+#include "../cross-level/raw-cl.h"
 #include "../cross-level/imagefuns-cl.h"
 #include "../cross-level/quality-cl.h"
+#include "../cross-level/gpu-cl.h"
+#include "../cross-level/utils-cl.h"
 #include "../higher-level/param-hl.h"
 
 
@@ -43,6 +47,14 @@ Reading ARD header
 extern "C" {
 #endif
 
+// valid observations of all pixels, in compressed sparse rows: the valid
+// ARD products of pixel p are idx[off[p]] ... idx[off[p+1]-1], ascending
+typedef struct {
+  int  nc;   // number of cells
+  int *off;  // offset of each pixel, nc+1 elements
+  int *idx;  // ARD products of valid observations, off[nc] elements
+} valid_t;
+
 typedef struct {
   brick_t *DAT;
   brick_t *QAI;
@@ -52,6 +64,8 @@ typedef struct {
   brick_t *VZN;
   brick_t *WVP;
   brick_t *MSK;
+  gpu_brick_t *GPU; // device copy of DAT
+  valid_t *valid;   // valid observations, shared by all products (see index_ard)
   short  **dat;  // quantitative data (reflectance, or index)
   short   *qai;  // quality assurance information (bit-coding)
   short   *dst;  // cloud / cloud shadow distance
@@ -66,11 +80,34 @@ typedef struct {
 
 brick_t *read_mask(int *success, int tx, int ty, int chunk, cube_t *cube, par_hl_t *phl);
 ard_t *read_features(int *nt, int tx, int ty, int chunk, cube_t *cube, par_hl_t *phl);
+ard_t *chain_features(int *nt, brick_t **OUTPUT, int nprod, bool *used, par_hl_t *phl);
 ard_t *read_confield(int *nt, int tx, int ty, int chunk, cube_t *cube, par_hl_t *phl);
 ard_t *read_ard(int *nt, int tx, int ty, int chunk, cube_t *cube, par_sen_t *sen, par_hl_t *phl);
 brick_t *read_block(char *file, int ard_type, par_sen_t *sen, int read_b, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube, bool psf, double partial_x, double partial_y);
+brick_t *nodata_block(char *file, int ard_type, par_sen_t *sen, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube);
 brick_t *add_blocks(char *file, int ard_type, par_sen_t *sen, int read_b, int read_nb, short nodata, int datatype, int chunk, int tx, int ty, cube_t *cube, bool psf, double radius, brick_t *ARD);
 int free_ard(ard_t *ard, int nt);
+void compact_ard(ard_t *ard, int nt, par_hl_t *phl);
+int index_ard(ard_t *ard, int nt, brick_t *mask);
+int valid_obs(ard_t *ard, int p, const int **obs);
+void free_valid(valid_t *valid);
+ard_t *window_ard(ard_t *ard, int nt, brick_t *mask, par_hl_t *phl, int *nw);
+void free_window(ard_t *win, int nw);
+int upload_ard(ard_t *ard, int nt, gpu_stream_t stream);
+size_t get_ard_memory(ard_t *ard, int nt);
+void set_ard_owner(ard_t *ard, int nt, const char *owner);
+void prefetch_ard(int tx, int ty, par_hl_t *phl);
+void free_ard_catalog();
+void free_halo_cache();
+void free_footprint_cache();
+void free_dataset_pool();
+void init_block_cache(size_t bytes);
+void free_block_cache();
+double auto_blocksize(par_hl_t *phl);
+double estimate_ard_memory(int tx, int ty, cube_t *cube, par_sen_t *sen, par_hl_t *phl);
+int count_ard(int tx, int ty, par_sen_t *sen, par_hl_t *phl);
+uint64_t version_ard(int tx, int ty, par_sen_t *sen, par_hl_t *phl);
+void configure_remote_ard(par_hl_t *phl);
 
 #ifdef __cplusplus
 }
@@ -29,6 +29,8 @@ This file contains functions for reading aux files
 
 #include <opencv2/ml.hpp>
 
+#include "rf-cv-hl.h"
+
 
 int read_endmember(par_hl_t *phl, aux_t *aux);
 int read_machine_learner(par_hl_t *phl, aux_t *aux);
@@ -77,6 +79,7 @@ int read_machine_learner(par_hl_t *phl, aux_t *aux){
 int s, m;
 char fname[NPOW_10];
 int nchar;
+rf_flat_t *flat = NULL;
 
 
   phl->mcl.nclass_all_sets = 0;
@@ -109,6 +112,14 @@ int nchar;
         newmodel = cv::ml::RTrees::load(fname);
         aux->ml.rf_model.push_back(newmodel);
 
+        // flat copy for faster prediction, OpenCV is used if not identical
+        flat = compile_rf_flat(newmodel, phl->ftr.nfeature, phl->mcl.method == _ML_RFC_);
+        if (flat != NULL && !check_rf_flat(flat, newmodel)){
+          printf("flat random forest of %s differs from OpenCV, OpenCV is used.\n", fname);
+          free_rf_flat(flat); flat = NULL;
+        }
+        aux->ml.rf_flat.push_back(flat);
+
         if (phl->mcl.method == _ML_RFC_){
 
           // number of classes need to be known to compute RF probability
@@ -141,7 +152,7 @@ int nchar;
 +++ use a header. For each library, the number of samples is allowed to 
 +++ differ, but number of features need to be consistent.
 +++ Mean and standard deviation are computed for ach table and feature;
-+++ the tables may be rescaled.
++++ the tables may be rescaled. A k-d tree is built for each table.
 --- phl:    HL parameters
 --- aux:    auxilliary data
 +++ Return: SUCCESS/FAILURE
@@ -216,6 +227,14 @@ double mx, vx, k;
   if (phl->lib.rescale) aux->library.scaled = true;
 
 
+  alloc((void**)&aux->library.tree, aux->library.n, sizeof(lib_tree_t*));
+
+  for (i=0; i<aux->library.n; i++){
+    if ((aux->library.tree[i] = build_lib_tree(aux->library.tab[i], aux->library.ns[i], aux->library.nf)) == NULL){
+      printf("unable to build search tree for library. "); return FAILURE;}
+  }
+
+
   return SUCCESS;
 }
 
@@ -246,6 +265,12 @@ int ns, nr;
   aux->sample.nr = nr;
   aux->sample.nleft = ns;
 
+  // output is buffered, and written in large batches
+  if ((aux->sample.w_sample   = open_table_writer(phl->smp.f_sample,   phl->smp.format, phl->ftr.nfeature, 0)) == NULL ||
+      (aux->sample.w_response = open_table_writer(phl->smp.f_response, phl->smp.format, nr-2, 6)) == NULL ||
+      (aux->sample.w_coords   = open_table_writer(phl->smp.f_coords,   phl->smp.format, 2,    6)) == NULL){
+    printf("unable to set up sample output. "); return FAILURE;}
+
   return SUCCESS;
 }
 
@@ -261,6 +286,7 @@ int ns, nr;
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 aux_t *read_aux(par_hl_t *phl){
 aux_t *aux;
+int s;
 
 
   alloc((void**)&aux, 1, sizeof(aux_t));
@@ -289,13 +315,31 @@ aux_t *aux;
     }
   }
 
-  if (phl->type == _HL_SMP_){
+  if (phl->type == _HL_SMP_ && phl->smp.mode == _SMP_POINTS_){
     if (read_samples(phl, aux) == FAILURE){
       printf("reading sample file failed. ");
       free_aux(phl, aux);
       return NULL;
     }
   }
+
+  if (phl->type == _HL_SMP_ && phl->smp.mode == _SMP_ZONES_){
+    if (read_zones(phl, &aux->zone) == FAILURE){
+      printf("reading zone file failed. ");
+      free_aux(phl, aux);
+      return NULL;
+    }
+  }
+
+  if (phl->nsub > 0) alloc((void**)&aux->sub, phl->nsub, sizeof(aux_t*));
+
+  for (s=0; s<phl->nsub; s++){
+    if ((aux->sub[s] = read_aux(phl->sub[s])) == NULL){
+      printf("reading aux of submodule failed. ");
+      free_aux(phl, aux);
+      return NULL;
+    }
+  }
   
 
   return aux;
@@ -308,7 +352,7 @@ aux_t *aux;
 +++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void free_aux(par_hl_t *phl, aux_t *aux){
-int i;
+int i, error;
   
   if (aux != NULL){
   
@@ -324,11 +368,38 @@ int i;
       free((void*)aux->library.ns);
       free_2D((void**)aux->library.mean, aux->library.n);
       free_2D((void**)aux->library.sd,   aux->library.n);
+      if (aux->library.tree != NULL){
+        for (i=0; i<aux->library.n; i++) free_lib_tree(aux->library.tree[i]);
+        free((void*)aux->library.tree);
+      }
     }
     
-    if (phl->type == _HL_SMP_){
+    if (phl->type == _HL_ML_){
+      for (i=0; i<(int)aux->ml.rf_flat.size(); i++) free_rf_flat(aux->ml.rf_flat[i]);
+    }
+
+    if (phl->type == _HL_SMP_ && phl->smp.mode == _SMP_ZONES_){
+      if (write_zones(phl, &aux->zone) == FAILURE) printf("writing zonal statistics failed.\n");
+      free_zones(&aux->zone);
+    }
+
+    if (phl->type == _HL_SMP_ && phl->smp.mode == _SMP_POINTS_){
       free_2D((void**)aux->sample.tab, aux->sample.ns);
       free((void*)aux->sample.visited);
+      free((void*)aux->sample.ti);
+      free((void*)aux->sample.tj);
+      free((void*)aux->sample.cell);
+      free((void*)aux->sample.member);
+      error = 0;
+      if (close_table_writer(aux->sample.w_sample)   == FAILURE) error++;
+      if (close_table_writer(aux->sample.w_response) == FAILURE) error++;
+      if (close_table_writer(aux->sample.w_coords)   == FAILURE) error++;
+      if (error > 0) printf("writing samples failed.\n");
+    }
+
+    if (aux->sub != NULL){
+      for (i=0; i<phl->nsub; i++) free_aux(phl->sub[i], aux->sub[i]);
+      free((void*)aux->sub);
     }
 
     free((void*)aux); aux = NULL;
@@ -39,17 +39,20 @@ Reading aux files
 #include "../higher-level/lib-hl.h"
 #include "../higher-level/ml-hl.h"
 #include "../higher-level/sample-hl.h"
+#include "../higher-level/zonal-hl.h"
 
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-typedef struct {
+typedef struct aux_s {
   aux_emb_t endmember;
   aux_lib_t library;
   aux_ml_t  ml;
   aux_smp_t sample;
+  aux_zon_t zone;
+  struct aux_s **sub; // auxiliary data of the submodules
 } aux_t;
 
 aux_t *read_aux(par_hl_t *phl);
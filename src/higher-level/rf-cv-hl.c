@@ -0,0 +1,194 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for compiling random forests of OpenCV into
+flat node arrays, such that they can be predicted with rf_flat_predict
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "rf-cv-hl.h"
+
+
+/** This function compiles a random forest of OpenCV into flat node 
++++ arrays (see rf-hl.c). Forests with categorical splits are not 
++++ supported.
+--- model:          random forest
+--- nfeature:       number of features
+--- classification: classification or regression forest?
++++ Return:         flat random forest, or NULL if not supported
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+rf_flat_t *compile_rf_flat(cv::Ptr<cv::ml::RTrees> model, int nfeature, bool classification){
+rf_flat_t *rf = NULL;
+int t, i, c, d, top, nclass = 0;
+int *stack = NULL, *level = NULL;
+bool error = false;
+cv::Mat sample, vote;
+
+
+  const std::vector<int> &roots = model->getRoots();
+  const std::vector<cv::ml::DTrees::Node> &nodes = model->getNodes();
+  const std::vector<cv::ml::DTrees::Split> &splits = model->getSplits();
+
+  if (roots.empty() || nodes.empty() || !model->getSubsets().empty()) return NULL;
+
+  // class labels, in the same order as the votes
+  if (classification){
+    sample = cv::Mat::zeros(1, nfeature, CV_32F);
+    model->getVotes(sample, vote, 0);
+    nclass = vote.cols;
+  }
+
+  rf = allocate_rf_flat((int)roots.size(), (int)nodes.size(), nfeature, nclass);
+
+  for (c=0; c<nclass; c++) rf->label[c] = vote.at<int>(0,c);
+
+  for (i=0; i<rf->nnode && !error; i++){
+
+    if (nodes[i].split < 0){
+
+      // leaves point to themselves
+      rf->var[i] = 0;
+      rf->thr[i] = 0;
+      rf->child[2*i]   = i;
+      rf->child[2*i+1] = i;
+      rf->value[i] = nodes[i].value;
+      rf->cls[i]   = (classification) ? nodes[i].classIdx : 0;
+
+      if (rf->cls[i] < 0 || (classification && rf->cls[i] >= nclass)) error = true;
+
+    } else {
+
+      const cv::ml::DTrees::Split &split = splits[nodes[i].split];
+
+      // inversed splits go left if feature > thr
+      rf->var[i] = split.varIdx;
+      rf->thr[i] = split.c;
+      rf->child[2*i+ split.inversed] = nodes[i].left;
+      rf->child[2*i+!split.inversed] = nodes[i].right;
+
+      if (split.varIdx < 0 || split.varIdx >= nfeature ||
+          nodes[i].left  < 0 || nodes[i].left  >= rf->nnode ||
+          nodes[i].right < 0 || nodes[i].right >= rf->nnode) error = true;
+
+    }
+
+  }
+
+  if (error){
+    free_rf_flat(rf);
+    return NULL;
+  }
+
+
+  // depth of each tree, i.e. the number of steps to reach all leaves
+  alloc((void**)&stack, 2*rf->nnode, sizeof(int));
+  alloc((void**)&level, 2*rf->nnode, sizeof(int));
+
+  for (t=0; t<rf->ntree; t++){
+
+    rf->root[t] = roots[t];
+    stack[0] = roots[t];
+    level[0] = 0;
+    top = 1;
+
+    while (top > 0 && top < rf->nnode){
+      top--;
+      i = stack[top];
+      d = level[top];
+      if (nodes[i].split < 0){
+        if (d > rf->depth[t]) rf->depth[t] = d;
+      } else {
+        stack[top] = nodes[i].left;  level[top++] = d+1;
+        stack[top] = nodes[i].right; level[top++] = d+1;
+      }
+    }
+
+    if (top > 0) error = true;
+
+  }
+
+  free((void*)stack);
+  free((void*)level);
+
+  if (error){
+    free_rf_flat(rf);
+    return NULL;
+  }
+
+  return rf;
+}
+
+
+/** This function checks that a flat random forest predicts the same as 
++++ OpenCV. The samples are drawn at and close to the split thresholds.
+--- rf:     flat random forest
+--- model:  random forest
++++ Return: true if the predictions (and votes) are identical
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool check_rf_flat(rf_flat_t *rf, cv::Ptr<cv::ml::RTrees> model){
+int i, f, k, nsample = 256;
+unsigned int seed = 1;
+float *pred = NULL;
+int *votes = NULL;
+bool same = true;
+cv::Mat sample(nsample, rf->nfeature, CV_32F), result, vote;
+
+
+  for (i=0; i<nsample; i++){
+  for (f=0; f<rf->nfeature; f++){
+    seed = seed*1103515245 + 12345;
+    k = (seed >> 8) % rf->nnode;
+    switch ((seed >> 4) % 4){
+      case 0:  sample.at<float>(i,f) = rf->thr[k];         break;
+      case 1:  sample.at<float>(i,f) = rf->thr[k] + 1e-4f; break;
+      case 2:  sample.at<float>(i,f) = rf->thr[k] - 1e-4f; break;
+      default: sample.at<float>(i,f) = ((seed >> 12) % 20001)/10000.0f - 1.0f; break;
+    }
+  }
+  }
+
+  alloc((void**)&pred, nsample, sizeof(float));
+  if (rf->nclass > 0) alloc((void**)&votes, nsample*rf->nclass, sizeof(int));
+
+  rf_flat_predict(rf, sample.ptr<float>(0), NULL, nsample, pred, votes);
+
+  model->predict(sample, result);
+  for (i=0; i<nsample && same; i++){
+    if (result.at<float>(i,0) != pred[i]) same = false;
+  }
+
+  if (rf->nclass > 0){
+    model->getVotes(sample, vote, 0);
+    for (i=0; i<nsample && same; i++){
+    for (k=0; k<rf->nclass; k++){
+      if (vote.at<int>(i+1,k) != votes[i*rf->nclass+k]) same = false;
+    }
+    }
+  }
+
+  free((void*)pred);
+  if (rf->nclass > 0) free((void*)votes);
+
+  return same;
+}
+
@@ -0,0 +1,46 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Compiling OpenCV random forests header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef RFCV_HL_H
+#define RFCV_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+/** OpenCV **/
+#include <opencv2/ml.hpp>
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/alloc-cl.h"
+#include "../higher-level/rf-hl.h"
+
+
+rf_flat_t *compile_rf_flat(cv::Ptr<cv::ml::RTrees> model, int nfeature, bool classification);
+bool check_rf_flat(rf_flat_t *rf, cv::Ptr<cv::ml::RTrees> model);
+
+#endif
+
@@ -0,0 +1,244 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains the prediction of flat random forests on the GPU. The
+kernel mirrors rf_flat_predict in rf-hl.c, one thread per pixel. The 
+features are read from the device copies of the feature bricks, and are
+scaled as in machine_learning. Without FORCE_CUDA, this file is compiled
+as C++ and rf_gpu always cancels.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "rf-gpu-hl.h"
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define GPU_NTHREAD 256
+
+// flat forest, device pointers
+typedef struct {
+  int ntree, nclass;
+  const int *root, *depth;
+  const int *var, *child, *cls, *label;
+  const float *thr;
+  const double *value;
+} gpu_rf_t;
+
+
+/** kernels
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+// prediction of one forest, see rf_flat_predict; the votes of the forest
+// are counted in cnt, and are added to votes (both class-major)
+__global__ void rf_kernel(const short * const *feature, const small *valid, int nc,
+  gpu_rf_t rf, int *cnt, float *pred, int *votes){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+int t, d, k, c, best;
+double sum = 0;
+float x;
+
+
+  if (p >= nc || !valid[p]) return;
+
+  for (c=0; c<rf.nclass; c++) cnt[c*nc+p] = 0;
+
+  for (t=0; t<rf.ntree; t++){
+
+    // all pixels take the same number of steps
+    for (d=0, k=rf.root[t]; d<rf.depth[t]; d++){
+      x = feature[rf.var[k]][p]/10000.0;
+      k = rf.child[2*k + !(x <= rf.thr[k])];
+    }
+
+    if (rf.nclass > 0){
+      cnt[rf.cls[k]*nc+p]++;
+    } else {
+      sum += rf.value[k];
+    }
+
+  }
+
+  if (rf.nclass > 0){
+
+    for (c=1, best=0; c<rf.nclass; c++){
+      if (cnt[best*nc+p] < cnt[c*nc+p]) best = c;
+    }
+    pred[p] = (float)rf.label[best];
+
+    if (votes != NULL){
+      for (c=0; c<rf.nclass; c++) votes[c*nc+p] += cnt[c*nc+p];
+    }
+
+  } else {
+
+    pred[p] = (float)sum * (1.0f/rf.ntree);
+
+  }
+
+  return;
+}
+
+#endif
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function predicts several random forests on the GPU. The features
++++ (job->feature) must already be on the device, enqueued in the same 
++++ stream. Each forest is copied to the device, predicted, and released
++++ before the next one. Pixels that are not valid are not predicted. The
++++ function returns after the downloads are complete.
+--- job:    RF job
+--- stream: stream of the processing unit
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int rf_gpu(rf_gpu_t *job, gpu_stream_t stream){
+#ifdef FORCE_CUDA
+cudaStream_t s = (cudaStream_t)gpu_cuda_stream(stream);
+size_t bytes_ptr, bytes_v, bytes_f, bytes_cnt = 0, bytes_rf;
+size_t o_root, o_depth, o_var, o_child, o_cls, o_label, o_thr;
+const short **d_ptr = NULL;
+small *d_v = NULL;
+float *d_f = NULL;
+int *d_cnt = NULL, *d_votes = NULL;
+char *d_rf = NULL;
+rf_flat_t *rf = NULL;
+gpu_rf_t in;
+int nblock, m, nc = job->nc;
+int error = 0;
+
+
+  if (!gpu_enabled() || gpu_select(stream) == FAILURE) return CANCEL;
+
+  nblock = (nc + GPU_NTHREAD - 1) / GPU_NTHREAD;
+
+  bytes_ptr = job->nf*sizeof(short*);
+  bytes_v   = nc*sizeof(small);
+  bytes_f   = nc*sizeof(float);
+  if (job->nclass > 0) bytes_cnt = (size_t)job->nclass*nc*sizeof(int);
+
+  if ((d_ptr = (const short**)gpu_alloc(bytes_ptr, stream)) == NULL) error++;
+  if ((d_v   = (small*)gpu_alloc(bytes_v, stream)) == NULL) error++;
+  if ((d_f   = (float*)gpu_alloc(bytes_f, stream)) == NULL) error++;
+  if (bytes_cnt > 0 && (d_cnt = (int*)gpu_alloc(bytes_cnt, stream)) == NULL) error++;
+  if (bytes_cnt > 0 && job->votes != NULL && 
+     (d_votes = (int*)gpu_alloc(bytes_cnt, stream)) == NULL) error++;
+
+  if (!error){
+    cudaMemcpyAsync(d_ptr, job->feature, bytes_ptr, cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_v,   job->valid,   bytes_v,   cudaMemcpyHostToDevice, s);
+    if (d_votes != NULL) cudaMemsetAsync(d_votes, 0, bytes_cnt, s);
+  }
+
+
+  for (m=0; m<job->nmodel && !error; m++){
+
+    rf = job->rf[m];
+
+    // one buffer per forest, the doubles go first for alignment
+    o_root  = rf->nnode*sizeof(double);
+    o_depth = o_root  + rf->ntree*sizeof(int);
+    o_var   = o_depth + rf->ntree*sizeof(int);
+    o_child = o_var   + rf->nnode*sizeof(int);
+    o_cls   = o_child + 2*rf->nnode*sizeof(int);
+    o_thr   = o_cls   + rf->nnode*sizeof(int);
+    o_label = o_thr   + rf->nnode*sizeof(float);
+    bytes_rf = o_label + rf->nclass*sizeof(int);
+
+    if ((d_rf = (char*)gpu_alloc(bytes_rf, stream)) == NULL){ error++; break;}
+
+    cudaMemcpyAsync(d_rf,         rf->value, rf->nnode*sizeof(double), cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_rf+o_root,  rf->root,  rf->ntree*sizeof(int),    cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_rf+o_depth, rf->depth, rf->ntree*sizeof(int),    cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_rf+o_var,   rf->var,   rf->nnode*sizeof(int),    cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_rf+o_child, rf->child, 2*rf->nnode*sizeof(int),  cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_rf+o_cls,   rf->cls,   rf->nnode*sizeof(int),    cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_rf+o_thr,   rf->thr,   rf->nnode*sizeof(float),  cudaMemcpyHostToDevice, s);
+    if (rf->nclass > 0) cudaMemcpyAsync(d_rf+o_label, rf->label, rf->nclass*sizeof(int), cudaMemcpyHostToDevice, s);
+
+    in.ntree  = rf->ntree;
+    in.nclass = rf->nclass;
+    in.value  = (const double*)d_rf;
+    in.root   = (const int*)(d_rf+o_root);
+    in.depth  = (const int*)(d_rf+o_depth);
+    in.var    = (const int*)(d_rf+o_var);
+    in.child  = (const int*)(d_rf+o_child);
+    in.cls    = (const int*)(d_rf+o_cls);
+    in.thr    = (const float*)(d_rf+o_thr);
+    in.label  = (const int*)(d_rf+o_label);
+
+    // forests of a modelset have the same classes
+    if (rf->nclass != job->nclass){
+      printf("number of classes differs between forests. ");
+      error++;
+    } else {
+
+      rf_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(
+        d_ptr, d_v, nc, in, d_cnt, d_f, d_votes);
+
+      if (cudaGetLastError() != cudaSuccess){
+        printf("launching RF kernel failed. ");
+        error++;
+      } else {
+        cudaMemcpyAsync(job->pred[m], d_f, bytes_f, cudaMemcpyDeviceToHost, s);
+      }
+
+    }
+
+    // the forest buffer can only be recycled when the stream is done
+    if (gpu_sync(stream) == FAILURE) error++;
+    gpu_release(d_rf, bytes_rf, stream);
+
+  }
+
+  if (!error && d_votes != NULL){
+    cudaMemcpyAsync(job->votes, d_votes, bytes_cnt, cudaMemcpyDeviceToHost, s);
+  }
+
+  if (gpu_sync(stream) == FAILURE) error++;
+
+
+  gpu_release(d_ptr,   bytes_ptr, stream);
+  gpu_release(d_v,     bytes_v,   stream);
+  gpu_release(d_f,     bytes_f,   stream);
+  gpu_release(d_cnt,   bytes_cnt, stream);
+  gpu_release(d_votes, bytes_cnt, stream);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
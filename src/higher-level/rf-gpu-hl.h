@@ -0,0 +1,62 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Flat random forest prediction on the GPU header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef RFGPU_HL_H
+#define RFGPU_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/gpu-cl.h"
+#include "../higher-level/rf-hl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// prediction of several random forests on the device
+typedef struct {
+  int nc, nf;             // number of cells, features
+  const short **feature;  // feature bands (device pointers, host array of nf)
+  const small *valid;     // pixels to predict (host, nc)
+  int nmodel;             // number of forests
+  rf_flat_t **rf;         // flat forests (host)
+  int nclass;             // number of classes, 0: regression
+  float **pred;           // host: prediction of each forest (nmodel x nc)
+  int *votes;             // host: votes summed over all forests (nclass x nc), NULL: not needed
+} rf_gpu_t;
+
+int rf_gpu(rf_gpu_t *job, gpu_stream_t stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,176 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for predicting random forests that were 
+compiled into flat node arrays (see compile_rf_flat). A block of samples
+traverses each tree together, such that the nodes of one tree stay in 
+cache. The results are identical to OpenCV's RTrees::predict and getVotes
+for ordered (non-categorical) features without missing values.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "rf-hl.h"
+
+
+// number of samples that traverse a tree together
+#define RF_LANE 64
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function allocates a flat random forest
+--- ntree:    number of trees
+--- nnode:    number of nodes of all trees
+--- nfeature: number of features
+--- nclass:   number of classes, 0: regression
++++ Return:   flat random forest
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+rf_flat_t *allocate_rf_flat(int ntree, int nnode, int nfeature, int nclass){
+rf_flat_t *rf = NULL;
+
+
+  alloc((void**)&rf, 1, sizeof(rf_flat_t));
+
+  rf->ntree    = ntree;
+  rf->nnode    = nnode;
+  rf->nfeature = nfeature;
+  rf->nclass   = nclass;
+
+  if (nclass > 0) alloc((void**)&rf->label, nclass, sizeof(int));
+  alloc((void**)&rf->root,  ntree,   sizeof(int));
+  alloc((void**)&rf->depth, ntree,   sizeof(int));
+  alloc((void**)&rf->var,   nnode,   sizeof(int));
+  alloc((void**)&rf->thr,   nnode,   sizeof(float));
+  alloc((void**)&rf->child, 2*nnode, sizeof(int));
+  alloc((void**)&rf->value, nnode,   sizeof(double));
+  alloc((void**)&rf->cls,   nnode,   sizeof(int));
+
+  return rf;
+}
+
+
+/** This function frees a flat random forest
+--- rf:     flat random forest
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_rf_flat(rf_flat_t *rf){
+
+  if (rf == NULL) return;
+
+  if (rf->label != NULL) free((void*)rf->label);
+  free((void*)rf->root);
+  free((void*)rf->depth);
+  free((void*)rf->var);
+  free((void*)rf->thr);
+  free((void*)rf->child);
+  free((void*)rf->value);
+  free((void*)rf->cls);
+  free((void*)rf);
+
+  return;
+}
+
+
+/** This function predicts samples with a flat random forest. For 
++++ regression, the prediction is the mean of all trees. For classifi-
++++ cation, the prediction is the class label with most votes (the first
++++ one in case of ties); the votes can be returned, too.
+--- rf:     flat random forest
+--- x:      samples, one row of rf->nfeature values per sample
+--- row:    rows of x that are predicted (n), NULL: the first n rows
+--- n:      number of samples to predict
+--- pred:   predictions (n, returned)
+--- votes:  votes of each class (n x nclass, returned), or NULL
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void rf_flat_predict(rf_flat_t *rf, const float *x, const int *row, int n, float *pred, int *votes){
+int r0, nl, l, t, d, k, c, best;
+int node[RF_LANE];
+const float *xr[RF_LANE];
+double sum[RF_LANE];
+int *cnt = NULL, *v = NULL;
+
+
+  if (rf->nclass > 0) alloc((void**)&cnt, RF_LANE*rf->nclass, sizeof(int));
+
+  for (r0=0; r0<n; r0+=RF_LANE){
+
+    if ((nl = n-r0) > RF_LANE) nl = RF_LANE;
+
+    for (l=0; l<nl; l++){
+      xr[l]  = x + (size_t)((row != NULL) ? row[r0+l] : r0+l)*rf->nfeature;
+      sum[l] = 0;
+    }
+    if (rf->nclass > 0) memset(cnt, 0, nl*rf->nclass*sizeof(int));
+
+    for (t=0; t<rf->ntree; t++){
+
+      for (l=0; l<nl; l++) node[l] = rf->root[t];
+
+      // all samples take the same number of steps
+      for (d=0; d<rf->depth[t]; d++){
+        #pragma omp simd private(k)
+        for (l=0; l<nl; l++){
+          k = node[l];
+          node[l] = rf->child[2*k + !(xr[l][rf->var[k]] <= rf->thr[k])];
+        }
+      }
+
+      if (rf->nclass > 0){
+        for (l=0; l<nl; l++) cnt[l*rf->nclass + rf->cls[node[l]]]++;
+      } else {
+        for (l=0; l<nl; l++) sum[l] += rf->value[node[l]];
+      }
+
+    }
+
+    for (l=0; l<nl; l++){
+
+      if (rf->nclass > 0){
+
+        v = cnt + l*rf->nclass;
+        for (c=1, best=0; c<rf->nclass; c++){
+          if (v[best] < v[c]) best = c;
+        }
+
+        pred[r0+l] = (float)rf->label[best];
+        if (votes != NULL) memcpy(votes + (size_t)(r0+l)*rf->nclass, v, rf->nclass*sizeof(int));
+
+      } else {
+
+        // same rounding as OpenCV
+        pred[r0+l] = (float)sum[l] * (1.0f/rf->ntree);
+
+      }
+
+    }
+
+  }
+
+  if (rf->nclass > 0) free((void*)cnt);
+
+  return;
+}
+
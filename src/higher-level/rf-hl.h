@@ -0,0 +1,70 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Flat random forest header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef RF_HL_H
+#define RF_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <stdbool.h> // boolean data type
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/alloc-cl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// random forest with the nodes of all trees in flat arrays; leaves point
+// to themselves, such that each tree is traversed in a fixed number of 
+// steps without branches
+typedef struct {
+  int ntree;          // number of trees
+  int nnode;          // number of nodes of all trees
+  int nfeature;       // number of features
+  int nclass;         // number of classes, 0: regression
+  int *label;         // class labels (nclass)
+  int *root;          // root node of each tree (ntree)
+  int *depth;         // depth of each tree (ntree)
+  int *var;           // split feature of each node (nnode)
+  float *thr;         // split threshold, go left if feature <= thr (nnode)
+  int *child;         // left and right child of each node (2 x nnode)
+  double *value;      // leaf value for regression (nnode)
+  int *cls;           // leaf class index for classification (nnode)
+} rf_flat_t;
+
+rf_flat_t *allocate_rf_flat(int ntree, int nnode, int nfeature, int nclass);
+void free_rf_flat(rf_flat_t *rf);
+void rf_flat_predict(rf_flat_t *rf, const float *x, const int *row, int n, float *pred, int *votes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -27,11 +27,13 @@ This file contains functions for sampling of features
 
 #include "sample-hl.h"
 
+/** OpenMP **/
+#include <omp.h> // multi-platform shared memory multiprocessing
+
 
 /** private functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
-#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 #define MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
 
 double **parse_coord_list(char *fname, size_t *ncoord);
@@ -88,66 +90,155 @@ size_t bufsize = NPOW_10;
 }**/
 
 
-void append_table(char *fname, bool *allow, double **tab, int nrow, int ncol, int decimals);
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function reprojects all samples once, and buckets them by the 
++++ tile and chunk they fall into. Samples outside of the processing ex-
++++ tent are not bucketed, and do not count as left to do.
+--- smp:    samples
+--- phl:    HL parameters
+--- cube:   datacube definition
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void index_samples(aux_smp_t *smp, par_hl_t *phl, cube_t *cube){
+int s, c, k;
+int tx, ty, ti, tj, chunk;
+int *cell_of = NULL;
+int *fill = NULL;
+coord_t smp_map, smp_map_ul;
+double *map_x = NULL, *map_y = NULL;
+int nthread, thread, s0, s1;
+int error = 0;
+
+
+  smp->ncell = cube->tnc*cube->cn;
+
+  alloc((void**)&smp->ti,   smp->ns,      sizeof(int));
+  alloc((void**)&smp->tj,   smp->ns,      sizeof(int));
+  alloc((void**)&smp->cell, smp->ncell+1, sizeof(int));
+  alloc((void**)&cell_of,   smp->ns,      sizeof(int));
 
-void append_table(char *fname, bool *allow, double **tab, int nrow, int ncol, int decimals){
-int row, col;
-FILE *fp = NULL;
 
+  alloc((void**)&map_x, smp->ns, sizeof(double));
+  alloc((void**)&map_y, smp->ns, sizeof(double));
 
-  if (!(fp = fopen(fname, "a"))){
-    printf("unable to open %s. ", fname); exit(FAILURE);}
+  for (s=0; s<smp->ns; s++){
+    map_x[s] = smp->tab[s][_X_];
+    map_y[s] = smp->tab[s][_Y_];
+  }
+
+  // get target coordinates in target css coordinates,
+  // each thread transforms one contiguous batch of samples
+  if (!phl->smp.projected){
+
+    #pragma omp parallel private(nthread,thread,s0,s1) shared(smp,cube,map_x,map_y) default(none)
+    {
 
-  for (row=0; row<nrow; row++){
+      nthread = omp_get_num_threads();
+      thread  = omp_get_thread_num();
+      s0 = (int)((long)smp->ns*thread/nthread);
+      s1 = (int)((long)smp->ns*(thread+1)/nthread);
 
-    if (allow[row]){
+      warp_geo_to_any_array(map_x+s0, map_y+s0, s1-s0, cube->proj);
 
-      fprintf(fp, "%.*f", decimals, tab[row][0]);
-      for (col=1; col<ncol; col++) fprintf(fp, " %.*f", decimals, tab[row][col]);
-      fprintf(fp, "\n");
     }
 
   }
 
-  fclose(fp);
 
-  return;
-}
+  #pragma omp parallel for private(smp_map,smp_map_ul,tx,ty,ti,tj,chunk) shared(smp,cube,cell_of,map_x,map_y) reduction(+: error) default(none)
+  for (s=0; s<smp->ns; s++){
 
+    cell_of[s] = -1;
 
+    if (isnan(map_x[s]) || isnan(map_y[s])){
+      error++;
+      continue;
+    }
 
+    smp_map.x = map_x[s];
+    smp_map.y = map_y[s];
 
+    // find the tile the sample falls into
+    tile_find(smp_map.x, smp_map.y, &smp_map_ul.x, &smp_map_ul.y, &tx, &ty, cube);
 
+    if (tx < cube->tminx || tx > cube->tmaxx) continue;
+    if (ty < cube->tminy || ty > cube->tmaxy) continue;
 
-/** public functions
-+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+    // find pixel and chunk in tile
+    tj = (int)((smp_map.x-smp_map_ul.x)/cube->res);
+    ti = (int)((smp_map_ul.y-smp_map.y)/cube->res);
+    chunk = (int)(ti/cube->cy);
+
+    if (chunk >= cube->cn) continue;
 
+    smp->ti[s] = ti;
+    smp->tj[s] = tj;
+    cell_of[s] = ((ty-cube->tminy)*cube->tnx + (tx-cube->tminx))*cube->cn + chunk;
 
-/** This function is the entry point to the sampling module
+  }
+
+  if (error > 0) printf("there were %d errors in coordinate conversion..\n", error);
+
+  free((void*)map_x);
+  free((void*)map_y);
+
+
+  // counting sort, samples stay in order within each cell
+  for (s=0; s<smp->ns; s++){
+    if (cell_of[s] >= 0) smp->cell[cell_of[s]+1]++;
+  }
+
+  for (c=0; c<smp->ncell; c++) smp->cell[c+1] += smp->cell[c];
+
+  alloc((void**)&fill, smp->ncell, sizeof(int));
+  memcpy(fill, smp->cell, smp->ncell*sizeof(int));
+
+  alloc((void**)&smp->member, MAX(smp->cell[smp->ncell], 1), sizeof(int));
+
+  for (s=0; s<smp->ns; s++){
+    if ((c = cell_of[s]) < 0) continue;
+    k = fill[c]++;
+    smp->member[k] = s;
+  }
+
+  smp->nleft = smp->cell[smp->ncell];
+
+  #ifdef FORCE_DEBUG
+  printf("%d of %d samples are in the processing extent.\n", smp->nleft, smp->ns);
+  #endif
+
+  free((void*)fill);
+  free((void*)cell_of);
+
+  return;
+}
+
+
+/** This function is the entry point to the sampling module. Only the 
++++ samples that index_samples bucketed into the current chunk are visit-
++++ ed.
 --- features: input features
 --- mask:      mask image
 --- nf:        number of features
 --- phl:       HL parameters
+--- smp:       samples
 --- cube:      datacube definition
 --- nproduct:  number of output bricks (returned)
 +++ Return:    empty bricks
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 brick_t **sample_points(ard_t *features, brick_t *mask, int nf, par_hl_t *phl, aux_smp_t *smp, cube_t *cube, int *nproduct){
 small *mask_ = NULL;
-int f, r, s, i, j, p;
+int f, r, s, i, j, k, p, c, n;
 int cx, cy, chunk, tx, ty;
 int nr;
-double res;
-coord_t smp_map, smp_map_ul;
-int smp_tx, smp_ty, smp_chunk;
-int smp_tj, smp_ti;
-int error = 0, found = 0, added = 0;
+int found = 0, added = 0, error = 0;
 bool *copied = NULL, valid;
 double **smp_features = NULL;
 double **smp_response = NULL;
-coord_t geo_ul, geo_ur, geo_lr, geo_ll;
-coord_t geo_upper, geo_lower, geo_left, geo_right;
-double minx, maxx, miny, maxy; 
+double **smp_coords   = NULL;
 
 
   // if no sample is left, skip all
@@ -160,12 +251,24 @@ double minx, maxx, miny, maxy;
   // import bricks
   cx    = get_brick_chunkncols(features[0].DAT);
   cy    = get_brick_chunknrows(features[0].DAT);
-  res   = get_brick_res(features[0].DAT);
   chunk = get_brick_chunk(features[0].DAT);
   tx    = get_brick_tilex(features[0].DAT);
   ty    = get_brick_tiley(features[0].DAT);
 
-//  nodata = get_brick_nodata(features[0].DAT, 0);
+  // if no sample falls into this chunk, skip
+  if (tx < cube->tminx || tx > cube->tmaxx || 
+      ty < cube->tminy || ty > cube->tmaxy || chunk >= cube->cn){
+    *nproduct = 0;
+    return NULL;
+  }
+
+  c = ((ty-cube->tminy)*cube->tnx + (tx-cube->tminx))*cube->cn + chunk;
+  n = smp->cell[c+1]-smp->cell[c];
+
+  if (n == 0){
+    *nproduct = 0;
+    return NULL;
+  }
 
   // import mask (if available)
   if (mask != NULL){
@@ -178,96 +281,26 @@ double minx, maxx, miny, maxy;
 
   nr = smp->nr-2;
 
-  alloc((void**)&copied,           smp->ns,     sizeof(bool));
-  alloc_2D((void***)&smp_features, smp->ns, nf, sizeof(double));
-  alloc_2D((void***)&smp_response, smp->ns, nr, sizeof(double));
-
-
-  if (phl->smp.projected){
-
-    // corner coordinates of chunk
-    minx = get_brick_x(features[0].DAT, 0);
-    maxx = get_brick_x(features[0].DAT, cx);
-    miny = get_brick_y(features[0].DAT, (chunk+1)*cy);
-    maxy = get_brick_y(features[0].DAT, chunk*cy);
-
-  } else {
-
-    // corner coordinates of chunk
-    get_brick_geo(features[0].DAT, 0,    chunk*cy,        &geo_ul.x, &geo_ul.y);
-    get_brick_geo(features[0].DAT, cx,   chunk*cy,        &geo_ur.x, &geo_ur.y);
-    get_brick_geo(features[0].DAT, 0,    (chunk+1)*cy,    &geo_ll.x, &geo_ll.y);
-    get_brick_geo(features[0].DAT, cx,   (chunk+1)*cy,    &geo_lr.x, &geo_lr.y);
-
-    // min/max coordinates
-    minx = MIN(geo_ul.x, geo_ll.x);
-    maxx = MAX(geo_ur.x, geo_lr.x);
-    miny = MIN(geo_ll.y, geo_lr.y);
-    maxy = MAX(geo_ul.y, geo_ur.y);
-
-    // edge coordinates of chunk
-    get_brick_geo(features[0].DAT, cx/2, chunk*cy,        &geo_upper.x, &geo_upper.y);
-    get_brick_geo(features[0].DAT, cx/2, (chunk+1)*cy,    &geo_lower.x, &geo_lower.y);
-    get_brick_geo(features[0].DAT, 0,    chunk*cy + cy/2, &geo_left.x,  &geo_left.y);
-    get_brick_geo(features[0].DAT, cx,   chunk*cy + cy/2, &geo_right.x, &geo_right.y);
+  // tables hold the samples of this chunk only
+  alloc((void**)&copied,           n,     sizeof(bool));
+  alloc((void**)&smp_coords,       n,     sizeof(double*));
+  alloc_2D((void***)&smp_features, n, nf, sizeof(double));
+  alloc_2D((void***)&smp_response, n, nr, sizeof(double));
 
-    // if edge coordinates are outside of corner min/max, expand the box a bit
-    if (geo_left.x  < minx) minx -= 2*fabs(geo_left.x -minx);
-    if (geo_right.x > maxx) maxx += 2*fabs(geo_right.x-maxx);
-    if (geo_lower.y < miny) miny -= 2*fabs(geo_lower.y-miny);
-    if (geo_upper.y > maxy) maxy += 2*fabs(geo_upper.y-maxy);
 
-  }
-
-
-  #pragma omp parallel private(smp_map,smp_map_ul,smp_tx,smp_ty,smp_tj,smp_ti,smp_chunk,j,i,p,f,r,valid) shared(tx,ty,chunk,res,cx,cy,nf,nr,minx,maxx,miny,maxy,copied,smp_features,smp_response,smp,features,mask_,cube,phl) reduction(+: error, found, added) default(none)
+  #pragma omp parallel private(s,j,i,p,f,r,valid) shared(c,n,chunk,cx,cy,nf,nr,copied,smp_features,smp_response,smp_coords,smp,features,mask_,phl) reduction(+: found, added) default(none)
   {
 
     #pragma omp for
-    for (s=0; s<smp->ns; s++){
-
-      if (smp->visited[s]) continue;
+    for (k=0; k<n; k++){
 
-      if (smp->tab[s][_X_] < minx) continue;
-      if (smp->tab[s][_X_] > maxx) continue;
-      if (smp->tab[s][_Y_] < miny) continue;
-      if (smp->tab[s][_Y_] > maxy) continue;
-      
-      if (phl->smp.projected){
-
-        smp_map.x = smp->tab[s][_X_];
-        smp_map.y = smp->tab[s][_Y_];
-
-      } else {
-
-        // get target coordinates in target css coordinates
-        if ((warp_geo_to_any(smp->tab[s][_X_], smp->tab[s][_Y_], &smp_map.x, &smp_map.y, cube->proj)) == FAILURE){
-          printf("Computing target coordinates in dst_srs failed!\n"); 
-          error++;
-          continue;
-        }
-
-      }
+      s = smp->member[smp->cell[c]+k];
 
-      // find the tile the sample falls into
-      tile_find(smp_map.x, smp_map.y, &smp_map_ul.x, &smp_map_ul.y, &smp_tx, &smp_ty, cube);
-
-      // if not in current tile, skip
-      if (smp_tx != tx || smp_ty != ty) continue;
-
-      // find pixel in tile
-      smp_tj = (int)((smp_map.x-smp_map_ul.x)/res);
-      smp_ti = (int)((smp_map_ul.y-smp_map.y)/res);
-
-      // find chunk in tile
-      smp_chunk = (int)(smp_ti/cy);
-
-      // if not in current chunk, skip
-      if (smp_chunk != chunk) continue;
+      if (smp->visited[s]) continue;
 
       // find pixel in chunk
-      j = smp_tj;
-      i = smp_ti - chunk*cy;
+      j = smp->tj[s];
+      i = smp->ti[s] - chunk*cy;
       p = i*cx+j;
 
       // skip pixels that are masked
@@ -275,10 +308,11 @@ double minx, maxx, miny, maxy;
 
       // extract
       for (f=0, valid=true; f<nf; f++){
-        smp_features[s][f] = features[f].dat[0][p];
+        smp_features[k][f] = features[f].dat[0][p];
         if (!features[f].msk[p] && phl->ftr.exclude) valid = false;
       }
-     for (r=0; r<nr; r++) smp_response[s][r] = smp->tab[s][_Z_+r];
+      for (r=0; r<nr; r++) smp_response[k][r] = smp->tab[s][_Z_+r];
+      smp_coords[k] = smp->tab[s];
 
 
       // we are done with this sample
@@ -287,24 +321,30 @@ double minx, maxx, miny, maxy;
 
       if (!valid) continue;
 
-      copied[s] = true;
+      copied[k] = true;
       added++;
 
     }
 
   }
 
-  if (error > 0) printf("there were %d errors in coordinate conversion..\n", error);
+  // chunks may be sampled concurrently, the writers are shared
+  #pragma omp critical (sample_writer)
+  {
 
-  smp->nleft -= found;
+    smp->nleft -= found;
 
+    if (added > 0){
+      if (write_table_rows(smp->w_sample,   smp_features, copied, n) == FAILURE) error++;
+      if (write_table_rows(smp->w_response, smp_response, copied, n) == FAILURE) error++;
+      if (write_table_rows(smp->w_coords,   smp_coords,   copied, n) == FAILURE) error++;
+    }
 
-  if (added > 0){
-    append_table(phl->smp.f_sample,   copied, smp_features, smp->ns, nf, 0);
-    append_table(phl->smp.f_response, copied, smp_response, smp->ns, nr, 6);
-    append_table(phl->smp.f_coords,   copied, smp->tab,     smp->ns, 2,  6);
   }
 
+  if (error > 0){
+    printf("writing samples failed. "); exit(FAILURE);}
+
 
   #ifdef FORCE_DEBUG
   if (added > 0) printf("Added %d samples in Tile X%04d_Y%04d Chunk %03d.\n", 
@@ -313,8 +353,9 @@ double minx, maxx, miny, maxy;
 
 
   free((void*)copied);
-  free_2D((void**)smp_response, smp->ns);
-  free_2D((void**)smp_features, smp->ns);
+  free((void*)smp_coords);
+  free_2D((void**)smp_response, n);
+  free_2D((void**)smp_features, n);
 
   *nproduct = 0;
   return NULL;
@@ -32,6 +32,7 @@ Sampling header
 #include <stdlib.h>  // standard general utilities library
 
 #include "../cross-level/const-cl.h"
+#include "../cross-level/table-cl.h"
 #include "../higher-level/read-ard-hl.h"
 
 
@@ -45,8 +46,16 @@ typedef struct {
   int ns;        // number of samples
   int nleft;     // number of samples still to do
   int nr;        // number of response variables
+  int *ti, *tj;  // pixel of sample in its tile
+  int ncell;     // number of cells, i.e. chunks of all tiles in extent
+  int *cell;     // offset of each cell in member (ncell+1)
+  int *member;   // samples, bucketed by cell
+  table_writer_t *w_sample;   // writer of sampled features
+  table_writer_t *w_response; // writer of response variables
+  table_writer_t *w_coords;   // writer of coordinates
 } aux_smp_t;
 
+void index_samples(aux_smp_t *smp, par_hl_t *phl, cube_t *cube);
 brick_t **sample_points(ard_t *features, brick_t *mask, int nf, par_hl_t *phl, aux_smp_t *smp, cube_t *cube, int *nproduct);
 
 #ifdef __cplusplus
@@ -0,0 +1,211 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains the spectral adjustment on the GPU. One thread per
+pixel computes the spectral angle to all cluster centers, selects the
+closest clusters and predicts the target reflectance, like spectral_
+predict in spec-adjust-hl.c. The ARD are adjusted in place, in the de-
+vice copy of the processing unit. Without FORCE_CUDA, this file is 
+compiled as C++ and spectral_gpu always cancels.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "spec-adjust-gpu-hl.h"
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define GPU_NTHREAD 256
+
+
+/** Spectral adjustment kernel, one thread per pixel
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+__global__ void spectral_kernel(short *ard, const small *msk, const small *mask, spec_gpu_t job, const double *center, const double *coef){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+int b, b_, s, c;
+double x[_SPECHOMO_N_SRC_];
+double xy, xx, yy, sam;
+double weight[_SPECHOMO_N_CLS_], weight_select[_SPECHOMO_N_SIM_], max_weight;
+int cluster_select[_SPECHOMO_N_SIM_], max_cluster, n_cluster;
+double pred, wpred[_SPECHOMO_N_DST_], wsum;
+
+
+  if (p >= job.nc) return;
+  if (mask != NULL && !mask[p]) return;
+  if (!msk[p]) return;
+
+  for (b=0, xx=0.0; b<_SPECHOMO_N_SRC_; b++){
+    x[b] = ard[job.b_src[b]*job.stride+p];
+    xx += x[b]*x[b];
+  }
+
+  max_weight = -1.0;
+  max_cluster = 0;
+
+  // compute SAM and weight for each cluster
+  for (s=0; s<_SPECHOMO_N_CLS_; s++){
+
+    for (b=0, xy=yy=0.0; b<_SPECHOMO_N_SRC_; b++){
+      xy += x[b] * center[b*_SPECHOMO_N_CLS_+s];
+      yy += center[b*_SPECHOMO_N_CLS_+s] * center[b*_SPECHOMO_N_CLS_+s];
+    }
+
+    if (xx > 0 && yy > 0){
+      sam = xy / sqrt(xx*yy);
+      sam = (sam < _SPECHOMO_POOR_COS_) ? 1.0 : acos(sam);
+    } else {
+      sam = 1.0;
+    }
+
+    if (sam > _SPECHOMO_POOR_SAM_){
+      weight[s] = 0.00001;
+    } else {
+      weight[s] = 1.0 - sam / _SPECHOMO_POOR_SAM_;
+    }
+
+    if (weight[s] > max_weight && 
+        s != _SPECHOMO_N_SIM_-1){
+      max_weight  = weight[s];
+      max_cluster = s;
+    }
+
+  }
+
+  // find closest clusters, fill with global
+  for (c=0; c<_SPECHOMO_N_SIM_; c++){
+
+    cluster_select[c] = _SPECHOMO_N_CLS_-1;
+    weight_select[c]  = weight[_SPECHOMO_N_CLS_-1];
+
+    if (max_weight > _SPECHOMO_MIN_WEIGHT_ ||
+       (max_weight > _SPECHOMO_MED_WEIGHT_ &&
+        max_weight > weight[_SPECHOMO_N_CLS_-1])){
+      cluster_select[c] = max_cluster;
+      weight_select[c]  = max_weight;
+      weight[max_cluster] = 0.0;
+    } else break;
+
+    max_weight = -1.0;
+    for (s=0; s<(_SPECHOMO_N_CLS_-1); s++){
+      if (weight[s] >  max_weight){
+        max_weight  = weight[s];
+        max_cluster = s;
+      }
+    }
+
+  }
+
+  n_cluster = c+1;
+  if (n_cluster > _SPECHOMO_N_SIM_) n_cluster = _SPECHOMO_N_SIM_;
+
+  // weighted average of all close regressors
+  for (b=0; b<_SPECHOMO_N_DST_; b++) wpred[b] = 0.0;
+  wsum = 0.0;
+
+  for (c=0; c<n_cluster; c++){
+
+    s = cluster_select[c];
+
+    for (b=0; b<_SPECHOMO_N_DST_; b++){
+      for (b_=0, pred=0; b_<_SPECHOMO_N_SRC_; b_++){
+        pred += coef[(b*_SPECHOMO_N_COF_+b_)*_SPECHOMO_N_CLS_+s] * x[b_];
+      }
+      pred += coef[(b*_SPECHOMO_N_COF_+b_)*_SPECHOMO_N_CLS_+s]; // offset
+      wpred[b] += weight_select[c]*pred;
+    }
+
+    wsum += weight_select[c];
+
+  }
+
+  for (b=0; b<_SPECHOMO_N_DST_; b++) ard[job.b_dst[b]*job.stride+p] = (short)(wpred[b] / wsum);
+
+  return;
+}
+
+#endif
+
+
+/** This function adjusts one ARD product on the GPU. The cluster centers
++++ and regressors of the sensor are copied to the device, the ARD are 
++++ adjusted in place. The arc cosine of the device may differ from the
++++ host's in the last bit, thus pixels with a spectral angle very close
++++ to a weight threshold may deviate by one integer from the CPU result.
+--- job:    spectral adjustment
+--- stream: stream of the device copy of the ARD
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int spectral_gpu(spec_gpu_t *job, gpu_stream_t stream){
+#ifdef FORCE_CUDA
+cudaStream_t s = (cudaStream_t)gpu_cuda_stream(stream);
+size_t bytes_c, bytes_r;
+double *d_center = NULL, *d_coef = NULL;
+int nblock;
+int error = 0;
+
+
+  if (!gpu_enabled() || gpu_select(stream) == FAILURE) return CANCEL;
+
+  nblock = (job->nc + GPU_NTHREAD - 1) / GPU_NTHREAD;
+
+  bytes_c = _SPECHOMO_N_SRC_*_SPECHOMO_N_CLS_*sizeof(double);
+  bytes_r = _SPECHOMO_N_DST_*_SPECHOMO_N_COF_*_SPECHOMO_N_CLS_*sizeof(double);
+
+  if ((d_center = (double*)gpu_alloc(bytes_c, stream)) == NULL) error++;
+  if ((d_coef   = (double*)gpu_alloc(bytes_r, stream)) == NULL) error++;
+
+  if (!error){
+
+    cudaMemcpyAsync(d_center, job->center, bytes_c, cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_coef,   job->coef,   bytes_r, cudaMemcpyHostToDevice, s);
+
+    spectral_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(
+      job->ard, job->msk, job->mask, *job, d_center, d_coef);
+
+    if (cudaGetLastError() != cudaSuccess){
+      printf("launching spectral adjustment kernel failed. ");
+      error++;
+    }
+
+  }
+
+  if (gpu_sync(stream) == FAILURE) error++;
+
+  gpu_release(d_center, bytes_c, stream);
+  gpu_release(d_coef,   bytes_r, stream);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
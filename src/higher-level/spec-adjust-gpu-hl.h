@@ -0,0 +1,80 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Spectral adjustment on the GPU header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef SPECHOMOGPU_HL_H
+#define SPECHOMOGPU_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/gpu-cl.h"
+
+
+#define _SPECHOMO_N_SEN_  7 // number of sensors that we can homogenize
+#define _SPECHOMO_N_CLS_ 51 // number of clusters, incl. global
+#define _SPECHOMO_N_SRC_  6 // number of source bands
+#define _SPECHOMO_N_DST_ 10 // number of destination bands
+#define _SPECHOMO_N_COF_  7 // number of coefficients
+#define _SPECHOMO_N_SIM_ 10 // max. number of close clusters to be used for kNN
+#define _SPECHOMO_GOOD_SAM_ 0.0698132 // good clusters are closer than this angle (4°)
+#define _SPECHOMO_MEDI_SAM_ 0.2094395 // ok'ish clusters are closer than this angle (12°)
+#define _SPECHOMO_POOR_SAM_ 0.2617995 // clusters further away from this angle (15°) should not be used
+                                      // also used to compute a weight for each cluster
+#define _SPECHOMO_MIN_WEIGHT_ 1.0 - _SPECHOMO_GOOD_SAM_/_SPECHOMO_POOR_SAM_
+#define _SPECHOMO_MED_WEIGHT_ 1.0 - _SPECHOMO_MEDI_SAM_/_SPECHOMO_POOR_SAM_
+
+// cosine below which a cluster is surely further away than the poor angle,
+// i.e. the arc cosine does not need to be computed
+#define _SPECHOMO_POOR_COS_ (0.96592580-1e-7)
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// spectral adjustment of one ARD product on the device
+typedef struct {
+  int nc;                           // number of cells
+  size_t stride;                    // cells per band in device arrays
+  short *ard;                       // ARD band slab, adjusted in place
+  const small *msk;                 // ARD mask
+  const small *mask;                // processing mask (optional)
+  int b_src[_SPECHOMO_N_SRC_];      // source bands
+  int b_dst[_SPECHOMO_N_DST_];      // destination bands
+  const double *center;             // cluster centers [src][cls] (host)
+  const double *coef;               // regressors [dst][cof][cls] (host)
+} spec_gpu_t;
+
+int spectral_gpu(spec_gpu_t *job, gpu_stream_t stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
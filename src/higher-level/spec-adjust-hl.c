@@ -33,20 +33,10 @@ https://doi.org/10.1016/j.rse.2020.111723
 #include "spec-adjust-hl.h"
 
 
-int spectral_predict(ard_t ard, small *mask_, int nc, int sid);
+#define SPECHOMO_BLOCK 64 // pixels per block in spectral_predict
 
-#define _SPECHOMO_N_SEN_  7 // number of sensors that we can homogenize
-#define _SPECHOMO_N_CLS_ 51 // number of clusters, incl. global
-#define _SPECHOMO_N_SRC_  6 // number of source bands
-#define _SPECHOMO_N_DST_ 10 // number of destination bands
-#define _SPECHOMO_N_COF_  7 // number of coefficients
-#define _SPECHOMO_N_SIM_ 10 // max. number of close clusters to be used for kNN
-#define _SPECHOMO_GOOD_SAM_ 0.0698132 // good clusters are closer than this angle (4°)
-#define _SPECHOMO_MEDI_SAM_ 0.2094395 // ok'ish clusters are closer than this angle (12°)
-#define _SPECHOMO_POOR_SAM_ 0.2617995 // clusters further away from this angle (15°) should not be used
-                                      // also used to compute a weight for each cluster
-#define _SPECHOMO_MIN_WEIGHT_ 1.0 - _SPECHOMO_GOOD_SAM_/_SPECHOMO_POOR_SAM_
-#define _SPECHOMO_MED_WEIGHT_ 1.0 - _SPECHOMO_MEDI_SAM_/_SPECHOMO_POOR_SAM_
+int spectral_predict(ard_t ard, small *mask_, int nc, int sid);
+int spectral_predict_gpu(ard_t ard, gpu_brick_t *mask, int nc, int sid);
 
 const char _SPECHOMO_SENSOR_[_SPECHOMO_N_SEN_][NPOW_04] = {
   "LND04", "LND05", "LND07", "LND08", "LND09", "MOD01", "MOD02" };
@@ -766,7 +756,13 @@ const double _SPECHOMO_COEFS_[_SPECHOMO_N_SEN_][_SPECHOMO_N_DST_][_SPECHOMO_N_CO
 
 
 /** This function performs spectral adjustment to Sentinel-2 using the 
-+++ Scheffler 2020 method
++++ Scheffler 2020 method. The pixels are processed in blocks. Only pix-
++++ els that pass the QAI and processing masks are gathered into a block.
++++ The spectral angles to the cluster centers are computed for all pix-
++++ els of a block in one SIMD loop per cluster. The arc cosine is only 
++++ evaluated if the angle may be closer than the poor angle, as the 
++++ weight is constant beyond. Selection and prediction remain per pixel,
++++ with the same operations as before, i.e. the results are identical.
 --- ard:       ARD image (single time step)
 --- mask:      mask image
 --- nc:        number of pixels
@@ -774,11 +770,17 @@ const double _SPECHOMO_COEFS_[_SPECHOMO_N_SEN_][_SPECHOMO_N_DST_][_SPECHOMO_N_CO
 +++ Return:    SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int spectral_predict(ard_t ard, small *mask_, int nc, int sid){
-int b, b_, p, s, c;
+int b, b_, i, k, n, p, s, c;
 int b_src[_SPECHOMO_N_SRC_];
 int b_dst[_SPECHOMO_N_DST_];
-double xy, xx, yy, sam;
-double weight[_SPECHOMO_N_CLS_], weight_select[_SPECHOMO_N_SIM_], max_weight;
+int nblock;
+double center[_SPECHOMO_N_SRC_][_SPECHOMO_N_CLS_], yy[_SPECHOMO_N_CLS_];
+const double (*coef)[_SPECHOMO_N_COF_][_SPECHOMO_N_CLS_] = _SPECHOMO_COEFS_[sid];
+int pix[SPECHOMO_BLOCK];
+double x[_SPECHOMO_N_SRC_][SPECHOMO_BLOCK], xx[SPECHOMO_BLOCK];
+double weight[_SPECHOMO_N_CLS_][SPECHOMO_BLOCK];
+double xy, sam;
+double weight_select[_SPECHOMO_N_SIM_], max_weight;
 int cluster_select[_SPECHOMO_N_SIM_], max_cluster, n_cluster;
 double pred, wpred[_SPECHOMO_N_DST_], wsum;
 
@@ -799,175 +801,245 @@ double pred, wpred[_SPECHOMO_N_DST_], wsum;
     }
   }
 
-  // attention: removed default(none) for gcc back-compatibility (https://gcc.gnu.org/gcc-9/porting_to.html#ompdatasharing)
-  // adding _SPECHOMO_CENTER_ and _SPECHOMO_COEFS_ to the firstprivate clause was no option as the build time and executables increased substantially
-  // if something goes wrong, this might be a good place to start looking!
-  // if you change something in the parallel block below, it is advised to temporarily add the default(none) and firstprivate clauses
-  #pragma omp parallel private(s,c,b,b_,weight,weight_select,cluster_select,max_weight,max_cluster,n_cluster,xy,xx,yy,sam,wpred,wsum,pred) shared(ard,mask_,nc,b_src,b_dst,sid) // default(none)
+  // cluster centers and their squared norm, once per sensor
+  for (s=0; s<_SPECHOMO_N_CLS_; s++){
+    for (b=0, yy[s]=0.0; b<_SPECHOMO_N_SRC_; b++){
+      center[b][s] = _SPECHOMO_CENTER_[sid][b][s];
+      yy[s] += center[b][s] * center[b][s];
+    }
+  }
+
+  nblock = (nc + SPECHOMO_BLOCK - 1) / SPECHOMO_BLOCK;
+
+
+  #pragma omp parallel private(i,n,p,s,c,b,b_,pix,x,xx,weight,weight_select,cluster_select,max_weight,max_cluster,n_cluster,xy,sam,wpred,wsum,pred) shared(ard,mask_,nc,nblock,b_src,b_dst,center,yy,coef) default(none)
   {
 
-    #pragma omp for
-    for (p=0; p<nc; p++){
+    #pragma omp for schedule(dynamic)
+    for (k=0; k<nblock; k++){
+
+      // gather the pixels that pass both masks
+      for (p=k*SPECHOMO_BLOCK, n=0; p<nc && p<(k+1)*SPECHOMO_BLOCK; p++){
+        if (mask_ != NULL && !mask_[p]) continue;
+        if (!ard.msk[p]) continue;
+        pix[n++] = p;
+      }
+
+      if (n == 0) continue;
 
-      if (mask_ != NULL && !mask_[p]) continue;
-      if (!ard.msk[p]) continue;
+      for (b=0; b<_SPECHOMO_N_SRC_; b++){
+        for (i=0; i<n; i++) x[b][i] = ard.dat[b_src[b]][pix[i]];
+      }
+
+      for (i=0; i<n; i++) xx[i] = 0.0;
+      for (b=0; b<_SPECHOMO_N_SRC_; b++){
+        #pragma omp simd
+        for (i=0; i<n; i++) xx[i] += x[b][i] * x[b][i];
+      }
 
-      memset(weight,         0, _SPECHOMO_N_CLS_*sizeof(double));
-      memset(weight_select,  0, _SPECHOMO_N_SIM_*sizeof(double));
-      memset(cluster_select, 0, _SPECHOMO_N_SIM_*sizeof(int));
-      max_weight = -1.0;
-      max_cluster = 0;
 
-      // compute SAM and weight for each cluster
+      // cosine of SAM to each cluster center
       for (s=0; s<_SPECHOMO_N_CLS_; s++){
 
-        // SAM to each cluster center
-        xy = xx = yy = 0.0;
+        #pragma omp simd private(b,xy)
+        for (i=0; i<n; i++){
 
-        for (b=0; b<_SPECHOMO_N_SRC_; b++){
-          xy += ard.dat[b_src[b]][p]         * _SPECHOMO_CENTER_[sid][b][s];
-          xx += ard.dat[b_src[b]][p]         * ard.dat[b_src[b]][p];
-          yy += _SPECHOMO_CENTER_[sid][b][s] * _SPECHOMO_CENTER_[sid][b][s];
-        }
+          for (b=0, xy=0.0; b<_SPECHOMO_N_SRC_; b++) xy += x[b][i] * center[b][s];
+
+          if (xx[i] > 0 && yy[s] > 0){
+            weight[s][i] = xy / sqrt(xx[i]*yy[s]);
+          } else {
+            weight[s][i] = -1.0;
+          }
 
-        if (xx > 0 && yy > 0){
-          sam = acos(xy / sqrt(xx*yy));
-        } else {
-          sam = 1.0;
         }
 
-        // weight for each cluster center
-        // not exactly as in the paper, pragmatic suggestion by D. Scheffler
-        if (sam > _SPECHOMO_POOR_SAM_){
-          weight[s] = 0.00001;
-        } else {
-          weight[s] = 1.0 - sam / _SPECHOMO_POOR_SAM_;
+      }
+
+      // weight for each cluster center
+      // not exactly as in the paper, pragmatic suggestion by D. Scheffler
+      for (s=0; s<_SPECHOMO_N_CLS_; s++){
+        for (i=0; i<n; i++){
+
+          sam = (weight[s][i] < _SPECHOMO_POOR_COS_) ? 1.0 : acos(weight[s][i]);
+
+          if (sam > _SPECHOMO_POOR_SAM_){
+            weight[s][i] = 0.00001;
+          } else {
+            weight[s][i] = 1.0 - sam / _SPECHOMO_POOR_SAM_;
+          }
+
         }
+      }
 
-        #ifdef FORCE_DEBUG
-        printf("\n");
-        printf("on/off: %d\n", ard.msk[p]);
-        printf("cluster number: %d\n", s);
-        printf("ard: ");
-        for (b=0; b<_SPECHOMO_N_SRC_; b++) printf("%05d ", ard.dat[b_src[b]][p]);
-        printf("\n");
-        printf("lib: ");
-        for (b=0; b<_SPECHOMO_N_SRC_; b++) printf("%05d ", _SPECHOMO_CENTER_[sid][b][s]);
-        printf("\n");
-        printf("xx: %.2f, yy: %.2f, xy: %.2f, sam: %.8f, sam_deg: %.8f, weight: %.8f\n", xx, yy, xy, sam, sam*_R2D_CONV_, weight[s]);
-        #endif
+
+      for (i=0; i<n; i++){
+
+        p = pix[i];
+
+        memset(weight_select,  0, _SPECHOMO_N_SIM_*sizeof(double));
+        memset(cluster_select, 0, _SPECHOMO_N_SIM_*sizeof(int));
 
         // maximum weight of close clusters (-1 if no close cluster)
-        if (weight[s] > max_weight && 
-            s != _SPECHOMO_N_SIM_-1){
+        max_weight = -1.0;
+        max_cluster = 0;
 
-          max_weight  = weight[s];
-          max_cluster = s;
+        for (s=0; s<_SPECHOMO_N_CLS_; s++){
+          if (weight[s][i] > max_weight && 
+              s != _SPECHOMO_N_SIM_-1){
+            max_weight  = weight[s][i];
+            max_cluster = s;
+          }
+        }
+
+        // find closest clusters, fill with global
+        for (c=0; c<_SPECHOMO_N_SIM_; c++){
+
+          // init with global cluster
+          cluster_select[c] = _SPECHOMO_N_CLS_-1;
+          weight_select[c]  = weight[_SPECHOMO_N_CLS_-1][i];
+
+          if (max_weight > _SPECHOMO_MIN_WEIGHT_ ||
+             (max_weight > _SPECHOMO_MED_WEIGHT_ &&
+              max_weight > weight[_SPECHOMO_N_CLS_-1][i])){
+          
+            // copy closest cluster
+            cluster_select[c] = max_cluster;
+            weight_select[c]  = max_weight;
+
+            // remove weight from closest cluster
+            weight[max_cluster][i] = 0.0;
+
+          } else break;
+
+          // find the next closest cluster
+          max_weight = -1.0;
+          for (s=0; s<(_SPECHOMO_N_CLS_-1); s++){
+            if (weight[s][i] > max_weight){
+              max_weight  = weight[s][i];
+              max_cluster = s;
+            }
+          }
 
         }
 
+        // number of close clusters
+        n_cluster = c+1;
+        if (n_cluster > _SPECHOMO_N_SIM_) n_cluster = _SPECHOMO_N_SIM_;
+
         #ifdef FORCE_DEBUG
-        printf("max_weight: %.5f, max_cluster: %02d\n", max_weight, max_cluster);
+        printf("found %d clusters\n", n_cluster);
+        print_ivector(cluster_select, "cluster", _SPECHOMO_N_SIM_, 8);
+        print_dvector(weight_select,  "weights", _SPECHOMO_N_SIM_, 2, 5);
         #endif
 
-      }
+        // predict the target reflectance by using a weighted average of 
+        // all close regressors
 
-      #ifdef FORCE_DEBUG
-      print_dvector(weight,  "all weights", _SPECHOMO_N_CLS_, 2, 5);
-      #endif
+        memset(wpred, 0, _SPECHOMO_N_DST_*sizeof(double));
+        wsum = 0.0;
 
+        for (c=0; c<n_cluster; c++){
 
-      n_cluster = 0;
+          s = cluster_select[c];
 
-      // find closest clusters, fill with global
-      for (c=0; c<_SPECHOMO_N_SIM_; c++){
+          for (b=0;  b <_SPECHOMO_N_DST_; b++){
 
-        // init with global cluster
-        cluster_select[c] = _SPECHOMO_N_CLS_-1;
-        weight_select[c]  = weight[_SPECHOMO_N_CLS_-1];
+            for (b_=0, pred=0; b_<_SPECHOMO_N_SRC_; b_++){
+              pred += coef[b][b_][s] * x[b_][i];
+            }
+            pred += coef[b][b_][s]; // offset
 
-        if (max_weight > _SPECHOMO_MIN_WEIGHT_ ||
-           (max_weight > _SPECHOMO_MED_WEIGHT_ &&
-            max_weight > weight[_SPECHOMO_N_CLS_-1])){
-        
-          // copy closest cluster
-          cluster_select[c] = max_cluster;
-          weight_select[c]  = max_weight;
+            wpred[b] += weight_select[c]*pred;
 
-          // remove weight from closest cluster
-          weight[max_cluster] = 0.0;
+          }
 
-        } else break;
+          wsum += weight_select[c];
 
-        // find the next closest cluster
-        max_weight = -1.0;
-        for (s=0; s<(_SPECHOMO_N_CLS_-1); s++){
-          if (weight[s] >  max_weight){
-            max_weight  = weight[s];
-            max_cluster = s;
-          }
         }
 
+        for (b=0; b <_SPECHOMO_N_DST_; b++) ard.dat[b_dst[b]][p] = (short)(wpred[b] / wsum);
+
       }
 
-      // number of close clusters
-      n_cluster = c+1;
-      if (n_cluster > _SPECHOMO_N_SIM_) n_cluster = _SPECHOMO_N_SIM_;
+    }
 
-      #ifdef FORCE_DEBUG
-      printf("found %d clusters\n", n_cluster);
-      print_ivector(cluster_select, "cluster", _SPECHOMO_N_SIM_, 8);
-      print_dvector(weight_select,  "weights", _SPECHOMO_N_SIM_, 2, 5);
-      #endif
-      
-      // predict the target reflectance by using a weighted average of 
-      // all close regressors
+  }
 
-      memset(wpred, 0, _SPECHOMO_N_DST_*sizeof(double));
-      wsum = 0.0;
+  return SUCCESS;
+}
 
-      for (c=0; c<n_cluster; c++){
 
-        s = cluster_select[c];
+/** This function performs spectral adjustment to Sentinel-2 on the GPU.
++++ The device copy of the ARD is adjusted in place, and copied back to 
++++ the host, such that both copies hold the adjusted data.
+--- ard:       ARD image (single time step)
+--- mask:      device copy of mask image (optional)
+--- nc:        number of pixels
+--- sid:       sensor ID
++++ Return:    SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int spectral_predict_gpu(ard_t ard, gpu_brick_t *mask, int nc, int sid){
+int b, s;
+spec_gpu_t job;
+gpu_brick_t *MSK = NULL;
+gpu_stream_t stream = NULL;
+double center[_SPECHOMO_N_SRC_][_SPECHOMO_N_CLS_];
+int status = SUCCESS;
 
-        for (b=0;  b <_SPECHOMO_N_DST_; b++){
 
-          for (b_=0, pred=0; b_<_SPECHOMO_N_SRC_; b_++){
-            pred += _SPECHOMO_COEFS_[sid][b][b_][s] * ard.dat[b_src[b_]][p];
-          }
-          pred += _SPECHOMO_COEFS_[sid][b][b_][s]; // offset
+  if (ard.GPU == NULL || ard.MSK == NULL) return CANCEL;
 
-          wpred[b] += weight_select[c]*pred;
+  memset(&job, 0, sizeof(spec_gpu_t));
+  job.nc     = nc;
+  job.stride = get_brick_stride(ard.DAT);
 
-        }
+  for (b=0; b<_SPECHOMO_N_SRC_; b++){
+    if ((job.b_src[b] = find_domain(ard.DAT, _SPECHOMO_SRC_DOMAIN_[b])) < 0) return CANCEL;
+  }
 
-        wsum += weight_select[c];
+  for (b=0; b<_SPECHOMO_N_DST_; b++){
+    if ((job.b_dst[b] = find_domain(ard.DAT, _SPECHOMO_DST_DOMAIN_[b])) < 0) return CANCEL;
+  }
 
-      }
+  for (b=0; b<_SPECHOMO_N_SRC_; b++){
+    for (s=0; s<_SPECHOMO_N_CLS_; s++) center[b][s] = _SPECHOMO_CENTER_[sid][b][s];
+  }
 
+  job.center = center[0];
+  job.coef   = _SPECHOMO_COEFS_[sid][0][0];
 
-      #ifdef FORCE_DEBUG
-      printf("using %d regressors\n", n_cluster);
-      printf("reflectance before:");
-      for (b=0; b<_SPECHOMO_N_DST_; b++) printf(" %04d", ard.dat[b_dst[b]][p]); 
-      printf("\n");
-      printf("reflectance after: ");
-      for (b=0; b<_SPECHOMO_N_DST_; b++) printf(" %04d", (short)(wpred[b] / wsum));
-      printf("\n");
-      //ard.dat[0][p] = n_cluster;
-      #endif
 
-      for (b=0; b <_SPECHOMO_N_DST_; b++) ard.dat[b_dst[b]][p] = (short)(wpred[b] / wsum);
+  // the mask is final after screening, copy it in the ARD stream
+  stream = ard.GPU->stream;
 
-    }
+  if ((MSK = allocate_gpu_brick(ard.MSK, stream)) == NULL ||
+      upload_brick(ard.MSK, MSK) == FAILURE){
+    gpu_sync(stream);
+    free_gpu_brick(MSK);
+    return CANCEL;
+  }
+
+  job.ard  = (short*)get_gpu_band(ard.GPU, 0);
+  job.msk  = (const small*)get_gpu_band(MSK, 0);
+  job.mask = (mask != NULL) ? (const small*)get_gpu_band(mask, 0) : NULL;
 
+  if ((status = spectral_gpu(&job, stream)) == SUCCESS){
+    if (download_brick(ard.GPU, ard.DAT) == FAILURE) status = FAILURE;
   }
 
-  return SUCCESS;
-};
+  if (gpu_sync(stream) == FAILURE) status = FAILURE;
+
+  free_gpu_brick(MSK);
+
+  return status;
+}
 
 
-/** This function performs spectral adjustment to Sentinel-2
+/** This function performs spectral adjustment to Sentinel-2. If the ARD
++++ were copied to the GPU, they are adjusted on the device. Otherwise, 
++++ or if this is not possible, they are adjusted on the host, and the
++++ device copy is refreshed.
 --- ard:       ARD
 --- mask:      mask image
 --- nt:        number of ARD products over time
@@ -979,6 +1051,8 @@ int t, s, nc;
 char sensor[NPOW_04];
 bool adjust = false;
 small *mask_ = NULL;
+gpu_brick_t *GMASK = NULL;
+int status = SUCCESS;
 
 
   if (!phl->sen.spec_adjust) return CANCEL;
@@ -995,7 +1069,7 @@ small *mask_ = NULL;
   nc = get_brick_chunkncells(ard[0].DAT);
 
   // for each time step
-  for (t=0; t<nt; t++){
+  for (t=0; t<nt && status != FAILURE; t++){
 
     get_brick_sensor(ard[t].DAT, 0, sensor, NPOW_04);
 
@@ -1013,12 +1087,35 @@ small *mask_ = NULL;
 
     if (!adjust) continue;
 
-    // perform the adjustment
-    if (spectral_predict(ard[t], mask_, nc, s) == FAILURE){
-      printf("failed to compute spectral prediction. "); return FAILURE;}
+    // copy the processing mask to the device once
+    if (ard[t].GPU != NULL && mask != NULL && GMASK == NULL){
+      if ((GMASK = allocate_gpu_brick(mask, ard[t].GPU->stream)) == NULL ||
+          upload_brick(mask, GMASK) == FAILURE){
+        gpu_sync(ard[t].GPU->stream);
+        free_gpu_brick(GMASK);
+        GMASK = NULL;
+      }
+    }
+
+    // perform the adjustment, on the device if possible
+    if (ard[t].GPU == NULL || (mask != NULL && GMASK == NULL) ||
+       (status = spectral_predict_gpu(ard[t], GMASK, nc, s)) == CANCEL){
+
+      if ((status = spectral_predict(ard[t], mask_, nc, s)) == FAILURE) break;
+
+      if (ard[t].GPU != NULL){
+        upload_brick(ard[t].DAT, ard[t].GPU);
+        gpu_sync(ard[t].GPU->stream);
+      }
+
+    }
 
   }
 
+  free_gpu_brick(GMASK);
+
+  if (status == FAILURE){
+    printf("failed to compute spectral prediction. "); return FAILURE;}
 
   return SUCCESS;
 }
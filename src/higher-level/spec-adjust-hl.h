@@ -36,6 +36,7 @@ Spectral adjustment header
 #include "../cross-level/cite-cl.h"
 #include "../higher-level/param-hl.h"
 #include "../higher-level/read-ard-hl.h"
+#include "../higher-level/spec-adjust-gpu-hl.h"
 
 
 #ifdef __cplusplus
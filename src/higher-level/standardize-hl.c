@@ -31,7 +31,13 @@ This file contains functions for standardizing time series
 int standardize_timeseries(short **ts_, small *mask_, int nc, int nt, short nodata, int method);
 
 
-/** This function standardizes a specific time series
+/** This function standardizes a specific time series. STD_LANES pixels 
++++ are standardized together, such that both passes vectorize across 
++++ pixels. Mean and variance are accumulated in one pass with the recur-
++++ rence formula; the first valid value of each pixel yields the same 
++++ mean and variance as the explicit initialization, i.e. the results do
++++ not depend on the number of lanes. The second pass reads the series 
++++ of the lanes while they are still cached.
 --- ts_:    image array
 --- mask:   mask image
 --- nc:     number of cells
@@ -41,53 +47,70 @@ int standardize_timeseries(short **ts_, small *mask_, int nc, int nt, short noda
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int standardize_timeseries(short **ts_, small *mask_, int nc, int nt, short nodata, int method){
-double avg, var, std = 1.0, k, tmp;
-int t, p;
+int t, l, nl, p0;
+short *y_ = NULL;
+double avg[STD_LANES], var[STD_LANES], k[STD_LANES], std[STD_LANES];
+bool use[STD_LANES];
+double d, tmp;
 
 
   if (method == _STD_NONE_) return SUCCESS;
   
   
-  #pragma omp parallel private(t,avg,var,k,tmp) firstprivate(std) shared(mask_,ts_,nt,nc,nodata,method) default(none)
+  #pragma omp parallel private(t,l,nl,y_,avg,var,k,std,use,d,tmp) shared(mask_,ts_,nt,nc,nodata,method) default(none)
   {
 
     #pragma omp for
-    for (p=0; p<nc; p++){
+    for (p0=0; p0<nc; p0+=STD_LANES){
 
-      if (mask_ != NULL && !mask_[p]) continue;
+      nl = (nc-p0 < STD_LANES) ? nc-p0 : STD_LANES;
 
-      avg = var = k = 0.0;
+      for (l=0; l<nl; l++) avg[l] = var[l] = k[l] = 0.0;
 
       // compute stats
       for (t=0; t<nt; t++){
-        
-        if (ts_[t][p] == nodata) continue;
-        
-        k++;
-        if (k == 1){
-          avg = ts_[t][p];
-        } else {
-          var_recurrence(ts_[t][p], &avg, &var, k);
+
+        y_ = ts_[t] + p0;
+
+        #pragma omp simd private(d)
+        for (l=0; l<nl; l++){
+          if (y_[l] != nodata){
+            k[l]++;
+            d = y_[l] - avg[l];
+            avg[l] += d / k[l];
+            var[l] += d * (y_[l] - avg[l]);
+          }
         }
 
       }
 
-      if (k < 2) continue;
+      for (l=0; l<nl; l++){
 
+        use[l] = (mask_ == NULL || mask_[p0+l]) && k[l] >= 2;
 
-      if (method == _STD_NORMAL_) std = standdev(var, k)/10000; // scale
+        if (use[l] && method == _STD_NORMAL_){
+          std[l] = standdev(var[l], k[l])/10000; // scale
+        } else {
+          std[l] = 1.0;
+        }
 
+      }
 
 
       // center or standardize time series
       for (t=0; t<nt; t++){
-        
-        if (ts_[t][p] == nodata) continue;
 
-        tmp = (ts_[t][p] - avg) / std;
-        if (tmp > SHRT_MAX) tmp = SHRT_MAX;
-        if (tmp < SHRT_MIN) tmp = SHRT_MIN;
-        ts_[t][p] = (short)tmp;;
+        y_ = ts_[t] + p0;
+
+        #pragma omp simd private(tmp)
+        for (l=0; l<nl; l++){
+          if (use[l] && y_[l] != nodata){
+            tmp = (y_[l] - avg[l]) / std[l];
+            if (tmp > SHRT_MAX) tmp = SHRT_MAX;
+            if (tmp < SHRT_MIN) tmp = SHRT_MIN;
+            y_[l] = (short)tmp;
+          }
+        }
 
       }
 
@@ -35,6 +35,10 @@ Standardizing time series header
 #include "../higher-level/tsa-hl.h"
 
 
+// number of pixels that are standardized together (SIMD lanes)
+#define STD_LANES 64
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -28,6 +28,102 @@ This file contains functions for spectral temporal metrics
 #include "stm-hl.h"
 
 
+int stm_quantiles(par_stm_t *stm, float **p_, int **pos_, int *p25, int *p75);
+void stm_moments(short **stm_, int p, int n, short minimum, short maximum, double mean, double var, double skew, double kurt, par_sta_t *sta);
+
+
+/** This function collects all quantiles that are needed for the STM, in-
++++ cluding the quartiles for the IQR, as one ascending list of unique 
++++ probabilities, such that they can be computed in one pass.
+--- stm:    STM parameters
+--- p_:     probabilities (returned)
+--- pos_:   position of each requested quantile in p_ (returned)
+--- p25:    position of the 1st quartile in p_ (returned, -1 if not needed)
+--- p75:    position of the 3rd quartile in p_ (returned, -1 if not needed)
++++ Return: number of probabilities
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int stm_quantiles(par_stm_t *stm, float **p_, int **pos_, int *p25, int *p75){
+float *p = NULL, tmp;
+int *pos = NULL;
+int q, i, j, np = 0;
+
+
+  alloc((void**)&p,   stm->sta.nquantiles+2, sizeof(float));
+  alloc((void**)&pos, stm->sta.nquantiles,   sizeof(int));
+
+  if (stm->sta.quantiles){
+    for (q=0; q<stm->sta.nquantiles; q++) p[np++] = stm->sta.q[q];
+  }
+
+  if (stm->sta.iqr > -1){
+    p[np++] = 0.25;
+    p[np++] = 0.75;
+  }
+
+  // sort, and remove duplicates
+  for (i=1; i<np; i++){
+    for (j=i; j>0 && p[j-1] > p[j]; j--){ tmp = p[j-1]; p[j-1] = p[j]; p[j] = tmp;}
+  }
+
+  for (i=1, j=0; i<np; i++){
+    if (p[i] != p[j]) p[++j] = p[i];
+  }
+  if (np > 0) np = j+1;
+
+  *p25 = *p75 = -1;
+
+  for (i=0; i<np; i++){
+    if (stm->sta.quantiles){
+      for (q=0; q<stm->sta.nquantiles; q++){
+        if (stm->sta.q[q] == p[i]) pos[q] = i;
+      }
+    }
+    if (stm->sta.iqr > -1 && p[i] == (float)0.25) *p25 = i;
+    if (stm->sta.iqr > -1 && p[i] == (float)0.75) *p75 = i;
+  }
+
+  *p_ = p;
+  *pos_ = pos;
+  return np;
+}
+
+
+/** This function writes the range and moments metrics of one pixel
+--- stm_:    STM image array
+--- p:       pixel
+--- n:       number of observations (> 0)
+--- minimum: minimum
+--- maximum: maximum
+--- mean:    recurrence mean
+--- var:     recurrence variance
+--- skew:    recurrence skewness
+--- kurt:    recurrence kurtosis
+--- sta:     statistics parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void stm_moments(short **stm_, int p, int n, short minimum, short maximum, double mean, double var, double skew, double kurt, par_sta_t *sta){
+double skewscaled, kurtscaled;
+
+
+  skewscaled = skewness(var, skew, n)*1000;
+  kurtscaled = (kurtosis(var, kurt, n)-3)*1000;
+  if (skewscaled < -30000) skewscaled = -30000;
+  if (skewscaled >  30000) skewscaled =  30000;
+  if (kurtscaled < -30000) kurtscaled = -30000;
+  if (kurtscaled >  30000) kurtscaled =  30000;
+  if (sta->num > -1) stm_[sta->num][p] = n;
+  if (sta->min > -1) stm_[sta->min][p] = minimum;
+  if (sta->max > -1) stm_[sta->max][p] = maximum;
+  if (sta->rng > -1) stm_[sta->rng][p] = maximum-minimum;
+  if (sta->avg > -1) stm_[sta->avg][p] = (short)mean;
+  if (sta->std > -1) stm_[sta->std][p] = (short)standdev(var, n);
+  if (sta->skw > -1) stm_[sta->skw][p] = (short)skewscaled;
+  if (sta->krt > -1) stm_[sta->krt][p] = (short)kurtscaled;
+
+  return;
+}
+
+
 /** public functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
@@ -44,11 +140,12 @@ This file contains functions for spectral temporal metrics
 int tsa_stm(tsa_t *ts, small *mask_, int nc, int ni, short nodata, par_stm_t *stm){
 int t, b, n, p, q;
 short minimum, maximum;
-short q25_, q75_;
 double mean, var;
 double skew, kurt;
-double skewscaled, kurtscaled;
-float *q_array = NULL;
+float *q_array = NULL, *q_value = NULL;
+float *q_prob = NULL;
+int *q_pos = NULL, *hist = NULL;
+int nq = 0, q25, q75;
 bool alloc_q_array = false;
 
 
@@ -58,12 +155,19 @@ bool alloc_q_array = false;
   
   if (stm->sta.quantiles || stm->sta.iqr > -1) alloc_q_array = true;
   
+  // all quantiles are computed together
+  if (alloc_q_array) nq = stm_quantiles(stm, &q_prob, &q_pos, &q25, &q75);
 
-  #pragma omp parallel private(t,b,minimum,maximum,q,q_array,mean,var,skew,kurt,n,skewscaled,kurtscaled,q25_,q75_) shared(mask_,ts,nc,ni,nodata,stm,alloc_q_array) default(none)
+
+  #pragma omp parallel private(t,b,minimum,maximum,q,q_array,q_value,hist,mean,var,skew,kurt,n) shared(mask_,ts,nc,ni,nodata,stm,alloc_q_array,nq,q_prob,q_pos,q25,q75) default(none)
   {
 
     // initialize stats
-    if (alloc_q_array) alloc((void**)&q_array, ni, sizeof(float));
+    if (alloc_q_array){
+      alloc((void**)&q_array, ni, sizeof(float));
+      alloc((void**)&q_value, nq, sizeof(float));
+      alloc((void**)&hist, USHRT_MAX+1, sizeof(int));
+    }
 
     #pragma omp for
     for (p=0; p<nc; p++){
@@ -75,56 +179,48 @@ bool alloc_q_array = false;
 
       mean = var = skew = kurt = n = 0;
       minimum = SHRT_MAX; maximum = SHRT_MIN;
-      q25_ = q75_ = SHRT_MIN;
 
       for (t=0; t<ni; t++){
 
-        if (ts->tsi_[t][p] == nodata) continue;
+        if (ts->tsi_pm[(size_t)p*ni+t] == nodata) continue;
 
         // range metrics
-        if (ts->tsi_[t][p] < minimum) minimum = ts->tsi_[t][p];
-        if (ts->tsi_[t][p] > maximum) maximum = ts->tsi_[t][p];
+        if (ts->tsi_pm[(size_t)p*ni+t] < minimum) minimum = ts->tsi_pm[(size_t)p*ni+t];
+        if (ts->tsi_pm[(size_t)p*ni+t] > maximum) maximum = ts->tsi_pm[(size_t)p*ni+t];
 
         // quantile metrics
-        if (alloc_q_array) q_array[n] = ts->tsi_[t][p];
+        if (alloc_q_array) q_array[n] = ts->tsi_pm[(size_t)p*ni+t];
 
         n++;
 
         // moments metrics
-        kurt_recurrence(ts->tsi_[t][p], &mean, &var, 
+        kurt_recurrence(ts->tsi_pm[(size_t)p*ni+t], &mean, &var, 
                           &skew, &kurt, n);
 
       }
 
   
       if (n > 0){
-        skewscaled = skewness(var, skew, n)*1000;
-        kurtscaled = (kurtosis(var, kurt, n)-3)*1000;
-        if (skewscaled < -30000) skewscaled = -30000;
-        if (skewscaled >  30000) skewscaled =  30000;
-        if (kurtscaled < -30000) kurtscaled = -30000;
-        if (kurtscaled >  30000) kurtscaled =  30000;
-        if (stm->sta.num > -1) ts->stm_[stm->sta.num][p] = n;
-        if (stm->sta.min > -1) ts->stm_[stm->sta.min][p] = minimum;
-        if (stm->sta.max > -1) ts->stm_[stm->sta.max][p] = maximum;
-        if (stm->sta.rng > -1) ts->stm_[stm->sta.rng][p] = maximum-minimum;
-        if (stm->sta.avg > -1) ts->stm_[stm->sta.avg][p] = (short)mean;
-        if (stm->sta.std > -1) ts->stm_[stm->sta.std][p] = (short)standdev(var, n);
-        if (stm->sta.skw > -1) ts->stm_[stm->sta.skw][p] = (short)skewscaled;
-        if (stm->sta.krt > -1) ts->stm_[stm->sta.krt][p] = (short)kurtscaled;
+        stm_moments(ts->stm_, p, n, minimum, maximum, mean, var, skew, kurt, &stm->sta);
+
+        // quantiles from histogram if the value range is small
+        if (alloc_q_array){
+          if (maximum-minimum < STM_HIST_RANGE*n){
+            for (t=0; t<n; t++) hist[(int)q_array[t]-SHRT_MIN]++;
+            quantiles_hist(hist, minimum, maximum, n, q_prob, nq, q_value);
+          } else {
+            quantiles(q_array, n, q_prob, nq, q_value);
+          }
+        }
 
         if (stm->sta.quantiles){
           for (q=0; q<stm->sta.nquantiles; q++){
-            ts->stm_[stm->sta.qxx[q]][p] = (short)quantile(q_array, n, stm->sta.q[q]);
-            if (stm->sta.q[q] == 0.25) q25_ = ts->stm_[stm->sta.qxx[q]][p];
-            if (stm->sta.q[q] == 0.75) q75_ = ts->stm_[stm->sta.qxx[q]][p];
+            ts->stm_[stm->sta.qxx[q]][p] = (short)q_value[q_pos[q]];
           }
         }
 
         if (stm->sta.iqr > -1){
-          if (q25_ == SHRT_MIN) q25_ = (short)quantile(q_array, n, 0.25);
-          if (q75_ == SHRT_MIN) q75_ = (short)quantile(q_array, n, 0.75);
-          ts->stm_[stm->sta.iqr][p] = q75_-q25_;
+          ts->stm_[stm->sta.iqr][p] = (short)q_value[q75]-(short)q_value[q25];
         }
       } else {
         for (b=0; b<stm->sta.nmetrics; b++) ts->stm_[b][p] = nodata;
@@ -132,10 +228,134 @@ bool alloc_q_array = false;
       
     }
 
-    if (alloc_q_array) free((void*)q_array);
+    if (alloc_q_array){
+      free((void*)q_array);
+      free((void*)q_value);
+      free((void*)hist);
+    }
     
   }
 
+  if (alloc_q_array){
+    free((void*)q_prob);
+    free((void*)q_pos);
+  }
+
   return SUCCESS;
 }
 
+
+/** This function initializes running statistics
+--- acc:    running statistics
+--- n:      number of running statistics
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void init_run_stats(run_stats_t *acc, size_t n){
+size_t i;
+
+
+  for (i=0; i<n; i++){
+    acc[i].n = 0;
+    acc[i].minimum = SHRT_MAX;
+    acc[i].maximum = SHRT_MIN;
+    acc[i].mean = acc[i].var = acc[i].skew = acc[i].kurt = 0;
+  }
+
+  return;
+}
+
+
+/** This function adds a value to running statistics. Values are added in
++++ the same order as in a single pass, thus the results do not depend on
++++ the windowing.
+--- acc:    running statistics
+--- v:      value
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void add_run_stats(run_stats_t *acc, short v){
+
+
+  if (v < acc->minimum) acc->minimum = v;
+  if (v > acc->maximum) acc->maximum = v;
+
+  acc->n++;
+
+  kurt_recurrence(v, &acc->mean, &acc->var, &acc->skew, &acc->kurt, acc->n);
+
+  return;
+}
+
+
+/** This function adds one temporal window of the interpolated time series
++++ to the running statistics of the STM (see INT_WINDOW)
+--- acc:    running statistics (nc)
+--- tsi_:   interpolated window (nw x nc)
+--- mask:   mask image
+--- nc:     number of cells
+--- nw:     number of interpolation steps in the window
+--- nodata: nodata value
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int stm_window(run_stats_t *acc, short **tsi_, small *mask_, int nc, int nw, short nodata){
+int t, p;
+
+
+  #pragma omp parallel private(t) shared(acc,tsi_,mask_,nc,nw,nodata) default(none)
+  {
+
+    #pragma omp for
+    for (p=0; p<nc; p++){
+
+      if (mask_ != NULL && !mask_[p]) continue;
+
+      for (t=0; t<nw; t++){
+        if (tsi_[t][p] != nodata) add_run_stats(&acc[p], tsi_[t][p]);
+      }
+
+    }
+
+  }
+
+  return SUCCESS;
+}
+
+
+/** This function computes Spectral Temporal Metrics from the running 
++++ statistics of a windowed time series (see INT_WINDOW). Quantiles are
++++ not supported.
+--- ts:     pointer to instantly useable TSA image arrays
+--- acc:    running statistics (nc)
+--- mask:   mask image
+--- nc:     number of cells
+--- nodata: nodata value
+--- stm:    STM parameters
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int tsa_stm_window(tsa_t *ts, run_stats_t *acc, small *mask_, int nc, short nodata, par_stm_t *stm){
+int b, p;
+
+
+  if (ts->stm_ == NULL) return CANCEL;
+
+  cite_me(_CITE_STM_);
+
+  #pragma omp parallel private(b) shared(ts,acc,mask_,nc,nodata,stm) default(none)
+  {
+
+    #pragma omp for
+    for (p=0; p<nc; p++){
+
+      if ((mask_ != NULL && !mask_[p]) || acc[p].n == 0){
+        for (b=0; b<stm->sta.nmetrics; b++) ts->stm_[b][p] = nodata;
+        continue;
+      }
+
+      stm_moments(ts->stm_, p, acc[p].n, acc[p].minimum, acc[p].maximum, 
+        acc[p].mean, acc[p].var, acc[p].skew, acc[p].kurt, &stm->sta);
+
+    }
+
+  }
+
+  return SUCCESS;
+}
@@ -37,11 +37,19 @@ Spectral temporal metrics header
 #include "../higher-level/tsa-hl.h"
 
 
+// quantiles are computed from a histogram if the value range is smaller
+// than this factor times the number of observations
+#define STM_HIST_RANGE 4
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int tsa_stm(tsa_t *ts, small *mask_, int nc, int ni, short nodata, par_stm_t *stm);
+void init_run_stats(run_stats_t *acc, size_t n);
+void add_run_stats(run_stats_t *acc, short v);
+int stm_window(run_stats_t *acc, short **tsi_, small *mask_, int nc, int nw, short nodata);
+int tsa_stm_window(tsa_t *ts, run_stats_t *acc, small *mask_, int nc, short nodata, par_stm_t *stm);
 
 #ifdef __cplusplus
 }
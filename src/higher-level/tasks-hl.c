@@ -29,11 +29,78 @@ This file contains functions for higher level tasks
 
 /** Geospatial Data Abstraction Library (GDAL) **/
 #include "cpl_conv.h"      // various convenience functions for CPL
-#include "cpl_multiproc.h" // CPL Multi-Threading
 
 /** OpenMP **/
 #include <omp.h> // multi-platform shared memory multiprocessing
 
+#include <unistd.h>  // standard symbolic constants and types 
+#include <pthread.h> // POSIX threads
+
+
+// polling interval of idle workers
+#define STREAM_POLL_USEC 1000
+
+// stage of a processing unit in the task scheduler
+enum { _UNIT_FREE_, _UNIT_READING_, _UNIT_READ_, _UNIT_COMPUTING_, 
+       _UNIT_COMPUTED_, _UNIT_WRITING_, _UNIT_WRITTEN_ };
+
+// streaming state, shared by the workers
+typedef struct {
+  progress_t *pro;
+  brick_t **MASK;
+  ard_t **ARD1, **ARD2;
+  int *nt1, *nt2;
+  cube_t *cube;
+  par_hl_t *phl;
+  aux_t *aux;
+  brick_t ***OUTPUT;
+  int *nprod;
+  pthread_mutex_t lock; // task scheduler: lock for the following
+  char *state;          // stage of each claimed unit
+  int nclaim;           // number of claimed units
+  int nwrite;           // number of written units
+  bool claimed;         // all units claimed?
+} stream_t;
+
+
+void init_stream(stream_t *s, progress_t *pro, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, brick_t ***OUTPUT, int *nprod);
+void free_stream(stream_t *s);
+void pipeline_worker(void *ptr, int w);
+void task_worker(void *ptr, int w);
+double input_memory(int pu, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2);
+double output_memory(int pu, brick_t ***OUTPUT, int *nprod);
+double estimate_memory(int tx, int ty, cube_t *cube, par_hl_t *phl);
+brick_t **compute_chained(brick_t **OUTPUT, int nprod, brick_t *MASK, cube_t *cube, par_hl_t *phl, aux_t *aux, int *nprod_sub);
+brick_t **compute_window(ard_t *ARD1, ard_t *ARD2, brick_t *MASK, int nt1, int nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, int *nprod);
+
+/** This function tells whether the selected module has a GPU path. If
++++ so, ARD is copied to the device while reading (except for ImproPhe).
+--- phl:      HL parameters
++++ Return:   true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool gpu_module(par_hl_t *phl){
+
+  switch (phl->type){
+    case _HL_TSA_:
+      return true;
+    case _HL_BAP_:
+      return !phl->bap.pac.lsp;
+    case _HL_ML_:
+      return phl->mcl.method == _ML_RFR_ || phl->mcl.method == _ML_RFC_;
+    case _HL_TXT_:
+      return true;
+    case _HL_LIB_:
+      return true;
+    case _HL_L2I_:
+    case _HL_CFI_:
+      return true;
+    default:
+      return false;
+  }
+
+}
+
+
 /** This function handles the reading tasks
 --- pro:      progress handle
 --- MASK:     mask image
@@ -47,6 +114,7 @@ This file contains functions for higher level tasks
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void read_higher_level (progress_t *pro, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2, cube_t *cube, par_hl_t *phl){
 int mask_status;
+gpu_stream_t stream = NULL;
 
 
   if (!read_this_chunk(pro)) return;
@@ -60,7 +128,18 @@ int mask_status;
 
   measure_progress(pro, _TASK_INPUT_, _CLOCK_TICK_);
 
-  omp_set_num_threads(phl->ithread);
+  set_mem_owner("read");
+
+  omp_set_num_threads(numa_threads(get_threads(pro, _TASK_INPUT_)));
+  // the reading thread places the chunk where it will be computed
+  numa_bind_team(numa_unit_node(pro->pu_next));
+
+  // list the next tile in the background, while this tile is processed
+  if (pro->chunk_next == 0 && pro->tile_next+1 < pro->npu/pro->nchunk &&
+      (phl->input_level1 == _INP_ARD_ || phl->input_level1 == _INP_QAI_ ||
+       phl->input_level2 == _INP_ARD_ || phl->input_level2 == _INP_QAI_)){
+    prefetch_ard(pro->tiles_x[pro->tile_next+1], pro->tiles_y[pro->tile_next+1], phl);
+  }
 
   MASK[pro->pu_next] = read_mask(&mask_status,
     pro->tx_next, pro->ty_next, pro->chunk_next, cube, phl);
@@ -97,6 +176,12 @@ int mask_status;
     return;
   }
 
+  // no primary data in this chunk, secondary data won't be used
+  if (phl->input_level1 != _INP_NONE_ && nt1[pro->pu_next] == 0){
+    measure_progress(pro, _TASK_INPUT_, _CLOCK_TOCK_);
+    return;
+  }
+
 
   if (phl->input_level2 == _INP_FTR_){
     ARD2[pro->pu_next] = read_features(&nt2[pro->pu_next], 
@@ -118,12 +203,196 @@ int mask_status;
     return;
   }
 
+  // start the device copies, while the previous unit is computed;
+  // the unit goes to the least loaded device; ImproPhe works on derived
+  // features, thus its ARD stays on the host
+  if (phl->gpu && phl->type != _HL_L2I_ && phl->type != _HL_CFI_){
+    stream = claim_gpu_stream();
+    upload_ard(ARD1[pro->pu_next], nt1[pro->pu_next], stream);
+    upload_ard(ARD2[pro->pu_next], nt2[pro->pu_next], stream);
+  }
+
+  // the bricks were allocated by the reading team, book them to the input
+  set_brick_owner(MASK[pro->pu_next], "read/MASK");
+  set_ard_owner(ARD1[pro->pu_next], nt1[pro->pu_next], "read/ARD1");
+  set_ard_owner(ARD2[pro->pu_next], nt2[pro->pu_next], "read/ARD2");
+
+  record_input(pro, nt1[pro->pu_next] + nt2[pro->pu_next], 
+    input_memory(pro->pu_next, MASK, ARD1, ARD2, nt1, nt2));
+
   measure_progress(pro, _TASK_INPUT_, _CLOCK_TOCK_);
 
   return;
 }
 
 
+/** This function runs one processing module on the screened input
+--- ARD1:     primary   ARD
+--- ARD2:     secondary ARD
+--- MASK:     mask image
+--- nt1:      number of primary   ARD products
+--- nt2:      number of secondary ARD products
+--- cube:     datacube definition
+--- phl:      HL parameters of the module
+--- aux:      auxilliary data of the module
+--- nprod:    number of output bricks (returned)
++++ Return:   OUTPUT bricks
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t **compute_module(ard_t *ARD1, ard_t *ARD2, brick_t *MASK, int nt1, int nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, int *nprod){
+brick_t **OUTPUT = NULL;
+char owner[NPOW_10];
+int o;
+
+
+  *nprod = 0;
+
+  // intermediates are booked to the (sub)module, i.e. its parameter file
+  basename_without_ext(phl->f_par, owner, NPOW_10);
+  set_mem_owner(owner);
+
+  switch (phl->type){
+    case _HL_BAP_:
+      OUTPUT = level3(ARD1, ARD2, MASK, nt1, nt2, phl, cube, nprod);
+      break;
+    case _HL_TSA_:
+      OUTPUT = time_series_analysis(ARD1, MASK, nt1, phl, &aux->endmember, cube, nprod);
+      break;
+    case _HL_CSO_:
+      OUTPUT = clear_sky_observations(ARD1, MASK, nt1, phl, cube, nprod);
+      break;
+    case _HL_ML_:
+      OUTPUT = machine_learning(ARD1, MASK, nt1, phl, &aux->ml, cube, nprod);
+      break;
+    case _HL_SMP_:
+      if (phl->smp.mode == _SMP_ZONES_){
+        OUTPUT = zonal_statistics(ARD1, MASK, nt1, phl, &aux->zone, cube, nprod);
+      } else {
+        OUTPUT = sample_points(ARD1, MASK, nt1, phl, &aux->sample, cube, nprod);
+      }
+      break;
+    case _HL_TXT_:
+      OUTPUT = texture(ARD1, MASK, nt1, phl, cube, nprod);
+      break;
+    case _HL_LSM_:
+      OUTPUT = landscape_metrics(ARD1, MASK, nt1, phl, cube, nprod);
+      break;
+    case _HL_L2I_:
+      OUTPUT = level2_improphe(ARD1, ARD2, MASK, nt1, nt2, phl, cube, nprod);
+      break;
+    case _HL_CFI_:
+      OUTPUT = confield_improphe(ARD1, ARD2, MASK, nt1, nt2, phl, cube, nprod);
+      break;
+    case _HL_LIB_:
+      OUTPUT = library_completeness(ARD1, MASK, nt1, phl, &aux->library, cube, nprod);
+      break;
+    case _HL_UDF_:
+      OUTPUT = udf_plugin(ARD1, MASK, nt1, phl, cube, nprod);
+      break;
+    default:
+      printf("unknown processing module\n");
+      break;
+  }
+
+  for (o=0; o<*nprod; o++){
+    if (OUTPUT[o] == NULL) continue;
+    snprintf(owner, NPOW_10, "output/%s", OUTPUT[o]->product);
+    set_brick_owner(OUTPUT[o], owner);
+  }
+
+  set_mem_owner("compute");
+
+  return OUTPUT;
+}
+
+
+/** This function runs a chained submodule, i.e. a module that works on
++++ features, with the products of the preceding modules as features. The
++++ products that are used as features are not written.
+--- OUTPUT:    products of the preceding modules
+--- nprod:     number of products
+--- MASK:      mask image
+--- cube:      datacube definition
+--- phl:       HL parameters of the chained module
+--- aux:       auxilliary data of the chained module
+--- nprod_sub: number of output bricks of the chained module (returned)
++++ Return:    OUTPUT bricks of the chained module
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t **compute_chained(brick_t **OUTPUT, int nprod, brick_t *MASK, cube_t *cube, par_hl_t *phl, aux_t *aux, int *nprod_sub){
+brick_t **SUB = NULL;
+ard_t *features = NULL;
+bool *used = NULL;
+int nf, o;
+
+
+  *nprod_sub = 0;
+
+  if (nprod < 1) return NULL;
+
+  alloc((void**)&used, nprod, sizeof(bool));
+
+  if ((features = chain_features(&nf, OUTPUT, nprod, used, phl)) == NULL){
+    free((void*)used); return NULL;}
+
+  if (screen_qai(features, nf, MASK, &phl->qai, phl->input_level1) == SUCCESS &&
+      index_ard(features, nf, MASK) == SUCCESS){
+    SUB = compute_module(features, NULL, MASK, nf, 0, cube, phl, aux, nprod_sub);
+  }
+
+  for (o=0; o<nprod; o++){
+    if (used[o]) set_brick_open(OUTPUT[o], OPEN_FALSE);
+  }
+
+  free_ard(features, nf);
+  free((void*)used);
+
+  return SUB;
+}
+
+
+/** This function runs a module on the ARD within its temporal window. 
++++ The ARD are read for the union of the windows of all modules (see 
++++ add_submodule), thus a module with a narrower window only gets the 
++++ observations within its own window. Features are not filtered.
+--- ARD1:     primary   ARD
+--- ARD2:     secondary ARD
+--- MASK:     mask image
+--- nt1:      number of primary ARD products over time
+--- nt2:      number of secondary ARD products over time
+--- cube:     datacube definition
+--- phl:      HL parameters of the module
+--- aux:      auxilliary data of the module
+--- nprod:    number of output bricks (returned)
++++ Return:   OUTPUT bricks
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t **compute_window(ard_t *ARD1, ard_t *ARD2, brick_t *MASK, int nt1, int nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, int *nprod){
+brick_t **OUTPUT = NULL;
+ard_t *WIN1 = NULL, *WIN2 = NULL;
+int nw1 = nt1, nw2 = nt2;
+
+
+  if (phl->input_level1 == _INP_ARD_ || phl->input_level1 == _INP_QAI_){
+    WIN1 = window_ard(ARD1, nt1, MASK, phl, &nw1);
+  }
+
+  if (phl->input_level2 == _INP_ARD_ || phl->input_level2 == _INP_QAI_){
+    WIN2 = window_ard(ARD2, nt2, MASK, phl, &nw2);
+  }
+
+  if (nw1 > 0){
+    OUTPUT = compute_module((WIN1 != NULL) ? WIN1 : ARD1, 
+                            (WIN2 != NULL) ? WIN2 : ARD2, 
+                            MASK, nw1, nw2, cube, phl, aux, nprod);
+  } else {
+    *nprod = 0;
+  }
+
+  free_window(WIN1, nw1);
+  free_window(WIN2, nw2);
+
+  return OUTPUT;
+}
+
+
 /** This function handles the computing tasks
 --- pro:      progress handle
 --- MASK:     mask image
@@ -140,6 +409,9 @@ int mask_status;
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void compute_higher_level (progress_t *pro, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, brick_t ***OUTPUT, int *nprod){
 bool error = false;
+double start;
+brick_t **SUB = NULL;
+int s, nsub;
 
 
   if (!compute_this_chunk(pro)) return;
@@ -150,85 +422,83 @@ bool error = false;
 
   measure_progress(pro, _TASK_COMPUTE_, _CLOCK_TICK_);
 
-  omp_set_num_threads(phl->cthread);
+  set_mem_owner("compute");
+
+  omp_set_num_threads(numa_threads(get_threads(pro, _TASK_COMPUTE_)));
+  numa_bind_team(numa_unit_node(pro->pu));
 
 
   if (nt1[pro->pu] > 0){
+    start = omp_get_wtime();
     if (screen_qai(ARD1[pro->pu], nt1[pro->pu], MASK[pro->pu], &phl->qai, phl->input_level1) != SUCCESS) error = true;
+    record_subtask(pro, _SUBTASK_QAI_, start);
     if (phl->input_level1 == _INP_ARD_ || phl->input_level1 == _INP_QAI_){
+      start = omp_get_wtime();
       if (screen_noise(ARD1[pro->pu], nt1[pro->pu], MASK[pro->pu], &phl->qai) == FAILURE) error = true;
+      record_subtask(pro, _SUBTASK_NOISE_, start);
     }
+    compact_ard(ARD1[pro->pu], nt1[pro->pu], phl);
+    if (index_ard(ARD1[pro->pu], nt1[pro->pu], MASK[pro->pu]) == FAILURE) error = true;
   } else {
     error = true;
   }
 
   if (nt2[pro->pu] > 0){
+    start = omp_get_wtime();
     if (screen_qai(ARD2[pro->pu], nt2[pro->pu], MASK[pro->pu], &phl->qai, phl->input_level2) != SUCCESS) error = true;
+    record_subtask(pro, _SUBTASK_QAI_, start);
     if (phl->input_level2 == _INP_ARD_ || phl->input_level2 == _INP_QAI_){
+      start = omp_get_wtime();
       if (screen_noise(ARD2[pro->pu], nt2[pro->pu], MASK[pro->pu], &phl->qai) == FAILURE) error = true;
+      record_subtask(pro, _SUBTASK_NOISE_, start);
     }
+    compact_ard(ARD2[pro->pu], nt2[pro->pu], phl);
+    if (index_ard(ARD2[pro->pu], nt2[pro->pu], MASK[pro->pu]) == FAILURE) error = true;
   }
 
 
   if (!error && phl->input_level1 == _INP_ARD_){
+    start = omp_get_wtime();
     if (spectral_adjust(ARD1[pro->pu], MASK[pro->pu], nt1[pro->pu], phl) == FAILURE) error = true;
+    record_subtask(pro, _SUBTASK_ADJUST_, start);
   }
 
 
+  start = omp_get_wtime();
+
   if (!error){
 
-    switch (phl->type){
-      case _HL_BAP_:
-        OUTPUT[pro->pu] = level3(ARD1[pro->pu], ARD2[pro->pu], MASK[pro->pu], 
-          nt1[pro->pu], nt2[pro->pu], phl, cube, &nprod[pro->pu]);
-        break;
-      case _HL_TSA_:
-        OUTPUT[pro->pu] = time_series_analysis(ARD1[pro->pu], MASK[pro->pu], 
-          nt1[pro->pu], phl, &aux->endmember, cube, &nprod[pro->pu]);
-        break;
-      case _HL_CSO_:
-        OUTPUT[pro->pu] = clear_sky_observations(ARD1[pro->pu], MASK[pro->pu], 
-          nt1[pro->pu], phl, cube, &nprod[pro->pu]);
-        break;
-      case _HL_ML_:
-        OUTPUT[pro->pu] = machine_learning(ARD1[pro->pu], MASK[pro->pu], 
-          nt1[pro->pu], phl, &aux->ml, cube, &nprod[pro->pu]);
-        break;
-      case _HL_SMP_:
-        OUTPUT[pro->pu] = sample_points(ARD1[pro->pu], MASK[pro->pu], 
-          nt1[pro->pu], phl, &aux->sample, cube, &nprod[pro->pu]);
-        break;
-      case _HL_TXT_:
-        OUTPUT[pro->pu] = texture(ARD1[pro->pu], MASK[pro->pu], 
-          nt1[pro->pu], phl, cube, &nprod[pro->pu]);
-        break;
-      case _HL_LSM_:
-        OUTPUT[pro->pu] = landscape_metrics(ARD1[pro->pu], MASK[pro->pu], 
-          nt1[pro->pu], phl, cube, &nprod[pro->pu]);
-        break;
-      case _HL_L2I_:
-        OUTPUT[pro->pu] = level2_improphe(ARD1[pro->pu], ARD2[pro->pu], MASK[pro->pu], 
-          nt1[pro->pu], nt2[pro->pu], phl, cube, &nprod[pro->pu]);
-        break;
-      case _HL_CFI_:
-        OUTPUT[pro->pu] = confield_improphe(ARD1[pro->pu], ARD2[pro->pu], MASK[pro->pu], 
-          nt1[pro->pu], nt2[pro->pu], phl, cube, &nprod[pro->pu]);
-        break;
-      case _HL_LIB_:
-        OUTPUT[pro->pu] = library_completeness(ARD1[pro->pu], MASK[pro->pu], 
-          nt1[pro->pu], phl, &aux->library, cube, &nprod[pro->pu]);
-        break;
-      case _HL_UDF_:
-        OUTPUT[pro->pu] = udf_plugin(ARD1[pro->pu], MASK[pro->pu], 
-          nt1[pro->pu], phl, cube, &nprod[pro->pu]);
-        break;
-      default:
-        printf("unknown processing module\n");
-        break;
+    OUTPUT[pro->pu] = compute_window(ARD1[pro->pu], ARD2[pro->pu], MASK[pro->pu], 
+      nt1[pro->pu], nt2[pro->pu], cube, phl, aux, &nprod[pro->pu]);
+
+    // submodules work on the same, already screened data,
+    // chained submodules on the products of the preceding modules
+    for (s=0; s<phl->nsub; s++){
+
+      if (phl->sub[s]->input_level1 == _INP_FTR_){
+        SUB = compute_chained(OUTPUT[pro->pu], nprod[pro->pu], MASK[pro->pu], 
+          cube, phl->sub[s], aux->sub[s], &nsub);
+      } else {
+        SUB = compute_window(ARD1[pro->pu], ARD2[pro->pu], MASK[pro->pu], 
+          nt1[pro->pu], nt2[pro->pu], cube, phl->sub[s], aux->sub[s], &nsub);
+      }
+
+      if (SUB == NULL) continue;
+
+      if (nsub > 0){
+        re_alloc((void**)&OUTPUT[pro->pu], nprod[pro->pu], nprod[pro->pu]+nsub, sizeof(brick_t*));
+        memcpy(OUTPUT[pro->pu]+nprod[pro->pu], SUB, nsub*sizeof(brick_t*));
+        nprod[pro->pu] += nsub;
+      }
+
+      free((void*)SUB);
+
     }
 
   }
 
+  record_subtask(pro, _SUBTASK_MODULE_, start);
+
   
   free_ard(ARD1[pro->pu], nt1[pro->pu]);
   free_ard(ARD2[pro->pu], nt2[pro->pu]);
@@ -250,9 +520,12 @@ bool error = false;
 void output_higher_level (progress_t *pro, brick_t ***OUTPUT, int *nprod, par_hl_t *phl){
 char dname[NPOW_10]; 
 int nchar;
-char *lock = NULL;
+lock_t *lock = NULL;
 bool error = false;
-int o;
+int nerror = 0;
+int o, k, tmp, nthread;
+int *order = NULL;
+gdalopt_t format;
 
 
   if (!write_this_chunk(pro, nprod)) return;
@@ -261,11 +534,13 @@ int o;
 
   measure_progress(pro, _TASK_OUTPUT_, _CLOCK_TICK_);
 
+  set_mem_owner("write");
+
   nchar = snprintf(dname, NPOW_10, "%s/X%04d_Y%04d", phl->d_higher, pro->tx_prev, pro->ty_prev);
   if (nchar < 0 || nchar >= NPOW_10){ 
     printf("Buffer Overflow in assembling filename\n"); exit(1);}
 
-  if ((lock = (char*)CPLLockFile(dname, 60)) == NULL){
+  if ((lock = lock_file(dname, 60)) == NULL){
     printf("Unable to lock directory %s (timeout: %ds). ", dname, 60);
     error = true;
   }
@@ -273,12 +548,48 @@ int o;
   if (!error){
 
     createdir(dname);
-    CPLUnlockFile(lock);
+    unlock_file(lock);
     lock = NULL;
 
-    omp_set_num_threads(phl->othread);
+    nthread = numa_threads(get_threads(pro, _TASK_OUTPUT_));
+
+    // write the largest products first, such that the small ones fill 
+    // the gaps at the end (products differ by orders of magnitude)
+    alloc((void**)&order, nprod[pro->pu_prev], sizeof(int));
+    for (o=0; o<nprod[pro->pu_prev]; o++){
+      for (k=o, order[o]=o; k>0; k--){
+        if (get_brick_size(OUTPUT[pro->pu_prev][order[k-1]]) >= 
+            get_brick_size(OUTPUT[pro->pu_prev][order[k]])) break;
+        tmp = order[k-1]; order[k-1] = order[k]; order[k] = tmp;
+      }
+    }
+
+    for (o=0; o<nprod[pro->pu_prev]; o++){
+      if (OUTPUT[pro->pu_prev][o] == NULL) continue;
+      set_brick_vrt(OUTPUT[pro->pu_prev][o], phl->vrt);
+    }
+
+    // threads that are not needed for concurrent files are used to
+    // write the files of exploded bands in parallel, or are given to 
+    // GDAL to compress the files in parallel
+    if (nthread > nprod[pro->pu_prev]){
+      for (o=0; o<nprod[pro->pu_prev]; o++){
+        if (OUTPUT[pro->pu_prev][o] == NULL) continue;
+        if (get_brick_explode(OUTPUT[pro->pu_prev][o])){
+          set_brick_nthread(OUTPUT[pro->pu_prev][o], nthread/nprod[pro->pu_prev]);
+        } else {
+          format = get_brick_format(OUTPUT[pro->pu_prev][o]);
+          update_gdaloptions_threads(&format, nthread/nprod[pro->pu_prev]);
+          set_brick_format(OUTPUT[pro->pu_prev][o], &format);
+        }
+      }
+      nthread = nprod[pro->pu_prev];
+    }
+
+    omp_set_num_threads(nthread);
+    numa_bind_team(numa_unit_node(pro->pu_prev));
   
-    #pragma omp parallel shared(OUTPUT,pro,nprod,phl) default(none)
+    #pragma omp parallel private(k) shared(OUTPUT,order,pro,nprod,phl) reduction(+: nerror) default(none)
     {
 
       CPLPushErrorHandler(CPLQuietErrorHandler);
@@ -286,16 +597,19 @@ int o;
 
       #pragma omp for schedule(dynamic,1)
       for (o=0; o<nprod[pro->pu_prev]; o++){
-        if (phl->radius > 0) OUTPUT[pro->pu_prev][o] = crop_brick(
-          OUTPUT[pro->pu_prev][o], phl->radius);
-        write_brick(OUTPUT[pro->pu_prev][o]);
+        k = order[o];
+        if (phl->radius > 0) OUTPUT[pro->pu_prev][k] = crop_brick(
+          OUTPUT[pro->pu_prev][k], phl->radius);
+        if (write_brick(OUTPUT[pro->pu_prev][k]) != SUCCESS) nerror++;
       }
 
       CPLPopErrorHandler();
 
     }
     
+    free((void*)order);
 
+    if (nerror == 0) journal_unit(pro, pro->pu_prev, nprod[pro->pu_prev]);
 
   }
 
@@ -309,3 +623,395 @@ int o;
   return;
 }
 
+
+
+/** This function gets the memory held by the input of a processing unit
+--- pu:       processing unit
+--- MASK:     mask image
+--- ARD1:     primary   ARD
+--- ARD2:     secondary ARD
+--- nt1:      number of primary   ARD products
+--- nt2:      number of secondary ARD products
++++ Return:   memory in bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double input_memory(int pu, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2){
+double bytes = 0;
+
+  bytes += get_brick_memory(MASK[pu]);
+  if (nt1[pu] > 0) bytes += get_ard_memory(ARD1[pu], nt1[pu]);
+  if (nt2[pu] > 0) bytes += get_ard_memory(ARD2[pu], nt2[pu]);
+
+  return bytes;
+}
+
+
+/** This function estimates the memory that will be needed for reading the
++++ input of a processing unit. Continuous fields are not estimated.
+--- tx:       tile X-ID
+--- ty:       tile Y-ID
+--- cube:     datacube definition
+--- phl:      HL parameters
++++ Return:   memory in bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double estimate_input_memory(int tx, int ty, cube_t *cube, par_hl_t *phl){
+double bytes = 0;
+
+
+  if (phl->input_level1 == _INP_ARD_ || phl->input_level1 == _INP_QAI_){
+    bytes += estimate_ard_memory(tx, ty, cube, &phl->sen, phl);
+  } else if (phl->input_level1 == _INP_FTR_){
+    bytes += (double)phl->ftr.nfeature * cube->cc * sizeof(short);
+  }
+
+  if (phl->input_level2 == _INP_ARD_ || phl->input_level2 == _INP_QAI_){
+    bytes += estimate_ard_memory(tx, ty, cube, &phl->sen2, phl);
+  } else if (phl->input_level2 == _INP_FTR_){
+    bytes += (double)phl->ftr.nfeature * cube->cc * sizeof(short);
+  }
+
+  return bytes;
+}
+
+
+/** This function estimates the input memory of a processing unit for the
++++ memory budget. Nothing is estimated without budget, as the ARD would
++++ need to be listed.
+--- tx:       tile X-ID
+--- ty:       tile Y-ID
+--- cube:     datacube definition
+--- phl:      HL parameters
++++ Return:   memory in bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double estimate_memory(int tx, int ty, cube_t *cube, par_hl_t *phl){
+
+
+  if (phl->mem_budget <= 0) return 0;
+
+  return estimate_input_memory(tx, ty, cube, phl);
+}
+
+
+/** This function gets the memory held by the output of a processing unit
+--- pu:       processing unit
+--- OUTPUT:   OUTPUT bricks
+--- nproduct: number of output bricks
++++ Return:   memory in bytes
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+double output_memory(int pu, brick_t ***OUTPUT, int *nprod){
+double bytes = 0;
+int o;
+
+  if (OUTPUT[pu] == NULL) return 0;
+
+  for (o=0; o<nprod[pu]; o++) bytes += get_brick_memory(OUTPUT[pu][o]);
+
+  return bytes;
+}
+
+
+/** This function initializes the streaming state
+--- s:        streaming state (returned)
+--- pro:      progress handle
+--- MASK:     mask image
+--- ARD1:     primary   ARD
+--- ARD2:     secondary ARD
+--- nt1:      number of primary   ARD products
+--- nt2:      number of secondary ARD products
+--- cube:     datacube definition
+--- phl:      HL parameters
+--- aux:      auxilliary data
+--- OUTPUT:   OUTPUT bricks
+--- nproduct: number of output bricks
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void init_stream(stream_t *s, progress_t *pro, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, brick_t ***OUTPUT, int *nprod){
+
+
+  s->pro    = pro;
+  s->MASK   = MASK;
+  s->ARD1   = ARD1;
+  s->ARD2   = ARD2;
+  s->nt1    = nt1;
+  s->nt2    = nt2;
+  s->cube   = cube;
+  s->phl    = phl;
+  s->aux    = aux;
+  s->OUTPUT = OUTPUT;
+  s->nprod  = nprod;
+
+  pthread_mutex_init(&s->lock, NULL);
+  alloc((void**)&s->state, pro->npu, sizeof(char));
+  s->nclaim  = 0;
+  s->nwrite  = 0;
+  s->claimed = false;
+
+  return;
+}
+
+
+/** This function frees the streaming state
+--- s:        streaming state
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_stream(stream_t *s){
+
+
+  pthread_mutex_destroy(&s->lock);
+  free((void*)s->state);
+  s->state = NULL;
+
+  return;
+}
+
+
+/** This function is run by the workers of the streaming pipeline. There 
++++ are three workers that handle Input, Processing, and Output. Each wor-
++++ ker works through the processing units on its own, and waits if the 
++++ others are lagging more than STREAM_DEPTH units behind.
+--- ptr:      streaming state
+--- w:        worker ID
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void pipeline_worker(void *ptr, int w){
+stream_t *s = (stream_t*)ptr;
+progress_t *pro = s->pro;
+double estimate;
+
+
+  if (w == _TASK_INPUT_){
+
+    while (next_unit(pro, _TASK_INPUT_)){
+      estimate = estimate_memory(pro->tx_next, pro->ty_next, s->cube, s->phl);
+      reserve_memory(pro, estimate);
+      read_higher_level(pro, s->MASK, s->ARD1, s->ARD2, s->nt1, s->nt2, s->cube, s->phl);
+      account_memory(pro, _TASK_INPUT_, 
+        input_memory(pro->pu_next, s->MASK, s->ARD1, s->ARD2, s->nt1, s->nt2) - estimate);
+      done_unit(pro, _TASK_INPUT_);
+    }
+
+  } else if (w == _TASK_COMPUTE_){
+
+    while (next_unit(pro, _TASK_COMPUTE_)){
+      progress(pro);
+      account_memory(pro, _TASK_INPUT_, 
+        -input_memory(pro->pu, s->MASK, s->ARD1, s->ARD2, s->nt1, s->nt2));
+      compute_higher_level(pro, s->MASK, s->ARD1, s->ARD2, s->nt1, s->nt2, s->cube, s->phl, s->aux, s->OUTPUT, s->nprod);
+      account_memory(pro, _TASK_OUTPUT_, output_memory(pro->pu, s->OUTPUT, s->nprod));
+      done_unit(pro, _TASK_COMPUTE_);
+      tune_threads(pro);
+    }
+
+  } else {
+
+    while (next_unit(pro, _TASK_OUTPUT_)){
+      account_memory(pro, _TASK_OUTPUT_, -output_memory(pro->pu_prev, s->OUTPUT, s->nprod));
+      output_higher_level(pro, s->OUTPUT, s->nprod, s->phl);
+      write_telemetry(pro, pro->pu_prev);
+      done_unit(pro, _TASK_OUTPUT_);
+    }
+
+  }
+
+  return;
+}
+
+
+/** This function runs the streaming pipeline with one persistent worker
++++ per team, see pipeline_worker.
+--- pro:      progress handle
+--- MASK:     mask image
+--- ARD1:     primary   ARD
+--- ARD2:     secondary ARD
+--- nt1:      number of primary   ARD products
+--- nt2:      number of secondary ARD products
+--- cube:     datacube definition
+--- phl:      HL parameters
+--- aux:      auxilliary data
+--- OUTPUT:   OUTPUT bricks
+--- nproduct: number of output bricks
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void stream_pipeline(progress_t *pro, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, brick_t ***OUTPUT, int *nprod){
+stream_t s;
+
+
+  init_stream(&s, pro, MASK, ARD1, ARD2, nt1, nt2, cube, phl, aux, OUTPUT, nprod);
+
+  run_pool(3, pipeline_worker, &s);
+
+  free_stream(&s);
+
+  return;
+}
+
+
+/** This function is run by the workers of the task scheduler. The read-
++++ ing, processing and writing of each processing unit are tasks, which
++++ depend on each other. The workers pick up any task that is ready, i.e.
++++ the work is balanced dynamically between Input, Processing, and Out-
++++ put. Output is preferred to free memory, and is done in order, as the
++++ chunks of a tile are written into the same files. At most STREAM_DEPTH
++++ units are in flight.
+--- ptr:      streaming state
+--- w:        worker ID
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void task_worker(void *ptr, int w){
+stream_t *s = (stream_t*)ptr;
+progress_t *pro = s->pro;
+progress_t unit;
+int i, pu, task, tile;
+double estimate;
+bool done;
+
+
+  while (true){
+
+    task = -1;
+
+    pthread_mutex_lock(&s->lock);
+
+    for (i=s->nwrite; i<s->nclaim; i++){
+      if (s->state[i] == _UNIT_READ_) break;
+    }
+
+    if (s->nwrite < s->nclaim && s->state[s->nwrite] == _UNIT_COMPUTED_){
+      i = s->nwrite;
+      s->state[i] = _UNIT_WRITING_;
+      task = _TASK_OUTPUT_;
+    } else if (i < s->nclaim){
+      s->state[i] = _UNIT_COMPUTING_;
+      task = _TASK_COMPUTE_;
+    } else if (!s->claimed && s->nclaim - get_unit_count(pro, _TASK_OUTPUT_) <= pro->depth){
+      i = s->nclaim;
+      if ((pu = claim_unit(pro)) < 0){
+        s->claimed = true;
+        set_unit_max(pro, i);
+      } else {
+        pro->unit[i] = pu;
+        s->state[i] = _UNIT_READING_;
+        s->nclaim++;
+        task = _TASK_INPUT_;
+      }
+    }
+
+    done = (s->claimed && s->nwrite == s->nclaim);
+
+    pthread_mutex_unlock(&s->lock);
+
+    if (task < 0){
+      if (done) break;
+      usleep(STREAM_POLL_USEC);
+      continue;
+    }
+
+    pu = pro->unit[i];
+
+    unit_handle(pro, &unit, task, pu);
+
+    if (task == _TASK_INPUT_){
+
+      // reserve the memory for reading, wait if over budget
+      tile = pu / pro->nchunk;
+      estimate = estimate_memory(pro->tiles_x[tile], pro->tiles_y[tile], s->cube, s->phl);
+      reserve_memory(pro, estimate);
+      read_higher_level(&unit, s->MASK, s->ARD1, s->ARD2, s->nt1, s->nt2, s->cube, s->phl);
+      account_memory(pro, _TASK_INPUT_, 
+        input_memory(pu, s->MASK, s->ARD1, s->ARD2, s->nt1, s->nt2) - estimate);
+
+    } else if (task == _TASK_COMPUTE_){
+
+      #pragma omp critical (progress)
+      progress(&unit);
+      account_memory(pro, _TASK_INPUT_, 
+        -input_memory(pu, s->MASK, s->ARD1, s->ARD2, s->nt1, s->nt2));
+      compute_higher_level(&unit, s->MASK, s->ARD1, s->ARD2, s->nt1, s->nt2, s->cube, s->phl, s->aux, s->OUTPUT, s->nprod);
+      account_memory(pro, _TASK_OUTPUT_, output_memory(pu, s->OUTPUT, s->nprod));
+
+    } else {
+
+      account_memory(pro, _TASK_OUTPUT_, -output_memory(pu, s->OUTPUT, s->nprod));
+      output_higher_level(&unit, s->OUTPUT, s->nprod, s->phl);
+      write_telemetry(pro, pu);
+
+    }
+
+    done_unit_handle(pro, &unit, task);
+
+    pthread_mutex_lock(&s->lock);
+    s->state[i]++;
+    if (task == _TASK_OUTPUT_) s->nwrite++;
+    pthread_mutex_unlock(&s->lock);
+
+  }
+
+  return;
+}
+
+
+/** This function runs the task scheduler with persistent workers, see
++++ task_worker. There are three workers. With several GPUs, there is one
++++ more worker per additional device, such that each device can compute
++++ a unit. Likewise, with one pipeline per socket, there is one worker
++++ per socket.
+--- pro:      progress handle
+--- MASK:     mask image
+--- ARD1:     primary   ARD
+--- ARD2:     secondary ARD
+--- nt1:      number of primary   ARD products
+--- nt2:      number of secondary ARD products
+--- cube:     datacube definition
+--- phl:      HL parameters
+--- aux:      auxilliary data
+--- OUTPUT:   OUTPUT bricks
+--- nproduct: number of output bricks
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void stream_tasks(progress_t *pro, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, brick_t ***OUTPUT, int *nprod){
+int nworker = 2 + ((gpu_count() > 1) ? gpu_count() : 1);
+stream_t s;
+
+
+  if (numa_mode() == _NUMA_SOCKET_ && numa_count() > nworker-2) nworker = 2 + numa_count();
+
+  init_stream(&s, pro, MASK, ARD1, ARD2, nt1, nt2, cube, phl, aux, OUTPUT, nprod);
+
+  run_pool(nworker, task_worker, &s);
+
+  free_stream(&s);
+
+  return;
+}
+
+
+/** This function streams all processing units through Input, Processing,
++++ and Output, using the scheduler that was chosen in the parameter file.
++++ The pipeline has a single Processing team, thus the task scheduler is
++++ used when several GPUs are available, or with one pipeline per socket.
+--- pro:      progress handle
+--- MASK:     mask image
+--- ARD1:     primary   ARD
+--- ARD2:     secondary ARD
+--- nt1:      number of primary   ARD products
+--- nt2:      number of secondary ARD products
+--- cube:     datacube definition
+--- phl:      HL parameters
+--- aux:      auxilliary data
+--- OUTPUT:   OUTPUT bricks
+--- nproduct: number of output bricks
++++ Return:   void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void stream_higher_level(progress_t *pro, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, brick_t ***OUTPUT, int *nprod){
+
+
+  if (pro->mode == _STREAM_TASK_ || gpu_count() > 1 || numa_mode() == _NUMA_SOCKET_){
+    stream_tasks(pro, MASK, ARD1, ARD2, nt1, nt2, cube, phl, aux, OUTPUT, nprod);
+  } else {
+    stream_pipeline(pro, MASK, ARD1, ARD2, nt1, nt2, cube, phl, aux, OUTPUT, nprod);
+  }
+
+  progress(pro);
+
+  return;
+}
+
@@ -35,6 +35,8 @@ Higher level tasks header
 #include "../cross-level/brick-cl.h"
 #include "../cross-level/cube-cl.h"
 #include "../cross-level/lock-cl.h"
+#include "../cross-level/numa-cl.h"
+#include "../cross-level/pool-cl.h"
 #include "../higher-level/progress-hl.h"
 #include "../higher-level/param-hl.h"
 #include "../higher-level/quality-hl.h"
@@ -58,9 +60,13 @@ Higher level tasks header
 extern "C" {
 #endif
 
+bool gpu_module(par_hl_t *phl);
+double estimate_input_memory(int tx, int ty, cube_t *cube, par_hl_t *phl);
+brick_t **compute_module(ard_t *ARD1, ard_t *ARD2, brick_t *MASK, int nt1, int nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, int *nprod);
 void read_higher_level (progress_t *pro, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2, cube_t *cube, par_hl_t *phl);
 void compute_higher_level (progress_t *pro, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, brick_t ***OUTPUT, int *nprod);
 void output_higher_level (progress_t *pro, brick_t ***OUTPUT, int *nprod, par_hl_t *phl);
+void stream_higher_level(progress_t *pro, brick_t **MASK, ard_t **ARD1, ard_t **ARD2, int *nt1, int *nt2, cube_t *cube, par_hl_t *phl, aux_t *aux, brick_t ***OUTPUT, int *nprod);
 
 #ifdef __cplusplus
 }
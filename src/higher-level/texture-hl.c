@@ -34,6 +34,8 @@ using namespace cv;
 
 brick_t **compile_txt(ard_t *features, txt_t *txt, par_hl_t *phl, cube_t *cube, int *nproduct);
 brick_t *compile_txt_brick(brick_t *ard, int nb, bool write, char *prodname, par_hl_t *phl);
+int compile_txt_elem(int radius, morph_elem_t *elem);
+short saturate_diff(short a, short b);
 
 
 /** This function compiles the bricks, in which TXT results are stored. 
@@ -161,6 +163,63 @@ int nchar;
 }
 
 
+/** This function compiles the elliptic structuring element of OpenCV
++++ into horizontal chords for the morphology engine (see morph-hl.c).
+--- radius: radius of the element
+--- elem:   structuring element (returned)
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int compile_txt_elem(int radius, morph_elem_t *elem){
+int i, j, j1, j2, n = 2*radius+1;
+
+
+  Mat morph_elem = getStructuringElement(MORPH_ELLIPSE,
+                     Size(n, n), Point(radius, radius));
+
+  elem->r = radius;
+  alloc((void**)&elem->hw, n, sizeof(int));
+
+  for (i=0; i<n; i++){
+
+    for (j=0, j1=-1, j2=-1; j<n; j++){
+      if (morph_elem.at<uchar>(i,j) == 0) continue;
+      if (j1 < 0) j1 = j;
+      if (j2 >= 0 && j2 != j-1) j1 = n; // not contiguous
+      j2 = j;
+    }
+
+    if (j1 < 0){
+      elem->hw[i] = -1;
+    } else if (j1 < n && j1+j2 == 2*radius){
+      elem->hw[i] = radius-j1;
+    } else {
+      printf("row %d of structuring element is no centered chord. ", i);
+      free((void*)elem->hw); elem->hw = NULL;
+      return FAILURE;
+    }
+
+  }
+
+  morph_elem.release();
+
+  return SUCCESS;
+}
+
+
+/** This function subtracts two values with saturation (as OpenCV)
+--- a:      minuend
+--- b:      subtrahend
++++ Return: a-b, saturated to the range of short
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+short saturate_diff(short a, short b){
+int d = (int)a - (int)b;
+
+  if (d > SHRT_MAX) return SHRT_MAX;
+  if (d < SHRT_MIN) return SHRT_MIN;
+  return (short)d;
+}
+
+
 /** public functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
@@ -178,14 +237,20 @@ brick_t **texture(ard_t *features, brick_t *mask, int nf, par_hl_t *phl, cube_t
 txt_t txt;
 brick_t **TXT;
 small *mask_ = NULL;
+morph_elem_t elem;
+morph_t m;
+morph_gpu_t job;
+short *E = NULL, *D = NULL, *O = NULL, *C = NULL;
+bool gpu = false;
 int nprod = 0;
-int f, i, j, p, nx, ny;
+int f, o, p, nx, ny, nc;
 short nodata;
 
 
   // import bricks
   nx = get_brick_chunkncols(features[0].DAT);
   ny = get_brick_chunknrows(features[0].DAT);
+  nc = get_brick_chunkncells(features[0].DAT);
   nodata = get_brick_nodata(features[0].DAT, 0);
 
   // import mask (if available)
@@ -205,37 +270,56 @@ short nodata;
   }
 
   
-  // structuring element (kernel)
-  Mat morph_elem = getStructuringElement(MORPH_ELLIPSE,
-                     Size(2*phl->txt.radius+1, 2*phl->txt.radius+1),
-                     Point(phl->txt.radius, phl->txt.radius));
+  // structuring element (kernel) as horizontal chords
+  if (compile_txt_elem(phl->txt.radius, &elem) == FAILURE){
+    printf("Unable to compile structuring element!\n"); 
+    for (o=0; o<nprod; o++) free_brick(TXT[o]);
+    free((void*)TXT);
+    *nproduct = 0;
+    return NULL;
+  }
+
+
+  lap_profile("txt_compile");
 
 
-  #pragma omp parallel private(i,j,p) shared(nf,nx,ny,morph_elem,features,txt,phl,nodata) default(none)
+  // the features are filtered one after another on the device
+  if (phl->gpu){
+    for (f=0, gpu=true; f<nf; f++){
+      if (features[f].GPU == NULL) gpu = false;
+    }
+  }
+
+
+  #pragma omp parallel if(!gpu) private(p,m,job,E,D,O,C) shared(nf,nc,nx,ny,elem,features,txt,phl,nodata,gpu) default(none)
   {
 
+    // intermediate products that are not written
+    if (!phl->txt.oero && phl->txt.ogrd) alloc((void**)&E, nc, sizeof(short));
+    if (!phl->txt.odil && phl->txt.ogrd) alloc((void**)&D, nc, sizeof(short));
+    if (!phl->txt.oopn && phl->txt.otht) alloc((void**)&O, nc, sizeof(short));
+    if (!phl->txt.ocls && phl->txt.obht) alloc((void**)&C, nc, sizeof(short));
+
     #pragma omp for
     for (f=0; f<nf; f++){
 
-      Mat src(ny, nx, CV_16S, features[f].dat[0], Mat::AUTO_STEP);
-      Mat ero_dst(ny, nx, CV_16S);
-      Mat dil_dst(ny, nx, CV_16S);
-      Mat opn_dst(ny, nx, CV_16S);
-      Mat cls_dst(ny, nx, CV_16S);
-      Mat grd_dst(ny, nx, CV_16S);
-      Mat tht_dst(ny, nx, CV_16S);
-      Mat bht_dst(ny, nx, CV_16S);
-
-      if (phl->txt.oero) morphologyEx(src, ero_dst, MORPH_ERODE,    morph_elem, Point(-1,-1), phl->txt.iter);
-      if (phl->txt.odil) morphologyEx(src, dil_dst, MORPH_DILATE,   morph_elem, Point(-1,-1), phl->txt.iter);
-      if (phl->txt.oopn) morphologyEx(src, opn_dst, MORPH_OPEN,     morph_elem, Point(-1,-1), phl->txt.iter);
-      if (phl->txt.ocls) morphologyEx(src, cls_dst, MORPH_CLOSE,    morph_elem, Point(-1,-1), phl->txt.iter);
-      if (phl->txt.ogrd) morphologyEx(src, grd_dst, MORPH_GRADIENT, morph_elem, Point(-1,-1), phl->txt.iter);
-      if (phl->txt.otht) morphologyEx(src, tht_dst, MORPH_TOPHAT,   morph_elem, Point(-1,-1), phl->txt.iter);
-      if (phl->txt.obht) morphologyEx(src, bht_dst, MORPH_BLACKHAT, morph_elem, Point(-1,-1), phl->txt.iter);
-
-      for (i=0, p=0; i<ny; i++){
-      for (j=0; j<nx; j++, p++){
+      m.ero = (phl->txt.oero) ? txt.ero_[f] : (phl->txt.ogrd) ? E : NULL;
+      m.dil = (phl->txt.odil) ? txt.dil_[f] : (phl->txt.ogrd) ? D : NULL;
+      m.opn = (phl->txt.oopn) ? txt.opn_[f] : (phl->txt.otht) ? O : NULL;
+      m.cls = (phl->txt.ocls) ? txt.cls_[f] : (phl->txt.obht) ? C : NULL;
+
+      job.nx   = nx;
+      job.ny   = ny;
+      job.elem = &elem;
+      job.iter = phl->txt.iter;
+      job.out  = m;
+      if (gpu) job.src = (const short*)get_gpu_band(features[f].GPU, 0);
+
+      if (!gpu || morph_gpu(&job, features[f].GPU->stream) != SUCCESS){
+        morph_products(features[f].dat[0], nx, ny, &elem, phl->txt.iter, &m);
+      }
+
+      for (p=0; p<nc; p++){
         
         if (!features[f].msk[p] && phl->ftr.exclude){
           
@@ -249,33 +333,26 @@ short nodata;
           
         } else {
           
-          if (phl->txt.oero) txt.ero_[f][p] = ero_dst.at<short>(i,j);
-          if (phl->txt.odil) txt.dil_[f][p] = dil_dst.at<short>(i,j);
-          if (phl->txt.oopn) txt.opn_[f][p] = opn_dst.at<short>(i,j);
-          if (phl->txt.ocls) txt.cls_[f][p] = cls_dst.at<short>(i,j);
-          if (phl->txt.ogrd) txt.grd_[f][p] = grd_dst.at<short>(i,j);
-          if (phl->txt.otht) txt.tht_[f][p] = tht_dst.at<short>(i,j);
-          if (phl->txt.obht) txt.bht_[f][p] = bht_dst.at<short>(i,j);
+          if (phl->txt.ogrd) txt.grd_[f][p] = saturate_diff(m.dil[p], m.ero[p]);
+          if (phl->txt.otht) txt.tht_[f][p] = saturate_diff(features[f].dat[0][p], m.opn[p]);
+          if (phl->txt.obht) txt.bht_[f][p] = saturate_diff(m.cls[p], features[f].dat[0][p]);
           
         }
         
       }
-      }
-
-      src.release();
-      ero_dst.release();
-      dil_dst.release();
-      opn_dst.release();
-      cls_dst.release();
-      grd_dst.release();
-      tht_dst.release();
-      bht_dst.release();
 
     }
 
+    if (E != NULL) free((void*)E);
+    if (D != NULL) free((void*)D);
+    if (O != NULL) free((void*)O);
+    if (C != NULL) free((void*)C);
+
   }
 
-  morph_elem.release();
+  free((void*)elem.hw);
+
+  lap_profile("txt_morph");
 
   *nproduct = nprod;
   return TXT;
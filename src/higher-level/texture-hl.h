@@ -33,7 +33,10 @@ Texture header
 
 #include "../cross-level/const-cl.h"
 #include "../cross-level/brick-cl.h"
+#include "../cross-level/profile-cl.h"
 #include "../higher-level/read-ard-hl.h"
+#include "../higher-level/morph-hl.h"
+#include "../higher-level/morph-gpu-hl.h"
 
 
 #ifdef __cplusplus
@@ -30,6 +30,52 @@ This file contains functions for time series trends
 
 int trend(short **fld_, date_t *d_fld, small *mask_, int nc, int nf, short **trd_, short nodata, int by, bool in_ce, par_trd_t *trd);
 int cat(short **fld_, date_t *d_fld, small *mask_, int nc, int nf, short **cat_, short nodata, int by, bool in_ce, par_trd_t *trd);
+int *trend_x(date_t *d_fld, int nf, int by);
+void trend_tcrit(int nf, par_trd_t *trd, float **tcrit, bool **t_ok);
+
+
+/** This function computes the position of each fold relative to the first
++++ fold, i.e. the independent variable of the regression.
+--- d_fld:  dates of folded time series
+--- nf:     number of folds
+--- by:     aggregation period of fold
++++ Return: positions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int *trend_x(date_t *d_fld, int nf, int by){
+int f, *x = NULL;
+
+
+  alloc((void**)&x, nf, sizeof(int));
+
+  for (f=0; f<nf; f++) x[f] = fold_key(&d_fld[f], by) - fold_key(&d_fld[0], by);
+
+  return x;
+}
+
+
+/** This function computes the critical t-scores for the significance of
++++ slope, for any number of observations up to the number of folds. The
++++ t-score only depends on the degrees of freedom, thus it is looked up 
++++ once for all pixels, and computed once per run (see tscore_cached).
+--- nf:     number of folds
+--- trd:    trend parameters
+--- tcrit:  critical t-score for n observations (returned)
+--- t_ok:   could the t-score be computed? (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void trend_tcrit(int nf, par_trd_t *trd, float **tcrit, bool **t_ok){
+int n;
+
+
+  alloc((void**)tcrit, nf+1, sizeof(float));
+  alloc((void**)t_ok,  nf+1, sizeof(bool));
+
+  for (n=3; n<=nf; n++){
+    (*t_ok)[n] = tscore_cached(1-trd->conf, n-2, trd->tail, &(*tcrit)[n]) == SUCCESS;
+  }
+
+  return;
+}
 
 
 /** This function computes a trend analysis for any time series. Currently
@@ -54,12 +100,19 @@ double off, slp, rsq, yhat;
 double e, ssqe, sae;
 double sxsq, maxe, seb;
 double mae, rmse;
+int *x_fld = NULL;
+float *tcrit = NULL;
+bool *t_ok = NULL;
 
 
   if (trd_ == NULL) return CANCEL;
 
+  // fold positions and critical t-scores, shared by all pixels
+  x_fld = trend_x(d_fld, nf, by);
+  trend_tcrit(nf, trd, &tcrit, &t_ok);
+
 
-  #pragma omp parallel private(b,f,x,mx,my,vx,vy,cv,k,ssqe,sae,sxsq,maxe,seb,mae,rmse,off,slp,rsq,yhat,e,sig) shared(mask_,fld_,d_fld,trd_,nc,nf,by,nodata,in_ce,trd) default(none)
+  #pragma omp parallel private(b,f,x,mx,my,vx,vy,cv,k,ssqe,sae,sxsq,maxe,seb,mae,rmse,off,slp,rsq,yhat,e,sig) shared(mask_,fld_,x_fld,tcrit,t_ok,trd_,nc,nf,nodata,in_ce,trd) default(none)
   {
 
     #pragma omp for
@@ -80,23 +133,7 @@ double mae, rmse;
 
         if (fld_[f][p] == nodata) continue;
 
-        switch (by){
-          case _FLD_YEAR_:
-            x = d_fld[f].year - d_fld[0].year;
-            break;
-          case _FLD_QUARTER_:
-            x = d_fld[f].quarter - d_fld[0].quarter;
-            break;
-          case _FLD_MONTH_:
-            x = d_fld[f].month - d_fld[0].month;
-            break;
-          case _FLD_WEEK_:
-            x = d_fld[f].week - d_fld[0].week;
-            break;
-          case _FLD_DOY_:
-            x = d_fld[f].doy - d_fld[0].doy;
-            break;
-        }
+        x = x_fld[f];
 
         k++;
         if (k == 1){
@@ -127,23 +164,7 @@ double mae, rmse;
 
         if (fld_[f][p] == nodata) continue;
 
-        switch (by){
-          case _FLD_YEAR_:
-            x = d_fld[f].year - d_fld[0].year;
-            break;
-          case _FLD_QUARTER_:
-            x = d_fld[f].quarter - d_fld[0].quarter;
-            break;
-          case _FLD_MONTH_:
-            x = d_fld[f].month - d_fld[0].month;
-            break;
-          case _FLD_WEEK_:
-            x = d_fld[f].week - d_fld[0].week;
-            break;
-          case _FLD_DOY_:
-            x = d_fld[f].doy - d_fld[0].doy;
-            break;
-        }
+        x = x_fld[f];
 
         linreg_predict(x, slp, off, &yhat);
         e = fld_[f][p] - yhat;
@@ -164,7 +185,7 @@ double mae, rmse;
 
       // standard error of slope, and significance of slope
       seb = sqrt(1.0/(k-2)*ssqe)/sqrt(sxsq);
-      sig = slope_significant(1-trd->conf, trd->tail, k, slp, 0.0, seb);
+      sig = (t_ok[(int)k]) ? slope_significance(tcrit[(int)k], trd->tail, slp, 0.0, seb) : 0;
 
       // account for values given in continuous days
       if (in_ce) slp *= 1000;
@@ -194,6 +215,10 @@ double mae, rmse;
 
   }
 
+  free((void*)x_fld);
+  free((void*)tcrit);
+  free((void*)t_ok);
+
   return SUCCESS;
 }
 
@@ -225,15 +250,24 @@ double off, slp, rsq, yhat;
 double e, ssqe, sae;
 double sxsq, maxe, seb;
 double mae, rmse;
+int *x_fld = NULL, *f_next = NULL;
+float *tcrit = NULL;
+bool *t_ok = NULL;
 
 
 
   if (cat_ == NULL) return CANCEL;
 
+  // fold positions and critical t-scores, shared by all pixels
+  x_fld = trend_x(d_fld, nf, by);
+  trend_tcrit(nf, trd, &tcrit, &t_ok);
 
-  #pragma omp parallel private(b,part,f,f_pre,f_post,f_change,f_min,f_max,f_len,change,change_now,change_real,x,mx,my,vx,vy,cv,k,ssqe,sae,sxsq,maxe,seb,mae,rmse,off,slp,rsq,yhat,e,sig) shared(mask_,fld_,d_fld,cat_,nc,nf,by,nodata,in_ce,trd) default(none)
+
+  #pragma omp parallel private(b,part,f,f_pre,f_post,f_next,f_change,f_min,f_max,f_len,change,change_now,change_real,x,mx,my,vx,vy,cv,k,ssqe,sae,sxsq,maxe,seb,mae,rmse,off,slp,rsq,yhat,e,sig) shared(mask_,fld_,d_fld,x_fld,tcrit,t_ok,cat_,nc,nf,by,nodata,in_ce,trd) default(none)
   {
 
+    alloc((void**)&f_next, nf, sizeof(int));
+
     #pragma omp for
     for (p=0; p<nc; p++){
 
@@ -246,57 +280,47 @@ double mae, rmse;
       f_change = 0;
       change = SHRT_MIN;
 
-      // find largest change
-      for (f=1; f<nf; f++){
+      // next valid fold
+      if (trd->penalty){
+        for (f=nf-1, f_post=nf; f>=0; f--){
+          f_next[f] = f_post;
+          if (fld_[f][p] != nodata) f_post = f;
+        }
+      }
+
+      // find largest change between consecutive valid folds
+      for (f=0, f_pre=-1; f<nf; f++){
 
         if (fld_[f][p] == nodata) continue;
 
-        f_pre = f-1;
-        while (f_pre >= 0 && fld_[f_pre][p] == nodata) f_pre--;
-        if (f_pre < 0 || fld_[f_pre][p] == nodata) continue;
+        if (f_pre >= 0){
 
-        change_now  = change_real = (float)(fld_[f_pre][p] - fld_[f][p]);
+          change_now  = change_real = (float)(fld_[f_pre][p] - fld_[f][p]);
 
-        if (change_now > 0 && trd->penalty){
+          if (change_now > 0 && trd->penalty){
 
-          f_post = f+1;
-          while (f_post < nf && fld_[f_post][p] == nodata) f_post++;
-          if (f_post >= nf || fld_[f_post][p] == nodata) continue;
+            // last valid fold cannot be penalized
+            if ((f_post = f_next[f]) >= nf) break;
   
-          change_now *= (float)(fld_[f_pre][p] - fld_[f_post][p]) / 1e4;
+            change_now *= (float)(fld_[f_pre][p] - fld_[f_post][p]) / 1e4;
 
-        }
+          }
+
+          if (change_now > change){
+            change = change_real;
+            f_change = f;
+          }
 
-        if (change_now > change){
-          change = change_real;
-          f_change = f;
         }
 
+        f_pre = f;
+
       }
 
       if (change == SHRT_MIN) continue;
 
 
-      switch (by){
-        case _FLD_YEAR_:
-          x = d_fld[f_change].year;
-          break;
-        case _FLD_QUARTER_:
-          x = d_fld[f_change].quarter;
-          break;
-        case _FLD_MONTH_:
-          x = d_fld[f_change].month;
-          break;
-        case _FLD_WEEK_:
-          x = d_fld[f_change].week;
-          break;
-        case _FLD_DOY_:
-          x = d_fld[f_change].doy;
-          break;
-        default:
-          x = 0;
-          break;
-      }
+      x = fold_key(&d_fld[f_change], by);
 
       cat_[_CAT_CHANGE_][p] = (short)change;
       cat_[_CAT_YEAR_][p] = (short)x;
@@ -321,23 +345,7 @@ double mae, rmse;
 
           if (fld_[f][p] == nodata) continue;
 
-          switch (by){
-            case _FLD_YEAR_:
-              x = d_fld[f].year - d_fld[0].year;
-              break;
-            case _FLD_QUARTER_:
-              x = d_fld[f].quarter - d_fld[0].quarter;
-              break;
-            case _FLD_MONTH_:
-              x = d_fld[f].month - d_fld[0].month;
-              break;
-            case _FLD_WEEK_:
-              x = d_fld[f].week - d_fld[0].week;
-              break;
-            case _FLD_DOY_:
-              x = d_fld[f].doy - d_fld[0].doy;
-              break;
-          }
+          x = x_fld[f];
 
           k++;
           if (k == 1){
@@ -373,23 +381,7 @@ double mae, rmse;
 
           if (fld_[f][p] == nodata) continue;
 
-          switch (by){
-            case _FLD_YEAR_:
-              x = d_fld[f].year - d_fld[0].year;
-              break;
-            case _FLD_QUARTER_:
-              x = d_fld[f].quarter - d_fld[0].quarter;
-              break;
-            case _FLD_MONTH_:
-              x = d_fld[f].month - d_fld[0].month;
-              break;
-            case _FLD_WEEK_:
-              x = d_fld[f].week - d_fld[0].week;
-              break;
-            case _FLD_DOY_:
-              x = d_fld[f].doy - d_fld[0].doy;
-              break;
-          }
+          x = x_fld[f];
 
           linreg_predict(x, slp, off, &yhat);
           e = fld_[f][p] - yhat;
@@ -409,7 +401,7 @@ double mae, rmse;
 
         // standard error of slope, and significance of slope
         seb = sqrt(1.0/(k-2)*ssqe)/sqrt(sxsq);
-        sig = slope_significant(1-trd->conf, trd->tail, k, slp, 0.0, seb);
+        sig = (t_ok[(int)k]) ? slope_significance(tcrit[(int)k], trd->tail, slp, 0.0, seb) : 0;
 
         rmse = sqrt(ssqe/k);
         mae = sae/k;
@@ -445,8 +437,14 @@ double mae, rmse;
 
     }
 
+    free((void*)f_next);
+
   }
 
+  free((void*)x_fld);
+  free((void*)tcrit);
+  free((void*)t_ok);
+
 
   return SUCCESS;
 }
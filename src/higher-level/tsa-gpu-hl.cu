@@ -0,0 +1,784 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2022 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains the Time Series Analysis chain on the GPU
++++ The kernels mirror the CPU code in index-hl.c, interpolate-hl.c, stm-
++++ hl.c and fold-hl.c, one thread per pixel. All arrays are band-major
++++ with the brick stride, i.e. neighboring threads read neighboring
++++ cells, and the products can be downloaded into the brick slabs with
++++ one copy each. Without FORCE_CUDA, this file is compiled as C++ and
++++ tsa_gpu always cancels.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "tsa-gpu-hl.h"
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#include <climits>        // limits of integral types
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define GPU_NTHREAD 256
+
+
+/** device statistics, identical to stats-cl.c
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+__device__ void kurt_recurrence_gpu(double x, double *mx, double *vx, double *sx, double *kx, double n){
+double delta, delta_n, delta_n2, tmp;
+
+  delta = x-(*mx);
+  delta_n = delta/n;
+  delta_n2 = delta_n*delta_n;
+  tmp = delta*delta_n*(n-1);
+
+  *mx = *mx + delta_n;
+  *kx = *kx + tmp*delta_n2*(n*n-3*n+3) + 6*delta_n2*(*vx) - 4*delta_n*(*sx);
+  *sx = *sx + tmp*delta_n*(n-2) - 3*delta_n*(*vx);
+  *vx  = *vx + tmp;
+
+  return;
+}
+
+__device__ double variance_gpu(double var, double n){
+  return(var/(n-1));
+}
+
+__device__ double standdev_gpu(double var, double n){
+  return(sqrt(variance_gpu(var, n)));
+}
+
+__device__ double kurtosis_gpu(double var, double kurt, double n){
+  return(kurt/(n*variance_gpu(var, n+1)*variance_gpu(var, n+1)));
+}
+
+__device__ double skewness_gpu(double var, double skew, double n){
+  return(skew/(n*pow(standdev_gpu(var, n+1),3)));
+}
+
+// position of a quantile in the sorted array, see quantile_rank
+__device__ int quantile_rank_gpu(int n, float p){
+  return (int) (n-1)/(1/p);
+}
+
+// heap sort on a strided array, x[i*s]; the values are index values,
+// thus they are sorted as int16, which is exact, and half the scratch
+__device__ void sort_gpu(short *x, size_t s, int n){
+int i, root, child, end;
+short tmp;
+
+  for (end=n-1, i=n/2-1; end>0; ){
+
+    if (i >= 0){
+      // build the heap
+      root = i--;
+    } else {
+      // move the largest element to the end
+      tmp = x[0]; x[0] = x[(size_t)end*s]; x[(size_t)end*s] = tmp;
+      end--;
+      root = 0;
+    }
+
+    // sift down
+    while ((child = 2*root+1) <= end){
+      if (child < end && x[(size_t)child*s] < x[(size_t)(child+1)*s]) child++;
+      if (x[(size_t)root*s] >= x[(size_t)child*s]) break;
+      tmp = x[(size_t)root*s]; x[(size_t)root*s] = x[(size_t)child*s]; x[(size_t)child*s] = tmp;
+      root = child;
+    }
+
+  }
+
+  return;
+}
+
+// quick select on a strided array, x[i*s]
+__device__ short quantile_gpu(short *x, size_t s, int n, float p){
+int left = 0, right = n - 1, r, w, k;
+short piv, tmp;
+
+  k = (int) (n-1)/(1/p);
+
+  while (left < right){
+
+    r = left;
+    w = right;
+    piv = x[(size_t)((r+w)/2)*s];
+
+    while (r < w){
+      if (x[(size_t)r*s] >= piv){
+        tmp = x[(size_t)r*s]; x[(size_t)r*s] = x[(size_t)w*s]; x[(size_t)w*s] = tmp;
+        w--;
+      } else {
+        r++;
+      }
+    }
+
+    if (x[(size_t)left*s] == x[(size_t)right*s]) return x[(size_t)k*s];
+
+    if (x[(size_t)r*s] > piv) r--;
+
+    if (k <= r){
+      right = r;
+    } else {
+      left = r + 1;
+    }
+
+  }
+
+  return x[(size_t)k*s];
+}
+
+
+/** kernels
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+// float to short, as on the host: out-of-range values wrap, and values
+// beyond the int range become 0, instead of saturating
+__device__ short to_short_gpu(float x){
+
+  if (!(x > -2147483648.0f && x < 2147483648.0f)) return 0;
+
+  return (short)(int)x;
+}
+
+// one index value of one date, see index_band, index_differenced, ...
+// The arithmetic follows the CPU code step by step, in the same precision
+// (compiled without FMA contraction), such that the values are identical
+__device__ short index_value_gpu(const short *dat, size_t s, int p, const index_def_t *def, short nodata){
+const int *b = def->band;
+const float *f = def->f;
+float tmp, ind, x, sigma, diff, upper, lower, nir, red, blue;
+int i, comp0, comp1;
+float xtc[3] = { 1, 1, 1 };
+const float tc[3][6] = {
+{ 0.2043,  0.4158,  0.5524, 0.5741,  0.3124,  0.2303 },
+{-0.1603, -0.2819, -0.4934, 0.7940, -0.0002, -0.1446 },
+{ 0.0315,  0.2021,  0.3102, 0.1594, -0.6806, -0.6109 }};
+
+#define BAND(k) dat[(size_t)b[k]*s+p]
+
+  switch (def->family){
+
+    case _INDEX_BAND_:
+      return BAND(0);
+
+    case _INDEX_DIFF_:
+      tmp = (BAND(0)+BAND(1));
+      ind = (BAND(0)-BAND(1))/tmp;
+      if (tmp == 0 || ind < -1 || ind > 1) return nodata;
+      return to_short_gpu(ind*10000.0f);
+
+    case _INDEX_RATIO_:
+      ind = (BAND(0) / (float)BAND(1)) - 1.0;
+      if (BAND(1) == 0 || ind*1000.0f > SHRT_MAX || ind*1000.0f < SHRT_MIN) return nodata;
+      return to_short_gpu(ind*1000.0f);
+
+    case _INDEX_MSRRE_:
+      if (BAND(1) == 0) return nodata;
+      upper = (BAND(0) / (float)BAND(1)) - 1.0;
+      lower = sqrt((double)((BAND(0) / (float)BAND(1)) + 1.0));
+      ind = upper/lower;
+      if (lower == 0 || ind*10000.0f > SHRT_MAX || ind*10000.0f < SHRT_MIN) return nodata;
+      return to_short_gpu(ind*10000.0f);
+
+    case _INDEX_KERNEL_:
+      if (BAND(0) <= 0 || BAND(1) <= 0) return nodata;
+      sigma = 0.5 * (BAND(0) + BAND(1));
+      diff  = BAND(0) - BAND(1);
+      tmp   = exp((double)(-(diff*diff) / (2*sigma*sigma)));
+      ind   = (1-tmp) / (1+tmp);
+      return to_short_gpu(ind*10000.0f);
+
+    case _INDEX_RESIST_:
+      x    = (def->opt) ? 1.0f : 0.0f;
+      nir  = BAND(0);
+      red  = BAND(1);
+      blue = BAND(2);
+      red -= x*(blue-red);
+      tmp = nir+f[1]*red-f[2]*blue+f[3]*10000.0f;
+      ind = f[0]*(nir-red)/tmp;
+      if (tmp == 0) return nodata;
+      return to_short_gpu(ind*10000.0f);
+
+    case _INDEX_TASSEL_:
+      comp0 = def->opt; comp1 = def->opt+1;
+      if (def->opt == TCD){ comp0 = 0; comp1 = 3; xtc[1] = -1; xtc[2] = -1;}
+      for (i=comp0, ind=0; i<comp1; i++){
+        tmp = tc[i][0]*BAND(0) + tc[i][1]*BAND(1) + 
+              tc[i][2]*BAND(2) + tc[i][3]*BAND(3) + 
+              tc[i][4]*BAND(4) + tc[i][5]*BAND(5);
+        ind += xtc[i]*tmp;
+      }
+      return to_short_gpu(ind);
+
+    case _INDEX_CONTREM_:
+      tmp = (BAND(1) * (f[2] - f[0]) + 
+             BAND(2) * (f[0] - f[1])) / 
+            (f[2] - f[1]);
+      return to_short_gpu(BAND(0) - tmp);
+
+  }
+
+#undef BAND
+
+  return nodata;
+}
+
+// spectral indices; all indices of a pixel are computed in one go, such
+// that the bands are read once. Index j goes to tss[(j*nt+t)*s]
+__global__ void index_kernel(const short * const *ard, const small * const *msk, const small *mask,
+  const index_def_t *index, int nidx, short *tss, int nc, int nt, size_t s, short nodata){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+int t, j;
+
+  if (p >= nc) return;
+
+  for (t=0; t<nt; t++){
+
+    for (j=0; j<nidx; j++){
+
+      if ((mask != NULL && !mask[p]) || !msk[t][p]){
+        tss[((size_t)j*nt+t)*s+p] = nodata;
+      } else {
+        tss[((size_t)j*nt+t)*s+p] = index_value_gpu(ard[t], s, p, &index[j], nodata);
+      }
+
+    }
+
+  }
+
+  return;
+}
+
+// RBF kernel bank on the device, see rbf_bank
+typedef struct {
+  int nk;
+  const int *off, *n, *t;
+  const float *w, *max_w;
+} gpu_rbf_t;
+
+// interpolation, see interpolate_none, interpolate_linear, interpolate_moving,
+// and interpolate_rbf
+__global__ void interpolate_kernel(const short *tss, const int *__restrict__ ce_tss, const int *__restrict__ ce_tsi, const small *mask,
+  short *tsi, int nc, int nt, int ni, size_t s, int method, int mov_max, gpu_rbf_t rbf, short nodata){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+int t, t_left, i;
+float x_left, x_right, x, x_;
+float y_left, y_right, y;
+double sum, num;
+double sum_yw, sum_w, sum_kd, sum_d;
+int k, e;
+
+  if (p >= nc) return;
+
+  // index
+  tss += (size_t)blockIdx.y*nt*s;
+  tsi += (size_t)blockIdx.y*ni*s;
+
+  if (mask != NULL && !mask[p]){
+    // NONE leaves masked cells untouched
+    if (method != _INT_NONE_) for (i=0; i<ni; i++) tsi[i*s+p] = nodata;
+    return;
+  }
+
+  if (method == _INT_NONE_){
+    for (t=0; t<nt; t++) tsi[t*s+p] = tss[t*s+p];
+    return;
+  }
+
+  if (method == _INT_RBF_){
+    for (i=0; i<ni; i++){
+      for (k=0, sum_kd=0, sum_d=0; k<rbf.nk; k++){
+        sum_yw = sum_w = 0.0;
+        for (e=rbf.off[i*rbf.nk+k]; e<rbf.off[i*rbf.nk+k]+rbf.n[i*rbf.nk+k]; e++){
+          if (tss[rbf.t[e]*s+p] == nodata) continue;
+          sum_yw += tss[rbf.t[e]*s+p]*rbf.w[e];
+          sum_w  += rbf.w[e];
+        }
+        if (sum_w > 0){
+          sum_kd += sum_yw/rbf.max_w[k];
+          sum_d  += sum_w/rbf.max_w[k];
+        }
+      }
+      if (sum_d > 0){
+        y = sum_kd/sum_d;
+        tsi[i*s+p] = (short)y;
+      } else {
+        tsi[i*s+p] = nodata;
+      }
+    }
+    return;
+  }
+
+  for (i=0, t_left=0; i<ni; i++){
+
+    x = ce_tsi[i];
+
+    if (method == _INT_LINEAR_){
+
+      x_left = x_right = INT_MIN;
+      y_left = y_right = nodata;
+
+      for (t=t_left; t<nt; t++){
+
+        if (tss[t*s+p] == nodata) continue;
+
+        if (ce_tss[t] < x){
+          x_left = ce_tss[t];
+          y_left = tss[t*s+p];
+          t_left = t;
+        } else if (ce_tss[t] == x){
+          x_left = x_right = x;
+          y_left = y_right = tss[t*s+p];
+          t_left = t;
+          break;
+        } else if (ce_tss[t] > x){
+          x_right = ce_tss[t];
+          y_right = tss[t*s+p];
+          break;
+        }
+
+      }
+
+      if (x_left < 0 && x_right < 0){
+        y = nodata;
+      } else if (x_left < 0){
+        y = y_right;
+      } else if (x_right < 0){
+        y = y_left;
+      } else if (x_left == x_right){
+        y = (y_left+y_right)/2.0;
+      } else {
+        y = (y_left*(x_right-x) + y_right*(x-x_left))/(x_right-x_left);
+      }
+
+      tsi[i*s+p] = (short)y;
+
+    } else {
+
+      sum = num = 0.0;
+
+      for (t=t_left; t<nt; t++){
+
+        if (tss[t*s+p] == nodata) continue;
+
+        x_ = ce_tss[t];
+
+        if (x-x_ > mov_max){
+          t_left = t;
+          continue;
+        } else if (x_-x > mov_max){
+          break;
+        } else {
+          sum += tss[t*s+p];
+          num++;
+        }
+
+      }
+
+      if (num > 0){
+         tsi[i*s+p] = (short)(sum/num);
+      } else {
+         tsi[i*s+p] = nodata;
+      }
+
+    }
+
+  }
+
+  return;
+}
+
+// spectral temporal metrics, see tsa_stm
+__global__ void stm_kernel(const short *tsi, const small *mask, short *stm, short *q_array,
+  int nc, int ni, int nq, size_t s, par_sta_t sta, short nodata){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+int t, b, n, q;
+short minimum, maximum;
+double mean, var;
+double skew, kurt;
+double skewscaled, kurtscaled;
+bool alloc_q_array = (sta.quantiles || sta.iqr > -1);
+short *q_ = (q_array != NULL) ? q_array + (size_t)blockIdx.y*nq*s + p : NULL;
+
+  if (p >= nc) return;
+
+  // index
+  tsi += (size_t)blockIdx.y*ni*s;
+  stm += (size_t)blockIdx.y*sta.nmetrics*s;
+
+  if (mask != NULL && !mask[p]){
+    for (b=0; b<sta.nmetrics; b++) stm[b*s+p] = nodata;
+    return;
+  }
+
+  mean = var = skew = kurt = n = 0;
+  minimum = SHRT_MAX; maximum = SHRT_MIN;
+
+  for (t=0; t<ni; t++){
+
+    if (tsi[t*s+p] == nodata) continue;
+
+    if (tsi[t*s+p] < minimum) minimum = tsi[t*s+p];
+    if (tsi[t*s+p] > maximum) maximum = tsi[t*s+p];
+
+    if (alloc_q_array) q_[n*s] = tsi[t*s+p];
+
+    n++;
+
+    kurt_recurrence_gpu(tsi[t*s+p], &mean, &var, &skew, &kurt, n);
+
+  }
+
+  if (n > 0){
+    skewscaled = skewness_gpu(var, skew, n)*1000;
+    kurtscaled = (kurtosis_gpu(var, kurt, n)-3)*1000;
+    if (skewscaled < -30000) skewscaled = -30000;
+    if (skewscaled >  30000) skewscaled =  30000;
+    if (kurtscaled < -30000) kurtscaled = -30000;
+    if (kurtscaled >  30000) kurtscaled =  30000;
+    if (sta.num > -1) stm[sta.num*s+p] = n;
+    if (sta.min > -1) stm[sta.min*s+p] = minimum;
+    if (sta.max > -1) stm[sta.max*s+p] = maximum;
+    if (sta.rng > -1) stm[sta.rng*s+p] = maximum-minimum;
+    if (sta.avg > -1) stm[sta.avg*s+p] = (short)mean;
+    if (sta.std > -1) stm[sta.std*s+p] = (short)standdev_gpu(var, n);
+    if (sta.skw > -1) stm[sta.skw*s+p] = (short)skewscaled;
+    if (sta.krt > -1) stm[sta.krt*s+p] = (short)kurtscaled;
+
+    // all quantiles from one sort, see quantiles
+    if (alloc_q_array) sort_gpu(q_, s, n);
+
+    if (sta.quantiles){
+      for (q=0; q<sta.nquantiles; q++){
+        stm[sta.qxx[q]*s+p] = (short)q_[(size_t)quantile_rank_gpu(n, sta.q[q])*s];
+      }
+    }
+
+    if (sta.iqr > -1){
+      stm[sta.iqr*s+p] = (short)q_[(size_t)quantile_rank_gpu(n, 0.75)*s] -
+                         (short)q_[(size_t)quantile_rank_gpu(n, 0.25)*s];
+    }
+  } else {
+    for (b=0; b<sta.nmetrics; b++) stm[b*s+p] = nodata;
+  }
+
+  return;
+}
+
+// folding, see fold
+__global__ void fold_kernel(const short *tsi, const int *fold_of, const small *mask, short *fld, short *q_array,
+  int nc, int ni, int nf, int nq, size_t s, int type, short nodata){
+int p = blockIdx.x*blockDim.x + threadIdx.x;
+int f, t, n;
+short minimum, maximum;
+double mean, var;
+double skew, kurt;
+double skewscaled, kurtscaled;
+bool alloc_q_array = ((type >= _STA_Q01_ && type <= _STA_Q99_) || type == _STA_IQR_);
+short *q_ = (q_array != NULL) ? q_array + (size_t)blockIdx.y*nq*s + p : NULL;
+
+  if (p >= nc) return;
+
+  // index
+  tsi += (size_t)blockIdx.y*ni*s;
+  fld += (size_t)blockIdx.y*nf*s;
+
+  if (mask != NULL && !mask[p]){
+    for (f=0; f<nf; f++) fld[f*s+p] = nodata;
+    return;
+  }
+
+  for (f=0; f<nf; f++){
+
+    mean = var = skew = kurt = n = 0;
+    minimum = SHRT_MAX; maximum = SHRT_MIN;
+
+    for (t=0; t<ni; t++){
+
+      if (fold_of[t] != f) continue;
+
+      if (tsi[t*s+p] == nodata) continue;
+
+      if (tsi[t*s+p] < minimum) minimum = tsi[t*s+p];
+      if (tsi[t*s+p] > maximum) maximum = tsi[t*s+p];
+
+      if (alloc_q_array) q_[n*s] = tsi[t*s+p];
+
+      n++;
+
+      kurt_recurrence_gpu(tsi[t*s+p], &mean, &var, &skew, &kurt, n);
+
+    }
+
+    if (n > 0){
+
+      switch (type){
+        case _STA_NUM_:
+          fld[f*s+p] = n;
+          break;
+        case _STA_AVG_:
+          fld[f*s+p] = (short)mean;
+          break;
+        case _STA_MIN_:
+          fld[f*s+p] = minimum;
+          break;
+        case _STA_MAX_:
+          fld[f*s+p] = maximum;
+          break;
+        case _STA_RNG_:
+          fld[f*s+p] = maximum-minimum;
+          break;
+        case _STA_STD_:
+          fld[f*s+p] = (short)standdev_gpu(var, n);
+          break;
+        case _STA_SKW_:
+          skewscaled = skewness_gpu(var, skew, n)*1000;
+          if (skewscaled < -30000) skewscaled = -30000;
+          if (skewscaled >  30000) skewscaled =  30000;
+          fld[f*s+p] = (short)skewscaled;
+          break;
+        case _STA_KRT_:
+          kurtscaled = (kurtosis_gpu(var, kurt, n)-3)*1000;
+          if (kurtscaled < -30000) kurtscaled = -30000;
+          if (kurtscaled >  30000) kurtscaled =  30000;
+          fld[f*s+p] = (short)kurtscaled;
+          break;
+        case _STA_IQR_:
+          fld[f*s+p] = (short)(quantile_gpu(q_, s, n, 0.75)-quantile_gpu(q_, s, n, 0.25));
+          break;
+      }
+
+      if (type >= _STA_Q01_ && type <= _STA_Q99_){
+        fld[f*s+p] = (short)quantile_gpu(q_, s, n, (type-_STA_Q01_+1)/100.0);
+      }
+
+    } else {
+
+      fld[f*s+p] = nodata;
+
+    }
+
+  }
+
+  return;
+}
+
+#endif
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function runs the TSA chain on the GPU, i.e. spectral index,
++++ interpolation, STM and folds. All indices of the job are computed in
++++ one go: one index launch for all of them, and one launch per step 
++++ with one grid row per index. The ARD (job->ard, msk) must already be
++++ on the device, enqueued in the same stream. All intermediate arrays
++++ stay on the device; only the products with a host slab are download-
++++ ed. All data stay int16 on the device, i.e. transfers and device me-
++++ mory are the size of the data on disc; the kernels compute in fp32 or
++++ fp64 registers. The function returns after the downloads are complete.
+--- job:    TSA chain
+--- stream: stream of the processing unit
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int tsa_gpu(tsa_gpu_t *job, gpu_stream_t stream){
+#ifdef FORCE_CUDA
+cudaStream_t s = (cudaStream_t)gpu_cuda_stream(stream);
+size_t bytes_ptr, bytes_idx, bytes_tss, bytes_tsi, bytes_stm, bytes_q = 0;
+size_t bytes_fld[GPU_NFOLD];
+size_t one_tss, one_tsi, one_stm, one_fld[GPU_NFOLD];
+const void **ptr = NULL;
+void **d_ptr = NULL;
+index_def_t *d_idx = NULL;
+int *d_ce = NULL, *d_fold_of = NULL;
+int *d_rbf_i = NULL;
+float *d_rbf_f = NULL;
+size_t bytes_rbf_i = 0, bytes_rbf_f = 0;
+gpu_rbf_t rbf = { 0, NULL, NULL, NULL, NULL, NULL };
+short *d_tss = NULL, *d_tsi = NULL, *d_stm = NULL;
+short *d_fld[GPU_NFOLD];
+short *d_q = NULL;
+int nblock, t, j, k, nqfold;
+int error = 0;
+
+
+  if (!gpu_enabled() || gpu_select(stream) == FAILURE) return CANCEL;
+
+  nblock = (job->nc + GPU_NTHREAD - 1) / GPU_NTHREAD;
+
+  dim3 grid(nblock, job->nidx);
+
+  // cells per index
+  one_tss = job->nt*job->stride;
+  one_tsi = job->ni*job->stride;
+  one_stm = (job->stm != NULL) ? job->sta->nmetrics*job->stride : 0;
+
+  bytes_ptr = 2*job->nt*sizeof(void*);
+  bytes_idx = job->nidx*sizeof(index_def_t);
+  bytes_tss = job->nidx*one_tss*sizeof(short);
+  bytes_tsi = job->nidx*one_tsi*sizeof(short);
+  bytes_stm = job->nidx*one_stm*sizeof(short);
+
+  nqfold = ((job->fld_type >= _STA_Q01_ && job->fld_type <= _STA_Q99_) || job->fld_type == _STA_IQR_);
+  if ((job->stm != NULL && (job->sta->quantiles || job->sta->iqr > -1)) || nqfold){
+    // quantile scratch of the interpolated values, int16 as the data
+    bytes_q = job->nidx*one_tsi*sizeof(short);
+  }
+
+  if (job->method == _INT_RBF_){
+    bytes_rbf_i = (2*job->ni*job->rbf_nk + job->rbf_len)*sizeof(int);
+    bytes_rbf_f = (job->rbf_len + job->rbf_nk)*sizeof(float);
+  }
+
+  for (k=0; k<GPU_NFOLD; k++){
+    one_fld[k] = (job->fold[k] != NULL) ? job->nfold[k]*job->stride : 0;
+    bytes_fld[k] = job->nidx*one_fld[k]*sizeof(short);
+    d_fld[k] = NULL;
+  }
+
+
+  // device pointers of ARD, and dates
+  alloc((void**)&ptr, 2*job->nt, sizeof(void*));
+  for (t=0; t<job->nt; t++){
+    ptr[t]           = job->ard[t];
+    ptr[job->nt+t]   = job->msk[t];
+  }
+
+  if ((d_ptr     = (void**)gpu_alloc(bytes_ptr, stream)) == NULL) error++;
+  if ((d_idx     = (index_def_t*)gpu_alloc(bytes_idx, stream)) == NULL) error++;
+  if ((d_ce      = (int*)gpu_alloc((job->nt+job->ni)*sizeof(int), stream)) == NULL) error++;
+  if ((d_fold_of = (int*)gpu_alloc(GPU_NFOLD*job->ni*sizeof(int), stream)) == NULL) error++;
+  if ((d_tss     = (short*)gpu_alloc(bytes_tss, stream)) == NULL) error++;
+  if ((d_tsi     = (short*)gpu_alloc(bytes_tsi, stream)) == NULL) error++;
+  if (bytes_stm > 0 && (d_stm = (short*)gpu_alloc(bytes_stm, stream)) == NULL) error++;
+  if (bytes_q   > 0 && (d_q   = (short*)gpu_alloc(bytes_q, stream)) == NULL) error++;
+  if (bytes_rbf_i > 0 && (d_rbf_i = (int*)gpu_alloc(bytes_rbf_i, stream)) == NULL) error++;
+  if (bytes_rbf_f > 0 && (d_rbf_f = (float*)gpu_alloc(bytes_rbf_f, stream)) == NULL) error++;
+  for (k=0; k<GPU_NFOLD; k++){
+    if (bytes_fld[k] > 0 && (d_fld[k] = (short*)gpu_alloc(bytes_fld[k], stream)) == NULL) error++;
+  }
+
+  if (!error){
+
+    cudaMemcpyAsync(d_ptr, ptr, bytes_ptr, cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_idx, job->index, bytes_idx, cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_ce, job->ce_tss, job->nt*sizeof(int), cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(d_ce+job->nt, job->ce_tsi, job->ni*sizeof(int), cudaMemcpyHostToDevice, s);
+    for (k=0; k<GPU_NFOLD; k++){
+      if (job->fold[k] != NULL) cudaMemcpyAsync(d_fold_of+k*job->ni, job->fold_of[k],
+        job->ni*sizeof(int), cudaMemcpyHostToDevice, s);
+    }
+
+    if (d_rbf_i != NULL && d_rbf_f != NULL){
+      k = job->ni*job->rbf_nk;
+      cudaMemcpyAsync(d_rbf_i,     job->rbf_off, k*sizeof(int), cudaMemcpyHostToDevice, s);
+      cudaMemcpyAsync(d_rbf_i+k,   job->rbf_n,   k*sizeof(int), cudaMemcpyHostToDevice, s);
+      cudaMemcpyAsync(d_rbf_i+2*k, job->rbf_t,   job->rbf_len*sizeof(int), cudaMemcpyHostToDevice, s);
+      cudaMemcpyAsync(d_rbf_f,     job->rbf_w,   job->rbf_len*sizeof(float), cudaMemcpyHostToDevice, s);
+      cudaMemcpyAsync(d_rbf_f+job->rbf_len, job->rbf_max_w, job->rbf_nk*sizeof(float), cudaMemcpyHostToDevice, s);
+      rbf.nk    = job->rbf_nk;
+      rbf.off   = d_rbf_i;
+      rbf.n     = d_rbf_i+k;
+      rbf.t     = d_rbf_i+2*k;
+      rbf.w     = d_rbf_f;
+      rbf.max_w = d_rbf_f+job->rbf_len;
+    }
+
+    // cells that are not touched by the CPU code are zero, as in the bricks
+    cudaMemsetAsync(d_tsi, 0, bytes_tsi, s);
+
+    index_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(
+      (const short**)d_ptr, (const small**)d_ptr+job->nt, job->mask, 
+      d_idx, job->nidx, d_tss, job->nc, job->nt, job->stride, job->nodata);
+
+    interpolate_kernel<<<grid, GPU_NTHREAD, 0, s>>>(
+      d_tss, d_ce, d_ce+job->nt, job->mask, d_tsi, job->nc, job->nt, job->ni,
+      job->stride, job->method, job->mov_max, rbf, job->nodata);
+
+    if (d_stm != NULL){
+      stm_kernel<<<grid, GPU_NTHREAD, 0, s>>>(
+        d_tsi, job->mask, d_stm, d_q, job->nc, job->ni, job->ni, job->stride, *job->sta, job->nodata);
+    }
+
+    for (k=0; k<GPU_NFOLD; k++){
+      if (d_fld[k] == NULL) continue;
+      fold_kernel<<<grid, GPU_NTHREAD, 0, s>>>(
+        d_tsi, d_fold_of+k*job->ni, job->mask, d_fld[k], nqfold ? d_q : NULL,
+        job->nc, job->ni, job->nfold[k], job->ni, job->stride, job->fld_type, job->nodata);
+    }
+
+    if (cudaGetLastError() != cudaSuccess){
+      printf("launching TSA kernels failed. ");
+      error++;
+    }
+
+  }
+
+  if (!error){
+
+    // download products
+    for (j=0; j<job->nidx; j++){
+      if (job->tss != NULL) cudaMemcpyAsync(job->tss[j], d_tss+j*one_tss, one_tss*sizeof(short), cudaMemcpyDeviceToHost, s);
+      if (job->tsi != NULL) cudaMemcpyAsync(job->tsi[j], d_tsi+j*one_tsi, one_tsi*sizeof(short), cudaMemcpyDeviceToHost, s);
+      if (job->stm != NULL) cudaMemcpyAsync(job->stm[j], d_stm+j*one_stm, one_stm*sizeof(short), cudaMemcpyDeviceToHost, s);
+      for (k=0; k<GPU_NFOLD; k++){
+        if (d_fld[k] != NULL) cudaMemcpyAsync(job->fold[k][j], d_fld[k]+j*one_fld[k], 
+          one_fld[k]*sizeof(short), cudaMemcpyDeviceToHost, s);
+      }
+    }
+
+  }
+
+  if (gpu_sync(stream) == FAILURE) error++;
+
+
+  gpu_release(d_ptr,     bytes_ptr, stream);
+  gpu_release(d_idx,     bytes_idx, stream);
+  gpu_release(d_ce,      (job->nt+job->ni)*sizeof(int), stream);
+  gpu_release(d_fold_of, GPU_NFOLD*job->ni*sizeof(int), stream);
+  gpu_release(d_tss,     bytes_tss, stream);
+  gpu_release(d_tsi,     bytes_tsi, stream);
+  gpu_release(d_stm,     bytes_stm, stream);
+  gpu_release(d_q,       bytes_q, stream);
+  gpu_release(d_rbf_i,   bytes_rbf_i, stream);
+  gpu_release(d_rbf_f,   bytes_rbf_f, stream);
+  for (k=0; k<GPU_NFOLD; k++) gpu_release(d_fld[k], bytes_fld[k], stream);
+  free((void*)ptr);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
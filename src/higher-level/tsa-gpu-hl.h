@@ -0,0 +1,109 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Time Series Analysis on the GPU header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef TSAGPU_HL_H
+#define TSAGPU_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/gpu-cl.h"
+#include "../higher-level/param-hl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// index families, see index-hl.c; all but SMA and EXPR have a device kernel
+enum { _INDEX_BAND_, _INDEX_DIFF_, _INDEX_RATIO_, _INDEX_MSRRE_, 
+       _INDEX_KERNEL_, _INDEX_RESIST_, _INDEX_TASSEL_, _INDEX_CONTREM_,
+       _INDEX_SMA_, _INDEX_EXPR_, _INDEX_LENGTH_ };
+
+// Tasseled Cap components
+enum { TCB, TCG, TCW, TCD };
+
+// a spectral index, resolved to its family (see index_definition)
+typedef struct {
+  int family;    // index family
+  int band[6];   // bands, in the order of the family's arguments
+  float f[4];    // resistance factors, or wavelengths for continuum removal
+  int opt;       // red-blue correction (resistance), component (tasseled)
+  const index_expr_t *expr; // compiled band-math expression (host only)
+} index_def_t;
+
+// number of folding periods (year, quarter, month, week, doy)
+#define GPU_NFOLD 5
+
+// a TSA chain on the device: index, interpolation, STM, folds
+typedef struct {
+  int nc, nt, ni;        // number of cells, ARD dates, interpolation steps
+  size_t stride;         // cells per band in host and device arrays
+  short nodata;          // nodata value
+
+  // indices, computed in one go
+  int nidx;              // number of indices
+  index_def_t *index;    // index definitions (host)
+
+  // input (device pointers, listed in host arrays of length nt)
+  const short **ard;     // ARD band slabs, band b starts at b*stride
+  const small **msk;     // ARD masks
+  const small *mask;     // processing mask (device, optional)
+  int *ce_tss;           // dates of ARD (host)
+  int *ce_tsi;           // dates of interpolation steps (host)
+
+  // interpolation
+  int method;            // interpolation method (NONE, LINEAR, MOVING, RBF)
+  int mov_max;           // max. distance for moving average
+  int rbf_nk, rbf_len;   // RBF kernel bank (host), see rbf_bank
+  int *rbf_off, *rbf_n, *rbf_t;
+  float *rbf_w, *rbf_max_w;
+
+  // STM
+  par_sta_t *sta;        // STM parameters
+
+  // folds
+  int fld_type;               // folding statistic
+  int nfold[GPU_NFOLD];       // number of folds
+  int *fold_of[GPU_NFOLD];    // fold of each interpolation step, -1: none (host)
+
+  // host slabs that receive the products, one per index, NULL: not downloaded
+  short **tss;            // index time series
+  short **tsi;            // interpolated time series
+  short **stm;            // spectral temporal metrics
+  short **fold[GPU_NFOLD]; // folded time series
+} tsa_gpu_t;
+
+int tsa_gpu(tsa_gpu_t *job, gpu_stream_t stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
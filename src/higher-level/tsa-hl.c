@@ -39,14 +39,22 @@ typedef struct {
   short ***ptr;
 } brick_compile_info_t;
 
-enum { _full_, _stats_, _inter_, _nrt_, _year_, _quarter_, _month_, _week_, _day_, _lsp_, _pol_, _trd_, _cat_, _pyp_};
+enum { _full_, _stats_, _inter_, _nrt_, _year_, _quarter_, _month_, _week_, _day_, _lsp_, _pol_, _trd_, _cat_, _pyp_, _hcf_};
 
 
 void alloc_ts_dates(tsa_t *ts, par_hl_t *phl, int nt, int nr, int ni);
 void free_ts_dates(tsa_t *ts);
 void compile_ts_dates(ard_t *ard, tsa_t *ts, par_hl_t *phl, int nt, int nr, int ni);
+int tsa_state_filename(int idx, par_hl_t *phl, char *fname, int size);
 brick_t *compile_tsa_brick(brick_t *ard, int idx, brick_compile_info_t *info, par_hl_t *phl);
+brick_t *read_tsa_state(brick_t *from, int idx, short nodata, cube_t *cube, par_hl_t *phl);
 brick_t **compile_tsa(ard_t *ard, tsa_t *tsa, par_hl_t *phl, cube_t *cube, int nt, int nr, int ni, int idx, int *nproduct);
+void transpose_tsi(tsa_t *ts, int nc, int ni);
+void release_tsa_brick(brick_t **TSA, int nprod, short ***ptr);
+short **fold_product(tsa_t *ts, int by);
+int tsa_device(ard_t *ard, tsa_t *ts, int nidx, brick_t *mask, int nc, int nt, int ni, int idx, short nodata, par_hl_t *phl);
+bool tsa_windowed(par_hl_t *phl);
+int tsa_window(tsa_t *ts, small *mask_, int nc, int nt, int ni, short nodata, par_hl_t *phl);
 
 
 int info_tss(brick_compile_info_t *info, int o, int nt, tsa_t *ts, par_hl_t *phl){
@@ -77,6 +85,20 @@ int info_nrt(brick_compile_info_t *info, int o, int nr, tsa_t *ts, par_hl_t *phl
   return o+1;
 }
 
+int info_hcf(brick_compile_info_t *info, int o, tsa_t *ts, par_hl_t *phl){
+
+  copy_string(info[o].prodname, NPOW_02, "HCF");
+  info[o].prodlen  = phl->tsa.tsi.harm_nmodes*2 + 2;
+  info[o].bandname = NULL;
+  info[o].date     = NULL;
+  info[o].prodtype = _hcf_;
+  info[o].enable   = phl->tsa.tsi.onst;
+  info[o].write    = phl->tsa.tsi.onst;
+  info[o].ptr      = &ts->hcf_;
+
+  return o+1;
+}
+
 int info_tsi(brick_compile_info_t *info, int o, int ni, tsa_t *ts, par_hl_t *phl){
 
 
@@ -85,7 +107,17 @@ int info_tsi(brick_compile_info_t *info, int o, int ni, tsa_t *ts, par_hl_t *phl
   info[o].bandname = NULL;
   info[o].date     = NULL;
   info[o].prodtype = _inter_;
-  info[o].enable   = true;
+  info[o].enable   = (tsa_windowed(phl)) ? 0 :
+                     phl->tsa.tsi.otsi + phl->tsa.tsi.onrt + phl->tsa.tsi.onst + 
+                     phl->tsa.stm.ostm +
+                     phl->tsa.fld.ofby + phl->tsa.fld.otry + phl->tsa.fld.ocay +
+                     phl->tsa.fld.ofbq + phl->tsa.fld.otrq + phl->tsa.fld.ocaq +
+                     phl->tsa.fld.ofbm + phl->tsa.fld.otrm + phl->tsa.fld.ocam +
+                     phl->tsa.fld.ofbw + phl->tsa.fld.otrw + phl->tsa.fld.ocaw +
+                     phl->tsa.fld.ofbd + phl->tsa.fld.otrd + phl->tsa.fld.ocad +
+                     phl->tsa.lsp.ospl + phl->tsa.lsp.olsp + phl->tsa.lsp.otrd + phl->tsa.lsp.ocat +
+                     phl->tsa.pol.opct + phl->tsa.pol.opol + phl->tsa.pol.otrd + phl->tsa.pol.ocat +
+                     phl->tsa.pyp.out;
   info[o].write    = phl->tsa.tsi.otsi;
   info[o].ptr      = &ts->tsi_;
 
@@ -485,6 +517,9 @@ void free_ts_dates(tsa_t *ts){
   if (ts->d_lsp != NULL){ free((void*)ts->d_lsp); ts->d_lsp = NULL;}
   if (ts->d_pol != NULL){ free((void*)ts->d_pol); ts->d_pol = NULL;}
 
+  free_date_axis(&ts->ax_tss);
+  free_date_axis(&ts->ax_tsi);
+
   return;
 }
 
@@ -591,6 +626,9 @@ date_t date;
     }
   }
 
+  init_date_axis(&ts->ax_tss, ts->d_tss, nt);
+  init_date_axis(&ts->ax_tsi, ts->d_tsi, ni);
+
   return;
 }
 
@@ -622,7 +660,7 @@ int error = 0;
 brick_compile_info_t *info = NULL;
 
 
-  nprod = 6 +              // TSS, RMS, TSI, STM, SPL, NRT
+  nprod = 7 +              // TSS, RMS, TSI, STM, SPL, NRT, HCF
           5 +              // folds
           5 +              // trend on folds
           5 +              // cat on folds
@@ -641,6 +679,7 @@ brick_compile_info_t *info = NULL;
 
   o = info_tss(info, o, nt, ts, phl);
   o = info_nrt(info, o, nr, ts, phl);
+  o = info_hcf(info, o,     ts, phl);
   o = info_rms(info, o, nt, ts, phl);
   o = info_tsi(info, o, ni, ts, phl);
   o = info_stm(info, o,     ts, phl);
@@ -708,6 +747,20 @@ brick_compile_info_t *info = NULL;
               set_brick_bandname(TSA[o], t, domain);
               set_brick_date(TSA[o], t, date);
               break;
+            case _hcf_:
+              if (t == 0){
+                copy_string(fdate, NPOW_10, "INTERCEPT");
+              } else if (t == 1){
+                copy_string(fdate, NPOW_10, "TREND-DECADE");
+              } else {
+                nchar = snprintf(fdate, NPOW_10, "%s-%d", (t % 2 == 0) ? "COS" : "SIN", t/2);
+                if (nchar < 0 || nchar >= NPOW_10){ 
+                  printf("Buffer Overflow in assembling domain\n"); error++;}
+              }
+              set_brick_sensor(TSA[o], t, "BLEND");
+              set_brick_bandname(TSA[o], t, fdate);
+              set_brick_date(TSA[o], t, date);
+              break;
             case _stats_:
               set_brick_sensor(TSA[o], t, "BLEND");
               set_brick_bandname(TSA[o], t, _TAGGED_ENUM_STA_[phl->tsa.stm.sta.metrics[t]].tag);
@@ -889,6 +942,31 @@ brick_compile_info_t *info = NULL;
 }
 
 
+/** This function assembles the filename of the NRT state. The name is
++++ based on the harmonic fitting range instead of the processing period,
++++ such that subsequent runs with different processing periods find the
++++ state.
+--- idx:       spectral index
+--- phl:       HL parameters
+--- fname:     filename (returned)
+--- size:      length of the buffer for the filename
++++ Return:    SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int tsa_state_filename(int idx, par_hl_t *phl, char *fname, int size){
+int nchar;
+
+
+  nchar = snprintf(fname, size, "%04d-%04d_%03d-%03d_HL_TSA_%s_%s_HCF", 
+    phl->tsa.tsi.harm_fit_range[_MIN_].year, phl->tsa.tsi.harm_fit_range[_MAX_].year, 
+    phl->tsa.tsi.harm_fit_range[_MIN_].doy,  phl->tsa.tsi.harm_fit_range[_MAX_].doy, 
+    phl->sen.target, phl->tsa.index_name[idx]);
+  if (nchar < 0 || nchar >= size){ 
+    printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+  return SUCCESS;
+}
+
+
 /** This function compiles a TSA brick
 --- from:      brick from which most attributes are copied
 --- nb:        number of bands in brick
@@ -921,12 +999,16 @@ int nchar;
   set_brick_parentname(brick, phl->d_higher);
   set_brick_dirname(brick, dname);
 
-  nchar = snprintf(fname, NPOW_10, "%04d-%04d_%03d-%03d_HL_TSA_%s_%s_%s", 
-    phl->date_range[_MIN_].year, phl->date_range[_MAX_].year, 
-    phl->doy_range[_MIN_], phl->doy_range[_MAX_], 
-    phl->sen.target, phl->tsa.index_name[idx], info->prodname);
-  if (nchar < 0 || nchar >= NPOW_10){ 
-    printf("Buffer Overflow in assembling filename\n"); return NULL;}
+  if (info->prodtype == _hcf_){
+    if (tsa_state_filename(idx, phl, fname, NPOW_10) != SUCCESS) return NULL;
+  } else {
+    nchar = snprintf(fname, NPOW_10, "%04d-%04d_%03d-%03d_HL_TSA_%s_%s_%s", 
+      phl->date_range[_MIN_].year, phl->date_range[_MAX_].year, 
+      phl->doy_range[_MIN_], phl->doy_range[_MAX_], 
+      phl->sen.target, phl->tsa.index_name[idx], info->prodname);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); return NULL;}
+  }
   set_brick_filename(brick, fname);
   
   if (info->write){
@@ -935,7 +1017,8 @@ int nchar;
     set_brick_open(brick, OPEN_FALSE);
   }
   set_brick_format(brick, &phl->gdalopt);
-  set_brick_explode(brick, phl->explode);
+  // the NRT state is read back as one file
+  set_brick_explode(brick, (info->prodtype == _hcf_) ? false : phl->explode);
   set_brick_par(brick, phl->params->log);
 
   sprintf(domain, "%s_%s", phl->tsa.index_name[idx], info->prodname);
@@ -952,6 +1035,410 @@ int nchar;
 }
 
 
+/** This function reads the NRT state of a previous run, i.e. the harmonic
++++ coefficients of the current chunk.
+--- from:      brick from which the tile and chunk are taken
+--- idx:       spectral index
+--- nodata:    nodata value
+--- cube:      datacube definition
+--- phl:       HL parameters
++++ Return:    brick with NRT state (or NULL)
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t *read_tsa_state(brick_t *from, int idx, short nodata, cube_t *cube, par_hl_t *phl){
+brick_t *brick = NULL;
+char bname[NPOW_10];
+char fname[NPOW_10];
+int nchar;
+
+
+  if (tsa_state_filename(idx, phl, bname, NPOW_10) != SUCCESS) return NULL;
+
+  nchar = snprintf(fname, NPOW_10, "%s/X%04d_Y%04d/%s.%s", phl->d_higher, 
+    get_brick_tilex(from), get_brick_tiley(from), bname, phl->gdalopt.extension);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return NULL;}
+
+  if (!fileexist(fname)){
+    printf("NRT state %s does not exist. ", fname); return NULL;}
+
+  if ((brick = read_block(fname, _ARD_FTR_, NULL, 1, -1, nodata, _DT_SHORT_, 
+        get_brick_chunk(from), get_brick_tilex(from), get_brick_tiley(from), 
+        cube, false, 0, 0)) == NULL){
+    printf("Error reading NRT state %s. ", fname); return NULL;}
+
+  if (get_brick_nbands(brick) != phl->tsa.tsi.harm_nmodes*2 + 2){
+    printf("NRT state %s does not match the number of harmonic modes. ", fname);
+    free_brick(brick);
+    return NULL;
+  }
+
+  return brick;
+}
+
+
+/** This function transposes the interpolated time series into a pixel-
++++ major layout, i.e. all interpolation steps of one pixel are contiguous
++++ in memory. The pixel-wise submodules (STM, folds, LSP, POL) loop over
++++ time for each pixel, and can stream through memory instead of striding
++++ by the number of cells. The transpose is cache-blocked.
+--- ts:     pointer to instantly useable TSA image arrays
+--- nc:     number of cells
+--- ni:     number of interpolation steps
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void transpose_tsi(tsa_t *ts, int nc, int ni){
+int p, t, p0, t0, p1, t1, l;
+int block = 64;
+bool needed = false;
+
+
+  if (ts->tsi_ == NULL) return;
+
+  // only needed if any of the pixel-wise submodules is run
+  if (ts->stm_ != NULL || ts->spl_ != NULL || ts->pcx_ != NULL) needed = true;
+  if (ts->fby_ != NULL || ts->fbq_ != NULL || ts->fbm_ != NULL || 
+      ts->fbw_ != NULL || ts->fbd_ != NULL) needed = true;
+  for (l=0; l<_LSP_LENGTH_; l++){ if (ts->lsp_[l] != NULL) needed = true;}
+  for (l=0; l<_POL_LENGTH_; l++){ if (ts->pol_[l] != NULL) needed = true;}
+
+  if (!needed) return;
+
+
+  alloc((void**)&ts->tsi_pm, (size_t)nc*ni, sizeof(short));
+
+  #pragma omp parallel private(p,t,t0,p1,t1) shared(ts,nc,ni,block) default(none)
+  {
+
+    #pragma omp for schedule(static)
+    for (p0=0; p0<nc; p0+=block){
+
+      p1 = (p0+block < nc) ? p0+block : nc;
+
+      for (t0=0; t0<ni; t0+=block){
+
+        t1 = (t0+block < ni) ? t0+block : ni;
+
+        for (t=t0; t<t1; t++){
+        for (p=p0; p<p1; p++){
+          ts->tsi_pm[(size_t)p*ni+t] = ts->tsi_[t][p];
+        }
+        }
+
+      }
+
+    }
+
+  }
+
+  return;
+}
+
+
+/** This function releases an intermediate TSA product after its last
++++ consumer, i.e. the brick is freed right away instead of being carried
++++ along to the output stage. Products that are written are kept.
+--- TSA:    TSA bricks of one index
+--- nprod:  number of TSA bricks
+--- ptr:    image arrays of the product (set to NULL if released)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void release_tsa_brick(brick_t **TSA, int nprod, short ***ptr){
+int o;
+
+
+  if (*ptr == NULL) return;
+
+  for (o=0; o<nprod; o++){
+
+    if (TSA[o] == NULL || get_brick_open(TSA[o])) continue;
+    if (get_bands_short(TSA[o]) != *ptr) continue;
+
+    free_brick(TSA[o]);
+    TSA[o] = NULL;
+    *ptr = NULL;
+    break;
+
+  }
+
+  return;
+}
+
+
+/** This function returns the folded time series of a folding period
+--- ts:     pointer to instantly useable TSA image arrays
+--- by:     folding period (0: year, 1: quarter, 2: month, 3: week, 4: doy)
++++ Return: folded time series, NULL if not requested
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+short **fold_product(tsa_t *ts, int by){
+
+  switch (by){
+    case 0:  return ts->fby_;
+    case 1:  return ts->fbq_;
+    case 2:  return ts->fbm_;
+    case 3:  return ts->fbw_;
+    default: return ts->fbd_;
+  }
+
+}
+
+
+/** This function runs the index, interpolation, STM and folding steps
++++ on the GPU, for several indices in one go. The ARD was copied to the
++++ device by the read stage; only the products that are written, or 
++++ needed by the CPU steps thereafter, are copied back. The chain is 
++++ cancelled, i.e. left to the CPU, if any step is not available on the
++++ device, or if a later CPU step needs the full time series (UDF, LSP,
++++ POL, NRT).
+--- ard:    ARD
+--- ts:     pointer to instantly useable TSA image arrays, one per index
+--- nidx:   number of indices
+--- mask:   mask image
+--- nc:     number of cells
+--- nt:     number of ARD products over time
+--- ni:     number of interpolation steps
+--- idx:    first index
+--- nodata: nodata value
+--- phl:    HL parameters
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int tsa_device(ard_t *ard, tsa_t *ts, int nidx, brick_t *mask, int nc, int nt, int ni, int idx, short nodata, par_hl_t *phl){
+tsa_gpu_t job;
+gpu_brick_t **MSK = NULL;
+gpu_brick_t *PMASK = NULL;
+rbf_bank_t *bank = NULL;
+gpu_stream_t stream;
+date_t *d_fld[GPU_NFOLD] = { ts->d_fby, ts->d_fbq, ts->d_fbm, ts->d_fbw, ts->d_fbd };
+int **fold_of = NULL;
+int *key = NULL;
+int t, f, j, k, status = SUCCESS;
+
+
+  if (!phl->gpu) return CANCEL;
+
+  if (phl->tsa.tsi.method != _INT_NONE_ && 
+      phl->tsa.tsi.method != _INT_LINEAR_ &&
+      phl->tsa.tsi.method != _INT_MOVING_ &&
+      phl->tsa.tsi.method != _INT_RBF_) return CANCEL;
+
+  for (j=0; j<nidx; j++){
+    if (ts[j].pyp_ != NULL || ts[j].nrt_ != NULL || ts[j].rms_ != NULL) return CANCEL;
+  }
+
+  if (phl->tsa.lsp.ospl + phl->tsa.lsp.olsp + phl->tsa.lsp.otrd + phl->tsa.lsp.ocat +
+      phl->tsa.pol.opct + phl->tsa.pol.opol + phl->tsa.pol.otrd + phl->tsa.pol.ocat > 0) return CANCEL;
+
+  for (t=0; t<nt; t++){
+    if (ard[t].GPU == NULL || ard[t].MSK == NULL) return CANCEL;
+  }
+
+
+  memset(&job, 0, sizeof(tsa_gpu_t));
+  job.nidx    = nidx;
+  job.nc      = nc;
+  job.nt      = nt;
+  job.ni      = ni;
+  job.stride  = get_brick_stride(ard[0].DAT);
+  job.nodata  = nodata;
+  job.method  = phl->tsa.tsi.method;
+  job.mov_max = phl->tsa.tsi.mov_max;
+  job.sta     = &phl->tsa.stm.sta;
+
+  if (job.method == _INT_RBF_){
+    bank = rbf_bank(ts, nt, ni, &phl->tsa.tsi);
+    job.rbf_nk    = bank->nk;
+    job.rbf_len   = bank->len;
+    job.rbf_off   = bank->off;
+    job.rbf_n     = bank->n;
+    job.rbf_t     = bank->t;
+    job.rbf_w     = bank->w;
+    job.rbf_max_w = bank->max_w;
+  }
+  job.fld_type = phl->tsa.fld.type;
+
+  // index definitions, SMA and expressions are left to the CPU
+  alloc((void**)&job.index, nidx, sizeof(index_def_t));
+  for (j=0; j<nidx && status == SUCCESS; j++){
+    if (index_definition(&phl->tsa, idx+j, &phl->sen, &job.index[j]) == FAILURE ||
+        job.index[j].family == _INDEX_SMA_ || 
+        job.index[j].family == _INDEX_EXPR_) status = CANCEL;
+  }
+
+  // products that are needed on the host
+  if (phl->tsa.otss)     alloc((void**)&job.tss, nidx, sizeof(short*));
+  if (phl->tsa.tsi.otsi) alloc((void**)&job.tsi, nidx, sizeof(short*));
+  if (ts->stm_ != NULL)  alloc((void**)&job.stm, nidx, sizeof(short*));
+  for (j=0; j<nidx; j++){
+    if (job.tss != NULL) job.tss[j] = ts[j].tss_[0];
+    if (job.tsi != NULL) job.tsi[j] = ts[j].tsi_[0];
+    if (job.stm != NULL) job.stm[j] = ts[j].stm_[0];
+  }
+
+  job.ce_tss = ts->ax_tss.ce;
+  job.ce_tsi = ts->ax_tsi.ce;
+
+  alloc_2D((void***)&fold_of, GPU_NFOLD, ni, sizeof(int));
+  job.nfold[0] = phl->ny; job.nfold[1] = phl->nq; job.nfold[2] = phl->nm;
+  job.nfold[3] = phl->nw; job.nfold[4] = phl->nd;
+
+  for (k=0; k<GPU_NFOLD; k++){
+
+    if (fold_product(ts, k) == NULL) continue;
+
+    alloc((void**)&job.fold[k], nidx, sizeof(short*));
+    for (j=0; j<nidx; j++) job.fold[k][j] = fold_product(&ts[j], k)[0];
+    job.fold_of[k] = fold_of[k];
+
+    key = fold_axis(&ts->ax_tsi, k);
+
+    for (t=0; t<ni; t++){
+      job.fold_of[k][t] = -1;
+      for (f=0; f<job.nfold[k]; f++){
+        if (key[t] != fold_key(&d_fld[k][f], k)) continue;
+        // a step that falls into several folds is left to the CPU
+        if (job.fold_of[k][t] >= 0) status = CANCEL;
+        job.fold_of[k][t] = f;
+      }
+    }
+
+  }
+
+
+  // the masks are final after screening, copy them in the ARD stream,
+  // i.e. to the device that holds the ARD of this unit
+  stream = ard[0].GPU->stream;
+
+  alloc((void**)&job.ard, nt, sizeof(short*));
+  alloc((void**)&job.msk, nt, sizeof(small*));
+  alloc((void**)&MSK,     nt, sizeof(gpu_brick_t*));
+
+  for (t=0; t<nt && status == SUCCESS; t++){
+    if ((MSK[t] = allocate_gpu_brick(ard[t].MSK, stream)) == NULL ||
+        upload_brick(ard[t].MSK, MSK[t]) == FAILURE){
+      status = FAILURE; break;}
+    job.ard[t] = (const short*)get_gpu_band(ard[t].GPU, 0);
+    job.msk[t] = (const small*)get_gpu_band(MSK[t], 0);
+  }
+
+  if (status == SUCCESS && mask != NULL){
+    if ((PMASK = allocate_gpu_brick(mask, stream)) == NULL ||
+        upload_brick(mask, PMASK) == FAILURE){
+      status = FAILURE;
+    } else {
+      job.mask = (const small*)get_gpu_band(PMASK, 0);
+    }
+  }
+
+  if (status == SUCCESS){
+    if (job.method == _INT_RBF_) cite_me(_CITE_RBF_);
+    if (ts->stm_ != NULL) cite_me(_CITE_STM_);
+    status = tsa_gpu(&job, stream);
+  } else {
+    gpu_sync(stream);
+  }
+
+
+  for (t=0; t<nt; t++) free_gpu_brick(MSK[t]);
+  free_gpu_brick(PMASK);
+  free((void*)MSK);
+  free((void*)job.index);
+  free((void*)job.ard);
+  free((void*)job.msk);
+  free((void*)job.tss);
+  free((void*)job.tsi);
+  free((void*)job.stm);
+  for (k=0; k<GPU_NFOLD; k++) free((void*)job.fold[k]);
+  free_2D((void**)fold_of, GPU_NFOLD);
+  free_rbf_bank(bank);
+
+  return status;
+}
+
+
+/** This function tests whether the time series is interpolated window by
++++ window (INT_WINDOW). This needs an interpolation that only depends on
++++ the dates of each step, and consumers of the interpolated time series
++++ that can be accumulated, i.e. STM and folds without quantiles. Other-
++++ wise, all interpolation steps are processed at once.
+--- phl:    HL parameters
++++ Return: true/false
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool tsa_windowed(par_hl_t *phl){
+int type = phl->tsa.fld.type;
+
+
+  if (phl->tsa.tsi.window <= 0) return false;
+
+  if (phl->tsa.tsi.method != _INT_LINEAR_ &&
+      phl->tsa.tsi.method != _INT_MOVING_ &&
+      phl->tsa.tsi.method != _INT_RBF_) return false;
+
+  if (phl->tsa.tsi.otsi + phl->tsa.tsi.onrt + phl->tsa.tsi.onst + phl->tsa.tsi.inst + 
+      phl->tsa.lsp.ospl + phl->tsa.lsp.olsp + phl->tsa.lsp.otrd + phl->tsa.lsp.ocat +
+      phl->tsa.pol.opct + phl->tsa.pol.opol + phl->tsa.pol.otrd + phl->tsa.pol.ocat +
+      phl->tsa.pyp.out > 0) return false;
+
+  if (phl->tsa.stm.ostm && (phl->tsa.stm.sta.quantiles || phl->tsa.stm.sta.iqr > -1)) return false;
+
+  if ((type >= _STA_Q01_ && type <= _STA_Q99_) || type == _STA_IQR_) return false;
+
+  return true;
+}
+
+
+/** This function interpolates the time series window by window, and ac-
++++ cumulates STM and folds with running statistics, i.e. only INT_WINDOW
++++ interpolation steps are held in memory. The values are accumulated in
++++ the same order as in a single pass, thus the results are identical.
+--- ts:     pointer to instantly useable TSA image arrays
+--- mask:   mask image
+--- nc:     number of cells
+--- nt:     number of ARD products over time
+--- ni:     number of interpolation steps
+--- nodata: nodata value
+--- phl:    HL parameters
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int tsa_window(tsa_t *ts, small *mask_, int nc, int nt, int ni, short nodata, par_hl_t *phl){
+short **tsi_ = NULL;
+run_stats_t *stm = NULL;
+fold_window_t fld;
+int i0, nw, n;
+
+
+  nw = (phl->tsa.tsi.window < ni) ? phl->tsa.tsi.window : ni;
+
+  alloc_2D((void***)&tsi_, nw, nc, sizeof(short));
+
+  if (ts->stm_ != NULL){
+    alloc((void**)&stm, nc, sizeof(run_stats_t));
+    init_run_stats(stm, nc);
+  }
+
+  init_fold_window(ts, nc, ni, phl, &fld);
+
+  for (i0=0; i0<ni; i0+=nw){
+
+    n = (ni-i0 < nw) ? ni-i0 : nw;
+
+    interpolate_window(ts, mask_, nc, nt, i0, n, nodata, &phl->tsa.tsi, tsi_);
+
+    if (stm != NULL) stm_window(stm, tsi_, mask_, nc, n, nodata);
+
+    fold_window(&fld, tsi_, mask_, nc, i0, n, nodata);
+
+  }
+
+  if (stm != NULL) tsa_stm_window(ts, stm, mask_, nc, nodata, &phl->tsa.stm);
+
+  term_fold_window(&fld, mask_, nc, nodata, phl->tsa.fld.type);
+
+  free_2D((void**)tsi_, nw);
+  free((void*)stm);
+
+  return SUCCESS;
+}
+
+
 /** public functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
@@ -967,15 +1454,20 @@ int nchar;
 +++ Return:    bricks with TSA results
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 brick_t **time_series_analysis(ard_t *ard, brick_t *mask, int nt, par_hl_t *phl, aux_emb_t *endmember, cube_t *cube, int *nproduct){
-tsa_t ts;
+tsa_t *ts = NULL;
 brick_t ***TSA;
+brick_t **STATE = NULL;
 brick_t **PTR;
 small *mask_ = NULL;
-int t, idx;
+int t, idx, i, batch;
+int device = CANCEL;
 int o, k, nprod = 0;
 int nx, ny, nc;
 int ni, nr;
 short nodata;
+uint64_t version = 0;
+bool *cached = NULL;
+int ncached;
 
 
   // import bricks
@@ -1011,52 +1503,158 @@ short nodata;
 
 
   
+  // a python UDF is initialized per index, thus the indices are compiled
+  // one after another; otherwise, all are compiled up front, such that the
+  // GPU computes them in one go
+  batch = (phl->tsa.pyp.out) ? 1 : phl->tsa.n;
+
+  alloc((void**)&ts, phl->tsa.n, sizeof(tsa_t));
+  alloc((void**)&STATE, phl->tsa.n, sizeof(brick_t*));
+  alloc((void**)&cached, phl->tsa.n, sizeof(bool));
+
+  // version of the ARD, which keys the index cache
+  if (strcmp(phl->tsa.d_cache, "NULL") != 0){
+    version = version_ard(get_brick_tilex(ard[0].DAT), get_brick_tiley(ard[0].DAT), &phl->sen, phl);
+  }
+
   for (idx=0; idx<phl->tsa.n; idx++){
 
-    // generate data arrays
-    compile_ts_dates(ard, &ts, phl, nt, nr, ni);
+    if (idx % batch == 0){
+
+      for (i=idx; i<idx+batch; i++){
+
+        // generate data arrays
+        compile_ts_dates(ard, &ts[i], phl, nt, nr, ni);
+        ts[i].valid = ard[0].valid;
+
+        // initialize python udf
+        init_pyp(NULL, &ts[i], _HL_TSA_, phl->tsa.index_name[i], 1, ni, &phl->tsa.pyp);
+
+        // compile products + bricks
+        if ((TSA[i] = compile_tsa(ard, &ts[i], phl, cube, nt, nr, ni, i, &nprod)) == NULL || nprod == 0){
+          printf("Unable to compile TSA products!\n"); 
+          free((void*)TSA);
+          free((void*)ts);
+          free((void*)STATE);
+          free((void*)cached);
+          *nproduct = 0;
+          return NULL;
+        }
+
+        // NRT state of a previous run
+        if (phl->tsa.tsi.inst){
+          if ((STATE[i] = read_tsa_state(ard[0].DAT, i, nodata, cube, phl)) == NULL ||
+              (ts[i].hcf_ = get_bands_short(STATE[i])) == NULL){
+            printf("Unable to read NRT state, no prediction for %s.\n", phl->tsa.index_name[i]);
+          }
+        }
+
+      }
+
+      lap_profile("tsa_compile");
+
+      // index, interpolation, STM and folds, on the GPU if possible
+      device = tsa_device(ard, &ts[idx], batch, mask, nc, nt, ni, idx, nodata, phl);
 
-    // initialize python udf
-    init_pyp(NULL, &ts, _HL_TSA_, phl->tsa.index_name[idx], 1, ni, &phl->tsa.pyp);
+      // otherwise, read the indices from the cache, or compute all indices
+      // in one pass over the ARD, and cache the ones that were missing
+      if (device != SUCCESS){
+
+        for (i=idx, ncached=0; i<idx+batch; i++){
+          cached[i] = read_index_cache(ard, &ts[i], nt, nc, i, nodata, version, phl);
+          if (cached[i]) ncached++;
+        }
+
+        if (ncached < batch){
+          tsa_spectral_indices(ard, &ts[idx], batch, mask_, nc, nt, idx, nodata, &phl->tsa, &phl->sen, endmember);
+          for (i=idx; i<idx+batch; i++){
+            if (!cached[i]) write_index_cache(ard, &ts[i], nt, nc, i, nodata, version, phl);
+          }
+          lap_profile("tsa_index");
+        } else {
+          lap_profile("tsa_cache");
+        }
+
+      } else {
+        lap_profile("tsa_device");
+      }
 
-    // compile products + bricks
-    if ((TSA[idx] = compile_tsa(ard, &ts, phl, cube, nt, nr, ni, idx, &nprod)) == NULL || nprod == 0){
-      printf("Unable to compile TSA products!\n"); 
-      free((void*)TSA);
-      *nproduct = 0;
-      return NULL;
     }
 
-    
-    tsa_spectral_index(ard, &ts, mask_, nc, nt, idx, nodata, &phl->tsa, &phl->sen, endmember);
-    
-    tsa_interpolation(&ts, mask_, nc, nt, nr, ni, nodata, &phl->tsa.tsi);
 
-    python_udf(NULL, NULL, &ts, mask_, _HL_TSA_, phl->tsa.index_name[idx], 
-      nx, ny, nc, 1, ni, nodata, &phl->tsa.pyp, phl->cthread);
+    if (device != SUCCESS && tsa_windowed(phl)){
 
-    tsa_stm(&ts, mask_, nc, ni, nodata, &phl->tsa.stm);
-    
-    tsa_fold(&ts, mask_, nc, ni, nodata, phl);
+      tsa_window(&ts[idx], mask_, nc, nt, ni, nodata, phl);
+      lap_profile("tsa_window");
+
+    } else if (device != SUCCESS){
+
+      tsa_interpolation(&ts[idx], mask_, nc, nt, nr, ni, nodata, &phl->tsa.tsi);
+      lap_profile("tsa_interpolate");
+
+      if (phl->tsa.tsi.inst){
+        free_brick(STATE[idx]); STATE[idx] = NULL; ts[idx].hcf_ = NULL;
+      }
+
+      python_udf(NULL, NULL, &ts[idx], mask_, _HL_TSA_, phl->tsa.index_name[idx], 
+        nx, ny, nc, 1, ni, nodata, &phl->tsa.pyp, phl->cthread);
+
+      transpose_tsi(&ts[idx], nc, ni);
+      lap_profile("tsa_udf");
+
+      tsa_stm(&ts[idx], mask_, nc, ni, nodata, &phl->tsa.stm);
+      lap_profile("tsa_stm");
+      
+      tsa_fold(&ts[idx], mask_, nc, ni, nodata, phl);
+      lap_profile("tsa_fold");
+
+    }
+
+    // the raw and interpolated time series are consumed by now,
+    // unless they are written
+    release_tsa_brick(TSA[idx], nprod, &ts[idx].tss_);
+    release_tsa_brick(TSA[idx], nprod, &ts[idx].tsi_);
     
-    tsa_polar(&ts, mask_, nc, ni, nodata, phl);
+    tsa_polar(&ts[idx], mask_, nc, ni, nodata, phl);
+    lap_profile("tsa_polar");
     
-    tsa_pheno(&ts, mask_, nc, ni, nodata, phl);
+    tsa_pheno(&ts[idx], mask_, nc, ni, nodata, phl);
+    lap_profile("tsa_pheno");
+
+    // POL and LSP are the last pixel-wise consumers
+    free((void*)ts[idx].tsi_pm); ts[idx].tsi_pm = NULL;
     
-    tsa_trend(&ts, mask_, nc, nodata, phl);
+    tsa_trend(&ts[idx], mask_, nc, nodata, phl);
+    lap_profile("tsa_trend");
     
-    tsa_cat(&ts, mask_, nc, nodata, phl);
+    tsa_cat(&ts[idx], mask_, nc, nodata, phl);
+    lap_profile("tsa_cat");
+
+    // folds, phenometrics and polarmetrics are consumed by trend and CAT,
+    // unless they are written
+    release_tsa_brick(TSA[idx], nprod, &ts[idx].fby_);
+    release_tsa_brick(TSA[idx], nprod, &ts[idx].fbq_);
+    release_tsa_brick(TSA[idx], nprod, &ts[idx].fbm_);
+    release_tsa_brick(TSA[idx], nprod, &ts[idx].fbw_);
+    release_tsa_brick(TSA[idx], nprod, &ts[idx].fbd_);
+    for (k=0; k<_LSP_LENGTH_; k++) release_tsa_brick(TSA[idx], nprod, &ts[idx].lsp_[k]);
+    for (k=0; k<_POL_LENGTH_; k++) release_tsa_brick(TSA[idx], nprod, &ts[idx].pol_[k]);
     
-    tsa_standardize(&ts, mask_, nc, nt, ni, nodata, phl);
+    tsa_standardize(&ts[idx], mask_, nc, nt, ni, nodata, phl);
+    lap_profile("tsa_standardize");
 
 
     // clean date arrays
-    free_ts_dates(&ts);
+    free_ts_dates(&ts[idx]);
 
     // terminate python udf
     term_pyp(&phl->tsa.pyp);
 
   }
+
+  free((void*)ts);
+  free((void*)STATE);
+  free((void*)cached);
   
 
   // flatten out TSA bricks for returning to main
@@ -33,8 +33,10 @@ TSA Processing header
 
 #include "../cross-level/const-cl.h"
 #include "../cross-level/brick-cl.h"
+#include "../cross-level/profile-cl.h"
 #include "../higher-level/param-hl.h"
 #include "../higher-level/read-ard-hl.h"
+#include "../higher-level/tsa-gpu-hl.h"
 
 
 #ifdef __cplusplus
@@ -47,6 +49,14 @@ typedef struct {
   int ne;       // number of endmembers
 } aux_emb_t;
 
+// running statistics of one pixel, updated window by window (INT_WINDOW)
+typedef struct {
+  int n;                   // number of values
+  short minimum, maximum;  // range
+  double mean, var;        // recurrence mean and variance
+  double skew, kurt;       // recurrence skewness and kurtosis
+} run_stats_t;
+
 typedef struct {
   short **tss_, **rms_, **stm_, **tsi_, **spl_;
   short **fby_, **fbq_, **fbm_, **fbw_, **fbd_;
@@ -60,12 +70,17 @@ typedef struct {
   short **tro_[_POL_LENGTH_];
   short **cao_[_POL_LENGTH_];
   short **pyp_, **nrt_;
+  short **hcf_;  // harmonic coefficients (NRT state)
+  short *tsi_pm; // interpolated time series, pixel-major [p][ni]
+  const valid_t *valid; // valid observations of the ARD (see index_ard)
   date_t *d_tss, *d_nrt, *d_tsi;
+  date_axis_t ax_tss, ax_tsi; // flat date components of d_tss and d_tsi
   date_t *d_fby, *d_fbq, *d_fbm, *d_fbw, *d_fbd;
   date_t *d_lsp, *d_pol;
 } tsa_t;
 
 #include "../higher-level/index-hl.h"
+#include "../higher-level/index-cache-hl.h"
 #include "../higher-level/interpolate-hl.h"
 #include "../higher-level/stm-hl.h"
 #include "../higher-level/fold-hl.h"
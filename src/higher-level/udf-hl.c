@@ -39,7 +39,7 @@ typedef struct {
   short ***ptr;
 } brick_compile_info_t;
 
-enum { _pyp_, _rsp_ };
+enum { _pyp_, _rsp_, _nat_ };
 
 brick_t *compile_udf_brick(brick_t *ard, brick_compile_info_t *info, par_hl_t *phl);
 brick_t **compile_udf(ard_t *ard, udf_t *udf, par_hl_t *phl, cube_t *cube, int nt, int *nproduct);
@@ -75,6 +75,21 @@ int info_udf_rsp(brick_compile_info_t *info, int o, udf_t *udf, par_hl_t *phl){
   return o+1;
 }
 
+int info_udf_nat(brick_compile_info_t *info, int o, udf_t *udf, par_hl_t *phl){
+
+
+  copy_string(info[o].prodname, NPOW_02, "NAT");
+  info[o].prodlen  = phl->udf.nat.nb;
+  info[o].bandname = phl->udf.nat.bandname;
+  info[o].date     = phl->udf.nat.date;
+  info[o].prodtype = _nat_;
+  info[o].enable   = phl->udf.nat.out;
+  info[o].write    = phl->udf.nat.out;
+  info[o].ptr      = &udf->nat_;
+
+  return o+1;
+}
+
 
 
 /** This function compiles the bricks, in which UDF results are stored. 
@@ -97,7 +112,8 @@ brick_compile_info_t *info = NULL;
 
 
   nprod = 1 + // python UDF metrics
-          1;  // R UDF metrics
+          1 + // R UDF metrics
+          1;  // native UDF metrics
 
   //printf("%d potential products.\n", nprod);
 
@@ -105,6 +121,7 @@ brick_compile_info_t *info = NULL;
 
   o = info_udf_pyp(info, o, udf, phl);
   o = info_udf_rsp(info, o, udf, phl);
+  o = info_udf_nat(info, o, udf, phl);
 
 
   alloc((void**)&UDF, nprod, sizeof(brick_t*));
@@ -235,6 +252,9 @@ short nodata;
   // initialize python udf
   init_pyp(ard, NULL, _HL_UDF_, NULL, nb, nt, &phl->udf.pyp);
 
+  // initialize native udf
+  init_nat(ard, nb, nt, nodata, phl->cthread, &phl->udf.nat);
+
   // compile products + bricks
   if ((UDF = compile_udf(ard, &udf_, phl, cube, nt, &nprod)) == NULL || nprod == 0){
     printf("Unable to compile UDF products!\n"); 
@@ -248,10 +268,12 @@ short nodata;
   python_udf(ard, &udf_, NULL, mask_, _HL_UDF_, NULL, 
     nx, ny, nc, nb, nt, nodata, &phl->udf.pyp, phl->cthread);
   //rstats_udf(ard, NULL, &udf, mask_, nx, ny, nc, nb, nt, nodata, phl);
+  native_udf(ard, &udf_, mask_, nx, ny, nc, nt, &phl->udf.nat);
 
 
-  // terminate python udf
+  // terminate udfs
   term_pyp(&phl->udf.pyp);
+  term_nat(&phl->udf.nat);
 
 
   *nproduct = nprod;
@@ -44,9 +44,11 @@ extern "C" {
 typedef struct {
   short **pyp_;
   short **rsp_;
+  short **nat_;
 } udf_t;
 
 #include "../higher-level/py-udf-hl.h"
+#include "../higher-level/native-udf-hl.h"
 
 brick_t **udf_plugin(ard_t *ard, brick_t *mask, int nt, par_hl_t *phl, cube_t *cube, int *nproduct);
 
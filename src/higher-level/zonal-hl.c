@@ -0,0 +1,792 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for in-pipeline zonal statistics
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "zonal-hl.h"
+
+/** Geospatial Data Abstraction Library (GDAL) **/
+#include "gdal.h"           // public (C callable) GDAL entry points
+#include "gdal_alg.h"       // GDAL algorithms, e.g. rasterization
+#include "ogr_srs_api.h"    // coordinate systems services
+
+/** OpenMP **/
+#include <omp.h> // multi-platform shared memory multiprocessing
+
+
+/** private functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+#define MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+
+// number of zones that are written at once
+#define ZONE_BATCH NPOW_10
+
+// geometry of a zone, before the zones are compiled
+typedef struct {
+  double id;
+  int order;
+  OGRGeometryH geom;
+} zone_geom_t;
+
+int cmp_zone_geom(const void *a, const void *b);
+int cmp_short(const void *a, const void *b);
+int zone_chunk(double y, int ty, cube_t *cube);
+void sorted_zone_stat(zone_stat_t *st, short *v, int n);
+void merge_zone_stat(zone_stat_t *dst, zone_stat_t *src);
+
+
+/** This function compares two zone geometries by ID, and keeps the order
++++ in which they were read for identical IDs.
+--- a:      zone geometry 1
+--- b:      zone geometry 2
++++ Return: -1, 0 or 1
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int cmp_zone_geom(const void *a, const void *b){
+const zone_geom_t *x = (const zone_geom_t*)a;
+const zone_geom_t *y = (const zone_geom_t*)b;
+
+
+  if (x->id < y->id) return -1;
+  if (x->id > y->id) return  1;
+  if (x->order < y->order) return -1;
+  if (x->order > y->order) return  1;
+  return 0;
+}
+
+
+/** This function compares two short integers.
+--- a:      value 1
+--- b:      value 2
++++ Return: -1, 0 or 1
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int cmp_short(const void *a, const void *b){
+short x = *(const short*)a;
+short y = *(const short*)b;
+
+
+  return (x > y) - (x < y);
+}
+
+
+/** This function returns the chunk of a tile that contains a map coordi-
++++ nate, clamped to the chunks of the tile.
+--- y:      map y-coordinate
+--- ty:     tile Y-ID
+--- cube:   datacube definition
++++ Return: chunk
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int zone_chunk(double y, int ty, cube_t *cube){
+double uly = cube->origin_map.y - ty*cube->tilesize;
+int chunk;
+
+
+  chunk = (int)floor((uly - y)/cube->res/cube->cy);
+
+  return MAX(0, MIN(cube->cn-1, chunk));
+}
+
+
+/** This function computes the statistics of the sorted values of one fea-
++++ ture in one zone. The distinct values are kept with their number of
++++ occurences, which is exact for 16-bit data and can be merged without
++++ loss, such that exact percentiles are available at the end.
+--- st:     statistics (returned)
+--- v:      sorted values
+--- n:      number of values
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void sorted_zone_stat(zone_stat_t *st, short *v, int n){
+int i, k;
+double sum = 0, dev;
+
+
+  st->n = n;
+  st->min = v[0];
+  st->max = v[n-1];
+
+  for (i=0; i<n; i++) sum += v[i];
+  st->mean = sum/n;
+
+  for (i=0, st->m2=0; i<n; i++){
+    dev = v[i]-st->mean;
+    st->m2 += dev*dev;
+  }
+
+  for (i=1, st->nbin=1; i<n; i++) st->nbin += (v[i] != v[i-1]);
+
+  alloc((void**)&st->value, st->nbin, sizeof(short));
+  alloc((void**)&st->count, st->nbin, sizeof(int));
+
+  for (i=0, k=-1; i<n; i++){
+    if (k < 0 || v[i] != st->value[k]) st->value[++k] = v[i];
+    st->count[k]++;
+  }
+
+  return;
+}
+
+
+/** This function merges the statistics of one feature in one zone. The
++++ moments are combined with the pairwise update of Chan et al., and the
++++ distinct values are merged like sorted lists. The source is emptied.
+--- dst:    statistics, merged into
+--- src:    statistics, merged from (freed)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void merge_zone_stat(zone_stat_t *dst, zone_stat_t *src){
+int i, j, k, nbin;
+short *value = NULL;
+int *count = NULL;
+double n, delta;
+
+
+  if (src->n == 0) return;
+
+  if (dst->n == 0){
+    *dst = *src;
+    memset(src, 0, sizeof(zone_stat_t));
+    return;
+  }
+
+  n = (double)dst->n + src->n;
+  delta = src->mean - dst->mean;
+
+  dst->m2   += src->m2 + delta*delta*dst->n*src->n/n;
+  dst->mean += delta*src->n/n;
+  dst->n    += src->n;
+  dst->min = MIN(dst->min, src->min);
+  dst->max = MAX(dst->max, src->max);
+
+
+  // union of distinct values
+  for (i=0, j=0, nbin=0; i<dst->nbin || j<src->nbin; nbin++){
+    if (j >= src->nbin || (i < dst->nbin && dst->value[i] < src->value[j])){
+      i++;
+    } else if (i >= dst->nbin || src->value[j] < dst->value[i]){
+      j++;
+    } else {
+      i++; j++;
+    }
+  }
+
+  alloc((void**)&value, nbin, sizeof(short));
+  alloc((void**)&count, nbin, sizeof(int));
+
+  for (i=0, j=0, k=0; k<nbin; k++){
+    if (j >= src->nbin || (i < dst->nbin && dst->value[i] < src->value[j])){
+      value[k] = dst->value[i]; count[k] = dst->count[i]; i++;
+    } else if (i >= dst->nbin || src->value[j] < dst->value[i]){
+      value[k] = src->value[j]; count[k] = src->count[j]; j++;
+    } else {
+      value[k] = dst->value[i]; count[k] = dst->count[i] + src->count[j]; i++; j++;
+    }
+  }
+
+  free((void*)dst->value); free((void*)dst->count);
+  free((void*)src->value); free((void*)src->count);
+  memset(src, 0, sizeof(zone_stat_t));
+
+  dst->value = value;
+  dst->count = count;
+  dst->nbin  = nbin;
+
+  return;
+}
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function reads the zones from a vector file. All polygons of all
++++ layers are used, and polygons with the same ID in the zone attribute
++++ form one zone. The geometries are kept in memory, and are sorted by
++++ zone. The centroid of the first polygon of each zone is kept as co-
++++ ordinate of the zone.
+--- phl:    HL parameters
+--- zon:    zones (returned)
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int read_zones(par_hl_t *phl, aux_zon_t *zon){
+GDALDatasetH fp;
+OGRLayerH layer;
+OGRFeatureH feature;
+OGRGeometryH geom, point;
+zone_geom_t *list = NULL;
+int l, nl, g, z, k, field, nbuf = 0;
+float tmp;
+
+
+  if ((fp = GDALOpenEx(phl->smp.f_zones, GDAL_OF_VECTOR | GDAL_OF_READONLY, NULL, NULL, NULL)) == NULL){
+    printf("Unable to open %s. ", phl->smp.f_zones); return FAILURE;}
+
+  zon->ngeom = 0;
+
+  nl = GDALDatasetGetLayerCount(fp);
+
+  for (l=0; l<nl; l++){
+
+    layer = GDALDatasetGetLayer(fp, l);
+    OGR_L_ResetReading(layer);
+
+    while ((feature = OGR_L_GetNextFeature(layer)) != NULL){
+
+      if ((geom = OGR_F_GetGeometryRef(feature)) == NULL){
+        OGR_F_Destroy(feature); continue;}
+
+      if ((field = OGR_F_GetFieldIndex(feature, phl->smp.zone_attr)) < 0){
+        printf("Attribute %s does not exist in %s. ", phl->smp.zone_attr, phl->smp.f_zones);
+        for (g=0; g<zon->ngeom; g++) OGR_G_DestroyGeometry(list[g].geom);
+        zon->ngeom = 0; free((void*)list);
+        OGR_F_Destroy(feature); GDALClose(fp); return FAILURE;}
+
+      if (zon->ngeom >= nbuf){
+        re_alloc((void**)&list, nbuf, (nbuf > 0) ? nbuf*2 : NPOW_10, sizeof(zone_geom_t));
+        nbuf = (nbuf > 0) ? nbuf*2 : NPOW_10;
+      }
+
+      // the geometry keeps the projection of the layer
+      geom = OGR_G_Clone(geom);
+      if (OGR_G_GetSpatialReference(geom) == NULL){
+        OGR_G_AssignSpatialReference(geom, OGR_L_GetSpatialRef(layer));
+      }
+
+      list[zon->ngeom].id    = (double)OGR_F_GetFieldAsInteger64(feature, field);
+      list[zon->ngeom].order = zon->ngeom;
+      list[zon->ngeom].geom  = geom;
+      zon->ngeom++;
+
+      OGR_F_Destroy(feature);
+
+    }
+
+  }
+
+  GDALClose(fp);
+
+  if (zon->ngeom == 0){
+    printf("No polygons in %s. ", phl->smp.f_zones); return FAILURE;}
+
+
+  // polygons with the same ID form one zone
+  qsort(list, zon->ngeom, sizeof(zone_geom_t), cmp_zone_geom);
+
+  for (g=0, zon->nzone=0; g<zon->ngeom; g++){
+    if (g == 0 || list[g].id != list[g-1].id) zon->nzone++;
+  }
+
+  alloc((void**)&zon->geom,    zon->ngeom, sizeof(OGRGeometryH));
+  alloc((void**)&zon->zone_of, zon->ngeom, sizeof(int));
+  alloc((void**)&zon->id,      zon->nzone, sizeof(double));
+  alloc_2D((void***)&zon->centroid, zon->nzone, 2, sizeof(double));
+
+  point = OGR_G_CreateGeometry(wkbPoint);
+
+  for (g=0, z=-1; g<zon->ngeom; g++){
+
+    if (g == 0 || list[g].id != list[g-1].id){
+      z++;
+      zon->id[z] = list[g].id;
+      if (OGR_G_Centroid(list[g].geom, point) == OGRERR_NONE){
+        zon->centroid[z][_X_] = OGR_G_GetX(point, 0);
+        zon->centroid[z][_Y_] = OGR_G_GetY(point, 0);
+      }
+    }
+
+    zon->geom[g]    = list[g].geom;
+    zon->zone_of[g] = z;
+
+  }
+
+  OGR_G_DestroyGeometry(point);
+  free((void*)list);
+
+
+  // percentiles, ascending
+  zon->np = phl->smp.nzone_pct;
+  alloc((void**)&zon->p, zon->np, sizeof(float));
+
+  for (k=0; k<zon->np; k++){
+    zon->p[k] = phl->smp.zone_pct[k]/100.0;
+    for (l=k; l>0 && zon->p[l-1] > zon->p[l]; l--){
+      tmp = zon->p[l-1]; zon->p[l-1] = zon->p[l]; zon->p[l] = tmp;
+    }
+  }
+
+  zon->nf = phl->ftr.nfeature;
+  alloc((void**)&zon->stat, (size_t)zon->nzone*zon->nf, sizeof(zone_stat_t));
+
+  #ifdef FORCE_DEBUG
+  printf("%d polygons in %d zones.\n", zon->ngeom, zon->nzone);
+  #endif
+
+  return SUCCESS;
+}
+
+
+/** This function reprojects all zones once, and buckets the polygons by
++++ the tiles and chunks that their bounding box overlaps. Polygons outside
++++ of the processing extent are not bucketed.
+--- zon:    zones
+--- phl:    HL parameters
+--- cube:   datacube definition
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void index_zones(aux_zon_t *zon, par_hl_t *phl, cube_t *cube){
+OGRSpatialReferenceH srs = NULL, lsrs = NULL, last = NULL;
+OGRCoordinateTransformationH transform = NULL;
+OGREnvelope env;
+int g, c, k, pass;
+int tx, ty, tx0, tx1, ty0, ty1, chunk, chunk0, chunk1;
+int *fill = NULL;
+double tilex, tiley;
+char *wkt = cube->proj;
+bool *valid = NULL;
+int error = 0;
+
+
+  zon->ncell = cube->tnc*cube->cn;
+
+  alloc((void**)&zon->cell, zon->ncell+1, sizeof(int));
+  alloc((void**)&fill,      zon->ncell,   sizeof(int));
+  alloc((void**)&valid,     zon->ngeom,   sizeof(bool));
+
+  srs = OSRNewSpatialReference(NULL);
+  OSRImportFromWkt(srs, &wkt);
+  OSRSetAxisMappingStrategy(srs, OAMS_TRADITIONAL_GIS_ORDER);
+
+
+  // polygons in datacube projection, the polygons of one layer share
+  // the spatial reference, thus the transformation is reused
+  for (g=0; g<zon->ngeom; g++){
+
+    lsrs = OGR_G_GetSpatialReference(zon->geom[g]);
+
+    if (lsrs != NULL && !OSRIsSame(lsrs, srs)){
+
+      if (lsrs != last){
+        if (transform != NULL) OCTDestroyCoordinateTransformation(transform);
+        last = lsrs;
+        lsrs = OSRClone(lsrs);
+        OSRSetAxisMappingStrategy(lsrs, OAMS_TRADITIONAL_GIS_ORDER);
+        transform = OCTNewCoordinateTransformation(lsrs, srs);
+        OSRDestroySpatialReference(lsrs);
+      }
+
+      if (transform == NULL || OGR_G_Transform(zon->geom[g], transform) != OGRERR_NONE){
+        error++; continue;}
+
+    }
+
+    OGR_G_AssignSpatialReference(zon->geom[g], srs);
+    valid[g] = true;
+
+  }
+
+  if (transform != NULL) OCTDestroyCoordinateTransformation(transform);
+  OSRDestroySpatialReference(srs);
+
+  if (error > 0) printf("there were %d errors in reprojecting zones..\n", error);
+
+
+  // counting sort, the first pass counts, the second pass fills.
+  // Polygons stay in order within each cell, i.e. sorted by zone
+  for (pass=0; pass<2; pass++){
+
+    if (pass == 1){
+
+      for (c=0; c<zon->ncell; c++) zon->cell[c+1] += zon->cell[c];
+      memcpy(fill, zon->cell, zon->ncell*sizeof(int));
+
+      alloc((void**)&zon->member, MAX(zon->cell[zon->ncell], 1), sizeof(int));
+
+    }
+
+    for (g=0; g<zon->ngeom; g++){
+
+      if (!valid[g]) continue;
+
+      OGR_G_GetEnvelope(zon->geom[g], &env);
+      tile_find(env.MinX, env.MaxY, &tilex, &tiley, &tx0, &ty0, cube);
+      tile_find(env.MaxX, env.MinY, &tilex, &tiley, &tx1, &ty1, cube);
+
+      for (ty=MAX(ty0, cube->tminy); ty<=MIN(ty1, cube->tmaxy); ty++){
+
+        chunk0 = zone_chunk(env.MaxY, ty, cube);
+        chunk1 = zone_chunk(env.MinY, ty, cube);
+
+        for (tx=MAX(tx0, cube->tminx); tx<=MIN(tx1, cube->tmaxx); tx++){
+        for (chunk=chunk0; chunk<=chunk1; chunk++){
+
+          c = ((ty-cube->tminy)*cube->tnx + (tx-cube->tminx))*cube->cn + chunk;
+
+          if (pass == 0){
+            zon->cell[c+1]++;
+          } else {
+            k = fill[c]++;
+            zon->member[k] = g;
+          }
+
+        }
+        }
+
+      }
+
+    }
+
+  }
+
+  #ifdef FORCE_DEBUG
+  printf("%d polygons bucketed into %d cells.\n", zon->cell[zon->ncell], zon->ncell);
+  #endif
+
+  free((void*)fill);
+  free((void*)valid);
+
+  return;
+}
+
+
+/** This function is the entry point to the zonal mode of the sampling
++++ module. The polygons that index_zones bucketed into the current chunk
++++ are rasterized into zone IDs, and the statistics of each zone are ac-
++++ cumulated from the features in memory. The statistics are merged over
++++ all chunks, and are written at the end (see write_zones), thus no
++++ raster product is written.
+--- features: input features
+--- mask:     mask image
+--- nf:       number of features
+--- phl:      HL parameters
+--- zon:      zones
+--- cube:     datacube definition
+--- nproduct: number of output bricks (returned)
++++ Return:   empty bricks
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t **zonal_statistics(ard_t *features, brick_t *mask, int nf, par_hl_t *phl, aux_zon_t *zon, cube_t *cube, int *nproduct){
+small *mask_ = NULL;
+int f, g, k, p, s, c, n, nc, nv, nslot, nmax;
+int cx, cy, chunk, tx, ty;
+int *zone = NULL, *slot_zone = NULL, *off = NULL, *fill = NULL, *pix = NULL;
+short *val = NULL;
+double *burn = NULL;
+double geotran[6];
+OGRGeometryH *geom = NULL;
+GDALDriverH driver;
+GDALDatasetH dataset;
+GDALRasterBandH band;
+int bands[1] = { 1 };
+zone_stat_t *local = NULL;
+bool valid;
+int error = 0;
+
+
+  *nproduct = 0;
+
+  if (nf != zon->nf){
+    printf("number of features does not match zones (%d vs %d). ", nf, zon->nf); return NULL;}
+
+  // import bricks
+  cx    = get_brick_chunkncols(features[0].DAT);
+  cy    = get_brick_chunknrows(features[0].DAT);
+  nc    = get_brick_chunkncells(features[0].DAT);
+  chunk = get_brick_chunk(features[0].DAT);
+  tx    = get_brick_tilex(features[0].DAT);
+  ty    = get_brick_tiley(features[0].DAT);
+
+  // if no zone falls into this chunk, skip
+  if (tx < cube->tminx || tx > cube->tmaxx ||
+      ty < cube->tminy || ty > cube->tmaxy || chunk >= cube->cn) return NULL;
+
+  c = ((ty-cube->tminy)*cube->tnx + (tx-cube->tminx))*cube->cn + chunk;
+  n = zon->cell[c+1]-zon->cell[c];
+
+  if (n == 0) return NULL;
+
+  // import mask (if available)
+  if (mask != NULL){
+    if ((mask_ = get_band_small(mask, 0)) == NULL){
+      printf("Error getting processing mask."); return NULL;}
+  }
+
+
+  // the polygons of one zone get the same slot, the polygons are sorted
+  // by zone, thus the slots are sorted by zone, too
+  alloc((void**)&geom,      n, sizeof(OGRGeometryH));
+  alloc((void**)&burn,      n, sizeof(double));
+  alloc((void**)&slot_zone, n, sizeof(int));
+
+  for (k=0, nslot=0; k<n; k++){
+    g = zon->member[zon->cell[c]+k];
+    if (nslot == 0 || slot_zone[nslot-1] != zon->zone_of[g]) slot_zone[nslot++] = zon->zone_of[g];
+    geom[k] = zon->geom[g];
+    burn[k] = nslot-1;
+  }
+
+
+  // rasterize zones into the chunk
+  geotran[0] = cube->origin_map.x + tx*cube->tilesize;
+  geotran[1] = cube->res;
+  geotran[2] = 0;
+  geotran[3] = cube->origin_map.y - ty*cube->tilesize - chunk*cy*cube->res;
+  geotran[4] = 0;
+  geotran[5] = -cube->res;
+
+  alloc((void**)&zone, nc, sizeof(int));
+
+  if ((driver = GDALGetDriverByName("MEM")) == NULL ||
+      (dataset = GDALCreate(driver, "zones", cx, cy, 1, GDT_Int32, NULL)) == NULL){
+    printf("Unable to create zone raster. "); error++;
+  } else {
+
+    GDALSetGeoTransform(dataset, geotran);
+    GDALSetProjection(dataset, cube->proj);
+    band = GDALGetRasterBand(dataset, 1);
+
+    if (GDALFillRaster(band, -1, 0) != CE_None ||
+        GDALRasterizeGeometries(dataset, 1, bands, n, geom, NULL, NULL, burn, NULL, NULL, NULL) != CE_None ||
+        GDALRasterIO(band, GF_Read, 0, 0, cx, cy, zone, cx, cy, GDT_Int32, 0, 0) != CE_None){
+      printf("Unable to rasterize zones. "); error++;}
+
+    GDALClose(dataset);
+
+  }
+
+  free((void*)geom);
+  free((void*)burn);
+
+  if (error > 0){
+    free((void*)zone); free((void*)slot_zone); return NULL;}
+
+
+  // pixels of each slot, counting sort. Pixels are skipped if they are
+  // masked, or if any feature is nodata and such pixels are excluded
+  alloc((void**)&off, nslot+1, sizeof(int));
+
+  for (p=0; p<nc; p++){
+
+    if (zone[p] < 0) continue;
+
+    valid = (mask_ == NULL || mask_[p]);
+    for (f=0; f<nf && valid && phl->ftr.exclude; f++){
+      if (!features[f].msk[p]) valid = false;
+    }
+
+    if (valid) off[zone[p]+1]++; else zone[p] = -1;
+
+  }
+
+  for (s=0, nmax=0; s<nslot; s++){
+    nmax = MAX(nmax, off[s+1]);
+    off[s+1] += off[s];
+  }
+
+  if (off[nslot] == 0){
+    free((void*)zone); free((void*)slot_zone); free((void*)off); return NULL;}
+
+  alloc((void**)&fill, nslot, sizeof(int));
+  alloc((void**)&pix,  off[nslot], sizeof(int));
+  memcpy(fill, off, nslot*sizeof(int));
+
+  for (p=0; p<nc; p++){
+    if (zone[p] >= 0) pix[fill[zone[p]]++] = p;
+  }
+
+  free((void*)fill);
+  free((void*)zone);
+
+
+  // statistics of each slot and feature in this chunk
+  alloc((void**)&local, (size_t)nslot*nf, sizeof(zone_stat_t));
+
+  #pragma omp parallel private(val,f,k,nv) shared(nslot,nf,nmax,off,pix,features,local) default(none)
+  {
+
+    alloc((void**)&val, nmax, sizeof(short));
+
+    #pragma omp for schedule(dynamic)
+    for (s=0; s<nslot; s++){
+    for (f=0; f<nf; f++){
+
+      for (k=off[s], nv=0; k<off[s+1]; k++){
+        if (features[f].msk[pix[k]]) val[nv++] = features[f].dat[0][pix[k]];
+      }
+
+      if (nv == 0) continue;
+
+      qsort(val, nv, sizeof(short), cmp_short);
+      sorted_zone_stat(&local[s*nf+f], val, nv);
+
+    }
+    }
+
+    free((void*)val);
+
+  }
+
+
+  // chunks may be processed concurrently, the statistics are shared
+  #pragma omp critical (zonal_stats)
+  {
+    for (s=0; s<nslot; s++){
+    for (f=0; f<nf; f++){
+      merge_zone_stat(&zon->stat[(size_t)slot_zone[s]*nf+f], &local[s*nf+f]);
+    }
+    }
+  }
+
+  #ifdef FORCE_DEBUG
+  printf("Accumulated %d pixels of %d zones in Tile X%04d_Y%04d Chunk %03d.\n",
+    off[nslot], nslot, tx, ty, chunk);
+  #endif
+
+
+  free((void*)local);
+  free((void*)pix);
+  free((void*)off);
+  free((void*)slot_zone);
+
+  return NULL;
+}
+
+
+/** This function writes the zonal statistics. FILE_SAMPLE holds the sta-
++++ tistics of each feature, i.e. number of pixels, mean, standard devia-
++++ tion, minimum, maximum, and the percentiles. FILE_RESPONSE holds the
++++ zone IDs, and FILE_COORDINATES the centroids of the zones. Zones with-
++++ out any valid pixel are not written.
+--- phl:    HL parameters
+--- zon:    zones
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_zones(par_hl_t *phl, aux_zon_t *zon){
+table_writer_t *w_stat = NULL, *w_id = NULL, *w_coord = NULL;
+double **stat = NULL, **id = NULL;
+bool *allow = NULL;
+zone_stat_t *st = NULL;
+int z, z0, nz, f, k, b, i, sum, ncol;
+int error = 0;
+
+
+  if (zon->stat == NULL) return SUCCESS;
+
+  ncol = zon->nf*(5+zon->np);
+
+  if ((w_stat  = open_table_writer(phl->smp.f_sample,   phl->smp.format, ncol, 4)) == NULL ||
+      (w_id    = open_table_writer(phl->smp.f_response, phl->smp.format, 1,    0)) == NULL ||
+      (w_coord = open_table_writer(phl->smp.f_coords,   phl->smp.format, 2,    6)) == NULL){
+    printf("unable to set up zone output. ");
+    close_table_writer(w_stat); close_table_writer(w_id);
+    return FAILURE;}
+
+  alloc_2D((void***)&stat, ZONE_BATCH, ncol, sizeof(double));
+  alloc((void**)&id,    ZONE_BATCH, sizeof(double*));
+  alloc((void**)&allow, ZONE_BATCH, sizeof(bool));
+
+  for (z0=0; z0<zon->nzone; z0+=ZONE_BATCH){
+
+    nz = MIN(ZONE_BATCH, zon->nzone-z0);
+
+    for (z=0; z<nz; z++){
+
+      id[z] = &zon->id[z0+z];
+      allow[z] = false;
+
+      for (f=0, i=0; f<zon->nf; f++){
+
+        st = &zon->stat[(size_t)(z0+z)*zon->nf+f];
+
+        if (st->n > 0) allow[z] = true;
+
+        stat[z][i++] = st->n;
+        stat[z][i++] = (st->n > 0) ? st->mean : phl->ftr.nodata;
+        stat[z][i++] = (st->n > 1) ? standdev(st->m2, st->n) : 0;
+        stat[z][i++] = (st->n > 0) ? st->min : phl->ftr.nodata;
+        stat[z][i++] = (st->n > 0) ? st->max : phl->ftr.nodata;
+
+        // the percentiles are the values at quantile_rank, as in quantiles
+        for (k=0, b=0, sum=0; k<zon->np; k++){
+          if (st->n == 0){ stat[z][i++] = phl->ftr.nodata; continue;}
+          while (sum + st->count[b] <= quantile_rank(st->n, zon->p[k])) sum += st->count[b++];
+          stat[z][i++] = st->value[b];
+        }
+
+      }
+
+    }
+
+    if (write_table_rows(w_stat,  stat,              allow, nz) == FAILURE) error++;
+    if (write_table_rows(w_id,    id,                allow, nz) == FAILURE) error++;
+    if (write_table_rows(w_coord, zon->centroid+z0,  allow, nz) == FAILURE) error++;
+
+  }
+
+  free_2D((void**)stat, ZONE_BATCH);
+  free((void*)id);
+  free((void*)allow);
+
+  if (close_table_writer(w_stat)  == FAILURE) error++;
+  if (close_table_writer(w_id)    == FAILURE) error++;
+  if (close_table_writer(w_coord) == FAILURE) error++;
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+}
+
+
+/** This function frees the zones.
+--- zon:    zones
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_zones(aux_zon_t *zon){
+size_t i;
+int g;
+
+
+  for (g=0; g<zon->ngeom; g++) OGR_G_DestroyGeometry(zon->geom[g]);
+
+  if (zon->stat != NULL){
+    for (i=0; i<(size_t)zon->nzone*zon->nf; i++){
+      free((void*)zon->stat[i].value);
+      free((void*)zon->stat[i].count);
+    }
+  }
+
+  if (zon->centroid != NULL) free_2D((void**)zon->centroid, zon->nzone);
+
+  free((void*)zon->geom);
+  free((void*)zon->zone_of);
+  free((void*)zon->id);
+  free((void*)zon->stat);
+  free((void*)zon->p);
+  free((void*)zon->cell);
+  free((void*)zon->member);
+  memset(zon, 0, sizeof(aux_zon_t));
+
+  return;
+}
+
@@ -0,0 +1,87 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Zonal statistics header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef ZONAL_HL_H
+#define ZONAL_HL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/cube-cl.h"
+#include "../cross-level/table-cl.h"
+#include "../cross-level/stats-cl.h"
+#include "../higher-level/read-ard-hl.h"
+
+/** Geospatial Data Abstraction Library (GDAL) **/
+#include "ogr_api.h"        // OGR geometry and feature definition
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// mergeable statistics of one feature in one zone
+typedef struct {
+  int    n;      // number of values
+  double mean;   // mean
+  double m2;     // sum of squared deviations from the mean
+  short  min;    // minimum
+  short  max;    // maximum
+  int    nbin;   // number of distinct values
+  short *value;  // distinct values, ascending
+  int   *count;  // number of occurences of each value
+} zone_stat_t;
+
+typedef struct {
+  int ngeom;           // number of geometries
+  OGRGeometryH *geom;  // geometries, sorted by zone
+  int *zone_of;        // zone of each geometry
+  int nzone;           // number of zones
+  double *id;          // ID of each zone
+  double **centroid;   // centroid of each zone, in coordinates of the layer
+  int nf;              // number of features
+  zone_stat_t *stat;   // statistics of each zone and feature (nzone x nf)
+  int np;              // number of percentiles
+  float *p;            // percentiles [0,1], ascending
+  int ncell;           // number of cells, i.e. chunks of all tiles in extent
+  int *cell;           // offset of each cell in member (ncell+1)
+  int *member;         // geometries, bucketed by cell
+} aux_zon_t;
+
+int read_zones(par_hl_t *phl, aux_zon_t *zon);
+void index_zones(aux_zon_t *zon, par_hl_t *phl, cube_t *cube);
+brick_t **zonal_statistics(ard_t *features, brick_t *mask, int nf, par_hl_t *phl, aux_zon_t *zon, cube_t *cube, int *nproduct);
+int write_zones(par_hl_t *phl, aux_zon_t *zon);
+void free_zones(aux_zon_t *zon);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
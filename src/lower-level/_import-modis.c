@@ -46,6 +46,9 @@ This program imports MODIS 09 GA products to FORCE
 #include "cpl_string.h"     // various convenience functions for strings
 #include "gdal.h"           // public (C callable) GDAL entry points
 
+/** OpenMP **/
+#include <omp.h> // multi-platform shared memory multiprocessing
+
 
 typedef struct {
   int n;
@@ -128,14 +131,9 @@ int opt;
 }
 
 
-int get_modqa(ushort *modqa_, int index, int p, int bitfields){
-int i;
-short val = 0;
-
-
-  for (i=0; i<bitfields; i++) val |= (short)(1 << i);
+int get_modqa(ushort modqa, int index, int bitfields){
 
-  return (short)(modqa_[p] >> index) & val;
+  return (modqa >> index) & ((1 << bitfields) - 1);
 }
 
 
@@ -219,8 +217,10 @@ cube_t cube;
 
 void compile_qai(brick_t *QAI, ushort *modqa_, short **boa_, int nc, int nb, int sid, short nodata){
 int p, b;
+ushort qa;
 
 
+  #pragma omp parallel for private(b, qa) shared(QAI, modqa_, boa_, nc, nb, sid, nodata) schedule(static) default(none)
   for (p=0; p<nc; p++){
 
     if (boa_[0][p] < -100){
@@ -228,16 +228,18 @@ int p, b;
       set_off(QAI, p, 1);
     }
 
-    if (get_modqa(modqa_,  0, p, 2) >  0) set_cloud(QAI, p, 2);   // cloudy, mixed or not set
-    if (get_modqa(modqa_,  2, p, 1) >  0) set_shadow(QAI, p, 1);  // cloud shadow
-    if (get_modqa(modqa_,  3, p, 3) != 1) set_water(QAI, p, 1);   // any water type
-    if (get_modqa(modqa_,  6, p, 2) == 0) set_aerosol(QAI, p, 3); // aerosol climatology
-    if (get_modqa(modqa_,  6, p, 2) >  2) set_aerosol(QAI, p, 2); // high aerosol
-    if (get_modqa(modqa_,  8, p, 2) >  0) set_cloud(QAI, p, 3);   // cirrus
-    if (get_modqa(modqa_, 10, p, 1) >  0) set_cloud(QAI, p, 2);   // internal cloud algo
-    if (get_modqa(modqa_, 12, p, 1) >  0) set_snow(QAI, p, 1);    // snow/ice
-    if (get_modqa(modqa_, 13, p, 1) >  0) set_cloud(QAI, p, 1);   // adjacent to cloud
-    if (get_modqa(modqa_, 15, p, 1) >  0) set_snow(QAI, p, 1);    // internal snow algo
+    qa = modqa_[p];
+
+    if (get_modqa(qa,  0, 2) >  0) set_cloud(QAI, p, 2);   // cloudy, mixed or not set
+    if (get_modqa(qa,  2, 1) >  0) set_shadow(QAI, p, 1);  // cloud shadow
+    if (get_modqa(qa,  3, 3) != 1) set_water(QAI, p, 1);   // any water type
+    if (get_modqa(qa,  6, 2) == 0) set_aerosol(QAI, p, 3); // aerosol climatology
+    if (get_modqa(qa,  6, 2) >  2) set_aerosol(QAI, p, 2); // high aerosol
+    if (get_modqa(qa,  8, 2) >  0) set_cloud(QAI, p, 3);   // cirrus
+    if (get_modqa(qa, 10, 1) >  0) set_cloud(QAI, p, 2);   // internal cloud algo
+    if (get_modqa(qa, 12, 1) >  0) set_snow(QAI, p, 1);    // snow/ice
+    if (get_modqa(qa, 13, 1) >  0) set_cloud(QAI, p, 1);   // adjacent to cloud
+    if (get_modqa(qa, 15, 1) >  0) set_snow(QAI, p, 1);    // internal snow algo
 
     for (b=0; b<nb; b++){
       if (b == 5 && sid == _SEN_MOD02_) continue;
@@ -21,7 +21,8 @@ along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
 /**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-This program is the FORCE Level-2 Processing System (single image)
+This program is the FORCE Level-2 Processing System (single image, or
+batch of images)
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
 
@@ -39,6 +40,9 @@ This program is the FORCE Level-2 Processing System (single image)
 #include "../cross-level/brick-cl.h"
 #include "../cross-level/cube-cl.h"
 #include "../cross-level/quality-cl.h"
+#include "../cross-level/gpu-cl.h"
+#include "../cross-level/profile-cl.h"
+#include "../cross-level/numa-cl.h"
 #include "../lower-level/param-ll.h"
 #include "../lower-level/meta-ll.h"
 #include "../lower-level/cube-ll.h"
@@ -50,6 +54,7 @@ This program is the FORCE Level-2 Processing System (single image)
 #include "../lower-level/atmo-ll.h"
 #include "../lower-level/resmerge-ll.h"
 #include "../lower-level/coreg-ll.h"
+#include "../lower-level/batch-ll.h"
 
 /** Geospatial Data Abstraction Library (GDAL) **/
 #include "gdal.h"           // public (C callable) GDAL entry points
@@ -60,6 +65,7 @@ This program is the FORCE Level-2 Processing System (single image)
 
 typedef struct {
   int n;
+  bool batch;
   char fimg[NPOW_10];
   char fprm[NPOW_10];
 } args_t;
@@ -69,14 +75,16 @@ void usage(char *exe, int exit_code){
 
 
   printf("Usage: %s [-h] [-v] [-i] image-dir parameter-file\n", exe);
+  printf("   or: %s -b parameter-file\n", exe);
   printf("\n");
   printf("  -h  = show this help\n");
   printf("  -v  = show version\n");
   printf("  -i  = show program's purpose\n");
+  printf("  -b  = batch mode: process all images in FILE_QUEUE\n");
   printf("\n");
   printf("  Positional arguments:\n");
   printf("  - 'image-dir':      extracted Level 1 image\n");
-  printf("  - 'parameter-file': ML parameter file\n");
+  printf("  - 'parameter-file': L2 parameter file\n");
   printf("\n");
   // option -d is hidden from user and only used from force caller
 
@@ -90,9 +98,10 @@ int opt;
 
 
   opterr = 0;
+  args->batch = false;
 
   // optional parameters
-  while ((opt = getopt(argc, argv, "hvid")) != -1){
+  while ((opt = getopt(argc, argv, "hvidb")) != -1){
     switch(opt){
       case 'h':
         usage(argv[0], SUCCESS);
@@ -107,6 +116,9 @@ int opt;
         exit(FAILURE);
         #endif
         exit(SUCCESS);
+      case 'b':
+        args->batch = true;
+        break;
       case '?':
         if (isprint(optopt)){
           fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -122,12 +134,12 @@ int opt;
 
 
   // non-optional parameters
-  args->n = 2;
+  args->n = (args->batch) ? 1 : 2;
 
   if (optind < argc){
     konami_args(argv[optind]);
     if (argc-optind == args->n){
-      copy_string(args->fimg, NPOW_10, argv[optind++]);
+      if (!args->batch) copy_string(args->fimg, NPOW_10, argv[optind++]);
       copy_string(args->fprm, NPOW_10, argv[optind++]);
     } else if (argc-optind < args->n){
       fprintf(stderr, "some non-optional arguments are missing.\n");
@@ -145,10 +157,37 @@ int opt;
 }
 
 
-int main( int argc, char *argv[] ){
-args_t args;
+/** This function prints the stage profile of the processed image to the
++++ log, and optionally appends it to the profile file in the log directory
+--- pl2:    L2 parameters
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void report_profile(par_ll_t *pl2){
+char fname[NPOW_10];
+int nchar;
+
+
+  print_profile();
+
+  if (!pl2->oprf) return;
+
+  nchar = snprintf(fname, NPOW_10, "%s/force-l2ps_profile.csv", pl2->d_log);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return;}
+
+  if (write_profile(fname) != SUCCESS) printf("Writing profile failed.\n");
+
+  return;
+}
+
+
+/** This function processes one Level 1 image, which was resolved in the
++++ Level 2 parameters before
+--- pl2:    L2 parameters
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int level2(par_ll_t *pl2){
 int mission, c;
-par_ll_t *pl2  = NULL; // can be renamed to par, once par is not global anymore...
 meta_t   *meta = NULL;
 multicube_t   *multicube = NULL;
 atc_t    *atc  = NULL;
@@ -158,39 +197,25 @@ brick_t *DN  = NULL;
 brick_t *TOA = NULL;
 brick_t *QAI = NULL;
 
+brick_t **NATIVE = NULL;
 brick_t **LEVEL2 = NULL;
-int nprod;
+l1_gpu_t gpu;
+bool on_gpu;
+int nprod, last;
 int err;
-GDALDriverH driver;
-
-
+char bname[NPOW_10];
 
-  /** initialization + read metadata, parameter and tile file
-  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
   time_t TIME; time(&TIME);
-  
-  parse_args(argc, argv, &args);
-  
 
-  pl2 = allocate_param_lower();
-  copy_string(pl2->d_level1, NPOW_10, args.fimg);
-  copy_string(pl2->f_par,    NPOW_10, args.fprm);
-
-
-  // make GDAL less verbose
-  CPLPushErrorHandler(CPLQuietErrorHandler);
+  basename_with_ext(pl2->d_level1, bname, NPOW_10);
+  start_profile(bname);
 
-  // register GDAL drivers  
-  GDALAllRegister();
-  if ((driver = GDALGetDriverByName("JP2ECW")) != NULL) GDALDeregisterDriver(driver);
+  // initialize GPUs in the process that uses them (not before forking)
+  init_gpu(pl2->gpu_device, pl2->ngpu_device);
 
-  // parse parameter file
-  if (parse_param_lower(pl2) != SUCCESS){
-    printf("Parsing parameter file failed.\n"); return FAILURE;}
-
-  cite_me(_CITE_FORCE_);
-  cite_me(_CITE_L2PS_);
+  // spread the threads over the sockets, images are placed accordingly
+  if (numa_mode() == _NUMA_PIN_) numa_bind_team(-1);
 
   // parse metadata
   if (parse_metadata(pl2, &meta, &DN, &mission) == FAILURE){
@@ -199,16 +224,100 @@ GDALDriverH driver;
   // write and init a new datacube
   if ((multicube = start_multicube(pl2, DN)) == NULL){
     printf("Starting datacube(s) failed.\n"); return FAILURE;}
+  lap_profile("parse_metadata");
 
-  // open threads
-  if (omp_get_thread_limit() < (pl2->nthread)){
-    printf("not enough threads allowed. Reduce NTHREAD.\n"); return FAILURE;}
-  omp_set_num_threads(pl2->nthread);
-  omp_set_nested(true);
-  omp_set_max_active_levels(2);
+  // last active datacube, nothing to do if there is none
+  for (c=0, last=-1; c<multicube->n; c++){
+    if (multicube->cover[c]) last = c;
+  }
+
+  if (last < 0){
+    free_metadata(meta); free_multicube(multicube); free_brick(DN);
+    printf("Success! "); proctime_print("Processing time", TIME);
+    return SUCCESS;
+  }
+
+
+  /** read Digital Numbers + projection
+  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  if (read_level1(meta, mission, DN, pl2) != SUCCESS){
+    printf("reading DNs failed.\n"); return FAILURE;}
+  lap_profile("read_level1");
+
+  if ((atc = allocate_atc(pl2, meta, DN)) == NULL){
+    printf("Allocating atc failed.\n"); return FAILURE;}
+
+
+  // the DNs stay on the GPU until they are converted to TOA
+  on_gpu = open_level1_gpu(meta, mission, DN, &gpu);
+
+
+  /** initialize Quality Assurance Information
+  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  if (bounds_level1(meta, on_gpu ? &gpu : NULL, DN, &QAI, pl2) == FAILURE){
+    printf("Compiling nodata / saturation masks failed.\n"); return FAILURE;}
+  lap_profile("bounds_level1");
+
+
+  /** sun-target-view geometry
+  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  if (sun_target_view(pl2, meta, mission, atc, QAI) == FAILURE){
+    printf("computing sun/view geometry failed.\n"); return FAILURE;}
+  lap_profile("sun_target_view");
+
+
+  /** TOA reflectance + brightness temperature
+  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  if (convert_level1(meta, mission, atc, on_gpu ? &gpu : NULL, DN, &TOA, QAI) != SUCCESS){
+    printf("DN to TOA conversion failed.\n"); return FAILURE;}
+  free_brick_bands(DN);
+  level1_gpu_close(&gpu);
+  lap_profile("convert_level1");
+
+
+  /** read/reproject/ckeck DEM and compute slope/aspect
+  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  if (compile_topography(pl2, atc, &TOP, QAI) != SUCCESS){
+    printf("unable to compile topography.\n"); return FAILURE;}
+  lap_profile("compile_topography");
+
+
+  /** cloud and cloud shadow detection
+  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  err = detect_clouds(pl2, mission, atc, TOA, TOP->dem, TOP->exp, QAI);
+  lap_profile("detect_clouds");
+  if (err == FAILURE){
+    printf("error in cloud module.\n"); return FAILURE;
+  } else if (err == CANCEL){
+    free_metadata(meta); free_multicube(multicube); free_brick(DN);
+    proctime_print("Processing time", TIME);
+    report_profile(pl2);
+    return SUCCESS;
+  }
+
+
+  /** coregistration
+  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  if (coregister(mission, pl2, TOA, QAI) != SUCCESS){
+    printf("coregistration failed.\n"); return FAILURE;}
+  lap_profile("coregister");
 
 
-  // do processing for every datacube [not the best solution, but more easy to implenet atm]
+  /** resolution merge
+  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  if (resolution_merge(mission, pl2->resmerge, TOA, QAI) != SUCCESS){
+    printf("unable to merge resolutions.\n"); return FAILURE;}
+  lap_profile("resolution_merge");
+
+
+  /** radiometric correction
+  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  if ((NATIVE = radiometric_correction(pl2, meta, mission, atc, TOA, QAI, TOP, &nprod)) == NULL){
+    printf("Error in radiometric module.\n"); return FAILURE;}
+
+
+  // the image geometry is processed once, only the output is done for 
+  // every datacube; the last active datacube takes over the products
   for (c=0; c<multicube->n; c++){
 
     // skip inactive cubes
@@ -219,87 +328,110 @@ GDALDriverH driver;
       multicube->cube[c]->cx, multicube->cube[c]->cy);
 
 
-    /** read Digital Numbers + projection
+    /** reprojection, tiling and output
     ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    if (read_level1(meta, mission, DN, pl2) != SUCCESS){
-      printf("reading DNs failed.\n"); return FAILURE;}
+    if ((LEVEL2 = reproject_level2(pl2, atc, multicube->cube[c], NATIVE, nprod, c != last)) == NULL){
+      printf("Error in reprojection.\n"); return FAILURE;}
+    lap_profile("reproject_level2");
 
-    if ((atc = allocate_atc(pl2, meta, DN)) == NULL){
-      printf("Allocating atc failed.\n"); return FAILURE;}
+    if (cube_level2(pl2, meta, multicube->cube[c], LEVEL2, nprod) != SUCCESS){
+      printf("Error in geometric module.\n"); return FAILURE;}
+    lap_profile("cube_level2");
 
+  }
 
-    /** initialize Quality Assurance Information
-    ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    if (bounds_level1(meta, DN, &QAI, pl2) == FAILURE){
-      printf("Compiling nodata / saturation masks failed.\n"); return FAILURE;}
+  // products were handed over to the last datacube
+  free((void*)NATIVE);
+  free_atc(atc);
 
+  free_metadata(meta); free_multicube(multicube);
+  free_brick(DN);
+  lap_profile("cleanup");
 
-    /** sun-target-view geometry
-    ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    if (sun_target_view(pl2, meta, mission, atc, QAI) == FAILURE){
-      printf("computing sun/view geometry failed.\n"); return FAILURE;}
+  printf("Success! "); proctime_print("Processing time", TIME);
+  report_profile(pl2);
 
+  return SUCCESS;
+}
 
-    /** TOA reflectance + brightness temperature
-    ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    if (convert_level1(meta, mission, atc, DN, &TOA, QAI) != SUCCESS){
-      printf("DN to TOA conversion failed.\n"); return FAILURE;}
-    free_brick_bands(DN);
 
+int main( int argc, char *argv[] ){
+args_t args;
+par_ll_t *pl2  = NULL; // can be renamed to par, once par is not global anymore...
+l2_queue_t queue;
+int err;
+GDALDriverH driver;
 
-    /** read/reproject/ckeck DEM and compute slope/aspect
-    ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    if (compile_topography(pl2, atc, &TOP, QAI) != SUCCESS){
-      printf("unable to compile topography.\n"); return FAILURE;}
 
 
-   /** cloud and cloud shadow detection
-    ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    err = detect_clouds(pl2, mission, atc, TOA, TOP->dem, TOP->exp, QAI);
-    if (err == FAILURE){
-      printf("error in cloud module.\n"); return FAILURE;
-    } else if (err == CANCEL){
-      proctime_print("Processing time", TIME);
-      return SUCCESS;
-    }
+  /** initialization + read parameter file
+  ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+  
+  parse_args(argc, argv, &args);
+  
+
+  pl2 = allocate_param_lower();
+  if (!args.batch) copy_string(pl2->d_level1, NPOW_10, args.fimg);
+  copy_string(pl2->f_par,    NPOW_10, args.fprm);
 
 
-   /** coregistration
-    ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    if (coregister(mission, pl2, TOA, QAI) != SUCCESS){
-      printf("coregistration failed.\n"); return FAILURE;}
+  // make GDAL less verbose
+  CPLPushErrorHandler(CPLQuietErrorHandler);
 
+  // register GDAL drivers  
+  GDALAllRegister();
+  if ((driver = GDALGetDriverByName("JP2ECW")) != NULL) GDALDeregisterDriver(driver);
 
-  /** resolution merge
+  // parse parameter file
+  if (parse_param_lower(pl2) != SUCCESS){
+    printf("Parsing parameter file failed.\n"); return FAILURE;}
+
+  cite_me(_CITE_FORCE_);
+  cite_me(_CITE_L2PS_);
+
+  // open threads
+  if (omp_get_thread_limit() < (pl2->nthread)){
+    printf("not enough threads allowed. Reduce NTHREAD.\n"); return FAILURE;}
+  omp_set_num_threads(pl2->nthread);
+  omp_set_nested(true);
+  omp_set_max_active_levels(2);
+
+  // one socket per process only applies to several processes
+  if (pl2->numa_mode == _NUMA_SOCKET_ && !args.batch) pl2->numa_mode = _NUMA_PIN_;
+  init_numa(pl2->numa_mode);
+
+
+  /** process one image, or all queued images
   ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    if (resolution_merge(mission, pl2->resmerge, TOA, QAI) != SUCCESS){
-      printf("unable to merge resolutions.\n"); return FAILURE;}
+  if (args.batch){
 
+    if (strcmp(pl2->f_queue, "NULL") == 0){
+      printf("FILE_QUEUE is not given in parameter file.\n"); return FAILURE;}
 
-    /** radiometric correction
-    ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    if ((LEVEL2 = radiometric_correction(pl2, meta, mission, atc, multicube->cube[c], TOA, QAI, TOP, &nprod)) == NULL){
-      printf("Error in radiometric module.\n"); return FAILURE;}
-    free_atc(atc);
+    if (read_level2_queue(pl2->f_queue, &queue) != SUCCESS){
+      printf("Reading file queue failed.\n"); return FAILURE;}
 
+    err = batch_level2(pl2, &queue, level2);
+    free_level2_queue(&queue);
 
-    /** reprojection, tiling and output
-    ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    if (cube_level2(pl2, meta, multicube->cube[c], LEVEL2, nprod) != SUCCESS){
-      printf("Error in geometric module.\n"); return FAILURE;}
+  } else {
+
+    err = level2(pl2);
 
   }
 
-  free_param_lower(pl2); free_metadata(meta); free_multicube(multicube);
-  free_brick(DN);
+  if (err != SUCCESS) return FAILURE;
 
   cite_push(pl2->d_level2);
-  
-  CPLPopErrorHandler();
 
+  free_wvlut();
+  free_dem_cache();
+  free_base_cache();
+  free_gpu();
+  free_param_lower(pl2);
+
+  CPLPopErrorHandler();
 
-  printf("Success! "); proctime_print("Processing time", TIME);
 
   return SUCCESS;
 }
-
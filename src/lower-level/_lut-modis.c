@@ -43,6 +43,9 @@ used for atmospheric correction in the FORCE Level-2 Processing System
 #include "../cross-level/stats-cl.h"
 #include "../lower-level/modwvp-ll.h"
 
+/** OpenMP **/
+#include <omp.h> // multi-platform shared memory multiprocessing
+
 
 typedef struct {
   int n;
@@ -54,13 +57,15 @@ typedef struct {
   date_t date_end;
   bool daily;
   bool climatology;
+  int nconn;
+  int npar;
 } args_t;
 
 
 void usage(char *exe, int exit_code){
 
 
-  printf("Usage: %s [-h] [-v] [-i] [-d] [-t] [-c] coords-file wvp-dir geometa-dir download-dir\n", exe);
+  printf("Usage: %s [-h] [-v] [-i] [-d] [-t] [-c] [-j] [-p] coords-file wvp-dir geometa-dir download-dir\n", exe);
   printf("\n");
   printf("  -h  = show this help\n");
   printf("  -v  = show version\n");
@@ -70,6 +75,8 @@ void usage(char *exe, int exit_code){
   printf("        default: 20000224,today\n");
   printf("  -t  = build daily tables? Default: true\n");
   printf("  -c  = build climatology? Default: true\n");
+  printf("  -j  = number of concurrent downloads. Default: 4\n");
+  printf("  -p  = number of dates processed in parallel. Default: 1\n");
   printf("\n");
   printf("  Positional arguments:\n");
   printf("  - 'coords-file':  text file with coordinates\n");
@@ -97,9 +104,11 @@ int opt;
   current_date(&args->date_end);
   args->daily       = true;
   args->climatology = true;
+  args->nconn       = 4;
+  args->npar        = 1;
 
   // optional parameters
-  while ((opt = getopt(argc, argv, "hvid:t:c:")) != -1){
+  while ((opt = getopt(argc, argv, "hvid:t:c:j:p:")) != -1){
     switch(opt){
       case 'h':
         usage(argv[0], SUCCESS);
@@ -152,6 +161,20 @@ int opt;
           usage(argv[0], FAILURE);
         }
         break;
+      case 'j':
+        args->nconn = atoi(optarg);
+        if (args->nconn < 1){
+          fprintf(stderr, "number of concurrent downloads must be >= 1\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
+      case 'p':
+        args->npar = atoi(optarg);
+        if (args->npar < 1){
+          fprintf(stderr, "number of parallel dates must be >= 1\n");
+          usage(argv[0], FAILURE);
+        }
+        break;
       case '?':
         if (isprint(optopt)){
           fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -202,7 +225,8 @@ char    **SEN = NULL;
 float   **COO = NULL;
 float    *WVP = NULL;
 double ***AVG = NULL;
-int m, c, nc;
+date_t *dates = NULL, d;
+int m, c, nc, t, nd;
 char tablename[NPOW_10];
 char  key[NPOW_10];
 int nchar;
@@ -219,43 +243,64 @@ int nchar;
     printf("error parsing coordinates.\n"); exit(1);}
 
   alloc((void**)&WVP, nc, sizeof(float));
-  alloc_2D((void***)&SEN, nc, NPOW_02, sizeof(char));
 
 
   /** Step 1: daily Look-up-tables
-  +++ do for each day between start and end **/
+  +++ do for each day between start and end. Dates are independent
+  +++ of each other, and are distributed over a bounded number of 
+  +++ workers, each with its own water vapor buffers. **/
 
   if (args.daily){
 
-    while (0 < 1){
+    // enumerate the dates
+    for (nd=1, d=args.date_start; 0 < 1; nd++){
 
-      printf("%4d/%02d/%02d. ", args.date_start.year, args.date_start.month, args.date_start.day); fflush(stdout);
+      // if iterated date is end date, stop.
+      if (d.year  == args.date_end.year && 
+          d.month == args.date_end.month && 
+          d.day   == args.date_end.day) break;
 
-      // LUT name
-      nchar = snprintf(tablename, NPOW_10, "%s/WVP_%04d-%02d-%02d.txt", args.dwvp, 
-        args.date_start.year, args.date_start.month, args.date_start.day);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+      // go to next day
+      date_plus(&d);
 
-      // create LUT only if it doesn't exist
-      if (!fileexist(tablename)){
-        printf("do. ");
-        create_wvp_lut(args.dgeo, args.dhdf, tablename, args.date_start, nc, COO, WVP, SEN, key);
-      } else {
-        printf("LUT exists.\n");
-      }
+    }
 
-      // if iterated date is end date, stop.
-      if (args.date_start.year  == args.date_end.year && 
-          args.date_start.month == args.date_end.month && 
-          args.date_start.day   == args.date_end.day) break;
+    alloc((void**)&dates, nd, sizeof(date_t));
+    for (t=0, d=args.date_start; t<nd; t++){ dates[t] = d; date_plus(&d);}
 
-      // go to next day
-      //date_plus(&args.date_start, timeinfo);
-      date_plus(&args.date_start);
+
+    #pragma omp parallel num_threads(args.npar) private(tablename, nchar, WVP, SEN) shared(args, dates, nd, nc, COO, key) default(none)
+    {
+
+      alloc((void**)&WVP, nc, sizeof(float));
+      alloc_2D((void***)&SEN, nc, NPOW_02, sizeof(char));
+
+      #pragma omp for schedule(dynamic)
+      for (t=0; t<nd; t++){
+
+        // LUT name
+        nchar = snprintf(tablename, NPOW_10, "%s/WVP_%04d-%02d-%02d.txt", args.dwvp, 
+          dates[t].year, dates[t].month, dates[t].day);
+        if (nchar < 0 || nchar >= NPOW_10){ 
+          printf("Buffer Overflow in assembling filename\n"); exit(FAILURE);}
+
+        // create LUT only if it doesn't exist
+        if (!fileexist(tablename)){
+          printf("%4d/%02d/%02d. do. ", dates[t].year, dates[t].month, dates[t].day); fflush(stdout);
+          create_wvp_lut(args.dgeo, args.dhdf, tablename, dates[t], nc, COO, WVP, SEN, key, args.nconn);
+        } else {
+          printf("%4d/%02d/%02d. LUT exists.\n", dates[t].year, dates[t].month, dates[t].day);
+        }
+
+      }
+
+      free((void*)WVP);
+      free_2D((void**)SEN, nc);
 
     }
 
+    free((void*)dates);
+
   }
 
 
@@ -341,7 +386,6 @@ int nchar;
   // free memory
   free((void*)WVP);
   free_2D((void**)COO, 2);
-  free_2D((void**)SEN, nc);
 
   return SUCCESS;
 }
@@ -30,9 +30,8 @@ This file contains functions for handling Aerosol Optical Depth
 /** GNU Scientific Library (GSL) **/
 #include <gsl/gsl_multimin.h>          // minimization functions 
 
-/** Geospatial Data Abstraction Library (GDAL) **/
-#include "cpl_conv.h"       // various convenience functions for CPL
-#include "gdalgrid.h"       // GDAL gridder related entry points and defs
+/** OpenMP **/
+#include <omp.h> // multi-platform shared memory multiprocessing
 
 
 /** This function reads externally provided AOD values, e.g. to use an AOD
@@ -595,8 +594,6 @@ short **toa_   = NULL;
 
 #ifdef FORCE_DEBUG
 
-#include "cpl_multiproc.h"  // CPL Multi-Threading
-
 /** This function prints the dark objects
 --- dobj:   Extracted targets (returned)
 --- o:      Object ID
@@ -608,7 +605,7 @@ void print_dark_object(darkobj_t *dobj, int o, int nb, int type, char *dlog){
 int b;
 char fname[NPOW_10];
 int nchar;
-char *lock = NULL;
+lock_t *lock = NULL;
 FILE *fp = NULL;
 
 
@@ -616,7 +613,7 @@ FILE *fp = NULL;
   if (nchar < 0 || nchar >= NPOW_10){ 
     printf("Buffer Overflow in assembling filename\n"); exit(1);}
 
-  if ((lock = (char*)CPLLockFile(fname, 60)) == NULL){
+  if ((lock = lock_file(fname, 60)) == NULL){
     printf("Unable to lock %s (timeout: %ds).\n", fname, 60);
     return;}
 
@@ -634,7 +631,7 @@ FILE *fp = NULL;
   fprintf(fp, "   Rsq %01.2f, spec # %d, fit # %d\n\n", dobj[o].rsq, dobj[o].lib_id, dobj[o].ang_fit);
   
   fclose(fp);
-  CPLUnlockFile(lock);
+  unlock_file(lock);
 
   return;
 }
@@ -796,22 +793,26 @@ float coef[3], coefbest[3];
         if (type != _AOD_VEG_){
 
           fit = 0;
-          aod_polynomial_fit(atc, naod, aodlog[w], &coef[0], &coef[1], &coef[2]);
-          for (b=0; b<nb; b++) aodfit[w][b] = coef[0] * pow(atc->wvl[b], coef[1]+coef[2]*atc->lwvl[b]);
+          valid = (aod_polynomial_fit(atc, naod, aodlog[w], &coef[0], &coef[1], &coef[2]) == SUCCESS);
 
           /** some reasonability checks **/
-          valid = true;
-          for (b=1, valid = true; b<nb; b++){
-            if (aodfit[w][b] > aodfit[w][b-1] && 
-                aodfit[w][b] > 0.01 &&
-                aodfit[w][b-1] > 0.01) valid = false;
-            if (aodfit[w][b] < -0.01 &&
-                aodfit[w][b-1] < -0.01) valid = false;
-          }
+          if (valid){
 
-          if (coef[0] < 0 || coef[0] > 0.3) valid = false;
-          if (coef[1] > 0 || coef[1] < -3)  valid = false;
-          if (coef[2] > 0) valid = false;
+            for (b=0; b<nb; b++) aodfit[w][b] = coef[0] * pow(atc->wvl[b], coef[1]+coef[2]*atc->lwvl[b]);
+
+            for (b=1; b<nb; b++){
+              if (aodfit[w][b] > aodfit[w][b-1] && 
+                  aodfit[w][b] > 0.01 &&
+                  aodfit[w][b-1] > 0.01) valid = false;
+              if (aodfit[w][b] < -0.01 &&
+                  aodfit[w][b-1] < -0.01) valid = false;
+            }
+
+            if (coef[0] < 0 || coef[0] > 0.3) valid = false;
+            if (coef[1] > 0 || coef[1] < -3)  valid = false;
+            if (coef[2] > 0) valid = false;
+
+          }
         
         } else valid = false;
 
@@ -1238,6 +1239,11 @@ float E0_, Eg, Egc, k;
   if ((sw2   = find_domain(atc->xy_aod, "SWIR2")) < 0) return FAILURE; 
 
 
+  // molecular and aerosol environmental weighting, independent of AOD
+  km = dobj.r*res/1000.0+res/1000.0/2;
+  Fr = env_weight_molecular(km);
+  Fa = env_weight_aerosol(km);
+
   alloc((void**)&bestmatch, lib->n, sizeof(float));
 
   /** do separately for each band **/
@@ -1307,9 +1313,6 @@ float E0_, Eg, Egc, k;
       rhoe = tmp / (T + s*tmp);
 
       // environmental weighting function, F(r)
-      km = dobj.r*res/1000.0+res/1000.0/2;
-      Fr = env_weight_molecular(km);
-      Fa = env_weight_aerosol(km);
       F = env_weight(aod, mod, Fa, Fr);
 
 
@@ -1401,109 +1404,54 @@ float slope, inter;
 }
 
 
-/** Minimizer for 2nd order polynomial fit between ln(aod) and ln(wvl)
-+++ This function minimizes the RMSE of the polynomial fit.
-+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-double aod_polynomial_minimizer(const gsl_vector *v, void *params){
-float a0, a1, a2;
-int b, bb = 0, nb;
-float *p = (float *)params;
-double y, lwvl, laod, tmp = 0;
-
-  a0 = gsl_vector_get(v, 0);
-  a1 = gsl_vector_get(v, 1);
-  a2 = gsl_vector_get(v, 2);
-  nb = p[bb++];
-
-  for (b=0; b<nb; b++){
-    lwvl = p[bb++];
-    laod = p[bb++];
-    y = a0 + a1*lwvl + a2*lwvl*lwvl;
-    tmp += (y-laod)*(y-laod);
-  }
-
-  return sqrt(tmp/(float)nb);
-}
-
-
 /** 2nd order polynomial fit between ln(aod) and ln(wvl)
 +++ This function fits a modified Angstrom expression to the AOD spectrum,
 +++ which accounts for curvature in the AOD spectrum. The function estima-
 +++ tes the turbidity coefficient (a0), Angstrom exponent (a1) and a term
-+++ for describing the curvature (a2).
++++ for describing the curvature (a2). The least squares solution is com-
++++ puted in closed form, i.e. the 3x3 normal equations are solved with
++++ Cramer's rule.
 --- atc:    atmospheric correction factors
 --- naod:   number of bands for AOD estimation
 --- logaod: logarithm of estimated AOD
 --- a0:     turbidity coefficient (returned)
 --- a1:     Angstrom exponent     (returned)
 --- a2:     curvature coefficient (returned)
-+++ Return: GSL fit status
++++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int aod_polynomial_fit(atc_t *atc, int naod, float *logaod, float *a0, float *a1, float *a2){
-const gsl_multimin_fminimizer_type *T = gsl_multimin_fminimizer_nmsimplex2;
-gsl_multimin_fminimizer *s = NULL;
-gsl_vector *ss, *x;
-gsl_multimin_function minex_func;
-int b, bb, nb;
-float *param;
-size_t iter = 0;
-int status;
-double size;
+int b, nb;
+double x, x2, y;
+double s0 = 0, s1 = 0, s2 = 0, s3 = 0, s4 = 0;
+double t0 = 0, t1 = 0, t2 = 0;
+double det, d0, d1, d2;
 
 
-  nb = get_brick_nbands(atc->xy_aod);
+  if (naod < 3) return FAILURE;
 
-  alloc((void**)&param, naod*2+1, sizeof(float));
+  nb = get_brick_nbands(atc->xy_aod);
 
-  param[0] = naod;
-  for (b=0, bb=1; b<nb; b++){
+  // sums of the normal equations
+  for (b=0; b<nb; b++){
     if (!atc->aod_bands[b]) continue;
-    param[bb++] = atc->lwvl[b];
-    param[bb++] = logaod[b];
+    x = atc->lwvl[b]; x2 = x*x;
+    y = logaod[b];
+    s0 += 1;  s1 += x;    s2 += x2; s3 += x2*x; s4 += x2*x2;
+    t0 += y;  t1 += x*y;  t2 += x2*y;
   }
 
+  det = s0*(s2*s4-s3*s3) - s1*(s1*s4-s2*s3) + s2*(s1*s3-s2*s2);
+  if (fabs(det) < 1e-12) return FAILURE;
 
-  /* Starting point */
-  x = gsl_vector_alloc (3);
-  gsl_vector_set (x, 0, 0);
-  gsl_vector_set (x, 1, 0);
-  gsl_vector_set (x, 2, 0);
+  d0 = t0*(s2*s4-s3*s3) - s1*(t1*s4-s3*t2) + s2*(t1*s3-s2*t2);
+  d1 = s0*(t1*s4-s3*t2) - t0*(s1*s4-s2*s3) + s2*(s1*t2-t1*s2);
+  d2 = s0*(s2*t2-t1*s3) - s1*(s1*t2-t1*s2) + t0*(s1*s3-s2*s2);
 
-  /* Set initial step sizes */
-  ss = gsl_vector_alloc (3);
-  gsl_vector_set (ss, 0, 0.01);
-  gsl_vector_set (ss, 1, 0.01);
-  gsl_vector_set (ss, 2, 0.02);
+  *a0 = exp(d0/det);
+  *a1 = d1/det;
+  *a2 = d2/det;
 
-  /* Initialize method and iterate */
-  minex_func.n = 3;
-  minex_func.f = aod_polynomial_minimizer;
-  minex_func.params = param;
-
-  s = gsl_multimin_fminimizer_alloc(T, 3);
-  gsl_multimin_fminimizer_set(s, &minex_func, x, ss);
-
-  do {
-    iter++;
-    status = gsl_multimin_fminimizer_iterate(s);
-
-    if (status) break;
-
-    size = gsl_multimin_fminimizer_size(s);
-    status = gsl_multimin_test_size(size, 1e-2);
-
-  } while (status == GSL_CONTINUE && iter < 100);
-
-  *a0 = exp(gsl_vector_get(s->x, 0));
-  *a1 = gsl_vector_get(s->x, 1);
-  *a2 = gsl_vector_get(s->x, 2);
-
-  free((void*)param);
-  gsl_vector_free(x);
-  gsl_vector_free(ss);
-  gsl_multimin_fminimizer_free(s);
-
-  return status;
+  return SUCCESS;
 }
 
 
@@ -1596,25 +1544,28 @@ float *weight = NULL;
 /** This function interpolates the average AOD maps that may contain no-
 +++ data values. Inverse Distance Weighting is used, this reduces extra-
 +++ polation artifacts. Lowpass filtering is applied to the interpolation
-+++ to further smooth the map.
++++ to further smooth the map. The interpolation replicates the GDAL grid-
++++ der (power 2, no search radius), but the weights are only computed 
++++ once for all bands, and the grid cells are interpolated in parallel.
 --- atc:     atmospheric correction factors
 --- map_aod: averaged AOD map
 +++ Return:  SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int interpolate_aod_map(atc_t *atc, float **map_aod){
 int b, nb, green;
-int e, f, g, ee, ff, ne, nf, ng;
+int e, f, g, ee, ff, ne, nf, ng, o;
 int k = 0;
-GDALGridAlgorithm eAlgorithm = GGA_InverseDistanceToAPower;
-void *pOptions = NULL;
-GDALDataType eOutputType = GDT_Float64;
+double dx, dy, x, y, r2, w, wsum;
+double delta_x, delta_y;
 double  sum,  num;
 double gsum, gnum;
 float aod;
+int exact;
 double  *aod_x   = NULL;
 double  *aod_y   = NULL;
 double **aod_z   = NULL;
-double *interpol = NULL;
+double  *zsum    = NULL;
+double **interpol = NULL;
 
 
   nb = get_brick_nbands(atc->xy_aod);
@@ -1623,8 +1574,6 @@ double *interpol = NULL;
   ng = get_brick_ncells(atc->xy_aod);
   if ((green = find_domain(atc->xy_aod, "GREEN")) < 0) return FAILURE; 
 
-  ParseAlgorithmAndOptions(szAlgNameInvDist, &eAlgorithm, &pOptions);
-
   // number of cells with AOD estimate
   for (g=0, k=0; g<ng; g++){
     if (map_aod[green][g] > 0) k++;
@@ -1633,8 +1582,8 @@ double *interpol = NULL;
   // allocate memory
   alloc((void**)&aod_x, k, sizeof(double));
   alloc((void**)&aod_y, k, sizeof(double));
-  alloc_2D((void***)&aod_z, nb, k, sizeof(double));
-  alloc((void**)&interpol, ng, sizeof(double));
+  alloc_2D((void***)&aod_z, k, nb, sizeof(double));
+  alloc_2D((void***)&interpol, nb, ng, sizeof(double));
 
 
   // copy AOD estimates to array
@@ -1642,7 +1591,7 @@ double *interpol = NULL;
   for (f=0; f<nf; f++, g++){
     if (map_aod[green][g] > 0){
       for (b=0; b<nb; b++){
-        aod_z[b][k] = map_aod[b][g];
+        aod_z[k][b] = map_aod[b][g];
       }
       aod_x[k] = f;
       aod_y[k] = e;
@@ -1652,39 +1601,95 @@ double *interpol = NULL;
   }
 
 
-  // interpolate and smooth AOD
-  for (b=0; b<nb; b++){
+  /** compute interpolation for all bands at once. Grid nodes are
+  +++ located at the cell centers of the extent spanned by the
+  +++ coarse grid coordinates, like in GDALGridCreate. If a node
+  +++ coincides with an estimate, the estimate is used directly. **/
 
-    // compute interpolation
-    GDALGridCreate(eAlgorithm, pOptions, k, aod_x, aod_y, aod_z[b],
-      0, nf-1, 0, ne-1, nf, ne, eOutputType, (void*)interpol, NULL, NULL);
+  delta_x = (nf-1)/(double)nf;
+  delta_y = (ne-1)/(double)ne;
 
-    sum = num = 0;
+  #pragma omp parallel private(e, f, b, o, x, y, dx, dy, r2, w, wsum, exact, zsum) shared(nb, nf, ng, k, delta_x, delta_y, aod_x, aod_y, aod_z, interpol) default(none)
+  {
 
-    // lowpass filter
-    for (e=0, g=0; e<ne; e++){
-    for (f=0; f<nf; f++, g++){
+    alloc((void**)&zsum, nb, sizeof(double));
 
-      if (get_brick(atc->xy_view, ZEN, g) < 0) continue;
+    #pragma omp for schedule(static)
+    for (g=0; g<ng; g++){
+
+      e = g/nf;
+      f = g%nf;
+
+      x = (f+0.5)*delta_x;
+      y = (e+0.5)*delta_y;
+
+      for (b=0; b<nb; b++) zsum[b] = 0;
+      wsum = 0;
+      exact = -1;
+
+      for (o=0; o<k; o++){
+
+        dx = aod_x[o]-x;
+        dy = aod_y[o]-y;
+        r2 = dx*dx + dy*dy;
+
+        if (r2 < 1e-13){ exact = o; break;}
+
+        w = 1.0/r2;
+        for (b=0; b<nb; b++) zsum[b] += aod_z[o][b]*w;
+        wsum += w;
 
-      gsum = gnum = 0;
-      for (ee=-1; ee<=1; ee++){
-      for (ff=-1; ff<=1; ff++){
-        if (e+ee < 0 || f+ff < 0 || e+ee >= ne || f+ff >= nf) continue;
-        gsum += interpol[(e+ee)*nf + (f+ff)];
-        gnum++;
-      }
       }
-      
-      if (gnum > 0) aod = (float)(gsum/gnum); else aod = 0.0;
-      set_brick(atc->xy_aod, b, g, aod); 
 
-      if (aod > 0){
-        sum += aod;
-        num++;
+      if (exact >= 0){
+        for (b=0; b<nb; b++) interpol[b][g] = aod_z[exact][b];
+      } else if (wsum > 0){
+        for (b=0; b<nb; b++) interpol[b][g] = zsum[b]/wsum;
       }
 
     }
+
+    free((void*)zsum);
+
+  }
+
+
+  // smooth AOD
+  for (b=0; b<nb; b++){
+
+    sum = num = 0;
+
+    // lowpass filter
+    #pragma omp parallel private(e, f, ee, ff, gsum, gnum, aod) shared(b, nf, ne, ng, interpol, atc) reduction(+: sum, num) default(none)
+    {
+
+      #pragma omp for schedule(static)
+      for (g=0; g<ng; g++){
+
+        if (get_brick(atc->xy_view, ZEN, g) < 0) continue;
+
+        e = g/nf;
+        f = g%nf;
+
+        gsum = gnum = 0;
+        for (ee=-1; ee<=1; ee++){
+        for (ff=-1; ff<=1; ff++){
+          if (e+ee < 0 || f+ff < 0 || e+ee >= ne || f+ff >= nf) continue;
+          gsum += interpol[b][(e+ee)*nf + (f+ff)];
+          gnum++;
+        }
+        }
+        
+        if (gnum > 0) aod = (float)(gsum/gnum); else aod = 0.0;
+        set_brick(atc->xy_aod, b, g, aod); 
+
+        if (aod > 0){
+          sum += aod;
+          num++;
+        }
+
+      }
+
     }
 
     if (num > 0) atc->aod[b] = (float)(sum/num); else atc->aod[b] = 0.0;
@@ -1692,11 +1697,10 @@ double *interpol = NULL;
   }
 
   // clean
-  CPLFree(pOptions);
   free((void*)aod_x);
   free((void*)aod_y);
-  free_2D((void**)aod_z, nb);
-  free((void*)interpol);
+  free_2D((void**)aod_z, k);
+  free_2D((void**)interpol, nb);
 
   return SUCCESS;
 }
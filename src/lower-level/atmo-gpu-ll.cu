@@ -0,0 +1,504 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains the surface reflectance inversion on the GPU. One 
+thread per pixel interpolates the coarse atmospheric grids and inverts 
+the radiative transfer, like surface_reflectance in atmo-ll.c. The band-
+invariant inputs (DEM, topography, angles) are uploaded once per image,
+the coarse grids and TOA reflectance once per band. Without FORCE_CUDA,
+this file is compiled as C++ and surface_gpu_open always cancels.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "atmo-gpu-ll.h"
+
+#include <string.h>  // string handling functions
+#include <math.h>    // common mathematical functions
+#include <float.h>   // macro constants of the floating-point library
+#include <limits.h>  // macro constants of the integral types
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define GPU_NTHREAD 256
+
+// device copies of one image
+typedef struct {
+  gpu_stream_t stream;  // stream of the device
+  size_t nc, ng;        // number of cells in image and coarse grid
+  size_t bytes_xyz;     // bytes of the elevation-dependent grids
+  small  *dem;          // binned DEM
+  short  *ill;          // illumination angle
+  ushort *sky;          // sky view factor
+  ushort *cf;           // C-factor
+  float  *vz, *sz;      // view and sun zenith
+  short  *toa, *bck, *tg; // per-band input
+  small  *state;        // pixel state
+  short  *boa;          // BOA reflectance
+  small  *flag;         // pixel flags
+  float  *xy;           // Tg, Tvo, Tso, brdf [4][ng]
+  float  *xyz;          // T, Ts, tss, tsd, tvs, tvd, s, rho_p [8][nz][ng]
+  float  *host_xyz;     // staging buffer for xyz
+} boa_dev_t;
+
+enum { _XY_TG_, _XY_TVO_, _XY_TSO_, _XY_BRDF_, _XY_LENGTH_ };
+enum { _XYZ_T_, _XYZ_TS_, _XYZ_TSS_, _XYZ_TSD_, _XYZ_TVS_, _XYZ_TVD_, _XYZ_S_, _XYZ_RHO_P_ };
+
+
+// interpolation weights, see interpolation_weights in atmo-ll.c
+typedef struct {
+int   gul, gur, gll, glr;
+float wul, wur, wll, wlr;
+float wtop, wdown;
+} iweights_t;
+
+
+/** Relative float comparison, mirrors fequal in utils-cl.c
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+__device__ bool fequal_gpu(float a, float b){
+float diff, max, A, B;
+
+  diff = fabs(a-b);
+  A = fabs(a);
+  B = fabs(b);
+
+  max = (B > A) ? B : A;
+
+  if (diff <= max * FLT_EPSILON) return true;
+
+  return false;
+}
+
+
+/** Interpolation weights of the coarse grid, mirrors the host function
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+__device__ iweights_t interpolation_weights_gpu(int j, int i, int nf, int ne, float res, float full_res, const float *COARSE, float nodata){
+iweights_t weight;
+float e_, f_;
+int   e, f;
+int   gleft, gright, gtop, gdown;
+float cleft, cright, ctop, cdown;
+bool vtop = true, vdown = true;
+bool vul, vur, vll, vlr;
+
+
+  e_ = i*full_res/res; e = floor(e_);
+  f_ = j*full_res/res; f = floor(f_);
+
+  if (f_-f < 0.5){ gleft = f-1; gright = f;} else { gleft = f; gright = f+1;}
+  if (e_-e < 0.5){ gtop  = e-1; gdown  = e;} else { gtop  = e; gdown  = e+1;}
+
+  if (gleft < 0) gleft = f;
+  if (gtop < 0)  gtop  = e;
+  if (gright >= nf) gright = f;
+  if (gdown  >= ne) gdown  = e;
+
+  cleft  = gleft  + 0.5;
+  cright = gright + 0.5;
+  ctop   = gtop   + 0.5;
+  cdown  = gdown  + 0.5;
+
+  weight.gul = gtop*nf  + gleft;
+  weight.gur = gtop*nf  + gright;
+  weight.gll = gdown*nf + gleft;
+  weight.glr = gdown*nf + gright;
+
+  vul = !fequal_gpu(COARSE[weight.gul], nodata);
+  vur = !fequal_gpu(COARSE[weight.gur], nodata);
+  vll = !fequal_gpu(COARSE[weight.gll], nodata);
+  vlr = !fequal_gpu(COARSE[weight.glr], nodata);
+
+  if (gleft == gright){
+    weight.wul = 0.5; weight.wur = 0.5;
+  } else if (vul && vur){
+    weight.wul = (cright-f_)/(cright-cleft);
+    weight.wur = (f_-cleft)/(cright-cleft);
+  } else if (vul && !vur){
+    weight.wul = 1; weight.wur = 0;
+  } else if (!vul && vur){
+    weight.wul = 0; weight.wur = 1;
+  } else {
+    weight.wul = 0; weight.wur = 0;
+    vtop = false;
+  }
+
+  if (gleft == gright){
+    weight.wll = 0.5; weight.wlr = 0.5;
+  } else if (vll && vlr){
+    weight.wll = (cright-f_)/(cright-cleft);
+    weight.wlr = (f_-cleft)/(cright-cleft);
+  } else if (vll && !vlr){
+    weight.wll = 1; weight.wlr = 0;
+  } else if (!vll && vlr){
+    weight.wll = 0; weight.wlr = 1;
+  } else {
+    weight.wll = 0; weight.wlr = 0;
+    vdown = false;
+  }
+
+  if (gtop == gdown){
+    weight.wtop = 0.5; weight.wdown = 0.5;
+  } else if (vtop && vdown){
+    weight.wtop  = (cdown-e_)/(cdown-ctop);
+    weight.wdown = (e_-ctop)/(cdown-ctop);
+  } else if (vtop){
+    weight.wtop = 1; weight.wdown = 0;
+  } else if (vdown){
+    weight.wtop = 0; weight.wdown = 1;
+  } else {
+    weight.wtop = 0; weight.wdown = 0;
+  }
+
+  return weight;  
+}
+
+
+/** Interpolate one coarse grid through the read-only data cache
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+__device__ float interpolate_coarse_gpu(iweights_t weight, const float *__restrict__ COARSE){
+float ul, ur, ll, lr;
+
+  ul = __ldg(&COARSE[weight.gul]);
+  ur = __ldg(&COARSE[weight.gur]);
+  ll = __ldg(&COARSE[weight.gll]);
+  lr = __ldg(&COARSE[weight.glr]);
+
+  return weight.wtop  * (weight.wul*ul + weight.wur*ur) + 
+         weight.wdown * (weight.wll*ll + weight.wlr*lr);
+}
+
+
+/** Surface reflectance kernel, one thread per pixel
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+__global__ void surface_kernel(boa_gpu_t job, boa_dev_t dev, float E0){
+size_t p = (size_t)blockIdx.x*blockDim.x + threadIdx.x;
+int i, j, z;
+size_t ng = dev.ng;
+float A = 1.0;
+float brdf = 1.0;
+iweights_t weights;
+float toa, bck, ref, tmp;
+float E0_, tss_sw2, tsd_sw2;
+float sky, ill, cf, f, f0, h0; 
+float T, Ts, tss, tsd, tvs, tvd;
+float s, rho_p, szen, ms;
+float tg, Tso, Tvo;
+const float *xyz = NULL;
+small flag = 0;
+
+
+  if (p >= dev.nc) return;
+
+  if (dev.state[p] & ATMO_GPU_OFF){
+    dev.boa[p] = job.nodata; dev.flag[p] = 0; return;}
+
+  i = p / job.nx;
+  j = p % job.nx;
+
+  toa = dev.toa[p]/10000.0;
+  z = dev.dem[p];
+  xyz = dev.xyz + (size_t)z*ng;
+
+  // smooth atc variables
+  weights = interpolation_weights_gpu(j, i, job.nf, job.ne, job.gres, job.fres, dev.vz, job.vnodata);
+  T       = interpolate_coarse_gpu(weights, xyz + (size_t)_XYZ_T_    *job.nz*ng);
+  Ts      = interpolate_coarse_gpu(weights, xyz + (size_t)_XYZ_TS_   *job.nz*ng);
+  tss     = interpolate_coarse_gpu(weights, xyz + (size_t)_XYZ_TSS_  *job.nz*ng);
+  tsd     = interpolate_coarse_gpu(weights, xyz + (size_t)_XYZ_TSD_  *job.nz*ng);
+  tvs     = interpolate_coarse_gpu(weights, xyz + (size_t)_XYZ_TVS_  *job.nz*ng);
+  tvd     = interpolate_coarse_gpu(weights, xyz + (size_t)_XYZ_TVD_  *job.nz*ng);
+  s       = interpolate_coarse_gpu(weights, xyz + (size_t)_XYZ_S_    *job.nz*ng);
+  rho_p   = interpolate_coarse_gpu(weights, xyz + (size_t)_XYZ_RHO_P_*job.nz*ng);
+  // like the host, which interpolates tss/tsd of the band itself
+  tss_sw2 = tss;
+  tsd_sw2 = tsd;
+  if (job.dobrdf) brdf = interpolate_coarse_gpu(weights, dev.xy + _XY_BRDF_*ng); 
+
+  if (dev.tg == NULL){
+    tg = interpolate_coarse_gpu(weights, dev.xy + _XY_TG_*ng);
+  } else {
+    tg = dev.tg[p]/10000.0;
+  }
+
+  // topographic correction factor
+  if (job.dotopo){
+
+    sky = dev.sky[p]/10000.0;
+    ill = dev.ill[p]/10000.0;
+    cf  = dev.cf[p]/10000.0;
+
+    if (ill > 0){
+
+      szen = interpolate_coarse_gpu(weights, dev.sz); 
+      ms   = cos(szen);
+      Tso  = interpolate_coarse_gpu(weights, dev.xy + _XY_TSO_*ng); 
+      Tvo  = interpolate_coarse_gpu(weights, dev.xy + _XY_TVO_*ng); 
+      E0_ = E0 * Tvo*Tso;
+      f  = E0_*tss/(E0_*tsd);
+      f0 = E0_*tss_sw2/(E0_*tsd_sw2);
+      h0 = (M_PI+2*szen)/(2.0*M_PI);
+
+      A = (ms+cf/f0*f/h0)/(ill+sky*cf/f0*f/h0);
+      if (A < 0) A = -10000.0;
+
+    } else A = 1.0;
+
+  }
+
+  if (job.doenv){
+
+    // target reflectance
+    bck = dev.bck[p]/10000.0;
+    tmp = (1-bck*s);
+
+    ref = A * brdf * 
+        (toa/tg*tmp - rho_p*tmp - Ts*tvs*bck) / (Ts*tvd);
+
+  } else {
+
+    // homogeneous target reflectance
+    tmp = (toa-rho_p)/tg;
+    ref = A * brdf * tmp / (T + s*tmp);
+
+  }
+
+
+  if (ref < 0.0) flag |= ATMO_GPU_SUBZERO;
+  if (ref > 1.0) flag |= ATMO_GPU_SATURAT;
+
+  if (dev.state[p] & ATMO_GPU_ERASE){
+    dev.boa[p] = job.nodata;
+  } else if (ref < -1.0){
+    dev.boa[p] = job.nodata;
+    flag |= ATMO_GPU_SETOFF;
+  } else if (ref*10000.0 > SHRT_MAX){
+    dev.boa[p] = (short)SHRT_MAX;
+  } else {
+    dev.boa[p] = (short)(ref*10000.0);
+  }
+
+  dev.flag[p] = flag;
+
+  return;
+}
+
+#endif
+
+
+/** This function prepares the surface reflectance inversion of one image
++++ on the GPU. Device memory for all inputs and outputs is allocated, 
++++ and the band-invariant inputs are uploaded.
+--- job:    surface reflectance of one image
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int surface_gpu_open(boa_gpu_t *job){
+#ifdef FORCE_CUDA
+boa_dev_t *dev = NULL;
+cudaStream_t s;
+int error = 0;
+
+
+  job->dev = NULL;
+
+  if (!gpu_enabled()) return CANCEL;
+
+  alloc((void**)&dev, 1, sizeof(boa_dev_t));
+  job->dev = dev;
+
+  dev->stream = claim_gpu_stream();
+  if (gpu_select(dev->stream) == FAILURE){
+    surface_gpu_close(job); return CANCEL;}
+  s = (cudaStream_t)gpu_cuda_stream(dev->stream);
+
+  dev->nc = (size_t)job->nx*job->ny;
+  dev->ng = (size_t)job->nf*job->ne;
+  dev->bytes_xyz = ATMO_GPU_NXYZ*job->nz*dev->ng*sizeof(float);
+
+  if ((dev->dem   = (small*)gpu_alloc(dev->nc*sizeof(small),  dev->stream)) == NULL) error++;
+  if ((dev->toa   = (short*)gpu_alloc(dev->nc*sizeof(short),  dev->stream)) == NULL) error++;
+  if ((dev->state = (small*)gpu_alloc(dev->nc*sizeof(small),  dev->stream)) == NULL) error++;
+  if ((dev->boa   = (short*)gpu_alloc(dev->nc*sizeof(short),  dev->stream)) == NULL) error++;
+  if ((dev->flag  = (small*)gpu_alloc(dev->nc*sizeof(small),  dev->stream)) == NULL) error++;
+  if ((dev->vz    = (float*)gpu_alloc(dev->ng*sizeof(float),  dev->stream)) == NULL) error++;
+  if ((dev->sz    = (float*)gpu_alloc(dev->ng*sizeof(float),  dev->stream)) == NULL) error++;
+  if ((dev->xy    = (float*)gpu_alloc(_XY_LENGTH_*dev->ng*sizeof(float), dev->stream)) == NULL) error++;
+  if ((dev->xyz   = (float*)gpu_alloc(dev->bytes_xyz, dev->stream)) == NULL) error++;
+
+  if (job->doenv){
+    if ((dev->bck = (short*)gpu_alloc(dev->nc*sizeof(short), dev->stream)) == NULL) error++;
+  }
+
+  if (job->dotopo){
+    if ((dev->ill = (short*)gpu_alloc(dev->nc*sizeof(short),  dev->stream))  == NULL) error++;
+    if ((dev->sky = (ushort*)gpu_alloc(dev->nc*sizeof(ushort), dev->stream)) == NULL) error++;
+    if ((dev->cf  = (ushort*)gpu_alloc(dev->nc*sizeof(ushort), dev->stream)) == NULL) error++;
+  }
+
+  if (error > 0){
+    printf("not enough GPU memory for surface reflectance. ");
+    surface_gpu_close(job); return FAILURE;
+  }
+
+  alloc((void**)&dev->host_xyz, ATMO_GPU_NXYZ*job->nz*dev->ng, sizeof(float));
+
+  cudaMemcpyAsync(dev->dem, job->dem,   dev->nc*sizeof(small), cudaMemcpyHostToDevice, s);
+  cudaMemcpyAsync(dev->vz,  job->xy_vz, dev->ng*sizeof(float), cudaMemcpyHostToDevice, s);
+  cudaMemcpyAsync(dev->sz,  job->xy_sz, dev->ng*sizeof(float), cudaMemcpyHostToDevice, s);
+
+  if (job->dotopo){
+    cudaMemcpyAsync(dev->ill, job->ill, dev->nc*sizeof(short),  cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(dev->sky, job->sky, dev->nc*sizeof(ushort), cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(dev->cf,  job->cf,  dev->nc*sizeof(ushort), cudaMemcpyHostToDevice, s);
+  }
+
+  if (gpu_sync(dev->stream) == FAILURE){
+    surface_gpu_close(job); return FAILURE;}
+
+  return SUCCESS;
+
+#else
+
+  job->dev = NULL;
+  return CANCEL;
+
+#endif
+}
+
+
+/** This function computes the surface reflectance of one band on the GPU.
++++ The coarse grids are packed and uploaded with the band's TOA reflec-
++++ tance; BOA reflectance and pixel flags are downloaded. The cosine of
++++ the device may differ from the host's in the last bit, thus some pix-
++++ els may deviate by one integer from the CPU result.
+--- job:    surface reflectance of one image
+--- band:   surface reflectance of one band
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int surface_gpu_band(boa_gpu_t *job, boa_band_gpu_t *band){
+#ifdef FORCE_CUDA
+boa_dev_t *dev = (boa_dev_t*)job->dev;
+boa_dev_t dev_;
+cudaStream_t s;
+size_t ng;
+int k, z, nblock;
+int error = 0;
+
+
+  if (dev == NULL) return CANCEL;
+  if (band->bck == NULL && job->doenv) return FAILURE;
+
+  if (gpu_select(dev->stream) == FAILURE) return FAILURE;
+  s  = (cudaStream_t)gpu_cuda_stream(dev->stream);
+  ng = dev->ng;
+
+  for (k=0; k<ATMO_GPU_NXYZ; k++){
+  for (z=0; z<job->nz; z++){
+    memcpy(dev->host_xyz + ((size_t)k*job->nz+z)*ng, band->xyz[k][z], ng*sizeof(float));
+  }
+  }
+
+  cudaMemcpyAsync(dev->xyz, dev->host_xyz, dev->bytes_xyz, cudaMemcpyHostToDevice, s);
+  cudaMemcpyAsync(dev->xy + _XY_TG_*ng,   band->xy_Tg,   ng*sizeof(float), cudaMemcpyHostToDevice, s);
+  cudaMemcpyAsync(dev->xy + _XY_TVO_*ng,  band->xy_Tvo,  ng*sizeof(float), cudaMemcpyHostToDevice, s);
+  cudaMemcpyAsync(dev->xy + _XY_TSO_*ng,  band->xy_Tso,  ng*sizeof(float), cudaMemcpyHostToDevice, s);
+  cudaMemcpyAsync(dev->xy + _XY_BRDF_*ng, band->xy_brdf, ng*sizeof(float), cudaMemcpyHostToDevice, s);
+  cudaMemcpyAsync(dev->toa,   band->toa,   dev->nc*sizeof(short), cudaMemcpyHostToDevice, s);
+  cudaMemcpyAsync(dev->state, band->state, dev->nc*sizeof(small), cudaMemcpyHostToDevice, s);
+  if (job->doenv) cudaMemcpyAsync(dev->bck, band->bck, dev->nc*sizeof(short), cudaMemcpyHostToDevice, s);
+
+  // gaseous transmittance is given per pixel (Sentinel-2), or on the grid
+  if (band->Tg != NULL){
+    if (dev->tg == NULL && (dev->tg = (short*)gpu_alloc(dev->nc*sizeof(short), dev->stream)) == NULL){
+      printf("not enough GPU memory for surface reflectance. "); return FAILURE;}
+    cudaMemcpyAsync(dev->tg, band->Tg, dev->nc*sizeof(short), cudaMemcpyHostToDevice, s);
+  }
+
+  dev_ = *dev;
+  if (band->Tg == NULL) dev_.tg = NULL;
+
+  nblock = (dev->nc + GPU_NTHREAD - 1) / GPU_NTHREAD;
+
+  surface_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(*job, dev_, band->E0);
+
+  if (cudaGetLastError() != cudaSuccess){
+    printf("launching surface reflectance kernel failed. ");
+    error++;
+  } else {
+    cudaMemcpyAsync(band->boa,  dev->boa,  dev->nc*sizeof(short), cudaMemcpyDeviceToHost, s);
+    cudaMemcpyAsync(band->flag, dev->flag, dev->nc*sizeof(small), cudaMemcpyDeviceToHost, s);
+  }
+
+  if (gpu_sync(dev->stream) == FAILURE) error++;
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
+
+/** This function releases the device memory of one image
+--- job:    surface reflectance of one image
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void surface_gpu_close(boa_gpu_t *job){
+#ifdef FORCE_CUDA
+boa_dev_t *dev = (boa_dev_t*)job->dev;
+
+
+  if (dev == NULL) return;
+
+  gpu_release(dev->dem,   dev->nc*sizeof(small),  dev->stream);
+  gpu_release(dev->toa,   dev->nc*sizeof(short),  dev->stream);
+  gpu_release(dev->state, dev->nc*sizeof(small),  dev->stream);
+  gpu_release(dev->boa,   dev->nc*sizeof(short),  dev->stream);
+  gpu_release(dev->flag,  dev->nc*sizeof(small),  dev->stream);
+  gpu_release(dev->vz,    dev->ng*sizeof(float),  dev->stream);
+  gpu_release(dev->sz,    dev->ng*sizeof(float),  dev->stream);
+  gpu_release(dev->xy,    _XY_LENGTH_*dev->ng*sizeof(float), dev->stream);
+  gpu_release(dev->xyz,   dev->bytes_xyz,         dev->stream);
+  gpu_release(dev->bck,   dev->nc*sizeof(short),  dev->stream);
+  gpu_release(dev->tg,    dev->nc*sizeof(short),  dev->stream);
+  gpu_release(dev->ill,   dev->nc*sizeof(short),  dev->stream);
+  gpu_release(dev->sky,   dev->nc*sizeof(ushort), dev->stream);
+  gpu_release(dev->cf,    dev->nc*sizeof(ushort), dev->stream);
+
+  if (dev->host_xyz != NULL) free((void*)dev->host_xyz);
+  free((void*)dev);
+
+#endif
+
+  job->dev = NULL;
+
+  return;
+}
+
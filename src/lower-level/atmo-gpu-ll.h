@@ -0,0 +1,101 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Surface reflectance on the GPU header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef ATMOGPU_LL_H
+#define ATMOGPU_LL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <stdbool.h> // boolean data type
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/gpu-cl.h"
+
+
+// number of elevation-dependent coarse grids
+#define ATMO_GPU_NXYZ 8
+
+// per-pixel state on input
+#define ATMO_GPU_OFF   1 // pixel is off
+#define ATMO_GPU_ERASE 2 // cloud that is erased
+
+// per-pixel flags on output
+#define ATMO_GPU_SUBZERO 1 // subzero reflectance
+#define ATMO_GPU_SATURAT 2 // saturated reflectance
+#define ATMO_GPU_SETOFF  4 // pixel needs to be set off
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// surface reflectance of one image on the device, band-invariant part
+typedef struct {
+  int nx, ny;           // dimensions of image
+  int nf, ne, nz;       // dimensions of coarse grid, number of elevation bins
+  float fres, gres;     // resolution of image and coarse grid
+  float vnodata;        // nodata of coarse grid
+  short nodata;         // nodata of BOA
+  bool dobrdf;          // BRDF correction
+  bool dotopo;          // topographic correction
+  bool doenv;           // adjacency effect correction
+  const small  *dem;    // binned DEM (host)
+  const short  *ill;    // illumination angle (host, NULL w/o topo)
+  const ushort *sky;    // sky view factor (host, NULL w/o topo)
+  const ushort *cf;     // C-factor (host, NULL w/o topo)
+  const float  *xy_vz;  // view zenith, coarse grid (host)
+  const float  *xy_sz;  // sun zenith, coarse grid (host)
+  void *dev;            // device copies, managed by surface_gpu_*
+} boa_gpu_t;
+
+// surface reflectance of one band on the device
+typedef struct {
+  float E0;                        // exoatmospheric irradiance
+  const short *toa;                // TOA reflectance (host)
+  const short *bck;                // background reflectance (host, or NULL)
+  const short *Tg;                 // gaseous transmittance (host, or NULL)
+  const small *state;              // pixel state (host)
+  const float *xy_Tg;              // gaseous transmittance, coarse grid (host)
+  const float *xy_Tvo;             // ozone transmittance (view), coarse grid (host)
+  const float *xy_Tso;             // ozone transmittance (sun), coarse grid (host)
+  const float *xy_brdf;            // BRDF factor, coarse grid (host)
+  float **xyz[ATMO_GPU_NXYZ];      // T, Ts, tss, tsd, tvs, tvd, s, rho_p [z] (host)
+  short *boa;                      // BOA reflectance (host, returned)
+  small *flag;                     // pixel flags (host, returned)
+} boa_band_gpu_t;
+
+int  surface_gpu_open(boa_gpu_t *job);
+int  surface_gpu_band(boa_gpu_t *job, boa_band_gpu_t *band);
+void surface_gpu_close(boa_gpu_t *job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
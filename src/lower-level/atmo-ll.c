@@ -41,19 +41,22 @@ float wtop, wdown;
 
 iweights_t interpolation_weights(int j, int i, int nf, int ne, float res, float full_res, float *COARSE, float nodata);
 float interpolate_coarse(iweights_t weight, float *COARSE);
-int surface_reflectance(par_ll_t *pl2, atc_t *atc, int b, short *bck_, short *toa_, short *Tg_, short *boa_, small *dem_, short *ill_, ushort *sky_, ushort *cf_, brick_t *QAI);
+int surface_reflectance(par_ll_t *pl2, atc_t *atc, int b, boa_gpu_t *gpu, short *bck_, short *toa_, short *Tg_, short *boa_, small *dem_, short *ill_, ushort *sky_, ushort *cf_, brick_t *QAI);
+bool open_surface_gpu(par_ll_t *pl2, atc_t *atc, top_t *TOP, brick_t *QAI, boa_gpu_t *gpu);
+int surface_reflectance_gpu(par_ll_t *pl2, atc_t *atc, int b, boa_gpu_t *gpu, short *bck_, short *toa_, short *Tg_, short *boa_, brick_t *QAI);
 short *background_reflectance(atc_t *atc, int b, short *toa_, short *Tg_, small *dem_, brick_t *QAI);
 int atmo_angledep(par_ll_t *pl2, meta_t *meta, atc_t *atc, top_t *TOP, brick_t *QAI);
 int atmo_elevdep(par_ll_t *pl2, atc_t *atc, brick_t *QAI, top_t *TOP);
-brick_t *compile_l2_qai(par_ll_t *pl2, cube_t *cube, brick_t *QAI);
-brick_t *compile_l2_boa(par_ll_t *pl2, int mission, atc_t *atc, cube_t *cube, brick_t *TOA, brick_t *QAI, brick_t *WVP, top_t *TOP);
+brick_t *compile_l2_qai(par_ll_t *pl2, brick_t *QAI);
+brick_t *compile_l2_boa(par_ll_t *pl2, int mission, atc_t *atc, brick_t *TOA, brick_t *QAI, brick_t *WVP, top_t *TOP);
 brick_t *compile_l2_dst(par_ll_t *pl2, cube_t *cube, brick_t *QAI);
 brick_t *compile_l2_ovv(par_ll_t *pl2, brick_t *BOA, brick_t *QAI);
 brick_t *compile_l2_vzn(par_ll_t *pl2, atc_t *atc, cube_t *cube, brick_t *QAI);
-brick_t *compile_l2_hot(par_ll_t *pl2, cube_t *cube, brick_t *TOA, brick_t *QAI);
-brick_t *compile_l2_aod(par_ll_t *pl2, atc_t *atc, cube_t *cube, brick_t *QAI, top_t *TOP);
-brick_t *compile_l2_wvp(par_ll_t *pl2, atc_t *atc, cube_t *cube, brick_t *QAI, brick_t *WVP);
-brick_t **compile_level2(par_ll_t *pl2, int mission, atc_t *atc, cube_t *cube, brick_t *TOA, brick_t *QAI, brick_t *WVP, top_t *TOP, int *nproduct);
+brick_t *compile_l2_hot(par_ll_t *pl2, brick_t *TOA, brick_t *QAI);
+brick_t *compile_l2_aod(par_ll_t *pl2, atc_t *atc, brick_t *QAI, top_t *TOP);
+brick_t *compile_l2_wvp(par_ll_t *pl2, atc_t *atc, brick_t *QAI, brick_t *WVP);
+int index_level2(par_ll_t *pl2, int *p_qai, int *p_boa, int *p_dst, int *p_vzn, int *p_hot, int *p_aod, int *p_wvp, int *p_ovv);
+brick_t **compile_level2(par_ll_t *pl2, int mission, atc_t *atc, brick_t *TOA, brick_t *QAI, brick_t *WVP, top_t *TOP, int *nproduct);
 
 
 /** This function computes the weights to interpolate the coarse atmos-
@@ -176,6 +179,7 @@ float ul, ur, ll, lr;
 --- pl2:    L2 parameters
 --- atc:    atmospheric correction factors
 --- b:      band
+--- gpu:    surface reflectance on the GPU (or NULL)
 --- bck_:   background reflectance
 --- toa_:   TOA reflectance
 --- Tg_:    gaseous transmittance
@@ -187,7 +191,7 @@ float ul, ur, ll, lr;
 --- QAI:    Quality Assurance Information
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int surface_reflectance(par_ll_t *pl2, atc_t *atc, int b, short *bck_, short *toa_, short *Tg_, short *boa_, small *dem_, short *ill_, ushort *sky_, ushort *cf_, brick_t *QAI){
+int surface_reflectance(par_ll_t *pl2, atc_t *atc, int b, boa_gpu_t *gpu, short *bck_, short *toa_, short *Tg_, short *boa_, small *dem_, short *ill_, ushort *sky_, ushort *cf_, brick_t *QAI){
 int i, j, p, nx, ny, ne, nf, z, b_sw2;
 float fres, gres;
 float A = 1.0;
@@ -224,6 +228,16 @@ float **xyz_tsd_sw2 = NULL;
   #endif
 
 
+  // offload to GPU, fall back to CPU if this fails
+  if (gpu != NULL && pl2->doatmo &&
+      surface_reflectance_gpu(pl2, atc, b, gpu, bck_, toa_, Tg_, boa_, QAI) == SUCCESS){
+    #ifdef FORCE_CLOCK
+    proctime_print("compute surface reflectance (GPU)", TIME);
+    #endif
+    return SUCCESS;
+  }
+
+
   nx  = get_brick_ncols(QAI);
   ny  = get_brick_nrows(QAI);
   fres  = get_brick_res(QAI);
@@ -387,6 +401,133 @@ float **xyz_tsd_sw2 = NULL;
 }
 
 
+/** This function prepares the surface reflectance inversion on the GPU,
++++ i.e. uploads the band-invariant inputs of the image
+--- pl2:    L2 parameters
+--- atc:    atmospheric correction factors
+--- TOP:    Topographic Derivatives
+--- QAI:    Quality Assurance Information
+--- gpu:    surface reflectance on the GPU (returned)
++++ Return: true if the GPU is used, false if not
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool open_surface_gpu(par_ll_t *pl2, atc_t *atc, top_t *TOP, brick_t *QAI, boa_gpu_t *gpu){
+
+
+  memset(gpu, 0, sizeof(boa_gpu_t));
+
+  if (!pl2->doatmo || !gpu_enabled()) return false;
+
+  gpu->nx      = get_brick_ncols(QAI);
+  gpu->ny      = get_brick_nrows(QAI);
+  gpu->fres    = get_brick_res(QAI);
+  gpu->nf      = get_brick_ncols(atc->xy_view);
+  gpu->ne      = get_brick_nrows(atc->xy_view);
+  gpu->nz      = NPOW_08;
+  gpu->gres    = get_brick_res(atc->xy_view);
+  gpu->vnodata = get_brick_nodata(atc->xy_view, ZEN);
+  gpu->nodata  = -9999;
+  gpu->dobrdf  = pl2->dobrdf;
+  gpu->dotopo  = pl2->dotopo;
+  gpu->doenv   = pl2->doenv;
+
+  if ((gpu->dem   = get_band_small(TOP->dem, 0))         == NULL) return false;
+  if ((gpu->xy_vz = get_band_float(atc->xy_view, ZEN))   == NULL) return false;
+  if ((gpu->xy_sz = get_band_float(atc->xy_sun,  ZEN))   == NULL) return false;
+
+  if (pl2->dotopo){
+    if ((gpu->ill = get_band_short(TOP->ill,  0)) == NULL) return false;
+    if ((gpu->sky = get_band_ushort(TOP->sky, 0)) == NULL) return false;
+    if ((gpu->cf  = get_band_ushort(TOP->c,   0)) == NULL) return false;
+  }
+
+  return surface_gpu_open(gpu) == SUCCESS;
+}
+
+
+/** This function computes the surface reflectance on the GPU. The state
++++ of each pixel is taken from the QAI before, and the QAI flags are up-
++++ dated after the inversion, such that the result equals the CPU path.
+--- pl2:    L2 parameters
+--- atc:    atmospheric correction factors
+--- b:      band
+--- gpu:    surface reflectance on the GPU
+--- bck_:   background reflectance
+--- toa_:   TOA reflectance
+--- Tg_:    gaseous transmittance
+--- boa_:   BOA reflectance
+--- QAI:    Quality Assurance Information
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int surface_reflectance_gpu(par_ll_t *pl2, atc_t *atc, int b, boa_gpu_t *gpu, short *bck_, short *toa_, short *Tg_, short *boa_, brick_t *QAI){
+boa_band_gpu_t band;
+brick_t **xyz[ATMO_GPU_NXYZ] = { atc->xyz_T, atc->xyz_Ts, atc->xyz_tss, atc->xyz_tsd, 
+                                 atc->xyz_tvs, atc->xyz_tvd, atc->xyz_s, atc->xyz_rho_p };
+small *state = NULL;
+small *flag = NULL;
+int p, nc, k;
+int err;
+
+
+  memset(&band, 0, sizeof(boa_band_gpu_t));
+  nc = get_brick_ncells(QAI);
+
+  band.E0  = atc->E0[b];
+  band.toa = toa_;
+  band.bck = bck_;
+  band.Tg  = Tg_;
+  band.boa = boa_;
+
+  if ((band.xy_Tg   = get_band_float(atc->xy_Tg,   b)) == NULL) return FAILURE;
+  if ((band.xy_Tvo  = get_band_float(atc->xy_Tvo,  b)) == NULL) return FAILURE;
+  if ((band.xy_Tso  = get_band_float(atc->xy_Tso,  b)) == NULL) return FAILURE;
+  if ((band.xy_brdf = get_band_float(atc->xy_brdf, b)) == NULL) return FAILURE;
+
+  for (k=0; k<ATMO_GPU_NXYZ; k++){
+    if ((band.xyz[k] = atc_get_band_reshaped(xyz[k], b)) == NULL) return FAILURE;
+  }
+
+  alloc((void**)&state, nc, sizeof(small));
+  alloc((void**)&flag,  nc, sizeof(small));
+
+  #pragma omp parallel shared(nc, pl2, QAI, state) default(none) 
+  {
+    #pragma omp for schedule(static)
+    for (p=0; p<nc; p++){
+      if (get_off(QAI, p)){
+        state[p] = ATMO_GPU_OFF;
+      } else if (pl2->erase_cloud && get_cloud(QAI, p) == 2){
+        state[p] = ATMO_GPU_ERASE;
+      }
+    }
+  }
+
+  band.state = state;
+  band.flag  = flag;
+
+  if (pl2->dobrdf) cite_me(_CITE_BRDF_);
+
+  if ((err = surface_gpu_band(gpu, &band)) == SUCCESS){
+
+    #pragma omp parallel shared(nc, QAI, flag) default(none) 
+    {
+      #pragma omp for schedule(static)
+      for (p=0; p<nc; p++){
+        if (flag[p] & ATMO_GPU_SUBZERO) set_subzero(QAI,    p, true);
+        if (flag[p] & ATMO_GPU_SATURAT) set_saturation(QAI, p, true);
+        if (flag[p] & ATMO_GPU_SETOFF)  set_off(QAI,        p, true);
+      }
+    }
+
+  }
+
+  for (k=0; k<ATMO_GPU_NXYZ; k++) free((void*)band.xyz[k]);
+  free((void*)state);
+  free((void*)flag);
+
+  return err;
+}
+
+
 /** This function computes the background reflectance used for correcting
 +++ adjacency effects
 --- atc:    atmospheric correction factors
@@ -398,11 +539,12 @@ float **xyz_tsd_sw2 = NULL;
 +++ Return: Background reflectance
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 short *background_reflectance(atc_t *atc, int b, short *toa_, short *Tg_, small *dem_, brick_t *QAI){
-int i, j, p, nx, ny, nc, g, z, k;
+int i, j, l, nl, p, nx, ny, nc, g, z, k;
 float F[3], Fr, Fa, km[3], r[3], dF[3], sF, aod, mod;
 float rho_p, T, s, F_, res;
 float alpha[3], tmp, tg;
-float old[3];
+float old[3], lold[3][BCK_LANES];
+bool cloud, lcloud[BCK_LANES], loff[BCK_LANES];
 short  *ref = NULL;
 float **avg = NULL;
 short *bck = NULL;
@@ -533,7 +675,7 @@ float **xyz_F = NULL;
   
   /** exponential moving average, left to right, then right to left **/
   
-  #pragma omp parallel private(k, j, p, old) shared(nx, ny, imean, ref, QAI, avg, alpha) default(none) 
+  #pragma omp parallel private(k, j, p, old, cloud) shared(nx, ny, imean, ref, QAI, avg, alpha) default(none) 
   {
 
     #pragma omp for schedule(static)
@@ -543,8 +685,9 @@ float **xyz_F = NULL;
 
       for (j=0, p=i*nx; j<nx; j++, p++){
         if (get_off(QAI, p)) continue;
+        cloud = get_cloud(QAI, p) > 0;
         for (k=0; k<3; k++){
-          if (get_cloud(QAI, p) > 0){
+          if (cloud){
             avg[k][p] = old[k];
           } else {
             avg[k][p] = alpha[k]*ref[p]/10000.0 + (1.0-alpha[k])*old[k];
@@ -556,8 +699,9 @@ float **xyz_F = NULL;
 
       for (j=nx-1; j>=0; j--, p--){
         if (get_off(QAI, p)) continue;
+        cloud = get_cloud(QAI, p) > 0;
         for (k=0; k<3; k++){
-          if (get_cloud(QAI, p) > 0){
+          if (cloud){
             avg[k][p] = old[k];
           } else {
             avg[k][p] = alpha[k]*avg[k][p] + (1.0-alpha[k])*old[k];
@@ -571,39 +715,64 @@ float **xyz_F = NULL;
   }
   
 
-  /** exponential moving average, top to bottom, then bottom to top **/
+  /** exponential moving average, top to bottom, then bottom to top.
+  +++ BCK_LANES neighboring columns are filtered together, such that each
+  +++ row of the block is read contiguously (instead of one column with a
+  +++ stride of nx). Each column is still filtered on its own, in the same
+  +++ order, i.e. the result is identical. **/
   
-  #pragma omp parallel private(k, i, p, old) shared(nx, ny, jmean, QAI, avg, alpha) default(none) 
+  #pragma omp parallel private(k, i, j, l, nl, p, lold, lcloud, loff) shared(nx, ny, jmean, QAI, avg, alpha) default(none) 
   {
 
     #pragma omp for schedule(static)
-    for (j=0; j<nx; j++){
+    for (j=0; j<nx; j+=BCK_LANES){
 
-      for (k=0; k<3; k++) old[k] = jmean[j];
+      nl = (nx-j < BCK_LANES) ? nx-j : BCK_LANES;
+
+      for (k=0; k<3; k++){
+      for (l=0; l<nl; l++) lold[k][l] = jmean[j+l];
+      }
+
+      for (i=0; i<ny; i++){
+
+        for (l=0, p=i*nx+j; l<nl; l++, p++){
+          loff[l]   = get_off(QAI, p);
+          lcloud[l] = get_cloud(QAI, p) > 0;
+        }
 
-      for (i=0, p=j; i<ny; i++, p+=nx){
-        if (get_off(QAI, p)) continue;
         for (k=0; k<3; k++){
-          if (get_cloud(QAI, p) > 0){
-            avg[k][p] = old[k];
-          } else {
-            avg[k][p] = alpha[k]*avg[k][p] + (1.0-alpha[k])*old[k];
-            old[k] = avg[k][p];
+          for (l=0, p=i*nx+j; l<nl; l++, p++){
+            if (loff[l]) continue;
+            if (lcloud[l]){
+              avg[k][p] = lold[k][l];
+            } else {
+              avg[k][p] = alpha[k]*avg[k][p] + (1.0-alpha[k])*lold[k][l];
+              lold[k][l] = avg[k][p];
+            }
           }
         }
+
       }
-      p-=nx;
 
-      for (i=ny-1; i>=0; i--, p-=nx){
-        if (get_off(QAI, p)) continue;
+      for (i=ny-1; i>=0; i--){
+
+        for (l=0, p=i*nx+j; l<nl; l++, p++){
+          loff[l]   = get_off(QAI, p);
+          lcloud[l] = get_cloud(QAI, p) > 0;
+        }
+
         for (k=0; k<3; k++){
-          if (get_cloud(QAI, p) > 0){
-            avg[k][p] = old[k];
-          } else {
-            avg[k][p] = alpha[k]*avg[k][p] + (1.0-alpha[k])*old[k];
-            old[k] = avg[k][p];
+          for (l=0, p=i*nx+j; l<nl; l++, p++){
+            if (loff[l]) continue;
+            if (lcloud[l]){
+              avg[k][p] = lold[k][l];
+            } else {
+              avg[k][p] = alpha[k]*avg[k][p] + (1.0-alpha[k])*lold[k][l];
+              lold[k][l] = avg[k][p];
+            }
           }
         }
+
       }
 
     }
@@ -679,7 +848,7 @@ int atmo_angledep(par_ll_t *pl2, meta_t *meta, atc_t *atc, top_t *TOP, brick_t *
 int e, f, g, ne, nf, b, nb;
 int dem, doy;
 float ms, mv, psi, Hr;
-float ozone;
+float *ozone_ = NULL;
 double lon, lat;
 
 
@@ -692,10 +861,17 @@ double lon, lat;
   nf = get_brick_nrows(atc->xy_mod);
   nb = get_brick_nbands(atc->xy_mod);
 
-  #pragma omp parallel private(g, b, ms, mv, psi, Hr, doy, lon, lat, ozone, dem) shared(nb, ne, nf, meta, atc, pl2, QAI, TOP) default(none) 
+  // bi-directional correction parameters
+  if (brdf_factor(atc->xy_sun, atc->xy_view, atc->xy_brdf) == FAILURE){
+    printf("error in BRDF correction factors. "); return FAILURE;}
+
+  alloc((void**)&ozone_, ne*nf, sizeof(float));
+
+  // cell-wise terms; cells differ in cost (nodata, elevation averaging)
+  #pragma omp parallel private(g, ms, mv, psi, Hr, doy, lon, lat, dem) shared(nb, ne, nf, ozone_, atc, pl2, QAI, TOP) default(none) 
   {
 
-    #pragma omp for collapse(2) schedule(static)
+    #pragma omp for collapse(2) schedule(dynamic)
 
     for (e=0; e<ne; e++){
     for (f=0; f<nf; f++){
@@ -704,9 +880,6 @@ double lon, lat;
 
       if (is_brick_nodata(atc->xy_view, 0, g)) continue;
 
-      // bi-directional correction parameter
-      brdf_factor(atc->xy_sun, atc->xy_view, atc->xy_brdf, g);
-
       // relative air mass
       ms = get_brick(atc->xy_sun,  cZEN, g);
       mv = get_brick(atc->xy_view, cZEN, g);
@@ -723,21 +896,7 @@ double lon, lat;
       // ozone amount (very rough approximation)
       get_brick_geo(atc->xy_sun, f, e, &lon, &lat);
       doy   = get_brick_doy(atc->xy_sun, 0);
-      ozone = ozone_amount(lon, lat, doy);
-
-      for (b=0; b<nb; b++){
-
-        // gaseous transmittance
-        set_brick(atc->xy_Tsw, b, g, wvp_transmitt(atc->wvp, ms, meta->cal[b].rsr_band));
-        set_brick(atc->xy_Tvw, b, g, wvp_transmitt(atc->wvp, mv, meta->cal[b].rsr_band));
-        set_brick(atc->xy_Tso, b, g, ozone_transmitt(ozone, ms, meta->cal[b].rsr_band));
-        set_brick(atc->xy_Tvo, b, g, ozone_transmitt(ozone, mv, meta->cal[b].rsr_band));
-        
-        set_brick(atc->xy_Tg, b, g, gas_transmitt(
-          get_brick(atc->xy_Tsw, b, g), get_brick(atc->xy_Tvw, b, g),
-          get_brick(atc->xy_Tso, b, g), get_brick(atc->xy_Tvo, b, g)));
-
-      }
+      ozone_[g] = ozone_amount(lon, lat, doy);
 
       // average elevation
       average_elevation_cell(g, atc->xy_dem, TOP->dem, QAI);
@@ -758,6 +917,42 @@ double lon, lat;
   }
 
 
+  // gaseous transmittance; the spectral integration dominates, thus
+  // cells and bands are distributed jointly
+  #pragma omp parallel private(g, ms, mv) shared(nb, ne, nf, ozone_, meta, atc) default(none) 
+  {
+
+    #pragma omp for collapse(3) schedule(dynamic)
+
+    for (e=0; e<ne; e++){
+    for (f=0; f<nf; f++){
+    for (b=0; b<nb; b++){
+
+      g = e*nf+f;
+
+      if (is_brick_nodata(atc->xy_view, 0, g)) continue;
+
+      ms = get_brick(atc->xy_sun,  cZEN, g);
+      mv = get_brick(atc->xy_view, cZEN, g);
+
+      set_brick(atc->xy_Tsw, b, g, wvp_transmitt(atc->wvp, ms, meta->cal[b].rsr_band));
+      set_brick(atc->xy_Tvw, b, g, wvp_transmitt(atc->wvp, mv, meta->cal[b].rsr_band));
+      set_brick(atc->xy_Tso, b, g, ozone_transmitt(ozone_[g], ms, meta->cal[b].rsr_band));
+      set_brick(atc->xy_Tvo, b, g, ozone_transmitt(ozone_[g], mv, meta->cal[b].rsr_band));
+      
+      set_brick(atc->xy_Tg, b, g, gas_transmitt(
+        get_brick(atc->xy_Tsw, b, g), get_brick(atc->xy_Tvw, b, g),
+        get_brick(atc->xy_Tso, b, g), get_brick(atc->xy_Tvo, b, g)));
+
+    }
+    }
+    }
+
+  }
+
+  free((void*)ozone_);
+
+
   #ifdef FORCE_DEBUG
   print_brick_info(atc->xy_brdf);  set_brick_open(atc->xy_brdf,  OPEN_CREATE); write_brick(atc->xy_brdf);
   print_brick_info(atc->xy_psi); set_brick_open(atc->xy_psi, OPEN_CREATE); write_brick(atc->xy_psi);
@@ -796,8 +991,10 @@ int atmo_elevdep(par_ll_t *pl2, atc_t *atc, brick_t *QAI, top_t *TOP){
 int e, f, g, ne, nf, b, nb, z, nz, p, nc, b_green;
 float z0, zmed;
 float ms, mv, Pr, Pa;
-float od, mod, aod, Hr, Ha, rho_p;
-float T, Ts, tsd, tss, Tv, tvd, tvs, F = 1.0;
+float od, mod, aod, rho_p;
+float T, Ts, tsd, tss, Tv, tvd, tvs, s, F = 1.0;
+float *z_Hr = NULL, *z_Ha = NULL;
+float **z_mod = NULL, **z_aod = NULL, **z_od = NULL, **z_s = NULL, **z_F = NULL;
 small  *dem_ = NULL;
 float **xyz_aod = NULL;
 small *xy_interp = NULL;
@@ -818,55 +1015,104 @@ small *xy_interp = NULL;
 
   z0 = (atc->dem.min+atc->dem.step/2.0);
 
-  #pragma omp parallel private(f, g, b, z, zmed, Pr, Pa, ms, mv, Ha, Hr, mod, aod, od, T, Ts, Tv, tsd, tss, tvd, tvs, rho_p) firstprivate(F) shared(nb, ne, nf, nz, z0, atc, pl2) default(none) 
+
+  /** tabulate the terms that only depend on elevation and band once, 
+  +++ only the angle-dependent terms are evaluated for every coarse cell.
+  +++ If there is an AOD map, the AOD-dependent terms vary in space
+  +++ and are evaluated per cell
+  +++**/
+
+  alloc((void**)&z_Hr, nz, sizeof(float));
+  alloc((void**)&z_Ha, nz, sizeof(float));
+  alloc_2D((void***)&z_mod, nz, nb, sizeof(float));
+  alloc_2D((void***)&z_aod, nz, nb, sizeof(float));
+  alloc_2D((void***)&z_od,  nz, nb, sizeof(float));
+  alloc_2D((void***)&z_s,   nz, nb, sizeof(float));
+  alloc_2D((void***)&z_F,   nz, nb, sizeof(float));
+
+  // for every possible elevation (100m steps)
+  for (z=0, zmed=z0; z<nz; z++, zmed+=atc->dem.step){
+
+    // correct mod for elevation
+    z_Hr[z] = mod_elev_factor(zmed);
+    z_Ha[z] = aod_elev_factor(zmed, atc->Hp);
+
+    for (b=0; b<nb; b++){
+
+      // correct mod and aod for elevation
+      z_mod[z][b] = mod_elev_scale(atc->mod[b], 1, z_Hr[z]);
+
+      if (atc->aodmap) continue;
+
+      z_aod[z][b] = aod_elev_scale(atc->aod[b], atc->Ha, z_Ha[z]);
+
+      // optical depth
+      z_od[z][b] = optical_depth(z_aod[z][b], z_mod[z][b]);
+
+      // spherical albedo
+      z_s[z][b] = sphere_albedo(z_aod[z][b], z_mod[z][b], z_od[z][b]);
+
+      // environmental weighting function
+      if (pl2->doenv){
+        z_F[z][b] = env_weight(z_aod[z][b], z_mod[z][b], atc->Fa, atc->Fr);
+      } else {
+        z_F[z][b] = 1.0;
+      }
+
+    }
+
+  }
+
+
+  // the coarse grid has few rows, thus cells and elevations are distri-
+  // buted jointly; nodata cells make the cost uneven
+  #pragma omp parallel private(g, b, Pr, Pa, ms, mv, mod, aod, od, T, Ts, Tv, tsd, tss, tvd, tvs, rho_p, s) firstprivate(F) shared(nb, ne, nf, nz, z_Hr, z_Ha, z_mod, z_aod, z_od, z_s, z_F, atc, pl2) default(none) 
   {
 
-    //#pragma omp for collapse(2) schedule(static)
-    #pragma omp for schedule(static)
+    #pragma omp for collapse(3) schedule(dynamic)
 
     for (e=0; e<ne; e++){
     for (f=0; f<nf; f++){
 
-      g = e*nf+f;
-      
-      if (is_brick_nodata(atc->xy_view, 0, g)) continue;
+      // for every possible elevation (100m steps)
+      for (z=0; z<nz; z++){
 
-      // phase functions
-      Pr = get_brick(atc->xy_Pr, 0, g);
-      Pa = get_brick(atc->xy_Pa, 0, g);
+        g = e*nf+f;
       
-      // relative air mass
-      ms = get_brick(atc->xy_sun,  cZEN, g);
-      mv = get_brick(atc->xy_view, cZEN, g);
-
-      // for every possible elevation (100m steps)
-      for (z=0, zmed=z0; z<nz; z++, zmed+=atc->dem.step){
+        if (is_brick_nodata(atc->xy_view, 0, g)) continue;
 
-        // correct mod for elevation
-        Hr = mod_elev_factor(zmed);
-        Ha = aod_elev_factor(zmed, atc->Hp);
+        // phase functions
+        Pr = get_brick(atc->xy_Pr, 0, g);
+        Pa = get_brick(atc->xy_Pa, 0, g);
+      
+        // relative air mass
+        ms = get_brick(atc->xy_sun,  cZEN, g);
+        mv = get_brick(atc->xy_view, cZEN, g);
 
-        set_brick(atc->xyz_Hr[z], 0, g, Hr);
-        set_brick(atc->xyz_Ha[z], 0, g, Ha);
+        set_brick(atc->xyz_Hr[z], 0, g, z_Hr[z]);
+        set_brick(atc->xyz_Ha[z], 0, g, z_Ha[z]);
 
 
         // down/up-welling scattering transmittances
         for (b=0; b<nb; b++){
 
-          // correct mod and aod for elevation
-          mod = mod_elev_scale(atc->mod[b], 1, Hr);
-          set_brick(atc->xyz_mod[z], b, g, mod);
+          mod = z_mod[z][b];
 
           if (atc->aodmap){
-            aod = aod_elev_scale(get_brick(atc->xy_aod, b, g), atc->Ha, Ha);
+            aod = aod_elev_scale(get_brick(atc->xy_aod, b, g), atc->Ha, z_Ha[z]);
+            od  = optical_depth(aod, mod);
+            s   = sphere_albedo(aod, mod, od);
+            if (pl2->doenv) F = env_weight(aod, mod, atc->Fa, atc->Fr);
           } else {
-            aod = aod_elev_scale(atc->aod[b], atc->Ha, Ha);
+            aod = z_aod[z][b];
+            od  = z_od[z][b];
+            s   = z_s[z][b];
+            F   = z_F[z][b];
           }
-          set_brick(atc->xyz_aod[z], b, g, aod);
 
-          // optical depth
-          od = optical_depth(aod, mod);
-          set_brick(atc->xyz_od[z], b, g, od);
+          set_brick(atc->xyz_mod[z], b, g, mod);
+          set_brick(atc->xyz_aod[z], b, g, aod);
+          set_brick(atc->xyz_od[z],  b, g, od);
 
           // scattering transmittance
           T = scatt_transmitt(aod, mod, od, ms, mv, 
@@ -884,10 +1130,9 @@ small *xy_interp = NULL;
           set_brick(atc->xyz_rho_p[z], b, g, rho_p);
 
           // spherical albedo
-          set_brick(atc->xyz_s[z], b, g, sphere_albedo(aod, mod, od));
+          set_brick(atc->xyz_s[z], b, g, s);
 
           // environmental weighting function
-          if (pl2->doenv) F = env_weight(aod, mod, atc->Fa, atc->Fr);
           set_brick(atc->xyz_F[z], b, g, F);
 
         }
@@ -898,6 +1143,14 @@ small *xy_interp = NULL;
     }
     
   }
+
+  free((void*)z_Hr);
+  free((void*)z_Ha);
+  free_2D((void**)z_mod, nz);
+  free_2D((void**)z_aod, nz);
+  free_2D((void**)z_od,  nz);
+  free_2D((void**)z_s,   nz);
+  free_2D((void**)z_F,   nz);
   
 
   if ((xyz_aod   = atc_get_band_reshaped(atc->xyz_aod, b_green)) == NULL) return FAILURE;
@@ -940,14 +1193,13 @@ small *xy_interp = NULL;
 --- pl2:    L2 parameters
 --- mission: mission ID
 --- atc:    atmospheric correction factors
---- cube:   data cube parameters
 --- TOA:    TOA reflectance
 --- QAI:    Quality Assurance Information
 --- WVP:    water vapor
 --- TOP:    Topographic Derivatives
 +++ Return: BOA brick
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-brick_t *compile_l2_boa(par_ll_t *pl2, int mission, atc_t *atc, cube_t *cube, brick_t *TOA, brick_t *QAI, brick_t *WVP, top_t *TOP){
+brick_t *compile_l2_boa(par_ll_t *pl2, int mission, atc_t *atc, brick_t *TOA, brick_t *QAI, brick_t *WVP, top_t *TOP){
 int p, nc;
 int b, b_red, b_nir, b_sw1;
 #ifndef ACIX
@@ -980,6 +1232,8 @@ short  *Tg_      = NULL;
 short  *toa_     = NULL;
 short  *boa_     = NULL;
 short  **boa__   = NULL;
+boa_gpu_t gpu;
+bool on_gpu;
 
 brick_t *BOA = TOA;
 
@@ -1010,6 +1264,10 @@ brick_t *BOA = TOA;
   #endif
 
 
+  // upload band-invariant inputs if GPU is available
+  on_gpu = open_surface_gpu(pl2, atc, TOP, QAI, &gpu);
+
+
   // final radiometric processing and band reordering
   for (b_=0; b_<nb_; b_++){
 
@@ -1028,7 +1286,7 @@ brick_t *BOA = TOA;
       printf("error in background reflectance.\n"); return NULL;}
     } else bck_ = NULL;
  
-    if (surface_reflectance(pl2, atc, b, bck_, toa_, Tg_, boa_, dem_, ill_, sky_, cf_, QAI) == FAILURE){
+    if (surface_reflectance(pl2, atc, b, (on_gpu) ? &gpu : NULL, bck_, toa_, Tg_, boa_, dem_, ill_, sky_, cf_, QAI) == FAILURE){
     printf("error in surface reflectance.\n"); return NULL;}
 
     set_brick_wavelength(BOA, b_, get_brick_wavelength(BOA, b));
@@ -1042,6 +1300,8 @@ brick_t *BOA = TOA;
 
   }
 
+  if (on_gpu) surface_gpu_close(&gpu);
+
 
   // force nodata in all bands
   if ((boa__ = get_bands_short(BOA)) == NULL) return NULL;
@@ -1062,13 +1322,6 @@ brick_t *BOA = TOA;
     printf("error in reallocating brick.\n"); return NULL;}
 
 
-  // reproj the data
-  if (pl2->doreproj){
-    if (warp_from_brick_to_unknown_brick(pl2->dotile, pl2->resample, pl2->nthread, BOA, cube) == FAILURE){
-      printf("warping BOA failed.\n"); return NULL;}
-  }
-
-
   // set metadata
   if (pl2->doatmo){
     copy_string(product, NPOW_02, "BOA");
@@ -1109,11 +1362,10 @@ brick_t *BOA = TOA;
 
 /** This function compiles the QAI product ready to be output
 --- pl2:    L2 parameters
---- cube:   data cube parameters
 --- QAI:    Quality Assurance Information
 +++ Return: QAI brick
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-brick_t *compile_l2_qai(par_ll_t *pl2, cube_t *cube, brick_t *QAI){
+brick_t *compile_l2_qai(par_ll_t *pl2, brick_t *QAI){
 char fname[NPOW_10];
 char product[NPOW_02];
 char sensor[NPOW_04];
@@ -1129,12 +1381,6 @@ short *qa_ = NULL;
   #endif
   
   
-  // reproj the data
-  if (pl2->doreproj){
-    if (warp_from_brick_to_unknown_brick(pl2->dotile, 0, pl2->nthread, QA, cube) == FAILURE){
-      printf("warping QAI failed.\n"); return NULL;}
-  }
-
   // make sure that OFF bit is set exclusively
   nc = get_brick_ncells(QA);
   qa_ = get_band_short(QA, 0);
@@ -1390,6 +1636,7 @@ enum { R, G, B };
   set_brick_filename(OVV, fname);
   set_brick_open(OVV, OPEN_UPDATE);
   set_brick_explode(OVV, false);
+  set_brick_overview(OVV, false);
   
   for (b=0; b<3; b++){
     set_brick_scale(OVV, b, 1);
@@ -1585,12 +1832,11 @@ GDALDataType eOutputType = GDT_Float64;
 
 /** This function compiles the HOT product ready to be output
 --- pl2:    L2 parameters
---- cube:   data cube parameters
 --- TOA:    TOA reflectance
 --- QAI:    Quality Assurance Information
 +++ Return: HOT brick
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-brick_t *compile_l2_hot(par_ll_t *pl2, cube_t *cube, brick_t *TOA, brick_t *QAI){
+brick_t *compile_l2_hot(par_ll_t *pl2, brick_t *TOA, brick_t *QAI){
 int p, nc;
 char fname[NPOW_10];
 char product[NPOW_02];
@@ -1632,13 +1878,6 @@ short *hot_ = NULL;
   }
 
 
-  // reproj the data
-  if (pl2->doreproj){
-    if (warp_from_brick_to_unknown_brick(pl2->dotile, pl2->resample, pl2->nthread, HOT, cube) == FAILURE){
-      printf("warping HOT failed.\n"); return NULL;}
-  }
-
-
   // set metadata
 
   copy_string(product, NPOW_02, "HOT");
@@ -1677,12 +1916,11 @@ short *hot_ = NULL;
 /** This function compiles the AOD product ready to be output
 --- pl2:    L2 parameters
 --- atc:    atmospheric correction factors
---- cube:   data cube parameters
 --- QAI:    Quality Assurance Information
 --- TOP:    Topographic Derivatives
 +++ Return: AOD brick
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-brick_t *compile_l2_aod(par_ll_t *pl2, atc_t *atc, cube_t *cube, brick_t *QAI, top_t *TOP){
+brick_t *compile_l2_aod(par_ll_t *pl2, atc_t *atc, brick_t *QAI, top_t *TOP){
 int i, j, p, nx, ny, ne, nf, z;
 int b_green;
 float fres, gres;
@@ -1746,13 +1984,6 @@ float **xy_aod_ = NULL;
   free((void*)xy_aod_);
 
 
-  // reproj the data
-  if (pl2->doreproj){
-    if (warp_from_brick_to_unknown_brick(pl2->dotile, pl2->resample, pl2->nthread, AOD, cube) == FAILURE){
-      printf("warping AOD failed.\n"); return NULL;}
-  }
-
-
   // set metadata
   copy_string(product, NPOW_02, "AOD");
   set_brick_product(AOD, product);
@@ -1791,12 +2022,11 @@ float **xy_aod_ = NULL;
 /** This function compiles the WVP product ready to be output
 --- pl2:    L2 parameters
 --- atc:    atmospheric correction factors
---- cube:   data cube parameters
 --- QAI:    Quality Assurance Information
 --- WVP:    Water vapor
 +++ Return: WVP brick
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-brick_t *compile_l2_wvp(par_ll_t *pl2, atc_t *atc, cube_t *cube, brick_t *QAI, brick_t *WVP){
+brick_t *compile_l2_wvp(par_ll_t *pl2, atc_t *atc, brick_t *QAI, brick_t *WVP){
 int p, nc;
 char fname[NPOW_10];
 char product[NPOW_02];
@@ -1836,13 +2066,6 @@ short *wvp_ = NULL;
 
   }
 
-  // reproj the data
-  if (pl2->doreproj){
-    if (warp_from_brick_to_unknown_brick(pl2->dotile, pl2->resample, pl2->nthread, WV, cube) == FAILURE){
-      printf("warping WVP failed.\n"); return NULL;}
-  }
-  
-
   // set metadata
   copy_string(product, NPOW_02, "WVP");
   set_brick_product(WV, product);
@@ -1877,11 +2100,42 @@ short *wvp_ = NULL;
 }
 
     
-/** This function compiles the Level 2 products ready to be output
+/** This function assigns the position of each Level 2 product in the
++++ product array
+--- pl2:      L2 parameters
+--- p_qai:    index of QAI product (returned)
+--- p_boa:    index of BOA product (returned)
+--- p_dst:    index of DST product, or -1 (returned)
+--- p_vzn:    index of VZN product, or -1 (returned)
+--- p_hot:    index of HOT product, or -1 (returned)
+--- p_aod:    index of AOD product, or -1 (returned)
+--- p_wvp:    index of WVP product, or -1 (returned)
+--- p_ovv:    index of OVV product, or -1 (returned)
++++ Return:   number of products
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int index_level2(par_ll_t *pl2, int *p_qai, int *p_boa, int *p_dst, int *p_vzn, int *p_hot, int *p_aod, int *p_wvp, int *p_ovv){
+int nprod = 0;
+
+
+  *p_qai = nprod++;
+  *p_boa = nprod++;
+  if (pl2->odst){ *p_dst = nprod++;} else { *p_dst = -1;}
+  if (pl2->ovzn){ *p_vzn = nprod++;} else { *p_vzn = -1;}
+  if (pl2->ohot){ *p_hot = nprod++;} else { *p_hot = -1;}
+  if (pl2->oaod){ *p_aod = nprod++;} else { *p_aod = -1;}
+  if (pl2->owvp){ *p_wvp = nprod++;} else { *p_wvp = -1;}
+  if (pl2->oovv){ *p_ovv = nprod++;} else { *p_ovv = -1;}
+
+  return nprod;
+}
+
+    
+/** This function compiles the Level 2 products in the image geometry. 
++++ The products that depend on the output grid (DST, VZN, OVV) are left
++++ empty, see reproject_level2.
 --- pl2:      L2 parameters
 --- mission:  mission ID
 --- atc:      atmospheric correction factors
---- cube:     data cube parameters
 --- TOA:      TOA reflectance
 --- QAI:      Quality Assurance Information
 --- WVP:      water vapor
@@ -1889,7 +2143,7 @@ short *wvp_ = NULL;
 --- nproduct: number of products
 +++ Return: array of product bricks
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-brick_t **compile_level2(par_ll_t *pl2, int mission, atc_t *atc, cube_t *cube, brick_t *TOA, brick_t *QAI, brick_t *WVP, top_t *TOP, int *nproduct){
+brick_t **compile_level2(par_ll_t *pl2, int mission, atc_t *atc, brick_t *TOA, brick_t *QAI, brick_t *WVP, top_t *TOP, int *nproduct){
 int nprod, p_boa, p_qai, p_dst, p_vzn, p_hot, p_aod, p_wvp, p_ovv;
 brick_t **LEVEL2 = NULL;
 
@@ -1899,16 +2153,7 @@ brick_t **LEVEL2 = NULL;
   #endif
 
 
-  
-  nprod = 0;
-  p_qai = nprod++;
-  p_boa = nprod++;
-  if (pl2->odst){ p_dst = nprod++;} else { p_dst = -1;}
-  if (pl2->ovzn){ p_vzn = nprod++;} else { p_vzn = -1;}
-  if (pl2->ohot){ p_hot = nprod++;} else { p_hot = -1;}
-  if (pl2->oaod){ p_aod = nprod++;} else { p_aod = -1;}
-  if (pl2->owvp){ p_wvp = nprod++;} else { p_wvp = -1;}
-  if (pl2->oovv){ p_ovv = nprod++;} else { p_ovv = -1;}
+  nprod = index_level2(pl2, &p_qai, &p_boa, &p_dst, &p_vzn, &p_hot, &p_aod, &p_wvp, &p_ovv);
   
   #ifdef FORCE_DEBUG
   printf("compiling %d products\n", nprod);
@@ -1918,42 +2163,27 @@ brick_t **LEVEL2 = NULL;
   alloc((void**)&LEVEL2, nprod, sizeof(brick_t*));
 
 
-
-
-
   if (p_hot >= 0){
-    if ((LEVEL2[p_hot] = compile_l2_hot(pl2, cube, TOA, QAI)) == NULL){
+    if ((LEVEL2[p_hot] = compile_l2_hot(pl2, TOA, QAI)) == NULL){
       printf("error in compiling L2 HOT. "); return NULL;}}
       
   if (p_aod >= 0){
-    if ((LEVEL2[p_aod] = compile_l2_aod(pl2, atc, cube, QAI, TOP)) == NULL){
+    if ((LEVEL2[p_aod] = compile_l2_aod(pl2, atc, QAI, TOP)) == NULL){
       printf("error in compiling L2 AOD. "); return NULL;}}
 
   // do BOA near the end (TOA is altered within)
-  if ((LEVEL2[p_boa] = compile_l2_boa(pl2, mission, atc, cube, TOA, QAI, WVP, TOP)) == NULL){
+  if ((LEVEL2[p_boa] = compile_l2_boa(pl2, mission, atc, TOA, QAI, WVP, TOP)) == NULL){
     printf("error in compiling L2 BOA. "); return NULL;}
 
   // do WVP after BOA (WVP is altered within)
   if (p_wvp >= 0){
-    if ((LEVEL2[p_wvp] = compile_l2_wvp(pl2, atc, cube, QAI, WVP)) == NULL){
+    if ((LEVEL2[p_wvp] = compile_l2_wvp(pl2, atc, QAI, WVP)) == NULL){
       printf("error in compiling L2 WVP. "); return NULL;}} else free_brick(WVP);
 
   // do QAI at the very end (QAI is altered within)
-  if ((LEVEL2[p_qai] = compile_l2_qai(pl2, cube, QAI)) == NULL){
+  if ((LEVEL2[p_qai] = compile_l2_qai(pl2, QAI)) == NULL){
     printf("error in compiling L2 QAI. "); return NULL;}
 
-  if (p_dst >= 0){
-    if ((LEVEL2[p_dst] = compile_l2_dst(pl2, cube, LEVEL2[p_qai])) == NULL){
-      printf("error in compiling L2 DST. "); return NULL;}}
-
-  if (p_vzn >= 0){
-    if ((LEVEL2[p_vzn] = compile_l2_vzn(pl2, atc, cube, LEVEL2[p_qai])) == NULL){
-    printf("error in compiling L2 VZN. "); return NULL;}}
-
-  if (p_ovv >= 0){
-    if ((LEVEL2[p_ovv] = compile_l2_ovv(pl2, LEVEL2[p_boa], LEVEL2[p_qai])) == NULL){
-    printf("error in compiling L2 OVV. "); return NULL;}}
-
     // free some memory
   free_topography(TOP);
 
@@ -1979,14 +2209,13 @@ brick_t **LEVEL2 = NULL;
 --- meta:    metadata
 --- mission: mission ID
 --- atc:     atmospheric correction factors
---- cube:    data cube parameters
 --- TOA:     TOA reflectance
 --- QAI:     Quality Assurance Information
 --- TOP:     Topographic Derivatives
 --- nprod:   number of products
-+++ Return:  array of product bricks
++++ Return:  array of product bricks in the image geometry
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-brick_t **radiometric_correction(par_ll_t *pl2, meta_t *meta, int mission, atc_t *atc, cube_t *cube, brick_t *TOA, brick_t *QAI, top_t *TOP, int *nprod){
+brick_t **radiometric_correction(par_ll_t *pl2, meta_t *meta, int mission, atc_t *atc, brick_t *TOA, brick_t *QAI, top_t *TOP, int *nprod){
 int b, nb;
 brick_t  *WVP    = NULL;
 brick_t **L2 = NULL;
@@ -2025,20 +2254,25 @@ brick_t **L2 = NULL;
       if ((atc->wvp = water_vapor_from_lut(pl2, atc)) < 0){
         printf("Cannot read wvp from LUT. "); return NULL;}
     } else atc->wvp = 0.0;
+    lap_profile("water_vapor");
 
     /** angle-dependent coarse-grid atmospheric modelling
     +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    atmo_angledep(pl2, meta, atc, TOP, QAI);
+    if (atmo_angledep(pl2, meta, atc, TOP, QAI) == FAILURE){
+      printf("Angle-dependent atmospheric modelling failed. "); return NULL;}
+    lap_profile("atmo_angledep");
 
     /** compile AOD, use image-based water/shadow targets, refine by DODB, 
     +++ use external values (one or several options are possible)
     +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
     if (compile_aod(pl2, meta, atc, TOA, QAI, TOP) == FAILURE){
       printf("error in AOD module.\n"); return NULL;}
+    lap_profile("compile_aod");
 
     /** elevation-dependent coarse-grid atmospheric modelling
     +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
     atmo_elevdep(pl2, atc, QAI, TOP);
+    lap_profile("atmo_elevdep");
     
     /** water vapor and gaseous transmittance estimation
     +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
@@ -2046,6 +2280,7 @@ brick_t **L2 = NULL;
       if ((WVP = water_vapor(meta, atc, TOA, QAI, TOP->dem)) == NULL){
         printf("error in water vapor estimation. "); return NULL;}
     } else WVP = NULL;
+    lap_profile("water_vapor");
 
     /** estimate topographic correction factor
     +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
@@ -2053,6 +2288,7 @@ brick_t **L2 = NULL;
       if ((TOP->c = cfactor_topography(atc, TOA, QAI, 
                       TOP->dem, TOP->exp, TOP->ill)) == NULL){
           printf("error in topographic correction. "); return NULL;}
+      lap_profile("cfactor_topography");
     }
 
   }
@@ -2060,18 +2296,14 @@ brick_t **L2 = NULL;
 
   /** Level 2 datasets
   +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-  if ((L2 = compile_level2(pl2, mission, atc, cube, TOA, QAI, WVP, TOP, nprod)) == NULL){
+  if ((L2 = compile_level2(pl2, mission, atc, TOA, QAI, WVP, TOP, nprod)) == NULL){
     printf("error in compiling Level 2 products. "); return NULL;}
-
-
-  /** clean
-  +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-  free_wvlut();
+  lap_profile("compile_level2");
 
 
   #ifdef FORCE_DEBUG
   int prod;
-  for (prod=0; prod<(*nprod); prod++){ print_brick_info(L2[prod]); write_brick(L2[prod]);}
+  for (prod=0; prod<(*nprod); prod++){ if (L2[prod] == NULL) continue; print_brick_info(L2[prod]); write_brick(L2[prod]);}
   #endif
 
 
@@ -2082,3 +2314,88 @@ brick_t **L2 = NULL;
   return L2;
 }
 
+
+/** This function reprojects the Level 2 products into one output grid,
++++ and compiles the products that depend on this grid (DST, VZN, OVV).
++++ The products in image geometry are computed once, and are reprojec-
++++ ted into each of the requested datacubes. For all but the last data-
++++ cube, the products are copied; for the last datacube, they are repro-
++++ jected in place.
+--- pl2:     L2 parameters
+--- atc:     atmospheric correction factors
+--- cube:    data cube parameters
+--- NATIVE:  array of product bricks in image geometry
+--- nprod:   number of products
+--- copy:    copy the products (true), or reproject in place (false)
++++ Return:  array of product bricks in the grid of the datacube
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+brick_t **reproject_level2(par_ll_t *pl2, atc_t *atc, cube_t *cube, brick_t **NATIVE, int nprod, bool copy){
+int prod, b, nb, nc, p_boa, p_qai, p_dst, p_vzn, p_hot, p_aod, p_wvp, p_ovv;
+char product[NPOW_02];
+short **native_ = NULL;
+short **level2_ = NULL;
+brick_t **LEVEL2 = NULL;
+
+
+  #ifdef FORCE_CLOCK
+  time_t TIME; time(&TIME);
+  #endif
+
+
+  index_level2(pl2, &p_qai, &p_boa, &p_dst, &p_vzn, &p_hot, &p_aod, &p_wvp, &p_ovv);
+
+  alloc((void**)&LEVEL2, nprod, sizeof(brick_t*));
+
+
+  for (prod=0; prod<nprod; prod++){
+
+    if (NATIVE[prod] == NULL) continue;
+
+    if (copy){
+      nb = get_brick_nbands(NATIVE[prod]);
+      nc = get_brick_ncells(NATIVE[prod]);
+      LEVEL2[prod] = copy_brick(NATIVE[prod], nb, _DT_SHORT_);
+      if ((native_ = get_bands_short(NATIVE[prod])) == NULL) return NULL;
+      if ((level2_ = get_bands_short(LEVEL2[prod])) == NULL) return NULL;
+      for (b=0; b<nb; b++) memcpy(level2_[b], native_[b], nc*sizeof(short));
+    } else {
+      LEVEL2[prod] = NATIVE[prod];
+    }
+
+    // reproj the data (QAI with nearest neighbor)
+    if (pl2->doreproj){
+      if (warp_from_brick_to_unknown_brick(pl2->dotile, (prod == p_qai) ? 0 : pl2->resample, 
+            pl2->nthread, LEVEL2[prod], cube) == FAILURE){
+        get_brick_product(LEVEL2[prod], product, NPOW_02);
+        printf("warping %s failed.\n", product); return NULL;}
+    }
+
+    // GDAL options with the block size of this datacube
+    set_brick_format(LEVEL2[prod], &pl2->gdalopt);
+
+    // internal overviews are reduced from memory when writing
+    set_brick_overview(LEVEL2[prod], true);
+
+  }
+
+
+  if (p_dst >= 0){
+    if ((LEVEL2[p_dst] = compile_l2_dst(pl2, cube, LEVEL2[p_qai])) == NULL){
+      printf("error in compiling L2 DST. "); return NULL;}}
+
+  if (p_vzn >= 0){
+    if ((LEVEL2[p_vzn] = compile_l2_vzn(pl2, atc, cube, LEVEL2[p_qai])) == NULL){
+    printf("error in compiling L2 VZN. "); return NULL;}}
+
+  if (p_ovv >= 0){
+    if ((LEVEL2[p_ovv] = compile_l2_ovv(pl2, LEVEL2[p_boa], LEVEL2[p_qai])) == NULL){
+    printf("error in compiling L2 OVV. "); return NULL;}}
+
+
+  #ifdef FORCE_CLOCK
+  proctime_print("reproject Level 2 products", TIME);
+  #endif
+
+  return LEVEL2;
+}
+
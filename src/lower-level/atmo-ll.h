@@ -35,6 +35,7 @@ Atmospheric correction header
 #include "../cross-level/string-cl.h"
 #include "../cross-level/brick-cl.h"
 #include "../cross-level/cube-cl.h"
+#include "../cross-level/profile-cl.h"
 #include "../lower-level/param-ll.h"
 #include "../lower-level/atc-ll.h"
 #include "../lower-level/topo-ll.h"
@@ -43,13 +44,19 @@ Atmospheric correction header
 #include "../lower-level/gas-ll.h"
 #include "../lower-level/aod-ll.h"
 #include "../lower-level/cloud-ll.h"
+#include "../lower-level/atmo-gpu-ll.h"
+
+
+// number of columns that are filtered together in the background reflectance
+#define BCK_LANES 64
 
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-brick_t **radiometric_correction(par_ll_t *pl2, meta_t *meta, int mission, atc_t *atc, cube_t *cube, brick_t *TOA, brick_t *QAI, top_t *TOP, int *nprod);
+brick_t **radiometric_correction(par_ll_t *pl2, meta_t *meta, int mission, atc_t *atc, brick_t *TOA, brick_t *QAI, top_t *TOP, int *nprod);
+brick_t **reproject_level2(par_ll_t *pl2, atc_t *atc, cube_t *cube, brick_t **NATIVE, int nprod, bool copy);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,427 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for processing a queue of Level 1 images in
+one long-lived Level 2 process
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "batch-ll.h"
+
+#include <unistd.h>       // standard symbolic constants and types 
+#include <sys/mman.h>     // memory management declarations
+#include <sys/wait.h>     // declarations for waiting
+#include <sys/resource.h> // definitions for XSI resource operations
+
+
+typedef struct {
+  int  next;     // next image in queue
+  long peak;     // peak memory of one worker (kB)
+  int  *current; // image that is processed by each worker
+  bool *busy;    // is worker processing an image?
+} batch_t;
+
+
+void *shared_alloc(size_t size);
+long available_memory();
+int  batch_image(par_ll_t *pl2, char *image, int (*process)(par_ll_t *pl2));
+void batch_worker(par_ll_t *pl2, l2_queue_t *queue, batch_t *batch, int w, int nw, int (*process)(par_ll_t *pl2));
+
+
+/** This function allocates memory that is shared between processes, i.e.
++++ it stays visible to the parent after forking workers
+--- size:   number of bytes
++++ Return: shared memory
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void *shared_alloc(size_t size){
+void *ptr = NULL;
+
+
+  ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED){
+    printf("unable to allocate shared memory.\n"); exit(FAILURE);}
+
+  memset(ptr, 0, size);
+
+  return ptr;
+}
+
+
+/** This function reads the available main memory from /proc/meminfo
++++ Return: available memory in kB, -1 if unknown
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+long available_memory(){
+FILE *fp = NULL;
+char  buffer[NPOW_10] = "\0";
+long  kb = -1;
+
+
+  if ((fp = fopen("/proc/meminfo", "r")) == NULL) return -1;
+
+  while (fgets(buffer, NPOW_10, fp) != NULL){
+    if (sscanf(buffer, "MemAvailable: %ld kB", &kb) == 1) break;
+  }
+
+  fclose(fp);
+
+  return kb;
+}
+
+
+/** This function processes one image of the queue. Output is redirected
++++ to a logfile in DIR_LOG, named after the queued image.
+--- pl2:     L2 parameters
+--- image:   queued image
+--- process: Level 2 processing function
++++ Return:  SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int batch_image(par_ll_t *pl2, char *image, int (*process)(par_ll_t *pl2)){
+char bname[NPOW_10] = "\0";
+char flog[NPOW_10] = "\0";
+int nchar;
+
+
+  basename_with_ext(image, bname, NPOW_10);
+
+  nchar = snprintf(flog, NPOW_10, "%s/%s.log", pl2->d_log, bname);
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return FAILURE;}
+
+  fflush(stdout);
+  if (freopen(flog, "w", stdout) == NULL) return FAILURE;
+
+  printf("%s: ", image);
+
+  copy_string(pl2->d_level1, NPOW_10, image);
+
+  if (parse_level1_input(pl2) != SUCCESS){
+    fflush(stdout); return FAILURE;}
+
+  if (process(pl2) != SUCCESS){
+    fflush(stdout); return FAILURE;}
+
+  fflush(stdout);
+
+  return SUCCESS;
+}
+
+
+/** This function is the main loop of one worker. The worker pulls images
++++ from the queue until it is exhausted. Before starting an image, the 
++++ worker waits until enough memory is available, i.e. the peak memory
++++ of one worker. It will always start if no other image is processed.
++++ After a failure, the worker exits, such that it does not carry a cor-
++++ rupted state; the parent will start a new worker.
+--- pl2:     L2 parameters
+--- queue:   file queue
+--- batch:   shared scheduling state
+--- w:       worker ID
+--- nw:      number of workers
+--- process: Level 2 processing function
++++ Return:  void, worker exits
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void batch_worker(par_ll_t *pl2, l2_queue_t *queue, batch_t *batch, int w, int nw, int (*process)(par_ll_t *pl2)){
+int i, v, active;
+long mem, peak;
+struct rusage usage;
+int err;
+
+
+  // the threads of this worker inherit the socket
+  if (numa_mode() == _NUMA_SOCKET_) numa_pin(w);
+
+  while ((i = __sync_fetch_and_add(&batch->next, 1)) < queue->n){
+
+    batch->current[w] = i;
+
+    // resource-aware start
+    while (true){
+
+      for (v=0, active=0; v<nw; v++) active += batch->busy[v];
+      if (active == 0) break;
+
+      mem = available_memory();
+      if (mem < 0 || mem >= batch->peak) break;
+
+      sleep(1);
+
+    }
+
+    batch->busy[w] = true;
+    err = batch_image(pl2, queue->image[i], process);
+    batch->busy[w] = false;
+
+    // update peak memory of one worker
+    getrusage(RUSAGE_SELF, &usage);
+    while ((peak = batch->peak) < usage.ru_maxrss){
+      if (__sync_bool_compare_and_swap(&batch->peak, peak, usage.ru_maxrss)) break;
+    }
+
+    update_level2_queue(pl2->f_queue, queue->image[i]);
+    batch->current[w] = -1;
+
+    if (err != SUCCESS){
+      fflush(stdout); _exit(FAILURE);}
+
+  }
+
+  fflush(stdout);
+  _exit(SUCCESS);
+}
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function reads the file queue, and keeps all images that are 
++++ still QUEUED. The images need to be given with absolute paths, and
++++ need to be extracted already (use force-level2 for containers).
+--- fname:  file queue
+--- queue:  file queue (returned)
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int read_level2_queue(char *fname, l2_queue_t *queue){
+FILE *fp = NULL;
+char image[NPOW_10] = "\0";
+char status[NPOW_10] = "\0";
+char ext[NPOW_10] = "\0";
+int n = 0, nbuf = 100;
+
+
+  queue->n = 0;
+  queue->image = NULL;
+
+  if ((fp = fopen(fname, "r")) == NULL){
+    printf("Unable to open file queue %s.\n", fname); return FAILURE;}
+
+  alloc_2D((void***)&queue->image, nbuf, NPOW_10, sizeof(char));
+
+  while (fscanf(fp, "%1023s %1023s", image, status) == 2){
+
+    if (strcmp(status, "QUEUED") != 0) continue;
+
+    if (image[0] != '/'){
+      printf("relative pathnames are not allowed in FILE_QUEUE.\n");
+      fclose(fp); return FAILURE;}
+
+    extension(image, ext, NPOW_10);
+    if (strcmp(ext, ".zip") == 0 || strcmp(ext, ".tar") == 0 || strcmp(ext, ".gz") == 0){
+      printf("containers are not supported in batch mode. Use force-level2.\n");
+      fclose(fp); return FAILURE;}
+
+    if (n == nbuf){
+      re_alloc_2D((void***)&queue->image, nbuf, NPOW_10, nbuf*2, NPOW_10, sizeof(char));
+      nbuf *= 2;
+    }
+
+    copy_string(queue->image[n++], NPOW_10, image);
+
+  }
+
+  fclose(fp);
+
+  queue->n = n;
+  re_alloc_2D((void***)&queue->image, nbuf, NPOW_10, (n > 0) ? n : 1, NPOW_10, sizeof(char));
+
+  return SUCCESS;
+}
+
+
+/** This function frees the file queue
+--- queue:  file queue
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_level2_queue(l2_queue_t *queue){
+
+  if (queue->image != NULL) free_2D((void**)queue->image, (queue->n > 0) ? queue->n : 1);
+  queue->image = NULL;
+  queue->n = 0;
+
+  return;
+}
+
+
+/** This function marks an image as DONE in the file queue. The queue is
++++ locked, as it is shared between workers.
+--- fname:  file queue
+--- image:  image
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int update_level2_queue(char *fname, char *image){
+FILE *fp = NULL;
+lock_t *lock = NULL;
+char **line = NULL;
+char  buffer[NPOW_10] = "\0";
+char  entry[NPOW_10] = "\0";
+int n = 0, nbuf = 100, i;
+
+
+  if ((lock = lock_file(fname, 60)) == NULL) return FAILURE;
+
+  if ((fp = fopen(fname, "r")) == NULL){
+    printf("Unable to open file queue %s.\n", fname); 
+    unlock_file(lock); return FAILURE;}
+
+  alloc_2D((void***)&line, nbuf, NPOW_10, sizeof(char));
+
+  while (fgets(buffer, NPOW_10, fp) != NULL){
+
+    if (n == nbuf){
+      re_alloc_2D((void***)&line, nbuf, NPOW_10, nbuf*2, NPOW_10, sizeof(char));
+      nbuf *= 2;
+    }
+
+    if (sscanf(buffer, "%1023s", entry) == 1 && strcmp(entry, image) == 0){
+      snprintf(line[n++], NPOW_10, "%s DONE\n", image);
+    } else {
+      copy_string(line[n++], NPOW_10, buffer);
+    }
+
+  }
+
+  fclose(fp);
+
+  if ((fp = fopen(fname, "w")) == NULL){
+    printf("Unable to update file queue %s.\n", fname); 
+    free_2D((void**)line, nbuf); unlock_file(lock); return FAILURE;}
+
+  for (i=0; i<n; i++) fputs(line[i], fp);
+
+  fclose(fp);
+
+  free_2D((void**)line, nbuf);
+  unlock_file(lock);
+
+  return SUCCESS;
+}
+
+
+/** This function processes a queue of Level 1 images with NPROC long-
++++ lived worker processes. Parameters, GDAL drivers and everything that
++++ was initialized before are inherited by the workers, and resources 
++++ that are cached during processing (e.g. the water vapor LUT) are re-
++++ used by all images processed by one worker. The start of the workers
++++ is staggered by DELAY seconds. Workers that fail or crash are repla-
++++ ced, and their image is marked as DONE, too. Note that no OpenMP pa-
++++ rallel region may have been entered before calling this function.
+--- pl2:     L2 parameters
+--- queue:   file queue
+--- process: Level 2 processing function
++++ Return:  SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int batch_level2(par_ll_t *pl2, l2_queue_t *queue, int (*process)(par_ll_t *pl2)){
+batch_t *batch = NULL;
+pid_t *worker = NULL;
+pid_t pid;
+int w, nw, status, running = 0, nfail = 0;
+
+
+  if (queue->n == 0){
+    printf("No images queued in %s\n", pl2->f_queue); return SUCCESS;}
+
+  nw = (pl2->nproc < queue->n) ? pl2->nproc : queue->n;
+
+  batch = (batch_t*)shared_alloc(sizeof(batch_t));
+  batch->current = (int*)shared_alloc(nw*sizeof(int));
+  batch->busy    = (bool*)shared_alloc(nw*sizeof(bool));
+  for (w=0; w<nw; w++) batch->current[w] = -1;
+
+  alloc((void**)&worker, nw, sizeof(pid_t));
+
+  printf("%d images enqueued. Start processing with %d CPUs\n", queue->n, nw);
+  fflush(stdout);
+
+
+  for (w=0; w<nw; w++){
+
+    if (w > 0 && pl2->delay > 0) sleep(pl2->delay);
+    if (batch->next >= queue->n) break;
+
+    if ((pid = fork()) < 0){
+      printf("unable to start worker.\n"); break;
+    } else if (pid == 0){
+      batch_worker(pl2, queue, batch, w, nw, process);
+    }
+
+    worker[w] = pid;
+    running++;
+
+  }
+
+
+  while (running > 0){
+
+    if ((pid = wait(&status)) < 0) break;
+
+    for (w=0; w<nw; w++){
+      if (worker[w] == pid) break;
+    }
+    if (w == nw) continue;
+
+    worker[w] = 0;
+    running--;
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == SUCCESS) continue;
+
+    nfail++;
+    batch->busy[w] = false;
+
+    // worker crashed while processing an image
+    if (batch->current[w] >= 0){
+      printf("%s: worker crashed.\n", queue->image[batch->current[w]]);
+      update_level2_queue(pl2->f_queue, queue->image[batch->current[w]]);
+      batch->current[w] = -1;
+    }
+
+    // replace worker
+    if (batch->next < queue->n){
+
+      if ((pid = fork()) < 0){
+        printf("unable to start worker.\n");
+      } else if (pid == 0){
+        batch_worker(pl2, queue, batch, w, nw, process);
+      } else {
+        worker[w] = pid;
+        running++;
+      }
+
+    }
+
+  }
+
+  if (nfail > 0) printf("%d images failed. See logfiles in %s\n", nfail, pl2->d_log);
+
+  munmap(batch->current, nw*sizeof(int));
+  munmap(batch->busy,    nw*sizeof(bool));
+  munmap(batch, sizeof(batch_t));
+  free((void*)worker);
+
+  return SUCCESS;
+}
+
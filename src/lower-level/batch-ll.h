@@ -0,0 +1,65 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Level 2 batch processing header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef BATCH_LL_H
+#define BATCH_LL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <stdbool.h> // boolean data type
+#include <string.h>  // string handling functions
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/alloc-cl.h"
+#include "../cross-level/string-cl.h"
+#include "../cross-level/dir-cl.h"
+#include "../cross-level/lock-cl.h"
+#include "../cross-level/numa-cl.h"
+#include "../lower-level/param-ll.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  int n;         // number of queued images
+  char **image;  // queued images
+} l2_queue_t;
+
+int read_level2_queue(char *fname, l2_queue_t *queue);
+void free_level2_queue(l2_queue_t *queue);
+int update_level2_queue(char *fname, char *image);
+int batch_level2(par_ll_t *pl2, l2_queue_t *queue, int (*process)(par_ll_t *pl2));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -61,19 +61,23 @@ This file contains functions for BRDF forward modelling
 +++ ted Reflectance (NBAR) and Quantification of Red-Edge Band BRDF Effect
 +++ s. Remote Sensing 9 (12), 1325.
 +++-----------------------------------------------------------------------
++++ The factors are computed for all valid cells of the coarse grid, row
++++ by row, and the kernels are shared between the bands.
 --- sun:    sun angle brick
 --- view:   view angle brick
 --- cor:    brdf correction factor brick
---- g:      Coarse grid cell
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int brdf_factor(brick_t *sun, brick_t *view, brick_t *cor, int g){
-int e, f;
-double lon, lat;
-float szen, sazi, vzen, vazi, standard_szen;
+int brdf_factor(brick_t *sun, brick_t *view, brick_t *cor){
+int e, f, g, ne, nf, ng;
+double *lon = NULL, *lat = NULL;
+float *szen = NULL, *sazi = NULL, *vzen = NULL, *vazi = NULL;
+float *ti = NULL, *tv = NULL, *phi = NULL, *kvol = NULL, *kgeo = NULL;
+float *ti0 = NULL, *tv0 = NULL, *phi0 = NULL, *kvol0 = NULL, *kgeo0 = NULL;
 float brdf_correction;
 int b,  nb; // band ID of actual bands
 int b_, nb_ = 10; // band ID and number of bands for which we have parameters
+int band[10];
 float iso[10] = { 0.0774, 0.1306, 0.1690, 0.2085, 0.2316, 0.2599, 0.3093, 0.3093, 0.3430, 0.2658 };
 float vol[10] = { 0.0372, 0.0580, 0.0574, 0.0845, 0.1003, 0.1197, 0.1535, 0.1535, 0.1154, 0.0639 };
 float geo[10] = { 0.0079, 0.0178, 0.0227, 0.0256, 0.0273, 0.0294, 0.0330, 0.0330, 0.0453, 0.0387 };
@@ -84,55 +88,160 @@ char domain[10][NPOW_10] = { "BLUE", "GREEN", "RED",
 
 
   nb = get_brick_nbands(cor);
-  szen = get_brick(sun,  ZEN, g);
-  vzen = get_brick(view, ZEN, g);
-  sazi = get_brick(sun,  AZI, g);
-  vazi = get_brick(view, AZI, g);
+  nf = get_brick_ncols(sun);
+  ne = get_brick_nrows(sun);
+  ng = get_brick_ncells(sun);
 
-  convert_brick_p2ji(sun, sun, g, &e, &f);
-  get_brick_geo(sun, f, e, &lon, &lat);
+  if ((szen = get_band_float(sun,  ZEN)) == NULL) return FAILURE;
+  if ((sazi = get_band_float(sun,  AZI)) == NULL) return FAILURE;
+  if ((vzen = get_band_float(view, ZEN)) == NULL) return FAILURE;
+  if ((vazi = get_band_float(view, AZI)) == NULL) return FAILURE;
 
-  // initialize
-  for (b=0; b<nb; b++) set_brick(cor, b, g, 1.0);
+  for (b_=0; b_<nb_; b_++) band[b_] = find_domain(cor, domain[b_]);
 
-  #ifdef FORCE_DEBUG
-  printf("BRDF: ");
-  #endif
+  // geo coordinates of the coarse grid
+  alloc((void**)&lat, ng, sizeof(double));
+  alloc((void**)&lon, ng, sizeof(double));
 
+  if (get_brick_geo_grid(sun, lon, lat) == FAILURE){
+    free((void*)lat); free((void*)lon);
+    return FAILURE;}
 
-  standard_szen = standard_sunzenith(sun->date, lat, lon);
-  standard_szen *= _D2R_CONV_;
 
-  #ifdef FORCE_DEBUG
-  printf("actual sun zenith: %.2f, azimuth: %.2f\n", 
-    szen*_R2D_CONV_, sazi*_R2D_CONV_);
-  #endif
+  #pragma omp parallel private(f, g, b, b_, brdf_correction, ti, tv, phi, kvol, kgeo, ti0, tv0, phi0, kvol0, kgeo0) shared(ne, nf, nb, nb_, band, iso, vol, geo, lat, lon, szen, sazi, vzen, vazi, sun, view, cor) default(none)
+  {
 
-  for (b_=0; b_<nb_; b_++){
+    alloc((void**)&ti,    nf, sizeof(float));
+    alloc((void**)&tv,    nf, sizeof(float));
+    alloc((void**)&phi,   nf, sizeof(float));
+    alloc((void**)&kvol,  nf, sizeof(float));
+    alloc((void**)&kgeo,  nf, sizeof(float));
+    alloc((void**)&ti0,   nf, sizeof(float));
+    alloc((void**)&tv0,   nf, sizeof(float));
+    alloc((void**)&phi0,  nf, sizeof(float));
+    alloc((void**)&kvol0, nf, sizeof(float));
+    alloc((void**)&kgeo0, nf, sizeof(float));
 
-    if ((b = find_domain(cor, domain[b_])) < 0) continue;
+    #pragma omp for schedule(guided)
+    for (e=0; e<ne; e++){
 
-    brdf_correction = 
-      brdf_forward(standard_szen, 0, 0,   iso[b_], vol[b_], geo[b_]) / 
-      //brdf_forward(45*_D2R_CONV_, 0, 0,   iso[b_], vol[b_], geo[b_]) / 
-      brdf_forward(szen, vzen, sazi-vazi, iso[b_], vol[b_], geo[b_]);
+      // actual and standardized (nadir) geometry of this row
+      for (f=0, g=e*nf; f<nf; f++, g++){
 
-    set_brick(cor, b, g, brdf_correction);
+        if (is_brick_nodata(view, 0, g)) continue;
 
-    #ifdef FORCE_DEBUG
-    printf(" %.3f", brdf_correction);
-    #endif
+        ti[f]  = szen[g];
+        tv[f]  = vzen[g];
+        phi[f] = sazi[g]-vazi[g];
+
+        ti0[f] = standard_sunzenith(sun->date, lat[g], lon[g]) * _D2R_CONV_;
+
+      }
+
+      // volumetric and geometric kernels, valid for all bands
+      brdf_kernels_row(ti,  tv,  phi,  nf, kvol,  kgeo);
+      brdf_kernels_row(ti0, tv0, phi0, nf, kvol0, kgeo0);
+
+      for (f=0, g=e*nf; f<nf; f++, g++){
+
+        if (is_brick_nodata(view, 0, g)) continue;
+
+        for (b=0; b<nb; b++) set_brick(cor, b, g, 1.0);
+
+        for (b_=0; b_<nb_; b_++){
+
+          if ((b = band[b_]) < 0) continue;
+
+          brdf_correction = 
+            (iso[b_] + vol[b_]*kvol0[f] + geo[b_]*kgeo0[f]) / 
+            (iso[b_] + vol[b_]*kvol[f]  + geo[b_]*kgeo[f]);
+
+          set_brick(cor, b, g, brdf_correction);
+
+        }
+
+      }
+
+    }
+
+    free((void*)ti);    free((void*)tv);    free((void*)phi);
+    free((void*)kvol);  free((void*)kgeo);
+    free((void*)ti0);   free((void*)tv0);   free((void*)phi0);
+    free((void*)kvol0); free((void*)kgeo0);
 
   }
 
-  #ifdef FORCE_DEBUG
-  printf("\n");
-  #endif
+  free((void*)lat); free((void*)lon);
 
   return SUCCESS;
 }
 
 
+/** BRDF kernels for a row of angles
++++ This function computes the RossThick and LiSparse-Reciprocal kernels
++++ for a number of sun/view geometries. The kernels do not depend on the
++++ band, thus the reflectance of any band is iso + vol*kvol + geo*kgeo.
++++ The math is the same as in brdf_forward, but the prime angles are de-
++++ rived algebraically (cos(atan(x)) = 1/sqrt(1+x^2)) and sines are ob-
++++ tained from cosines, such that the loop is free of calls and can be
++++ vectorized.
+--- ti:     sunzenith in radians
+--- tv:     view zenith in radians
+--- phi:    relative azimuth in radians
+--- n:      number of geometries
+--- kvol:   RossThick kernel (returned)
+--- kgeo:   LiSparse-Reciprocal kernel (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void brdf_kernels_row(float *ti, float *tv, float *phi, int n, float *kvol, float *kgeo){
+int i;
+const float hbratio = 2.0, brratio = 1.0;
+float cosphi, sinphi, costv, sintv, costi, sinti;
+float cosphaang, phaang, sinphaang;
+float tantvp, tantip, costvp, costip, sintvp, sintip;
+float cosphaangp, distancep, temp, cost, sint, tvar, overlap;
+
+
+  #pragma omp simd private(cosphi, sinphi, costv, sintv, costi, sinti, cosphaang, phaang, sinphaang, tantvp, tantip, costvp, costip, sintvp, sintip, cosphaangp, distancep, temp, cost, sint, tvar, overlap)
+  for (i=0; i<n; i++){
+
+    cosphi = cos(phi[i]); sinphi = sin(phi[i]);
+    costv  = cos(tv[i]);  costi  = cos(ti[i]);
+    sintv  = sin(tv[i]);  sinti  = sin(ti[i]);
+
+    // RossThick kernel
+    cosphaang = FMAX(-1.0, FMIN(1.0, costv*costi + sintv*sinti*cosphi));
+    phaang    = acos(cosphaang);
+    sinphaang = sqrt(1.0 - cosphaang*cosphaang);
+    kvol[i] = ((M_PI/2 - phaang) * cosphaang + sinphaang)/(costi + costv) - M_PI/4;
+
+    // prime angles
+    tantvp = brratio*sintv/costv;
+    tantip = brratio*sinti/costi;
+    costvp = 1.0/sqrt(1.0 + tantvp*tantvp); sintvp = tantvp*costvp;
+    costip = 1.0/sqrt(1.0 + tantip*tantip); sintip = tantip*costip;
+
+    // phase angle and D distance
+    cosphaangp = costvp*costip + sintvp*sintip*cosphi;
+    distancep  = sqrt(FMAX(0.0, tantvp*tantvp + tantip*tantip - 2.0*tantvp*tantip*cosphi));
+
+    // overlap
+    temp = 1.0/costvp + 1.0/costip;
+    cost = hbratio*sqrt(distancep*distancep + tantvp*tantvp*tantip*tantip*sinphi*sinphi)/temp;
+    cost = FMAX(-1.0, FMIN(1.0, cost));
+    tvar = acos(cost);
+    sint = sqrt(1.0 - cost*cost);
+    overlap = FMAX(0.0, 1.0/M_PI * (tvar - sint*cost) * temp);
+
+    // LiSparse-Reciprocal kernel
+    kgeo[i] = overlap - temp + 0.5 * (1.0+cosphaangp)/costvp/costip;
+
+  }
+
+  return;
+}
+
+
 /** BRDF forward model
 +++ This function runs the Ross-Thick-Li-Sparse-Reciprocal model in the 
 +++ forward mode and returns the calculated reflectance.
@@ -41,7 +41,8 @@ BRDF header
 extern "C" {
 #endif
 
-int brdf_factor(brick_t *sun, brick_t *view, brick_t *cor, int g);
+int brdf_factor(brick_t *sun, brick_t *view, brick_t *cor);
+void brdf_kernels_row(float *ti, float *tv, float *phi, int n, float *kvol, float *kgeo);
 float brdf_forward(float ti, float tv, float phi, float iso, float vol, float geo);
 void LiKernel(float hbratio, float brratio, float tantv, float tanti, float sinphi, float cosphi, float *result);
 void GetPhaang(float cos1, float cos2, float sin1, float sin2, float cos3, float *cosres, float *res,float *sinres);
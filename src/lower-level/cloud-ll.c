@@ -39,13 +39,19 @@ This file contains functions for cloud and cloud shadow identification
 
 float finalize_cloud(par_ll_t *pl2, int npix, atc_t *atc, brick_t *TOA, brick_t *QAI, brick_t *DEM, small *fcld_, small *fshd_);
 int potential_cloud(par_ll_t *pl2, int *npix, int *nclear, int *nland, brick_t *TOA, brick_t *QAI, brick_t *EXP, small **PCP, small **CLR, small **LND, small **BRT, short **VAR);
-float land_probability(int nc, int nclear, int nland, int npix, float cldprob, float *lowt, float *hight, small *lnd_, small *clr_, short *temp_, short *var_, brick_t *QAI, float **PROB);
-float water_probability(int nc, float cldprob, short *temp_, short *sw1_, short *sw2_, brick_t *QAI, float **PROB);
+float land_prob(float lowtemp, float hightemp, short temp, short var);
+float water_prob(float wtrtemp, short temp, short sw1);
+float land_probability(int nc, int nclear, int nland, int npix, float cldprob, float *lowt, float *hight, small *lnd_, small *clr_, short *temp_, short *var_);
+float water_probability(int nc, float cldprob, float *wtrt, int *nwtr, short *temp_, short *sw1_, short *sw2_, brick_t *QAI);
 int cloud_probability(int nthread, int npix, int nclear, int nland, int *ncloud, float cldprob, float *cc, float *lowt, float *hight, brick_t *TOA, brick_t *QAI, small *pcp_, small *clr_, small *lnd_, small *brt_, short *var_, small **CLD);
 int shadow_probability(int nthread, int nland, atc_t *atc, brick_t *TOA, brick_t *QAI, small *lnd_, small *cld_, short **SPR);
 int cloud_parallax(int nclear, int nland, int npix, int *ncloud, float *cc, brick_t *TOA, brick_t *QAI, small *pcp_, small *clr_, small *lnd_, small *brt_, short *var_, small **CLD);
+void parallax_gauss(int nx, int ny, int nk, float sigma, short *bnir_, brick_t *QAI, float *gauss_);
+void parallax_texture(int nx, int ny, int nodata, float **ratio_, float *var2_, float *cdi_, float *var3_);
 int shadow_position(float h, int x, int y, float res, int g, float **sun, float **view, int *newx, int *newy);
 int shadow_matching(float shdprob, float lowtemp, float hightemp, atc_t *atc, brick_t *TOA, brick_t *QAI, brick_t *EXP, small *cld_, short *spr_, small **SHD);
+int *shadow_candidates(float shdprob, int nx, int ny, brick_t *QAI, small *cld_, short *spr_, ushort *slp_);
+bool shadow_candidate_box(int *sat, int nx, int ny, float xmin, float xmax, float ymin, float ymax);
 
 
 /** This function builds the final cloud and cloud shadow classification.
@@ -380,30 +386,70 @@ int snw_buf;
 }
 
 
-/** This function computes the land probability
+/** This function computes the cloud probability over land for one pixel.
++++ The probability is cheap to evaluate, and is recomputed whenever it is
++++ needed instead of being stored for the full scene
+--- lowtemp:  low temperature threshold
+--- hightemp: high temperature threshold
+--- temp:     temperature
+--- var:      variability probability
++++ Return:   cloud probability over land
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+float land_prob(float lowtemp, float hightemp, short temp, short var){
+float A, B;
+float tempprob;
+
+
+  A = hightemp+400.0;
+  B = hightemp+400.0-lowtemp+400.0;
+
+  if ((tempprob = (A-temp)/B) < 0) tempprob = 0.0;
+
+  // note: not using the Zhu et al. 2015 ciirus probability
+  return tempprob*(var/10000.0);
+}
+
+
+/** This function computes the cloud probability over water for one pixel.
++++ The probability is cheap to evaluate, and is recomputed whenever it is
++++ needed instead of being stored for the full scene
+--- wtrtemp:  clear water temperature
+--- temp:     temperature
+--- sw1:      SWIR1
++++ Return:   cloud probability over water
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+float water_prob(float wtrtemp, short temp, short sw1){
+float brightprob, tempprob;
+
+
+  tempprob = (wtrtemp-temp)/400.0;
+  if ((brightprob = sw1/1100.0) > 1.0) brightprob = 1.0;
+
+  // note: not using the Zhu et al. 2015 ciirus probability
+  return tempprob*brightprob;
+}
+
+
+/** This function computes the adaptive cloud probability threshold over
++++ land
 --- nc:      number of cells
---- nclear:  number of clear-sky pixels (returned)
---- nland:   number of clear-sky land pixels (returned)
---- npix:    number of valid image pixels (returned)
+--- nclear:  number of clear-sky pixels
+--- nland:   number of clear-sky land pixels
+--- npix:    number of valid image pixels
 --- cldprob: fixed cloud probability threshold
---- lowt:    low temperature threshold
---- hight:   high temperature threshold
+--- lowt:    low temperature threshold (returned)
+--- hight:   high temperature threshold (returned)
 --- lnd_:    Clear-sky land pixels
 --- clr_:    Clear-sky pixels
 --- temp_:   temperature
 --- var_:    Variability probability
---- QAI:     Quality Assurance Information (modified)
---- PROB:    cloud probability
 +++ Return:  adaptive cloud probability threshold
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-float land_probability(int nc, int nclear, int nland, int npix, float cldprob, float *lowt, float *hight, small *lnd_, small *clr_, short *temp_, short *var_, brick_t *QAI, float **PROB){
+float land_probability(int nc, int nclear, int nland, int npix, float cldprob, float *lowt, float *hight, small *lnd_, small *clr_, short *temp_, short *var_){
 int p, k = 0;
 float lclr_max;
 float lo = 0.175, hi = 0.825;
 float lowtemp = 0.0, hightemp = 0.0;
-float A, B;
-float tempprob;
-float *LANDPROB = NULL;
 float *CLEARLPROB = NULL;
 float *CLEARTEMP = NULL;
 
@@ -446,29 +492,13 @@ float *CLEARTEMP = NULL;
   free((void*)CLEARTEMP);
   
 
-  /** cloud probability over land **/
-
-  A = hightemp+400.0;
-  B = hightemp+400.0-lowtemp+400.0;
-
-  alloc((void**)&LANDPROB, nc, sizeof(float));
-
-  for (p=0; p<nc; p++){
-
-    if (get_off(QAI, p)){ LANDPROB[p] = 0; continue;}
-
-    if ((tempprob = (A-temp_[p])/B) < 0) tempprob = 0.0;
-    // note: not using the Zhu et al. 2015 ciirus probability
-    LANDPROB[p] = tempprob*(var_[p]/10000.0);
-
-  }
-
+  /** dynamic cloud detection threshold over land, 
+  +++ cloud probability of clear-sky land pixels **/
 
-  // dynamic cloud detection threshold over land
   alloc((void**)&CLEARLPROB, nland, sizeof(float));
 
   for (p=0, k=0; p<nc; p++){
-    if (lnd_[p]) CLEARLPROB[k++] = LANDPROB[p];
+    if (lnd_[p]) CLEARLPROB[k++] = land_prob(lowtemp, hightemp, temp_[p], var_[p]);
   }
 
   lclr_max = quantile(CLEARLPROB, nland, hi) + cldprob;
@@ -480,30 +510,28 @@ float *CLEARTEMP = NULL;
 
   *lowt  = lowtemp;
   *hight = hightemp;
-  *PROB = LANDPROB;
   return lclr_max;
 }
 
 
-/** This function computes the water probability
+/** This function computes the adaptive cloud probability threshold over
++++ water
 --- nc:      number of cells
 --- cldprob: fixed cloud probability threshold
+--- wtrt:    clear water temperature (returned)
+--- nwtr:    number of clear water pixels (returned)
 --- temp_:   temperature
 --- sw1_:    SWIR1
 --- sw2_:    SWIR2
---- QAI:     Quality Assurance Information (modified)
---- PROB:    cloud probability
+--- QAI:     Quality Assurance Information
 +++ Return:  adaptive cloud probability threshold
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-float water_probability(int nc, float cldprob, short *temp_, short *sw1_, short *sw2_, brick_t *QAI, float **PROB){
+float water_probability(int nc, float cldprob, float *wtrt, int *nwtr, short *temp_, short *sw1_, short *sw2_, brick_t *QAI){
 int p, k = 0;
 float wclr_max;
 float hi = 0.825;
-float brightprob, tempprob;
 float wtrtemp = 0.0;
 int nCLEARWTR = 0;
-bool  *CLEARWTR = NULL;
-float *WATERPROB = NULL;
 float *CLEARWPROB = NULL;
 float *CLEARTEMP = NULL;
 
@@ -513,45 +541,31 @@ float *CLEARTEMP = NULL;
   #endif
 
 
-  /** cloud probability over water **/
-
-  alloc((void**)&CLEARWTR, nc, sizeof(bool));
+  /** clear water pixels **/
 
   for (p=0; p<nc; p++){
-    if (get_water(QAI, p) && sw2_[p] <= 300){ CLEARWTR[p] = true; nCLEARWTR++;}
+    if (get_water(QAI, p) && sw2_[p] <= 300) nCLEARWTR++;
   }
 
-  // test if there is clear water, if not skip and give water prob = -1
+  // test if there is clear water, if not skip and give water prob = 0
   if (nCLEARWTR > 0){
 
     alloc((void**)&CLEARTEMP, nCLEARWTR, sizeof(float));
 
     for (p=0, k=0; p<nc; p++){
-      if (CLEARWTR[p])CLEARTEMP[k++] = temp_[p];
+      if (get_water(QAI, p) && sw2_[p] <= 300) CLEARTEMP[k++] = temp_[p];
     }
 
     wtrtemp = quantile(CLEARTEMP, nCLEARWTR, hi);
     free((void*)CLEARTEMP);
 
 
-    alloc((void**)&WATERPROB, nc, sizeof(float));
-
-    for (p=0; p<nc; p++){
-
-      if (get_off(QAI, p)){ WATERPROB[p] = 0; continue;}
-
-      tempprob = (wtrtemp-temp_[p])/400.0;
-      if ((brightprob = sw1_[p]/1100.0) > 1.0) brightprob = 1.0;
-      // note: not using the Zhu et al. 2015 ciirus probability
-      WATERPROB[p] = tempprob*brightprob;
-
-    }
-
-    // dynamic cloud detection threshold over water
+    // dynamic cloud detection threshold over water,
+    // cloud probability of clear water pixels
     alloc((void**)&CLEARWPROB, nCLEARWTR, sizeof(float));
 
     for (p=0, k=0; p<nc; p++){
-      if (CLEARWTR[p]) CLEARWPROB[k++] = WATERPROB[p];
+      if (get_water(QAI, p) && sw2_[p] <= 300) CLEARWPROB[k++] = water_prob(wtrtemp, temp_[p], sw1_[p]);
     }
 
     wclr_max = quantile(CLEARWPROB, nCLEARWTR, hi) + cldprob;
@@ -559,24 +573,26 @@ float *CLEARTEMP = NULL;
 
   } else {
 
-    alloc((void**)&WATERPROB, nc, sizeof(float));
     wclr_max = 1;
 
   }
 
-  free((void*)CLEARWTR);
-  
 
   #ifdef FORCE_CLOCK
   proctime_print("water probability", TIME);
   #endif
 
-  *PROB = WATERPROB;
+  *wtrt = wtrtemp;
+  *nwtr = nCLEARWTR;
   return wclr_max;
 }
 
 
 /** This function computes the cloud probability.
++++ The land and water probabilities are not stored for the full scene.
++++ Only the adaptive thresholds are derived from the clear-sky pixels,
++++ and the probabilities are evaluated in the final sweep, for potential
++++ cloud pixels only.
 --- nthread: number of threads
 --- npix:    number of valid image pixels
 --- nclear:  number of clear-sky pixels
@@ -601,9 +617,8 @@ int p, nx, ny, nc;
 int ncld = 0;
 
 float lclr_max, wclr_max;
-float lowtemp, hightemp;
-float *LANDPROB = NULL;
-float *WATERPROB = NULL;
+float lowtemp, hightemp, wtrtemp;
+int nwtr;
 
 
 short *sw1_  = NULL;
@@ -630,18 +645,18 @@ small *cld_  = NULL;
   
   if (nthread == 1){
     lclr_max = land_probability(nc, nclear, nland, npix, cldprob, &lowtemp, &hightemp, 
-                                lnd_, clr_, temp_, var_, QAI, &LANDPROB);
-    wclr_max =  water_probability(nc, cldprob, temp_, sw1_, sw2_, QAI, &WATERPROB);
+                                lnd_, clr_, temp_, var_);
+    wclr_max =  water_probability(nc, cldprob, &wtrtemp, &nwtr, temp_, sw1_, sw2_, QAI);
   } else {
 
-    #pragma omp parallel num_threads(2) shared(nc, nclear, nland, npix, cldprob, lowtemp, hightemp, lnd_, clr_, temp_, var_, sw1_, sw2_, QAI, lclr_max, wclr_max, LANDPROB, WATERPROB) default(none)
+    #pragma omp parallel num_threads(2) shared(nc, nclear, nland, npix, cldprob, lowtemp, hightemp, wtrtemp, nwtr, lnd_, clr_, temp_, var_, sw1_, sw2_, QAI, lclr_max, wclr_max) default(none)
     {
 
       if (omp_get_thread_num() == 0){
         lclr_max = land_probability(nc, nclear, nland, npix, cldprob, &lowtemp, &hightemp, 
-                                    lnd_, clr_, temp_, var_, QAI, &LANDPROB);
+                                    lnd_, clr_, temp_, var_);
       } else {
-        wclr_max =  water_probability(nc, cldprob, temp_, sw1_, sw2_, QAI, &WATERPROB);
+        wclr_max =  water_probability(nc, cldprob, &wtrtemp, &nwtr, temp_, sw1_, sw2_, QAI);
       }
 
     }
@@ -661,15 +676,17 @@ small *cld_  = NULL;
        OR extremly cold cloud 
        AND white**/
     
-  #pragma omp parallel shared(nc, lclr_max, wclr_max, lowtemp, cld_, pcp_, temp_, brt_, LANDPROB, WATERPROB, QAI) default(none)
+  #pragma omp parallel shared(nc, lclr_max, wclr_max, lowtemp, hightemp, wtrtemp, nwtr, cld_, pcp_, temp_, var_, sw1_, brt_, QAI) default(none)
   {
 
     #pragma omp for
     for (p=0; p<nc; p++){
       // Zhu et al., 2015 modification :::
       // Frantz et al., 2015 modification :::
-      cld_[p] = ((pcp_[p] && !get_water(QAI, p) && LANDPROB[p]  > lclr_max) ||
-                  (pcp_[p] &&  get_water(QAI, p) && WATERPROB[p] > wclr_max) ||
+      cld_[p] = ((pcp_[p] && !get_water(QAI, p) && 
+                   land_prob(lowtemp, hightemp, temp_[p], var_[p]) > lclr_max) ||
+                  (pcp_[p] &&  get_water(QAI, p) && nwtr > 0 &&
+                   water_prob(wtrtemp, temp_[p], sw1_[p]) > wclr_max) ||
                    temp_[p] < (lowtemp-3500) || 
                    get_saturation(QAI, p)) &&
                    brt_[p];
@@ -677,9 +694,6 @@ small *cld_  = NULL;
     
   }
 
-  free((void*)LANDPROB);
-  free((void*)WATERPROB);
-
 
   // set clear pixel to cloud if 5 or more cloud pixels in neighborhood + 
   // set boundary to clear
@@ -867,9 +881,7 @@ int nx_, ny_, nc_;
 int ncld = 0;
 int nodata = -9999;
 int nk = 5;
-float **kernel = NULL;
-double sum_re3, sum_nir, sum_bnir, sum_var, num, min_var;
-double mx, my, varx, vary, vx, vy, cv, k;
+double sum_re3, sum_nir, sum_bnir, sum_var, num;
 float *gauss_ = NULL;
 float *var2_ = NULL;
 float *var3_ = NULL;
@@ -877,7 +889,10 @@ float **ratio_ = NULL;
 float *cdi_ = NULL;
 bool pcp, valid;
 small *clouds_ = NULL;
-queue_t fifo;
+small claimed;
+frontier_t front[2], seg;
+frontier_t *cur = &front[0], *nxt = &front[1], *tmp = NULL;
+int f, err = 0;
 short *re3_  = NULL;
 short *bnir_ = NULL;
 short *nir_  = NULL;
@@ -903,47 +918,8 @@ small *cld_  = NULL;
 
   /** Convolute BNIR with gaussian kernel **/
 
-  if (gauss_kernel(nk, 0.5, &kernel) != SUCCESS){
-    printf("Could not generate kernel. "); return FAILURE;}
-
   alloc((void**)&gauss_, nc, sizeof(float));
-
-  #pragma omp parallel private (j, p, ii, jj, ni, nj, np, sum_bnir, num) shared(nx, ny, nk, kernel, bnir_, QAI, gauss_) default(none)
-  {
-
-    #pragma omp for schedule(guided)
-    for (i=0; i<ny; i++){
-    for (j=0; j<nx; j++){
-      
-      p = i*nx+j;
-      
-      if (get_off(QAI, p)) continue;
-
-      sum_bnir = num = 0;
-
-      for (ii=0; ii<nk; ii++){
-      for (jj=0; jj<nk; jj++){
-
-        ni = -(nk-1)/2 + ii + i; nj = -(nk-1)/2 + jj + j;
-        if (ni < 0 || ni >= ny || nj < 0 || nj >= nx) continue;
-        np = ni*nx+nj;
-        
-        if (get_off(QAI, np)) continue;
-
-        sum_bnir += bnir_[np]*kernel[ii][jj];
-        num += kernel[ii][jj];
-
-      }
-      }
-
-      if (num > 0) gauss_[p] = (float)(sum_bnir/num);
-
-    }
-    }
-    
-  }
-
-  free_2D((void**)kernel, nk);
+  parallax_gauss(nx, ny, nk, 0.5, bnir_, QAI, gauss_);
 
 
   /** Compute NIR Ratios at reduced spatial resolution.
@@ -1030,72 +1006,7 @@ small *cld_  = NULL;
   alloc((void**)&cdi_,  nc_, sizeof(float));
   alloc((void**)&var3_, nc_, sizeof(float));
 
-  #pragma omp parallel private(j_, p_, ii, jj, ni, nj, np_, mx, my, vx, vy, cv, k, varx, vary, min_var) shared(nx_, ny_, cdi_, ratio_, var2_, var3_, nodata) default(none)
-  {
-
-    #pragma omp for schedule(guided)
-    for (i_=0; i_<ny_; i_++){
-    for (j_=0; j_<nx_; j_++){
-      
-      p_ = i_*nx_+j_;
-
-      cdi_[p_] = nodata;
-
-      if (ratio_[0][p_] == 0) continue;
-
-      mx = my = vx = vy = cv = k = 0;
-     // min_var = INT_MAX;
-
-      for (ii=-3; ii<=3; ii++){
-      for (jj=-3; jj<=3; jj++){
-
-        ni = i_+ii; nj = j_+jj;
-        if (ni < 0 || ni >= ny_ || nj < 0 || nj >= nx_) continue;
-        np_ = ni*nx_+nj;
-
-        if (ratio_[0][np_] == 0) continue;
-
-        if (++k == 1){
-          mx = ratio_[0][np_]; my = ratio_[1][np_];
-        } else {
-          covar_recurrence(ratio_[0][np_], ratio_[1][np_],
-            &mx, &my, &vx, &vy, &cv, k);
-        }
-
-        //if (var2_[np_] < min_var) min_var = var2_[np_];
-
-      }
-      }
-
-      if (k > 2){
-        varx = variance(vx, k);
-        vary = variance(vy, k);
-        cdi_[p_] = (varx-vary)/(varx+vary);
-      }
-      
-      
-      min_var = INT_MAX;
-      
-      for (ii=-7; ii<=7; ii++){
-      for (jj=-7; jj<=7; jj++){
-
-        ni = i_+ii; nj = j_+jj;
-        if (ni < 0 || ni >= ny_ || nj < 0 || nj >= nx_) continue;
-        np_ = ni*nx_+nj;
-
-        if (ratio_[0][np_] == 0) continue;
-
-        if (var2_[np_] < min_var) min_var = var2_[np_];
-
-      }
-      }
-
-      if (min_var != INT_MAX) var3_[p_] = min_var;
-
-    }
-    }
-    
-  }
+  parallax_texture(nx_, ny_, nodata, ratio_, var2_, cdi_, var3_);
 
   free_2D((void**)ratio_, 2);
   free((void*)var2_);
@@ -1178,67 +1089,103 @@ small *cld_  = NULL;
 
 
   /** Region-growing 1. Put all cloud edge pixels, from which
-  +++ clouds can be grown in FIFO **/
+  +++ clouds can be grown in the frontier **/
   
-  if ((create_queue(&fifo, nc_)) == FAILURE){
-    printf("failed to create new queue!\n"); return FAILURE;}
+  if ((create_frontier(&front[0], nx_+ny_)) == FAILURE ||
+      (create_frontier(&front[1], nx_+ny_)) == FAILURE){
+    printf("failed to create new frontier!\n"); return FAILURE;}
+
+  #pragma omp parallel private(j_, p_, ii, jj, ni, nj, np_, f, claimed, seg) shared(nx_, ny_, clouds_, cdi_, cur, nxt, tmp) reduction(+: err) default(none)
+  {
+
+    create_frontier(&seg, 1024);
+
+    #pragma omp for schedule(guided)
+    for (i_=0; i_<ny_; i_++){
+    for (j_=0; j_<nx_; j_++){
 
-  for (i_=0, p_=0; i_<ny_; i_++){
-  for (j_=0; j_<nx_; j_++, p_++){
+      p_ = i_*nx_+j_;
 
-    if (!clouds_[p_]) continue;
+      if (!clouds_[p_]) continue;
 
-      for (ii=-1; ii<=1; ii++){
-      for (jj=-1; jj<=1; jj++){
+        for (ii=-1; ii<=1; ii++){
+        for (jj=-1; jj<=1; jj++){
 
-        if (ii==0 && jj==0) continue;
+          if (ii==0 && jj==0) continue;
 
-        ni = i_+ii; nj = j_+jj;
-        if (ni < 0 || ni >= ny_ || nj < 0 || nj >= nx_) continue;
-        np_ = ni*nx_+nj;
+          ni = i_+ii; nj = j_+jj;
+          if (ni < 0 || ni >= ny_ || nj < 0 || nj >= nx_) continue;
+          np_ = ni*nx_+nj;
+
+          if (!clouds_[np_] && cdi_[np_] < -0.25 && cdi_[np_] >= -1){
+            if (push_frontier(&seg, j_, i_) == FAILURE) err++;
+            ii = jj = 10;
+          }
 
-        if (!clouds_[np_] && cdi_[np_] < -0.25 && cdi_[np_] >= -1){
-          if (enqueue(&fifo, j_, i_) == FAILURE){
-            printf("Failed to allocate enqueue memory\n"); return FAILURE;}
-          ii = jj = 10;
+        }
         }
 
-      }
-      }
+    }
+    }
 
-  }
-  }
+    gather_frontier(cur, &seg);
+
+
+    /** Region-growing 2. Grow cloud objects, one frontier level at a 
+    +++ time. All connected pixels with fairly low CDI become clouds. 
+    +++ Each pixel is claimed atomically, thus it is only pushed once. **/
+
+    while (cur->n > 0){
+
+      #pragma omp for schedule(guided)
+      for (f=0; f<cur->n; f++){
+
+        j_ = cur->buf_x[f];
+        i_ = cur->buf_y[f];
+
+        for (ii=-1; ii<=1; ii++){
+        for (jj=-1; jj<=1; jj++){
+
+          if (ii==0 && jj==0) continue;
+
+          ni = i_+ii; nj = j_+jj;
+          if (ni < 0 || ni >= ny_ || nj < 0 || nj >= nx_) continue;
+          np_ = ni*nx_+nj;
 
+          if (cdi_[np_] < -0.25 && cdi_[np_] >= -1){
 
-  /** Region-growing 2. Use FIFO to grow cloud objects.
-  +++ All connected pixels with fairly low CDI become clouds. **/
+            #pragma omp atomic capture
+            { claimed = clouds_[np_]; clouds_[np_] = true; }
 
-  while (dequeue(&fifo, &j_, &i_) == SUCCESS){
+            if (!claimed && push_frontier(&seg, nj, ni) == FAILURE) err++;
 
-    p_ = i_*nx_+j_;
+          }
 
-    for (ii=-1; ii<=1; ii++){
-    for (jj=-1; jj<=1; jj++){
+        }
+        }
 
-      if (ii==0 && jj==0) continue;
+      }
 
-      ni = i_+ii; nj = j_+jj;
-      if (ni < 0 || ni >= ny_ || nj < 0 || nj >= nx_) continue;
-      np_ = ni*nx_+nj;
+      gather_frontier(nxt, &seg);
 
-      if (!clouds_[np_] && cdi_[np_] < -0.25 && cdi_[np_] >= -1){
-        clouds_[np_] = true;
-        if (enqueue(&fifo, nj, ni) == FAILURE){
-          printf("Failed to allocate enqueue memory\n"); return FAILURE;}
+      #pragma omp single
+      {
+        tmp = cur; cur = nxt; nxt = tmp;
       }
 
     }
-    }
+
+    destroy_frontier(&seg);
 
   }
 
+  destroy_frontier(&front[0]);
+  destroy_frontier(&front[1]);
+
+  if (err > 0){
+    printf("Failed to allocate enqueue memory\n"); return FAILURE;}
+
   free((void*)cdi_);
-  destroy_queue(&fifo);
 
 
   /** Restore original resolution **/
@@ -1308,6 +1255,245 @@ small *cld_  = NULL;
 }
 
 
+/** This function convolutes the broad NIR band with a gaussian kernel. 
++++ The kernel is separable, thus the convolution is done in two 1D 
++++ passes, first along rows, then along columns. Pixels flagged as 
++++ nodata are skipped and the weights are renormalized with the valid 
++++ weights, which gives the same result as the 2D kernel. The image is
++++ processed in tiles of rows, which are distributed over the threads.
+--- nx:     number of columns
+--- ny:     number of rows
+--- nk:     kernel width
+--- sigma:  standard deviation of kernel
+--- bnir_:  broad NIR band
+--- QAI:    Quality Assurance Information
+--- gauss_: convoluted broad NIR band (modified)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void parallax_gauss(int nx, int ny, int nk, float sigma, short *bnir_, brick_t *QAI, float *gauss_){
+int i, j, p, ii, ni, nj, r;
+int h = (nk-1)/2, nt = (ny+PLX_TILE-1)/PLX_TILE;
+int t, i0, i1, r0, r1;
+float *kernel = NULL;
+double sum, num, sig = sigma*sigma*2;
+double *rsum = NULL, *rnum = NULL;
+
+
+  alloc((void**)&kernel, nk, sizeof(float));
+  for (ii=0; ii<nk; ii++) kernel[ii] = exp(-((ii-h)*(ii-h))/sig);
+
+  #pragma omp parallel private(t, i0, i1, r0, r1, r, i, j, p, ii, ni, nj, sum, num, rsum, rnum) shared(nx, ny, nk, h, nt, kernel, bnir_, QAI, gauss_) default(none)
+  {
+
+    alloc((void**)&rsum, (PLX_TILE+nk-1)*nx, sizeof(double));
+    alloc((void**)&rnum, (PLX_TILE+nk-1)*nx, sizeof(double));
+
+    #pragma omp for schedule(dynamic)
+    for (t=0; t<nt; t++){
+
+      i0 = t*PLX_TILE;  i1 = i0+PLX_TILE;
+      if (i1 > ny) i1 = ny;
+
+      r0 = i0-h; if (r0 < 0)  r0 = 0;
+      r1 = i1+h; if (r1 > ny) r1 = ny;
+
+      // row pass, including the halo of the tile
+      for (i=r0; i<r1; i++){
+      for (j=0; j<nx; j++){
+
+        sum = num = 0;
+
+        for (ii=0; ii<nk; ii++){
+
+          nj = j-h+ii;
+          if (nj < 0 || nj >= nx) continue;
+          p = i*nx+nj;
+
+          if (get_off(QAI, p)) continue;
+
+          sum += bnir_[p]*kernel[ii];
+          num += kernel[ii];
+
+        }
+
+        r = (i-r0)*nx+j;
+        rsum[r] = sum;
+        rnum[r] = num;
+
+      }
+      }
+
+      // column pass
+      for (i=i0; i<i1; i++){
+      for (j=0; j<nx; j++){
+
+        p = i*nx+j;
+
+        if (get_off(QAI, p)) continue;
+
+        sum = num = 0;
+
+        for (ii=0; ii<nk; ii++){
+
+          ni = i-h+ii;
+          if (ni < r0 || ni >= r1) continue;
+          r = (ni-r0)*nx+j;
+
+          sum += rsum[r]*kernel[ii];
+          num += rnum[r]*kernel[ii];
+
+        }
+
+        if (num > 0) gauss_[p] = (float)(sum/num);
+
+      }
+      }
+
+    }
+
+    free((void*)rsum);
+    free((void*)rnum);
+
+  }
+
+  free((void*)kernel);
+
+  return;
+}
+
+
+/** This function computes the texture of the NIR ratios, i.e. the Cloud
++++ Displacement Index (CDI) from the variances of both ratios in a 7x7 
++++ window, and the minimum variability probability in a 15x15 window.
++++ Both window statistics are separable. The moments (count, sum, sum 
++++ of squares) and the minimum are first reduced along rows, then along
++++ columns. Each window sum is a direct sum over the 1D window, thus 
++++ non-finite ratios only affect the windows they fall in, and there is
++++ no cancellation as with running sums. The image is processed in tiles
++++ of rows, which are distributed over the threads.
+--- nx:     number of columns
+--- ny:     number of rows
+--- nodata: nodata value
+--- ratio_: NIR ratios; 0 if not computed
+--- var2_:  variability probability
+--- cdi_:   Cloud Displacement Index (modified)
+--- var3_:  minimum variability probability (modified)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void parallax_texture(int nx, int ny, int nodata, float **ratio_, float *var2_, float *cdi_, float *var3_){
+int i, j, p, ii, ni, nj, r;
+int hc = 3, hm = 7, nt = (ny+PLX_TILE-1)/PLX_TILE;
+int t, i0, i1, r0, r1;
+double n, sx, sy, sxx, syy, varx, vary;
+float x, y, min_var;
+double *mom = NULL;
+float  *rmin = NULL;
+enum { _N_, _SX_, _SY_, _SXX_, _SYY_, _MOMENTS_ };
+
+
+  #pragma omp parallel private(t, i0, i1, r0, r1, r, i, j, p, ii, ni, nj, n, sx, sy, sxx, syy, varx, vary, x, y, min_var, mom, rmin) shared(nx, ny, hc, hm, nt, nodata, ratio_, var2_, cdi_, var3_) default(none)
+  {
+
+    alloc((void**)&mom,  (PLX_TILE+2*hm)*nx*_MOMENTS_, sizeof(double));
+    alloc((void**)&rmin, (PLX_TILE+2*hm)*nx, sizeof(float));
+
+    #pragma omp for schedule(dynamic)
+    for (t=0; t<nt; t++){
+
+      i0 = t*PLX_TILE;  i1 = i0+PLX_TILE;
+      if (i1 > ny) i1 = ny;
+
+      r0 = i0-hm; if (r0 < 0)  r0 = 0;
+      r1 = i1+hm; if (r1 > ny) r1 = ny;
+
+      // row pass, including the halo of the tile
+      for (i=r0; i<r1; i++){
+      for (j=0; j<nx; j++){
+
+        n = sx = sy = sxx = syy = 0;
+        min_var = INT_MAX;
+
+        for (ii=-hm; ii<=hm; ii++){
+
+          nj = j+ii;
+          if (nj < 0 || nj >= nx) continue;
+          p = i*nx+nj;
+
+          if (ratio_[0][p] == 0) continue;
+
+          if (var2_[p] < min_var) min_var = var2_[p];
+
+          if (ii < -hc || ii > hc) continue;
+
+          x = ratio_[0][p]; y = ratio_[1][p];
+          n++; sx += x; sy += y; sxx += x*x; syy += y*y;
+
+        }
+
+        r = (i-r0)*nx+j;
+        mom[r*_MOMENTS_+_N_]   = n;
+        mom[r*_MOMENTS_+_SX_]  = sx;
+        mom[r*_MOMENTS_+_SY_]  = sy;
+        mom[r*_MOMENTS_+_SXX_] = sxx;
+        mom[r*_MOMENTS_+_SYY_] = syy;
+        rmin[r] = min_var;
+
+      }
+      }
+
+      // column pass
+      for (i=i0; i<i1; i++){
+      for (j=0; j<nx; j++){
+
+        p = i*nx+j;
+
+        cdi_[p] = nodata;
+
+        if (ratio_[0][p] == 0) continue;
+
+        n = sx = sy = sxx = syy = 0;
+        min_var = INT_MAX;
+
+        for (ii=-hm; ii<=hm; ii++){
+
+          ni = i+ii;
+          if (ni < r0 || ni >= r1) continue;
+          r = (ni-r0)*nx+j;
+
+          if (rmin[r] < min_var) min_var = rmin[r];
+
+          if (ii < -hc || ii > hc) continue;
+
+          n   += mom[r*_MOMENTS_+_N_];
+          sx  += mom[r*_MOMENTS_+_SX_];
+          sy  += mom[r*_MOMENTS_+_SY_];
+          sxx += mom[r*_MOMENTS_+_SXX_];
+          syy += mom[r*_MOMENTS_+_SYY_];
+
+        }
+
+        if (n > 2){
+          varx = variance(sxx - sx*sx/n, n);
+          vary = variance(syy - sy*sy/n, n);
+          cdi_[p] = (varx-vary)/(varx+vary);
+        }
+
+        if (min_var != INT_MAX) var3_[p] = min_var;
+
+      }
+      }
+
+    }
+
+    free((void*)mom);
+    free((void*)rmin);
+
+  }
+
+  return;
+}
+
+
 /** Due to the scanning geometry, a cloud is projected to the image plane
 +++ in a ~perpendicular angle to the nadir line, i.e. the viewing azimuth.
 +++ This is not exactly correct for detectors with multiple lines, but it
@@ -1354,6 +1540,88 @@ float dy_across, dy_cast;
 }
 
 
+/** This function builds a summed-area table of the pixels that could 
++++ contribute to a shadow match, aggregated to blocks of SHD_BLOCK pixels.
++++ It is used to quickly prune cloud heights whose projected shadow can-
++++ not hit any potential shadow pixel.
+--- shdprob: shadow probability
+--- nx:      number of columns
+--- ny:      number of rows
+--- QAI:     Quality Assurance Information
+--- cld_:    Cloud mask
+--- spr_:    Potential Shadow Pixels
+--- slp_:    Topographic slope
++++ Return:  summed-area table with (ny/SHD_BLOCK+2)*(nx/SHD_BLOCK+2) cells
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int *shadow_candidates(float shdprob, int nx, int ny, brick_t *QAI, small *cld_, short *spr_, ushort *slp_){
+int i, j, p, bi, bj, nbx, nby;
+int *sat = NULL;
+
+
+  nbx = nx/SHD_BLOCK+1;
+  nby = ny/SHD_BLOCK+1;
+
+  alloc((void**)&sat, (nbx+1)*(nby+1), sizeof(int));
+
+  // count candidates per block
+  for (i=0, p=0; i<ny; i++){
+  for (j=0; j<nx; j++, p++){
+    if (spr_[p] > (shdprob*10000) && !cld_[p] && !(slp_[p] == 0 && get_water(QAI, p))){
+      bi = i/SHD_BLOCK+1;
+      bj = j/SHD_BLOCK+1;
+      sat[bi*(nbx+1)+bj]++;
+    }
+  }
+  }
+
+  // cumulate
+  for (bi=1; bi<=nby; bi++){
+  for (bj=1; bj<=nbx; bj++){
+    sat[bi*(nbx+1)+bj] += sat[(bi-1)*(nbx+1)+bj] + 
+                          sat[bi*(nbx+1)+bj-1] - 
+                          sat[(bi-1)*(nbx+1)+bj-1];
+  }
+  }
+
+  return sat;
+}
+
+
+/** This function tests whether there is any potential shadow pixel with-
++++ in a box in image coordinates.
+--- sat:    summed-area table of shadow candidates
+--- nx:     number of columns
+--- ny:     number of rows
+--- xmin:   left   edge of box
+--- xmax:   right  edge of box
+--- ymin:   top    edge of box
+--- ymax:   bottom edge of box
++++ Return: true if box may contain a shadow candidate
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool shadow_candidate_box(int *sat, int nx, int ny, float xmin, float xmax, float ymin, float ymax){
+int bj0, bj1, bi0, bi1, nbx;
+
+
+  if (xmin < 0) xmin = 0;
+  if (ymin < 0) ymin = 0;
+  if (xmax > nx-1) xmax = nx-1;
+  if (ymax > ny-1) ymax = ny-1;
+
+  // box is outside of image
+  if (xmin > xmax || ymin > ymax) return false;
+
+  nbx = nx/SHD_BLOCK+1;
+
+  bj0 = (int)xmin/SHD_BLOCK;
+  bj1 = (int)xmax/SHD_BLOCK+1;
+  bi0 = (int)ymin/SHD_BLOCK;
+  bi1 = (int)ymax/SHD_BLOCK+1;
+
+  return (sat[bi1*(nbx+1)+bj1] - sat[bi0*(nbx+1)+bj1] - 
+          sat[bi1*(nbx+1)+bj0] + sat[bi0*(nbx+1)+bj0]) > 0;
+}
+
+
 /** Knowing the view and solar geometry (and cloud height), we can predict
 +++ the location where the shadow is projected to the ground. This projec-
 +++ tion is matched with the shadow probability, and if it matches, a sha-
@@ -1387,6 +1655,10 @@ float base_min, base_max, base_step, base;
 float best_match, match, shadow, total;
 int x, y;
 float height;
+int *G = NULL, *sat = NULL;
+float ax, ay, axmin, axmax, aymin, aymax;
+float oxmin, oxmax, oymin, oymax, dhmin, dhmax;
+float hlo, hhi, bxmin, bxmax, bymin, bymax;
 float wlapse = 0.65, dlapse = 0.98, rlapse = 0.1; // wet, dry and reducced adiabatic lapse rate in 100*kelvin/m
 int    *CCL        = NULL;
 int    *SIZE       = NULL;
@@ -1512,16 +1784,22 @@ short  *temp_      = NULL;
   printf("max. object size: %d\n", size_max);
   #endif
 
+  
+  /** potential shadow pixels that can contribute to a match, 
+  +++ used for pruning base heights without any candidate **/
+  sat = shadow_candidates(shdprob, nx, ny, QAI, cld_, spr_, slp_);
+
 
 
 
 
-  #pragma omp parallel private(k, g, x, y, p, size, radius, core, basetemp, base_min, base_max, base, height, shadow, total, match, best_match, qtemp, P, best_P) shared(nx, ny, res, nobj, influence, lowtemp, hightemp, dlapse, rlapse, wlapse, base_step, size_max, spr_, shdprob, cld_, slp_, atc, sun_, view_, QAI, CCL, shd_, array_x, array_y, array_temp, SIZE, temp_) default(none) 
+  #pragma omp parallel private(k, g, x, y, p, size, radius, core, basetemp, base_min, base_max, base, height, shadow, total, match, best_match, qtemp, P, best_P, G, ax, ay, axmin, axmax, aymin, aymax, oxmin, oxmax, oymin, oymax, dhmin, dhmax, hlo, hhi, bxmin, bxmax, bymin, bymax) shared(nx, ny, res, nobj, influence, lowtemp, hightemp, dlapse, rlapse, wlapse, base_step, size_max, spr_, shdprob, cld_, slp_, atc, sun_, view_, QAI, CCL, shd_, array_x, array_y, array_temp, SIZE, temp_, sat) default(none) 
   {
 
     if (temp_ != NULL) alloc((void**)&qtemp, size_max, sizeof(float));
     alloc((void**)&P,       size_max, sizeof(int));
     alloc((void**)&best_P,  size_max, sizeof(int));
+    alloc((void**)&G,       size_max, sizeof(int));
 
     #pragma omp for schedule(guided)
     for (id=0; id<nobj; id++){
@@ -1564,11 +1842,56 @@ short  *temp_      = NULL;
       }
 
 
+      /** Projection bounds:
+      +++ The shadow shift is linear in height. Bound the object, its shift
+      +++ per meter and its pixel heights above base, such that the pro-
+      +++ jected bounding box can be computed for each base height. **/
+      oxmin = oymin = axmin = aymin = dhmin =  INT_MAX;
+      oxmax = oymax = axmax = aymax = dhmax = -INT_MAX;
+
+      for (k=0; k<size; k++){
+
+        G[k] = g = convert_brick_ji2p(QAI, atc->xy_sun, array_y[id][k], array_x[id][k]);
+
+        ax = (view_[tZEN][g]*view_[sAZI][g] - sun_[tZEN][g]*sun_[sAZI][g]) / res;
+        ay = (sun_[tZEN][g]*sun_[cAZI][g] - view_[tZEN][g]*view_[cAZI][g]) / res;
+
+        if (temp_ != NULL){
+          height = (basetemp-array_temp[id][k])/wlapse;
+        } else {
+          height = 0;
+        }
+
+        if (array_x[id][k] < oxmin) oxmin = array_x[id][k];
+        if (array_x[id][k] > oxmax) oxmax = array_x[id][k];
+        if (array_y[id][k] < oymin) oymin = array_y[id][k];
+        if (array_y[id][k] > oymax) oymax = array_y[id][k];
+        if (ax < axmin) axmin = ax;
+        if (ax > axmax) axmax = ax;
+        if (ay < aymin) aymin = ay;
+        if (ay > aymax) aymax = ay;
+        if (height < dhmin) dhmin = height;
+        if (height > dhmax) dhmax = height;
+
+      }
+
+
       /** Base height iteration:
       +++ Lift the cloud up across the possible base height range and match
       +++ the casted shadow with the potential shadow layer. **/
       for (base=base_min, best_match=0; base<=base_max; base+=base_step){
 
+        /** Pruning:
+        +++ If the projected bounding box (with a margin for rounding) does 
+        +++ not contain any potential shadow pixel, there is no match. **/
+        hlo = base + dhmin;
+        hhi = base + dhmax;
+        bxmin = oxmin + fminf(fminf(hlo*axmin, hlo*axmax), fminf(hhi*axmin, hhi*axmax)) - 2;
+        bxmax = oxmax + fmaxf(fmaxf(hlo*axmin, hlo*axmax), fmaxf(hhi*axmin, hhi*axmax)) + 2;
+        bymin = oymin + fminf(fminf(hlo*aymin, hlo*aymax), fminf(hhi*aymin, hhi*aymax)) - 2;
+        bymax = oymax + fmaxf(fmaxf(hlo*aymin, hlo*aymax), fmaxf(hhi*aymin, hhi*aymax)) + 2;
+        if (!shadow_candidate_box(sat, nx, ny, bxmin, bxmax, bymin, bymax)) continue;
+
         for (k=0, shadow=0, total=0; k<size; k++){
 
           /** Predict cloud pixel height:
@@ -1586,8 +1909,7 @@ short  *temp_      = NULL;
           /** Position of projected shadow:
           +++ Copmpute the position of the projected shadow as a function of
           +++ view and sun geometry. **/
-          g = convert_brick_ji2p(QAI, atc->xy_sun, array_y[id][k], array_x[id][k]);
-          shadow_position(height, array_x[id][k], array_y[id][k], res, g, sun_, view_, &x, &y);
+          shadow_position(height, array_x[id][k], array_y[id][k], res, G[k], sun_, view_, &x, &y);
 
           if (y < 0 || y >= ny || x < 0 || x >= nx){
             P[k] = -1; continue;}
@@ -1652,8 +1974,11 @@ short  *temp_      = NULL;
     if (temp_ != NULL) free((void*)qtemp);
     free((void*)P);
     free((void*)best_P);
+    free((void*)G);
 
   } // end omp parallel
+
+  free((void*)sat);
   
 
   #ifdef FORCE_DEBUG
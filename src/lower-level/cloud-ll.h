@@ -40,6 +40,12 @@ Cloud and cloud shadow header
 #include "../lower-level/atc-ll.h"
 #include "../lower-level/param-ll.h"
 
+// block size (in pixels) of the shadow candidate lookup in shadow matching
+#define SHD_BLOCK 16
+
+// tile height (in rows) of the separable window passes in the parallax test
+#define PLX_TILE 32
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -40,15 +40,24 @@ This file contains functions for supporting coregistration
 
 #include "coreg-ll.h"
 
+#include <stddef.h>  // standard type definitions
+#include <unistd.h>  // standard symbolic constants and types 
+
 #define MAX_PYRAMID_LAYER (10)
 #define MIN_TIES_NUM (12)
 #define MIN_SAM_THRESHOLD (0.985)
+#define REG_BANDS (4) // number of bands that are registered in one pass
 
 #define ABS(x)        ((x>=0)? (x):-(x))
 #define MAX(a,b) (((a)>(b))? (a) : (b))
 #define MIN(a,b) (((a)<(b))? (a) : (b))
 
 
+// warped base images of previous images
+base_cache_t _BASECACHE_[COREG_CACHE];
+long _BASECACHE_USE_ = 0;
+
+
 typedef enum { enum_TRANSLATION = 1, enum_AFFINE = 2, enum_POLYNOMIAL = 3, enum_AUTO = 4 } enum_tranformation_type;
 
 typedef struct{
@@ -80,9 +89,12 @@ match_t depth_first_matching(short ***pyramids_, int *nx_pyr, int *ny_pyr, int t
 enum_tranformation_type choose_transform(int ntie); 
 int transform_from_df(enum_tranformation_type transform_, tie_t *tie, double *coefs, double *rmse);
 int transform_from_dm(enum_tranformation_type transform, float *parallaxmap_x, float *parallaxmap_y, float *corrmap, int nx_new, int ny_new, int step, double *coefs, double *rmse);
-short *register_band(enum_tranformation_type transform, match_t *dm, short *image, int nx, int ny, short nodata);
-short *register_quality(enum_tranformation_type transform, match_t *dm, short *image, int nx, int ny, short nodata);
+int register_bands(enum_tranformation_type transform, match_t *dm, short **target, int nb, short **qai, int nx, int ny, short nodata, short qai_nodata);
 match_t dense_matching(short ***pyramids_, int *nx_pyr, int *ny_pyr, short nodata, int layer, int toplayer, int *scales, int step, int h, int max_h_, double SAM, enum_tranformation_type transform, match_t *df);
+void key_base_cache(par_ll_t *pl2, const char *fbase, int band, brick_t *BASE, base_cache_t *key);
+void file_base_cache(par_ll_t *pl2, base_cache_t *key, char fname[], int size);
+bool read_base_cache(par_ll_t *pl2, const char *fbase, int band, brick_t *BASE);
+void write_base_cache(par_ll_t *pl2, const char *fbase, int band, brick_t *BASE);
 
 
 /** This function is the private entry point to the LSReg coregistration.
@@ -98,7 +110,7 @@ match_t dense_matching(short ***pyramids_, int *nx_pyr, int *ny_pyr, short nodat
 +++ Return:  SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int coreg(short **target, short *base, brick_t *QAI, float res, int nx, int ny, int nb, int band, short nodata){
-int h, max_h, b;
+int h, max_h;
 int i, j, p;
 double SAM, SAM_original;
 bool success = false;
@@ -246,8 +258,7 @@ int nland = 0;
 
   if (success){
     printf(" - good, ");
-    for (b=0; b<nb; b++) target[b] = register_band(transform, &dm, target[b], nx, ny, nodata);
-    qai_[0] = register_quality(transform, &dm, qai_[0], nx, ny, qai_nodata);
+    register_bands(transform, &dm, target, nb, &qai_[0], nx, ny, nodata, qai_nodata);
   } else {
     //printf(" - fail, ");
     printf(" coreg failed. Exit.\n");
@@ -655,12 +666,13 @@ double xdif, ydif;
 int ws, w, ww;
 int n;
 int dx, dy;
-int x, y, x2, y2, x1 = 0, y1 = 0;
+int x, y, x2, y2, x1, y1;
 int nx, ny;
 short *target     = NULL;
 short *base       = NULL;
 short *target_sub = NULL;
 short *base_sub   = NULL;
+bool  *matched    = NULL;
 double diff_threshold;
 int ntie;
 tie_t init;
@@ -696,74 +708,101 @@ tie_t init;
   ww = w*w;
 
 
-  alloc((void**)&target_sub, ww, sizeof(short));
-  alloc((void**)&base_sub,   ww, sizeof(short));
-  
   alloc((void**)&init.target.j, poi->n, sizeof(double));
   alloc((void**)&init.target.i, poi->n, sizeof(double));
   alloc((void**)&init.base.j,   poi->n, sizeof(double));
   alloc((void**)&init.base.i,   poi->n, sizeof(double));
+  alloc((void**)&matched,       poi->n, sizeof(bool));
 
 
-  ntie = 0;
-  for (n=0; n<poi->n; n++){
-    
-    x2 = (int)poi->j[n];
-    y2 = (int)poi->i[n];
-
-    // initial cross-correlation matching
-    if (!imsub(target, nx, ny, x2, y2, h, target_sub))      continue;
-
-    // get cross-correlation matched position (x1, y1)
-    maxcor = 0;
-    for (y=y2-dy; y<=y2+dy; y++){
-    for (x=x2-dx; x<=x2+dx; x++){
-      if (imsub(base, nx, ny, x, y, h, base_sub)){
-        cor = corr2(target_sub, base_sub, ww);
-        if (cor > maxcor){
-          x1 = x;
-          y1 = y;
-          maxcor = cor;
+  // points of interest are matched independently
+  #pragma omp parallel private(x, y, x1, y1, x2, y2, cor, maxcor, corr, x1n, y1n, x2n, y2n, xdif, ydif, ws, target_sub, base_sub) shared(poi, target, base, nx, ny, h, w, ww, dx, dy, max_h, corr_threshold, diff_threshold, init, matched) default(none)
+  {
+
+    alloc((void**)&target_sub, ww, sizeof(short));
+    alloc((void**)&base_sub,   ww, sizeof(short));
+
+    #pragma omp for schedule(dynamic)
+    for (n=0; n<poi->n; n++){
+      
+      x2 = (int)poi->j[n];
+      y2 = (int)poi->i[n];
+
+      // initial cross-correlation matching
+      if (!imsub(target, nx, ny, x2, y2, h, target_sub))      continue;
+
+      // get cross-correlation matched position (x1, y1),
+      // start from the target position if there is no positive correlation
+      maxcor = 0;
+      x1 = x2;
+      y1 = y2;
+      for (y=y2-dy; y<=y2+dy; y++){
+      for (x=x2-dx; x<=x2+dx; x++){
+        if (imsub(base, nx, ny, x, y, h, base_sub)){
+          cor = corr2(target_sub, base_sub, ww);
+          if (cor > maxcor){
+            x1 = x;
+            y1 = y;
+            maxcor = cor;
+          }
         }
       }
+      }
+
+      // (x1, y1) is initially matched to (x2n, y2n), i.e. (x2, y2)
+      // do least-squares matching (LSM) to get new matched position (x1n, y1n)
+      // iteratively increasing matching window is used to increase matching ratio
+      corr = (float)(maxcor);
+      x2n = (float)(x2);
+      y2n = (float)(y2);
+      xdif = 0.f;
+      ydif = 0.f;
+      ws = w;
+      do {
+        // get LSM matched position (x1n, y1n)
+        x1n = (float)(x1);
+        y1n = (float)(y1);
+        LSMatching_SAM(target, nx, ny, base, nx, ny, ws, ws, x2n, y2n, &x1n, &y1n, &corr, SHRT_MAX);
+
+        // increment matching window size
+        ws = ws + 4;
+
+        // compare (x1n, y1n) with initial position (x1, y1)
+        xdif = ABS(x1n - x1);
+        ydif = ABS(y1n - y1);
+      } while (xdif < 1e-10 && ydif < 1e-10 && ws / 2 < max_h && corr > 0);
+
+      if ((xdif<1e-10 && ydif<1e-10) || xdif>diff_threshold || ydif>diff_threshold || corr<corr_threshold)
+        continue; // match unsuccessful
+
+      // output matched points
+      //fprintf(fout, "%d\t%d\t%.2f\t%.2f\t%.2f\t%.2f\t%.3f\n", x2, y2, x1n, y1n, x1n - x2, y1n - y2, corr);
+      init.target.j[n] = x2;
+      init.target.i[n] = y2;
+      init.base.j[n]   = x1n;
+      init.base.i[n]   = y1n;
+      matched[n] = true;
+
     }
-    }
 
-    // (x1, y1) is initially matched to (x2n, y2n), i.e. (x2, y2)
-    // do least-squares matching (LSM) to get new matched position (x1n, y1n)
-    // iteratively increasing matching window is used to increase matching ratio
-    corr = (float)(maxcor);
-    x2n = (float)(x2);
-    y2n = (float)(y2);
-    xdif = 0.f;
-    ydif = 0.f;
-    ws = w;
-    do {
-      // get LSM matched position (x1n, y1n)
-      x1n = (float)(x1);
-      y1n = (float)(y1);
-      LSMatching_SAM(target, nx, ny, base, nx, ny, ws, ws, x2n, y2n, &x1n, &y1n, &corr, SHRT_MAX);
-
-      // increment matching window size
-      ws = ws + 4;
-
-      // compare (x1n, y1n) with initial position (x1, y1)
-      xdif = ABS(x1n - x1);
-      ydif = ABS(y1n - y1);
-    } while (xdif < 1e-10 && ydif < 1e-10 && ws / 2 < max_h && corr > 0);
-
-    if ((xdif<1e-10 && ydif<1e-10) || xdif>diff_threshold || ydif>diff_threshold || corr<corr_threshold)
-      continue; // match unsuccessful
-
-    // output matched points
-    //fprintf(fout, "%d\t%d\t%.2f\t%.2f\t%.2f\t%.2f\t%.3f\n", x2, y2, x1n, y1n, x1n - x2, y1n - y2, corr);
-    init.target.j[ntie] = x2;
-    init.target.i[ntie] = y2;
-    init.base.j[ntie]   = x1n;
-    init.base.i[ntie]   = y1n;
+    free(base_sub);
+    free(target_sub);
+
+  }
+
+
+  // compact matched points, keep order of points of interest
+  for (n=0, ntie=0; n<poi->n; n++){
+    if (!matched[n]) continue;
+    init.target.j[ntie] = init.target.j[n];
+    init.target.i[ntie] = init.target.i[n];
+    init.base.j[ntie]   = init.base.j[n];
+    init.base.i[ntie]   = init.base.i[n];
     ntie++;
   }
 
+  free((void*)matched);
+
   init.target.n = ntie;
   init.base.n   = ntie;
 
@@ -772,9 +811,6 @@ tie_t init;
   #endif
 
 
-  free(base_sub);
-  free(target_sub);
-  
   #ifdef FORCE_CLOCK
   proctime_print("initial matching", TIME);
   #endif
@@ -876,7 +912,11 @@ match_t df;
     diff_threshold = (layer > 0) ? 0.35 : 0.4; // empiracal dislocation thresholds
 
  
-    // do matching on current layer
+    // do matching on current layer, points are matched independently
+    #pragma omp parallel private(x1, y1, x2, y2, corr, x1n, y1n, x2n, y2n, xdif, ydif, ws) shared(ninit, invalid, init, target, base, nx, ny, w, max_h, cumscale, layerscale, layer, diff_threshold, value_threshold, SAM, j_new, i_new) reduction(+: ntie) default(none)
+    {
+
+    #pragma omp for schedule(dynamic)
     for (n=0; n<ninit; n++){
       
       if (invalid[n]) continue;  // point n have been detected as mismatch
@@ -930,6 +970,8 @@ match_t df;
       init->base.i[n] = y1n;
     }
 
+    }
+
   }
   
 
@@ -1262,21 +1304,33 @@ enum_tranformation_type choose_transform(int ntie){
 }
 
 
-/** Re-register a band (apply transformation to image)
---- transform: transformation type
---- dm:        dense matching tie points
---- target:    image to be registered
---- nx:        columns of image
---- ny:        rows of image
---- nodata:    nodata value
-+++ Return:    registered image
+/** Re-register all bands and the quality band (apply transformation to
++++ images). The transformed coordinates are computed once per row, and
++++ are then used to resample a group of REG_BANDS bands (bilinear) and
++++ the quality band (nearest neighbor). Band groups limit the memory
++++ held by the warped copies.
+--- transform:  transformation type
+--- dm:         dense matching tie points
+--- target:     images to be registered (modified)
+--- nb:         number of bands
+--- qai:        quality band to be registered (modified)
+--- nx:         columns of image
+--- ny:         rows of image
+--- nodata:     nodata value
+--- qai_nodata: nodata value of quality band
++++ Return:     SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-short *register_band(enum_tranformation_type transform, match_t *dm, short *target, int nx, int ny, short nodata){
-int i, j, p_;
-short *warped = NULL;
+int register_bands(enum_tranformation_type transform, match_t *dm, short **target, int nb, short **qai, int nx, int ny, short nodata, short qai_nodata){
+int i, j, b, b0, nb0, k, p, p_;
+short **warped = NULL;
+short *qai_warped = NULL;
+short *image = NULL;
 double di_, dj_;
 int i_, j_;
-float avg, weight, weightsum;
+int *corner = NULL;
+int *nearest = NULL;
+float *weight = NULL;
+float avg, weightsum;
 float dx, dy;
 
 
@@ -1285,147 +1339,121 @@ float dx, dy;
   #endif
 
 
-  // allocate memory for new registered (warped) image
-  alloc((void**)&warped, ny*nx, sizeof(short));
+  alloc((void**)&warped, REG_BANDS, sizeof(short*));
+
+  for (b0=0; b0<nb; b0+=REG_BANDS){
+
+  nb0 = (nb-b0 < REG_BANDS) ? nb-b0 : REG_BANDS;
+
+  // allocate memory for new registered (warped) images
+  for (b=0; b<nb0; b++) alloc((void**)&warped[b], ny*nx, sizeof(short));
+  if (b0 == 0) alloc((void**)&qai_warped, ny*nx, sizeof(short));
 
-  #pragma omp parallel private(j,j_,i_,dj_,di_,dx,dy,p_,weightsum,avg,weight) shared(nx,ny,transform,dm,target,warped,nodata) default(none)
+  #pragma omp parallel private(j, b, k, p, p_, j_, i_, dj_, di_, dx, dy, corner, nearest, weight, avg, weightsum, image) shared(b0, nb0, nx, ny, transform, dm, target, qai, warped, qai_warped, nodata, qai_nodata) default(none)
   {
 
+    // 4 bilinear neighbors per pixel of one row, -1 if outside
+    alloc((void**)&corner,  4*nx, sizeof(int));
+    alloc((void**)&weight,  4*nx, sizeof(float));
+    alloc((void**)&nearest, nx,   sizeof(int));
+
     #pragma omp for
     for (i=0; i<ny; i++){
-    for (j=0; j<nx; j++){
-      
-      GetTransformedCoords((double)j, (double)i, transform, dm->coefs, &dj_, &di_);
-
-      // for bilinear resampling
-      weightsum = 0;
-      avg = 0;
-
-      // top left point
-      j_ = (int)dj_;
-      i_ = (int)di_;
-
-      dx = (float)(dj_ - j_);
-      dy = (float)(di_ - i_);
-      if (j_ >= 0 && j_ < nx && i_ >= 0 && i_ < ny){
-        p_ = i_*nx + j_;
-        if (target[p_] != nodata){
-          weight = (1 - dx)*(1 - dy);
-          avg += target[p_] * weight;
-          weightsum += weight;
-        }
-      }
 
-      // top right point
-      j_ += 1;
-      if (j_ >= 0 && j_ < nx && i_ >= 0 && i_ < ny){
-        p_ = i_*nx + j_;
-        if (target[p_] != nodata){
-          weight = dx*(1 - dy);
-          avg += target[p_] * weight;
-          weightsum += weight;
-        }
-      }
+      // transformed coordinates of this row
+      for (j=0; j<nx; j++){
 
-      // bottom right point
-      i_ += 1;
-      if (j_ >= 0 && j_ < nx && i_ >= 0 && i_ < ny){
-        p_ = i_*nx + j_;
-        if (target[p_] != nodata){
-          weight = dx*dy;
-          avg += target[p_] * weight;
-          weightsum += weight;
-        }
-      }
+        GetTransformedCoords((double)j, (double)i, transform, dm->coefs, &dj_, &di_);
 
-      // bottom left point
-      j_ -= 1;
-      if (j_ >= 0 && j_ < nx && i_ >= 0 && i_ < ny){
-        p_ = i_*nx + j_;
-        if (target[p_] != nodata){
-          weight = (1 - dx)*dy;
-          avg += target[p_] * weight;
-          weightsum += weight;
-        }
-      }
+        // top left point
+        j_ = (int)dj_;
+        i_ = (int)di_;
 
-      if (weightsum > 0){
-        avg /= weightsum;
-        warped[i*nx + j] = (short)(avg + 0.5f);
-      } else {
-        warped[i*nx + j] = nodata;
-      }
+        dx = (float)(dj_ - j_);
+        dy = (float)(di_ - i_);
 
-    }
-    }
-    
-  }
+        // top left, top right, bottom right, bottom left point
+        corner[4*j+0] = (j_   >= 0 && j_   < nx && i_   >= 0 && i_   < ny) ? i_*nx + j_       : -1;
+        corner[4*j+1] = (j_+1 >= 0 && j_+1 < nx && i_   >= 0 && i_   < ny) ? i_*nx + j_+1     : -1;
+        corner[4*j+2] = (j_+1 >= 0 && j_+1 < nx && i_+1 >= 0 && i_+1 < ny) ? (i_+1)*nx + j_+1 : -1;
+        corner[4*j+3] = (j_   >= 0 && j_   < nx && i_+1 >= 0 && i_+1 < ny) ? (i_+1)*nx + j_   : -1;
 
-  free((void*)target);
+        weight[4*j+0] = (1 - dx)*(1 - dy);
+        weight[4*j+1] = dx*(1 - dy);
+        weight[4*j+2] = dx*dy;
+        weight[4*j+3] = (1 - dx)*dy;
 
-  #ifdef FORCE_CLOCK
-  proctime_print("registering band", TIME);
-  #endif
+        // nearest neighbor for quality band
+        j_ = (int)(dj_ + 0.5 + 1e-10);
+        i_ = (int)(di_ + 0.5 + 1e-10);
+        nearest[j] = (j_ >= 0 && j_ < nx && i_ >= 0 && i_ < ny) ? i_*nx + j_ : -1;
 
-  return warped;
-}
+      }
 
+      // bilinear resampling of band group
+      for (b=0; b<nb0; b++){
 
-/** Re-register the quality band (apply transformation to image, 
-+++ using NN resampling)
---- transform: transformation type
---- dm:        dense matching tie points
---- image:     image to be registered
---- nx:        columns of image
---- ny:        rows of image
---- nodata:    nodata value
-+++ Return:    registered image
-+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-short *register_quality(enum_tranformation_type transform, match_t *dm, short *image, int nx, int ny, short nodata){
-int i, j, p_;
-short *warped = NULL;
-double di_, dj_;
-int i_, j_;
+        image = target[b0+b];
 
+        for (j=0, p=i*nx; j<nx; j++, p++){
 
-  #ifdef FORCE_CLOCK 
-  time_t TIME; time(&TIME);
-  #endif
+          weightsum = 0;
+          avg = 0;
 
+          for (k=0; k<4; k++){
+            if ((p_ = corner[4*j+k]) < 0 || image[p_] == nodata) continue;
+            avg += image[p_] * weight[4*j+k];
+            weightsum += weight[4*j+k];
+          }
 
-  // allocate memory for new registered (warped) image
-  alloc((void**)&warped, ny*nx, sizeof(short));
+          if (weightsum > 0){
+            avg /= weightsum;
+            warped[b][p] = (short)(avg + 0.5f);
+          } else {
+            warped[b][p] = nodata;
+          }
 
-  #pragma omp parallel private(j,j_,i_,dj_,di_,p_) shared(nx,ny,transform,dm,image,warped,nodata) default(none)
-  {
+        }
 
-    #pragma omp for
-    for (i=0; i<ny; i++){
-    for (j=0; j<nx; j++){
-      
-      GetTransformedCoords((double)j, (double)i, transform, dm->coefs, &dj_, &di_);
-    
-      j_ = (int)(dj_ + 0.5 + 1e-10);
-      i_ = (int)(di_ + 0.5 + 1e-10);
-      if (j_ >= 0 && j_ < nx && i_ >= 0 && i_ < ny){
-        p_ = i_*nx + j_;
-        warped[i*nx + j] = image[p_];
-      } else {
-        warped[i*nx + j] = nodata;
       }
-    
-    }
+
+      // nearest neighbor resampling of quality band
+      if (b0 == 0){
+      for (j=0, p=i*nx; j<nx; j++, p++){
+        if ((p_ = nearest[j]) >= 0){
+          qai_warped[p] = (*qai)[p_];
+        } else {
+          qai_warped[p] = qai_nodata;
+        }
+      }
+      }
+
     }
-  
+
+    free((void*)corner);
+    free((void*)weight);
+    free((void*)nearest);
+
+  }
+
+
+  for (b=0; b<nb0; b++){
+    free((void*)target[b0+b]);
+    target[b0+b] = warped[b];
+  }
+
   }
 
-  free((void*)image);
+  free((void*)warped);
+
+  free((void*)(*qai));
+  *qai = qai_warped;
 
   #ifdef FORCE_CLOCK
-  proctime_print("registering quality", TIME);
+  proctime_print("registering bands", TIME);
   #endif
 
-  return warped;
+  return SUCCESS;
 }
 
 
@@ -1596,13 +1624,187 @@ match_t dm;
 }
 
 
+/** This function compiles the key of the base image cache, i.e. the base
++++ image file, its band, and the target grid
+--- pl2:    L2 parameters
+--- fbase:  base image file
+--- band:   band of base image
+--- BASE:   base image (target grid)
+--- key:    cache key (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void key_base_cache(par_ll_t *pl2, const char *fbase, int band, brick_t *BASE, base_cache_t *key){
+
+
+  memset(key, 0, sizeof(base_cache_t));
+  copy_string(key->fbase, NPOW_10, fbase);
+  key->band = band;
+  get_brick_proj(BASE, key->proj, NPOW_10);
+  get_brick_geotran(BASE, key->geotran, 6);
+  key->nx = get_brick_ncols(BASE);
+  key->ny = get_brick_nrows(BASE);
+  key->nodata = pl2->coreg_nodata;
+
+  return;
+}
+
+
+/** This function compiles the filename of a base image in the on-disc 
++++ cache. The filename is a hash of the cache key.
+--- pl2:    L2 parameters
+--- key:    cache key
+--- fname:  filename (returned)
+--- size:   length of filename buffer
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void file_base_cache(par_ll_t *pl2, base_cache_t *key, char fname[], int size){
+unsigned long hash = 14695981039346656037UL;
+unsigned char *byte = (unsigned char*)key;
+size_t i, n = offsetof(base_cache_t, base);
+int nchar;
+
+
+  for (i=0; i<n; i++) hash = (hash ^ byte[i]) * 1099511628211UL;
+
+  nchar = snprintf(fname, size, "%s/BASE-%016lx.dat", pl2->d_coregcache, hash);
+  if (nchar < 0 || nchar >= size){ 
+    printf("Buffer Overflow in assembling filename\n"); fname[0] = '\0';}
+
+  return;
+}
+
+
+/** This function retrieves a warped base image from the cache. The in-
++++ memory cache is searched first, then the on-disc cache (if given). The
++++ on-disc file starts with the cache key, which must match.
+--- pl2:    L2 parameters
+--- fbase:  base image file
+--- band:   band of base image
+--- BASE:   base image (filled if found)
++++ Return: true if found, false if not
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool read_base_cache(par_ll_t *pl2, const char *fbase, int band, brick_t *BASE){
+base_cache_t key, file_key;
+char fname[NPOW_10];
+short *base_ = NULL;
+size_t n = offsetof(base_cache_t, base);
+FILE *fp = NULL;
+int k, nc;
+bool found = false;
+
+
+  key_base_cache(pl2, fbase, band, BASE, &key);
+  nc = key.nx*key.ny;
+  if ((base_ = get_band_short(BASE, 0)) == NULL) return false;
+
+  for (k=0; k<COREG_CACHE; k++){
+    if (_BASECACHE_[k].base != NULL && memcmp(&_BASECACHE_[k], &key, n) == 0){
+      memcpy(base_, _BASECACHE_[k].base, nc*sizeof(short));
+      _BASECACHE_[k].used = ++_BASECACHE_USE_;
+      return true;
+    }
+  }
+
+  if (strcmp(pl2->d_coregcache, "NULL") == 0) return false;
+
+  file_base_cache(pl2, &key, fname, NPOW_10);
+  if ((fp = fopen(fname, "rb")) == NULL) return false;
+
+  memset(&file_key, 0, sizeof(base_cache_t));
+  if (fread(&file_key, 1, n, fp) == n && memcmp(&file_key, &key, n) == 0 &&
+      fread(base_, sizeof(short), nc, fp) == (size_t)nc) found = true;
+
+  fclose(fp);
+
+  // keep in memory for the next images on this grid
+  if (found) write_base_cache(pl2, fbase, band, BASE);
+
+  return found;
+}
+
+
+/** This function stores a warped base image in the cache. In memory, the
++++ least recently used image is replaced. On disc (if given), the file 
++++ is written to a temporary name first, and then renamed, such that con-
++++ current processes never read incomplete files. Existing files are not
++++ written again.
+--- pl2:    L2 parameters
+--- fbase:  base image file
+--- band:   band of base image
+--- BASE:   base image
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void write_base_cache(par_ll_t *pl2, const char *fbase, int band, brick_t *BASE){
+base_cache_t key;
+char fname[NPOW_10];
+char ftemp[NPOW_10];
+short *base_ = NULL;
+size_t n = offsetof(base_cache_t, base);
+FILE *fp = NULL;
+int k, kmin = 0, nc, nchar;
+
+
+  key_base_cache(pl2, fbase, band, BASE, &key);
+  nc = key.nx*key.ny;
+  if ((base_ = get_band_short(BASE, 0)) == NULL) return;
+
+  for (k=1; k<COREG_CACHE; k++){
+    if (_BASECACHE_[k].used < _BASECACHE_[kmin].used) kmin = k;
+  }
+
+  if (_BASECACHE_[kmin].base != NULL) free((void*)_BASECACHE_[kmin].base);
+  key.used = ++_BASECACHE_USE_;
+  alloc((void**)&key.base, nc, sizeof(short));
+  memcpy(key.base, base_, nc*sizeof(short));
+  memcpy(&_BASECACHE_[kmin], &key, sizeof(base_cache_t));
+
+  if (strcmp(pl2->d_coregcache, "NULL") == 0) return;
+
+  file_base_cache(pl2, &key, fname, NPOW_10);
+  if (fileexist(fname)) return;
+
+  nchar = snprintf(ftemp, NPOW_10, "%s.%d", fname, (int)getpid());
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return;}
+
+  if ((fp = fopen(ftemp, "wb")) == NULL) return;
+
+  if (fwrite(&key, 1, n, fp) != n ||
+      fwrite(base_, sizeof(short), nc, fp) != (size_t)nc){
+    fclose(fp); remove(ftemp); return;}
+
+  fclose(fp);
+
+  if (rename(ftemp, fname) != 0) remove(ftemp);
+
+  return;
+}
+
+
 /** public functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
 
+/** This function frees the base image cache
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_base_cache(){
+int k;
+
+  for (k=0; k<COREG_CACHE; k++){
+    if (_BASECACHE_[k].base != NULL) free((void*)_BASECACHE_[k].base);
+    _BASECACHE_[k].base = NULL;
+  }
+
+  return;
+}
+
+
+
 /** This function is the public interface to the LSReg coregistration.
 +++ Only Sentinel-2 images will be co-registered. The tie point detection
-+++ is performed on the NIR band.
++++ is performed on the NIR band. The warped base image is cached, and re-
++++ used by images on the same grid (e.g. the same MGRS tile).
 --- mission: mission ID
 --- pl2:     L2 parameters
 --- meta:    metadata
@@ -1672,8 +1874,11 @@ int success = FAILURE;
 
 
   BASE = copy_brick(TOA, 1, _DT_SHORT_);
-  if ((warp_from_disc_to_known_brick(2, pl2->nthread, fname, BASE, month-1, 0, pl2->coreg_nodata)) != SUCCESS){
-    printf("Warping base failed! "); return FAILURE;}
+  if (!read_base_cache(pl2, fname, month-1, BASE)){
+    if ((warp_from_disc_to_known_brick(2, pl2->nthread, fname, BASE, month-1, 0, pl2->coreg_nodata)) != SUCCESS){
+      printf("Warping base failed! "); return FAILURE;}
+    write_base_cache(pl2, fname, month-1, BASE);
+  }
   if ((base = get_band_short(BASE, 0)) == NULL) return FAILURE;
   
   
@@ -42,6 +42,21 @@ Coregistration header
 extern "C" {
 #endif
 
+// number of warped base images that are kept in memory
+#define COREG_CACHE 2
+
+typedef struct {
+  char   fbase[NPOW_10]; // base image file
+  int    band;           // band of base image (month)
+  char   proj[NPOW_10];  // projection of target grid
+  double geotran[6];     // geotransformation of target grid
+  int    nx, ny;         // dimensions of target grid
+  int    nodata;         // base image nodata
+  short *base;           // warped base image
+  long   used;           // last use (for replacement)
+} base_cache_t;
+
+void free_base_cache();
 int coregister(int mission, par_ll_t *pl2, brick_t *TOA, brick_t *QAI);
 
 #ifdef __cplusplus
@@ -45,6 +45,7 @@ This file contains functions for supporting coregistration
 #define ABS(x)        ((x>=0)? (x):-(x))
 #define MAX(a,b) (((a)>(b))? (a) : (b))
 #define MIN(a,b) (((a)<(b))? (a) : (b))
+#define CONV_ROWS (32) // number of output rows per chunk of the separable convolution
 
 
 /** public functions
@@ -903,191 +904,121 @@ double dRef = -0.5 / pow(dSigma, 2);
 }
 
 
+/** This function filters an image with a Gaussian and evaluates every 
++++ step-th pixel in both dimensions. Nodata pixels are excluded, and the
++++ filter is re-normalized. The Gaussian is separable, thus the image is
++++ filtered row-wise first (at the evaluated columns only), followed by 
++++ a column-wise pass (at the evaluated rows only). Horizontally filtered
++++ rows are kept in a ring buffer of w rows per thread, and every thread
++++ works on chunks of CONV_ROWS output rows.
+--- pImg:    image
+--- pImgNew: filtered image (returned, zero if not evaluated)
+--- iWidth:  number of columns
+--- iHeight: number of rows
+--- nodata:  nodata value
+--- dFilter: 2D Gaussian filter (see GetGaussian)
+--- w:       filter width
+--- step:    step between evaluated pixels
++++ Return:  void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void Conv2same(short *pImg, short *pImgNew, int iWidth, int iHeight, short nodata, float* dFilter, int w, int step){
-int    h, start;
-float  dCurSum, fsum;
-int    i, j, k, l;
-int k1, k2, l1, l2;
+int    h, nxo, nyo, nchunk;
+int    c, io, jo, i, j, k, l, l1, l2, y, ynext;
+float  dCurSum, fsum, m;
+float  *g = NULL;
+float  *num = NULL, *den = NULL;
+
 
   h = (w - 1) / 2;
-  start = step;
-  while (start < h) start += step;
 
-  
   memset(pImgNew, 0, iWidth*iHeight*sizeof(short));
 
+  // 1D filter, center row of 2D filter
+  g = (float *)malloc(w*sizeof(float));
+  for (l=0; l<w; l++) g[l] = dFilter[h*w + l];
 
-  #pragma omp parallel private(j,dCurSum,fsum,k,l) shared(start,step,iHeight,iWidth,pImg,pImgNew,nodata,w,h,dFilter) default(none)
-  {
+  nxo = (iWidth  - 1) / step + 1;
+  nyo = (iHeight - 1) / step + 1;
+  nchunk = (nyo - 1) / CONV_ROWS + 1;
 
-    #pragma omp for
-    for (i=start; i<iHeight-h; i+=step){ // old: for (i = 0; i <= iHeight - w; i++)
-    for (j=start; j<iWidth -h; j+=step){ // old: for (j = 0; j <= iWidth - w; j++)
 
-      if (pImg[i*iWidth + j] == nodata) continue;
-
-      dCurSum = 0;
-      fsum = 0;
-      for (k=0; k<w; k++){
-      for (l=0; l<w; l++){
-        if (pImg[(i + k - h)*iWidth + (j + l - h)] == nodata) continue;
-        dCurSum += pImg[(i + k - h)*iWidth + (j + l - h)] * dFilter[k*w + l];  // old: dCurSum += pImg[(i + k)*iWidth + (j + l)] * dFilter[k*w + l];
-        fsum += dFilter[k*w + l];
-      }
-      }
-
-      if (ABS(fsum) < 1e-10) continue;
+  #pragma omp parallel private(io,jo,i,j,k,l,l1,l2,y,ynext,dCurSum,fsum,m,num,den) shared(nchunk,nxo,nyo,step,iHeight,iWidth,pImg,pImgNew,nodata,w,h,g) default(none)
+  {
 
-      dCurSum /= fsum;
-      pImgNew[i*iWidth + j] = (short)(dCurSum + 1e-10);
+    num = (float *)calloc(w*nxo, sizeof(float));
+    den = (float *)calloc(w*nxo, sizeof(float));
 
-    }
-    }
-    
-  }
+    #pragma omp for schedule(static)
+    for (c=0; c<nchunk; c++){
 
+      // next input row to be filtered horizontally
+      ynext = c*CONV_ROWS*step - h;
 
-  // Upper part
-  #pragma omp parallel private(i,dCurSum,fsum,k,l,k1,k2,l1,l2) shared(step,iHeight,iWidth,pImg,pImgNew,nodata,w,h,dFilter) default(none)
-  {
+      for (io=c*CONV_ROWS; io<nyo && io<(c+1)*CONV_ROWS; io++){
 
-    #pragma omp for
-    for (j=0; j<iWidth; j+=step){
-    for (i=0; i<h;      i+=step){
+        i = io*step;
 
-      if (pImg[i*iWidth + j] == nodata) continue;
+        // horizontal pass for all rows up to i+h
+        for (; ynext<=i+h; ynext++){
 
-      dCurSum = 0;
-      fsum = 0;
-      k1 = (h - i)>0 ? (h - i) : 0;
-      k2 = (iHeight - i)<w ? (iHeight - i) : w;
-      l1 = (h - j)>0 ? (h - j) : 0;
-      l2 = (iWidth - j)<w ? (iWidth - j) : w;
-      for (k=k1; k<k2; k++){
-      for (l=l1; l<l2; l++){
-        if (pImg[(i + k - h)*iWidth + (j + l - h)] == nodata) continue;
-        dCurSum += pImg[(i + k - h)*iWidth + (j + l - h)] * dFilter[k*w + l];
-        fsum += dFilter[k*w + l];
-      }
-      }
-      if (ABS(fsum) < 1e-10) continue;
+          if (ynext < 0 || ynext >= iHeight) continue;
 
-      dCurSum /= fsum;
-      pImgNew[i*iWidth + j] = (short)(dCurSum + 1e-10);
+          y = ynext % w;
 
-    }
-    }
-    
-  }
-  
+          for (jo=0; jo<nxo; jo++){
 
-  start = iHeight - h;
-  while (fmod(start, step) != 0) start++;
-  
-  // lower part
-  #pragma omp parallel private(i,dCurSum,fsum,k,l,k1,k2,l1,l2) shared(start,step,iHeight,iWidth,pImg,pImgNew,nodata,w,h,dFilter) default(none)
-  {
+            j = jo*step;
 
-    #pragma omp for
-    for (j=0;     j<iWidth;  j+=step){
-    for (i=start; i<iHeight; i+=step){
+            l1 = (h - j)>0 ? (h - j) : 0;
+            l2 = (iWidth - j + h)<w ? (iWidth - j + h) : w;
 
-      if (pImg[i*iWidth + j] == nodata) continue;
+            dCurSum = 0;
+            fsum = 0;
+            for (l=l1; l<l2; l++){
+              m = (pImg[ynext*iWidth + (j + l - h)] != nodata);
+              dCurSum += pImg[ynext*iWidth + (j + l - h)] * g[l] * m;
+              fsum += g[l] * m;
+            }
 
-      dCurSum = 0;
-      fsum = 0;
-      k1 = (h - i)>0 ? (h - i) : 0;
-      k2 = (iHeight - i)<w ? (iHeight - i) : w;
-      l1 = (h - j)>0 ? (h - j) : 0;
-      l2 = (iWidth - j)<w ? (iWidth - j) : w;
-      for (k = k1; k<k2; k++){
-      for (l = l1; l<l2; l++){
-        if (pImg[(i + k - h)*iWidth + (j + l - h)] == nodata) continue;
-        dCurSum += pImg[(i + k - h)*iWidth + (j + l - h)] * dFilter[k*w + l];
-        fsum += dFilter[k*w + l];
-      }
-      }
-      if (ABS(fsum) < 1e-10) continue;
+            num[y*nxo + jo] = dCurSum;
+            den[y*nxo + jo] = fsum;
 
-      dCurSum /= fsum;
-      pImgNew[i*iWidth + j] = (short)(dCurSum + 1e-10);
+          }
 
-    }
-    }
-  
-  }
-  
-  
-  // left part
-  #pragma omp parallel private(j,dCurSum,fsum,k,l,k1,k2,l1,l2) shared(start,step,iHeight,iWidth,pImg,pImgNew,nodata,w,h,dFilter) default(none)
-  {
+        }
 
-    #pragma omp for
-    for (i=0; i<iHeight; i+=step){
-    for (j=0; j<h;       j+=step){
+        // vertical pass
+        for (jo=0; jo<nxo; jo++){
 
-      if (pImg[i*iWidth + j] == nodata) continue;
+          j = jo*step;
 
-      dCurSum = 0;
-      fsum = 0;
-      k1 = (h - i)>0 ? (h - i) : 0;
-      k2 = (iHeight - i)<w ? (iHeight - i) : w;
-      l1 = (h - j)>0 ? (h - j) : 0;
-      l2 = (iWidth - j)<w ? (iWidth - j) : w;
-      for (k=k1; k<k2; k++){
-      for (l=l1; l<l2; l++){
-        if (pImg[(i + k - h)*iWidth + (j + l - h)] == nodata) continue;
-        dCurSum += pImg[(i + k - h)*iWidth + (j + l - h)] * dFilter[k*w + l];
-        fsum += dFilter[k*w + l];
-      }
-      }
-      if (ABS(fsum) < 1e-10) continue;
+          if (pImg[i*iWidth + j] == nodata) continue;
 
-      dCurSum /= fsum;
-      pImgNew[i*iWidth + j] = (short)(dCurSum + 1e-10);
+          dCurSum = 0;
+          fsum = 0;
+          for (k=0; k<w; k++){
+            if ((y = i + k - h) < 0 || y >= iHeight) continue;
+            dCurSum += num[(y % w)*nxo + jo] * g[k];
+            fsum    += den[(y % w)*nxo + jo] * g[k];
+          }
 
-    }
-    }
-  
-  }
-  
+          if (ABS(fsum) < 1e-10) continue;
 
-  start = iWidth - h;
-  while (fmod(start, step) != 0) start++;
-  
-  // right part
-  #pragma omp parallel private(j,dCurSum,fsum,k,l,k1,k2,l1,l2) shared(start,step,iHeight,iWidth,pImg,pImgNew,nodata,w,h,dFilter) default(none)
-  {
+          dCurSum /= fsum;
+          pImgNew[i*iWidth + j] = (short)(dCurSum + 1e-10);
 
-    #pragma omp for
-    for (i=0;     i<iHeight; i+=step){
-    for (j=start; j<iWidth;  j+=step){
-      
-      if (pImg[i*iWidth + j] == nodata) continue;
+        }
 
-      dCurSum = 0;
-      fsum = 0;
-      k1 = (h - i)>0 ? (h - i) : 0;
-      k2 = (iHeight - i)<w ? (iHeight - i) : w;
-      l1 = (h - j)>0 ? (h - j) : 0;
-      l2 = (iWidth - j)<w ? (iWidth - j) : w;
-      for (k=k1; k<k2; k++){
-      for (l=l1; l<l2; l++){
-        if (pImg[(i + k - h)*iWidth + (j + l - h)] == nodata) continue;
-        dCurSum += pImg[(i + k - h)*iWidth + (j + l - h)] * dFilter[k*w + l];
-        fsum += dFilter[k*w + l];
       }
-      }
-      if (ABS(fsum) < 1e-10) continue;
 
-      dCurSum /= fsum;
-      pImgNew[i*iWidth + j] = (short)(dCurSum + 1e-10);
-      
-    }
     }
-    
+
+    free(num);
+    free(den);
+
   }
-  
+
+  free(g);
 
   return;
 }
@@ -28,13 +28,43 @@ This file contains functions that define the datacubes
 #include "cube-ll.h"
 
 
+int write_level2(par_ll_t *pl2, brick_t *brick);
 int tile_level2(par_ll_t *pl2, cube_t *cube, brick_t **LEVEL2, int nprod);
 int flush_level2(par_ll_t *pl2, meta_t *meta, brick_t **LEVEL2, int nprod);
 multicube_t *start_datacube(par_ll_t *pl2, brick_t *brick);
 
 
+/** This function writes a L2 product, and optionally a copy in the FORCE
++++ chunk format
+--- pl2:    L2 parameters
+--- brick:  L2 product
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int write_level2(par_ll_t *pl2, brick_t *brick){
+gdalopt_t format, fcf;
+int err = 0;
+
+
+  if (write_brick(brick) == FAILURE) return FAILURE;
+
+  if (!pl2->ofcf || pl2->format == _FMT_FCF_) return SUCCESS;
+
+  format = get_brick_format(brick);
+  default_gdaloptions(_FMT_FCF_, &fcf);
+
+  set_brick_format(brick, &fcf);
+  if (write_brick(brick) == FAILURE) err++;
+  set_brick_format(brick, &format);
+
+  if (err > 0) return FAILURE; else return SUCCESS;
+}
+
+
 /** This function tiles the image, computes tile cloud coverage and writes
-+++ gridded images to disc.
++++ gridded images to disc. Tiles that do not intersect the footprint of
++++ valid data are skipped beforehand, the remaining tiles are processed 
++++ in parallel (each thread has its own chips, write_brick locks the 
++++ output files).
 --- pl2:    L2 parameters
 --- cube:   data cube parameters
 --- LEVEL2: L2 brick
@@ -50,10 +80,14 @@ int tx, ty;  // tile id
 double tulx, tuly; // ul of tile
 double ulx, uly; // ul of image
 int istart, jstart; // image-to-chip offset
+int j0, j1; // chip columns that intersect the image
 int ntile = 0; // number of written tiles
-int *tiles_x = NULL;
-int *tiles_y = NULL;
-int  tiles_k;
+tile_list_t tiles;
+int *todo_x = NULL; // tiles that intersect the data footprint
+int *todo_y = NULL;
+int  ntodo = 0, t;
+int imin, imax, jmin, jmax; // footprint of valid data
+int nthread;
 int err = 0;
 bool empty;
 short nodata;
@@ -71,144 +105,219 @@ int cube_nx, cube_ny, cube_nc;
 
   
   // get tile file and read it
-  if (tile_readlist(pl2->f_tile, &tiles_x, &tiles_y, &tiles_k) != SUCCESS){
+  if (tile_readlist(pl2->f_tile, &tiles) != SUCCESS){
     printf("Reading tile file failed! "); return FAILURE;}
 
   // get dataset information
   get_brick_geotran(LEVEL2[0], geotran, 6);
   ulx = get_brick_ulx(LEVEL2[0]);
   uly = get_brick_uly(LEVEL2[0]);
-  
+  nx  = get_brick_ncols(LEVEL2[0]);
+  ny  = get_brick_nrows(LEVEL2[0]);
+  res = get_brick_res(LEVEL2[0]);
+
 
+  // footprint of valid data in the first product (QAI)
+  imin = ny; imax = -1;
+  jmin = nx; jmax = -1;
 
-  // intersect the image with the tile grid
+  #pragma omp parallel private(j, p) shared(nx, ny, LEVEL2) reduction(min: imin, jmin) reduction(max: imax, jmax) default(none)
+  {
 
-  // initialize smaller cubed products
-  alloc((void**)&CUBED, nprod, sizeof(brick_t*));
+    #pragma omp for schedule(static)
+    for (i=0; i<ny; i++){
+    for (j=0; j<nx; j++){
+
+      p = i*nx+j;
+      if (get_off(LEVEL2[0], p)) continue;
+
+      if (i < imin) imin = i;
+      if (i > imax) imax = i;
+      if (j < jmin) jmin = j;
+      if (j > jmax) jmax = j;
+
+    }
+    }
 
-  for (prod=0; prod<(nprod); prod++){
-    nb = get_brick_nbands(LEVEL2[prod]);
-    res = get_brick_res(LEVEL2[prod]);
-    scale = cube->res/res;
-    CUBED[prod] = copy_brick(LEVEL2[prod], nb, _DT_NONE_);
-    set_brick_geotran(CUBED[prod], geotran);
-    set_brick_ncols(CUBED[prod], (int)(cube->nx*scale));
-    set_brick_nrows(CUBED[prod], (int)(cube->ny*scale));
-    set_brick_chunkncols(CUBED[prod], (int)(cube->cx*scale));
-    set_brick_chunknrows(CUBED[prod], (int)(cube->cy*scale));
-    allocate_brick_bands(CUBED[prod], nb, (int)(cube->nc*scale), _DT_SHORT_);
   }
 
 
-//    #pragma omp for collapse(2) schedule(guided)
+  // intersect the image footprint with the tile grid
+  scale = cube->res/res;
+  cube_nx = (int)(cube->nx*scale);
+  cube_ny = (int)(cube->ny*scale);
+
+  alloc((void**)&todo_x, (cube->tmaxx-cube->tminx+1)*(cube->tmaxy-cube->tminy+1), sizeof(int));
+  alloc((void**)&todo_y, (cube->tmaxx-cube->tminx+1)*(cube->tmaxy-cube->tminy+1), sizeof(int));
+
   for (ty=cube->tminy; ty<=cube->tmaxy; ty++){
   for (tx=cube->tminx; tx<=cube->tmaxx; tx++){
 
     // if tile is not allowlisted (if specified), skip
-    if (tile_allowlisted(tiles_x, tiles_y, tiles_k, tx, ty) == FAILURE) continue;
+    if (tile_allowlisted(&tiles, tx, ty) == FAILURE) continue;
 
     // upper left coordinate of current tile
     tulx = cube->origin_map.x + tx*cube->tilesize;
     tuly = cube->origin_map.y - ty*cube->tilesize;
 
-    
-    empty = true;
-    ndata = ncld = 0.0;
+    // image offset relative to current tile
+    jstart = floor((tulx-ulx)/res);
+    istart = floor((uly-tuly)/res);
 
-    // copy to cubed products
-    for (prod=0; prod<nprod; prod++){
-      
-      if (prod > 0 && empty) break;
+    // if no valid data in tile, skip
+    if (istart > imax || istart+cube_ny-1 < imin ||
+        jstart > jmax || jstart+cube_nx-1 < jmin) continue;
+
+    todo_x[ntodo] = tx;
+    todo_y[ntodo] = ty;
+    ntodo++;
+
+  }
+  }
 
+  nthread = (pl2->nthread < ntodo) ? pl2->nthread : ntodo;
+  if (nthread < 1) nthread = 1;
+
+
+  #pragma omp parallel num_threads(nthread) private(t, tx, ty, tulx, tuly, i, j, p, np, nx, ny, b, nb, prod, res, scale, cube_nx, cube_ny, cube_nc, istart, jstart, j0, j1, nodata, empty, ndata, ncld, level2_, cubed_, CUBED, dname, nchar) firstprivate(geotran) shared(pl2, cube, LEVEL2, nprod, ulx, uly, ntodo, todo_x, todo_y) reduction(+: err, ntile) default(none)
+  {
+
+    // initialize smaller cubed products
+    alloc((void**)&CUBED, nprod, sizeof(brick_t*));
+
+    for (prod=0; prod<(nprod); prod++){
       nb = get_brick_nbands(LEVEL2[prod]);
-      nx  = get_brick_ncols(LEVEL2[prod]);
-      ny  = get_brick_nrows(LEVEL2[prod]);
       res = get_brick_res(LEVEL2[prod]);
       scale = cube->res/res;
-      cube_nx = (int)(cube->nx*scale);
-      cube_ny = (int)(cube->ny*scale);
-      cube_nc = (int)(cube->nc*scale);
+      CUBED[prod] = copy_brick(LEVEL2[prod], nb, _DT_NONE_);
+      set_brick_geotran(CUBED[prod], geotran);
+      set_brick_ncols(CUBED[prod], (int)(cube->nx*scale));
+      set_brick_nrows(CUBED[prod], (int)(cube->ny*scale));
+      set_brick_chunkncols(CUBED[prod], (int)(cube->cx*scale));
+      set_brick_chunknrows(CUBED[prod], (int)(cube->cy*scale));
+      allocate_brick_bands(CUBED[prod], nb, (int)(cube->nc*scale), _DT_SHORT_);
+    }
+
+
+    #pragma omp for schedule(dynamic,1)
+    for (t=0; t<ntodo; t++){
+
+      tx = todo_x[t];
+      ty = todo_y[t];
+
+      // upper left coordinate of current tile
+      tulx = cube->origin_map.x + tx*cube->tilesize;
+      tuly = cube->origin_map.y - ty*cube->tilesize;
 
-      // image offset relative to current tile
-      jstart = floor((tulx-ulx)/res); // changed from round to floor
-      istart = floor((uly-tuly)/res); // changed from round to floor
-      
-      #ifdef FORCE_DEBUG
-      printf("ul: %f/%f, offset: %d/%d\n", tulx, tuly, jstart, istart);
-      #endif
       
-      if ((level2_ = get_bands_short(LEVEL2[prod])) == NULL){ err++; continue;}
-      if ((cubed_  = get_bands_short(CUBED[prod]))  == NULL){ err++; continue;}
+      empty = true;
+      ndata = ncld = 0.0;
+
+      // copy to cubed products
+      for (prod=0; prod<nprod; prod++){
+        
+        if (prod > 0 && empty) break;
+
+        nb = get_brick_nbands(LEVEL2[prod]);
+        nx  = get_brick_ncols(LEVEL2[prod]);
+        ny  = get_brick_nrows(LEVEL2[prod]);
+        res = get_brick_res(LEVEL2[prod]);
+        scale = cube->res/res;
+        cube_nx = (int)(cube->nx*scale);
+        cube_ny = (int)(cube->ny*scale);
+        cube_nc = (int)(cube->nc*scale);
+
+        // image offset relative to current tile
+        jstart = floor((tulx-ulx)/res); // changed from round to floor
+        istart = floor((uly-tuly)/res); // changed from round to floor
+
+        // chip columns that intersect the image
+        j0 = (jstart < 0) ? -jstart : 0;
+        j1 = (nx-jstart < cube_nx) ? nx-jstart : cube_nx;
+        
+        #ifdef FORCE_DEBUG
+        printf("ul: %f/%f, offset: %d/%d\n", tulx, tuly, jstart, istart);
+        #endif
+        
+        if ((level2_ = get_bands_short(LEVEL2[prod])) == NULL){ err++; continue;}
+        if ((cubed_  = get_bands_short(CUBED[prod]))  == NULL){ err++; continue;}
+
+        // init with nodata
+        for (b=0; b<nb; b++){
+          nodata = get_brick_nodata(LEVEL2[prod], b);
+          for (p=0; p<cube_nc; p++) cubed_[b][p] = nodata;
+        }
 
-      // init with nodata
-      for (b=0; b<nb; b++){
-        nodata = get_brick_nodata(LEVEL2[prod], b);
-        for (p=0; p<cube_nc; p++) cubed_[b][p] = nodata;
-      }
+        if (j1 <= j0) continue;
 
-      // copy image to chip + compute tile cloud cover
-      for (i=0, p=0; i<cube_ny; i++){
-      for (j=0; j<cube_nx; j++, p++){
+        // copy image to chip, row by row
+        for (i=0; i<cube_ny; i++){
 
-        np  = nx*(i+istart) + j+jstart; // image
-        p = cube_nx*i+j;               // chip
+          if (i+istart < 0 || i+istart >= ny) continue;
 
-        if (i+istart < 0 || i+istart >= ny || 
-            j+jstart < 0 || j+jstart >= nx) continue;
+          np = nx*(i+istart) + j0+jstart; // image
+          p  = cube_nx*i+j0;              // chip
 
-        for (b=0; b<nb; b++) cubed_[b][p] = level2_[b][np];
+          for (b=0; b<nb; b++) memcpy(cubed_[b]+p, level2_[b]+np, (j1-j0)*sizeof(short));
 
-        // count valid and cloudy pixels
-        if (prod == 0){
+          // count valid and cloudy pixels
+          if (prod == 0){
 
-          if (get_off(CUBED[prod], p)) continue;
-          
-          if (get_cloud(CUBED[prod], p) > 0 || get_shadow(CUBED[prod], p)) ncld++;
-          ndata++;
-          empty = false;
+            for (j=j0; j<j1; j++, p++){
 
-        }
+              if (get_off(CUBED[prod], p)) continue;
+              
+              if (get_cloud(CUBED[prod], p) > 0 || get_shadow(CUBED[prod], p)) ncld++;
+              ndata++;
+              empty = false;
 
+            }
+
+          }
+
+        }
+        
       }
-      }
-      
-    }
 
 
-    // meteor cover of tile
-    if (ndata > 0) ncld = ncld/ndata*100.0;
+      // meteor cover of tile
+      if (ndata > 0) ncld = ncld/ndata*100.0;
 
 
-    #ifdef FORCE_DEBUG
-    printf("tile X%04d_Y%04d: empty: %d, cloud cover: %03.0f%%\n", 
-      tx, ty, empty, ncld);
-    #endif
+      #ifdef FORCE_DEBUG
+      printf("tile X%04d_Y%04d: empty: %d, cloud cover: %03.0f%%\n", 
+        tx, ty, empty, ncld);
+      #endif
 
-    if (ncld > pl2->maxtc) empty = true;
+      if (ncld > pl2->maxtc) empty = true;
 
 
-    // if there are data in tile -> output
-    if (!empty){
+      // if there are data in tile -> output
+      if (!empty){
 
-      geotran[0] = tulx;
-      geotran[3] = tuly;
+        geotran[0] = tulx;
+        geotran[3] = tuly;
 
-      nchar = snprintf(dname, NPOW_10, "%s/X%04d_Y%04d", cube->dname, tx, ty);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling dirname\n"); return FAILURE;}
+        nchar = snprintf(dname, NPOW_10, "%s/X%04d_Y%04d", cube->dname, tx, ty);
+        if (nchar < 0 || nchar >= NPOW_10){ 
+          printf("Buffer Overflow in assembling dirname\n"); err++; continue;}
 
-      for (prod=0; prod<(nprod); prod++){
-        set_brick_geotran(CUBED[prod], geotran);
-        set_brick_parentname(CUBED[prod], cube->dname);
-        set_brick_dirname(CUBED[prod], dname);
-        if (write_brick(CUBED[prod]) == FAILURE){ err++; continue;}
-      }
+        for (prod=0; prod<(nprod); prod++){
+          set_brick_geotran(CUBED[prod], geotran);
+          set_brick_parentname(CUBED[prod], cube->dname);
+          set_brick_dirname(CUBED[prod], dname);
+          if (write_level2(pl2, CUBED[prod]) == FAILURE){ err++; continue;}
+        }
+
+        ntile++;
 
-      ntile++;
+      }
 
     }
 
-  }
+    for (prod=0; prod<nprod; prod++) free_brick(CUBED[prod]);
+    free((void*)CUBED);
+
   }
   
 
@@ -219,9 +328,8 @@ int cube_nx, cube_ny, cube_nc;
   printf("%2d product(s) written. ", ntile);
 
   // clean
-  free((void*)tiles_x); free((void*)tiles_y);
-  for (prod=0; prod<nprod; prod++) free_brick(CUBED[prod]);
-  free((void*)CUBED);
+  tile_freelist(&tiles);
+  free((void*)todo_x);  free((void*)todo_y);
 
 
   #ifdef FORCE_CLOCK
@@ -257,7 +365,7 @@ int nchar;
   for (prod=0; prod<nprod; prod++){
     set_brick_parentname(LEVEL2[prod], pl2->d_level2);
     set_brick_dirname(LEVEL2[prod], dname);
-    if (write_brick(LEVEL2[prod]) == FAILURE){
+    if (write_level2(pl2, LEVEL2[prod]) == FAILURE){
       printf("error flushing L2 products. \n"); return FAILURE;}
   }
 
@@ -281,10 +389,7 @@ int nchar;
 multicube_t *start_datacube(par_ll_t *pl2, brick_t *brick){
 multicube_t *multicube = NULL;
 cube_t *cube = NULL;
-double tilex, tiley;
 double utm_ulx, utm_uly, utm_lrx, utm_lry;
-double ulx, uly, urx, ury, lrx, lry, llx, lly;
-int t_ulx, t_uly, t_urx, t_ury, t_lrx, t_lry, t_llx, t_lly;
 char utm_proj[NPOW_10];
 double tol = 5e-3;
 
@@ -365,78 +470,11 @@ double tol = 5e-3;
       utm_lry = utm_uly - get_brick_height(brick);
       get_brick_proj(brick, utm_proj, NPOW_10);
 
-      // UL
-      if ((warp_any_to_any(utm_ulx, utm_uly, &ulx, &uly,
-                          utm_proj, cube->proj)) == FAILURE){
-        printf("computing upper left in dst_srs failed. ");
-        free_multicube(multicube);
-        return NULL;
-      }
-
-      // UR
-      if ((warp_any_to_any(utm_lrx, utm_uly, &urx, &ury,
-                          utm_proj, cube->proj)) == FAILURE){
-        printf("computing upper left in dst_srs failed. ");
-        free_multicube(multicube);
-        return NULL;
-      }
-      
-      // LR
-      if ((warp_any_to_any(utm_lrx, utm_lry, &lrx, &lry,
-                          utm_proj, cube->proj)) == FAILURE){
-        printf("computing lower right in dst_srs failed. ");
-        free_multicube(multicube);
-        return NULL;
-      }
-
-      // LL
-      if ((warp_any_to_any(utm_ulx, utm_lry, &llx, &lly,
-                          utm_proj, cube->proj)) == FAILURE){
-        printf("computing lower right in dst_srs failed. ");
+      if (cube_footprint(utm_ulx, utm_uly, utm_lrx, utm_lry, utm_proj, cube) == FAILURE){
         free_multicube(multicube);
         return NULL;
       }
 
-      tile_find(ulx, uly, &tilex, &tiley, &t_ulx, &t_uly, cube);
-      tile_find(urx, ury, &tilex, &tiley, &t_urx, &t_ury, cube);
-      tile_find(lrx, lry, &tilex, &tiley, &t_lrx, &t_lry, cube);
-      tile_find(llx, lly, &tilex, &tiley, &t_llx, &t_lly, cube);
-      
-      #ifdef FORCE_DEBUG
-      printf("tile UL: %d %d\n", t_ulx, t_uly);
-      printf("tile UR: %d %d\n", t_urx, t_ury);
-      printf("tile LR: %d %d\n", t_lrx, t_lry);
-      printf("tile LL: %d %d\n", t_llx, t_lly);
-      #endif
-
-      cube->tminx = INT_MAX;
-      if (t_ulx < cube->tminx) cube->tminx = t_ulx;
-      if (t_urx < cube->tminx) cube->tminx = t_urx;
-      if (t_lrx < cube->tminx) cube->tminx = t_lrx;
-      if (t_llx < cube->tminx) cube->tminx = t_llx;
-
-      cube->tminy = INT_MAX;
-      if (t_uly < cube->tminy) cube->tminy = t_uly;
-      if (t_ury < cube->tminy) cube->tminy = t_ury;
-      if (t_lry < cube->tminy) cube->tminy = t_lry;
-      if (t_lly < cube->tminy) cube->tminy = t_lly;
-
-      cube->tmaxx = INT_MIN;
-      if (t_ulx > cube->tmaxx) cube->tmaxx = t_ulx;
-      if (t_urx > cube->tmaxx) cube->tmaxx = t_urx;
-      if (t_lrx > cube->tmaxx) cube->tmaxx = t_lrx;
-      if (t_llx > cube->tmaxx) cube->tmaxx = t_llx;
-
-      cube->tmaxy = INT_MIN;
-      if (t_uly > cube->tmaxy) cube->tmaxy = t_uly;
-      if (t_ury > cube->tmaxy) cube->tmaxy = t_ury;
-      if (t_lry > cube->tmaxy) cube->tmaxy = t_lry;
-      if (t_lly > cube->tmaxy) cube->tmaxy = t_lly;
-
-      cube->tnx = cube->tmaxx-cube->tminx+1;
-      cube->tny = cube->tmaxy-cube->tminy+1;
-      cube->tnc = cube->tnx*cube->tny;
-
     }
 
 
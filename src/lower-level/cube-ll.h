@@ -30,6 +30,7 @@ Datacube header
 
 #include <stdio.h>   // core input and output functions
 #include <stdlib.h>  // standard general utilities library
+#include <string.h>  // string handling functions
 
 #include "../cross-level/string-cl.h"
 #include "../cross-level/cube-cl.h"
@@ -27,9 +27,6 @@ This file contains functions for handling Atmospheric Gas
 
 #include "gas-ll.h"
 
-/** GNU Scientific Library (GSL) **/
-#include <gsl/gsl_multimin.h>          // minimization functions 
-
 
 wvp_lut_t _WVLUT_;
 
@@ -37,7 +34,9 @@ wvp_lut_t _WVLUT_;
 /** This function computes a water vapor transmittace look-up-table, which
 +++ is used for fast estimation of Sentinel-2 water vapor. The function 
 +++ will exit successfully if atmospheric correction is disabled or if not
-+++ Sentinel-2
++++ Sentinel-2. The LUT is kept between images, and is only extended by
++++ the airmass steps that were not computed yet. It is recomputed if the
++++ spectral response of the bands changed (e.g. Sentinel-2A vs. 2B).
 --- meta:   metadata
 --- atc:    atmospheric correction factors
 +++ Return: SUCCESS / FAILURE
@@ -48,6 +47,7 @@ float w, m, m_min, m_max;
 int km_min, km_max;
 int nm = 101;
 int nw = 701;
+bool reuse;
 
 
   #ifdef FORCE_CLOCK
@@ -55,10 +55,24 @@ int nw = 701;
   #endif
 
 
-  _WVLUT_.nb = nb = get_brick_nbands(atc->xy_Tg);
-  _WVLUT_.nw = nw;
-  _WVLUT_.nm = nm;
-  alloc_3D((void****)&_WVLUT_.val, _WVLUT_.nb, _WVLUT_.nw, _WVLUT_.nm, sizeof(float));
+  nb = get_brick_nbands(atc->xy_Tg);
+
+  // LUT of a previous image with the same bands?
+  reuse = (_WVLUT_.val != NULL && _WVLUT_.nb == nb);
+  for (b=0; b<nb && reuse; b++){
+    if (_WVLUT_.rsr[b] != meta->cal[b].rsr_band) reuse = false;
+  }
+
+  if (!reuse){
+    free_wvlut();
+    _WVLUT_.nb = nb;
+    _WVLUT_.nw = nw;
+    _WVLUT_.nm = nm;
+    alloc_3D((void****)&_WVLUT_.val, _WVLUT_.nb, _WVLUT_.nw, _WVLUT_.nm, sizeof(float));
+    alloc((void**)&_WVLUT_.rsr,  nb, sizeof(int));
+    alloc((void**)&_WVLUT_.done, nm, sizeof(bool));
+    for (b=0; b<nb; b++) _WVLUT_.rsr[b] = meta->cal[b].rsr_band;
+  }
 
 
   if (atc->cosszen[0] < atc->cosvzen[0]){
@@ -89,6 +103,8 @@ int nw = 701;
 
       for (kw=0; kw<nw; kw++){
 
+        if (_WVLUT_.done[km]) continue;
+
         m = km*0.01;
         w = kw*0.01;
     
@@ -101,6 +117,8 @@ int nw = 701;
     
   }
 
+  for (km=km_min; km<=km_max; km++) _WVLUT_.done[km] = true;
+
 
   #ifdef FORCE_CLOCK
   proctime_print("water vapor LUT", TIME);
@@ -110,80 +128,86 @@ int nw = 701;
 }
 
 
-/** This minimizer function computes BOA reflectance for the reference and
-+++ measurement channels and returns the absolute residual.
---- v:      current water vapor estimate
---- params: parameters used for minimization
-+++ Return: Absolute residual of BOA reflectance (reference - measurement)
+/** This function computes BOA reflectance for the reference and measure-
++++ ment channels at one tabulated water vapor step, and returns the resi-
++++ dual. The residual decreases with water vapor, thus the estimate is 
++++ found where it changes sign.
+--- p:      parameters of the 60m cell
+--- kw:     water vapor step in LUT
++++ Return: residual of BOA reflectance (reference - measurement)
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-double fun_wvp(const gsl_vector *v, void *params){
-float *p = (float *)params;
-float w;
+float wvp_residual(float *p, int kw){
 float nir, wvp;
-int b_nir, b_wvp, b_nir_rsr, b_wvp_rsr;
-float ms, mv, To_nir, To_wvp, rho_p_nir, rho_p_wvp;
+int b_nir, b_wvp, kms, kmv;
+float To_nir, To_wvp, rho_p_nir, rho_p_wvp;
 float T_nir, T_wvp, s_nir, s_wvp;
-float Tsw_nir, Tvw_nir, Tsw_wvp, Tvw_wvp, Tg_nir, Tg_wvp;
+float Tg_nir, Tg_wvp;
 float tmp, sr_reference, sr_measure;
-int kms, kmv, kw;
-
 
-  w = gsl_vector_get(v, 0);
 
   nir       = p[0];
   wvp       = p[1];
   b_nir     = (int)p[2];
   b_wvp     = (int)p[3];
-  b_nir_rsr = (int)p[4];
-  b_wvp_rsr = (int)p[5];
-  ms        = p[6];
-  mv        = p[7];
-  To_nir    = p[8];
-  To_wvp    = p[9];
-  rho_p_nir = p[10];
-  rho_p_wvp = p[11];
-  T_nir     = p[12];
-  T_wvp     = p[13];
-  s_nir     = p[14];
-  s_wvp     = p[15];
-
-
-  // negative water vapor values are not allowed
-  if (w < 0.0) w = 0.0;
-
-  // if water vapor > tabulated values, compute
-  if (w > 7.0){
-
-    Tsw_nir = wvp_transmitt(w, ms, b_nir_rsr);
-    Tvw_nir = wvp_transmitt(w, mv, b_nir_rsr);
-    Tsw_wvp = wvp_transmitt(w, ms, b_wvp_rsr);
-    Tvw_wvp = wvp_transmitt(w, mv, b_wvp_rsr);
-
-  // use tabulated values
-  } else {
+  kms       = (int)p[4];
+  kmv       = (int)p[5];
+  To_nir    = p[6];
+  To_wvp    = p[7];
+  rho_p_nir = p[8];
+  rho_p_wvp = p[9];
+  T_nir     = p[10];
+  T_wvp     = p[11];
+  s_nir     = p[12];
+  s_wvp     = p[13];
+
+  Tg_nir  = _WVLUT_.val[b_nir][kw][kms]*_WVLUT_.val[b_nir][kw][kmv]*To_nir;
+  Tg_wvp  = _WVLUT_.val[b_wvp][kw][kms]*_WVLUT_.val[b_wvp][kw][kmv]*To_wvp;
+
+  tmp = (nir-rho_p_nir)/Tg_nir;
+  sr_reference = tmp / (T_nir + s_nir*tmp);
 
-    kw =  (int)floor(w/0.01);
-    kms = (int)floor(ms/0.01);
-    kmv = (int)floor(mv/0.01);
+  tmp = (wvp-rho_p_wvp)/Tg_wvp;
+  sr_measure = tmp / (T_wvp + s_wvp*tmp);
 
-    Tsw_nir = _WVLUT_.val[b_nir][kw][kms];
-    Tvw_nir = _WVLUT_.val[b_nir][kw][kmv];
-    Tsw_wvp = _WVLUT_.val[b_wvp][kw][kms];
-    Tvw_wvp = _WVLUT_.val[b_wvp][kw][kmv];
+  return sr_reference-sr_measure;
+}
 
-  }
 
+/** This function inverts the water vapor transmittance LUT for one 60m
++++ cell. The sign change of the BOA residual is bracketed by bisection 
++++ over the tabulated water vapor steps, and the root is linearly inter-
++++ polated in between.
+--- p:      parameters of the 60m cell
++++ Return: water vapor, or -1 if there is no solution in the LUT range
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+float wvp_invert_lut(float *p){
+int lo, hi, mid;
+float r_lo, r_hi, r_mid;
 
-  Tg_nir  = Tsw_nir*Tvw_nir*To_nir;
-  Tg_wvp  = Tsw_wvp*Tvw_wvp*To_wvp;
 
-  tmp = (nir-rho_p_nir)/Tg_nir;
-  sr_reference = tmp / (T_nir + s_nir*tmp);
+  lo = 0;
+  hi = _WVLUT_.nw-1;
 
-  tmp = (wvp-rho_p_wvp)/Tg_wvp;
-  sr_measure = tmp / (T_wvp + s_wvp*tmp);
+  r_lo = wvp_residual(p, lo);
+  r_hi = wvp_residual(p, hi);
+
+  // no solution within tabulated water vapor
+  if (!(r_lo > 0 && r_hi < 0) && !(r_lo < 0 && r_hi > 0)) return -1;
 
-  return fabs(sr_reference-sr_measure);
+  while (hi-lo > 1){
+
+    mid = (lo+hi)/2;
+    r_mid = wvp_residual(p, mid);
+
+    if ((r_mid > 0) == (r_lo > 0)){
+      lo = mid; r_lo = r_mid;
+    } else {
+      hi = mid; r_hi = r_mid;
+    }
+
+  }
+
+  return (lo + r_lo/(r_lo-r_hi)) * 0.01;
 }
 
 
@@ -192,7 +216,8 @@ int kms, kmv, kw;
 +++ allocated in this case. Water vapor is estimated for each 60m pixel
 +++ using the complete radiative transfer assuming that BOA reflectance
 +++ of the NIR reference channel @ 0.865m and the NIR water vapor channel
-+++ @ 0.945 should be equal. Nelder-Mead Simplex optimization is used.
++++ @ 0.945 should be equal. The water vapor transmittance LUT is inver-
++++ ted for this purpose.
 +++ Water and shadow pixels will be set to the scene average, and a QAI
 +++ flag is set in this case.
 --- meta:   metadata
@@ -208,14 +233,7 @@ int b_reference, b_measure;
 float reference, measure, dem;
 float w, w_avg;
 double w_sum = 0, num = 0;
-float param[16];
-const gsl_multimin_fminimizer_type *T = NULL;
-gsl_multimin_fminimizer *s = NULL;
-gsl_vector *ss = NULL, *x = NULL;
-gsl_multimin_function minex_func;
-size_t iter;
-int status;
-double size;
+float param[14];
 brick_t *WVP = NULL;
 short  *wvp_ = NULL;
 small  *dem_ = NULL;
@@ -274,30 +292,9 @@ float **xyz_s_m = NULL;
   if ((xyz_s_m     = atc_get_band_reshaped(atc->xyz_s, b_measure))   == NULL) return NULL;
 
 
-  #pragma omp parallel private(j, ii, jj, p, g, reference, measure, dem, z, k, w, x, T, ss, s, minex_func, param, iter, status, size) shared(nx, ny, b_reference, b_measure, toa_, wvp_, dem_, QAI, xy_ms, xy_mv, xy_Tvo_r, xy_Tvo_m, xy_Tso_r, xy_Tso_m, xyz_rho_p_r, xyz_rho_p_m, xyz_T_r, xyz_T_m, xyz_s_r, xyz_s_m, atc, meta, gsl_multimin_fminimizer_nmsimplex2) reduction(+: w_sum, num) default(none)
+  #pragma omp parallel private(j, ii, jj, p, g, reference, measure, dem, z, k, w, param) shared(nx, ny, b_reference, b_measure, toa_, wvp_, dem_, QAI, xy_ms, xy_mv, xy_Tvo_r, xy_Tvo_m, xy_Tso_r, xy_Tso_m, xyz_rho_p_r, xyz_rho_p_m, xyz_T_r, xyz_T_m, xyz_s_r, xyz_s_m, atc) reduction(+: w_sum, num) default(none)
   {
 
-  
-    /** initialize optimizer
-    +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    
-    w = 3.0;
-
-    // start value, is set to last value in loop
-    x = gsl_vector_alloc(1);
-
-    // initial step size of simplex
-    ss = gsl_vector_alloc(1);
-    gsl_vector_set(ss, 0, 0.25);
-
-    // initialize method and iterate
-    minex_func.n = 1;
-    minex_func.f = fun_wvp;
-    minex_func.params = param;
-    T = gsl_multimin_fminimizer_nmsimplex2;
-    s = gsl_multimin_fminimizer_alloc(T, 1);
-
-
     /**estimate water vapor for each 60m pixel
     +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
@@ -340,48 +337,29 @@ float **xyz_s_m = NULL;
       if (fequal(xy_mv[g], get_brick_nodata(atc->xy_view, cZEN))) continue;
 
 
-      /** copy variables to param, and initialize minimizer
+      /** copy variables to param
       +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
       param[0]  = reference;
       param[1]  = measure;
       param[2]  = b_reference;
       param[3]  = b_measure;
-      param[4]  = meta->cal[b_reference].rsr_band;
-      param[5]  = meta->cal[b_measure].rsr_band;
-      param[6]  = xy_ms[g];
-      param[7]  = xy_mv[g];
-      param[8]  = xy_Tso_r[g]*xy_Tvo_r[g];
-      param[9]  = xy_Tso_m[g]*xy_Tvo_m[g];
-      param[10] = xyz_rho_p_r[z][g];
-      param[11] = xyz_rho_p_m[z][g];
-      param[12] = xyz_T_r[z][g];
-      param[13] = xyz_T_m[z][g];
-      param[14] = xyz_s_r[z][g];
-      param[15] = xyz_s_m[z][g];
-
-      gsl_vector_set(x, 0, w);
-      gsl_multimin_fminimizer_set(s, &minex_func, x, ss);
-
-
-      /** optimize radiative transfer, estimate water vapor
+      param[4]  = floor(xy_ms[g]/0.01);
+      param[5]  = floor(xy_mv[g]/0.01);
+      param[6]  = xy_Tso_r[g]*xy_Tvo_r[g];
+      param[7]  = xy_Tso_m[g]*xy_Tvo_m[g];
+      param[8]  = xyz_rho_p_r[z][g];
+      param[9]  = xyz_rho_p_m[z][g];
+      param[10] = xyz_T_r[z][g];
+      param[11] = xyz_T_m[z][g];
+      param[12] = xyz_s_r[z][g];
+      param[13] = xyz_s_m[z][g];
+
+
+      /** invert radiative transfer, estimate water vapor
       +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
-      iter = 0;
-
-      do {
-        iter++;
-        status = gsl_multimin_fminimizer_iterate(s);
-
-        if (status) break;
-
-        size = gsl_multimin_fminimizer_size(s);
-        status = gsl_multimin_test_size(size, 1e-2);
-
-      } while (status == GSL_CONTINUE && iter < 100);
-
-      if ((w = (float)gsl_vector_get(s->x, 0)) > 7 || w <= 0){
-        w = 3; ;continue;}
+      if ((w = wvp_invert_lut(param)) > 7 || w <= 0) continue;
 
       w_sum += w;
       num++;
@@ -404,10 +382,6 @@ float **xyz_s_m = NULL;
     }
     }
 
-    /** clean
-    +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-    gsl_vector_free(x); gsl_vector_free(ss); gsl_multimin_fminimizer_free(s);
-
   }
 
   free((void*)xyz_rho_p_r); free((void*)xyz_rho_p_m);
@@ -560,7 +534,12 @@ float *xy_Tvo = NULL;
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void free_wvlut(){
 
+  if (_WVLUT_.val == NULL) return;
+
   free_3D((void***)_WVLUT_.val, _WVLUT_.nb, _WVLUT_.nw);
+  free((void*)_WVLUT_.rsr);
+  free((void*)_WVLUT_.done);
+  memset(&_WVLUT_, 0, sizeof(wvp_lut_t));
   
   return;
 }
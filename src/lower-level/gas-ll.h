@@ -52,6 +52,8 @@ typedef struct {
   int nb;
   int nw;
   int nm;
+  int *rsr;   // RSR ID of each band
+  bool *done; // airmass steps that were computed
 } wvp_lut_t;
 
 // global instance
@@ -0,0 +1,391 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains the Level 1 conversion on the GPU. The digital numbers
+are uploaded once, and stay on the device for the nodata / saturation
+masks (bounds_level1) and the conversion to TOA reflectance and bright-
+ness temperature (convert_level1), which is done in place like on the 
+host. Only the masks and the TOA reflectance are copied back, as they 
+are needed for the cloud detection on the host. One thread processes 
+all bands of one pixel, thus the band order of the host is retained. 
+Without FORCE_CUDA, this file is compiled as C++ and level1_gpu_open 
+always cancels.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "l1-gpu-ll.h"
+
+#include <string.h>  // string handling functions
+#include <math.h>    // common mathematical functions
+#include <float.h>   // macro constants of the floating-point library
+#include <limits.h>  // macro constants of the integral types
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define GPU_NTHREAD 256
+
+// device copies of one image
+typedef struct {
+  gpu_stream_t stream;  // stream of the device
+  gpu_brick_t *dn;      // digital numbers, converted to TOA in place
+  size_t nc, ng;        // number of cells in image and coarse grid
+  small *off;           // nodata mask
+  small *sat;           // saturation mask
+  int   *tvalid;        // temperature has any valid value?
+  float *sun;           // cosine of sun zenith, coarse grid
+  l1_cal_gpu_t *cal;    // calibration of all bands
+} l1_dev_t;
+
+
+/** Nodata and saturation kernel, one thread per pixel
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+__global__ void bounds_kernel(l1_gpu_t job, const ushort *__restrict__ dn, size_t stride, size_t nc, small *off, small *sat, int *tvalid){
+size_t p = (size_t)blockIdx.x*blockDim.x + threadIdx.x;
+small off_ = 0, sat_ = 0;
+ushort v;
+int b;
+
+
+  if (p >= nc) return;
+
+  for (b=0; b<job.nb; b++){
+
+    v = dn[(size_t)b*stride + p];
+
+    // if any layer void --> boundary
+    if (b != job.b_cirrus && v == 0){ off_ = 1; break;}
+
+    // if any (non-temp) layer saturated
+    if (b != job.b_temp && v >= job.sat){ sat_ = 1; break;}
+
+    // if temperature has any non-0 value
+    if (b == job.b_temp) *tvalid = 1;
+
+  }
+
+  off[p] = off_;
+  sat[p] = sat_;
+
+  return;
+}
+
+
+/** DN to TOA kernel, one thread per pixel, mirrors convert_level1
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+__global__ void convert_kernel(l1_gpu_t job, const l1_cal_gpu_t *__restrict__ cal, void *slab, size_t stride, size_t nc, small *off, const float *__restrict__ sun){
+size_t p = (size_t)blockIdx.x*blockDim.x + threadIdx.x;
+const ushort *dn = (const ushort*)slab;
+short *toa = (short*)slab;
+size_t k;
+int b, i, j, g;
+float A, rad, tmp;
+small off_;
+l1_cal_gpu_t c;
+
+
+  if (p >= nc) return;
+
+  // TOA reflectance to TOA reflectance (Sentinel-2)
+  if (job.sentinel2){
+
+    for (b=0; b<job.nb; b++){
+      k = (size_t)b*stride + p;
+      c = cal[b];
+      toa[k] = (dn[k] + c.radd) / c.dn_scale*c.toa_scale;
+    }
+
+    return;
+
+  }
+
+  // digital numbers to TOA reflectance and brightness temperature (Landsat)
+  i = p / job.nx;
+  j = p % job.nx;
+  g = (int)floor(i*job.fres/job.gres)*job.nf + (int)floor(j*job.fres/job.gres);
+
+  off_ = off[p];
+
+  for (b=0; b<job.nb; b++){
+
+    k = (size_t)b*stride + p;
+
+    if (off_){ toa[k] = job.nodata; continue;}
+
+    c = cal[b];
+    A = (c.lmax-c.lmin) / (c.qmax-c.qmin);
+
+    // dn to radiance
+    rad = A * (dn[k]-c.qmin) + c.lmin;
+
+    // radiance to brightness temperature in kelvin
+    if (b == job.b_temp){
+
+      tmp = c.k2/log((c.k1/rad)+1)*c.toa_scale;
+      if (tmp < SHRT_MAX){
+        toa[k] = (short)tmp;
+      } else {
+        toa[k] = SHRT_MAX;
+      }
+
+    // radiance to reflectance
+    } else {
+
+      if (c.radiance){
+        // old-style DN -> radiance -> reflectance conversion
+        tmp = rad*job.pi_dsun2 / (c.E0*sun[g]);
+      } else {
+        // new DN -> reflectance conversion
+        tmp = (c.radd + c.rmul*dn[k]) / sun[g];
+      }
+
+      if (tmp < FLT_MIN){
+        if (b == job.b_cirrus){
+          toa[k] = (short)0;
+        } else {
+          toa[k] = job.nodata;
+          off_ = 1;
+        }
+      } else {
+        toa[k] = (short)(tmp*c.toa_scale);
+      }
+
+    }
+
+  }
+
+  off[p] = off_;
+
+  return;
+}
+
+#endif
+
+
+/** This function prepares the Level 1 conversion of one image on the GPU.
++++ Device memory is allocated, and the digital numbers are uploaded. The
++++ dimensions of the job are taken from the DN brick.
+--- job:    Level 1 conversion of one image
+--- DN:     digital numbers
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int level1_gpu_open(l1_gpu_t *job, brick_t *DN){
+#ifdef FORCE_CUDA
+l1_dev_t *dev = NULL;
+int error = 0;
+
+
+  job->dev = NULL;
+
+  if (!gpu_enabled()) return CANCEL;
+  if (get_brick_datatype(DN) != _DT_USHORT_) return CANCEL;
+
+  job->nx = get_brick_ncols(DN);
+  job->ny = get_brick_nrows(DN);
+  job->nb = get_brick_nbands(DN);
+
+  alloc((void**)&dev, 1, sizeof(l1_dev_t));
+  job->dev = dev;
+
+  dev->stream = claim_gpu_stream();
+  if (gpu_select(dev->stream) == FAILURE){
+    level1_gpu_close(job); return CANCEL;}
+
+  dev->nc = (size_t)job->nx*job->ny;
+
+  // copies are asynchronous if the slab can be pinned
+  pin_brick(DN);
+
+  if ((dev->dn     = allocate_gpu_brick(DN, dev->stream))              == NULL) error++;
+  if ((dev->off    = (small*)gpu_alloc(dev->nc*sizeof(small), dev->stream)) == NULL) error++;
+  if ((dev->sat    = (small*)gpu_alloc(dev->nc*sizeof(small), dev->stream)) == NULL) error++;
+  if ((dev->tvalid = (int*)gpu_alloc(sizeof(int), dev->stream))          == NULL) error++;
+  if ((dev->cal    = (l1_cal_gpu_t*)gpu_alloc(job->nb*sizeof(l1_cal_gpu_t), dev->stream)) == NULL) error++;
+
+  // not enough memory on the device: the host takes over
+  if (error > 0){
+    level1_gpu_close(job); return CANCEL;}
+
+  if (upload_brick(DN, dev->dn) == FAILURE){
+    level1_gpu_close(job); return FAILURE;}
+
+  return SUCCESS;
+
+#else
+
+  job->dev = NULL;
+  return CANCEL;
+
+#endif
+}
+
+
+/** This function computes the nodata and saturation masks of one image on
++++ the GPU. The digital numbers stay on the device.
+--- job:    Level 1 conversion of one image
+--- off:    nodata mask (returned)
+--- sat:    saturation mask (returned)
+--- tvalid: temperature has any valid value? (returned)
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int level1_gpu_bounds(l1_gpu_t *job, small *off, small *sat, int *tvalid){
+#ifdef FORCE_CUDA
+l1_dev_t *dev = (l1_dev_t*)job->dev;
+cudaStream_t s;
+int nblock;
+int error = 0;
+
+
+  if (dev == NULL) return CANCEL;
+
+  if (gpu_select(dev->stream) == FAILURE) return FAILURE;
+  s = (cudaStream_t)gpu_cuda_stream(dev->stream);
+
+  cudaMemsetAsync(dev->tvalid, 0, sizeof(int), s);
+
+  nblock = (dev->nc + GPU_NTHREAD - 1) / GPU_NTHREAD;
+
+  bounds_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(*job, (const ushort*)dev->dn->slab, 
+    dev->dn->stride, dev->nc, dev->off, dev->sat, dev->tvalid);
+
+  if (cudaGetLastError() != cudaSuccess){
+    printf("launching bounds kernel failed. ");
+    error++;
+  } else {
+    cudaMemcpyAsync(off,    dev->off,    dev->nc*sizeof(small), cudaMemcpyDeviceToHost, s);
+    cudaMemcpyAsync(sat,    dev->sat,    dev->nc*sizeof(small), cudaMemcpyDeviceToHost, s);
+    cudaMemcpyAsync(tvalid, dev->tvalid, sizeof(int),           cudaMemcpyDeviceToHost, s);
+  }
+
+  if (gpu_sync(dev->stream) == FAILURE) error++;
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
+
+/** This function converts the digital numbers of one image to TOA reflec-
++++ tance and brightness temperature on the GPU. The conversion is done in
++++ place on the device, and the result is copied to the TOA brick, which
++++ took over the memory of the DN brick. The nodata mask is updated for
++++ pixels with invalid reflectance.
+--- job:    Level 1 conversion of one image
+--- cal:    calibration of all bands
+--- off:    nodata mask (modified)
+--- sun_cz: cosine of sun zenith, coarse grid (not used for Sentinel-2)
+--- TOA:    TOA reflectance (returned)
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int level1_gpu_convert(l1_gpu_t *job, l1_cal_gpu_t *cal, small *off, const float *sun_cz, brick_t *TOA){
+#ifdef FORCE_CUDA
+l1_dev_t *dev = (l1_dev_t*)job->dev;
+cudaStream_t s;
+void *host = get_brick_slab(TOA);
+int nblock;
+int error = 0;
+
+
+  if (dev == NULL) return CANCEL;
+
+  if (host == NULL || get_brick_datatype(TOA) != _DT_SHORT_ ||
+      dev->dn->bytes != (size_t)get_brick_nbands(TOA) * get_brick_stride(TOA) * get_brick_byte(TOA)){
+    printf("device brick does not match TOA brick. "); return FAILURE;}
+
+  if (gpu_select(dev->stream) == FAILURE) return FAILURE;
+  s = (cudaStream_t)gpu_cuda_stream(dev->stream);
+
+  if (!job->sentinel2){
+    dev->ng = (size_t)job->nf*job->ne;
+    if ((dev->sun = (float*)gpu_alloc(dev->ng*sizeof(float), dev->stream)) == NULL){
+      printf("not enough GPU memory for TOA conversion. "); return FAILURE;}
+    cudaMemcpyAsync(dev->sun, sun_cz, dev->ng*sizeof(float), cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(dev->off, off,    dev->nc*sizeof(small), cudaMemcpyHostToDevice, s);
+  }
+
+  cudaMemcpyAsync(dev->cal, cal, job->nb*sizeof(l1_cal_gpu_t), cudaMemcpyHostToDevice, s);
+
+  nblock = (dev->nc + GPU_NTHREAD - 1) / GPU_NTHREAD;
+
+  convert_kernel<<<nblock, GPU_NTHREAD, 0, s>>>(*job, dev->cal, dev->dn->slab, 
+    dev->dn->stride, dev->nc, dev->off, dev->sun);
+
+  if (cudaGetLastError() != cudaSuccess){
+    printf("launching TOA conversion kernel failed. ");
+    error++;
+  } else {
+    cudaMemcpyAsync(host, dev->dn->slab, dev->dn->bytes, cudaMemcpyDeviceToHost, s);
+    if (!job->sentinel2) cudaMemcpyAsync(off, dev->off, dev->nc*sizeof(small), cudaMemcpyDeviceToHost, s);
+  }
+
+  if (gpu_sync(dev->stream) == FAILURE) error++;
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
+
+/** This function releases the device memory of one image
+--- job:    Level 1 conversion of one image
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void level1_gpu_close(l1_gpu_t *job){
+#ifdef FORCE_CUDA
+l1_dev_t *dev = (l1_dev_t*)job->dev;
+
+
+  if (dev == NULL) return;
+
+  free_gpu_brick(dev->dn);
+  gpu_release(dev->off,    dev->nc*sizeof(small), dev->stream);
+  gpu_release(dev->sat,    dev->nc*sizeof(small), dev->stream);
+  gpu_release(dev->tvalid, sizeof(int),           dev->stream);
+  gpu_release(dev->sun,    dev->ng*sizeof(float), dev->stream);
+  gpu_release(dev->cal,    job->nb*sizeof(l1_cal_gpu_t), dev->stream);
+
+  free((void*)dev);
+
+#endif
+
+  job->dev = NULL;
+
+  return;
+}
+
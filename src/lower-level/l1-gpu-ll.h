@@ -0,0 +1,79 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Level 1 conversion on the GPU header
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#ifndef L1GPU_LL_H
+#define L1GPU_LL_H
+
+#include <stdio.h>   // core input and output functions
+#include <stdlib.h>  // standard general utilities library
+#include <stdbool.h> // boolean data type
+
+#include "../cross-level/const-cl.h"
+#include "../cross-level/brick-cl.h"
+#include "../cross-level/gpu-cl.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Level 1 conversion of one image on the device
+typedef struct {
+  int nx, ny, nb;         // dimensions of image
+  int b_temp, b_cirrus;   // temperature and cirrus band (or -1)
+  int sat;                // saturation value
+  bool sentinel2;         // TOA reflectance is given, rescale only
+  int nf, ne;             // dimensions of coarse sun grid
+  double fres, gres;      // resolution of image and coarse grid
+  float pi_dsun2;         // pi times squared sun distance
+  short nodata;           // nodata of TOA
+  void *dev;              // device copies, managed by level1_gpu_*
+} l1_gpu_t;
+
+// calibration of one band
+typedef struct {
+  float dn_scale, toa_scale; // scale of DN and TOA
+  float radd, rmul;          // reflectance offset and gain
+  float lmin, lmax;          // radiance min/max
+  float qmin, qmax;          // quantized DN min/max
+  float k1, k2;              // conversion factors brightness temperature
+  float E0;                  // exoatmospheric irradiance
+  bool radiance;             // DN -> radiance -> reflectance conversion
+} l1_cal_gpu_t;
+
+int  level1_gpu_open(l1_gpu_t *job, brick_t *DN);
+int  level1_gpu_bounds(l1_gpu_t *job, small *off, small *sat, int *tvalid);
+int  level1_gpu_convert(l1_gpu_t *job, l1_cal_gpu_t *cal, small *off, const float *sun_cz, brick_t *TOA);
+void level1_gpu_close(l1_gpu_t *job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
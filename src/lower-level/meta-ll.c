@@ -659,6 +659,7 @@ int sv_nx = 0, sv_ny = 0;
 int d = 0, nd;
 float *s_sz = NULL, *s_sa = NULL;
 float ***s_vz = NULL, ***s_va = NULL;
+float val;
 bool s = false, v = false, z = false, a = false;
 char d_img[NPOW_10];
 char id_img[NPOW_10];
@@ -1010,20 +1011,21 @@ int svgrid = 5000;
 
         while (strcmp(tokenptr, "/VALUES") != 0 && j < sv_nx){
 
-          if (s){
-            if (z){
-              if (strcmp(tokenptr, "NaN") !=0) s_sz[i*sv_ny+j] = atof(tokenptr);
-            } else if (a){
-              if (strcmp(tokenptr, "NaN") !=0) s_sa[i*sv_ny+j] = atof(tokenptr);
-            }
-          } else if (v){
-            if (z){
-              if (strcmp(tokenptr, "NaN") !=0){
-                s_vz[b][d][i*sv_ny+j] += atof(tokenptr);
+          // NaN is parsed as such, and skipped
+          val = strtof(tokenptr, NULL);
+
+          if (!isnan(val)){
+            if (s){
+              if (z){
+                s_sz[i*sv_ny+j] = val;
+              } else if (a){
+                s_sa[i*sv_ny+j] = val;
               }
-            } else if (a){
-              if (strcmp(tokenptr, "NaN") !=0){
-                s_va[b][d][i*sv_ny+j] += atof(tokenptr);
+            } else if (v){
+              if (z){
+                s_vz[b][d][i*sv_ny+j] += val;
+              } else if (a){
+                s_va[b][d][i*sv_ny+j] += val;
               }
             }
           }
@@ -1050,11 +1052,19 @@ int svgrid = 5000;
   // angles are given at grid intersections, we need one value per cell
   interpolate_sunview_grid(s_sz, sv_nx, sv_ny, meta->s2.nodata);
   interpolate_sunview_grid(s_sa, sv_nx, sv_ny, meta->s2.nodata);
-  for (b=0; b<nb; b++){
-    for (d=0; d<nd; d++){
-      interpolate_sunview_grid(s_vz[b][d], sv_nx, sv_ny, meta->s2.nodata);
-      interpolate_sunview_grid(s_va[b][d], sv_nx, sv_ny, meta->s2.nodata);
+
+  // the band- and detector-wise view grids are independent
+  #pragma omp parallel shared(nb, nd, s_vz, s_va, sv_nx, sv_ny, meta) default(none)
+  {
+
+    #pragma omp for collapse(2) schedule(dynamic)
+    for (b=0; b<nb; b++){
+      for (d=0; d<nd; d++){
+        interpolate_sunview_grid(s_vz[b][d], sv_nx, sv_ny, meta->s2.nodata);
+        interpolate_sunview_grid(s_va[b][d], sv_nx, sv_ny, meta->s2.nodata);
+      }
     }
+
   }
   sv_nx--;
   sv_ny--;
@@ -1333,7 +1343,9 @@ int nchar;
 
 /** This function interpolates the sun and view angle grids given in the 
 +++ Sentinel-2 metadata. The interpolation grid will be interpolated to
-+++ a cell-based grid, and then clipped to the image extent.
++++ a cell-based grid, and then clipped to the image extent. The grid is
++++ reduced in place, row by row, such that no copy of the grid is needed.
++++ The inner loop is branch-free to allow vectorization.
 +++ int_grid: interpolation grid (modified)
 --- nx:       number of columns
 --- ny:       number of rows
@@ -1341,48 +1353,47 @@ int nchar;
 +++ Return:   void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void interpolate_sunview_grid(float *int_grid, int int_nx, int int_ny, float nodata){
-int i, j, ii, jj;
+int i, j;
 int cell_nx, cell_ny;
-int cell_p, int_p;
-float *cell_grid = NULL;
+float *cell_row = NULL;
+float *upper = NULL, *lower = NULL;
+float v00, v01, v10, v11;
 float sum, num;
 
 
   cell_nx = int_nx - 1;
   cell_ny = int_ny - 1;
 
-  alloc((void**)&cell_grid, cell_ny*cell_nx, sizeof(float));
+  if (cell_nx < 1 || cell_ny < 1) return;
 
+  alloc((void**)&cell_row, cell_nx, sizeof(float));
 
-  for (i=0, cell_p=0; i<cell_ny; i++){
-  for (j=0; j<cell_nx; j++, cell_p++){
+  // cell row i is written before row i+1 of the interpolation grid is 
+  // read, and it never overlaps with rows i or i+1
+  for (i=0; i<cell_ny; i++){
 
-    sum = num = 0;
+    upper = int_grid + i*int_nx;
+    lower = int_grid + (i+1)*int_nx;
 
-    for (ii=0; ii<=1; ii++){
-    for (jj=0; jj<=1; jj++){
+    #pragma omp simd private(v00, v01, v10, v11, sum, num)
+    for (j=0; j<cell_nx; j++){
 
-      int_p = (i+ii) * int_ny + (j+jj);
+      v00 = upper[j]; v01 = upper[j+1];
+      v10 = lower[j]; v11 = lower[j+1];
 
-      if (int_grid[int_p] > 0){
-        sum += int_grid[int_p];
-        num++;
-      }
-    }
-    }
+      sum = (v00 > 0 ? v00 : 0) + (v01 > 0 ? v01 : 0) +
+            (v10 > 0 ? v10 : 0) + (v11 > 0 ? v11 : 0);
+      num = (v00 > 0) + (v01 > 0) + (v10 > 0) + (v11 > 0);
+
+      cell_row[j] = (num > 0) ? sum/num : nodata;
 
-    if (num > 0){
-      cell_grid[cell_p] = sum/num;
-    } else {
-      cell_grid[cell_p] = nodata;
     }
 
-  }
+    memcpy(int_grid + i*cell_nx, cell_row, cell_nx*sizeof(float));
+
   }
 
-  memmove(int_grid, cell_grid, cell_nx*cell_ny*sizeof(float));
-  re_alloc((void**)&int_grid, int_nx*int_ny, cell_nx*cell_ny, sizeof(float));
-  free((void*)cell_grid);
+  free((void*)cell_row);
 
   return;
 }
@@ -1391,7 +1402,8 @@ float sum, num;
 /** This function collapses the Sentinel-2 view angle grids to a single
 +++ grid. All band- and detector-based grids will be averaged. There is
 +++ room for improvement at this point. The collapsed grid will be put
-+++ into the first slot.
++++ into the first slot. The grids are accumulated one after another, 
++++ such that each grid is traversed contiguously.
 +++ grid:     3D grid (modified)
 --- nb:       number of bands
 --- nd:       number of detectors
@@ -1401,35 +1413,35 @@ float sum, num;
 +++ Return:   void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 void collapse_view_grid(float ***grid, int nb, int nd, int nx, int ny, float nodata){
-int b, d, i, j, p;
-float sum, num;
+int b, d, p, np = nx*ny;
+float *sum = NULL, *num = NULL;
+float *g = NULL;
 
 
-  for (i=0, p=0; i<ny; i++){
-  for (j=0; j<nx; j++, p++){
+  alloc((void**)&sum, np, sizeof(float));
+  alloc((void**)&num, np, sizeof(float));
 
-    sum = num = 0;
-
-    for (b=0; b<nb; b++){
-    for (d=0; d<nd; d++){
+  for (b=0; b<nb; b++){
+  for (d=0; d<nd; d++){
 
-      if (grid[b][d][p] != nodata){
-        sum += grid[b][d][p];
-        num++;
-      }
+    g = grid[b][d];
 
-    }
-    }
-
-    if (num > 0){
-      grid[0][0][p] = sum/num;
-    } else {
-      grid[0][0][p] = nodata;
+    #pragma omp simd
+    for (p=0; p<np; p++){
+      sum[p] += (g[p] != nodata) ? g[p] : 0;
+      num[p] += (g[p] != nodata);
     }
 
   }
   }
-  
+
+  g = grid[0][0];
+
+  #pragma omp simd
+  for (p=0; p<np; p++) g[p] = (num[p] > 0) ? sum[p]/num[p] : nodata;
+
+  free((void*)sum);
+  free((void*)num);
 
   return;
 }
@@ -243,7 +243,7 @@ int dv[10] = { 30, 31,  1,  2,  3,  4,  5,  6,  7, 13 };
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int read_modis_geometa(char *fname, char ***fid, float ****gr, bool **v, int *nl, int *nv){
 char buffer[NPOW_10] = "\0";
-char *tokenptr = NULL;
+char *tokenptr = NULL, *save = NULL;
 char *separator = ",";
 FILE *fp = NULL;
 int l, g, k, nline = 0, nvalid = 0;
@@ -274,7 +274,7 @@ float tmp, min[3];
 
     k = 0;
 
-    tokenptr = strtok(buffer, separator);
+    tokenptr = strtok_r(buffer, separator, &save);
 
     while (tokenptr != NULL){
 
@@ -301,7 +301,7 @@ float tmp, min[3];
       } else if (k == 16){ gring[nline][1][3] = atof(tokenptr); // Gring Y 4
       }
 
-      tokenptr = strtok(NULL, separator);
+      tokenptr = strtok_r(NULL, separator, &save);
       k++;
     }
 
@@ -494,7 +494,10 @@ float wlon, elon, nlat, slat, dboff[3] = { 0, 360, -360 };
 
 /** This function identifies the MODIS data that should be processed, then
 +++ downloads them, reads them, and computes the average for each reques-
-+++ ted coordinate.
++++ ted coordinate. The granules are selected for all coordinates first, 
++++ and each selected granule is downloaded and read only once, even if
++++ it is used by several coordinates. Missing granules are downloaded 
++++ concurrently before any granule is read.
 --- dir_geo:   Directory of MODIS geometa tables
 --- dir_hdf:   Directory of MODIS water vapor data
 --- d_now:     Date
@@ -503,16 +506,21 @@ float wlon, elon, nlat, slat, dboff[3] = { 0, 360, -360 };
 --- COO:       Coordinate array
 --- avg:       Water vapor averages
 --- count:     Number of pixels for averaging
+--- key:       App key
+--- nconn:     Number of concurrent downloads
 +++ Return:    void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-void compile_modis_wvp(char *dir_geo, char *dir_hdf, date_t d_now, char *sen, int nc, float **COO, double **avg, double **count, char *key){
+void compile_modis_wvp(char *dir_geo, char *dir_hdf, date_t d_now, char *sen, int nc, float **COO, double **avg, double **count, char *key, int nconn){
 char geoname[NPOW_10];
 char pattern[NPOW_10], ftp_pattern[NPOW_10], doy[4];
 char httplist[NPOW_10];
 char loclist[NPOW_10];
 char basename[NPOW_10];
-char httpname[NPOW_10];
 char fullname[NPOW_10];
+char **hdf_remote = NULL, **hdf_local = NULL;
+char **f_remote = NULL, **f_local = NULL;
+int *idx = NULL, *status = NULL;
+int nd, nfail;
 char buffer[NPOW_10];
 int nchar;
 int curl;
@@ -520,9 +528,11 @@ float ***gr = NULL; // gring coords: (0/0-3): Lon/ul-ur-lr-ll, (1/0-3): Lat/ul-u
 char **id = NULL;
 bool *v = NULL;
 int *ptr = NULL;
-char *str = NULL;
+char *str = NULL, *save = NULL;
 int nl, nv, ni;
-int i, c, p;
+int i, c, p, l;
+bool **use = NULL;
+bool any;
 int y, yc, yct, x, xc, xct, pos, posc;
 int try__;
 GDALDatasetH hdfDS, subDS;
@@ -542,7 +552,7 @@ float *LON = NULL;
 int pcld = 6, pwvp = 7, plat = 12, plon = 13;
 bool bit[8];
 FILE *fp = NULL;
-double sumwvp, ctrwvp, *average = NULL, *ctrall = NULL;
+double *sumwvp = NULL, *ctrwvp = NULL, *average = NULL, *ctrall = NULL;
 float wlon, elon, nlat, slat;
 bool ok;
 const char *separator = ",";
@@ -552,6 +562,9 @@ const char *separator = ",";
   alloc((void**)&ctrall,  nc, sizeof(double));
   for (c=0; c<nc; c++) average[c] = 9999;
 
+  alloc((void**)&sumwvp, nc, sizeof(double));
+  alloc((void**)&ctrwvp, nc, sizeof(double));
+
   // geomate filename
   nchar = snprintf(geoname, NPOW_10, "%s/%s03_%4d-%02d-%02d.txt", 
     dir_geo, sen, d_now.year, d_now.month, d_now.day);
@@ -560,7 +573,9 @@ const char *separator = ",";
 
 
   // if geometa file doesn't exist, return
-  if (!fileexist(geoname)){ *avg = average; *count = ctrall; return;}
+  if (!fileexist(geoname)){ 
+    free((void*)sumwvp); free((void*)ctrwvp);
+    *avg = average; *count = ctrall; return;}
 
 
   GDALAllRegister();
@@ -575,24 +590,24 @@ const char *separator = ",";
   #endif
 
   // if no granule is valid, return
-  if (nv == 0){ *avg = average; *count = ctrall; return;}
+  if (nv == 0){ 
+    free((void*)sumwvp); free((void*)ctrwvp);
+    *avg = average; *count = ctrall; return;}
 
 
-  // do for each requested coordinate
-  for (c=0; c<nc; c++){
-
-    sumwvp = ctrwvp = 0;
+  alloc_2D((void***)&use, nl, nc, sizeof(bool));
 
-    // estimate average of wvp in a 1.5° x 1.5° box
-    wlon = COO[0][c]-0.75; elon = COO[0][c]+0.75;
-    nlat = COO[1][c]+0.75; slat = COO[1][c]-0.75;
+  // select the granules for each requested coordinate
+  for (c=0; c<nc; c++){
 
     // get intersecting granules
     if ((ni = modis_intersect(COO[1][c], COO[0][c], gr, v, 
-                                  nl, nv, &ptr)) < 1) continue;
+                                  nl, nv, &ptr)) < 1){
+      free((void*)ptr); continue;}
 
     #ifdef FORCE_DEBUG
-    printf("requested box: UL %.2f/%.2f, LR %.2f/%.2f\n", wlon, nlat, elon, slat);
+    printf("requested box: UL %.2f/%.2f, LR %.2f/%.2f\n", 
+      COO[0][c]-0.75, COO[1][c]+0.75, COO[0][c]+0.75, COO[1][c]-0.75);
     printf("%d intersecting granules\n", ni);
     #endif
 
@@ -610,235 +625,292 @@ const char *separator = ",";
       }
     }
 
+    for (i=0; i<ni; i++) use[ptr[i]][c] = true;
 
-    // for every remaining granule: get correct HDF name, download if not there and process
-    for (i=0; i<ni; i++){
+    free((void*)ptr);
 
-      // appr. HDF name with wildcards
-      strncpy(pattern, sen, 3);
-      strncpy(pattern+3, "05_L2", 5);
-      strncpy(pattern+8, id[ptr[i]]+5, 14);
-      pattern[22] = '\0';
-      strncpy(doy, pattern+14, 3); doy[3] = '\0';
-      nchar = snprintf(ftp_pattern, NPOW_10, 
-        "https://ladsweb.modaps.eosdis.nasa.gov/archive/allData/61/%s05_L2/%4d/%s/%s*", 
-        sen, d_now.year, doy, pattern);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling filename\n"); exit(1);}
+  }
 
-      // download file listing
-      try__ = 0;
-      nchar = snprintf(httplist, NPOW_10, 
-        "https://ladsweb.modaps.eosdis.nasa.gov/archive/allData/61/%s05_L2/%4d/%s.csv",
-        sen, d_now.year, doy);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling filename\n"); exit(1);}
 
-      nchar = snprintf(loclist, NPOW_10, 
-        "%s/%s05_L2-%04d-%s.csv", dir_hdf, sen, d_now.year, doy);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling filename\n"); exit(1);}
+  alloc_2D((void***)&hdf_remote, nl, NPOW_10, sizeof(char));
+  alloc_2D((void***)&hdf_local,  nl, NPOW_10, sizeof(char));
 
-      while (try__ < 10 && !fileexist(loclist)){
-        curl = download_file(httplist, loclist, key);
-        printf("\b\b%2d", try__+1);
-        if (curl != 0) printf("; curl: %02d. fail. ", curl);
-        if (curl == 78) try__ = 99;
-        try__++; fflush(stdout);
-      }
+  // for every selected granule: get correct HDF name
+  for (l=0; l<nl; l++){
+
+    for (c=0, any=false; c<nc && !any; c++) any = use[l][c];
+    if (!any) continue;
+
+    // appr. HDF name with wildcards
+    strncpy(pattern, sen, 3);
+    strncpy(pattern+3, "05_L2", 5);
+    strncpy(pattern+8, id[l]+5, 14);
+    pattern[22] = '\0';
+    strncpy(doy, pattern+14, 3); doy[3] = '\0';
+    nchar = snprintf(ftp_pattern, NPOW_10, 
+      "https://ladsweb.modaps.eosdis.nasa.gov/archive/allData/61/%s05_L2/%4d/%s/%s*", 
+      sen, d_now.year, doy, pattern);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); exit(1);}
+
+    // download file listing
+    try__ = 0;
+    nchar = snprintf(httplist, NPOW_10, 
+      "https://ladsweb.modaps.eosdis.nasa.gov/archive/allData/61/%s05_L2/%4d/%s.csv",
+      sen, d_now.year, doy);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); exit(1);}
 
-      if (!fileexist(loclist)) continue;
+    nchar = snprintf(loclist, NPOW_10, 
+      "%s/%s05_L2-%04d-%s.csv", dir_hdf, sen, d_now.year, doy);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); exit(1);}
 
+    while (try__ < 10 && !fileexist(loclist)){
+      curl = download_file(httplist, loclist, key);
+      printf("\b\b%2d", try__+1);
+      if (curl != 0) printf("; curl: %02d. fail. ", curl);
+      if (curl == 78) try__ = 99;
+      try__++; fflush(stdout);
+    }
 
-      if ((fp = fopen(loclist, "r")) == NULL){
-        printf("Unable to open file list!\n"); continue;}
-      ok = false;
+    if (!fileexist(loclist)) continue;
 
-      while (fgets(buffer, NPOW_10, fp) != NULL){
-        if (strstr(buffer, pattern) != NULL){
-          str = strtok(buffer, separator);
-          copy_string(basename, NPOW_10, str);
-          ok = true;
-        }
+
+    if ((fp = fopen(loclist, "r")) == NULL){
+      printf("Unable to open file list!\n"); continue;}
+    ok = false;
+
+    while (fgets(buffer, NPOW_10, fp) != NULL){
+      if (strstr(buffer, pattern) != NULL){
+        str = strtok_r(buffer, separator, &save);
+        copy_string(basename, NPOW_10, str);
+        ok = true;
       }
+    }
 
-      fclose(fp);
+    fclose(fp);
 
-      if (!ok){
-        printf("Unable to locate name in filelist!\n"); continue;}
+    if (!ok){
+      printf("Unable to locate name in filelist!\n"); continue;}
 
-      nchar = snprintf(fullname, NPOW_10, "%s/%s", dir_hdf, basename);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling filename\n"); exit(1);}
-      
-      nchar = snprintf(httpname, NPOW_10, 
-        "https://ladsweb.modaps.eosdis.nasa.gov/archive/allData/61/%s05_L2/%4d/%s/%s", 
-        sen, d_now.year, doy, basename);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling filename\n"); exit(1);}
+    nchar = snprintf(hdf_local[l], NPOW_10, "%s/%s", dir_hdf, basename);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); exit(1);}
+    
+    nchar = snprintf(hdf_remote[l], NPOW_10, 
+      "https://ladsweb.modaps.eosdis.nasa.gov/archive/allData/61/%s05_L2/%4d/%s/%s", 
+      sen, d_now.year, doy, basename);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling filename\n"); exit(1);}
 
+  }
 
-      for (try__=0; try__ < 10; try__++){
 
-        if (fileexist(fullname)) break;
+  // download all missing granules concurrently
+  alloc((void**)&f_remote, nl, sizeof(char*));
+  alloc((void**)&f_local,  nl, sizeof(char*));
+  alloc((void**)&idx,      nl, sizeof(int));
+  alloc((void**)&status,   nl, sizeof(int));
 
-        #ifdef FORCE_DEBUG
-        printf("Download file (%s). Try # %2d\n", pattern, try__);
-        #endif
+  for (try__=0; try__ < 10; try__++){
 
-        curl = download_file(httpname, fullname, key);
-        printf("\b\b%2d", try__+1);
-        if (curl != 0) printf("; curl: %02d. fail. ", curl);
-        if (curl == 78) try__ = 99;
+    for (l=0, nd=0; l<nl; l++){
+      if (hdf_local[l][0] == '\0' || fileexist(hdf_local[l])) continue;
+      f_remote[nd] = hdf_remote[l];
+      f_local[nd]  = hdf_local[l];
+      idx[nd] = l;
+      nd++;
+    }
 
-        if (fileexist(fullname)) break;
+    if (nd == 0) break;
 
-      }
+    #ifdef FORCE_DEBUG
+    printf("Download %d files. Try # %2d\n", nd, try__);
+    #endif
 
+    nfail = download_files(f_remote, f_local, nd, key, nconn, status);
+    printf("\b\b%2d", try__+1);
+    if (nfail > 0) printf("; %d downloads failed. ", nfail);
+    fflush(stdout);
 
-      if (!fileexist(fullname)) continue;
+    // do not retry files that do not exist on the server
+    for (i=0; i<nd; i++){
+      if (status[i] == 78) hdf_local[idx[i]][0] = '\0';
+    }
 
-      // open input dataset
-      if ((hdfDS = GDALOpenEx(fullname, GA_ReadOnly, 
-                              NULL, 
-                              (const char *const *)sdsopenoptions, 
-                              NULL)) == NULL){
-        printf("unable to open image %s\n", fullname); exit(1);
-      } else {
-        //free((void*)hdfname); hdfname = NULL;
-      }
+  }
 
-      // get SDS listing
-      sds = GDALGetMetadata(hdfDS, "SUBDATASETS");
-      if (CSLCount(sds) == 0){
-        printf("unable to retrieve SDS list.\n"); exit(1);}
+  free((void*)f_remote); free((void*)f_local);
+  free((void*)idx);      free((void*)status);
 
 
+  // process every downloaded granule
+  for (l=0; l<nl; l++){
 
-      // read NIR water vapour retrieval
-      nchar = snprintf(KeyName, NPOW_10, "SUBDATASET_%d_NAME", pwvp);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling hdf sds name\n"); exit(1);}
-
-      sdsname = CPLStrdup(CSLFetchNameValue(sds, KeyName));
-      subDS = GDALOpen(sdsname, GA_ReadOnly);
-      nx = GDALGetRasterXSize(subDS); 
-      ny = GDALGetRasterYSize(subDS);
-      alloc((void**)&PW, nx*ny, sizeof(short));
-      band = GDALGetRasterBand(subDS, 1);
-      if (GDALRasterIO(band, GF_Read,  0, 0, nx, ny, 
-            PW, nx, ny, GDT_Int16, 0, 0) == CE_Failure){
-        printf("could not read image. "); return;}
-      CPLFree(sdsname);
-
-      // read some metadata
-      metadata = GDALGetMetadata(subDS, "GEOLOCATION");
-      yoff = atoi(CSLFetchNameValue(metadata,"LINE_OFFSET"));
-      xoff = atoi(CSLFetchNameValue(metadata,"PIXEL_OFFSET"));
-      //CSLDestroy(metadata);
+    if (hdf_local[l][0] == '\0' || !fileexist(hdf_local[l])) continue;
+    copy_string(fullname, NPOW_10, hdf_local[l]);
+
+    // open input dataset
+    if ((hdfDS = GDALOpenEx(fullname, GA_ReadOnly, 
+                            NULL, 
+                            (const char *const *)sdsopenoptions, 
+                            NULL)) == NULL){
+      printf("unable to open image %s\n", fullname); exit(1);
+    } else {
+      //free((void*)hdfname); hdfname = NULL;
+    }
+
+    // get SDS listing
+    sds = GDALGetMetadata(hdfDS, "SUBDATASETS");
+    if (CSLCount(sds) == 0){
+      printf("unable to retrieve SDS list.\n"); exit(1);}
+
+
+
+    // read NIR water vapour retrieval
+    nchar = snprintf(KeyName, NPOW_10, "SUBDATASET_%d_NAME", pwvp);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling hdf sds name\n"); exit(1);}
+
+    sdsname = CPLStrdup(CSLFetchNameValue(sds, KeyName));
+    subDS = GDALOpen(sdsname, GA_ReadOnly);
+    nx = GDALGetRasterXSize(subDS); 
+    ny = GDALGetRasterYSize(subDS);
+    alloc((void**)&PW, nx*ny, sizeof(short));
+    band = GDALGetRasterBand(subDS, 1);
+    if (GDALRasterIO(band, GF_Read,  0, 0, nx, ny, 
+          PW, nx, ny, GDT_Int16, 0, 0) == CE_Failure){
+      printf("could not read image. "); return;}
+    CPLFree(sdsname);
+
+    // read some metadata
+    metadata = GDALGetMetadata(subDS, "GEOLOCATION");
+    yoff = atoi(CSLFetchNameValue(metadata,"LINE_OFFSET"));
+    xoff = atoi(CSLFetchNameValue(metadata,"PIXEL_OFFSET"));
+    //CSLDestroy(metadata);
+    
+    metadata = GDALGetMetadata(subDS, NULL);
+    voff = atof(CSLFetchNameValue(metadata,"add_offset"));
+    vscl = atof(CSLFetchNameValue(metadata,"scale_factor"));
+    fill = atoi(CSLFetchNameValue(metadata,"_FillValue"));
+    //CSLDestroy(metadata);
+    GDALClose(subDS);
+
+    // read latitude
+    nchar = snprintf(KeyName, NPOW_10, "SUBDATASET_%d_NAME", plat);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling hdf sds name\n"); exit(1);}
+
+    sdsname = CPLStrdup(CSLFetchNameValue(sds, KeyName));
+    subDS = GDALOpen(sdsname, GA_ReadOnly);
+    nxc = GDALGetRasterXSize(subDS); 
+    nyc = GDALGetRasterYSize(subDS);
+    alloc((void**)&LAT, nxc*nyc, sizeof(float));
+    band = GDALGetRasterBand(subDS, 1);
+    if (GDALRasterIO(band, GF_Read,  0, 0, nxc, nyc, 
+          LAT, nxc, nyc, GDT_Float32, 0, 0) == CE_Failure){
+      printf("could not read image. "); return;}
+    GDALClose(subDS);
+    CPLFree(sdsname);
+
+    // read longitude
+    nchar = snprintf(KeyName, NPOW_10, "SUBDATASET_%d_NAME", plon);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling hdf sds name\n"); exit(1);}
       
-      metadata = GDALGetMetadata(subDS, NULL);
-      voff = atof(CSLFetchNameValue(metadata,"add_offset"));
-      vscl = atof(CSLFetchNameValue(metadata,"scale_factor"));
-      fill = atoi(CSLFetchNameValue(metadata,"_FillValue"));
-      //CSLDestroy(metadata);
-      GDALClose(subDS);
-
-      // read latitude
-      nchar = snprintf(KeyName, NPOW_10, "SUBDATASET_%d_NAME", plat);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling hdf sds name\n"); exit(1);}
-
-      sdsname = CPLStrdup(CSLFetchNameValue(sds, KeyName));
-      subDS = GDALOpen(sdsname, GA_ReadOnly);
-      nxc = GDALGetRasterXSize(subDS); 
-      nyc = GDALGetRasterYSize(subDS);
-      alloc((void**)&LAT, nxc*nyc, sizeof(float));
-      band = GDALGetRasterBand(subDS, 1);
-      if (GDALRasterIO(band, GF_Read,  0, 0, nxc, nyc, 
-            LAT, nxc, nyc, GDT_Float32, 0, 0) == CE_Failure){
-        printf("could not read image. "); return;}
-      GDALClose(subDS);
-      CPLFree(sdsname);
-
-      // read longitude
-      nchar = snprintf(KeyName, NPOW_10, "SUBDATASET_%d_NAME", plon);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling hdf sds name\n"); exit(1);}
-        
-      sdsname = CPLStrdup(CSLFetchNameValue(sds, KeyName));
-      subDS = GDALOpen(sdsname, GA_ReadOnly);
-      alloc((void**)&LON, nxc*nyc, sizeof(float));
-      band = GDALGetRasterBand(subDS, 1);
-      if (GDALRasterIO(band, GF_Read,  0, 0, nxc, nyc, 
-            LON, nxc, nyc, GDT_Float32, 0, 0) == CE_Failure){
-        printf("could not read image. "); return;}
-      GDALClose(subDS);
-      CPLFree(sdsname);
-
-      // read cloud state
-      nchar = snprintf(KeyName, NPOW_10, "SUBDATASET_%d_NAME", pcld);
-      if (nchar < 0 || nchar >= NPOW_10){ 
-        printf("Buffer Overflow in assembling hdf sds name\n"); exit(1);}
+    sdsname = CPLStrdup(CSLFetchNameValue(sds, KeyName));
+    subDS = GDALOpen(sdsname, GA_ReadOnly);
+    alloc((void**)&LON, nxc*nyc, sizeof(float));
+    band = GDALGetRasterBand(subDS, 1);
+    if (GDALRasterIO(band, GF_Read,  0, 0, nxc, nyc, 
+          LON, nxc, nyc, GDT_Float32, 0, 0) == CE_Failure){
+      printf("could not read image. "); return;}
+    GDALClose(subDS);
+    CPLFree(sdsname);
+
+    // read cloud state
+    nchar = snprintf(KeyName, NPOW_10, "SUBDATASET_%d_NAME", pcld);
+    if (nchar < 0 || nchar >= NPOW_10){ 
+      printf("Buffer Overflow in assembling hdf sds name\n"); exit(1);}
 
-      sdsname = CPLStrdup(CSLFetchNameValue(sds, KeyName));
-      subDS = GDALOpen(sdsname, GA_ReadOnly);
-      alloc((void**)&CLD, nx*ny, sizeof(small));
-      band = GDALGetRasterBand(subDS, 1);
-      if (GDALRasterIO(band, GF_Read,  0, 0, nx, ny, 
-            CLD, nx, ny, GDT_Byte, 0, 0) == CE_Failure){
-        printf("could not read image. "); return;}
-      GDALClose(subDS);
-      CPLFree(sdsname);
+    sdsname = CPLStrdup(CSLFetchNameValue(sds, KeyName));
+    subDS = GDALOpen(sdsname, GA_ReadOnly);
+    alloc((void**)&CLD, nx*ny, sizeof(small));
+    band = GDALGetRasterBand(subDS, 1);
+    if (GDALRasterIO(band, GF_Read,  0, 0, nx, ny, 
+          CLD, nx, ny, GDT_Byte, 0, 0) == CE_Failure){
+      printf("could not read image. "); return;}
+    GDALClose(subDS);
+    CPLFree(sdsname);
 
-      //CSLDestroy(sds);
-      GDALClose(hdfDS);
+    //CSLDestroy(sds);
+    GDALClose(hdfDS);
 
 
-      // sum up precipitable water for mean
-      for (y=yoff, yc=0, yct=1; y<ny; y++){
-      for (x=xoff, xc=0, xct=1; x<nx; x++){
-       
-        pos  = nx*y+x;
-        posc = nxc*yc+xc;
+    // sum up precipitable water for mean, for each coordinate that uses this granule
+    #pragma omp parallel private(y, yc, yct, x, xc, xct, pos, posc, wlon, elon, nlat, slat, bit, val) shared(l, nc, nx, ny, nxc, xoff, yoff, voff, vscl, fill, use, COO, PW, CLD, LAT, LON, sumwvp, ctrwvp, ctrall) default(none)
+    {
 
-        //if in frame
-        if (LON[posc] >= wlon && LON[posc] <= elon &&
-          LAT[posc] <= nlat && LAT[posc] >= slat){
+      #pragma omp for schedule(dynamic)
+      for (c=0; c<nc; c++){
 
-          if (PW[pos] != fill){
+        if (!use[l][c]) continue;
 
-            int2bit(CLD[pos], bit, 0, 8);
+        // estimate average of wvp in a 1.5 x 1.5 box
+        wlon = COO[0][c]-0.75; elon = COO[0][c]+0.75;
+        nlat = COO[1][c]+0.75; slat = COO[1][c]-0.75;
 
-            if (bit[2] && bit[4]){
-              val = vscl*(PW[pos]-voff);
-              sumwvp += val;
-              ctrwvp++;
-            }
+        for (y=yoff, yc=0, yct=1; y<ny; y++){
+        for (x=xoff, xc=0, xct=1; x<nx; x++){
+         
+          pos  = nx*y+x;
+          posc = nxc*yc+xc;
+
+          //if in frame
+          if (LON[posc] >= wlon && LON[posc] <= elon &&
+            LAT[posc] <= nlat && LAT[posc] >= slat){
+
+            if (PW[pos] != fill){
+
+              int2bit(CLD[pos], bit, 0, 8);
+
+              if (bit[2] && bit[4]){
+                val = vscl*(PW[pos]-voff);
+                sumwvp[c] += val;
+                ctrwvp[c]++;
+              }
 
+            }
+            ctrall[c]++;
           }
-          ctrall[c]++;
+
+          if ((xct++) >= 5){ xct = 1; xc++;}
+        }
+        if ((yct++) >= 5){ yct = 1; yc++;}
         }
 
-        if ((xct++) >= 5){ xct = 1; xc++;}
       }
-      if ((yct++) >= 5){ yct = 1; yc++;}
-      }
-
-      free((void*)PW); free((void*)CLD);
-      free((void*)LAT); free((void*)LON);
 
     }
 
-    // only calculate average if at least 10% of in-frame pixels were valid
-    if (ctrall[c] > 0 && ctrwvp >= ctrall[c]/10){
-      average[c] = sumwvp/ctrwvp;
-    } else average[c] = 9999;
+    free((void*)PW); free((void*)CLD);
+    free((void*)LAT); free((void*)LON);
 
-    free((void*)ptr);
+  }
+
+  // only calculate average if at least 10% of in-frame pixels were valid
+  for (c=0; c<nc; c++){
+    if (ctrall[c] > 0 && ctrwvp[c] >= ctrall[c]/10){
+      average[c] = sumwvp[c]/ctrwvp[c];
+    } else average[c] = 9999;
   }
 
   // free memory
+  free_2D((void**)use, nl);
+  free_2D((void**)hdf_remote, nl);
+  free_2D((void**)hdf_local,  nl);
+  free((void*)sumwvp); free((void*)ctrwvp);
   free_3D((void***)gr, NPOW_10, 2);
   free_2D((void**)id, NPOW_10);
   free((void*)v);
@@ -1009,9 +1081,11 @@ float x, y;
 --- COO:       Coordinate array
 --- WVP:       Water vapor array
 --- SEN:       Sensor source array
+--- key:       App key
+--- nconn:     Number of concurrent downloads
 +++ Return:    void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-void create_wvp_lut(char *dir_geo, char *dir_hdf, char *tablename, date_t d_now, int nc, float **COO, float *WVP, char **SEN, char *key){
+void create_wvp_lut(char *dir_geo, char *dir_hdf, char *tablename, date_t d_now, int nc, float **COO, float *WVP, char **SEN, char *key, int nconn){
 char ftpname[NPOW_10], locname[NPOW_10];
 int nchar;
 int c, try__, nvalid, curl;
@@ -1059,7 +1133,7 @@ double *modavg, *mydavg, *modctr, *mydctr;
   printf("\n");
 
   // compile water vapour
-  compile_modis_wvp(dir_geo, dir_hdf, d_now, "MOD", nc, COO, &modavg, &modctr, key);
+  compile_modis_wvp(dir_geo, dir_hdf, d_now, "MOD", nc, COO, &modavg, &modctr, key, nconn);
 
   if (aqua){
 
@@ -1094,7 +1168,7 @@ double *modavg, *mydavg, *modctr, *mydctr;
   printf("\n");
 
   // compile water vapour
-  if (aqua) compile_modis_wvp(dir_geo, dir_hdf, d_now, "MYD", nc, COO, &mydavg, &mydctr, key);
+  if (aqua) compile_modis_wvp(dir_geo, dir_hdf, d_now, "MYD", nc, COO, &mydavg, &mydctr, key, nconn);
 
   // choose between TERRA and AQUA
   choose_modis_wvp(aqua, nc, WVP, SEN, modavg, mydavg, modctr, mydctr);
@@ -51,12 +51,12 @@ int failure_aqua(date_t d);
 int read_modis_geometa(char *fname, char ***fid, float ****gr, bool **v, int *nl, int *nv);
 int modis_intersect(float lat, float lon, float ***gr, bool *v, int nl, int nv, int **ptr);
 int modis_inside(float lat, float lon, float ***gr, int nintersect, int *ptr);
-void compile_modis_wvp(char *dir_geo, char *dir_hdf, date_t d_now, char *sen, int nc, float **COO, double **avg, double **count, char *key);
+void compile_modis_wvp(char *dir_geo, char *dir_hdf, date_t d_now, char *sen, int nc, float **COO, double **avg, double **count, char *key, int nconn);
 void choose_modis_wvp(bool aqua, int nc, float *WVP, char **SEN, double *modavg, double *mydavg, double *modctr, double *mydctr);
 void write_wvp_lut(char *fname, int nc, float **COO, float *WVP, char **SEN);
 void write_avg_table(char *dir_wvp, int nc, float **COO, double ***AVG);
 void read_wvp_lut(char *fname, int nc, float **COO, float *WVP);
-void create_wvp_lut(char *dir_geo, char *dir_hdf, char *tablename, date_t d_now, int nc, float **COO, float *WVP, char **SEN, char *key);
+void create_wvp_lut(char *dir_geo, char *dir_hdf, char *tablename, date_t d_now, int nc, float **COO, float *WVP, char **SEN, char *key, int nconn);
 
 #ifdef __cplusplus
 }
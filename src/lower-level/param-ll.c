@@ -72,6 +72,8 @@ void register_lower(params_t *params, par_ll_t *pl2){
   register_bool_par(params,    "IMPULSE_NOISE",         &pl2->impulse);
   register_bool_par(params,    "BUFFER_NODATA",         &pl2->bufnodata);
   register_int_par(params,     "DEM_NODATA",            SHRT_MIN, SHRT_MAX, &pl2->dem_nodata);
+  register_char_par(params,    "DIR_DEM_CACHE",         _CHAR_TEST_NULL_OR_EXIST_, &pl2->d_demcache);
+  register_char_par(params,    "DIR_COREG_CACHE",       _CHAR_TEST_NULL_OR_EXIST_, &pl2->d_coregcache);
   register_int_par(params,     "COREG_BASE_NODATA",     SHRT_MIN, SHRT_MAX, &pl2->coreg_nodata);
   register_bool_par(params,    "ERASE_CLOUDS",          &pl2->erase_cloud);
   register_float_par(params,   "MAX_CLOUD_COVER_FRAME", 1, 100, &pl2->maxcc);
@@ -86,6 +88,8 @@ void register_lower(params_t *params, par_ll_t *pl2){
   register_bool_par(params,    "PARALLEL_READS",        &pl2->ithread);
   register_int_par(params,     "DELAY",                 0, INT_MAX, &pl2->delay);
   register_int_par(params,     "TIMEOUT_ZIP",           0, INT_MAX, &pl2->timeout);
+  register_intvec_par(params,  "GPU_DEVICES",           -1, GPU_MAXDEVICE-1, &pl2->gpu_device, &pl2->ngpu_device);
+  register_enum_par(params,    "NUMA_MODE",             _TAGGED_ENUM_NUMA_, _NUMA_LENGTH_, &pl2->numa_mode);
   register_char_par(params,    "FILE_OUTPUT_OPTIONS",   _CHAR_TEST_NULL_OR_EXIST_, &pl2->f_gdalopt);
   register_enum_par(params,    "OUTPUT_FORMAT",         _TAGGED_ENUM_FMT_, _FMT_LENGTH_, &pl2->format);
   register_bool_par(params,    "OUTPUT_DST",            &pl2->odst);
@@ -94,6 +98,8 @@ void register_lower(params_t *params, par_ll_t *pl2){
   register_bool_par(params,    "OUTPUT_VZN",            &pl2->ovzn);
   register_bool_par(params,    "OUTPUT_HOT",            &pl2->ohot);
   register_bool_par(params,    "OUTPUT_OVV",            &pl2->oovv);
+  register_bool_par(params,    "OUTPUT_CHUNK_STORE",    &pl2->ofcf);
+  register_bool_par(params,    "OUTPUT_PROFILE",        &pl2->oprf);
 
   return;
 }
@@ -150,20 +156,17 @@ void free_param_lower(par_ll_t *pl2){
 }
 
 
-/** This function parses the Level 2 parameters
+/** This function resolves the Level 1 input of a single image, i.e. it
++++ dives down a Sentinel-2 .SAFE directory and sets the basename
 --- pl2:    L2 parameters
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int parse_param_lower(par_ll_t *pl2){
-FILE *fpar = NULL;
-char  buffer[NPOW_16] = "\0";
+int parse_level1_input(par_ll_t *pl2){
 char  ext[NPOW_10] = "\0";
 char  bname[NPOW_10] = "\0";
 
 
-  pl2->params = allocate_params();
-  
-  if (pl2->d_level1 != NULL){
+  if (strlen(pl2->d_level1) > 0){
     
     // if .SAFE directory (S2) was given, use 1st granule
     extension(pl2->d_level1, ext, NPOW_10);
@@ -184,6 +187,25 @@ char  bname[NPOW_10] = "\0";
   } else {
     printf("No input image given!\n"); return FAILURE;}
 
+  return SUCCESS;
+}
+
+
+/** This function parses the Level 2 parameters. The Level 1 input is on-
++++ ly resolved if given, i.e. not in batch mode, where the images are
++++ taken from the file queue
+--- pl2:    L2 parameters
++++ Return: SUCCESS/FAILURE
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int parse_param_lower(par_ll_t *pl2){
+FILE *fpar = NULL;
+char  buffer[NPOW_16] = "\0";
+
+
+  pl2->params = allocate_params();
+  
+  if (strlen(pl2->d_level1) > 0 && parse_level1_input(pl2) != SUCCESS) return FAILURE;
+
 
   // open parameter file
   if ((fpar = fopen(pl2->f_par, "r")) == NULL){
@@ -57,6 +57,8 @@ typedef struct {
   char *f_queue;          // file queue
   char *d_aod;            // directory of AOD LUT
   char *d_wvp;            // directory of water vapor LUT
+  char *d_demcache;       // directory of DEM cache
+  char *d_coregcache;     // directory of coregistration base cache
   char *f_gdalopt;        // file for GDAL options
 
   /** output parameters **/
@@ -68,6 +70,8 @@ typedef struct {
   int oaod;   // flag: output AOD @ 550nm
   int owvp;   // flag: output water vapor
   int oovv;   // flag: output product overview
+  int ofcf;   // flag: output FORCE chunk format alongside
+  int oprf;   // flag: output processing profile
 
   /** projection/tiling parameters **/
   int dotile;         // flag: tile
@@ -118,11 +122,15 @@ typedef struct {
   int ithread; // use threads for reading bands in parallel?
   int delay;   // delay for starting a new process
   int timeout;   // delay for starting a new process
+  int *gpu_device;   // CUDA devices, -1: none
+  int ngpu_device;   // number of CUDA devices
+  int numa_mode;     // NUMA placement
   
 } par_ll_t;
 
 par_ll_t *allocate_param_lower();
 void free_param_lower(par_ll_t *pl2);
+int parse_level1_input(par_ll_t *pl2);
 int parse_param_lower(par_ll_t *pl2);
 
 #ifdef __cplusplus
@@ -302,6 +302,8 @@ double a, s;
   tmp = w/m;
 
   for (wvl=0, a=0, s=0; wvl<_WVL_DIM_; wvl++){
+    // outside of the band, there is nothing to integrate
+    if (_RSR_[b_rsr][wvl] == 0) continue;
     tmp2 = _AW_[wvl]*tmp;
     a += _RSR_[b_rsr][wvl]*
             exp((-1.2110662*tmp2)/pow(1+24.1229127*tmp2, 0.3669996));
@@ -329,6 +331,7 @@ double a, s;
   tmp = -o/m;
 
   for (wvl=0, a=0, s=0; wvl<_WVL_DIM_; wvl++){
+    if (_RSR_[b_rsr][wvl] == 0) continue;
     a += _RSR_[b_rsr][wvl]*exp(_AO_[wvl]*tmp);
     s += _RSR_[b_rsr][wvl];
   }
@@ -27,8 +27,19 @@ This file contains functions for reading Level 1 data
 
 #include "read-ll.h"
 
+int bounds_level1_gpu(l1_gpu_t *gpu, brick_t *QAI, small *off_, int *tvalid);
 
-/** This function reads all necessary or available Level 1 data
+// per-pixel state while testing the bands
+enum { _BOUNDS_OPEN_, _BOUNDS_OFF_, _BOUNDS_SAT_ };
+int convert_level1_gpu(meta_t *meta, int mission, atc_t *atc, l1_gpu_t *gpu, brick_t *DN, brick_t *TOA, brick_t *QAI);
+
+
+/** This function reads all necessary or available Level 1 data. With
++++ parallel reads, each band is decoded by its own thread with its own
++++ dataset handle, and the decoder threads of the GDAL drivers (e.g. 
++++ JPEG2000) share the remaining threads. The GDAL block cache is large
++++ enough to keep one row of blocks of each band that is decoded at the
++++ same time.
 --- meta:    metadata
 --- mission: mission ID
 --- DN:      Digital Numbers
@@ -38,13 +49,17 @@ This file contains functions for reading Level 1 data
 int read_level1(meta_t *meta, int mission, brick_t *DN, par_ll_t *pl2){
 int b, nb, nx, ny, nc;
 int nx_, ny_, xoff_ = 0, yoff_ = 0;
+int bx, by;
 float res, res_;
 double geotran[6];
 ushort **dn_ = NULL;
-GDALDatasetH dataset;
+GDALDatasetH *dataset = NULL;
 GDALRasterBandH band;
+GIntBig row, rowmax = 0;
 int error = 0;
-int threads;
+int threads, decoder;
+char ndecoder[NPOW_04];
+int nchar;
 
 
   #ifdef FORCE_CLOCK
@@ -75,28 +90,55 @@ int threads;
     threads = 1;
   }
 
+  // decoder threads per band
+  if ((decoder = pl2->nthread/threads) < 1) decoder = 1;
+  nchar = snprintf(ndecoder, NPOW_04, "%d", decoder);
+  if (nchar < 0 || nchar >= NPOW_04){ 
+    printf("Buffer Overflow in assembling threads\n"); return FAILURE;}
+
+
+  // open all bands, and get the size of one row of blocks
+  alloc((void**)&dataset, nb, sizeof(GDALDatasetH));
+
+  for (b=0; b<nb; b++){
+
+    if ((dataset[b] = GDALOpen(meta->cal[b].fname, GA_ReadOnly)) == NULL){
+      printf("unable to open %s. ", meta->cal[b].fname); error++; continue;}
+      
+    #ifdef FORCE_DEBUG
+    GDALDriverH driver = GDALGetDatasetDriver(dataset[b]);
+    printf("Driver: %s/%s\n", GDALGetDriverShortName(driver), GDALGetDriverLongName(driver));
+    #endif
+
+    band = GDALGetRasterBand(dataset[b], 1);
+    GDALGetBlockSize(band, &bx, &by);
+    row = (GIntBig)GDALGetRasterXSize(dataset[b])*by*sizeof(ushort);
+    if (row > rowmax) rowmax = row;
 
-  #pragma omp parallel  num_threads(threads) private(dataset,band,nx_,ny_,geotran,res_) firstprivate(xoff_,yoff_) shared(dn_,nb,meta,mission,nx,ny,res) reduction(+: error) default(none)
+  }
+
+  if (error > 0){
+    for (b=0; b<nb; b++){ if (dataset[b] != NULL) GDALClose(dataset[b]);}
+    free((void*)dataset);
+    printf("reading error. "); return FAILURE;
+  }
+
+  // block cache for all concurrently decoded bands
+  if (GDALGetCacheMax64() < threads*rowmax) GDALSetCacheMax64(threads*rowmax);
+
+
+  #pragma omp parallel num_threads(threads) private(band,nx_,ny_,geotran,res_) firstprivate(xoff_,yoff_) shared(dn_,dataset,nb,meta,mission,nx,ny,res,ndecoder) reduction(+: error) default(none)
   {
+
+    CPLSetThreadLocalConfigOption("GDAL_NUM_THREADS", ndecoder);
  
-    #pragma omp for
+    #pragma omp for schedule(dynamic,1)
     for (b=0; b<nb; b++){
 
-      if ((dataset = GDALOpen(meta->cal[b].fname, GA_ReadOnly)) == NULL){
-        printf("unable to open %s. ", meta->cal[b].fname); error++;
-      }// else {
-        //CPLPopErrorHandler();
-      //}
-      
-      #ifdef FORCE_DEBUG
-      GDALDriverH driver = GDALGetDatasetDriver(dataset);
-      printf("Driver: %s/%s\n", GDALGetDriverShortName(driver), GDALGetDriverLongName(driver));
-      #endif
-
       // get number of pixels, GDAL handles conversion to nx, ny
-      nx_ = GDALGetRasterXSize(dataset);
-      ny_ = GDALGetRasterYSize(dataset);
-      GDALGetGeoTransform(dataset, geotran);
+      nx_ = GDALGetRasterXSize(dataset[b]);
+      ny_ = GDALGetRasterYSize(dataset[b]);
+      GDALGetGeoTransform(dataset[b], geotran);
       res_ = geotran[1];
 
       if (mission == SENTINEL2){
@@ -110,16 +152,20 @@ int threads;
         #endif
       }
 
-      band = GDALGetRasterBand(dataset, 1);
+      band = GDALGetRasterBand(dataset[b], 1);
       if (GDALRasterIO(band, GF_Read, xoff_, yoff_, nx_, ny_, dn_[b], 
         nx, ny, GDT_UInt16, 0, 0) == CE_Failure){
         printf("could not read %s. ", meta->cal[b].fname); error++;}
 
-      GDALClose(dataset);
+      GDALClose(dataset[b]);
 
     }
 
+    CPLSetThreadLocalConfigOption("GDAL_NUM_THREADS", NULL);
+
   }
+
+  free((void*)dataset);
   
   if (error > 0){
     printf("reading error. "); return FAILURE;}
@@ -137,16 +183,45 @@ int threads;
 }
 
 
+/** This function prepares the Level 1 conversion on the GPU, i.e. the 
++++ digital numbers are uploaded once for bounds_level1 and convert_level1.
+--- meta:    metadata
+--- mission: mission ID
+--- DN:      digital numbers
+--- gpu:     Level 1 conversion on the GPU (returned)
++++ Return:  true if the GPU is used
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool open_level1_gpu(meta_t *meta, int mission, brick_t *DN, l1_gpu_t *gpu){
+
+
+  memset(gpu, 0, sizeof(l1_gpu_t));
+
+  if (!gpu_enabled()) return false;
+
+  gpu->b_temp    = find_domain(DN, "TEMP");
+  gpu->b_cirrus  = find_domain(DN, "CIRRUS");
+  gpu->sat       = meta->sat;
+  gpu->sentinel2 = (mission == SENTINEL2);
+  gpu->nodata    = -9999;
+
+  return level1_gpu_open(gpu, DN) == SUCCESS;
+}
+
+
 /** This function detects extreme values and builds the nodata and satu-
 +++ ration masks.
 --- meta:   metadata
+--- gpu:    Level 1 conversion on the GPU (or NULL)
 --- DN:     digital numbers
 --- QAI:    Quality Assurance Information
 --- pl2:    L2 parameters
 +++ Return: void
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int bounds_level1(meta_t *meta, brick_t *DN, brick_t **QAI, par_ll_t *pl2){
+int bounds_level1(meta_t *meta, l1_gpu_t *gpu, brick_t *DN, brick_t **QAI, par_ll_t *pl2){
 int b, b_temp, b_cirrus, nb, p, nx, ny, nc;
+int i, j;
+ushort *dn_row = NULL;
+small  *state  = NULL;
 brick_t *qai  = NULL;
 ushort **dn_  = NULL;
 small   *off_ = NULL;
@@ -184,25 +259,57 @@ int tvalid = 0;
   alloc((void**)&off_, nc, sizeof(small));
 
 
-  #pragma omp parallel private(b) shared(b_temp, b_cirrus, nb, nc, dn_, off_, qai, meta) reduction(+:tvalid) default(none) 
-  {
+  if (gpu != NULL && bounds_level1_gpu(gpu, qai, off_, &tvalid) == SUCCESS){
 
-    #pragma omp for schedule(static)
-    for (p=0; p<nc; p++){
+    // masks were computed on the device, the DNs stay there
+
+  } else {
+
+    // one row of all bands is tested in one go. Each pixel is decided by
+    // the first band that is void or saturated, like a per-pixel loop 
+    // over the bands, but every band is read contiguously
+    #pragma omp parallel private(i, j, p, b, dn_row, state) shared(b_temp, b_cirrus, nb, nx, ny, dn_, off_, qai, meta) reduction(+:tvalid) default(none) 
+    {
+
+      alloc((void**)&state, nx, sizeof(small));
+
+      #pragma omp for schedule(static)
+      for (i=0; i<ny; i++){
+
+        memset(state, _BOUNDS_OPEN_, nx*sizeof(small));
+
+        for (b=0; b<nb; b++){
 
-      for (b=0; b<nb; b++){
+          dn_row = dn_[b] + i*nx;
 
-        // if any layer void --> boundary
-        if (b != b_cirrus && dn_[b][p] == 0){ off_[p] = true; break;}
+          for (j=0; j<nx; j++){
 
-        // if any (non-temp) layer saturated
-        if (b != b_temp && dn_[b][p] >= meta->sat){ set_saturation(qai, p, true); break;}
+            if (state[j] != _BOUNDS_OPEN_) continue;
 
-        // if temperature has any non-0 value
-        if (b == b_temp) tvalid++;
+            // if any layer void --> boundary
+            if (b != b_cirrus && dn_row[j] == 0){ state[j] = _BOUNDS_OFF_; continue;}
+
+            // if any (non-temp) layer saturated
+            if (b != b_temp && dn_row[j] >= meta->sat){ state[j] = _BOUNDS_SAT_; continue;}
+
+            // if temperature has any non-0 value
+            if (b == b_temp) tvalid++;
+
+          }
+
+        }
+
+        for (j=0, p=i*nx; j<nx; j++, p++){
+          if (state[j] == _BOUNDS_OFF_) off_[p] = true;
+          if (state[j] == _BOUNDS_SAT_) set_saturation(qai, p, true);
+        }
 
       }
+
+      free((void*)state);
+
     }
+
   }
 
 
@@ -231,6 +338,39 @@ int tvalid = 0;
 }
 
 
+/** This function builds the nodata and saturation masks on the GPU. If
++++ the device fails, the masks are reset, such that the host can take 
++++ over.
+--- gpu:    Level 1 conversion on the GPU
+--- QAI:    Quality Assurance Information
+--- off_:   nodata mask (returned)
+--- tvalid: temperature has any valid value? (returned)
++++ Return: SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int bounds_level1_gpu(l1_gpu_t *gpu, brick_t *QAI, small *off_, int *tvalid){
+small *sat_ = NULL;
+int p, nc, err;
+
+
+  nc = get_brick_ncells(QAI);
+
+  alloc((void**)&sat_, nc, sizeof(small));
+
+  if ((err = level1_gpu_bounds(gpu, off_, sat_, tvalid)) == SUCCESS){
+    for (p=0; p<nc; p++){
+      if (sat_[p]) set_saturation(QAI, p, true);
+    }
+  } else {
+    memset(off_, 0, nc*sizeof(small));
+    *tvalid = 0;
+  }
+
+  free((void*)sat_);
+
+  return err;
+}
+
+
 /** This function attempts to detect and mask Impulse Noise, a phenomenon
 +++ observed in 8bit Landsat data. The first three bands (RGB) are used
 +++ to detect this. Note that IN is not confined to these bands and small
@@ -330,21 +470,31 @@ ushort **dn_  = NULL;
 +++ ness Temperature. In case of Sentinel-2, TOA reflectance is first re-
 +++ transformed to DNs before it is converted to TOA reflectance again.
 +++ This is done to maintain a constant calibration between sensors and
-+++ to retain the flexibility to e.g. use another E0 spectrum.
++++ to retain the flexibility to e.g. use another E0 spectrum. The con-
++++ version is done in place, i.e. the TOA brick takes over the memory of
++++ the DN brick (ushort and short have the same size), and the DN bands
++++ are released.
 --- meta:    metadata
 --- mission: mission ID
 --- atc:     atmospheric correction factors
---- DN:      digital numbers
+--- gpu:     Level 1 conversion on the GPU (or NULL)
+--- DN:      digital numbers (bands are released)
 --- TOA:     Top of Atmosphere reflectance and temperature
 --- QAI:     Quality Assurance Information
 +++ Return:  SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int convert_level1(meta_t *meta, int mission, atc_t *atc, brick_t *DN, brick_t **toa, brick_t *QAI){
+int convert_level1(meta_t *meta, int mission, atc_t *atc, l1_gpu_t *gpu, brick_t *DN, brick_t **toa, brick_t *QAI){
 brick_t  *TOA  = NULL;
 ushort **dn_  = NULL;
 short  **toa_ = NULL;
 float    *sun_ = NULL;
-int b, b_temp, b_cirrus, nb, nc, p, g;
+int b, b_temp, b_cirrus, nb, nc, p;
+int i, j, nx, ny, gi;
+int *gcol = NULL;
+small *off_row = NULL;
+float *sun_row = NULL;
+float *toa_row = NULL;
+int err;
 short nodata;
 float A, rad, dsun, pi_dsun2, tmp;
 float dn_scale, toa_scale;
@@ -359,7 +509,7 @@ float dn_scale, toa_scale;
   nc = get_brick_ncells(DN);
   nodata = -9999;
 
-  TOA = copy_brick(DN, nb, _DT_SHORT_);
+  TOA = copy_brick(DN, nb, _DT_NONE_);
   
   // temperature band?
   b_temp   = find_domain(TOA, "TEMP");
@@ -382,12 +532,29 @@ float dn_scale, toa_scale;
   }
 
 
-  // get brick arrays for faster computation
+  // get brick arrays for faster computation, TOA is written to DN's 
+  // memory (each value is read before it is overwritten)
   if ((dn_  = get_bands_ushort(DN)) == NULL) return FAILURE;
+  if (move_brick_bands(TOA, DN, _DT_SHORT_) == FAILURE) return FAILURE;
   if ((toa_ = get_bands_short(TOA)) == NULL) return FAILURE;
   if ((sun_ = get_band_float(atc->xy_sun, cZEN)) == NULL) return FAILURE;
 
 
+  // convert on the device, where the DNs already are. A failure after
+  // the conversion started cannot be recovered, as DN's memory is reused
+  if (gpu != NULL){
+    if ((err = convert_level1_gpu(meta, mission, atc, gpu, DN, TOA, QAI)) == FAILURE){
+      printf("TOA conversion on GPU failed. "); return FAILURE;
+    } else if (err == SUCCESS){
+      #ifdef FORCE_CLOCK
+      proctime_print("Level 1 to TOA conversion", TIME);
+      #endif
+      *toa = TOA;
+      return SUCCESS;
+    }
+  }
+
+
   /** TOA reflectance to TOA reflectance (Sentinel-2) 
   in early processing versions, scale factor was 1000, now 10000 **/
   if (mission == SENTINEL2){
@@ -413,53 +580,92 @@ float dn_scale, toa_scale;
     dsun = doy2dsun(get_brick_doy(TOA, 0));
     pi_dsun2  = M_PI*dsun*dsun;
 
-    for (b=0; b<nb; b++){
+    nx = get_brick_ncols(TOA);
+    ny = get_brick_nrows(TOA);
 
-      toa_scale = get_brick_scale(TOA, b);
+    // column of the coarse sun grid for each image column
+    alloc((void**)&gcol, nx, sizeof(int));
+    for (j=0; j<nx; j++) gcol[j] = convert_brick_ji2p(QAI, atc->xy_sun, 0, j);
 
-      A = (meta->cal[b].lmax-meta->cal[b].lmin) / 
-          (meta->cal[b].qmax-meta->cal[b].qmin);
+    // all bands of one row are converted in one go, such that the nodata 
+    // mask and the sun zenith of the row are gathered once, and stay in 
+    // the cache; the inner loops are free of band-specific branches
+    #pragma omp parallel private(i, j, p, b, gi, A, rad, tmp, toa_scale, off_row, sun_row, toa_row) shared(nx, ny, nb, b_temp, b_cirrus, nodata, dn_, toa_, sun_, gcol, QAI, pi_dsun2, meta, atc, TOA) default(none) 
+    {
 
-      #pragma omp parallel private(rad, tmp, g) shared(b, b_temp, b_cirrus, nc, nodata, toa_scale, dn_, toa_, sun_, QAI, A, pi_dsun2, meta, atc) default(none) 
-      {
+      alloc((void**)&off_row, nx, sizeof(small));
+      alloc((void**)&sun_row, nx, sizeof(float));
+      alloc((void**)&toa_row, nx, sizeof(float));
+
+      #pragma omp for schedule(guided)
+      for (i=0; i<ny; i++){
+
+        // first cell of the coarse sun grid in this row
+        gi = convert_brick_ji2p(QAI, atc->xy_sun, i, 0);
 
-        #pragma omp for schedule(guided)
-        for (p=0; p<nc; p++){
+        for (j=0, p=i*nx; j<nx; j++, p++){
+          off_row[j] = get_off(QAI, p);
+          sun_row[j] = sun_[gi+gcol[j]];
+        }
+
+        for (b=0; b<nb; b++){
 
-          if (get_off(QAI, p)){ toa_[b][p] = nodata; continue;}
+          toa_scale = get_brick_scale(TOA, b);
 
-          // dn to radiance
-          rad = A * (dn_[b][p]-meta->cal[b].qmin) + meta->cal[b].lmin;
+          A = (meta->cal[b].lmax-meta->cal[b].lmin) / 
+              (meta->cal[b].qmax-meta->cal[b].qmin);
 
           // radiance to brightness temperature in kelvin
           if (b == b_temp){
 
-            tmp = meta->cal[b].k2/log((meta->cal[b].k1/rad)+1)*toa_scale;
-            if (tmp < SHRT_MAX){
-              toa_[b][p] = (short)tmp;
-            } else {
-              toa_[b][p] = SHRT_MAX;
+            for (j=0, p=i*nx; j<nx; j++, p++){
+
+              if (off_row[j]){ toa_[b][p] = nodata; continue;}
+
+              // dn to radiance
+              rad = A * (dn_[b][p]-meta->cal[b].qmin) + meta->cal[b].lmin;
+
+              tmp = meta->cal[b].k2/log((meta->cal[b].k1/rad)+1)*toa_scale;
+              toa_[b][p] = (tmp < SHRT_MAX) ? (short)tmp : SHRT_MAX;
+
             }
 
+            continue;
+
+          }
+
           // radiance to reflectance
-          } else {
+          if (meta->cal[b].rmul == meta->cal[b].fill){
+
+            // old-style DN -> radiance -> reflectance conversion
+            #pragma omp simd private(rad)
+            for (j=0; j<nx; j++){
+              rad = A * (dn_[b][i*nx+j]-meta->cal[b].qmin) + meta->cal[b].lmin;
+              toa_row[j] = rad*pi_dsun2 / (atc->E0[b]*sun_row[j]);
+            }
 
-            g = convert_brick_p2p(QAI, atc->xy_sun, p);
+          } else {
 
-            if (meta->cal[b].rmul == meta->cal[b].fill){
-              // old-style DN -> radiance -> reflectance conversion
-              tmp = rad*pi_dsun2 / (atc->E0[b]*sun_[g]);
-            } else {
-              // new DN -> reflectance conversion
-              tmp = (meta->cal[b].radd + meta->cal[b].rmul*dn_[b][p]) / sun_[g];
+            // new DN -> reflectance conversion
+            #pragma omp simd
+            for (j=0; j<nx; j++){
+              toa_row[j] = (meta->cal[b].radd + meta->cal[b].rmul*dn_[b][i*nx+j]) / sun_row[j];
             }
 
-            if (tmp < FLT_MIN){
+          }
+
+          for (j=0, p=i*nx; j<nx; j++, p++){
+
+            tmp = toa_row[j];
+
+            if (off_row[j]){
+              toa_[b][p] = nodata;
+            } else if (tmp < FLT_MIN){
               if (b == b_cirrus){
                 toa_[b][p] = (short)0;
               } else {
                 toa_[b][p] = (short)nodata;
-                set_off(QAI, p, true);
+                off_row[j] = true;
               }
             } else {
               toa_[b][p] = (short)(tmp*toa_scale);
@@ -468,11 +674,21 @@ float dn_scale, toa_scale;
           }
 
         }
-        
+
+        for (j=0, p=i*nx; j<nx; j++, p++){
+          if (off_row[j] && !get_off(QAI, p)) set_off(QAI, p, true);
+        }
+
       }
 
+      free((void*)off_row);
+      free((void*)sun_row);
+      free((void*)toa_row);
+
     }
 
+    free((void*)gcol);
+
   }
 
 
@@ -488,3 +704,68 @@ float dn_scale, toa_scale;
   return SUCCESS;
 }
 
+
+/** This function converts the digital numbers to TOA reflectance and 
++++ brightness temperature on the GPU, see convert_level1.
+--- meta:    metadata
+--- mission: mission ID
+--- atc:     atmospheric correction factors
+--- gpu:     Level 1 conversion on the GPU
+--- DN:      digital numbers
+--- TOA:     Top of Atmosphere reflectance and temperature (modified)
+--- QAI:     Quality Assurance Information
++++ Return:  SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int convert_level1_gpu(meta_t *meta, int mission, atc_t *atc, l1_gpu_t *gpu, brick_t *DN, brick_t *TOA, brick_t *QAI){
+l1_cal_gpu_t *cal = NULL;
+small *off_ = NULL;
+float *sun_ = NULL;
+float dsun;
+int b, nb, nc, p, err;
+
+
+  nb = get_brick_nbands(TOA);
+  nc = get_brick_ncells(TOA);
+
+  if ((sun_ = get_band_float(atc->xy_sun, cZEN)) == NULL) return FAILURE;
+
+  gpu->nf   = get_brick_ncols(atc->xy_sun);
+  gpu->ne   = get_brick_nrows(atc->xy_sun);
+  gpu->fres = get_brick_res(QAI);
+  gpu->gres = get_brick_res(atc->xy_sun);
+
+  dsun = doy2dsun(get_brick_doy(TOA, 0));
+  gpu->pi_dsun2 = M_PI*dsun*dsun;
+
+  alloc((void**)&cal, nb, sizeof(l1_cal_gpu_t));
+
+  for (b=0; b<nb; b++){
+    cal[b].dn_scale  = get_brick_scale(DN,  b);
+    cal[b].toa_scale = get_brick_scale(TOA, b);
+    cal[b].radd      = meta->cal[b].radd;
+    cal[b].rmul      = meta->cal[b].rmul;
+    cal[b].lmin      = meta->cal[b].lmin;
+    cal[b].lmax      = meta->cal[b].lmax;
+    cal[b].qmin      = meta->cal[b].qmin;
+    cal[b].qmax      = meta->cal[b].qmax;
+    cal[b].k1        = meta->cal[b].k1;
+    cal[b].k2        = meta->cal[b].k2;
+    cal[b].E0        = atc->E0[b];
+    cal[b].radiance  = (meta->cal[b].rmul == meta->cal[b].fill);
+  }
+
+  alloc((void**)&off_, nc, sizeof(small));
+  for (p=0; p<nc; p++) off_[p] = get_off(QAI, p);
+
+  if ((err = level1_gpu_convert(gpu, cal, off_, sun_, TOA)) == SUCCESS && mission != SENTINEL2){
+    for (p=0; p<nc; p++){
+      if (off_[p] && !get_off(QAI, p)) set_off(QAI, p, true);
+    }
+  }
+
+  free((void*)cal);
+  free((void*)off_);
+
+  return err;
+}
+
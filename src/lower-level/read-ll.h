@@ -43,6 +43,7 @@ Read Level 1 header
 #include "../lower-level/param-ll.h"
 #include "../lower-level/meta-ll.h"
 #include "../lower-level/atc-ll.h"
+#include "../lower-level/l1-gpu-ll.h"
 
 
 #ifdef __cplusplus
@@ -50,9 +51,10 @@ extern "C" {
 #endif
 
 int read_level1(meta_t *meta, int mission, brick_t *DN, par_ll_t *pl2);
-int bounds_level1(meta_t *meta, brick_t *DN, brick_t **QAI, par_ll_t *pl2);
+bool open_level1_gpu(meta_t *meta, int mission, brick_t *DN, l1_gpu_t *gpu);
+int bounds_level1(meta_t *meta, l1_gpu_t *gpu, brick_t *DN, brick_t **QAI, par_ll_t *pl2);
 int impulse_noise_level1(meta_t *meta, brick_t *DN, brick_t *QAI, par_ll_t *pl2);
-int convert_level1(meta_t *meta, int mission, atc_t *atc, brick_t *DN, brick_t **toa, brick_t *QAI);
+int convert_level1(meta_t *meta, int mission, atc_t *atc, l1_gpu_t *gpu, brick_t *DN, brick_t **toa, brick_t *QAI);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,301 @@
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+This file is part of FORCE - Framework for Operational Radiometric 
+Correction for Environmental monitoring.
+
+Copyright (C) 2013-2020 David Frantz
+
+FORCE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+FORCE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with FORCE.  If not, see <http://www.gnu.org/licenses/>.
+
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+/**+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+This file contains functions for resolution merging on the GPU
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+#include "resmerge-gpu-ll.h"
+
+#include <string.h>  // string handling functions
+
+#ifdef FORCE_CUDA
+#include <cuda_runtime.h> // CUDA runtime API
+#endif
+
+
+#ifdef FORCE_CUDA
+
+#define RSM_GPU_BLOCK  16      // block width
+#define RSM_GPU_SHARED 49152   // usable shared memory per block
+#define RSM_GPU_MAXB   16      // max. number of CR bands
+
+
+/** device functions and kernels
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+// see rescale_weight in resmerge-ll.c
+__device__ double rescale_weight_ll_device(double weight, double minweight, double maxweight){
+
+  if (weight == 0) return 1;
+  if (minweight == maxweight) return 1;
+
+  return 1+exp(25 * ((weight-minweight)/(maxweight-minweight))-7.5);
+}
+
+
+__global__ void improphe_ll_kernel(const short *__restrict__ mr, const short *__restrict__ cr, 
+  const small *__restrict__ valid, const float *__restrict__ kdist, short *pred, 
+  int nx, int ny, int h, int nb_m, int nb_c, int mink, int tiled){
+extern __shared__ short tile[];
+int tw = blockDim.x+2*h, tn = tw*tw;
+small *vtile = (small*)(tile + (size_t)nb_m*tn);
+int i0 = blockIdx.y*blockDim.y - h;
+int j0 = blockIdx.x*blockDim.x - h;
+int i  = blockIdx.y*blockDim.y + threadIdx.y;
+int j  = blockIdx.x*blockDim.x + threadIdx.x;
+size_t nc = (size_t)nx*ny, np, bs;
+const short *M = NULL;
+const small *V = NULL;
+int vw, oi, oj, ci, ni, nj, ni0, ni1, nj0, nj1, idx, k, b, f, s, Sc, wn = 0;
+double S, SS, W, sum, weight = 0.0;
+double Srange[2][RSM_NS];
+double weightxdata[RSM_GPU_MAXB];
+const float Sthr[RSM_NS] = { 0.0025, 0.005, 0.01, 0.02, 0.025 };
+int Sn[RSM_NS] = { 0, 0, 0, 0, 0 };
+
+
+  // stage MR data and validity of the block + halo
+  if (tiled){
+    for (k=threadIdx.y*blockDim.x+threadIdx.x; k<tn; k+=blockDim.x*blockDim.y){
+      ni = i0 + k/tw;
+      nj = j0 + k%tw;
+      if (ni < 0 || nj < 0 || ni >= ny || nj >= nx){ vtile[k] = 0; continue;}
+      np = (size_t)ni*nx+nj;
+      for (b=0; b<nb_m; b++) tile[b*tn+k] = mr[b*nc+np];
+      vtile[k] = valid[np];
+    }
+    __syncthreads();
+  }
+
+  if (i >= ny || j >= nx) return;
+
+  if (tiled){
+    M = tile;  V = vtile; bs = tn; vw = tw; oi = i0; oj = j0;
+  } else {
+    M = mr;    V = valid; bs = nc; vw = nx; oi = 0;  oj = 0;
+  }
+
+  ci = (i-oi)*vw + (j-oj);
+
+  // if nodata or cloud/shadow: skip
+  if (!V[ci]) return;
+
+  for (s=0; s<RSM_NS; s++){ Srange[0][s] = INT_MAX; Srange[1][s] = INT_MIN;}
+  for (f=0; f<nb_c; f++) weightxdata[f] = 0.0;
+
+  ni0 = max(i-h, 0); ni1 = min(i+h, ny-1);
+  nj0 = max(j-h, 0); nj1 = min(j+h, nx-1);
+
+
+  // first pass: range of S
+  for (ni=ni0; ni<=ni1; ni++){
+  for (nj=nj0; nj<=nj1; nj++){
+
+    if (kdist[(ni-i+h)*(2*h+1) + (nj-j+h)] > h) continue;
+
+    idx = (ni-oi)*vw + (nj-oj);
+    if (!V[idx]) continue;
+
+    for (b=0, sum=0; b<nb_m; b++) sum += fabs(((float)(M[b*bs+ci]-M[b*bs+idx]))/10000.0);
+    S = sum/(float)nb_m;
+
+    for (s=0, Sc=-1; s<RSM_NS; s++){
+      if (S < Sthr[s]){ Sc = s; break;}
+    }
+    if (Sc < 0) continue;
+
+    if (S > 0){
+      for (s=Sc; s<RSM_NS; s++){
+        if (S > Srange[1][s]) Srange[1][s] = S;
+        if (S < Srange[0][s]) Srange[0][s] = S;
+      }
+    }
+
+    wn++;
+    for (s=Sc; s<RSM_NS; s++) Sn[s]++;
+
+  }
+  }
+
+  np = (size_t)i*nx+j;
+
+  // if no valid neighbour, use CR
+  if (wn == 0){
+    for (f=0; f<nb_c; f++) pred[f*nc+np] = cr[f*nc+np];
+    return;
+  }
+
+  for (s=0, Sc=-1; s<RSM_NS; s++){
+    if (Sn[s] >= mink){ Sc = s; break;}
+  }
+  if (Sc < 0) Sc = RSM_NS-1;
+
+
+  // second pass: weighted mean
+  for (ni=ni0; ni<=ni1; ni++){
+  for (nj=nj0; nj<=nj1; nj++){
+
+    if (kdist[(ni-i+h)*(2*h+1) + (nj-j+h)] > h) continue;
+
+    idx = (ni-oi)*vw + (nj-oj);
+    if (!V[idx]) continue;
+
+    for (b=0, sum=0; b<nb_m; b++) sum += fabs(((float)(M[b*bs+ci]-M[b*bs+idx]))/10000.0);
+    S = sum/(float)nb_m;
+
+    if (S >= Sthr[Sc]) continue;
+
+    np = (size_t)ni*nx+nj;
+
+    SS = rescale_weight_ll_device(S, Srange[0][Sc], Srange[1][Sc]);
+
+    W = 1/SS;
+    for (f=0; f<nb_c; f++) weightxdata[f] += W*(double)(((float)cr[f*nc+np])/10000.0);
+    weight += W;
+
+  }
+  }
+
+  np = (size_t)i*nx+j;
+
+  for (f=0; f<nb_c; f++) pred[f*nc+np] = (short)((weightxdata[f]/weight)*10000);
+
+  return;
+}
+
+#endif
+
+
+/** public functions
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+
+
+/** This function predicts the Sentinel-2 20m bands of a complete image on
++++ the GPU, see improphe in resmerge-ll.c. Invalid pixels are left un-
++++ touched in pred_.
+--- toa_:      TOA reflectance
+--- valid_:    validity of pixels (not nodata, cloud or shadow)
+--- pred_:     prediction
+--- KDIST:     kernel distance
+--- nx:        number of columns
+--- ny:        number of rows
+--- h:         prediction radius
+--- nb_m:      number of bands in MR data
+--- nb_c:      number of bands in CR data
+--- bands_m:   MR bands to use
+--- bands_c:   CR bands to predict
+--- mink:      minimum number of pixels for good prediction
++++ Return:    SUCCESS/FAILURE/CANCEL
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+int improphe_ll_gpu(short **toa_, small *valid_, short **pred_, float **KDIST, int nx, int ny, int h, int nb_m, int nb_c, int *bands_m, int *bands_c, int mink){
+#ifdef FORCE_CUDA
+gpu_stream_t stream = NULL;
+cudaStream_t s;
+short *mr = NULL, *cr = NULL, *pred = NULL;
+float *kdist = NULL, *kdist_ = NULL;
+small *valid = NULL;
+int b, k, width = 2*h+1, block = RSM_GPU_BLOCK, tiled = true;
+size_t nc = (size_t)nx*ny, bytes_s, bytes_v, bytes_k, shared = 0;
+int error = 0;
+
+
+  if (nb_c > RSM_GPU_MAXB) return CANCEL;
+
+  stream = claim_gpu_stream();
+  s = (cudaStream_t)gpu_cuda_stream(stream);
+
+  if (!gpu_enabled() || gpu_select(stream) == FAILURE) return CANCEL;
+
+  // largest block whose tile fits into shared memory
+  while (block >= 8){
+    shared = (size_t)(block+2*h)*(block+2*h)*(nb_m*sizeof(short)+sizeof(small));
+    if (shared <= RSM_GPU_SHARED) break;
+    block /= 2;
+  }
+  if (block < 8){
+    block  = RSM_GPU_BLOCK;
+    shared = 0;
+    tiled  = false;
+  }
+
+  bytes_s = nc*sizeof(short);
+  bytes_v = nc*sizeof(small);
+  bytes_k = (size_t)width*width*sizeof(float);
+
+  if ((mr    = (short*)gpu_alloc(bytes_s*nb_m, stream)) == NULL) error++;
+  if ((cr    = (short*)gpu_alloc(bytes_s*nb_c, stream)) == NULL) error++;
+  if ((pred  = (short*)gpu_alloc(bytes_s*nb_c, stream)) == NULL) error++;
+  if ((valid = (small*)gpu_alloc(bytes_v,      stream)) == NULL) error++;
+  if ((kdist = (float*)gpu_alloc(bytes_k,      stream)) == NULL) error++;
+
+  alloc((void**)&kdist_, width*width, sizeof(float));
+  for (k=0; k<width; k++) memcpy(kdist_+k*width, KDIST[k], width*sizeof(float));
+
+
+  if (!error){
+
+    for (b=0; b<nb_m; b++) cudaMemcpyAsync(mr+b*nc, toa_[bands_m[b]], bytes_s, cudaMemcpyHostToDevice, s);
+    for (b=0; b<nb_c; b++){
+      cudaMemcpyAsync(cr+b*nc,   toa_[bands_c[b]], bytes_s, cudaMemcpyHostToDevice, s);
+      cudaMemcpyAsync(pred+b*nc, pred_[b],         bytes_s, cudaMemcpyHostToDevice, s);
+    }
+    cudaMemcpyAsync(valid, valid_, bytes_v, cudaMemcpyHostToDevice, s);
+    cudaMemcpyAsync(kdist, kdist_, bytes_k, cudaMemcpyHostToDevice, s);
+
+    dim3 threads(block, block);
+    dim3 blocks((nx+block-1)/block, (ny+block-1)/block);
+
+    improphe_ll_kernel<<<blocks, threads, shared, s>>>(mr, cr, valid, 
+      kdist, pred, nx, ny, h, nb_m, nb_c, mink, tiled);
+
+    for (b=0; b<nb_c; b++) cudaMemcpyAsync(pred_[b], pred+b*nc, bytes_s, cudaMemcpyDeviceToHost, s);
+
+    if (cudaGetLastError() != cudaSuccess){
+      printf("launching ImproPhe kernel failed. ");
+      error++;
+    }
+
+  }
+
+  if (gpu_sync(stream) == FAILURE) error++;
+
+  gpu_release(mr,    bytes_s*nb_m, stream);
+  gpu_release(cr,    bytes_s*nb_c, stream);
+  gpu_release(pred,  bytes_s*nb_c, stream);
+  gpu_release(valid, bytes_v,      stream);
+  gpu_release(kdist, bytes_k,      stream);
+
+  free((void*)kdist_);
+
+  if (error > 0) return FAILURE;
+
+  return SUCCESS;
+
+#else
+
+  return CANCEL;
+
+#endif
+}
+
@@ -575,12 +575,26 @@ int Sn[5];  // number of neighbours for each cutoff-threshold
 int ns = 5, Sc, *Sclass;             // index for cutoff-threshold
 
 short **pred_ = NULL;
+small *valid_ = NULL;
 
 
 
   alloc_2D((void***)&pred_, nb_c, nx*ny, sizeof(short));
+  alloc((void**)&valid_, nx*ny, sizeof(small));
+
+  // validity of pixels, evaluated once instead of for every neighbour
+  #pragma omp parallel for shared(nx, ny, valid_, QAI) default(none)
+  for (p=0; p<nx*ny; p++){
+    valid_[p] = !(get_off(QAI, p) || get_cloud(QAI, p) > 0 || get_shadow(QAI, p));
+  }
+
+  // use the GPU if available, fall back to the CPU otherwise
+  if (improphe_ll_gpu(toa_, valid_, pred_, KDIST, nx, ny, h, nb_m, nb_c, bands_m, bands_c, mink) == SUCCESS){
+    free((void*)valid_);
+    return pred_;
+  }
   
-  #pragma omp parallel private(b, f, s, k, j, p, ii, jj, ni, nj, np, ki, kj, sum, S, SS, W, Sc, Sclass, Srecord, weightxdata, Crecord, Sn, Srange, weight, wn) shared(nx, ny, h, ns, nb_m, nb_c, bands_m, bands_c, nk, mink, Sthr, pred_, toa_, KDIST, QAI) default(none)
+  #pragma omp parallel private(b, f, s, k, j, p, ii, jj, ni, nj, np, ki, kj, sum, S, SS, W, Sc, Sclass, Srecord, weightxdata, Crecord, Sn, Srange, weight, wn) shared(nx, ny, h, ns, nb_m, nb_c, bands_m, bands_c, nk, mink, Sthr, pred_, toa_, KDIST, valid_) default(none)
   {
 
     alloc((void**)&Sclass, nk, sizeof(int));
@@ -595,7 +609,7 @@ short **pred_ = NULL;
       p = i*nx+j;
 
       // if nodata or cloud/shadow: skip
-      if (get_off(QAI, p) || get_cloud(QAI, p) > 0 || get_shadow(QAI, p)) continue;
+      if (!valid_[p]) continue;
 
 
       // initialize arrays
@@ -621,7 +635,7 @@ short **pred_ = NULL;
         if (KDIST[ki][kj] > h) continue;
 
         // if nodata, skip
-        if (get_off(QAI, np) || get_cloud(QAI, np) > 0 || get_shadow(QAI, np)) continue;
+        if (!valid_[np]) continue;
 
         // specral distance (MAE)
         for (b=0, sum=0; b<nb_m; b++) sum += fabs(((float)(toa_[bands_m[b]][p]-toa_[bands_m[b]][np]))/10000.0);
@@ -692,6 +706,8 @@ short **pred_ = NULL;
     
   }
 
+  free((void*)valid_);
+
   return pred_;
 }
 
@@ -37,6 +37,7 @@ Enhance spatial resolution header
 #include "../cross-level/brick-cl.h"
 #include "../cross-level/imagefuns-cl.h"
 #include "../cross-level/cite-cl.h"
+#include "../lower-level/resmerge-gpu-ll.h"
 
 
 #ifdef __cplusplus
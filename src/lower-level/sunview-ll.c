@@ -131,7 +131,10 @@ float szen, sazi;
 
 
 /** Compute sun positions and view geometry
-+++ This function computes sun positions (+cos/sin/tan), and view angles
++++ This function computes sun positions (+cos/sin/tan), and view angles.
++++ The geographic coordinates of the coarse grid are reprojected in one
++++ go; then the grid is processed row by row in parallel, and the sun 
++++ positions of each row are computed in one batch.
 --- pl2:    L2 parameters
 --- meta:   metadata
 --- mission: mission ID
@@ -140,10 +143,14 @@ float szen, sazi;
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int sun_target_view(par_ll_t *pl2, meta_t *meta, int mission, atc_t *atc, brick_t *QAI){
-double lat, lon;
+double *lat = NULL, *lon = NULL;
+float *lat_ = NULL, *lon_ = NULL;
+float *zen_ = NULL, *azi_ = NULL;
 float zen, azi;
 int e, f, g, p;
-int ne, nf, nc;
+int ne, nf, ng, nc;
+int error = 0;
+date_t date;
 float *xy_szen = NULL;
 
 
@@ -154,6 +161,7 @@ float *xy_szen = NULL;
 
   nf  = get_brick_ncols(atc->xy_sun);
   ne  = get_brick_nrows(atc->xy_sun);
+  ng  = get_brick_ncells(atc->xy_sun);
   nc  = get_brick_ncells(QAI);
 
   // average satellite height (m)
@@ -171,34 +179,68 @@ float *xy_szen = NULL;
   }
 
 
-  for (e=0, g=0; e<ne; e++){
-  for (f=0; f<nf; f++, g++){
+  // geo coordinates of the coarse grid
+  alloc((void**)&lat, ng, sizeof(double));
+  alloc((void**)&lon, ng, sizeof(double));
 
-    // geo coordinate
-    get_brick_geo(atc->xy_sun, f, e, &lon, &lat);
+  if (get_brick_geo_grid(atc->xy_sun, lon, lat) == FAILURE){
+    printf("error in geo coordinates. "); 
+    free((void*)lat); free((void*)lon);
+    return FAILURE;}
 
-    // calculate sun angles
-    sunpos(lat, lon, get_brick_date(atc->xy_sun, 0), &zen, &azi);
+  date = get_brick_date(atc->xy_sun, 0);
 
-    // degree to radians
-    zen *= _D2R_CONV_;
-    azi *= _D2R_CONV_;
+  #pragma omp parallel private(f, g, zen, azi, lat_, lon_, zen_, azi_) shared(ne, nf, lat, lon, date, meta, mission, atc, QAI) reduction(+: error) default(none)
+  {
 
-    set_brick(atc->xy_sun,  ZEN, g, zen);
-    set_brick(atc->xy_sun,  AZI, g, azi);
-    set_brick(atc->xy_sun, cZEN, g, cos(zen));
-    set_brick(atc->xy_sun, cAZI, g, cos(azi));
-    set_brick(atc->xy_sun, sZEN, g, sin(zen));
-    set_brick(atc->xy_sun, sAZI, g, sin(azi));
-    set_brick(atc->xy_sun, tZEN, g, tan(zen));
-    set_brick(atc->xy_sun, tAZI, g, tan(azi));
+    alloc((void**)&lat_, nf, sizeof(float));
+    alloc((void**)&lon_, nf, sizeof(float));
+    alloc((void**)&zen_, nf, sizeof(float));
+    alloc((void**)&azi_, nf, sizeof(float));
 
-    // satellite view geometry
-    if (view_angle(meta, mission, atc, QAI, f, e, g) == FAILURE){
-      printf("error in view geometry. "); return FAILURE;}
+    #pragma omp for schedule(guided)
+    for (e=0; e<ne; e++){
+
+      // geo coordinates of this row
+      for (f=0, g=e*nf; f<nf; f++, g++){
+        lat_[f] = lat[g];
+        lon_[f] = lon[g];
+      }
+
+      // calculate sun angles
+      sunpos_row(lat_, lon_, nf, date, zen_, azi_);
+
+      for (f=0, g=e*nf; f<nf; f++, g++){
+
+        // degree to radians
+        zen = zen_[f]*_D2R_CONV_;
+        azi = azi_[f]*_D2R_CONV_;
+
+        set_brick(atc->xy_sun,  ZEN, g, zen);
+        set_brick(atc->xy_sun,  AZI, g, azi);
+        set_brick(atc->xy_sun, cZEN, g, cos(zen));
+        set_brick(atc->xy_sun, cAZI, g, cos(azi));
+        set_brick(atc->xy_sun, sZEN, g, sin(zen));
+        set_brick(atc->xy_sun, sAZI, g, sin(azi));
+        set_brick(atc->xy_sun, tZEN, g, tan(zen));
+        set_brick(atc->xy_sun, tAZI, g, tan(azi));
+
+        // satellite view geometry
+        if (view_angle(meta, mission, atc, QAI, f, e, g) == FAILURE) error++;
+
+      }
+
+    }
+
+    free((void*)lat_); free((void*)lon_);
+    free((void*)zen_); free((void*)azi_);
 
   }
-  }
+
+  free((void*)lat); free((void*)lon);
+
+  if (error > 0){
+    printf("error in view geometry. "); return FAILURE;}
 
   // min/max of cos(szen) & cos(vzen)
   get_brick_range(atc->xy_sun,  cZEN, &atc->cosszen[0], &atc->cosszen[1]);
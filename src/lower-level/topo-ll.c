@@ -27,14 +27,26 @@ This file contains functions for handling topographic effects
 
 #include "topo-ll.h"
 
+#include <stddef.h>  // standard type definitions
+#include <unistd.h>  // standard symbolic constants and types 
+
+
+// warped DEMs of previous images
+dem_cache_t _DEMCACHE_[TOPO_CACHE];
+long _DEMCACHE_USE_ = 0;
+
 
 top_t *allocate_topography();
 int init_topography(top_t *top);
 int ocean_topography(brick_t *DEM);
 int smooth_topography(brick_t *DEM);
 int exposition_topography(brick_t *DEM, brick_t *EXP, brick_t *QAI);
-int stats_topography(atc_t *atc, brick_t *DEM, brick_t *CDEM, brick_t *QAI);
-int illumination_topography(atc_t *atc, brick_t *EXP, brick_t *ILL, brick_t *SKY, brick_t *QAI);
+int stats_topography(atc_t *atc, brick_t *DEM, brick_t *QAI);
+int illumination_topography(atc_t *atc, brick_t *DEM, brick_t *CDEM, brick_t *EXP, brick_t *ILL, brick_t *SKY, brick_t *QAI);
+void key_dem_cache(par_ll_t *pl2, brick_t *DEM, dem_cache_t *key);
+void file_dem_cache(par_ll_t *pl2, dem_cache_t *key, char fname[], int size);
+bool read_dem_cache(par_ll_t *pl2, brick_t *DEM);
+void write_dem_cache(par_ll_t *pl2, brick_t *DEM);
 
 
 /** This function allocates the topographic variables
@@ -73,7 +85,7 @@ int init_topography(top_t *top){
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int ocean_topography(brick_t *DEM){
-int i, j, ii, jj, p, np, nx, ny;
+int i, j, ii, jj, j0, j1, p, np, nx, ny;
 float *dem_ = NULL;
 float nodata;
 
@@ -88,59 +100,47 @@ float nodata;
   nodata = get_brick_nodata(DEM, 0);
   if ((dem_ = get_band_float(DEM, 0)) == NULL) return FAILURE;
 
-  #pragma omp parallel private(i, ii, p, np) shared(nx, ny, dem_, nodata) default(none) 
+  #pragma omp parallel private(i, j, ii, jj, j0, j1, p, np) shared(nx, ny, dem_, nodata) default(none) 
   {
 
+    // vertical sweeps (down, then up), a block of columns per thread
     #pragma omp for schedule(static)
-    for (j=0; j<nx; j++){
-    for (i=0, ii=1; ii<ny; i++, ii++){
-      p = i*nx+j; np = ii*nx+j;
-      if (fequal(dem_[p], 0) && fequal(dem_[np], nodata)) dem_[np] = 0.0;
-    }
-    }
+    for (j0=0; j0<nx; j0+=TOPO_LANES){
 
-  }
-  
+      j1 = (j0+TOPO_LANES < nx) ? j0+TOPO_LANES : nx;
 
-  #pragma omp parallel private(i, ii, p, np) shared(nx, ny, dem_, nodata) default(none) 
-  {
+      for (i=0, ii=1; ii<ny; i++, ii++){
+      for (j=j0; j<j1; j++){
+        p = i*nx+j; np = ii*nx+j;
+        if (fequal(dem_[p], 0) && fequal(dem_[np], nodata)) dem_[np] = 0.0;
+      }
+      }
 
-    #pragma omp for schedule(static)
-    for (j=0; j<nx; j++){
-    for (i=(ny-1), ii=(ny-2); ii>=0; i--, ii--){
-      p = i*nx+j; np = ii*nx+j;
-      if (fequal(dem_[p], 0) && fequal(dem_[np], nodata)) dem_[np] = 0.0;
-    }
-    }
-  
-  }
+      for (i=(ny-1), ii=(ny-2); ii>=0; i--, ii--){
+      for (j=j0; j<j1; j++){
+        p = i*nx+j; np = ii*nx+j;
+        if (fequal(dem_[p], 0) && fequal(dem_[np], nodata)) dem_[np] = 0.0;
+      }
+      }
 
-  
-  #pragma omp parallel private(j, jj, p, np) shared(nx, ny, dem_, nodata) default(none) 
-  {
+    }
 
+    // horizontal sweeps (left, then right)
     #pragma omp for schedule(static)
     for (i=0; i<ny; i++){
-    for (j=0, jj=1; jj<nx; j++, jj++){
-      p = i*nx+j; np = i*nx+jj;
-      if (fequal(dem_[p], 0) && fequal(dem_[np], nodata)) dem_[np] = 0.0;
-    }
-    }
-  
-  }
 
-  
-  #pragma omp parallel private(j, jj, p, np) shared(nx, ny, dem_, nodata) default(none) 
-  {
+      for (j=0, jj=1; jj<nx; j++, jj++){
+        p = i*nx+j; np = i*nx+jj;
+        if (fequal(dem_[p], 0) && fequal(dem_[np], nodata)) dem_[np] = 0.0;
+      }
+
+      for (j=(nx-1), jj=(nx-2); jj>=0; j--, jj--){
+        p = i*nx+j; np = i*nx+jj;
+        if (fequal(dem_[p], 0) && fequal(dem_[np], nodata)) dem_[np] = 0.0;
+      }
 
-    #pragma omp for schedule(static)
-    for (i=0; i<ny; i++){
-    for (j=(nx-1), jj=(nx-2); jj>=0; j--, jj--){
-      p = i*nx+j; np = i*nx+jj;
-      if (fequal(dem_[p], 0) && fequal(dem_[np], nodata)) dem_[np] = 0.0;
-    }
     }
-    
+
   }
 
 
@@ -159,7 +159,7 @@ float nodata;
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 int smooth_topography(brick_t *DEM){
 int i, j, ii, jj, ni, nj, p, np, nx, ny, nc, k;
-float *buf = NULL;
+float *buf = NULL, *hsum = NULL, *hnum = NULL;
 float sum, num;
 float res;
 float *dem_ = NULL;
@@ -187,12 +187,42 @@ float nodata;
 
   k = 30/res;
 
-  alloc((void**)&buf, nc, sizeof(float));
+  alloc((void**)&buf,  nc, sizeof(float));
+  alloc((void**)&hsum, nc, sizeof(float));
+  alloc((void**)&hnum, nc, sizeof(float));
 
-  #pragma omp parallel private(j, p, ii, jj, ni, nj, np, sum, num) shared(nx, ny, k, dem_, buf, nodata) default(none) 
+  #pragma omp parallel private(j, p, ii, jj, ni, nj, np, sum, num) shared(nx, ny, k, dem_, buf, hsum, hnum, nodata) default(none) 
   {
 
-    #pragma omp for schedule(guided)
+    // the box filter is separable: horizontal sums of valid pixels first
+    #pragma omp for schedule(static)
+    for (i=0; i<ny; i++){
+    for (j=0; j<nx; j++){
+
+      sum = num = 0;
+
+      for (jj=-1*k; jj<=k; jj++){
+
+        nj = j+jj;
+        if (nj > nx-1 || nj < 0) continue;
+
+        np = i*nx+nj;
+        if (fequal(dem_[np], nodata)) continue;
+
+        sum += dem_[np];
+        num++;
+
+      }
+
+      p = i*nx+j;
+      hsum[p] = sum;
+      hnum[p] = num;
+
+    }
+    }
+
+    // then vertical sums of the horizontal sums
+    #pragma omp for schedule(static)
     for (i=0; i<ny; i++){
     for (j=0; j<nx; j++){
 
@@ -205,19 +235,15 @@ float nodata;
       sum = num = 0;
 
       for (ii=-1*k; ii<=k; ii++){
-      for (jj=-1*k; jj<=k; jj++){
-
-        ni = i+ii; nj = j+jj;
-        if (ni > ny-1 || ni < 0 || nj > nx-1 || nj < 0) continue;
 
-        np = ni*nx+nj;
-        if (fequal(dem_[np], nodata)) continue;
+        ni = i+ii;
+        if (ni > ny-1 || ni < 0) continue;
 
-        sum += dem_[np];
-        num++;
+        np = ni*nx+j;
+        sum += hsum[np];
+        num += hnum[np];
 
       }
-      }
 
       if (num > 0) buf[p] = sum/num;
 
@@ -228,6 +254,8 @@ float nodata;
   
   memmove(dem_, buf, nc*sizeof(float));
   free((void*)buf);
+  free((void*)hsum);
+  free((void*)hnum);
   
   
   #ifdef FORCE_CLOCK
@@ -336,7 +364,9 @@ bool valid;
   }
 
 
-  #pragma omp parallel shared(nx, nc, QAI, slp_, asp_) default(none) 
+  // image edges: copy from the inner neighbour, in the order left, 
+  // right, top, bottom (the barriers between the loops keep the order)
+  #pragma omp parallel shared(nx, ny, nc, QAI, slp_, asp_) default(none) 
   {
 
     #pragma omp for schedule(static)
@@ -351,12 +381,6 @@ bool valid;
         asp_[p] = asp_[p+1];
       }
     }
-    
-  }
-  
-  
-  #pragma omp parallel shared(nx, nc, QAI, slp_, asp_) default(none) 
-  {
 
     #pragma omp for schedule(static)
     for (p=nx-1; p<nc; p+=nx){
@@ -370,12 +394,6 @@ bool valid;
         asp_[p] = asp_[p-1];
       }
     }
-    
-  }
-  
-  
-  #pragma omp parallel shared(nx, QAI, slp_, asp_) default(none) 
-  {
 
     #pragma omp for schedule(static)
     for (p=0; p<nx; p++){
@@ -389,12 +407,6 @@ bool valid;
         asp_[p] = asp_[p+nx];
       }
     }
-    
-  }
-  
-  
-  #pragma omp parallel shared(nx, ny, nc, QAI, slp_, asp_) default(none) 
-  {
 
     #pragma omp for schedule(static)
     for (p=(ny-1)*nx; p<nc; p++){
@@ -420,20 +432,18 @@ bool valid;
 }
 
 
-/** This function computes elevation statistics (in km) and computes the
-+++ binned DEM (100m classes)
+/** This function computes elevation statistics (in km) and the class
++++ width of the binned DEM
 --- atc:    atmospheric correction factors
 --- DEM:    Digital Elevation Model
---- CDEM:   Binned Digital Elevation Model
 --- QAI:    Quality Assurance Information
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int stats_topography(atc_t *atc, brick_t *DEM, brick_t *CDEM, brick_t *QAI){
+int stats_topography(atc_t *atc, brick_t *DEM, brick_t *QAI){
 int p, nc;
 float dem, mn = SHRT_MAX, mx = SHRT_MIN;
 double sum = 0, num = 0;
 float  *dem_  = NULL;
-small  *cdem_ = NULL;
 
 
   #ifdef FORCE_CLOCK
@@ -443,7 +453,6 @@ small  *cdem_ = NULL;
 
   nc = get_brick_ncells(DEM);
   if ((dem_ = get_band_float(DEM, 0)) == NULL) return FAILURE;
-  if ((cdem_ = get_band_small(CDEM, 0)) == NULL) return FAILURE;
 
 
   #pragma omp parallel private(dem) shared(nc, QAI, dem_) reduction(+: sum, num) reduction(max: mx) reduction(min: mn) default(none) 
@@ -468,19 +477,6 @@ small  *cdem_ = NULL;
 
   atc->dem.cnum = NPOW_08 - 1;
   atc->dem.step = (atc->dem.max-atc->dem.min)/atc->dem.cnum;
-  
-  
-  #pragma omp parallel private(dem) shared(nc, QAI, dem_, cdem_, atc) default(none) 
-  {
-
-    #pragma omp for schedule(guided)
-    for (p=0; p<nc; p++){
-      if (get_off(QAI, p)) continue;
-      dem = dem_[p]/1000.0; // -> kilometer
-      cdem_[p] = (small)floor((dem-atc->dem.min)/atc->dem.step);
-    }
-
-  }
 
 
   if (atc->dem.min < -0.5 || atc->dem.max > 9){
@@ -503,18 +499,22 @@ small  *cdem_ = NULL;
 }
 
 
-/** This function computes the illumination angle and a simple sky view 
-+++ factor
+/** This function computes the binned DEM (see stats_topography), the 
++++ illumination angle and a simple sky view factor in one pass
 --- atc:    atmospheric correction factors
+--- DEM:    Digital Elevation Model
+--- CDEM:   Binned Digital Elevation Model
 --- EXP:    Exposition
 --- ILL:    Illumination angle
 --- SKY:    Sky view factor
 --- QAI:    Quality Assurance Information
 +++ Return: SUCCESS/FAILURE
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
-int illumination_topography(atc_t *atc, brick_t *EXP, brick_t *ILL, brick_t *SKY, brick_t *QAI){
+int illumination_topography(atc_t *atc, brick_t *DEM, brick_t *CDEM, brick_t *EXP, brick_t *ILL, brick_t *SKY, brick_t *QAI){
 int p, g, nc;
-float slp, asp;
+float dem, slp, asp;
+float  *dem_  = NULL;
+small  *cdem_ = NULL;
 ushort *slp_ = NULL;
 ushort *asp_ = NULL;
 short  *ill_ = NULL;
@@ -528,6 +528,8 @@ float **sun_ = NULL;
 
 
   nc = get_brick_ncells(EXP);
+  if ((dem_ = get_band_float(DEM, 0)) == NULL) return FAILURE;
+  if ((cdem_ = get_band_small(CDEM, 0)) == NULL) return FAILURE;
   if ((slp_ = get_band_ushort(EXP, ZEN)) == NULL) return FAILURE;
   if ((asp_ = get_band_ushort(EXP, AZI)) == NULL) return FAILURE;
   if ((ill_ = get_band_short(ILL, 0)) == NULL) return FAILURE;
@@ -535,7 +537,7 @@ float **sun_ = NULL;
   if ((sun_ = get_bands_float(atc->xy_sun)) == NULL) return FAILURE;
 
 
-  #pragma omp parallel private(g, slp, asp) shared(nc, QAI, slp_, asp_, ill_, sky_, sun_, atc) default(none) 
+  #pragma omp parallel private(g, dem, slp, asp) shared(nc, QAI, dem_, cdem_, slp_, asp_, ill_, sky_, sun_, atc) default(none) 
   {
 
     #pragma omp for schedule(guided)
@@ -543,6 +545,10 @@ float **sun_ = NULL;
 
       if (get_off(QAI, p)){ ill_[p] = -10000; continue;}
 
+      // binned DEM
+      dem = dem_[p]/1000.0; // -> kilometer
+      cdem_[p] = (small)floor((dem-atc->dem.min)/atc->dem.step);
+
       g = convert_brick_p2p(QAI, atc->xy_sun, p);
 
       slp = slp_[p]/10000.0;
@@ -581,6 +587,151 @@ float **sun_ = NULL;
 }
 
 
+/** This function compiles the key of the DEM cache, i.e. the DEM file
++++ and the target grid
+--- pl2:    L2 parameters
+--- DEM:    Digital Elevation Model (target grid)
+--- key:    cache key (returned)
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void key_dem_cache(par_ll_t *pl2, brick_t *DEM, dem_cache_t *key){
+
+
+  memset(key, 0, sizeof(dem_cache_t));
+  copy_string(key->fdem, NPOW_10, pl2->fdem);
+  get_brick_proj(DEM, key->proj, NPOW_10);
+  get_brick_geotran(DEM, key->geotran, 6);
+  key->nx = get_brick_ncols(DEM);
+  key->ny = get_brick_nrows(DEM);
+  key->nodata = pl2->dem_nodata;
+
+  return;
+}
+
+
+/** This function compiles the filename of a DEM in the on-disc cache. The
++++ filename is a hash of the cache key.
+--- pl2:    L2 parameters
+--- key:    cache key
+--- fname:  filename (returned)
+--- size:   length of filename buffer
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void file_dem_cache(par_ll_t *pl2, dem_cache_t *key, char fname[], int size){
+unsigned long hash = 14695981039346656037UL;
+unsigned char *byte = (unsigned char*)key;
+size_t i, n = offsetof(dem_cache_t, dem);
+int nchar;
+
+
+  for (i=0; i<n; i++) hash = (hash ^ byte[i]) * 1099511628211UL;
+
+  nchar = snprintf(fname, size, "%s/DEM-%016lx.dat", pl2->d_demcache, hash);
+  if (nchar < 0 || nchar >= size){ 
+    printf("Buffer Overflow in assembling filename\n"); fname[0] = '\0';}
+
+  return;
+}
+
+
+/** This function retrieves a warped and smoothed DEM from the cache. The
++++ in-memory cache is searched first, then the on-disc cache (if given).
++++ The on-disc file starts with the cache key, which must match.
+--- pl2:    L2 parameters
+--- DEM:    Digital Elevation Model (filled if found)
++++ Return: true if found, false if not
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+bool read_dem_cache(par_ll_t *pl2, brick_t *DEM){
+dem_cache_t key, file_key;
+char fname[NPOW_10];
+float *dem_ = NULL;
+size_t n = offsetof(dem_cache_t, dem);
+FILE *fp = NULL;
+int k, nc;
+bool found = false;
+
+
+  key_dem_cache(pl2, DEM, &key);
+  nc = key.nx*key.ny;
+  if ((dem_ = get_band_float(DEM, 0)) == NULL) return false;
+
+  for (k=0; k<TOPO_CACHE; k++){
+    if (_DEMCACHE_[k].dem != NULL && memcmp(&_DEMCACHE_[k], &key, n) == 0){
+      memcpy(dem_, _DEMCACHE_[k].dem, nc*sizeof(float));
+      _DEMCACHE_[k].used = ++_DEMCACHE_USE_;
+      return true;
+    }
+  }
+
+  if (strcmp(pl2->d_demcache, "NULL") == 0) return false;
+
+  file_dem_cache(pl2, &key, fname, NPOW_10);
+  if ((fp = fopen(fname, "rb")) == NULL) return false;
+
+  memset(&file_key, 0, sizeof(dem_cache_t));
+  if (fread(&file_key, 1, n, fp) == n && memcmp(&file_key, &key, n) == 0 &&
+      fread(dem_, sizeof(float), nc, fp) == (size_t)nc) found = true;
+
+  fclose(fp);
+
+  return found;
+}
+
+
+/** This function stores a warped and smoothed DEM in the cache. In memory,
++++ the least recently used DEM is replaced. On disc (if given), the file
++++ is written to a temporary name first, and then renamed, such that con-
++++ current processes never read incomplete files.
+--- pl2:    L2 parameters
+--- DEM:    Digital Elevation Model
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void write_dem_cache(par_ll_t *pl2, brick_t *DEM){
+dem_cache_t key;
+char fname[NPOW_10];
+char ftemp[NPOW_10];
+float *dem_ = NULL;
+size_t n = offsetof(dem_cache_t, dem);
+FILE *fp = NULL;
+int k, kmin = 0, nc, nchar;
+
+
+  key_dem_cache(pl2, DEM, &key);
+  nc = key.nx*key.ny;
+  if ((dem_ = get_band_float(DEM, 0)) == NULL) return;
+
+  for (k=1; k<TOPO_CACHE; k++){
+    if (_DEMCACHE_[k].used < _DEMCACHE_[kmin].used) kmin = k;
+  }
+
+  if (_DEMCACHE_[kmin].dem != NULL) free((void*)_DEMCACHE_[kmin].dem);
+  key.used = ++_DEMCACHE_USE_;
+  alloc((void**)&key.dem, nc, sizeof(float));
+  memcpy(key.dem, dem_, nc*sizeof(float));
+  memcpy(&_DEMCACHE_[kmin], &key, sizeof(dem_cache_t));
+
+  if (strcmp(pl2->d_demcache, "NULL") == 0) return;
+
+  file_dem_cache(pl2, &key, fname, NPOW_10);
+
+  nchar = snprintf(ftemp, NPOW_10, "%s.%d", fname, (int)getpid());
+  if (nchar < 0 || nchar >= NPOW_10){ 
+    printf("Buffer Overflow in assembling filename\n"); return;}
+
+  if ((fp = fopen(ftemp, "wb")) == NULL) return;
+
+  if (fwrite(&key, 1, n, fp) != n ||
+      fwrite(dem_, sizeof(float), nc, fp) != (size_t)nc){
+    fclose(fp); remove(ftemp); return;}
+
+  fclose(fp);
+
+  if (rename(ftemp, fname) != 0) remove(ftemp);
+
+  return;
+}
+
+
 /** public functions
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
 
@@ -605,9 +756,25 @@ void free_topography(top_t *top){
 }
 
 
+/** This function frees the DEM cache
++++ Return: void
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++**/
+void free_dem_cache(){
+int k;
+
+  for (k=0; k<TOPO_CACHE; k++){
+    if (_DEMCACHE_[k].dem != NULL) free((void*)_DEMCACHE_[k].dem);
+    _DEMCACHE_[k].dem = NULL;
+  }
+
+  return;
+}
+
+
 /** This function compiles the basic set of topographic derivatives. This 
 +++ includes reprojecting the DEM to the image extent/projection and com-
-+++ puting slope and aspect
++++ puting slope and aspect. The reprojected DEM is cached, and reused by
++++ images on the same grid (e.g. the same MGRS tile)
 --- pl2:        L2 parameters
 --- atc:        atmospheric correction factors
 --- topography: topographic variables
@@ -635,21 +802,27 @@ brick_t *DEM = NULL;
   set_brick_nodata(DEM, 0, pl2->dem_nodata);
 
 
-  // warp DEM to MEM or use flat DEM (z = 0m)
-  if (strcmp(pl2->fdem, "NULL") != 0){
-    if ((warp_from_disc_to_known_brick(1, pl2->nthread, pl2->fdem, DEM, 0, 0, pl2->dem_nodata)) != SUCCESS){
-      printf("Reprojecting of DEM failed! "); return FAILURE;}
-  }
+  if (!read_dem_cache(pl2, DEM)){
+
+    // warp DEM to MEM or use flat DEM (z = 0m)
+    if (strcmp(pl2->fdem, "NULL") != 0){
+      if ((warp_from_disc_to_known_brick(1, pl2->nthread, pl2->fdem, DEM, 0, 0, pl2->dem_nodata)) != SUCCESS){
+        printf("Reprojecting of DEM failed! "); return FAILURE;}
+    }
 
 
-  /** detect oceans and set to 0m a.s.l **/
-  if ((ocean_topography(DEM)) != SUCCESS){
-    printf("Compiling ocean DEM failed! "); return FAILURE;}
+    /** detect oceans and set to 0m a.s.l **/
+    if ((ocean_topography(DEM)) != SUCCESS){
+      printf("Compiling ocean DEM failed! "); return FAILURE;}
 
 
-  /** smooth DEM **/
-  if ((smooth_topography(DEM)) != SUCCESS){
-    printf("Smoothing of DEM failed! "); return FAILURE;}
+    /** smooth DEM **/
+    if ((smooth_topography(DEM)) != SUCCESS){
+      printf("Smoothing of DEM failed! "); return FAILURE;}
+
+    write_dem_cache(pl2, DEM);
+
+  }
 
 
   #ifdef FORCE_DEBUG
@@ -673,22 +846,18 @@ brick_t *DEM = NULL;
   #endif
 
   
-  /** calculate DEM stats + binned DEM **/
+  /** calculate DEM stats **/
+  if ((stats_topography(atc, DEM, QAI)) != SUCCESS){
+    printf("Elevation statistics failed! "); return FAILURE;}
+
+
+  /** binned DEM, illumination angle and sky view factor **/
   top->dem = copy_brick(DEM, 1, _DT_SMALL_);
   set_brick_name(top->dem, "FORCE binned DEM brick");
   set_brick_product(top->dem, "BEM");
   set_brick_filename(top->dem, "DEM-BINNED");
   set_brick_bandname(top->dem, 0, "binned DEM");
 
-  if ((stats_topography(atc, DEM, top->dem, QAI)) != SUCCESS){
-    printf("Elevation statistics failed! "); return FAILURE;}
-
-  #ifdef FORCE_DEBUG
-  print_brick_info(top->dem); set_brick_open(top->dem, OPEN_CREATE); write_brick(top->dem);
-  #endif
-
-
-  /** illumination angle and sky view factor **/
   top->ill = copy_brick(DEM, 1, _DT_SHORT_);
   set_brick_name(top->ill, "FORCE Illumination angle brick");
   set_brick_product(top->ill, "ILL");
@@ -701,13 +870,14 @@ brick_t *DEM = NULL;
   set_brick_filename(top->sky, "DEM-SKY-VIEW");
   set_brick_bandname(top->sky, 0, "Sky View Factor");
 
-  if (illumination_topography(atc, top->exp, top->ill, top->sky, QAI) != SUCCESS){
+  if (illumination_topography(atc, DEM, top->dem, top->exp, top->ill, top->sky, QAI) != SUCCESS){
     printf("error in topographic correction. "); return FAILURE;}
 
   free_brick(DEM);
 
 
   #ifdef FORCE_DEBUG
+  print_brick_info(top->dem); set_brick_open(top->dem, OPEN_CREATE); write_brick(top->dem);
   print_brick_info(top->ill); set_brick_open(top->ill, OPEN_CREATE); write_brick(top->ill);
   print_brick_info(top->sky); set_brick_open(top->sky, OPEN_CREATE); write_brick(top->sky);
   print_brick_info(QAI); set_brick_open(QAI, OPEN_CREATE); write_brick(QAI);
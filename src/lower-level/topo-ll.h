@@ -30,6 +30,8 @@ Topographic effects header
 
 #include <stdio.h>   // core input and output functions
 #include <stdlib.h>  // standard general utilities library
+#include <string.h>  // string handling functions
+#include <stdbool.h> // boolean data type
 
 #include "../cross-level/const-cl.h"
 #include "../cross-level/brick-cl.h"
@@ -53,7 +55,24 @@ typedef struct {
   brick_t *c;   // C-factor SWIR2
 } top_t;
 
+// number of warped DEMs that are kept in memory
+#define TOPO_CACHE 2
+
+// number of columns per thread in vertical DEM sweeps
+#define TOPO_LANES 64
+
+typedef struct {
+  char   fdem[NPOW_10];  // DEM file
+  char   proj[NPOW_10];  // projection of target grid
+  double geotran[6];     // geotransformation of target grid
+  int    nx, ny;         // dimensions of target grid
+  int    nodata;         // DEM nodata
+  float *dem;            // warped + smoothed DEM
+  long   used;           // last use (for replacement)
+} dem_cache_t;
+
 void free_topography(top_t *top);
+void free_dem_cache();
 int compile_topography(par_ll_t *pl2, atc_t *atc, top_t **topography, brick_t *QAI);
 brick_t *cfactor_topography(atc_t *atc, brick_t *TOA, brick_t *QAI, brick_t *DEM, brick_t *EXP, brick_t *ILL);
 int average_elevation_cell(int g, brick_t *CDEM, brick_t *FDEM, brick_t *QAI);